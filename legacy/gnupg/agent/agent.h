@@ -48,6 +48,9 @@
    this shouldn't be a problem in practice.  */
 #define MAX_PASSPHRASE_LEN 255
 
+/* The default time in milliseconds the S2K hashing should take.  */
+#define AGENT_S2K_CALIBRATION 100
+
 /* A large struct name "opt" to keep global flags */
 struct agent_options {
   unsigned int debug; /* Debug flags (DBG_foo_VALUE) */
@@ -105,6 +108,21 @@ struct agent_options {
      for signing operations.  */
   int ignore_cache_for_signing;
 
+  /* If this global option is true, unprotected private keys are kept
+     in secure memory for as long as their passphrase would be cached,
+     so that repeated operations skip reading and unprotecting the
+     key file.  */
+  int cache_unprotected_keys;
+
+  /* If this global option is true, the protection keys derived from
+     a passphrase are cached like the passphrase, so that unprotecting
+     a key again skips the S2K.  */
+  int cache_derived_keys;
+
+  /* The time in milliseconds the S2K hashing with the standard count
+     should take, or 0 for AGENT_S2K_CALIBRATION.  */
+  unsigned long s2k_calibration_time;
+
   /* If this global option is true, the user is allowed to
      interactively mark certificate in trustlist.txt as trusted. */
   int allow_mark_trusted;
@@ -291,6 +309,7 @@ gpg_error_t agent_public_key_from_file(ctrl_t ctrl, const unsigned char *grip,
 int agent_is_dsa_key(gcry_sexp_t s_key);
 int agent_is_eddsa_key(gcry_sexp_t s_key);
 int agent_key_available(const unsigned char *grip);
+gpg_error_t agent_list_key_grips(std::vector<std::string> &r_grips);
 gpg_error_t agent_key_info_from_file(ctrl_t ctrl, const unsigned char *grip,
                                      int *r_keytype,
                                      unsigned char **r_shadow_info);
@@ -327,6 +346,10 @@ int agent_put_cache(const char *key, cache_mode_t cache_mode, const char *data,
                     int ttl);
 char *agent_get_cache(const char *key, cache_mode_t cache_mode);
 void agent_store_cache_hit(const char *key);
+void agent_put_key_cache(const char *key, const unsigned char *keybuf,
+                         size_t keybuflen, int ttl);
+gcry_sexp_t agent_get_key_cache(const char *key);
+void agent_forget_key_cache(const char *key);
 
 /*-- pksign.c --*/
 int agent_pksign_do(ctrl_t ctrl, const char *cache_nonce, const char *desc_text,
@@ -335,6 +358,10 @@ int agent_pksign_do(ctrl_t ctrl, const char *cache_nonce, const char *desc_text,
                     size_t overridedatalen);
 int agent_pksign(ctrl_t ctrl, const char *cache_nonce, const char *desc_text,
                  membuf_t *outbuf, cache_mode_t cache_mode);
+int agent_pksign_batch(ctrl_t ctrl, const char *cache_nonce,
+                       const char *desc_text, const unsigned char *digests,
+                       size_t ndigests, membuf_t *outbuf,
+                       cache_mode_t cache_mode);
 
 /*-- pkdecrypt.c --*/
 int agent_pkdecrypt(ctrl_t ctrl, const char *desc_text,
@@ -352,9 +379,16 @@ int agent_genkey(ctrl_t ctrl, const char *cache_nonce, const char *keyparam,
 gpg_error_t agent_protect_and_store(ctrl_t ctrl, gcry_sexp_t s_skey,
                                     char **passphrase_addr);
 
+/*-- genkey-pool.c --*/
+gpg_error_t genkey_pool_configure(const char *algos, unsigned int size);
+gcry_sexp_t genkey_pool_take(gcry_sexp_t s_keyparam);
+void genkey_pool_stop(void);
+
 /*-- protect.c --*/
 unsigned long get_standard_s2k_count(void);
 unsigned char get_standard_s2k_count_rfc4880(void);
+unsigned long get_standard_s2k_time(void);
+void agent_flush_kek_cache(void);
 int agent_protect(const unsigned char *plainkey, const char *passphrase,
                   unsigned char **result, size_t *resultlen,
                   unsigned long s2k_count, int use_ocb);
@@ -19,9 +19,15 @@
 
 #include <config.h>
 
+#include <atomic>
+#include <functional>
 #include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
 
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -43,8 +49,8 @@ static const size_t ENCRYPTION_KEYSIZE = 128 / 8;
    necessary infrastructure to make it more secure.  */
 static Botan::SymmetricKey *encryption_handle;
 
-/* A mutex used to serialize access to the cache.  */
-static std::mutex cache_lock;
+/* A mutex used to serialize the creation of ENCRYPTION_HANDLE.  */
+static std::mutex encryption_lock;
 
 struct secret_data_s {
   int totallen; /* This includes the padding and space for AESWRAP. */
@@ -53,22 +59,63 @@ struct secret_data_s {
 
 typedef struct cache_item_s *ITEM;
 struct cache_item_s {
-  ITEM next;
+  /* The neighbours in the timer wheel slot.  */
+  ITEM wheel_prev;
+  ITEM wheel_next;
+  /* When the item is checked for expiry next.  */
+  time_t deadline;
+
   time_t created;
   time_t accessed;
   int ttl; /* max. lifetime given in seconds, -1 one means infinite */
   struct secret_data_s *pw;
+  /* The unprotected private key as a canonical S-expression in secure
+     memory, or NULL (see agent_put_key_cache).  */
+  unsigned char *keybuf;
+  size_t keybuflen;
   cache_mode_t cache_mode;
-  char key[1];
+  std::string key;
+};
+
+/* The number of timer wheel slots (one per second).  Items that expire
+   later than that are looked at once per round and put back.  */
+static const size_t WHEEL_SIZE = 256;
+
+/* Unused and expired items are kept this long before they are removed.  */
+static const time_t UNUSED_SLOT_TTL = 60 * 30;
+
+/* The cache is split into shards by the hash of the key, each with its
+   own lock, so that lookups of different keys don't contend.  All items
+   with the same key (but different cache modes) are in the same shard.
+   Expiry is driven by a timer wheel per shard, so an operation only
+   looks at the items that are due, not at the whole cache.  The wheels
+   of all shards are advanced at most once per second by sweep_shards,
+   and lookups check the expiry of the items they find.  */
+struct cache_shard_s {
+  std::mutex lock;
+  std::unordered_multimap<std::string, ITEM> items;
+  /* The circular lists of items by DEADLINE modulo WHEEL_SIZE.  */
+  ITEM wheel[WHEEL_SIZE];
+  /* All slots up to this time have been processed.  */
+  time_t tick;
 };
 
+static const size_t CACHE_SHARDS = 16;
+
 /* The cache himself.  */
-static ITEM thecache;
+static cache_shard_s thecache[CACHE_SHARDS];
+
+/* The last time all shards were swept by sweep_shards.  */
+static std::atomic<time_t> last_sweep;
+
+/* A mutex to protect LAST_STORED_CACHE_KEY.  */
+static std::mutex last_stored_lock;
 
-/* NULL or the last cache key stored by agent_store_cache_hit.  */
-static char *last_stored_cache_key;
+/* Empty or the last cache key stored by agent_store_cache_hit.  */
+static std::string last_stored_cache_key;
 
 void deinitialize_module_cache(void) {
+  std::lock_guard<std::mutex> lock(encryption_lock);
   delete encryption_handle;
   encryption_handle = NULL;
 }
@@ -80,8 +127,7 @@ void deinitialize_module_cache(void) {
    connections.  Thus we should get into listen state as soon as
    possible.  */
 static gpg_error_t init_encryption(void) {
-  gpg_error_t err;
-  void *key;
+  std::lock_guard<std::mutex> lock(encryption_lock);
 
   if (encryption_handle) return 0;
 
@@ -93,6 +139,26 @@ static gpg_error_t init_encryption(void) {
 
 static void release_data(struct secret_data_s *data) { xfree(data); }
 
+static void release_keybuf(ITEM r) {
+  if (!r->keybuf) return;
+  wipememory(r->keybuf, r->keybuflen);
+  xfree(r->keybuf);
+  r->keybuf = NULL;
+  r->keybuflen = 0;
+}
+
+/* Return true if R holds a passphrase or a key.  */
+static bool item_has_data(ITEM r) { return r->pw || r->keybuf; }
+
+/* Release the passphrase and the key of R.  */
+static void release_item_data(ITEM r) {
+  if (r->pw) {
+    release_data(r->pw);
+    r->pw = NULL;
+  }
+  release_keybuf(r);
+}
+
 static gpg_error_t new_data(const char *string, struct secret_data_s **r_data) {
   gpg_error_t err;
   struct secret_data_s *d, *d_enc;
@@ -144,75 +210,178 @@ static gpg_error_t new_data(const char *string, struct secret_data_s **r_data) {
   return 0;
 }
 
-/* Check whether there are items to expire.  */
-static void housekeeping(void) {
-  ITEM r, rprev;
-  time_t current = gnupg_get_time();
+/* Return the shard for KEY.  */
+static cache_shard_s &shard_for(const std::string &key) {
+  return thecache[std::hash<std::string>()(key) % CACHE_SHARDS];
+}
 
-  /* First expire the actual data */
-  for (r = thecache; r; r = r->next) {
-    if (r->pw && r->ttl >= 0 && r->accessed + r->ttl < current) {
-      if (DBG_CACHE)
-        log_debug("  expired '%s' (%ds after last access)\n", r->key, r->ttl);
-      release_data(r->pw);
-      r->pw = NULL;
-      r->accessed = current;
-    }
+/* The time at which R needs to be looked at next: when its data
+   expires, or when the empty slot is removed.  (time_t)-1 means
+   never.  */
+static time_t item_deadline(ITEM r) {
+  if (item_has_data(r)) {
+    time_t deadline = (time_t)-1;
+    /* A huge maximum means no maximum.  */
+    if (opt.max_cache_ttl < (unsigned long)INT_MAX)
+      deadline = r->created + (time_t)opt.max_cache_ttl + 1;
+    if (r->ttl >= 0 &&
+        (deadline == (time_t)-1 || r->accessed + r->ttl + 1 < deadline))
+      deadline = r->accessed + r->ttl + 1;
+    return deadline;
   }
+  if (r->ttl >= 0) return r->accessed + UNUSED_SLOT_TTL + 1;
+  return (time_t)-1;
+}
+
+static void wheel_unlink(cache_shard_s &shard, ITEM r) {
+  if (!r->wheel_next) return;
+  size_t slot = r->deadline % WHEEL_SIZE;
+  if (r->wheel_next == r)
+    shard.wheel[slot] = NULL;
+  else {
+    r->wheel_prev->wheel_next = r->wheel_next;
+    r->wheel_next->wheel_prev = r->wheel_prev;
+    if (shard.wheel[slot] == r) shard.wheel[slot] = r->wheel_next;
+  }
+  r->wheel_prev = r->wheel_next = NULL;
+}
+
+/* (Re-)insert R into the timer wheel according to its current
+   deadline.  */
+static void wheel_schedule(cache_shard_s &shard, ITEM r) {
+  wheel_unlink(shard, r);
+  r->deadline = item_deadline(r);
+  if (r->deadline == (time_t)-1) return;
+  /* Due items are picked up at the next tick.  */
+  if (r->deadline <= shard.tick) r->deadline = shard.tick + 1;
+
+  ITEM &head = shard.wheel[r->deadline % WHEEL_SIZE];
+  if (!head) {
+    r->wheel_prev = r->wheel_next = r;
+    head = r;
+  } else {
+    r->wheel_next = head;
+    r->wheel_prev = head->wheel_prev;
+    head->wheel_prev->wheel_next = r;
+    head->wheel_prev = r;
+  }
+}
 
-  /* Second, make sure that we also remove them based on the created stamp so
+/* Expire the data of R if it is too old, like housekeeping of all items
+   would.  Returns true if R should be removed altogether.  */
+static bool expire_item(ITEM r, time_t current) {
+  if (item_has_data(r) && r->ttl >= 0 && r->accessed + r->ttl < current) {
+    if (DBG_CACHE)
+      log_debug("  expired '%s' (%ds after last access)\n", r->key.c_str(),
+                r->ttl);
+    release_item_data(r);
+    r->accessed = current;
+  }
+
+  /* Make sure that we also remove them based on the created stamp so
      that the user has to enter it from time to time. */
-  for (r = thecache; r; r = r->next) {
-    unsigned long maxttl;
-
-    maxttl = opt.max_cache_ttl;
-    if (r->pw && r->created + maxttl < current) {
-      if (DBG_CACHE)
-        log_debug("  expired '%s' (%lus after creation)\n", r->key,
-                  opt.max_cache_ttl);
-      release_data(r->pw);
-      r->pw = NULL;
-      r->accessed = current;
-    }
+  unsigned long maxttl = opt.max_cache_ttl;
+  if (item_has_data(r) && r->created + maxttl < (unsigned long)current) {
+    if (DBG_CACHE)
+      log_debug("  expired '%s' (%lus after creation)\n", r->key.c_str(),
+                opt.max_cache_ttl);
+    release_item_data(r);
+    r->accessed = current;
   }
 
-  /* Third, make sure that we don't have too many items in the list.
-     Expire old and unused entries after 30 minutes */
-  for (rprev = NULL, r = thecache; r;) {
-    if (!r->pw && r->ttl >= 0 && r->accessed + 60 * 30 < current) {
-      ITEM r2 = r->next;
-      if (DBG_CACHE)
-        log_debug("  removed '%s' (mode %d) (slot not used for 30m)\n", r->key,
-                  r->cache_mode);
-      xfree(r);
-      if (!rprev)
-        thecache = r2;
-      else
-        rprev->next = r2;
-      r = r2;
-    } else {
-      rprev = r;
-      r = r->next;
+  /* Make sure that we don't have too many items in the list.  Expire
+     old and unused entries after 30 minutes */
+  if (!item_has_data(r) && r->ttl >= 0 &&
+      r->accessed + UNUSED_SLOT_TTL < current) {
+    if (DBG_CACHE)
+      log_debug("  removed '%s' (mode %d) (slot not used for 30m)\n",
+                r->key.c_str(), r->cache_mode);
+    return true;
+  }
+  return false;
+}
+
+static void remove_item(cache_shard_s &shard, ITEM r) {
+  wheel_unlink(shard, r);
+  auto range = shard.items.equal_range(r->key);
+  for (auto it = range.first; it != range.second; ++it)
+    if (it->second == r) {
+      shard.items.erase(it);
+      break;
+    }
+  release_item_data(r);
+  delete r;
+}
+
+/* Check whether there are items to expire in SHARD.  Only the timer
+   wheel slots since the last call are looked at.  */
+static void housekeeping(cache_shard_s &shard) {
+  time_t current = gnupg_get_time();
+  if (current <= shard.tick) return;
+
+  /* After a long pause (or the first time), every slot is due.  */
+  time_t first = shard.tick + 1;
+  if (current - shard.tick > (time_t)WHEEL_SIZE)
+    first = current - WHEEL_SIZE + 1;
+  shard.tick = current;
+
+  for (time_t t = first; t <= current; t++) {
+    ITEM &head = shard.wheel[t % WHEEL_SIZE];
+    /* Detach the slot first, as items may be put back into it.  */
+    ITEM r = head;
+    head = NULL;
+    if (!r) continue;
+    r->wheel_prev->wheel_next = NULL;
+    while (r) {
+      ITEM next = r->wheel_next;
+      r->wheel_prev = r->wheel_next = NULL;
+      if (r->deadline > current)
+        ; /* Due in a later round.  */
+      else if (expire_item(r, current)) {
+        remove_item(shard, r);
+        r = next;
+        continue;
+      }
+      wheel_schedule(shard, r);
+      r = next;
     }
   }
 }
 
-void agent_flush_cache(void) {
-  ITEM r;
-  int res;
+/* Run the housekeeping of all shards, at most once per second.  An
+   operation only locks the shard of its key, and without this the
+   expired data in the other shards would be kept until one of their
+   keys is used again.  Must be called without holding a shard lock.  */
+static void sweep_shards(void) {
+  time_t current = gnupg_get_time();
+  time_t last = last_sweep.load();
 
+  if (current <= last || !last_sweep.compare_exchange_strong(last, current))
+    return;
+  for (auto &shard : thecache) {
+    std::lock_guard<std::mutex> lock(shard.lock);
+    housekeeping(shard);
+  }
+}
+
+void agent_flush_cache(void) {
   if (DBG_CACHE) log_debug("agent_flush_cache\n");
 
-  std::lock_guard<std::mutex> lock(cache_lock);
+  for (auto &shard : thecache) {
+    std::lock_guard<std::mutex> lock(shard.lock);
 
-  for (r = thecache; r; r = r->next) {
-    if (r->pw) {
-      if (DBG_CACHE) log_debug("  flushing '%s'\n", r->key);
-      release_data(r->pw);
-      r->pw = NULL;
-      r->accessed = 0;
+    for (auto &item : shard.items) {
+      ITEM r = item.second;
+      if (item_has_data(r)) {
+        if (DBG_CACHE) log_debug("  flushing '%s'\n", r->key.c_str());
+        release_item_data(r);
+        r->accessed = 0;
+        wheel_schedule(shard, r);
+      }
     }
   }
+
+  agent_flush_kek_cache();
 }
 
 /* Compare two cache modes.  */
@@ -222,6 +391,30 @@ static int cache_mode_equal(cache_mode_t a, cache_mode_t b) {
           (b == CACHE_MODE_ANY && a != CACHE_MODE_IGNORE) || a == b);
 }
 
+/* Find the item for KEY in SHARD that matches CACHE_MODE, after expiring
+   it if necessary.  Only items with data are considered if WITH_DATA is
+   true.  */
+static ITEM find_item(cache_shard_s &shard, const std::string &key,
+                      cache_mode_t cache_mode, bool with_data) {
+  time_t current = gnupg_get_time();
+  auto range = shard.items.equal_range(key);
+  for (auto it = range.first; it != range.second;) {
+    ITEM r = it->second;
+    ++it;
+    /* The timer wheel may not have caught up with R yet.  */
+    if (expire_item(r, current)) {
+      remove_item(shard, r);
+      continue;
+    }
+    if ((with_data && !r->pw) ||
+        ((cache_mode == CACHE_MODE_USER || cache_mode == CACHE_MODE_NONCE) &&
+         !cache_mode_equal(r->cache_mode, cache_mode)))
+      continue;
+    return r;
+  }
+  return NULL;
+}
+
 /* Store the string DATA in the cache under KEY and mark it with a
    maximum lifetime of TTL seconds.  If there is already data under
    this key, it will be replaced.  Using a DATA of NULL deletes the
@@ -232,30 +425,24 @@ int agent_put_cache(const char *key, cache_mode_t cache_mode, const char *data,
                     int ttl) {
   gpg_error_t err = 0;
   ITEM r;
-  int res;
 
-  std::lock_guard<std::mutex> lock(cache_lock);
+  sweep_shards();
+  cache_shard_s &shard = shard_for(key);
+  std::lock_guard<std::mutex> lock(shard.lock);
 
   if (DBG_CACHE)
     log_debug("agent_put_cache '%s' (mode %d) requested ttl=%d\n", key,
               cache_mode, ttl);
-  housekeeping();
+  housekeeping(shard);
 
   if (!ttl) ttl = opt.def_cache_ttl;
   if ((!ttl && data) || cache_mode == CACHE_MODE_IGNORE) goto out;
 
-  for (r = thecache; r; r = r->next) {
-    if (((cache_mode != CACHE_MODE_USER && cache_mode != CACHE_MODE_NONCE) ||
-         cache_mode_equal(r->cache_mode, cache_mode)) &&
-        !strcmp(r->key, key))
-      break;
-  }
+  r = find_item(shard, key, cache_mode, false);
   if (r) /* Replace.  */
   {
-    if (r->pw) {
-      release_data(r->pw);
-      r->pw = NULL;
-    }
+    /* A changed passphrase may belong to a changed key.  */
+    release_item_data(r);
     if (data) {
       r->created = r->accessed = gnupg_get_time();
       r->ttl = ttl;
@@ -263,22 +450,23 @@ int agent_put_cache(const char *key, cache_mode_t cache_mode, const char *data,
       err = new_data(data, &r->pw);
       if (err) log_error("error replacing cache item: %s\n", gpg_strerror(err));
     }
+    wheel_schedule(shard, r);
   } else if (data) /* Insert.  */
   {
-    r = (ITEM)xtrycalloc(1, sizeof *r + strlen(key));
+    r = new (std::nothrow) cache_item_s();
     if (!r)
       err = gpg_error_from_syserror();
     else {
-      strcpy(r->key, key);
+      r->key = key;
       r->created = r->accessed = gnupg_get_time();
       r->ttl = ttl;
       r->cache_mode = cache_mode;
       err = new_data(data, &r->pw);
       if (err)
-        xfree(r);
+        delete r;
       else {
-        r->next = thecache;
-        thecache = r;
+        shard.items.emplace(r->key, r);
+        wheel_schedule(shard, r);
       }
     }
     if (err) log_error("error inserting cache item: %s\n", gpg_strerror(err));
@@ -295,59 +483,60 @@ char *agent_get_cache(const char *key, cache_mode_t cache_mode) {
   gpg_error_t err;
   ITEM r;
   char *value = NULL;
-  int res;
   int last_stored = 0;
+  std::string the_key;
 
   if (cache_mode == CACHE_MODE_IGNORE) return NULL;
 
-  std::lock_guard<std::mutex> lock(cache_lock);
-
-  if (!key) {
-    key = last_stored_cache_key;
-    if (!key) goto out;
+  if (key)
+    the_key = key;
+  else {
+    std::lock_guard<std::mutex> lock(last_stored_lock);
+    the_key = last_stored_cache_key;
+    if (the_key.empty()) return NULL;
     last_stored = 1;
   }
 
+  sweep_shards();
+  cache_shard_s &shard = shard_for(the_key);
+  std::lock_guard<std::mutex> lock(shard.lock);
+
   if (DBG_CACHE)
-    log_debug("agent_get_cache '%s' (mode %d)%s ...\n", key, cache_mode,
-              last_stored ? " (stored cache key)" : "");
-  housekeeping();
-
-  for (r = thecache; r; r = r->next) {
-    if (r->pw &&
-        ((cache_mode != CACHE_MODE_USER && cache_mode != CACHE_MODE_NONCE) ||
-         cache_mode_equal(r->cache_mode, cache_mode)) &&
-        !strcmp(r->key, key)) {
-      /* Note: To avoid races KEY may not be accessed anymore below.  */
-      r->accessed = gnupg_get_time();
-      if (DBG_CACHE) log_debug("... hit\n");
-      if (r->pw->totallen < 32)
-        err = GPG_ERR_INV_LENGTH;
-      else if ((err = init_encryption()))
-        ;
-      else if (!(value = (char *)xtrymalloc_secure(r->pw->totallen - 8)))
-        err = gpg_error_from_syserror();
-      else {
-        const Botan::secure_vector<uint8_t> pw_data(r->pw->totallen);
-        memcpy((void *)(pw_data.data()), r->pw->data, r->pw->totallen);
-        Botan::secure_vector<uint8_t> val =
-            Botan::rfc3394_keyunwrap(pw_data, *encryption_handle);
-        assert(val.size() == r->pw->totallen - 8);
-        memcpy(value, val.data(), val.size());
-        err = 0;
-      }
-      if (err) {
-        xfree(value);
-        value = NULL;
-        log_error("retrieving cache entry '%s' failed: %s\n", key,
-                  gpg_strerror(err));
-      }
-      break;
+    log_debug("agent_get_cache '%s' (mode %d)%s ...\n", the_key.c_str(),
+              cache_mode, last_stored ? " (stored cache key)" : "");
+  housekeeping(shard);
+
+  r = find_item(shard, the_key, cache_mode, true);
+  if (r) {
+    r->accessed = gnupg_get_time();
+    if (DBG_CACHE) log_debug("... hit\n");
+    if (r->pw->totallen < 32)
+      err = GPG_ERR_INV_LENGTH;
+    else if ((err = init_encryption()))
+      ;
+    else if (!(value = (char *)xtrymalloc_secure(r->pw->totallen - 8)))
+      err = gpg_error_from_syserror();
+    else {
+      const Botan::secure_vector<uint8_t> pw_data(r->pw->totallen);
+      memcpy((void *)(pw_data.data()), r->pw->data, r->pw->totallen);
+      Botan::secure_vector<uint8_t> val =
+          Botan::rfc3394_keyunwrap(pw_data, *encryption_handle);
+      assert(val.size() == r->pw->totallen - 8);
+      memcpy(value, val.data(), val.size());
+      err = 0;
+    }
+    if (err) {
+      xfree(value);
+      value = NULL;
+      log_error("retrieving cache entry '%s' failed: %s\n", the_key.c_str(),
+                gpg_strerror(err));
     }
+    /* The access moved the expiry time.  The wheel notices this when
+       it gets to R, but moving it now keeps that to one visit.  */
+    wheel_schedule(shard, r);
   }
   if (DBG_CACHE && value == NULL) log_debug("... miss\n");
 
-out:
   return value;
 }
 
@@ -355,29 +544,117 @@ out:
    used by agent_get_cache if the requested KEY is given as NULL.
    NULL may be used to remove that key. */
 void agent_store_cache_hit(const char *key) {
-  char *neu;
-  char *old;
-
-  /* To make sure the update is atomic under the non-preemptive thread
-   * model, we must make sure not to surrender control to a different
-   * thread.  Therefore, we avoid calling the allocator during the
-   * update.
-   *
-   * Background: xtrystrdup uses gcry_strdup which may use the secure
-   * memory allocator of Libgcrypt.  That allocator takes locks and
-   * since version 1.14 libgpg-error is nPth aware and thus taking a
-   * lock may now lead to thread switch.  Note that this only happens
-   * when secure memory is _allocated_ (the standard allocator uses
-   * malloc which is not nPth aware) but not when calling _xfree_
-   * because gcry_free needs to check whether the pointer is in secure
-   * memory and thus needs to take a lock.
-   */
-  neu = key ? xtrystrdup(key) : NULL;
-
-  /* Atomic update.  */
-  old = last_stored_cache_key;
-  last_stored_cache_key = neu;
-  /* Done.  */
-
-  xfree(old);
+  std::lock_guard<std::mutex> lock(last_stored_lock);
+  if (key)
+    last_stored_cache_key = key;
+  else
+    last_stored_cache_key.clear();
+}
+
+/* Keep the unprotected private key KEYBUF of length KEYBUFLEN (a
+   canonical S-expression) for KEY, usually the hexified keygrip.  The
+   key shares the cache item with a passphrase cached under the same
+   KEY in normal mode, and expires with it.  Otherwise it gets its own
+   item with a lifetime of TTL seconds, interpreted like in
+   agent_put_cache.  This does nothing unless --cache-unprotected-keys
+   is given.  */
+void agent_put_key_cache(const char *key, const unsigned char *keybuf,
+                         size_t keybuflen, int ttl) {
+  ITEM r;
+  unsigned char *copy;
+
+  if (!opt.cache_unprotected_keys) return;
+
+  sweep_shards();
+  cache_shard_s &shard = shard_for(key);
+  std::lock_guard<std::mutex> lock(shard.lock);
+
+  if (DBG_CACHE)
+    log_debug("agent_put_key_cache '%s' requested ttl=%d\n", key, ttl);
+  housekeeping(shard);
+
+  if (!ttl) ttl = opt.def_cache_ttl;
+  if (!ttl) return;
+
+  copy = (unsigned char *)xtrymalloc_secure(keybuflen);
+  if (!copy) {
+    log_error("error caching key: %s\n",
+              gpg_strerror(gpg_error_from_syserror()));
+    return;
+  }
+  memcpy(copy, keybuf, keybuflen);
+
+  r = find_item(shard, key, CACHE_MODE_NORMAL, false);
+  if (!r) {
+    r = new (std::nothrow) cache_item_s();
+    if (!r) {
+      log_error("error caching key: %s\n",
+                gpg_strerror(gpg_error_from_syserror()));
+      wipememory(copy, keybuflen);
+      xfree(copy);
+      return;
+    }
+    r->key = key;
+    r->cache_mode = CACHE_MODE_NORMAL;
+    shard.items.emplace(r->key, r);
+  }
+  if (!r->pw) {
+    r->created = r->accessed = gnupg_get_time();
+    r->ttl = ttl;
+  }
+  release_keybuf(r);
+  r->keybuf = copy;
+  r->keybuflen = keybuflen;
+  wheel_schedule(shard, r);
+}
+
+/* Return the private key cached for KEY with agent_put_key_cache as a
+   new S-expression in secure memory, or NULL.  The caller needs to
+   release it.  */
+gcry_sexp_t agent_get_key_cache(const char *key) {
+  ITEM r;
+  gcry_sexp_t s_key = NULL;
+  size_t erroff;
+
+  if (!opt.cache_unprotected_keys) return NULL;
+
+  sweep_shards();
+  cache_shard_s &shard = shard_for(key);
+  std::lock_guard<std::mutex> lock(shard.lock);
+
+  housekeeping(shard);
+
+  r = find_item(shard, key, CACHE_MODE_NORMAL, false);
+  if (r && r->keybuf) {
+    /* KEYBUF is in secure memory, thus the S-expression is too.  */
+    gpg_error_t err =
+        gcry_sexp_sscan(&s_key, &erroff, (char *)r->keybuf, r->keybuflen);
+    if (err) {
+      log_error("retrieving cached key '%s' failed: %s\n", key,
+                gpg_strerror(err));
+      s_key = NULL;
+      release_keybuf(r);
+    } else
+      r->accessed = gnupg_get_time();
+    wheel_schedule(shard, r);
+  }
+  if (DBG_CACHE)
+    log_debug("agent_get_key_cache '%s' ... %s\n", key,
+              s_key ? "hit" : "miss");
+  return s_key;
+}
+
+/* Remove the private key cached for KEY, if any.  The passphrase is
+   kept.  */
+void agent_forget_key_cache(const char *key) {
+  ITEM r;
+
+  cache_shard_s &shard = shard_for(key);
+  std::lock_guard<std::mutex> lock(shard.lock);
+
+  r = find_item(shard, key, CACHE_MODE_NORMAL, false);
+  if (r && r->keybuf) {
+    release_keybuf(r);
+    wheel_schedule(shard, r);
+  }
 }
@@ -26,7 +26,6 @@
 
 #include <assert.h>
 #include <ctype.h>
-#include <dirent.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,6 +39,7 @@
 #include <assuan.h>
 #include "../common/asshelp.h"
 #include "../common/server-help.h"
+#include "../common/trace.h"
 #include "agent.h"
 #include "cvt-openpgp.h"
 
@@ -49,6 +49,8 @@
 #define MAXLEN_KEYPARAM 1024
 /* Maximum allowed size of key data as used in inquiries (bytes). */
 #define MAXLEN_KEYDATA 8192
+/* Maximum allowed number of digests for PKSIGN_BATCH.  */
+#define MAXCOUNT_DIGESTS 1024
 
 /* A shortcut to call assuan_set_error using an gpg_error_t and a
    text string.  */
@@ -356,13 +358,24 @@ static gpg_error_t cmd_marktrusted(assuan_context_t ctx, char *line) {
 
 static const char hlp_havekey[] =
     "HAVEKEY <hexstrings_with_keygrips>\n"
+    "HAVEKEY --list\n"
     "\n"
     "Return success if at least one of the secret keys with the given\n"
-    "keygrips is available.";
+    "keygrips is available.  With --list return all available keygrips\n"
+    "as binary data.";
 static gpg_error_t cmd_havekey(assuan_context_t ctx, char *line) {
   gpg_error_t err;
   unsigned char buf[20];
 
+  if (has_option(line, "--list")) {
+    std::vector<std::string> grips;
+
+    err = agent_list_key_grips(grips);
+    for (size_t i = 0; !err && i < grips.size(); i++)
+      err = assuan_send_data(ctx, grips[i].data(), grips[i].size());
+    return leave_cmd(ctx, err);
+  }
+
   do {
     err = parse_keygrip(ctx, line, buf);
     if (err) return err;
@@ -433,54 +446,66 @@ static gpg_error_t cmd_setkeydesc(assuan_context_t ctx, char *line) {
   return 0;
 }
 
-static const char hlp_sethash[] =
-    "SETHASH (--hash=<name>)|(<algonumber>) <hexstring>\n"
-    "\n"
-    "The client can use this command to tell the server about the data\n"
-    "(which usually is a hash) to be signed.";
-static gpg_error_t cmd_sethash(assuan_context_t ctx, char *line) {
-  int rc;
-  size_t n;
-  char *p;
-  ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
-  unsigned char *buf;
+/* Parse the hash algorithm given as "--hash=<name>" option or as
+   algorithm number at the start of *LINE, store it at R_ALGO and
+   advance *LINE to the next argument.  */
+static gpg_error_t parse_hash_algo(char **line, int *r_algo) {
   char *endp;
   int algo;
 
   /* Parse the alternative hash options which may be used instead of
      the algo number.  */
-  if (has_option_name(line, "--hash")) {
-    if (has_option(line, "--hash=sha1"))
+  if (has_option_name(*line, "--hash")) {
+    if (has_option(*line, "--hash=sha1"))
       algo = GCRY_MD_SHA1;
-    else if (has_option(line, "--hash=sha224"))
+    else if (has_option(*line, "--hash=sha224"))
       algo = GCRY_MD_SHA224;
-    else if (has_option(line, "--hash=sha256"))
+    else if (has_option(*line, "--hash=sha256"))
       algo = GCRY_MD_SHA256;
-    else if (has_option(line, "--hash=sha384"))
+    else if (has_option(*line, "--hash=sha384"))
       algo = GCRY_MD_SHA384;
-    else if (has_option(line, "--hash=sha512"))
+    else if (has_option(*line, "--hash=sha512"))
       algo = GCRY_MD_SHA512;
-    else if (has_option(line, "--hash=rmd160"))
+    else if (has_option(*line, "--hash=rmd160"))
       algo = GCRY_MD_RMD160;
-    else if (has_option(line, "--hash=md5"))
+    else if (has_option(*line, "--hash=md5"))
       algo = GCRY_MD_MD5;
-    else if (has_option(line, "--hash=tls-md5sha1"))
+    else if (has_option(*line, "--hash=tls-md5sha1"))
       algo = MD_USER_TLS_MD5SHA1;
     else
       return set_error(GPG_ERR_ASS_PARAMETER, "invalid hash algorithm");
   } else
     algo = 0;
 
-  line = skip_options(line);
+  *line = skip_options(*line);
 
   if (!algo) {
     /* No hash option has been given: require an algo number instead  */
-    algo = (int)strtoul(line, &endp, 10);
-    for (line = endp; *line == ' ' || *line == '\t'; line++)
+    algo = (int)strtoul(*line, &endp, 10);
+    for (*line = endp; **line == ' ' || **line == '\t'; (*line)++)
       ;
     if (!algo || gcry_md_test_algo(algo))
       return set_error(GPG_ERR_UNSUPPORTED_ALGORITHM, NULL);
   }
+  *r_algo = algo;
+  return 0;
+}
+
+static const char hlp_sethash[] =
+    "SETHASH (--hash=<name>)|(<algonumber>) <hexstring>\n"
+    "\n"
+    "The client can use this command to tell the server about the data\n"
+    "(which usually is a hash) to be signed.";
+static gpg_error_t cmd_sethash(assuan_context_t ctx, char *line) {
+  int rc;
+  size_t n;
+  char *p;
+  ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
+  unsigned char *buf;
+  int algo;
+
+  rc = parse_hash_algo(&line, &algo);
+  if (rc) return rc;
   ctrl->digest.algo = algo;
   ctrl->digest.raw_value = 0;
 
@@ -546,6 +571,77 @@ static gpg_error_t cmd_pksign(assuan_context_t ctx, char *line) {
   return leave_cmd(ctx, rc);
 }
 
+static const char hlp_pksign_batch[] =
+    "PKSIGN_BATCH (--hash=<name>)|(<algonumber>) [<cache_nonce>]\n"
+    "\n"
+    "Sign several digests with the key set by SIGKEY in one exchange.\n"
+    "The digests are inquired with \"DIGESTS\" as the concatenation of\n"
+    "up to 1024 binary digests of the given algorithm.  The key is only\n"
+    "unlocked once.  The result is the concatenation of the signatures\n"
+    "as canonical S-expressions, in the same order.";
+static gpg_error_t cmd_pksign_batch(assuan_context_t ctx, char *line) {
+  int rc;
+  cache_mode_t cache_mode = CACHE_MODE_NORMAL;
+  ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
+  membuf_t outbuf;
+  char *cache_nonce = NULL;
+  unsigned char *digests = NULL;
+  size_t digestslen;
+  size_t n;
+  int algo;
+  char *p;
+
+  rc = parse_hash_algo(&line, &algo);
+  if (rc) return rc;
+  if (algo == MD_USER_TLS_MD5SHA1)
+    n = 36;
+  else
+    n = gcry_md_get_algo_dlen(algo);
+  if (!n || n > MAX_DIGEST_LEN)
+    return set_error(GPG_ERR_ASS_PARAMETER, "unsupported length of hash");
+
+  for (p = line; *p && *p != ' ' && *p != '\t'; p++)
+    ;
+  *p = '\0';
+  if (*line) cache_nonce = xtrystrdup(line);
+
+  if (opt.ignore_cache_for_signing)
+    cache_mode = CACHE_MODE_IGNORE;
+  else if (!ctrl->server_local->use_cache_for_signing)
+    cache_mode = CACHE_MODE_IGNORE;
+
+  rc = print_assuan_status(ctx, "INQUIRE_MAXLEN", "%u",
+                           (unsigned int)(MAXCOUNT_DIGESTS * n));
+  if (!rc)
+    rc = assuan_inquire(ctx, "DIGESTS", &digests, &digestslen,
+                        MAXCOUNT_DIGESTS * n);
+  if (rc) goto leave;
+  if (!digestslen || digestslen % n) {
+    rc = set_error(GPG_ERR_ASS_PARAMETER, "invalid length of digests");
+    goto leave;
+  }
+
+  ctrl->digest.algo = algo;
+  ctrl->digest.raw_value = 0;
+  ctrl->digest.valuelen = n;
+
+  init_membuf(&outbuf, 512);
+
+  rc = agent_pksign_batch(ctrl, cache_nonce, ctrl->server_local->keydesc,
+                          digests, digestslen / n, &outbuf, cache_mode);
+  if (rc)
+    clear_outbuf(&outbuf);
+  else
+    rc = write_and_clear_outbuf(ctx, &outbuf);
+
+leave:
+  xfree(digests);
+  xfree(cache_nonce);
+  xfree(ctrl->server_local->keydesc);
+  ctrl->server_local->keydesc = NULL;
+  return leave_cmd(ctx, rc);
+}
+
 static const char hlp_pkdecrypt[] =
     "PKDECRYPT [<options>]\n"
     "\n"
@@ -908,10 +1004,8 @@ static gpg_error_t cmd_keyinfo(assuan_context_t ctx, char *line) {
   ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
   int err;
   unsigned char grip[20];
-  DIR *dir = NULL;
   int list_mode;
   int opt_data;
-  char hexgrip[41];
   int disabled, ttl, confirm;
 
   list_mode = has_option(line, "--list");
@@ -919,31 +1013,13 @@ static gpg_error_t cmd_keyinfo(assuan_context_t ctx, char *line) {
   line = skip_options(line);
 
   if (list_mode) {
-    char *dirname;
-    struct dirent *dir_entry;
-
-    dirname = make_filename_try(gnupg_homedir(), GNUPG_PRIVATE_KEYS_DIR, NULL);
-    if (!dirname) {
-      err = gpg_error_from_syserror();
-      goto leave;
-    }
-    dir = opendir(dirname);
-    if (!dir) {
-      err = gpg_error_from_syserror();
-      xfree(dirname);
-      goto leave;
-    }
-    xfree(dirname);
+    std::vector<std::string> grips;
 
-    while ((dir_entry = readdir(dir))) {
-      if (strlen(dir_entry->d_name) != 44 ||
-          strcmp(dir_entry->d_name + 40, ".key"))
-        continue;
-      strncpy(hexgrip, dir_entry->d_name, 40);
-      hexgrip[40] = 0;
-
-      if (hex2bin(hexgrip, grip, 20) < 0) continue; /* Bad hex string.  */
+    err = agent_list_key_grips(grips);
+    if (err) goto leave;
 
+    for (const auto &listed : grips) {
+      memcpy(grip, listed.data(), 20);
       disabled = ttl = confirm = 0;
 
       err = do_one_keyinfo(ctrl, grip, ctx, opt_data, ttl, disabled, confirm);
@@ -959,7 +1035,6 @@ static gpg_error_t cmd_keyinfo(assuan_context_t ctx, char *line) {
   }
 
 leave:
-  if (dir) closedir(dir);
   if (err && err != GPG_ERR_NOT_FOUND) leave_cmd(ctx, err);
   return err;
 }
@@ -1706,6 +1781,7 @@ static const char hlp_getinfo[] =
     "  version     - Return the version of the program.\n"
     "  pid         - Return the process id of the server.\n"
     "  s2k_count   - Return the calibrated S2K count.\n"
+    "  s2k_time    - Return the time in ms the S2K takes with that count.\n"
     "  cmd_has_option\n"
     "              - Returns OK if the command CMD implements the option OPT.\n"
     "  connections - Return number of active connections.\n";
@@ -1744,6 +1820,11 @@ static gpg_error_t cmd_getinfo(assuan_context_t ctx, char *line) {
 
     snprintf(numbuf, sizeof numbuf, "%lu", get_standard_s2k_count());
     rc = assuan_send_data(ctx, numbuf, strlen(numbuf));
+  } else if (!strcmp(line, "s2k_time")) {
+    char numbuf[50];
+
+    snprintf(numbuf, sizeof numbuf, "%lu", get_standard_s2k_time());
+    rc = assuan_send_data(ctx, numbuf, strlen(numbuf));
   } else
     rc = set_error(GPG_ERR_ASS_PARAMETER, "unknown value for WHAT");
   return rc;
@@ -1801,6 +1882,7 @@ static int register_commands(assuan_context_t ctx) {
                {"SETKEYDESC", cmd_setkeydesc, hlp_setkeydesc},
                {"SETHASH", cmd_sethash, hlp_sethash},
                {"PKSIGN", cmd_pksign, hlp_pksign},
+               {"PKSIGN_BATCH", cmd_pksign_batch, hlp_pksign_batch},
                {"PKDECRYPT", cmd_pkdecrypt, hlp_pkdecrypt},
                {"GENKEY", cmd_genkey, hlp_genkey},
                {"READKEY", cmd_readkey, hlp_readkey},
@@ -1860,6 +1942,7 @@ void start_command_handler(ctrl_t ctrl) {
   }
 
   assuan_set_pointer(ctx, ctrl);
+  trace_assuan_context(ctx, "agent_command");
   ctrl->server_local = (server_local_s *)xcalloc(1, sizeof *ctrl->server_local);
   ctrl->server_local->assuan_ctx = ctx;
   ctrl->server_local->use_cache_for_signing = 1;
@@ -22,6 +22,7 @@
 #include <assert.h>
 #include <config.h>
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -30,6 +31,11 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "agent.h"
 
 #include "../common/name-value.h"
@@ -38,6 +44,25 @@
 #define O_BINARY 0
 #endif
 
+/* A mutex used to serialize access to the files in the private key
+   directory, so that a key is never read while it is rewritten.  */
+static std::mutex key_file_lock;
+
+/* The result of agent_key_info_from_file for a key file, valid as
+   long as the file is in the state of STAMP.  */
+struct key_info_s {
+  gnupg_file_stamp_t stamp;
+  int keytype;
+  std::string shadow_info; /* Canonical S-expression or empty.  */
+};
+
+/* Key infos by binary keygrip, and the keygrips of all keys in the
+   private key directory as of KEY_DIR_STAMP.  */
+static std::unordered_map<std::string, key_info_s> key_info_cache;
+static std::vector<std::string> key_dir_grips;
+static gnupg_file_stamp_t key_dir_stamp;
+static std::mutex key_cache_lock;
+
 /* Helper to pass data to the check callback of the unprotect function. */
 struct try_unprotect_arg_s {
   ctrl_t ctrl;
@@ -123,7 +148,10 @@ int agent_write_private_key(const unsigned char *grip, const void *buffer,
   estream_t fp;
   char hexgrip[40 + 4 + 1];
 
+  std::lock_guard<std::mutex> lock(key_file_lock);
+
   bin2hex(grip, 20, hexgrip);
+  agent_forget_key_cache(hexgrip);
   strcpy(hexgrip + 40, ".key");
 
   fname = make_filename(gnupg_homedir(), GNUPG_PRIVATE_KEYS_DIR, hexgrip, NULL);
@@ -546,6 +574,8 @@ static gpg_error_t read_key_file(const unsigned char *grip,
 
   *result = NULL;
 
+  std::lock_guard<std::mutex> lock(key_file_lock);
+
   bin2hex(grip, 20, hexgrip);
   strcpy(hexgrip + 40, ".key");
 
@@ -649,7 +679,10 @@ static gpg_error_t remove_key_file(const unsigned char *grip) {
   char *fname;
   char hexgrip[40 + 4 + 1];
 
+  std::lock_guard<std::mutex> lock(key_file_lock);
+
   bin2hex(grip, 20, hexgrip);
+  agent_forget_key_cache(hexgrip);
   strcpy(hexgrip + 40, ".key");
   fname = make_filename(gnupg_homedir(), GNUPG_PRIVATE_KEYS_DIR, hexgrip, NULL);
   if (gnupg_remove(fname)) err = gpg_error_from_syserror();
@@ -671,7 +704,10 @@ static gpg_error_t remove_key_file(const unsigned char *grip) {
    R_PASSPHRASE is not NULL, the function succeeded and the key was
    protected the used passphrase (entered or from the cache) is stored
    there; if not NULL will be stored.  The caller needs to free the
-   returned passphrase.   */
+   returned passphrase.  With --cache-unprotected-keys, the unprotected
+   key is cached and later calls skip reading and unprotecting the key
+   file, unless CACHE_MODE is CACHE_MODE_IGNORE or the passphrase is
+   requested.  */
 gpg_error_t agent_key_from_file(ctrl_t ctrl, const char *cache_nonce,
                                 const char *desc_text,
                                 const unsigned char *grip,
@@ -683,11 +719,19 @@ gpg_error_t agent_key_from_file(ctrl_t ctrl, const char *cache_nonce,
   unsigned char *buf;
   size_t len, buflen, erroff;
   gcry_sexp_t s_skey;
+  char hexgrip[40 + 1];
+  int cacheable = 0;
 
   *result = NULL;
   if (shadow_info) *shadow_info = NULL;
   if (r_passphrase) *r_passphrase = NULL;
 
+  bin2hex(grip, 20, hexgrip);
+  if (cache_mode != CACHE_MODE_IGNORE && !r_passphrase) {
+    *result = agent_get_key_cache(hexgrip);
+    if (*result) return 0;
+  }
+
   rc = read_key_file(grip, &s_skey);
   if (rc) {
     if (rc == GPG_ERR_ENOENT) rc = GPG_ERR_NO_SECKEY;
@@ -702,6 +746,7 @@ gpg_error_t agent_key_from_file(ctrl_t ctrl, const char *cache_nonce,
 
   switch (agent_private_key_type(buf)) {
     case PRIVATE_KEY_CLEAR:
+      cacheable = 1;
       break; /* no unprotection needed */
     case PRIVATE_KEY_OPENPGP_NONE: {
       unsigned char *buf_new;
@@ -714,6 +759,7 @@ gpg_error_t agent_key_from_file(ctrl_t ctrl, const char *cache_nonce,
       else {
         xfree(buf);
         buf = buf_new;
+        cacheable = 1;
       }
     } break;
     case PRIVATE_KEY_PROTECTED: {
@@ -743,6 +789,8 @@ gpg_error_t agent_key_from_file(ctrl_t ctrl, const char *cache_nonce,
         if (rc)
           log_error("failed to unprotect the secret key: %s\n",
                     gpg_strerror(rc));
+        else
+          cacheable = 1;
       }
 
       xfree(desc_text_final);
@@ -786,6 +834,9 @@ gpg_error_t agent_key_from_file(ctrl_t ctrl, const char *cache_nonce,
 
   buflen = gcry_sexp_canon_len(buf, 0, NULL, NULL);
   rc = gcry_sexp_sscan(&s_skey, &erroff, (char *)buf, buflen);
+  if (!rc && cacheable && cache_mode != CACHE_MODE_IGNORE)
+    agent_put_key_cache(hexgrip, buf, buflen,
+                        lookup_ttl ? lookup_ttl(hexgrip) : 0);
   wipememory(buf, buflen);
   xfree(buf);
   if (rc) {
@@ -1092,10 +1143,64 @@ int agent_key_available(const unsigned char *grip) {
   return result;
 }
 
+/* Store the keygrips of all keys in the private key directory in
+   R_GRIPS as binary strings of 20 bytes.  The directory is only read
+   again if it changed since the last call.  */
+gpg_error_t agent_list_key_grips(std::vector<std::string> &r_grips) {
+  gnupg_file_stamp_t stamp;
+  char *dirname;
+  DIR *dir;
+  struct dirent *dir_entry;
+  unsigned char grip[20];
+  char hexgrip[41];
+  std::vector<std::string> grips;
+
+  dirname = make_filename_try(gnupg_homedir(), GNUPG_PRIVATE_KEYS_DIR, NULL);
+  if (!dirname) return gpg_error_from_syserror();
+
+  /* Adding, removing or renaming a key file changes the directory.  */
+  gnupg_file_stamp(dirname, &stamp);
+  {
+    std::lock_guard<std::mutex> lock(key_cache_lock);
+    if (stamp.exists && gnupg_file_stamp_equal(&stamp, &key_dir_stamp)) {
+      xfree(dirname);
+      r_grips = key_dir_grips;
+      return 0;
+    }
+  }
+
+  dir = opendir(dirname);
+  if (!dir) {
+    gpg_error_t err = gpg_error_from_syserror();
+    xfree(dirname);
+    return err;
+  }
+  xfree(dirname);
+
+  while ((dir_entry = readdir(dir))) {
+    if (strlen(dir_entry->d_name) != 44 ||
+        strcmp(dir_entry->d_name + 40, ".key"))
+      continue;
+    strncpy(hexgrip, dir_entry->d_name, 40);
+    hexgrip[40] = 0;
+
+    if (hex2bin(hexgrip, grip, 20) < 0) continue; /* Bad hex string.  */
+    grips.push_back(std::string((const char *)grip, 20));
+  }
+  closedir(dir);
+
+  std::lock_guard<std::mutex> lock(key_cache_lock);
+  key_dir_grips = grips;
+  key_dir_stamp = stamp;
+  r_grips = grips;
+  return 0;
+}
+
 /* Return the information about the secret key specified by the binary
    keygrip GRIP.  If the key is a shadowed one the shadow information
    will be stored at the address R_SHADOW_INFO as an allocated
-   S-expression.  */
+   S-expression.  The information is cached until the key file
+   changes.  */
 gpg_error_t agent_key_info_from_file(ctrl_t ctrl, const unsigned char *grip,
                                      int *r_keytype,
                                      unsigned char **r_shadow_info) {
@@ -1103,13 +1208,38 @@ gpg_error_t agent_key_info_from_file(ctrl_t ctrl, const unsigned char *grip,
   unsigned char *buf;
   size_t len;
   int keytype;
+  char hexgrip[40 + 4 + 1];
+  char *fname;
+  const std::string key((const char *)grip, 20);
+  key_info_s info;
+  int cacheable = 1;
 
   (void)ctrl;
 
   if (r_keytype) *r_keytype = PRIVATE_KEY_UNKNOWN;
   if (r_shadow_info) *r_shadow_info = NULL;
 
+  /* The stamp is taken first, so that a change while reading the
+     file is noticed at the next call.  */
+  bin2hex(grip, 20, hexgrip);
+  strcpy(hexgrip + 40, ".key");
+  fname = make_filename(gnupg_homedir(), GNUPG_PRIVATE_KEYS_DIR, hexgrip, NULL);
+  gnupg_file_stamp(fname, &info.stamp);
+  xfree(fname);
+
   {
+    std::lock_guard<std::mutex> lock(key_cache_lock);
+    auto cached = key_info_cache.find(key);
+    info.keytype = PRIVATE_KEY_UNKNOWN;
+    if (cached != key_info_cache.end()) {
+      if (gnupg_file_stamp_equal(&info.stamp, &cached->second.stamp))
+        info = cached->second;
+      else
+        key_info_cache.erase(cached);
+    }
+  }
+
+  if (info.keytype == PRIVATE_KEY_UNKNOWN) {
     gcry_sexp_t sexp;
 
     err = read_key_file(grip, &sexp);
@@ -1122,19 +1252,17 @@ gpg_error_t agent_key_info_from_file(ctrl_t ctrl, const unsigned char *grip,
     err = make_canon_sexp(sexp, &buf, &len);
     gcry_sexp_release(sexp);
     if (err) return err;
-  }
 
-  keytype = agent_private_key_type(buf);
-  switch (keytype) {
-    case PRIVATE_KEY_CLEAR:
-    case PRIVATE_KEY_OPENPGP_NONE:
-      break;
-    case PRIVATE_KEY_PROTECTED:
-      /* If we ever require it we could retrieve the comment fields
-         from such a key. */
-      break;
-    case PRIVATE_KEY_SHADOWED:
-      if (r_shadow_info) {
+    keytype = agent_private_key_type(buf);
+    switch (keytype) {
+      case PRIVATE_KEY_CLEAR:
+      case PRIVATE_KEY_OPENPGP_NONE:
+        break;
+      case PRIVATE_KEY_PROTECTED:
+        /* If we ever require it we could retrieve the comment fields
+           from such a key. */
+        break;
+      case PRIVATE_KEY_SHADOWED: {
         const unsigned char *s;
         size_t n;
 
@@ -1142,23 +1270,34 @@ gpg_error_t agent_key_info_from_file(ctrl_t ctrl, const unsigned char *grip,
         if (!err) {
           n = gcry_sexp_canon_len(s, 0, NULL, NULL);
           assert(n);
-          *r_shadow_info = (unsigned char *)xtrymalloc(n);
-          if (!*r_shadow_info)
-            err = gpg_error_from_syserror();
-          else
-            memcpy(*r_shadow_info, s, n);
+          info.shadow_info.assign((const char *)s, n);
+        } else if (!r_shadow_info) {
+          /* Only an error if the shadow info is requested.  */
+          err = 0;
+          cacheable = 0;
         }
-      }
-      break;
-    default:
-      err = GPG_ERR_BAD_SECKEY;
-      break;
-  }
+      } break;
+      default:
+        err = GPG_ERR_BAD_SECKEY;
+        break;
+    }
+    xfree(buf);
+    if (err) return err;
 
-  if (!err && r_keytype) *r_keytype = keytype;
+    info.keytype = keytype;
+    if (cacheable && info.stamp.exists) {
+      std::lock_guard<std::mutex> lock(key_cache_lock);
+      key_info_cache[key] = info;
+    }
+  }
 
-  xfree(buf);
-  return err;
+  if (r_shadow_info && info.keytype == PRIVATE_KEY_SHADOWED) {
+    *r_shadow_info = (unsigned char *)xtrymalloc(info.shadow_info.size());
+    if (!*r_shadow_info) return gpg_error_from_syserror();
+    memcpy(*r_shadow_info, info.shadow_info.data(), info.shadow_info.size());
+  }
+  if (r_keytype) *r_keytype = info.keytype;
+  return 0;
 }
 
 /* Delete the key with GRIP from the disk after having asked for
@@ -0,0 +1,262 @@
+/* genkey-pool.c - Pre-generated key pairs
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* With --genkey-pool, a background thread keeps a few RSA key pairs of
+   each configured size ready, so that GENKEY does not wait for the
+   prime search.  The thread is only started by the first GENKEY of a
+   connection, as most agents never generate a key and would otherwise
+   spend CPU time for nothing.  The pooled keys are stored in canonical
+   form in secure memory, are handed out once and then wiped.  */
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "agent.h"
+
+namespace {
+
+/* A pooled key: the canonical S-expression, in secure memory.  */
+struct pooled_key_s {
+  unsigned char *buf;
+  size_t len;
+};
+
+/* The pool of one key type.  */
+struct key_pool_s {
+  /* The key parameters as sent by gpg with GENKEY, in canonical
+     form.  */
+  std::string keyparam;
+  std::deque<pooled_key_s> keys;
+};
+
+std::mutex pool_lock;
+std::condition_variable pool_cond;
+std::vector<key_pool_s> pools;
+unsigned int pool_size;
+std::thread pool_thread;
+bool pool_started;
+bool pool_stopping;
+/* True while the thread is generating a key without the lock.  */
+bool pool_generating;
+
+void release_key(pooled_key_s &key) {
+  wipememory(key.buf, key.len);
+  xfree(key.buf);
+  key.buf = NULL;
+  key.len = 0;
+}
+
+/* Return the canonical form of S_KEYPARAM.  */
+std::string canon_keyparam(gcry_sexp_t s_keyparam) {
+  size_t len = gcry_sexp_sprint(s_keyparam, GCRYSEXP_FMT_CANON, NULL, 0);
+  std::string canon(len, '\0');
+
+  len = gcry_sexp_sprint(s_keyparam, GCRYSEXP_FMT_CANON, &canon[0], len);
+  canon.resize(len);
+  return canon;
+}
+
+/* Generate a key for the canonical KEYPARAM and store it in KEY.
+   Return 0 on success.  */
+gpg_error_t generate_key(const std::string &keyparam, pooled_key_s &key) {
+  gcry_sexp_t s_keyparam, s_key;
+  gpg_error_t err;
+
+  err = gcry_sexp_new(&s_keyparam, keyparam.data(), keyparam.size(), 0);
+  if (err) return err;
+  err = gcry_pk_genkey(&s_key, s_keyparam);
+  gcry_sexp_release(s_keyparam);
+  if (err) return err;
+
+  key.len = gcry_sexp_sprint(s_key, GCRYSEXP_FMT_CANON, NULL, 0);
+  key.buf = (unsigned char *)gcry_malloc_secure(key.len);
+  if (!key.buf) {
+    err = gpg_error_from_syserror();
+    gcry_sexp_release(s_key);
+    return err;
+  }
+  key.len = gcry_sexp_sprint(s_key, GCRYSEXP_FMT_CANON, key.buf, key.len);
+  gcry_sexp_release(s_key);
+  return 0;
+}
+
+/* Refill the pools until genkey_pool_stop is called.  */
+void refill_pools(void) {
+#ifdef __linux__
+  /* On Linux, this only lowers the priority of this thread.  */
+  setpriority(PRIO_PROCESS, 0, 19);
+#endif
+
+  std::unique_lock<std::mutex> lock(pool_lock);
+  for (;;) {
+    key_pool_s *pool = NULL;
+
+    /* Fill up the emptiest pool first.  */
+    for (auto &candidate : pools)
+      if (candidate.keys.size() < pool_size &&
+          (!pool || candidate.keys.size() < pool->keys.size()))
+        pool = &candidate;
+
+    if (pool_stopping) return;
+    if (!pool) {
+      pool_cond.wait(lock);
+      continue;
+    }
+
+    pooled_key_s key;
+    gpg_error_t err;
+    std::string keyparam = pool->keyparam;
+
+    /* The pools are only changed by genkey_pool_stop, which sets
+       POOL_STOPPING first, so POOL is valid again after the check
+       below.  */
+    pool_generating = true;
+    lock.unlock();
+    err = generate_key(keyparam, key);
+    lock.lock();
+    pool_generating = false;
+    if (err) {
+      log_error("pre-generating a key failed: %s\n", gpg_strerror(err));
+      return;
+    }
+    if (pool_stopping) {
+      release_key(key);
+      return;
+    }
+    pool->keys.push_back(key);
+  }
+}
+
+}  // namespace
+
+/* Configure pools of SIZE keys for each of ALGOS, a comma separated
+   list of "rsaNBITS" values.  Return an error if ALGOS is not valid.  */
+gpg_error_t genkey_pool_configure(const char *algos, unsigned int size) {
+  std::vector<key_pool_s> configured;
+  const char *p = algos;
+
+  while (*p) {
+    const char *end = strchr(p, ',');
+    std::string algo(p, end ? end - p : strlen(p));
+    char *nbitsend;
+    unsigned long nbits;
+    char nbitsstr[20];
+    char *keyparam;
+    gcry_sexp_t s_keyparam;
+    gpg_error_t err;
+
+    if (algo.compare(0, 3, "rsa")) return GPG_ERR_INV_VALUE;
+    nbits = strtoul(algo.c_str() + 3, &nbitsend, 10);
+    if (*nbitsend || nbits < 1024 || nbits > 16384 || (nbits % 32))
+      return GPG_ERR_INV_VALUE;
+
+    /* The same parameters as gpg uses for RSA keys.  */
+    snprintf(nbitsstr, sizeof nbitsstr, "%lu", nbits);
+    keyparam = xtryasprintf("(genkey(rsa(nbits %zu:%s)))", strlen(nbitsstr),
+                            nbitsstr);
+    if (!keyparam) return gpg_error_from_syserror();
+    err = gcry_sexp_sscan(&s_keyparam, NULL, keyparam, strlen(keyparam));
+    xfree(keyparam);
+    if (err) return err;
+    key_pool_s pool;
+    pool.keyparam = canon_keyparam(s_keyparam);
+    gcry_sexp_release(s_keyparam);
+    configured.push_back(pool);
+
+    p = end ? end + 1 : p + algo.size();
+  }
+
+  std::lock_guard<std::mutex> lock(pool_lock);
+  log_assert(!pool_started);
+  pools = configured;
+  pool_size = size;
+  return 0;
+}
+
+/* Return a pre-generated key for the parameters S_KEYPARAM (as
+   returned by gcry_pk_genkey), or NULL if there is none.  The key is
+   removed from the pool.  */
+gcry_sexp_t genkey_pool_take(gcry_sexp_t s_keyparam) {
+  gcry_sexp_t s_key = NULL;
+  std::lock_guard<std::mutex> lock(pool_lock);
+
+  if (pools.empty() || !pool_size) return NULL;
+  if (!pool_started) {
+    pool_started = true;
+    try {
+      pool_thread = std::thread(refill_pools);
+    } catch (const std::system_error &) {
+      log_error("error starting the key pool thread\n");
+    }
+    return NULL;
+  }
+
+  std::string canon = canon_keyparam(s_keyparam);
+  for (auto &pool : pools) {
+    if (pool.keyparam != canon) continue;
+    if (!pool.keys.empty()) {
+      pooled_key_s key = pool.keys.front();
+      pool.keys.pop_front();
+      if (gcry_sexp_new(&s_key, key.buf, key.len, 0)) s_key = NULL;
+      release_key(key);
+      pool_cond.notify_one();
+    }
+    break;
+  }
+  return s_key;
+}
+
+/* Stop the background thread and wipe the remaining keys.  A key
+   generation in progress can take seconds, so the thread is not waited
+   for in that case.  It wipes the key and exits when it is done.  */
+void genkey_pool_stop(void) {
+  bool generating;
+
+  {
+    std::lock_guard<std::mutex> lock(pool_lock);
+    pool_stopping = true;
+    generating = pool_generating;
+    pool_cond.notify_one();
+  }
+  if (pool_thread.joinable()) {
+    if (generating)
+      pool_thread.detach();
+    else
+      pool_thread.join();
+  }
+
+  std::lock_guard<std::mutex> lock(pool_lock);
+  for (auto &pool : pools)
+    for (auto &key : pool.keys) release_key(key);
+  pools.clear();
+}
@@ -199,7 +199,11 @@ int agent_genkey(ctrl_t ctrl, const char *cache_nonce, const char *keyparam,
     passphrase = passphrase_buffer;
   }
 
-  rc = gcry_pk_genkey(&s_key, s_keyparam);
+  s_key = genkey_pool_take(s_keyparam);
+  if (s_key)
+    rc = 0;
+  else
+    rc = gcry_pk_genkey(&s_key, s_keyparam);
   gcry_sexp_release(s_keyparam);
   if (rc) {
     log_error("key generation failed: %s\n", gpg_strerror(rc));
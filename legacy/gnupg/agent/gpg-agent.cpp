@@ -67,6 +67,10 @@ enum cmd_and_opt_values {
   oHomedir,
   oNoDetach,
   oLogFile,
+  oLogQueueSize,
+  oLogOverflow,
+  oGenkeyPool,
+  oGenkeyPoolSize,
   oServer,
   oBatch,
 
@@ -79,6 +83,9 @@ enum cmd_and_opt_values {
   oFakedSystemTime,
 
   oIgnoreCacheForSigning,
+  oCacheUnprotectedKeys,
+  oCacheDerivedKeys,
+  oS2KCalibration,
   oAllowMarkTrusted,
   oNoAllowMarkTrusted,
   oNoAllowExternalCache,
@@ -105,6 +112,10 @@ static ARGPARSE_OPTS opts[] = {
 
     ARGPARSE_s_n(oNoDetach, "no-detach", N_("do not detach from the console")),
     ARGPARSE_s_s(oLogFile, "log-file", N_("use a log file for the server")),
+    ARGPARSE_s_u(oLogQueueSize, "log-queue-size",
+                 N_("|N|queue up to N log lines for the log writer")),
+    ARGPARSE_s_s(oLogOverflow, "log-overflow",
+                 N_("|POLICY|block or discard if the log queue is full")),
     ARGPARSE_s_n(oDisableScdaemon, "disable-scdaemon",
                  /* */ N_("do not use the SCdaemon")),
 
@@ -119,9 +130,16 @@ static ARGPARSE_OPTS opts[] = {
     ARGPARSE_s_u(oDefCacheTTL, "default-cache-ttl",
                  N_("|N|expire cached PINs after N seconds")),
     ARGPARSE_s_u(oMaxCacheTTL, "max-cache-ttl", "@"),
+    ARGPARSE_s_s(oGenkeyPool, "genkey-pool",
+                 N_("|ALGOS|pre-generate keys for ALGOS (e.g. rsa4096)")),
+    ARGPARSE_s_u(oGenkeyPoolSize, "genkey-pool-size",
+                 N_("|N|pre-generate N keys for each algorithm")),
 
     ARGPARSE_s_n(oIgnoreCacheForSigning, "ignore-cache-for-signing",
                  /* */ N_("do not use the PIN cache when signing")),
+    ARGPARSE_s_n(oCacheUnprotectedKeys, "cache-unprotected-keys", "@"),
+    ARGPARSE_s_n(oCacheDerivedKeys, "cache-derived-keys", "@"),
+    ARGPARSE_s_u(oS2KCalibration, "s2k-calibration", "@"),
     ARGPARSE_s_n(oNoAllowExternalCache, "no-allow-external-cache",
                  /* */ N_("disallow the use of an external password cache")),
     ARGPARSE_s_n(oNoAllowMarkTrusted, "no-allow-mark-trusted",
@@ -167,6 +185,15 @@ static const char *debug_level;
    the log file after a SIGHUP if it didn't changed. Malloced. */
 static char *current_logfile;
 
+/* The size of the log queue (0 to log directly) and the
+   LOG_OVERFLOW_ policy for --log-queue-size and --log-overflow.  */
+static unsigned int log_queue_size = 8192;
+static int log_overflow = LOG_OVERFLOW_BLOCK;
+
+/* The algorithms and the number of keys for --genkey-pool.  */
+static const char *genkey_pool_algos;
+static unsigned int genkey_pool_size = 2;
+
 /*
    Local prototypes.
  */
@@ -263,6 +290,7 @@ static void cleanup(void) {
 
   if (done) return;
   done = 1;
+  genkey_pool_stop();
   deinitialize_module_cache();
 }
 
@@ -288,6 +316,9 @@ static int parse_rereadable_options(ARGPARSE_ARGS *pargs, int reread) {
     opt.enable_passphrase_history = 0;
     opt.enable_extended_key_format = 0;
     opt.ignore_cache_for_signing = 0;
+    opt.cache_unprotected_keys = 0;
+    opt.cache_derived_keys = 0;
+    opt.s2k_calibration_time = 0;
     opt.allow_mark_trusted = 1;
     opt.allow_external_cache = 1;
     opt.disable_scdaemon = 0;
@@ -341,6 +372,18 @@ static int parse_rereadable_options(ARGPARSE_ARGS *pargs, int reread) {
       opt.ignore_cache_for_signing = 1;
       break;
 
+    case oCacheUnprotectedKeys:
+      opt.cache_unprotected_keys = 1;
+      break;
+
+    case oCacheDerivedKeys:
+      opt.cache_derived_keys = 1;
+      break;
+
+    case oS2KCalibration:
+      opt.s2k_calibration_time = pargs->r.ret_ulong;
+      break;
+
     case oAllowMarkTrusted:
       opt.allow_mark_trusted = 1;
       break;
@@ -502,6 +545,21 @@ next_pass:
       case oLogFile:
         logfile = pargs.r.ret_str;
         break;
+      case oLogQueueSize:
+        log_queue_size = pargs.r.ret_ulong;
+        break;
+      case oGenkeyPool:
+        genkey_pool_algos = pargs.r.ret_str;
+        break;
+      case oGenkeyPoolSize:
+        genkey_pool_size = pargs.r.ret_ulong;
+        break;
+      case oLogOverflow:
+        log_overflow = log_parse_overflow(pargs.r.ret_str);
+        if (log_overflow < 0)
+          log_error(_("invalid log overflow policy '%s'\n"),
+                    pargs.r.ret_str);
+        break;
       case oServer:
         pipe_server = 1;
         break;
@@ -543,6 +601,9 @@ next_pass:
 
   xfree(configname);
   configname = NULL;
+  if (genkey_pool_algos &&
+      genkey_pool_configure(genkey_pool_algos, genkey_pool_size))
+    log_error(_("invalid genkey-pool '%s'\n"), genkey_pool_algos);
   if (log_get_errorcount(0)) exit(2);
 
   finalize_rereadable_options();
@@ -591,6 +652,7 @@ next_pass:
                           GPGRT_LOG_WITH_PID));
     current_logfile = xstrdup(logfile);
   }
+  log_set_async(log_queue_size, log_overflow);
 
   if (pipe_server) {
     /* This is the simple pipe based server */
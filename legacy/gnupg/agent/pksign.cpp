@@ -225,45 +225,20 @@ static int do_encode_raw_pkcs1(const byte *md, size_t mdlen, unsigned int nbits,
   return rc;
 }
 
-/* SIGN whatever information we have accumulated in CTRL and return
-   the signature S-expression.  LOOKUP is an optional function to
-   provide a way for lower layers to ask for the caching TTL.  If a
-   CACHE_NONCE is given that cache item is first tried to get a
-   passphrase.  If OVERRIDEDATA is not NULL, OVERRIDEDATALEN bytes
-   from this buffer are used instead of the data in CTRL.  The
-   override feature is required to allow the use of Ed25519 with ssh
-   because Ed25519 does the hashing itself.  */
-int agent_pksign_do(ctrl_t ctrl, const char *cache_nonce, const char *desc_text,
-                    gcry_sexp_t *signature_sexp, cache_mode_t cache_mode,
-                    lookup_ttl_t lookup_ttl, const void *overridedata,
-                    size_t overridedatalen) {
-  gcry_sexp_t s_skey = NULL;
+/* Sign DATA of DATALEN bytes with the secret key S_SKEY, or divert the
+   operation to the smartcard if SHADOW_INFO is not NULL, and store the
+   signature S-expression at R_SIG.  The hash algorithm is taken from
+   CTRL.  */
+static int sign_with_key(ctrl_t ctrl, const char *desc_text,
+                         gcry_sexp_t s_skey, const unsigned char *shadow_info,
+                         const unsigned char *data, int datalen,
+                         gcry_sexp_t *r_sig) {
   gcry_sexp_t s_sig = NULL;
   gcry_sexp_t s_hash = NULL;
   gcry_sexp_t s_pkey = NULL;
-  unsigned char *shadow_info = NULL;
   unsigned int rc = 0; /* FIXME: gpg-error? */
-  const unsigned char *data;
-  int datalen;
   int check_signature = 0;
 
-  if (overridedata) {
-    data = (const unsigned char *)overridedata;
-    datalen = overridedatalen;
-  } else {
-    data = ctrl->digest.value;
-    datalen = ctrl->digest.valuelen;
-  }
-
-  if (!ctrl->have_keygrip) return GPG_ERR_NO_SECKEY;
-
-  rc = agent_key_from_file(ctrl, cache_nonce, desc_text, ctrl->keygrip,
-                           &shadow_info, cache_mode, lookup_ttl, &s_skey, NULL);
-  if (rc) {
-    if (rc != GPG_ERR_NO_SECKEY) log_error("failed to read the secret key\n");
-    goto leave;
-  }
-
   if (shadow_info) {
     /* Divert operation to the smartcard */
     size_t len;
@@ -400,41 +375,131 @@ int agent_pksign_do(ctrl_t ctrl, const char *cache_nonce, const char *desc_text,
 
 leave:
 
-  *signature_sexp = s_sig;
+  *r_sig = s_sig;
 
   gcry_sexp_release(s_pkey);
-  gcry_sexp_release(s_skey);
   gcry_sexp_release(s_hash);
+
+  return rc;
+}
+
+/* SIGN whatever information we have accumulated in CTRL and return
+   the signature S-expression.  LOOKUP is an optional function to
+   provide a way for lower layers to ask for the caching TTL.  If a
+   CACHE_NONCE is given that cache item is first tried to get a
+   passphrase.  If OVERRIDEDATA is not NULL, OVERRIDEDATALEN bytes
+   from this buffer are used instead of the data in CTRL.  The
+   override feature is required to allow the use of Ed25519 with ssh
+   because Ed25519 does the hashing itself.  */
+int agent_pksign_do(ctrl_t ctrl, const char *cache_nonce, const char *desc_text,
+                    gcry_sexp_t *signature_sexp, cache_mode_t cache_mode,
+                    lookup_ttl_t lookup_ttl, const void *overridedata,
+                    size_t overridedatalen) {
+  gcry_sexp_t s_skey = NULL;
+  unsigned char *shadow_info = NULL;
+  unsigned int rc = 0; /* FIXME: gpg-error? */
+  const unsigned char *data;
+  int datalen;
+
+  *signature_sexp = NULL;
+
+  if (overridedata) {
+    data = (const unsigned char *)overridedata;
+    datalen = overridedatalen;
+  } else {
+    data = ctrl->digest.value;
+    datalen = ctrl->digest.valuelen;
+  }
+
+  if (!ctrl->have_keygrip) return GPG_ERR_NO_SECKEY;
+
+  rc = agent_key_from_file(ctrl, cache_nonce, desc_text, ctrl->keygrip,
+                           &shadow_info, cache_mode, lookup_ttl, &s_skey, NULL);
+  if (rc) {
+    if (rc != GPG_ERR_NO_SECKEY) log_error("failed to read the secret key\n");
+    goto leave;
+  }
+
+  rc = sign_with_key(ctrl, desc_text, s_skey, shadow_info, data, datalen,
+                     signature_sexp);
+
+leave:
+  gcry_sexp_release(s_skey);
   xfree(shadow_info);
 
   return rc;
 }
 
+/* Append the signature S_SIG as canonical S-expression to OUTBUF.  */
+static void put_sig(membuf_t *outbuf, gcry_sexp_t s_sig) {
+  char *buf;
+  size_t len;
+
+  len = gcry_sexp_sprint(s_sig, GCRYSEXP_FMT_CANON, NULL, 0);
+  assert(len);
+  buf = (char *)xmalloc(len);
+  len = gcry_sexp_sprint(s_sig, GCRYSEXP_FMT_CANON, buf, len);
+  assert(len);
+
+  put_membuf(outbuf, buf, len);
+  xfree(buf);
+}
+
 /* SIGN whatever information we have accumulated in CTRL and write it
    back to OUTFP.  If a CACHE_NONCE is given that cache item is first
    tried to get a passphrase.  */
 int agent_pksign(ctrl_t ctrl, const char *cache_nonce, const char *desc_text,
                  membuf_t *outbuf, cache_mode_t cache_mode) {
   gcry_sexp_t s_sig = NULL;
-  char *buf = NULL;
-  size_t len = 0;
   int rc = 0;
 
   rc = agent_pksign_do(ctrl, cache_nonce, desc_text, &s_sig, cache_mode, NULL,
                        NULL, 0);
-  if (rc) goto leave;
+  if (!rc) put_sig(outbuf, s_sig);
 
-  len = gcry_sexp_sprint(s_sig, GCRYSEXP_FMT_CANON, NULL, 0);
-  assert(len);
-  buf = (char *)xmalloc(len);
-  len = gcry_sexp_sprint(s_sig, GCRYSEXP_FMT_CANON, buf, len);
-  assert(len);
+  gcry_sexp_release(s_sig);
 
-  put_membuf(outbuf, buf, len);
+  return rc;
+}
+
+/* Sign NDIGESTS digests, stored one after the other at DIGESTS, with
+   the key and the hash algorithm in CTRL (the length of each digest is
+   CTRL->digest.valuelen), and append the signatures to OUTBUF.  The
+   secret key is read and unprotected only once for the whole batch.
+   Because canonical S-expressions are self-delimiting, the signatures
+   are simply concatenated.  */
+int agent_pksign_batch(ctrl_t ctrl, const char *cache_nonce,
+                       const char *desc_text, const unsigned char *digests,
+                       size_t ndigests, membuf_t *outbuf,
+                       cache_mode_t cache_mode) {
+  gcry_sexp_t s_skey = NULL;
+  unsigned char *shadow_info = NULL;
+  size_t digestlen = ctrl->digest.valuelen;
+  size_t i;
+  int rc = 0;
+
+  if (!ctrl->have_keygrip) return GPG_ERR_NO_SECKEY;
+
+  rc = agent_key_from_file(ctrl, cache_nonce, desc_text, ctrl->keygrip,
+                           &shadow_info, cache_mode, NULL, &s_skey, NULL);
+  if (rc) {
+    if (rc != GPG_ERR_NO_SECKEY) log_error("failed to read the secret key\n");
+    goto leave;
+  }
+
+  for (i = 0; i < ndigests; i++) {
+    gcry_sexp_t s_sig = NULL;
+
+    rc = sign_with_key(ctrl, desc_text, s_skey, shadow_info,
+                       digests + i * digestlen, digestlen, &s_sig);
+    if (!rc) put_sig(outbuf, s_sig);
+    gcry_sexp_release(s_sig);
+    if (rc) goto leave;
+  }
 
 leave:
-  gcry_sexp_release(s_sig);
-  xfree(buf);
+  gcry_sexp_release(s_skey);
+  xfree(shadow_info);
 
   return rc;
 }
@@ -18,6 +18,8 @@
  * along with this program; if not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <mutex>
+
 #include <assert.h>
 #include <config.h>
 #include <ctype.h>
@@ -26,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #ifdef HAVE_W32_SYSTEM
 #ifdef HAVE_WINSOCK2_H
@@ -52,6 +55,9 @@
 /* Decode an rfc4880 encoded S2K count.  */
 #define S2K_DECODE_COUNT(_val) ((16ul + ((_val)&15)) << (((_val) >> 4) + 6))
 
+/* The number of protection keys kept with --cache-derived-keys.  */
+#define KEK_CACHE_SIZE 16
+
 /* A table containing the information needed to create a protected
    private key.  */
 static const struct {
@@ -135,18 +141,22 @@ static unsigned long calibrate_s2k_count_one(unsigned long count) {
 }
 
 /* Measure the time we need to do the hash operations and deduce an
-   S2K count which requires about 100ms of time.  */
+   S2K count which requires about opt.s2k_calibration_time ms of time
+   (100ms by default).  */
 static unsigned long calibrate_s2k_count(void) {
   unsigned long count;
   unsigned long ms;
+  unsigned long target = opt.s2k_calibration_time;
+
+  if (!target) target = AGENT_S2K_CALIBRATION;
 
   for (count = 65536; count; count *= 2) {
     ms = calibrate_s2k_count_one(count);
     if (opt.verbose > 1) log_info("S2K calibration: %lu -> %lums\n", count, ms);
-    if (ms > 100) break;
+    if (ms > target) break;
   }
 
-  count = (unsigned long)(((double)count / ms) * 100);
+  count = (unsigned long)(((double)count / ms) * target);
   count /= 1024;
   count *= 1024;
   if (count < 65536) count = 65536;
@@ -190,6 +200,128 @@ unsigned char get_standard_s2k_count_rfc4880(void) {
   return result;
 }
 
+/* Return the time in milliseconds the S2K takes with the standard
+   count.  This measures the hashing again, so it can be used to check
+   the calibration.  */
+unsigned long get_standard_s2k_time(void) {
+  return calibrate_s2k_count_one(get_standard_s2k_count());
+}
+
+/* The cache of protection keys derived from a passphrase, used by
+   do_decryption if opt.cache_derived_keys is set.  Unprotecting a key
+   with the same passphrase again then skips the deliberately slow S2K.
+   An item is bound to all inputs of the KDF: the salt, the count, the
+   key length and the passphrase, of which only a hash is kept.  Items
+   expire like cached passphrases.  */
+struct kek_cache_item_s {
+  time_t created;  /* 0 for an unused slot.  */
+  time_t accessed; /* Last use.  */
+  unsigned char salt[8];
+  unsigned long count;
+  size_t keylen;
+  unsigned char passphrase_hash[32]; /* SHA-256 of the passphrase.  */
+  unsigned char *key;                /* In secure memory.  */
+};
+static struct kek_cache_item_s kek_cache[KEK_CACHE_SIZE];
+static std::mutex kek_cache_lock;
+
+static void kek_cache_release(struct kek_cache_item_s *item) {
+  if (item->key) {
+    wipememory(item->key, item->keylen);
+    xfree(item->key);
+  }
+  memset(item, 0, sizeof *item);
+}
+
+static int kek_cache_expired(struct kek_cache_item_s *item, time_t current) {
+  unsigned long ttl = opt.def_cache_ttl;
+
+  return (item->accessed + ttl < current ||
+          item->created + opt.max_cache_ttl < current);
+}
+
+/* Look up the protection key derived from PASSPHRASE with S2KSALT and
+   S2KCOUNT and copy it to KEY.  Returns true if it was found.  */
+static int kek_cache_get(const char *passphrase, const unsigned char *s2ksalt,
+                         unsigned long s2kcount, unsigned char *key,
+                         size_t keylen) {
+  unsigned char passphrase_hash[32];
+  time_t current = gnupg_get_time();
+  int i;
+
+  gcry_md_hash_buffer(GCRY_MD_SHA256, passphrase_hash, passphrase,
+                      strlen(passphrase));
+
+  std::lock_guard<std::mutex> lock(kek_cache_lock);
+  for (i = 0; i < KEK_CACHE_SIZE; i++) {
+    struct kek_cache_item_s *item = &kek_cache[i];
+
+    if (!item->created) continue;
+    if (kek_cache_expired(item, current)) {
+      kek_cache_release(item);
+      continue;
+    }
+    if (item->count == s2kcount && item->keylen == keylen &&
+        !memcmp(item->salt, s2ksalt, 8) &&
+        !memcmp(item->passphrase_hash, passphrase_hash, 32)) {
+      memcpy(key, item->key, keylen);
+      item->accessed = current;
+      wipememory(passphrase_hash, sizeof passphrase_hash);
+      return 1;
+    }
+  }
+  wipememory(passphrase_hash, sizeof passphrase_hash);
+  return 0;
+}
+
+/* Store KEY as the protection key derived from PASSPHRASE with
+   S2KSALT and S2KCOUNT, replacing the least recently used item.  Keys
+   for an empty passphrase are not cached.  */
+static void kek_cache_put(const char *passphrase, const unsigned char *s2ksalt,
+                          unsigned long s2kcount, const unsigned char *key,
+                          size_t keylen) {
+  struct kek_cache_item_s *slot = &kek_cache[0];
+  unsigned char *copy;
+  time_t current = gnupg_get_time();
+  int i;
+
+  if (!passphrase || !*passphrase) return;
+
+  copy = (unsigned char *)gcry_malloc_secure(keylen);
+  if (!copy) return;
+  memcpy(copy, key, keylen);
+
+  std::lock_guard<std::mutex> lock(kek_cache_lock);
+  for (i = 0; i < KEK_CACHE_SIZE; i++) {
+    struct kek_cache_item_s *item = &kek_cache[i];
+
+    if (item->created && kek_cache_expired(item, current))
+      kek_cache_release(item);
+    if (!item->created) {
+      slot = item;
+      break;
+    }
+    if (item->accessed < slot->accessed) slot = item;
+  }
+
+  kek_cache_release(slot);
+  slot->created = slot->accessed = current;
+  memcpy(slot->salt, s2ksalt, 8);
+  slot->count = s2kcount;
+  slot->keylen = keylen;
+  gcry_md_hash_buffer(GCRY_MD_SHA256, slot->passphrase_hash, passphrase,
+                      strlen(passphrase));
+  slot->key = copy;
+}
+
+/* Forget all cached protection keys.  */
+void agent_flush_kek_cache(void) {
+  int i;
+
+  std::lock_guard<std::mutex> lock(kek_cache_lock);
+  for (i = 0; i < KEK_CACHE_SIZE; i++) kek_cache_release(&kek_cache[i]);
+}
+
 /* Calculate the MIC for a private key or shared secret S-expression.
    SHA1HASH should point to a 20 byte buffer.  This function is
    suitable for all algorithms. */
@@ -616,6 +748,8 @@ static int do_decryption(const unsigned char *aad_begin, size_t aad_len,
   int blklen;
   gcry_cipher_hd_t hd;
   unsigned char *outbuf;
+  unsigned char *key = NULL;
+  int key_from_cache = 0;
   size_t reallen;
 
   blklen = gcry_cipher_get_algo_blklen(prot_cipher);
@@ -640,16 +774,17 @@ static int do_decryption(const unsigned char *aad_begin, size_t aad_len,
 
   /* Hash the passphrase and set the key.  */
   if (!rc) {
-    unsigned char *key;
-
     key = (unsigned char *)gcry_malloc_secure(prot_cipher_keylen);
     if (!key)
       rc = gpg_error_from_syserror();
     else {
-      rc = hash_passphrase(passphrase, GCRY_MD_SHA1, 3, s2ksalt, s2kcount, key,
-                           prot_cipher_keylen);
+      if (opt.cache_derived_keys && passphrase && *passphrase)
+        key_from_cache = kek_cache_get(passphrase, s2ksalt, s2kcount, key,
+                                       prot_cipher_keylen);
+      if (!key_from_cache)
+        rc = hash_passphrase(passphrase, GCRY_MD_SHA1, 3, s2ksalt, s2kcount,
+                             key, prot_cipher_keylen);
       if (!rc) rc = gcry_cipher_setkey(hd, key, prot_cipher_keylen);
-      xfree(key);
     }
   }
 
@@ -682,27 +817,37 @@ static int do_decryption(const unsigned char *aad_begin, size_t aad_len,
 
   /* Release cipher handle and check for errors.  */
   gcry_cipher_close(hd);
-  if (rc) {
-    xfree(outbuf);
-    return rc;
-  }
+  if (rc) goto leave;
 
   /* Do a quick check on the data structure. */
   if (*outbuf != '(' && outbuf[1] != '(') {
     /* Note that in OCB mode this is actually invalid _encrypted_
      * data and not a bad passphrase.  */
-    xfree(outbuf);
-    return GPG_ERR_BAD_PASSPHRASE;
+    rc = GPG_ERR_BAD_PASSPHRASE;
+    goto leave;
   }
 
   /* Check that we have a consistent S-Exp. */
   reallen = gcry_sexp_canon_len(outbuf, protectedlen, NULL, NULL);
   if (!reallen || (reallen + blklen < protectedlen)) {
-    xfree(outbuf);
-    return GPG_ERR_BAD_PASSPHRASE;
+    rc = GPG_ERR_BAD_PASSPHRASE;
+    goto leave;
   }
+
+  /* Only keys which decrypted successfully are cached.  */
+  if (opt.cache_derived_keys && !key_from_cache)
+    kek_cache_put(passphrase, s2ksalt, s2kcount, key, prot_cipher_keylen);
+
   *result = outbuf;
-  return 0;
+  outbuf = NULL;
+
+leave:
+  xfree(outbuf);
+  if (key) {
+    wipememory(key, prot_cipher_keylen);
+    xfree(key);
+  }
+  return rc;
 }
 
 /* Merge the parameter list contained in CLEARTEXT with the original
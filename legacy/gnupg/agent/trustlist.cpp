@@ -21,6 +21,8 @@
 #include <config.h>
 
 #include <mutex>
+#include <string>
+#include <unordered_map>
 
 #include <assert.h>
 #include <ctype.h>
@@ -51,6 +53,12 @@ typedef struct trustitem_s trustitem_t;
 /* Malloced table and its allocated size with all trust items. */
 static trustitem_t *trusttable;
 static size_t trusttablesize;
+/* The index of the first item for each binary fingerprint.  */
+static std::unordered_map<std::string, size_t> trustindex;
+/* True if the table is valid for the trust files in the state of
+   TRUSTFILE_STAMPS (the user's and the global file).  */
+static int trusttable_loaded;
+static gnupg_file_stamp_t trustfile_stamps[2];
 /* A mutex used to protect the table. */
 static std::mutex trusttable_lock;
 
@@ -76,6 +84,8 @@ static inline void clear_trusttable(void) {
   xfree(trusttable);
   trusttable = NULL;
   trusttablesize = 0;
+  trustindex.clear();
+  trusttable_loaded = 0;
 }
 
 static gpg_error_t read_one_trustfile(const char *fname, int allow_include,
@@ -301,6 +311,47 @@ static gpg_error_t read_trustfiles(void) {
   xfree(trusttable);
   trusttable = ti;
   trusttablesize = tableidx;
+
+  /* Index the table.  For duplicates, the first item counts.  */
+  trustindex.clear();
+  for (size_t idx = 0; idx < trusttablesize; idx++)
+    trustindex.emplace(std::string((const char *)trusttable[idx].fpr, 20), idx);
+  return 0;
+}
+
+/* Store the state of the user's and the global trust file in
+   STAMPS.  */
+static void stamp_trustfiles(gnupg_file_stamp_t stamps[2]) {
+  char *fname;
+
+  fname = make_filename(gnupg_homedir(), "trustlist.txt", NULL);
+  gnupg_file_stamp(fname, &stamps[0]);
+  xfree(fname);
+  fname = make_filename(gnupg_sysconfdir(), "trustlist.txt", NULL);
+  gnupg_file_stamp(fname, &stamps[1]);
+  xfree(fname);
+}
+
+/* Make sure that the trusttable is up to date.  The trust files are
+   only read again if one of them changed since they were read.  The
+   trusttable is assumed to be locked.  */
+static gpg_error_t load_trustfiles(void) {
+  gnupg_file_stamp_t stamps[2];
+  gpg_error_t err;
+
+  /* The stamps are taken first, so that a change while reading the
+     files is noticed at the next check.  */
+  stamp_trustfiles(stamps);
+  if (trusttable_loaded &&
+      gnupg_file_stamp_equal(&stamps[0], &trustfile_stamps[0]) &&
+      gnupg_file_stamp_equal(&stamps[1], &trustfile_stamps[1]))
+    return 0;
+
+  err = read_trustfiles();
+  if (err) return err;
+  trustfile_stamps[0] = stamps[0];
+  trustfile_stamps[1] = stamps[1];
+  trusttable_loaded = 1;
   return 0;
 }
 
@@ -312,7 +363,7 @@ static gpg_error_t istrusted_internal(ctrl_t ctrl, const char *fpr,
   gpg_error_t err = 0;
   int locked = already_locked;
   trustitem_t *ti;
-  size_t len;
+  int disabled;
   unsigned char fprbin[20];
 
   if (r_disabled) *r_disabled = 0;
@@ -327,36 +378,36 @@ static gpg_error_t istrusted_internal(ctrl_t ctrl, const char *fpr,
     locked = 1;
   }
 
-  if (!trusttable) {
-    err = read_trustfiles();
-    if (err) {
-      log_error(_("error reading list of trusted root certificates\n"));
-      goto leave;
-    }
+  err = load_trustfiles();
+  if (err) {
+    log_error(_("error reading list of trusted root certificates\n"));
+    goto leave;
   }
 
-  if (trusttable) {
-    for (ti = trusttable, len = trusttablesize; len; ti++, len--)
-      if (!memcmp(ti->fpr, fprbin, 20)) {
-        if (ti->flags.disabled && r_disabled) *r_disabled = 1;
-
-        /* Print status messages only if we have not been called
-           in a locked state.  */
-        if (already_locked)
-          ;
-        else if (ti->flags.relax) {
-          trusttable_lock.unlock();
-          locked = 0;
-          err = agent_write_status(ctrl, "TRUSTLISTFLAG", "relax", NULL);
-        } else if (ti->flags.cm) {
-          trusttable_lock.unlock();
-          locked = 0;
-          err = agent_write_status(ctrl, "TRUSTLISTFLAG", "cm", NULL);
-        }
-
-        if (!err) err = ti->flags.disabled ? GPG_ERR_NOT_TRUSTED : 0;
-        goto leave;
+  {
+    auto item = trustindex.find(std::string((const char *)fprbin, 20));
+    if (item != trustindex.end()) {
+      ti = &trusttable[item->second];
+      if (ti->flags.disabled && r_disabled) *r_disabled = 1;
+      disabled = ti->flags.disabled;
+
+      /* Print status messages only if we have not been called
+         in a locked state.  */
+      if (already_locked)
+        ;
+      else if (ti->flags.relax) {
+        trusttable_lock.unlock();
+        locked = 0;
+        err = agent_write_status(ctrl, "TRUSTLISTFLAG", "relax", NULL);
+      } else if (ti->flags.cm) {
+        trusttable_lock.unlock();
+        locked = 0;
+        err = agent_write_status(ctrl, "TRUSTLISTFLAG", "cm", NULL);
       }
+
+      if (!err) err = disabled ? GPG_ERR_NOT_TRUSTED : 0;
+      goto leave;
+    }
   }
   err = GPG_ERR_NOT_TRUSTED;
 
@@ -379,12 +430,10 @@ gpg_error_t agent_listtrusted(void *assuan_context) {
   size_t len;
   std::lock_guard<std::mutex> lock(trusttable_lock);
 
-  if (!trusttable) {
-    err = read_trustfiles();
-    if (err) {
-      log_error(_("error reading list of trusted root certificates\n"));
-      return err;
-    }
+  err = load_trustfiles();
+  if (err) {
+    log_error(_("error reading list of trusted root certificates\n"));
+    return err;
   }
 
   if (trusttable) {
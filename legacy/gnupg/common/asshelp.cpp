@@ -285,6 +285,32 @@ gpg_error_t start_new_dirmngr(assuan_context_t *r_ctx, int verbose, int debug) {
     return err;
   }
 
+  /* Prefer a running "dirmngr --daemon", which serves all clients
+     from one process and keeps its caches warm.  */
+  {
+    char *sockname = make_filename(gnupg_homedir(), DIRMNGR_SOCK_NAME, NULL);
+
+    err = assuan_socket_connect(ctx, sockname, 0,
+                                ASSUAN_SOCKET_CONNECT_FDPASSING);
+    xfree(sockname);
+    /* CRLs and certificates are sent in binary frames if the dirmngr
+       supports them.  */
+    if (!err) err = assuan_negotiate_binary_data(ctx);
+    if (!err) {
+      if (debug) log_debug("connection to the dirmngr daemon established\n");
+      *r_ctx = ctx;
+      return 0;
+    }
+
+    /* A failed connect may leave the context half set up.  */
+    assuan_release(ctx);
+    err = assuan_new(&ctx);
+    if (err) {
+      log_error("error allocating assuan context: %s\n", gpg_strerror(err));
+      return err;
+    }
+  }
+
   {
     lock_spawn_t lock;
     const char *argv[6];
@@ -323,6 +349,13 @@ gpg_error_t start_new_dirmngr(assuan_context_t *r_ctx, int verbose, int debug) {
     xfree(abs_homedir);
   }
 
+  err = assuan_negotiate_binary_data(ctx);
+  if (err) {
+    log_error("can't connect to the dirmngr: %s\n", gpg_strerror(err));
+    assuan_release(ctx);
+    return err;
+  }
+
   if (debug) log_debug("connection to the dirmngr established\n");
 
   *r_ctx = ctx;
@@ -76,7 +76,8 @@
    having an unproved better performance of fcntl locking.  However
    there are still problems left, thus we resort to use a hardlink
    which has the well defined property that a link call will fail if
-   the target file already exists.
+   the target file already exists.  Where available, kernel locks are
+   used in addition to avoid polling; see "On kernel locks" below.
 
    Given that hardlinks are also available on NTFS file systems since
    Windows XP; it will be possible to enhance this module to use
@@ -152,6 +153,21 @@
    before releasing the lock and prints diagnostics to help detecting
    bugs.
 
+   Readers which only need to exclude concurrent writers may instead
+   take a shared lock:
+
+     if (dotlock_take_shared (h, -1))
+       error ("error taking lock: %s\n", strerror (errno));
+     ...
+     dotlock_release_shared (h);
+
+   Any number of processes may hold a shared lock at the same time,
+   but not while another process holds the lock taken by dotlock_take.
+   Shared locks nest and are also granted if the own process already
+   holds the exclusive lock on H.  If kernel locks are not available
+   (see below), dotlock_take_shared always succeeds immediately, which
+   matches the old behaviour of readers not locking at all.
+
    If you want to explicitly destroy all lock files you may call
 
      dotlock_remove_lockfiles ();
@@ -192,6 +208,9 @@
      DOTLOCK_EXT_SYM_PREFIX - Prefix all external symbols with the
                               string to which this macro evaluates.
 
+     DOTLOCK_NO_KERNEL_LOCKS - Define to use only the lock file, even
+                               if fcntl or flock locks are available.
+
      HAVE_DOSISH_SYSTEM  - Defined for Windows etc.  Will be
                            automatically defined if a the target is
                            Windows.
@@ -235,6 +254,26 @@
    - An advantage of fcntl locking is that R/W locks can be
      implemented which is not easy with a straight lock file.
 
+   On kernel locks:
+   - Waiting for a lock file is done by polling with increasing
+     intervals, which adds up to seconds of delay if several
+     processes contend for a keyring.  Therefore, on systems with
+     F_OFD_SETLK (Linux 3.15) or flock (BSD, older Linux), each handle
+     also locks a "gate" file, FNAME with the suffix ".klock" appended,
+     which is never removed.  The kernel lock is taken first, with a
+     blocking wait, so that our own processes queue up there and then
+     find the lock file free.  The lock file itself is still used to
+     stay compatible with other implementations of this protocol.
+   - Both lock types belong to the open file description and not to
+     the process, thus two handles for the same file conflict even
+     within one process, unlike POSIX record locks.  They are released
+     by the kernel if the process dies, so no stale lock handling is
+     needed for the gate.  The gate is opened with close-on-exec, so
+     that spawned daemons do not inherit the lock.
+   - If the gate file can't be opened or locked (e.g. a read-only
+     file system or NFS without a lock manager), the handle silently
+     falls back to the lock file alone.
+
    On O_EXCL:
    - Does not work reliable on NFS
    - Should work on CIFS and SMBFS but how can we delete lockfiles?
@@ -287,6 +326,9 @@
 #ifdef DOTLOCK_USE_PTHREAD
 #include <pthread.h>
 #endif
+#ifdef HAVE_POSIX_SYSTEM
+#include <sys/file.h>
+#endif
 
 #ifdef DOTLOCK_GLIB_LOGGING
 #include <glib.h>
@@ -309,6 +351,14 @@
 #endif
 #endif
 
+/* Use kernel locks on the gate file if the system supports OFD locks
+   or flock.  */
+#if defined(HAVE_POSIX_SYSTEM) && !defined(DOTLOCK_NO_KERNEL_LOCKS)
+#if defined(F_OFD_SETLKW) || defined(LOCK_EX)
+#define DOTLOCK_KERNEL_LOCKS 1
+#endif
+#endif
+
 #define my_set_errno(e) gpg_err_set_errno((e))
 
 /* Gettext macro replacement.  */
@@ -333,6 +383,8 @@ struct dotlock_handle {
   unsigned int locked : 1;     /* Lock status.                          */
   unsigned int disable : 1;    /* If true, locking is disabled.         */
   unsigned int use_o_excl : 1; /* Use open (O_EXCL) for locking.        */
+  unsigned int no_klock : 1;   /* Kernel locks are not usable.          */
+  int shared;                  /* Nesting level of shared locks.        */
 
   int extra_fd; /* A place for the caller to store an FD.  */
 
@@ -342,6 +394,8 @@ struct dotlock_handle {
   char *tname;         /* Name of the lockfile template.        */
   size_t nodename_off; /* Offset in TNAME of the nodename part. */
   size_t nodename_len; /* Length of the nodename part.          */
+  char *kname;         /* Name of the gate file for kernel locks. */
+  int kfd;             /* The opened gate file or -1.            */
 #endif           /*!HAVE_DOSISH_SYSTEM */
 };
 
@@ -640,6 +694,14 @@ static dotlock_t dotlock_create_unix(dotlock_t h, const char *file_to_lock) {
     return NULL;
   }
   strcpy(stpcpy(h->lockname, file_to_lock), EXTSEP_S "lock");
+#ifdef DOTLOCK_KERNEL_LOCKS
+  /* Without a name for the gate we just fall back to the lock file.  */
+  h->kname = (char *)xtrymalloc(strlen(file_to_lock) + 7);
+  if (h->kname)
+    strcpy(stpcpy(h->kname, file_to_lock), EXTSEP_S "klock");
+  else
+    h->no_klock = 1;
+#endif /*DOTLOCK_KERNEL_LOCKS*/
   UNLOCK_all_lockfiles();
   if (h->use_o_excl)
     my_debug_1("locking for '%s' done via O_EXCL\n", h->lockname);
@@ -748,6 +810,9 @@ dotlock_t dotlock_create(const char *file_to_lock, unsigned int flags) {
   h = (dotlock_t)xtrycalloc(1, sizeof *h);
   if (!h) return NULL;
   h->extra_fd = -1;
+#ifndef HAVE_DOSISH_SYSTEM
+  h->kfd = -1;
+#endif
 
   if (never_lock) {
     h->disable = 1;
@@ -779,6 +844,9 @@ static void dotlock_destroy_unix(dotlock_t h) {
   if (h->locked && h->lockname) unlink(h->lockname);
   if (h->tname && !h->use_o_excl) unlink(h->tname);
   xfree(h->tname);
+  /* Closing the gate file releases any kernel lock.  */
+  if (h->kfd != -1) close(h->kfd);
+  xfree(h->kname);
 }
 #endif /*HAVE_POSIX_SYSTEM*/
 
@@ -827,6 +895,128 @@ void dotlock_destroy(dotlock_t h) {
   xfree(h);
 }
 
+#ifdef DOTLOCK_KERNEL_LOCKS
+/* Set the kernel lock on FD to TYPE, which is one of F_RDLCK, F_WRLCK
+   or F_UNLCK.  If WAIT is true, block until the lock is granted.
+   Returns 0 on success and -1 with ERRNO set on error.  If the lock
+   is held by someone else, ERRNO is EAGAIN, EACCES or EWOULDBLOCK.  */
+static int kernel_lock_op(int fd, int type, int wait) {
+  int res;
+
+#ifdef F_OFD_SETLKW
+  static int no_ofd;
+
+  if (!no_ofd) {
+    struct flock fl;
+
+    memset(&fl, 0, sizeof fl);
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET; /* With a length of 0 the whole file.  */
+    do
+      res = fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &fl);
+    while (res == -1 && errno == EINTR);
+    if (!res || errno != EINVAL) return res;
+    no_ofd = 1; /* Kernel older than 3.15.  */
+  }
+#endif /*F_OFD_SETLKW*/
+
+#ifdef LOCK_EX
+  do
+    res = flock(fd, ((type == F_RDLCK ? LOCK_SH
+                                      : type == F_WRLCK ? LOCK_EX : LOCK_UN) |
+                     (wait ? 0 : LOCK_NB)));
+  while (res == -1 && errno == EINTR);
+  return res;
+#else
+  my_set_errno(EINVAL);
+  return -1;
+#endif
+}
+
+/* Take the kernel lock of type TYPE on the gate file of H.  TIMEOUT
+   is as for dotlock_take; the time spent waiting is subtracted from
+   it.  Returns 0 on success and -1 with ERRNO set to EACCES on
+   timeout.  If kernel locks can't be used for H, 0 is returned
+   without taking a lock.  */
+static int take_kernel_lock(dotlock_t h, int type, long *timeout) {
+  int wtime = 0;
+  int flags = O_CREAT;
+
+  if (h->no_klock) return 0;
+
+#ifdef O_CLOEXEC
+  flags |= O_CLOEXEC;
+#endif
+  if (h->kfd == -1) {
+    do
+      h->kfd = open(h->kname, O_RDWR | flags,
+                    S_IRUSR | S_IRGRP | S_IROTH | S_IWUSR);
+    while (h->kfd == -1 && errno == EINTR);
+    if (h->kfd == -1 && type == F_RDLCK)
+      h->kfd = open(h->kname, O_RDONLY | (flags & ~O_CREAT));
+    if (h->kfd == -1) {
+      my_debug_1("kernel locks for '%s' disabled\n", h->lockname);
+      h->no_klock = 1;
+      return 0;
+    }
+#if !defined(O_CLOEXEC) && defined(FD_CLOEXEC)
+    fcntl(h->kfd, F_SETFD, FD_CLOEXEC);
+#endif
+  }
+
+  for (;;) {
+    struct timeval tv;
+
+    if (!kernel_lock_op(h->kfd, type, 0)) return 0;
+    if (errno != EAGAIN && errno != EACCES && errno != EWOULDBLOCK) {
+      /* E.g. ENOLCK on NFS without a lock manager.  */
+      my_debug_1("kernel locks for '%s' disabled\n", h->lockname);
+      close(h->kfd);
+      h->kfd = -1;
+      h->no_klock = 1;
+      return 0;
+    }
+
+    if (!*timeout) {
+      my_set_errno(EACCES);
+      return -1;
+    }
+    if (*timeout < 0) {
+      /* No need to poll; the kernel wakes us up.  Readers did not
+         wait at all before, so they don't say so.  */
+      if (type == F_WRLCK)
+        my_info_1(_("waiting for lock %s...\n"), h->lockname);
+      if (!kernel_lock_op(h->kfd, type, 1)) return 0;
+      return -1;
+    }
+
+    /* The kernel has no timed wait, so poll with retry intervals of
+       10ms, 20ms, 40ms up to 160ms.  */
+    if (!wtime)
+      wtime = 10;
+    else if (wtime < 160)
+      wtime *= 2;
+    if (wtime > *timeout) wtime = *timeout;
+    *timeout -= wtime;
+
+    tv.tv_sec = wtime / 1000;
+    tv.tv_usec = (wtime % 1000) * 1000;
+    select(0, NULL, NULL, NULL, &tv);
+  }
+}
+
+/* Return the kernel lock of H to the state required by the remaining
+   locks of H: a shared lock if a shared lock is held, and none
+   otherwise.  */
+static void release_kernel_lock(dotlock_t h) {
+  if (h->kfd == -1) return;
+
+  if (kernel_lock_op(h->kfd, h->shared ? F_RDLCK : F_UNLCK, 1))
+    my_error_2("release_dotlock: error unlocking '%s': %s\n", h->kname,
+               strerror(errno));
+}
+#endif /*DOTLOCK_KERNEL_LOCKS*/
+
 #ifdef HAVE_POSIX_SYSTEM
 /* Unix specific code of make_dotlock.  Returns 0 on success and -1 on
    error.  */
@@ -1038,13 +1228,61 @@ int dotlock_take(dotlock_t h, long timeout) {
 
 #ifdef HAVE_DOSISH_SYSTEM
   ret = dotlock_take_w32(h, timeout);
-#else  /*!HAVE_DOSISH_SYSTEM*/
+#else /*!HAVE_DOSISH_SYSTEM*/
+#ifdef DOTLOCK_KERNEL_LOCKS
+  /* Queue up at the gate first.  Once we are through, the lock file
+     is only held by processes not using kernel locks.  */
+  if (take_kernel_lock(h, F_WRLCK, &timeout)) return -1;
+#endif
   ret = dotlock_take_unix(h, timeout);
+#ifdef DOTLOCK_KERNEL_LOCKS
+  if (ret) {
+    int saveerrno = errno;
+    release_kernel_lock(h);
+    my_set_errno(saveerrno);
+  }
+#endif
 #endif /*!HAVE_DOSISH_SYSTEM*/
 
   return ret;
 }
 
+/* Take a shared lock on H, which excludes a lock taken by
+   dotlock_take in another process but not other shared locks.
+   TIMEOUT is as for dotlock_take.  Returns: 0 on success  */
+int dotlock_take_shared(dotlock_t h, long timeout) {
+  if (h->disable)
+    return 0; /* Locks are completely disabled.  Return success. */
+
+#ifdef DOTLOCK_KERNEL_LOCKS
+  /* Nested shared locks and shared locks below our own exclusive lock
+     are granted without asking the kernel.  */
+  if (!h->shared && !h->locked && take_kernel_lock(h, F_RDLCK, &timeout))
+    return -1;
+#else
+  (void)timeout;
+#endif
+  h->shared++;
+  return 0;
+}
+
+/* Release a shared lock taken by dotlock_take_shared.  Returns 0 on
+   success.  */
+int dotlock_release_shared(dotlock_t h) {
+  if (h->disable) return 0;
+
+  if (!h->shared) {
+    my_debug_1("Oops, '%s' is not locked shared\n", h->lockname);
+    return 0;
+  }
+
+  h->shared--;
+#ifdef DOTLOCK_KERNEL_LOCKS
+  if (!h->shared && !h->locked) release_kernel_lock(h);
+#endif
+  return 0;
+}
+
 #ifdef HAVE_POSIX_SYSTEM
 /* Unix specific code of release_dotlock.  */
 static int dotlock_release_unix(dotlock_t h) {
@@ -1120,7 +1358,12 @@ int dotlock_release(dotlock_t h) {
   ret = dotlock_release_unix(h);
 #endif
 
-  if (!ret) h->locked = 0;
+  if (!ret) {
+    h->locked = 0;
+#ifdef DOTLOCK_KERNEL_LOCKS
+    release_kernel_lock(h);
+#endif
+  }
   return ret;
 }
 
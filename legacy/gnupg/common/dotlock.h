@@ -82,6 +82,8 @@
 #define dotlock_destroy _DOTLOCK_PREFIX(dotlock_destroy)
 #define dotlock_take _DOTLOCK_PREFIX(dotlock_take)
 #define dotlock_release _DOTLOCK_PREFIX(dotlock_release)
+#define dotlock_take_shared _DOTLOCK_PREFIX(dotlock_take_shared)
+#define dotlock_release_shared _DOTLOCK_PREFIX(dotlock_release_shared)
 #define dotlock_remove_lockfiles _DOTLOCK_PREFIX(dotlock_remove_lockfiles)
 #endif /*DOTLOCK_EXT_SYM_PREFIX*/
 
@@ -102,6 +104,8 @@ int dotlock_get_fd(dotlock_t h);
 void dotlock_destroy(dotlock_t h);
 int dotlock_take(dotlock_t h, long timeout);
 int dotlock_release(dotlock_t h);
+int dotlock_take_shared(dotlock_t h, long timeout);
+int dotlock_release_shared(dotlock_t h);
 void dotlock_remove_lockfiles(void);
 
 #ifdef __cplusplus
@@ -59,6 +59,7 @@
 
 #if __linux__
 #include <dirent.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #endif /*__linux__ */
 
@@ -141,33 +142,76 @@ int get_max_fds(void) {
   return max_fds;
 }
 
+/* Close the file descriptors FIRST to LAST.  If LAST is -1 all
+   descriptors from FIRST on are closed.  MAX_FD caches the result of
+   get_max_fds and is initialized to -1 by the caller; it is only
+   needed if the system can't close a range of descriptors at once.  */
+static void close_fd_range(int first, int last, int *max_fd) {
+  int fd;
+
+  if (last != -1 && last < first) return;
+
+#if defined(__linux__) && defined(SYS_close_range)
+  /* Linux 5.9 and later.  */
+  if (!syscall(SYS_close_range, (unsigned int)first,
+               last == -1 ? ~0U : (unsigned int)last, 0))
+    return;
+#elif defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || \
+    defined(__sun)
+  if (last == -1) {
+    closefrom(first);
+    return;
+  }
+#endif
+
+  if (*max_fd == -1) *max_fd = get_max_fds();
+  if (last == -1 || last >= *max_fd) last = *max_fd - 1;
+  for (fd = first; fd <= last; fd++) close(fd);
+}
+
 /* Close all file descriptors starting with descriptor FIRST.  If
    EXCEPT is not NULL, it is expected to be a list of file descriptors
    which shall not be closed.  This list shall be sorted in ascending
    order with the end marked by -1.  */
 void close_all_fds(int first, int *except) {
-  int max_fd = get_max_fds();
-  int fd, i, except_start;
-
-  if (except) {
-    except_start = 0;
-    for (fd = first; fd < max_fd; fd++) {
-      for (i = except_start; except[i] != -1; i++) {
-        if (except[i] == fd) {
-          /* If we found the descriptor in the exception list
-             we can start the next compare run at the next
-             index because the exception list is ordered.  */
-          except_start = i + 1;
-          break;
-        }
+  int max_fd = -1;
+  int i;
+
+  /* Close the gaps between the exceptions.  */
+  if (except)
+    for (i = 0; except[i] != -1; i++)
+      if (except[i] >= first) {
+        close_fd_range(first, except[i] - 1, &max_fd);
+        first = except[i] + 1;
       }
-      if (except[i] == -1) close(fd);
+  close_fd_range(first, -1, &max_fd);
+
+  gpg_err_set_errno(0);
+}
+
+/* Append FD to the list of IDX descriptors in ARRAY with room for
+   NARRAY entries, growing it as needed.  Returns -1 and releases
+   ARRAY on error.  */
+static int add_to_fd_list(int **array, size_t *narray, int idx, int fd) {
+  if (idx + 1 >= *narray) {
+    int *tmp;
+
+    *narray += (*narray < 256) ? 32 : 256;
+    tmp = (int *)realloc(*array, *narray * sizeof **array);
+    if (!tmp) {
+      free(*array);
+      *array = NULL;
+      return -1;
     }
-  } else {
-    for (fd = first; fd < max_fd; fd++) close(fd);
+    *array = tmp;
   }
+  (*array)[idx] = fd;
+  return 0;
+}
 
-  gpg_err_set_errno(0);
+/* Compare function for qsort.  */
+static int compare_fds(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
 }
 
 /* Returns an array with all currently open file descriptors.  The end
@@ -186,27 +230,47 @@ int *get_all_open_fds(void) {
 #else  /*HAVE_STAT*/
   struct stat statbuf;
 
-  max_fd = get_max_fds();
   narray = 32; /* If you change this change also t-exechelp.c.  */
   array = (int *)calloc(narray, sizeof *array);
   if (!array) return NULL;
 
-  /* Note:  The list we return is ordered.  */
-  for (idx = 0, fd = 0; fd < max_fd; fd++)
-    if (!(fstat(fd, &statbuf) == -1 && errno == EBADF)) {
-      if (idx + 1 >= narray) {
-        int *tmp;
-
-        narray += (narray < 256) ? 32 : 256;
-        tmp = (int *)realloc(array, narray * sizeof *array);
-        if (!tmp) {
-          free(array);
+#ifdef __linux__
+  /* The directory lists exactly the open descriptors, which saves a
+     fstat for every possible one.  */
+  {
+    DIR *dir;
+    struct dirent *dir_entry;
+    const char *s;
+
+    dir = opendir("/proc/self/fd");
+    if (dir) {
+      idx = 0;
+      while ((dir_entry = readdir(dir))) {
+        s = dir_entry->d_name;
+        if (*s < '0' || *s > '9') continue;
+        fd = atoi(s);
+        if (fd == dirfd(dir)) continue;
+        if (add_to_fd_list(&array, &narray, idx++, fd)) {
+          closedir(dir);
           return NULL;
         }
-        array = tmp;
       }
-      array[idx++] = fd;
+      closedir(dir);
+      /* Note:  The list we return is ordered.  */
+      qsort(array, idx, sizeof *array, compare_fds);
+      array[idx] = -1;
+      return array;
     }
+  }
+#endif /* __linux__ */
+
+  max_fd = get_max_fds();
+
+  /* Note:  The list we return is ordered.  */
+  for (idx = 0, fd = 0; fd < max_fd; fd++)
+    if (!(fstat(fd, &statbuf) == -1 && errno == EBADF) &&
+        add_to_fd_list(&array, &narray, idx++, fd))
+      return NULL;
   array[idx] = -1;
 #endif /*HAVE_STAT*/
   return array;
@@ -37,6 +37,7 @@
 #endif
 
 #include <gcrypt.h>
+#include "trace.h"
 #include "util.h"
 
 /* This object is used to register memory cleanup functions.
@@ -135,4 +136,7 @@ void init_common_subsystems(int *argcp, char ***argvp) {
 
   /* --version et al shall use estream as well.  */
   argparse_register_outfnc(writestring_via_estream);
+
+  /* This needs estream for writing the trace at exit.  */
+  trace_init();
 }
@@ -40,6 +40,10 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
 #ifdef HAVE_W32_SYSTEM
 #ifdef HAVE_WINSOCK2_H
 #include <winsock2.h>
@@ -60,6 +64,17 @@
    test "armored_key_8192" in armor.test! */
 #define IOBUF_BUFFER_SIZE 8192
 
+/* The largest internal buffer used when reading a big file.  Input
+   files larger than 64 times IOBUF_BUFFER_SIZE get a buffer of about
+   1/64th of their size, up to this limit.  Filters pushed on top of
+   such a file inherit its buffer size.  */
+#define IOBUF_MAX_BUFFER_SIZE (1024 * 1024)
+
+/* The number and size of the buffers an I/O thread keeps in flight
+   (see IOBUF_IOCTL_ASYNC and iobuf_push_thread_filter).  */
+#define ASYNC_IO_BUFFERS 4
+#define ASYNC_IO_BUFFER_SIZE (256 * 1024)
+
 /* To avoid a potential DoS with compression packets we better limit
    the number of filters in a chain.  */
 #define MAX_NESTING_FILTER 64
@@ -76,12 +91,15 @@
 
 int iobuf_debug_mode;
 
+struct async_io_s;
+
 /* The context used by the file filter.  */
 typedef struct {
   gnupg_fd_t fp; /* Open file pointer or handle.  */
   int keep_open;
   int no_cache;
   int eof_seen;
+  struct async_io_s *async; /* I/O thread or NULL.  */
   int print_only_name; /* Flags indicating that fname is not a real file.  */
   char fname[1];       /* Name of the file.  */
 } file_filter_ctx_t;
@@ -147,8 +165,8 @@ static int translate_file_handle(int fd, int for_write);
    underlying file; it just causes any data buffered at the filter A
    to be sent to A's filter function.
 
-   If A is a IOBUF_OUTPUT_TEMP filter, then this also enlarges the
-   buffer by IOBUF_BUFFER_SIZE.
+   If A is a IOBUF_OUTPUT_TEMP filter, then this also doubles the size
+   of the buffer.
 
    May only be called on an IOBUF_OUTPUT or IOBUF_OUTPUT_TEMP filters.  */
 static int filter_flush(iobuf_t a);
@@ -340,6 +358,348 @@ static gnupg_fd_t fd_cache_open(const char *fname, const char *mode) {
   return direct_open(fname, mode, 0);
 }
 
+/* Read up to SIZE bytes from F into BUF and store the number of
+   bytes read at R_NBYTES.  Returns 0 on success, -1 on EOF or an
+   error code, in which case the system error code is stored at R_EC.
+   A broken pipe is not an error but nothing is read.  */
+static int file_read_raw(gnupg_fd_t f, byte *buf, size_t size,
+                         size_t *r_nbytes, int *r_ec) {
+  *r_nbytes = 0;
+#ifdef HAVE_W32_SYSTEM
+  unsigned long nread;
+
+  if (!ReadFile(f, buf, size, &nread, NULL)) {
+    int ec = (int)GetLastError();
+    if (ec != ERROR_BROKEN_PIPE) {
+      *r_ec = ec;
+      return gpg_error_from_errno(ec);
+    }
+    return 0;
+  }
+  if (!nread) return -1;
+  *r_nbytes = nread;
+#else
+  int n;
+
+  do {
+    n = read(f, buf, size);
+  } while (n == -1 && errno == EINTR);
+  if (n == -1) {
+    if (errno == EPIPE) return 0;
+    *r_ec = errno;
+    return gpg_error_from_syserror();
+  }
+  if (!n) return -1;
+  *r_nbytes = n;
+#endif
+  return 0;
+}
+
+/* Write SIZE bytes from BUF to F and store the number of bytes
+   written at R_NBYTES.  Returns 0 on success or an error code, in
+   which case the system error code is stored at R_EC.  */
+static int file_write_raw(gnupg_fd_t f, const byte *buf, size_t size,
+                          size_t *r_nbytes, int *r_ec) {
+  const byte *p = buf;
+  int rc = 0;
+
+#ifdef HAVE_W32_SYSTEM
+  unsigned long n;
+  size_t nbytes = size;
+
+  do {
+    if (size && !WriteFile(f, p, nbytes, &n, NULL)) {
+      *r_ec = (int)GetLastError();
+      rc = gpg_error_from_errno(*r_ec);
+      break;
+    }
+    p += n;
+    nbytes -= n;
+  } while (nbytes);
+#else
+  int n;
+  size_t nbytes = size;
+
+  do {
+    do {
+      n = write(f, p, nbytes);
+    } while (n == -1 && errno == EINTR);
+    if (n > 0) {
+      p += n;
+      nbytes -= n;
+    }
+  } while (n != -1 && nbytes);
+  if (n == -1) {
+    *r_ec = errno;
+    rc = gpg_error_from_syserror();
+  }
+#endif
+  *r_nbytes = p - buf;
+  return rc;
+}
+
+/* Log a read or write error of the file filter A.  WHAT is "read" or
+   "write" and EC the system error code.  */
+static void file_log_error(file_filter_ctx_t *a, const char *what, int ec) {
+#ifdef HAVE_W32_SYSTEM
+  log_error("%s: %s error: ec=%d\n", a->fname, what, ec);
+#else
+  log_error("%s: %s error: %s\n", a->fname, what, strerror(ec));
+#endif
+}
+
+/* The state of an I/O thread.  An I/O thread either reads ahead
+   from a file (input) or writes the data handed to it, to a file or
+   to the rest of a pipeline (output), through a ring of buffers.
+   The thread works on the buffer at TAIL, the other side on the one
+   at HEAD; COUNT is the number of buffers filled but not yet
+   consumed.  Only the counters and flags are protected by LOCK: a
+   buffer belongs to the side whose turn it is.  */
+struct async_io_s {
+  int use;        /* IOBUF_INPUT or IOBUF_OUTPUT.  */
+  gnupg_fd_t fd;  /* The file to read or write, */
+  iobuf_t chain;  /* or, if not NULL, the pipeline to write to.  */
+  std::thread thread;
+  std::mutex lock;
+  std::condition_variable cond;
+  struct {
+    byte *buf;
+    size_t len;   /* Number of valid bytes.  */
+    size_t start; /* Number of bytes already consumed (input).  */
+  } slot[ASYNC_IO_BUFFERS];
+  unsigned int head;
+  unsigned int tail;
+  unsigned int count;
+  int eof;      /* The thread saw EOF (input).  */
+  int rc;       /* Error code of a failed read or write.  */
+  int ec;       /* The system error code for RC or 0.  */
+  int reported; /* RC has been logged.  */
+  int stop;     /* Ask the thread to terminate.  */
+};
+
+static void async_io_thread(struct async_io_s *as) {
+  std::unique_lock<std::mutex> lock(as->lock);
+
+  for (;;) {
+    unsigned int idx;
+    size_t nbytes;
+    int rc, ec = 0;
+
+    if (as->use == IOBUF_INPUT) {
+      as->cond.wait(
+          lock, [as] { return as->stop || as->count < ASYNC_IO_BUFFERS; });
+      if (as->stop) break;
+      idx = as->tail;
+      lock.unlock();
+      rc = file_read_raw(as->fd, as->slot[idx].buf, ASYNC_IO_BUFFER_SIZE,
+                         &nbytes, &ec);
+      lock.lock();
+      as->slot[idx].len = nbytes;
+      as->slot[idx].start = 0;
+      if (nbytes) {
+        as->tail = (idx + 1) % ASYNC_IO_BUFFERS;
+        as->count++;
+      }
+      if (rc && rc != -1) {
+        as->rc = rc;
+        as->ec = ec;
+      } else if (!nbytes)
+        as->eof = 1; /* EOF or broken pipe.  */
+      as->cond.notify_all();
+      if (as->eof || as->rc) break;
+    } else {
+      int failed;
+
+      as->cond.wait(lock, [as] { return as->stop || as->count; });
+      if (!as->count) break; /* Stopped and everything written.  */
+      idx = as->tail;
+      failed = !!as->rc;
+      lock.unlock();
+      /* After an error the remaining data is discarded.  */
+      if (failed)
+        rc = 0;
+      else if (as->chain)
+        rc = iobuf_write(as->chain, as->slot[idx].buf, as->slot[idx].len);
+      else
+        rc = file_write_raw(as->fd, as->slot[idx].buf, as->slot[idx].len,
+                            &nbytes, &ec);
+      lock.lock();
+      if (rc) {
+        as->rc = rc;
+        as->ec = ec;
+      }
+      as->tail = (idx + 1) % ASYNC_IO_BUFFERS;
+      as->count--;
+      as->cond.notify_all();
+    }
+  }
+}
+
+/* Start an I/O thread for USE on the file FD or, for output, the
+   pipeline CHAIN and store it at R_AS.  Returns 0 on success or -1 if
+   the thread could not be created.  */
+static int async_io_start(struct async_io_s **r_as, int use, gnupg_fd_t fd,
+                          iobuf_t chain) {
+  struct async_io_s *as = NULL;
+  int i;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  /* Ask for a larger read-ahead of the kernel as well.  This fails
+     for pipes, which does not matter.  */
+  if (use == IOBUF_INPUT) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  try {
+    as = new struct async_io_s();
+    as->use = use;
+    as->fd = fd;
+    as->chain = chain;
+    for (i = 0; i < ASYNC_IO_BUFFERS; i++)
+      if (!(as->slot[i].buf = (byte *)xtrymalloc(ASYNC_IO_BUFFER_SIZE)))
+        goto failed;
+    as->thread = std::thread(async_io_thread, as);
+  } catch (const std::exception &) {
+    goto failed;
+  }
+  *r_as = as;
+  return 0;
+
+failed:
+  if (as) {
+    for (i = 0; i < ASYNC_IO_BUFFERS; i++) xfree(as->slot[i].buf);
+    delete as;
+  }
+  return -1;
+}
+
+/* Stop and release the I/O thread AS.  Pending output is written
+   first; data read ahead is discarded.  Returns the error code of a
+   failed write, which is logged if that has not yet been done and
+   WHAT is not NULL.  */
+static int async_io_stop(struct async_io_s *as, file_filter_ctx_t *what) {
+  int i, rc = 0;
+
+  if (!as) return 0;
+
+  {
+    std::lock_guard<std::mutex> lock(as->lock);
+    as->stop = 1;
+  }
+  as->cond.notify_all();
+  as->thread.join();
+
+  if (as->use == IOBUF_OUTPUT && as->rc) {
+    if (what && !as->reported && as->ec) file_log_error(what, "write", as->ec);
+    rc = as->rc;
+  }
+  for (i = 0; i < ASYNC_IO_BUFFERS; i++) {
+    memset(as->slot[i].buf, 0, ASYNC_IO_BUFFER_SIZE);
+    xfree(as->slot[i].buf);
+  }
+  delete as;
+  return rc;
+}
+
+/* Read up to SIZE bytes from the buffers filled by the I/O thread AS.
+   Same return values as file_read_raw, except that the system error
+   code is only stored at R_EC the first time.  */
+static int async_io_read(struct async_io_s *as, byte *buf, size_t size,
+                         size_t *r_nbytes, int *r_ec) {
+  std::unique_lock<std::mutex> lock(as->lock);
+  unsigned int idx;
+  size_t n;
+
+  *r_nbytes = 0;
+  *r_ec = 0;
+  as->cond.wait(lock, [as] { return as->count || as->eof || as->rc; });
+  if (!as->count) {
+    if (!as->rc) return -1;
+    if (!as->reported) *r_ec = as->ec;
+    as->reported = 1;
+    return as->rc;
+  }
+  idx = as->head;
+  lock.unlock();
+
+  n = as->slot[idx].len - as->slot[idx].start;
+  if (n > size) n = size;
+  memcpy(buf, as->slot[idx].buf + as->slot[idx].start, n);
+  as->slot[idx].start += n;
+  *r_nbytes = n;
+
+  if (as->slot[idx].start == as->slot[idx].len) {
+    lock.lock();
+    as->head = (idx + 1) % ASYNC_IO_BUFFERS;
+    as->count--;
+    as->cond.notify_all();
+  }
+  return 0;
+}
+
+/* Queue SIZE bytes from BUF for writing by the I/O thread AS.
+   Returns an error code if an earlier write failed; the system error
+   code is then stored at R_EC the first time.  */
+static int async_io_write(struct async_io_s *as, const byte *buf, size_t size,
+                          int *r_ec) {
+  *r_ec = 0;
+  while (size) {
+    std::unique_lock<std::mutex> lock(as->lock);
+    unsigned int idx;
+    size_t n;
+
+    as->cond.wait(
+        lock, [as] { return as->rc || as->count < ASYNC_IO_BUFFERS; });
+    if (as->rc) {
+      if (!as->reported) *r_ec = as->ec;
+      as->reported = 1;
+      return as->rc;
+    }
+    idx = as->head;
+    lock.unlock();
+
+    n = size > ASYNC_IO_BUFFER_SIZE ? ASYNC_IO_BUFFER_SIZE : size;
+    memcpy(as->slot[idx].buf, buf, n);
+    as->slot[idx].len = n;
+    buf += n;
+    size -= n;
+
+    lock.lock();
+    as->head = (idx + 1) % ASYNC_IO_BUFFERS;
+    as->count++;
+    as->cond.notify_all();
+  }
+  return 0;
+}
+
+/* The filter pushed by iobuf_push_thread_filter.  OPAQUE points to
+   the I/O thread writing to CHAIN, or is NULL if the thread could not
+   be started.  */
+static int thread_filter(void *opaque, int control, iobuf_t chain, byte *buf,
+                         size_t *ret_len) {
+  struct async_io_s **r_as = (struct async_io_s **)opaque;
+  int rc = 0;
+  int ec;
+
+  if (control == IOBUFCTRL_FLUSH) {
+    if (!*ret_len)
+      ;
+    else if (*r_as)
+      rc = async_io_write(*r_as, buf, *ret_len, &ec);
+    else
+      rc = iobuf_write(chain, buf, *ret_len);
+  } else if (control == IOBUFCTRL_INIT) {
+    if (async_io_start(r_as, IOBUF_OUTPUT, GNUPG_INVALID_FD, chain))
+      log_info("can't start pipeline thread\n");
+  } else if (control == IOBUFCTRL_DESC) {
+    mem2str((char *)(buf), "thread_filter", *ret_len);
+  } else if (control == IOBUFCTRL_FREE) {
+    rc = async_io_stop(*r_as, NULL);
+    xfree(r_as);
+  }
+
+  return rc;
+}
+
 static int file_filter(void *opaque, int control, iobuf_t chain, byte *buf,
                        size_t *ret_len) {
   file_filter_ctx_t *a = (file_filter_ctx_t *)opaque;
@@ -356,92 +716,37 @@ static int file_filter(void *opaque, int control, iobuf_t chain, byte *buf,
       rc = -1;
       *ret_len = 0;
     } else {
-#ifdef HAVE_W32_SYSTEM
-      unsigned long nread;
-
-      nbytes = 0;
-      if (!ReadFile(f, buf, size, &nread, NULL)) {
-        int ec = (int)GetLastError();
-        if (ec != ERROR_BROKEN_PIPE) {
-          rc = gpg_error_from_errno(ec);
-          log_error("%s: read error: ec=%d\n", a->fname, ec);
-        }
-      } else if (!nread) {
-        a->eof_seen = 1;
-        rc = -1;
-      } else {
-        nbytes = nread;
-      }
-
-#else
-
-      int n;
-
-      nbytes = 0;
-      do {
-        n = read(f, buf, size);
-      } while (n == -1 && errno == EINTR);
-      if (n == -1) { /* error */
-        if (errno != EPIPE) {
-          rc = gpg_error_from_syserror();
-          log_error("%s: read error: %s\n", a->fname, strerror(errno));
-        }
-      } else if (!n) { /* eof */
-        a->eof_seen = 1;
-        rc = -1;
-      } else {
-        nbytes = n;
-      }
-#endif
+      int ec;
+
+      if (a->async)
+        rc = async_io_read(a->async, buf, size, &nbytes, &ec);
+      else
+        rc = file_read_raw(f, buf, size, &nbytes, &ec);
+      if (rc && rc != -1 && ec) file_log_error(a, "read", ec);
+      if (rc == -1) a->eof_seen = 1;
       *ret_len = nbytes;
     }
   } else if (control == IOBUFCTRL_FLUSH) {
     if (size) {
-#ifdef HAVE_W32_SYSTEM
-      byte *p = buf;
-      unsigned long n;
+      int ec;
 
-      nbytes = size;
-      do {
-        if (size && !WriteFile(f, p, nbytes, &n, NULL)) {
-          int ec = (int)GetLastError();
-          rc = gpg_error_from_errno(ec);
-          log_error("%s: write error: ec=%d\n", a->fname, ec);
-          break;
-        }
-        p += n;
-        nbytes -= n;
-      } while (nbytes);
-      nbytes = p - buf;
-#else
-      byte *p = buf;
-      int n;
-
-      nbytes = size;
-      do {
-        do {
-          n = write(f, p, nbytes);
-        } while (n == -1 && errno == EINTR);
-        if (n > 0) {
-          p += n;
-          nbytes -= n;
-        }
-      } while (n != -1 && nbytes);
-      if (n == -1) {
-        rc = gpg_error_from_syserror();
-        log_error("%s: write error: %s\n", a->fname, strerror(errno));
-      }
-      nbytes = p - buf;
-#endif
+      if (a->async) {
+        if (!(rc = async_io_write(a->async, buf, size, &ec))) nbytes = size;
+      } else
+        rc = file_write_raw(f, buf, size, &nbytes, &ec);
+      if (rc && ec) file_log_error(a, "write", ec);
     }
     *ret_len = nbytes;
   } else if (control == IOBUFCTRL_INIT) {
     a->eof_seen = 0;
     a->keep_open = 0;
     a->no_cache = 0;
+    a->async = NULL;
   } else if (control == IOBUFCTRL_DESC) {
     mem2str((char *)(buf), "file_filter(fd)", *ret_len);
   } else if (control == IOBUFCTRL_FREE) {
+    rc = async_io_stop(a->async, a);
+    a->async = NULL;
     if (f != FD_FOR_STDIN && f != FD_FOR_STDOUT) {
       if (DBG_IOBUF) log_debug("%s: close fd/handle %d\n", a->fname, FD2INT(f));
       if (!a->keep_open) fd_cache_close(a->no_cache ? NULL : a->fname, f);
@@ -944,6 +1249,15 @@ int iobuf_is_pipe_filename(const char *fname) {
   return 0;
 }
 
+/* Return the size of the internal buffer to use for reading a file
+   of FILELEN bytes.  */
+static size_t buffer_size_for_file(off_t filelen) {
+  size_t size = IOBUF_BUFFER_SIZE;
+
+  while (size < IOBUF_MAX_BUFFER_SIZE && (off_t)size * 64 < filelen) size *= 2;
+  return size;
+}
+
 static iobuf_t do_open(const char *fname, int special_filenames, int use,
                        const char *opentype, int mode700) {
   iobuf_t a;
@@ -986,6 +1300,15 @@ static iobuf_t do_open(const char *fname, int special_filenames, int use,
   a->filter = file_filter;
   a->filter_ov = fcx;
   file_filter(fcx, IOBUFCTRL_INIT, NULL, NULL, &len);
+  if (use == IOBUF_INPUT && !print_only) {
+    size_t size = buffer_size_for_file(iobuf_get_filelength(a, NULL));
+
+    if (size > a->d.size) {
+      xfree(a->d.buf);
+      a->d.buf = (byte *)xmalloc(size);
+      a->d.size = size;
+    }
+  }
   if (DBG_IOBUF)
     log_debug("iobuf-%d.%d: open '%s' desc=%s fd=%d\n", a->no, a->subno, fname,
               iobuf_desc(a, desc), FD2INT(fcx->fp));
@@ -1131,6 +1454,24 @@ int iobuf_ioctl(iobuf_t a, iobuf_ioctl_t cmd, int intval, void *ptrval) {
         return 0;
       }
 #endif
+  } else if (cmd == IOBUF_IOCTL_ASYNC) {
+    if (DBG_IOBUF)
+      log_debug("iobuf-%d.%d: ioctl '%s' async=%d\n", a ? a->no : -1,
+                a ? a->subno : -1, iobuf_desc(a, desc), intval);
+    if (!intval) return -1; /* Can't be switched off.  */
+    for (; a; a = a->chain)
+      if (!a->chain && a->filter == file_filter &&
+          (a->use == IOBUF_INPUT || a->use == IOBUF_OUTPUT))
+      {
+        file_filter_ctx_t *b = (file_filter_ctx_t *)a->filter_ov;
+
+        if (b->async) return 0;
+        if (async_io_start(&b->async, a->use, b->fp, NULL)) {
+          log_info("%s: can't start I/O thread\n", b->fname);
+          return -1;
+        }
+        return 0;
+      }
   } else if (cmd == IOBUF_IOCTL_FSYNC) {
     /* Do a fsync on the open fd and return any errors to the caller
        of iobuf_ioctl.  Note that we work on a file name here. */
@@ -1156,6 +1497,19 @@ int iobuf_push_filter(iobuf_t a,
   return iobuf_push_filter2(a, f, ov, 0);
 }
 
+int iobuf_push_thread_filter(iobuf_t a) {
+  struct async_io_s **r_as;
+  int rc;
+
+  if (a->use != IOBUF_OUTPUT) return GPG_ERR_NOT_SUPPORTED;
+
+  r_as = (struct async_io_s **)xtrycalloc(1, sizeof *r_as);
+  if (!r_as) return gpg_error_from_syserror();
+  rc = iobuf_push_filter2(a, thread_filter, r_as, 0);
+  if (rc) xfree(r_as);
+  return rc;
+}
+
 int iobuf_push_filter2(iobuf_t a,
                        int (*f)(void *opaque, int control, iobuf_t chain,
                                 byte *buf, size_t *len),
@@ -1442,19 +1796,27 @@ static int underflow_target(iobuf_t a, int clear_pending_eof, size_t target) {
   /* We have a filter function and the last time we tried to read we
      didn't get an EOF or an error.  Try to fill the buffer.  */
   {
+    /* If the caller supplied a buffer (see iobuf_read) and nothing
+       is buffered, let the filter write directly into it.  */
+    int external = a->e_d.buf && a->d.len == 0;
+
     /* Be careful to account for any buffered data.  */
-    len = a->d.size - a->d.len;
+    len = external ? a->e_d.size : a->d.size - a->d.len;
     if (DBG_IOBUF)
-      log_debug("iobuf-%d.%d: underflow: A->FILTER (%lu bytes)\n", a->no,
-                a->subno, (unsigned long)len);
+      log_debug("iobuf-%d.%d: underflow: A->FILTER (%lu bytes%s)\n", a->no,
+                a->subno, (unsigned long)len, external ? ", external" : "");
     if (len == 0)
       /* There is no space for more data.  Don't bother calling
          A->FILTER.  */
       rc = 0;
     else
       rc = a->filter(a->filter_ov, IOBUFCTRL_UNDERFLOW, a->chain,
-                     &a->d.buf[a->d.len], &len);
-    a->d.len += len;
+                     external ? a->e_d.buf : &a->d.buf[a->d.len], &len);
+    if (external) {
+      a->e_d.len = len;
+      a->e_d.used = 1;
+    } else
+      a->d.len += len;
 
     if (DBG_IOBUF)
       log_debug(
@@ -1481,7 +1843,7 @@ static int underflow_target(iobuf_t a, int clear_pending_eof, size_t target) {
       a->filter = NULL;
       a->filter_eof = 1;
 
-      if (clear_pending_eof && a->d.len == 0 && a->chain)
+      if (clear_pending_eof && a->d.len == 0 && !a->e_d.len && a->chain)
       /* We don't need to keep this filter around at all:
 
            - we got an EOF
@@ -1503,7 +1865,7 @@ static int underflow_target(iobuf_t a, int clear_pending_eof, size_t target) {
         print_chain(a);
 
         return -1;
-      } else if (a->d.len == 0)
+      } else if (a->d.len == 0 && !a->e_d.len)
         /* We can't unlink this filter (it is the only one in the
            pipeline), but we can immediately return EOF.  */
         return -1;
@@ -1512,12 +1874,16 @@ static int underflow_target(iobuf_t a, int clear_pending_eof, size_t target) {
     {
       a->error = rc;
 
-      if (a->d.len == 0)
+      if (a->d.len == 0 && !a->e_d.len)
         /* There is no buffered data.  Immediately return EOF.  */
         return -1;
     }
   }
 
+  /* The data went to the caller's buffer; there is no byte to
+     return.  */
+  if (a->e_d.used) return a->e_d.len ? 0 : -1;
+
   assert(a->d.start <= a->d.len);
   if (a->d.start < a->d.len) return a->d.buf[a->d.start++];
 
@@ -1530,7 +1896,9 @@ static int filter_flush(iobuf_t a) {
   int rc;
 
   if (a->use == IOBUF_OUTPUT_TEMP) { /* increase the temp buffer */
-    size_t newsize = a->d.size + IOBUF_BUFFER_SIZE;
+    /* Grow geometrically so that building a large temp buffer does
+       not copy its contents over and over again.  */
+    size_t newsize = a->d.size * 2;
 
     if (DBG_IOBUF)
       log_debug("increasing temp iobuf from %lu to %lu\n",
@@ -1618,7 +1986,40 @@ int iobuf_read(iobuf_t a, void *buffer, unsigned int buflen) {
       a->d.start += size;
       if (buf) buf += size;
     }
-    if (n < buflen)
+    if (n < buflen && buf && buflen - n >= a->d.size) {
+      /* The internal buffer is empty and the rest of the request
+         does not fit into it anyway.  Let the filter fill BUFFER
+         directly instead of copying the data through A->D.  If the
+         filter itself reads from its chain with iobuf_read, the
+         same applies down the pipeline.  */
+      size_t len;
+      int used;
+
+      a->e_d.buf = buf;
+      a->e_d.size = buflen - n;
+      a->e_d.len = 0;
+      a->e_d.used = 0;
+      c = underflow(a, 1);
+      /* Note: A might have been replaced by its chain in underflow,
+         which only happens if nothing was read.  */
+      used = a->e_d.used;
+      len = a->e_d.len;
+      a->e_d.buf = NULL;
+      a->e_d.size = 0;
+      a->e_d.len = 0;
+      a->e_d.used = 0;
+      if (used && len) {
+        n += len;
+        buf += len;
+        continue;
+      }
+      if (c == -1) {
+        a->nbytes += n;
+        return n ? n : -1 /*EOF*/;
+      }
+      *buf++ = c;
+      n++;
+    } else if (n < buflen)
     /* Draining the internal buffer didn't fill BUFFER.  Call
        underflow to read more data into the filter's internal
        buffer.  */
@@ -1696,6 +2097,25 @@ int iobuf_write(iobuf_t a, const void *buffer, unsigned int buflen) {
     return -1;
   }
 
+  if (a->use == IOBUF_OUTPUT && a->filter == file_filter && !a->d.len &&
+      buflen >= a->d.size) {
+    /* Nothing is buffered and the data would fill the buffer
+       anyway: hand BUF directly to the file filter.  This is only
+       done for the file filter because it does not modify the data,
+       whereas other filters (e.g. the cipher filter) transform their
+       buffer in place.  Those filters pass their own buffer down the
+       chain with iobuf_write and thus end up here without a copy.  */
+    size_t len = buflen;
+
+    rc = a->filter(a->filter_ov, IOBUFCTRL_FLUSH, a->chain, (byte *)buf, &len);
+    if (!rc && len != buflen) {
+      log_info("iobuf_write did not write all!\n");
+      rc = GPG_ERR_INTERNAL;
+    } else if (rc)
+      a->error = rc;
+    return rc;
+  }
+
   do {
     if (buflen && a->d.len < a->d.size) {
       unsigned size = a->d.size - a->d.len;
@@ -1888,6 +2308,15 @@ int iobuf_seek(iobuf_t a, off_t newpos) {
 
     b = (file_filter_ctx_t *)a->filter_ov;
 
+    /* Read-ahead data is worthless after a seek and pending writes
+       must go to the old position.  */
+    if (b->async) {
+      int rc = async_io_stop(b->async, b);
+
+      b->async = NULL;
+      if (rc) return -1;
+    }
+
 #ifdef HAVE_W32_SYSTEM
     if (SetFilePointer(b->fp, newpos, NULL, FILE_BEGIN) == 0xffffffff) {
       log_error("SetFilePointer failed on handle %p: ec=%d\n", b->fp,
@@ -1902,8 +2331,11 @@ int iobuf_seek(iobuf_t a, off_t newpos) {
 #endif
     /* Discard the buffer it is not a temp stream.  */
     a->d.len = 0;
-  }
-  a->d.start = 0;
+  } else if (a->use == IOBUF_INPUT_TEMP &&
+             (newpos < 0 || (size_t)newpos > a->d.len))
+    return -1;
+  /* A temp input stream is read from the buffer at NEWPOS.  */
+  a->d.start = a->use == IOBUF_INPUT_TEMP ? newpos : 0;
   a->nbytes = 0;
   a->nlimit = 0;
   a->nofast = 0;
@@ -2016,9 +2448,26 @@ unsigned int iobuf_read_line(iobuf_t a, byte **addr_of_buffer,
   }
 
   p = buffer;
-  while ((c = iobuf_get(a)) != -1) {
-    *p++ = c;
-    nbytes++;
+  for (;;) {
+    if (!a->nofast && a->d.start < a->d.len) {
+      /* Copy up to the next newline straight from the buffer.  */
+      size_t n = a->d.len - a->d.start;
+      byte *nl;
+
+      if (n > length - 1 - nbytes) n = length - 1 - nbytes;
+      nl = (byte *)memchr(a->d.buf + a->d.start, '\n', n);
+      if (nl) n = nl - (a->d.buf + a->d.start) + 1;
+      memcpy(p, a->d.buf + a->d.start, n);
+      a->d.start += n;
+      a->nbytes += n;
+      p += n;
+      nbytes += n;
+      c = p[-1];
+    } else if ((c = iobuf_get(a)) != -1) {
+      *p++ = c;
+      nbytes++;
+    } else
+      break;
     if (c == '\n') break;
 
     if (nbytes == length - 1)
@@ -113,7 +113,8 @@ typedef enum {
   IOBUF_IOCTL_KEEP_OPEN = 1,        /* Uses intval.  */
   IOBUF_IOCTL_INVALIDATE_CACHE = 2, /* Uses ptrval.  */
   IOBUF_IOCTL_NO_CACHE = 3,         /* Uses intval.  */
-  IOBUF_IOCTL_FSYNC = 4             /* Uses ptrval.  */
+  IOBUF_IOCTL_FSYNC = 4,            /* Uses ptrval.  */
+  IOBUF_IOCTL_ASYNC = 5             /* Uses intval.  */
 } iobuf_ioctl_t;
 
 enum iobuf_use {
@@ -195,6 +196,21 @@ struct iobuf_struct {
     byte *buf;
   } d;
 
+  /* A buffer supplied by the caller of iobuf_read.  For large reads
+     with an empty internal buffer, the data is read by FILTER
+     directly into this buffer instead of D.  BUF is NULL if not
+     used.  */
+  struct {
+    /* Size of the buffer.  */
+    size_t size;
+    /* The number of bytes read into the buffer.  */
+    size_t len;
+    /* Whether FILTER was called with the buffer.  */
+    int used;
+    /* The buffer itself.  */
+    byte *buf;
+  } e_d;
+
   /* When FILTER is called to read some data, it may read some data
      and then return EOF.  We can't return the EOF immediately.
      Instead, we note that we observed the EOF and when the buffer is
@@ -312,7 +328,12 @@ iobuf_t iobuf_esopen(estream_t estream, const char *mode, int keep_open);
 iobuf_t iobuf_sockopen(int fd, const char *mode);
 
 /* Set various options / perform different actions on a PIPELINE.  See
-   the IOBUF_IOCTL_* macros above.  */
+   the IOBUF_IOCTL_* macros above.
+
+   IOBUF_IOCTL_ASYNC with a non-zero INTVAL moves the reads (or
+   writes) of the file at the end of the pipeline to an I/O thread,
+   which reads ahead (or writes behind) while the filters run.  It
+   stays on until the pipeline is closed or the file is seeked.  */
 int iobuf_ioctl(iobuf_t a, iobuf_ioctl_t cmd, int intval, void *ptrval);
 
 /* Close a pipeline.  The filters in the pipeline are first flushed
@@ -397,6 +418,14 @@ int iobuf_push_filter2(iobuf_t a,
                                 byte *buf, size_t *len),
                        void *ov, int rel_ov);
 
+/* Push a filter onto the output pipeline A which hands the data
+   written to A over to a new thread.  The rest of the pipeline then
+   runs on that thread, so that pushing such a filter above each
+   stage runs the stages in parallel.  The data reaching the end of
+   the pipeline is the same.  If the thread can't be started, the
+   filter just passes the data on.  */
+int iobuf_push_thread_filter(iobuf_t a);
+
 /* Pop the top filter.  The top filter must have the filter function F
    and the cookie OV.  The cookie check is ignored if OV is NULL.  */
 int iobuf_pop_filter(iobuf_t a, int (*f)(void *opaque, int control,
@@ -442,6 +471,10 @@ off_t iobuf_tell(iobuf_t a);
      That is, data is appended to the buffer and the seek does not
      cause the size of the buffer to grow.
 
+   - If A is an INPUT_TEMP pipeline, then reading continues at offset
+     NEWPOS of the buffer.  -1 is returned if NEWPOS is beyond the end
+     of the buffer.
+
    If no error occurred, then any limit previous set by
    iobuf_set_limit() is cleared.  Further, any error on the filter
    (the file filter or the temp filter) is cleared.
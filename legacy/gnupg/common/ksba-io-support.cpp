@@ -38,6 +38,11 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <neopg/utils/base64.h>
+
+#include <algorithm>
+#include <stdexcept>
+
 #include "ksba-io-support.h"
 #include "util.h"
 
@@ -47,10 +52,23 @@
 #define LF "\n"
 #endif
 
+/* The number of base64 lines encoded at once by the writer.  */
+#define BASE64_LINES 64
+
+/* The size of the buffers for reading and writing.  */
+static size_t io_buffer_size = GNUPG_KSBA_IO_BUFSIZE;
+
 /* Data used by the reader callbacks.  */
 struct reader_cb_parm_s {
   estream_t fp;
 
+  /* Input read from FP in large chunks.  Only used by the base64
+     reader.  */
+  unsigned char *inbuf;
+  size_t insize;
+  size_t inlen;
+  size_t inpos;
+
   unsigned char line[1024];
   int linelen;
   int readpos;
@@ -155,38 +173,99 @@ static int is_empty_line(const unsigned char *line, int linelen) {
   return 0;
 }
 
+/* Refill the input buffer of PARM, which must be empty.  At EOF the
+   buffer is left empty and EOF_SEEN is set.  Returns -1 on a read
+   error.  */
+static int fill_input(struct reader_cb_parm_s *parm) {
+  size_t n;
+  int rc;
+
+  rc = es_read(parm->fp, parm->inbuf, parm->insize, &n);
+  parm->inpos = 0;
+  parm->inlen = rc ? 0 : n;
+  if (rc || !n) parm->eof_seen = 1;
+  return rc ? -1 : 0;
+}
+
+/* Read an entire line or up to the size of the line buffer from the
+   input of PARM.  Returns -1 on a read error.  */
+static int read_line(struct reader_cb_parm_s *parm) {
+  const unsigned char *p, *lf;
+  size_t n = 0, len;
+
+  parm->line_counter++;
+  parm->have_lf = 0;
+  while (n < DIM(parm->line)) {
+    if (parm->inpos == parm->inlen) {
+      if (fill_input(parm)) return -1;
+      if (!parm->inlen) break; /* eof */
+    }
+    p = parm->inbuf + parm->inpos;
+    len = std::min(parm->inlen - parm->inpos, DIM(parm->line) - n);
+    lf = (const unsigned char *)memchr(p, '\n', len);
+    if (lf) len = lf - p + 1;
+    memcpy(parm->line + n, p, len);
+    n += len;
+    parm->inpos += len;
+    if (lf) {
+      parm->have_lf = 1;
+      /* Fixme: we need to skip overlong lines while detecting
+         the dashed lines */
+      break;
+    }
+  }
+  parm->linelen = n;
+  parm->readpos = 0;
+  return 0;
+}
+
+/* Decode the line in PARM to BUFFER, which has room for COUNT bytes,
+   if it is plain base64 without padding or whitespace other than at
+   its end, as nearly all lines are.  Return the number of bytes
+   decoded.  The rest of the line is left to the caller.  */
+static size_t base64_decode_line(struct reader_cb_parm_s *parm, char *buffer,
+                                 size_t count) {
+  const char *line = (const char *)parm->line;
+  size_t len = parm->linelen;
+  size_t n;
+
+  while (len && (line[len - 1] == '\n' || line[len - 1] == '\r' ||
+                 line[len - 1] == ' ' || line[len - 1] == '\t'))
+    len--;
+  len &= ~(size_t)3;
+  if (len > count / 3 * 4) len = count / 3 * 4;
+  if (!len || memchr(line, '=', len)) return 0;
+
+  try {
+    n = NeoPG::base64_decode(line, len, (uint8_t *)buffer);
+  } catch (const std::exception &) {
+    /* The caller skips the invalid characters.  */
+    return 0;
+  }
+  parm->readpos = len;
+  return n;
+}
+
+/* Return up to COUNT bytes of the decoded input in BUFFER.  Lines are
+   processed until BUFFER is full, so that the ksba reader is called
+   back only once per buffer.  */
 static int base64_reader_cb(void *cb_value, char *buffer, size_t count,
                             size_t *nread) {
   struct reader_cb_parm_s *parm = (reader_cb_parm_s *)cb_value;
-  size_t n;
+  size_t n = 0;
   int c, c2;
 
   *nread = 0;
   if (!buffer) return -1; /* not supported */
 
 next:
+  if (n == count) goto leave;
   if (!parm->linelen) {
-    /* read an entire line or up to the size of the buffer */
-    parm->line_counter++;
-    parm->have_lf = 0;
-    for (n = 0; n < DIM(parm->line);) {
-      c = es_getc(parm->fp);
-      if (c == EOF) {
-        parm->eof_seen = 1;
-        if (es_ferror(parm->fp)) return -1;
-        break;
-      }
-      parm->line[n++] = c;
-      if (c == '\n') {
-        parm->have_lf = 1;
-        /* Fixme: we need to skip overlong lines while detecting
-           the dashed lines */
-        break;
-      }
+    if (read_line(parm)) return -1;
+    if (!parm->linelen) { /* eof */
+      if (!n) return -1;
+      goto leave;
     }
-    parm->linelen = n;
-    if (!n) return -1; /* eof */
-    parm->readpos = 0;
   }
 
   if (!parm->identified) {
@@ -242,10 +321,11 @@ next:
     parm->base64.idx = 0;
   }
 
-  n = 0;
   if (parm->is_pem || parm->is_base64) {
     if (parm->is_pem && parm->have_lf &&
         !strncmp((char *)parm->line, "-----END ", 9)) {
+      /* Return the bytes of this object before ending it.  */
+      if (n) goto leave;
       parm->identified = 0;
       parm->linelen = parm->readpos = 0;
 
@@ -269,6 +349,8 @@ next:
       int idx = parm->base64.idx;
       unsigned char val = parm->base64.val;
 
+      if (!idx && !parm->readpos)
+        n += base64_decode_line(parm, buffer + n, count - n);
       while (n < count && parm->readpos < parm->linelen) {
         c = parm->line[parm->readpos++];
         if (c == '\n' || c == ' ' || c == '\r' || c == '\t') continue;
@@ -308,11 +390,29 @@ next:
       parm->base64.val = val;
     }
   } else { /* DER encoded */
-    while (n < count && parm->readpos < parm->linelen)
-      buffer[n++] = parm->line[parm->readpos++];
+    size_t len;
+
+    len = std::min(count - n, (size_t)(parm->linelen - parm->readpos));
+    memcpy(buffer + n, parm->line + parm->readpos, len);
+    n += len;
+    parm->readpos += len;
     if (parm->readpos == parm->linelen) parm->linelen = parm->readpos = 0;
+
+    /* There are no lines in DER; copy straight from the input.  */
+    while (!parm->linelen && n < count) {
+      if (parm->inpos == parm->inlen) {
+        if (fill_input(parm)) return -1;
+        if (!parm->inlen) break; /* eof */
+      }
+      len = std::min(count - n, parm->inlen - parm->inpos);
+      memcpy(buffer + n, parm->inbuf + parm->inpos, len);
+      n += len;
+      parm->inpos += len;
+    }
   }
+  goto next;
 
+leave:
   *nread = n;
   return 0;
 }
@@ -321,31 +421,51 @@ static int simple_reader_cb(void *cb_value, char *buffer, size_t count,
                             size_t *nread) {
   struct reader_cb_parm_s *parm = (reader_cb_parm_s *)cb_value;
   size_t n;
-  int c = 0;
+  int rc;
 
   *nread = 0;
   if (!buffer) return -1; /* not supported */
 
-  for (n = 0; n < count; n++) {
-    c = es_getc(parm->fp);
-    if (c == EOF) {
-      parm->eof_seen = 1;
-      if (es_ferror(parm->fp)) return -1;
-      if (n) break; /* Return what we have before an EOF.  */
-      return -1;
-    }
-    *(byte *)buffer++ = c;
-  }
+  rc = es_read(parm->fp, buffer, count, &n);
+  if (rc || !n || es_feof(parm->fp)) parm->eof_seen = 1;
+  if (rc || !n) return -1;
 
   *nread = n;
   return 0;
 }
 
+/* Write as many full lines of base64 for the COUNT bytes at BUFFER
+   to STREAM as possible, starting a new line.  Return the number of
+   bytes encoded, a multiple of the 48 bytes per line.  */
+static size_t base64_write_lines(estream_t stream, const unsigned char *buffer,
+                                 size_t count) {
+  char line[BASE64_LINES * 64];
+  char out[BASE64_LINES * (64 + sizeof LF)];
+  size_t done = 0;
+  size_t nlines, i;
+  char *p;
+
+  while (count - done >= 48) {
+    nlines = std::min((count - done) / 48, (size_t)BASE64_LINES);
+    NeoPG::base64_encode(buffer + done, nlines * 48, line);
+    for (p = out, i = 0; i < nlines; i++) {
+      memcpy(p, line + 64 * i, 64);
+      p += 64;
+      memcpy(p, LF, sizeof LF - 1);
+      p += sizeof LF - 1;
+    }
+    es_write(stream, out, p - out, NULL);
+    done += nlines * 48;
+  }
+  return done;
+}
+
 static int base64_writer_cb(void *cb_value, const void *buffer, size_t count) {
   struct writer_cb_parm_s *parm = (writer_cb_parm_s *)cb_value;
   unsigned char radbuf[4];
   int i, c, idx, quad_count;
   const unsigned char *p;
+  size_t n;
   estream_t stream = parm->stream;
 
   if (!count) return 0;
@@ -366,6 +486,12 @@ static int base64_writer_cb(void *cb_value, const void *buffer, size_t count) {
   for (i = 0; i < idx; i++) radbuf[i] = parm->base64.radbuf[i];
 
   for (p = (const unsigned char *)buffer; count; p++, count--) {
+    if (!idx && !quad_count && count >= 48) {
+      n = base64_write_lines(stream, p, count);
+      p += n;
+      count -= n;
+      if (!count) break;
+    }
     radbuf[idx++] = *p;
     if (idx > 2) {
       idx = 0;
@@ -448,6 +574,20 @@ static int base64_finish_write(struct writer_cb_parm_s *parm) {
   return es_ferror(stream) ? gpg_error_from_syserror() : 0;
 }
 
+/* Set the size of the buffers used by the readers and writers created
+   from now on to SIZE bytes.  A SIZE of 0 restores the default; sizes
+   below 4 KiB are rounded up.  */
+void gnupg_ksba_set_io_buffer_size(size_t size) {
+  if (!size)
+    size = GNUPG_KSBA_IO_BUFSIZE;
+  else if (size < 4096)
+    size = 4096;
+  io_buffer_size = size;
+}
+
+/* Return the size of the buffers for reading and writing.  */
+size_t gnupg_ksba_get_io_buffer_size(void) { return io_buffer_size; }
+
 /* Create a reader for the stream FP.  FLAGS can be used to specify
  * the expected input encoding.
  *
@@ -499,8 +639,17 @@ gpg_error_t gnupg_ksba_create_reader(gnupg_ksba_io_t *ctx, unsigned int flags,
   } else
     rc = ksba_reader_set_cb(r, simple_reader_cb, &(*ctx)->u.rparm);
 
+  if (!rc && (flags & (GNUPG_KSBA_IO_PEM | GNUPG_KSBA_IO_BASE64 |
+                       GNUPG_KSBA_IO_AUTODETECT))) {
+    (*ctx)->u.rparm.insize = io_buffer_size;
+    (*ctx)->u.rparm.inbuf = (unsigned char *)xtrymalloc(io_buffer_size);
+    if (!(*ctx)->u.rparm.inbuf) rc = gpg_error_from_syserror();
+  }
+  if (!rc) rc = ksba_reader_set_bufsize(r, io_buffer_size);
+
   if (rc) {
     ksba_reader_release(r);
+    xfree((*ctx)->u.rparm.inbuf);
     xfree(*ctx);
     *ctx = NULL;
     return rc;
@@ -511,9 +660,14 @@ gpg_error_t gnupg_ksba_create_reader(gnupg_ksba_io_t *ctx, unsigned int flags,
   return 0;
 }
 
-/* Return True if an EOF as been seen.  */
+/* Return True if an EOF as been seen and the reader has no more
+   buffered bytes.  */
 int gnupg_ksba_reader_eof_seen(gnupg_ksba_io_t ctx) {
-  return ctx && ctx->u.rparm.eof_seen;
+  size_t n;
+
+  if (!ctx || !ctx->u.rparm.eof_seen) return 0;
+  if (!ksba_reader_read(ctx->u2.reader, NULL, 0, &n) && n) return 0;
+  return 1;
 }
 
 /* Destroy a reader object.  */
@@ -521,6 +675,7 @@ void gnupg_ksba_destroy_reader(gnupg_ksba_io_t ctx) {
   if (!ctx) return;
 
   ksba_reader_release(ctx->u2.reader);
+  xfree(ctx->u.rparm.inbuf);
   xfree(ctx);
 }
 
@@ -577,6 +732,8 @@ gpg_error_t gnupg_ksba_create_writer(gnupg_ksba_io_t *ctx, unsigned int flags,
   } else
     rc = GPG_ERR_INV_ARG;
 
+  if (!rc) rc = ksba_writer_set_bufsize(w, io_buffer_size);
+
   if (rc) {
     ksba_writer_release(w);
     xfree(*ctx);
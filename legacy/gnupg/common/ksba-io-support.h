@@ -40,9 +40,15 @@
 #define GNUPG_KSBA_IO_AUTODETECT 4 /* Try to autodetect the format.  */
 #define GNUPG_KSBA_IO_MULTIPEM 8   /* Allow more than one PEM chunk.  */
 
+/* The default size of the buffers for reading and writing.  */
+#define GNUPG_KSBA_IO_BUFSIZE 65536
+
 /* Context object.  */
 typedef struct gnupg_ksba_io_s *gnupg_ksba_io_t;
 
+void gnupg_ksba_set_io_buffer_size(size_t size);
+size_t gnupg_ksba_get_io_buffer_size(void);
+
 gpg_error_t gnupg_ksba_create_reader(gnupg_ksba_io_t *ctx, unsigned int flags,
                                      estream_t fp, ksba_reader_t *r_reader);
 
@@ -55,6 +55,14 @@
 #include <unistd.h>
 /* #include <execinfo.h> */
 
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <spdlog/async_logger.h>
+#include <spdlog/sinks/base_sink.h>
+
 #define GNUPG_COMMON_NEED_AFLOCAL 1
 #include "common-defs.h"
 #include "logging.h"
@@ -108,6 +116,72 @@ static int force_prefixes;
 static int missing_lf;
 static int errorcount;
 
+/* Protects MISSING_LF and the order of the records.  */
+static std::mutex log_mutex;
+
+/* The background writer, if enabled with log_set_async.  It is only
+ * used by the process that enabled it, as a forked child does not
+ * have the thread.  */
+static std::shared_ptr<spdlog::async_logger> async_logger;
+static pid_t async_pid;
+static size_t async_queue_size;
+static int async_overflow;
+
+/* Write the formatted records, which are passed as the raw message,
+ * to the log stream.  */
+class logstream_sink : public spdlog::sinks::base_sink<std::mutex> {
+ protected:
+  void _sink_it(const spdlog::details::log_msg &msg) override {
+    es_fwrite(msg.raw.data(), 1, msg.raw.size(), logstream);
+  }
+
+  void _flush() override { es_fflush(logstream); }
+};
+
+/* Write the record REC directly to the log stream.  */
+static void write_record(const std::string &rec) {
+  es_fwrite(rec.data(), 1, rec.size(), logstream);
+}
+
+/* Wait until the background writer has written all queued records.
+ * The caller must hold LOG_MUTEX.  */
+static void flush_async(void) {
+  if (async_logger && getpid() == async_pid) async_logger->flush();
+}
+
+/* Start the background writer with the current settings.  The caller
+ * must hold LOG_MUTEX.  */
+static void start_async(void) {
+  size_t size = 1;
+
+  /* The queue size must be a power of two.  */
+  while (size < async_queue_size) size <<= 1;
+  try {
+    async_logger = std::make_shared<spdlog::async_logger>(
+        "legacy", std::make_shared<logstream_sink>(), size,
+        async_overflow == LOG_OVERFLOW_DISCARD
+            ? spdlog::async_overflow_policy::discard_log_msg
+            : spdlog::async_overflow_policy::block_retry,
+        nullptr, std::chrono::seconds(1));
+    async_logger->set_level(spdlog::level::trace);
+    async_pid = getpid();
+  } catch (const std::exception &) {
+    /* Keep writing directly.  */
+    async_logger.reset();
+  }
+}
+
+/* Stop the background writer after it has written all queued records.
+ * The caller must hold LOG_MUTEX.  */
+static void stop_async(void) {
+  if (async_logger && getpid() == async_pid) async_logger.reset();
+}
+
+static void stop_async_atexit(void) {
+  std::lock_guard<std::mutex> lock(log_mutex);
+  stop_async();
+}
+
 int log_get_errorcount(int clear) {
   int n = errorcount;
   if (clear) errorcount = 0;
@@ -191,6 +265,11 @@ static int fun_closer(void *cookie_arg) {
 static void set_file_fd(const char *name, int fd) {
   estream_t fp;
   struct fun_cookie_s *cookie;
+  std::lock_guard<std::mutex> lock(log_mutex);
+  bool restart_async = async_logger && getpid() == async_pid;
+
+  /* The background writer must not use the old stream.  */
+  stop_async();
 
   /* Close an open log stream.  */
   if (logstream) {
@@ -239,6 +318,8 @@ static void set_file_fd(const char *name, int fd) {
   logstream = fp;
 
   missing_lf = 0;
+
+  if (restart_async) start_async();
 }
 
 /* Set the file to write log to.  The special names NULL and "-" may
@@ -313,10 +394,71 @@ estream_t log_get_stream() {
     log_set_file(NULL); /* Make sure a log stream has been set.  */
     assert(logstream);
   }
+  /* The caller writes directly, so queued records must come first.  */
+  std::lock_guard<std::mutex> lock(log_mutex);
+  flush_async();
   return logstream;
 }
 
-static void print_prefix(int level, int leading_backspace) {
+/* Write the log from a background thread with a queue of QUEUE_SIZE
+ * records (rounded up to a power of two), so that logging does not
+ * wait for the log file or socket.  OVERFLOW is one of the
+ * LOG_OVERFLOW_ values and selects what happens if the queue is full.
+ * A QUEUE_SIZE of 0 writes the queued records and returns to writing
+ * directly.  Fatal errors and bugs are always written directly, after
+ * the queued records.  */
+void log_set_async(size_t queue_size, int overflow) {
+  static int atexit_registered;
+
+  if (!logstream) {
+    log_set_file(NULL); /* Make sure a log stream has been set.  */
+    assert(logstream);
+  }
+
+  std::lock_guard<std::mutex> lock(log_mutex);
+  stop_async();
+  async_queue_size = queue_size;
+  async_overflow = overflow;
+  if (!queue_size) return;
+
+  if (!atexit_registered) {
+    atexit(stop_async_atexit);
+    atexit_registered = 1;
+  }
+  start_async();
+}
+
+/* Return the LOG_OVERFLOW_ value for NAME ("block" or "discard"), or
+ * -1 if NAME is not valid.  */
+int log_parse_overflow(const char *name) {
+  if (!strcmp(name, "block")) return LOG_OVERFLOW_BLOCK;
+  if (!strcmp(name, "discard")) return LOG_OVERFLOW_DISCARD;
+  return -1;
+}
+
+/* Records are formatted completely into a buffer before they are
+ * written, so that each record is written with one call, either
+ * directly or by the background writer (see log_set_async).  */
+static void rec_puts(std::string &rec, const char *string) { rec += string; }
+
+static void rec_vprintf(std::string &rec, const char *fmt, va_list arg_ptr) {
+  char *buf;
+  int len = es_vasprintf(&buf, fmt, arg_ptr);
+
+  if (len < 0) return;
+  rec.append(buf, len);
+  es_free(buf);
+}
+
+static void rec_printf(std::string &rec, const char *fmt, ...) {
+  va_list arg_ptr;
+
+  va_start(arg_ptr, fmt);
+  rec_vprintf(rec, fmt, arg_ptr);
+  va_end(arg_ptr);
+}
+
+static void print_prefix(std::string &rec, int level, int leading_backspace) {
   if (level != GPGRT_LOG_CONT) { /* Note this does not work for multiple line
                                   * logging as we would
                                   * need to print to a buffer first */
@@ -325,29 +467,28 @@ static void print_prefix(int level, int leading_backspace) {
       time_t atime = time(NULL);
 
       tp = localtime(&atime);
-      es_fprintf_unlocked(logstream, "%04d-%02d-%02d %02d:%02d:%02d ",
-                          1900 + tp->tm_year, tp->tm_mon + 1, tp->tm_mday,
-                          tp->tm_hour, tp->tm_min, tp->tm_sec);
+      rec_printf(rec, "%04d-%02d-%02d %02d:%02d:%02d ", 1900 + tp->tm_year,
+                 tp->tm_mon + 1, tp->tm_mday, tp->tm_hour, tp->tm_min,
+                 tp->tm_sec);
     }
-    if (with_prefix || force_prefixes)
-      es_fputs_unlocked(prefix_buffer, logstream);
+    if (with_prefix || force_prefixes) rec_puts(rec, prefix_buffer);
     if (with_pid || force_prefixes) {
       unsigned long pidsuf;
       int pidfmt;
 
       if (get_pid_suffix_cb && (pidfmt = get_pid_suffix_cb(&pidsuf)))
-        es_fprintf_unlocked(logstream, pidfmt == 1 ? "[%u.%lu]" : "[%u.%lx]",
-                            (unsigned int)getpid(), pidsuf);
+        rec_printf(rec, pidfmt == 1 ? "[%u.%lu]" : "[%u.%lx]",
+                   (unsigned int)getpid(), pidsuf);
       else
-        es_fprintf_unlocked(logstream, "[%u]", (unsigned int)getpid());
+        rec_printf(rec, "[%u]", (unsigned int)getpid());
     }
     if ((!with_time && (with_prefix || with_pid)) || force_prefixes)
-      es_putc_unlocked(':', logstream);
+      rec += ':';
     /* A leading backspace suppresses the extra space so that we can
        correctly output, programname, filename and linenumber. */
     if (!leading_backspace &&
         (with_time || with_prefix || with_pid || force_prefixes))
-      es_putc_unlocked(' ', logstream);
+      rec += ' ';
   }
 
   switch (level) {
@@ -362,16 +503,16 @@ static void print_prefix(int level, int leading_backspace) {
     case GPGRT_LOG_ERROR:
       break;
     case GPGRT_LOG_FATAL:
-      es_fputs_unlocked("Fatal: ", logstream);
+      rec_puts(rec, "Fatal: ");
       break;
     case GPGRT_LOG_BUG:
-      es_fputs_unlocked("Ohhhh jeeee: ", logstream);
+      rec_puts(rec, "Ohhhh jeeee: ");
       break;
     case GPGRT_LOG_DEBUG:
-      es_fputs_unlocked("DBG: ", logstream);
+      rec_puts(rec, "DBG: ");
       break;
     default:
-      es_fprintf_unlocked(logstream, "[Unknown log level %d]: ", level);
+      rec_printf(rec, "[Unknown log level %d]: ", level);
       break;
   }
 }
@@ -379,6 +520,7 @@ static void print_prefix(int level, int leading_backspace) {
 static void do_logv(int level, int ignore_arg_ptr, const char *extrastring,
                     const char *prefmt, const char *fmt, va_list arg_ptr) {
   int leading_backspace = (fmt && *fmt == '\b');
+  std::string rec;
 
   if (!logstream) {
 #ifdef HAVE_W32_SYSTEM
@@ -395,15 +537,15 @@ static void do_logv(int level, int ignore_arg_ptr, const char *extrastring,
     assert(logstream);
   }
 
-  es_flockfile(logstream);
-  if (missing_lf && level != GPGRT_LOG_CONT) es_putc_unlocked('\n', logstream);
+  std::unique_lock<std::mutex> lock(log_mutex);
+  if (missing_lf && level != GPGRT_LOG_CONT) rec += '\n';
   missing_lf = 0;
 
-  print_prefix(level, leading_backspace);
+  print_prefix(rec, level, leading_backspace);
   if (leading_backspace) fmt++;
 
   if (fmt) {
-    if (prefmt) es_fputs_unlocked(prefmt, logstream);
+    if (prefmt) rec_puts(rec, prefmt);
 
     if (ignore_arg_ptr) { /* This is used by log_string and comes with the extra
                            * feature that after a LF the next line is indent at
@@ -414,59 +556,59 @@ static void do_logv(int level, int ignore_arg_ptr, const char *extrastring,
                            * computation.  */
       const char *p, *pend;
 
-      for (p = fmt; (pend = strchr(p, '\n')); p = pend + 1)
-        es_fprintf_unlocked(logstream, "%*s%.*s",
-                            (int)((p != fmt && (with_prefix || force_prefixes))
-                                      ? strlen(prefix_buffer) + 2
-                                      : 0),
-                            "", (int)(pend - p) + 1, p);
-      es_fputs_unlocked(p, logstream);
+      for (p = fmt; (pend = strchr(p, '\n')); p = pend + 1) {
+        if (p != fmt && (with_prefix || force_prefixes))
+          rec.append(strlen(prefix_buffer) + 2, ' ');
+        rec.append(p, pend - p + 1);
+      }
+      rec_puts(rec, p);
     } else
-      es_vfprintf_unlocked(logstream, fmt, arg_ptr);
+      rec_vprintf(rec, fmt, arg_ptr);
     if (*fmt && fmt[strlen(fmt) - 1] != '\n') missing_lf = 1;
   }
 
   /* If we have an EXTRASTRING print it now while we still hold the
-   * lock on the logstream.  */
+   * lock on the log.  */
   if (extrastring) {
     int c;
 
     if (missing_lf) {
-      es_putc_unlocked('\n', logstream);
+      rec += '\n';
       missing_lf = 0;
     }
-    print_prefix(level, leading_backspace);
-    es_fputs_unlocked(">> ", logstream);
+    print_prefix(rec, level, leading_backspace);
+    rec_puts(rec, ">> ");
     missing_lf = 1;
     while ((c = *extrastring++)) {
       missing_lf = 1;
       if (c == '\\')
-        es_fputs_unlocked("\\\\", logstream);
+        rec_puts(rec, "\\\\");
       else if (c == '\r')
-        es_fputs_unlocked("\\r", logstream);
+        rec_puts(rec, "\\r");
       else if (c == '\n') {
-        es_fputs_unlocked("\\n\n", logstream);
+        rec_puts(rec, "\\n\n");
         if (*extrastring) {
-          print_prefix(level, leading_backspace);
-          es_fputs_unlocked(">> ", logstream);
+          print_prefix(rec, level, leading_backspace);
+          rec_puts(rec, ">> ");
         } else
           missing_lf = 0;
       } else
-        es_putc_unlocked(c, logstream);
+        rec += (char)c;
     }
     if (missing_lf) {
-      es_putc_unlocked('\n', logstream);
+      rec += '\n';
       missing_lf = 0;
     }
   }
 
-  if (level == GPGRT_LOG_FATAL) {
-    if (missing_lf) es_putc_unlocked('\n', logstream);
-    es_funlockfile(logstream);
-    exit(2);
-  } else if (level == GPGRT_LOG_BUG) {
-    if (missing_lf) es_putc_unlocked('\n', logstream);
-    es_funlockfile(logstream);
+  if (level == GPGRT_LOG_FATAL || level == GPGRT_LOG_BUG) {
+    /* The queue is written first, and this record directly, as the
+     * process ends now.  */
+    if (missing_lf) rec += '\n';
+    flush_async();
+    write_record(rec);
+    lock.unlock();
+    if (level == GPGRT_LOG_FATAL) exit(2);
     /* Using backtrace requires a configure test and to pass
      * -rdynamic to gcc.  Thus we do not enable it now.  */
     /* { */
@@ -481,8 +623,13 @@ static void do_logv(int level, int ignore_arg_ptr, const char *extrastring,
     /*       log_debug ("[%d] %s\n", btidx, btstr[btidx]); */
     /* } */
     abort();
-  } else
-    es_funlockfile(logstream);
+  }
+
+  if (rec.empty()) return;
+  if (async_logger && getpid() == async_pid)
+    async_logger->log(spdlog::level::info, rec.c_str());
+  else
+    write_record(rec);
 }
 
 void log_log(int level, const char *fmt, ...) {
@@ -585,7 +732,11 @@ void log_printf(const char *fmt, ...) {
 
 /* Flush the log - this is useful to make sure that the trailing
    linefeed has been printed.  */
-void log_flush(void) { do_log_ignore_arg(GPGRT_LOG_CONT, NULL); }
+void log_flush(void) {
+  do_log_ignore_arg(GPGRT_LOG_CONT, NULL);
+  std::lock_guard<std::mutex> lock(log_mutex);
+  flush_async();
+}
 
 /* Print a hexdump of BUFFER.  With TEXT of NULL print just the raw
    dump, with TEXT just an empty string, print a trailing linefeed,
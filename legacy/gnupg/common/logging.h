@@ -50,6 +50,15 @@ int log_test_fd(int fd);
 int log_get_fd(void);
 estream_t log_get_stream(void);
 
+/* Overflow policies for log_set_async.  */
+enum log_overflow_policies {
+  LOG_OVERFLOW_BLOCK = 0, /* Wait for room in the queue.  */
+  LOG_OVERFLOW_DISCARD    /* Drop the record.  */
+};
+
+void log_set_async(size_t queue_size, int overflow);
+int log_parse_overflow(const char *name);
+
 #ifdef GPGRT_HAVE_MACRO_FUNCTION
 void bug_at(const char *file, int line, const char *func) GPGRT_ATTR_NORETURN;
 void _log_assert(const char *expr, const char *file, int line,
@@ -50,6 +50,7 @@ typedef enum {
   PKT_ATTRIBUTE = 17,     /* PGP's attribute packet. */
   PKT_ENCRYPTED_MDC = 18, /* Integrity protected encrypted data. */
   PKT_MDC = 19,           /* Manipulation detection code packet. */
+  PKT_ENCRYPTED_AEAD = 20, /* AEAD encrypted data (RFC4880bis).  */
   PKT_COMMENT = 61,       /* new comment packet (GnuPG specific). */
   PKT_GPG_CONTROL = 63    /* internal control packet (GnuPG specific). */
 } pkttype_t;
@@ -92,6 +93,8 @@ static inline const char* pkttype_str(pkttype_t type) {
       return "ENCRYPTED_MDC";
     case PKT_MDC:
       return "MDC";
+    case PKT_ENCRYPTED_AEAD:
+      return "ENCRYPTED_AEAD";
     case PKT_COMMENT:
       return "COMMENT";
     case PKT_GPG_CONTROL:
@@ -152,6 +155,12 @@ typedef enum {
   CIPHER_ALGO_PRIVATE10 = 110
 } cipher_algo_t;
 
+typedef enum {
+  AEAD_ALGO_NONE = 0,
+  AEAD_ALGO_EAX = 1,
+  AEAD_ALGO_OCB = 2
+} aead_algo_t;
+
 typedef enum {
   PUBKEY_ALGO_RSA = 1,
   PUBKEY_ALGO_RSA_E = 2,      /* RSA encrypt only (legacy). */
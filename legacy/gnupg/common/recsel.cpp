@@ -55,42 +55,54 @@ typedef enum {
   SELECT_STRGT
 } select_op_t;
 
+/* The number of distinct properties whose values are remembered
+   during one call of recsel_select.  */
+#define MAX_CACHED_PROPS 16
+
 /* Definition for a select expression.  */
 struct recsel_expr_s {
   recsel_expr_t next;
-  select_op_t op;          /* Operation code.  */
-  unsigned int nonono : 1; /* Negate operators. */
-  unsigned int disjun : 1; /* Start of a disjunction.  */
-  unsigned int xcase : 1;  /* String match is case sensitive.  */
-  const char *value;       /* (Points into NAME.)  */
-  long numvalue;           /* strtol of VALUE.  */
-  char name[1];            /* Name of the property.  */
+  recsel_expr_t next_disjun; /* Start of the next disjunction or NULL.  */
+  select_op_t op;            /* Operation code.  */
+  unsigned int nonono : 1;   /* Negate operators. */
+  unsigned int disjun : 1;   /* Start of a disjunction.  */
+  unsigned int xcase : 1;    /* String match is case sensitive.  */
+  int slot;                  /* Index into the value cache or -1.  */
+  const char *value;         /* (Points into NAME.)  */
+  size_t valuelen;           /* strlen of VALUE.  */
+  long numvalue;             /* strtol of VALUE.  */
+  unsigned int *shift;       /* Horspool shift table for SELECT_SUB.  */
+  char name[1];              /* Name of the property.  */
 };
 
-/* This is a case-sensitive version of our memistr.  I wonder why no
- * standard function memstr exists but I better do not use the name
- * memstr to avoid future conflicts.
- *
- * FIXME: Move this to a stringhelp.c
- */
-static const char *my_memstr(const void *buffer, size_t buflen,
-                             const char *sub) {
+/* Return true if the substring of SE is found in {BUFFER,BUFLEN}.
+ * This is the Boyer-Moore-Horspool search with the shift table built
+ * by compile_selector.  Unless the match is case sensitive the value
+ * of SE has been lower cased and the buffer is lower cased on the
+ * fly.  */
+static int find_substring(recsel_expr_t se, const void *buffer,
+                          size_t buflen) {
   const unsigned char *buf = (const unsigned char *)buffer;
-  const unsigned char *t = (const unsigned char *)buf;
-  const unsigned char *s = (const unsigned char *)sub;
-  size_t n = buflen;
-
-  for (; n; t++, n--) {
-    if (*t == *s) {
-      for (buf = t++, buflen = n--, s++; n && *t == *s; t++, s++, n--)
-        ;
-      if (!*s) return (const char *)buf;
-      t = (const unsigned char *)buf;
-      s = (const unsigned char *)sub;
-      n = buflen;
+  const unsigned char *sub = (const unsigned char *)se->value;
+  size_t last = se->valuelen - 1;
+  size_t pos, i;
+  int c;
+
+  if (se->valuelen > buflen) return 0;
+
+  for (pos = 0; pos + last < buflen; pos += se->shift[c]) {
+    c = buf[pos + last];
+    if (!se->xcase) c = ascii_tolower(c);
+    if (c != sub[last]) continue;
+    for (i = last; i; i--) {
+      int c2 = buf[pos + i - 1];
+
+      if (!se->xcase) c2 = ascii_tolower(c2);
+      if (c2 != sub[i - 1]) break;
     }
+    if (!i) return 1;
   }
-  return NULL;
+  return 0;
 }
 
 /* Return a pointer to the next logical connection operator or NULL if
@@ -107,6 +119,41 @@ static char *find_next_lc(char *string) {
   return p1 < p2 ? p1 : p2;
 }
 
+/* Prepare the complete list of expressions SELECTOR for
+ * recsel_select: link every expression to the start of the next
+ * disjunction, give all expressions with the same property name the
+ * same slot in the value cache and build the tables for the substring
+ * searches.  */
+static gpg_error_t compile_selector(recsel_expr_t selector) {
+  recsel_expr_t se, se2;
+  int nslots = 0;
+  size_t i;
+
+  for (se = selector; se; se = se->next) {
+    for (se2 = se->next; se2 && !se2->disjun; se2 = se2->next)
+      ;
+    se->next_disjun = se2;
+
+    for (se2 = selector; se2 != se && strcmp(se2->name, se->name);
+         se2 = se2->next)
+      ;
+    if (se2 != se)
+      se->slot = se2->slot;
+    else
+      se->slot = nslots < MAX_CACHED_PROPS ? nslots++ : -1;
+
+    if (se->op == SELECT_SUB && !se->shift) {
+      se->shift = (unsigned int *)xtrymalloc(256 * sizeof *se->shift);
+      if (!se->shift) return gpg_error_from_syserror();
+      if (!se->xcase) ascii_strlwr((char *)se->value);
+      for (i = 0; i < 256; i++) se->shift[i] = se->valuelen;
+      for (i = 0; i + 1 < se->valuelen; i++)
+        se->shift[(unsigned char)se->value[i]] = se->valuelen - 1 - i;
+    }
+  }
+  return 0;
+}
+
 /* Parse an expression.  The expression syntax is:
  *
  *   [<lc>] {{<flag>} PROPNAME <op> VALUE [<lc>]}
@@ -214,6 +261,7 @@ next_term:
   if (!se) return gpg_error_from_syserror();
   strcpy(se->name, expr);
   se->next = NULL;
+  se->shift = NULL;
   se->nonono = 0;
   se->disjun = disjun;
   se->xcase = xcase;
@@ -349,6 +397,7 @@ next_term:
     return GPG_ERR_MISSING_VALUE;
   }
 
+  se->valuelen = strlen(se->value);
   se->numvalue = strtol(se->value, NULL, 0);
 
   if (next_lc) {
@@ -367,12 +416,13 @@ next_term:
   }
 
   xfree(expr_buffer);
-  return 0;
+  return compile_selector(*selector);
 }
 
 void recsel_release(recsel_expr_t a) {
   while (a) {
     recsel_expr_t tmp = a->next;
+    xfree(a->shift);
     xfree(a);
     a = tmp;
   }
@@ -427,43 +477,78 @@ void recsel_dump(recsel_expr_t selector) {
 
 /* Return true if the record RECORD has been selected.  The GETVAL
  * function is called with COOKIE and the NAME of a property used in
- * the expression.  */
+ * the expression.  Each property is only requested once, so the
+ * returned strings must stay valid until this function returns.  */
 int recsel_select(recsel_expr_t selector,
                   const char *(*getval)(void *cookie, const char *propname),
                   void *cookie) {
+  struct {
+    const char *value;
+    size_t len;
+    long num;
+  } cache[MAX_CACHED_PROPS];
+  unsigned int have_value = 0;
+  unsigned int have_num = 0;
   recsel_expr_t se;
   const char *value;
-  size_t selen, valuelen;
+  size_t valuelen;
   long numvalue;
   int result = 1;
 
   se = selector;
   while (se) {
-    value = getval ? getval(cookie, se->name) : NULL;
-    if (!value) value = "";
+    if (se->slot >= 0 && (have_value & (1u << se->slot))) {
+      value = cache[se->slot].value;
+      valuelen = cache[se->slot].len;
+    } else {
+      value = getval ? getval(cookie, se->name) : NULL;
+      if (!value) value = "";
+      valuelen = strlen(value);
+      if (se->slot >= 0) {
+        cache[se->slot].value = value;
+        cache[se->slot].len = valuelen;
+        have_value |= 1u << se->slot;
+      }
+    }
 
     if (!*value) {
       /* Field is empty.  */
       result = 0;
     } else /* Field has a value.  */
     {
-      valuelen = strlen(value);
-      numvalue = strtol(value, NULL, 0);
-      selen = strlen(se->value);
+      switch (se->op) {
+        case SELECT_ISTRUE:
+        case SELECT_EQ:
+        case SELECT_GT:
+        case SELECT_GE:
+        case SELECT_LT:
+        case SELECT_LE:
+          if (se->slot >= 0 && (have_num & (1u << se->slot)))
+            numvalue = cache[se->slot].num;
+          else {
+            numvalue = strtol(value, NULL, 0);
+            if (se->slot >= 0) {
+              cache[se->slot].num = numvalue;
+              have_num |= 1u << se->slot;
+            }
+          }
+          break;
+        default:
+          numvalue = 0;
+          break;
+      }
 
       switch (se->op) {
         case SELECT_SAME:
           if (se->xcase)
-            result = (valuelen == selen && !memcmp(value, se->value, selen));
+            result = (valuelen == se->valuelen &&
+                      !memcmp(value, se->value, valuelen));
           else
-            result =
-                (valuelen == selen && !strncasecmp(value, se->value, selen));
+            result = (valuelen == se->valuelen &&
+                      !strncasecmp(value, se->value, valuelen));
           break;
         case SELECT_SUB:
-          if (se->xcase)
-            result = !!my_memstr(value, valuelen, se->value);
-          else
-            result = !!memistr(value, valuelen, se->value);
+          result = find_substring(se, value, valuelen);
           break;
         case SELECT_NONEMPTY:
           result = !!valuelen;
@@ -526,9 +611,7 @@ int recsel_select(recsel_expr_t selector,
        * conjunction evaluates to false.  We skip over the
        * remaining expressions of this conjunction and continue
        * with the next disjunction if any.  */
-      do
-        se = se->next;
-      while (se && !se->disjun);
+      se = se->next_disjun;
     }
   }
 
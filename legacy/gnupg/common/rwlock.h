@@ -0,0 +1,89 @@
+/* rwlock.h - A reader/writer lock
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GNUPG_COMMON_RWLOCK_H
+#define GNUPG_COMMON_RWLOCK_H
+
+#include <condition_variable>
+#include <mutex>
+
+/* A lock which may be held by many readers or a single writer, for
+   C++11 which lacks std::shared_mutex.  Waiting writers are preferred
+   so that a steady stream of readers can't starve them; thus a thread
+   must not take the lock for reading twice.  Use it with
+   std::lock_guard for writing and rwlock_reader for reading.  */
+class rwlock {
+ public:
+  void lock() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_writers_waiting++;
+    m_cond.wait(lock, [this] { return !m_writer && !m_readers; });
+    m_writers_waiting--;
+    m_writer = true;
+  }
+
+  void unlock() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_writer = false;
+    m_cond.notify_all();
+  }
+
+  void lock_shared() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this] { return !m_writer && !m_writers_waiting; });
+    m_readers++;
+  }
+
+  void unlock_shared() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!--m_readers) m_cond.notify_all();
+  }
+
+ private:
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  unsigned int m_readers{0};
+  unsigned int m_writers_waiting{0};
+  bool m_writer{false};
+};
+
+/* Hold an rwlock for reading for the lifetime of the object.  */
+class rwlock_reader {
+ public:
+  explicit rwlock_reader(rwlock &lock) : m_lock(lock) { m_lock.lock_shared(); }
+  ~rwlock_reader() { m_lock.unlock_shared(); }
+
+ private:
+  rwlock &m_lock;
+
+  rwlock_reader(const rwlock_reader &) = delete;
+  rwlock_reader &operator=(const rwlock_reader &) = delete;
+};
+
+#endif /*GNUPG_COMMON_RWLOCK_H*/
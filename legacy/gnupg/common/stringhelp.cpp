@@ -199,22 +199,23 @@ char *trim_trailing_spaces(char *string) {
   return string;
 }
 
-unsigned trim_trailing_chars(byte *line, unsigned len, const char *trimchars) {
-  byte *p, *mark;
-  unsigned n;
+/* Return the length of the LEN bytes at LINE without the trailing
+ * characters in TRIMCHARS.  */
+size_t length_sans_trailing_chars(const unsigned char *line, size_t len,
+                                  const char *trimchars) {
+  while (len && strchr(trimchars, line[len - 1])) len--;
+  return len;
+}
 
-  for (mark = NULL, p = line, n = 0; n < len; n++, p++) {
-    if (strchr(trimchars, *p)) {
-      if (!mark) mark = p;
-    } else
-      mark = NULL;
-  }
+/* Remove the trailing characters in TRIMCHARS from the LEN bytes at
+ * LINE and return the new length.  Only the trailing characters are
+ * looked at, so this is cheap even for long lines.  As with strchr, a
+ * Nul byte counts as one of the TRIMCHARS.  */
+unsigned trim_trailing_chars(byte *line, unsigned len, const char *trimchars) {
+  unsigned n = length_sans_trailing_chars(line, len, trimchars);
 
-  if (mark) {
-    *mark = 0;
-    return mark - line;
-  }
-  return len;
+  if (n != len) line[n] = 0;
+  return n;
 }
 
 /****************
@@ -224,22 +225,6 @@ unsigned trim_trailing_ws(byte *line, unsigned len) {
   return trim_trailing_chars(line, len, " \t\r\n");
 }
 
-size_t length_sans_trailing_chars(const unsigned char *line, size_t len,
-                                  const char *trimchars) {
-  const unsigned char *p, *mark;
-  size_t n;
-
-  for (mark = NULL, p = line, n = 0; n < len; n++, p++) {
-    if (strchr(trimchars, *p)) {
-      if (!mark) mark = p;
-    } else
-      mark = NULL;
-  }
-
-  if (mark) return mark - line;
-  return len;
-}
-
 /*
  *  Return the length of line ignoring trailing white-space.
  */
@@ -401,3 +401,36 @@ int gnupg_fd_valid(int fd) {
   close(d);
   return 1;
 }
+
+/* Store the state of the file FNAME in R_STAMP.  A file that can not
+   be stat'ed is recorded as not existing.  */
+void gnupg_file_stamp(const char *fname, gnupg_file_stamp_t *r_stamp) {
+  struct stat st;
+
+  memset(r_stamp, 0, sizeof *r_stamp);
+  if (stat(fname, &st)) return;
+
+  r_stamp->exists = 1;
+  r_stamp->dev = st.st_dev;
+  r_stamp->ino = st.st_ino;
+  r_stamp->size = st.st_size;
+  r_stamp->mtime = st.st_mtime;
+  r_stamp->ctime = st.st_ctime;
+#if defined(__APPLE__)
+  r_stamp->mtime_nsec = st.st_mtimespec.tv_nsec;
+  r_stamp->ctime_nsec = st.st_ctimespec.tv_nsec;
+#elif !defined(HAVE_W32_SYSTEM)
+  r_stamp->mtime_nsec = st.st_mtim.tv_nsec;
+  r_stamp->ctime_nsec = st.st_ctim.tv_nsec;
+#endif
+}
+
+/* Return true if the stamps A and B describe the same state of a
+   file.  */
+int gnupg_file_stamp_equal(const gnupg_file_stamp_t *a,
+                           const gnupg_file_stamp_t *b) {
+  return a->exists == b->exists && a->dev == b->dev && a->ino == b->ino &&
+         a->size == b->size && a->mtime == b->mtime &&
+         a->mtime_nsec == b->mtime_nsec && a->ctime == b->ctime &&
+         a->ctime_nsec == b->ctime_nsec;
+}
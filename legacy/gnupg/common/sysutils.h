@@ -66,4 +66,21 @@ int gnupg_setenv(const char *name, const char *value, int overwrite);
 char *gnupg_getcwd(void);
 int gnupg_fd_valid(int fd);
 
+/* The identity and modification state of a file, to check whether
+   data cached from it is still valid.  */
+typedef struct gnupg_file_stamp_s {
+  int exists;
+  unsigned long long dev;
+  unsigned long long ino;
+  unsigned long long size;
+  long long mtime;
+  long mtime_nsec;
+  long long ctime;
+  long ctime_nsec;
+} gnupg_file_stamp_t;
+
+void gnupg_file_stamp(const char *fname, gnupg_file_stamp_t *r_stamp);
+int gnupg_file_stamp_equal(const gnupg_file_stamp_t *a,
+                           const gnupg_file_stamp_t *b);
+
 #endif /*GNUPG_COMMON_SYSUTILS_H*/
@@ -297,6 +297,77 @@ static void run_test_2(void) {
   FREEEXPR();
 }
 
+/* Count the calls in the unsigned int at COOKIE.  */
+static const char *test_3_getval(void *cookie, const char *name) {
+  (*(unsigned int *)cookie)++;
+  if (!strcmp(name, "uid"))
+    return "Alpha Test <alpha@example.org>";
+  else if (!strcmp(name, "text"))
+    return "aaabaababcabcd";
+  else if (!strcmp(name, "num"))
+    return "42";
+  else
+    return NULL;
+}
+
+static void run_test_3(void) {
+  gpg_error_t err;
+  recsel_expr_t se = NULL;
+  unsigned int ncalls;
+
+  ADDEXPR("uid =~ Alfa && uid !~ Test || uid =~ Alpha && uid !~ Test");
+  ncalls = 0;
+  if (recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  if (ncalls != 1) fail(0, 0);
+  FREEEXPR();
+
+  ADDEXPR("uid =~ Alfa && uid !~ Test || uid =~ Alpha && uid =~ test");
+  ncalls = 0;
+  if (!recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  if (ncalls != 1) fail(0, 0);
+  FREEEXPR();
+
+  ADDEXPR("num < 10 || uid =~ ALPHA@ && num > 40 && num != 43");
+  ncalls = 0;
+  if (!recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  if (ncalls != 2) fail(0, 0);
+  FREEEXPR();
+
+  /* The same conditions given in separate calls.  */
+  ADDEXPR("-c uid =~ ALPHA");
+  ADDEXPR("|| nothere -n");
+  ADDEXPR("|| num == 42");
+  ncalls = 0;
+  if (!recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  if (ncalls != 3) fail(0, 0);
+  FREEEXPR();
+
+  ADDEXPR("text =~ abcd");
+  if (!recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  FREEEXPR();
+  ADDEXPR("text =~ aaab");
+  if (!recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  FREEEXPR();
+  ADDEXPR("text =~ baab");
+  if (!recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  FREEEXPR();
+  ADDEXPR("text =~ ABCA");
+  if (!recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  FREEEXPR();
+  ADDEXPR("text =~ abcda");
+  if (recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  FREEEXPR();
+  ADDEXPR("text =~ abba");
+  if (recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  FREEEXPR();
+  ADDEXPR("text =~ aaabaababcabcdx");
+  if (recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  FREEEXPR();
+  ADDEXPR("-c text =~ aaabaababcabcd");
+  if (!recsel_select(se, test_3_getval, &ncalls)) fail(0, 0);
+  FREEEXPR();
+}
+
 int main(int argc, char **argv) {
   int last_argc = -1;
 
@@ -339,7 +410,7 @@ int main(int argc, char **argv) {
   run_test_1();
   run_test_1b();
   run_test_2();
-  /* Fixme: We should add test for complex conditions.  */
+  run_test_3();
 
   return 0;
 }
@@ -0,0 +1,401 @@
+/* trace.c - Span and counter tracing
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "argparse.h"
+#include "trace.h"
+#include "util.h"
+
+/* An event in a ring buffer.  */
+struct trace_event {
+  const char *name;
+  char type;       /* 'X' for a span, 'C' for a counter.  */
+  uint64_t start;  /* Start of a span or time of a counter.  */
+  uint64_t value;  /* Duration of a span or value of a counter.  */
+  uint64_t id;     /* ID of the span.  */
+  uint64_t parent; /* ID of the enclosing span or 0.  */
+  char arg[TRACE_ARG_LEN + 1];
+};
+
+/* The ring buffer of one thread.  */
+struct trace_ring {
+  unsigned int tid;
+  /* The number of events ever recorded.  Only the last
+     TRACE_RING_SIZE of them are kept.  */
+  uint64_t count;
+  trace_event events[TRACE_RING_SIZE];
+};
+
+int trace_enabled;
+
+/* The name of the output file.  */
+static std::string trace_fname;
+static int trace_otlp;
+
+/* The offset of the wall clock to trace_now in nanoseconds.  */
+static int64_t trace_epoch_offset;
+
+/* All ring buffers.  They are never released, since they must be
+   written after their threads are gone.  */
+static std::mutex trace_lock;
+static std::vector<trace_ring *> trace_rings;
+
+/* The ring buffer of this thread, created on first use, and the
+   innermost open span.  */
+static thread_local trace_ring *trace_my_ring;
+static thread_local uint64_t trace_current;
+
+static std::atomic<uint64_t> trace_next_id;
+
+uint64_t trace_now(void) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/* Return a new event in the ring buffer of this thread, or NULL if
+   there is no memory.  */
+static trace_event *trace_new_event(void) {
+  trace_ring *ring = trace_my_ring;
+
+  if (!ring) {
+    ring = new (std::nothrow) trace_ring;
+    if (!ring) return NULL;
+    ring->count = 0;
+
+    std::lock_guard<std::mutex> lock(trace_lock);
+    ring->tid = trace_rings.size() + 1;
+    trace_rings.push_back(ring);
+    trace_my_ring = ring;
+  }
+
+  return &ring->events[ring->count++ % TRACE_RING_SIZE];
+}
+
+static void trace_copy_arg(char *dst, const char *arg, size_t len) {
+  if (!arg) len = 0;
+  if (len > TRACE_ARG_LEN) len = TRACE_ARG_LEN;
+  if (len) memcpy(dst, arg, len);
+  dst[len] = 0;
+}
+
+static void trace_record(const char *name, uint64_t start, uint64_t end,
+                         uint64_t id, uint64_t parent, const char *arg) {
+  trace_event *ev = trace_new_event();
+
+  if (!ev) return;
+  ev->name = name;
+  ev->type = 'X';
+  ev->start = start;
+  ev->value = end > start ? end - start : 0;
+  ev->id = id;
+  ev->parent = parent;
+  trace_copy_arg(ev->arg, arg, arg ? strlen(arg) : 0);
+}
+
+void trace_complete(const char *name, uint64_t start, uint64_t end,
+                    const char *arg) {
+  if (!trace_enabled) return;
+  trace_record(name, start, end, ++trace_next_id, trace_current, arg);
+}
+
+void trace_counter(const char *name, int64_t value) {
+  trace_event *ev;
+
+  if (!trace_enabled) return;
+  ev = trace_new_event();
+  if (!ev) return;
+  ev->name = name;
+  ev->type = 'C';
+  ev->start = trace_now();
+  ev->value = value;
+  ev->id = ev->parent = 0;
+  ev->arg[0] = 0;
+}
+
+void trace_span::begin(const char *name, const char *arg) {
+  m_name = name;
+  trace_copy_arg(m_arg, arg, arg ? strlen(arg) : 0);
+  m_parent = trace_current;
+  m_id = trace_current = ++trace_next_id;
+  m_start = trace_now();
+}
+
+void trace_span::end(void) {
+  trace_record(m_name, m_start, trace_now(), m_id, m_parent, m_arg);
+  trace_current = m_parent;
+}
+
+/* State of the assuan round trip in progress on a context.  A command
+   and its response are handled by the same thread, so a few slots
+   per thread suffice.  */
+struct trace_assuan_pending {
+  assuan_context_t ctx;
+  int inout; /* The direction of the command.  */
+  uint64_t start;
+  char cmd[TRACE_ARG_LEN + 1];
+};
+
+#define TRACE_ASSUAN_SLOTS 4
+static thread_local trace_assuan_pending
+    trace_assuan_slots[TRACE_ASSUAN_SLOTS];
+
+static int trace_line_is(const char *line, size_t linelen,
+                         const char *word) {
+  size_t n = strlen(word);
+
+  return linelen >= n && !memcmp(line, word, n) &&
+         (linelen == n || line[n] == ' ');
+}
+
+static unsigned int trace_assuan_monitor(assuan_context_t ctx, void *hook,
+                                         int inout, const char *line,
+                                         size_t linelen) {
+  trace_assuan_pending *slot = NULL;
+  int i;
+
+  for (i = 0; i < TRACE_ASSUAN_SLOTS; i++)
+    if (trace_assuan_slots[i].ctx == ctx) {
+      slot = &trace_assuan_slots[i];
+      break;
+    }
+
+  if (trace_line_is(line, linelen, "OK") ||
+      trace_line_is(line, linelen, "ERR")) {
+    if (slot && slot->inout != inout) {
+      trace_complete((const char *)hook, slot->start, trace_now(), slot->cmd);
+      slot->ctx = NULL;
+    }
+    return 0;
+  }
+
+  /* Data, status lines, comments and inquiries are part of the
+     command in progress.  */
+  if (trace_line_is(line, linelen, "D") ||
+      trace_line_is(line, linelen, "S") || (linelen && *line == '#') ||
+      trace_line_is(line, linelen, "INQUIRE") ||
+      trace_line_is(line, linelen, "END") ||
+      trace_line_is(line, linelen, "CAN"))
+    return 0;
+
+  if (!slot)
+    for (i = 0; i < TRACE_ASSUAN_SLOTS && !slot; i++)
+      if (!trace_assuan_slots[i].ctx) slot = &trace_assuan_slots[i];
+  if (!slot) slot = &trace_assuan_slots[0];
+
+  slot->ctx = ctx;
+  slot->inout = inout;
+  slot->start = trace_now();
+  for (i = 0; (size_t)i < linelen && line[i] != ' '; i++)
+    ;
+  trace_copy_arg(slot->cmd, line, i);
+  return 0;
+}
+
+void trace_assuan_context(assuan_context_t ctx, const char *name) {
+  if (trace_enabled && ctx)
+    assuan_set_io_monitor(ctx, trace_assuan_monitor, (void *)name);
+}
+
+/* Write STRING as a JSON string to FP.  */
+static void trace_put_string(estream_t fp, const char *string) {
+  const unsigned char *s;
+
+  es_putc('"', fp);
+  for (s = (const unsigned char *)string; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      es_fprintf(fp, "\\%c", *s);
+    else if (*s < 0x20 || *s >= 0x7f)
+      es_fprintf(fp, "\\u%04x", *s);
+    else
+      es_putc(*s, fp);
+  }
+  es_putc('"', fp);
+}
+
+/* Write the events as a Chrome trace (JSON object format).  */
+static void trace_write_chrome(estream_t fp, unsigned long pid) {
+  es_fputs("{\"traceEvents\":[\n", fp);
+  es_fprintf(fp,
+             "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,"
+             "\"args\":{\"name\":",
+             pid);
+  trace_put_string(fp, strusage(11));
+  es_fputs("}}", fp);
+
+  for (trace_ring *ring : trace_rings) {
+    uint64_t n =
+        ring->count < TRACE_RING_SIZE ? 0 : ring->count - TRACE_RING_SIZE;
+
+    for (; n < ring->count; n++) {
+      trace_event *ev = &ring->events[n % TRACE_RING_SIZE];
+
+      es_fputs(",\n{\"name\":", fp);
+      trace_put_string(fp, ev->name);
+      /* Timestamps are in microseconds.  */
+      es_fprintf(fp, ",\"ph\":\"%c\",\"pid\":%lu,\"tid\":%u,\"ts\":%llu.%03u",
+                 ev->type, pid, ring->tid,
+                 (unsigned long long)(ev->start / 1000),
+                 (unsigned int)(ev->start % 1000));
+      if (ev->type == 'X') {
+        es_fprintf(fp, ",\"dur\":%llu.%03u",
+                   (unsigned long long)(ev->value / 1000),
+                   (unsigned int)(ev->value % 1000));
+        if (*ev->arg) {
+          es_fputs(",\"args\":{\"arg\":", fp);
+          trace_put_string(fp, ev->arg);
+          es_putc('}', fp);
+        }
+      } else
+        es_fprintf(fp, ",\"args\":{\"value\":%lld}", (long long)ev->value);
+      es_putc('}', fp);
+    }
+  }
+  es_fputs("\n]}\n", fp);
+}
+
+/* Write the spans as an OpenTelemetry (OTLP/JSON) trace.  Counters
+   have no place in a trace and are left out.  */
+static void trace_write_otlp(estream_t fp, unsigned long pid) {
+  char traceid[33];
+  int first = 1;
+
+  /* One trace per process.  */
+  snprintf(traceid, sizeof traceid, "%016llx%016llx", (unsigned long long)pid,
+           (unsigned long long)(trace_epoch_offset));
+
+  es_fputs(
+      "{\"resourceSpans\":[{\"resource\":{\"attributes\":["
+      "{\"key\":\"service.name\",\"value\":{\"stringValue\":",
+      fp);
+  trace_put_string(fp, strusage(11));
+  es_fprintf(fp,
+             "}},{\"key\":\"process.pid\",\"value\":{\"intValue\":\"%lu\"}}]},"
+             "\"scopeSpans\":[{\"scope\":{\"name\":\"gnupg\"},\"spans\":[",
+             pid);
+
+  for (trace_ring *ring : trace_rings) {
+    uint64_t n =
+        ring->count < TRACE_RING_SIZE ? 0 : ring->count - TRACE_RING_SIZE;
+
+    for (; n < ring->count; n++) {
+      trace_event *ev = &ring->events[n % TRACE_RING_SIZE];
+      uint64_t start = ev->start + trace_epoch_offset;
+
+      if (ev->type != 'X') continue;
+
+      es_fputs(first ? "\n" : ",\n", fp);
+      first = 0;
+      es_fprintf(fp, "{\"traceId\":\"%s\",\"spanId\":\"%016llx\",", traceid,
+                 (unsigned long long)ev->id);
+      if (ev->parent)
+        es_fprintf(fp, "\"parentSpanId\":\"%016llx\",",
+                   (unsigned long long)ev->parent);
+      es_fputs("\"name\":", fp);
+      trace_put_string(fp, ev->name);
+      es_fprintf(fp,
+                 ",\"kind\":1,\"startTimeUnixNano\":\"%llu\","
+                 "\"endTimeUnixNano\":\"%llu\",\"attributes\":["
+                 "{\"key\":\"thread.id\",\"value\":{\"intValue\":\"%u\"}}",
+                 (unsigned long long)start,
+                 (unsigned long long)(start + ev->value), ring->tid);
+      if (*ev->arg) {
+        es_fputs(",{\"key\":\"arg\",\"value\":{\"stringValue\":", fp);
+        trace_put_string(fp, ev->arg);
+        es_fputs("}}", fp);
+      }
+      es_fputs("]}", fp);
+    }
+  }
+  es_fputs("\n]}]}]}\n", fp);
+}
+
+void trace_write(void) {
+  estream_t fp;
+  unsigned long pid = (unsigned long)getpid();
+  std::string fname = trace_fname;
+  size_t pos;
+
+  if (!trace_enabled) return;
+
+  /* This is done here and not in trace_init, so that a daemon
+     writes to its own file after forking.  */
+  while ((pos = fname.find("%p")) != std::string::npos)
+    fname.replace(pos, 2, std::to_string(pid));
+
+  std::lock_guard<std::mutex> lock(trace_lock);
+  fp = es_fopen(fname.c_str(), "w");
+  if (!fp) {
+    log_error("can't create '%s': %s\n", fname.c_str(),
+              gpg_strerror(gpg_error_from_syserror()));
+    return;
+  }
+
+  if (trace_otlp)
+    trace_write_otlp(fp, pid);
+  else
+    trace_write_chrome(fp, pid);
+
+  if (es_fclose(fp))
+    log_error("error writing '%s': %s\n", fname.c_str(),
+              gpg_strerror(gpg_error_from_syserror()));
+}
+
+void trace_init(void) {
+#ifndef NO_TRACE
+  const char *fname = getenv("GNUPG_TRACE");
+  const char *format = getenv("GNUPG_TRACE_FORMAT");
+  int64_t wall;
+
+  if (trace_enabled || !fname || !*fname) return;
+
+  trace_fname = fname;
+  trace_otlp = format && !strcmp(format, "otlp");
+
+  wall = std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+             .count();
+  trace_epoch_offset = wall - (int64_t)trace_now();
+
+  trace_enabled = 1;
+  atexit(trace_write);
+#endif /*!NO_TRACE*/
+}
@@ -0,0 +1,131 @@
+/* trace.h - Span and counter tracing
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GNUPG_COMMON_TRACE_H
+#define GNUPG_COMMON_TRACE_H
+
+#include <stdint.h>
+
+#include <assuan.h>
+
+/* Tracing is enabled at run time by setting the environment variable
+   GNUPG_TRACE to the name of a file.  A "%p" in the name is replaced
+   by the process id, so that gpg and the daemons it starts do not
+   overwrite each others traces.  The events are written to that file
+   at exit, in the Chrome trace event format (for chrome://tracing or
+   Perfetto), or as OpenTelemetry JSON spans if GNUPG_TRACE_FORMAT is
+   "otlp".
+
+   Each thread records into its own ring buffer of TRACE_RING_SIZE
+   events, so only the most recent events of a long running daemon
+   are kept.  If tracing is not enabled, a trace point costs a test of
+   a global flag.  Define NO_TRACE to remove all trace points at
+   compile time.  */
+
+#define TRACE_RING_SIZE 4096
+
+/* The maximum length of the argument of an event.  */
+#define TRACE_ARG_LEN 31
+
+/* True if tracing is enabled.  */
+extern int trace_enabled;
+
+/* Enable tracing if requested by the environment.  Called by
+   init_common_subsystems.  */
+void trace_init(void);
+
+/* Write the events recorded so far to the trace file.  This is done
+   automatically at exit.  */
+void trace_write(void);
+
+/* Return the current time in nanoseconds.  */
+uint64_t trace_now(void);
+
+/* Record a span NAME from START to END (as returned by trace_now),
+   with the optional argument ARG.  NAME must be a static string.  */
+void trace_complete(const char *name, uint64_t start, uint64_t end,
+                    const char *arg);
+
+/* Record VALUE of the counter NAME.  */
+void trace_counter(const char *name, int64_t value);
+
+/* Record a span for each command on the assuan context CTX.  NAME is
+   used as the name of the spans and the command as argument.  */
+void trace_assuan_context(assuan_context_t ctx, const char *name);
+
+/* A span covering the lifetime of the object.  Use it through the
+   TRACE_SPAN macros.  */
+class trace_span {
+ public:
+  trace_span(const char *name, const char *arg = NULL) {
+    if (trace_enabled) begin(name, arg);
+  }
+  ~trace_span() {
+    if (m_name) end();
+  }
+
+ private:
+  void begin(const char *name, const char *arg);
+  void end(void);
+
+  const char *m_name{NULL};
+  uint64_t m_start;
+  uint64_t m_id;
+  uint64_t m_parent;
+  char m_arg[TRACE_ARG_LEN + 1];
+
+  trace_span(const trace_span &) = delete;
+  trace_span &operator=(const trace_span &) = delete;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifndef NO_TRACE
+#define TRACE_SPAN(name) \
+  trace_span TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define TRACE_SPAN_ARG(name, arg) \
+  trace_span TRACE_CONCAT(trace_span_, __LINE__)(name, arg)
+#define TRACE_COUNTER(name, value)                 \
+  do {                                             \
+    if (trace_enabled) trace_counter(name, value); \
+  } while (0)
+#else /*NO_TRACE*/
+#define TRACE_SPAN(name) \
+  do {                   \
+  } while (0)
+#define TRACE_SPAN_ARG(name, arg) \
+  do {                            \
+  } while (0)
+#define TRACE_COUNTER(name, value) \
+  do {                             \
+  } while (0)
+#endif /*NO_TRACE*/
+
+#endif /*GNUPG_COMMON_TRACE_H*/
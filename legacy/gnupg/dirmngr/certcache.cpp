@@ -20,6 +20,8 @@
 #include <config.h>
 
 #include <mutex>
+#include <string>
+#include <unordered_map>
 
 #include <assert.h>
 #include <dirent.h>
@@ -36,7 +38,11 @@
 #include "crlfetch.h"
 #include "misc.h"
 
-#define MAX_NONPERM_CACHED_CERTS 1000
+/* The limits for the non-permanent certificates.  The cache is
+   sized by memory; the count limit only guards against a flood of
+   tiny certificates.  */
+#define MAX_NONPERM_CACHED_CERTS 10000
+#define MAX_NONPERM_CACHED_BYTES (8 * 1024 * 1024)
 
 /* Constants used to classify search patterns.  */
 enum pattern_class {
@@ -57,9 +63,14 @@ enum pattern_class {
 /* A certificate cache item.  This consists of a the KSBA cert object
    and some meta data for easier lookup.  We use a hash table to keep
    track of all items and use the (randomly distributed) first byte of
-   the fingerprint directly as the hash which makes it pretty easy. */
+   the fingerprint directly as the hash which makes it pretty easy.
+   Valid items are also listed in the secondary indices below, and the
+   non-permanent ones in the LRU list.  */
 struct cert_item_s {
-  struct cert_item_s *next; /* Next item with the same hash value. */
+  struct cert_item_s *next;     /* Next item with the same hash value. */
+  struct cert_item_s *lru_prev; /* Next more recently used item.  */
+  struct cert_item_s *lru_next; /* Next less recently used item.  */
+  size_t size;                  /* The approximate memory used.  */
   ksba_cert_t cert;         /* The KSBA cert object or NULL is this is
                                not a valid item.  */
   unsigned char fpr[20];    /* The fingerprint of this object. */
@@ -81,14 +92,28 @@ typedef struct cert_item_s *cert_item_t;
    the first byte of the fingerprint.  */
 static cert_item_t cert_cache[256];
 
+/* Secondary indices mapping the subject DN, the issuer DN, the
+   issuer DN with the serial number and the subject key identifier to
+   the valid items.  */
+typedef std::unordered_multimap<std::string, cert_item_t> cert_index_t;
+static cert_index_t subject_index;
+static cert_index_t issuer_index;
+static cert_index_t sn_index;
+static cert_index_t ski_index;
+
+/* The non-permanent items, the most recently used first.  */
+static cert_item_t lru_head;
+static cert_item_t lru_tail;
+
 /* This is the global cache_lock variable.  */
 static std::mutex cache_lock;
 
 /* Flag to track whether the cache has been initialized.  */
 static int initialization_done;
 
-/* Total number of non-permanent certificates.  */
+/* Total number and size of non-permanent certificates.  */
 static unsigned int total_nonperm_certificates;
+static size_t total_nonperm_bytes;
 
 #ifdef HAVE_W32_SYSTEM
 /* We load some functions dynamically.  Provide typedefs for tehse
@@ -127,10 +152,18 @@ ksba_sexp_t hexsn_to_sexp(const char *hexsn) {
 }
 
 /* Compute the fingerprint of the certificate CERT and put it into
-   the 20 bytes large buffer DIGEST.  Return address of this buffer.  */
+   the 20 bytes large buffer DIGEST.  Return address of this buffer.
+   The fingerprint is cached with the certificate object, using the
+   same key as gpgsm.  */
 unsigned char *cert_compute_fpr(ksba_cert_t cert, unsigned char *digest) {
   gpg_error_t err;
   gcry_md_hd_t md;
+  size_t buflen;
+
+  if (!ksba_cert_get_user_data(cert, "sha1-fingerprint", digest, 20,
+                               &buflen) &&
+      buflen == 20)
+    return digest;
 
   err = gcry_md_open(&md, GCRY_MD_SHA1, 0);
   if (err) log_fatal("gcry_md_open failed: %s\n", gpg_strerror(err));
@@ -142,11 +175,113 @@ unsigned char *cert_compute_fpr(ksba_cert_t cert, unsigned char *digest) {
   } else {
     gcry_md_final(md);
     memcpy(digest, gcry_md_read(md, GCRY_MD_SHA1), 20);
+    ksba_cert_set_user_data(cert, "sha1-fingerprint", digest, 20);
   }
   gcry_md_close(md);
   return digest;
 }
 
+/* Return the canonical S-expression SEXP as a key for the indices.  */
+static std::string sexp_key(ksba_const_sexp_t sexp) {
+  size_t n = gcry_sexp_canon_len(sexp, 0, NULL, NULL);
+
+  return std::string((const char *)sexp, n);
+}
+
+/* Return the key for ISSUER_DN and SERIALNO in the sn_index.  */
+static std::string sn_key(const char *issuer_dn, ksba_const_sexp_t serialno) {
+  std::string key(issuer_dn);
+
+  key.push_back('\0');
+  key += sexp_key(serialno);
+  return key;
+}
+
+/* Add CI to INDEX under KEY.  */
+static void index_add(cert_index_t &index, const std::string &key,
+                      cert_item_t ci) {
+  index.emplace(key, ci);
+}
+
+/* Remove CI from INDEX.  */
+static void index_remove(cert_index_t &index, const std::string &key,
+                         cert_item_t ci) {
+  auto range = index.equal_range(key);
+
+  for (auto it = range.first; it != range.second; ++it)
+    if (it->second == ci) {
+      index.erase(it);
+      return;
+    }
+}
+
+/* Return the SEQ-th valid item in INDEX under KEY or NULL.  */
+static cert_item_t index_find(cert_index_t &index, const std::string &key,
+                              unsigned int seq) {
+  auto range = index.equal_range(key);
+
+  for (auto it = range.first; it != range.second; ++it)
+    if (!seq--) return it->second;
+  return NULL;
+}
+
+/* Add or remove the valid item CI from the secondary indices.  */
+static void index_cert_item(cert_item_t ci, int remove) {
+  void (*fnc)(cert_index_t &, const std::string &, cert_item_t) =
+      remove ? index_remove : index_add;
+  ksba_sexp_t ski;
+
+  fnc(issuer_index, ci->issuer_dn, ci);
+  fnc(sn_index, sn_key(ci->issuer_dn, ci->sn), ci);
+  if (ci->subject_dn) {
+    fnc(subject_index, ci->subject_dn, ci);
+    if (!ksba_cert_get_subj_key_id(ci->cert, NULL, &ski)) {
+      fnc(ski_index, sexp_key(ski), ci);
+      ksba_free(ski);
+    }
+  }
+}
+
+/* Insert the non-permanent item CI at the head of the LRU list.  */
+static void lru_link(cert_item_t ci) {
+  ci->lru_prev = NULL;
+  ci->lru_next = lru_head;
+  if (lru_head)
+    lru_head->lru_prev = ci;
+  else
+    lru_tail = ci;
+  lru_head = ci;
+}
+
+/* Remove the non-permanent item CI from the LRU list.  */
+static void lru_unlink(cert_item_t ci) {
+  if (ci->lru_prev)
+    ci->lru_prev->lru_next = ci->lru_next;
+  else
+    lru_head = ci->lru_next;
+  if (ci->lru_next)
+    ci->lru_next->lru_prev = ci->lru_prev;
+  else
+    lru_tail = ci->lru_prev;
+  ci->lru_prev = ci->lru_next = NULL;
+}
+
+/* Return true if CI is in the LRU list.  */
+static int lru_linked(cert_item_t ci) {
+  return ci->lru_prev || lru_head == ci;
+}
+
+/* Mark the item CI as just used and return its certificate with an
+   extra reference.  */
+static ksba_cert_t use_cert_item(cert_item_t ci) {
+  if (ci->lru_prev) {
+    lru_unlink(ci);
+    lru_link(ci);
+  }
+  ksba_cert_ref(ci->cert);
+  return ci->cert;
+}
+
 /* Cleanup one slot.  This releases all resourses but keeps the actual
    slot in the cache marked for reuse. */
 static void clean_cache_slot(cert_item_t ci) {
@@ -154,6 +289,14 @@ static void clean_cache_slot(cert_item_t ci) {
 
   if (!ci->cert) return; /* Already cleaned.  */
 
+  if (lru_linked(ci)) {
+    lru_unlink(ci);
+    index_cert_item(ci, 1);
+    total_nonperm_certificates--;
+    total_nonperm_bytes -= ci->size;
+  } else if (ci->permanent)
+    index_cert_item(ci, 1);
+
   ksba_free(ci->sn);
   ci->sn = NULL;
   ksba_free(ci->issuer_dn);
@@ -186,48 +329,11 @@ static gpg_error_t put_cert(ksba_cert_t cert, int permanent,
                             unsigned int trustclass, void *fpr_buffer) {
   unsigned char help_fpr_buffer[20], *fpr;
   cert_item_t ci;
+  const unsigned char *image;
+  size_t imagelen;
 
   fpr = (unsigned char *)(fpr_buffer ? fpr_buffer : &help_fpr_buffer);
 
-  /* If we already reached the caching limit, drop a couple of certs
-   * from the cache.  Our dropping strategy is simple: We keep a
-   * static index counter and use this to start looking for
-   * certificates, then we drop 5 percent of the oldest certificates
-   * starting at that index.  For a large cache this is a fair way of
-   * removing items.  An LRU strategy would be better of course.
-   * Because we append new entries to the head of the list and we want
-   * to remove old ones first, we need to do this from the tail.  The
-   * implementation is not very efficient but compared to the long
-   * time it takes to retrieve a certificate from an external resource
-   * it seems to be reasonable.  */
-  if (!permanent && total_nonperm_certificates >= MAX_NONPERM_CACHED_CERTS) {
-    static int idx;
-    cert_item_t ci_mark;
-    int i;
-    unsigned int drop_count;
-
-    drop_count = MAX_NONPERM_CACHED_CERTS / 20;
-    if (drop_count < 2) drop_count = 2;
-
-    log_info(_("dropping %u certificates from the cache\n"), drop_count);
-    assert(idx < 256);
-    for (i = idx; drop_count; i = ((i + 1) % 256)) {
-      ci_mark = NULL;
-      for (ci = cert_cache[i]; ci; ci = ci->next)
-        if (ci->cert && !ci->permanent) ci_mark = ci;
-      if (ci_mark) {
-        clean_cache_slot(ci_mark);
-        drop_count--;
-        total_nonperm_certificates--;
-      }
-    }
-    if (i == idx)
-      idx++;
-    else
-      idx = i;
-    idx %= 256;
-  }
-
   cert_compute_fpr(cert, fpr);
   for (ci = cert_cache[*fpr]; ci; ci = ci->next)
     if (ci->cert && !memcmp(ci->fpr, fpr, 20)) return GPG_ERR_DUP_VALUE;
@@ -253,8 +359,26 @@ static gpg_error_t put_cert(ksba_cert_t cert, int permanent,
   ci->subject_dn = ksba_cert_get_subject(cert, 0);
   ci->permanent = !!permanent;
   ci->trustclasses = trustclass;
-
-  if (!permanent) total_nonperm_certificates++;
+  index_cert_item(ci, 0);
+
+  if (permanent) return 0;
+
+  image = ksba_cert_get_image(cert, &imagelen);
+  ci->size = sizeof *ci + (image ? imagelen : 0) + strlen(ci->issuer_dn) +
+             gcry_sexp_canon_len(ci->sn, 0, NULL, NULL) +
+             (ci->subject_dn ? strlen(ci->subject_dn) : 0);
+  lru_link(ci);
+  total_nonperm_certificates++;
+  total_nonperm_bytes += ci->size;
+
+  /* If we exceeded the caching limit, drop the least recently used
+   * certificates from the cache.  */
+  while (lru_tail != ci &&
+         (total_nonperm_certificates > MAX_NONPERM_CACHED_CERTS ||
+          total_nonperm_bytes > MAX_NONPERM_CACHED_BYTES)) {
+    if (DBG_CACHE) log_debug("dropping certificate from the cache\n");
+    clean_cache_slot(lru_tail);
+  }
 
   return 0;
 }
@@ -606,6 +730,7 @@ void cert_cache_deinit(int full) {
   }
 
   total_nonperm_certificates = 0;
+  total_nonperm_bytes = 0;
   initialization_done = 0;
 }
 
@@ -642,7 +767,8 @@ void cert_cache_print_stats(void) {
       }
 
   log_info(_("permanently loaded certificates: %u\n"), n_permanent);
-  log_info(_("    runtime cached certificates: %u\n"), n_nonperm);
+  log_info(_("    runtime cached certificates: %u (%lu KiB)\n"), n_nonperm,
+           (unsigned long)(total_nonperm_bytes / 1024));
   log_info(_("           trusted certificates: %u (%u,%u,%u,%u)\n"), n_trusted,
            n_trustclass_system, n_trustclass_config, n_trustclass_hkp,
            n_trustclass_hkpspool);
@@ -688,10 +814,7 @@ ksba_cert_t get_cert_byfpr(const unsigned char *fpr) {
 
   std::lock_guard<std::mutex> lock(cache_lock);
   for (ci = cert_cache[*fpr]; ci; ci = ci->next)
-    if (ci->cert && !memcmp(ci->fpr, fpr, 20)) {
-      ksba_cert_ref(ci->cert);
-      return ci->cert;
-    }
+    if (ci->cert && !memcmp(ci->fpr, fpr, 20)) return use_cert_item(ci);
 
   return NULL;
 }
@@ -729,61 +852,48 @@ ksba_cert_t get_cert_byhexfpr(const char *string) {
 
 /* Return the certificate matching ISSUER_DN and SERIALNO.  */
 ksba_cert_t get_cert_bysn(const char *issuer_dn, ksba_sexp_t serialno) {
-  /* Simple and inefficient implementation.   fixme! */
   cert_item_t ci;
-  int i;
 
   std::lock_guard<std::mutex> lock(cache_lock);
-  for (i = 0; i < 256; i++) {
-    for (ci = cert_cache[i]; ci; ci = ci->next)
-      if (ci->cert && !strcmp(ci->issuer_dn, issuer_dn) &&
-          !compare_serialno(ci->sn, serialno)) {
-        ksba_cert_ref(ci->cert);
-        return ci->cert;
-      }
-  }
-
-  return NULL;
+  ci = index_find(sn_index, sn_key(issuer_dn, serialno), 0);
+  return ci ? use_cert_item(ci) : NULL;
 }
 
 /* Return the certificate matching ISSUER_DN.  SEQ should initially be
    set to 0 and bumped up to get the next issuer with that DN. */
 ksba_cert_t get_cert_byissuer(const char *issuer_dn, unsigned int seq) {
-  /* Simple and very inefficient implementation and API.  fixme! */
   cert_item_t ci;
-  int i;
 
   std::lock_guard<std::mutex> lock(cache_lock);
-  for (i = 0; i < 256; i++) {
-    for (ci = cert_cache[i]; ci; ci = ci->next)
-      if (ci->cert && !strcmp(ci->issuer_dn, issuer_dn))
-        if (!seq--) {
-          ksba_cert_ref(ci->cert);
-          return ci->cert;
-        }
-  }
-
-  return NULL;
+  ci = index_find(issuer_index, issuer_dn, seq);
+  return ci ? use_cert_item(ci) : NULL;
 }
 
 /* Return the certificate matching SUBJECT_DN.  SEQ should initially be
    set to 0 and bumped up to get the next subject with that DN. */
 ksba_cert_t get_cert_bysubject(const char *subject_dn, unsigned int seq) {
-  /* Simple and very inefficient implementation and API.  fixme! */
   cert_item_t ci;
-  int i;
 
   if (!subject_dn) return NULL;
 
   std::lock_guard<std::mutex> lock(cache_lock);
-  for (i = 0; i < 256; i++) {
-    for (ci = cert_cache[i]; ci; ci = ci->next)
-      if (ci->cert && ci->subject_dn && !strcmp(ci->subject_dn, subject_dn))
-        if (!seq--) {
-          ksba_cert_ref(ci->cert);
-          return ci->cert;
-        }
-  }
+  ci = index_find(subject_index, subject_dn, seq);
+  return ci ? use_cert_item(ci) : NULL;
+}
+
+/* Return the certificate matching SUBJECT_DN and the subject key
+   identifier KEYID.  */
+static ksba_cert_t get_cert_byski(const char *subject_dn, ksba_sexp_t keyid) {
+  std::string key;
+
+  if (!subject_dn) return NULL;
+  key = sexp_key(keyid);
+
+  std::lock_guard<std::mutex> lock(cache_lock);
+  auto range = ski_index.equal_range(key);
+  for (auto it = range.first; it != range.second; ++it)
+    if (!strcmp(it->second->subject_dn, subject_dn))
+      return use_cert_item(it->second);
 
   return NULL;
 }
@@ -1144,7 +1254,6 @@ ksba_cert_t find_cert_bysn(ctrl_t ctrl, const char *issuer_dn,
 ksba_cert_t find_cert_bysubject(ctrl_t ctrl, const char *subject_dn,
                                 ksba_sexp_t keyid) {
   gpg_error_t err;
-  int seq;
   ksba_cert_t cert = NULL;
   cert_fetch_context_t context = NULL;
   ksba_sexp_t subj;
@@ -1156,35 +1265,25 @@ ksba_cert_t find_cert_bysubject(ctrl_t ctrl, const char *subject_dn,
    * for example required by Telesec certificates where a keyId is
    * used but the issuer certificate comes without a subject keyId! */
   if (ctrl->ocsp_certs && subject_dn) {
-    cert_item_t ci;
     cert_ref_t cr;
-    int i;
 
     /* For efficiency reasons we won't use get_cert_bysubject here. */
     std::lock_guard<std::mutex> lock(cache_lock);
-    for (i = 0; i < 256; i++)
-      for (ci = cert_cache[i]; ci; ci = ci->next)
-        if (ci->cert && ci->subject_dn && !strcmp(ci->subject_dn, subject_dn))
-          for (cr = ctrl->ocsp_certs; cr; cr = cr->next)
-            if (!memcmp(ci->fpr, cr->fpr, 20)) {
-              ksba_cert_ref(ci->cert);
-              return ci->cert; /* We use this certificate. */
-            }
+    auto range = subject_index.equal_range(subject_dn);
+    for (auto it = range.first; it != range.second; ++it)
+      for (cr = ctrl->ocsp_certs; cr; cr = cr->next)
+        if (!memcmp(it->second->fpr, cr->fpr, 20))
+          return use_cert_item(it->second); /* We use this certificate. */
     if (DBG_LOOKUP)
       log_debug("find_cert_bysubject: certificate not in ocsp_certs\n");
   }
 
-  /* No check whether the certificate is cached.  */
-  for (seq = 0; (cert = get_cert_bysubject(subject_dn, seq)); seq++) {
-    if (!keyid) break; /* No keyid requested, so return the first one found. */
-    if (!ksba_cert_get_subj_key_id(cert, NULL, &subj) &&
-        !cmp_simple_canon_sexp(keyid, subj)) {
-      xfree(subj);
-      break; /* Found matching cert. */
-    }
-    xfree(subj);
-    ksba_cert_release(cert);
-  }
+  /* No check whether the certificate is cached.  If no keyid is
+     requested, return the first one found.  */
+  if (keyid)
+    cert = get_cert_byski(subject_dn, keyid);
+  else
+    cert = get_cert_bysubject(subject_dn, 0);
   if (cert) return cert; /* Done.  */
 
   if (DBG_LOOKUP) log_debug("find_cert_bysubject: certificate not in cache\n");
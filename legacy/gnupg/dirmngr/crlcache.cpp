@@ -90,7 +90,9 @@
 #include <config.h>
 
 #include <boost/format.hpp>
+#include <mutex>
 #include <ostream>
+#include <string>
 
 #include <assert.h>
 #include <dirent.h>
@@ -112,6 +114,7 @@
 #include <botan/hash.h>
 #include <botan/hex.h>
 
+#include "../common/rwlock.h"
 #include "cdb.h"
 #include "certcache.h"
 #include "crlcache.h"
@@ -125,11 +128,11 @@
 #define DBDIRFILE "DIR.txt"
 #define DBDIRVERSION 1
 
-/* The number of DB files we may have open at one time.  We need to
-   limit this because there is no guarantee that the number of issuers
-   has a upper limit.  We are currently using mmap, so it is a good
-   idea anyway to limit the number of opened cache files. */
-#define MAX_OPEN_DB_FILES 5
+/* The number of DB files we may have open at one time is given by
+   --max-open-crl-files.  We need to limit this because there is no
+   guarantee that the number of issuers has a upper limit.  The files
+   are mapped into memory and their descriptors closed right away, so
+   the limit is on address space and not on file descriptors.  */
 
 static const char oidstr_crlNumber[] = "2.5.29.20";
 /* static const char oidstr_issuingDistributionPoint[] = "2.5.29.28"; */
@@ -159,9 +162,10 @@ struct crl_cache_entry_s {
   struct cdb *cdb; /* The cache file handle or NULL if not open. */
 
   unsigned int cdb_use_count; /* Current use count. */
-  unsigned int cdb_lru_count; /* Used for LRU purposes. */
-  int dbfile_checked;         /* Set to true if the dbfile_hash value has
-                                 been checked one. */
+  unsigned int cdb_lru_count; /* Value of LRU_CLOCK at the last use. */
+  int dbfile_checked;         /* Set to 1 if the dbfile_hash value has
+                                 been checked once, or -1 if that check
+                                 failed. */
 };
 
 /* Definition of the entire cache object. */
@@ -179,6 +183,18 @@ static crl_cache_entry_t find_entry(crl_cache_entry_t first,
    right at startup.  */
 static crl_cache_t current_cache;
 
+/* Incremented on each use of a DB file to find the least recently
+   used one.  */
+static unsigned int lru_clock;
+
+/* Sessions running in parallel look up CRLs with CACHE_RWLOCK held
+   for reading; the list of entries is only changed with it held for
+   writing.  DB_LOCK serializes the opening and closing of DB files
+   and the lookups in them, as a struct cdb keeps the position of the
+   last record found.  */
+static rwlock cache_rwlock;
+static std::mutex db_lock;
+
 /* Return the current cache object or bail out if it is has not yet
    been initialized.  */
 static crl_cache_t get_current_cache(void) {
@@ -318,16 +334,17 @@ static char *next_line_from_file(estream_t fp, gpg_error_t *r_err) {
   return tmpbuf;
 }
 
+/* Unmap the DB file of ENTRY.  */
+static void close_db_file(crl_cache_entry_t entry) {
+  cdb_free(entry->cdb);
+  xfree(entry->cdb);
+  entry->cdb = NULL;
+}
+
 /* Release one cache entry.  */
 static void release_one_cache_entry(crl_cache_entry_t entry) {
   if (entry) {
-    if (entry->cdb) {
-      int fd = cdb_fileno(entry->cdb);
-      cdb_free(entry->cdb);
-      xfree(entry->cdb);
-      if (close(fd))
-        log_error(_("error closing cache file: %s\n"), strerror(errno));
-    }
+    if (entry->cdb) close_db_file(entry);
     xfree(entry->release_ptr);
     xfree(entry->check_trust_anchor);
     xfree(entry);
@@ -662,8 +679,14 @@ static void write_dir_line_crl(estream_t fp, crl_cache_entry_t e) {
   es_putc('\n', fp);
 }
 
-/* Update the current dir file using the cache. */
+/* Update the current dir file using the cache.  The dir file is
+   shared by all dirmngr processes using the same cache directory, and
+   each of them may insert a CRL for another issuer at the same time.
+   Only the merge of the dir file is serialized by a lock; the fetching
+   and parsing of the CRLs proceeds in parallel.  */
 static gpg_error_t update_dir(crl_cache_t cache) {
+  static dotlock_t lockhd;
+  int locked = 0;
   char *fname = NULL;
   char *tmpfname = NULL;
   char *line = NULL;
@@ -676,7 +699,14 @@ static gpg_error_t update_dir(crl_cache_t cache) {
 
   fname = make_filename(opt.homedir_cache, DBDIR_D, DBDIRFILE, NULL);
 
-  /* Fixme: Take an update file lock here. */
+  if (!lockhd) lockhd = dotlock_create(fname, 0);
+  if (!lockhd || dotlock_take(lockhd, -1)) {
+    err = gpg_error_from_syserror();
+    log_error(_("can't lock '%s'\n"), fname);
+    fp = NULL;
+    goto leave;
+  }
+  locked = 1;
 
   for (e = cache->entries; e; e = e->next) e->mark = 1;
 
@@ -820,7 +850,7 @@ static gpg_error_t update_dir(crl_cache_t cache) {
   }
 
 leave:
-  /* Fixme: Relinquish update lock. */
+  if (locked) dotlock_release(lockhd);
   xfree(line);
   es_fclose(fp);
   xfree(fname);
@@ -844,6 +874,25 @@ static char *make_db_file_name(const char *issuer_hash) {
   return make_filename(opt.homedir_cache, DBDIR_D, bname, NULL);
 }
 
+/* Create the MD5 context used to hash a DB file at R_MD5.  Returns 0
+   on success.  */
+static int open_db_hash(gcry_md_hd_t *r_md5) {
+  char buffer[256];
+  gpg_error_t err;
+
+  err = gcry_md_open(r_md5, GCRY_MD_MD5, 0);
+  if (err) {
+    log_error(_("error setting up MD5 hash context: %s\n"), gpg_strerror(err));
+    return -1;
+  }
+
+  /* We better hash some information about the cache file layout in. */
+  snprintf(buffer, sizeof buffer, "%.100s/%.100s:%d", DBDIR_D, DBDIRFILE,
+           DBDIRVERSION);
+  gcry_md_write(*r_md5, buffer, strlen(buffer));
+  return 0;
+}
+
 /* Hash the file FNAME and return the MD5 digest in MD5BUFFER. The
    caller must allocate MD%buffer wityh at least 16 bytes. Returns 0
    on success. */
@@ -852,7 +901,6 @@ static int hash_dbfile(const char *fname, unsigned char *md5buffer) {
   char *buffer;
   size_t n;
   gcry_md_hd_t md5;
-  gpg_error_t err;
 
   buffer = (char *)xtrymalloc(65536);
   fp = buffer ? es_fopen(fname, "rb") : NULL;
@@ -862,18 +910,12 @@ static int hash_dbfile(const char *fname, unsigned char *md5buffer) {
     return -1;
   }
 
-  err = gcry_md_open(&md5, GCRY_MD_MD5, 0);
-  if (err) {
-    log_error(_("error setting up MD5 hash context: %s\n"), gpg_strerror(err));
+  if (open_db_hash(&md5)) {
     xfree(buffer);
     es_fclose(fp);
     return -1;
   }
 
-  /* We better hash some information about the cache file layout in. */
-  sprintf(buffer, "%.100s/%.100s:%d", DBDIR_D, DBDIRFILE, DBDIRVERSION);
-  gcry_md_write(md5, buffer, strlen(buffer));
-
   for (;;) {
     n = es_fread(buffer, 1, 65536, fp);
     if (n < 65536 && es_ferror(fp)) {
@@ -895,10 +937,15 @@ static int hash_dbfile(const char *fname, unsigned char *md5buffer) {
   return 0;
 }
 
-/* Compare the file FNAME against the dexified MD5 hash MD5HASH and
-   return 0 if they match. */
-static int check_dbfile(const char *fname, const char *md5hexvalue) {
-  unsigned char buffer1[16], buffer2[16];
+/* Compare the mapped DB file CDB read from FNAME against the dexified
+   MD5 hash MD5HASH and return 0 if they match.  Hashing the mapping
+   checks exactly the data used for the lookups and saves reading the
+   file a second time. */
+static int check_dbfile(const char *fname, const struct cdb *cdb,
+                        const char *md5hexvalue) {
+  unsigned char buffer1[16];
+  gcry_md_hd_t md5;
+  int rc;
 
   if (strlen(md5hexvalue) != 32) {
     log_error(_("invalid formatted checksum for '%s'\n"), fname);
@@ -906,20 +953,27 @@ static int check_dbfile(const char *fname, const char *md5hexvalue) {
   }
   Botan::hex_decode(buffer1, md5hexvalue, strlen(md5hexvalue), false);
 
-  if (hash_dbfile(fname, buffer2)) return -1;
-
-  return memcmp(buffer1, buffer2, 16);
+  if (open_db_hash(&md5)) return -1;
+  gcry_md_write(md5, cdb->cdb_mem, cdb->cdb_fsize);
+  gcry_md_final(md5);
+  rc = memcmp(buffer1, gcry_md_read(md5, GCRY_MD_MD5), 16);
+  gcry_md_close(md5);
+  return rc;
 }
 
 /* Open the cache file for ENTRY.  This function implements a caching
    strategy and might close unused cache files. It is required to use
-   unlock_db_file after using the file. */
+   unlock_db_file after using the file.  The integrity of the file is
+   only checked when it is mapped, so lookups in a mapped file are
+   just memory accesses. */
 static struct cdb *lock_db_file(crl_cache_t cache, crl_cache_entry_t entry) {
   char *fname;
   int fd;
-  int open_count;
+  int open_count, max_open;
   crl_cache_entry_t e;
 
+  std::lock_guard<std::mutex> lock(db_lock);
+  entry->cdb_lru_count = ++lru_clock;
   if (entry->cdb) {
     entry->cdb_use_count++;
     return entry->cdb;
@@ -932,15 +986,17 @@ static struct cdb *lock_db_file(crl_cache_t cache, crl_cache_entry_t entry) {
   }
 
   /* If there are too many file open, find the least recent used DB
-     file and close it.  Note that for Pth thread safeness we need to
-     use a loop here. */
-  while (open_count >= MAX_OPEN_DB_FILES) {
+     file and close it.  */
+  max_open = opt.max_open_crl_files > 0 ? opt.max_open_crl_files : 1;
+  while (open_count >= max_open) {
     crl_cache_entry_t last_e = NULL;
-    unsigned int last_lru = (unsigned int)(-1);
+    unsigned int last_lru = 0;
 
+    /* Compare the age to cope with a wrap of LRU_CLOCK.  */
     for (e = cache->entries; e; e = e->next)
-      if (e->cdb && !e->cdb_use_count && e->cdb_lru_count < last_lru) {
-        last_lru = e->cdb_lru_count;
+      if (e->cdb && !e->cdb_use_count &&
+          (!last_e || lru_clock - e->cdb_lru_count > last_lru)) {
+        last_lru = lru_clock - e->cdb_lru_count;
         last_e = e;
       }
     if (!last_e) {
@@ -950,24 +1006,13 @@ static struct cdb *lock_db_file(crl_cache_t cache, crl_cache_entry_t entry) {
 
     /*       log_debug ("CACHE: closing file at cdb=%p\n", last_e->cdb); */
 
-    fd = cdb_fileno(last_e->cdb);
-    cdb_free(last_e->cdb);
-    xfree(last_e->cdb);
-    last_e->cdb = NULL;
-    if (close(fd))
-      log_error(_("error closing cache file: %s\n"), strerror(errno));
+    close_db_file(last_e);
     open_count--;
   }
 
   fname = make_db_file_name(entry->issuer_hash);
   if (opt.verbose) log_info(_("opening cache file '%s'\n"), fname);
 
-  if (!entry->dbfile_checked) {
-    if (!check_dbfile(fname, entry->dbfile_hash)) entry->dbfile_checked = 1;
-    /* Note, in case of an error we don't print an error here but
-       let require the caller to do that check. */
-  }
-
   entry->cdb = (cdb *)xtrycalloc(1, sizeof *entry->cdb);
   if (!entry->cdb) {
     xfree(fname);
@@ -990,41 +1035,52 @@ static struct cdb *lock_db_file(crl_cache_t cache, crl_cache_entry_t entry) {
     xfree(fname);
     return NULL;
   }
+  /* The mapping stays valid without the descriptor.  */
+  if (close(fd))
+    log_error(_("error closing cache file: %s\n"), strerror(errno));
+  entry->cdb->cdb_fd = -1;
+
+  /* Note, in case of an error we don't print an error here but
+     let require the caller to do that check. */
+  if (!entry->dbfile_checked)
+    entry->dbfile_checked =
+        check_dbfile(fname, entry->cdb, entry->dbfile_hash) ? -1 : 1;
   xfree(fname);
 
   entry->cdb_use_count = 1;
-  entry->cdb_lru_count = 0;
 
   return entry->cdb;
 }
 
 /* Unlock a cache file, so that it can be reused. */
 static void unlock_db_file(crl_cache_t cache, crl_cache_entry_t entry) {
+  (void)cache;
+
+  std::lock_guard<std::mutex> lock(db_lock);
   if (!entry->cdb)
     log_error(_("calling unlock_db_file on a closed file\n"));
   else if (!entry->cdb_use_count)
     log_error(_("calling unlock_db_file on an unlocked file\n"));
   else {
     entry->cdb_use_count--;
-    entry->cdb_lru_count++;
   }
 
-  /* If the entry was marked for deletion in the meantime do it now.
-     We do this for the sake of Pth thread safeness. */
-  if (!entry->cdb_use_count && entry->deleted) {
-    crl_cache_entry_t eprev, enext;
+  /* Entries marked for deletion are released by crl_cache_insert,
+     which holds the cache for writing and thus knows that no one
+     uses them anymore.  */
+}
 
-    enext = entry->next;
-    for (eprev = cache->entries; eprev && eprev->next != entry;
-         eprev = eprev->next)
-      ;
-    assert(eprev);
-    if (eprev == cache->entries)
-      cache->entries = enext;
-    else
-      eprev->next = enext;
-    /* FIXME: Do we leak ENTRY? */
-  }
+/* Release the entries of CACHE marked for deletion.  The caller must
+   hold CACHE_RWLOCK for writing.  */
+static void reap_deleted_entries(crl_cache_t cache) {
+  crl_cache_entry_t e, *eprev;
+
+  for (eprev = &cache->entries; (e = *eprev);)
+    if (e->deleted && !e->cdb_use_count) {
+      *eprev = e->next;
+      release_one_cache_entry(e);
+    } else
+      eprev = &e->next;
 }
 
 /* Find ISSUER_HASH in our cache FIRST. This may be used to enumerate
@@ -1057,6 +1113,8 @@ void crl_cache_init(void) {
 /* Remove the cache information and all its resources.  Note that we
    still keep the cache on disk. */
 void crl_cache_deinit(void) {
+  std::lock_guard<rwlock> lock(cache_rwlock);
+
   if (current_cache) {
     release_cache(current_cache);
     current_cache = NULL;
@@ -1078,9 +1136,10 @@ int crl_cache_flush(void) {
    cache has not yet expired.  We use a 30 minutes threshold here so
    that invoking this function several times won't load the CRL over
    and over.  */
-static crl_cache_result_t cache_isvalid(ctrl_t ctrl, const char *issuer_hash,
-                                        const unsigned char *sn, size_t snlen,
-                                        int force_refresh) {
+static crl_cache_result_t cache_lookup(const char *issuer_hash,
+                                       const unsigned char *sn, size_t snlen,
+                                       int force_refresh,
+                                       std::string *r_trust_anchor) {
   crl_cache_t cache = get_current_cache();
   crl_cache_result_t retval;
   struct cdb *cdb;
@@ -1089,8 +1148,7 @@ static crl_cache_result_t cache_isvalid(ctrl_t ctrl, const char *issuer_hash,
   gnupg_isotime_t current_time;
   size_t n;
 
-  (void)ctrl;
-
+  rwlock_reader lock(cache_rwlock);
   entry = find_entry(cache->entries, issuer_hash);
   if (!entry) {
     log_info(_("no CRL available for issuer id %s\n"), issuer_hash);
@@ -1131,13 +1189,14 @@ static crl_cache_result_t cache_isvalid(ctrl_t ctrl, const char *issuer_hash,
   cdb = lock_db_file(cache, entry);
   if (!cdb) return CRL_CACHE_DONTKNOW; /* Hmmm, not the best error code. */
 
-  if (!entry->dbfile_checked) {
+  if (entry->dbfile_checked != 1) {
     log_error(_("cached CRL for issuer id %s tampered; we need to update\n"),
               issuer_hash);
     unlock_db_file(cache, entry);
     return CRL_CACHE_DONTKNOW;
   }
 
+  std::unique_lock<std::mutex> find_lock(db_lock);
   rc = cdb_find(cdb, sn, snlen);
   if (rc == 1) {
     n = cdb_datalen(cdb);
@@ -1168,20 +1227,15 @@ static crl_cache_result_t cache_isvalid(ctrl_t ctrl, const char *issuer_hash,
     log_error(_("error getting data from cache file: %s\n"), strerror(errno));
     retval = CRL_CACHE_DONTKNOW;
   }
+  find_lock.unlock();
 
   if (entry->user_trust_req &&
       (retval == CRL_CACHE_VALID || retval == CRL_CACHE_INVALID)) {
     if (!entry->check_trust_anchor) {
       log_error("inconsistent data on user trust check\n");
       retval = CRL_CACHE_CANTUSE;
-    } else if (get_istrusted_from_client(ctrl, entry->check_trust_anchor)) {
-      if (opt.verbose)
-        log_info("no system trust and client does not trust either\n");
-      retval = CRL_CACHE_CANTUSE;
-    } else {
-      /* Okay, the CRL is considered valid by the client and thus
-         we can return the result as is.  */
-    }
+    } else
+      *r_trust_anchor = entry->check_trust_anchor;
   }
 
   unlock_db_file(cache, entry);
@@ -1189,6 +1243,29 @@ static crl_cache_result_t cache_isvalid(ctrl_t ctrl, const char *issuer_hash,
   return retval;
 }
 
+/* Check whether the certificate identified by ISSUER_HASH and
+   SN/SNLEN is valid; see cache_lookup.  If the CRL requires it, the
+   client is asked whether it trusts the root certificate; we don't
+   hold the cache while waiting for the answer.  */
+static crl_cache_result_t cache_isvalid(ctrl_t ctrl, const char *issuer_hash,
+                                        const unsigned char *sn, size_t snlen,
+                                        int force_refresh) {
+  crl_cache_result_t retval;
+  std::string trust_anchor;
+
+  retval = cache_lookup(issuer_hash, sn, snlen, force_refresh, &trust_anchor);
+  if (!trust_anchor.empty() &&
+      get_istrusted_from_client(ctrl, trust_anchor.c_str())) {
+    if (opt.verbose)
+      log_info("no system trust and client does not trust either\n");
+    retval = CRL_CACHE_CANTUSE;
+  }
+  /* Otherwise the CRL is considered valid by the client and thus we
+     can return the result as is.  */
+
+  return retval;
+}
+
 /* Check whether the certificate identified by ISSUER_HASH and
    SERIALNO is valid; i.e. not listed in our cache.  With
    FORCE_REFRESH set to true, a new CRL will be retrieved even if the
@@ -1672,10 +1749,13 @@ gpg_error_t crl_cache_insert(ctrl_t ctrl, const char *url,
   const char *oid;
   int critical;
   char *trust_anchor = NULL;
+  int locked = 0;
 
   /* FIXME: We should acquire a mutex for the URL, so that we don't
      simultaneously enter the same CRL twice.  However this needs to be
-     interweaved with the checking function.*/
+     interweaved with the checking function.  Note that the CRL is
+     fetched and parsed without holding the cache; it is locked only
+     to swap in the new DB file.  */
 
   err2 = 0;
 
@@ -1843,6 +1923,9 @@ gpg_error_t crl_cache_insert(ctrl_t ctrl, const char *url,
   entry->check_trust_anchor = trust_anchor;
   trust_anchor = NULL;
 
+  cache_rwlock.lock();
+  locked = 1;
+
   /* Check whether we already have an entry for this issuer and mark
      it as deleted. We better use a loop, just in case duplicates got
      somehow into the list. */
@@ -1862,12 +1945,7 @@ gpg_error_t crl_cache_insert(ctrl_t ctrl, const char *url,
       for (e = cache->entries; e; e = e->next)
         if (!e->cdb_use_count && e->cdb &&
             !strcmp(e->issuer_hash, entry->issuer_hash)) {
-          int fd = cdb_fileno(e->cdb);
-          cdb_free(e->cdb);
-          xfree(e->cdb);
-          e->cdb = NULL;
-          if (close(fd))
-            log_error(_("error closing cache file: %s\n"), strerror(errno));
+          close_db_file(e);
           any = 1;
           break;
         }
@@ -1897,8 +1975,10 @@ gpg_error_t crl_cache_insert(ctrl_t ctrl, const char *url,
           "cache entry will get lost with the next program start\n"));
     err = 0; /* Keep on running. */
   }
+  reap_deleted_entries(cache);
 
 leave:
+  if (locked) cache_rwlock.unlock();
   release_one_cache_entry(entry);
   if (fd_cdb != -1) close(fd_cdb);
   if (fname) {
@@ -1961,7 +2041,7 @@ static gpg_error_t list_one_crl_entry(crl_cache_t cache, crl_cache_entry_t e,
   cdb = lock_db_file(cache, e);
   if (!cdb) return GPG_ERR_GENERAL;
 
-  if (!e->dbfile_checked)
+  if (e->dbfile_checked != 1)
     out << _(" ERROR: This cached CRL may have been tampered with!\n");
 
   out << "\n";
@@ -2033,6 +2113,9 @@ gpg_error_t crl_cache_list(std::ostream &out) {
   crl_cache_entry_t entry;
   gpg_error_t err = 0;
 
+  /* Listing walks the DB files record by record.  */
+  std::lock_guard<rwlock> lock(cache_rwlock);
+
   for (entry = cache->entries; entry && !entry->deleted && !err;
        entry = entry->next)
     err = list_one_crl_entry(cache, entry, out);
@@ -2040,6 +2123,32 @@ gpg_error_t crl_cache_list(std::ostream &out) {
   return err;
 }
 
+/* Store in URLS the distribution points of the cached CRLs which
+   will expire within SECONDS, so that they can be fetched again
+   before a request has to wait for them.  Only HTTP URLs are
+   returned; CRLs loaded from files can't be refreshed.  */
+void crl_cache_expiring(int seconds, std::vector<std::string> &urls) {
+  crl_cache_entry_t entry;
+  gnupg_isotime_t current_time, horizon;
+
+  urls.clear();
+  gnupg_get_isotime(current_time);
+  gnupg_copy_time(horizon, current_time);
+  add_seconds_to_isotime(horizon, seconds);
+
+  rwlock_reader lock(cache_rwlock);
+  if (!current_cache) return;
+
+  for (entry = current_cache->entries; entry; entry = entry->next) {
+    if (entry->deleted || entry->invalid || !*entry->next_update) continue;
+    if (strcmp(entry->next_update, horizon) > 0) continue;
+    if (ascii_strncasecmp(entry->url, "http:", 5) &&
+        ascii_strncasecmp(entry->url, "https:", 6))
+      continue;
+    urls.push_back(entry->url);
+  }
+}
+
 /* Load the CRL containing the file named FILENAME into our CRL cache. */
 gpg_error_t crl_cache_load(ctrl_t ctrl, const char *filename) {
   gpg_error_t err;
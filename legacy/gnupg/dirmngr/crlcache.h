@@ -22,6 +22,8 @@
 #define CRLCACHE_H
 
 #include <ostream>
+#include <string>
+#include <vector>
 
 typedef enum {
   CRL_CACHE_VALID = 0,
@@ -56,6 +58,8 @@ gpg_error_t crl_cache_insert(ctrl_t ctrl, const char *url,
 
 gpg_error_t crl_cache_list(std::ostream &out);
 
+void crl_cache_expiring(int seconds, std::vector<std::string> &urls);
+
 gpg_error_t crl_cache_load(ctrl_t ctrl, const char *filename);
 
 gpg_error_t crl_cache_reload_crl(ctrl_t ctrl, ksba_cert_t cert);
@@ -23,15 +23,162 @@
 #include <errno.h>
 #include <stdio.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 #include <neopg/proto/http.h>
 
 #include "crlfetch.h"
+#include "dns-stuff.h"
+
+/* The amount of CRL data we download ahead of the parser.  */
+#define CRL_STREAM_BUFFER (1024 * 1024)
+
+/* A CRL which is downloaded by a background thread while ksba parses
+   it through the reader callback.  Thus the transfer, the parsing and
+   the creation of the cache DB overlap, and the CRL is never held in
+   memory as a whole.  */
+struct crl_stream_s {
+  NeoPG::Http request;
+  std::string url;
+  std::thread thread;
+
+  /* Shared with the download thread.  */
+  std::mutex lock;
+  std::condition_variable cond;
+  std::deque<std::string> chunks;
+  size_t buffered{0};
+  bool finished{false};  /* The download thread is done.  */
+  bool cancelled{false}; /* The reader has been released.  */
+  std::string error;     /* Set if the download failed.  */
+
+  /* Only used by the reader.  */
+  std::string chunk;
+  size_t chunk_pos{0};
+  int pem{-1}; /* Not yet known.  */
+  gpgrt_b64state_t b64state{nullptr};
+};
+
+/* The download thread of STREAM.  */
+static void crl_stream_fetch(crl_stream_s *stream) {
+  std::string error;
+
+  try {
+    stream->request.fetch([stream](const char *data, size_t length) {
+      std::unique_lock<std::mutex> lock(stream->lock);
+
+      stream->cond.wait(lock, [stream] {
+        return stream->cancelled || stream->buffered < CRL_STREAM_BUFFER;
+      });
+      if (stream->cancelled) throw std::runtime_error("cancelled");
+      stream->chunks.emplace_back(data, length);
+      stream->buffered += length;
+      stream->cond.notify_all();
+    });
+  } catch (const std::exception &e) {
+    error = e.what();
+  }
+
+  std::lock_guard<std::mutex> lock(stream->lock);
+  stream->error = error;
+  stream->finished = true;
+  stream->cond.notify_all();
+}
+
+/* Wait for the next chunk of STREAM and make it the current one.
+   Returns false at the end of the data.  */
+static bool crl_stream_next(crl_stream_s *stream) {
+  std::unique_lock<std::mutex> lock(stream->lock);
+
+  stream->cond.wait(lock, [stream] {
+    return !stream->chunks.empty() || stream->finished;
+  });
+  if (stream->chunks.empty()) return false;
+
+  stream->chunk = std::move(stream->chunks.front());
+  stream->chunks.pop_front();
+  stream->buffered -= stream->chunk.size();
+  stream->chunk_pos = 0;
+  stream->cond.notify_all();
+  return true;
+}
+
+/* The ksba reader callback for a CRL stream.  */
+static int crl_stream_read(void *cb_value, char *buffer, size_t count,
+                           size_t *r_nread) {
+  crl_stream_s *stream = (crl_stream_s *)cb_value;
+  size_t n;
+
+  if (!buffer && !count && !r_nread)
+    return GPG_ERR_NOT_SUPPORTED; /* We can't rewind.  */
+
+  *r_nread = 0;
+  while (stream->chunk_pos == stream->chunk.size()) {
+    if (!crl_stream_next(stream)) {
+      if (!stream->error.empty()) {
+        log_error(_("error retrieving '%s': %s\n"), stream->url.c_str(),
+                  stream->error.c_str());
+        stream->error.clear();
+        return GPG_ERR_NO_DATA;
+      }
+      return GPG_ERR_EOF;
+    }
+    if (stream->chunk.empty()) continue;
 
-/* Fetch CRL from URL and return the entire CRL using new ksba reader
-   object in READER. */
+    /* Check for PEM, such as http://grid.fzk.de/ca/gridka-crl.pem
+       (2008-2017).  */
+    if (stream->pem == -1) {
+      uint8_t c = stream->chunk[0];
+
+      stream->pem = !(((c & 0xc0) >> 6) == 0 /* class: universal */
+                      && (c & 0x1f) == 16    /* sequence */
+                      && (c & 0x20) /* is constructed */);
+      if (stream->pem) stream->b64state = gpgrt_b64dec_start("");
+    }
+    if (stream->pem) {
+      /* Decode PEM in place.  */
+      size_t new_size = 0;
+
+      if (!stream->b64state ||
+          gpgrt_b64dec_proc(stream->b64state, (void *)stream->chunk.data(),
+                            stream->chunk.size(), &new_size))
+        return GPG_ERR_INV_CRL;
+      stream->chunk.resize(new_size);
+    }
+  }
+
+  n = stream->chunk.size() - stream->chunk_pos;
+  if (n > count) n = count;
+  memcpy(buffer, stream->chunk.data() + stream->chunk_pos, n);
+  stream->chunk_pos += n;
+  *r_nread = n;
+  return 0;
+}
+
+/* Stop the download of STREAM and release it.  Used as the release
+   notification of the reader.  */
+static void crl_stream_release(void *value, ksba_reader_t reader) {
+  crl_stream_s *stream = (crl_stream_s *)value;
+
+  (void)reader;
+
+  {
+    std::lock_guard<std::mutex> lock(stream->lock);
+    stream->cancelled = true;
+    stream->cond.notify_all();
+  }
+  stream->thread.join();
+  if (stream->b64state) gpgrt_b64dec_finish(stream->b64state);
+  delete stream;
+}
+
+/* Fetch CRL from URL and return a new ksba reader object in READER,
+   which reads the CRL while it is being downloaded. */
 gpg_error_t crl_fetch(ctrl_t ctrl, const char *url, ksba_reader_t *reader) {
   gpg_error_t err;
-  std::string response;
+  crl_stream_s *stream;
   *reader = NULL;
 
   if (!url) return GPG_ERR_INV_ARG;
@@ -53,53 +200,60 @@ gpg_error_t crl_fetch(ctrl_t ctrl, const char *url, ksba_reader_t *reader) {
     return GPG_ERR_NOT_SUPPORTED;
   }
 
-  NeoPG::Http request;
-  request.set_url(url).forbid_reuse().set_timeout(ctrl->timeout).no_cache();
-
-  if (opt.http_proxy)
-    request.set_proxy(opt.http_proxy);
-  else
-    request.default_proxy(opt.honor_http_proxy);
+  stream = new crl_stream_s;
+  stream->url = url;
+  NeoPG::Http &request = stream->request;
+  try {
+    /* CRLs of large CAs are hundreds of megabytes.  */
+    request.set_url(stream->url)
+        .set_timeout(ctrl->timeout)
+        .no_cache()
+        .set_maxfilesize(0)
+        .set_http2()
+        .set_dns_cache(dns_cache());
 
-  if (opt.disable_ipv6)
-    request.set_ipresolve(NeoPG::Http::Resolve::IPv4);
-  else if (opt.disable_ipv4)
-    request.set_ipresolve(NeoPG::Http::Resolve::IPv6);
+    if (opt.http_proxy)
+      request.set_proxy(opt.http_proxy);
+    else
+      request.default_proxy(opt.honor_http_proxy);
 
-  try {
-    response = request.fetch();
+    if (opt.disable_ipv6)
+      request.set_ipresolve(NeoPG::Http::Resolve::IPv4);
+    else if (opt.disable_ipv4)
+      request.set_ipresolve(NeoPG::Http::Resolve::IPv6);
   } catch (const std::runtime_error &e) {
     log_error(_("error retrieving '%s': %s\n"), url, e.what());
+    delete stream;
     return GPG_ERR_NO_DATA;
   }
 
-  /* Check for PEM, such as http://grid.fzk.de/ca/gridka-crl.pem (2008-2017). */
-  if (response.size()) {
-    uint8_t c = response[0];
-    if (((c & 0xc0) >> 6) == 0 /* class: universal */
-        && (c & 0x1f) == 16    /* sequence */
-        && (c & 0x20) /* is constructed */)
-      ; /* Binary data.  */
-    else {
-      /* Decode PEM.  */
-      gpgrt_b64state_t b64state;
-      b64state = gpgrt_b64dec_start("");
-      size_t new_size;
-      gpgrt_b64dec_proc(b64state, (void *)response.data(), response.size(),
-                        &new_size);
-      gpgrt_b64dec_finish(b64state);
-      response.resize(new_size);
+  stream->thread = std::thread(crl_stream_fetch, stream);
+
+  /* Wait for the first data, so that a failing download is reported
+     here and the caller may try another distribution point.  */
+  {
+    std::unique_lock<std::mutex> lock(stream->lock);
+    stream->cond.wait(lock, [stream] {
+      return !stream->chunks.empty() || stream->finished;
+    });
+    if (stream->chunks.empty() && !stream->error.empty()) {
+      log_error(_("error retrieving '%s': %s\n"), url, stream->error.c_str());
+      lock.unlock();
+      stream->thread.join();
+      delete stream;
+      return GPG_ERR_NO_DATA;
     }
   }
 
   err = ksba_reader_new(reader);
-  if (!err) {
-    err = ksba_reader_set_mem(*reader, response.data(), response.size());
-  }
+  if (!err) err = ksba_reader_set_cb(*reader, crl_stream_read, stream);
+  if (!err)
+    err = ksba_reader_set_release_notify(*reader, crl_stream_release, stream);
   if (err) {
     log_error(_("error initializing reader object: %s\n"), gpg_strerror(err));
     ksba_reader_release(*reader);
     *reader = NULL;
+    crl_stream_release(stream, NULL);
   }
   return err;
 }
@@ -20,6 +20,11 @@
 
 #include <config.h>
 
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <assert.h>
 #include <errno.h>
 #include <stdarg.h>
@@ -56,7 +61,9 @@ enum {
   oLoadCRL,
   oPEM,
   oEscapedPEM,
-  oForceDefaultResponder
+  oForceDefaultResponder,
+  oLoadTest,
+  oRepeat
 };
 
 /* The list of options as used by the argparse.c code.  */
@@ -74,6 +81,9 @@ static ARGPARSE_OPTS opts[] = {
     {oPEM, "pem", 0, N_("expect certificates in PEM format")},
     {oForceDefaultResponder, "force-default-responder", 0,
      N_("force the use of the default OCSP responder")},
+    {oLoadTest, "load-test", 1,
+     N_("|N|run the command from N concurrent connections")},
+    {oRepeat, "repeat", 1, N_("|N|run the command N times per connection")},
     {0, NULL, 0, NULL}};
 
 /* The usual structure for the program flags.  */
@@ -87,6 +97,9 @@ static struct {
   int local;       /* Lookup up only local certificates.  */
 
   int use_ocsp;
+
+  int load_test; /* Number of concurrent connections or 0.  */
+  int repeat;    /* Number of requests per connection.  */
 } opt;
 
 /* Communication structure for the certificate inquire callback. */
@@ -128,6 +141,8 @@ static gpg_error_t do_validate(assuan_context_t ctx, const unsigned char *cert,
                                size_t certlen);
 static gpg_error_t do_loadcrl(assuan_context_t ctx, const char *filename);
 static gpg_error_t do_lookup(assuan_context_t ctx, const char *pattern);
+static int run_load_test(int cmd_cache_cert, int cmd_validate,
+                         const unsigned char *cert, size_t certlen);
 
 /* Function called by argparse.c to display information.  */
 static const char *my_strusage(int level) {
@@ -238,6 +253,12 @@ int dirmngr_client_main(int argc, char **argv) {
       case oForceDefaultResponder:
         opt.force_default_responder = 1;
         break;
+      case oLoadTest:
+        opt.load_test = pargs.r.ret_int;
+        break;
+      case oRepeat:
+        opt.repeat = pargs.r.ret_int;
+        break;
 
       default:
         pargs.err = 2;
@@ -246,6 +267,11 @@ int dirmngr_client_main(int argc, char **argv) {
   }
   if (log_get_errorcount(0)) exit(2);
 
+  if (opt.load_test && (cmd_ping || cmd_lookup || cmd_loadcrl)) {
+    log_error(_("--load-test only works with a certificate check\n"));
+    exit(2);
+  }
+
   if (cmd_ping)
     err = 0;
   else if (cmd_lookup || cmd_loadcrl) {
@@ -273,6 +299,12 @@ int dirmngr_client_main(int argc, char **argv) {
     exit(2);
   }
 
+  if (opt.load_test > 0) {
+    int rc = run_load_test(cmd_cache_cert, cmd_validate, certbuf, certbuflen);
+    xfree(certbuf);
+    return rc;
+  }
+
   err = start_new_dirmngr(&ctx, opt.verbose, 0);
   if (err) {
     log_error(_("can't connect to the dirmngr: %s\n"), gpg_strerror(err));
@@ -344,6 +376,71 @@ int dirmngr_client_main(int argc, char **argv) {
   }
 }
 
+/* Run the check selected by CMD_CACHE_CERT and CMD_VALIDATE for CERT
+   opt.repeat times from each of opt.load_test concurrent connections
+   and print the throughput and the worst latency.  This is meant to
+   measure how well a "dirmngr --daemon" serves concurrent clients.
+   Returns the exit code.  */
+static int run_load_test(int cmd_cache_cert, int cmd_validate,
+                         const unsigned char *cert, size_t certlen) {
+  typedef std::chrono::steady_clock clock;
+  std::vector<std::thread> threads;
+  std::mutex lock;
+  int repeat = opt.repeat > 0 ? opt.repeat : 1;
+  int requests = 0;
+  int failures = 0;
+  clock::duration slowest = clock::duration::zero();
+  clock::time_point start = clock::now();
+  double elapsed;
+  int i;
+
+  for (i = 0; i < opt.load_test; i++)
+    threads.emplace_back([&] {
+      assuan_context_t ctx;
+      gpg_error_t err;
+      int n;
+
+      err = start_new_dirmngr(&ctx, opt.verbose, 0);
+      if (err) {
+        log_error(_("can't connect to the dirmngr: %s\n"), gpg_strerror(err));
+        std::lock_guard<std::mutex> guard(lock);
+        failures += repeat;
+        return;
+      }
+
+      for (n = 0; n < repeat; n++) {
+        clock::time_point t0 = clock::now();
+
+        if (cmd_cache_cert) {
+          err = do_cache(ctx, cert, certlen);
+          if (err == GPG_ERR_DUP_VALUE) err = 0;
+        } else if (cmd_validate)
+          err = do_validate(ctx, cert, certlen);
+        else
+          err = do_check(ctx, cert, certlen);
+
+        clock::duration t = clock::now() - t0;
+        std::lock_guard<std::mutex> guard(lock);
+        requests++;
+        if (err) failures++;
+        if (t > slowest) slowest = t;
+      }
+
+      assuan_release(ctx);
+    });
+
+  for (auto &t : threads) t.join();
+
+  elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  log_info("%d requests from %d connections in %.3fs (%.1f/s)\n", requests,
+           opt.load_test, elapsed, elapsed > 0 ? requests / elapsed : 0.0);
+  log_info("slowest request: %.3fms, failed requests: %d\n",
+           std::chrono::duration<double, std::milli>(slowest).count(),
+           failures);
+
+  return failures ? 1 : 0;
+}
+
 /* Print status line from the assuan protocol.  */
 static gpg_error_t status_cb(void *opaque, const char *line) {
   (void)opaque;
@@ -21,11 +21,16 @@
 
 #include <config.h>
 
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <system_error>
+#include <thread>
 
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -52,6 +57,7 @@
 #include "crlcache.h"
 #include "crlfetch.h"
 #include "misc.h"
+#include "refresh.h"
 
 #ifndef ENAMETOOLONG
 #define ENAMETOOLONG EINVAL
@@ -68,6 +74,7 @@ enum cmd_and_opt_values {
   oNoVerbose = 500,
 
   aServer,
+  aDaemon,
   aListCRLs,
   aLoadCRL,
   aFetchCRL,
@@ -84,6 +91,8 @@ enum cmd_and_opt_values {
   oHomedir,
   oNoDetach,
   oLogFile,
+  oLogQueueSize,
+  oLogOverflow,
   oBatch,
   oDisableHTTP,
   oDisableIPv4,
@@ -97,7 +106,13 @@ enum cmd_and_opt_values {
   oOCSPMaxClockSkew,
   oOCSPMaxPeriod,
   oOCSPCurrentPeriod,
+  oOCSPDiskCache,
   oMaxReplies,
+  oMaxOpenCRLFiles,
+  oMaxSessions,
+  oDnsCacheTTL,
+  oMaxHostConnections,
+  oRefreshAhead,
   oHkpCaCert,
   oFakedSystemTime,
   oForce,
@@ -118,6 +133,7 @@ static ARGPARSE_OPTS opts[] = {
     ARGPARSE_group(300, N_("@Commands:\n ")),
 
     ARGPARSE_c(aServer, "server", N_("run in server mode (foreground)")),
+    ARGPARSE_c(aDaemon, "daemon", N_("run in daemon mode (background)")),
     ARGPARSE_c(aListCRLs, "list-crls",
                N_("list the contents of the CRL cache")),
     ARGPARSE_c(aLoadCRL, "load-crl", N_("|FILE|load CRL from FILE into cache")),
@@ -137,6 +153,10 @@ static ARGPARSE_OPTS opts[] = {
     ARGPARSE_s_n(oNoDetach, "no-detach", N_("do not detach from the console")),
     ARGPARSE_s_s(oLogFile, "log-file",
                  N_("|FILE|write server mode logs to FILE")),
+    ARGPARSE_s_u(oLogQueueSize, "log-queue-size",
+                 N_("|N|queue up to N log lines for the log writer")),
+    ARGPARSE_s_s(oLogOverflow, "log-overflow",
+                 N_("|POLICY|block or discard if the log queue is full")),
     ARGPARSE_s_n(oBatch, "batch", N_("run without asking a user")),
     ARGPARSE_s_n(oForce, "force", N_("force loading of outdated CRLs")),
     ARGPARSE_s_n(oAllowOCSP, "allow-ocsp", N_("allow sending OCSP requests")),
@@ -158,9 +178,22 @@ static ARGPARSE_OPTS opts[] = {
     ARGPARSE_s_i(oOCSPMaxClockSkew, "ocsp-max-clock-skew", "@"),
     ARGPARSE_s_i(oOCSPMaxPeriod, "ocsp-max-period", "@"),
     ARGPARSE_s_i(oOCSPCurrentPeriod, "ocsp-current-period", "@"),
+    ARGPARSE_s_n(oOCSPDiskCache, "ocsp-disk-cache",
+                 N_("keep verified OCSP responses on disk")),
 
     ARGPARSE_s_i(oMaxReplies, "max-replies",
                  N_("|N|do not return more than N items in one query")),
+    ARGPARSE_s_i(oMaxOpenCRLFiles, "max-open-crl-files",
+                 N_("|N|keep at most N cached CRLs mapped in memory")),
+    ARGPARSE_s_i(oMaxSessions, "max-sessions",
+                 N_("|N|serve at most N clients at the same time")),
+    ARGPARSE_s_i(oDnsCacheTTL, "dns-cache-ttl",
+                 N_("|N|cache DNS lookups for N seconds")),
+    ARGPARSE_s_i(oMaxHostConnections, "max-host-connections",
+                 N_("|N|open at most N connections to one host")),
+    ARGPARSE_s_i(oRefreshAhead, "refresh-ahead",
+                 N_("|N|refresh CRLs and OCSP responses N seconds "
+                    "before they expire")),
 
     ARGPARSE_s_s(oKeyServer, "keyserver", "@"),
     ARGPARSE_s_s(oHkpCaCert, "hkp-cacert",
@@ -203,6 +236,11 @@ static struct debug_flags_s debug_flags[] = {
 };
 
 #define DEFAULT_MAX_REPLIES 10
+#define DEFAULT_MAX_OPEN_CRL_FILES 64
+#define DEFAULT_MAX_SESSIONS 16
+#define DEFAULT_DNS_CACHE_TTL (5 * 60) /* 5 minutes */
+#define DEFAULT_MAX_HOST_CONNECTIONS 4
+#define DEFAULT_REFRESH_AHEAD (15 * 60) /* 15 minutes */
 
 #define DEFAULT_CONNECT_TIMEOUT (15 * 1000)      /* 15 seconds */
 #define DEFAULT_CONNECT_QUICK_TIMEOUT (2 * 1000) /*  2 seconds */
@@ -211,17 +249,32 @@ static struct debug_flags_s debug_flags[] = {
    the log file after a SIGHUP if it didn't changed. Malloced. */
 static char *current_logfile;
 
+/* The size of the log queue (0 to log directly) and the
+   LOG_OVERFLOW_ policy for --log-queue-size and --log-overflow.  */
+static unsigned int log_queue_size = 8192;
+static int log_overflow = LOG_OVERFLOW_BLOCK;
+
 /* Helper to implement --debug-level. */
 static const char *debug_level;
 
-/* Counter for the active connections.  */
+/* Counter for the active connections of the daemon.  Protected by
+   connection_lock; connection_cond is signalled whenever a connection
+   terminates.  */
 static int active_connections;
+static std::mutex connection_lock;
+static std::condition_variable connection_cond;
+
+/* The name of the socket the daemon listens on, or NULL.  Malloced.  */
+static char *socket_name;
 
 /* A list of filenames registred with --hkp-cacert.  */
 static std::vector<std::string> hkp_cacert_filenames;
 
 /* Prototypes. */
 static void cleanup(void);
+static int create_server_socket(void);
+static void detach_stdio(void);
+static void handle_connections(int listen_fd);
 static fingerprint_list_t parse_ocsp_signer(const char *string);
 
 static const char *my_strusage(int level) {
@@ -331,7 +384,13 @@ static int parse_rereadable_options(ARGPARSE_ARGS *pargs, int reread) {
     opt.ocsp_max_clock_skew = 10 * 60;     /* 10 minutes.  */
     opt.ocsp_max_period = 90 * 86400;      /* 90 days.  */
     opt.ocsp_current_period = 3 * 60 * 60; /* 3 hours. */
+    opt.ocsp_disk_cache = 0;
     opt.max_replies = DEFAULT_MAX_REPLIES;
+    opt.max_open_crl_files = DEFAULT_MAX_OPEN_CRL_FILES;
+    opt.max_sessions = DEFAULT_MAX_SESSIONS;
+    opt.dns_cache_ttl = DEFAULT_DNS_CACHE_TTL;
+    opt.max_host_connections = DEFAULT_MAX_HOST_CONNECTIONS;
+    opt.refresh_ahead = DEFAULT_REFRESH_AHEAD;
     while (opt.ocsp_signer) {
       fingerprint_list_t tmp = opt.ocsp_signer->next;
       xfree(opt.ocsp_signer);
@@ -416,10 +475,28 @@ static int parse_rereadable_options(ARGPARSE_ARGS *pargs, int reread) {
     case oOCSPCurrentPeriod:
       opt.ocsp_current_period = pargs->r.ret_int;
       break;
+    case oOCSPDiskCache:
+      opt.ocsp_disk_cache = 1;
+      break;
 
     case oMaxReplies:
       opt.max_replies = pargs->r.ret_int;
       break;
+    case oMaxOpenCRLFiles:
+      opt.max_open_crl_files = pargs->r.ret_int > 0 ? pargs->r.ret_int : 1;
+      break;
+    case oMaxSessions:
+      opt.max_sessions = pargs->r.ret_int > 0 ? pargs->r.ret_int : 1;
+      break;
+    case oDnsCacheTTL:
+      opt.dns_cache_ttl = pargs->r.ret_int > 0 ? pargs->r.ret_int : 0;
+      break;
+    case oMaxHostConnections:
+      opt.max_host_connections = pargs->r.ret_int > 0 ? pargs->r.ret_int : 0;
+      break;
+    case oRefreshAhead:
+      opt.refresh_ahead = pargs->r.ret_int > 0 ? pargs->r.ret_int : 0;
+      break;
 
     case oHkpCaCert: {
       /* FIXME: We are not supporting this anymore, but could.  */
@@ -493,6 +570,7 @@ int dirmngr_main(int argc, char **argv) {
   init_common_subsystems(&argc, &argv);
 
   gcry_control(GCRYCTL_DISABLE_SECMEM, 0);
+  dotlock_create(NULL, 0); /* Register lockfile cleanup.  */
 
   ksba_set_malloc_hooks(gcry_malloc, gcry_realloc, gcry_free);
 
@@ -575,6 +653,7 @@ next_pass:
     if (parse_rereadable_options(&pargs, 0)) continue; /* Already handled */
     switch (pargs.r_opt) {
       case aServer:
+      case aDaemon:
       case aShutdown:
       case aFlush:
       case aListCRLs:
@@ -621,6 +700,15 @@ next_pass:
       case oLogFile:
         logfile = pargs.r.ret_str;
         break;
+      case oLogQueueSize:
+        log_queue_size = pargs.r.ret_ulong;
+        break;
+      case oLogOverflow:
+        log_overflow = log_parse_overflow(pargs.r.ret_str);
+        if (log_overflow < 0)
+          log_error(_("invalid log overflow policy '%s'\n"),
+                    pargs.r.ret_str);
+        break;
       case oCsh:
         csh_style = 1;
         break;
@@ -711,9 +799,48 @@ next_pass:
       log_debug("... okay\n");
     }
 
+    log_set_async(log_queue_size, log_overflow);
     cert_cache_init(hkp_cacert_filenames);
     crl_cache_init();
-    start_command_handler();
+    start_command_handler(ASSUAN_INVALID_FD);
+  } else if (cmd == aDaemon) {
+    int fd;
+
+    if (argc) wrong_args("--daemon");
+
+    fd = create_server_socket();
+
+    if (logfile) {
+      log_set_file(logfile);
+      log_set_prefix(NULL, GPGRT_LOG_WITH_TIME | GPGRT_LOG_WITH_PID);
+    }
+
+    if (!nodetach) {
+      pid_t pid = fork();
+      if (pid == (pid_t)-1) {
+        log_error("fork failed: %s\n", strerror(errno));
+        dirmngr_exit(1);
+      }
+      if (pid) {
+        /* The parent leaves the socket to the child.  */
+        close(fd);
+        xfree(socket_name);
+        socket_name = NULL;
+        exit(0);
+      }
+      if (setsid() == -1) {
+        log_error("setsid() failed: %s\n", strerror(errno));
+        dirmngr_exit(1);
+      }
+      detach_stdio();
+    }
+
+    /* After the fork, as the log writer is a thread.  */
+    log_set_async(log_queue_size, log_overflow);
+    cert_cache_init(hkp_cacert_filenames);
+    crl_cache_init();
+    refresh_start();
+    handle_connections(fd);
   } else if (cmd == aListCRLs) {
     /* Just list the CRL cache and exit. */
     if (argc) wrong_args("--list-crls");
@@ -768,6 +895,148 @@ next_pass:
 static void cleanup(void) {
   crl_cache_deinit();
   cert_cache_deinit(1);
+  if (socket_name) {
+    remove(socket_name);
+    xfree(socket_name);
+    socket_name = NULL;
+  }
+}
+
+/* Return the name of the socket the daemon listens on, or NULL if we
+   are not running as a daemon.  */
+const char *dirmngr_get_current_socket_name(void) { return socket_name; }
+
+/* Create the socket for the daemon in the home directory and return
+   it listening.  A stale socket left over by a crashed daemon is
+   removed; if another dirmngr is still serving it we exit.  */
+static int create_server_socket(void) {
+  struct sockaddr_un addr;
+  int fd;
+  int rc;
+
+  socket_name = make_filename(gnupg_homedir(), DIRMNGR_SOCK_NAME, NULL);
+  if (strlen(socket_name) + 1 >= sizeof addr.sun_path) {
+    log_error(_("socket name '%s' is too long\n"), socket_name);
+    xfree(socket_name);
+    socket_name = NULL;
+    dirmngr_exit(2);
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    log_error(_("can't create socket: %s\n"), strerror(errno));
+    xfree(socket_name);
+    socket_name = NULL;
+    dirmngr_exit(2);
+  }
+
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socket_name);
+
+  rc = bind(fd, (struct sockaddr *)&addr, sizeof addr);
+  if (rc == -1 && errno == EADDRINUSE) {
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (probe != -1 &&
+        !connect(probe, (struct sockaddr *)&addr, sizeof addr)) {
+      close(probe);
+      close(fd);
+      log_error(_("a dirmngr is already running - "
+                  "not starting a new one\n"));
+      xfree(socket_name);
+      socket_name = NULL;
+      dirmngr_exit(2);
+    }
+    if (probe != -1) close(probe);
+    remove(socket_name);
+    rc = bind(fd, (struct sockaddr *)&addr, sizeof addr);
+  }
+  if (rc == -1) {
+    log_error(_("error binding socket to '%s': %s\n"), socket_name,
+              strerror(errno));
+    close(fd);
+    xfree(socket_name);
+    socket_name = NULL;
+    dirmngr_exit(2);
+  }
+
+  if (chmod(socket_name, S_IRUSR | S_IWUSR) == -1)
+    log_info("can't set permissions of '%s': %s\n", socket_name,
+             strerror(errno));
+
+  if (listen(fd, 5) == -1) {
+    log_error(_("listen() failed: %s\n"), strerror(errno));
+    close(fd);
+    dirmngr_exit(2);
+  }
+
+  if (opt.verbose) log_info(_("listening on socket '%s'\n"), socket_name);
+  return fd;
+}
+
+/* Point stdin and stdout of the detached daemon to /dev/null.  stderr
+   is kept for the log unless a log file was given.  */
+static void detach_stdio(void) {
+  int fd = open("/dev/null", O_RDWR);
+
+  if (fd == -1) return;
+  dup2(fd, 0);
+  dup2(fd, 1);
+  if (fd > 1) close(fd);
+}
+
+/* Serve one connection of the daemon.  Runs in its own thread.  */
+static void connection_thread(int fd) {
+  start_command_handler(fd);
+
+  std::lock_guard<std::mutex> lock(connection_lock);
+  active_connections--;
+  connection_cond.notify_one();
+}
+
+/* Accept connections on the listening socket LISTEN_FD and serve each
+   one in a separate thread, at most opt.max_sessions at a time.
+   Connections beyond that limit wait in the listen queue.  The
+   threads share the certificate, CRL and OCSP caches, which do their
+   own locking.  Returns only if accept fails.  */
+static void handle_connections(int listen_fd) {
+  /* A client going away must not kill the whole daemon.  */
+  signal(SIGPIPE, SIG_IGN);
+
+  for (;;) {
+    struct sockaddr_un paddr;
+    socklen_t plen = sizeof paddr;
+    int fd;
+
+    {
+      std::unique_lock<std::mutex> lock(connection_lock);
+      connection_cond.wait(
+          lock, [] { return active_connections < opt.max_sessions; });
+    }
+
+    fd = accept(listen_fd, (struct sockaddr *)&paddr, &plen);
+    if (fd == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      log_error(_("accept failed: %s\n"), strerror(errno));
+      break;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(connection_lock);
+      active_connections++;
+    }
+    try {
+      std::thread(connection_thread, fd).detach();
+    } catch (const std::system_error &e) {
+      log_error(_("error spawning connection handler: %s\n"), e.what());
+      close(fd);
+      std::lock_guard<std::mutex> lock(connection_lock);
+      active_connections--;
+    }
+  }
+
+  close(listen_fd);
 }
 
 void dirmngr_exit(int rc) {
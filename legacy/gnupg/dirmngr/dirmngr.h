@@ -96,6 +96,17 @@ struct dirmngr_options {
 
   int max_replies{0};
 
+  int max_open_crl_files{0}; /* Number of CRL cache files kept mapped.  */
+
+  int max_sessions{0}; /* Number of clients served concurrently.  */
+
+  int dns_cache_ttl{0}; /* Seconds to keep DNS results, 0 to disable.  */
+
+  int max_host_connections{0}; /* Connections to one host, 0 is unlimited.  */
+
+  int refresh_ahead{0}; /* Refresh CRLs and OCSP responses this many
+                           seconds before they expire, 0 to disable.  */
+
   const char *ocsp_responder{nullptr}; /* Standard OCSP responder's URL. */
   fingerprint_list_t ocsp_signer{
       nullptr}; /* The list of fingerprints with allowed
@@ -106,6 +117,8 @@ struct dirmngr_options {
                                       considered valid after thisUpdate. */
   unsigned int ocsp_current_period{0}; /* Seconds a response is considered
                                       current after nextUpdate. */
+  int ocsp_disk_cache{0};              /* Also keep verified OCSP responses
+                                      in the cache directory.  */
 
   std::vector<std::string> keyserver; /* List of default keyservers.  */
 };
@@ -179,7 +192,7 @@ ksba_cert_t get_issuing_cert_local(ctrl_t ctrl, const char *issuer);
 ksba_cert_t get_cert_local_ski(ctrl_t ctrl, const char *name,
                                ksba_sexp_t keyid);
 gpg_error_t get_istrusted_from_client(ctrl_t ctrl, const char *hexfpr);
-void start_command_handler();
+void start_command_handler(assuan_fd_t fd);
 gpg_error_t dirmngr_status(ctrl_t ctrl, const char *keyword, ...);
 gpg_error_t dirmngr_status_help(ctrl_t ctrl, const char *text);
 
@@ -30,11 +30,18 @@
 
 #include <config.h>
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <neopg/proto/dns_cache.h>
+
+#include "dirmngr.h"
 #include "dns-stuff.h"
 
+/* Failed lookups are retried after this many seconds.  */
+#define DNS_NEGATIVE_TTL 30
+
 /* Check whether NAME is an IP address.  Returns a true if it is
  * either an IPv6 or a IPv4 numerical address.  The actual return
  * values can also be used to identify whether it is v4 or v6: The
@@ -89,3 +96,33 @@ legacy:
   }
   return (ndots == 3) ? 4 : 0;
 }
+
+/* Return the DNS cache shared by all requests.  It also keeps the idle
+   connections and TLS sessions, so that keyserver, CRL and OCSP requests
+   to the same host reuse them.  It is never released, because detached
+   connection threads may still use it at exit.  The TTL and the limit of
+   connections per host are taken from the options each time, so that
+   they follow a reload.  */
+NeoPG::DnsCache *dns_cache(void) {
+  static NeoPG::DnsCache *cache = new NeoPG::DnsCache;
+
+  cache->set_ttl(opt.dns_cache_ttl)
+      .set_negative_ttl(opt.dns_cache_ttl ? DNS_NEGATIVE_TTL : 0)
+      .set_max_host_connections(opt.max_host_connections);
+  return cache;
+}
+
+/* Format the statistics of the DNS cache into BUFFER of SIZE.  */
+void dns_cache_stats(char *buffer, size_t size) {
+  NeoPG::DnsCache::Stats stats = dns_cache()->stats();
+
+  snprintf(buffer, size,
+           "requests=%llu failures=%llu negative_hits=%llu resolve_ms=%.0f"
+           " reused=%llu host_waits=%llu",
+           (unsigned long long)stats.m_requests,
+           (unsigned long long)stats.m_failures,
+           (unsigned long long)stats.m_negative_hits,
+           stats.m_resolve_time * 1000,
+           (unsigned long long)stats.m_reused,
+           (unsigned long long)stats.m_host_waits);
+}
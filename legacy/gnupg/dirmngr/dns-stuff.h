@@ -30,7 +30,20 @@
 #ifndef GNUPG_DIRMNGR_DNS_STUFF_H
 #define GNUPG_DIRMNGR_DNS_STUFF_H
 
+#include <stddef.h>
+
+namespace NeoPG {
+class DnsCache;
+}
+
 /* Return true if NAME is a numerical IP address.  */
 int is_ip_address(const char *name);
 
+/* Return the DNS cache shared by all requests of the process,
+   configured by the current options.  */
+NeoPG::DnsCache *dns_cache(void);
+
+/* Format the statistics of the DNS cache into BUFFER of SIZE.  */
+void dns_cache_stats(char *buffer, size_t size);
+
 #endif /*GNUPG_DIRMNGR_DNS_STUFF_H*/
@@ -147,28 +147,24 @@ gpg_error_t ks_action_get(ctrl_t ctrl, uri_item_t keyservers,
   for (uri = keyservers; !err && uri; uri = uri->next) {
     int is_http = uri->parsed_uri->is_http;
 
-    printf("considering %s %i\n", uri->uri, is_http);
-
     if (is_http) {
-      std::string one_response;
+      std::vector<std::string> responses;
+      std::vector<gpg_error_t> errors;
       any_server = 1;
-      for (auto &pattern : patterns) {
-        {
-          err =
-              ks_hkp_get(ctrl, uri->parsed_uri, pattern.c_str(), one_response);
-          if (err) break;
-        }
+      err = ks_hkp_get_many(ctrl, uri->parsed_uri, patterns, responses,
+                            errors);
+      if (err) break;
 
-        if (err) {
+      for (size_t i = 0; i < patterns.size(); i++) {
+        if (errors[i]) {
           /* It is possible that a server does not carry a
              key, thus we only save the error and continue
              with the next pattern.  FIXME: It is an open
              question how to return such an error condition to
              the caller.  */
-          first_err = err;
-          err = 0;
+          if (!first_err) first_err = errors[i];
         } else {
-          response.append(one_response);
+          response.append(responses[i]);
           any_data = 1;
         }
       }
@@ -23,12 +23,20 @@
 #include <tao/json/external/optional.hpp>
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <neopg/proto/http.h>
+#include <neopg/proto/http_cache.h>
+#include <neopg/proto/http_pool.h>
 
+#include <map>
+#include <memory>
+
+#include "../common/trace.h"
 #include "../common/userids.h"
 #include "dirmngr.h"
 #include "dns-stuff.h"
@@ -39,6 +47,13 @@
    more characters than actually needed. */
 #define EXTRA_ESCAPE_CHARS "@!\"#$%&'()*+,-./:;<=>?[\\]^_{|}~"
 
+/* The number of concurrent requests of ks_hkp_get_many.  */
+#define HKP_GET_CONCURRENCY 16
+
+/* The HTTP cache directory for ks_hkp_get_many below the cache
+   directory.  */
+#define HKP_CACHE_DIR "hkp.d"
+
 /* Print a help output for the schemata supported by this module. */
 gpg_error_t ks_hkp_help(ctrl_t ctrl, parsed_uri_t uri) {
   const char data[] =
@@ -89,16 +104,8 @@ static std::string make_host_part(ctrl_t ctrl, const std::string &scheme,
   return hostport;
 }
 
-/* Send an HTTP request.  On success returns response in RESPONSE.  If
-   POST_CB is not NULL a post request is used and that callback is
-   called to allow writing the post data.  If R_HTTP_STATUS is not
-   NULL, the http status code will be stored there.  */
-static gpg_error_t send_request(ctrl_t ctrl, const std::string &url,
-                                tao::optional<std::string> post_data,
-                                std::string &response,
-                                unsigned int *r_http_status) {
-  if (url.empty()) return GPG_ERR_INV_ARG;
-
+/* Return an error if HTTP access has been disabled.  */
+static gpg_error_t check_http_access(void) {
   if (opt.disable_http) {
     log_error(_("CRL access not possible due to disabled %s\n"), "HTTP");
     return GPG_ERR_NOT_SUPPORTED;
@@ -109,9 +116,27 @@ static gpg_error_t send_request(ctrl_t ctrl, const std::string &url,
               "ipv4 and ipv6");
     return GPG_ERR_NOT_SUPPORTED;
   }
+  return 0;
+}
+
+/* Send an HTTP request.  On success returns response in RESPONSE.  If
+   POST_CB is not NULL a post request is used and that callback is
+   called to allow writing the post data.  If R_HTTP_STATUS is not
+   NULL, the http status code will be stored there.  */
+static gpg_error_t send_request(ctrl_t ctrl, const std::string &url,
+                                tao::optional<std::string> post_data,
+                                std::string &response,
+                                unsigned int *r_http_status) {
+  gpg_error_t err;
+
+  if (url.empty()) return GPG_ERR_INV_ARG;
+
+  err = check_http_access();
+  if (err) return err;
 
   NeoPG::Http request;
-  request.set_url(url).forbid_reuse().set_timeout(ctrl->timeout).no_cache();
+  request.set_url(url).set_timeout(ctrl->timeout).no_cache().set_http2();
+  request.set_dns_cache(dns_cache());
 
   if (opt.http_proxy)
     request.set_proxy(opt.http_proxy);
@@ -136,8 +161,10 @@ static gpg_error_t send_request(ctrl_t ctrl, const std::string &url,
     request.set_cainfo(pemname);
   }
 
+  TRACE_SPAN_ARG("hkp_fetch", uri.host.c_str());
   try {
     response = request.fetch();
+    TRACE_COUNTER("hkp_response_bytes", response.size());
     /* FIXMEFIXMEFIXME: Return http status in r_http_status.  */
   } catch (const std::runtime_error &e) {
     log_error(_("error retrieving '%s': %s\n"), url.c_str(), e.what());
@@ -223,19 +250,18 @@ gpg_error_t ks_hkp_search(ctrl_t ctrl, parsed_uri_t uri, const char *pattern,
   return 0;
 }
 
-/* Get the key described key the KEYSPEC string from the keyserver
-   identified by URI.  On success data is in RESPONSE.  The data will
-   be provided in a format GnuPG can import (either a binary OpenPGP
-   message or an armored one).  */
-gpg_error_t ks_hkp_get(ctrl_t ctrl, parsed_uri_t uri, const char *keyspec,
-                       std::string &response) {
+/* Build the request URL at R_REQUEST to get the key described by the
+   KEYSPEC string from the keyserver identified by URI.  The remote
+   part of the URL is also stored at R_HOSTPORT.  */
+static gpg_error_t make_get_request(ctrl_t ctrl, parsed_uri_t uri,
+                                    const char *keyspec,
+                                    std::string &r_request,
+                                    std::string &r_hostport) {
   gpg_error_t err;
   KEYDB_SEARCH_DESC desc;
   char kidbuf[2 + 40 + 1];
   const char *exactname = NULL;
   std::string searchkey;
-  std::string hostport;
-  std::string request;
 
   /* Remove search type indicator and adjust PATTERN accordingly.
      Note that HKP keyservers like the 0x to be present when searching
@@ -274,9 +300,24 @@ gpg_error_t ks_hkp_get(ctrl_t ctrl, parsed_uri_t uri, const char *keyspec,
       http_escape_string(exactname ? exactname : kidbuf, EXTRA_ESCAPE_CHARS);
 
   /* Build the request string.  */
-  hostport = make_host_part(ctrl, uri->scheme, uri->host, uri->port);
-  request = hostport + "/pks/lookup?op=get&options=mr&search=" + searchkey +
-            (exactname ? "&exact=on" : "");
+  r_hostport = make_host_part(ctrl, uri->scheme, uri->host, uri->port);
+  r_request = r_hostport + "/pks/lookup?op=get&options=mr&search=" +
+              searchkey + (exactname ? "&exact=on" : "");
+  return 0;
+}
+
+/* Get the key described key the KEYSPEC string from the keyserver
+   identified by URI.  On success data is in RESPONSE.  The data will
+   be provided in a format GnuPG can import (either a binary OpenPGP
+   message or an armored one).  */
+gpg_error_t ks_hkp_get(ctrl_t ctrl, parsed_uri_t uri, const char *keyspec,
+                       std::string &response) {
+  gpg_error_t err;
+  std::string hostport;
+  std::string request;
+
+  err = make_get_request(ctrl, uri, keyspec, request, hostport);
+  if (err) return err;
 
   /* Send the request.  */
   response.clear();
@@ -286,6 +327,98 @@ gpg_error_t ks_hkp_get(ctrl_t ctrl, parsed_uri_t uri, const char *keyspec,
   return dirmngr_status(ctrl, "SOURCE", hostport.c_str(), NULL);
 }
 
+/* Get the keys described by the KEYSPECS strings from the keyserver
+   identified by URI, like ks_hkp_get, but with up to
+   HKP_GET_CONCURRENCY requests in flight over pooled connections.
+   Identical requests are only sent once.  Responses are cached below
+   the cache directory and revalidated with conditional requests, so
+   refreshing unchanged keys is cheap.  On return R_RESPONSES has one
+   entry for each keyspec and R_ERRORS the error code for each of
+   them; the function itself only fails if no request could be sent
+   at all.  */
+gpg_error_t ks_hkp_get_many(ctrl_t ctrl, parsed_uri_t uri,
+                            const std::vector<std::string> &keyspecs,
+                            std::vector<std::string> &r_responses,
+                            std::vector<gpg_error_t> &r_errors) {
+  gpg_error_t err;
+  std::string hostport;
+  std::vector<std::string> urls;
+  std::map<std::string, size_t> url_index;
+  /* The index into URLS for each keyspec, or -1 on error.  */
+  std::vector<ssize_t> index;
+  char *cachedir;
+  char *pemname = NULL;
+
+  r_responses.assign(keyspecs.size(), std::string());
+  r_errors.assign(keyspecs.size(), 0);
+
+  err = check_http_access();
+  if (err) return err;
+
+  for (size_t i = 0; i < keyspecs.size(); i++) {
+    std::string request;
+
+    r_errors[i] = make_get_request(ctrl, uri, keyspecs[i].c_str(), request,
+                                   hostport);
+    if (r_errors[i]) {
+      index.push_back(-1);
+      continue;
+    }
+    auto it = url_index.emplace(request, urls.size());
+    if (it.second) urls.push_back(request);
+    index.push_back(it.first->second);
+  }
+  if (urls.empty()) return r_errors.empty() ? 0 : r_errors[0];
+
+  /* The cache is optional; without it all keys are fetched again.  */
+  std::unique_ptr<NeoPG::HttpCache> cache;
+  cachedir = make_filename_try(opt.homedir_cache, HKP_CACHE_DIR, NULL);
+  if (cachedir &&
+      (!mkdir(cachedir, S_IRUSR | S_IWUSR | S_IXUSR) || errno == EEXIST))
+    cache.reset(new NeoPG::HttpCache(cachedir));
+  xfree(cachedir);
+
+  /* See send_request.  */
+  if (uri->host && !strcmp(uri->host, "hkps.pool.sks-keyservers.net"))
+    pemname =
+        make_filename_try(gnupg_datadir(), "sks-keyservers.netCA.pem", NULL);
+
+  std::vector<NeoPG::HttpResult> results;
+  TRACE_SPAN_ARG("hkp_fetch_many", uri->host);
+  try {
+    NeoPG::HttpPool pool;
+    pool.set_concurrency(HKP_GET_CONCURRENCY)
+        .set_timeout(ctrl->timeout)
+        .set_cache(cache.get())
+        .set_max_host_connections(opt.max_host_connections)
+        .set_dns_cache(dns_cache())
+        .no_cache();
+    if (opt.http_proxy) pool.set_proxy(opt.http_proxy);
+    if (pemname) pool.set_cainfo(pemname);
+
+    results = pool.fetch_many(urls);
+  } catch (const std::runtime_error &e) {
+    log_error(_("error retrieving '%s': %s\n"), hostport.c_str(), e.what());
+    xfree(pemname);
+    return GPG_ERR_NO_DATA;
+  }
+  xfree(pemname);
+
+  for (size_t i = 0; i < keyspecs.size(); i++) {
+    if (index[i] < 0) continue;
+    const NeoPG::HttpResult &result = results[index[i]];
+    if (!result.m_error.empty()) {
+      if (result.m_status != 404)
+        log_error(_("error retrieving '%s': %s\n"), result.m_url.c_str(),
+                  result.m_error.c_str());
+      r_errors[i] = GPG_ERR_NO_DATA;
+    } else
+      r_responses[i] = result.m_body;
+  }
+
+  return dirmngr_status(ctrl, "SOURCE", hostport.c_str(), NULL);
+}
+
 /* Send the key in {DATA,DATALEN} to the keyserver identified by URI.  */
 gpg_error_t ks_hkp_put(ctrl_t ctrl, parsed_uri_t uri, const void *data,
                        size_t datalen) {
@@ -26,7 +26,9 @@
 
 #include <neopg/proto/http.h>
 
+#include "../common/trace.h"
 #include "dirmngr.h"
+#include "dns-stuff.h"
 #include "ks-engine.h"
 #include "misc.h"
 
@@ -70,7 +72,8 @@ gpg_error_t ks_http_fetch(ctrl_t ctrl, const char *url, std::string &response) {
   /* Note that we only use the system provided certificates.  */
   /* ctrl->http_no_crl support?  */
   NeoPG::Http request;
-  request.set_url(url).forbid_reuse().set_timeout(ctrl->timeout).no_cache();
+  request.set_url(url).set_timeout(ctrl->timeout).no_cache().set_http2();
+  request.set_dns_cache(dns_cache());
 
   if (opt.http_proxy)
     request.set_proxy(opt.http_proxy);
@@ -82,6 +85,7 @@ gpg_error_t ks_http_fetch(ctrl_t ctrl, const char *url, std::string &response) {
   else if (opt.disable_ipv4)
     request.set_ipresolve(NeoPG::Http::Resolve::IPv6);
 
+  TRACE_SPAN("http_fetch");
   try {
     response = request.fetch();
   } catch (const std::runtime_error &e) {
@@ -21,6 +21,9 @@
 #ifndef DIRMNGR_KS_ENGINE_H
 #define DIRMNGR_KS_ENGINE_H 1
 
+#include <string>
+#include <vector>
+
 #include "http.h"
 
 /*-- ks-action.c --*/
@@ -34,6 +37,10 @@ gpg_error_t ks_hkp_search(ctrl_t ctrl, parsed_uri_t uri, const char *pattern,
                           std::string &response, unsigned int *r_http_status);
 gpg_error_t ks_hkp_get(ctrl_t ctrl, parsed_uri_t uri, const char *keyspec,
                        std::string &response);
+gpg_error_t ks_hkp_get_many(ctrl_t ctrl, parsed_uri_t uri,
+                            const std::vector<std::string> &keyspecs,
+                            std::vector<std::string> &r_responses,
+                            std::vector<gpg_error_t> &r_errors);
 gpg_error_t ks_hkp_put(ctrl_t ctrl, parsed_uri_t uri, const void *data,
                        size_t datalen);
 
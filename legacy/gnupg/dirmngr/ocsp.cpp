@@ -23,11 +23,21 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
 
 #include <neopg/proto/http.h>
 
 #include "certcache.h"
 #include "dirmngr.h"
+#include "dns-stuff.h"
 #include "misc.h"
 #include "ocsp.h"
 #include "validate.h"
@@ -45,6 +55,213 @@ static const char oidstr_ocsp[] = "1.3.6.1.5.5.7.48.1";
  */
 /* static const char oidstr_certHash[] = "1.3.36.8.3.13"; */
 
+/* The maximum number of verified responses kept in memory.  */
+#define OCSP_CACHE_SIZE 4096
+
+/* The subdirectory of the cache directory for --ocsp-disk-cache.  */
+#define OCSP_CACHE_DIR "ocsp.d"
+#define OCSP_CACHE_VERSION 1
+
+/* The part of a verified OCSP response we need to evaluate it again.
+   SIGNER_FPR is the certificate for which ONLY_VALID_IF_CERT_VALID
+   was sent, or empty if a default signer was used.  CERT_IMAGE is the
+   target certificate, which is needed to ask again before the
+   response expires; it is not kept in the disk cache.  */
+struct ocsp_cache_entry {
+  ksba_status_t status;
+  ksba_crl_reason_t reason;
+  ksba_isotime_t this_update;
+  ksba_isotime_t next_update;
+  ksba_isotime_t revocation_time;
+  std::string signer_fpr;
+  std::string cert_image;
+};
+
+/* Verified responses by cache key, and the keys for which a request
+   is currently running.  Another request for such a key waits on
+   OCSP_CACHE_COND for the running one instead of asking the
+   responder again.  */
+static std::mutex ocsp_cache_lock;
+static std::condition_variable ocsp_cache_cond;
+static std::map<std::string, ocsp_cache_entry> ocsp_cache;
+static std::set<std::string> ocsp_in_flight;
+
+/* Return the cache key for CERT issued by ISSUER_CERT: the SHA-1 hash
+   of the issuer's public key and the serial number, as in the CertID
+   of the request.  Responses from the default responder are kept
+   apart as they are checked against a different signer.  Returns an
+   empty string on error.  */
+static std::string ocsp_cache_key(ksba_cert_t cert, ksba_cert_t issuer_cert,
+                                  int default_responder) {
+  std::string key;
+  ksba_sexp_t pubkey, serial;
+  size_t pubkeylen, seriallen;
+  unsigned char hash[20];
+  char hashhex[2 * sizeof hash + 1];
+  char *hex;
+
+  pubkey = ksba_cert_get_public_key(issuer_cert);
+  serial = ksba_cert_get_serial(cert);
+  pubkeylen = pubkey ? gcry_sexp_canon_len(pubkey, 0, NULL, NULL) : 0;
+  seriallen = serial ? gcry_sexp_canon_len(serial, 0, NULL, NULL) : 0;
+  if (pubkeylen && seriallen &&
+      (hex = (char *)xtrymalloc(2 * seriallen + 1))) {
+    gcry_md_hash_buffer(GCRY_MD_SHA1, hash, pubkey, pubkeylen);
+    key = default_responder ? "d-" : "c-";
+    key += bin2hex(hash, sizeof hash, hashhex);
+    key += '-';
+    key += bin2hex(serial, seriallen, hex);
+    xfree(hex);
+  }
+  ksba_free(pubkey);
+  ksba_free(serial);
+  return key;
+}
+
+/* Return true if ENTRY may still be used instead of asking the
+   responder; that is until its nextUpdate.  Responses without a
+   nextUpdate are never cached.  */
+static int ocsp_cache_fresh(const ocsp_cache_entry &entry) {
+  ksba_isotime_t current_time;
+
+  gnupg_get_isotime(current_time);
+  return *entry.next_update && strcmp(current_time, entry.next_update) < 0;
+}
+
+/* Return true if S is empty or looks like an ISO time.  */
+static int cache_isotime_p(const std::string &s) {
+  return s.empty() || (s.size() == 15 && s[8] == 'T');
+}
+
+/* Read the entry for KEY from the disk cache into R_ENTRY.  Returns
+   true on success.  */
+static int ocsp_cache_read(const std::string &key, ocsp_cache_entry *r_entry) {
+  char *fname;
+  estream_t fp;
+  char line[512];
+  std::vector<std::string> fields;
+  int okay = 0;
+
+  fname = make_filename(opt.homedir_cache, OCSP_CACHE_DIR, key.c_str(), NULL);
+  fp = es_fopen(fname, "r");
+  if (fp && es_fgets(line, sizeof line, fp)) {
+    char *p, *endp;
+
+    trim_trailing_spaces(line);
+    for (p = line; (endp = strchr(p, ':')); p = endp + 1)
+      fields.emplace_back(p, endp - p);
+    fields.emplace_back(p);
+  }
+  if (fp) es_fclose(fp);
+
+  if (fields.size() == 8 && fields[0] == "v" &&
+      atoi(fields[1].c_str()) == OCSP_CACHE_VERSION &&
+      cache_isotime_p(fields[4]) && cache_isotime_p(fields[5]) &&
+      cache_isotime_p(fields[6])) {
+    r_entry->status = (ksba_status_t)atoi(fields[2].c_str());
+    r_entry->reason = (ksba_crl_reason_t)atoi(fields[3].c_str());
+    strcpy(r_entry->this_update, fields[4].c_str());
+    strcpy(r_entry->next_update, fields[5].c_str());
+    strcpy(r_entry->revocation_time, fields[6].c_str());
+    r_entry->signer_fpr = fields[7];
+    okay = ocsp_cache_fresh(*r_entry);
+  }
+  if (fp && !okay) unlink(fname); /* Outdated or corrupt.  */
+  xfree(fname);
+  return okay;
+}
+
+/* Write ENTRY for KEY to the disk cache.  Errors are only logged.  */
+static void ocsp_cache_write(const std::string &key,
+                             const ocsp_cache_entry &entry) {
+  char *dname, *fname, *tmpfname;
+  estream_t fp;
+
+  dname = make_filename(opt.homedir_cache, OCSP_CACHE_DIR, NULL);
+  if (mkdir(dname, S_IRUSR | S_IWUSR | S_IXUSR) && errno != EEXIST)
+    log_info(_("error creating directory '%s': %s\n"), dname,
+             strerror(errno));
+  fname = make_filename(dname, key.c_str(), NULL);
+  tmpfname = strconcat(fname, ".tmp", NULL);
+  fp = es_fopen(tmpfname, "w");
+  if (!fp ||
+      es_fprintf(fp, "v:%d:%d:%d:%s:%s:%s:%s\n", OCSP_CACHE_VERSION,
+                 (int)entry.status, (int)entry.reason, entry.this_update,
+                 entry.next_update, entry.revocation_time,
+                 entry.signer_fpr.c_str()) < 0 ||
+      es_fclose(fp) || rename(tmpfname, fname)) {
+    log_info(_("error writing '%s': %s\n"), fname, strerror(errno));
+    if (fp) unlink(tmpfname);
+  }
+  xfree(tmpfname);
+  xfree(fname);
+  xfree(dname);
+}
+
+/* Finish the request for KEY started by ocsp_cache_lookup and store
+   ENTRY, if not NULL.  With TO_DISK set, ENTRY is also written to the
+   disk cache if enabled.  Waiting requests for KEY are woken up.  */
+static void ocsp_cache_done(const std::string &key,
+                            const ocsp_cache_entry *entry, int to_disk) {
+  if (entry && to_disk && opt.ocsp_disk_cache) ocsp_cache_write(key, *entry);
+
+  std::lock_guard<std::mutex> lock(ocsp_cache_lock);
+  if (entry) {
+    if (ocsp_cache.size() >= OCSP_CACHE_SIZE) {
+      for (auto it = ocsp_cache.begin(); it != ocsp_cache.end();)
+        if (ocsp_cache_fresh(it->second))
+          ++it;
+        else
+          it = ocsp_cache.erase(it);
+    }
+    if (ocsp_cache.size() >= OCSP_CACHE_SIZE)
+      ocsp_cache.erase(ocsp_cache.begin());
+    ocsp_cache[key] = *entry;
+  }
+  ocsp_in_flight.erase(key);
+  ocsp_cache_cond.notify_all();
+}
+
+/* Look up KEY in the cache and store a fresh entry at R_ENTRY.
+   Returns true on success.  Otherwise the caller is expected to ask
+   the responder and must call ocsp_cache_done with the result.  If
+   another request for KEY is running, wait for it first.  */
+static int ocsp_cache_lookup(const std::string &key,
+                             ocsp_cache_entry *r_entry) {
+  {
+    std::unique_lock<std::mutex> lock(ocsp_cache_lock);
+
+    for (;;) {
+      auto it = ocsp_cache.find(key);
+      if (it != ocsp_cache.end()) {
+        if (ocsp_cache_fresh(it->second)) {
+          *r_entry = it->second;
+          return 1;
+        }
+        ocsp_cache.erase(it);
+      }
+      if (!ocsp_in_flight.count(key)) break;
+      ocsp_cache_cond.wait(lock);
+    }
+    ocsp_in_flight.insert(key);
+  }
+
+  if (opt.ocsp_disk_cache && ocsp_cache_read(key, r_entry)) {
+    ocsp_cache_done(key, r_entry, 0);
+    return 1;
+  }
+  return 0;
+}
+
+/* Claim KEY for a refresh of its entry.  Unlike ocsp_cache_lookup,
+   the current entry stays in place and is used by other requests
+   until the new response is stored.  Returns false if a request for
+   KEY is already running.  */
+static int ocsp_cache_claim(const std::string &key) {
+  std::lock_guard<std::mutex> lock(ocsp_cache_lock);
+  return ocsp_in_flight.insert(key).second;
+}
+
 /* Read from FP and return a newly allocated buffer in R_BUFFER with the
    entire data read from FP. */
 static gpg_error_t read_response(estream_t fp, unsigned char **r_buffer,
@@ -151,7 +368,8 @@ static gpg_error_t do_ocsp_request(ctrl_t ctrl, ksba_ocsp_t ocsp,
   }
 
   NeoPG::Http request;
-  request.set_url(url).forbid_reuse().set_timeout(ctrl->timeout).no_cache();
+  request.set_url(url).set_timeout(ctrl->timeout).no_cache().set_http2();
+  request.set_dns_cache(dns_cache());
 
   if (opt.http_proxy)
     request.set_proxy(opt.http_proxy);
@@ -236,7 +454,8 @@ static gpg_error_t do_ocsp_request(ctrl_t ctrl, ksba_ocsp_t ocsp,
    SIGNER_FPR_LIST is not NULL we simply check that CERT matches one
    of the fingerprints in this list. */
 static gpg_error_t validate_responder_cert(ctrl_t ctrl, ksba_cert_t cert,
-                                           fingerprint_list_t signer_fpr_list) {
+                                           fingerprint_list_t signer_fpr_list,
+                                           std::string *r_signer_fpr) {
   gpg_error_t err;
   char *fpr;
 
@@ -271,6 +490,7 @@ static gpg_error_t validate_responder_cert(ctrl_t ctrl, ksba_cert_t cert,
        all. */
     fpr = get_fingerprint_hexstring(cert);
     dirmngr_status(ctrl, "ONLY_VALID_IF_CERT_VALID", fpr, NULL);
+    *r_signer_fpr = fpr;
     xfree(fpr);
     err = 0;
   }
@@ -281,7 +501,8 @@ static gpg_error_t validate_responder_cert(ctrl_t ctrl, ksba_cert_t cert,
 /* Helper for check_signature. */
 static int check_signature_core(ctrl_t ctrl, ksba_cert_t cert,
                                 gcry_sexp_t s_sig, gcry_sexp_t s_hash,
-                                fingerprint_list_t signer_fpr_list) {
+                                fingerprint_list_t signer_fpr_list,
+                                std::string *r_signer_fpr) {
   gpg_error_t err;
   ksba_sexp_t pubkey;
   gcry_sexp_t s_pkey = NULL;
@@ -293,7 +514,8 @@ static int check_signature_core(ctrl_t ctrl, ksba_cert_t cert,
     err = canon_sexp_to_gcry(pubkey, &s_pkey);
   xfree(pubkey);
   if (!err) err = gcry_pk_verify(s_sig, s_hash, s_pkey);
-  if (!err) err = validate_responder_cert(ctrl, cert, signer_fpr_list);
+  if (!err)
+    err = validate_responder_cert(ctrl, cert, signer_fpr_list, r_signer_fpr);
   if (!err) {
     gcry_sexp_release(s_pkey);
     return 0; /* Successfully verified the signature. */
@@ -309,10 +531,13 @@ static int check_signature_core(ctrl_t ctrl, ksba_cert_t cert,
    the response.  This function automagically finds the correct public
    key.  If SIGNER_FPR_LIST is not NULL, the default OCSP reponder has been
    used and thus the certificate is one of those identified by
-   the fingerprints. */
+   the fingerprints.  Otherwise the fingerprint of the responder's
+   certificate, which the client still needs to validate, is stored
+   at R_SIGNER_FPR. */
 static gpg_error_t check_signature(ctrl_t ctrl, ksba_ocsp_t ocsp,
                                    gcry_sexp_t s_sig, gcry_md_hd_t md,
-                                   fingerprint_list_t signer_fpr_list) {
+                                   fingerprint_list_t signer_fpr_list,
+                                   std::string *r_signer_fpr) {
   gpg_error_t err;
   int algo, cert_idx;
   gcry_sexp_t s_hash;
@@ -342,7 +567,8 @@ static gpg_error_t check_signature(ctrl_t ctrl, ksba_ocsp_t ocsp,
     cert = get_cert_byhexfpr(signer_fpr_list->hexfpr);
     if (!cert) cert = get_cert_local(ctrl, signer_fpr_list->hexfpr);
     if (cert) {
-      err = check_signature_core(ctrl, cert, s_sig, s_hash, signer_fpr_list);
+      err = check_signature_core(ctrl, cert, s_sig, s_hash, signer_fpr_list,
+                                 r_signer_fpr);
       ksba_cert_release(cert);
       cert = NULL;
       if (!err) {
@@ -392,7 +618,8 @@ static gpg_error_t check_signature(ctrl_t ctrl, ksba_ocsp_t ocsp,
     ksba_free(keyid);
 
     if (cert) {
-      err = check_signature_core(ctrl, cert, s_sig, s_hash, signer_fpr_list);
+      err = check_signature_core(ctrl, cert, s_sig, s_hash, signer_fpr_list,
+                                 r_signer_fpr);
       ksba_cert_release(cert);
       if (!err) {
         gcry_sexp_release(s_hash);
@@ -410,8 +637,13 @@ static gpg_error_t check_signature(ctrl_t ctrl, ksba_ocsp_t ocsp,
    or directly through the CERT object is valid by running an OCSP
    transaction.  With FORCE_DEFAULT_RESPONDER set only the configured
    default responder is used. */
-gpg_error_t ocsp_isvalid(ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
-                         int force_default_responder) {
+/* Check the status of CERT (or the certificate CERT_FPR of the
+   client) with OCSP, see ocsp_isvalid.  With REFRESH set, a cached
+   response is not used; a new one is requested and replaces it,
+   unless such a request is running already.  */
+static gpg_error_t ocsp_check(ctrl_t ctrl, ksba_cert_t cert,
+                              const char *cert_fpr,
+                              int force_default_responder, int refresh) {
   gpg_error_t err;
   ksba_ocsp_t ocsp = NULL;
   ksba_cert_t issuer_cert = NULL;
@@ -429,6 +661,9 @@ gpg_error_t ocsp_isvalid(ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
   char *oid;
   ksba_name_t name;
   fingerprint_list_t default_signer = NULL;
+  std::string cache_key;
+  int in_flight = 0;
+  ocsp_cache_entry entry;
 
   /* Get the certificate.  */
   if (cert) {
@@ -506,6 +741,30 @@ gpg_error_t ocsp_isvalid(ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
     if (opt.verbose) log_info(_("using OCSP responder '%s'\n"), url);
   }
 
+  /* A verified response which is still current is used again.  If a
+     request for the same certificate is already running, this waits
+     for its result.  */
+  cache_key = ocsp_cache_key(cert, issuer_cert, !!default_signer);
+  if (refresh) {
+    err = 0;
+    if (cache_key.empty() || !ocsp_cache_claim(cache_key)) goto leave;
+    in_flight = 1;
+  } else if (!cache_key.empty()) {
+    if (ocsp_cache_lookup(cache_key, &entry)) {
+      if (DBG_CACHE) log_debug("OCSP cache hit for %s\n", cache_key.c_str());
+      status = entry.status;
+      reason = entry.reason;
+      gnupg_copy_time(this_update, entry.this_update);
+      gnupg_copy_time(next_update, entry.next_update);
+      gnupg_copy_time(revocation_time, entry.revocation_time);
+      if (!entry.signer_fpr.empty())
+        dirmngr_status(ctrl, "ONLY_VALID_IF_CERT_VALID",
+                       entry.signer_fpr.c_str(), NULL);
+      goto check_status;
+    }
+    in_flight = 1;
+  }
+
   /* Ask the OCSP responder. */
   err = gcry_md_open(&md, GCRY_MD_SHA1, 0);
   if (err) {
@@ -525,7 +784,8 @@ gpg_error_t ocsp_isvalid(ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
   if ((err = canon_sexp_to_gcry(sigval, &s_sig))) goto leave;
   xfree(sigval);
   sigval = NULL;
-  err = check_signature(ctrl, ocsp, s_sig, md, default_signer);
+  err = check_signature(ctrl, ocsp, s_sig, md, default_signer,
+                        &entry.signer_fpr);
   if (err) goto leave;
 
   /* We only support one certificate per request.  Check that the
@@ -538,6 +798,22 @@ gpg_error_t ocsp_isvalid(ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
     goto leave;
   }
 
+  if (in_flight) {
+    entry.status = status;
+    entry.reason = reason;
+    gnupg_copy_time(entry.this_update, this_update);
+    gnupg_copy_time(entry.next_update, next_update);
+    gnupg_copy_time(entry.revocation_time, revocation_time);
+    {
+      size_t imagelen;
+      const unsigned char *image = ksba_cert_get_image(cert, &imagelen);
+      if (image) entry.cert_image.assign((const char *)image, imagelen);
+    }
+    ocsp_cache_done(cache_key, ocsp_cache_fresh(entry) ? &entry : NULL, 1);
+    in_flight = 0;
+  }
+
+check_status:
   /* In case the certificate has been revoked, we better invalidate
      our cached validation status. */
   if (status == KSBA_STATUS_REVOKED) {
@@ -642,6 +918,7 @@ gpg_error_t ocsp_isvalid(ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
   }
 
 leave:
+  if (in_flight) ocsp_cache_done(cache_key, NULL, 0);
   gcry_md_close(md);
   gcry_sexp_release(s_sig);
   xfree(sigval);
@@ -652,6 +929,54 @@ leave:
   return err;
 }
 
+/* Check the status of CERT with OCSP.  If CERT is NULL, the
+   certificate CERT_FPR and its issuer are requested from the client.
+   With FORCE_DEFAULT_RESPONDER, the responder named by the
+   certificate is ignored.  */
+gpg_error_t ocsp_isvalid(ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
+                         int force_default_responder) {
+  return ocsp_check(ctrl, cert, cert_fpr, force_default_responder, 0);
+}
+
+/* Store in KEYS the cache keys of the responses which will expire
+   within SECONDS and can be asked for again with ocsp_refresh.  */
+void ocsp_cache_expiring(int seconds, std::vector<std::string> &keys) {
+  ksba_isotime_t horizon;
+
+  keys.clear();
+  gnupg_get_isotime(horizon);
+  add_seconds_to_isotime(horizon, seconds);
+
+  std::lock_guard<std::mutex> lock(ocsp_cache_lock);
+  for (auto &item : ocsp_cache)
+    if (!item.second.cert_image.empty() && ocsp_cache_fresh(item.second) &&
+        strcmp(item.second.next_update, horizon) <= 0 &&
+        !ocsp_in_flight.count(item.first))
+      keys.push_back(item.first);
+}
+
+/* Ask the responder again for the cached response KEY, which is kept
+   until the new response has been verified.  */
+gpg_error_t ocsp_refresh(ctrl_t ctrl, const std::string &key) {
+  gpg_error_t err;
+  std::string image;
+  ksba_cert_t cert = NULL;
+
+  {
+    std::lock_guard<std::mutex> lock(ocsp_cache_lock);
+    auto it = ocsp_cache.find(key);
+    if (it != ocsp_cache.end()) image = it->second.cert_image;
+  }
+  if (image.empty()) return GPG_ERR_NOT_FOUND;
+
+  err = ksba_cert_new(&cert);
+  if (!err)
+    err = ksba_cert_init_from_mem(cert, image.data(), image.size());
+  if (!err) err = ocsp_check(ctrl, cert, NULL, key[0] == 'd', 1);
+  ksba_cert_release(cert);
+  return err;
+}
+
 /* Release the list of OCSP certificates hold in the CTRL object. */
 void release_ctrl_ocsp_certs(ctrl_t ctrl) {
   while (ctrl->ocsp_certs) {
@@ -22,10 +22,16 @@
 #ifndef OCSP_H
 #define OCSP_H
 
+#include <string>
+#include <vector>
+
 gpg_error_t ocsp_isvalid(ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
                          int force_default_responder);
 
 /* Release the list of OCSP certificates hold in the CTRL object. */
 void release_ctrl_ocsp_certs(ctrl_t ctrl);
 
+void ocsp_cache_expiring(int seconds, std::vector<std::string> &keys);
+gpg_error_t ocsp_refresh(ctrl_t ctrl, const std::string &key);
+
 #endif /*OCSP_H*/
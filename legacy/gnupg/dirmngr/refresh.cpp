@@ -0,0 +1,154 @@
+/* refresh.cpp - Background refresh of cached CRLs and OCSP responses
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of DirMngr.
+ *
+ * DirMngr is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DirMngr is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* The daemon keeps its CRLs and OCSP responses current by itself, so
+   that a client rarely has to wait for a download: every
+   REFRESH_INTERVAL seconds (with some jitter, so that many daemons do
+   not hit a CA at the same moment) the entries expiring within
+   opt.refresh_ahead seconds are fetched again.  A new CRL or response
+   replaces the old one only once it has been verified; until then
+   requests keep using the old one.
+
+   To be gentle to the servers, at most REFRESH_MAX_FETCHES are done
+   per round, REFRESH_FETCH_GAP seconds apart, and an entry which
+   failed to refresh is not tried again for REFRESH_RETRY_INTERVAL
+   seconds.  */
+
+#include <config.h>
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <string.h>
+#include <time.h>
+
+#include "dirmngr.h"
+
+#include "crlcache.h"
+#include "crlfetch.h"
+#include "ocsp.h"
+#include "refresh.h"
+
+#define REFRESH_INTERVAL (5 * 60)
+#define REFRESH_MAX_FETCHES 8
+#define REFRESH_FETCH_GAP 2
+#define REFRESH_RETRY_INTERVAL (30 * 60)
+
+/* When a failed entry may be tried again, by CRL URL or OCSP cache
+   key.  Only used by the refresh thread.  */
+static std::map<std::string, time_t> refresh_failed;
+
+/* Return true if NAME failed recently and is not yet due again.  */
+static int refresh_backoff(const std::string &name, time_t now) {
+  auto it = refresh_failed.find(name);
+
+  if (it == refresh_failed.end()) return 0;
+  if (it->second > now) return 1;
+  refresh_failed.erase(it);
+  return 0;
+}
+
+/* Fetch the CRL from URL again and replace the cached one.  */
+static gpg_error_t refresh_crl(ctrl_t ctrl, const std::string &url) {
+  gpg_error_t err;
+  ksba_reader_t reader;
+
+  if (opt.verbose) log_info(_("refreshing CRL from '%s'\n"), url.c_str());
+
+  err = crl_fetch(ctrl, url.c_str(), &reader);
+  if (!err) {
+    err = crl_cache_insert(ctrl, url.c_str(), reader);
+    crl_close_reader(reader);
+  }
+  return err;
+}
+
+/* Do one round of refreshes.  */
+static void refresh_round(ctrl_t ctrl) {
+  std::vector<std::string> urls, keys;
+  time_t now = time(NULL);
+  gpg_error_t err;
+  int fetches = 0;
+
+  crl_cache_expiring(opt.refresh_ahead, urls);
+  for (auto &url : urls) {
+    if (fetches >= REFRESH_MAX_FETCHES) break;
+    if (refresh_backoff(url, now)) continue;
+    if (fetches++)
+      std::this_thread::sleep_for(std::chrono::seconds(REFRESH_FETCH_GAP));
+
+    err = refresh_crl(ctrl, url);
+    if (err) {
+      log_info(_("refreshing CRL from '%s' failed: %s\n"), url.c_str(),
+               gpg_strerror(err));
+      refresh_failed[url] = now + REFRESH_RETRY_INTERVAL;
+    }
+  }
+
+  ocsp_cache_expiring(opt.refresh_ahead, keys);
+  for (auto &key : keys) {
+    if (fetches >= REFRESH_MAX_FETCHES) break;
+    if (refresh_backoff(key, now)) continue;
+    if (fetches++)
+      std::this_thread::sleep_for(std::chrono::seconds(REFRESH_FETCH_GAP));
+
+    if (DBG_CACHE) log_debug("refreshing OCSP response %s\n", key.c_str());
+    err = ocsp_refresh(ctrl, key);
+    /* A revoked or unknown status is a valid answer as well.  */
+    if (err && err != GPG_ERR_CERT_REVOKED && err != GPG_ERR_NO_DATA) {
+      log_info(_("refreshing OCSP response failed: %s\n"),
+               gpg_strerror(err));
+      refresh_failed[key] = now + REFRESH_RETRY_INTERVAL;
+    }
+  }
+}
+
+static void refresh_thread(void) {
+  std::mt19937 rng(std::random_device{}());
+  /* Up to a quarter of the interval earlier or later.  */
+  std::uniform_int_distribution<int> jitter(-REFRESH_INTERVAL / 4,
+                                            REFRESH_INTERVAL / 4);
+  struct server_control_s ctrlbuf;
+
+  for (;;) {
+    std::this_thread::sleep_for(
+        std::chrono::seconds(REFRESH_INTERVAL + jitter(rng)));
+    if (opt.refresh_ahead <= 0) continue;
+
+    memset(&ctrlbuf, 0, sizeof ctrlbuf);
+    dirmngr_init_default_ctrl(&ctrlbuf);
+    refresh_round(&ctrlbuf);
+    dirmngr_deinit_default_ctrl(&ctrlbuf);
+  }
+}
+
+void refresh_start(void) {
+  if (opt.refresh_ahead <= 0) return;
+
+  try {
+    std::thread(refresh_thread).detach();
+  } catch (const std::system_error &e) {
+    log_error("error starting the refresh thread: %s\n", e.what());
+  }
+}
@@ -0,0 +1,27 @@
+/* refresh.h - Background refresh of cached CRLs and OCSP responses
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of DirMngr.
+ *
+ * DirMngr is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DirMngr is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef REFRESH_H
+#define REFRESH_H
+
+/* Start the thread which fetches cached CRLs and OCSP responses again
+   shortly before they expire.  Only used by the daemon.  */
+void refresh_start(void);
+
+#endif /*REFRESH_H*/
@@ -33,6 +33,7 @@
 
 #include <botan/hash.h>
 #include <botan/hex.h>
+#include <mutex>
 #include <sstream>
 
 #include <assuan.h>
@@ -40,10 +41,12 @@
 
 #include "../common/mbox-util.h"
 #include "../common/server-help.h"
+#include "../common/trace.h"
 #include "../common/zb32.h"
 #include "certcache.h"
 #include "crlcache.h"
 #include "crlfetch.h"
+#include "dns-stuff.h"
 #include "ks-action.h"
 #include "misc.h"
 #include "ocsp.h"
@@ -1288,6 +1291,7 @@ static const char hlp_getinfo[] =
     "\n"
     "version     - Return the version of the program.\n"
     "pid         - Return the process id of the server.\n"
+    "dnsstats    - Return statistics of the DNS cache.\n"
     "tor         - Return OK if running in Tor mode\n";
 static gpg_error_t cmd_getinfo(assuan_context_t ctx, char *line) {
   ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
@@ -1301,6 +1305,11 @@ static gpg_error_t cmd_getinfo(assuan_context_t ctx, char *line) {
 
     snprintf(numbuf, sizeof numbuf, "%lu", (unsigned long)getpid());
     err = assuan_send_data(ctx, numbuf, strlen(numbuf));
+  } else if (!strcmp(line, "dnsstats")) {
+    char buf[200];
+
+    dns_cache_stats(buf, sizeof buf);
+    err = assuan_send_data(ctx, buf, strlen(buf));
   } else
     err = set_error(GPG_ERR_ASS_PARAMETER, "unknown value for WHAT");
 
@@ -1338,11 +1347,14 @@ static int register_commands(assuan_context_t ctx) {
   return 0;
 }
 
-/* Startup the server and run the main command loop.  With FD = -1,
-   use stdin/stdout. */
-void start_command_handler() {
+/* Startup the server and run the main command loop.  With FD =
+   ASSUAN_INVALID_FD, use stdin/stdout.  Otherwise FD is a connection
+   accepted by the daemon; each one is served by its own thread with
+   its own control structure.  */
+void start_command_handler(assuan_fd_t fd) {
   static const char hello[] = "Dirmngr " VERSION " at your service";
   static char *hello_line;
+  static std::once_flag hello_once;
   int rc;
   assuan_context_t ctx;
   ctrl_t ctrl;
@@ -1354,7 +1366,9 @@ void start_command_handler() {
         (server_local_s *)xtrycalloc(1, sizeof *ctrl->server_local);
   if (!ctrl || !ctrl->server_local) {
     log_error(_("can't allocate control structure: %s\n"), strerror(errno));
+    if (ctrl) xfree(ctrl->server_local);
     xfree(ctrl);
+    if (fd != ASSUAN_INVALID_FD) close(fd);
     return;
   }
 
@@ -1366,13 +1380,24 @@ void start_command_handler() {
     dirmngr_exit(2);
   }
 
-  filedes[0] = assuan_fdopen(0);
-  filedes[1] = assuan_fdopen(1);
-  rc = assuan_init_pipe_server(ctx, filedes);
+  if (fd == ASSUAN_INVALID_FD) {
+    filedes[0] = assuan_fdopen(0);
+    filedes[1] = assuan_fdopen(1);
+    rc = assuan_init_pipe_server(ctx, filedes);
+  } else
+    rc = assuan_init_socket_server(
+        ctx, fd,
+        ASSUAN_SOCKET_SERVER_ACCEPTED | ASSUAN_SOCKET_SERVER_FDPASSING);
   if (rc) {
     assuan_release(ctx);
     log_error(_("failed to initialize the server: %s\n"), gpg_strerror(rc));
-    dirmngr_exit(2);
+    if (fd == ASSUAN_INVALID_FD) dirmngr_exit(2);
+    /* Only this connection is lost.  */
+    close(fd);
+    xfree(ctrl->server_local);
+    dirmngr_deinit_default_ctrl(ctrl);
+    xfree(ctrl);
+    return;
   }
 
   rc = register_commands(ctx);
@@ -1381,15 +1406,16 @@ void start_command_handler() {
               gpg_strerror(rc));
     dirmngr_exit(2);
   }
+  trace_assuan_context(ctx, "dirmngr_command");
 
-  if (!hello_line) {
+  std::call_once(hello_once, [] {
     hello_line = xtryasprintf(
         "Home: %s\n"
         "Config: %s\n"
         "%s",
         gnupg_homedir(), opt.config_filename ? opt.config_filename : "[none]",
         hello);
-  }
+  });
 
   ctrl->server_local->assuan_ctx = ctx;
   assuan_set_pointer(ctx, ctrl);
@@ -27,6 +27,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <map>
+#include <mutex>
+#include <string>
+
 #include "certcache.h"
 #include "crlcache.h"
 #include "dirmngr.h"
@@ -56,6 +60,22 @@ struct chain_item_s {
 };
 typedef struct chain_item_s *chain_item_t;
 
+/* The maximum number of verified chain links we remember.  */
+#define CHAIN_LINK_CACHE_SIZE 4096
+
+/* For how long a successful revocation check of a link is reused.  */
+#define CHAIN_LINK_REVOCATION_TTL (30 * 60)
+
+/* A verified link of a chain, keyed by the fingerprints of the issuer
+   and the subject certificate.  The signature of the subject was good
+   and the issuer may act as a CA.  REVOCATION_CHECKED is the time the
+   subject has last been found not revoked, or 0.  */
+struct chain_link_s {
+  time_t revocation_checked;
+};
+static std::map<std::string, chain_link_s> chain_links;
+static std::mutex chain_links_lock;
+
 /* A couple of constants with Object Identifiers.  */
 static const char oid_kp_serverAuth[] = "1.3.6.1.5.5.7.3.1";
 static const char oid_kp_clientAuth[] = "1.3.6.1.5.5.7.3.2";
@@ -199,13 +219,56 @@ static gpg_error_t allowed_ca(ksba_cert_t cert, int *chainlen) {
   return 0;
 }
 
+/* Return the key for the link from ISSUER_FPR to SUBJECT_FPR.  */
+static std::string chain_link_key(const unsigned char *issuer_fpr,
+                                  const unsigned char *subject_fpr) {
+  std::string key((const char *)issuer_fpr, 20);
+
+  key.append((const char *)subject_fpr, 20);
+  return key;
+}
+
+/* Return true if the link from ISSUER_FPR to SUBJECT_FPR has been
+   verified.  If REVOCATION_CHECKED is true, also require a recent
+   revocation check.  */
+static int chain_link_known(const unsigned char *issuer_fpr,
+                            const unsigned char *subject_fpr,
+                            int revocation_checked) {
+  std::lock_guard<std::mutex> lock(chain_links_lock);
+  auto it = chain_links.find(chain_link_key(issuer_fpr, subject_fpr));
+
+  if (it == chain_links.end()) return 0;
+  if (!revocation_checked) return 1;
+  return (it->second.revocation_checked &&
+          it->second.revocation_checked + CHAIN_LINK_REVOCATION_TTL >
+              gnupg_get_time());
+}
+
+/* Remember the verified link from ISSUER_FPR to SUBJECT_FPR.  With
+   REVOCATION_CHECKED set, the subject has just been found not
+   revoked.  */
+static void chain_link_put(const unsigned char *issuer_fpr,
+                           const unsigned char *subject_fpr,
+                           int revocation_checked) {
+  std::lock_guard<std::mutex> lock(chain_links_lock);
+  std::string key = chain_link_key(issuer_fpr, subject_fpr);
+  auto it = chain_links.find(key);
+
+  if (it == chain_links.end()) {
+    if (chain_links.size() >= CHAIN_LINK_CACHE_SIZE)
+      chain_links.erase(chain_links.begin());
+    it = chain_links.emplace(key, chain_link_s{0}).first;
+  }
+  if (revocation_checked) it->second.revocation_checked = gnupg_get_time();
+}
+
 /* Helper for validate_cert_chain.  */
 static gpg_error_t check_revocations(ctrl_t ctrl, chain_item_t chain) {
   gpg_error_t err = 0;
   int any_revoked = 0;
   int any_no_crl = 0;
   int any_crl_too_old = 0;
-  chain_item_t ci;
+  chain_item_t ci, ci_issuer;
 
   log_assert(ctrl->check_revocations_nest_level >= 0);
   log_assert(chain);
@@ -216,7 +279,7 @@ static gpg_error_t check_revocations(ctrl_t ctrl, chain_item_t chain) {
   }
   ctrl->check_revocations_nest_level++;
 
-  for (ci = chain; ci; ci = ci->next) {
+  for (ci_issuer = NULL, ci = chain; ci; ci_issuer = ci, ci = ci->next) {
     assert(ci->cert);
     if (ci == chain) {
       /* It does not make sense to check the root certificate for
@@ -229,6 +292,12 @@ static gpg_error_t check_revocations(ctrl_t ctrl, chain_item_t chain) {
       continue;
     }
 
+    /* A link found not revoked a short time ago needs no CRL check. */
+    if (chain_link_known(ci_issuer->fpr, ci->fpr, 1)) {
+      if (opt.verbose) cert_log_name(_("CRL check cached for"), ci->cert);
+      continue;
+    }
+
     if (opt.verbose) cert_log_name(_("checking CRL for"), ci->cert);
     err = crl_cache_cert_isvalid(ctrl, ci->cert, 0);
     if (err == GPG_ERR_NO_CRL_KNOWN) {
@@ -237,6 +306,7 @@ static gpg_error_t check_revocations(ctrl_t ctrl, chain_item_t chain) {
     }
     switch (err) {
       case 0:
+        chain_link_put(ci_issuer->fpr, ci->fpr, 1);
         err = 0;
         break;
       case GPG_ERR_CERT_REVOKED:
@@ -352,6 +422,8 @@ gpg_error_t validate_cert_chain(ctrl_t ctrl, ksba_cert_t cert,
   ksba_cert_t issuer_cert = NULL;
   ksba_isotime_t current_time;
   ksba_isotime_t exptime;
+  unsigned char subject_fpr[20];
+  unsigned char issuer_fpr[20];
   int any_expired = 0;
   int any_no_policy_match = 0;
   chain_item_t chain;
@@ -384,7 +456,7 @@ gpg_error_t validate_cert_chain(ctrl_t ctrl, ksba_cert_t cert,
       err = 0; /* Not available or other error. */
     else {
       /* If the validation is not older than 30 minutes we are ready. */
-      if (validated_at < gnupg_get_time() + (30 * 60)) {
+      if (validated_at + (30 * 60) > gnupg_get_time()) {
         if (opt.verbose) log_info("certificate is good (cached)\n");
         /* Note, that we can't jump to leave here as this would
            falsely updated the validation timestamp.  */
@@ -472,15 +544,19 @@ gpg_error_t validate_cert_chain(ctrl_t ctrl, ksba_cert_t cert,
     /* Is this a self-signed certificate? */
     if (is_root_cert(subject_cert, issuer, subject)) {
       /* Yes, this is our trust anchor.  */
-      if (check_cert_sig(subject_cert, subject_cert)) {
-        log_error(_("selfsigned certificate has a BAD signature"));
-        err = depth ? GPG_ERR_BAD_CERT_CHAIN : GPG_ERR_BAD_CERT;
-        goto leave;
-      }
+      cert_compute_fpr(subject_cert, subject_fpr);
+      if (!chain_link_known(subject_fpr, subject_fpr, 0)) {
+        if (check_cert_sig(subject_cert, subject_cert)) {
+          log_error(_("selfsigned certificate has a BAD signature"));
+          err = depth ? GPG_ERR_BAD_CERT_CHAIN : GPG_ERR_BAD_CERT;
+          goto leave;
+        }
 
-      /* Is this certificate allowed to act as a CA.  */
-      err = allowed_ca(subject_cert, NULL);
-      if (err) goto leave; /* No. */
+        /* Is this certificate allowed to act as a CA.  */
+        err = allowed_ca(subject_cert, NULL);
+        if (err) goto leave; /* No. */
+        chain_link_put(subject_fpr, subject_fpr, 0);
+      }
 
       err = is_trusted_cert(subject_cert, (flags & VALIDATE_FLAG_MASK_TRUST));
       if (!err)
@@ -516,7 +592,7 @@ gpg_error_t validate_cert_chain(ctrl_t ctrl, ksba_cert_t cert,
         }
         ksba_cert_ref(subject_cert);
         ci->cert = subject_cert;
-        cert_compute_fpr(subject_cert, ci->fpr);
+        memcpy(ci->fpr, subject_fpr, 20);
         ci->next = chain;
         chain = ci;
       }
@@ -563,10 +639,18 @@ gpg_error_t validate_cert_chain(ctrl_t ctrl, ksba_cert_t cert,
       dump_cert("issuer", issuer_cert);
     }
 
-    /* Now check the signature of the certificate.  FIXME: we should
-     * delay this until later so that faked certificates can't be
-     * turned into a DoS easily.  */
-    err = check_cert_sig(issuer_cert, subject_cert);
+    /* Skip the signature check if we have verified this link
+     * before.  */
+    cert_compute_fpr(subject_cert, subject_fpr);
+    cert_compute_fpr(issuer_cert, issuer_fpr);
+    if (chain_link_known(issuer_fpr, subject_fpr, 0)) {
+      if (DBG_X509) log_debug("signature of certificate cached as good\n");
+      err = 0;
+    } else
+      /* Now check the signature of the certificate.  FIXME: we should
+       * delay this until later so that faked certificates can't be
+       * turned into a DoS easily.  */
+      err = check_cert_sig(issuer_cert, subject_cert);
     if (err) {
       log_error(_("certificate has a BAD signature"));
 #if 0
@@ -625,6 +709,7 @@ gpg_error_t validate_cert_chain(ctrl_t ctrl, ksba_cert_t cert,
     /* May that certificate be used for certification? */
     err = check_cert_use_cert(issuer_cert);
     if (err) goto leave; /* No.  */
+    chain_link_put(issuer_fpr, subject_fpr, 0);
 
     /* Prepend the certificate to our list.  */
     {
@@ -637,7 +722,7 @@ gpg_error_t validate_cert_chain(ctrl_t ctrl, ksba_cert_t cert,
       }
       ksba_cert_ref(subject_cert);
       ci->cert = subject_cert;
-      cert_compute_fpr(subject_cert, ci->fpr);
+      memcpy(ci->fpr, subject_fpr, 20);
       ci->next = chain;
       chain = ci;
     }
@@ -27,6 +27,9 @@
 
 #include <botan/base64.h>
 #include <boost/algorithm/string.hpp>
+#include <exception>
+
+#include <neopg/utils/base64.h>
 
 #include "../common/iobuf.h"
 #include "../common/status.h"
@@ -39,14 +42,9 @@
 
 #define MAX_LINELEN 20000
 
-#define CRCINIT 0xB704CE
-#define CRCPOLY 0X864CFB
-#define CRCUPDATE(a, c)                                 \
-  do {                                                  \
-    a = ((a) << 8) ^ crc_table[((a)&0xff >> 16) ^ (c)]; \
-    a &= 0x00ffffff;                                    \
-  } while (0)
-static u32 crc_table[256];
+/* Full lines of 64 characters are encoded this many at a time.  */
+#define RADIX64_LINES 64
+
 static byte bintoasc[] =
     "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
     "abcdefghijklmnopqrstuvwxyz"
@@ -124,6 +122,7 @@ void release_armor_context(armor_filter_context_t *afx) {
   if (!afx) return;
   log_assert(afx->refcount);
   if (--afx->refcount) return;
+  gcry_md_close(afx->crc_md);
   xfree(afx);
 }
 
@@ -138,24 +137,9 @@ int push_armor_filter(armor_filter_context_t *afx, iobuf_t iobuf) {
 }
 
 static void initialize(void) {
-  int i, j;
-  u32 t;
+  int i;
   byte *s;
 
-  /* init the crc lookup table */
-  crc_table[0] = 0;
-  for (i = j = 0; j < 128; j++) {
-    t = crc_table[j];
-    if (t & 0x00800000) {
-      t <<= 1;
-      crc_table[i++] = t ^ CRCPOLY;
-      crc_table[i++] = t;
-    } else {
-      t <<= 1;
-      crc_table[i++] = t;
-      crc_table[i++] = t ^ CRCPOLY;
-    }
-  }
   /* build the helptable for radix64 to bin conversion */
   for (i = 0; i < 256; i++)
     asctobin[i] = 255; /* used to detect invalid characters */
@@ -164,6 +148,23 @@ static void initialize(void) {
   is_initialized = 1;
 }
 
+/* Start a new CRC24 in AFX.  Libgcrypt's implementation is used
+   because it folds with PCLMUL where the CPU has it.  */
+static void crc_init(armor_filter_context_t *afx) {
+  if (afx->crc_md)
+    gcry_md_reset(afx->crc_md);
+  else if (gcry_md_open(&afx->crc_md, GCRY_MD_CRC24_RFC2440, 0))
+    BUG();
+}
+
+/* Return the CRC24 of the data added to AFX.  This finalizes it, so
+   crc_init must be called before adding more data.  */
+static u32 crc_value(armor_filter_context_t *afx) {
+  const byte *p = gcry_md_read(afx->crc_md, GCRY_MD_CRC24_RFC2440);
+
+  return ((u32)p[0] << 16) | ((u32)p[1] << 8) | p[2];
+}
+
 /*
  * Check whether this is an armored file.  See also
  * parse-packet.c for details on this code.
@@ -205,6 +206,7 @@ static int is_armored(const byte *buf) {
     case PKT_COMPRESSED:
     case PKT_ENCRYPTED:
     case PKT_ENCRYPTED_MDC:
+    case PKT_ENCRYPTED_AEAD:
     case PKT_PLAINTEXT:
     case PKT_OLD_COMMENT:
     case PKT_COMMENT:
@@ -497,7 +499,7 @@ static int check_input(armor_filter_context_t *afx, IOBUF a) {
     afx->faked = 1;
   else {
     afx->inp_checked = 1;
-    afx->crc = CRCINIT;
+    crc_init(afx);
     afx->idx = 0;
     afx->radbuf[0] = 0;
   }
@@ -648,7 +650,7 @@ static int fake_packet(armor_filter_context_t *afx, IOBUF a, size_t *retn,
       }
     }
     afx->inp_checked = 1;
-    afx->crc = CRCINIT;
+    crc_init(afx);
     afx->idx = 0;
     afx->radbuf[0] = 0;
   }
@@ -663,6 +665,33 @@ static int invalid_crc(void) {
   return GPG_ERR_INV_ARMOR;
 }
 
+/* Decode the line just read into AFX to BUF, which has room for SIZE
+   octets, if it is plain radix64 without padding or whitespace other
+   than at its end, as nearly all lines are.  Return the number of
+   octets decoded.  The rest of the line is left to the caller.  */
+static size_t radix64_read_line(armor_filter_context_t *afx, byte *buf,
+                                size_t size) {
+  const char *line = (const char *)afx->buffer;
+  size_t len = afx->buffer_len;
+  size_t n;
+
+  while (len && (line[len - 1] == '\n' || line[len - 1] == '\r' ||
+                 line[len - 1] == ' ' || line[len - 1] == '\t'))
+    len--;
+  len &= ~(size_t)3;
+  if (len > size / 3 * 4) len = size / 3 * 4;
+  if (!len || memchr(line, '=', len)) return 0;
+
+  try {
+    n = NeoPG::base64_decode(line, len, buf);
+  } catch (const std::exception &) {
+    /* The caller skips the invalid characters.  */
+    return 0;
+  }
+  afx->buffer_pos = len;
+  return n;
+}
+
 static int radix64_read(armor_filter_context_t *afx, IOBUF a, size_t *retn,
                         byte *buf, size_t size) {
   byte val;
@@ -670,13 +699,16 @@ static int radix64_read(armor_filter_context_t *afx, IOBUF a, size_t *retn,
   int checkcrc = 0;
   int rc = 0;
   size_t n = 0;
-  int idx, i, onlypad = 0;
+  int idx, onlypad = 0;
   u32 crc;
 
-  crc = afx->crc;
   idx = afx->idx;
   val = afx->radbuf[0];
   for (n = 0; n < size;) {
+    if (!idx && !afx->buffer_pos && afx->buffer_len) {
+      n += radix64_read_line(afx, buf + n, size - n);
+      if (n == size) break;
+    }
     if (afx->buffer_pos < afx->buffer_len)
       c = afx->buffer[afx->buffer_pos++];
     else { /* read the next line */
@@ -759,10 +791,7 @@ static int radix64_read(armor_filter_context_t *afx, IOBUF a, size_t *retn,
     idx = (idx + 1) % 4;
   }
 
-  for (i = 0; i < n; i++)
-    crc = (crc << 8) ^ crc_table[((crc >> 16) & 0xff) ^ buf[i]];
-  crc &= 0x00ffffff;
-  afx->crc = crc;
+  gcry_md_write(afx->crc_md, buf, n);
   afx->idx = idx;
   afx->radbuf[0] = val;
 
@@ -836,8 +865,8 @@ static int radix64_read(armor_filter_context_t *afx, IOBUF a, size_t *retn,
       } else if (idx != 4) {
         log_info(_("malformed CRC\n"));
         rc = invalid_crc();
-      } else if (mycrc != afx->crc) {
-        log_info(_("CRC error; %06lX - %06lX\n"), (unsigned long)afx->crc,
+      } else if ((crc = crc_value(afx)) != mycrc) {
+        log_info(_("CRC error; %06lX - %06lX\n"), (unsigned long)crc,
                  (unsigned long)mycrc);
         rc = invalid_crc();
       } else {
@@ -874,6 +903,33 @@ static int radix64_read(armor_filter_context_t *afx, IOBUF a, size_t *retn,
   return rc;
 }
 
+/* Write as many full lines of radix64 for the SIZE octets at BUF to
+   A as possible, starting a new line.  Return the number of octets
+   encoded, a multiple of the 48 octets per line.  */
+static size_t radix64_write_lines(armor_filter_context_t *afx, IOBUF a,
+                                  const byte *buf, size_t size) {
+  char line[RADIX64_LINES * 64];
+  byte out[RADIX64_LINES * (64 + sizeof afx->eol)];
+  size_t eollen = strlen((const char *)afx->eol);
+  size_t done = 0;
+  size_t nlines, i;
+  byte *p;
+
+  while (size - done >= 48) {
+    nlines = std::min((size - done) / 48, (size_t)RADIX64_LINES);
+    NeoPG::base64_encode(buf + done, nlines * 48, line);
+    for (p = out, i = 0; i < nlines; i++) {
+      memcpy(p, line + 64 * i, 64);
+      p += 64;
+      memcpy(p, afx->eol, eollen);
+      p += eollen;
+    }
+    iobuf_write(a, out, p - out);
+    done += nlines * 48;
+  }
+  return done;
+}
+
 /****************
  * This filter is used to handle the armor stuff
  */
@@ -1003,18 +1059,21 @@ static int armor_filter(void *opaque, int control, IOBUF a, byte *buf,
       afx->status++;
       afx->idx = 0;
       afx->idx2 = 0;
-      afx->crc = CRCINIT;
+      crc_init(afx);
     }
-    crc = afx->crc;
     idx = afx->idx;
     idx2 = afx->idx2;
     for (i = 0; i < idx; i++) radbuf[i] = afx->radbuf[i];
 
-    for (i = 0; i < size; i++)
-      crc = (crc << 8) ^ crc_table[((crc >> 16) & 0xff) ^ buf[i]];
-    crc &= 0x00ffffff;
+    gcry_md_write(afx->crc_md, buf, size);
 
     for (; size; buf++, size--) {
+      if (!idx && !idx2 && size >= 48) {
+        n = radix64_write_lines(afx, a, buf, size);
+        buf += n;
+        size -= n;
+        if (!size) break;
+      }
       radbuf[idx++] = *buf;
       if (idx > 2) {
         idx = 0;
@@ -1036,7 +1095,6 @@ static int armor_filter(void *opaque, int control, IOBUF a, byte *buf,
     for (i = 0; i < idx; i++) afx->radbuf[i] = radbuf[i];
     afx->idx = idx;
     afx->idx2 = idx2;
-    afx->crc = crc;
   } else if (control == IOBUFCTRL_INIT) {
     if (!is_initialized) initialize();
 
@@ -1056,7 +1114,7 @@ static int armor_filter(void *opaque, int control, IOBUF a, byte *buf,
     if (afx->cancel)
       ;
     else if (afx->status) { /* pad, write cecksum, and bottom line */
-      crc = afx->crc;
+      crc = crc_value(afx);
       idx = afx->idx;
       idx2 = afx->idx2;
       if (idx) {
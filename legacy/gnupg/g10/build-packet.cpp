@@ -41,6 +41,7 @@ static u32 calc_plaintext(PKT_plaintext *pt);
 static int do_plaintext(IOBUF out, int ctb, PKT_plaintext *pt);
 static int do_encrypted(IOBUF out, int ctb, PKT_encrypted *ed);
 static int do_encrypted_mdc(IOBUF out, int ctb, PKT_encrypted *ed);
+static int do_encrypted_aead(IOBUF out, int ctb, PKT_encrypted *ed);
 static int do_compressed(IOBUF out, int ctb, PKT_compressed *cd);
 static int do_signature(IOBUF out, int ctb, PKT_signature *sig);
 static int do_onepass_sig(IOBUF out, int ctb, PKT_onepass_sig *ops);
@@ -93,6 +94,7 @@ int build_packet(IOBUF out, PACKET *pkt) {
       break;
     case PKT_ENCRYPTED:
     case PKT_ENCRYPTED_MDC:
+    case PKT_ENCRYPTED_AEAD:
       new_ctb = pkt->pkt.encrypted->new_ctb;
       break;
     case PKT_COMPRESSED:
@@ -143,6 +145,9 @@ int build_packet(IOBUF out, PACKET *pkt) {
     case PKT_ENCRYPTED_MDC:
       rc = do_encrypted_mdc(out, ctb, pkt->pkt.encrypted);
       break;
+    case PKT_ENCRYPTED_AEAD:
+      rc = do_encrypted_aead(out, ctb, pkt->pkt.encrypted);
+      break;
     case PKT_COMPRESSED:
       rc = do_compressed(out, ctb, pkt->pkt.compressed);
       break;
@@ -208,6 +213,32 @@ gpg_error_t build_packet_and_meta(iobuf_t out, PACKET *pkt) {
   return err;
 }
 
+/* Return the value of the opaque MPI A with leading zero bits
+ * stripped and store its length in bits at R_NBITS.  */
+static const unsigned char *get_stripped_opaque(gcry_mpi_t a,
+                                                unsigned int *r_nbits) {
+  unsigned int nbits;
+  const unsigned char *p;
+
+  /* gcry_log_debugmpi ("a", a); */
+  p = (const unsigned char *)gcry_mpi_get_opaque(a, &nbits);
+  if (p) {
+    /* Strip leading zero bits.  */
+    for (; nbits >= 8 && !*p; p++, nbits -= 8)
+      ;
+    if (nbits >= 8 && !(*p & 0x80))
+      if (--nbits >= 7 && !(*p & 0x40))
+        if (--nbits >= 6 && !(*p & 0x20))
+          if (--nbits >= 5 && !(*p & 0x10))
+            if (--nbits >= 4 && !(*p & 0x08))
+              if (--nbits >= 3 && !(*p & 0x04))
+                if (--nbits >= 2 && !(*p & 0x02))
+                  if (--nbits >= 1 && !(*p & 0x01)) --nbits;
+  }
+  *r_nbits = nbits;
+  return p;
+}
+
 /*
  * Write the mpi A to OUT.
  */
@@ -219,21 +250,7 @@ gpg_error_t gpg_mpi_write(iobuf_t out, gcry_mpi_t a) {
     const unsigned char *p;
     unsigned char lenhdr[2];
 
-    /* gcry_log_debugmpi ("a", a); */
-    p = (const unsigned char *)gcry_mpi_get_opaque(a, &nbits);
-    if (p) {
-      /* Strip leading zero bits.  */
-      for (; nbits >= 8 && !*p; p++, nbits -= 8)
-        ;
-      if (nbits >= 8 && !(*p & 0x80))
-        if (--nbits >= 7 && !(*p & 0x40))
-          if (--nbits >= 6 && !(*p & 0x20))
-            if (--nbits >= 5 && !(*p & 0x10))
-              if (--nbits >= 4 && !(*p & 0x08))
-                if (--nbits >= 3 && !(*p & 0x04))
-                  if (--nbits >= 2 && !(*p & 0x02))
-                    if (--nbits >= 1 && !(*p & 0x01)) --nbits;
-    }
+    p = get_stripped_opaque(a, &nbits);
     /* gcry_log_debug ("   [%u bit]\n", nbits); */
     /* gcry_log_debughex (" ", p, (nbits+7)/8); */
     lenhdr[0] = nbits >> 8;
@@ -278,6 +295,105 @@ gpg_error_t gpg_mpi_write_nohdr(iobuf_t out, gcry_mpi_t a) {
   return rc;
 }
 
+/* The bodies of keys, signatures and session key packets are
+ * serialized twice by the same code: first into a counting sink to
+ * learn the length for the header, then straight to the output
+ * stream.  This avoids collecting each body in a temporary buffer
+ * just to copy it afterwards.  With OUT set the bytes are written to
+ * OUT; otherwise only their number is added to LEN.  ERR keeps the
+ * first error.  */
+struct body_sink {
+  iobuf_t out;
+  u32 len;
+  gpg_error_t err;
+};
+
+static void sink_put(struct body_sink *sink, int c) {
+  if (!sink->out)
+    sink->len++;
+  else if (!sink->err)
+    sink->err = iobuf_put(sink->out, c);
+}
+
+static void sink_write(struct body_sink *sink, const void *buf, size_t len) {
+  if (!sink->out)
+    sink->len += len;
+  else if (!sink->err)
+    sink->err = iobuf_write(sink->out, buf, len);
+}
+
+static void sink_write_16(struct body_sink *sink, u16 a) {
+  byte buf[2];
+
+  buf[0] = a >> 8;
+  buf[1] = a;
+  sink_write(sink, buf, 2);
+}
+
+static void sink_write_32(struct body_sink *sink, u32 a) {
+  byte buf[4];
+
+  buf[0] = a >> 24;
+  buf[1] = a >> 16;
+  buf[2] = a >> 8;
+  buf[3] = a;
+  sink_write(sink, buf, 4);
+}
+
+/* Write the MPI A to SINK like gpg_mpi_write does.  */
+static gpg_error_t sink_mpi(struct body_sink *sink, gcry_mpi_t a) {
+  gpg_error_t err;
+  unsigned int nbits;
+  size_t nbytes;
+
+  if (sink->out) {
+    err = gpg_mpi_write(sink->out, a);
+    if (err && !sink->err) sink->err = err;
+    return err;
+  }
+
+  if (gcry_mpi_get_flag(a, GCRYMPI_FLAG_OPAQUE)) {
+    if (get_stripped_opaque(a, &nbits))
+      nbytes = 2 + (nbits + 7) / 8;
+    else
+      nbytes = 2;
+  } else {
+    err = gcry_mpi_print(GCRYMPI_FMT_PGP, NULL, 0, &nbytes, a);
+    if (err) {
+      if (!sink->err) sink->err = err;
+      return err;
+    }
+    if (nbytes > (MAX_EXTERN_MPI_BITS + 7) / 8 + 2) {
+      log_info("mpi too large (%u bits)\n", gcry_mpi_get_nbits(a));
+      if (!sink->err) sink->err = GPG_ERR_TOO_LARGE;
+      return GPG_ERR_TOO_LARGE;
+    }
+  }
+  sink->len += nbytes;
+  return 0;
+}
+
+/* Write the opaque MPI A to SINK like gpg_mpi_write_nohdr does.  */
+static gpg_error_t sink_mpi_nohdr(struct body_sink *sink, gcry_mpi_t a) {
+  gpg_error_t err;
+  unsigned int nbits;
+  const void *p;
+
+  if (sink->out) {
+    err = gpg_mpi_write_nohdr(sink->out, a);
+    if (err && !sink->err) sink->err = err;
+    return err;
+  }
+
+  if (!gcry_mpi_get_flag(a, GCRYMPI_FLAG_OPAQUE)) {
+    if (!sink->err) sink->err = GPG_ERR_BAD_MPI;
+    return GPG_ERR_BAD_MPI;
+  }
+  p = gcry_mpi_get_opaque(a, &nbits);
+  if (p) sink->len += (nbits + 7) / 8;
+  return 0;
+}
+
 /* Calculate the length of a packet described by PKT.  */
 u32 calc_packet_length(PACKET *pkt) {
   u32 n = 0;
@@ -310,18 +426,18 @@ u32 calc_packet_length(PACKET *pkt) {
   return n;
 }
 
-static gpg_error_t write_fake_data(IOBUF out, gcry_mpi_t a) {
+static void write_fake_data(struct body_sink *sink, gcry_mpi_t a) {
   unsigned int n;
   void *p;
 
-  if (!a) return 0;
+  if (!a) return;
   if (!gcry_mpi_get_flag(a, GCRYMPI_FLAG_OPAQUE))
-    return 0; /* e.g. due to generating a key with wrong usage.  */
+    return; /* e.g. due to generating a key with wrong usage.  */
   p = gcry_mpi_get_opaque(a, &n);
   if (!p)
-    return 0; /* For example due to a read error in
-                 parse-packet.c:read_rest.  */
-  return iobuf_write(out, p, (n + 7) / 8);
+    return; /* For example due to a read error in
+               parse-packet.c:read_rest.  */
+  sink_write(sink, p, (n + 7) / 8);
 }
 
 /* Write a ring trust meta packet.  */
@@ -378,44 +494,19 @@ static int do_user_id(IOBUF out, int ctb, PKT_user_id *uid) {
   return rc;
 }
 
-/* Serialize the key (RFC 4880, Section 5.5) described by PK and write
- * it to OUT.
- *
- * This function serializes both primary keys and subkeys with or
- * without a secret part.
- *
- * CTB is the serialization's CTB.  It specifies the header format and
- * the packet's type.  The header length must not be set.
- *
- * PK->VERSION specifies the serialization format.  A value of 0 means
- * to use the default version.  Currently, only version 4 packets are
- * supported.
- */
-static int do_key(iobuf_t out, int ctb, PKT_public_key *pk) {
+/* Write the body of the key packet PK to SINK.  */
+static gpg_error_t write_key_body(struct body_sink *sink, PKT_public_key *pk) {
   gpg_error_t err = 0;
-  /* The length of the body is stored in the packet's header, which
-     occurs before the body.  Unfortunately, we don't know the length
-     of the packet's body until we've written all of the data!  To
-     work around this, we first write the data into this temporary
-     buffer, then generate the header, and finally copy the contents
-     of this buffer to OUT.  */
-  iobuf_t a = iobuf_temp();
   int i, nskey, npkey;
 
-  log_assert(pk->version == 0 || pk->version == 4);
-  log_assert(ctb_pkttype(ctb) == PKT_PUBLIC_KEY ||
-             ctb_pkttype(ctb) == PKT_PUBLIC_SUBKEY ||
-             ctb_pkttype(ctb) == PKT_SECRET_KEY ||
-             ctb_pkttype(ctb) == PKT_SECRET_SUBKEY);
-
   /* Write the version number - if none is specified, use 4 */
   if (!pk->version)
-    iobuf_put(a, 4);
+    sink_put(sink, 4);
   else
-    iobuf_put(a, pk->version);
-  write_32(a, pk->timestamp);
+    sink_put(sink, pk->version);
+  sink_write_32(sink, pk->timestamp);
 
-  iobuf_put(a, pk->pubkey_algo);
+  sink_put(sink, pk->pubkey_algo);
 
   /* Get number of secret and public parameters.  They are held in one
      array: the public ones followed by the secret ones.  */
@@ -426,7 +517,7 @@ static int do_key(iobuf_t out, int ctb, PKT_public_key *pk) {
      case if we don't know the algorithm used - the parameters are
      stored as one blob in a faked (opaque) MPI. */
   if (!npkey) {
-    write_fake_data(a, pk->pkey[0]);
+    write_fake_data(sink, pk->pkey[0]);
     goto leave;
   }
   log_assert(npkey < nskey);
@@ -435,9 +526,9 @@ static int do_key(iobuf_t out, int ctb, PKT_public_key *pk) {
     if ((pk->pubkey_algo == PUBKEY_ALGO_ECDSA && (i == 0)) ||
         (pk->pubkey_algo == PUBKEY_ALGO_EDDSA && (i == 0)) ||
         (pk->pubkey_algo == PUBKEY_ALGO_ECDH && (i == 0 || i == 2)))
-      err = gpg_mpi_write_nohdr(a, pk->pkey[i]);
+      err = sink_mpi_nohdr(sink, pk->pkey[i]);
     else
-      err = gpg_mpi_write(a, pk->pkey[i]);
+      err = sink_mpi(sink, pk->pkey[i]);
     if (err) goto leave;
   }
 
@@ -448,43 +539,43 @@ static int do_key(iobuf_t out, int ctb, PKT_public_key *pk) {
     /* Build the header for protected (encrypted) secret parameters.  */
     if (ski->is_protected) {
       /* OpenPGP protection according to rfc2440. */
-      iobuf_put(a, ski->sha1chk ? 0xfe : 0xff);
-      iobuf_put(a, ski->algo);
+      sink_put(sink, ski->sha1chk ? 0xfe : 0xff);
+      sink_put(sink, ski->algo);
       if (ski->s2k.mode >= 1000) {
         /* These modes are not possible in OpenPGP, we use them
            to implement our extensions, 101 can be viewed as a
            private/experimental extension (this is not specified
            in rfc2440 but the same scheme is used for all other
            algorithm identifiers). */
-        iobuf_put(a, 101);
-        iobuf_put(a, ski->s2k.hash_algo);
-        iobuf_write(a, "GNU", 3);
-        iobuf_put(a, ski->s2k.mode - 1000);
+        sink_put(sink, 101);
+        sink_put(sink, ski->s2k.hash_algo);
+        sink_write(sink, "GNU", 3);
+        sink_put(sink, ski->s2k.mode - 1000);
       } else {
-        iobuf_put(a, ski->s2k.mode);
-        iobuf_put(a, ski->s2k.hash_algo);
+        sink_put(sink, ski->s2k.mode);
+        sink_put(sink, ski->s2k.hash_algo);
       }
 
       if (ski->s2k.mode == 1 || ski->s2k.mode == 3)
-        iobuf_write(a, ski->s2k.salt, 8);
+        sink_write(sink, ski->s2k.salt, 8);
 
-      if (ski->s2k.mode == 3) iobuf_put(a, ski->s2k.count);
+      if (ski->s2k.mode == 3) sink_put(sink, ski->s2k.count);
 
       /* For our special modes 1001, 1002 we do not need an IV. */
       if (ski->s2k.mode != 1001 && ski->s2k.mode != 1002)
-        iobuf_write(a, ski->iv, ski->ivlen);
+        sink_write(sink, ski->iv, ski->ivlen);
 
     } else /* Not protected. */
-      iobuf_put(a, 0);
+      sink_put(sink, 0);
 
     if (ski->s2k.mode == 1001)
       ; /* GnuPG extension - don't write a secret key at all. */
     else if (ski->s2k.mode == 1002) {
       /* GnuPG extension - divert to OpenPGP smartcard. */
       /* Length of the serial number or 0 for no serial number. */
-      iobuf_put(a, ski->ivlen);
+      sink_put(sink, ski->ivlen);
       /* The serial number gets stored in the IV field.  */
-      iobuf_write(a, ski->iv, ski->ivlen);
+      sink_write(sink, ski->iv, ski->ivlen);
     } else if (ski->is_protected) {
       /* The secret key is protected - write it out as it is.  */
       byte *p;
@@ -492,27 +583,65 @@ static int do_key(iobuf_t out, int ctb, PKT_public_key *pk) {
 
       log_assert(gcry_mpi_get_flag(pk->pkey[npkey], GCRYMPI_FLAG_OPAQUE));
       p = (byte *)gcry_mpi_get_opaque(pk->pkey[npkey], &ndatabits);
-      if (p) iobuf_write(a, p, (ndatabits + 7) / 8);
+      if (p) sink_write(sink, p, (ndatabits + 7) / 8);
     } else {
       /* Non-protected key. */
       for (; i < nskey; i++)
-        if ((err = gpg_mpi_write(a, pk->pkey[i]))) goto leave;
-      write_16(a, ski->csum);
+        if ((err = sink_mpi(sink, pk->pkey[i]))) goto leave;
+      sink_write_16(sink, ski->csum);
     }
   }
 
 leave:
-  if (!err) {
-    /* Build the header of the packet - which we must do after
-       writing all the other stuff, so that we know the length of
-       the packet */
-    write_header2(out, ctb, iobuf_get_temp_length(a), 0);
-    /* And finally write it out to the real stream. */
-    err = iobuf_write_temp(out, a);
-  }
+  return err ? err : sink->err;
+}
 
-  iobuf_close(a); /* Close the temporary buffer */
-  return err;
+/* Serialize the key (RFC 4880, Section 5.5) described by PK and write
+ * it to OUT.
+ *
+ * This function serializes both primary keys and subkeys with or
+ * without a secret part.
+ *
+ * CTB is the serialization's CTB.  It specifies the header format and
+ * the packet's type.  The header length must not be set.
+ *
+ * PK->VERSION specifies the serialization format.  A value of 0 means
+ * to use the default version.  Currently, only version 4 packets are
+ * supported.
+ */
+static int do_key(iobuf_t out, int ctb, PKT_public_key *pk) {
+  struct body_sink sink = {NULL, 0, 0};
+  gpg_error_t err;
+
+  log_assert(pk->version == 0 || pk->version == 4);
+  log_assert(ctb_pkttype(ctb) == PKT_PUBLIC_KEY ||
+             ctb_pkttype(ctb) == PKT_PUBLIC_SUBKEY ||
+             ctb_pkttype(ctb) == PKT_SECRET_KEY ||
+             ctb_pkttype(ctb) == PKT_SECRET_SUBKEY);
+
+  /* The length of the body is stored in the packet's header, which
+     occurs before the body.  Thus we first only count the bytes of
+     the body, then write the header and finally the body to OUT.  */
+  err = write_key_body(&sink, pk);
+  if (err) return err;
+  write_header2(out, ctb, sink.len, 0);
+  sink.out = out;
+  return write_key_body(&sink, pk);
+}
+
+/* Write the body of the symmetric-key encrypted session key packet
+ * ENC to SINK.  */
+static void write_symkey_enc_body(struct body_sink *sink,
+                                  PKT_symkey_enc *enc) {
+  sink_put(sink, enc->version);
+  sink_put(sink, enc->cipher_algo);
+  sink_put(sink, enc->s2k.mode);
+  sink_put(sink, enc->s2k.hash_algo);
+  if (enc->s2k.mode == 1 || enc->s2k.mode == 3) {
+    sink_write(sink, enc->s2k.salt, 8);
+    if (enc->s2k.mode == 3) sink_put(sink, enc->s2k.count);
+  }
+  if (enc->seskeylen) sink_write(sink, enc->seskey, enc->seskeylen);
 }
 
 /* Serialize the symmetric-key encrypted session key packet (RFC 4880,
@@ -521,8 +650,7 @@ leave:
  * CTB is the serialization's CTB.  It specifies the header format and
  * the packet's type.  The header length must not be set.  */
 static int do_symkey_enc(IOBUF out, int ctb, PKT_symkey_enc *enc) {
-  int rc = 0;
-  IOBUF a = iobuf_temp();
+  struct body_sink sink = {NULL, 0, 0};
 
   log_assert(ctb_pkttype(ctb) == PKT_SYMKEY_ENC);
 
@@ -539,61 +667,60 @@ static int do_symkey_enc(IOBUF out, int ctb, PKT_symkey_enc *enc) {
     default:
       log_bug("do_symkey_enc: s2k=%d\n", enc->s2k.mode);
   }
-  iobuf_put(a, enc->version);
-  iobuf_put(a, enc->cipher_algo);
-  iobuf_put(a, enc->s2k.mode);
-  iobuf_put(a, enc->s2k.hash_algo);
-  if (enc->s2k.mode == 1 || enc->s2k.mode == 3) {
-    iobuf_write(a, enc->s2k.salt, 8);
-    if (enc->s2k.mode == 3) iobuf_put(a, enc->s2k.count);
-  }
-  if (enc->seskeylen) iobuf_write(a, enc->seskey, enc->seskeylen);
-
-  write_header(out, ctb, iobuf_get_temp_length(a));
-  rc = iobuf_write_temp(out, a);
-
-  iobuf_close(a);
-  return rc;
+  write_symkey_enc_body(&sink, enc);
+  write_header(out, ctb, sink.len);
+  sink.out = out;
+  write_symkey_enc_body(&sink, enc);
+  return sink.err;
 }
 
-/* Serialize the public-key encrypted session key packet (RFC 4880,
-   5.1) described by ENC and write it to OUT.
-
-   CTB is the serialization's CTB.  It specifies the header format and
-   the packet's type.  The header length must not be set.  */
-static int do_pubkey_enc(IOBUF out, int ctb, PKT_pubkey_enc *enc) {
-  int rc = 0;
+/* Write the body of the public-key encrypted session key packet ENC
+   to SINK.  */
+static gpg_error_t write_pubkey_enc_body(struct body_sink *sink,
+                                         PKT_pubkey_enc *enc) {
+  gpg_error_t rc = 0;
   int n, i;
-  IOBUF a = iobuf_temp();
 
-  log_assert(ctb_pkttype(ctb) == PKT_PUBKEY_ENC);
-
-  iobuf_put(a, 3); /* Version.  */
+  sink_put(sink, 3); /* Version.  */
 
   if (enc->throw_keyid) {
-    write_32(a, 0); /* Don't tell Eve who can decrypt the message.  */
-    write_32(a, 0);
+    /* Don't tell Eve who can decrypt the message.  */
+    sink_write_32(sink, 0);
+    sink_write_32(sink, 0);
   } else {
-    write_32(a, enc->keyid[0]);
-    write_32(a, enc->keyid[1]);
+    sink_write_32(sink, enc->keyid[0]);
+    sink_write_32(sink, enc->keyid[1]);
   }
-  iobuf_put(a, enc->pubkey_algo);
+  sink_put(sink, enc->pubkey_algo);
   n = pubkey_get_nenc((pubkey_algo_t)(enc->pubkey_algo));
-  if (!n) write_fake_data(a, enc->data[0]);
+  if (!n) write_fake_data(sink, enc->data[0]);
 
   for (i = 0; i < n && !rc; i++) {
     if (enc->pubkey_algo == PUBKEY_ALGO_ECDH && i == 1)
-      rc = gpg_mpi_write_nohdr(a, enc->data[i]);
+      rc = sink_mpi_nohdr(sink, enc->data[i]);
     else
-      rc = gpg_mpi_write(a, enc->data[i]);
+      rc = sink_mpi(sink, enc->data[i]);
   }
 
-  if (!rc) {
-    write_header(out, ctb, iobuf_get_temp_length(a));
-    rc = iobuf_write_temp(out, a);
-  }
-  iobuf_close(a);
-  return rc;
+  return rc ? rc : sink->err;
+}
+
+/* Serialize the public-key encrypted session key packet (RFC 4880,
+   5.1) described by ENC and write it to OUT.
+
+   CTB is the serialization's CTB.  It specifies the header format and
+   the packet's type.  The header length must not be set.  */
+static int do_pubkey_enc(IOBUF out, int ctb, PKT_pubkey_enc *enc) {
+  struct body_sink sink = {NULL, 0, 0};
+  int rc;
+
+  log_assert(ctb_pkttype(ctb) == PKT_PUBKEY_ENC);
+
+  rc = write_pubkey_enc_body(&sink, enc);
+  if (rc) return rc;
+  write_header(out, ctb, sink.len);
+  sink.out = out;
+  return write_pubkey_enc_body(&sink, enc);
 }
 
 /* Calculate the length of the serialized plaintext packet PT (RFC
@@ -691,6 +818,25 @@ static int do_encrypted_mdc(IOBUF out, int ctb, PKT_encrypted *ed) {
   return rc;
 }
 
+/* Serialize the AEAD encrypted data packet (RFC4880bis) described by
+   ED and write it to OUT.  The packet always uses partial body
+   lengths.
+
+   Note: this only writes the packet's header!  The caller must then
+   follow up and write the IV, the chunks and the final tag to OUT.
+   (If you use the encryption iobuf filter (cipher_filter_aead), then
+   this is done automatically.)  */
+static int do_encrypted_aead(IOBUF out, int ctb, PKT_encrypted *ed) {
+  log_assert(ed->aead_algo);
+  log_assert(ctb_pkttype(ctb) == PKT_ENCRYPTED_AEAD);
+
+  write_header(out, ctb, 0);
+  iobuf_put(out, 1); /* version */
+  iobuf_put(out, ed->cipher_algo);
+  iobuf_put(out, ed->aead_algo);
+  return iobuf_put(out, ed->chunkbyte) == -1 ? -1 : 0;
+}
+
 /* Serialize the compressed packet (RFC 4880, Section 5.6) described
    by CD and write it to OUT.
 
@@ -1298,60 +1444,66 @@ void free_notation(struct notation *notation) {
   }
 }
 
-/* Serialize the signature packet (RFC 4880, Section 5.2) described by
-   SIG and write it to OUT.  */
-static int do_signature(IOBUF out, int ctb, PKT_signature *sig) {
-  int rc = 0;
+/* Write the body of the signature packet SIG to SINK.  */
+static gpg_error_t write_signature_body(struct body_sink *sink,
+                                        PKT_signature *sig) {
+  gpg_error_t rc = 0;
   int n, i;
-  IOBUF a = iobuf_temp();
-
-  log_assert(ctb_pkttype(ctb) == PKT_SIGNATURE);
 
   if (!sig->version || sig->version == 3) {
-    iobuf_put(a, 3);
+    sink_put(sink, 3);
 
     /* Version 3 packets don't support subpackets.  */
     log_assert(!sig->hashed);
     log_assert(!sig->unhashed);
   } else
-    iobuf_put(a, sig->version);
-  if (sig->version < 4) iobuf_put(a, 5); /* Constant */
-  iobuf_put(a, sig->sig_class);
+    sink_put(sink, sig->version);
+  if (sig->version < 4) sink_put(sink, 5); /* Constant */
+  sink_put(sink, sig->sig_class);
   if (sig->version < 4) {
-    write_32(a, sig->timestamp);
-    write_32(a, sig->keyid[0]);
-    write_32(a, sig->keyid[1]);
+    sink_write_32(sink, sig->timestamp);
+    sink_write_32(sink, sig->keyid[0]);
+    sink_write_32(sink, sig->keyid[1]);
   }
-  iobuf_put(a, sig->pubkey_algo);
-  iobuf_put(a, sig->digest_algo);
+  sink_put(sink, sig->pubkey_algo);
+  sink_put(sink, sig->digest_algo);
   if (sig->version >= 4) {
     size_t nn;
     /* Timestamp and keyid must have been packed into the subpackets
        prior to the call of this function, because these subpackets
        are hashed. */
     nn = sig->hashed ? sig->hashed->len : 0;
-    write_16(a, nn);
-    if (nn) iobuf_write(a, sig->hashed->data, nn);
+    sink_write_16(sink, nn);
+    if (nn) sink_write(sink, sig->hashed->data, nn);
     nn = sig->unhashed ? sig->unhashed->len : 0;
-    write_16(a, nn);
-    if (nn) iobuf_write(a, sig->unhashed->data, nn);
+    sink_write_16(sink, nn);
+    if (nn) sink_write(sink, sig->unhashed->data, nn);
   }
-  iobuf_put(a, sig->digest_start[0]);
-  iobuf_put(a, sig->digest_start[1]);
+  sink_put(sink, sig->digest_start[0]);
+  sink_put(sink, sig->digest_start[1]);
   n = pubkey_get_nsig((pubkey_algo_t)(sig->pubkey_algo));
-  if (!n) write_fake_data(a, sig->data[0]);
-  for (i = 0; i < n && !rc; i++) rc = gpg_mpi_write(a, sig->data[i]);
+  if (!n) write_fake_data(sink, sig->data[0]);
+  for (i = 0; i < n && !rc; i++) rc = sink_mpi(sink, sig->data[i]);
 
-  if (!rc) {
-    if (is_RSA(sig->pubkey_algo) && sig->version < 4)
-      write_sign_packet_header(out, ctb, iobuf_get_temp_length(a));
-    else
-      write_header(out, ctb, iobuf_get_temp_length(a));
-    rc = iobuf_write_temp(out, a);
-  }
+  return rc ? rc : sink->err;
+}
 
-  iobuf_close(a);
-  return rc;
+/* Serialize the signature packet (RFC 4880, Section 5.2) described by
+   SIG and write it to OUT.  */
+static int do_signature(IOBUF out, int ctb, PKT_signature *sig) {
+  struct body_sink sink = {NULL, 0, 0};
+  int rc;
+
+  log_assert(ctb_pkttype(ctb) == PKT_SIGNATURE);
+
+  rc = write_signature_body(&sink, sig);
+  if (rc) return rc;
+  if (is_RSA(sig->pubkey_algo) && sig->version < 4)
+    write_sign_packet_header(out, ctb, sink.len);
+  else
+    write_header(out, ctb, sink.len);
+  sink.out = out;
+  return write_signature_body(&sink, sig);
 }
 
 /* Serialize the one-pass signature packet (RFC 4880, Section 5.4)
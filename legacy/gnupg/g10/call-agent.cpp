@@ -29,6 +29,9 @@
 #include <locale.h>
 #endif
 
+#include <set>
+#include <string>
+
 #include <boost/algorithm/string.hpp>
 
 #include <assuan.h>
@@ -37,6 +40,7 @@
 #include "../common/membuf.h"
 #include "../common/status.h"
 #include "../common/sysutils.h"
+#include "../common/trace.h"
 #include "../common/util.h"
 #include "call-agent.h"
 #include "gpg.h"
@@ -47,6 +51,19 @@
 static assuan_context_t agent_ctx = NULL;
 static int did_early_card_test;
 
+/* The keygrips (in binary) of all secret keys the agent knows about,
+   as returned by "KEYINFO --list".  With this we can answer the
+   frequent "is there a secret key for this public key" question
+   locally instead of sending a HAVEKEY for every key.  The cache is
+   flushed by every command which may change the agent's set of
+   secret keys.  If the agent does not support the command we fall
+   back to HAVEKEY.  */
+static struct {
+  int valid;
+  int unsupported;
+  std::set<std::string> grips;
+} seckey_cache;
+
 struct default_inq_parm_s {
   ctrl_t ctrl;
   assuan_context_t ctx;
@@ -167,6 +184,7 @@ static int start_agent(ctrl_t ctrl, int flag_for_card) {
                              opt.lc_ctype ? opt.lc_ctype->c_str() : NULL,
                              opt.lc_messages ? opt.lc_messages->c_str() : NULL,
                              opt.verbose, DBG_IPC);
+    if (!rc) trace_assuan_context(agent_ctx, "agent");
   }
 
   if (!rc && flag_for_card && !did_early_card_test) {
@@ -461,6 +479,7 @@ int agent_scd_learn(struct agent_card_info_s *info, int force) {
   if (rc) return rc;
 
   parm.ctx = agent_ctx;
+  agent_flush_seckey_cache(); /* LEARN may create shadow keys.  */
   rc = assuan_transact(
       agent_ctx, force ? "LEARN --sendinfo --force" : "LEARN --sendinfo",
       dummy_data_cb, NULL, default_inq_cb, &parm, learn_status_cb, info);
@@ -533,6 +552,7 @@ int agent_keytocard(const char *hexgrip, int keyno, int force,
   if (rc) return rc;
   parm.ctx = agent_ctx;
 
+  agent_flush_seckey_cache();
   rc = assuan_transact(agent_ctx, line, NULL, NULL, default_inq_cb, &parm, NULL,
                        NULL);
   if (rc) return rc;
@@ -1053,6 +1073,59 @@ gpg_error_t agent_get_s2k_count(unsigned long *r_count) {
   return err;
 }
 
+/* Status callback for load_seckey_cache.  */
+static gpg_error_t keyinfo_list_status_cb(void *opaque, const char *line) {
+  std::set<std::string> *grips = (std::set<std::string> *)opaque;
+  unsigned char grip[20];
+  const char *s;
+
+  if ((s = has_leading_keyword(line, "KEYINFO")) &&
+      hex2bin(s, grip, sizeof grip) == 40)
+    grips->insert(std::string((char *)grip, sizeof grip));
+  return 0;
+}
+
+/* Make sure that the secret key cache is filled.  Returns an error if
+   the cache can't be used; the caller should then ask the agent
+   directly.  */
+static gpg_error_t load_seckey_cache(void) {
+  gpg_error_t err;
+
+  if (seckey_cache.valid) return 0;
+  if (seckey_cache.unsupported) return GPG_ERR_NOT_SUPPORTED;
+
+  seckey_cache.grips.clear();
+  err = assuan_transact(agent_ctx, "KEYINFO --list", NULL, NULL, NULL, NULL,
+                        keyinfo_list_status_cb, &seckey_cache.grips);
+  if (err) {
+    if (opt.verbose)
+      log_info("listing secret keys failed: %s\n", gpg_strerror(err));
+    seckey_cache.grips.clear();
+    seckey_cache.unsupported = 1;
+    return err;
+  }
+  seckey_cache.valid = 1;
+  return 0;
+}
+
+/* Return 0 if the cache knows a secret key for PK.  */
+static gpg_error_t lookup_seckey_cache(PKT_public_key *pk) {
+  gpg_error_t err;
+  unsigned char grip[20];
+
+  err = keygrip_from_pk(pk, grip);
+  if (err) return err;
+  if (seckey_cache.grips.count(std::string((char *)grip, sizeof grip)))
+    return 0;
+  return GPG_ERR_NO_SECKEY;
+}
+
+/* Forget the cached list of secret keys.  */
+void agent_flush_seckey_cache(void) {
+  seckey_cache.valid = 0;
+  seckey_cache.grips.clear();
+}
+
 /* Ask the agent whether a secret key for the given public key is
    available.  Returns 0 if available.  */
 gpg_error_t agent_probe_secret_key(ctrl_t ctrl, PKT_public_key *pk) {
@@ -1063,6 +1136,8 @@ gpg_error_t agent_probe_secret_key(ctrl_t ctrl, PKT_public_key *pk) {
   err = start_agent(ctrl, 0);
   if (err) return err;
 
+  if (!load_seckey_cache()) return lookup_seckey_cache(pk);
+
   err = hexkeygrip_from_pk(pk, &hexgrip);
   if (err) return err;
 
@@ -1073,6 +1148,39 @@ gpg_error_t agent_probe_secret_key(ctrl_t ctrl, PKT_public_key *pk) {
   return err;
 }
 
+/* Ask the agent for each of the NPKS public keys in PKS whether a
+   secret key is available.  R_ERRORS receives 0 for each available
+   key and an error, usually GPG_ERR_NO_SECKEY, for the others.  All
+   HAVEKEY commands are sent at once, so this costs one round-trip to
+   the agent, not one per key.  */
+gpg_error_t agent_probe_secret_keys(ctrl_t ctrl, PKT_public_key **pks,
+                                    int npks, gpg_error_t *r_errors) {
+  gpg_error_t err;
+  std::vector<std::string> lines;
+  std::vector<const char *> cmds;
+  char *hexgrip;
+  int i;
+
+  err = start_agent(ctrl, 0);
+  if (err) return err;
+
+  if (!load_seckey_cache()) {
+    for (i = 0; i < npks; i++) r_errors[i] = lookup_seckey_cache(pks[i]);
+    return 0;
+  }
+
+  for (i = 0; i < npks; i++) {
+    err = hexkeygrip_from_pk(pks[i], &hexgrip);
+    if (err) return err;
+    lines.push_back(std::string("HAVEKEY ") + hexgrip);
+    xfree(hexgrip);
+  }
+  for (const auto &line : lines) cmds.push_back(line.c_str());
+
+  return assuan_transact_pipelined(agent_ctx, cmds.data(), npks, r_errors,
+                                   NULL, NULL);
+}
+
 /* Ask the agent whether a secret key is available for any of the
    keys (primary or sub) in KEYBLOCK.  Returns 0 if available.  */
 gpg_error_t agent_probe_any_secret_key(ctrl_t ctrl, kbnode_t keyblock) {
@@ -1086,6 +1194,18 @@ gpg_error_t agent_probe_any_secret_key(ctrl_t ctrl, kbnode_t keyblock) {
   err = start_agent(ctrl, 0);
   if (err) return err;
 
+  if (!load_seckey_cache()) {
+    err = GPG_ERR_NO_SECKEY;
+    for (kbctx = NULL; err == GPG_ERR_NO_SECKEY &&
+                       (node = walk_kbnode(keyblock, &kbctx, 0));)
+      if (node->pkt->pkttype == PKT_PUBLIC_KEY ||
+          node->pkt->pkttype == PKT_PUBLIC_SUBKEY ||
+          node->pkt->pkttype == PKT_SECRET_KEY ||
+          node->pkt->pkttype == PKT_SECRET_SUBKEY)
+        err = lookup_seckey_cache(node->pkt->pkt.public_key);
+    return err;
+  }
+
   err = GPG_ERR_NO_SECKEY; /* Just in case no key was
                                           found in KEYBLOCK.  */
   p = stpcpy(line, "HAVEKEY");
@@ -1274,6 +1394,7 @@ gpg_error_t agent_genkey(ctrl_t ctrl, char **cache_nonce_addr,
            cache_nonce_addr && *cache_nonce_addr ? *cache_nonce_addr : "");
   cn_parm.cache_nonce_addr = cache_nonce_addr;
   cn_parm.passwd_nonce_addr = NULL;
+  agent_flush_seckey_cache();
   err = assuan_transact(agent_ctx, line, put_membuf_cb, &data, inq_genkey_parms,
                         &gk_parm, cache_nonce_status_cb, &cn_parm);
   if (err) {
@@ -1318,6 +1439,9 @@ gpg_error_t agent_readkey(ctrl_t ctrl, int fromcard, const char *hexkeygrip,
   snprintf(line, DIM(line), "READKEY %s%s", fromcard ? "--card " : "",
            hexkeygrip);
 
+  /* Reading from the card stores a shadow key.  */
+  if (fromcard) agent_flush_seckey_cache();
+
   init_membuf(&data, 1024);
   err = assuan_transact(agent_ctx, line, put_membuf_cb, &data, default_inq_cb,
                         &dfltparm, NULL, NULL);
@@ -1364,24 +1488,28 @@ gpg_error_t agent_pksign(ctrl_t ctrl, const char *cache_nonce,
 
   if (digestlen * 2 + 50 > DIM(line)) return GPG_ERR_GENERAL;
 
-  err = assuan_transact(agent_ctx, "RESET", NULL, NULL, NULL, NULL, NULL, NULL);
-  if (err) return err;
-
-  snprintf(line, DIM(line), "SIGKEY %s", keygrip);
-  err = assuan_transact(agent_ctx, line, NULL, NULL, NULL, NULL, NULL, NULL);
-  if (err) return err;
+  /* The setup commands are sent in one go.  */
+  {
+    char keyline[ASSUAN_LINELENGTH];
+    char descline[ASSUAN_LINELENGTH];
+    const char *cmds[4];
+    int ncmds = 0;
+
+    cmds[ncmds++] = "RESET";
+    snprintf(keyline, DIM(keyline), "SIGKEY %s", keygrip);
+    cmds[ncmds++] = keyline;
+    if (desc) {
+      snprintf(descline, DIM(descline), "SETKEYDESC %s", desc);
+      cmds[ncmds++] = descline;
+    }
+    snprintf(line, sizeof line, "SETHASH %d ", digestalgo);
+    bin2hex(digest, digestlen, line + strlen(line));
+    cmds[ncmds++] = line;
 
-  if (desc) {
-    snprintf(line, DIM(line), "SETKEYDESC %s", desc);
-    err = assuan_transact(agent_ctx, line, NULL, NULL, NULL, NULL, NULL, NULL);
+    err = assuan_transact_pipelined(agent_ctx, cmds, ncmds, NULL, NULL, NULL);
     if (err) return err;
   }
 
-  snprintf(line, sizeof line, "SETHASH %d ", digestalgo);
-  bin2hex(digest, digestlen, line + strlen(line));
-  err = assuan_transact(agent_ctx, line, NULL, NULL, NULL, NULL, NULL, NULL);
-  if (err) return err;
-
   init_membuf(&data, 1024);
 
   snprintf(line, sizeof line, "PKSIGN%s%s", cache_nonce ? " -- " : "",
@@ -1469,16 +1597,20 @@ gpg_error_t agent_pkdecrypt(ctrl_t ctrl, const char *keygrip, const char *desc,
   if (err) return err;
   dfltparm.ctx = agent_ctx;
 
-  err = assuan_transact(agent_ctx, "RESET", NULL, NULL, NULL, NULL, NULL, NULL);
-  if (err) return err;
-
-  snprintf(line, sizeof line, "SETKEY %s", keygrip);
-  err = assuan_transact(agent_ctx, line, NULL, NULL, NULL, NULL, NULL, NULL);
-  if (err) return err;
+  {
+    char keyline[50];
+    const char *cmds[3];
+    int ncmds = 0;
+
+    cmds[ncmds++] = "RESET";
+    snprintf(keyline, sizeof keyline, "SETKEY %s", keygrip);
+    cmds[ncmds++] = keyline;
+    if (desc) {
+      snprintf(line, DIM(line), "SETKEYDESC %s", desc);
+      cmds[ncmds++] = line;
+    }
 
-  if (desc) {
-    snprintf(line, DIM(line), "SETKEYDESC %s", desc);
-    err = assuan_transact(agent_ctx, line, NULL, NULL, NULL, NULL, NULL, NULL);
+    err = assuan_transact_pipelined(agent_ctx, cmds, ncmds, NULL, NULL, NULL);
     if (err) return err;
   }
 
@@ -1581,6 +1713,7 @@ gpg_error_t agent_import_key(ctrl_t ctrl, const char *desc,
            cache_nonce_addr && *cache_nonce_addr ? *cache_nonce_addr : "");
   cn_parm.cache_nonce_addr = cache_nonce_addr;
   cn_parm.passwd_nonce_addr = NULL;
+  agent_flush_seckey_cache();
   err = assuan_transact(agent_ctx, line, NULL, NULL, inq_import_key_parms,
                         &parm, cache_nonce_status_cb, &cn_parm);
   return err;
@@ -1669,6 +1802,7 @@ gpg_error_t agent_delete_key(ctrl_t ctrl, const char *hexkeygrip,
 
   snprintf(line, DIM(line), "DELETE_KEY%s %s", force ? " --force" : "",
            hexkeygrip);
+  agent_flush_seckey_cache();
   err = assuan_transact(agent_ctx, line, NULL, NULL, default_inq_cb, &dfltparm,
                         NULL, NULL);
   return err;
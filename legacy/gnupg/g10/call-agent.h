@@ -138,6 +138,13 @@ gpg_error_t agent_get_s2k_count(unsigned long *r_count);
    0 if the secret key is available. */
 gpg_error_t agent_probe_secret_key(ctrl_t ctrl, PKT_public_key *pk);
 
+/* Check for each of the public keys whether its secret key exists.  */
+gpg_error_t agent_probe_secret_keys(ctrl_t ctrl, PKT_public_key **pks,
+                                    int npks, gpg_error_t *r_errors);
+
+/* Forget the list of secret keys cached from the agent.  */
+void agent_flush_seckey_cache(void);
+
 /* Ask the agent whether a secret key is availabale for any of the
    keys (primary or sub) in KEYBLOCK.  Returns 0 if available.  */
 gpg_error_t agent_probe_any_secret_key(ctrl_t ctrl, kbnode_t keyblock);
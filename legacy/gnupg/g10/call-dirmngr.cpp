@@ -34,6 +34,7 @@
 #include "../common/keyserver.h"
 #include "../common/membuf.h"
 #include "../common/status.h"
+#include "../common/trace.h"
 #include "../common/util.h"
 #include "call-dirmngr.h"
 #include "gpg.h"
@@ -114,6 +115,7 @@ static gpg_error_t create_context(ctrl_t ctrl, assuan_context_t *r_ctx) {
   *r_ctx = NULL;
   err = start_new_dirmngr(&ctx, opt.verbose, DBG_IPC);
   if (err) return err;
+  trace_assuan_context(ctx, "dirmngr");
 
   char *line;
 
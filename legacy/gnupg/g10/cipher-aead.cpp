@@ -0,0 +1,496 @@
+/* cipher-aead.c - AEAD encryption filter
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * An AEAD encrypted data packet (RFC4880bis) carries the plaintext in
+ * chunks of 2^(chunkbyte+6) octets.  Each chunk is encrypted and
+ * authenticated on its own, with a nonce made from the starting IV
+ * and the chunk index, and is followed by its tag.  A final tag over
+ * no data, which also covers the total length, detects truncation at
+ * a chunk boundary.
+ *
+ * As the chunks are independent, they are handed to a pool of worker
+ * threads with an own cipher handle each.  The calling thread reads
+ * and writes the chunks in order and helps out when it has to wait
+ * for the oldest one.  The threads are only started once more than
+ * one chunk is in flight, so short messages are processed without.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <neopg/utils/workers.h>
+
+#include "../common/iobuf.h"
+#include "../common/status.h"
+#include "../common/util.h"
+#include "filter.h"
+#include "gpg.h"
+#include "main.h"
+#include "options.h"
+#include "packet.h"
+
+/* The number of chunks per thread which may be in flight, and an
+   upper bound for the memory used by them.  */
+#define AEAD_JOBS_PER_THREAD 2
+#define AEAD_MAX_IN_FLIGHT (64 * 1024 * 1024)
+
+/* A chunk.  BUF has room for a full chunk and two tags.  */
+struct aead_job_s {
+  byte *buf;
+  size_t len; /* The data, including the tag when decrypting.  */
+  uint64_t index;
+  gpg_error_t err;
+  int done;
+};
+
+struct aead_chunks_s {
+  int decrypt;
+  DEK *dek;
+  byte cipher_algo;
+  byte aead_algo;
+  byte chunkbyte;
+  enum gcry_cipher_modes mode;
+  unsigned int ivlen;
+  byte iv[16];
+  size_t chunksize;
+  gcry_cipher_hd_t hd; /* The handle of the calling thread.  */
+  uint64_t total;      /* The plaintext octets submitted so far.  */
+
+  std::vector<struct aead_job_s> jobs;
+  std::vector<std::thread> threads;
+  int nthreads; /* The number of threads to start.  */
+  std::mutex lock;
+  std::condition_variable work_cv, done_cv;
+  uint64_t head; /* The next job to take.  */
+  uint64_t next; /* The next job to run.  */
+  uint64_t tail; /* The next job to fill.  */
+  int finished;
+};
+
+/* Open a cipher handle for AC and set the key.  A weak key is not
+   an error here.  */
+static gpg_error_t aead_open(aead_chunks_t ac, gcry_cipher_hd_t *r_hd) {
+  gpg_error_t err;
+
+  err = openpgp_cipher_open(r_hd, ac->cipher_algo, ac->mode,
+                            GCRY_CIPHER_SECURE);
+  if (err) {
+    *r_hd = NULL;
+    return err;
+  }
+  err = gcry_cipher_setkey(*r_hd, ac->dek->key, ac->dek->keylen);
+  if (err && err != GPG_ERR_WEAK_KEY) {
+    gcry_cipher_close(*r_hd);
+    *r_hd = NULL;
+  }
+  return err;
+}
+
+/* Compute the nonce and the associated data for the chunk INDEX.
+   The nonce is the IV with the big-endian index xor-ed into its low
+   eight octets.  AD must have room for 13 octets.  */
+static void aead_nonce(aead_chunks_t ac, uint64_t index, byte *nonce,
+                       byte *ad) {
+  int i;
+
+  memcpy(nonce, ac->iv, ac->ivlen);
+  for (i = 0; i < 8; i++) nonce[ac->ivlen - 1 - i] ^= (byte)(index >> (8 * i));
+
+  ad[0] = 0xc0 | PKT_ENCRYPTED_AEAD;
+  ad[1] = 1; /* version */
+  ad[2] = ac->cipher_algo;
+  ad[3] = ac->aead_algo;
+  ad[4] = ac->chunkbyte;
+  for (i = 0; i < 8; i++) ad[5 + i] = (byte)(index >> (56 - 8 * i));
+}
+
+/* En- or decrypt the LEN octets at BUF in place as chunk INDEX using
+   HD, with additional data beyond the chunk's octets in EXTRA.  The
+   tag is written to or checked against TAG.  This runs on any
+   thread.  */
+static gpg_error_t aead_crypt(aead_chunks_t ac, gcry_cipher_hd_t hd,
+                              uint64_t index, byte *buf, size_t len,
+                              const byte *extra, size_t extralen, byte *tag) {
+  byte nonce[16], ad[13];
+  gpg_error_t err;
+
+  aead_nonce(ac, index, nonce, ad);
+  err = gcry_cipher_setiv(hd, nonce, ac->ivlen);
+  if (!err) err = gcry_cipher_authenticate(hd, ad, sizeof ad);
+  if (!err && extralen) err = gcry_cipher_authenticate(hd, extra, extralen);
+  if (!err) err = gcry_cipher_final(hd);
+  if (err)
+    ;
+  else if (ac->decrypt) {
+    err = gcry_cipher_decrypt(hd, buf, len, NULL, 0);
+    if (!err) err = gcry_cipher_checktag(hd, tag, AEAD_TAG_LEN);
+    if (err == GPG_ERR_CHECKSUM) err = GPG_ERR_BAD_SIGNATURE;
+  } else {
+    err = gcry_cipher_encrypt(hd, buf, len, NULL, 0);
+    if (!err) err = gcry_cipher_gettag(hd, tag, AEAD_TAG_LEN);
+  }
+  return err;
+}
+
+/* Process JOB using HD.  */
+static gpg_error_t aead_job_run(aead_chunks_t ac, gcry_cipher_hd_t hd,
+                                struct aead_job_s *job) {
+  size_t len = ac->decrypt ? job->len - AEAD_TAG_LEN : job->len;
+
+  return aead_crypt(ac, hd, job->index, job->buf, len, NULL, 0,
+                    job->buf + len);
+}
+
+static void aead_worker(aead_chunks_t ac) {
+  gcry_cipher_hd_t hd;
+  struct aead_job_s *job;
+  gpg_error_t err;
+
+  err = aead_open(ac, &hd);
+  if (!hd) {
+    log_debug("aead: can't open cipher for worker: %s\n", gpg_strerror(err));
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> guard(ac->lock);
+
+    for (;;) {
+      ac->work_cv.wait(guard,
+                       [ac] { return ac->next < ac->tail || ac->finished; });
+      if (ac->finished) break;
+      job = &ac->jobs[ac->next++ % ac->jobs.size()];
+      guard.unlock();
+      err = aead_job_run(ac, hd, job);
+      guard.lock();
+      job->err = err;
+      job->done = 1;
+      ac->done_cv.notify_all();
+    }
+  }
+
+  gcry_cipher_close(hd);
+}
+
+/* Create a chunk engine for an AEAD encrypted data packet using the
+   key from DEK, which must stay valid until the engine is released.
+   CIPHER_ALGO, AEAD_ALGO and CHUNKBYTE are the values from the packet
+   header, IV is the starting IV.  If DECRYPT is set, the chunks are
+   authenticated and decrypted, otherwise encrypted.  */
+gpg_error_t aead_chunks_new(aead_chunks_t *r_ac, int decrypt, DEK *dek,
+                            int cipher_algo, int aead_algo, int chunkbyte,
+                            const byte *iv) {
+  aead_chunks_t ac = NULL;
+  gpg_error_t err;
+  size_t njobs;
+  int nthreads;
+
+  *r_ac = NULL;
+  log_assert(chunkbyte >= 0 && chunkbyte <= AEAD_MAX_CHUNK_BYTE);
+
+  try {
+    ac = new struct aead_chunks_s();
+  } catch (const std::exception &) {
+    return GPG_ERR_ENOMEM;
+  }
+  ac->decrypt = decrypt;
+  ac->dek = dek;
+  ac->cipher_algo = cipher_algo;
+  ac->aead_algo = aead_algo;
+  ac->chunkbyte = chunkbyte;
+  ac->chunksize = (size_t)1 << (chunkbyte + 6);
+  err = openpgp_aead_test_algo((aead_algo_t)aead_algo, &ac->mode, &ac->ivlen);
+  if (err) goto leave;
+  memcpy(ac->iv, iv, ac->ivlen);
+
+  err = aead_open(ac, &ac->hd);
+  if (err == GPG_ERR_WEAK_KEY) {
+    log_info(
+        _("WARNING: message was encrypted with"
+          " a weak key in the symmetric cipher.\n"));
+    err = 0;
+  } else if (err) {
+    log_error("key setup failed: %s\n", gpg_strerror(err));
+    goto leave;
+  }
+
+  nthreads = NeoPG::hardware_threads();
+  njobs = nthreads * AEAD_JOBS_PER_THREAD;
+  if (njobs > AEAD_MAX_IN_FLIGHT / ac->chunksize)
+    njobs = AEAD_MAX_IN_FLIGHT / ac->chunksize;
+  if (njobs < 2) njobs = 2;
+  if ((size_t)nthreads > njobs) nthreads = njobs;
+  ac->nthreads = nthreads;
+
+  try {
+    ac->jobs.resize(njobs);
+  } catch (const std::exception &) {
+    err = GPG_ERR_ENOMEM;
+  }
+
+leave:
+  if (err)
+    aead_chunks_release(ac);
+  else
+    *r_ac = ac;
+  return err;
+}
+
+/* Stop the threads of AC and release it.  Pending chunks are
+   discarded.  */
+void aead_chunks_release(aead_chunks_t ac) {
+  if (!ac) return;
+
+  {
+    std::lock_guard<std::mutex> guard(ac->lock);
+    ac->finished = 1;
+  }
+  ac->work_cv.notify_all();
+  for (auto &t : ac->threads) t.join();
+
+  for (auto &job : ac->jobs) xfree(job.buf);
+  gcry_cipher_close(ac->hd);
+  delete ac;
+}
+
+/* Return the chunk size of AC.  */
+size_t aead_chunks_size(aead_chunks_t ac) { return ac->chunksize; }
+
+/* Return the number of chunks submitted to AC but not yet popped.  */
+size_t aead_chunks_pending(aead_chunks_t ac) { return ac->tail - ac->head; }
+
+/* Return true if no more chunks can be submitted to AC before the
+   oldest one has been taken and popped.  */
+int aead_chunks_full(aead_chunks_t ac) {
+  return ac->tail - ac->head == ac->jobs.size();
+}
+
+/* Return the buffer for the next chunk of AC, which has room for the
+   chunk size plus two tags, or NULL if out of core.  AC must not be
+   full.  */
+byte *aead_chunks_buffer(aead_chunks_t ac) {
+  struct aead_job_s *job = &ac->jobs[ac->tail % ac->jobs.size()];
+
+  log_assert(!aead_chunks_full(ac));
+  if (!job->buf)
+    job->buf = (byte *)xtrymalloc(ac->chunksize + 2 * AEAD_TAG_LEN);
+  return job->buf;
+}
+
+/* Queue the next chunk of AC, whose LEN octets have been stored in
+   the buffer returned by aead_chunks_buffer.  When decrypting, LEN
+   includes the tag.  */
+void aead_chunks_submit(aead_chunks_t ac, size_t len) {
+  struct aead_job_s *job = &ac->jobs[ac->tail % ac->jobs.size()];
+
+  log_assert(len <= ac->chunksize + (ac->decrypt ? AEAD_TAG_LEN : 0));
+  log_assert(!ac->decrypt || len >= AEAD_TAG_LEN);
+  job->len = len;
+  job->index = ac->tail;
+  job->err = 0;
+  job->done = 0;
+  ac->total += ac->decrypt ? len - AEAD_TAG_LEN : len;
+
+  {
+    std::lock_guard<std::mutex> guard(ac->lock);
+    ac->tail++;
+  }
+
+  if (ac->threads.empty() && ac->tail - ac->head > 1 && ac->nthreads) {
+    /* If a thread can't be created, the calling thread does more of
+       the work.  */
+    NeoPG::start_threads(ac->threads, ac->nthreads,
+                         [ac]() { aead_worker(ac); });
+    ac->nthreads = 0;
+  }
+  ac->work_cv.notify_one();
+}
+
+/* Wait for the oldest pending chunk of AC and store a pointer to its
+   output at R_BUF and the length at R_LEN.  That is the ciphertext
+   followed by the tag when encrypting, and the plaintext when
+   decrypting.  The buffer stays valid until aead_chunks_pop.  If the
+   chunk failed to authenticate, GPG_ERR_BAD_SIGNATURE is returned; its
+   output must then not be used.  */
+gpg_error_t aead_chunks_take(aead_chunks_t ac, byte **r_buf, size_t *r_len) {
+  struct aead_job_s *job = &ac->jobs[ac->head % ac->jobs.size()];
+  struct aead_job_s *own;
+  gpg_error_t err;
+
+  log_assert(ac->head < ac->tail);
+
+  {
+    std::unique_lock<std::mutex> guard(ac->lock);
+
+    while (!job->done) {
+      if (ac->next < ac->tail) {
+        own = &ac->jobs[ac->next++ % ac->jobs.size()];
+        guard.unlock();
+        err = aead_job_run(ac, ac->hd, own);
+        guard.lock();
+        own->err = err;
+        own->done = 1;
+      } else
+        ac->done_cv.wait(guard, [job] { return job->done; });
+    }
+  }
+
+  *r_buf = job->buf;
+  *r_len =
+      ac->decrypt ? job->len - AEAD_TAG_LEN : job->len + AEAD_TAG_LEN;
+  return job->err;
+}
+
+/* Release the oldest chunk of AC, which has been taken.  */
+void aead_chunks_pop(aead_chunks_t ac) {
+  log_assert(ac->head < ac->tail);
+  ac->head++;
+}
+
+/* Compute the final tag of AC into TAG or, when decrypting, check
+   TAG.  All chunks must have been submitted.  */
+gpg_error_t aead_chunks_final(aead_chunks_t ac, byte *tag) {
+  byte total[8], dummy[1];
+  int i;
+
+  for (i = 0; i < 8; i++) total[i] = (byte)(ac->total >> (56 - 8 * i));
+  return aead_crypt(ac, ac->hd, ac->tail, dummy, 0, total, sizeof total, tag);
+}
+
+/* Write the header of the AEAD encrypted data packet and the IV to A
+   and set up the chunk engine of CFX.  */
+static gpg_error_t write_header(cipher_filter_context_t *cfx, IOBUF a) {
+  gpg_error_t err;
+  PACKET pkt;
+  PKT_encrypted ed;
+  byte iv[16];
+  unsigned int ivlen;
+
+  memset(&ed, 0, sizeof ed);
+  ed.new_ctb = 1;
+  ed.cipher_algo = cfx->dek->algo;
+  ed.aead_algo = cfx->aead_algo;
+  ed.chunkbyte = opt.chunk_size - 6;
+  if (openpgp_aead_test_algo((aead_algo_t)ed.aead_algo, NULL, &ivlen) ||
+      ed.chunkbyte > AEAD_MAX_CHUNK_BYTE)
+    BUG(); /* Checked by the caller.  */
+
+  {
+    char buf[20];
+
+    snprintf(buf, sizeof buf, "0 %d %d", cfx->dek->algo, ed.aead_algo);
+    write_status_text(STATUS_BEGIN_ENCRYPTION, buf);
+  }
+
+  init_packet(&pkt);
+  pkt.pkttype = PKT_ENCRYPTED_AEAD;
+  pkt.pkt.encrypted = &ed;
+  if (build_packet(a, &pkt)) log_bug("build_packet(ENCR_DATA) failed\n");
+  gcry_randomize(iv, ivlen);
+  print_cipher_algo_note((cipher_algo_t)(cfx->dek->algo));
+
+  err = aead_chunks_new(&cfx->aead, 0, cfx->dek, ed.cipher_algo,
+                        ed.aead_algo, ed.chunkbyte, iv);
+  if (err) return err;
+  cfx->header = 1;
+  return iobuf_write(a, iv, ivlen);
+}
+
+/* Write the oldest chunk of CFX to A.  */
+static gpg_error_t write_chunk(cipher_filter_context_t *cfx, IOBUF a) {
+  gpg_error_t err;
+  byte *buf;
+  size_t len;
+
+  err = aead_chunks_take(cfx->aead, &buf, &len);
+  if (err)
+    log_error("AEAD encryption failed: %s\n", gpg_strerror(err));
+  else
+    err = iobuf_write(a, buf, len);
+  aead_chunks_pop(cfx->aead);
+  return err;
+}
+
+/****************
+ * This filter is used to encrypt data into an AEAD encrypted data
+ * packet.  CFX->AEAD_ALGO must be set.
+ */
+int cipher_filter_aead(void *opaque, int control, IOBUF a, byte *buf,
+                       size_t *ret_len) {
+  size_t size = *ret_len;
+  cipher_filter_context_t *cfx = (cipher_filter_context_t *)opaque;
+  int rc = 0;
+
+  if (control == IOBUFCTRL_UNDERFLOW) {    /* decrypt */
+    rc = -1;                               /* not used */
+  } else if (control == IOBUFCTRL_FLUSH) { /* encrypt */
+    size_t chunksize, n;
+    byte *p;
+
+    log_assert(a);
+    if (!cfx->header && (rc = write_header(cfx, a))) return rc;
+    chunksize = aead_chunks_size(cfx->aead);
+    while (size) {
+      if (!cfx->aead_fill && aead_chunks_full(cfx->aead) &&
+          (rc = write_chunk(cfx, a)))
+        break;
+      if (!(p = aead_chunks_buffer(cfx->aead))) {
+        rc = gpg_error_from_syserror();
+        break;
+      }
+      n = chunksize - cfx->aead_fill;
+      if (n > size) n = size;
+      memcpy(p + cfx->aead_fill, buf, n);
+      cfx->aead_fill += n;
+      buf += n;
+      size -= n;
+      if (cfx->aead_fill == chunksize) {
+        aead_chunks_submit(cfx->aead, chunksize);
+        cfx->aead_fill = 0;
+      }
+    }
+  } else if (control == IOBUFCTRL_FREE) {
+    if (cfx->aead) {
+      byte tag[AEAD_TAG_LEN];
+
+      if (cfx->aead_fill) {
+        aead_chunks_submit(cfx->aead, cfx->aead_fill);
+        cfx->aead_fill = 0;
+      }
+      while (!rc && aead_chunks_pending(cfx->aead))
+        rc = write_chunk(cfx, a);
+      if (!rc) rc = aead_chunks_final(cfx->aead, tag);
+      if (!rc) rc = iobuf_write(a, tag, AEAD_TAG_LEN);
+      if (rc) log_error("writing final AEAD tag failed\n");
+      aead_chunks_release(cfx->aead);
+      cfx->aead = NULL;
+    }
+  } else if (control == IOBUFCTRL_DESC) {
+    mem2str((char *)(buf), "cipher_filter_aead", *ret_len);
+  }
+  return rc;
+}
@@ -103,12 +103,17 @@ int cipher_filter(void *opaque, int control, IOBUF a, byte *buf,
   if (control == IOBUFCTRL_UNDERFLOW) {    /* decrypt */
     rc = -1;                               /* not yet used */
   } else if (control == IOBUFCTRL_FLUSH) { /* encrypt */
+    size_t off, n;
+
     log_assert(a);
     if (!cfx->header) {
       write_header(cfx, a);
     }
-    if (cfx->mdc_hash) cfx->mdc_hash->update(buf, size);
-    gcry_cipher_encrypt(cfx->cipher_hd, buf, size, NULL, 0);
+    for (off = 0; off < size; off += n) {
+      n = size - off < CIPHER_CHUNK_SIZE ? size - off : CIPHER_CHUNK_SIZE;
+      if (cfx->mdc_hash) cfx->mdc_hash->update(buf + off, n);
+      gcry_cipher_encrypt(cfx->cipher_hd, buf + off, n, NULL, 0);
+    }
     rc = iobuf_write(a, buf, size);
   } else if (control == IOBUFCTRL_FREE) {
     if (cfx->mdc_hash) {
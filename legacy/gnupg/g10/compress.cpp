@@ -31,11 +31,18 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <condition_variable>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <botan/compression.h>
 
+#include <neopg/utils/workers.h>
+
 #include "../common/util.h"
 #include "filter.h"
 #include "gpg.h"
@@ -47,47 +54,347 @@ const std::map<int, std::string> algo_to_spec{{COMPRESS_ALGO_ZIP, "deflate"},
                                               {COMPRESS_ALGO_ZLIB, "zlib"},
                                               {COMPRESS_ALGO_BZIP2, "bz2"}};
 
+/* The amount of compressed data read from the underlying iobuf per
+   decompression step.  */
+#define COMPRESS_INBUF_SIZE 8192
+
+/* With --compress-threads, ZIP and ZLIB data is compressed in blocks
+   of this size, and this many blocks per thread may be in flight.  */
+#define COMPRESS_BLOCK_SIZE (128 * 1024)
+#define COMPRESS_JOBS_PER_THREAD 2
+
+/* A block for parallel compression.  BUF holds the plaintext until
+   the job is done, and the compressed data after that.  */
+struct compress_job_s {
+  Botan::secure_vector<uint8_t> buf;
+  size_t len;     /* The length of the plaintext.  */
+  uint32_t adler; /* The Adler-32 checksum of the plaintext.  */
+  int last;
+  int failed;
+  int done;
+};
+
+/* The state of a compress filter as stored in ZFX->OPAQUE.  BUF is
+   used for all calls: Botan's update swaps it with its own buffer,
+   so once both have grown to the working size no further secure
+   memory is allocated.  While decompressing, the data in BUF before
+   POS has already been returned.
+
+   If JOBS is not empty, the data is compressed in parallel instead.
+   The blocks between HEAD and TAIL are in flight, those before NEXT
+   are taken or being worked on, and the one at TAIL is being
+   filled.  */
+struct compress_state_s {
+  std::unique_ptr<Botan::Compression_Algorithm> compressor;
+  std::unique_ptr<Botan::Decompression_Algorithm> decompressor;
+  Botan::secure_vector<uint8_t> buf;
+  size_t pos;
+  int eof;
+  size_t level;
+
+  int algo;
+  std::vector<struct compress_job_s> jobs;
+  std::vector<std::thread> threads;
+  int nthreads; /* The number of threads to start.  */
+  std::mutex lock;
+  std::condition_variable work_cv, done_cv;
+  uint64_t head;
+  uint64_t next;
+  uint64_t tail;
+  int finished;
+  uint32_t adler; /* The Adler-32 checksum of the blocks written.  */
+};
+
+/* Return the compression level to pass to Botan.  Zero selects the
+   library default.  */
+static size_t compress_level(void) {
+  if (opt.compress_level >= 1 && opt.compress_level <= 9)
+    return opt.compress_level;
+  if (opt.compress_level != -1)
+    log_error("invalid compression level; using default level\n");
+  return 0;
+}
+
+/* Return the number of threads to compress ALGO with.  Independently
+   compressed blocks can be joined into one deflate stream.  Bzip2
+   streams could only be concatenated, which not every OpenPGP
+   implementation accepts.  */
+static int compress_threads(int algo) {
+  int n;
+
+  if (algo != COMPRESS_ALGO_ZIP && algo != COMPRESS_ALGO_ZLIB) return 1;
+  n = opt.compress_threads;
+  if (!n) n = NeoPG::hardware_threads();
+  return n > 1 ? n : 1;
+}
+
+#define ADLER_BASE 65521
+
+/* Update the Adler-32 checksum ADLER with LEN octets at BUF.  */
+static uint32_t adler32_update(uint32_t adler, const byte *buf, size_t len) {
+  uint32_t s1 = adler & 0xffff;
+  uint32_t s2 = adler >> 16;
+  size_t n;
+
+  while (len) {
+    /* The largest N for which S2 can not overflow.  */
+    n = len < 5552 ? len : 5552;
+    len -= n;
+    while (n--) {
+      s1 += *buf++;
+      s2 += s1;
+    }
+    s1 %= ADLER_BASE;
+    s2 %= ADLER_BASE;
+  }
+  return (s2 << 16) | s1;
+}
+
+/* Return the Adler-32 checksum of two pieces of data from their
+   checksums ADLER1 and ADLER2 and the length LEN2 of the second.
+   This is adler32_combine from zlib.  */
+static uint32_t adler32_combine(uint32_t adler1, uint32_t adler2,
+                                uint64_t len2) {
+  uint32_t rem = len2 % ADLER_BASE;
+  uint32_t s1 = adler1 & 0xffff;
+  uint32_t s2 = (rem * s1) % ADLER_BASE;
+
+  s1 += (adler2 & 0xffff) + ADLER_BASE - 1;
+  s2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - rem;
+  if (s1 >= ADLER_BASE) s1 -= ADLER_BASE;
+  if (s1 >= ADLER_BASE) s1 -= ADLER_BASE;
+  if (s2 >= 2 * ADLER_BASE) s2 -= 2 * ADLER_BASE;
+  if (s2 >= ADLER_BASE) s2 -= ADLER_BASE;
+  return (s2 << 16) | s1;
+}
+
+/* Compress JOB of ST with the raw deflate compressor C.  Each block
+   is a deflate stream of its own.  All but the last one end with a
+   sync flush instead of a final block, so that their concatenation
+   is a single valid deflate stream.  This runs on any thread.  */
+static void compress_job_run(struct compress_state_s *st,
+                             Botan::Compression_Algorithm *c,
+                             struct compress_job_s *job) {
+  job->len = job->buf.size();
+  job->adler = adler32_update(1, job->buf.data(), job->len);
+  try {
+    c->start(st->level);
+    if (job->last)
+      c->finish(job->buf);
+    else
+      c->update(job->buf, 0, true);
+  } catch (const std::exception &) {
+    job->failed = 1;
+  }
+}
+
+static void compress_worker(struct compress_state_s *st) {
+  std::unique_ptr<Botan::Compression_Algorithm> c;
+  struct compress_job_s *job;
+
+  try {
+    c.reset(Botan::make_compressor("deflate"));
+  } catch (const std::exception &) {
+  }
+  if (!c) {
+    log_debug("compress: can't create compressor for worker\n");
+    return;
+  }
+
+  std::unique_lock<std::mutex> guard(st->lock);
+  for (;;) {
+    st->work_cv.wait(guard,
+                     [st] { return st->next < st->tail || st->finished; });
+    if (st->finished) break;
+    job = &st->jobs[st->next++ % st->jobs.size()];
+    guard.unlock();
+    compress_job_run(st, c.get(), job);
+    guard.lock();
+    job->done = 1;
+    st->done_cv.notify_all();
+  }
+}
+
+/* Set up ST for compressing ALGO on NTHREADS threads and write the
+   zlib header to A if needed.  */
+static int parallel_start(struct compress_state_s *st, int algo,
+                          int nthreads, IOBUF a) {
+  st->algo = algo;
+  st->adler = 1;
+  st->nthreads = nthreads;
+  st->compressor.reset(Botan::make_compressor("deflate"));
+  st->jobs.resize(nthreads * COMPRESS_JOBS_PER_THREAD);
+  for (auto &job : st->jobs) job.buf.reserve(COMPRESS_BLOCK_SIZE);
+
+  if (algo == COMPRESS_ALGO_ZLIB) {
+    byte hdr[2];
+    int flevel;
+
+    /* A 32k window with deflate, and the level as a hint.  */
+    if (st->level == 1)
+      flevel = 0;
+    else if (st->level >= 2 && st->level <= 5)
+      flevel = 1;
+    else if (st->level >= 7)
+      flevel = 3;
+    else
+      flevel = 2;
+    hdr[0] = 0x78;
+    hdr[1] = flevel << 6;
+    hdr[1] += 31 - ((hdr[0] << 8) + hdr[1]) % 31;
+    return iobuf_write(a, hdr, 2);
+  }
+  return 0;
+}
+
+/* Queue the block being filled in ST.  LAST marks the final one.  */
+static void parallel_submit(struct compress_state_s *st, int last) {
+  struct compress_job_s *job = &st->jobs[st->tail % st->jobs.size()];
+
+  job->last = last;
+  job->failed = 0;
+  job->done = 0;
+  {
+    std::lock_guard<std::mutex> guard(st->lock);
+    st->tail++;
+  }
+
+  if (st->threads.empty() && st->tail - st->head > 1 && st->nthreads) {
+    /* If a thread can't be created, the calling thread does more of
+       the work.  */
+    NeoPG::start_threads(st->threads, st->nthreads,
+                         [st]() { compress_worker(st); });
+    st->nthreads = 0;
+  }
+  st->work_cv.notify_one();
+}
+
+/* Wait for the oldest block in flight in ST, helping with the
+   others meanwhile, and write it to A.  */
+static int parallel_take(struct compress_state_s *st, IOBUF a) {
+  struct compress_job_s *job = &st->jobs[st->head % st->jobs.size()];
+  struct compress_job_s *own;
+  int rc;
+
+  {
+    std::unique_lock<std::mutex> guard(st->lock);
+
+    while (!job->done) {
+      if (st->next < st->tail) {
+        own = &st->jobs[st->next++ % st->jobs.size()];
+        guard.unlock();
+        compress_job_run(st, st->compressor.get(), own);
+        guard.lock();
+        own->done = 1;
+      } else
+        st->done_cv.wait(guard, [job] { return job->done; });
+    }
+  }
+
+  if (job->failed) {
+    log_error("compressing a block failed\n");
+    return GPG_ERR_INTERNAL;
+  }
+  st->adler = adler32_combine(st->adler, job->adler, job->len);
+  rc = iobuf_write(a, job->buf.data(), job->buf.size());
+  job->buf.clear();
+  st->head++;
+  return rc;
+}
+
+/* Add the SIZE octets at BUF to the blocks of ST and write the
+   blocks done to A.  */
+static int parallel_write(struct compress_state_s *st, IOBUF a,
+                          const byte *buf, size_t size) {
+  struct compress_job_s *job;
+  size_t n;
+  int rc;
+
+  while (size) {
+    if (st->tail - st->head == st->jobs.size() && (rc = parallel_take(st, a)))
+      return rc;
+    job = &st->jobs[st->tail % st->jobs.size()];
+    n = std::min(size, COMPRESS_BLOCK_SIZE - job->buf.size());
+    job->buf.insert(job->buf.end(), buf, buf + n);
+    buf += n;
+    size -= n;
+    if (job->buf.size() == COMPRESS_BLOCK_SIZE) parallel_submit(st, 0);
+  }
+  return 0;
+}
+
+/* Compress the last block of ST and write the rest of the data and
+   the zlib trailer to A.  */
+static int parallel_finish(struct compress_state_s *st, IOBUF a) {
+  byte trailer[4];
+  int rc;
+
+  if (st->tail - st->head == st->jobs.size() && (rc = parallel_take(st, a)))
+    return rc;
+  parallel_submit(st, 1);
+  while (st->head < st->tail)
+    if ((rc = parallel_take(st, a))) return rc;
+
+  if (st->algo == COMPRESS_ALGO_ZLIB) {
+    trailer[0] = st->adler >> 24;
+    trailer[1] = st->adler >> 16;
+    trailer[2] = st->adler >> 8;
+    trailer[3] = st->adler;
+    return iobuf_write(a, trailer, 4);
+  }
+  return 0;
+}
+
+/* Stop the threads of ST and release it.  */
+static void release_state(struct compress_state_s *st) {
+  {
+    std::lock_guard<std::mutex> guard(st->lock);
+    st->finished = 1;
+  }
+  st->work_cv.notify_all();
+  for (auto &t : st->threads) t.join();
+  delete st;
+}
+
 int compress_filter(void *opaque, int control, IOBUF a, byte *buf,
                     size_t *ret_len) {
   size_t size = *ret_len;
   compress_filter_context_t *zfx = (compress_filter_context_t *)opaque;
+  struct compress_state_s *st = (struct compress_state_s *)zfx->opaque;
   int rc = 0;
+  int nthreads;
 
   if (control == IOBUFCTRL_UNDERFLOW) {
     if (!zfx->status) {
       /* We just found out we are used as a decompressor.  */
-      std::string algo = algo_to_spec.at(zfx->algo);
-      auto decompressor = Botan::make_decompressor(algo);
-      auto input = new Botan::secure_vector<uint8_t>;
-      zfx->opaque =
-          new std::pair<Botan::Decompression_Algorithm *,
-                        Botan::secure_vector<uint8_t> *>(decompressor, input);
-      decompressor->start();
+      st = new compress_state_s();
+      st->decompressor.reset(
+          Botan::make_decompressor(algo_to_spec.at(zfx->algo)));
+      st->decompressor->start();
+      st->buf.reserve(COMPRESS_INBUF_SIZE);
+      zfx->opaque = st;
       zfx->status = 1;
     }
-    auto *opaque_ = (std::pair<Botan::Decompression_Algorithm *,
-                               Botan::secure_vector<uint8_t> *> *)zfx->opaque;
-    auto decompressor = opaque_->first;
-    auto input = opaque_->second;
-    while (input->empty() && decompressor) {
-      input->resize(2048);
-      int nread = iobuf_read(a, input->data(), input->size());
+    while (st->pos == st->buf.size() && !st->eof) {
+      int nread;
+
+      st->buf.resize(COMPRESS_INBUF_SIZE);
+      st->pos = 0;
+      nread = iobuf_read(a, st->buf.data(), st->buf.size());
       if (nread <= 0) {
-        input->clear();
-        decompressor->finish(*input);
-        delete decompressor;
-        decompressor = nullptr;
-        opaque_->first = nullptr;
+        st->buf.clear();
+        st->decompressor->finish(st->buf);
+        st->eof = 1;
       } else {
-        input->resize(nread);
-        decompressor->update(*input);
+        st->buf.resize(nread);
+        st->decompressor->update(st->buf);
       }
     }
-    if (!input->empty()) {
-      size_t amount = std::min(input->size(), size);
-      memcpy(buf, input->data(), amount);
+    if (st->pos < st->buf.size()) {
+      size_t amount = std::min(st->buf.size() - st->pos, size);
+      memcpy(buf, st->buf.data() + st->pos, amount);
+      st->pos += amount;
       *ret_len = amount;
-      input->erase(input->begin(), input->begin() + amount);
     } else {
       *ret_len = 0;
       rc = -1;
@@ -105,49 +412,48 @@ int compress_filter(void *opaque, int control, IOBUF a, byte *buf,
       pkt.pkt.compressed = &cd;
       if (build_packet(a, &pkt))
         log_bug("build_packet(PKT_COMPRESSED) failed\n");
-      std::string algo = algo_to_spec.at(zfx->algo);
-      zfx->opaque = Botan::make_compressor(algo);
-      auto compression = (Botan::Compression_Algorithm *)zfx->opaque;
-      compression->start(0);  // compression level: default
+      nthreads = compress_threads(zfx->algo);
+      st = new compress_state_s();
+      st->level = compress_level();
+      zfx->opaque = st;
       zfx->status = 2;
+      if (nthreads > 1) {
+        if ((rc = parallel_start(st, zfx->algo, nthreads, a))) return rc;
+      } else {
+        st->compressor.reset(
+            Botan::make_compressor(algo_to_spec.at(zfx->algo)));
+        st->compressor->start(st->level);
+      }
     }
 
-    Botan::secure_vector<uint8_t> input(size);
-    memcpy(input.data(), buf, size);
-    auto compression = (Botan::Compression_Algorithm *)zfx->opaque;
-    compression->update(input, 0, false);
-    if ((rc = iobuf_write(a, input.data(), input.size()))) {
+    if (!st->jobs.empty()) return parallel_write(st, a, buf, size);
+    st->buf.assign(buf, buf + size);
+    st->compressor->update(st->buf, 0, false);
+    if ((rc = iobuf_write(a, st->buf.data(), st->buf.size()))) {
       log_debug("bzCompress: iobuf_write failed\n");
       return rc;
     }
   } else if (control == IOBUFCTRL_FREE) {
-    if (zfx->status == 1) {
-      auto opaque_ = (std::pair<Botan::Decompression_Algorithm *,
-                                Botan::secure_vector<uint8_t> *> *)zfx->opaque;
-      auto decompressor = opaque_->first;
-      auto input = opaque_->second;
-      if (decompressor) delete decompressor;
-      delete input;
-      delete opaque_;
-      zfx->opaque = NULL;
+    if (zfx->status == 2 && !st->jobs.empty()) {
+      /* The threads must be stopped even if writing failed.  */
+      rc = parallel_finish(st, a);
     } else if (zfx->status == 2) {
-      Botan::secure_vector<uint8_t> input;
-      auto compression = (Botan::Compression_Algorithm *)zfx->opaque;
-
-      compression->update(input, 0, true);
-      if ((rc = iobuf_write(a, input.data(), input.size()))) {
+      st->buf.clear();
+      st->compressor->update(st->buf, 0, true);
+      if ((rc = iobuf_write(a, st->buf.data(), st->buf.size()))) {
         log_debug("bzCompress: iobuf_write failed\n");
         return rc;
       }
 
-      input.clear();
-      compression->finish(input, 0);
-      if ((rc = iobuf_write(a, input.data(), input.size()))) {
+      st->buf.clear();
+      st->compressor->finish(st->buf, 0);
+      if ((rc = iobuf_write(a, st->buf.data(), st->buf.size()))) {
         log_debug("bzCompress: iobuf_write failed\n");
         return rc;
       }
-
-      delete compression;
+    }
+    if (zfx->status) {
+      release_state(st);
       zfx->opaque = NULL;
     }
     if (zfx->release) zfx->release(zfx);
@@ -36,12 +36,36 @@
 
 #include <botan/secmem.h>
 
+#include <chrono>
+#include <mutex>
+#include <string>
+
 #define CONTROL_D ('D' - 'A' + 1)
 
 /* The stream to output the status information.  Output is disabled if
    this is NULL.  */
 static estream_t statusfp;
 
+/* Status lines are not flushed one by one, because a client reading
+   a long key listing would otherwise get a write call for every
+   line.  Pending lines are flushed once STATUS_FLUSH_SIZE bytes have
+   accumulated or STATUS_FLUSH_INTERVAL milliseconds have passed since
+   the oldest of them was written, with a status line the client may
+   be waiting for (see status_wants_flush), and at exit.  */
+#define STATUS_FLUSH_SIZE 4096
+#define STATUS_FLUSH_INTERVAL 100
+
+/* Protects the line buffer and the pending state below.  */
+static std::mutex status_lock;
+
+/* The status line being built.  It is kept to reuse its buffer.  */
+static std::string status_line;
+
+/* The number of bytes written since the last flush and the time the
+   first of them was written.  */
+static size_t status_pending;
+static std::chrono::steady_clock::time_point status_pending_since;
+
 static void progress_cb(void *ctx, const char *what, int printchar, int current,
                         int total) {
   char buf[50];
@@ -83,11 +107,106 @@ static int status_currently_allowed(int no) {
   return 0; /* No. */
 }
 
+/* Return true if a status line NO must be flushed at once, because
+   the client is likely to wait for it before it does anything else,
+   or to show it to the user.  */
+static int status_wants_flush(int no) {
+  /* Log output goes to stderr, too, and must not overtake the status
+     lines.  */
+  if (statusfp == es_stderr) return 1;
+
+  switch (no) {
+    case STATUS_GET_BOOL:
+    case STATUS_GET_LINE:
+    case STATUS_GET_HIDDEN:
+    case STATUS_PROGRESS:
+    case STATUS_USERID_HINT:
+    case STATUS_NEED_PASSPHRASE:
+    case STATUS_NEED_PASSPHRASE_SYM:
+    case STATUS_NEED_PASSPHRASE_PIN:
+    case STATUS_PINENTRY_LAUNCHED:
+    case STATUS_INQUIRE_MAXLEN:
+    case STATUS_CARDCTRL:
+      return 1;
+    default:
+      break;
+  }
+  return 0;
+}
+
+/* Start a new status line with code NO in STATUS_LINE.  The caller
+   must hold STATUS_LOCK.  */
+static void status_line_begin(int no) {
+  status_line.assign("[GNUPG:] ");
+  status_line.append(get_status_string(no));
+}
+
+/* Append the printf style FORMAT to STATUS_LINE.  */
+static void status_line_vprintf(const char *format, va_list arg_ptr) {
+  size_t off = status_line.size();
+  size_t room = status_line.capacity() - off;
+  va_list arg_copy;
+  int n;
+
+  if (room < 128) room = 128;
+  status_line.resize(off + room);
+  va_copy(arg_copy, arg_ptr);
+  n = vsnprintf(&status_line[off], room, format, arg_ptr);
+  if (n >= 0 && (size_t)n >= room) {
+    status_line.resize(off + n + 1);
+    vsnprintf(&status_line[off], n + 1, format, arg_copy);
+  }
+  va_end(arg_copy);
+  status_line.resize(off + (n > 0 ? n : 0));
+}
+
+/* Flush the pending status lines.  The caller must hold STATUS_LOCK.
+   Returns true on a write error.  */
+static int status_flush_locked(void) {
+  status_pending = 0;
+  return !!es_fflush(statusfp);
+}
+
+/* Write out the line in STATUS_LINE for status code NO and flush
+   if required.  Releases STATUS_LOCK.  */
+static void status_line_end(int no, std::unique_lock<std::mutex> &lock) {
+  auto now = std::chrono::steady_clock::now();
+  int failed;
+
+  status_line.push_back('\n');
+  failed = es_fwrite(status_line.data(), status_line.size(), 1, statusfp) != 1;
+  if (!status_pending) status_pending_since = now;
+  status_pending += status_line.size();
+  if (failed || status_pending >= STATUS_FLUSH_SIZE ||
+      now - status_pending_since >=
+          std::chrono::milliseconds(STATUS_FLUSH_INTERVAL) ||
+      status_wants_flush(no))
+    failed |= status_flush_locked();
+  lock.unlock();
+
+  if (failed && opt.exit_on_status_write_error) g10_exit(0);
+}
+
+/* Flush all pending status lines.  This needs to be done when the
+   client might wait for them, for example before gpg blocks.  */
+void flush_status(void) {
+  int failed;
+
+  if (!statusfp) return;
+
+  std::unique_lock<std::mutex> lock(status_lock);
+  failed = status_pending ? status_flush_locked() : 0;
+  lock.unlock();
+
+  if (failed && opt.exit_on_status_write_error) g10_exit(0);
+}
+
 void set_status_fd(int fd) {
   static int last_fd = -1;
 
   if (fd != -1 && last_fd == fd) return;
 
+  flush_status();
   if (statusfp && statusfp != es_stdout && statusfp != es_stderr)
     es_fclose(statusfp);
   statusfp = NULL;
@@ -110,6 +229,17 @@ void set_status_fd(int fd) {
   gcry_set_progress_handler(progress_cb, NULL);
 }
 
+/* Write the status output to FP instead of a file descriptor.  This
+   is used in server mode, which forwards the status lines to the
+   client, when no status fd has been set.  FP is not closed by us;
+   call this with NULL before closing it.  */
+void set_status_stream(estream_t fp) {
+  flush_status();
+  statusfp = fp;
+
+  if (fp) gcry_set_progress_handler(progress_cb, NULL);
+}
+
 int is_status_enabled() { return !!statusfp; }
 
 void write_status(int no) { write_status_text(no, NULL); }
@@ -123,26 +253,27 @@ void write_status_strings(int no, const char *text, ...) {
   if (!statusfp || !status_currently_allowed(no))
     return; /* Not enabled or allowed. */
 
-  es_fputs("[GNUPG:] ", statusfp);
-  es_fputs(get_status_string(no), statusfp);
+  std::unique_lock<std::mutex> lock(status_lock);
+  status_line_begin(no);
   if (text) {
-    es_putc(' ', statusfp);
+    status_line.push_back(' ');
     va_start(arg_ptr, text);
     s = text;
     do {
-      for (; *s; s++) {
-        if (*s == '\n')
-          es_fputs("\\n", statusfp);
-        else if (*s == '\r')
-          es_fputs("\\r", statusfp);
-        else
-          es_fputc(*(const byte *)s, statusfp);
+      const char *start;
+
+      /* Append runs of plain characters in one go.  */
+      for (start = s; *s; s++) {
+        if (*s != '\n' && *s != '\r') continue;
+        status_line.append(start, s - start);
+        status_line.append(*s == '\n' ? "\\n" : "\\r");
+        start = s + 1;
       }
+      status_line.append(start, s - start);
     } while ((s = va_arg(arg_ptr, const char *)));
     va_end(arg_ptr);
   }
-  es_putc('\n', statusfp);
-  if (es_fflush(statusfp) && opt.exit_on_status_write_error) g10_exit(0);
+  status_line_end(no, lock);
 }
 
 void write_status_text(int no, const char *text) {
@@ -158,16 +289,15 @@ void write_status_printf(int no, const char *format, ...) {
   if (!statusfp || !status_currently_allowed(no))
     return; /* Not enabled or allowed. */
 
-  es_fputs("[GNUPG:] ", statusfp);
-  es_fputs(get_status_string(no), statusfp);
+  std::unique_lock<std::mutex> lock(status_lock);
+  status_line_begin(no);
   if (format) {
-    es_putc(' ', statusfp);
+    status_line.push_back(' ');
     va_start(arg_ptr, format);
-    es_vfprintf(statusfp, format, arg_ptr);
+    status_line_vprintf(format, arg_ptr);
     va_end(arg_ptr);
   }
-  es_putc('\n', statusfp);
-  if (es_fflush(statusfp) && opt.exit_on_status_write_error) g10_exit(0);
+  status_line_end(no, lock);
 }
 
 /* Write an ERROR status line using a full gpg-error error value.  */
@@ -175,9 +305,7 @@ void write_status_error(const char *where, gpg_error_t err) {
   if (!statusfp || !status_currently_allowed(STATUS_ERROR))
     return; /* Not enabled or allowed. */
 
-  es_fprintf(statusfp, "[GNUPG:] %s %s %u\n", get_status_string(STATUS_ERROR),
-             where, err);
-  if (es_fflush(statusfp) && opt.exit_on_status_write_error) g10_exit(0);
+  write_status_printf(STATUS_ERROR, "%s %u", where, err);
 }
 
 /* Same as above but outputs the error code only.  */
@@ -185,9 +313,7 @@ void write_status_errcode(const char *where, int errcode) {
   if (!statusfp || !status_currently_allowed(STATUS_ERROR))
     return; /* Not enabled or allowed. */
 
-  es_fprintf(statusfp, "[GNUPG:] %s %s %u\n", get_status_string(STATUS_ERROR),
-             where, errcode);
-  if (es_fflush(statusfp) && opt.exit_on_status_write_error) g10_exit(0);
+  write_status_printf(STATUS_ERROR, "%s %u", where, (unsigned int)errcode);
 }
 
 /* Write a FAILURE status line.  */
@@ -195,9 +321,7 @@ void write_status_failure(const char *where, gpg_error_t err) {
   if (!statusfp || !status_currently_allowed(STATUS_FAILURE))
     return; /* Not enabled or allowed. */
 
-  es_fprintf(statusfp, "[GNUPG:] %s %s %u\n", get_status_string(STATUS_FAILURE),
-             where, err);
-  if (es_fflush(statusfp) && opt.exit_on_status_write_error) g10_exit(0);
+  write_status_printf(STATUS_FAILURE, "%s %u", where, err);
 }
 
 /*
@@ -221,18 +345,22 @@ void write_status_text_and_buffer(int no, const char *string,
     wrap = 0;
   }
 
+  std::unique_lock<std::mutex> lock(status_lock);
+  status_line.clear();
   text = get_status_string(no);
   count = dowrap = first = 1;
   do {
     if (dowrap) {
-      es_fprintf(statusfp, "[GNUPG:] %s ", text);
+      status_line.append("[GNUPG:] ");
+      status_line.append(text);
+      status_line.push_back(' ');
       count = dowrap = 0;
       if (first && string) {
-        es_fputs(string, statusfp);
+        status_line.append(string);
         count += strlen(string);
         /* Make sure that there is a space after the string.  */
         if (*string && string[strlen(string) - 1] != ' ') {
-          es_putc(' ', statusfp);
+          status_line.push_back(' ');
           count++;
         }
       }
@@ -251,19 +379,22 @@ void write_status_text_and_buffer(int no, const char *string,
       s--;
       n++;
     }
-    if (s != buffer) es_fwrite(buffer, s - buffer, 1, statusfp);
+    if (s != buffer) status_line.append(buffer, s - buffer);
     if (esc) {
-      es_fprintf(statusfp, "%%%02X", *(const byte *)s);
+      static const char hexdigits[] = "0123456789ABCDEF";
+
+      status_line.push_back('%');
+      status_line.push_back(hexdigits[*(const byte *)s >> 4]);
+      status_line.push_back(hexdigits[*(const byte *)s & 15]);
       s++;
       n--;
     }
     buffer = s;
     len = n;
-    if (dowrap && len) es_putc('\n', statusfp);
+    if (dowrap && len) status_line.push_back('\n');
   } while (len);
 
-  es_putc('\n', statusfp);
-  if (es_fflush(statusfp) && opt.exit_on_status_write_error) g10_exit(0);
+  status_line_end(no, lock);
 }
 
 void write_status_buffer(int no, const char *buffer, size_t len, int wrap) {
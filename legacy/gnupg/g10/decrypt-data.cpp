@@ -30,10 +30,14 @@
 #include "../common/compliance.h"
 #include "../common/status.h"
 #include "../common/util.h"
+#include "filter.h"
 #include "gpg.h"
+#include "main.h"
 #include "options.h"
 #include "packet.h"
 
+static int aead_decode_filter(void *opaque, int control, IOBUF a, byte *buf,
+                              size_t *ret_len);
 static int mdc_decode_filter(void *opaque, int control, IOBUF a, byte *buf,
                              size_t *ret_len);
 static int decode_filter(void *opaque, int control, IOBUF a, byte *buf,
@@ -48,6 +52,19 @@ typedef struct decode_filter_context_s {
   int refcount;
   int partial;   /* Working on a partial length packet.  */
   size_t length; /* If !partial: Remaining bytes in the packet.  */
+
+  /* For AEAD encrypted data: the chunk engine, the last tag sized
+     block read (the final tag at the end of the packet) and the
+     plaintext of the current chunk.  */
+  aead_chunks_t aead;
+  byte aead_tag[AEAD_TAG_LEN];
+  byte *aead_out;
+  size_t aead_outlen;
+  int aead_taken;        /* The current chunk must be popped.  */
+  int aead_eof;          /* All chunks have been submitted.  */
+  int aead_done;         /* The final tag has been checked.  */
+  int aead_symmetric;    /* A failure of the first chunk means BAD_KEY.  */
+  gpg_error_t aead_err;  /* The first authentication error.  */
 } * decode_filter_ctx_t;
 
 /* Helper to release the decode context.  */
@@ -58,11 +75,37 @@ static void release_dfx_context(decode_filter_ctx_t dfx) {
   if (!--dfx->refcount) {
     gcry_cipher_close(dfx->cipher_hd);
     dfx->cipher_hd = NULL;
+    aead_chunks_release(dfx->aead);
+    dfx->aead = NULL;
     dfx->mdc_hash = nullptr;
     xfree(dfx);
   }
 }
 
+/* Read up to SIZE bytes of packet data for DFX from A into BUF and
+   return the number of bytes read.  For a fixed length packet, at
+   most the remaining length is read.  On EOF, DFX->EOF_SEEN is set
+   to 1 or, if a fixed length packet ended prematurely, to 3.  */
+static size_t read_packet_data(decode_filter_ctx_t dfx, IOBUF a, byte *buf,
+                               size_t size) {
+  size_t want = size;
+  int nread = 0;
+
+  if (!dfx->partial && want > dfx->length) want = dfx->length;
+  if (want) {
+    nread = iobuf_read(a, buf, want);
+    if (nread == -1) nread = 0;
+  }
+  if (dfx->partial) {
+    if ((size_t)nread < want) dfx->eof_seen = 1; /* Normal EOF.  */
+  } else {
+    dfx->length -= nread;
+    if ((size_t)nread < want) dfx->eof_seen = 3; /* Premature EOF.  */
+    if (!dfx->length) dfx->eof_seen = 1;         /* Normal EOF.  */
+  }
+  return nread;
+}
+
 /****************
  * Decrypt the data, specified by ED with the key DEK.
  */
@@ -88,8 +131,9 @@ int decrypt_data(ctrl_t ctrl, void *procctx, PKT_encrypted *ed, DEK *dek) {
   }
 
   /* Check compliance.  */
-  if (!gnupg_cipher_is_allowed(opt.compliance, 0, (cipher_algo_t)(dek->algo),
-                               GCRY_CIPHER_MODE_CFB)) {
+  if (!gnupg_cipher_is_allowed(
+          opt.compliance, 0, (cipher_algo_t)(dek->algo),
+          ed->aead_algo ? GCRY_CIPHER_MODE_OCB : GCRY_CIPHER_MODE_CFB)) {
     log_error(_("you may not use cipher algorithm '%s'"
                 " while in %s mode\n"),
               openpgp_cipher_algo_name((cipher_algo_t)(dek->algo)),
@@ -101,7 +145,10 @@ int decrypt_data(ctrl_t ctrl, void *procctx, PKT_encrypted *ed, DEK *dek) {
   {
     char buf[20];
 
-    snprintf(buf, sizeof buf, "%d %d", ed->mdc_method, dek->algo);
+    if (ed->aead_algo)
+      snprintf(buf, sizeof buf, "0 %d %d", dek->algo, ed->aead_algo);
+    else
+      snprintf(buf, sizeof buf, "%d %d", ed->mdc_method, dek->algo);
     write_status_text(STATUS_DECRYPTION_INFO, buf);
   }
 
@@ -122,6 +169,52 @@ int decrypt_data(ctrl_t ctrl, void *procctx, PKT_encrypted *ed, DEK *dek) {
 
   rc = openpgp_cipher_test_algo((cipher_algo_t)(dek->algo));
   if (rc) goto leave;
+
+  if (ed->aead_algo) {
+    unsigned int ivlen;
+    byte iv[16];
+
+    if (ed->cipher_algo != dek->algo ||
+        openpgp_cipher_blocklen((cipher_algo_t)(dek->algo)) != 16) {
+      log_error(_("cipher algorithm %d is not usable with AEAD\n"),
+                ed->cipher_algo);
+      rc = GPG_ERR_CIPHER_ALGO;
+      goto leave;
+    }
+    if (openpgp_aead_test_algo((aead_algo_t)(ed->aead_algo), NULL, &ivlen)) {
+      log_error(_("AEAD algorithm '%s' is not supported\n"),
+                openpgp_aead_algo_name((aead_algo_t)(ed->aead_algo)));
+      rc = GPG_ERR_CIPHER_ALGO;
+      goto leave;
+    }
+    if (ed->chunkbyte > AEAD_MAX_CHUNK_BYTE) {
+      log_error(_("AEAD chunk size %d is not supported\n"), ed->chunkbyte);
+      rc = GPG_ERR_NOT_SUPPORTED;
+      goto leave;
+    }
+    if (!ed->buf) {
+      log_error(_("problem handling encrypted packet\n"));
+      goto leave;
+    }
+
+    /* Read the IV and the first tag sized block.  */
+    dfx->partial = ed->is_partial;
+    dfx->length = ed->len;
+    if (read_packet_data(dfx, ed->buf, iv, ivlen) != ivlen ||
+        read_packet_data(dfx, ed->buf, dfx->aead_tag, AEAD_TAG_LEN) !=
+            AEAD_TAG_LEN) {
+      rc = GPG_ERR_INV_PACKET;
+      goto leave;
+    }
+
+    rc = aead_chunks_new(&dfx->aead, 1, dek, ed->cipher_algo, ed->aead_algo,
+                         ed->chunkbyte, iv);
+    if (rc) goto leave;
+    dfx->aead_symmetric = dek->symmetric;
+    dfx->refcount++;
+    iobuf_push_filter(ed->buf, aead_decode_filter, dfx);
+    goto process;
+  }
   blocksize = openpgp_cipher_get_algo_blklen(dek->algo);
   if (!blocksize || blocksize > 16)
     log_fatal("unsupported blocksize %u\n", blocksize);
@@ -219,6 +312,7 @@ int decrypt_data(ctrl_t ctrl, void *procctx, PKT_encrypted *ed, DEK *dek) {
   else
     iobuf_push_filter(ed->buf, decode_filter, dfx);
 
+process:
   if (opt.unwrap_encryption) {
     char *filename = NULL;
     estream_t fp;
@@ -246,7 +340,15 @@ int decrypt_data(ctrl_t ctrl, void *procctx, PKT_encrypted *ed, DEK *dek) {
     proc_packets(ctrl, procctx, ed->buf);
 
   ed->buf = NULL;
-  if (dfx->eof_seen > 1)
+  if (ed->aead_algo) {
+    /* The plaintext of a chunk is only released after it has been
+       authenticated, and the final tag is checked before the last
+       chunk is released.  */
+    if (dfx->aead_err)
+      rc = dfx->aead_err;
+    else if (dfx->eof_seen > 1 || !dfx->aead_done)
+      rc = GPG_ERR_INV_PACKET;
+  } else if (dfx->eof_seen > 1)
     rc = GPG_ERR_INV_PACKET;
   else if (ed->mdc_method) {
     /* We used to let parse-packet.c handle the MDC packet but this
@@ -326,25 +428,7 @@ static int mdc_decode_filter(void *opaque, int control, IOBUF a, byte *buf,
         memcpy(buf, dfx->defer, 22);
       }
       /* Fill up the buffer. */
-      if (dfx->partial) {
-        for (; n < size; n++) {
-          if ((c = iobuf_get(a)) == -1) {
-            dfx->eof_seen = 1; /* Normal EOF. */
-            break;
-          }
-          buf[n] = c;
-        }
-      } else {
-        for (; n < size && dfx->length; n++, dfx->length--) {
-          c = iobuf_get(a);
-          if (c == -1) {
-            dfx->eof_seen = 3; /* Premature EOF. */
-            break;
-          }
-          buf[n] = c;
-        }
-        if (!dfx->length) dfx->eof_seen = 1; /* Normal EOF.  */
-      }
+      n += read_packet_data(dfx, a, buf + n, size - n);
 
       /* Move the trailing 22 bytes back to the defer buffer.  We
          have at least 44 bytes thus a memmove is not needed.  */
@@ -366,8 +450,14 @@ static int mdc_decode_filter(void *opaque, int control, IOBUF a, byte *buf,
     }
 
     if (n) {
-      if (dfx->cipher_hd) gcry_cipher_decrypt(dfx->cipher_hd, buf, n, NULL, 0);
-      if (dfx->mdc_hash) dfx->mdc_hash->update(buf, n);
+      size_t off, len;
+
+      for (off = 0; off < n; off += len) {
+        len = n - off < CIPHER_CHUNK_SIZE ? n - off : CIPHER_CHUNK_SIZE;
+        if (dfx->cipher_hd)
+          gcry_cipher_decrypt(dfx->cipher_hd, buf + off, len, NULL, 0);
+        if (dfx->mdc_hash) dfx->mdc_hash->update(buf + off, len);
+      }
     } else {
       log_assert(dfx->eof_seen);
       rc = -1; /* Return EOF.  */
@@ -381,12 +471,114 @@ static int mdc_decode_filter(void *opaque, int control, IOBUF a, byte *buf,
   return rc;
 }
 
+/* Read the next chunk of an AEAD encrypted packet into the chunk
+   engine of DFX.  The last AEAD_TAG_LEN octets read are always kept
+   back in DFX->AEAD_TAG, because they are the final tag if the packet
+   ends there.  */
+static gpg_error_t aead_read_chunk(decode_filter_ctx_t dfx, IOBUF a) {
+  size_t chunksize = aead_chunks_size(dfx->aead);
+  size_t n;
+  byte *p;
+
+  p = aead_chunks_buffer(dfx->aead);
+  if (!p) return gpg_error_from_syserror();
+  memcpy(p, dfx->aead_tag, AEAD_TAG_LEN);
+  n = AEAD_TAG_LEN +
+      read_packet_data(dfx, a, p + AEAD_TAG_LEN, chunksize + AEAD_TAG_LEN);
+  memcpy(dfx->aead_tag, p + n - AEAD_TAG_LEN, AEAD_TAG_LEN);
+  n -= AEAD_TAG_LEN;
+  if (n == chunksize + AEAD_TAG_LEN) {
+    aead_chunks_submit(dfx->aead, n);
+    return 0;
+  }
+
+  /* The packet ended.  What is left before the final tag is the last
+     chunk, which needs to have at least its tag.  */
+  dfx->aead_eof = 1;
+  if (dfx->eof_seen > 1 || (n && n < AEAD_TAG_LEN)) return GPG_ERR_INV_PACKET;
+  if (n) aead_chunks_submit(dfx->aead, n);
+  return 0;
+}
+
+/* Check the final tag of the AEAD encrypted packet of DFX.  */
+static gpg_error_t aead_check_final(decode_filter_ctx_t dfx) {
+  dfx->aead_done = 1;
+  return aead_chunks_final(dfx->aead, dfx->aead_tag);
+}
+
+static int aead_decode_filter(void *opaque, int control, IOBUF a, byte *buf,
+                              size_t *ret_len) {
+  decode_filter_ctx_t dfx = (decode_filter_ctx_t)opaque;
+  size_t n, len, size = *ret_len;
+  gpg_error_t err;
+  int rc = 0;
+
+  if (control == IOBUFCTRL_UNDERFLOW) {
+    log_assert(a);
+
+    for (n = 0; n < size && !dfx->aead_err;) {
+      if (dfx->aead_outlen) {
+        len = size - n < dfx->aead_outlen ? size - n : dfx->aead_outlen;
+        memcpy(buf + n, dfx->aead_out, len);
+        dfx->aead_out += len;
+        dfx->aead_outlen -= len;
+        n += len;
+        continue;
+      }
+      if (dfx->aead_taken) {
+        aead_chunks_pop(dfx->aead);
+        dfx->aead_taken = 0;
+      }
+
+      /* Keep the engine busy.  */
+      while (!dfx->aead_eof && !aead_chunks_full(dfx->aead))
+        if ((err = aead_read_chunk(dfx, a))) {
+          dfx->aead_err = err;
+          break;
+        }
+      if (dfx->aead_err) break;
+
+      if (!aead_chunks_pending(dfx->aead)) {
+        if (!dfx->aead_done) dfx->aead_err = aead_check_final(dfx);
+        break;
+      }
+      if (n) break; /* Don't wait with data at hand.  */
+
+      err = aead_chunks_take(dfx->aead, &dfx->aead_out, &dfx->aead_outlen);
+      dfx->aead_taken = 1;
+      /* With a passphrase there is no other check of the key.  */
+      if (err == GPG_ERR_BAD_SIGNATURE && dfx->aead_symmetric)
+        err = GPG_ERR_BAD_KEY;
+      dfx->aead_symmetric = 0;
+      if (!err && dfx->aead_eof && aead_chunks_pending(dfx->aead) == 1)
+        err = aead_check_final(dfx);
+      if (err) {
+        dfx->aead_err = err;
+        dfx->aead_outlen = 0;
+      }
+    }
+
+    /* Errors are reported by decrypt_data.  Skip the rest of the
+       packet, so that it is not read as the next packets once we
+       have returned EOF.  */
+    if (!n && dfx->aead_err)
+      while (!dfx->eof_seen) read_packet_data(dfx, a, buf, size);
+    *ret_len = n;
+    if (!n) rc = -1;
+  } else if (control == IOBUFCTRL_FREE) {
+    release_dfx_context(dfx);
+  } else if (control == IOBUFCTRL_DESC) {
+    mem2str((char *)(buf), "aead_decode_filter", *ret_len);
+  }
+  return rc;
+}
+
 static int decode_filter(void *opaque, int control, IOBUF a, byte *buf,
                          size_t *ret_len) {
   decode_filter_ctx_t fc = (decode_filter_ctx_t)opaque;
   size_t size = *ret_len;
   size_t n;
-  int c, rc = 0;
+  int rc = 0;
 
   if (control == IOBUFCTRL_UNDERFLOW && fc->eof_seen) {
     *ret_len = 0;
@@ -394,26 +586,7 @@ static int decode_filter(void *opaque, int control, IOBUF a, byte *buf,
   } else if (control == IOBUFCTRL_UNDERFLOW) {
     log_assert(a);
 
-    if (fc->partial) {
-      for (n = 0; n < size; n++) {
-        c = iobuf_get(a);
-        if (c == -1) {
-          fc->eof_seen = 1; /* Normal EOF. */
-          break;
-        }
-        buf[n] = c;
-      }
-    } else {
-      for (n = 0; n < size && fc->length; n++, fc->length--) {
-        c = iobuf_get(a);
-        if (c == -1) {
-          fc->eof_seen = 3; /* Premature EOF. */
-          break;
-        }
-        buf[n] = c;
-      }
-      if (!fc->length) fc->eof_seen = 1; /* Normal EOF.  */
-    }
+    n = read_packet_data(fc, a, buf, size);
     if (n) {
       if (fc->cipher_hd) gcry_cipher_decrypt(fc->cipher_hd, buf, n, NULL, 0);
     } else {
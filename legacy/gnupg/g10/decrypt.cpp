@@ -50,6 +50,7 @@ int decrypt_message(ctrl_t ctrl, const char *filename) {
 
   /* Open the message file.  */
   fp = iobuf_open(filename);
+  if (fp && opt.async_io) iobuf_ioctl(fp, IOBUF_IOCTL_ASYNC, 1, NULL);
   if (fp && is_secured_file(iobuf_get_fd(fp))) {
     iobuf_close(fp);
     fp = NULL;
@@ -196,6 +197,7 @@ void decrypt_messages(ctrl_t ctrl, int nfiles, char *files[]) {
     if (!output) goto next_file;
     fp = iobuf_open(filename);
     if (fp) iobuf_ioctl(fp, IOBUF_IOCTL_NO_CACHE, 1, NULL);
+    if (fp && opt.async_io) iobuf_ioctl(fp, IOBUF_IOCTL_ASYNC, 1, NULL);
     if (fp && is_secured_file(iobuf_get_fd(fp))) {
       iobuf_close(fp);
       fp = NULL;
@@ -26,6 +26,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "../common/iobuf.h"
 #include "../common/status.h"
 #include "../common/ttyio.h"
@@ -146,14 +149,28 @@ static gpg_error_t do_delete_key(ctrl_t ctrl, const char *username, int secret,
       char *prompt;
       gpg_error_t firsterr = 0;
       char *hexgrip;
+      std::vector<kbnode_t> nodes;
+      std::vector<PKT_public_key *> pks;
+      std::vector<gpg_error_t> probed;
+      size_t i;
 
       setup_main_keyids(keyblock);
-      for (kbctx = NULL; (node = walk_kbnode(keyblock, &kbctx, 0));) {
-        if (!(node->pkt->pkttype == PKT_PUBLIC_KEY ||
-              node->pkt->pkttype == PKT_PUBLIC_SUBKEY))
-          continue;
+      for (kbctx = NULL; (node = walk_kbnode(keyblock, &kbctx, 0));)
+        if (node->pkt->pkttype == PKT_PUBLIC_KEY ||
+            node->pkt->pkttype == PKT_PUBLIC_SUBKEY) {
+          nodes.push_back(node);
+          pks.push_back(node->pkt->pkt.public_key);
+        }
+
+      /* Ask for all (sub)keys at once.  */
+      probed.resize(pks.size());
+      err = agent_probe_secret_keys(NULL, pks.data(), pks.size(),
+                                    probed.data());
+      if (err) std::fill(probed.begin(), probed.end(), err);
 
-        if (agent_probe_secret_key(NULL, node->pkt->pkt.public_key))
+      for (i = 0; i < nodes.size(); i++) {
+        node = nodes[i];
+        if (probed[i])
           continue; /* No secret key for that public (sub)key.  */
 
         prompt = gpg_format_keydesc(ctrl, node->pkt->pkt.public_key,
@@ -25,8 +25,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <botan/mem_ops.h>
 
+#include <neopg/utils/workers.h>
+
 #include "../common/compliance.h"
 #include "../common/iobuf.h"
 #include "../common/status.h"
@@ -96,6 +101,28 @@ void encrypt_seskey(DEK *dek, DEK **seskey, byte *enckey) {
   wipememory(buf, sizeof buf); /* burn key */
 }
 
+/* Return the AEAD algorithm with which to encrypt using DEK, or 0 to
+   create an MDC protected packet.  AEAD is only used as requested
+   with --aead-algo and needs a cipher with 16 octet blocks.  */
+static int use_aead(DEK *dek) {
+  enum gcry_cipher_modes mode;
+
+  if (!opt.def_aead_algo ||
+      openpgp_aead_test_algo((aead_algo_t)(opt.def_aead_algo), &mode, NULL))
+    return 0;
+
+  if (openpgp_cipher_blocklen((cipher_algo_t)(dek->algo)) != 16 ||
+      !gnupg_cipher_is_allowed(opt.compliance, 1, (cipher_algo_t)(dek->algo),
+                               mode)) {
+    log_info(_("cipher algorithm '%s' may not be used with AEAD"
+               " - using MDC\n"),
+             openpgp_cipher_algo_name((cipher_algo_t)(dek->algo)));
+    return 0;
+  }
+
+  return opt.def_aead_algo;
+}
+
 /* We don't want to use use_seskey yet because older gnupg versions
    can't handle it, and there isn't really any point unless we're
    making a message that can be decrypted by a public key or
@@ -125,6 +152,7 @@ static int encrypt_simple(const char *filename, int mode, int use_seskey) {
   /* Prepare iobufs. */
   inp = iobuf_open(filename);
   if (inp) iobuf_ioctl(inp, IOBUF_IOCTL_NO_CACHE, 1, NULL);
+  if (inp && opt.async_io) iobuf_ioctl(inp, IOBUF_IOCTL_ASYNC, 1, NULL);
   if (inp && is_secured_file(iobuf_get_fd(inp))) {
     iobuf_close(inp);
     inp = NULL;
@@ -197,6 +225,7 @@ static int encrypt_simple(const char *filename, int mode, int use_seskey) {
   if (opt.armor) {
     afx = new_armor_context();
     push_armor_filter(afx, out);
+    if (opt.threaded_filters) iobuf_push_thread_filter(out);
   }
 
   if (s2k) {
@@ -257,12 +286,18 @@ static int encrypt_simple(const char *filename, int mode, int use_seskey) {
   }
 
   /* Register the cipher filter. */
-  if (mode) iobuf_push_filter(out, cipher_filter, &cfx);
+  if (mode) {
+    cfx.aead_algo = use_aead(cfx.dek);
+    iobuf_push_filter(out, cfx.aead_algo ? cipher_filter_aead : cipher_filter,
+                      &cfx);
+    if (opt.threaded_filters) iobuf_push_thread_filter(out);
+  }
 
   /* Register the compress filter. */
   if (do_compress) {
     if (cfx.dek) zfx.new_ctb = 1;
     push_compress_filter(out, &zfx, default_compress_algo());
+    if (opt.threaded_filters) iobuf_push_thread_filter(out);
   }
 
   /* Do the work. */
@@ -400,6 +435,7 @@ int encrypt_crypt(
     inp = iobuf_fdopen_nc(FD2INT(filefd), "rb");
 #endif
   if (inp) iobuf_ioctl(inp, IOBUF_IOCTL_NO_CACHE, 1, NULL);
+  if (inp && opt.async_io) iobuf_ioctl(inp, IOBUF_IOCTL_ASYNC, 1, NULL);
   if (inp && is_secured_file(iobuf_get_fd(inp))) {
     iobuf_close(inp);
     inp = NULL;
@@ -433,6 +469,7 @@ int encrypt_crypt(
   if (opt.armor) {
     afx = new_armor_context();
     push_armor_filter(afx, out);
+    if (opt.threaded_filters) iobuf_push_thread_filter(out);
   }
 
   /* Create a session key. */
@@ -567,7 +604,10 @@ int encrypt_crypt(
   cfx.datalen = filesize && !do_compress ? calc_packet_length(&pkt) : 0;
 
   /* Register the cipher filter. */
-  iobuf_push_filter(out, cipher_filter, &cfx);
+  cfx.aead_algo = use_aead(cfx.dek);
+  iobuf_push_filter(out, cfx.aead_algo ? cipher_filter_aead : cipher_filter,
+                    &cfx);
+  if (opt.threaded_filters) iobuf_push_thread_filter(out);
 
   /* Register the compress filter. */
   if (do_compress) {
@@ -590,6 +630,7 @@ int encrypt_crypt(
     if (compr_algo) {
       if (cfx.dek) zfx.new_ctb = 1;
       push_compress_filter(out, &zfx, compr_algo);
+      if (opt.threaded_filters) iobuf_push_thread_filter(out);
     }
   }
 
@@ -676,7 +717,10 @@ int encrypt_filter(void *opaque, int control, iobuf_t a, byte *buf,
         if (rc) return rc;
       }
 
-      iobuf_push_filter(a, cipher_filter, &efx->cfx);
+      efx->cfx.aead_algo = use_aead(efx->cfx.dek);
+      iobuf_push_filter(
+          a, efx->cfx.aead_algo ? cipher_filter_aead : cipher_filter,
+          &efx->cfx);
 
       efx->header_okay = 1;
     }
@@ -692,21 +736,32 @@ int encrypt_filter(void *opaque, int control, iobuf_t a, byte *buf,
   return rc;
 }
 
-/*
- * Write a pubkey-enc packet for the public key PK to OUT.
- */
-int write_pubkey_enc(ctrl_t ctrl, PKT_public_key *pk, int throw_keyid, DEK *dek,
-                     iobuf_t out) {
-  PACKET pkt;
+/* Lists with fewer recipients are encrypted in the calling thread,
+   as starting threads would cost more than it saves.  */
+#define PUBKEY_ENC_MIN_JOBS 8
+/* The minimum number of recipients per thread.  */
+#define PUBKEY_ENC_JOBS_PER_THREAD 4
+
+/* Allocate a pubkey-enc packet for PK.  This also computes the
+   fingerprint of PK, so that PK is not modified by the following
+   do_pubkey_enc, which may run in another thread.  */
+static PKT_pubkey_enc *new_pubkey_enc(PKT_public_key *pk, int throw_keyid) {
   PKT_pubkey_enc *enc;
-  int rc;
-  gcry_mpi_t frame;
 
   print_pubkey_algo_note((pubkey_algo_t)(pk->pubkey_algo));
   enc = (PKT_pubkey_enc *)xmalloc_clear(sizeof *enc);
   enc->pubkey_algo = pk->pubkey_algo;
   keyid_from_pk(pk, enc->keyid);
   enc->throw_keyid = throw_keyid;
+  return enc;
+}
+
+/* Encrypt the session key DEK to PK and store the result in ENC.
+   This does not touch any global state and may be called for
+   several recipients at once.  */
+static int do_pubkey_enc(PKT_public_key *pk, DEK *dek, PKT_pubkey_enc *enc) {
+  gcry_mpi_t frame;
+  int rc;
 
   /* Okay, what's going on: We have the session key somewhere in
    * the structure DEK and want to encode this session key in an
@@ -725,6 +780,15 @@ int write_pubkey_enc(ctrl_t ctrl, PKT_public_key *pk, int throw_keyid, DEK *dek,
   rc = pk_encrypt((pubkey_algo_t)(pk->pubkey_algo), enc->data, frame, pk,
                   pk->pkey);
   gcry_mpi_release(frame);
+  return rc;
+}
+
+/* Write the pubkey-enc packet ENC, for which do_pubkey_enc returned
+   RC, to OUT and release ENC.  */
+static int finish_pubkey_enc(ctrl_t ctrl, PKT_pubkey_enc *enc, int rc,
+                             DEK *dek, iobuf_t out) {
+  PACKET pkt;
+
   if (rc)
     log_error("pubkey_encrypt failed: %s\n", gpg_strerror(rc));
   else {
@@ -747,11 +811,39 @@ int write_pubkey_enc(ctrl_t ctrl, PKT_public_key *pk, int throw_keyid, DEK *dek,
   return rc;
 }
 
+/*
+ * Write a pubkey-enc packet for the public key PK to OUT.
+ */
+int write_pubkey_enc(ctrl_t ctrl, PKT_public_key *pk, int throw_keyid, DEK *dek,
+                     iobuf_t out) {
+  PKT_pubkey_enc *enc;
+  int rc;
+
+  enc = new_pubkey_enc(pk, throw_keyid);
+  rc = do_pubkey_enc(pk, dek, enc);
+  return finish_pubkey_enc(ctrl, enc, rc, dek, out);
+}
+
 /*
  * Write pubkey-enc packets from the list of PKs to OUT.
+ *
+ * Each recipient costs at least one public key operation, which
+ * dominates the time needed to encrypt a message to a long list of
+ * recipients.  Thus the session key is first encrypted to all
+ * recipients using one thread per CPU, and then the packets are
+ * written in the order of the list.
  */
 static int write_pubkey_enc_from_list(ctrl_t ctrl, PK_LIST pk_list, DEK *dek,
                                       iobuf_t out) {
+  struct job {
+    PKT_public_key *pk;
+    PKT_pubkey_enc *enc;
+    int rc;
+  };
+  std::vector<job> jobs;
+  size_t nthreads;
+  int rc = 0;
+
   if (opt.throw_keyids && (PGP6 || PGP7 || PGP8)) {
     log_info(_("you may not use %s while in %s mode\n"), "--throw-keyids",
              gnupg_compliance_option_string(opt.compliance));
@@ -761,11 +853,27 @@ static int write_pubkey_enc_from_list(ctrl_t ctrl, PK_LIST pk_list, DEK *dek,
   for (; pk_list; pk_list = pk_list->next) {
     PKT_public_key *pk = pk_list->pk;
     int throw_keyid = (opt.throw_keyids || (pk_list->flags & 1));
-    int rc = write_pubkey_enc(ctrl, pk, throw_keyid, dek, out);
-    if (rc) return rc;
+
+    jobs.push_back({pk, new_pubkey_enc(pk, throw_keyid), 0});
   }
 
-  return 0;
+  nthreads = std::min(NeoPG::hardware_threads(),
+                      jobs.size() / PUBKEY_ENC_JOBS_PER_THREAD);
+  if (jobs.size() < PUBKEY_ENC_MIN_JOBS) nthreads = 1;
+
+  NeoPG::parallel_for(jobs.size(), nthreads, [&](size_t k) {
+    jobs[k].rc = do_pubkey_enc(jobs[k].pk, dek, jobs[k].enc);
+  });
+
+  /* Write the packets, but stop at the first error.  */
+  for (auto &j : jobs) {
+    if (!rc)
+      rc = finish_pubkey_enc(ctrl, j.enc, j.rc, dek, out);
+    else
+      free_pubkey_enc(j.enc);
+  }
+
+  return rc;
 }
 
 void encrypt_crypt_files(
@@ -25,9 +25,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <botan/hash.h>
 #include <botan/hex.h>
 
+#include <neopg/utils/workers.h>
+
 #include "../common/host2net.h"
 #include "../common/init.h"
 #include "../common/mbox-util.h"
@@ -101,6 +108,9 @@ int parse_export_options(char *str, unsigned int *options, int noisy) {
       {"backup", EXPORT_BACKUP, NULL, N_("use the GnuPG key backup format")},
       {"export-backup", EXPORT_BACKUP, NULL, NULL},
 
+      {"export-parallel", EXPORT_PARALLEL, NULL,
+       N_("read and write keys on several threads")},
+
       /* Aliases for backward compatibility */
       {"include-local-sigs", EXPORT_LOCAL_SIGS, NULL, NULL},
       {"include-attributes", EXPORT_ATTRIBUTES, NULL, NULL},
@@ -1157,7 +1167,9 @@ static void apply_drop_subkey_filter(ctrl_t ctrl, kbnode_t keyblock,
   }
 }
 
-/* Helper for do_export_stream which writes one keyblock to OUT.  */
+/* Helper for do_export_stream which writes one keyblock to OUT.  If
+   STATS is NULL the caller counts the exported key and prints the
+   status line.  */
 static gpg_error_t do_export_one_keyblock(ctrl_t ctrl, kbnode_t keyblock,
                                           u32 *keyid, iobuf_t out, int secret,
                                           unsigned int options,
@@ -1339,7 +1351,7 @@ static gpg_error_t do_export_one_keyblock(ctrl_t ctrl, kbnode_t keyblock,
           err = build_packet_and_meta(out, node->pkt);
         else
           err = build_packet(out, node->pkt);
-        if (!err && node->pkt->pkttype == PKT_PUBLIC_KEY) {
+        if (!err && node->pkt->pkttype == PKT_PUBLIC_KEY && stats) {
           stats->exported++;
           print_status_exported(node->pkt->pkt.public_key);
         }
@@ -1355,7 +1367,7 @@ static gpg_error_t do_export_one_keyblock(ctrl_t ctrl, kbnode_t keyblock,
             err = build_packet_and_meta(out, node->pkt);
           else
             err = build_packet(out, node->pkt);
-          if (node->pkt->pkttype == PKT_PUBLIC_KEY) {
+          if (node->pkt->pkttype == PKT_PUBLIC_KEY && stats) {
             stats->exported++;
             print_status_exported(node->pkt->pkt.public_key);
           }
@@ -1385,7 +1397,7 @@ static gpg_error_t do_export_one_keyblock(ctrl_t ctrl, kbnode_t keyblock,
         err = build_packet_and_meta(out, node->pkt);
       else
         err = build_packet(out, node->pkt);
-      if (!err && node->pkt->pkttype == PKT_PUBLIC_KEY) {
+      if (!err && node->pkt->pkttype == PKT_PUBLIC_KEY && stats) {
         stats->exported++;
         print_status_exported(node->pkt->pkt.public_key);
       }
@@ -1408,6 +1420,196 @@ leave:
   return err;
 }
 
+/* The number of keyblocks per thread which may be in flight with
+   --export-options export-parallel.  The output is written in order,
+   so this bounds the memory used when one keyblock takes long.  */
+#define EXPORT_JOBS_PER_THREAD 8
+
+/* A keyblock exported by do_export_stream_parallel.  */
+struct export_job_s {
+  iobuf_t image;     /* The raw keyblock read from the keydb.  */
+  iobuf_t result;    /* The packets to write to the output.  */
+  kbnode_t keyblock; /* The parsed keyblock or NULL.  */
+  gpg_error_t err;
+  int any; /* Something has been written to RESULT.  */
+  int done;
+};
+
+/* Parse the keyblock of JOB and serialize the packets to export.
+   This runs on a worker thread and must not touch any global state.  */
+static void export_job_run(ctrl_t ctrl, struct export_job_s *job,
+                           unsigned int options, KEYDB_SEARCH_DESC *desc) {
+  kbnode_t node;
+  u32 keyid[2];
+
+  job->err = keydb_parse_keyblock_image(job->image, &job->keyblock);
+  if (job->err) return;
+
+  node = find_kbnode(job->keyblock, PKT_PUBLIC_KEY);
+  if (!node) return;
+  keyid_from_pk(node->pkt->pkt.public_key, keyid);
+
+  job->err = do_export_one_keyblock(ctrl, job->keyblock, keyid, job->result,
+                                    0, options, NULL, &job->any, desc, 1, 0);
+}
+
+/* Write the finished JOB to OUT and account for it in STATS.  */
+static gpg_error_t export_job_flush(struct export_job_s *job, iobuf_t out,
+                                    export_stats_t stats, int *any) {
+  gpg_error_t err;
+  kbnode_t node;
+
+  if (!job->keyblock) {
+    log_error(_("error reading keyblock: %s\n"), gpg_strerror(job->err));
+    return job->err;
+  }
+
+  node = find_kbnode(job->keyblock, PKT_PUBLIC_KEY);
+  if (!node) {
+    log_error("public key packet not found in keyblock - skipped\n");
+    return 0;
+  }
+  stats->count++;
+  if (job->err) return job->err;
+
+  err = iobuf_write_temp(out, job->result);
+  if (err) {
+    log_error("error writing keyblock: %s\n", gpg_strerror(err));
+    return err;
+  }
+  stats->exported++;
+  print_status_exported(node->pkt->pkt.public_key);
+  if (job->any) *any = 1;
+  return 0;
+}
+
+/* Release the resources of JOB.  */
+static void export_job_clear(struct export_job_s *job) {
+  iobuf_close(job->image);
+  iobuf_close(job->result);
+  release_kbnode(job->keyblock);
+  memset(job, 0, sizeof *job);
+}
+
+/* Export all public keys to OUT, like do_export_stream does for an
+ * empty list of users.  The keys are read from KDBHD in the calling
+ * thread, while parsing and serializing them is spread over worker
+ * threads.  The calling thread writes the results in the original
+ * order and helps out when it has to wait.  At most
+ * EXPORT_JOBS_PER_THREAD keyblocks per thread are kept in memory.  */
+static gpg_error_t do_export_stream_parallel(ctrl_t ctrl, KEYDB_HANDLE kdbhd,
+                                             KEYDB_SEARCH_DESC *desc,
+                                             iobuf_t out, unsigned int options,
+                                             export_stats_t stats, int *any) {
+  gpg_error_t err = 0;
+  gpg_error_t read_err = 0;
+  std::vector<struct export_job_s> jobs;
+  std::vector<std::thread> threads;
+  std::mutex lock;
+  std::condition_variable work_cv, done_cv;
+  size_t head = 0; /* The next job to write.  */
+  size_t next = 0; /* The next job to run.  */
+  size_t tail = 0; /* The next job to fill.  */
+  size_t njobs;
+  int finished = 0;
+  size_t nthreads;
+  int save_mode;
+  struct export_job_s *job;
+  iobuf_t image;
+
+  nthreads = NeoPG::hardware_threads();
+  njobs = nthreads * EXPORT_JOBS_PER_THREAD;
+  jobs.resize(njobs);
+  for (auto &j : jobs) memset(&j, 0, sizeof j);
+
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> guard(lock);
+
+    for (;;) {
+      work_cv.wait(guard, [&] { return next < tail || finished; });
+      if (next == tail) break;
+      struct export_job_s *own = &jobs[next++ % njobs];
+      guard.unlock();
+      export_job_run(ctrl, own, options, desc);
+      guard.lock();
+      own->done = 1;
+      done_cv.notify_all();
+    }
+  };
+
+  /* The parser must not write to the packet listing while several
+     threads are using it.  */
+  save_mode = set_packet_list_mode(0);
+
+  /* The calling thread only runs jobs when it is blocked, so it is
+     not counted.  If a thread can't be created, it does more of the
+     work.  */
+  NeoPG::start_threads(threads, nthreads, worker);
+
+  for (;;) {
+    /* Write out the finished jobs in order.  Wait for the oldest one
+       only if there is no room for another job.  */
+    while (!err && head < tail) {
+      job = &jobs[head % njobs];
+      std::unique_lock<std::mutex> guard(lock);
+      if (!job->done) {
+        if (!finished && tail - head < njobs) break;
+        if (next < tail) {
+          struct export_job_s *own = &jobs[next++ % njobs];
+          guard.unlock();
+          export_job_run(ctrl, own, options, desc);
+          guard.lock();
+          own->done = 1;
+          continue;
+        }
+        done_cv.wait(guard, [job] { return job->done; });
+      }
+      guard.unlock();
+      err = export_job_flush(job, out, stats, any);
+      export_job_clear(job);
+      head++;
+    }
+    if (err || finished) break;
+
+    /* A read error ends the search, but the keyblocks already in the
+       window are still written out before it is returned.  */
+    read_err = keydb_search(kdbhd, desc, 1, NULL);
+    desc[0].mode = KEYDB_SEARCH_MODE_NEXT;
+    if (!read_err) {
+      read_err = keydb_get_keyblock_image(kdbhd, &image);
+      if (read_err)
+        log_error(_("error reading keyblock: %s\n"), gpg_strerror(read_err));
+    }
+    if (!read_err) {
+      job = &jobs[tail % njobs];
+      job->image = image;
+      job->result = iobuf_temp();
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (read_err)
+        finished = 1;
+      else
+        tail++;
+    }
+    work_cv.notify_all();
+    if (read_err == GPG_ERR_NOT_FOUND) read_err = 0;
+  }
+  if (!err) err = read_err;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    finished = 1;
+  }
+  work_cv.notify_all();
+  for (auto &t : threads) t.join();
+  for (; head < tail; head++) export_job_clear(&jobs[head % njobs]);
+  set_packet_list_mode(save_mode);
+
+  return err;
+}
+
 /* Export the keys identified by the list of strings in USERS to the
    stream OUT.  If SECRET is false public keys will be exported.  With
    secret true secret keys will be exported; in this case 1 means the
@@ -1462,6 +1664,16 @@ static int do_export_stream(ctrl_t ctrl, iobuf_t out,
        this we need an extra flag to enable this feature.  */
   }
 
+  /* Without per-key work in the calling thread, the keys can be
+     exported in parallel.  */
+  if ((options & EXPORT_PARALLEL) && users.empty() && !secret &&
+      !keyblock_out && !(options & EXPORT_CLEAN) && !export_keep_uid &&
+      !export_drop_subkey) {
+    err = do_export_stream_parallel(ctrl, kdbhd, desc, out, options, stats,
+                                    any);
+    goto leave;
+  }
+
 #ifdef ENABLE_SELINUX_HACKS
   if (secret) {
     log_error(_("exporting secret keys not allowed\n"));
@@ -65,7 +65,7 @@ typedef struct {
 
   byte radbuf[4];
   int idx, idx2;
-  u32 crc;
+  gcry_md_hd_t crc_md; /* The CRC24 of the data.  */
 
   int status; /* an internal state flag */
   int cancel;
@@ -78,13 +78,30 @@ typedef struct unarmor_pump_s *UnarmorPump;
 
 struct compress_filter_context_s {
   int status;
-  void *opaque; /* (used for z_stream) */
+  void *opaque; /* (struct compress_state_s) */
   int algo;     /* compress algo */
   int new_ctb;
   void (*release)(struct compress_filter_context_s *);
 };
 typedef struct compress_filter_context_s compress_filter_context_t;
 
+/* The cipher filters hash and en/decrypt their buffers in pieces of
+   this size, so that a piece is still in the cache for the second
+   pass.  */
+#define CIPHER_CHUNK_SIZE 16384
+
+/* The length of the authentication tags of AEAD encrypted data.  */
+#define AEAD_TAG_LEN 16
+
+/* The largest chunk size octet which we support (4 MiB chunks).  A
+   chunk must be buffered until it has been authenticated.  */
+#define AEAD_MAX_CHUNK_BYTE 16
+
+/* Encrypts or decrypts the chunks of an AEAD encrypted data packet
+   on a pool of threads.  See cipher-aead.c.  */
+struct aead_chunks_s;
+typedef struct aead_chunks_s *aead_chunks_t;
+
 typedef struct {
   DEK *dek;
   u32 datalen;
@@ -93,6 +110,9 @@ typedef struct {
   std::unique_ptr<Botan::HashFunction> mdc_hash;
   byte enchash[20];
   int create_mdc; /* flag will be set by the cipher filter */
+  int aead_algo;  /* Used by cipher_filter_aead.  */
+  aead_chunks_t aead;
+  size_t aead_fill; /* Plaintext in the current chunk.  */
 } cipher_filter_context_t;
 
 typedef struct {
@@ -141,6 +161,22 @@ void push_compress_filter2(iobuf_t out, compress_filter_context_t *zfx,
 int cipher_filter(void *opaque, int control, iobuf_t chain, byte *buf,
                   size_t *ret_len);
 
+/*-- cipher-aead.c --*/
+gpg_error_t aead_chunks_new(aead_chunks_t *r_ac, int decrypt, DEK *dek,
+                            int cipher_algo, int aead_algo, int chunkbyte,
+                            const byte *iv);
+void aead_chunks_release(aead_chunks_t ac);
+size_t aead_chunks_size(aead_chunks_t ac);
+byte *aead_chunks_buffer(aead_chunks_t ac);
+void aead_chunks_submit(aead_chunks_t ac, size_t len);
+size_t aead_chunks_pending(aead_chunks_t ac);
+int aead_chunks_full(aead_chunks_t ac);
+gpg_error_t aead_chunks_take(aead_chunks_t ac, byte **r_buf, size_t *r_len);
+void aead_chunks_pop(aead_chunks_t ac);
+gpg_error_t aead_chunks_final(aead_chunks_t ac, byte *tag);
+int cipher_filter_aead(void *opaque, int control, iobuf_t chain, byte *buf,
+                       size_t *ret_len);
+
 /*-- textfilter.c --*/
 int text_filter(void *opaque, int control, iobuf_t chain, byte *buf,
                 size_t *ret_len);
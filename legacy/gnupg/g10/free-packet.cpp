@@ -23,6 +23,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
 #include "../common/iobuf.h"
 #include "../common/util.h"
 #include "gpg.h"
@@ -39,6 +43,155 @@ static gcry_mpi_t my_mpi_copy(gcry_mpi_t a) {
   return gcry_mpi_copy(a);
 }
 
+/* Signatures, public keys and user ids read by the parser are carved
+ * out of slabs of PACKET_SLAB_SIZE slots, like the nodes of a
+ * keyblock (see kbnode.cpp), instead of being allocated one by one.
+ * Such objects have the flag POOLED set and are returned to a free
+ * list of the releasing thread by the free functions below; all
+ * other objects are released with xfree as before.  Once a thread
+ * has twice a slab's worth of free slots of a kind, it hands a slab's
+ * worth to the pool shared by all threads.  The slabs themselves are
+ * never freed.  */
+#define PACKET_SLAB_SIZE 128
+
+/* The room for the name in a pooled user id.  Longer user ids and
+ * those which do not fit are allocated with xmalloc.  */
+#define POOLED_UID_NAME_SIZE 128
+
+enum { POOL_SIGNATURE, POOL_PUBLIC_KEY, POOL_USER_ID, N_PACKET_POOLS };
+
+struct packet_slot {
+  struct packet_slot *next;
+};
+
+struct packet_pool {
+  size_t slot_size;
+  std::mutex lock;
+  /* Lists of free slots given up by threads, with their lengths.  */
+  std::vector<std::pair<packet_slot *, size_t>> lists;
+};
+
+/* Round the size of a slot up, so that all slots of a slab are
+ * suitably aligned.  */
+#define PACKET_SLOT_SIZE(n) \
+  (((n) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1))
+
+static struct packet_pool packet_pools[N_PACKET_POOLS] = {
+    {PACKET_SLOT_SIZE(sizeof(PKT_signature))},
+    {PACKET_SLOT_SIZE(sizeof(PKT_public_key))},
+    {PACKET_SLOT_SIZE(sizeof(PKT_user_id) + POOLED_UID_NAME_SIZE)}};
+
+struct packet_free_list {
+  struct packet_slot *head = NULL;
+  size_t count = 0;
+
+  ~packet_free_list();
+};
+
+static thread_local struct packet_free_list packet_free[N_PACKET_POOLS];
+
+/* Return the free slots of an exiting thread to the pool.  */
+packet_free_list::~packet_free_list() {
+  struct packet_pool *pool = &packet_pools[this - packet_free];
+
+  if (!head) return;
+  std::lock_guard<std::mutex> guard(pool->lock);
+  pool->lists.emplace_back(head, count);
+}
+
+/* Fill the empty free list FL from POOL or with a new slab.  */
+static void refill_packet_free_list(struct packet_free_list *fl,
+                                    struct packet_pool *pool) {
+  char *slab;
+  size_t i;
+
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    if (!pool->lists.empty()) {
+      fl->head = pool->lists.back().first;
+      fl->count = pool->lists.back().second;
+      pool->lists.pop_back();
+      return;
+    }
+  }
+
+  slab = (char *)xmalloc(PACKET_SLAB_SIZE * pool->slot_size);
+  for (i = 0; i + 1 < PACKET_SLAB_SIZE; i++)
+    ((struct packet_slot *)(slab + i * pool->slot_size))->next =
+        (struct packet_slot *)(slab + (i + 1) * pool->slot_size);
+  ((struct packet_slot *)(slab + i * pool->slot_size))->next = NULL;
+  fl->head = (struct packet_slot *)slab;
+  fl->count = PACKET_SLAB_SIZE;
+}
+
+/* Return a cleared slot from the pool KIND.  */
+static void *alloc_pooled(int kind) {
+  struct packet_pool *pool = &packet_pools[kind];
+  struct packet_free_list *fl = &packet_free[kind];
+  struct packet_slot *slot;
+
+  if (!fl->head) refill_packet_free_list(fl, pool);
+  slot = fl->head;
+  fl->head = slot->next;
+  fl->count--;
+
+  memset(slot, 0, pool->slot_size);
+  return slot;
+}
+
+/* Put the slot P back into the pool KIND.  */
+static void free_pooled(int kind, void *p) {
+  struct packet_pool *pool = &packet_pools[kind];
+  struct packet_free_list *fl = &packet_free[kind];
+  struct packet_slot *slot = (struct packet_slot *)p;
+  struct packet_slot *last;
+  size_t i;
+
+  slot->next = fl->head;
+  fl->head = slot;
+  fl->count++;
+  if (fl->count < 2 * PACKET_SLAB_SIZE) return;
+
+  /* Give the most recently freed slab's worth to the pool.  */
+  for (last = fl->head, i = 1; i < PACKET_SLAB_SIZE; i++) last = last->next;
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    pool->lists.emplace_back(fl->head, PACKET_SLAB_SIZE);
+  }
+  fl->head = last->next;
+  last->next = NULL;
+  fl->count -= PACKET_SLAB_SIZE;
+}
+
+/* Return a new cleared signature.  */
+PKT_signature *alloc_signature(void) {
+  PKT_signature *sig = (PKT_signature *)alloc_pooled(POOL_SIGNATURE);
+
+  sig->flags.pooled = 1;
+  return sig;
+}
+
+/* Return a new cleared public key.  */
+PKT_public_key *alloc_public_key(void) {
+  PKT_public_key *pk = (PKT_public_key *)alloc_pooled(POOL_PUBLIC_KEY);
+
+  pk->flags.pooled = 1;
+  return pk;
+}
+
+/* Return a new cleared user id with room for a name of NAMELEN bytes
+ * plus the terminating Nul.  */
+PKT_user_id *alloc_user_id(size_t namelen) {
+  PKT_user_id *uid;
+
+  if (namelen > POOLED_UID_NAME_SIZE)
+    return (PKT_user_id *)xmalloc_clear(sizeof *uid + namelen);
+
+  uid = (PKT_user_id *)alloc_pooled(POOL_USER_ID);
+  uid->flags.pooled = 1;
+  return uid;
+}
+
 void free_symkey_enc(PKT_symkey_enc *enc) { xfree(enc); }
 
 void free_pubkey_enc(PKT_pubkey_enc *enc) {
@@ -60,12 +213,16 @@ void free_seckey_enc(PKT_signature *sig) {
   xfree(sig->hashed);
   xfree(sig->unhashed);
 
-  xfree(sig);
+  if (sig->flags.pooled)
+    free_pooled(POOL_SIGNATURE, sig);
+  else
+    xfree(sig);
 }
 
 void release_public_key_parts(PKT_public_key *pk) {
   int n, i;
 
+  sig_check_forget_key(pk);
   if (pk->seckey_info)
     n = pubkey_get_nskey((pubkey_algo_t)(pk->pubkey_algo));
   else
@@ -105,7 +262,10 @@ void release_public_key_parts(PKT_public_key *pk) {
 void free_public_key(PKT_public_key *pk) {
   if (pk) {
     release_public_key_parts(pk);
-    xfree(pk);
+    if (pk->flags.pooled)
+      free_pooled(POOL_PUBLIC_KEY, pk);
+    else
+      xfree(pk);
   }
 }
 
@@ -132,6 +292,7 @@ PKT_public_key *copy_public_key(PKT_public_key *d, PKT_public_key *s) {
 
   if (!d) d = (PKT_public_key *)xmalloc(sizeof *d);
   memcpy(d, s, sizeof *d);
+  d->flags.pooled = 0;
   d->seckey_info = NULL;
   d->user_id = scopy_user_id(s->user_id);
   if (s->prefs) d->prefs = new std::vector<prefitem_t>(*s->prefs);
@@ -160,6 +321,7 @@ PKT_signature *copy_signature(PKT_signature *d, PKT_signature *s) {
 
   if (!d) d = (PKT_signature *)xmalloc(sizeof *d);
   memcpy(d, s, sizeof *d);
+  d->flags.pooled = 0;
   n = pubkey_get_nsig((pubkey_algo_t)(s->pubkey_algo));
   if (!n)
     d->data[0] = my_mpi_copy(s->data[0]);
@@ -203,12 +365,16 @@ void free_user_id(PKT_user_id *uid) {
   log_assert(uid->ref > 0);
   if (--uid->ref) return;
 
+  sig_check_forget_uid(uid);
   free_attributes(uid);
   delete uid->prefs;
   xfree(uid->namehash);
   xfree(uid->updateurl);
   xfree(uid->mbox);
-  xfree(uid);
+  if (uid->flags.pooled)
+    free_pooled(POOL_USER_ID, uid);
+  else
+    xfree(uid);
 }
 
 void free_compressed(PKT_compressed *zd) {
@@ -323,6 +489,7 @@ void free_packet(PACKET *pkt, parse_packet_ctx_t parsectx) {
       break;
     case PKT_ENCRYPTED:
     case PKT_ENCRYPTED_MDC:
+    case PKT_ENCRYPTED_AEAD:
       free_encrypted(pkt->pkt.encrypted);
       break;
     case PKT_PLAINTEXT:
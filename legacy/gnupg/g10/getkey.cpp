@@ -42,10 +42,14 @@
 #include "packet.h"
 #include "trustdb.h"
 
-#define MAX_PK_CACHE_ENTRIES PK_UID_CACHE_SIZE
-#define MAX_UID_CACHE_ENTRIES PK_UID_CACHE_SIZE
-
-#if MAX_PK_CACHE_ENTRIES < 2
+/* The public key and user ID caches are limited by the (estimated)
+   amount of memory they use.  */
+#define PK_CACHE_BUDGET (PK_UID_CACHE_SIZE * 1024)
+#define UID_CACHE_BUDGET (PK_UID_CACHE_SIZE * 256)
+#define PK_CACHE_BUCKETS 1024  /* Must be a power of 2.  */
+#define UID_CACHE_BUCKETS 1024 /* Must be a power of 2.  */
+
+#if PK_CACHE_BUDGET < 2 * 1024
 #error We need the cache for key creation
 #endif
 
@@ -93,34 +97,55 @@ struct getkey_ctx_s {
   std::vector<KEYDB_SEARCH_DESC> items;
 };
 
-typedef struct keyid_list {
-  struct keyid_list *next;
-  char fpr[MAX_FINGERPRINT_LEN];
-  u32 keyid[2];
-} * keyid_list_t;
+/* Both caches are hash tables with chaining, and their entries are
+   also kept on a list in least recently used order.  When the budget
+   of a cache is exceeded, entries are evicted from the tail of its
+   list.  */
+struct cache_stats {
+  unsigned int count;     /* The current number of entries.  */
+  size_t bytes;           /* The estimated size of all entries.  */
+  unsigned int hits;      /* Lookups answered by the cache.  */
+  unsigned int misses;    /* Lookups not answered by the cache.  */
+  unsigned int evictions; /* Entries dropped to stay in budget.  */
+};
 
-#if MAX_PK_CACHE_ENTRIES
 typedef struct pk_cache_entry {
-  struct pk_cache_entry *next;
+  struct pk_cache_entry *next;     /* Next in the hash bucket.  */
+  struct pk_cache_entry *lru_prev; /* Towards the most recent.  */
+  struct pk_cache_entry *lru_next; /* Towards the least recent.  */
+  size_t size;                     /* Estimated size of the entry.  */
   u32 keyid[2];
   PKT_public_key *pk;
 } * pk_cache_entry_t;
-static pk_cache_entry_t pk_cache;
-static int pk_cache_entries; /* Number of entries in pk cache.  */
+static pk_cache_entry_t pk_cache[PK_CACHE_BUCKETS];
+static pk_cache_entry_t pk_cache_lru_head, pk_cache_lru_tail;
+static struct cache_stats pk_cache_stats;
 static int pk_cache_disabled;
-#endif
 
-#if MAX_UID_CACHE_ENTRIES < 5
-#error we really need the userid cache
-#endif
+/* The user ID cache maps the key ids and fingerprints of all keys of
+   a keyblock to the primary user ID.  Each key is on two hash chains,
+   one for its key id and one for its fingerprint.  */
+typedef struct keyid_list {
+  struct keyid_list *next;     /* Next key of the same user ID.  */
+  struct keyid_list *kid_next; /* Next in the key id hash bucket.  */
+  struct keyid_list *fpr_next; /* Next in the fingerprint hash bucket.  */
+  struct user_id_db *owner;
+  char fpr[MAX_FINGERPRINT_LEN];
+  u32 keyid[2];
+} * keyid_list_t;
+
 typedef struct user_id_db {
-  struct user_id_db *next;
+  struct user_id_db *lru_prev; /* Towards the most recent.  */
+  struct user_id_db *lru_next; /* Towards the least recent.  */
+  size_t size;                 /* Estimated size of the entry.  */
   keyid_list_t keyids;
   int len;
   char name[1];
 } * user_id_db_t;
-static user_id_db_t user_id_db;
-static int uid_cache_entries; /* Number of entries in uid cache. */
+static keyid_list_t uid_cache_by_kid[UID_CACHE_BUCKETS];
+static keyid_list_t uid_cache_by_fpr[UID_CACHE_BUCKETS];
+static user_id_db_t uid_cache_lru_head, uid_cache_lru_tail;
+static struct cache_stats uid_cache_stats;
 
 static void merge_selfsigs(ctrl_t ctrl, kbnode_t keyblock);
 static int lookup(ctrl_t ctrl, getkey_ctx_t ctx, int want_secret,
@@ -129,6 +154,75 @@ static kbnode_t finish_lookup(kbnode_t keyblock, unsigned int req_usage,
                               int want_exact, unsigned int *r_flags);
 static void print_status_key_considered(kbnode_t keyblock, unsigned int flags);
 
+/* Remove the entry E from the LRU list given by *HEAD and *TAIL.  */
+template <typename T>
+static void lru_unlink(T *e, T **head, T **tail) {
+  if (e->lru_prev)
+    e->lru_prev->lru_next = e->lru_next;
+  else
+    *head = e->lru_next;
+  if (e->lru_next)
+    e->lru_next->lru_prev = e->lru_prev;
+  else
+    *tail = e->lru_prev;
+}
+
+/* Insert the entry E at the front of the LRU list given by *HEAD and
+   *TAIL.  */
+template <typename T>
+static void lru_push(T *e, T **head, T **tail) {
+  e->lru_prev = NULL;
+  e->lru_next = *head;
+  if (*head)
+    (*head)->lru_prev = e;
+  else
+    *tail = e;
+  *head = e;
+}
+
+/* Move the entry E to the front of the LRU list given by *HEAD and
+   *TAIL.  */
+template <typename T>
+static void lru_touch(T *e, T **head, T **tail) {
+  if (*head == e) return;
+  lru_unlink(e, head, tail);
+  lru_push(e, head, tail);
+}
+
+static unsigned int pk_cache_bucket(const u32 *keyid) {
+  return keyid[1] & (PK_CACHE_BUCKETS - 1);
+}
+
+/* Return the entry of the public key cache for KEYID or NULL.  A
+   found entry becomes the most recently used one.  */
+static pk_cache_entry_t pk_cache_lookup(const u32 *keyid) {
+  pk_cache_entry_t ce;
+
+  for (ce = pk_cache[pk_cache_bucket(keyid)]; ce; ce = ce->next)
+    if (ce->keyid[0] == keyid[0] && ce->keyid[1] == keyid[1]) {
+      lru_touch(ce, &pk_cache_lru_head, &pk_cache_lru_tail);
+      pk_cache_stats.hits++;
+      return ce;
+    }
+  pk_cache_stats.misses++;
+  return NULL;
+}
+
+/* Remove the entry CE from the public key cache and release it.  */
+static void pk_cache_drop(pk_cache_entry_t ce) {
+  pk_cache_entry_t *pp;
+
+  for (pp = &pk_cache[pk_cache_bucket(ce->keyid)]; *pp != ce;
+       pp = &(*pp)->next)
+    ;
+  *pp = ce->next;
+  lru_unlink(ce, &pk_cache_lru_head, &pk_cache_lru_tail);
+  pk_cache_stats.count--;
+  pk_cache_stats.bytes -= ce->size;
+  free_public_key(ce->pk);
+  xfree(ce);
+}
+
 /* Cache a copy of a public key in the public key cache.  PK is not
  * cached if caching is disabled (via getkey_disable_caches), if
  * PK->FLAGS.DONT_CACHE is set, we don't know how to derive a key id
@@ -137,13 +231,13 @@ static void print_status_key_considered(kbnode_t keyblock, unsigned int flags);
  *
  * The public key packet is copied into the cache using
  * copy_public_key.  Thus, any secret parts are not copied, for
- * instance.
+ * instance.  If the cache exceeds PK_CACHE_BUDGET, the least
+ * recently used keys are dropped.
  *
  * This cache is filled by get_pubkey and is read by get_pubkey and
  * get_pubkey_fast.  */
 void cache_public_key(PKT_public_key *pk) {
-#if MAX_PK_CACHE_ENTRIES
-  pk_cache_entry_t ce, ce2;
+  pk_cache_entry_t ce;
   u32 keyid[2];
 
   if (pk_cache_disabled) return;
@@ -158,39 +252,31 @@ void cache_public_key(PKT_public_key *pk) {
   } else
     return; /* Don't know how to get the keyid.  */
 
-  for (ce = pk_cache; ce; ce = ce->next)
+  for (ce = pk_cache[pk_cache_bucket(keyid)]; ce; ce = ce->next)
     if (ce->keyid[0] == keyid[0] && ce->keyid[1] == keyid[1]) {
       if (DBG_CACHE) log_debug("cache_public_key: already in cache\n");
       return;
     }
 
-  if (pk_cache_entries >= MAX_PK_CACHE_ENTRIES) {
-    int n;
-
-    /* Remove the last 50% of the entries.  */
-    for (ce = pk_cache, n = 0; ce && n < pk_cache_entries / 2; n++)
-      ce = ce->next;
-    if (ce && ce != pk_cache && ce->next) {
-      ce2 = ce->next;
-      ce->next = NULL;
-      ce = ce2;
-      for (; ce; ce = ce2) {
-        ce2 = ce->next;
-        free_public_key(ce->pk);
-        xfree(ce);
-        pk_cache_entries--;
-      }
-    }
-    log_assert(pk_cache_entries < MAX_PK_CACHE_ENTRIES);
-  }
-  pk_cache_entries++;
   ce = (pk_cache_entry_t)xmalloc(sizeof *ce);
-  ce->next = pk_cache;
-  pk_cache = ce;
   ce->pk = copy_public_key(NULL, pk);
   ce->keyid[0] = keyid[0];
   ce->keyid[1] = keyid[1];
-#endif
+  /* The key material is the bulk of a public key; count it twice to
+     account for the MPI overhead.  */
+  ce->size = sizeof *ce + sizeof *ce->pk + nbits_from_pk(pk) / 4;
+
+  while (pk_cache_lru_tail &&
+         pk_cache_stats.bytes + ce->size > PK_CACHE_BUDGET) {
+    pk_cache_drop(pk_cache_lru_tail);
+    pk_cache_stats.evictions++;
+  }
+
+  ce->next = pk_cache[pk_cache_bucket(keyid)];
+  pk_cache[pk_cache_bucket(keyid)] = ce;
+  lru_push(ce, &pk_cache_lru_head, &pk_cache_lru_tail);
+  pk_cache_stats.count++;
+  pk_cache_stats.bytes += ce->size;
 }
 
 /* Return a const utf-8 string with the text "[User ID not found]".
@@ -230,6 +316,70 @@ static void release_keyid_list(keyid_list_t k) {
   }
 }
 
+static unsigned int uid_cache_kid_bucket(const u32 *keyid) {
+  return keyid[1] & (UID_CACHE_BUCKETS - 1);
+}
+
+static unsigned int uid_cache_fpr_bucket(const char *fpr) {
+  return (((byte)fpr[MAX_FINGERPRINT_LEN - 2] << 8) |
+          (byte)fpr[MAX_FINGERPRINT_LEN - 1]) &
+         (UID_CACHE_BUCKETS - 1);
+}
+
+/* Return the user ID cache entry for the key with KEYID, or NULL.  A
+   found entry becomes the most recently used one.  */
+static user_id_db_t uid_cache_lookup_kid(const u32 *keyid) {
+  keyid_list_t a;
+
+  for (a = uid_cache_by_kid[uid_cache_kid_bucket(keyid)]; a; a = a->kid_next)
+    if (a->keyid[0] == keyid[0] && a->keyid[1] == keyid[1]) {
+      lru_touch(a->owner, &uid_cache_lru_head, &uid_cache_lru_tail);
+      uid_cache_stats.hits++;
+      return a->owner;
+    }
+  uid_cache_stats.misses++;
+  return NULL;
+}
+
+/* Return the user ID cache entry for the key with the fingerprint
+   FPR, or NULL.  If TOUCH is set, a found entry becomes the most
+   recently used one and the lookup is counted.  */
+static user_id_db_t uid_cache_lookup_fpr(const char *fpr, int touch) {
+  keyid_list_t a;
+
+  for (a = uid_cache_by_fpr[uid_cache_fpr_bucket(fpr)]; a; a = a->fpr_next)
+    if (!memcmp(a->fpr, fpr, MAX_FINGERPRINT_LEN)) {
+      if (touch) {
+        lru_touch(a->owner, &uid_cache_lru_head, &uid_cache_lru_tail);
+        uid_cache_stats.hits++;
+      }
+      return a->owner;
+    }
+  if (touch) uid_cache_stats.misses++;
+  return NULL;
+}
+
+/* Remove the entry R from the user ID cache and release it.  */
+static void uid_cache_drop(user_id_db_t r) {
+  keyid_list_t a, *pp;
+
+  for (a = r->keyids; a; a = a->next) {
+    for (pp = &uid_cache_by_kid[uid_cache_kid_bucket(a->keyid)]; *pp != a;
+         pp = &(*pp)->kid_next)
+      ;
+    *pp = a->kid_next;
+    for (pp = &uid_cache_by_fpr[uid_cache_fpr_bucket(a->fpr)]; *pp != a;
+         pp = &(*pp)->fpr_next)
+      ;
+    *pp = a->fpr_next;
+  }
+  lru_unlink(r, &uid_cache_lru_head, &uid_cache_lru_tail);
+  uid_cache_stats.count--;
+  uid_cache_stats.bytes -= r->size;
+  release_keyid_list(r->keyids);
+  xfree(r);
+}
+
 /****************
  * Store the association of keyid and userid
  * Feed only public keys to this function.
@@ -239,76 +389,80 @@ static void cache_user_id(KBNODE keyblock) {
   const char *uid;
   size_t uidlen;
   keyid_list_t keyids = NULL;
+  keyid_list_t a;
   KBNODE k;
+  size_t size;
 
+  size = 0;
   for (k = keyblock; k; k = k->next) {
     if (k->pkt->pkttype == PKT_PUBLIC_KEY ||
         k->pkt->pkttype == PKT_PUBLIC_SUBKEY) {
-      keyid_list_t a = (keyid_list_t)xmalloc_clear(sizeof *a);
+      a = (keyid_list_t)xmalloc_clear(sizeof *a);
       /* Hmmm: For a long list of keyids it might be an advantage
        * to append the keys.  */
       fingerprint_from_pk(k->pkt->pkt.public_key, (byte *)(a->fpr), NULL);
       keyid_from_pk(k->pkt->pkt.public_key, a->keyid);
       /* First check for duplicates.  */
-      for (r = user_id_db; r; r = r->next) {
-        keyid_list_t b;
-
-        for (b = r->keyids; b; b = b->next) {
-          if (!memcmp(b->fpr, a->fpr, MAX_FINGERPRINT_LEN)) {
-            if (DBG_CACHE) log_debug("cache_user_id: already in cache\n");
-            release_keyid_list(keyids);
-            xfree(a);
-            return;
-          }
-        }
+      if (uid_cache_lookup_fpr(a->fpr, 0)) {
+        if (DBG_CACHE) log_debug("cache_user_id: already in cache\n");
+        release_keyid_list(keyids);
+        xfree(a);
+        return;
       }
       /* Now put it into the cache.  */
       a->next = keyids;
       keyids = a;
+      size += sizeof *a;
     }
   }
   if (!keyids) BUG(); /* No key no fun.  */
 
   uid = get_primary_uid(keyblock, &uidlen);
+  size += sizeof *r + uidlen;
 
-  if (uid_cache_entries >= MAX_UID_CACHE_ENTRIES) {
-    /* fixme: use another algorithm to free some cache slots */
-    r = user_id_db;
-    user_id_db = r->next;
-    release_keyid_list(r->keyids);
-    xfree(r);
-    uid_cache_entries--;
+  while (uid_cache_lru_tail && uid_cache_stats.bytes + size > UID_CACHE_BUDGET) {
+    uid_cache_drop(uid_cache_lru_tail);
+    uid_cache_stats.evictions++;
   }
+
   r = (user_id_db_t)xmalloc(sizeof *r + uidlen - 1);
   r->keyids = keyids;
   r->len = uidlen;
+  r->size = size;
   memcpy(r->name, uid, r->len);
-  r->next = user_id_db;
-  user_id_db = r;
-  uid_cache_entries++;
+  for (a = keyids; a; a = a->next) {
+    a->owner = r;
+    a->kid_next = uid_cache_by_kid[uid_cache_kid_bucket(a->keyid)];
+    uid_cache_by_kid[uid_cache_kid_bucket(a->keyid)] = a;
+    a->fpr_next = uid_cache_by_fpr[uid_cache_fpr_bucket(a->fpr)];
+    uid_cache_by_fpr[uid_cache_fpr_bucket(a->fpr)] = a;
+  }
+  lru_push(r, &uid_cache_lru_head, &uid_cache_lru_tail);
+  uid_cache_stats.count++;
+  uid_cache_stats.bytes += size;
 }
 
 /* Disable and drop the public key cache (which is filled by
    cache_public_key and get_pubkey).  Note: there is currently no way
    to re-enable this cache.  */
 void getkey_disable_caches() {
-#if MAX_PK_CACHE_ENTRIES
-  {
-    pk_cache_entry_t ce, ce2;
-
-    for (ce = pk_cache; ce; ce = ce2) {
-      ce2 = ce->next;
-      free_public_key(ce->pk);
-      xfree(ce);
-    }
-    pk_cache_disabled = 1;
-    pk_cache_entries = 0;
-    pk_cache = NULL;
-  }
-#endif
+  while (pk_cache_lru_tail) pk_cache_drop(pk_cache_lru_tail);
+  pk_cache_disabled = 1;
   /* fixme: disable user id cache ? */
 }
 
+/* Print statistics about the public key and user ID caches.  */
+void getkey_dump_stats(void) {
+  log_info("pk_cache: count=%u bytes=%lu hits=%u misses=%u evictions=%u\n",
+           pk_cache_stats.count, (unsigned long)pk_cache_stats.bytes,
+           pk_cache_stats.hits, pk_cache_stats.misses,
+           pk_cache_stats.evictions);
+  log_info("uid_cache: count=%u bytes=%lu hits=%u misses=%u evictions=%u\n",
+           uid_cache_stats.count, (unsigned long)uid_cache_stats.bytes,
+           uid_cache_stats.hits, uid_cache_stats.misses,
+           uid_cache_stats.evictions);
+}
+
 void pubkey_free(pubkey_t key) {
   if (key) {
     xfree(key->pk);
@@ -593,23 +747,19 @@ int get_pubkey(ctrl_t ctrl, PKT_public_key *pk, u32 *keyid) {
   int internal = 0;
   int rc = 0;
 
-#if MAX_PK_CACHE_ENTRIES
   if (pk) {
     /* Try to get it from the cache.  We don't do this when pk is
        NULL as it does not guarantee that the user IDs are
        cached. */
-    pk_cache_entry_t ce;
-    for (ce = pk_cache; ce; ce = ce->next) {
-      if (ce->keyid[0] == keyid[0] && ce->keyid[1] == keyid[1])
-      /* XXX: We don't check PK->REQ_USAGE here, but if we don't
-         read from the cache, we do check it!  */
-      {
-        copy_public_key(pk, ce->pk);
-        return 0;
-      }
+    pk_cache_entry_t ce = pk_cache_lookup(keyid);
+    if (ce)
+    /* XXX: We don't check PK->REQ_USAGE here, but if we don't
+       read from the cache, we do check it!  */
+    {
+      copy_public_key(pk, ce->pk);
+      return 0;
     }
   }
-#endif
   /* More init stuff.  */
   if (!pk) {
     pk = (PKT_public_key *)xmalloc_clear(sizeof *pk);
@@ -676,22 +826,18 @@ int get_pubkey_fast(PKT_public_key *pk, u32 *keyid) {
   u32 pkid[2];
 
   log_assert(pk);
-#if MAX_PK_CACHE_ENTRIES
   {
     /* Try to get it from the cache */
-    pk_cache_entry_t ce;
-
-    for (ce = pk_cache; ce; ce = ce->next) {
-      if (ce->keyid[0] == keyid[0] && ce->keyid[1] == keyid[1]
-          /* Only consider primary keys.  */
-          && ce->pk->keyid[0] == ce->pk->main_keyid[0] &&
-          ce->pk->keyid[1] == ce->pk->main_keyid[1]) {
-        if (pk) copy_public_key(pk, ce->pk);
-        return 0;
-      }
+    pk_cache_entry_t ce = pk_cache_lookup(keyid);
+
+    if (ce
+        /* Only consider primary keys.  */
+        && ce->pk->keyid[0] == ce->pk->main_keyid[0] &&
+        ce->pk->keyid[1] == ce->pk->main_keyid[1]) {
+      if (pk) copy_public_key(pk, ce->pk);
+      return 0;
     }
   }
-#endif
 
   hd = keydb_new();
   if (!hd) return gpg_error_from_syserror();
@@ -2755,7 +2901,8 @@ static void merge_selfsigs_subkey(ctrl_t ctrl, kbnode_t keyblock,
    See documentation for merge_selfsigs_main, merge_selfsigs_subkey
    and fixup_uidnode for exactly which fields are updated.  */
 static void merge_selfsigs(ctrl_t ctrl, kbnode_t keyblock) {
-  KBNODE k;
+  kbnode_view_t view;
+  struct kbnode_view_item *item, *end;
   int revoked;
   struct revoke_info rinfo;
   PKT_public_key *main_pk;
@@ -2774,12 +2921,20 @@ static void merge_selfsigs(ctrl_t ctrl, kbnode_t keyblock) {
     BUG();
   }
 
+  /* Verify the self-signatures up front, using all CPUs.  */
+  check_self_sigs_batch(ctrl, keyblock);
+
   merge_selfsigs_main(ctrl, keyblock, &revoked, &rinfo);
 
+  /* The remaining passes don't change the structure of the keyblock,
+     so they can use an array instead of chasing the list.  */
+  view = kbnode_view_new(keyblock);
+  end = view->items + view->count;
+
   /* Now merge in the data from each of the subkeys.  */
-  for (k = keyblock; k; k = k->next) {
-    if (k->pkt->pkttype == PKT_PUBLIC_SUBKEY) {
-      merge_selfsigs_subkey(ctrl, keyblock, k);
+  for (item = view->items; item != end; item++) {
+    if (item->pkttype == PKT_PUBLIC_SUBKEY) {
+      merge_selfsigs_subkey(ctrl, keyblock, item->node);
     }
   }
 
@@ -2788,10 +2943,10 @@ static void merge_selfsigs(ctrl_t ctrl, kbnode_t keyblock) {
     /* If the primary key is revoked, expired, or invalid we
      * better set the appropriate flags on that key and all
      * subkeys.  */
-    for (k = keyblock; k; k = k->next) {
-      if (k->pkt->pkttype == PKT_PUBLIC_KEY ||
-          k->pkt->pkttype == PKT_PUBLIC_SUBKEY) {
-        PKT_public_key *pk = k->pkt->pkt.public_key;
+    for (item = view->items; item != end; item++) {
+      if (item->pkttype == PKT_PUBLIC_KEY ||
+          item->pkttype == PKT_PUBLIC_SUBKEY) {
+        PKT_public_key *pk = item->pkt->pkt.public_key;
         if (!main_pk->flags.valid) pk->flags.valid = 0;
         if (revoked && !pk->flags.revoked) {
           pk->flags.revoked = revoked;
@@ -2800,6 +2955,7 @@ static void merge_selfsigs(ctrl_t ctrl, kbnode_t keyblock) {
         if (main_pk->has_expired) pk->has_expired = main_pk->has_expired;
       }
     }
+    kbnode_view_release(view);
     return;
   }
 
@@ -2813,23 +2969,25 @@ static void merge_selfsigs(ctrl_t ctrl, kbnode_t keyblock) {
    * Do a similar thing for the MDC feature flag.  */
   std::vector<prefitem_t> prefs;
   mdc_feature = 0;
-  for (k = keyblock; k && k->pkt->pkttype != PKT_PUBLIC_SUBKEY; k = k->next) {
-    if (k->pkt->pkttype == PKT_USER_ID && !k->pkt->pkt.user_id->attrib_data &&
-        k->pkt->pkt.user_id->flags.primary) {
-      prefs = *(k->pkt->pkt.user_id->prefs);
-      mdc_feature = k->pkt->pkt.user_id->flags.mdc;
+  for (item = view->items;
+       item != end && item->pkttype != PKT_PUBLIC_SUBKEY; item++) {
+    if (item->pkttype == PKT_USER_ID && !item->pkt->pkt.user_id->attrib_data &&
+        item->pkt->pkt.user_id->flags.primary) {
+      prefs = *(item->pkt->pkt.user_id->prefs);
+      mdc_feature = item->pkt->pkt.user_id->flags.mdc;
       break;
     }
   }
-  for (k = keyblock; k; k = k->next) {
-    if (k->pkt->pkttype == PKT_PUBLIC_KEY ||
-        k->pkt->pkttype == PKT_PUBLIC_SUBKEY) {
-      PKT_public_key *pk = k->pkt->pkt.public_key;
+  for (item = view->items; item != end; item++) {
+    if (item->pkttype == PKT_PUBLIC_KEY ||
+        item->pkttype == PKT_PUBLIC_SUBKEY) {
+      PKT_public_key *pk = item->pkt->pkt.public_key;
       if (pk->prefs) delete pk->prefs;
       pk->prefs = new std::vector<prefitem_t>(prefs);
       pk->flags.mdc = mdc_feature;
     }
   }
+  kbnode_view_release(view);
 }
 
 /* See whether the key satisfies any additional requirements specified
@@ -3403,34 +3561,30 @@ gpg_error_t get_seckey_default_or_card(ctrl_t ctrl, PKT_public_key *pk,
 static char *get_user_id_string(ctrl_t ctrl, u32 *keyid, int mode,
                                 size_t *r_len) {
   user_id_db_t r;
-  keyid_list_t a;
   int pass = 0;
   char *p;
 
   /* Try it two times; second pass reads from the database.  */
   do {
-    for (r = user_id_db; r; r = r->next) {
-      for (a = r->keyids; a; a = a->next) {
-        if (a->keyid[0] == keyid[0] && a->keyid[1] == keyid[1]) {
-          if (mode == 2) {
-            /* An empty string as user id is possible.  Make
-               sure that the malloc allocates one byte and
-               does not bail out.  */
-            p = (char *)xmalloc(r->len ? r->len : 1);
-            memcpy(p, r->name, r->len);
-            if (r_len) *r_len = r->len;
-          } else {
-            if (mode)
-              p = xasprintf("%08lX%08lX %.*s", (unsigned long)keyid[0],
-                            (unsigned long)keyid[1], r->len, r->name);
-            else
-              p = xasprintf("%s %.*s", keystr(keyid), r->len, r->name);
-            if (r_len) *r_len = strlen(p);
-          }
-
-          return p;
-        }
+    r = uid_cache_lookup_kid(keyid);
+    if (r) {
+      if (mode == 2) {
+        /* An empty string as user id is possible.  Make
+           sure that the malloc allocates one byte and
+           does not bail out.  */
+        p = (char *)xmalloc(r->len ? r->len : 1);
+        memcpy(p, r->name, r->len);
+        if (r_len) *r_len = r->len;
+      } else {
+        if (mode)
+          p = xasprintf("%08lX%08lX %.*s", (unsigned long)keyid[0],
+                        (unsigned long)keyid[1], r->len, r->name);
+        else
+          p = xasprintf("%s %.*s", keystr(keyid), r->len, r->name);
+        if (r_len) *r_len = strlen(p);
       }
+
+      return p;
     }
   } while (++pass < 2 && !get_pubkey(ctrl, NULL, keyid));
 
@@ -3483,19 +3637,15 @@ char *get_user_id_byfpr(ctrl_t ctrl, const byte *fpr, size_t *rn) {
 
   /* Try it two times; second pass reads from the database.  */
   do {
-    for (r = user_id_db; r; r = r->next) {
-      keyid_list_t a;
-      for (a = r->keyids; a; a = a->next) {
-        if (!memcmp(a->fpr, fpr, MAX_FINGERPRINT_LEN)) {
-          /* An empty string as user id is possible.  Make
-             sure that the malloc allocates one byte and does
-             not bail out.  */
-          p = (char *)xmalloc(r->len ? r->len : 1);
-          memcpy(p, r->name, r->len);
-          *rn = r->len;
-          return p;
-        }
-      }
+    r = uid_cache_lookup_fpr((const char *)fpr, 1);
+    if (r) {
+      /* An empty string as user id is possible.  Make
+         sure that the malloc allocates one byte and does
+         not bail out.  */
+      p = (char *)xmalloc(r->len ? r->len : 1);
+      memcpy(p, r->name, r->len);
+      *rn = r->len;
+      return p;
     }
   } while (++pass < 2 &&
            !get_pubkey_byfprint(ctrl, NULL, NULL, fpr, MAX_FINGERPRINT_LEN));
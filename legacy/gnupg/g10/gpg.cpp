@@ -130,6 +130,7 @@ enum cmd_and_opt_values {
   aQuickRevUid,
   aQuickSetExpire,
   aQuickSetPrimaryUid,
+  aQuickBatchEdit,
   aListPackets,
   aEditKey,
   aDeleteKeys,
@@ -163,9 +164,13 @@ enum cmd_and_opt_values {
   aCardEdit,
   aChangePIN,
   aPasswd,
+  aCompactKeyDB,
+  aServer,
 
   oMimemode,
   oNoTextmode,
+  oAsyncIO,
+  oThreadedFilters,
   oExpert,
   oNoExpert,
   oDefSigExpire,
@@ -183,6 +188,7 @@ enum cmd_and_opt_values {
   oWithSubkeyFingerprint,
   oWithICAOSpelling,
   oWithKeygrip,
+  oFastListMode,
   oWithSecret,
   oWithColons,
   oWithKeyData,
@@ -220,9 +226,12 @@ enum cmd_and_opt_values {
   oPGP8,
   oDE_VS,
   oCipherAlgo,
+  oAEADAlgo,
+  oChunkSize,
   oDigestAlgo,
   oCertDigestAlgo,
   oCompressAlgo,
+  oCompressThreads,
   oPassphrase,
   oPassphraseFD,
   oPassphraseFile,
@@ -262,6 +271,7 @@ enum cmd_and_opt_values {
   oKeyServerOptions,
   oImportOptions,
   oImportFilter,
+  oImportMaxUidSigs,
   oExportOptions,
   oExportFilter,
   oListOptions,
@@ -293,6 +303,8 @@ enum cmd_and_opt_values {
   oTryAllSecrets,
   oTrustedKey,
   oNoSigCache,
+  oNoRecipientCache,
+  oLegacyPacketParser,
   oAutoCheckTrustDB,
   oNoAutoCheckTrustDB,
   oPreservePermissions,
@@ -370,6 +382,8 @@ const static ARGPARSE_OPTS opts[] = {
     ARGPARSE_c(aQuickSetExpire, "quick-set-expire",
                N_("quickly set a new expiration date")),
     ARGPARSE_c(aQuickSetPrimaryUid, "quick-set-primary-uid", "@"),
+    ARGPARSE_c(aQuickBatchEdit, "quick-batch-edit",
+               N_("apply a list of quick key edits")),
     ARGPARSE_c(aFullKeygen, "full-generate-key",
                N_("full featured key pair generation")),
     ARGPARSE_c(aFullKeygen, "full-gen-key", "@"),
@@ -413,6 +427,8 @@ const static ARGPARSE_OPTS opts[] = {
     ARGPARSE_c(aChangePIN, "change-pin", N_("change a card's PIN")),
 #endif
     ARGPARSE_c(aListPackets, "list-packets", "@"),
+    ARGPARSE_c(aCompactKeyDB, "compact-keydb", "@"),
+    ARGPARSE_c(aServer, "server", N_("run in server mode")),
 
 #ifndef NO_TRUST_MODELS
     ARGPARSE_c(aExportOwnerTrust, "export-ownertrust", "@"),
@@ -449,6 +465,8 @@ const static ARGPARSE_OPTS opts[] = {
     ARGPARSE_s_n(oMimemode, "mimemode", "@"),
     ARGPARSE_s_n(oTextmode, "textmode", N_("use canonical text mode")),
     ARGPARSE_s_n(oNoTextmode, "no-textmode", "@"),
+    ARGPARSE_s_n(oAsyncIO, "async-io", "@"),
+    ARGPARSE_s_n(oThreadedFilters, "threaded-filters", "@"),
 
     ARGPARSE_s_n(oExpert, "expert", "@"),
     ARGPARSE_s_n(oNoExpert, "no-expert", "@"),
@@ -485,6 +503,7 @@ const static ARGPARSE_OPTS opts[] = {
     ARGPARSE_s_s(oKeyServerOptions, "keyserver-options", "@"),
     ARGPARSE_s_s(oImportOptions, "import-options", "@"),
     ARGPARSE_s_s(oImportFilter, "import-filter", "@"),
+    ARGPARSE_s_i(oImportMaxUidSigs, "import-max-uid-sigs", "@"),
     ARGPARSE_s_s(oExportOptions, "export-options", "@"),
     ARGPARSE_s_s(oExportFilter, "export-filter", "@"),
     ARGPARSE_s_s(oListOptions, "list-options", "@"),
@@ -521,8 +540,13 @@ const static ARGPARSE_OPTS opts[] = {
     ARGPARSE_s_s(oS2KCipher, "s2k-cipher-algo", "@"),
     ARGPARSE_s_i(oS2KCount, "s2k-count", "@"),
     ARGPARSE_s_s(oCipherAlgo, "cipher-algo", "@"),
+    ARGPARSE_s_s(oAEADAlgo, "aead-algo", "@"),
+    ARGPARSE_s_i(oChunkSize, "chunk-size", "@"),
     ARGPARSE_s_s(oDigestAlgo, "digest-algo", "@"),
     ARGPARSE_s_s(oCertDigestAlgo, "cert-digest-algo", "@"),
+    ARGPARSE_s_i(oCompress, "compress-level",
+                 N_("|N|set compress level to N (0 disables)")),
+    ARGPARSE_s_i(oCompressThreads, "compress-threads", "@"),
     ARGPARSE_s_s(oCompressAlgo, "compress-algo", "@"),
     ARGPARSE_s_s(oCompressAlgo, "compression-algo", "@"), /* Alias */
     ARGPARSE_s_n(oThrowKeyids, "throw-keyids", "@"),
@@ -603,6 +627,7 @@ const static ARGPARSE_OPTS opts[] = {
     ARGPARSE_s_n(oWithSubkeyFingerprint, "with-subkey-fingerprints", "@"),
     ARGPARSE_s_n(oWithICAOSpelling, "with-icao-spelling", "@"),
     ARGPARSE_s_n(oWithKeygrip, "with-keygrip", "@"),
+    ARGPARSE_s_n(oFastListMode, "fast-list-mode", "@"),
     ARGPARSE_s_n(oWithSecret, "with-secret", "@"),
     ARGPARSE_s_s(oDisableCipherAlgo, "disable-cipher-algo", "@"),
     ARGPARSE_s_s(oDisablePubkeyAlgo, "disable-pubkey-algo", "@"),
@@ -618,6 +643,8 @@ const static ARGPARSE_OPTS opts[] = {
     ARGPARSE_s_n(oAutoKeyRetrieve, "auto-key-retrieve", "@"),
     ARGPARSE_s_n(oNoAutoKeyRetrieve, "no-auto-key-retrieve", "@"),
     ARGPARSE_s_n(oNoSigCache, "no-sig-cache", "@"),
+    ARGPARSE_s_n(oNoRecipientCache, "no-recipient-cache", "@"),
+    ARGPARSE_s_n(oLegacyPacketParser, "legacy-packet-parser", "@"),
     ARGPARSE_s_n(oMergeOnly, "merge-only", "@"),
     ARGPARSE_s_n(oTryAllSecrets, "try-all-secrets", "@"),
     ARGPARSE_s_n(oPreservePermissions, "preserve-permissions", "@"),
@@ -1502,6 +1529,7 @@ int gpg_main(int argc, char **argv) {
   const char *trustdb_name = NULL;
 #endif /*!NO_TRUST_MODELS*/
   char *def_cipher_string = NULL;
+  char *def_aead_string = NULL;
   char *def_digest_string = NULL;
   char *compress_algo_string = NULL;
   char *cert_digest_string = NULL;
@@ -1678,6 +1706,7 @@ next_pass:
       case aQuickRevUid:
       case aQuickSetExpire:
       case aQuickSetPrimaryUid:
+      case aQuickBatchEdit:
       case aExportOwnerTrust:
       case aImportOwnerTrust:
       case aKeygen:
@@ -1687,6 +1716,8 @@ next_pass:
       case aDeleteSecretAndPublicKeys:
       case aDeleteKeys:
       case aPasswd:
+      case aCompactKeyDB:
+      case aServer:
         set_cmd(&cmd, (cmd_and_opt_values)(pargs.r_opt));
         break;
 
@@ -1827,6 +1858,10 @@ next_pass:
         opt.with_keygrip = true;
         break;
 
+      case oFastListMode:
+        opt.fast_list_mode = true;
+        break;
+
       case oWithSecret:
         opt.with_secret = true;
         break;
@@ -2067,6 +2102,14 @@ next_pass:
         opt.mimemode = false;
         break;
 
+      case oAsyncIO:
+        opt.async_io = true;
+        break;
+
+      case oThreadedFilters:
+        opt.threaded_filters = true;
+        break;
+
       case oExpert:
         opt.expert = true;
         break;
@@ -2162,9 +2205,21 @@ next_pass:
       case oCipherAlgo:
         def_cipher_string = xstrdup(pargs.r.ret_str);
         break;
+      case oAEADAlgo:
+        def_aead_string = xstrdup(pargs.r.ret_str);
+        break;
+      case oChunkSize:
+        opt.chunk_size = pargs.r.ret_int;
+        break;
       case oDigestAlgo:
         def_digest_string = xstrdup(pargs.r.ret_str);
         break;
+      case oCompress:
+        opt.compress_level = pargs.r.ret_int;
+        break;
+      case oCompressThreads:
+        opt.compress_threads = pargs.r.ret_int;
+        break;
       case oCompressAlgo:
         /* If it is all digits, stick a Z in front of it for
            later.  This is for backwards compatibility with
@@ -2231,6 +2286,9 @@ next_pass:
         rc = parse_and_set_import_filter(pargs.r.ret_str);
         if (rc) log_error(_("invalid filter option: %s\n"), gpg_strerror(rc));
         break;
+      case oImportMaxUidSigs:
+        opt.import_max_uid_sigs = pargs.r.ret_int < 0 ? 0 : pargs.r.ret_int;
+        break;
       case oExportOptions:
         if (!parse_export_options(pargs.r.ret_str, &opt.export_options, 1)) {
           if (configname)
@@ -2310,6 +2368,12 @@ next_pass:
       case oNoSigCache:
         opt.no_sig_cache = true;
         break;
+      case oNoRecipientCache:
+        opt.no_recipient_cache = true;
+        break;
+      case oLegacyPacketParser:
+        opt.legacy_packet_parser = true;
+        break;
 
       case oAllowFreeformUID:
         opt.allow_freeform_uid = true;
@@ -2611,6 +2675,17 @@ next_pass:
     if (openpgp_cipher_test_algo((cipher_algo_t)(opt.def_cipher_algo)))
       log_error(_("selected cipher algorithm is invalid\n"));
   }
+  if (def_aead_string) {
+    opt.def_aead_algo = string_to_aead_algo(def_aead_string);
+    if (!opt.def_aead_algo)
+      log_error(_("selected AEAD algorithm is invalid\n"));
+    xfree(def_aead_string);
+    def_aead_string = NULL;
+  }
+  if (opt.chunk_size < 6 || opt.chunk_size > 22) {
+    opt.chunk_size = opt.chunk_size < 6 ? 6 : 22;
+    log_info(_("chunk size invalid - using %d\n"), opt.chunk_size);
+  }
   if (def_digest_string) {
     opt.def_digest_algo = string_to_digest_algo(def_digest_string);
     xfree(def_digest_string);
@@ -2625,6 +2700,12 @@ next_pass:
     if (check_compress_algo(opt.compress_algo))
       log_error(_("selected compression algorithm is invalid\n"));
   }
+  if (!opt.compress_level) opt.compress_algo = COMPRESS_ALGO_NONE;
+  if (opt.compress_threads < 0) {
+    opt.compress_threads = 1;
+    log_info(_("invalid number of compression threads - using %d\n"),
+             opt.compress_threads);
+  }
   if (cert_digest_string) {
     opt.cert_digest_algo = string_to_digest_algo(cert_digest_string);
     xfree(cert_digest_string);
@@ -2689,7 +2770,7 @@ next_pass:
 
     switch (cmd) {
       case aSign:
-        cmdname = "--sign";
+        cmdname = detached_sig ? NULL : "--sign";
         break;
       case aSignEncr:
         cmdname = "--sign --encrypt";
@@ -2929,6 +3010,10 @@ next_pass:
     case aSign: /* sign the given file */
     {
       std::vector<std::string> filenames;
+      if (multifile) { /* sign each file on its own */
+        sign_files_detached(ctrl, argc, argv, locusr);
+        break;
+      }
       if (detached_sig) { /* sign all files */
         for (; argc; argc--, argv++) filenames.emplace_back(*argv);
       } else {
@@ -3239,6 +3324,11 @@ next_pass:
       keyedit_quick_set_primary(ctrl, uid, primaryuid);
     } break;
 
+    case aQuickBatchEdit:
+      if (argc > 1) wrong_args("--quick-batch-edit [FILE]");
+      keyedit_quick_batch(ctrl, argc ? *argv : NULL);
+      break;
+
     case aFastImport:
       opt.import_options |= IMPORT_FAST; /* fall through */
     case aImport:
@@ -3393,6 +3483,26 @@ next_pass:
       break;
 #endif /*!NO_TRUST_MODELS*/
 
+    case aCompactKeyDB: {
+      KEYDB_HANDLE hd;
+
+      if (argc) wrong_args("--compact-keydb");
+      hd = keydb_new();
+      if (hd) {
+        rc = keydb_compact(hd);
+        if (rc)
+          log_error(_("compacting the keyring failed: %s\n"),
+                    gpg_strerror(rc));
+        keydb_release(hd);
+      }
+    } break;
+
+    case aServer:
+      if (argc) wrong_args("--server");
+      if ((rc = gpg_server(ctrl)))
+        log_error("server mode failed: %s\n", gpg_strerror(rc));
+      break;
+
 #ifdef ENABLE_CARD_SUPPORT
     case aCardStatus:
       if (argc == 0)
@@ -3476,6 +3586,7 @@ next_pass:
 }
 
 void g10_exit(int rc) {
+  flush_status();
   if (DBG_CLOCK) log_clock("stop");
 
   if ((opt.debug & DBG_MEMSTAT_VALUE)) {
@@ -41,6 +41,11 @@
 #include "packet.h"
 #include "trustdb.h"
 
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
 struct import_stats_s {
   unsigned long count;
   unsigned long no_user_id;
@@ -162,6 +167,9 @@ int parse_import_options(char *str, unsigned int *options, int noisy) {
 
       {"repair-keys", IMPORT_REPAIR_KEYS, NULL, N_("repair keys on import")},
 
+      {"import-bulk", IMPORT_BULK, NULL,
+       N_("import many keys at once while holding the keyring lock")},
+
       /* Aliases for backward compatibility */
       {"allow-local-sigs", IMPORT_LOCAL_SIGS, NULL, NULL},
       {"repair-hkp-subkey-bug", IMPORT_REPAIR_PKS_SUBKEY_BUG, NULL, NULL},
@@ -454,6 +462,42 @@ int import_keys_es_stream(ctrl_t ctrl, estream_t fp,
   return rc;
 }
 
+/* The number of key blocks which are read ahead and verified
+   together with --import-options import-bulk.  */
+#define IMPORT_BULK_KEYS 64
+
+/* Import the single KEYBLOCK read by read_block.  */
+static int import_block(ctrl_t ctrl, kbnode_t keyblock,
+                        struct import_stats_s *stats, unsigned char **fpr,
+                        size_t *fpr_len, unsigned int options,
+                        import_screener_t screener, void *screener_arg) {
+  int rc = 0;
+
+  if (keyblock->pkt->pkttype == PKT_PUBLIC_KEY)
+    rc = import_one(ctrl, keyblock, stats, fpr, fpr_len, options, 0, 0,
+                    screener, screener_arg);
+  else if (keyblock->pkt->pkttype == PKT_SECRET_KEY)
+    rc = import_secret_one(ctrl, keyblock, stats, opt.batch, options, 0,
+                           screener, screener_arg);
+  else if (keyblock->pkt->pkttype == PKT_SIGNATURE &&
+           keyblock->pkt->pkt.signature->sig_class == 0x20)
+    rc = import_revoke_cert(ctrl, keyblock, stats);
+  else {
+    log_info(_("skipping block of type %d\n"), keyblock->pkt->pkttype);
+  }
+  return rc;
+}
+
+/*
+ * Import all key blocks from INP.  Usually the key blocks are read
+ * and imported one after the other.  With IMPORT_BULK a pipeline is
+ * used instead: up to IMPORT_BULK_KEYS key blocks are read, their
+ * self-signatures are verified in parallel and then they are merged
+ * and written one after the other.  The keyring lock is taken once
+ * for the whole import, the keyboxes are only appended to and
+ * compacted or reindexed at the end.  The trustdb is checked once
+ * after the import anyway.
+ */
 static int import(ctrl_t ctrl, IOBUF inp, const char *fname,
                   struct import_stats_s *stats, unsigned char **fpr,
                   size_t *fpr_len, unsigned int options,
@@ -462,6 +506,10 @@ static int import(ctrl_t ctrl, IOBUF inp, const char *fname,
   kbnode_t keyblock = NULL; /* Need to initialize because gcc can't
                                grasp the return semantics of
                                read_block. */
+  std::vector<kbnode_t> batch;
+  size_t nbatch = 1, i;
+  KEYDB_HANDLE lock_hd = NULL;
+  u32 start_time = make_timestamp();
   int rc = 0;
   int v3keys;
 
@@ -477,36 +525,74 @@ static int import(ctrl_t ctrl, IOBUF inp, const char *fname,
     release_armor_context(afx);
   }
 
-  while (!(rc = read_block(inp, !!(options & IMPORT_RESTORE), &pending_pkt,
-                           &keyblock, &v3keys))) {
-    stats->v3keys += v3keys;
-    if (keyblock->pkt->pkttype == PKT_PUBLIC_KEY)
-      rc = import_one(ctrl, keyblock, stats, fpr, fpr_len, options, 0, 0,
-                      screener, screener_arg);
-    else if (keyblock->pkt->pkttype == PKT_SECRET_KEY)
-      rc = import_secret_one(ctrl, keyblock, stats, opt.batch, options, 0,
-                             screener, screener_arg);
-    else if (keyblock->pkt->pkttype == PKT_SIGNATURE &&
-             keyblock->pkt->pkt.signature->sig_class == 0x20)
-      rc = import_revoke_cert(ctrl, keyblock, stats);
-    else {
-      log_info(_("skipping block of type %d\n"), keyblock->pkt->pkttype);
+  if ((options & IMPORT_BULK) && !opt.interactive) {
+    nbatch = IMPORT_BULK_KEYS;
+    lock_hd = keydb_new();
+    if (lock_hd && keydb_hold_lock(lock_hd)) {
+      keydb_release(lock_hd);
+      lock_hd = NULL;
     }
-    release_kbnode(keyblock);
+    /* While we hold the lock, the keyboxes are only appended to.  */
+    if (lock_hd && keydb_set_append_only(lock_hd, 1))
+      keydb_set_append_only(lock_hd, 0);
+  }
+
+  while (!rc) {
+    /* Parse.  */
+    while (batch.size() < nbatch &&
+           !(rc = read_block(inp, !!(options & IMPORT_RESTORE), &pending_pkt,
+                             &keyblock, &v3keys))) {
+      stats->v3keys += v3keys;
+      batch.push_back(keyblock);
+    }
+    if (rc) stats->v3keys += v3keys;
 
-    /* fixme: we should increment the not imported counter but
-       this does only make sense if we keep on going despite of
-       errors.  For now we do this only if the imported key is too
-       large. */
-    if (rc == GPG_ERR_TOO_LARGE) {
-      stats->not_imported++;
-    } else if (rc)
-      break;
+    /* Verify the self-signatures.  The repair of the PKS bug moves
+       signatures to other subkeys and thus needs to come first.  */
+    if (batch.size() > 1 && !(options & IMPORT_REPAIR_PKS_SUBKEY_BUG))
+      check_self_sigs_bulk(ctrl, batch.data(), batch.size());
+
+    /* Merge and write.  */
+    for (i = 0; i < batch.size(); i++) {
+      int rc2;
+
+      if (rc && rc != -1) {
+        /* Stop at the first error.  */
+        release_kbnode(batch[i]);
+        continue;
+      }
+
+      rc2 = import_block(ctrl, batch[i], stats, fpr, fpr_len, options,
+                         screener, screener_arg);
+      release_kbnode(batch[i]);
+
+      /* fixme: we should increment the not imported counter but
+         this does only make sense if we keep on going despite of
+         errors.  For now we do this only if the imported key is too
+         large. */
+      if (rc2 == GPG_ERR_TOO_LARGE) {
+        stats->not_imported++;
+      } else if (rc2) {
+        rc = rc2;
+        continue;
+      }
 
-    if (!(++stats->count % 100) && !opt.quiet)
-      log_info(_("%lu keys processed so far\n"), stats->count);
+      if (!(++stats->count % 100) && !opt.quiet) {
+        if (nbatch > 1)
+          log_info(_("%lu keys processed so far (%lu keys/s)\n"),
+                   stats->count,
+                   stats->count /
+                       std::max<unsigned long>(
+                           1, make_timestamp() - start_time));
+        else
+          log_info(_("%lu keys processed so far\n"), stats->count);
+      }
+    }
+    batch.clear();
   }
-  stats->v3keys += v3keys;
+  if (lock_hd) keydb_set_append_only(lock_hd, 0);
+  keydb_release(lock_hd);
+
   if (rc == -1)
     rc = 0;
   else if (rc && rc != GPG_ERR_INV_KEYRING)
@@ -643,6 +729,10 @@ static int read_block(IOBUF a, int with_meta, PACKET **pending_pkt,
   PACKET *pkt;
   kbnode_t root = NULL;
   int in_cert, in_v3key;
+  unsigned int max_sigs = with_meta ? 0 : opt.import_max_uid_sigs;
+  unsigned int nsigs = 0;
+  unsigned long dropped = 0;
+  u32 keyid[2];
 
   *r_v3keys = 0;
 
@@ -697,6 +787,27 @@ static int read_block(IOBUF a, int with_meta, PACKET **pending_pkt,
       goto ready;
     }
 
+    /* Drop the signatures by other keys beyond the limit for a user
+     ID or subkey right away, so that a flooded key takes neither
+     much memory nor time to merge.  Self-signatures are always
+     kept.  */
+    if (max_sigs && in_cert && root) {
+      if (pkt->pkttype == PKT_USER_ID || pkt->pkttype == PKT_PUBLIC_SUBKEY ||
+          pkt->pkttype == PKT_SECRET_SUBKEY)
+        nsigs = 0;
+      else if (pkt->pkttype == PKT_SIGNATURE) {
+        keyid_from_pk(root->pkt->pkt.public_key, keyid);
+        if ((pkt->pkt.signature->keyid[0] != keyid[0] ||
+             pkt->pkt.signature->keyid[1] != keyid[1]) &&
+            ++nsigs > max_sigs) {
+          dropped++;
+          free_packet(pkt, &parsectx);
+          init_packet(pkt);
+          continue;
+        }
+      }
+    }
+
     /* Make a linked list of all packets.  */
     switch (pkt->pkttype) {
       case PKT_COMPRESSED:
@@ -745,6 +856,12 @@ static int read_block(IOBUF a, int with_meta, PACKET **pending_pkt,
 
 ready:
   if (rc == -1 && root) rc = 0;
+  if (dropped) {
+    keyid_from_pk(root->pkt->pkt.public_key, keyid);
+    log_info(_("key %s: %lu signatures dropped"
+               " (more than %u on a user ID or subkey)\n"),
+             keystr(keyid), dropped, max_sigs);
+  }
 
   if (rc)
     release_kbnode(root);
@@ -975,13 +1092,14 @@ static void check_prefs(ctrl_t ctrl, kbnode_t keyblock) {
   }
 }
 
-/* Helper for apply_*_filter in import.c and export.c.  */
+/* Helper for apply_*_filter in import.c and export.c.  Each numerical
+ * property of a packet type has its own buffer in PARM because
+ * recsel_select keeps the returned values until it is done with the
+ * record.  */
 const char *impex_filter_getval(void *cookie, const char *propname) {
-  /* FIXME: Malloc our static buffers and access them via PARM.  */
   struct impex_filter_parm_s *parm = (impex_filter_parm_s *)cookie;
   ctrl_t ctrl = parm->ctrl;
   kbnode_t node = parm->node;
-  static char numbuf[20];
   const char *result;
 
   if (node->pkt->pkttype == PKT_USER_ID ||
@@ -1007,16 +1125,19 @@ const char *impex_filter_getval(void *cookie, const char *propname) {
     PKT_signature *sig = node->pkt->pkt.signature;
 
     if (!strcmp(propname, "sig_created")) {
-      snprintf(numbuf, sizeof numbuf, "%lu", (unsigned long)sig->timestamp);
-      result = numbuf;
+      snprintf(parm->numbuf[0], sizeof parm->numbuf[0],
+               "%lu", (unsigned long)sig->timestamp);
+      result = parm->numbuf[0];
     } else if (!strcmp(propname, "sig_created_d")) {
       result = datestr_from_sig(sig);
     } else if (!strcmp(propname, "sig_algo")) {
-      snprintf(numbuf, sizeof numbuf, "%d", sig->pubkey_algo);
-      result = numbuf;
+      snprintf(parm->numbuf[1], sizeof parm->numbuf[1],
+               "%d", sig->pubkey_algo);
+      result = parm->numbuf[1];
     } else if (!strcmp(propname, "sig_digest_algo")) {
-      snprintf(numbuf, sizeof numbuf, "%d", sig->digest_algo);
-      result = numbuf;
+      snprintf(parm->numbuf[2], sizeof parm->numbuf[2],
+               "%d", sig->digest_algo);
+      result = parm->numbuf[2];
     } else if (!strcmp(propname, "expired")) {
       result = sig->flags.expired ? "1" : "0";
     } else
@@ -1033,11 +1154,13 @@ const char *impex_filter_getval(void *cookie, const char *propname) {
                    ? "1"
                    : "0";
     } else if (!strcmp(propname, "key_algo")) {
-      snprintf(numbuf, sizeof numbuf, "%d", pk->pubkey_algo);
-      result = numbuf;
+      snprintf(parm->numbuf[0], sizeof parm->numbuf[0],
+               "%d", pk->pubkey_algo);
+      result = parm->numbuf[0];
     } else if (!strcmp(propname, "key_created")) {
-      snprintf(numbuf, sizeof numbuf, "%lu", (unsigned long)pk->timestamp);
-      result = numbuf;
+      snprintf(parm->numbuf[1], sizeof parm->numbuf[1],
+               "%lu", (unsigned long)pk->timestamp);
+      result = parm->numbuf[1];
     } else if (!strcmp(propname, "key_created_d")) {
       result = datestr_from_pk(pk);
     } else if (!strcmp(propname, "expired")) {
@@ -2058,6 +2181,10 @@ static int chk_self_sigs(ctrl_t ctrl, kbnode_t keyblock, u32 *keyid,
   u32 bsdate = 0, rsdate = 0;
   kbnode_t bsnode = NULL, rsnode = NULL;
 
+  /* Verify the self-signatures in parallel; the checks below then
+     use the cached results.  */
+  check_self_sigs_batch(ctrl, keyblock);
+
   for (n = keyblock; (n = find_next_kbnode(n, 0));) {
     if (n->pkt->pkttype == PKT_PUBLIC_SUBKEY) {
       knode = n;
@@ -2495,6 +2622,88 @@ static void revocation_present(ctrl_t ctrl, kbnode_t keyblock) {
   }
 }
 
+/* A set of signatures for finding duplicates while merging keyblocks
+ * without comparing each new signature to all existing ones.  The
+ * signatures are hashed over the parts compared by cmp_signatures.  */
+typedef std::unordered_multimap<uint64_t, PKT_signature *> sig_set_t;
+
+/* Add {BUFFER,LENGTH} to the FNV-1a hash at H.  */
+static void hash_bytes(uint64_t *h, const void *buffer, size_t length) {
+  const unsigned char *p = (const unsigned char *)buffer;
+
+  for (; length; length--, p++) *h = (*h ^ *p) * 0x100000001b3ULL;
+}
+
+static uint64_t hash_signature(PKT_signature *sig) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  int i, n;
+
+  hash_bytes(&h, sig->keyid, sizeof sig->keyid);
+  hash_bytes(&h, &sig->pubkey_algo, sizeof sig->pubkey_algo);
+  n = pubkey_get_nsig((pubkey_algo_t)(sig->pubkey_algo));
+  for (i = 0; i < n; i++) {
+    unsigned int nbits;
+    unsigned char *buf;
+    const void *p;
+    size_t len;
+
+    if (!sig->data[i]) continue;
+    if (gcry_mpi_get_flag(sig->data[i], GCRYMPI_FLAG_OPAQUE)) {
+      p = gcry_mpi_get_opaque(sig->data[i], &nbits);
+      hash_bytes(&h, &nbits, sizeof nbits);
+      if (p) hash_bytes(&h, p, (nbits + 7) / 8);
+    } else if (!gcry_mpi_aprint(GCRYMPI_FMT_USG, &buf, &len, sig->data[i])) {
+      hash_bytes(&h, buf, len);
+      gcry_free(buf);
+    }
+  }
+  return h;
+}
+
+/* Return true if SET has a signature equal to SIG.  The hash of SIG
+ * is stored at R_HASH for adding it to SET.  */
+static int sig_set_find(const sig_set_t &set, PKT_signature *sig,
+                        uint64_t *r_hash) {
+  *r_hash = hash_signature(sig);
+  auto range = set.equal_range(*r_hash);
+  for (auto it = range.first; it != range.second; ++it)
+    if (!cmp_signatures(it->second, sig)) return 1;
+  return 0;
+}
+
+/* Merge the signatures of class SIG_CLASS on the primary key of
+ * KEYBLOCK into KEYBLOCK_ORIG.  Calls ADDED for each new one.  */
+template <typename F>
+static void merge_key_sigs(kbnode_t keyblock_orig, kbnode_t keyblock,
+                           int sig_class, int *n_sigs, F added) {
+  kbnode_t onode, node;
+  sig_set_t sigs;
+  uint64_t hash;
+
+  for (onode = keyblock_orig->next;
+       onode && onode->pkt->pkttype != PKT_USER_ID; onode = onode->next)
+    if (onode->pkt->pkttype == PKT_SIGNATURE &&
+        onode->pkt->pkt.signature->sig_class == sig_class)
+      sigs.emplace(hash_signature(onode->pkt->pkt.signature),
+                   onode->pkt->pkt.signature);
+
+  for (node = keyblock->next; node && node->pkt->pkttype != PKT_USER_ID;
+       node = node->next) {
+    if (node->pkt->pkttype != PKT_SIGNATURE ||
+        node->pkt->pkt.signature->sig_class != sig_class)
+      continue;
+    /* check whether we already have this */
+    if (sig_set_find(sigs, node->pkt->pkt.signature, &hash)) continue;
+
+    kbnode_t n2 = clone_kbnode(node);
+    insert_kbnode(keyblock_orig, n2, 0);
+    n2->flag |= NODE_FLAG_A;
+    ++*n_sigs;
+    sigs.emplace(hash, node->pkt->pkt.signature);
+    added();
+  }
+}
+
 /*
  * compare and merge the blocks
  *
@@ -2509,72 +2718,24 @@ static void revocation_present(ctrl_t ctrl, kbnode_t keyblock) {
 static int merge_blocks(ctrl_t ctrl, kbnode_t keyblock_orig, kbnode_t keyblock,
                         u32 *keyid, int *n_uids, int *n_sigs, int *n_subk) {
   kbnode_t onode, node;
-  int rc, found;
+  int rc;
 
   /* 1st: handle revocation certificates */
-  for (node = keyblock->next; node; node = node->next) {
-    if (node->pkt->pkttype == PKT_USER_ID)
-      break;
-    else if (node->pkt->pkttype == PKT_SIGNATURE &&
-             node->pkt->pkt.signature->sig_class == 0x20) {
-      /* check whether we already have this */
-      found = 0;
-      for (onode = keyblock_orig->next; onode; onode = onode->next) {
-        if (onode->pkt->pkttype == PKT_USER_ID)
-          break;
-        else if (onode->pkt->pkttype == PKT_SIGNATURE &&
-                 onode->pkt->pkt.signature->sig_class == 0x20 &&
-                 !cmp_signatures(onode->pkt->pkt.signature,
-                                 node->pkt->pkt.signature)) {
-          found = 1;
-          break;
-        }
-      }
-      if (!found) {
-        kbnode_t n2 = clone_kbnode(node);
-        insert_kbnode(keyblock_orig, n2, 0);
-        n2->flag |= NODE_FLAG_A;
-        ++*n_sigs;
-        if (!opt.quiet) {
-          char *p = get_user_id_native(ctrl, keyid);
-          log_info(_("key %s: \"%s\" revocation"
-                     " certificate added\n"),
-                   keystr(keyid), p);
-          xfree(p);
-        }
-      }
+  merge_key_sigs(keyblock_orig, keyblock, 0x20, n_sigs, [&]() {
+    if (!opt.quiet) {
+      char *p = get_user_id_native(ctrl, keyid);
+      log_info(_("key %s: \"%s\" revocation"
+                 " certificate added\n"),
+               keystr(keyid), p);
+      xfree(p);
     }
-  }
+  });
 
   /* 2nd: merge in any direct key (0x1F) sigs */
-  for (node = keyblock->next; node; node = node->next) {
-    if (node->pkt->pkttype == PKT_USER_ID)
-      break;
-    else if (node->pkt->pkttype == PKT_SIGNATURE &&
-             node->pkt->pkt.signature->sig_class == 0x1F) {
-      /* check whether we already have this */
-      found = 0;
-      for (onode = keyblock_orig->next; onode; onode = onode->next) {
-        if (onode->pkt->pkttype == PKT_USER_ID)
-          break;
-        else if (onode->pkt->pkttype == PKT_SIGNATURE &&
-                 onode->pkt->pkt.signature->sig_class == 0x1F &&
-                 !cmp_signatures(onode->pkt->pkt.signature,
-                                 node->pkt->pkt.signature)) {
-          found = 1;
-          break;
-        }
-      }
-      if (!found) {
-        kbnode_t n2 = clone_kbnode(node);
-        insert_kbnode(keyblock_orig, n2, 0);
-        n2->flag |= NODE_FLAG_A;
-        ++*n_sigs;
-        if (!opt.quiet)
-          log_info(_("key %s: direct key signature added\n"), keystr(keyid));
-      }
-    }
-  }
+  merge_key_sigs(keyblock_orig, keyblock, 0x1F, n_sigs, [&]() {
+    if (!opt.quiet)
+      log_info(_("key %s: direct key signature added\n"), keystr(keyid));
+  });
 
   /* 3rd: try to merge new certificates in */
   for (onode = keyblock_orig->next; onode; onode = onode->next) {
@@ -2709,24 +2870,27 @@ static int append_uid(kbnode_t keyblock, kbnode_t node, int *n_sigs) {
  */
 static int merge_sigs(kbnode_t dst, kbnode_t src, int *n_sigs) {
   kbnode_t n, n2;
-  int found = 0;
+  sig_set_t sigs;
+  uint64_t hash;
 
   log_assert(dst->pkt->pkttype == PKT_USER_ID);
   log_assert(src->pkt->pkttype == PKT_USER_ID);
 
+  for (n2 = dst->next; n2 && n2->pkt->pkttype != PKT_USER_ID &&
+                       n2->pkt->pkttype != PKT_PUBLIC_SUBKEY &&
+                       n2->pkt->pkttype != PKT_SECRET_SUBKEY;
+       n2 = n2->next)
+    if (n2->pkt->pkttype == PKT_SIGNATURE)
+      sigs.emplace(hash_signature(n2->pkt->pkt.signature),
+                   n2->pkt->pkt.signature);
+
   for (n = src->next; n && n->pkt->pkttype != PKT_USER_ID; n = n->next) {
     if (n->pkt->pkttype != PKT_SIGNATURE) continue;
     if (n->pkt->pkt.signature->sig_class == 0x18 ||
         n->pkt->pkt.signature->sig_class == 0x28)
       continue; /* skip signatures which are only valid on subkeys */
 
-    found = 0;
-    for (n2 = dst->next; n2 && n2->pkt->pkttype != PKT_USER_ID; n2 = n2->next)
-      if (!cmp_signatures(n->pkt->pkt.signature, n2->pkt->pkt.signature)) {
-        found++;
-        break;
-      }
-    if (!found) {
+    if (!sig_set_find(sigs, n->pkt->pkt.signature, &hash)) {
       /* This signature is new or newer, append N to DST.
        * We add a clone to the original keyblock, because this
        * one is released first */
@@ -2735,6 +2899,7 @@ static int merge_sigs(kbnode_t dst, kbnode_t src, int *n_sigs) {
       n2->flag |= NODE_FLAG_A;
       n->flag |= NODE_FLAG_A;
       ++*n_sigs;
+      sigs.emplace(hash, n->pkt->pkt.signature);
     }
   }
 
@@ -2746,36 +2911,34 @@ static int merge_sigs(kbnode_t dst, kbnode_t src, int *n_sigs) {
  */
 static int merge_keysigs(kbnode_t dst, kbnode_t src, int *n_sigs) {
   kbnode_t n, n2;
-  int found = 0;
+  /* The newest timestamp by issuer and signature class.  */
+  std::map<std::pair<uint64_t, int>, u32> newest;
 
   log_assert(dst->pkt->pkttype == PKT_PUBLIC_SUBKEY ||
              dst->pkt->pkttype == PKT_SECRET_SUBKEY);
 
+  auto key_of = [](PKT_signature *sig) {
+    return std::make_pair(((uint64_t)sig->keyid[0] << 32) | sig->keyid[1],
+                          (int)sig->sig_class);
+  };
+  for (n2 = dst->next; n2; n2 = n2->next) {
+    if (n2->pkt->pkttype == PKT_PUBLIC_SUBKEY ||
+        n2->pkt->pkttype == PKT_PUBLIC_KEY)
+      break;
+    if (n2->pkt->pkttype == PKT_SIGNATURE) {
+      auto it = newest.emplace(key_of(n2->pkt->pkt.signature), 0).first;
+      it->second = std::max(it->second, n2->pkt->pkt.signature->timestamp);
+    }
+  }
+
   for (n = src->next; n; n = n->next) {
     if (n->pkt->pkttype == PKT_PUBLIC_SUBKEY ||
         n->pkt->pkttype == PKT_PUBLIC_KEY)
       break;
     if (n->pkt->pkttype != PKT_SIGNATURE) continue;
 
-    found = 0;
-    for (n2 = dst->next; n2; n2 = n2->next) {
-      if (n2->pkt->pkttype == PKT_PUBLIC_SUBKEY ||
-          n2->pkt->pkttype == PKT_PUBLIC_KEY)
-        break;
-      if (n2->pkt->pkttype == PKT_SIGNATURE &&
-          (n->pkt->pkt.signature->keyid[0] ==
-           n2->pkt->pkt.signature->keyid[0]) &&
-          (n->pkt->pkt.signature->keyid[1] ==
-           n2->pkt->pkt.signature->keyid[1]) &&
-          (n->pkt->pkt.signature->timestamp <=
-           n2->pkt->pkt.signature->timestamp) &&
-          (n->pkt->pkt.signature->sig_class ==
-           n2->pkt->pkt.signature->sig_class)) {
-        found++;
-        break;
-      }
-    }
-    if (!found) {
+    auto it = newest.find(key_of(n->pkt->pkt.signature));
+    if (it == newest.end() || n->pkt->pkt.signature->timestamp > it->second) {
       /* This signature is new or newer, append N to DST.
        * We add a clone to the original keyblock, because this
        * one is released first */
@@ -2784,6 +2947,7 @@ static int merge_keysigs(kbnode_t dst, kbnode_t src, int *n_sigs) {
       n2->flag |= NODE_FLAG_A;
       n->flag |= NODE_FLAG_A;
       ++*n_sigs;
+      newest[key_of(n->pkt->pkt.signature)] = n->pkt->pkt.signature->timestamp;
     }
   }
 
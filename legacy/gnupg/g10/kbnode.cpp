@@ -23,16 +23,84 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <mutex>
+#include <vector>
+
 #include "../common/init.h"
 #include "../common/util.h"
 #include "gpg.h"
 #include "keydb.h"
 #include "packet.h"
 
+/* Nodes are carved out of slabs of KBNODE_SLAB_SIZE slots, so that a
+ * keyblock read in one go lies in adjacent memory instead of being
+ * scattered over the heap.  Each slot also has room for the packet of
+ * the node (see new_kbnode_with_packet).  Released slots go to a free
+ * list of the releasing thread.  Once a thread has twice a slab's
+ * worth of free slots, it hands a slab's worth to the pool shared by
+ * all threads.  The slabs themselves are never freed.  */
+#define KBNODE_SLAB_SIZE 256
+
+/* The node owns the packet stored in its slot.  */
+#define KBNODE_OWN_PACKET 4
+
+struct kbnode_slot {
+  struct kbnode_struct node; /* Must be the first member.  */
+  PACKET pkt;
+};
+
+struct kbnode_free_list {
+  kbnode_t head = NULL;
+  size_t count = 0;
+
+  ~kbnode_free_list();
+};
+
+/* Lists of free slots given up by threads, with their lengths.  */
+static std::mutex kbnode_pool_lock;
+static std::vector<std::pair<kbnode_t, size_t>> kbnode_pool;
+
+static thread_local struct kbnode_free_list kbnode_free;
+
+/* Return the free slots of an exiting thread to the pool.  */
+kbnode_free_list::~kbnode_free_list() {
+  if (!head) return;
+  std::lock_guard<std::mutex> guard(kbnode_pool_lock);
+  kbnode_pool.emplace_back(head, count);
+}
+
+/* Fill the empty free list FL from the pool or with a new slab.  */
+static void refill_free_list(struct kbnode_free_list *fl) {
+  struct kbnode_slot *slab;
+  size_t i;
+
+  {
+    std::lock_guard<std::mutex> guard(kbnode_pool_lock);
+    if (!kbnode_pool.empty()) {
+      fl->head = kbnode_pool.back().first;
+      fl->count = kbnode_pool.back().second;
+      kbnode_pool.pop_back();
+      return;
+    }
+  }
+
+  slab = (struct kbnode_slot *)xmalloc(KBNODE_SLAB_SIZE * sizeof *slab);
+  for (i = 0; i + 1 < KBNODE_SLAB_SIZE; i++)
+    slab[i].node.next = &slab[i + 1].node;
+  slab[i].node.next = NULL;
+  fl->head = &slab[0].node;
+  fl->count = KBNODE_SLAB_SIZE;
+}
+
 static kbnode_t alloc_node(void) {
+  struct kbnode_free_list *fl = &kbnode_free;
   kbnode_t n;
 
-  n = (kbnode_t)xmalloc(sizeof *n);
+  if (!fl->head) refill_free_list(fl);
+  n = fl->head;
+  fl->head = n->next;
+  fl->count--;
+
   n->next = NULL;
   n->pkt = NULL;
   n->flag = 0;
@@ -42,7 +110,33 @@ static kbnode_t alloc_node(void) {
 }
 
 static void free_node(KBNODE n) {
-  if (n) xfree(n);
+  struct kbnode_free_list *fl = &kbnode_free;
+  kbnode_t last;
+  size_t i;
+
+  if (!n) return;
+
+  n->next = fl->head;
+  fl->head = n;
+  fl->count++;
+  if (fl->count < 2 * KBNODE_SLAB_SIZE) return;
+
+  /* Give the most recently freed slab's worth to the pool.  */
+  for (last = fl->head, i = 1; i < KBNODE_SLAB_SIZE; i++) last = last->next;
+  {
+    std::lock_guard<std::mutex> guard(kbnode_pool_lock);
+    kbnode_pool.emplace_back(fl->head, KBNODE_SLAB_SIZE);
+  }
+  fl->head = last->next;
+  last->next = NULL;
+  fl->count -= KBNODE_SLAB_SIZE;
+}
+
+/* Release the packet of the node N unless it is a clone.  */
+static void free_node_packet(kbnode_t n) {
+  if (is_cloned_kbnode(n)) return;
+  free_packet(n->pkt, NULL);
+  if (!(n->private_flag & KBNODE_OWN_PACKET)) xfree(n->pkt);
 }
 
 KBNODE
@@ -52,12 +146,33 @@ new_kbnode(PACKET *pkt) {
   return n;
 }
 
+/* Return a new node with an empty packet which is allocated together
+ * with the node.  The packet is released along with the node; it must
+ * not be freed separately, see replace_kbnode_packet.  */
+kbnode_t new_kbnode_with_packet(void) {
+  kbnode_t n = alloc_node();
+
+  n->pkt = &((struct kbnode_slot *)n)->pkt;
+  init_packet(n->pkt);
+  n->private_flag = KBNODE_OWN_PACKET;
+  return n;
+}
+
+/* Release the packet of NODE and replace it by PKT, which must have
+ * been allocated with xmalloc.  */
+void replace_kbnode_packet(kbnode_t node, PACKET *pkt) {
+  free_node_packet(node);
+  node->pkt = pkt;
+  node->private_flag &= ~(2 | KBNODE_OWN_PACKET);
+}
+
 KBNODE
 clone_kbnode(KBNODE node) {
   KBNODE n = alloc_node();
 
   n->pkt = node->pkt;
-  n->private_flag = node->private_flag | 2; /* mark cloned */
+  /* mark cloned */
+  n->private_flag = (node->private_flag | 2) & ~KBNODE_OWN_PACKET;
   return n;
 }
 
@@ -66,10 +181,7 @@ void release_kbnode(KBNODE n) {
 
   while (n) {
     n2 = n->next;
-    if (!is_cloned_kbnode(n)) {
-      free_packet(n->pkt, NULL);
-      xfree(n->pkt);
-    }
+    free_node_packet(n);
     free_node(n);
     n = n2;
   }
@@ -210,10 +322,7 @@ int commit_kbnode(KBNODE *root) {
         *root = nl = n->next;
       else
         nl->next = n->next;
-      if (!is_cloned_kbnode(n)) {
-        free_packet(n->pkt, NULL);
-        xfree(n->pkt);
-      }
+      free_node_packet(n);
       free_node(n);
       changed = 1;
     } else
@@ -222,6 +331,32 @@ int commit_kbnode(KBNODE *root) {
   return changed;
 }
 
+/* Return an array view of all nodes of KEYBLOCK, including those
+ * marked as deleted.  The view is meant for code which walks a
+ * keyblock several times without changing its structure; it must not
+ * be used after nodes have been added to or removed from KEYBLOCK.
+ * Release it with kbnode_view_release.  */
+kbnode_view_t kbnode_view_new(kbnode_t keyblock) {
+  kbnode_view_t view;
+  kbnode_t n;
+  size_t count;
+
+  for (count = 0, n = keyblock; n; n = n->next) count++;
+
+  view = (kbnode_view_t)xmalloc(sizeof *view +
+                                count * sizeof(struct kbnode_view_item));
+  view->count = count;
+  view->items = (struct kbnode_view_item *)(view + 1);
+  for (count = 0, n = keyblock; n; n = n->next, count++) {
+    view->items[count].pkttype = n->pkt->pkttype;
+    view->items[count].pkt = n->pkt;
+    view->items[count].node = n;
+  }
+  return view;
+}
+
+void kbnode_view_release(kbnode_view_t view) { xfree(view); }
+
 void dump_kbnode(KBNODE node) {
   for (; node; node = node->next) {
     const char *s;
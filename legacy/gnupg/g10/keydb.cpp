@@ -27,6 +27,13 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include <neopg/utils/workers.h>
+
+#include "../common/trace.h"
 #include "../common/util.h"
 #include "../kbx/keybox.h"
 #include "gpg.h"
@@ -61,11 +68,13 @@ static void *primary_keydb;
 /* Whether we have successfully registered any resource.  */
 static int any_registered;
 
-/* This is a simple cache used to return the last result of a
-   successful fingerprint search.  This works only for keybox resources
-   because (due to lack of a copy_keyblock function) we need to store
-   an image of the keyblock which is fortunately instantly available
-   for keyboxes.  */
+/* Each handle remembers the result of its last successful
+   fingerprint search.  This works only for keybox resources because
+   (due to lack of a copy_keyblock function) we need to store an image
+   of the keyblock which is fortunately instantly available for
+   keyboxes.  The images are also kept in a cache shared by all
+   handles (see below), so that later fingerprint searches through any
+   handle can be answered without touching the keybox.  */
 enum keyblock_cache_states {
   KEYBLOCK_CACHE_EMPTY,
   KEYBLOCK_CACHE_PREPARED,
@@ -81,8 +90,51 @@ struct keyblock_cache {
   /* Offset of the record in the keybox.  */
   int resource;
   off_t offset;
+  /* Set if the last search was answered by the shared cache.  In
+     that case the keybox has no selected record.  */
+  int from_cache;
 };
 
+/* The shared keyblock cache.  Entries are keyed by fingerprint and
+   resource token, hashed on the last byte of the fingerprint, and
+   kept on a list in least recently used order.  The total size of
+   the images is limited to KEYBLOCK_CACHE_BUDGET bytes.  Each entry
+   records the generation of the cache at the time it was added; any
+   change to the database bumps the generation, which invalidates all
+   entries at once.  Stale entries are released when they are
+   encountered or evicted.  */
+#define KEYBLOCK_CACHE_BUDGET (4 * 1024 * 1024)
+#define KEYBLOCK_CACHE_BUCKETS 256
+
+struct keyblock_cache_entry {
+  struct keyblock_cache_entry *next;     /* Next in the hash bucket.  */
+  struct keyblock_cache_entry *lru_prev; /* Towards the most recent.  */
+  struct keyblock_cache_entry *lru_next; /* Towards the least recent.  */
+  unsigned int generation;
+  void *token; /* The resource the record was found in.  */
+  byte fpr[20];
+  int pk_no;
+  int uid_no;
+  off_t offset; /* See struct keyblock_cache.  */
+  size_t size;  /* The length of IMAGE.  */
+  byte image[1];
+};
+
+static struct keyblock_cache_entry *keyblock_cache_table
+    [KEYBLOCK_CACHE_BUCKETS];
+static struct keyblock_cache_entry *keyblock_cache_lru_head;
+static struct keyblock_cache_entry *keyblock_cache_lru_tail;
+static unsigned int keyblock_cache_generation;
+
+struct {
+  unsigned int count;         /* The current number of entries.  */
+  size_t bytes;               /* The current size of all entries.  */
+  size_t peak;                /* The peak of BYTES.  */
+  unsigned int hits;          /* Searches answered by the cache.  */
+  unsigned int evictions;     /* Entries dropped to stay in budget.  */
+  unsigned int invalidations; /* Number of generation changes.  */
+} keyblock_cache_stats;
+
 struct keydb_handle {
   /* When we locked all of the resources in ACTIVE (using keyring_lock
      / keybox_lock, as appropriate).  */
@@ -127,28 +179,32 @@ struct keydb_handle {
    exist, we don't have to spend time looking it up.  This
    particularly helps the --list-sigs and --check-sigs commands.
 
-   The cache stores the results in a hash using separate chaining.
-   Concretely: we use the LSB of the keyid to index the hash table and
-   each bucket consists of a linked list of entries.  An entry
-   consists of the 64-bit key id.  If a key id is not in the cache,
-   then we don't know whether it is in the DB or not.
+   The cache is a hash table of fixed size with open addressing
+   (linear probing), indexed by the low bits of the key id.  If a key
+   id is not in the cache, then we don't know whether it is in the DB
+   or not.
 
-   To simplify the cache consistency protocol, we simply flush the
-   whole cache whenever a key is inserted or updated.  */
+   When a keyblock is inserted or updated, the key ids of its keys are
+   removed from the cache.  Deleting keys does not make the cache
+   wrong.  If the table gets too full, it is flushed.  */
 
-#define KID_NOT_FOUND_CACHE_BUCKETS 256
-static struct kid_not_found_cache_bucket
-    *kid_not_found_cache[KID_NOT_FOUND_CACHE_BUCKETS];
+#define KID_NOT_FOUND_CACHE_SIZE 4096 /* Must be a power of 2.  */
+#define KID_NOT_FOUND_CACHE_MAX (KID_NOT_FOUND_CACHE_SIZE / 4 * 3)
 
-struct kid_not_found_cache_bucket {
-  struct kid_not_found_cache_bucket *next;
+struct kid_not_found_cache_slot {
   u32 kid[2];
+  int used;
 };
+static struct kid_not_found_cache_slot
+    kid_not_found_cache[KID_NOT_FOUND_CACHE_SIZE];
 
 struct {
   unsigned int count;   /* The current number of entries in the hash table.  */
   unsigned int peak;    /* The peak of COUNT.  */
   unsigned int flushes; /* The number of flushes.  */
+  unsigned int hits;    /* Lookups answered by the cache.  */
+  unsigned int misses;  /* Lookups not answered by the cache.  */
+  unsigned int removed; /* Entries removed for new or updated keys.  */
 } kid_not_found_stats;
 
 struct {
@@ -167,9 +223,29 @@ struct {
   unsigned int notfound_cached;  /* Ditto but from the cache.              */
 } keydb_stats;
 
+/* Search statistics for each resource, in the order of
+   ALL_RESOURCES.  */
+static struct {
+  unsigned int searches; /* Number of keybox searches.  */
+  unsigned int found;    /* Ditto, which returned the result.  */
+  unsigned int canceled; /* Ditto, stopped by a match elsewhere.  */
+  unsigned long long usecs;     /* Total search time.  */
+  unsigned long long max_usecs; /* Longest search.  */
+} resource_stats[MAX_KEYDB_RESOURCES];
+
 static int lock_all(KEYDB_HANDLE hd);
 static void unlock_all(KEYDB_HANDLE hd);
 
+/* The handle which keeps the resources locked for a series of
+   updates (see keydb_hold_lock) or NULL.  */
+static KEYDB_HANDLE lock_holder;
+
+/* Return the slot of the kid_not_found_cache where the search for KID
+   starts.  */
+static inline unsigned int kid_not_found_home(const u32 *kid) {
+  return kid[1] % KID_NOT_FOUND_CACHE_SIZE;
+}
+
 /* Check whether the keyid KID is in key id is definitely not in the
    database.
 
@@ -183,62 +259,111 @@ static void unlock_all(KEYDB_HANDLE hd);
          We searched for a key with this key id previously, but we
          didn't find it in the database.  */
 static int kid_not_found_p(u32 *kid) {
-  struct kid_not_found_cache_bucket *k;
+  unsigned int i;
 
-  for (k = kid_not_found_cache[kid[0] % KID_NOT_FOUND_CACHE_BUCKETS]; k;
-       k = k->next)
-    if (k->kid[0] == kid[0] && k->kid[1] == kid[1]) {
+  for (i = kid_not_found_home(kid); kid_not_found_cache[i].used;
+       i = (i + 1) % KID_NOT_FOUND_CACHE_SIZE)
+    if (kid_not_found_cache[i].kid[0] == kid[0] &&
+        kid_not_found_cache[i].kid[1] == kid[1]) {
       if (DBG_CACHE)
         log_debug("keydb: kid_not_found_p (%08lx%08lx) => not in DB\n",
                   (unsigned long)kid[0], (unsigned long)kid[1]);
+      kid_not_found_stats.hits++;
       return 1;
     }
 
   if (DBG_CACHE)
     log_debug("keydb: kid_not_found_p (%08lx%08lx) => indeterminate\n",
               (unsigned long)kid[0], (unsigned long)kid[1]);
+  kid_not_found_stats.misses++;
   return 0;
 }
 
+/* Flush the kid not found cache.  */
+static void kid_not_found_flush(void) {
+  if (DBG_CACHE) log_debug("keydb: kid_not_found_flush\n");
+
+  if (!kid_not_found_stats.count) return;
+
+  memset(kid_not_found_cache, 0, sizeof kid_not_found_cache);
+  kid_not_found_stats.count = 0;
+  kid_not_found_stats.flushes++;
+}
+
 /* Insert the keyid KID into the kid_not_found_cache.  FOUND is whether
    the key is in the key database or not.
 
    Note this function does not check whether the key id is already in
    the cache.  As such, kid_not_found_p() should be called first.  */
 static void kid_not_found_insert(u32 *kid) {
-  struct kid_not_found_cache_bucket *k;
+  unsigned int i;
 
   if (DBG_CACHE)
     log_debug("keydb: kid_not_found_insert (%08lx%08lx)\n",
               (unsigned long)kid[0], (unsigned long)kid[1]);
-  k = (kid_not_found_cache_bucket *)xmalloc(sizeof *k);
-  k->kid[0] = kid[0];
-  k->kid[1] = kid[1];
-  k->next = kid_not_found_cache[kid[0] % KID_NOT_FOUND_CACHE_BUCKETS];
-  kid_not_found_cache[kid[0] % KID_NOT_FOUND_CACHE_BUCKETS] = k;
+
+  /* Keep some slots free, so that the probe sequences stay short.  */
+  if (kid_not_found_stats.count >= KID_NOT_FOUND_CACHE_MAX)
+    kid_not_found_flush();
+
+  for (i = kid_not_found_home(kid); kid_not_found_cache[i].used;
+       i = (i + 1) % KID_NOT_FOUND_CACHE_SIZE)
+    ;
+  kid_not_found_cache[i].kid[0] = kid[0];
+  kid_not_found_cache[i].kid[1] = kid[1];
+  kid_not_found_cache[i].used = 1;
   kid_not_found_stats.count++;
+  if (kid_not_found_stats.count > kid_not_found_stats.peak)
+    kid_not_found_stats.peak = kid_not_found_stats.count;
 }
 
-/* Flush the kid not found cache.  */
-static void kid_not_found_flush(void) {
-  struct kid_not_found_cache_bucket *k, *knext;
-  int i;
+/* Remove the keyid KID from the kid_not_found_cache, if it is there.  */
+static void kid_not_found_remove(u32 *kid) {
+  unsigned int i, j, home;
 
-  if (DBG_CACHE) log_debug("keydb: kid_not_found_flush\n");
+  for (i = kid_not_found_home(kid); kid_not_found_cache[i].used;
+       i = (i + 1) % KID_NOT_FOUND_CACHE_SIZE)
+    if (kid_not_found_cache[i].kid[0] == kid[0] &&
+        kid_not_found_cache[i].kid[1] == kid[1])
+      break;
+  if (!kid_not_found_cache[i].used) return;
 
-  if (!kid_not_found_stats.count) return;
+  if (DBG_CACHE)
+    log_debug("keydb: kid_not_found_remove (%08lx%08lx)\n",
+              (unsigned long)kid[0], (unsigned long)kid[1]);
 
-  for (i = 0; i < DIM(kid_not_found_cache); i++) {
-    for (k = kid_not_found_cache[i]; k; k = knext) {
-      knext = k->next;
-      xfree(k);
+  /* Move the following entries of the cluster into the hole if their
+     probe sequence passes it, so that they can still be found.  */
+  for (j = (i + 1) % KID_NOT_FOUND_CACHE_SIZE; kid_not_found_cache[j].used;
+       j = (j + 1) % KID_NOT_FOUND_CACHE_SIZE) {
+    home = kid_not_found_home(kid_not_found_cache[j].kid);
+    if ((j - home) % KID_NOT_FOUND_CACHE_SIZE >=
+        (j - i) % KID_NOT_FOUND_CACHE_SIZE) {
+      kid_not_found_cache[i] = kid_not_found_cache[j];
+      i = j;
     }
-    kid_not_found_cache[i] = NULL;
   }
-  if (kid_not_found_stats.count > kid_not_found_stats.peak)
-    kid_not_found_stats.peak = kid_not_found_stats.count;
-  kid_not_found_stats.count = 0;
-  kid_not_found_stats.flushes++;
+  kid_not_found_cache[i].used = 0;
+  kid_not_found_stats.count--;
+  kid_not_found_stats.removed++;
+}
+
+/* Remove the key ids of all keys in the keyblock KB from the
+   kid_not_found_cache.  */
+static void kid_not_found_remove_keyblock(kbnode_t kb) {
+  kbnode_t node;
+  u32 kid[2];
+
+  if (!kid_not_found_stats.count) return;
+
+  for (node = kb; node; node = node->next)
+    if (node->pkt->pkttype == PKT_PUBLIC_KEY ||
+        node->pkt->pkttype == PKT_PUBLIC_SUBKEY ||
+        node->pkt->pkttype == PKT_SECRET_KEY ||
+        node->pkt->pkttype == PKT_SECRET_SUBKEY) {
+      keyid_from_pk(node->pkt->pkt.public_key, kid);
+      kid_not_found_remove(kid);
+    }
 }
 
 static void keyblock_cache_clear(struct keydb_handle *hd) {
@@ -247,6 +372,140 @@ static void keyblock_cache_clear(struct keydb_handle *hd) {
   hd->keyblock_cache.iobuf = NULL;
   hd->keyblock_cache.resource = -1;
   hd->keyblock_cache.offset = -1;
+  hd->keyblock_cache.from_cache = 0;
+}
+
+/* The amount of the budget taken by the entry E.  */
+static size_t keyblock_cache_entry_size(struct keyblock_cache_entry *e) {
+  return sizeof *e + e->size;
+}
+
+/* Remove the entry E from the shared keyblock cache and release it.  */
+static void keyblock_cache_drop(struct keyblock_cache_entry *e) {
+  struct keyblock_cache_entry **pp;
+
+  for (pp = &keyblock_cache_table[e->fpr[19] % KEYBLOCK_CACHE_BUCKETS];
+       *pp != e; pp = &(*pp)->next)
+    ;
+  *pp = e->next;
+
+  if (e->lru_prev)
+    e->lru_prev->lru_next = e->lru_next;
+  else
+    keyblock_cache_lru_head = e->lru_next;
+  if (e->lru_next)
+    e->lru_next->lru_prev = e->lru_prev;
+  else
+    keyblock_cache_lru_tail = e->lru_prev;
+
+  keyblock_cache_stats.count--;
+  keyblock_cache_stats.bytes -= keyblock_cache_entry_size(e);
+  xfree(e);
+}
+
+/* Move the entry E to the front of the LRU list.  */
+static void keyblock_cache_touch(struct keyblock_cache_entry *e) {
+  if (!e->lru_prev) return;
+
+  e->lru_prev->lru_next = e->lru_next;
+  if (e->lru_next)
+    e->lru_next->lru_prev = e->lru_prev;
+  else
+    keyblock_cache_lru_tail = e->lru_prev;
+
+  e->lru_prev = NULL;
+  e->lru_next = keyblock_cache_lru_head;
+  keyblock_cache_lru_head->lru_prev = e;
+  keyblock_cache_lru_head = e;
+}
+
+/* Invalidate all entries of the shared keyblock cache.  This must be
+   called before any change to the database.  */
+static void keyblock_cache_invalidate(void) {
+  keyblock_cache_generation++;
+  keyblock_cache_stats.invalidations++;
+}
+
+/* Return the entry of the shared keyblock cache for the fingerprint
+   FPR in one of the resources of HD, or NULL if there is none.  The
+   index of the resource is stored at R_RESOURCE.  */
+static struct keyblock_cache_entry *keyblock_cache_lookup(KEYDB_HANDLE hd,
+                                                         const byte *fpr,
+                                                         int *r_resource) {
+  struct keyblock_cache_entry *e, *next;
+  int i;
+
+  for (e = keyblock_cache_table[fpr[19] % KEYBLOCK_CACHE_BUCKETS]; e;
+       e = next) {
+    next = e->next;
+    if (e->generation != keyblock_cache_generation) {
+      keyblock_cache_drop(e);
+      continue;
+    }
+    if (memcmp(e->fpr, fpr, 20)) continue;
+    for (i = 0; i < hd->used; i++)
+      if (hd->active[i].token == e->token) {
+        keyblock_cache_touch(e);
+        *r_resource = i;
+        return e;
+      }
+  }
+  return NULL;
+}
+
+/* Add the keyblock image IOBUF, found with the fingerprint FPR at
+   OFFSET of the resource TOKEN, to the shared keyblock cache.  The
+   least recently used entries are evicted to stay within the budget.
+   Errors are ignored; the image is then just not cached.  */
+static void keyblock_cache_add(void *token, const byte *fpr, off_t offset,
+                               int pk_no, int uid_no, iobuf_t iobuf) {
+  struct keyblock_cache_entry *e, *next;
+  size_t size = iobuf_get_temp_length(iobuf);
+
+  /* Don't let a single huge keyblock flush the whole cache.  */
+  if (sizeof *e + size > KEYBLOCK_CACHE_BUDGET / 4) return;
+
+  for (e = keyblock_cache_table[fpr[19] % KEYBLOCK_CACHE_BUCKETS]; e;
+       e = next) {
+    next = e->next;
+    if (e->generation != keyblock_cache_generation ||
+        (e->token == token && !memcmp(e->fpr, fpr, 20)))
+      keyblock_cache_drop(e);
+  }
+
+  while (keyblock_cache_lru_tail &&
+         keyblock_cache_stats.bytes + sizeof *e + size >
+             KEYBLOCK_CACHE_BUDGET) {
+    if (keyblock_cache_lru_tail->generation == keyblock_cache_generation)
+      keyblock_cache_stats.evictions++;
+    keyblock_cache_drop(keyblock_cache_lru_tail);
+  }
+
+  e = (struct keyblock_cache_entry *)xtrymalloc(sizeof *e + size);
+  if (!e) return;
+  e->generation = keyblock_cache_generation;
+  e->token = token;
+  memcpy(e->fpr, fpr, 20);
+  e->pk_no = pk_no;
+  e->uid_no = uid_no;
+  e->offset = offset;
+  e->size = size;
+  memcpy(e->image, iobuf_get_temp_buffer(iobuf), size);
+
+  e->next = keyblock_cache_table[fpr[19] % KEYBLOCK_CACHE_BUCKETS];
+  keyblock_cache_table[fpr[19] % KEYBLOCK_CACHE_BUCKETS] = e;
+  e->lru_prev = NULL;
+  e->lru_next = keyblock_cache_lru_head;
+  if (keyblock_cache_lru_head)
+    keyblock_cache_lru_head->lru_prev = e;
+  else
+    keyblock_cache_lru_tail = e;
+  keyblock_cache_lru_head = e;
+
+  keyblock_cache_stats.count++;
+  keyblock_cache_stats.bytes += keyblock_cache_entry_size(e);
+  if (keyblock_cache_stats.bytes > keyblock_cache_stats.peak)
+    keyblock_cache_stats.peak = keyblock_cache_stats.bytes;
 }
 
 /* Handle the creation of a keyring or a keybox if it does not yet
@@ -677,6 +936,8 @@ leave:
 }
 
 void keydb_dump_stats(void) {
+  int i;
+
   log_info("keydb: handles=%u locks=%u parse=%u get=%u\n", keydb_stats.handles,
            keydb_stats.locks, keydb_stats.parse_keyblocks,
            keydb_stats.get_keyblocks);
@@ -686,9 +947,34 @@ void keydb_dump_stats(void) {
   log_info("       reset=%u found=%u not=%u cache=%u not=%u\n",
            keydb_stats.search_resets, keydb_stats.found, keydb_stats.notfound,
            keydb_stats.found_cached, keydb_stats.notfound_cached);
-  log_info("kid_not_found_cache: count=%u peak=%u flushes=%u\n",
+  log_info("kid_not_found_cache: count=%u peak=%u flushes=%u removed=%u\n",
            kid_not_found_stats.count, kid_not_found_stats.peak,
-           kid_not_found_stats.flushes);
+           kid_not_found_stats.flushes, kid_not_found_stats.removed);
+  log_info("       hits=%u misses=%u hit rate=%u%%\n",
+           kid_not_found_stats.hits, kid_not_found_stats.misses,
+           kid_not_found_stats.hits + kid_not_found_stats.misses
+               ? (unsigned int)(100ULL * kid_not_found_stats.hits /
+                                (kid_not_found_stats.hits +
+                                 kid_not_found_stats.misses))
+               : 0);
+  log_info("keyblock_cache: count=%u bytes=%lu peak=%lu hits=%u\n",
+           keyblock_cache_stats.count,
+           (unsigned long)keyblock_cache_stats.bytes,
+           (unsigned long)keyblock_cache_stats.peak, keyblock_cache_stats.hits);
+  log_info("       evictions=%u invalidations=%u\n",
+           keyblock_cache_stats.evictions, keyblock_cache_stats.invalidations);
+  for (i = 0; i < used_resources; i++) {
+    if (!resource_stats[i].searches) continue;
+    log_info("resource %d (%s): searches=%u found=%u canceled=%u\n", i,
+             keybox_get_token_name(all_resources[i].token),
+             resource_stats[i].searches, resource_stats[i].found,
+             resource_stats[i].canceled);
+    log_info("       time=%llums avg=%lluus max=%lluus\n",
+             resource_stats[i].usecs / 1000,
+             resource_stats[i].usecs / resource_stats[i].searches,
+             resource_stats[i].max_usecs);
+  }
+  getkey_dump_stats();
 }
 
 /* Create a new database handle.  A database handle is similar to a
@@ -755,6 +1041,7 @@ void keydb_release(KEYDB_HANDLE hd) {
   log_assert(active_handles > 0);
   active_handles--;
 
+  if (hd == lock_holder) lock_holder = NULL;
   unlock_all(hd);
   for (i = 0; i < hd->used; i++) {
     switch (hd->active[i].type) {
@@ -810,6 +1097,36 @@ const char *keydb_get_resource_name(KEYDB_HANDLE hd) {
   return s ? s : "";
 }
 
+/* Hash a description of the current state of all registered
+ * resources into MD.  The description changes whenever a keybox is
+ * updated, by this or by another process, and is used to validate
+ * data derived from the database which is kept across invocations
+ * (see the recipient cache in pkclist.c).  */
+void keydb_hash_state(gcry_md_hd_t md) {
+  int i;
+
+  for (i = 0; i < used_resources; i++) {
+    const char *fname;
+    struct stat st;
+    uint64_t id[3] = {0, 0, 0};
+
+    if (all_resources[i].type != KEYDB_RESOURCE_TYPE_KEYBOX) continue;
+    fname = keybox_get_token_name(all_resources[i].token);
+    if (!stat(fname, &st)) {
+      id[0] = st.st_size;
+      id[1] = st.st_mtime;
+      id[2] = st.st_ino;
+    }
+    gcry_md_write(md, fname, strlen(fname) + 1);
+    gcry_md_write(md, id, sizeof id);
+  }
+
+  /* Updates by this process within the resolution of the
+     modification time are caught by the cache generation.  */
+  gcry_md_write(md, &keyblock_cache_generation,
+                sizeof keyblock_cache_generation);
+}
+
 static int lock_all(KEYDB_HANDLE hd) {
   int i, rc = 0;
 
@@ -853,6 +1170,11 @@ static void unlock_all(KEYDB_HANDLE hd) {
   int i;
 
   if (!hd->locked) return;
+  if (lock_holder && hd != lock_holder) {
+    /* The locks are kept until keydb_release_lock.  */
+    hd->locked = 0;
+    return;
+  }
 
   for (i = hd->used - 1; i >= 0; i--) {
     switch (hd->active[i].type) {
@@ -866,6 +1188,95 @@ static void unlock_all(KEYDB_HANDLE hd) {
   hd->locked = 0;
 }
 
+/* Lock all resources using HD and keep them locked until
+ * keydb_release_lock is called, even if other handles take and
+ * release the locks meanwhile.  This allows a series of updates across
+ * several handles with only one lock acquisition.  Only one handle
+ * may hold the locks at a time.  Does nothing with --dry-run.
+ *
+ * Returns 0 on success or an error code.  */
+gpg_error_t keydb_hold_lock(KEYDB_HANDLE hd) {
+  gpg_error_t err;
+
+  if (!hd) return GPG_ERR_INV_ARG;
+  if (opt.dry_run) return 0;
+  if (lock_holder) return GPG_ERR_CONFLICT;
+
+  err = lock_all(hd);
+  if (!err) lock_holder = hd;
+  return err;
+}
+
+/* Release the locks taken by keydb_hold_lock for HD.  */
+void keydb_release_lock(KEYDB_HANDLE hd) {
+  if (!hd || hd != lock_holder) return;
+  lock_holder = NULL;
+  unlock_all(hd);
+}
+
+/* Switch the writable keyboxes of HD to append only updates if YES is
+ * true, or back to normal updates.  Updated and new keyblocks are
+ * then appended instead of rewriting the keybox each time.  This is
+ * meant for a series of updates under keydb_hold_lock; switching back
+ * compacts or reindexes the keyboxes once.  Does nothing with
+ * --dry-run.
+ *
+ * Returns 0 on success or an error code.  */
+gpg_error_t keydb_set_append_only(KEYDB_HANDLE hd, int yes) {
+  gpg_error_t rc = 0, err;
+  int i;
+
+  if (!hd) return GPG_ERR_INV_ARG;
+  if (opt.dry_run) return 0;
+
+  /* Compacting moves the keyblocks.  */
+  if (!yes) {
+    keyblock_cache_clear(hd);
+    keyblock_cache_invalidate();
+  }
+
+  for (i = 0; i < hd->used; i++) {
+    switch (hd->active[i].type) {
+      case KEYDB_RESOURCE_TYPE_NONE:
+        break;
+      case KEYDB_RESOURCE_TYPE_KEYBOX:
+        if (!keybox_is_writable(hd->active[i].token)) break;
+        err = keybox_set_append_only(hd->active[i].u.kb, yes);
+        if (err) {
+          log_error(_("error updating keybox '%s': %s\n"),
+                    keybox_get_resource_name(hd->active[i].u.kb),
+                    gpg_strerror(err));
+          if (!rc) rc = err;
+        }
+        break;
+    }
+  }
+  return rc;
+}
+
+/* If the last search of HD was answered by the shared keyblock
+   cache, repeat it without the cache, so that the record is also
+   selected in the keybox.  This is required before operating on the
+   selected record.  */
+static void keyblock_cache_select(KEYDB_HANDLE hd) {
+  KEYDB_SEARCH_DESC desc;
+  int no_caching;
+
+  if (hd->keyblock_cache.state != KEYBLOCK_CACHE_FILLED ||
+      !hd->keyblock_cache.from_cache)
+    return;
+
+  memset(&desc, 0, sizeof(desc));
+  desc.mode = KEYDB_SEARCH_MODE_FPR20;
+  memcpy(desc.u.fpr, hd->keyblock_cache.fpr, 20);
+
+  no_caching = hd->no_caching;
+  hd->no_caching = 1;
+  keydb_search_reset(hd);
+  if (keydb_search(hd, &desc, 1, NULL)) hd->found = -1;
+  hd->no_caching = no_caching;
+}
+
 /* Save the last found state and invalidate the current selection
  * (i.e., the entry selected by keydb_search() is invalidated and
  * something like keydb_get_keyblock() will return an error).  This
@@ -885,6 +1296,8 @@ static void unlock_all(KEYDB_HANDLE hd) {
 void keydb_push_found_state(KEYDB_HANDLE hd) {
   if (!hd) return;
 
+  keyblock_cache_select(hd);
+
   if (hd->found < 0 || hd->found >= hd->used) {
     hd->saved_found = -1;
     return;
@@ -920,23 +1333,24 @@ void keydb_pop_found_state(KEYDB_HANDLE hd) {
   }
 }
 
-static gpg_error_t parse_keyblock_image(iobuf_t iobuf, int pk_no, int uid_no,
-                                        kbnode_t *r_keyblock) {
+/* Parse the keyblock image in IOBUF into *R_KEYBLOCK.  This does not
+   touch any global state; the packet list mode must be off.  */
+static gpg_error_t do_parse_keyblock_image(iobuf_t iobuf, int pk_no,
+                                           int uid_no, kbnode_t *r_keyblock) {
   gpg_error_t err;
   struct parse_packet_ctx_s parsectx;
   PACKET *pkt;
   kbnode_t keyblock = NULL;
   kbnode_t node, *tail;
-  int in_cert, save_mode;
+  int in_cert;
   int pk_count, uid_count;
 
   *r_keyblock = NULL;
 
-  pkt = (PACKET *)xtrymalloc(sizeof *pkt);
-  if (!pkt) return gpg_error_from_syserror();
-  init_packet(pkt);
-  init_parse_packet(&parsectx, iobuf);
-  save_mode = set_packet_list_mode(0);
+  /* The packets are allocated along with their nodes.  */
+  node = new_kbnode_with_packet();
+  pkt = node->pkt;
+  init_parse_packet_framed(&parsectx, iobuf);
   in_cert = 0;
   tail = NULL;
   pk_count = uid_count = 0;
@@ -991,8 +1405,6 @@ static gpg_error_t parse_keyblock_image(iobuf_t iobuf, int pk_no, int uid_no,
     }
     in_cert = 1;
 
-    node = new_kbnode(pkt);
-
     switch (pkt->pkttype) {
       case PKT_PUBLIC_KEY:
       case PKT_PUBLIC_SUBKEY:
@@ -1014,29 +1426,43 @@ static gpg_error_t parse_keyblock_image(iobuf_t iobuf, int pk_no, int uid_no,
     else
       *tail = node;
     tail = &node->next;
-    pkt = (PACKET *)xtrymalloc(sizeof *pkt);
-    if (!pkt) {
-      err = gpg_error_from_syserror();
-      break;
-    }
-    init_packet(pkt);
+    node = new_kbnode_with_packet();
+    pkt = node->pkt;
   }
-  set_packet_list_mode(save_mode);
 
   if (err == -1 && keyblock) err = 0; /* Got the entire keyblock.  */
 
   if (err)
     release_kbnode(keyblock);
-  else {
+  else
     *r_keyblock = keyblock;
-    keydb_stats.parse_keyblocks++;
-  }
   free_packet(pkt, &parsectx);
   deinit_parse_packet(&parsectx);
-  xfree(pkt);
+  init_packet(pkt);
+  release_kbnode(node);
+  return err;
+}
+
+static gpg_error_t parse_keyblock_image(iobuf_t iobuf, int pk_no, int uid_no,
+                                        kbnode_t *r_keyblock) {
+  gpg_error_t err;
+  int save_mode;
+
+  save_mode = set_packet_list_mode(0);
+  err = do_parse_keyblock_image(iobuf, pk_no, uid_no, r_keyblock);
+  set_packet_list_mode(save_mode);
+  if (!err) keydb_stats.parse_keyblocks++;
   return err;
 }
 
+/* Parse the keyblock image IMAGE as returned by
+ * keydb_get_keyblock_image into *R_KEYBLOCK.  Unlike the other keydb
+ * functions this may be called from several threads at once, provided
+ * that the packet list mode is off (see set_packet_list_mode).  */
+gpg_error_t keydb_parse_keyblock_image(iobuf_t image, kbnode_t *r_keyblock) {
+  return do_parse_keyblock_image(image, 0, 0, r_keyblock);
+}
+
 /* Return the keyblock last found by keydb_search() in *RET_KB.
  *
  * On success, the function returns 0 and the caller must free *RET_KB
@@ -1087,6 +1513,9 @@ gpg_error_t keydb_get_keyblock(KEYDB_HANDLE hd, KBNODE *ret_kb) {
       if (!err) {
         err = parse_keyblock_image(iobuf, pk_no, uid_no, ret_kb);
         if (!err && hd->keyblock_cache.state == KEYBLOCK_CACHE_PREPARED) {
+          keyblock_cache_add(hd->active[hd->found].token,
+                             hd->keyblock_cache.fpr, hd->keyblock_cache.offset,
+                             pk_no, uid_no, iobuf);
           hd->keyblock_cache.state = KEYBLOCK_CACHE_FILLED;
           hd->keyblock_cache.iobuf = iobuf;
           hd->keyblock_cache.pk_no = pk_no;
@@ -1109,6 +1538,75 @@ gpg_error_t keydb_get_keyblock(KEYDB_HANDLE hd, KBNODE *ret_kb) {
   return err;
 }
 
+/* Return the keys and user IDs recorded for the keyblock last found
+ * by keydb_search() in *R_INFO, without reading the keyblock itself.
+ * If the keyblock was taken from a cache, GPG_ERR_VALUE_NOT_FOUND is
+ * returned and the caller needs to use keydb_get_keyblock.  On
+ * success the caller must release *R_INFO using
+ * keybox_release_keyinfo.  */
+gpg_error_t keydb_get_keyinfo(KEYDB_HANDLE hd, keybox_keyinfo_t *r_info) {
+  gpg_error_t err = 0;
+
+  *r_info = NULL;
+
+  if (!hd) return GPG_ERR_INV_ARG;
+  if (hd->found < 0 || hd->found >= hd->used) return GPG_ERR_VALUE_NOT_FOUND;
+
+  switch (hd->active[hd->found].type) {
+    case KEYDB_RESOURCE_TYPE_NONE:
+      err = GPG_ERR_GENERAL; /* oops */
+      break;
+    case KEYDB_RESOURCE_TYPE_KEYBOX:
+      err = keybox_get_keyinfo(hd->active[hd->found].u.kb, r_info);
+      break;
+  }
+
+  return err;
+}
+
+/* Return the raw image of the keyblock last found by keydb_search()
+ * in *R_IMAGE.  This is like keydb_get_keyblock but leaves the
+ * parsing to keydb_parse_keyblock_image, which is safe to run in
+ * another thread.  On success the caller must close *R_IMAGE.  */
+gpg_error_t keydb_get_keyblock_image(KEYDB_HANDLE hd, iobuf_t *r_image) {
+  gpg_error_t err = 0;
+  int pk_no, uid_no;
+
+  *r_image = NULL;
+
+  if (!hd) return GPG_ERR_INV_ARG;
+
+  if (hd->keyblock_cache.state == KEYBLOCK_CACHE_FILLED) {
+    iobuf_t cached = hd->keyblock_cache.iobuf;
+
+    err = iobuf_seek(cached, 0);
+    if (!err) {
+      *r_image = iobuf_temp_with_content(
+          (const char *)iobuf_get_temp_buffer(cached),
+          iobuf_get_temp_length(cached));
+      keydb_stats.get_keyblocks++;
+      return 0;
+    }
+    keyblock_cache_clear(hd);
+  }
+
+  if (hd->found < 0 || hd->found >= hd->used) return GPG_ERR_VALUE_NOT_FOUND;
+
+  switch (hd->active[hd->found].type) {
+    case KEYDB_RESOURCE_TYPE_NONE:
+      err = GPG_ERR_GENERAL; /* oops */
+      break;
+    case KEYDB_RESOURCE_TYPE_KEYBOX:
+      err = keybox_get_keyblock(hd->active[hd->found].u.kb, r_image, &pk_no,
+                                &uid_no);
+      break;
+  }
+
+  keyblock_cache_clear(hd);
+  if (!err) keydb_stats.get_keyblocks++;
+  return err;
+}
+
 /* Build a keyblock image from KEYBLOCK.  Returns 0 on success and
  * only then stores a new iobuf object at R_IOBUF.  */
 static gpg_error_t build_keyblock_image(kbnode_t keyblock, iobuf_t *r_iobuf) {
@@ -1172,8 +1670,9 @@ gpg_error_t keydb_update_keyblock(ctrl_t ctrl, KEYDB_HANDLE hd, kbnode_t kb) {
 
   if (!hd) return GPG_ERR_INV_ARG;
 
-  kid_not_found_flush();
+  kid_not_found_remove_keyblock(kb);
   keyblock_cache_clear(hd);
+  keyblock_cache_invalidate();
 
   if (opt.dry_run) return 0;
 
@@ -1230,8 +1729,9 @@ gpg_error_t keydb_insert_keyblock(KEYDB_HANDLE hd, kbnode_t kb) {
 
   if (!hd) return GPG_ERR_INV_ARG;
 
-  kid_not_found_flush();
+  kid_not_found_remove_keyblock(kb);
   keyblock_cache_clear(hd);
+  keyblock_cache_invalidate();
 
   if (opt.dry_run) return 0;
 
@@ -1284,8 +1784,9 @@ gpg_error_t keydb_delete_keyblock(KEYDB_HANDLE hd) {
 
   if (!hd) return GPG_ERR_INV_ARG;
 
-  kid_not_found_flush();
+  keyblock_cache_select(hd);
   keyblock_cache_clear(hd);
+  keyblock_cache_invalidate();
 
   if (hd->found < 0 || hd->found >= hd->used) return GPG_ERR_VALUE_NOT_FOUND;
 
@@ -1308,6 +1809,49 @@ gpg_error_t keydb_delete_keyblock(KEYDB_HANDLE hd) {
   return rc;
 }
 
+/* Compact all writable keyboxes of HD: drop deleted and expired
+ * blobs and store the others in fingerprint order.  The space
+ * reclaimed is reported for each keybox.  */
+gpg_error_t keydb_compact(KEYDB_HANDLE hd) {
+  gpg_error_t rc, err;
+  off_t reclaimed;
+  int i;
+
+  if (!hd) return GPG_ERR_INV_ARG;
+
+  keyblock_cache_clear(hd);
+  keyblock_cache_invalidate();
+
+  if (opt.dry_run) return 0;
+
+  rc = lock_all(hd);
+  if (rc) return rc;
+
+  for (i = 0; i < hd->used; i++) {
+    switch (hd->active[i].type) {
+      case KEYDB_RESOURCE_TYPE_NONE:
+        break;
+      case KEYDB_RESOURCE_TYPE_KEYBOX:
+        if (!keybox_is_writable(hd->active[i].token)) break;
+        err = keybox_compact(hd->active[i].u.kb, &reclaimed);
+        if (err) {
+          log_error(_("error compacting keybox '%s': %s\n"),
+                    keybox_get_resource_name(hd->active[i].u.kb),
+                    gpg_strerror(err));
+          if (!rc) rc = err;
+        } else
+          log_info(_("keybox '%s': %lld bytes reclaimed\n"),
+                   keybox_get_resource_name(hd->active[i].u.kb),
+                   (long long)reclaimed);
+        break;
+    }
+  }
+
+  unlock_all(hd);
+  keydb_search_reset(hd);
+  return rc;
+}
+
 /* A database may consists of multiple keyrings / key boxes.  This
  * sets the "file position" to the start of the first keyring / key
  * box that is writable (i.e., doesn't have the read-only flag set).
@@ -1397,6 +1941,152 @@ gpg_error_t keydb_search_reset(KEYDB_HANDLE hd) {
   return rc;
 }
 
+/* The outcome of searching one resource in keydb_search.  */
+struct resource_search_s {
+  gpg_error_t rc;
+  size_t descindex;
+  unsigned long skipped;
+  unsigned long long usecs;
+  /* Set when a resource before this one has ended the search.  */
+  std::atomic<bool> cancel;
+};
+
+/* Search the resource with the index IDX in HD->ACTIVE, which must be
+   a keybox locked with keybox_lock_shared, and store the outcome in
+   RESULT.  */
+static void search_resource(KEYDB_HANDLE hd, int idx, KEYDB_SEARCH_DESC *desc,
+                            size_t ndesc, struct resource_search_s *result) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  do
+    result->rc = keybox_search(hd->active[idx].u.kb, desc, ndesc,
+                               KEYBOX_BLOBTYPE_PGP, &result->descindex,
+                               &result->skipped);
+  while (result->rc == GPG_ERR_LEGACY_KEY);
+
+  result->usecs = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+}
+
+/* Add the outcome RESULT of a search in the resource with the index
+   IDX in HD->ACTIVE to the statistics.  */
+static void record_resource_search(KEYDB_HANDLE hd, int idx,
+                                   struct resource_search_s *result) {
+  int i;
+
+  for (i = 0; i < used_resources; i++)
+    if (all_resources[i].token == hd->active[idx].token) break;
+  if (i == used_resources) return;
+
+  resource_stats[i].searches++;
+  if (!result->rc)
+    resource_stats[i].found++;
+  else if (result->rc == GPG_ERR_CANCELED)
+    resource_stats[i].canceled++;
+  resource_stats[i].usecs += result->usecs;
+  if (result->usecs > resource_stats[i].max_usecs)
+    resource_stats[i].max_usecs = result->usecs;
+}
+
+/* Return true if the search for DESC should use search_parallel.
+   This is only worth it if there are several resources left and the
+   search has to read every blob.  Searches which the sidecar index
+   answers, and those for the first or next key, end after a few
+   blobs.  The skip functions are not meant to be called
+   concurrently.  */
+static int want_parallel_search(KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc,
+                                size_t ndesc) {
+  size_t n;
+
+  if (hd->current < 0 || hd->used - hd->current < 2) return 0;
+  if (keybox_search_indexable(desc, ndesc)) return 0;
+  for (n = 0; n < ndesc; n++)
+    if (desc[n].skipfnc || desc[n].mode == KEYDB_SEARCH_MODE_FIRST ||
+        desc[n].mode == KEYDB_SEARCH_MODE_NEXT)
+      return 0;
+  return 1;
+}
+
+/* Search the resources of HD from HD->CURRENT on at the same time,
+   with one thread per resource, and leave HD as if they had been
+   searched one after another: The result is the first match in the
+   first resource with a match (or the first error), and the
+   resources after it are not searched.  As soon as a resource has
+   ended the search, the threads for the resources after it stop.
+   Returns as keybox_search.  */
+static gpg_error_t search_parallel(KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc,
+                                   size_t ndesc, size_t *descindex) {
+  int first = hd->current;
+  int count = hd->used - first;
+  std::vector<resource_search_s> results(count);
+  std::vector<int> locked(count);
+  gpg_error_t rc;
+  int i, j;
+  size_t nlocked;
+
+  auto worker = [&](size_t idx) {
+    search_resource(hd, first + idx, desc, ndesc, &results[idx]);
+    if (results[idx].rc != -1 && results[idx].rc != GPG_ERR_EOF)
+      for (size_t later = idx + 1; later < results.size(); later++)
+        results[later].cancel = true;
+  };
+
+  /* Keep out writers which update the keyboxes in place.  The locks
+     are taken here, as the lock handles are not shared between
+     threads.  */
+  for (i = 0; i < count; i++) {
+    results[i].rc = -1;
+    results[i].descindex = 0;
+    results[i].skipped = 0;
+    results[i].usecs = 0;
+    results[i].cancel = false;
+  }
+  for (i = 0; i < count; i++) {
+    rc = keybox_lock_shared(hd->active[first + i].u.kb, 1);
+    if (rc) {
+      results[i].rc = rc;
+      break;
+    }
+    locked[i] = 1;
+    keybox_set_cancel(hd->active[first + i].u.kb, &results[i].cancel);
+  }
+
+  for (nlocked = 0; nlocked < locked.size() && locked[nlocked]; nlocked++)
+    ;
+  NeoPG::parallel_for(nlocked, nlocked, worker);
+
+  for (i = 0; i < count; i++) {
+    if (!locked[i]) continue;
+    keybox_set_cancel(hd->active[first + i].u.kb, NULL);
+    keybox_lock_shared(hd->active[first + i].u.kb, 0);
+    record_resource_search(hd, first + i, &results[i]);
+  }
+
+  /* Pick the outcome of a sequential search.  */
+  rc = -1;
+  for (i = 0; i < count; i++) {
+    rc = results[i].rc;
+    hd->skipped_long_blobs += results[i].skipped;
+    if (DBG_LOOKUP)
+      log_debug("%s: searched keybox (resource %d of %d) => %s\n", __func__,
+                first + i, hd->used, rc == -1 ? "EOF" : gpg_strerror(rc));
+    if (rc != -1 && rc != GPG_ERR_EOF) break;
+  }
+  hd->current = first + i;
+  if (i < count) {
+    if (!rc) {
+      hd->found = hd->current;
+      if (descindex) *descindex = results[i].descindex;
+    }
+    /* The resources after it have not been searched.  */
+    for (j = i + 1; j < count; j++)
+      keybox_search_reset(hd->active[first + j].u.kb);
+  }
+  return rc;
+}
+
 /* Search the database for keys matching the search description.  If
  * the DB contains any legacy keys, these are silently ignored.
  *
@@ -1422,6 +2112,9 @@ gpg_error_t keydb_search(KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc, size_t ndesc,
   int was_reset = hd->is_reset;
   /* If an entry is already in the cache, then don't add it again.  */
   int already_in_cache = 0;
+  struct keyblock_cache_entry *entry;
+  int resource;
+  TRACE_SPAN("keydb_search");
 
   if (descindex) *descindex = 0; /* Make sure it is always set on return.  */
 
@@ -1475,9 +2168,49 @@ gpg_error_t keydb_search(KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc, size_t ndesc,
     return 0;
   }
 
+  /* Try the cache shared by all handles.  The same restriction on
+     the file position applies.  */
+  if (!hd->no_caching && ndesc == 1 &&
+      (desc[0].mode == KEYDB_SEARCH_MODE_FPR20 ||
+       desc[0].mode == KEYDB_SEARCH_MODE_FPR) &&
+      (entry = keyblock_cache_lookup(hd, desc[0].u.fpr, &resource)) &&
+      (hd->current < resource ||
+       (hd->current == resource &&
+        keybox_offset(hd->active[hd->current].u.kb) <= entry->offset))) {
+    iobuf_t iobuf;
+
+    iobuf = iobuf_temp_with_content((const char *)entry->image, entry->size);
+    if (iobuf) {
+      if (DBG_CLOCK) log_clock("keydb_search leave (shared cache)");
+
+      keyblock_cache_clear(hd);
+      hd->keyblock_cache.state = KEYBLOCK_CACHE_FILLED;
+      hd->keyblock_cache.iobuf = iobuf;
+      hd->keyblock_cache.pk_no = entry->pk_no;
+      hd->keyblock_cache.uid_no = entry->uid_no;
+      hd->keyblock_cache.resource = resource;
+      hd->keyblock_cache.offset = entry->offset;
+      hd->keyblock_cache.from_cache = 1;
+      memcpy(hd->keyblock_cache.fpr, desc[0].u.fpr, 20);
+
+      /* The keybox did not select the record.  */
+      hd->found = -1;
+      hd->current = resource;
+      keybox_seek(hd->active[hd->current].u.kb, entry->offset + 1);
+      hd->is_reset = 0;
+      keydb_stats.found_cached++;
+      keyblock_cache_stats.hits++;
+      return 0;
+    }
+  }
+
   rc = -1;
+  if (want_parallel_search(hd, desc, ndesc))
+    rc = search_parallel(hd, desc, ndesc, descindex);
   while ((rc == -1 || rc == GPG_ERR_EOF) && hd->current >= 0 &&
          hd->current < hd->used) {
+    struct resource_search_s result;
+
     if (DBG_LOOKUP)
       log_debug("%s: searching %s (resource %d of %d)\n", __func__,
                 (hd->active[hd->current].type == KEYDB_RESOURCE_TYPE_KEYBOX
@@ -1490,11 +2223,17 @@ gpg_error_t keydb_search(KEYDB_HANDLE hd, KEYDB_SEARCH_DESC *desc, size_t ndesc,
         BUG(); /* we should never see it here */
         break;
       case KEYDB_RESOURCE_TYPE_KEYBOX:
-        do
-          rc = keybox_search(hd->active[hd->current].u.kb, desc, ndesc,
-                             KEYBOX_BLOBTYPE_PGP, descindex,
-                             &hd->skipped_long_blobs);
-        while (rc == GPG_ERR_LEGACY_KEY);
+        /* Keep out writers which update the keybox in place.  */
+        rc = keybox_lock_shared(hd->active[hd->current].u.kb, 1);
+        if (rc) break;
+        result.descindex = 0;
+        result.skipped = 0;
+        search_resource(hd, hd->current, desc, ndesc, &result);
+        keybox_lock_shared(hd->active[hd->current].u.kb, 0);
+        record_resource_search(hd, hd->current, &result);
+        rc = result.rc;
+        if (descindex) *descindex = result.descindex;
+        hd->skipped_long_blobs += result.skipped;
         break;
     }
 
@@ -64,6 +64,19 @@ struct kbnode_struct {
 #define is_deleted_kbnode(a) ((a)->private_flag & 1)
 #define is_cloned_kbnode(a) ((a)->private_flag & 2)
 
+/* A node of a keyblock view, see kbnode_view_new.  */
+struct kbnode_view_item {
+  pkttype_t pkttype; /* Copied from PKT for a cheaper scan.  */
+  PACKET *pkt;
+  kbnode_t node;
+};
+
+/* The nodes of a keyblock as an array, for read-only traversal.  */
+typedef struct kbnode_view_s {
+  size_t count;
+  struct kbnode_view_item *items;
+} * kbnode_view_t;
+
 /* Bit flags used with build_pk_list.  */
 enum {
   PK_LIST_ENCRYPT_TO = 1, /* This is an encrypt-to recipient.    */
@@ -157,9 +170,22 @@ void keydb_pop_found_state(KEYDB_HANDLE hd);
 /* Return the file name of the resource.  */
 const char *keydb_get_resource_name(KEYDB_HANDLE hd);
 
+/* Hash a description of the state of all resources into MD.  */
+void keydb_hash_state(gcry_md_hd_t md);
+
 /* Return the keyblock last found by keydb_search.  */
 gpg_error_t keydb_get_keyblock(KEYDB_HANDLE hd, KBNODE *ret_kb);
 
+/* Return the raw image of the keyblock last found by keydb_search.  */
+gpg_error_t keydb_get_keyblock_image(KEYDB_HANDLE hd, iobuf_t *r_image);
+
+/* Parse an image returned by keydb_get_keyblock_image.  */
+gpg_error_t keydb_parse_keyblock_image(iobuf_t image, kbnode_t *r_keyblock);
+
+/* Return the keys and user IDs stored along with the keyblock.  */
+gpg_error_t keydb_get_keyinfo(KEYDB_HANDLE hd,
+                              struct keybox_keyinfo_s **r_info);
+
 /* Update the keyblock KB.  */
 gpg_error_t keydb_update_keyblock(ctrl_t ctrl, KEYDB_HANDLE hd, kbnode_t kb);
 
@@ -169,6 +195,18 @@ gpg_error_t keydb_insert_keyblock(KEYDB_HANDLE hd, kbnode_t kb);
 /* Delete the currently selected keyblock.  */
 gpg_error_t keydb_delete_keyblock(KEYDB_HANDLE hd);
 
+/* Keep all resources locked for a series of updates.  */
+gpg_error_t keydb_hold_lock(KEYDB_HANDLE hd);
+
+/* Release the locks taken by keydb_hold_lock.  */
+void keydb_release_lock(KEYDB_HANDLE hd);
+
+/* Append updates to the keyboxes instead of rewriting them.  */
+gpg_error_t keydb_set_append_only(KEYDB_HANDLE hd, int yes);
+
+/* Compact all writable keyboxes.  */
+gpg_error_t keydb_compact(KEYDB_HANDLE hd);
+
 /* Find the first writable resource.  */
 gpg_error_t keydb_locate_writable(KEYDB_HANDLE hd);
 
@@ -257,6 +295,9 @@ void cache_public_key(PKT_public_key *pk);
 /* Disable and drop the public key cache.  */
 void getkey_disable_caches(void);
 
+/* Print statistics about the public key and user ID caches.  */
+void getkey_dump_stats(void);
+
 /* Return the public key with the key id KEYID and store it at PK.  */
 int get_pubkey(ctrl_t ctrl, PKT_public_key *pk, u32 *keyid);
 
@@ -445,6 +486,8 @@ gpg_error_t hexkeygrip_from_pk(PKT_public_key *pk, char **r_grip);
 
 /*-- kbnode.c --*/
 KBNODE new_kbnode(PACKET *pkt);
+kbnode_t new_kbnode_with_packet(void);
+void replace_kbnode_packet(kbnode_t node, PACKET *pkt);
 KBNODE clone_kbnode(KBNODE node);
 void release_kbnode(KBNODE n);
 void delete_kbnode(KBNODE node);
@@ -457,5 +500,7 @@ KBNODE walk_kbnode(KBNODE root, KBNODE *context, int all);
 void clear_kbnode_flags(KBNODE n);
 int commit_kbnode(KBNODE *root);
 void dump_kbnode(KBNODE node);
+kbnode_view_t kbnode_view_new(kbnode_t keyblock);
+void kbnode_view_release(kbnode_view_t view);
 
 #endif /*G10_KEYDB_H*/
@@ -2460,6 +2460,115 @@ leave:
   if (err) write_status_error("set_expire", err);
 }
 
+/* Apply the quick edit operations listed in the file FNAME (stdin if
+ * FNAME is NULL or "-"), one per line:
+ *
+ *   set-expire FINGERPRINT EXPIRE
+ *   add-uid USER-ID NEW-USER-ID
+ *   revoke-uid USER-ID USER-ID-TO-REVOKE
+ *   set-primary-uid USER-ID PRIMARY-USER-ID
+ *
+ * The key is given by one word, the rest of the line is the second
+ * argument.  Empty lines and lines starting with '#' are ignored.  A
+ * failed operation is reported like the corresponding --quick command
+ * and does not stop the batch.  All operations are done under one
+ * lock of the key database, the changed keyblocks are appended to the
+ * keyboxes, which are compacted once at the end, and the trustdb is
+ * checked once at the end.  */
+void keyedit_quick_batch(ctrl_t ctrl, const char *fname) {
+  estream_t fp;
+  int is_stdin = 0;
+  char line[2048];
+  unsigned int lno = 0, count = 0;
+  KEYDB_HANDLE lock_hd;
+  char *p, *cmd, *key, *arg;
+  size_t n;
+
+  if (iobuf_is_pipe_filename(fname)) {
+    fp = es_stdin;
+    fname = "[stdin]";
+    is_stdin = 1;
+  } else if (!(fp = es_fopen(fname, "r"))) {
+    log_error(_("can't open '%s': %s\n"), fname, strerror(errno));
+    return;
+  }
+
+  if (is_secured_file(es_fileno(fp))) {
+    if (!is_stdin) es_fclose(fp);
+    gpg_err_set_errno(EPERM);
+    log_error(_("can't open '%s': %s\n"), fname, strerror(errno));
+    return;
+  }
+
+#ifdef HAVE_W32_SYSTEM
+  /* See keyedit_menu for why we need this.  */
+  check_trustdb_stale(ctrl);
+#endif
+
+  lock_hd = keydb_new();
+  if (lock_hd && keydb_hold_lock(lock_hd)) {
+    keydb_release(lock_hd);
+    lock_hd = NULL;
+  }
+  /* While we hold the lock, the keyboxes are only appended to.  */
+  if (lock_hd && keydb_set_append_only(lock_hd, 1))
+    keydb_set_append_only(lock_hd, 0);
+
+  while (es_fgets(line, DIM(line), fp)) {
+    lno++;
+    n = strlen(line);
+    if (line[n - 1] != '\n' && !es_feof(fp)) {
+      log_error(_("error in '%s': %s\n"), fname, _("line too long"));
+      break; /* can't continue */
+    }
+    trim_spaces(line);
+    if (!*line || *line == '#') continue;
+
+    /* Split the line into the command, the key and the rest.  */
+    cmd = line;
+    for (p = cmd; *p && !spacep(p); p++)
+      ;
+    if (*p) *p++ = 0;
+    while (spacep(p)) p++;
+    key = p;
+    for (; *p && !spacep(p); p++)
+      ;
+    if (*p) *p++ = 0;
+    while (spacep(p)) p++;
+    arg = p;
+    if (!*key || !*arg) {
+      log_error("%s:%u: %s\n", fname, lno, gpg_strerror(GPG_ERR_SYNTAX));
+      continue;
+    }
+
+    if (!strcmp(cmd, "set-expire"))
+      keyedit_quick_set_expire(ctrl, key, arg);
+    else if (!strcmp(cmd, "add-uid"))
+      keyedit_quick_adduid(ctrl, key, arg);
+    else if (!strcmp(cmd, "revoke-uid"))
+      keyedit_quick_revuid(ctrl, key, arg);
+    else if (!strcmp(cmd, "set-primary-uid"))
+      keyedit_quick_set_primary(ctrl, key, arg);
+    else {
+      log_error("%s:%u: %s: '%s'\n", fname, lno,
+                gpg_strerror(GPG_ERR_UNKNOWN_COMMAND), cmd);
+      continue;
+    }
+    if (!(++count % 100) && !opt.quiet)
+      log_info(_("%u operations processed so far\n"), count);
+  }
+  if (es_ferror(fp))
+    log_error(_("error reading '%s': %s\n"), fname,
+              gpg_strerror(gpg_error_from_syserror()));
+  if (!is_stdin) es_fclose(fp);
+
+  if (lock_hd) keydb_set_append_only(lock_hd, 0);
+  keydb_release(lock_hd);
+
+  /* The operations only marked the trustdb for a check.  */
+  check_or_update_trustdb(ctrl);
+}
+
 static void tty_print_notations(int indent, PKT_signature *sig) {
   int first = 1;
   struct notation *notation, *nd;
@@ -3655,9 +3764,7 @@ static gpg_error_t menu_expire(ctrl_t ctrl, kbnode_t pub_keyblock,
         newpkt = (PACKET *)xmalloc_clear(sizeof *newpkt);
         newpkt->pkttype = PKT_SIGNATURE;
         newpkt->pkt.signature = newsig;
-        free_packet(node->pkt, NULL);
-        xfree(node->pkt);
-        node->pkt = newpkt;
+        replace_kbnode_packet(node, newpkt);
         sub_pk = NULL;
       }
     }
@@ -3742,9 +3849,7 @@ static int menu_changeusage(ctrl_t ctrl, kbnode_t keyblock) {
         newpkt = (PACKET *)xmalloc_clear(sizeof *newpkt);
         newpkt->pkttype = PKT_SIGNATURE;
         newpkt->pkt.signature = newsig;
-        free_packet(node->pkt, NULL);
-        xfree(node->pkt);
-        node->pkt = newpkt;
+        replace_kbnode_packet(node, newpkt);
         sub_pk = NULL;
         break;
       }
@@ -3827,9 +3932,7 @@ static int menu_backsign(ctrl_t ctrl, kbnode_t pub_keyblock) {
         newpkt = (PACKET *)xmalloc_clear(sizeof(*newpkt));
         newpkt->pkttype = PKT_SIGNATURE;
         newpkt->pkt.signature = newsig;
-        free_packet(sig_pk->pkt, NULL);
-        xfree(sig_pk->pkt);
-        sig_pk->pkt = newpkt;
+        replace_kbnode_packet(sig_pk, newpkt);
 
         modified = 1;
       } else {
@@ -3953,9 +4056,7 @@ static int menu_set_primary_uid(ctrl_t ctrl, kbnode_t pub_keyblock) {
             newpkt = (PACKET *)xmalloc_clear(sizeof *newpkt);
             newpkt->pkttype = PKT_SIGNATURE;
             newpkt->pkt.signature = newsig;
-            free_packet(node->pkt, NULL);
-            xfree(node->pkt);
-            node->pkt = newpkt;
+            replace_kbnode_packet(node, newpkt);
             modified = 1;
           }
         }
@@ -4023,9 +4124,7 @@ static int menu_set_preferences(ctrl_t ctrl, kbnode_t pub_keyblock) {
           newpkt = (PACKET *)xmalloc_clear(sizeof *newpkt);
           newpkt->pkttype = PKT_SIGNATURE;
           newpkt->pkt.signature = newsig;
-          free_packet(node->pkt, NULL);
-          xfree(node->pkt);
-          node->pkt = newpkt;
+          replace_kbnode_packet(node, newpkt);
           modified = 1;
         }
       }
@@ -4178,9 +4277,7 @@ static int menu_set_notation(ctrl_t ctrl, const char *string,
           newpkt = (PACKET *)xmalloc_clear(sizeof *newpkt);
           newpkt->pkttype = PKT_SIGNATURE;
           newpkt->pkt.signature = newsig;
-          free_packet(node->pkt, NULL);
-          xfree(node->pkt);
-          node->pkt = newpkt;
+          replace_kbnode_packet(node, newpkt);
           modified = 1;
 
           if (notation) {
@@ -53,6 +53,7 @@ void keyedit_quick_set_expire(ctrl_t ctrl, const char *fpr,
                               const char *expirestr);
 void keyedit_quick_set_primary(ctrl_t ctrl, const char *username,
                                const char *primaryuid);
+void keyedit_quick_batch(ctrl_t ctrl, const char *fname);
 void show_basic_key_info(ctrl_t ctrl, kbnode_t keyblock);
 int keyedit_print_one_sig(ctrl_t ctrl, int rc, kbnode_t keyblock, kbnode_t node,
                           int *inv_sigs, int *no_key, int *oth_err,
@@ -137,20 +137,19 @@ char *pubkey_string(PKT_public_key *pk, char *buffer, size_t bufsize) {
 void hash_public_key(gcry_md_hd_t md, PKT_public_key *pk) {
   unsigned int n = 6;
   unsigned int nn[PUBKEY_MAX_NPKEY];
-  byte *pp[PUBKEY_MAX_NPKEY];
+  const byte *pp[PUBKEY_MAX_NPKEY];
+  byte *buf[PUBKEY_MAX_NPKEY]; /* Malloced copies to be released.  */
   int i;
   unsigned int nbits;
   size_t nbytes;
   int npkey = pubkey_get_npkey((pubkey_algo_t)(pk->pubkey_algo));
 
-  /* FIXME: We can avoid the extra malloc by calling only the first
-     mpi_print here which computes the required length and calling the
-     real mpi_print only at the end.  The speed advantage would only be
-     for ECC (opaque MPIs) or if we could implement an mpi_print
+  /* Opaque MPIs (ECC) are hashed from their own buffer.  FIXME: For
+     the other MPIs we could avoid the extra malloc with an mpi_print
      variant with a callback handler to do the hashing.  */
   if (npkey == 0 && pk->pkey[0] &&
       gcry_mpi_get_flag(pk->pkey[0], GCRYMPI_FLAG_OPAQUE)) {
-    pp[0] = (byte *)gcry_mpi_get_opaque(pk->pkey[0], &nbits);
+    pp[0] = (const byte *)gcry_mpi_get_opaque(pk->pkey[0], &nbits);
     nn[0] = (nbits + 7) / 8;
     n += nn[0];
   } else {
@@ -159,24 +158,19 @@ void hash_public_key(gcry_md_hd_t md, PKT_public_key *pk) {
         /* This case may only happen if the parsing of the MPI
            failed but the key was anyway created.  May happen
            during "gpg KEYFILE".  */
-        pp[i] = NULL;
+        pp[i] = buf[i] = NULL;
         nn[i] = 0;
       } else if (gcry_mpi_get_flag(pk->pkey[i], GCRYMPI_FLAG_OPAQUE)) {
-        const void *p;
-
-        p = gcry_mpi_get_opaque(pk->pkey[i], &nbits);
-        pp[i] = (byte *)xmalloc((nbits + 7) / 8);
-        if (p)
-          memcpy(pp[i], p, (nbits + 7) / 8);
-        else
-          pp[i] = NULL;
+        /* Opaque MPIs are hashed directly from their buffer.  */
+        pp[i] = (const byte *)gcry_mpi_get_opaque(pk->pkey[i], &nbits);
+        buf[i] = NULL;
         nn[i] = (nbits + 7) / 8;
         n += nn[i];
       } else {
         if (gcry_mpi_print(GCRYMPI_FMT_PGP, NULL, 0, &nbytes, pk->pkey[i]))
           BUG();
-        pp[i] = (byte *)xmalloc(nbytes);
-        if (gcry_mpi_print(GCRYMPI_FMT_PGP, pp[i], nbytes, &nbytes,
+        pp[i] = buf[i] = (byte *)xmalloc(nbytes);
+        if (gcry_mpi_print(GCRYMPI_FMT_PGP, buf[i], nbytes, &nbytes,
                            pk->pkey[i]))
           BUG();
         nn[i] = nbytes;
@@ -204,19 +198,32 @@ void hash_public_key(gcry_md_hd_t md, PKT_public_key *pk) {
   } else {
     for (i = 0; i < npkey; i++) {
       if (pp[i]) gcry_md_write(md, pp[i], nn[i]);
-      xfree(pp[i]);
+      xfree(buf[i]);
     }
   }
 }
 
-static gcry_md_hd_t do_fingerprint_md(PKT_public_key *pk) {
+/* Compute the fingerprint of PK and store it, and the keyid derived
+   from it, in PK.  Fingerprint and keyid only depend on the public
+   key parameters, which do not change after parsing, so this is done
+   at most once per key.  */
+static void compute_fingerprint(PKT_public_key *pk) {
   gcry_md_hd_t md;
+  const byte *dp;
+  size_t len;
 
   if (gcry_md_open(&md, DIGEST_ALGO_SHA1, 0)) BUG();
   hash_public_key(md, pk);
   gcry_md_final(md);
 
-  return md;
+  dp = gcry_md_read(md, 0);
+  len = gcry_md_get_algo_dlen(DIGEST_ALGO_SHA1);
+  log_assert(len <= MAX_FINGERPRINT_LEN);
+  memcpy(pk->fpr, dp, len);
+  pk->fprlen = len;
+  pk->keyid[0] = buf32_to_u32(dp + 12);
+  pk->keyid[1] = buf32_to_u32(dp + 16);
+  gcry_md_close(md);
 }
 
 /* fixme: Check whether we can replace this function or if not
@@ -425,26 +432,11 @@ u32 keyid_from_pk(PKT_public_key *pk, u32 *keyid) {
 
   if (!keyid) keyid = dummy_keyid;
 
-  if (pk->keyid[0] || pk->keyid[1]) {
-    keyid[0] = pk->keyid[0];
-    keyid[1] = pk->keyid[1];
-    lowbits = keyid[1];
-  } else {
-    const byte *dp;
-    gcry_md_hd_t md;
-
-    md = do_fingerprint_md(pk);
-    if (md) {
-      dp = gcry_md_read(md, 0);
-      keyid[0] = buf32_to_u32(dp + 12);
-      keyid[1] = buf32_to_u32(dp + 16);
-      lowbits = keyid[1];
-      gcry_md_close(md);
-      pk->keyid[0] = keyid[0];
-      pk->keyid[1] = keyid[1];
-    } else
-      pk->keyid[0] = pk->keyid[1] = keyid[0] = keyid[1] = lowbits = 0xFFFFFFFF;
-  }
+  if (!pk->keyid[0] && !pk->keyid[1]) compute_fingerprint(pk);
+
+  keyid[0] = pk->keyid[0];
+  keyid[1] = pk->keyid[1];
+  lowbits = keyid[1];
 
   return lowbits;
 }
@@ -632,21 +624,12 @@ const char *colon_expirestr_from_sig(PKT_signature *sig) {
  * the array or provide an array of length MAX_FINGERPRINT_LEN.
  */
 byte *fingerprint_from_pk(PKT_public_key *pk, byte *array, size_t *ret_len) {
-  const byte *dp;
-  size_t len;
-  gcry_md_hd_t md;
+  if (!pk->fprlen) compute_fingerprint(pk);
 
-  md = do_fingerprint_md(pk);
-  dp = gcry_md_read(md, 0);
-  len = gcry_md_get_algo_dlen(gcry_md_get_algo(md));
-  log_assert(len <= MAX_FINGERPRINT_LEN);
-  if (!array) array = (byte *)xmalloc(len);
-  memcpy(array, dp, len);
-  pk->keyid[0] = buf32_to_u32(dp + 12);
-  pk->keyid[1] = buf32_to_u32(dp + 16);
-  gcry_md_close(md);
+  if (!array) array = (byte *)xmalloc(pk->fprlen);
+  memcpy(array, pk->fpr, pk->fprlen);
 
-  if (ret_len) *ret_len = len;
+  if (ret_len) *ret_len = pk->fprlen;
   return array;
 }
 
@@ -28,6 +28,8 @@
 #include <fcntl.h> /* for setmode() */
 #endif
 
+#include <memory>
+
 #include <botan/hash.h>
 
 #include "../common/compliance.h"
@@ -36,6 +38,7 @@
 #include "../common/ttyio.h"
 #include "../common/util.h"
 #include "../common/zb32.h"
+#include "../kbx/keybox.h"
 #include "call-agent.h"
 #include "gpg.h"
 #include "keydb.h"
@@ -379,6 +382,59 @@ static void print_signature_stats(struct keylist_context *s) {
              s->oth_err);
 }
 
+/* Print the key last found at HD in colon format, using only what is
+ * stored in the keybox next to the keyblock.  This is the fast path
+ * of --fast-list-mode: the fingerprints, key IDs and user IDs are
+ * printed while the fields which require the parsed key or its
+ * self-signatures are left empty.  Returns an error if the data is
+ * not available; the caller then lists the keyblock as usual.  */
+static gpg_error_t list_keyinfo_colon(KEYDB_HANDLE hd) {
+  gpg_error_t err;
+  keybox_keyinfo_t info;
+  unsigned int i, j;
+
+  err = keydb_get_keyinfo(hd, &info);
+  if (err) return err;
+
+  for (i = 0; i < info->nkeys; i++) {
+    es_fputs(i ? "sub::::" : "pub::::", es_stdout);
+    for (j = 0; j < 8; j++)
+      es_fprintf(es_stdout, "%02X", info->keys[i].keyid[j]);
+    /* Fields 6 to 18 or 20.  */
+    es_fputs(i ? "::::::::::::::" : "::::::::::::::::", es_stdout);
+    es_putc('\n', es_stdout);
+    es_fputs("fpr:::::::::", es_stdout);
+    for (j = 0; j < 20; j++)
+      es_fprintf(es_stdout, "%02X", info->keys[i].fpr[j]);
+    es_fputs(":\n", es_stdout);
+
+    if (i) continue;
+
+    for (j = 0; j < info->nuids; j++) {
+      std::unique_ptr<Botan::HashFunction> rmd160(
+          Botan::HashFunction::create_or_throw("RIPEMD-160"));
+      byte namehash[20];
+      int k;
+
+      rmd160->update((const uint8_t *)info->uids[j].name, info->uids[j].len);
+      rmd160->final(namehash);
+
+      es_fputs("uid:::::::", es_stdout);
+      for (k = 0; k < 20; k++) es_fprintf(es_stdout, "%02X", namehash[k]);
+      es_fputs("::", es_stdout);
+      es_write_sanitized(es_stdout, info->uids[j].name, info->uids[j].len,
+                         ":", NULL);
+      es_fputs(":::::::::", es_stdout);
+      es_putc(':', es_stdout); /* End of field 19 (last_update). */
+      es_putc(':', es_stdout); /* End of field 20 (origin). */
+      es_putc('\n', es_stdout);
+    }
+  }
+
+  keybox_release_keyinfo(info);
+  return 0;
+}
+
 /* List all keys.  If SECRET is true only secret keys are listed.  If
    MARK_SECRET is true secret keys are indicated in a public key
    listing.  */
@@ -389,10 +445,17 @@ static void list_all(ctrl_t ctrl, int secret, int mark_secret) {
   int any_secret;
   const char *lastresname, *resname;
   struct keylist_context listctx;
+  int fast;
 
   memset(&listctx, 0, sizeof(listctx));
   if (opt.check_sigs) listctx.check_sigs = 1;
 
+  /* The keybox does not record anything beyond the fingerprints and
+     user IDs, so other requests need the full keyblock.  */
+  fast = (opt.fast_list_mode && opt.with_colons && !secret && !mark_secret &&
+          !opt.list_sigs && !opt.check_sigs && !opt.with_keygrip &&
+          !opt.with_key_data && !attrib_fp);
+
   hd = keydb_new();
   if (!hd)
     rc = gpg_error_from_syserror();
@@ -406,6 +469,8 @@ static void list_all(ctrl_t ctrl, int secret, int mark_secret) {
 
   lastresname = NULL;
   do {
+    if (fast && !list_keyinfo_colon(hd)) continue;
+
     rc = keydb_get_keyblock(hd, &keyblock);
     if (rc) {
       if (rc == GPG_ERR_LEGACY_KEY) continue; /* Skip legacy keys.  */
@@ -26,6 +26,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <set>
+#include <string>
+
 #include <boost/algorithm/string/join.hpp>
 
 #include "../common/iobuf.h"
@@ -846,6 +849,9 @@ static int keyidlist(ctrl_t ctrl, const std::vector<std::string> &users,
   KEYDB_HANDLE kdbhd;
   int ndesc;
   KEYDB_SEARCH_DESC *desc = NULL;
+  /* The fingerprints and keyids already listed.  A key may be found
+     more than once, for example if it is in several keyrings.  */
+  std::set<std::string> seen;
 
   *count = 0;
 
@@ -890,21 +896,28 @@ static int keyidlist(ctrl_t ctrl, const std::vector<std::string> &users,
     }
 
     if ((node = find_kbnode(keyblock, PKT_PUBLIC_KEY))) {
+      KEYDB_SEARCH_DESC *item = &(*klist)[*count];
+      std::string ident;
+
       /* v4 keys get full fingerprints.  v3 keys get long keyids.
          This is because it's easy to calculate any sort of keyid
          from a v4 fingerprint, but not a v3 fingerprint. */
 
+      memset(item, 0, sizeof *item);
       if (node->pkt->pkt.public_key->version < 4) {
-        (*klist)[*count].mode = KEYDB_SEARCH_MODE_LONG_KID;
-        keyid_from_pk(node->pkt->pkt.public_key, (*klist)[*count].u.kid);
+        item->mode = KEYDB_SEARCH_MODE_LONG_KID;
+        keyid_from_pk(node->pkt->pkt.public_key, item->u.kid);
+        ident.assign((const char *)item->u.kid, sizeof item->u.kid);
       } else {
         size_t dummy;
 
-        (*klist)[*count].mode = KEYDB_SEARCH_MODE_FPR20;
-        fingerprint_from_pk(node->pkt->pkt.public_key, (*klist)[*count].u.fpr,
-                            &dummy);
+        item->mode = KEYDB_SEARCH_MODE_FPR20;
+        fingerprint_from_pk(node->pkt->pkt.public_key, item->u.fpr, &dummy);
+        ident.assign((const char *)item->u.fpr, 20);
       }
 
+      if (!seen.insert(ident).second) continue;
+
       (*count)++;
 
       if (*count == num) {
@@ -110,6 +110,9 @@ enum gcry_cipher_algos map_cipher_openpgp_to_gcry(cipher_algo_t algo);
 int openpgp_cipher_blocklen(cipher_algo_t algo);
 int openpgp_cipher_test_algo(cipher_algo_t algo);
 const char *openpgp_cipher_algo_name(cipher_algo_t algo);
+int openpgp_aead_test_algo(aead_algo_t algo, enum gcry_cipher_modes *r_mode,
+                           unsigned int *r_ivlen);
+const char *openpgp_aead_algo_name(aead_algo_t algo);
 
 pubkey_algo_t map_pk_gcry_to_openpgp(enum gcry_pk_algos algo);
 int openpgp_pk_test_algo(pubkey_algo_t algo);
@@ -139,6 +142,7 @@ void obsolete_scdaemon_option(const char *configname, unsigned int configlineno,
                               const char *name);
 
 int string_to_cipher_algo(const char *string);
+int string_to_aead_algo(const char *string);
 int string_to_digest_algo(const char *string);
 
 const char *compress_algo_to_string(int algo);
@@ -175,7 +179,9 @@ unsigned int ecdsa_qbits_from_Q(unsigned int qbits);
 
 /*-- cpr.c --*/
 void set_status_fd(int fd);
+void set_status_stream(estream_t fp);
 int is_status_enabled(void);
+void flush_status(void);
 void write_status(int no);
 void write_status_error(const char *where, gpg_error_t err);
 void write_status_errcode(const char *where, int errcode);
@@ -232,6 +238,9 @@ int sign_file(ctrl_t ctrl, const std::vector<std::string> &filenames,
               int do_encrypt,
               const std::vector<std::pair<std::string, unsigned int>> &remusr,
               const char *outfile);
+void sign_files_detached(
+    ctrl_t ctrl, int nfiles, char **files,
+    const std::vector<std::pair<std::string, unsigned int>> &locusr);
 int clearsign_file(
     ctrl_t ctrl, const char *fname,
     const std::vector<std::pair<std::string, unsigned int>> &locusr,
@@ -243,6 +252,28 @@ int sign_symencrypt_file(
 /*-- sig-check.c --*/
 void sig_check_dump_stats(void);
 
+/* Verify many independent signatures in parallel.  */
+typedef struct sig_batch_s *sig_batch_t;
+sig_batch_t sig_batch_new(void);
+void sig_batch_release(sig_batch_t batch);
+size_t sig_batch_add(sig_batch_t batch, PKT_public_key *pk,
+                     PKT_signature *sig, gcry_md_hd_t digest);
+void sig_batch_run(sig_batch_t batch, int nthreads);
+size_t sig_batch_count(sig_batch_t batch);
+gpg_error_t sig_batch_result(sig_batch_t batch, size_t idx);
+
+/* Verify and cache the uncached self-signatures of KEYBLOCK in
+   parallel.  */
+void check_self_sigs_batch(ctrl_t ctrl, kbnode_t keyblock);
+void check_self_sigs_bulk(ctrl_t ctrl, kbnode_t *keyblocks,
+                          size_t nkeyblocks);
+
+/* Likewise for the certifications by other keys on the user IDs of
+   the NKEYBLOCKS key blocks at KEYBLOCKS.  */
+void check_certs_batch(ctrl_t ctrl, kbnode_t *keyblocks, size_t nkeyblocks,
+                       int (*filter)(void *opaque, PKT_signature *sig),
+                       void *opaque);
+
 /* SIG is a revocation signature.  Check if any of PK's designated
    revokers generated it.  If so, return 0.  Note: this function
    (correctly) doesn't care if the designated revoker is revoked.  */
@@ -355,6 +386,7 @@ void import_print_stats(import_stats_t hd);
 struct impex_filter_parm_s {
   ctrl_t ctrl;
   kbnode_t node;
+  char numbuf[3][20]; /* Buffers for the numerical properties.  */
 };
 
 const char *impex_filter_getval(void *cookie, const char *propname);
@@ -51,6 +51,12 @@ struct kidlist_item {
   int reason;
 };
 
+/* A public key encrypted session key for an anonymous recipient.  */
+struct hidden_pkenc_item {
+  struct hidden_pkenc_item *next;
+  PKT_pubkey_enc *enc;
+};
+
 /*
  * Object to hold the processing context.
  */
@@ -89,6 +95,10 @@ struct mainproc_context {
   int trustletter;       /* Temporary usage in list_node. */
   unsigned long symkeys; /* Number of symmetrically encrypted session keys.  */
   struct kidlist_item *pkenc_list; /* List of encryption packets. */
+  /* Encryption packets for anonymous recipients, which are only tried
+     after all other encryption packets (in reverse order).  */
+  struct hidden_pkenc_item *hidden_pkenc;
+  seckey_index_t seckey_index; /* Our secret keys, see get_session_key.  */
   struct {
     unsigned int sig_seen : 1; /* Set to true if a signature packet
                                   has been seen. */
@@ -101,6 +111,7 @@ struct mainproc_context {
 static int do_proc_packets(ctrl_t ctrl, CTX c, iobuf_t a);
 static void list_node(CTX c, kbnode_t node);
 static void proc_tree(CTX c, kbnode_t node);
+static void proc_hidden_pubkey_enc(CTX c);
 static int literals_seen;
 
 /*** Functions.  ***/
@@ -116,6 +127,14 @@ static void release_list(CTX c) {
     c->pkenc_list = tmp;
   }
   c->pkenc_list = NULL;
+  while (c->hidden_pkenc) {
+    struct hidden_pkenc_item *tmp = c->hidden_pkenc->next;
+    free_pubkey_enc(c->hidden_pkenc->enc);
+    xfree(c->hidden_pkenc);
+    c->hidden_pkenc = tmp;
+  }
+  release_seckey_index(c->seckey_index);
+  c->seckey_index = NULL;
   c->list = NULL;
   c->any.data = 0;
   c->any.uncompress_failed = 0;
@@ -235,6 +254,9 @@ static int symkey_decrypt_seskey(DEK *dek, byte *seskey, size_t slen) {
 static void proc_symkey_enc(CTX c, PACKET *pkt) {
   PKT_symkey_enc *enc;
 
+  /* Do not ask for a passphrase before we tried our secret keys.  */
+  proc_hidden_pubkey_enc(c);
+
   enc = pkt->pkt.symkey_enc;
   if (!enc)
     log_error("invalid symkey encrypted packet\n");
@@ -297,30 +319,11 @@ leave:
   free_packet(pkt, NULL);
 }
 
-static void proc_pubkey_enc(ctrl_t ctrl, CTX c, PACKET *pkt) {
-  PKT_pubkey_enc *enc;
+/* Try to get the session key from the encryption packet ENC and
+   record the result in the list of encryption packets.  */
+static void try_pubkey_enc(ctrl_t ctrl, CTX c, PKT_pubkey_enc *enc) {
   int result = 0;
 
-  /* Check whether the secret key is available and store in this case.  */
-  c->last_was_session_key = 1;
-  enc = pkt->pkt.pubkey_enc;
-  /*printf("enc: encrypted by a pubkey with keyid %08lX\n", enc->keyid[1] );*/
-  /* Hmmm: why do I have this algo check here - anyway there is
-   * function to check it. */
-  if (opt.verbose) log_info(_("public key is %s\n"), keystr(enc->keyid));
-
-  if (is_status_enabled()) {
-    char buf[50];
-    /* FIXME: For ECC support we need to map the OpenPGP algo number
-       to the Libgcrypt defined one.  This is due a chicken-egg
-       problem: We need to have code in Libgcrypt for a new
-       algorithm so to implement a proposed new algorithm before the
-       IANA will finally assign an OpenPGP identifier.  */
-    snprintf(buf, sizeof buf, "%08lX%08lX %d 0", (unsigned long)enc->keyid[0],
-             (unsigned long)enc->keyid[1], enc->pubkey_algo);
-    write_status_text(STATUS_ENC_TO, buf);
-  }
-
   if (!opt.list_only && !opt.override_session_key.empty()) {
     c->dek = (DEK *)Botan::allocate_memory(1, sizeof *c->dek);
     result = get_override_session_key(
@@ -337,17 +340,13 @@ static void proc_pubkey_enc(ctrl_t ctrl, CTX c, PACKET *pkt) {
     /* Note that we also allow type 20 Elgamal keys for decryption.
        There are still a couple of those keys in active use as a
        subkey.  */
-
-    /* FIXME: Store this all in a list and process it later so that
-       we can prioritize what key to use.  This gives a better user
-       experience if wildcard keyids are used.  */
     if (!c->dek && ((!enc->keyid[0] && !enc->keyid[1]) || opt.try_all_secrets ||
                     have_secret_key_with_kid(enc->keyid))) {
       if (opt.list_only)
         result = -1;
       else {
         c->dek = (DEK *)Botan::allocate_memory(1, sizeof(*c->dek));
-        if ((result = get_session_key(ctrl, enc, c->dek))) {
+        if ((result = get_session_key(ctrl, &c->seckey_index, enc, c->dek))) {
           /* Error: Delete the DEK. */
           Botan::deallocate_memory(c->dek, 1, sizeof(*c->dek));
           c->dek = nullptr;
@@ -373,10 +372,69 @@ static void proc_pubkey_enc(ctrl_t ctrl, CTX c, PACKET *pkt) {
     if (!result && opt.verbose > 1)
       log_info(_("public key encrypted data: good DEK\n"));
   }
+}
+
+static void proc_pubkey_enc(ctrl_t ctrl, CTX c, PACKET *pkt) {
+  PKT_pubkey_enc *enc;
+
+  /* Check whether the secret key is available and store in this case.  */
+  c->last_was_session_key = 1;
+  enc = pkt->pkt.pubkey_enc;
+  /*printf("enc: encrypted by a pubkey with keyid %08lX\n", enc->keyid[1] );*/
+  /* Hmmm: why do I have this algo check here - anyway there is
+   * function to check it. */
+  if (opt.verbose) log_info(_("public key is %s\n"), keystr(enc->keyid));
+
+  if (is_status_enabled()) {
+    char buf[50];
+    /* FIXME: For ECC support we need to map the OpenPGP algo number
+       to the Libgcrypt defined one.  This is due a chicken-egg
+       problem: We need to have code in Libgcrypt for a new
+       algorithm so to implement a proposed new algorithm before the
+       IANA will finally assign an OpenPGP identifier.  */
+    snprintf(buf, sizeof buf, "%08lX%08lX %d 0", (unsigned long)enc->keyid[0],
+             (unsigned long)enc->keyid[1], enc->pubkey_algo);
+    write_status_text(STATUS_ENC_TO, buf);
+  }
+
+  /* An anonymous recipient requires trying all our secret keys.  We
+     do that only after all encryption packets have been seen, because
+     one of the others may name one of our keys.  */
+  if (!enc->keyid[0] && !enc->keyid[1] && !opt.try_all_secrets &&
+      !opt.list_only && opt.override_session_key.empty()) {
+    struct hidden_pkenc_item *x = (hidden_pkenc_item *)xmalloc(sizeof *x);
+    x->enc = enc;
+    x->next = c->hidden_pkenc;
+    c->hidden_pkenc = x;
+    pkt->pkt.pubkey_enc = NULL;
+    return;
+  }
 
+  try_pubkey_enc(ctrl, c, enc);
   free_packet(pkt, NULL);
 }
 
+/* Try the deferred encryption packets for anonymous recipients.  */
+static void proc_hidden_pubkey_enc(CTX c) {
+  struct hidden_pkenc_item *list = NULL;
+
+  /* Restore the order of the packets.  */
+  while (c->hidden_pkenc) {
+    struct hidden_pkenc_item *tmp = c->hidden_pkenc->next;
+    c->hidden_pkenc->next = list;
+    list = c->hidden_pkenc;
+    c->hidden_pkenc = tmp;
+  }
+
+  while (list) {
+    struct hidden_pkenc_item *tmp = list->next;
+    try_pubkey_enc(c->ctrl, c, list->enc);
+    free_pubkey_enc(list->enc);
+    xfree(list);
+    list = tmp;
+  }
+}
+
 /*
  * Print the list of public key encrypted packets which we could
  * not decrypt.
@@ -427,6 +485,8 @@ static void proc_encrypted(CTX c, PACKET *pkt) {
   bool fail = false;
   int result = 0;
 
+  proc_hidden_pubkey_enc(c);
+
   if (literals_seen > 0) {
     log_info(_("WARNING: plaintext seen before decryption\n"));
     fail = true;
@@ -503,7 +563,9 @@ static void proc_encrypted(CTX c, PACKET *pkt) {
       && opt.override_session_key.empty()
       /* Check symmetric cipher.  */
       && gnupg_cipher_is_compliant(CO_DE_VS, (cipher_algo_t)(c->dek->algo),
-                                   GCRY_CIPHER_MODE_CFB)) {
+                                   pkt->pkt.encrypted->aead_algo
+                                       ? GCRY_CIPHER_MODE_OCB
+                                       : GCRY_CIPHER_MODE_CFB)) {
     struct kidlist_item *i;
     int compliant = 1;
     PKT_public_key *pk = (PKT_public_key *)xmalloc(sizeof *pk);
@@ -537,7 +599,8 @@ static void proc_encrypted(CTX c, PACKET *pkt) {
 
   if (result == -1)
     ;
-  else if (!result && !pkt->pkt.encrypted->mdc_method) {
+  else if (!result && !pkt->pkt.encrypted->mdc_method &&
+           !pkt->pkt.encrypted->aead_algo) {
     /* The message has been decrypted but has no MDC.  */
     log_error(_("WARNING: message was not integrity protected\n"));
     if (opt.verbose > 1) log_info("decryption forced to fail\n");
@@ -545,7 +608,8 @@ static void proc_encrypted(CTX c, PACKET *pkt) {
   } else if (!result) {
     write_status(STATUS_DECRYPTION_OKAY);
     if (opt.verbose > 1) log_info(_("decryption okay\n"));
-    if (pkt->pkt.encrypted->mdc_method && !result)
+    if ((pkt->pkt.encrypted->mdc_method || pkt->pkt.encrypted->aead_algo) &&
+        !result)
       write_status(STATUS_GOODMDC);
     else
       log_info(_("WARNING: message was not integrity protected\n"));
@@ -1121,6 +1185,7 @@ static int do_proc_packets(ctrl_t ctrl, CTX c, iobuf_t a) {
           break;
         case PKT_ENCRYPTED:
         case PKT_ENCRYPTED_MDC:
+        case PKT_ENCRYPTED_AEAD:
           proc_encrypted(c, pkt);
           break;
         case PKT_COMPRESSED:
@@ -1139,6 +1204,7 @@ static int do_proc_packets(ctrl_t ctrl, CTX c, iobuf_t a) {
         case PKT_PUBKEY_ENC:
         case PKT_ENCRYPTED:
         case PKT_ENCRYPTED_MDC:
+        case PKT_ENCRYPTED_AEAD:
           write_status_text(STATUS_UNEXPECTED, "0");
           rc = GPG_ERR_UNEXPECTED;
           goto leave;
@@ -1182,6 +1248,7 @@ static int do_proc_packets(ctrl_t ctrl, CTX c, iobuf_t a) {
           break;
         case PKT_ENCRYPTED:
         case PKT_ENCRYPTED_MDC:
+        case PKT_ENCRYPTED_AEAD:
           proc_encrypted(c, pkt);
           break;
         case PKT_PLAINTEXT:
@@ -1226,6 +1293,7 @@ static int do_proc_packets(ctrl_t ctrl, CTX c, iobuf_t a) {
           break;
         case PKT_ENCRYPTED:
         case PKT_ENCRYPTED_MDC:
+        case PKT_ENCRYPTED_AEAD:
           proc_encrypted(c, pkt);
           break;
         case PKT_PLAINTEXT:
@@ -534,6 +534,39 @@ const char *openpgp_cipher_algo_name(cipher_algo_t algo) {
   }
 }
 
+/* Return 0 if the AEAD algorithm ALGO is supported.  On success the
+   Libgcrypt cipher mode and the length of the starting IV are stored
+   at R_MODE and R_IVLEN, which may be NULL.  EAX is defined by
+   RFC4880bis but not available in our Libgcrypt.  */
+int openpgp_aead_test_algo(aead_algo_t algo, enum gcry_cipher_modes *r_mode,
+                           unsigned int *r_ivlen) {
+  switch (algo) {
+    case AEAD_ALGO_OCB:
+      if (r_mode) *r_mode = GCRY_CIPHER_MODE_OCB;
+      if (r_ivlen) *r_ivlen = 15;
+      return 0;
+
+    case AEAD_ALGO_EAX:
+    default:
+      return GPG_ERR_CIPHER_ALGO;
+  }
+}
+
+/* Map the OpenPGP AEAD algorithm ALGO to a string representation of
+   the algorithm name.  For unknown algorithm IDs this function
+   returns "?".  */
+const char *openpgp_aead_algo_name(aead_algo_t algo) {
+  switch (algo) {
+    case AEAD_ALGO_EAX:
+      return "EAX";
+    case AEAD_ALGO_OCB:
+      return "OCB";
+    case AEAD_ALGO_NONE:
+    default:
+      return "?";
+  }
+}
+
 /* Return 0 if ALGO is a supported OpenPGP public key algorithm.  */
 int openpgp_pk_test_algo(pubkey_algo_t algo) {
   return openpgp_pk_test_algo2(algo, 0);
@@ -1014,6 +1047,29 @@ int string_to_cipher_algo(const char *string) {
   return val;
 }
 
+/* Map the name of an AEAD algorithm or the "An" syntax to its
+   OpenPGP ID.  Returns 0 for unknown or unsupported algorithms.  */
+int string_to_aead_algo(const char *string) {
+  int val = 0;
+
+  if (!string)
+    ;
+  else if (!ascii_strcasecmp(string, "EAX"))
+    val = AEAD_ALGO_EAX;
+  else if (!ascii_strcasecmp(string, "OCB"))
+    val = AEAD_ALGO_OCB;
+  else if (string[0] == 'A' || string[0] == 'a') {
+    char *endptr;
+
+    string++;
+    val = strtol(string, &endptr, 10);
+    if (!*string || *endptr) val = 0;
+  }
+
+  if (val && openpgp_aead_test_algo((aead_algo_t)val, NULL, NULL)) val = 0;
+  return val;
+}
+
 /*
  * Wrapper around gcry_md_map_name to provide a fallback using the
  * "Hn" syntax as used by the preference strings.
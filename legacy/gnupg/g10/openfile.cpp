@@ -223,6 +223,7 @@ int open_outfile(int inp_fd, const char *iname, int mode, int restrictedperm,
   }
 
   if (*a) iobuf_ioctl(*a, IOBUF_IOCTL_NO_CACHE, 1, NULL);
+  if (*a && opt.async_io) iobuf_ioctl(*a, IOBUF_IOCTL_ASYNC, 1, NULL);
 
   return rc;
 }
@@ -121,6 +121,7 @@ extern int memory_stat_debug_mode;
 #define IMPORT_EXPORT (1 << 9)
 #define IMPORT_RESTORE (1 << 10)
 #define IMPORT_REPAIR_KEYS (1 << 11)
+#define IMPORT_BULK (1 << 12)
 
 #define EXPORT_LOCAL_SIGS (1 << 0)
 #define EXPORT_ATTRIBUTES (1 << 1)
@@ -129,6 +130,7 @@ extern int memory_stat_debug_mode;
 #define EXPORT_MINIMAL (1 << 4)
 #define EXPORT_CLEAN (1 << 5)
 #define EXPORT_BACKUP (1 << 10)
+#define EXPORT_PARALLEL (1 << 11)
 
 #define LIST_SHOW_POLICY_URLS (1 << 1)
 #define LIST_SHOW_STD_NOTATIONS (1 << 2)
@@ -171,6 +173,8 @@ struct options {
   bool list_only{false};
   bool mimemode{false};
   bool textmode{false};
+  bool async_io{false}; /* Option --async-io active.  */
+  bool threaded_filters{false}; /* Option --threaded-filters active.  */
   bool expert{false};
   tao::optional<std::string> def_sig_expire{"0"};
   bool ask_sig_expire{false};
@@ -188,14 +192,19 @@ struct options {
       false};               /* Option --with-subkey-fingerprint active.  */
   bool with_keygrip{false}; /* Option --with-keygrip active.  */
   bool with_secret{false};  /* Option --with-secret active.  */
+  bool fast_list_mode{false}; /* Option --fast-list-mode active.  */
   int fingerprint{0};       /* list fingerprints */
   bool list_sigs{false};    /* list signatures */
   bool no_armor{false};
   bool list_packets{false}; /* Option --list-packets active.  */
   int def_cipher_algo{0};
+  int def_aead_algo{0}; /* Use AEAD encrypted data packets if set.  */
+  int chunk_size{22};   /* log2 of the AEAD chunk size.  */
   int def_digest_algo{0};
   int cert_digest_algo{0};
   int compress_algo{-1}; /* defaults to DEFAULT_COMPRESS_ALGO */
+  int compress_level{-1}; /* 1..9, or -1 for the library default.  */
+  int compress_threads{1}; /* 0 for one per core.  */
   std::vector<std::pair<std::string, unsigned int>> def_secret_key;
   tao::optional<std::string> def_recipient;
   int def_recipient_self{0};
@@ -253,6 +262,9 @@ struct options {
     tao::optional<std::string> http_proxy;
   } keyserver_options;
   unsigned int import_options{IMPORT_REPAIR_KEYS};
+  /* The maximum number of signatures by other keys imported for one
+     user ID or subkey, or 0 for no limit.  */
+  unsigned int import_max_uid_sigs{10000};
   unsigned int export_options{EXPORT_ATTRIBUTES};
   unsigned int list_options{(LIST_SHOW_UID_VALIDITY | LIST_SHOW_USAGE)};
   unsigned int verify_options{
@@ -283,6 +295,8 @@ struct options {
 
   bool try_all_secrets{false};
   bool no_sig_cache{false};
+  bool no_recipient_cache{false};
+  bool legacy_packet_parser{false}; /* Don't frame packets with NeoPG.  */
   bool no_auto_check_trustdb{false};
   bool preserve_permissions{false};
   std::vector<groupitem> grouplist;
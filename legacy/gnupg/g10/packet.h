@@ -188,6 +188,7 @@ typedef struct {
     unsigned policy_url : 1; /* At least one policy URL is present */
     unsigned notation : 1;   /* At least one notation is present */
     unsigned expired : 1;
+    unsigned pooled : 1; /* Allocated by alloc_signature.  */
   } flags;
   /* The key that allegedly generated this signature.  (Directly
      serialized in v3 sigs; for v4 sigs, this must be explicitly added
@@ -272,6 +273,7 @@ typedef struct {
         primary : 2; /* 2 if set via the primary flag, 1 if calculated */
     unsigned int revoked : 1;
     unsigned int expired : 1;
+    unsigned int pooled : 1; /* Allocated by alloc_user_id.  */
   } flags;
 
   char *mbox; /* NULL or the result of mailbox_from_userid.  */
@@ -352,6 +354,11 @@ typedef struct {
   /* keyid of this key.  Never access this value directly!  Instead,
      use pk_keyid().  */
   u32 keyid[2];
+  /* The fingerprint of this key, computed together with KEYID.  Valid
+     if FPRLEN is not 0.  Never access this value directly!  Instead,
+     use fingerprint_from_pk().  */
+  byte fprlen;
+  byte fpr[MAX_FINGERPRINT_LEN];
   std::vector<prefitem_t> *prefs; /* list of preferences (may be NULL) */
   struct {
     unsigned int mdc : 1;            /* MDC feature set.  */
@@ -369,6 +376,7 @@ typedef struct {
     unsigned int backsig : 2;        /* 0=none, 1=bad, 2=good.  */
     unsigned int serialno_valid : 1; /* SERIALNO below is valid.  */
     unsigned int exact : 1;          /* Found via exact (!) search.  */
+    unsigned int pooled : 1;         /* Allocated by alloc_public_key.  */
   } flags;
   PKT_user_id *user_id; /* If != NULL: found by that uid. */
   struct revocation_key *revkey;
@@ -441,6 +449,13 @@ typedef struct {
   /* If 0, MDC is disabled.  Otherwise, the MDC method that was used
      (currently, only DIGEST_ALGO_SHA1 is supported).  */
   byte mdc_method;
+  /* For PKT_ENCRYPTED_AEAD, the AEAD algorithm, the symmetric cipher
+     and the chunk size octet from the packet header (the chunks are
+     2^(chunkbyte+6) octets long).  All zero for the other packet
+     types.  */
+  byte aead_algo;
+  byte cipher_algo;
+  byte chunkbyte;
   /* An iobuf holding the data to be decrypted.  (This is not used for
      encryption!)  */
   iobuf_t buf;
@@ -588,6 +603,7 @@ struct parse_packet_ctx_s {
   int free_last_pkt;             /* Indicates that LAST_PKT must be freed.  */
   int skip_meta;                 /* Skip ring trust packets.  */
   unsigned int n_parsed_packets; /* Number of parsed packets.  */
+  struct parse_packet_frames_s *frames; /* See init_parse_packet_framed. */
 };
 typedef struct parse_packet_ctx_s *parse_packet_ctx_t;
 
@@ -599,13 +615,27 @@ typedef struct parse_packet_ctx_s *parse_packet_ctx_t;
     (a)->free_last_pkt = 0;               \
     (a)->skip_meta = 0;                   \
     (a)->n_parsed_packets = 0;            \
+    (a)->frames = NULL;                   \
   } while (0)
 
 #define deinit_parse_packet(a)                      \
   do {                                              \
     if ((a)->free_last_pkt) free_packet(NULL, (a)); \
+    release_parse_packet_frames(a);                 \
   } while (0)
 
+/* Like init_parse_packet, but INP must be a temp stream (as created
+ * by iobuf_temp_with_content): its packets are framed up front by the
+ * NeoPG packet parser, which works on the buffer in place.
+ * parse_packet then only parses the packet bodies.  Packets the
+ * framer does not handle (partial lengths, errors) and everything
+ * after them are left to the normal parser, so the results are the
+ * same.  */
+void init_parse_packet_framed(parse_packet_ctx_t ctx, iobuf_t inp);
+
+/* Release the frames of CTX, see init_parse_packet_framed.  */
+void release_parse_packet_frames(parse_packet_ctx_t ctx);
+
 #if DEBUG_PARSE_PACKET
 /* There are debug functions and should not be used directly.  */
 int dbg_search_packet(parse_packet_ctx_t ctx, PACKET *pkt, off_t *retpos,
@@ -791,6 +821,9 @@ struct notation *sig_to_notation(PKT_signature *sig);
 void free_notation(struct notation *notation);
 
 /*-- free-packet.c --*/
+PKT_signature *alloc_signature(void);
+PKT_public_key *alloc_public_key(void);
+PKT_user_id *alloc_user_id(size_t namelen);
 void free_symkey_enc(PKT_symkey_enc *enc);
 void free_pubkey_enc(PKT_pubkey_enc *enc);
 void free_seckey_enc(PKT_signature *enc);
@@ -822,8 +855,16 @@ gpg_error_t check_signature2(ctrl_t ctrl, PKT_signature *sig,
                              int *r_expired, int *r_revoked,
                              PKT_public_key **r_pk);
 
+/* Drop the hash checkpoints over PK or UID, which are about to be
+   released.  */
+void sig_check_forget_key(PKT_public_key *pk);
+void sig_check_forget_uid(PKT_user_id *uid);
+
 /*-- pubkey-enc.c --*/
-gpg_error_t get_session_key(ctrl_t ctrl, PKT_pubkey_enc *k, DEK *dek);
+typedef struct seckey_index_s *seckey_index_t;
+gpg_error_t get_session_key(ctrl_t ctrl, seckey_index_t *r_index,
+                            PKT_pubkey_enc *k, DEK *dek);
+void release_seckey_index(seckey_index_t idx);
 gpg_error_t get_override_session_key(DEK *dek, const char *string);
 
 /*-- compress.c --*/
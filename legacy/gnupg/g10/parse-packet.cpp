@@ -32,6 +32,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <vector>
+
+#include <neopg/parser/openpgp.h>
+
 #include "../common/host2net.h"
 #include "../common/iobuf.h"
 #include "../common/util.h"
@@ -242,6 +246,160 @@ static void unknown_pubkey_warning(int algo) {
   }
 }
 
+/* A packet found by the NeoPG framer.  */
+struct packet_frame {
+  size_t off;           /* Offset of the header in the buffer.  */
+  unsigned int hdrlen;  /* Length of the header.  */
+  unsigned long pktlen; /* Length of the body.  */
+};
+
+/* The packets of a temp stream, see init_parse_packet_framed.  */
+struct parse_packet_frames_s {
+  std::vector<struct packet_frame> frames;
+  size_t next;   /* Index of the next frame to parse.  */
+  size_t resume; /* Where the normal parser takes over.  */
+};
+
+namespace {
+/* Collect the complete packets passed by NeoPG::RawPacketParser.  At
+   the first packet that is not passed in one piece, framing stops by
+   throwing Stop.  It also stops at data packets, because their
+   bodies are left in the stream for the caller to read.  */
+class FrameSink : public NeoPG::RawPacketRefSink {
+ public:
+  struct Stop {};
+
+  FrameSink(struct parse_packet_frames_s *frames, const byte *base)
+      : m_frames(frames), m_base(base) {}
+
+  void next_packet(const NeoPG::PacketHeader &header, const char *data,
+                   size_t length) override {
+    struct packet_frame frame;
+    size_t body = (const byte *)data - m_base;
+
+    switch ((int)header.type()) {
+      case PKT_PLAINTEXT:
+      case PKT_COMPRESSED:
+      case PKT_ENCRYPTED:
+      case PKT_ENCRYPTED_MDC:
+      case PKT_ENCRYPTED_AEAD:
+        throw Stop();
+      default:
+        break;
+    }
+
+    frame.hdrlen = header_length(header);
+    if (body < m_frames->resume + frame.hdrlen) throw Stop();
+    frame.off = body - frame.hdrlen;
+    frame.pktlen = length;
+    if (frame.off != m_frames->resume || !(m_base[frame.off] & 0x80))
+      throw Stop();
+    m_frames->frames.push_back(frame);
+    m_frames->resume = body + length;
+  }
+  void start_packet(const NeoPG::PacketHeader &header) override {
+    throw Stop();
+  }
+  void continue_packet(const NeoPG::NewPacketLength *length_info,
+                       const char *data, size_t length) override {
+    throw Stop();
+  }
+  void finish_packet(const NeoPG::NewPacketLength *length_info,
+                     const char *data, size_t length) override {
+    throw Stop();
+  }
+  void error_packet(const NeoPG::PacketHeader &header,
+                    const NeoPG::ParserError &error) override {
+    throw Stop();
+  }
+
+ private:
+  struct parse_packet_frames_s *m_frames;
+  const byte *m_base;
+
+  static unsigned int header_length(const NeoPG::PacketHeader &header) {
+    NeoPG::PacketLengthType type;
+
+    if (header.format() == NeoPG::PacketFormat::Old) {
+      type = static_cast<const NeoPG::OldPacketHeader &>(header).m_length_type;
+      return type == NeoPG::PacketLengthType::OneOctet
+                 ? 2
+                 : type == NeoPG::PacketLengthType::TwoOctet ? 3 : 5;
+    }
+    type = static_cast<const NeoPG::NewPacketHeader &>(header)
+               .m_length.m_length_type;
+    return type == NeoPG::PacketLengthType::OneOctet
+               ? 2
+               : type == NeoPG::PacketLengthType::TwoOctet ? 3 : 6;
+  }
+};
+}  // namespace
+
+void init_parse_packet_framed(parse_packet_ctx_t ctx, iobuf_t inp) {
+  struct parse_packet_frames_s *frames;
+  const byte *base;
+  size_t start;
+
+  init_parse_packet(ctx, inp);
+  if (opt.legacy_packet_parser || inp->use != IOBUF_INPUT_TEMP || inp->chain)
+    return;
+
+  frames = new struct parse_packet_frames_s;
+  base = iobuf_get_temp_buffer(inp);
+  start = inp->d.start;
+  frames->next = 0;
+  frames->resume = start;
+
+  try {
+    FrameSink sink(frames, base);
+    NeoPG::RawPacketParser parser(sink);
+
+    parser.process((const char *)base + start,
+                   iobuf_get_temp_length(inp) - start);
+  } catch (const FrameSink::Stop &) {
+    /* The normal parser continues at FRAMES->RESUME.  */
+  } catch (const std::exception &) {
+    /* Likewise for errors in the framer.  The normal parser reports
+       them.  */
+  }
+  ctx->frames = frames;
+}
+
+void release_parse_packet_frames(parse_packet_ctx_t ctx) {
+  delete ctx->frames;
+  ctx->frames = NULL;
+}
+
+/* Set up PKTTYPE, PKTLEN, HDR, HDRLEN and the position of CTX->INP for
+   the next packet framed by init_parse_packet_framed.  Returns false
+   if there is no such packet; CTX->INP is then positioned for the
+   normal parser and the frames are released.  */
+static bool next_packet_frame(parse_packet_ctx_t ctx, int *pkttype,
+                              unsigned long *pktlen, byte *hdr, int *hdrlen,
+                              off_t *pos) {
+  struct parse_packet_frames_s *frames = ctx->frames;
+  const byte *base = iobuf_get_temp_buffer(ctx->inp);
+
+  if (frames->next < frames->frames.size()) {
+    const struct packet_frame &frame = frames->frames[frames->next++];
+
+    *pos = frame.off;
+    *hdrlen = frame.hdrlen;
+    memcpy(hdr, base + frame.off, frame.hdrlen);
+    if (hdr[0] & 0x40)
+      *pkttype = hdr[0] & 0x3f;
+    else
+      *pkttype = (hdr[0] >> 2) & 0xf;
+    *pktlen = frame.pktlen;
+    iobuf_seek(ctx->inp, frame.off + frame.hdrlen);
+    return true;
+  }
+
+  iobuf_seek(ctx->inp, frames->resume);
+  release_parse_packet_frames(ctx);
+  return false;
+}
+
 #if DEBUG_PARSE_PACKET
 int dbg_parse_packet(parse_packet_ctx_t ctx, PACKET *pkt, const char *dbg_f,
                      int dbg_l) {
@@ -475,6 +633,13 @@ static int parse(parse_packet_ctx_t ctx, PACKET *pkt, int onlykeypkts,
 
 again:
   log_assert(!pkt->pkt.generic);
+  if (ctx->frames &&
+      next_packet_frame(ctx, &pkttype, &pktlen, hdr, &hdrlen, &pos)) {
+    if (retpos) *retpos = pos;
+    ctb = hdr[0];
+    new_ctb = !!(ctb & 0x40);
+    goto framed;
+  }
   if (retpos || list_mode) {
     pos = iobuf_tell(inp);
     if (retpos) *retpos = pos;
@@ -550,6 +715,7 @@ again:
         case PKT_PLAINTEXT:
         case PKT_ENCRYPTED:
         case PKT_ENCRYPTED_MDC:
+        case PKT_ENCRYPTED_AEAD:
         case PKT_COMPRESSED:
           iobuf_set_partial_body_length_mode(inp, c & 0xff);
           pktlen = 0; /* To indicate partial length.  */
@@ -603,6 +769,7 @@ again:
     }
   }
 
+framed:
   /* Sometimes the decompressing layer enters an error state in which
      it simply outputs 0xff for every byte read.  If we have a stream
      of 0xff bytes, then it will be detected as a new format packet
@@ -680,8 +847,7 @@ again:
     case PKT_PUBLIC_SUBKEY:
     case PKT_SECRET_KEY:
     case PKT_SECRET_SUBKEY:
-      pkt->pkt.public_key =
-          (PKT_public_key *)xmalloc_clear(sizeof *pkt->pkt.public_key);
+      pkt->pkt.public_key = alloc_public_key();
       rc = parse_key(inp, pkttype, pktlen, hdr, hdrlen, pkt);
       break;
     case PKT_SYMKEY_ENC:
@@ -691,8 +857,7 @@ again:
       rc = parse_pubkeyenc(inp, pkttype, pktlen, pkt);
       break;
     case PKT_SIGNATURE:
-      pkt->pkt.signature =
-          (PKT_signature *)xmalloc_clear(sizeof *pkt->pkt.signature);
+      pkt->pkt.signature = alloc_signature();
       rc = parse_signature(inp, pkttype, pktlen, pkt->pkt.signature);
       break;
     case PKT_ONEPASS_SIG:
@@ -724,6 +889,7 @@ again:
       break;
     case PKT_ENCRYPTED:
     case PKT_ENCRYPTED_MDC:
+    case PKT_ENCRYPTED_AEAD:
       rc = parse_encrypted(inp, pkttype, pktlen, pkt, new_ctb, partial);
       break;
     case PKT_MDC:
@@ -1947,7 +2113,9 @@ static int parse_key(IOBUF inp, int pkttype, unsigned long pktlen, byte *hdr,
       }
     }
   }
-  if (list_mode) keyid_from_pk(pk, keyid);
+  /* Compute the keyid and the fingerprint right away; nearly every
+     user of a parsed key needs them and they are cached in PK.  */
+  keyid_from_pk(pk, keyid);
 
   if (pkttype == PKT_SECRET_KEY || pkttype == PKT_SECRET_SUBKEY) {
     struct seckey_info *ski;
@@ -2278,8 +2446,7 @@ static int parse_user_id(IOBUF inp, int pkttype, unsigned long pktlen,
     return GPG_ERR_INV_PACKET;
   }
 
-  packet->pkt.user_id =
-      (PKT_user_id *)xmalloc_clear(sizeof *packet->pkt.user_id + pktlen);
+  packet->pkt.user_id = alloc_user_id(pktlen);
   packet->pkt.user_id->len = pktlen;
   packet->pkt.user_id->ref = 1;
 
@@ -2336,8 +2503,7 @@ static int parse_attribute(IOBUF inp, int pkttype, unsigned long pktlen,
   }
 
 #define EXTRA_UID_NAME_SPACE 71
-  packet->pkt.user_id = (PKT_user_id *)xmalloc_clear(
-      sizeof *packet->pkt.user_id + EXTRA_UID_NAME_SPACE);
+  packet->pkt.user_id = alloc_user_id(EXTRA_UID_NAME_SPACE);
   packet->pkt.user_id->ref = 1;
   packet->pkt.user_id->attrib_data = (byte *)xmalloc(pktlen ? pktlen : 1);
   packet->pkt.user_id->attrib_len = pktlen;
@@ -2629,7 +2795,57 @@ static int parse_encrypted(IOBUF inp, int pkttype, unsigned long pktlen,
   ed->buf = NULL;
   ed->new_ctb = new_ctb;
   ed->is_partial = partial;
-  if (pkttype == PKT_ENCRYPTED_MDC) {
+  ed->aead_algo = 0;
+  ed->cipher_algo = 0;
+  ed->chunkbyte = 0;
+  if (pkttype == PKT_ENCRYPTED_AEAD) {
+    int version;
+
+    /* The header is the version, the cipher and AEAD algorithms and
+       the chunk size octet, followed by the IV and at least the final
+       16 octet tag.  */
+    if (orig_pktlen && pktlen < 4 + 16) {
+      log_error("packet(%d) too short\n", pkttype);
+      if (list_mode) *listfp << ":aead encrypted packet: [too short]\n";
+      rc = GPG_ERR_INV_PACKET;
+      iobuf_skip_rest(inp, pktlen, partial);
+      goto leave;
+    }
+    version = iobuf_get_noeof(inp);
+    ed->cipher_algo = iobuf_get_noeof(inp);
+    ed->aead_algo = iobuf_get_noeof(inp);
+    ed->chunkbyte = iobuf_get_noeof(inp);
+    if (orig_pktlen) pktlen -= 4;
+    if (version != 1) {
+      log_error("encrypted_aead packet with unknown version %d\n", version);
+      if (list_mode) *listfp << ":aead encrypted packet: [unknown version]\n";
+      rc = GPG_ERR_INV_PACKET;
+      goto leave;
+    }
+    if (ed->chunkbyte > 56) {
+      log_error("encrypted_aead packet with invalid chunk size %d\n",
+                ed->chunkbyte);
+      if (list_mode) *listfp << ":aead encrypted packet: [bad chunk size]\n";
+      rc = GPG_ERR_INV_PACKET;
+      goto leave;
+    }
+    ed->mdc_method = 0;
+    ed->len = pktlen;
+
+    if (list_mode) {
+      if (orig_pktlen)
+        *listfp << boost::format(":aead encrypted packet:\n\tlength: %lu\n") %
+                       orig_pktlen;
+      else
+        *listfp << ":aead encrypted packet:\n\tlength: unknown\n";
+      *listfp << boost::format("\tcipher: %d aead: %d cb: %d\n") %
+                     (unsigned)ed->cipher_algo % (unsigned)ed->aead_algo %
+                     (unsigned)ed->chunkbyte;
+    }
+
+    ed->buf = inp;
+    goto leave;
+  } else if (pkttype == PKT_ENCRYPTED_MDC) {
     /* Fixme: add some pktlen sanity checks.  */
     int version;
 
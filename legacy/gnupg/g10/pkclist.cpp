@@ -20,12 +20,20 @@
 
 #include <config.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <string>
+#include <unordered_map>
+
+#include "../common/mbox-util.h"
 #include "../common/status.h"
+#include "../common/sysutils.h"
 #include "../common/ttyio.h"
 #include "../common/util.h"
 #include "gpg.h"
@@ -33,6 +41,7 @@
 #include "main.h"
 #include "options.h"
 #include "packet.h"
+#include "tdbio.h"
 #include "trustdb.h"
 
 #define CONTROL_D ('D' - 'A' + 1)
@@ -673,6 +682,262 @@ static std::vector<std::pair<std::string, unsigned int>> expand_group(
   return output;
 }
 
+/* The recipient cache.
+ *
+ * Resolving a mail address to an encryption key ranks all keys with
+ * a matching user ID by their validity, which is the expensive part
+ * of building the recipient list for a large keyring.  The result is
+ * thus kept in the file RCPT_CACHE_NAME in the home directory, so
+ * that the next encryption to the same address only needs to fetch
+ * the chosen key by its fingerprint.
+ *
+ * A record maps a hash over the address, the requested usage and the
+ * trust model to the fingerprint of the chosen key, the name hash of
+ * the user ID which matched and the validity computed for it.  The
+ * record is only valid for the state of the key database and the
+ * trust database it was computed for.  That state is described by
+ * the identity of the files (see keydb_hash_state), which changes
+ * with every update; there are no generation counters stored in the
+ * databases themselves.  Only results that were accepted by the
+ * validity checks are stored.  Expiration and revocation of the key
+ * are still checked on every use by the fingerprint lookup.
+ *
+ * The file is handled like the signature cache in sig-check.c: it
+ * starts with a header record (RCPT_CACHE_MAGIC) followed by records
+ * of RCPT_CACHE_RECLEN bytes, is read once per process and extended
+ * with O_APPEND.  Later records override earlier ones.  The layout of
+ * a record is:
+ *
+ *   - b20  SHA-1 over the address, the usage and the trust model
+ *   - b20  SHA-1 over the state of the databases
+ *   - b20  Fingerprint of the chosen key
+ *   - b20  Name hash of the user ID
+ *   - u32  Validity, in network byte order
+ *   - b12  RFU
+ */
+#define RCPT_CACHE_NAME "rcptcache.dat"
+#define RCPT_CACHE_MAGIC "NeoPG recipient cache v1"
+#define RCPT_CACHE_RECLEN 96
+#define RCPT_CACHE_MAX_RECORDS (64 * 1024)
+
+static struct {
+  int loaded;
+  int fd; /* Opened for appending on the first store, or -1.  */
+  std::unordered_map<std::string, std::string> *records;
+} rcpt_cache = {0, -1, NULL};
+
+/* Return true if the lookup of NAME for USE may use the recipient
+   cache and store the key for it at KEY.  */
+static int rcpt_cache_key(const char *name, unsigned int use,
+                          std::string &key) {
+  gcry_md_hd_t md;
+  const char *s;
+
+  if (opt.no_recipient_cache || !is_valid_mailbox(name)) return 0;
+  /* Only trust models whose validity depends on nothing but the
+     databases are supported.  */
+  if (opt.trust_model != TM_CLASSIC && opt.trust_model != TM_PGP &&
+      opt.trust_model != TM_ALWAYS && opt.trust_model != TM_DIRECT)
+    return 0;
+
+  if (gcry_md_open(&md, GCRY_MD_SHA1, 0)) return 0;
+  for (s = name; *s; s++) gcry_md_putc(md, ascii_tolower(*s));
+  gcry_md_putc(md, 0);
+  gcry_md_putc(md, use);
+  gcry_md_putc(md, opt.trust_model);
+  key.assign((const char *)gcry_md_read(md, GCRY_MD_SHA1), 20);
+  gcry_md_close(md);
+  return 1;
+}
+
+/* Return the hash over the current state of the key database and the
+   trust database.  */
+static std::string rcpt_cache_state(void) {
+  gcry_md_hd_t md;
+  std::string state;
+  const char *fname;
+
+  if (gcry_md_open(&md, GCRY_MD_SHA1, 0)) return state;
+  keydb_hash_state(md);
+  fname = tdbio_get_dbname();
+  if (fname) {
+    struct stat st;
+    uint64_t id[3] = {0, 0, 0};
+
+    if (!stat(fname, &st)) {
+      id[0] = st.st_size;
+      id[1] = st.st_mtime;
+      id[2] = st.st_ino;
+    }
+    gcry_md_write(md, fname, strlen(fname) + 1);
+    gcry_md_write(md, id, sizeof id);
+  }
+  state.assign((const char *)gcry_md_read(md, GCRY_MD_SHA1), 20);
+  gcry_md_close(md);
+  return state;
+}
+
+/* Read the cache file.  Errors are ignored; the cache is then empty
+   or incomplete.  */
+static void rcpt_cache_load(void) {
+  char *fname;
+  FILE *fp;
+  char rec[RCPT_CACHE_RECLEN];
+  char magic[RCPT_CACHE_RECLEN];
+  struct stat st;
+
+  rcpt_cache.loaded = 1;
+  rcpt_cache.records = new std::unordered_map<std::string, std::string>;
+
+  fname = make_filename(gnupg_homedir(), RCPT_CACHE_NAME, NULL);
+  fp = fopen(fname, "rb");
+  if (!fp) goto leave;
+
+  if (fstat(fileno(fp), &st) ||
+      st.st_size / RCPT_CACHE_RECLEN > RCPT_CACHE_MAX_RECORDS) {
+    fclose(fp);
+    fp = NULL;
+    if (DBG_CACHE) log_debug("rcpt_cache: removing '%s'\n", fname);
+    gnupg_remove(fname);
+    goto leave;
+  }
+
+  memset(magic, 0, sizeof magic);
+  memcpy(magic, RCPT_CACHE_MAGIC, strlen(RCPT_CACHE_MAGIC));
+  if (fread(rec, RCPT_CACHE_RECLEN, 1, fp) != 1 ||
+      memcmp(rec, magic, RCPT_CACHE_RECLEN))
+    goto leave;
+
+  while (fread(rec, RCPT_CACHE_RECLEN, 1, fp) == 1)
+    (*rcpt_cache.records)[std::string(rec, 20)] =
+        std::string(rec, RCPT_CACHE_RECLEN);
+
+  if (DBG_CACHE)
+    log_debug("rcpt_cache: %zu records from '%s'\n",
+              rcpt_cache.records->size(), fname);
+
+leave:
+  if (fp) fclose(fp);
+  xfree(fname);
+}
+
+/* Try to resolve NAME for USE from the recipient cache.  On success
+   the key is stored at PK, which must have been cleared except for
+   the requested usage, its validity at R_TRUSTLEVEL and true is
+   returned.  */
+static int rcpt_cache_get(ctrl_t ctrl, PKT_public_key *pk, const char *name,
+                          unsigned int use, int *r_trustlevel) {
+  std::string key;
+  kbnode_t keyblock = NULL;
+  kbnode_t node;
+  const byte *rec;
+
+  if (!rcpt_cache_key(name, use, key)) return 0;
+  if (!rcpt_cache.loaded) rcpt_cache_load();
+
+  auto it = rcpt_cache.records->find(key);
+  if (it == rcpt_cache.records->end()) return 0;
+  rec = (const byte *)it->second.data();
+
+  /* A scheduled trustdb check updates the trustdb and thus changes
+     the state.  */
+  check_trustdb_stale(ctrl);
+  if (rcpt_cache_state().compare(0, 20, (const char *)rec + 20, 20)) {
+    if (DBG_CACHE) log_debug("rcpt_cache: '%s' is outdated\n", name);
+    return 0;
+  }
+
+  if (get_pubkey_byfprint(ctrl, pk, &keyblock, rec + 40, 20)) {
+    /* The key is not usable anymore.  */
+    release_public_key_parts(pk);
+    memset(pk, 0, sizeof *pk);
+    pk->req_usage = use;
+    return 0;
+  }
+
+  /* Restore the user ID for the preferences.  */
+  for (node = keyblock; node; node = node->next)
+    if (node->pkt->pkttype == PKT_USER_ID &&
+        !memcmp(namehash_from_uid(node->pkt->pkt.user_id), rec + 60, 20))
+      break;
+  if (!node) {
+    release_kbnode(keyblock);
+    release_public_key_parts(pk);
+    memset(pk, 0, sizeof *pk);
+    pk->req_usage = use;
+    return 0;
+  }
+  free_user_id(pk->user_id);
+  pk->user_id = scopy_user_id(node->pkt->pkt.user_id);
+  release_kbnode(keyblock);
+
+  *r_trustlevel = buf32_to_u32(rec + 80);
+  if (DBG_CACHE)
+    log_debug("rcpt_cache: '%s' resolved to %s\n", name, keystr_from_pk(pk));
+  return 1;
+}
+
+/* Store the key PK with validity TRUSTLEVEL, which has been found for
+   NAME and USE, in the recipient cache.  */
+static void rcpt_cache_put(PKT_public_key *pk, const char *name,
+                           unsigned int use, int trustlevel) {
+  std::string key;
+  std::string state;
+  byte rec[RCPT_CACHE_RECLEN];
+  size_t fprlen;
+
+  if (!pk->user_id || (trustlevel & TRUST_FLAG_PENDING_CHECK)) return;
+  if (!rcpt_cache_key(name, use, key)) return;
+  if (!rcpt_cache.loaded) rcpt_cache_load();
+  state = rcpt_cache_state();
+  if (state.size() != 20) return;
+
+  memset(rec, 0, sizeof rec);
+  memcpy(rec, key.data(), 20);
+  memcpy(rec + 20, state.data(), 20);
+  fingerprint_from_pk(pk, rec + 40, &fprlen);
+  if (fprlen != 20) return;
+  memcpy(rec + 60, namehash_from_uid(pk->user_id), 20);
+  rec[80] = trustlevel >> 24;
+  rec[81] = trustlevel >> 16;
+  rec[82] = trustlevel >> 8;
+  rec[83] = trustlevel;
+
+  std::string &slot = (*rcpt_cache.records)[key];
+  if (slot.size() == RCPT_CACHE_RECLEN && !memcmp(slot.data(), rec, sizeof rec))
+    return;
+  slot.assign((const char *)rec, sizeof rec);
+  if (opt.dry_run) return;
+
+  if (rcpt_cache.fd == -1) {
+    char *fname = make_filename(gnupg_homedir(), RCPT_CACHE_NAME, NULL);
+    struct stat st;
+
+    rcpt_cache.fd = open(fname, O_WRONLY | O_APPEND | O_CREAT, 0600);
+    if (rcpt_cache.fd == -1) {
+      if (DBG_CACHE)
+        log_debug("rcpt_cache: can't open '%s': %s\n", fname,
+                  strerror(errno));
+      rcpt_cache.fd = -2;
+    } else if (!fstat(rcpt_cache.fd, &st) && !st.st_size) {
+      char magic[RCPT_CACHE_RECLEN];
+
+      memset(magic, 0, sizeof magic);
+      memcpy(magic, RCPT_CACHE_MAGIC, strlen(RCPT_CACHE_MAGIC));
+      if (write(rcpt_cache.fd, magic, RCPT_CACHE_RECLEN) !=
+          RCPT_CACHE_RECLEN) {
+        close(rcpt_cache.fd);
+        rcpt_cache.fd = -2;
+      }
+    }
+    xfree(fname);
+  }
+  if (rcpt_cache.fd < 0) return;
+
+  if (write(rcpt_cache.fd, rec, sizeof rec) != sizeof rec && DBG_CACHE)
+    log_debug("rcpt_cache: write failed: %s\n", strerror(errno));
+}
+
 /* Helper for build_pk_list to find and check one key.  This helper is
  * also used directly in server mode by the RECIPIENTS command.  On
  * success the new key is added to PK_LIST_ADDR.  NAME is the user id
@@ -685,6 +950,8 @@ gpg_error_t find_and_check_key(ctrl_t ctrl, const char *name, unsigned int use,
                                pk_list_t *pk_list_addr) {
   int rc;
   PKT_public_key *pk;
+  int cached = 0;
+  int trustlevel = 0;
 
   if (!name || !*name) return GPG_ERR_INV_USER_ID;
 
@@ -694,6 +961,8 @@ gpg_error_t find_and_check_key(ctrl_t ctrl, const char *name, unsigned int use,
 
   if (from_file)
     rc = get_pubkey_fromfile(ctrl, pk, name);
+  else if ((cached = rcpt_cache_get(ctrl, pk, name, use, &trustlevel)))
+    rc = 0;
   else
     rc = get_best_pubkey_byname(ctrl, NULL, pk, name, NULL, 0, 0);
   if (rc) {
@@ -729,9 +998,8 @@ gpg_error_t find_and_check_key(ctrl_t ctrl, const char *name, unsigned int use,
 
   /* Key found and usable.  Check validity. */
   if (!from_file) {
-    int trustlevel;
-
-    trustlevel = get_validity(ctrl, NULL, pk, pk->user_id, NULL, 1);
+    if (!cached)
+      trustlevel = get_validity(ctrl, NULL, pk, pk->user_id, NULL, 1);
     if ((trustlevel & TRUST_FLAG_DISABLED)) {
       /* Key has been disabled. */
       send_status_inv_recp(13, name);
@@ -746,6 +1014,8 @@ gpg_error_t find_and_check_key(ctrl_t ctrl, const char *name, unsigned int use,
       free_public_key(pk);
       return GPG_ERR_UNUSABLE_PUBKEY;
     }
+
+    if (!cached) rcpt_cache_put(pk, name, use, trustlevel);
   }
 
   /* Skip the actual key if the key is already present in the
@@ -44,12 +44,13 @@ gcry_mpi_t get_mpi_from_sexp(gcry_sexp_t sexp, const char *item, int mpifmt) {
   return data;
 }
 
-/****************
- * Emulate our old PK interface here - sometime in the future we might
- * change the internal design to directly fit to libgcrypt.
- */
-int pk_verify(pubkey_algo_t pkalgo, gcry_mpi_t hash, gcry_mpi_t *data,
-              gcry_mpi_t *pkey) {
+/* Build the S-expressions to verify the signature DATA over HASH
+   with the public key PKEY and store them at R_SIG, R_HASH and
+   R_PKEY.  */
+static int pk_verify_sexps(pubkey_algo_t pkalgo, gcry_mpi_t hash,
+                           gcry_mpi_t *data, gcry_mpi_t *pkey,
+                           gcry_sexp_t *r_sig, gcry_sexp_t *r_hash,
+                           gcry_sexp_t *r_pkey) {
   gcry_sexp_t s_sig, s_hash, s_pkey;
   int rc;
   unsigned int neededfixedlen = 0;
@@ -176,7 +177,30 @@ int pk_verify(pubkey_algo_t pkalgo, gcry_mpi_t hash, gcry_mpi_t *data,
   } else
     BUG();
 
-  if (!rc) rc = gcry_pk_verify(s_sig, s_hash, s_pkey);
+  if (rc) {
+    gcry_sexp_release(s_sig);
+    gcry_sexp_release(s_hash);
+    gcry_sexp_release(s_pkey);
+    return rc;
+  }
+  *r_sig = s_sig;
+  *r_hash = s_hash;
+  *r_pkey = s_pkey;
+  return 0;
+}
+
+/****************
+ * Emulate our old PK interface here - sometime in the future we might
+ * change the internal design to directly fit to libgcrypt.
+ */
+int pk_verify(pubkey_algo_t pkalgo, gcry_mpi_t hash, gcry_mpi_t *data,
+              gcry_mpi_t *pkey) {
+  gcry_sexp_t s_sig, s_hash, s_pkey;
+  int rc;
+
+  rc = pk_verify_sexps(pkalgo, hash, data, pkey, &s_sig, &s_hash, &s_pkey);
+  if (rc) return rc;
+  rc = gcry_pk_verify(s_sig, s_hash, s_pkey);
 
   gcry_sexp_release(s_sig);
   gcry_sexp_release(s_hash);
@@ -184,6 +208,45 @@ int pk_verify(pubkey_algo_t pkalgo, gcry_mpi_t hash, gcry_mpi_t *data,
   return rc;
 }
 
+/* Verify the N signatures at JOBS like pk_verify, with one call to
+   gcry_pk_verify_batch, and store the result of each in its RC
+   field.  */
+void pk_verify_batch(struct pk_verify_job *jobs, size_t n) {
+  gcry_pk_verify_job_t *gjobs;
+  size_t i, ngjobs = 0;
+
+  gjobs = (gcry_pk_verify_job_t *)xtrycalloc(n ? n : 1, sizeof *gjobs);
+  if (!gjobs) {
+    for (i = 0; i < n; i++)
+      jobs[i].rc = pk_verify(jobs[i].algo, jobs[i].hash, jobs[i].data,
+                             jobs[i].pkey);
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    gcry_pk_verify_job_t *g = &gjobs[ngjobs];
+
+    jobs[i].rc = pk_verify_sexps(jobs[i].algo, jobs[i].hash, jobs[i].data,
+                                 jobs[i].pkey, &g->sigval, &g->data, &g->pkey);
+    if (!jobs[i].rc) ngjobs++;
+  }
+
+  gcry_pk_verify_batch(gjobs, ngjobs);
+
+  /* The jobs that could be set up are in the same order in GJOBS.  */
+  for (i = 0, ngjobs = 0; i < n; i++) {
+    gcry_pk_verify_job_t *g;
+
+    if (jobs[i].rc) continue;
+    g = &gjobs[ngjobs++];
+    jobs[i].rc = g->err;
+    gcry_sexp_release(g->sigval);
+    gcry_sexp_release(g->data);
+    gcry_sexp_release(g->pkey);
+  }
+  xfree(gjobs);
+}
+
 /****************
  * Emulate our old PK interface here - sometime in the future we might
  * change the internal design to directly fit to libgcrypt.
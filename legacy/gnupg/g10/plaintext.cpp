@@ -28,6 +28,8 @@
 #include <fcntl.h> /* for setmode() */
 #endif
 
+#include <algorithm>
+
 #include "../common/status.h"
 #include "../common/ttyio.h"
 #include "../common/util.h"
@@ -380,37 +382,72 @@ leave:
   return err;
 }
 
+/* Write the LEN bytes at BUF to MD2 with each lone CR and lone LF
+ * turned into CR,LF.  *LC is the last byte of the previous call or
+ * -1.  Runs without line endings are found with memchr and hashed in
+ * one go.  */
+static void hash_crlf(gcry_md_hd_t md2, const byte *buf, size_t len,
+                      int *lc) {
+  const byte *end = buf + len;
+  const byte *cr = buf, *lf = buf;
+  const byte *p, *q;
+
+  for (p = buf; p < end; p = q) {
+    if (*p == '\n') {
+      if (*lc != '\r') gcry_md_putc(md2, '\r');
+      gcry_md_putc(md2, '\n');
+      *lc = '\n';
+      q = p + 1;
+      continue;
+    }
+    if (*lc == '\r') gcry_md_putc(md2, '\n');
+    if (*p == '\r') {
+      gcry_md_putc(md2, '\r');
+      *lc = '\r';
+      q = p + 1;
+      continue;
+    }
+
+    /* CR and LF point to the next line endings after P.  P itself
+       is neither, so CR or LF at or before P must be searched
+       again.  */
+    if (cr <= p) {
+      cr = (const byte *)memchr(p, '\r', end - p);
+      if (!cr) cr = end;
+    }
+    if (lf <= p) {
+      lf = (const byte *)memchr(p, '\n', end - p);
+      if (!lf) lf = end;
+    }
+    q = std::min(cr, lf);
+    gcry_md_write(md2, p, q - p);
+    *lc = q[-1];
+  }
+}
+
 static void do_hash(gcry_md_hd_t md, gcry_md_hd_t md2, IOBUF fp, int textmode) {
   text_filter_context_t tfx;
-  int c;
+  byte *buffer;
+  int lc = -1;
+  int n;
+
+  /* With --async-io, the data is read ahead by a thread, so that
+     reading a large file overlaps with hashing it.  */
+  if (opt.async_io) iobuf_ioctl(fp, IOBUF_IOCTL_ASYNC, 1, NULL);
 
   if (textmode) {
     memset(&tfx, 0, sizeof tfx);
     iobuf_push_filter(fp, text_filter, &tfx);
   }
-  if (md2) { /* work around a strange behaviour in pgp2 */
-    /* It seems that at least PGP5 converts a single CR to a CR,LF too */
-    int lc = -1;
-    while ((c = iobuf_get(fp)) != -1) {
-      if (c == '\n' && lc == '\r')
-        gcry_md_putc(md2, c);
-      else if (c == '\n') {
-        gcry_md_putc(md2, '\r');
-        gcry_md_putc(md2, c);
-      } else if (c != '\n' && lc == '\r') {
-        gcry_md_putc(md2, '\n');
-        gcry_md_putc(md2, c);
-      } else
-        gcry_md_putc(md2, c);
-
-      if (md) gcry_md_putc(md, c);
-      lc = c;
-    }
-  } else {
-    while ((c = iobuf_get(fp)) != -1) {
-      if (md) gcry_md_putc(md, c);
-    }
+
+  buffer = (byte *)xmalloc(32768);
+  while ((n = iobuf_read(fp, buffer, 32768)) != -1) {
+    /* Work around a strange behaviour in pgp2.  It seems that at
+       least PGP5 converts a single CR to a CR,LF too.  */
+    if (md2) hash_crlf(md2, buffer, n, &lc);
+    if (md) gcry_md_write(md, buffer, n);
   }
+  xfree(buffer);
 }
 
 /****************
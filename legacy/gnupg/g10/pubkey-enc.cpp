@@ -23,6 +23,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <vector>
+
 #include "../common/compliance.h"
 #include "../common/host2net.h"
 #include "../common/status.h"
@@ -39,6 +41,14 @@
 static gpg_error_t get_it(ctrl_t ctrl, PKT_pubkey_enc *k, DEK *dek,
                           PKT_public_key *sk, u32 *keyid);
 
+/* The secret keys which may decrypt a session key for an anonymous
+   recipient.  The index is built on the first such recipient of a
+   message, so that the key database is walked and the agent is asked
+   for the keys only once and not again for each PKESK packet.  */
+struct seckey_index_s {
+  std::vector<PKT_public_key *> keys;
+};
+
 /* Check that the given algo is mentioned in one of the valid user-ids. */
 static int is_algo_in_prefs(kbnode_t keyblock, preftype_t type, int algo) {
   kbnode_t k;
@@ -57,11 +67,83 @@ static int is_algo_in_prefs(kbnode_t keyblock, preftype_t type, int algo) {
   return 0;
 }
 
+/* Build the index of the secret keys usable for decryption.  */
+static seckey_index_t build_seckey_index(ctrl_t ctrl) {
+  seckey_index_t idx = new seckey_index_s;
+  void *enum_context = NULL;
+  PKT_public_key *sk = NULL;
+
+  for (;;) {
+    free_public_key(sk);
+    sk = (PKT_public_key *)xmalloc_clear(sizeof *sk);
+    if (enum_secret_keys(ctrl, &enum_context, sk)) break;
+    if (!(sk->pubkey_usage & PUBKEY_USAGE_ENC)) continue;
+
+    /* Check compliance.  */
+    if (!gnupg_pk_is_allowed(opt.compliance, PK_USE_DECRYPTION,
+                             sk->pubkey_algo, sk->pkey, nbits_from_pk(sk),
+                             NULL)) {
+      log_info(_("key %s not suitable for decryption"
+                 " while in %s mode\n"),
+               keystr_from_pk(sk),
+               gnupg_compliance_option_string(opt.compliance));
+      continue;
+    }
+
+    idx->keys.push_back(sk);
+    sk = NULL;
+  }
+  free_public_key(sk);
+  enum_secret_keys(ctrl, &enum_context, NULL); /* free context */
+
+  return idx;
+}
+
+/* Release the index IDX of secret keys.  */
+void release_seckey_index(seckey_index_t idx) {
+  if (!idx) return;
+  for (auto sk : idx->keys) free_public_key(sk);
+  delete idx;
+}
+
+/* Return true if the session key K for an anonymous recipient can't
+   have been encrypted to SK, because its values do not fit into the
+   key's group.  This saves trying to decrypt it with the agent.  */
+static int pkenc_size_mismatch(PKT_pubkey_enc *k, PKT_public_key *sk) {
+  unsigned int nbits;
+
+  switch (sk->pubkey_algo) {
+    case PUBKEY_ALGO_RSA:
+    case PUBKEY_ALGO_RSA_E:
+      nbits = nbits_from_pk(sk);
+      return nbits && k->data[0] && gcry_mpi_get_nbits(k->data[0]) > nbits;
+
+    case PUBKEY_ALGO_ELGAMAL:
+    case PUBKEY_ALGO_ELGAMAL_E:
+      nbits = nbits_from_pk(sk);
+      return nbits && ((k->data[0] && gcry_mpi_get_nbits(k->data[0]) > nbits) ||
+                       (k->data[1] && gcry_mpi_get_nbits(k->data[1]) > nbits));
+
+    case PUBKEY_ALGO_ECDH:
+      /* The ephemeral point is encoded like our public point.  */
+      return k->data[0] && sk->pkey[1] &&
+             (gcry_mpi_get_nbits(k->data[0]) + 7) / 8 !=
+                 (gcry_mpi_get_nbits(sk->pkey[1]) + 7) / 8;
+
+    default:
+      return 0;
+  }
+}
+
 /*
  * Get the session key from a pubkey enc packet and return it in DEK,
  * which should have been allocated in secure memory by the caller.
+ * For anonymous recipients the secret keys are taken from the index
+ * at R_INDEX, which is built if it is NULL and must be released by
+ * the caller with release_seckey_index.
  */
-gpg_error_t get_session_key(ctrl_t ctrl, PKT_pubkey_enc *k, DEK *dek) {
+gpg_error_t get_session_key(ctrl_t ctrl, seckey_index_t *r_index,
+                            PKT_pubkey_enc *k, DEK *dek) {
   PKT_public_key *sk = NULL;
   int rc;
 
@@ -90,43 +172,27 @@ gpg_error_t get_session_key(ctrl_t ctrl, PKT_pubkey_enc *k, DEK *dek) {
     rc = GPG_ERR_NO_SECKEY;
   else /* Anonymous receiver: Try all available secret keys.  */
   {
-    void *enum_context = NULL;
     u32 keyid[2];
 
-    for (;;) {
-      free_public_key(sk);
-      sk = (PKT_public_key *)xmalloc_clear(sizeof *sk);
-      rc = enum_secret_keys(ctrl, &enum_context, sk);
-      if (rc) {
-        rc = GPG_ERR_NO_SECKEY;
-        break;
-      }
-      if (sk->pubkey_algo != k->pubkey_algo) continue;
-      if (!(sk->pubkey_usage & PUBKEY_USAGE_ENC)) continue;
-      keyid_from_pk(sk, keyid);
+    if (!*r_index) *r_index = build_seckey_index(ctrl);
+
+    rc = GPG_ERR_NO_SECKEY;
+    for (auto key : (*r_index)->keys) {
+      if (key->pubkey_algo != k->pubkey_algo) continue;
+      if (pkenc_size_mismatch(k, key)) continue;
+      keyid_from_pk(key, keyid);
       if (!opt.quiet)
         log_info(_("anonymous recipient; trying secret key %s ...\n"),
                  keystr(keyid));
 
-      /* Check compliance.  */
-      if (!gnupg_pk_is_allowed(opt.compliance, PK_USE_DECRYPTION,
-                               sk->pubkey_algo, sk->pkey, nbits_from_pk(sk),
-                               NULL)) {
-        log_info(_("key %s not suitable for decryption"
-                   " while in %s mode\n"),
-                 keystr_from_pk(sk),
-                 gnupg_compliance_option_string(opt.compliance));
-        continue;
-      }
-
-      rc = get_it(ctrl, k, dek, sk, keyid);
+      rc = get_it(ctrl, k, dek, key, keyid);
       if (!rc) {
         if (!opt.quiet) log_info(_("okay, we are the anonymous recipient.\n"));
         break;
       } else if (rc == GPG_ERR_FULLY_CANCELED)
         break; /* Don't try any more secret keys.  */
+      rc = GPG_ERR_NO_SECKEY;
     }
-    enum_secret_keys(ctrl, &enum_context, NULL); /* free context */
   }
 
 leave:
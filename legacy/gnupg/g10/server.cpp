@@ -0,0 +1,572 @@
+/* server.c - server mode for gpg
+ * Copyright (C) 2006, 2008  Free Software Foundation, Inc.
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* The server keeps the key database handles, the key caches and the
+   trustdb open between requests, so that a client doing many small
+   operations pays the startup costs of gpg only once.  */
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <assuan.h>
+#include "../common/server-help.h"
+#include "../common/status.h"
+#include "../common/sysutils.h"
+#include "../common/util.h"
+#include "call-agent.h"
+#include "gpg.h"
+#include "keydb.h"
+#include "main.h"
+#include "options.h"
+#include "packet.h"
+
+#include <string>
+
+#define set_error(e, t) assuan_set_error(ctx, e, (t))
+
+/* Data used to associate an Assuan context with local server data. */
+struct server_local_s {
+  /* Our current Assuan context. */
+  assuan_context_t assuan_ctx;
+  /* File descriptor as set by the MESSAGE command. */
+  int message_fd;
+  /* List of prepared recipients.  */
+  pk_list_t recplist;
+  /* The part of a status line not yet forwarded by
+     status_cookie_write.  */
+  std::string status_line;
+};
+
+/* Cookie definition for assuan data line output.  */
+static gpgrt_ssize_t data_line_cookie_write(void *cookie, const void *buffer,
+                                            size_t size);
+static int data_line_cookie_close(void *cookie);
+static es_cookie_io_functions_t data_line_cookie_functions = {
+    NULL, data_line_cookie_write, NULL, data_line_cookie_close};
+
+/* Cookie definition for the status output in server mode.  */
+static gpgrt_ssize_t status_cookie_write(void *cookie, const void *buffer,
+                                         size_t size);
+static es_cookie_io_functions_t status_cookie_functions = {
+    NULL, status_cookie_write, NULL, NULL};
+
+/* Note that it is sufficient to allocate the target string D as
+   long as the source string S, i.e.: strlen(s)+1; */
+static void strcpy_escaped_plus(char *d, const char *s) {
+  while (*s) {
+    if (*s == '%' && s[1] && s[2]) {
+      s++;
+      *d++ = xtoi_2(s);
+      s += 2;
+    } else if (*s == '+')
+      *d++ = ' ', s++;
+    else
+      *d++ = *s++;
+  }
+  *d = 0;
+}
+
+/* A write handler used by es_fopencookie to write assuan data
+   lines.  */
+static gpgrt_ssize_t data_line_cookie_write(void *cookie, const void *buffer,
+                                            size_t size) {
+  assuan_context_t ctx = (assuan_context_t)cookie;
+
+  if (assuan_send_data(ctx, buffer, size)) {
+    gpg_err_set_errno(EIO);
+    return -1;
+  }
+
+  return (gpgrt_ssize_t)size;
+}
+
+static int data_line_cookie_close(void *cookie) {
+  assuan_context_t ctx = (assuan_context_t)cookie;
+
+  if (assuan_send_data(ctx, NULL, 0)) {
+    gpg_err_set_errno(EIO);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* A write handler used by es_fopencookie to turn the "[GNUPG:] "
+   lines written by cpr.c into Assuan status lines.  */
+static gpgrt_ssize_t status_cookie_write(void *cookie, const void *buffer,
+                                         size_t size) {
+  ctrl_t ctrl = (ctrl_t)cookie;
+  std::string &line = ctrl->server_local->status_line;
+  size_t pos, end;
+
+  if (!buffer) return 0; /* Flush.  */
+
+  line.append((const char *)buffer, size);
+  for (pos = 0; (end = line.find('\n', pos)) != std::string::npos;
+       pos = end + 1) {
+    std::string keyword(line, pos, end - pos);
+    std::string args;
+    size_t n;
+
+    if (!keyword.compare(0, 9, "[GNUPG:] ")) keyword.erase(0, 9);
+    n = keyword.find(' ');
+    if (n != std::string::npos) {
+      args.assign(keyword, n + 1, std::string::npos);
+      keyword.resize(n);
+    }
+    if (assuan_write_status(ctrl->server_local->assuan_ctx, keyword.c_str(),
+                            args.c_str())) {
+      line.erase(0, end + 1);
+      gpg_err_set_errno(EIO);
+      return -1;
+    }
+  }
+  line.erase(0, pos);
+
+  return (gpgrt_ssize_t)size;
+}
+
+/* Close the file descriptor set by the MESSAGE command and the INPUT
+   and OUTPUT file descriptors of CTX.  */
+static void close_fds(ctrl_t ctrl, assuan_context_t ctx) {
+  if (ctrl->server_local->message_fd != -1) {
+    close(ctrl->server_local->message_fd);
+    ctrl->server_local->message_fd = -1;
+  }
+  assuan_close_input_fd(ctx);
+  assuan_close_output_fd(ctx);
+}
+
+/* Called by libassuan for Assuan options.  See the Assuan manual for
+   details. */
+static gpg_error_t option_handler(assuan_context_t ctx, const char *key,
+                                  const char *value) {
+  gpg_error_t err = 0;
+
+  if (!strcmp(key, "armor")) {
+    opt.armor = *value ? !!atoi(value) : true;
+    opt.no_armor = !opt.armor;
+  } else if (!strcmp(key, "textmode")) {
+    opt.textmode = *value ? !!atoi(value) : true;
+  } else if (!strcmp(key, "throw-keyids")) {
+    opt.throw_keyids = *value ? !!atoi(value) : true;
+  } else
+    err = GPG_ERR_UNKNOWN_OPTION;
+
+  (void)ctx;
+  return err;
+}
+
+/* Called by libassuan for RESET commands. */
+static gpg_error_t reset_notify(assuan_context_t ctx, char *line) {
+  ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
+
+  (void)line;
+
+  release_pk_list(ctrl->server_local->recplist);
+  ctrl->server_local->recplist = NULL;
+  close_fds(ctrl, ctx);
+  /* Other clients of the agent may have changed its keys meanwhile.  */
+  agent_flush_seckey_cache();
+  return 0;
+}
+
+static const char hlp_recipient[] =
+    "RECIPIENT [--hidden] <userID>\n"
+    "\n"
+    "Set the recipient for the encryption.  USERID may be any\n"
+    "specification gpg accepts for --recipient.  If this is a valid and\n"
+    "usable recipient the server responds with OK, otherwise the return\n"
+    "is an ERR with the reason why the recipient can't be used and the\n"
+    "encryption will not be done for it.  All RECIPIENT commands are\n"
+    "cumulative until a RESET or an ENCRYPT command.";
+static gpg_error_t cmd_recipient(assuan_context_t ctx, char *line) {
+  ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
+  int hidden;
+
+  hidden = has_option(line, "--hidden");
+  line = skip_options(line);
+
+  /* This emits the INV_RECP status line on error.  */
+  return find_and_check_key(ctrl, line, PUBKEY_USAGE_ENC, hidden, 0,
+                            &ctrl->server_local->recplist);
+}
+
+static const char hlp_encrypt[] =
+    "ENCRYPT\n"
+    "\n"
+    "Do the actual encryption process.  Takes the plaintext from the\n"
+    "INPUT command, writes the ciphertext to the file descriptor set\n"
+    "with the OUTPUT command and takes the recipients from all the\n"
+    "recipients set so far.  If this command fails the client should\n"
+    "delete all output currently done.  The recipients are reset and\n"
+    "the input and output pipes are closed.";
+static gpg_error_t cmd_encrypt(assuan_context_t ctx, char *line) {
+  ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
+  gpg_error_t err;
+  int inp_fd, out_fd;
+  std::vector<std::pair<std::string, unsigned int>> no_remusr;
+
+  (void)line;
+
+  inp_fd = translate_sys2libc_fd(assuan_get_input_fd(ctx), 0);
+  if (inp_fd == -1) return set_error(GPG_ERR_ASS_NO_INPUT, NULL);
+  out_fd = translate_sys2libc_fd(assuan_get_output_fd(ctx), 1);
+  if (out_fd == -1) return set_error(GPG_ERR_ASS_NO_OUTPUT, NULL);
+
+  if (!ctrl->server_local->recplist)
+    err = set_error(GPG_ERR_NO_USER_ID, "no recipients set");
+  else
+    err = encrypt_crypt(ctrl, inp_fd, NULL, no_remusr, 0,
+                        ctrl->server_local->recplist, out_fd);
+
+  release_pk_list(ctrl->server_local->recplist);
+  ctrl->server_local->recplist = NULL;
+  close_fds(ctrl, ctx);
+  return err;
+}
+
+static const char hlp_decrypt[] =
+    "DECRYPT\n"
+    "\n"
+    "This performs the decrypt operation on the data set with the INPUT\n"
+    "command and writes the plaintext to the file descriptor set with\n"
+    "the OUTPUT command.  The agent is used for the session key\n"
+    "decryption, so the client does not need to supply a passphrase.";
+static gpg_error_t cmd_decrypt(assuan_context_t ctx, char *line) {
+  ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
+  gpg_error_t err;
+  int inp_fd, out_fd;
+
+  (void)line;
+
+  inp_fd = translate_sys2libc_fd(assuan_get_input_fd(ctx), 0);
+  if (inp_fd == -1) return set_error(GPG_ERR_ASS_NO_INPUT, NULL);
+  out_fd = translate_sys2libc_fd(assuan_get_output_fd(ctx), 1);
+  if (out_fd == -1) return set_error(GPG_ERR_ASS_NO_OUTPUT, NULL);
+
+  err = decrypt_message_fd(ctrl, inp_fd, out_fd);
+
+  close_fds(ctrl, ctx);
+  return err;
+}
+
+static const char hlp_verify[] =
+    "VERIFY\n"
+    "\n"
+    "This does a verify operation on the message sent to the input FD.\n"
+    "The result is written out using status lines.  For a detached\n"
+    "signature the signed material is read from the file descriptor\n"
+    "set with the MESSAGE command.";
+static gpg_error_t cmd_verify(assuan_context_t ctx, char *line) {
+  ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
+  gpg_error_t err;
+  int fd;
+
+  (void)line;
+
+  fd = translate_sys2libc_fd(assuan_get_input_fd(ctx), 0);
+  if (fd == -1) return set_error(GPG_ERR_ASS_NO_INPUT, NULL);
+
+  err = gpg_verify(ctrl, fd, ctrl->server_local->message_fd, NULL);
+
+  close_fds(ctrl, ctx);
+  return err;
+}
+
+static const char hlp_import[] =
+    "IMPORT\n"
+    "\n"
+    "Import the keys read from the input FD.  The usual IMPORT_OK and\n"
+    "IMPORT_RES status lines are emitted.";
+static gpg_error_t cmd_import(assuan_context_t ctx, char *line) {
+  ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
+  gpg_error_t err;
+  estream_t fp;
+  int fd;
+
+  (void)line;
+
+  fd = translate_sys2libc_fd(assuan_get_input_fd(ctx), 0);
+  if (fd == -1) return set_error(GPG_ERR_ASS_NO_INPUT, NULL);
+
+  fp = es_fdopen_nc(fd, "rb");
+  if (!fp)
+    err = set_error(gpg_error_from_syserror(), "fdopen() failed");
+  else {
+    err = import_keys_es_stream(ctrl, fp, NULL, NULL, NULL, opt.import_options,
+                                NULL, NULL);
+    es_fclose(fp);
+  }
+
+  close_fds(ctrl, ctx);
+  return err;
+}
+
+static const char hlp_export[] =
+    "EXPORT <patterns>\n"
+    "\n"
+    "Export the public keys matching PATTERNS, which are percent-plus\n"
+    "escaped and separated by spaces.  The binary keyblocks are written\n"
+    "to the file descriptor set with the OUTPUT command or, if none has\n"
+    "been set, sent back as data lines.";
+static gpg_error_t cmd_export(assuan_context_t ctx, char *line) {
+  ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
+  gpg_error_t err = 0;
+  std::vector<std::string> patterns;
+  estream_t out_fp;
+  int out_fd;
+  char *p;
+
+  /* Break the line down into a list of patterns.  */
+  for (p = line; *p; line = p) {
+    while (*p && *p != ' ') p++;
+    if (*p) *p++ = 0;
+    if (*line) {
+      std::string pattern(strlen(line), '\0');
+
+      strcpy_escaped_plus(&pattern[0], line);
+      pattern.resize(strlen(pattern.c_str()));
+      patterns.emplace_back(pattern);
+    }
+  }
+  if (patterns.empty()) return set_error(GPG_ERR_NO_USER_ID, NULL);
+
+  out_fd = translate_sys2libc_fd(assuan_get_output_fd(ctx), 1);
+  if (out_fd == -1)
+    out_fp = es_fopencookie(ctx, "w", data_line_cookie_functions);
+  else
+    out_fp = es_fdopen_nc(out_fd, "w");
+  if (!out_fp) err = set_error(gpg_error_from_syserror(), "fdopen() failed");
+
+  for (auto &pattern : patterns) {
+    kbnode_t keyblock;
+    void *data;
+    size_t datalen;
+
+    if (err) break;
+    err = export_pubkey_buffer(ctrl, pattern.c_str(), opt.export_options, NULL,
+                               &keyblock, &data, &datalen);
+    if (err) break;
+    release_kbnode(keyblock);
+    if (es_write(out_fp, data, datalen, NULL))
+      err = set_error(gpg_error_from_syserror(), "writing keyblock failed");
+    xfree(data);
+  }
+  if (out_fp && es_fclose(out_fp) && !err)
+    err = set_error(gpg_error_from_syserror(), "closing output failed");
+
+  close_fds(ctrl, ctx);
+  return err;
+}
+
+static const char hlp_output[] =
+    "OUTPUT FD[=<n>]\n"
+    "\n"
+    "Set the file descriptor to write the output data to N.  If N is not\n"
+    "given and the operating system supports file descriptor passing, the\n"
+    "file descriptor currently in flight will be used.  See also the\n"
+    "\"INPUT\" and \"MESSAGE\" commands.";
+static const char hlp_input[] =
+    "INPUT FD[=<n>]\n"
+    "\n"
+    "Set the file descriptor to read the input data to N.  If N is not\n"
+    "given and the operating system supports file descriptor passing, the\n"
+    "file descriptor currently in flight will be used.  See also the\n"
+    "\"MESSAGE\" and \"OUTPUT\" commands.";
+static const char hlp_message[] =
+    "MESSAGE FD[=<n>]\n"
+    "\n"
+    "Set the file descriptor to read the message for a detached\n"
+    "signatures to N.  If N is not given and the operating system\n"
+    "supports file descriptor passing, the file descriptor currently in\n"
+    "flight will be used.  See also the \"INPUT\" and \"OUTPUT\" commands.";
+static gpg_error_t cmd_message(assuan_context_t ctx, char *line) {
+  ctrl_t ctrl = (ctrl_t)assuan_get_pointer(ctx);
+  gpg_error_t err;
+  gnupg_fd_t sysfd;
+  int fd;
+
+  err = assuan_command_parse_fd(ctx, line, &sysfd);
+  if (err) return err;
+
+  fd = translate_sys2libc_fd(sysfd, 0);
+  if (fd == -1) return set_error(GPG_ERR_ASS_NO_INPUT, NULL);
+  if (ctrl->server_local->message_fd != -1)
+    close(ctrl->server_local->message_fd);
+  ctrl->server_local->message_fd = fd;
+  return 0;
+}
+
+static const char hlp_getinfo[] =
+    "GETINFO <what>\n"
+    "\n"
+    "Multipurpose function to return a variety of information.\n"
+    "Supported values for WHAT are:\n"
+    "\n"
+    "  version     - Return the version of the program.\n"
+    "  pid         - Return the process id of the server.";
+static gpg_error_t cmd_getinfo(assuan_context_t ctx, char *line) {
+  gpg_error_t err;
+
+  if (!strcmp(line, "version")) {
+    const char *s = VERSION;
+    err = assuan_send_data(ctx, s, strlen(s));
+  } else if (!strcmp(line, "pid")) {
+    char numbuf[50];
+
+    snprintf(numbuf, sizeof numbuf, "%lu", (unsigned long)getpid());
+    err = assuan_send_data(ctx, numbuf, strlen(numbuf));
+  } else
+    err = set_error(GPG_ERR_ASS_PARAMETER, "unknown value for WHAT");
+
+  return err;
+}
+
+/* Tell the assuan library about our commands. */
+static int register_commands(assuan_context_t ctx) {
+  static struct {
+    const char *name;
+    assuan_handler_t handler;
+    const char *const help;
+  } table[] = {{"RECIPIENT", cmd_recipient, hlp_recipient},
+               {"ENCRYPT", cmd_encrypt, hlp_encrypt},
+               {"DECRYPT", cmd_decrypt, hlp_decrypt},
+               {"VERIFY", cmd_verify, hlp_verify},
+               {"IMPORT", cmd_import, hlp_import},
+               {"EXPORT", cmd_export, hlp_export},
+               {"INPUT", NULL, hlp_input},
+               {"OUTPUT", NULL, hlp_output},
+               {"MESSAGE", cmd_message, hlp_message},
+               {"GETINFO", cmd_getinfo, hlp_getinfo},
+               {NULL, NULL, NULL}};
+  int i, rc;
+
+  for (i = 0; table[i].name; i++) {
+    rc = assuan_register_command(ctx, table[i].name, table[i].handler,
+                                 table[i].help);
+    if (rc) return rc;
+  }
+  return 0;
+}
+
+/* Startup the server.  CTRL must have been allocated by the caller
+   and set to the default values.  Status lines go to the client as
+   Assuan status lines unless --status-fd has been given.  */
+int gpg_server(ctrl_t ctrl) {
+  int rc;
+  assuan_fd_t filedes[2];
+  assuan_context_t ctx = NULL;
+  estream_t statusfp = NULL;
+  static const char hello[] = ("GNU Privacy Guard's OpenPGP server " VERSION
+                               " ready");
+
+/* We use a pipe based server so that we can work from scripts.
+   assuan_init_pipe_server will automagically detect when we are
+   called with a socketpair and ignore FILEDES in this case. */
+#define SERVER_STDIN 0
+#define SERVER_STDOUT 1
+  filedes[0] = assuan_fdopen(SERVER_STDIN);
+  filedes[1] = assuan_fdopen(SERVER_STDOUT);
+  rc = assuan_new(&ctx);
+  if (rc) {
+    log_error("failed to allocate the assuan context: %s\n", gpg_strerror(rc));
+    goto leave;
+  }
+
+  rc = assuan_init_pipe_server(ctx, filedes);
+  if (rc) {
+    log_error("failed to initialize the server: %s\n", gpg_strerror(rc));
+    goto leave;
+  }
+
+  rc = register_commands(ctx);
+  if (rc) {
+    log_error("failed to the register commands with Assuan: %s\n",
+              gpg_strerror(rc));
+    goto leave;
+  }
+
+  assuan_set_pointer(ctx, ctrl);
+  if (opt.verbose || opt.debug) {
+    char *tmp;
+
+    tmp = xtryasprintf("Home: %s\n%s", gnupg_homedir(), hello);
+    if (tmp) {
+      assuan_set_hello_line(ctx, tmp);
+      xfree(tmp);
+    }
+  } else
+    assuan_set_hello_line(ctx, hello);
+  assuan_register_reset_notify(ctx, reset_notify);
+  assuan_register_option_handler(ctx, option_handler);
+
+  ctrl->server_local = new server_local_s();
+  ctrl->server_local->assuan_ctx = ctx;
+  ctrl->server_local->message_fd = -1;
+
+  if (!is_status_enabled()) {
+    statusfp = es_fopencookie(ctrl, "w", status_cookie_functions);
+    if (!statusfp) {
+      rc = gpg_error_from_syserror();
+      log_error("failed to open the status stream: %s\n", gpg_strerror(rc));
+      goto leave;
+    }
+    /* Each status line is forwarded as soon as it is complete.  */
+    es_setvbuf(statusfp, NULL, _IONBF, 0);
+    set_status_stream(statusfp);
+  }
+
+  for (;;) {
+    rc = assuan_accept(ctx);
+    if (rc == -1) {
+      rc = 0;
+      break;
+    } else if (rc) {
+      log_info("Assuan accept problem: %s\n", gpg_strerror(rc));
+      break;
+    }
+
+    rc = assuan_process(ctx);
+    if (rc) {
+      log_info("Assuan processing failed: %s\n", gpg_strerror(rc));
+      continue;
+    }
+  }
+
+leave:
+  if (statusfp) {
+    set_status_stream(NULL);
+    es_fclose(statusfp);
+  }
+  if (ctrl->server_local) {
+    release_pk_list(ctrl->server_local->recplist);
+    if (ctrl->server_local->message_fd != -1)
+      close(ctrl->server_local->message_fd);
+    delete ctrl->server_local;
+    ctrl->server_local = NULL;
+  }
+  assuan_release(ctx);
+  return rc;
+}
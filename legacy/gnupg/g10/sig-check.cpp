@@ -20,12 +20,26 @@
  */
 
 #include <config.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <neopg/utils/workers.h>
 
 #include "../common/compliance.h"
 #include "../common/status.h"
+#include "../common/sysutils.h"
+#include "../common/trace.h"
 #include "../common/util.h"
 #include "gpg.h"
 #include "keydb.h"
@@ -47,12 +61,207 @@ struct {
   unsigned int cached;  /* Number of seen cache entries.  */
   unsigned int goodsig; /* Number of good verifications from the cache.  */
   unsigned int badsig;  /* Number of bad verifications from the cache.  */
+  unsigned int persistent_hits;   /* Verifications from the file cache.  */
+  unsigned int persistent_stored; /* Records added to the file cache.  */
 } cache_stats;
 
 /* Dump verification stats.  */
 void sig_check_dump_stats(void) {
   log_info("sig_cache: total=%u cached=%u good=%u bad=%u\n", cache_stats.total,
            cache_stats.cached, cache_stats.goodsig, cache_stats.badsig);
+  log_info("sig_cache: persistent hits=%u stored=%u\n",
+           cache_stats.persistent_hits, cache_stats.persistent_stored);
+}
+
+/* The persistent signature cache.  The in-memory cache above lives
+ * only as long as the signature packet, so every new process would
+ * verify all key signatures again.  To avoid this, good results of
+ * the public key operation for signatures over keys are also stored
+ * in the file SIG_CACHE_NAME in the home directory.
+ *
+ * A record is the SHA-256 hash over the fingerprint of the signing
+ * key, the complete digest of the signed data and the signature
+ * value.  It thus only asserts that this key made this signature over
+ * this data, which can't become wrong later.  Revocation, expiration
+ * and the other metadata checks are done by the callers on every use
+ * and are never stored, so updating or revoking a key does not need
+ * to touch the file.  Only good results are stored; a missing or
+ * damaged record just means that the signature is verified again.
+ *
+ * The file starts with a header record (SIG_CACHE_MAGIC) followed by
+ * records of SIG_CACHE_RECLEN bytes.  It is read once per process and
+ * new records are appended with O_APPEND using a single write, so
+ * that several processes can share the file without locking.  When
+ * the file exceeds SIG_CACHE_MAX_RECORDS it is started over.  */
+#define SIG_CACHE_NAME "sigcache.dat"
+#define SIG_CACHE_MAGIC "NeoPG signature cache v1"
+#define SIG_CACHE_RECLEN 32
+#define SIG_CACHE_MAX_RECORDS (1024 * 1024)
+
+static struct {
+  int loaded;
+  int fd; /* Opened for appending on the first store, or -1.  */
+  std::unordered_set<std::string> *records;
+} sig_cache = {0, -1, NULL};
+
+/* Return true if SIG is a signature over a key or user ID.  Message
+   signatures are not cached.  */
+static int sig_cache_class_p(PKT_signature *sig) {
+  switch (sig->sig_class) {
+    case 0x10:
+    case 0x11:
+    case 0x12:
+    case 0x13:
+    case 0x18:
+    case 0x19:
+    case 0x1f:
+    case 0x20:
+    case 0x28:
+    case 0x30:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* Compute the record for the signature SIG by PK over the finalized
+   DIGEST and store it at KEY.  Returns false if that is not
+   possible.  */
+static int sig_cache_key(PKT_public_key *pk, PKT_signature *sig,
+                         gcry_md_hd_t digest, std::string &key) {
+  gcry_md_hd_t md;
+  byte fpr[MAX_FINGERPRINT_LEN];
+  size_t fprlen;
+  byte *buf;
+  size_t n;
+  int i, nsig;
+
+  nsig = pubkey_get_nsig((pubkey_algo_t)sig->pubkey_algo);
+  if (nsig <= 0) return 0;
+
+  if (gcry_md_open(&md, GCRY_MD_SHA256, 0)) return 0;
+  fingerprint_from_pk(pk, fpr, &fprlen);
+  gcry_md_putc(md, fprlen);
+  gcry_md_write(md, fpr, fprlen);
+  gcry_md_putc(md, sig->digest_algo);
+  gcry_md_write(md, gcry_md_read(digest, sig->digest_algo),
+                gcry_md_get_algo_dlen(sig->digest_algo));
+  gcry_md_putc(md, sig->pubkey_algo);
+  for (i = 0; i < nsig; i++) {
+    unsigned int nbits;
+    const void *p;
+
+    if (!sig->data[i]) {
+      gcry_md_close(md);
+      return 0;
+    }
+    if (gcry_mpi_get_flag(sig->data[i], GCRYMPI_FLAG_OPAQUE)) {
+      p = gcry_mpi_get_opaque(sig->data[i], &nbits);
+      gcry_md_putc(md, nbits >> 8);
+      gcry_md_putc(md, nbits);
+      if (p) gcry_md_write(md, p, (nbits + 7) / 8);
+    } else {
+      if (gcry_mpi_aprint(GCRYMPI_FMT_PGP, &buf, &n, sig->data[i])) {
+        gcry_md_close(md);
+        return 0;
+      }
+      gcry_md_write(md, buf, n);
+      gcry_free(buf);
+    }
+  }
+  key.assign((const char *)gcry_md_read(md, GCRY_MD_SHA256),
+             SIG_CACHE_RECLEN);
+  gcry_md_close(md);
+  return 1;
+}
+
+/* Read the cache file.  Errors are ignored; the cache is then empty
+   or incomplete.  */
+static void sig_cache_load(void) {
+  char *fname;
+  FILE *fp;
+  char rec[SIG_CACHE_RECLEN];
+  char magic[SIG_CACHE_RECLEN];
+  struct stat st;
+
+  sig_cache.loaded = 1;
+  sig_cache.records = new std::unordered_set<std::string>;
+
+  fname = make_filename(gnupg_homedir(), SIG_CACHE_NAME, NULL);
+  fp = fopen(fname, "rb");
+  if (!fp) goto leave;
+
+  if (fstat(fileno(fp), &st) ||
+      st.st_size / SIG_CACHE_RECLEN > SIG_CACHE_MAX_RECORDS) {
+    /* Start over.  Appends by other processes to the old file are
+       lost, which does not matter for a cache.  */
+    fclose(fp);
+    fp = NULL;
+    if (DBG_CACHE) log_debug("sig_cache: removing '%s'\n", fname);
+    gnupg_remove(fname);
+    goto leave;
+  }
+
+  memset(magic, 0, sizeof magic);
+  memcpy(magic, SIG_CACHE_MAGIC, strlen(SIG_CACHE_MAGIC));
+  if (fread(rec, SIG_CACHE_RECLEN, 1, fp) != 1 ||
+      memcmp(rec, magic, SIG_CACHE_RECLEN))
+    goto leave;
+
+  /* A partial record at the end (from a crashed writer) is
+     skipped.  */
+  while (fread(rec, SIG_CACHE_RECLEN, 1, fp) == 1)
+    sig_cache.records->insert(std::string(rec, SIG_CACHE_RECLEN));
+
+  if (DBG_CACHE)
+    log_debug("sig_cache: %zu records from '%s'\n", sig_cache.records->size(),
+              fname);
+
+leave:
+  if (fp) fclose(fp);
+  xfree(fname);
+}
+
+/* Return true if KEY is in the persistent cache.  */
+static int sig_cache_lookup(const std::string &key) {
+  if (!sig_cache.loaded) sig_cache_load();
+  return sig_cache.records->count(key) != 0;
+}
+
+/* Add KEY to the persistent cache.  */
+static void sig_cache_store(const std::string &key) {
+  if (!sig_cache.records->insert(key).second) return;
+  if (opt.dry_run) return;
+
+  if (sig_cache.fd == -1) {
+    char *fname = make_filename(gnupg_homedir(), SIG_CACHE_NAME, NULL);
+    struct stat st;
+
+    sig_cache.fd = open(fname, O_WRONLY | O_APPEND | O_CREAT, 0600);
+    if (sig_cache.fd == -1) {
+      if (DBG_CACHE)
+        log_debug("sig_cache: can't open '%s': %s\n", fname,
+                  strerror(errno));
+      /* Don't try again.  */
+      sig_cache.fd = -2;
+    } else if (!fstat(sig_cache.fd, &st) && !st.st_size) {
+      char magic[SIG_CACHE_RECLEN];
+
+      /* If another process creates the file at the same time, its
+         header ends up as an ordinary record, which never matches.  */
+      memset(magic, 0, sizeof magic);
+      memcpy(magic, SIG_CACHE_MAGIC, strlen(SIG_CACHE_MAGIC));
+      if (write(sig_cache.fd, magic, SIG_CACHE_RECLEN) != SIG_CACHE_RECLEN) {
+        close(sig_cache.fd);
+        sig_cache.fd = -2;
+      }
+    }
+    xfree(fname);
+  }
+  if (sig_cache.fd < 0) return;
+
+  if (write(sig_cache.fd, key.data(), SIG_CACHE_RECLEN) == SIG_CACHE_RECLEN)
+    cache_stats.persistent_stored++;
 }
 
 /* Check a signature.  This is shorthand for check_signature2 with
@@ -104,6 +313,7 @@ gpg_error_t check_signature2(ctrl_t ctrl, PKT_signature *sig,
                              PKT_public_key **r_pk) {
   int rc = 0;
   PKT_public_key *pk;
+  TRACE_SPAN("check_signature");
 
   if (r_expiredate) *r_expiredate = 0;
   if (r_expired) *r_expired = 0;
@@ -386,18 +596,41 @@ static int check_signature_end(PKT_public_key *pk, PKT_signature *sig,
   return rc;
 }
 
-/* This function is similar to check_signature_end, but it only checks
-   whether the signature was generated by PK.  It does not check
-   expiration, revocation, etc.  */
-static int check_signature_end_simple(PKT_public_key *pk, PKT_signature *sig,
-                                      gcry_md_hd_t digest) {
-  gcry_mpi_t result = NULL;
-  int rc = 0;
+/* The number of public key operations handed to pk_verify_batch at
+   once by sig_batch_run.  */
+#define SIG_BATCH_CHUNK 4
+
+/* The public key operation for one signature, split off so that
+   several of them can be done in parallel (see sig_batch_run).  */
+struct sig_batch_job {
+  PKT_public_key *pk;
+  PKT_signature *sig;
+  gcry_md_hd_t digest;   /* The digest while it is not finalized.  */
+  gcry_mpi_t hash;       /* The encoded digest.  */
+  std::string cache_key; /* Record for the persistent cache or empty.  */
+  int done;              /* Set if RC is already the result.  */
+  int rc;
+};
+
+/* Hash the trailer of the signature SIG by PK into DIGEST and start
+   setting up JOB to verify it.  Returns 0 if the result is already
+   known; JOB->RC is then the result.  */
+static int sig_job_hash(struct sig_batch_job *job, PKT_public_key *pk,
+                        PKT_signature *sig, gcry_md_hd_t digest) {
   gcry_md_algos algo = (gcry_md_algos)sig->digest_algo;
 
+  job->pk = pk;
+  job->sig = sig;
+  job->digest = NULL;
+  job->hash = NULL;
+  job->cache_key.clear();
+  job->done = 1;
+  job->rc = 0;
+
   if (opt.weak_digests.count(algo)) {
     print_digest_rejected_note(algo);
-    return GPG_ERR_DIGEST_ALGO;
+    job->rc = GPG_ERR_DIGEST_ALGO;
+    return 0;
   }
 
   /* Make sure the digest algo is enabled (in case of a detached
@@ -440,26 +673,106 @@ static int check_signature_end_simple(PKT_public_key *pk, PKT_signature *sig,
     buf[5] = n;
     gcry_md_write(digest, buf, 6);
   }
-  gcry_md_final(digest);
+  return 1;
+}
+
+/* Finish setting up JOB after sig_job_hash, once DIGEST has been
+   finalized.  If the result is already known, because of an error or
+   from the persistent cache, JOB->DONE is set.  */
+static void sig_job_encode(struct sig_batch_job *job, gcry_md_hd_t digest) {
+  PKT_public_key *pk = job->pk;
+  PKT_signature *sig = job->sig;
 
   /* Convert the digest to an MPI.  */
-  result = encode_md_value(pk, digest, sig->digest_algo);
-  if (!result) return GPG_ERR_GENERAL;
+  job->hash = encode_md_value(pk, digest, sig->digest_algo);
+  if (!job->hash) {
+    job->rc = GPG_ERR_GENERAL;
+    return;
+  }
+
+  /* The persistent cache may already know the result.  */
+  if (!opt.no_sig_cache && sig_cache_class_p(sig) &&
+      sig_cache_key(pk, sig, digest, job->cache_key) &&
+      sig_cache_lookup(job->cache_key)) {
+    cache_stats.persistent_hits++;
+    job->cache_key.clear();
+    return;
+  }
+
+  job->done = 0;
+}
 
-  /* Verify the signature.  */
-  rc = pk_verify((pubkey_algo_t)(pk->pubkey_algo), result, sig->data, pk->pkey);
-  gcry_mpi_release(result);
+/* Complete DIGEST for the signature SIG by PK and set up JOB to
+   verify it.  If the result is already known, because of an error or
+   from the persistent cache, JOB->DONE is set.  */
+static void sig_job_prepare(struct sig_batch_job *job, PKT_public_key *pk,
+                            PKT_signature *sig, gcry_md_hd_t digest) {
+  if (!sig_job_hash(job, pk, sig, digest)) return;
+  gcry_md_final(digest);
+  sig_job_encode(job, digest);
+}
+
+/* Do the public key operation of JOB.  This may be called from any
+   thread.  */
+static void sig_job_verify(struct sig_batch_job *job) {
+  job->rc = pk_verify((pubkey_algo_t)(job->pk->pubkey_algo), job->hash,
+                      job->sig->data, job->pk->pkey);
+  job->done = 1;
+}
 
-  if (!rc && sig->flags.unknown_critical) {
+/* Do the public key operations of the N jobs at JOBS (at most
+   SIG_BATCH_CHUNK) with one call to pk_verify_batch.  This may be
+   called from any thread.  */
+static void sig_jobs_verify(struct sig_batch_job **jobs, size_t n) {
+  struct pk_verify_job pkjobs[SIG_BATCH_CHUNK];
+  size_t i;
+
+  log_assert(n <= SIG_BATCH_CHUNK);
+  for (i = 0; i < n; i++) {
+    pkjobs[i].algo = (pubkey_algo_t)(jobs[i]->pk->pubkey_algo);
+    pkjobs[i].hash = jobs[i]->hash;
+    pkjobs[i].data = jobs[i]->sig->data;
+    pkjobs[i].pkey = jobs[i]->pk->pkey;
+  }
+  pk_verify_batch(pkjobs, n);
+  for (i = 0; i < n; i++) {
+    jobs[i]->rc = pkjobs[i].rc;
+    jobs[i]->done = 1;
+  }
+}
+
+/* Release the resources of JOB and return its final result.  */
+static int sig_job_finish(struct sig_batch_job *job) {
+  int rc = job->rc;
+
+  gcry_mpi_release(job->hash);
+  job->hash = NULL;
+
+  if (!rc && !job->cache_key.empty()) sig_cache_store(job->cache_key);
+  job->cache_key.clear();
+
+  if (!rc && job->sig->flags.unknown_critical) {
     log_info(_("assuming bad signature from key %s"
                " due to an unknown critical bit\n"),
-             keystr_from_pk(pk));
+             keystr_from_pk(job->pk));
     rc = GPG_ERR_BAD_SIGNATURE;
   }
-
+  job->rc = rc;
   return rc;
 }
 
+/* This function is similar to check_signature_end, but it only checks
+   whether the signature was generated by PK.  It does not check
+   expiration, revocation, etc.  */
+static int check_signature_end_simple(PKT_public_key *pk, PKT_signature *sig,
+                                      gcry_md_hd_t digest) {
+  struct sig_batch_job job;
+
+  sig_job_prepare(&job, pk, sig, digest);
+  if (!job.done) sig_job_verify(&job);
+  return sig_job_finish(&job);
+}
+
 /* Add a uid node to a hash context.  See section 5.2.4, paragraph 4
    of RFC 4880.  */
 static void hash_uid_packet(PKT_user_id *uid, gcry_md_hd_t md,
@@ -502,6 +815,93 @@ static void cache_sig_result(PKT_signature *sig, int result) {
   }
 }
 
+/* Checkpoints of the hash over a primary key, optionally followed by
+ * a user ID.  All certifications of a user ID start with the same
+ * data, so instead of hashing it again for each signature, the hash
+ * state is kept and copied.  A slot is identified by the key and user
+ * ID objects, the digest algorithm and whether the user ID is hashed
+ * with a v4 header.  To make sure that a slot never outlives the
+ * objects, the slots are dropped when the key or user ID is released
+ * (see sig_check_forget_key).  The key's algorithm, timestamp and
+ * first MPI are compared as well, in case its parts are replaced in
+ * place.  */
+#define SIG_PREFIX_SLOTS 4
+
+static struct sig_prefix_slot {
+  PKT_public_key *pk;
+  PKT_user_id *uid;
+  int digest_algo;
+  int v4;
+  int pubkey_algo;
+  u32 timestamp;
+  gcry_mpi_t pkey0;
+  gcry_md_hd_t md;
+} sig_prefix[SIG_PREFIX_SLOTS];
+static int sig_prefix_next; /* The slot to replace next.  */
+
+static void sig_prefix_drop(struct sig_prefix_slot *slot) {
+  gcry_md_close(slot->md);
+  memset(slot, 0, sizeof *slot);
+}
+
+void sig_check_forget_key(PKT_public_key *pk) {
+  int i;
+
+  for (i = 0; i < SIG_PREFIX_SLOTS; i++)
+    if (sig_prefix[i].pk == pk) sig_prefix_drop(&sig_prefix[i]);
+}
+
+void sig_check_forget_uid(PKT_user_id *uid) {
+  int i;
+
+  for (i = 0; i < SIG_PREFIX_SLOTS; i++)
+    if (uid && sig_prefix[i].uid == uid) sig_prefix_drop(&sig_prefix[i]);
+}
+
+/* Open a hash context for SIG in *R_MD that already contains the
+ * primary key PK and, if UID is not NULL, the user ID UID.  The
+ * caller must close it.  Returns an error if the digest algorithm of
+ * SIG is not available.  */
+static gpg_error_t sig_prefix_open(gcry_md_hd_t *r_md, PKT_signature *sig,
+                                   PKT_public_key *pk, PKT_user_id *uid) {
+  struct sig_prefix_slot *slot;
+  gpg_error_t err;
+  int v4 = uid && sig->version >= 4;
+  int i;
+
+  for (i = 0; i < SIG_PREFIX_SLOTS; i++) {
+    slot = &sig_prefix[i];
+    if (slot->md && slot->pk == pk && slot->uid == uid &&
+        slot->digest_algo == sig->digest_algo && slot->v4 == v4) {
+      if (slot->pubkey_algo == pk->pubkey_algo &&
+          slot->timestamp == pk->timestamp && slot->pkey0 == pk->pkey[0])
+        return gcry_md_copy(r_md, slot->md);
+      sig_prefix_drop(slot);
+    }
+  }
+
+  err = gcry_md_open(r_md, sig->digest_algo, 0);
+  if (err) return err;
+  hash_public_key(*r_md, pk);
+  if (uid) hash_uid_packet(uid, *r_md, sig);
+
+  slot = &sig_prefix[sig_prefix_next];
+  sig_prefix_next = (sig_prefix_next + 1) % SIG_PREFIX_SLOTS;
+  if (slot->md) sig_prefix_drop(slot);
+  if (gcry_md_copy(&slot->md, *r_md)) {
+    slot->md = NULL;
+    return 0;
+  }
+  slot->pk = pk;
+  slot->uid = uid;
+  slot->digest_algo = sig->digest_algo;
+  slot->v4 = v4;
+  slot->pubkey_algo = pk->pubkey_algo;
+  slot->timestamp = pk->timestamp;
+  slot->pkey0 = pk->pkey[0];
+  return 0;
+}
+
 /* SIG is a key revocation signature.  Check if this signature was
  * generated by any of the public key PK's designated revokers.
  *
@@ -791,21 +1191,22 @@ gpg_error_t check_signature_over_key_or_uid(ctrl_t ctrl, PKT_public_key *signer,
 
   /* We checked above that we supported this algo, so an error here is
      a bug.  */
-  if (gcry_md_open(&md, sig->digest_algo, 0)) BUG();
-
-  /* Hash the relevant data.  */
+  /* Hash the relevant data.  The hash over the primary key (and the
+     user ID) is shared by many signatures, so it comes from a
+     checkpoint.  We checked above that we supported this algo, so an
+     error here is a bug.  */
 
   if (/* Direct key signature.  */
       sig->sig_class == 0x1f
       /* Primary key revocation.  */
       || sig->sig_class == 0x20) {
     log_assert(packet->pkttype == PKT_PUBLIC_KEY);
-    hash_public_key(md, packet->pkt.public_key);
+    if (sig_prefix_open(&md, sig, packet->pkt.public_key, NULL)) BUG();
     rc = check_signature_end_simple(signer, sig, md);
   } else if (/* Primary key binding (made by a subkey).  */
              sig->sig_class == 0x19) {
     log_assert(packet->pkttype == PKT_PUBLIC_KEY);
-    hash_public_key(md, packet->pkt.public_key);
+    if (sig_prefix_open(&md, sig, packet->pkt.public_key, NULL)) BUG();
     hash_public_key(md, signer);
     rc = check_signature_end_simple(signer, sig, md);
   } else if (/* Subkey binding.  */
@@ -813,7 +1214,7 @@ gpg_error_t check_signature_over_key_or_uid(ctrl_t ctrl, PKT_public_key *signer,
              /* Subkey revocation.  */
              || sig->sig_class == 0x28) {
     log_assert(packet->pkttype == PKT_PUBLIC_SUBKEY);
-    hash_public_key(md, pripk);
+    if (sig_prefix_open(&md, sig, pripk, NULL)) BUG();
     hash_public_key(md, packet->pkt.public_key);
     rc = check_signature_end_simple(signer, sig, md);
   } else if (/* Certification.  */
@@ -822,8 +1223,7 @@ gpg_error_t check_signature_over_key_or_uid(ctrl_t ctrl, PKT_public_key *signer,
              /* Certification revocation.  */
              || sig->sig_class == 0x30) {
     log_assert(packet->pkttype == PKT_USER_ID);
-    hash_public_key(md, pripk);
-    hash_uid_packet(packet->pkt.user_id, md, sig);
+    if (sig_prefix_open(&md, sig, pripk, packet->pkt.user_id)) BUG();
     rc = check_signature_end_simple(signer, sig, md);
   } else
     /* We should never get here.  (The first if above should have
@@ -887,6 +1287,7 @@ int check_key_signature2(ctrl_t ctrl, kbnode_t root, kbnode_t node,
   PKT_signature *sig;
   int algo;
   int rc;
+  TRACE_SPAN("check_key_signature");
 
   if (is_selfsig) *is_selfsig = 0;
   if (r_expiredate) *r_expiredate = 0;
@@ -1010,3 +1411,306 @@ int check_key_signature2(ctrl_t ctrl, kbnode_t root, kbnode_t node,
 
   return rc;
 }
+
+/* Batch verification.  The public key operations of the signatures
+ * added to a batch are independent, so sig_batch_run spreads them
+ * over several threads.  Only the public key operation runs in the
+ * threads; completing the digests, the persistent cache and all
+ * logging happen in the calling thread.  The digests are finalized
+ * together with gcry_md_final_batch.  The threads hand their
+ * signatures to gcry_pk_verify_batch a few at a time, which shares
+ * the setup of an RSA key between its signatures; there is no
+ * algebraic batch verification, so each signature is still checked
+ * on its own.  */
+
+/* Batches with fewer jobs are verified in the calling thread, as
+   starting threads would cost more than it saves.  */
+#define SIG_BATCH_MIN_JOBS 8
+/* The minimum number of jobs per thread.  */
+#define SIG_BATCH_JOBS_PER_THREAD 4
+
+struct sig_batch_s {
+  std::vector<struct sig_batch_job> jobs;
+  int finished;
+};
+
+/* Create a new, empty batch.  Returns NULL on error.  */
+sig_batch_t sig_batch_new(void) {
+  try {
+    sig_batch_t batch = new sig_batch_s;
+    batch->finished = 0;
+    return batch;
+  } catch (const std::bad_alloc &) {
+    return NULL;
+  }
+}
+
+/* Release BATCH.  */
+void sig_batch_release(sig_batch_t batch) {
+  if (!batch) return;
+  for (auto &job : batch->jobs) {
+    gcry_md_close(job.digest);
+    gcry_mpi_release(job.hash);
+  }
+  delete batch;
+}
+
+/* Add the signature SIG by PK to BATCH.  DIGEST must contain the
+ * signed data, like for check_signature_end_simple.  BATCH takes
+ * over DIGEST; the digests of all signatures are finalized together
+ * by sig_batch_run.  PK and SIG must stay valid until the batch has
+ * been run.  Returns the index of the result.  */
+size_t sig_batch_add(sig_batch_t batch, PKT_public_key *pk,
+                     PKT_signature *sig, gcry_md_hd_t digest) {
+  batch->jobs.emplace_back();
+  if (sig_job_hash(&batch->jobs.back(), pk, sig, digest))
+    batch->jobs.back().digest = digest;
+  else
+    gcry_md_close(digest);
+  return batch->jobs.size() - 1;
+}
+
+/* Finalize the digests of the jobs of BATCH which have been added
+   since the last call and set up the jobs.  Libgcrypt computes the
+   last blocks of several SHA-1 or SHA-256 digests at once.  */
+static void sig_batch_digests(sig_batch_t batch) {
+  std::vector<gcry_md_hd_t> digests;
+
+  for (auto &job : batch->jobs)
+    if (job.digest) digests.push_back(job.digest);
+  if (digests.empty()) return;
+
+  gcry_md_final_batch(digests.data(), digests.size());
+
+  for (auto &job : batch->jobs) {
+    if (!job.digest) continue;
+    sig_job_encode(&job, job.digest);
+    gcry_md_close(job.digest);
+    job.digest = NULL;
+  }
+}
+
+/* Verify all signatures of BATCH using up to NTHREADS threads.  If
+ * NTHREADS is 0, the number of CPUs is used.  The results are
+ * available with sig_batch_result.  */
+void sig_batch_run(sig_batch_t batch, int nthreads) {
+  std::vector<size_t> pending;
+  std::atomic<size_t> next(0);
+  size_t i;
+
+  if (batch->finished) return;
+
+  sig_batch_digests(batch);
+  for (i = 0; i < batch->jobs.size(); i++)
+    if (!batch->jobs[i].done) pending.push_back(i);
+
+  if (nthreads <= 0) nthreads = NeoPG::hardware_threads();
+  nthreads = std::min<size_t>(nthreads,
+                              pending.size() / SIG_BATCH_JOBS_PER_THREAD);
+  if (pending.size() < SIG_BATCH_MIN_JOBS) nthreads = 1;
+
+  /* The workers take SIG_BATCH_CHUNK jobs at a time.  The jobs are
+     in the order of the key block, so a chunk often has several
+     signatures by the same key.  */
+  auto worker = [&](size_t) {
+    struct sig_batch_job *chunk[SIG_BATCH_CHUNK];
+    size_t k, j;
+
+    while ((k = next.fetch_add(SIG_BATCH_CHUNK)) < pending.size()) {
+      for (j = 0; j < SIG_BATCH_CHUNK && k + j < pending.size(); j++)
+        chunk[j] = &batch->jobs[pending[k + j]];
+      sig_jobs_verify(chunk, j);
+    }
+  };
+
+  NeoPG::run_workers(nthreads, worker);
+
+  for (auto &job : batch->jobs) sig_job_finish(&job);
+  batch->finished = 1;
+}
+
+/* Return the number of signatures in BATCH.  */
+size_t sig_batch_count(sig_batch_t batch) { return batch->jobs.size(); }
+
+/* Return the result for the signature at IDX of BATCH, which must
+   have been run.  This is 0 for a good signature and an error code
+   otherwise, as returned by check_signature_end_simple.  */
+gpg_error_t sig_batch_result(sig_batch_t batch, size_t idx) {
+  log_assert(batch->finished && idx < batch->jobs.size());
+  return batch->jobs[idx].rc;
+}
+
+/* Add the uncached self-signatures of the key block KEYBLOCK to BATCH
+   and append them to SIGS.  */
+static void add_self_sigs(sig_batch_t batch, kbnode_t keyblock,
+                          std::vector<PKT_signature *> &sigs) {
+  PKT_public_key *pripk;
+  u32 keyid[2];
+  PACKET *subkey = NULL;
+  PKT_user_id *uid = NULL;
+  kbnode_t n;
+
+  if (keyblock->pkt->pkttype != PKT_PUBLIC_KEY) return;
+  pripk = keyblock->pkt->pkt.public_key;
+  keyid_from_pk(pripk, keyid);
+
+  for (n = keyblock->next; n; n = n->next) {
+    PKT_signature *sig;
+    gcry_md_hd_t md;
+
+    if (n->pkt->pkttype == PKT_PUBLIC_SUBKEY) {
+      subkey = n->pkt;
+      continue;
+    }
+    if (n->pkt->pkttype == PKT_USER_ID) {
+      uid = n->pkt->pkt.user_id;
+      continue;
+    }
+    if (n->pkt->pkttype != PKT_SIGNATURE) continue;
+
+    sig = n->pkt->pkt.signature;
+    if (sig->flags.checked || sig->keyid[0] != keyid[0] ||
+        sig->keyid[1] != keyid[1])
+      continue;
+    if (openpgp_pk_test_algo((pubkey_algo_t)(sig->pubkey_algo)) ||
+        openpgp_md_test_algo((digest_algo_t)(sig->digest_algo)))
+      continue;
+
+    /* Hash the same data as check_signature_over_key_or_uid.  */
+    if (sig->sig_class == 0x1f || sig->sig_class == 0x20) {
+      if (sig_prefix_open(&md, sig, pripk, NULL)) continue;
+    } else if (sig->sig_class == 0x18 || sig->sig_class == 0x28) {
+      if (!subkey || sig_prefix_open(&md, sig, pripk, NULL)) continue;
+      hash_public_key(md, subkey->pkt.public_key);
+    } else if (sig->sig_class == 0x10 || sig->sig_class == 0x11 ||
+               sig->sig_class == 0x12 || sig->sig_class == 0x13 ||
+               sig->sig_class == 0x30) {
+      if (!uid || sig_prefix_open(&md, sig, pripk, uid)) continue;
+    } else
+      continue;
+
+    sig_batch_add(batch, pripk, sig, md);
+    sigs.push_back(sig);
+  }
+}
+
+/* Verify all self-signatures of the NKEYBLOCKS key blocks at
+ * KEYBLOCKS whose result is not yet cached in parallel and cache the
+ * results in the signature packets.  Later calls to
+ * check_key_signature then only check the metadata.  This does
+ * nothing if the signature cache is disabled.  Signatures by other
+ * keys are left alone, as their signers would need to be looked
+ * up.  */
+void check_self_sigs_bulk(ctrl_t ctrl, kbnode_t *keyblocks,
+                          size_t nkeyblocks) {
+  std::vector<PKT_signature *> sigs;
+  sig_batch_t batch;
+  size_t i;
+
+  (void)ctrl;
+
+  if (opt.no_sig_cache) return;
+
+  batch = sig_batch_new();
+  if (!batch) return;
+
+  for (i = 0; i < nkeyblocks; i++) add_self_sigs(batch, keyblocks[i], sigs);
+
+  sig_batch_run(batch, 0);
+  for (i = 0; i < sigs.size(); i++)
+    cache_sig_result(sigs[i], sig_batch_result(batch, i));
+  sig_batch_release(batch);
+}
+
+/* Like check_self_sigs_bulk for the single key block KEYBLOCK.  */
+void check_self_sigs_batch(ctrl_t ctrl, kbnode_t keyblock) {
+  check_self_sigs_bulk(ctrl, &keyblock, 1);
+}
+
+/* Verify the uncached certifications on the user IDs of the
+ * NKEYBLOCKS key blocks at KEYBLOCKS in parallel and cache the
+ * results in the signature packets, like check_self_sigs_batch does
+ * for self-signatures.  Only signatures for which FILTER returns true
+ * are considered, if FILTER is not NULL.  The signers are looked up
+ * in the calling thread; signatures whose signer is not available or
+ * is a subkey of the signed key are left to check_key_signature.  */
+void check_certs_batch(ctrl_t ctrl, kbnode_t *keyblocks, size_t nkeyblocks,
+                       int (*filter)(void *opaque, PKT_signature *sig),
+                       void *opaque) {
+  std::unordered_map<uint64_t, PKT_public_key *> signers;
+  std::vector<PKT_signature *> sigs;
+  sig_batch_t batch;
+  size_t i;
+
+  if (opt.no_sig_cache) return;
+
+  batch = sig_batch_new();
+  if (!batch) return;
+
+  for (i = 0; i < nkeyblocks; i++) {
+    kbnode_t keyblock = keyblocks[i];
+    PKT_public_key *pripk;
+    PKT_user_id *uid = NULL;
+    kbnode_t n;
+
+    if (keyblock->pkt->pkttype != PKT_PUBLIC_KEY) continue;
+    pripk = keyblock->pkt->pkt.public_key;
+
+    for (n = keyblock->next; n; n = n->next) {
+      PKT_signature *sig;
+      PKT_public_key *signer;
+      gcry_md_hd_t md;
+      kbnode_t k;
+      uint64_t signer_kid;
+
+      if (n->pkt->pkttype == PKT_USER_ID) {
+        uid = n->pkt->pkt.user_id;
+        continue;
+      }
+      if (n->pkt->pkttype == PKT_PUBLIC_SUBKEY) break;
+      if (n->pkt->pkttype != PKT_SIGNATURE || !uid) continue;
+
+      sig = n->pkt->pkt.signature;
+      if (sig->flags.checked || !(IS_UID_SIG(sig) || IS_UID_REV(sig)))
+        continue;
+      if (!keyid_cmp(pk_keyid(pripk), sig->keyid)) continue;
+      if (filter && !filter(opaque, sig)) continue;
+      if (openpgp_pk_test_algo((pubkey_algo_t)(sig->pubkey_algo)) ||
+          openpgp_md_test_algo((digest_algo_t)(sig->digest_algo)))
+        continue;
+
+      /* check_signature_over_key_or_uid prefers the subkeys of the
+         signed key.  */
+      for (k = keyblock->next; k; k = k->next)
+        if (k->pkt->pkttype == PKT_PUBLIC_SUBKEY &&
+            !keyid_cmp(pk_keyid(k->pkt->pkt.public_key), sig->keyid))
+          break;
+      if (k) continue;
+
+      signer_kid = ((uint64_t)sig->keyid[0] << 32) | sig->keyid[1];
+      auto it = signers.find(signer_kid);
+      if (it == signers.end()) {
+        signer = (PKT_public_key *)xmalloc_clear(sizeof *signer);
+        if (get_pubkey(ctrl, signer, sig->keyid)) {
+          xfree(signer);
+          signer = NULL;
+        }
+        it = signers.emplace(signer_kid, signer).first;
+      }
+      signer = it->second;
+      if (!signer) continue;
+
+      if (sig_prefix_open(&md, sig, pripk, uid)) continue;
+      sig_batch_add(batch, signer, sig, md);
+      sigs.push_back(sig);
+    }
+  }
+
+  sig_batch_run(batch, 0);
+  for (i = 0; i < sigs.size(); i++)
+    cache_sig_result(sigs[i], sig_batch_result(batch, i));
+  sig_batch_release(batch);
+
+  for (auto &signer : signers)
+    if (signer.second) free_public_key(signer.second);
+}
@@ -20,9 +20,13 @@
 
 #include <config.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <neopg/utils/workers.h>
 
 #include "../common/compliance.h"
 #include "../common/iobuf.h"
@@ -47,6 +51,16 @@
 #define LF "\n"
 #endif
 
+#if defined(HAVE_DOSISH_SYSTEM) || defined(__CYGWIN__)
+#define MY_O_BINARY O_BINARY
+#else
+#define MY_O_BINARY 0
+#endif
+
+/* The size of the chunks read by the hashing threads of
+   sign_files_detached.  */
+#define SIGN_READ_SIZE (64 * 1024)
+
 static int recipient_digest_algo = 0;
 
 /****************
@@ -901,6 +915,203 @@ leave:
   return rc;
 }
 
+/* A file to be signed by sign_files_detached.  */
+struct sign_job_s {
+  const char *fname;
+  gcry_md_hd_t md;
+  gpg_error_t err;
+};
+
+/* Hash the file of JOB into JOB->md.  This uses plain file
+ * descriptors and does not log anything, so that it can run in any
+ * thread; the iobuf layer is not thread-safe.  */
+static void sign_job_hash(struct sign_job_s *job) {
+  byte *buf;
+  ssize_t n;
+  int fd;
+
+  fd = open(job->fname, O_RDONLY | MY_O_BINARY);
+  if (fd != -1 && is_secured_file(fd)) {
+    close(fd);
+    fd = -1;
+    gpg_err_set_errno(EPERM);
+  }
+  if (fd == -1) {
+    job->err = gpg_error_from_syserror();
+    return;
+  }
+
+  buf = (byte *)xtrymalloc(SIGN_READ_SIZE);
+  if (!buf) {
+    job->err = gpg_error_from_syserror();
+    close(fd);
+    return;
+  }
+  while ((n = read(fd, buf, SIGN_READ_SIZE))) {
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      job->err = gpg_error_from_syserror();
+      break;
+    }
+    gcry_md_write(job->md, buf, n);
+  }
+  xfree(buf);
+  close(fd);
+}
+
+/* Hash the file of JOB into JOB->md through the iobuf layer.  This
+ * is used in text mode and for stdin and must only be called from
+ * the main thread.  */
+static void sign_job_hash_iobuf(struct sign_job_s *job) {
+  md_filter_context_t mfx;
+  text_filter_context_t tfx;
+  IOBUF inp;
+
+  inp = iobuf_open(job->fname);
+  if (inp && is_secured_file(iobuf_get_fd(inp))) {
+    iobuf_close(inp);
+    inp = NULL;
+    gpg_err_set_errno(EPERM);
+  }
+  if (!inp) {
+    job->err = gpg_error_from_syserror();
+    return;
+  }
+
+  memset(&mfx, 0, sizeof mfx);
+  mfx.md = job->md;
+  if (opt.textmode) {
+    memset(&tfx, 0, sizeof tfx);
+    iobuf_push_filter(inp, text_filter, &tfx);
+  }
+  iobuf_push_filter(inp, md_filter, &mfx);
+  while (iobuf_read(inp, NULL, SIGN_READ_SIZE) != -1)
+    ;
+  iobuf_close(inp);
+}
+
+/****************
+ * Make a separate detached signature for each of the NFILES files in
+ * FILES, or for each file named on a line of stdin if NFILES is 0.
+ * The signatures are written to FILE.sig or, with --armor, FILE.asc.
+ * Sign with all secret keys which can be taken from LOCUSR, if this is
+ * empty, use the default one.
+ *
+ * The files are independent, so they are first hashed in parallel,
+ * one message digest context per file and one thread per CPU.  The
+ * signatures are then made in order by the calling thread right
+ * after the hashing; the agent has no batch signing operation, so
+ * this is a sequence of PKSIGN requests on the one connection.
+ * Failures are reported per file and do not stop the others.
+ */
+void sign_files_detached(
+    ctrl_t ctrl, int nfiles, char **files,
+    const std::vector<std::pair<std::string, unsigned int>> &locusr) {
+  std::vector<std::string> names;
+  std::vector<struct sign_job_s> jobs;
+  SK_LIST sk_list = NULL;
+  SK_LIST sk_rover;
+  u32 duration, timestamp;
+  size_t i;
+  int rc;
+
+  if (opt.outfile) {
+    log_error(_("--output doesn't work for this command\n"));
+    return;
+  }
+
+  if (!nfiles) {
+    char line[2048];
+    unsigned int lno = 0;
+    while (fgets(line, DIM(line), stdin)) {
+      lno++;
+      if (!*line || line[strlen(line) - 1] != '\n') {
+        log_error("input line %u too long or missing LF\n", lno);
+        return;
+      }
+      line[strlen(line) - 1] = '\0';
+      names.emplace_back(line);
+    }
+  } else
+    for (; nfiles; nfiles--, files++) names.emplace_back(*files);
+
+  if (opt.ask_sig_expire && !opt.batch)
+    duration = ask_expire_interval(1, opt.def_sig_expire);
+  else
+    duration = parse_expire_string(opt.def_sig_expire);
+
+  if ((rc = build_sk_list(ctrl, locusr, &sk_list, PUBKEY_USAGE_SIG))) {
+    write_status_failure("sign", rc);
+    log_error("signing failed: %s\n", gpg_strerror(rc));
+    return;
+  }
+
+  jobs.resize(names.size());
+  for (i = 0; i < names.size(); i++) {
+    jobs[i].fname = names[i].c_str();
+    jobs[i].err = 0;
+    if (gcry_md_open(&jobs[i].md, 0, 0)) BUG();
+    if (DBG_HASHING) gcry_md_debug(jobs[i].md, "sign");
+    for (sk_rover = sk_list; sk_rover; sk_rover = sk_rover->next)
+      gcry_md_enable(jobs[i].md, hash_for(sk_rover->pk));
+  }
+
+  /* In text mode the files are hashed through the text filter, which
+     needs the iobuf layer and thus the main thread.  */
+  if (!opt.textmode)
+    NeoPG::parallel_for(jobs.size(), NeoPG::hardware_threads(),
+                        [&jobs](size_t k) {
+                          if (!iobuf_is_pipe_filename(jobs[k].fname))
+                            sign_job_hash(&jobs[k]);
+                        });
+
+  /* All signatures of a batch get the same creation time.  */
+  timestamp = make_timestamp();
+
+  for (auto &job : jobs) {
+    armor_filter_context_t *afx;
+    IOBUF out = NULL;
+
+    print_file_status(STATUS_FILE_START, job.fname, 4);
+    if (opt.textmode || iobuf_is_pipe_filename(job.fname))
+      sign_job_hash_iobuf(&job);
+    rc = job.err;
+    if (rc) {
+      log_error(_("can't open '%s': %s\n"), print_fname_stdin(job.fname),
+                gpg_strerror(rc));
+      goto next;
+    }
+
+    if ((rc = open_outfile(-1, job.fname, opt.armor ? 1 : 2, 0, &out)))
+      goto next;
+
+    afx = new_armor_context();
+    afx->what = 2;
+    if (opt.armor) push_armor_filter(afx, out);
+
+    write_status_begin_signing(job.md);
+    rc = write_signature_packets(ctrl, sk_list, out, job.md,
+                                 opt.textmode ? 0x01 : 0x00, timestamp,
+                                 duration, 'D', NULL);
+    if (rc)
+      iobuf_cancel(out);
+    else
+      iobuf_close(out);
+    release_armor_context(afx);
+
+  next:
+    if (rc) {
+      write_status_failure("sign", rc);
+      log_error("signing '%s' failed: %s\n", print_fname_stdin(job.fname),
+                gpg_strerror(rc));
+    }
+    write_status(STATUS_FILE_DONE);
+  }
+
+  for (auto &job : jobs) gcry_md_close(job.md);
+  release_sk_list(sk_list);
+}
+
 /****************
  * make a clear signature. note that opt.armor is not needed
  */
@@ -21,12 +21,17 @@
 #include <config.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifndef HAVE_W32_SYSTEM
+#include <sys/mman.h>
+#endif
 
 #include "../common/iobuf.h"
 #include "../common/status.h"
@@ -48,30 +53,46 @@
 #endif
 
 /*
- * Yes, this is a very simple implementation. We should really
- * use a page aligned buffer and read complete pages.
- * To implement a simple trannsaction system, this is sufficient.
+ * The record cache is a pool of pages.  A page holds
+ * TDBIO_PAGE_RECORDS consecutive records; with 40 byte records a page
+ * is 20 KiB and starts at a multiple of 4 KiB in the file.  A record
+ * which is not yet in the cache is read together with the rest of its
+ * page.  Pages are found through a hash table on the page number and
+ * are kept in least recently used order.  Pages with changed records
+ * are also on a dirty list; the changed records are written back by
+ * tdbio_sync or when the page is evicted.  To implement a simple
+ * transaction system, this is sufficient.
  */
-typedef struct cache_ctrl_struct *CACHE_CTRL;
-struct cache_ctrl_struct {
-  CACHE_CTRL next;
-  struct {
-    unsigned used : 1;
-    unsigned dirty : 1;
-  } flags;
-  unsigned long recno;
-  char data[TRUST_RECORD_LEN];
+#define TDBIO_PAGE_RECORDS 512
+#define TDBIO_PAGE_LEN (TDBIO_PAGE_RECORDS * TRUST_RECORD_LEN)
+#define TDBIO_PAGE_WORDS (TDBIO_PAGE_RECORDS / 64)
+#define CACHE_BUCKETS 256 /* Must be a power of 2.  */
+
+typedef struct cache_page_struct *CACHE_PAGE;
+struct cache_page_struct {
+  CACHE_PAGE next;                 /* Next in the hash bucket.  */
+  CACHE_PAGE lru_prev, lru_next;   /* LRU list, most recent first.  */
+  CACHE_PAGE dirty_prev, dirty_next; /* The dirty list.  */
+  int on_dirty_list;
+  unsigned long pageno;
+  /* Bit maps of the records which are in DATA and of those which
+     need to be written.  */
+  uint64_t present[TDBIO_PAGE_WORDS];
+  uint64_t dirty[TDBIO_PAGE_WORDS];
+  char data[TDBIO_PAGE_LEN];
 };
 
-/* Size of the cache.  The SOFT value is the general one.  While in a
-   transaction this may not be sufficient and thus we may increase it
-   then up to the HARD limit.  */
-#define MAX_CACHE_ENTRIES_SOFT 200
-#define MAX_CACHE_ENTRIES_HARD 10000
+/* Size of the cache in pages.  The SOFT value is the general one.
+   While in a transaction this may not be sufficient and thus we may
+   increase it then up to the HARD limit.  */
+#define MAX_CACHE_PAGES_SOFT 64
+#define MAX_CACHE_PAGES_HARD 1024
 
 /* The cache is controlled by these variables.  */
-static CACHE_CTRL cache_list;
-static int cache_entries;
+static CACHE_PAGE cache_table[CACHE_BUCKETS];
+static CACHE_PAGE cache_lru_head, cache_lru_tail;
+static CACHE_PAGE cache_dirty_list;
+static int cache_pages;
 static int cache_is_dirty;
 
 /* An object to pass information to cmp_krec_fpr. */
@@ -101,8 +122,41 @@ static int db_fd = -1;
 /* A flag indicating that a transaction is active.  */
 static int in_transaction;
 
+#ifndef HAVE_W32_SYSTEM
+/* A read-only mapping of the trustdb used to fill the cache.  It is
+   extended when the file grows.  DB_MAP_FAILED is set if we fell back
+   to read.  */
+static char *db_map;
+static size_t db_map_size;
+static int db_map_failed;
+#endif
+
+/*
+ * Changed records are first appended to a write-ahead journal next to
+ * the trustdb and only then written to the trustdb itself.  Only the
+ * journal is flushed to the disk for each batch of records; the
+ * trustdb is flushed and the journal truncated once it holds
+ * WAL_CHECKPOINT_RECORDS records.  After a crash the committed
+ * batches are replayed when the trustdb is opened.
+ *
+ * Each journal entry is a 4 byte record number followed by the
+ * record.  A batch is terminated by an entry with the record number
+ * WAL_COMMIT_RECNUM which holds WAL_COMMIT_MAGIC, the number of
+ * records in the batch and a checksum over them.
+ */
+#define WAL_ENTRY_LEN (4 + TRUST_RECORD_LEN)
+#define WAL_COMMIT_RECNUM 0xffffffff
+#define WAL_COMMIT_MAGIC "NPGWAL01"
+#define WAL_CHECKPOINT_RECORDS 16384
+
+static char *wal_name;
+static int wal_fd = -1;
+static unsigned long wal_records;
+
 static void open_db(void);
 static void create_hashtable(ctrl_t ctrl, TRUSTREC *vr, int type);
+static void cache_forget_clean(void);
+static int write_back_pages(CACHE_PAGE only);
 
 /*
  * Take a lock on the trustdb file name.  I a lock file can't be
@@ -122,6 +176,8 @@ static int take_write_lock(void) {
       log_fatal(_("can't lock '%s'\n"), db_name);
     else
       is_locked = 1;
+    /* Another process may have changed the trustdb meanwhile.  */
+    cache_forget_clean();
     return 0;
   } else
     return 1;
@@ -139,196 +195,527 @@ static void release_write_lock(void) {
  ************* record cache **********
  *************************************/
 
+static int bit_test(const uint64_t *map, unsigned int idx) {
+  return !!(map[idx / 64] & ((uint64_t)1 << (idx % 64)));
+}
+
+static void bit_set(uint64_t *map, unsigned int idx) {
+  map[idx / 64] |= (uint64_t)1 << (idx % 64);
+}
+
+static void cache_lru_unlink(CACHE_PAGE r) {
+  if (r->lru_prev)
+    r->lru_prev->lru_next = r->lru_next;
+  else
+    cache_lru_head = r->lru_next;
+  if (r->lru_next)
+    r->lru_next->lru_prev = r->lru_prev;
+  else
+    cache_lru_tail = r->lru_prev;
+}
+
+static void cache_lru_push(CACHE_PAGE r) {
+  r->lru_prev = NULL;
+  r->lru_next = cache_lru_head;
+  if (cache_lru_head)
+    cache_lru_head->lru_prev = r;
+  else
+    cache_lru_tail = r;
+  cache_lru_head = r;
+}
+
+static void cache_mark_dirty(CACHE_PAGE r, unsigned int idx) {
+  bit_set(r->dirty, idx);
+  cache_is_dirty = 1;
+  if (r->on_dirty_list) return;
+  r->dirty_prev = NULL;
+  r->dirty_next = cache_dirty_list;
+  if (cache_dirty_list) cache_dirty_list->dirty_prev = r;
+  cache_dirty_list = r;
+  r->on_dirty_list = 1;
+}
+
+static void cache_unmark_dirty(CACHE_PAGE r) {
+  if (!r->on_dirty_list) return;
+  if (r->dirty_prev)
+    r->dirty_prev->dirty_next = r->dirty_next;
+  else
+    cache_dirty_list = r->dirty_next;
+  if (r->dirty_next) r->dirty_next->dirty_prev = r->dirty_prev;
+  r->on_dirty_list = 0;
+  memset(r->dirty, 0, sizeof r->dirty);
+  if (!cache_dirty_list) cache_is_dirty = 0;
+}
+
 /*
- * Get the data from the record cache and return a pointer into that
- * cache.  Caller should copy the returned data.  NULL is returned on
- * a cache miss.
+ * Forget all records which have not been changed.  This is used when
+ * we take the lock because another process may have changed the
+ * trustdb since we read them.
  */
-static const char *get_record_from_cache(unsigned long recno) {
-  CACHE_CTRL r;
+static void cache_forget_clean(void) {
+  CACHE_PAGE r;
+  int i;
 
-  for (r = cache_list; r; r = r->next) {
-    if (r->flags.used && r->recno == recno) return r->data;
-  }
-  return NULL;
+  for (r = cache_lru_head; r; r = r->lru_next)
+    for (i = 0; i < TDBIO_PAGE_WORDS; i++) r->present[i] = r->dirty[i];
 }
 
 /*
- * Write a cached item back to the trustdb file.
+ * Write the changed records of the page R back to the trustdb file.
+ * Runs of adjacent records are written at once.
  *
  * Returns: 0 on success or an error code.
  */
-static int write_cache_item(CACHE_CTRL r) {
+static int write_cache_page(CACHE_PAGE r) {
   gpg_error_t err;
+  unsigned int idx, end;
+  unsigned long recno;
   int n;
 
-  if (lseek(db_fd, r->recno * TRUST_RECORD_LEN, SEEK_SET) == -1) {
-    err = gpg_error_from_syserror();
-    log_error(_("trustdb rec %lu: lseek failed: %s\n"), r->recno,
-              strerror(errno));
-    return err;
-  }
-  n = write(db_fd, r->data, TRUST_RECORD_LEN);
-  if (n != TRUST_RECORD_LEN) {
-    err = gpg_error_from_syserror();
-    log_error(_("trustdb rec %lu: write failed (n=%d): %s\n"), r->recno, n,
-              strerror(errno));
-    return err;
+  for (idx = 0; idx < TDBIO_PAGE_RECORDS; idx = end) {
+    if (!bit_test(r->dirty, idx)) {
+      end = idx + 1;
+      continue;
+    }
+    for (end = idx + 1; end < TDBIO_PAGE_RECORDS && bit_test(r->dirty, end);
+         end++)
+      ;
+
+    recno = r->pageno * TDBIO_PAGE_RECORDS + idx;
+    if (lseek(db_fd, recno * TRUST_RECORD_LEN, SEEK_SET) == -1) {
+      err = gpg_error_from_syserror();
+      log_error(_("trustdb rec %lu: lseek failed: %s\n"), recno,
+                strerror(errno));
+      return err;
+    }
+    n = write(db_fd, r->data + idx * TRUST_RECORD_LEN,
+              (end - idx) * TRUST_RECORD_LEN);
+    if (n != (int)((end - idx) * TRUST_RECORD_LEN)) {
+      err = gpg_error_from_syserror();
+      log_error(_("trustdb rec %lu: write failed (n=%d): %s\n"), recno, n,
+                strerror(errno));
+      return err;
+    }
   }
-  r->flags.dirty = 0;
+  cache_unmark_dirty(r);
   return 0;
 }
 
 /*
- * Put data into the cache.  This function may flush
- * some cache entries if the cache is filled up.
+ * Return the page with number PAGENO from the cache, creating an
+ * empty one if it is not yet cached.  This may evict the least
+ * recently used page and thus write back its changed records.
  *
  * Returns: 0 on success or an error code.
  */
-static int put_record_into_cache(unsigned long recno, const char *data) {
-  CACHE_CTRL r, unused;
-  int dirty_count = 0;
-  int clean_count = 0;
-
-  /* See whether we already cached this one.  */
-  for (unused = NULL, r = cache_list; r; r = r->next) {
-    if (!r->flags.used) {
-      if (!unused) unused = r;
-    } else if (r->recno == recno) {
-      if (!r->flags.dirty) {
-        /* Hmmm: should we use a copy and compare? */
-        if (memcmp(r->data, data, TRUST_RECORD_LEN)) {
-          r->flags.dirty = 1;
-          cache_is_dirty = 1;
-        }
+static int get_cache_page(unsigned long pageno, CACHE_PAGE *r_page) {
+  CACHE_PAGE r, *pp;
+  unsigned int bucket = pageno & (CACHE_BUCKETS - 1);
+
+  for (r = cache_table[bucket]; r; r = r->next)
+    if (r->pageno == pageno) {
+      if (r != cache_lru_head) {
+        cache_lru_unlink(r);
+        cache_lru_push(r);
       }
-      memcpy(r->data, data, TRUST_RECORD_LEN);
+      *r_page = r;
       return 0;
     }
-    if (r->flags.used) {
-      if (r->flags.dirty)
-        dirty_count++;
-      else
-        clean_count++;
+
+  if (cache_pages >= MAX_CACHE_PAGES_SOFT && cache_lru_tail) {
+    /* Reuse the least recently used page.  */
+    r = cache_lru_tail;
+    if (r->on_dirty_list) {
+      if (in_transaction) {
+        /* We can't write back dirty records while in a transaction.
+         * Thus we increase the cache size instead.  */
+        r = NULL;
+        if (cache_pages >= MAX_CACHE_PAGES_HARD) {
+          log_info(_("trustdb transaction too large\n"));
+          return GPG_ERR_RESOURCE_LIMIT;
+        }
+        if (opt.debug) log_debug("increasing tdbio cache size\n");
+      } else {
+        int did_lock, rc;
+
+        did_lock = !take_write_lock();
+        rc = write_back_pages(r);
+        if (did_lock) release_write_lock();
+        if (rc) return rc;
+      }
+    }
+    if (r) {
+      for (pp = &cache_table[r->pageno & (CACHE_BUCKETS - 1)]; *pp != r;
+           pp = &(*pp)->next)
+        ;
+      *pp = r->next;
+      cache_lru_unlink(r);
+      cache_pages--;
+    }
+  } else
+    r = NULL;
+
+  if (!r) r = (CACHE_PAGE)xmalloc(sizeof *r);
+  memset(r, 0, offsetof(struct cache_page_struct, data));
+  r->pageno = pageno;
+  r->next = cache_table[bucket];
+  cache_table[bucket] = r;
+  cache_lru_push(r);
+  cache_pages++;
+  *r_page = r;
+  return 0;
+}
+
+/*
+ * Copy the records in the N bytes at SRC which are not yet in the
+ * cache into the page R.
+ */
+static void fill_cache_page(CACHE_PAGE r, const char *src, int n) {
+  unsigned int idx;
+
+  for (idx = 0; idx < (unsigned int)n / TRUST_RECORD_LEN; idx++)
+    if (!bit_test(r->present, idx)) {
+      memcpy(r->data + idx * TRUST_RECORD_LEN, src + idx * TRUST_RECORD_LEN,
+             TRUST_RECORD_LEN);
+      bit_set(r->present, idx);
+    }
+}
+
+#ifndef HAVE_W32_SYSTEM
+static void unmap_db(void) {
+  if (db_map) munmap(db_map, db_map_size);
+  db_map = NULL;
+  db_map_size = 0;
+}
+
+/*
+ * Return a pointer to the page at OFFSET in the mapped trustdb and
+ * store the number of bytes available there at R_N.  The mapping is
+ * renewed if the file has grown.  Returns NULL if the trustdb can't
+ * be mapped.
+ */
+static const char *map_db(size_t offset, int *r_n) {
+  struct stat st;
+  void *image;
+
+  if (db_map_failed) return NULL;
+  if (offset + TDBIO_PAGE_LEN > db_map_size) {
+    if (fstat(db_fd, &st)) return NULL;
+    if ((size_t)st.st_size > db_map_size) {
+      unmap_db();
+      image = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, db_fd, 0);
+      if (image == MAP_FAILED) {
+        if (opt.debug)
+          log_debug("trustdb: mmap failed: %s\n", strerror(errno));
+        db_map_failed = 1;
+        return NULL;
+      }
+      db_map = (char *)image;
+      db_map_size = st.st_size;
     }
   }
+  if (offset >= db_map_size)
+    *r_n = 0;
+  else if (offset + TDBIO_PAGE_LEN > db_map_size)
+    *r_n = db_map_size - offset;
+  else
+    *r_n = TDBIO_PAGE_LEN;
+  return db_map + (offset < db_map_size ? offset : 0);
+}
+#endif /*!HAVE_W32_SYSTEM*/
 
-  /* Not in the cache: add a new entry. */
-  if (unused) {
-    /* Reuse this entry. */
-    r = unused;
-    r->flags.used = 1;
-    r->recno = recno;
-    memcpy(r->data, data, TRUST_RECORD_LEN);
-    r->flags.dirty = 1;
-    cache_is_dirty = 1;
-    cache_entries++;
-    return 0;
+/*
+ * Open the journal for appending.
+ *
+ * Returns: 0 on success or an error code.
+ */
+static gpg_error_t open_wal(void) {
+  gpg_error_t err;
+  mode_t oldmask;
+
+  if (wal_fd != -1) return 0;
+  oldmask = umask(077);
+  wal_fd = open(wal_name, O_RDWR | O_CREAT | O_APPEND | MY_O_BINARY, 0600);
+  umask(oldmask);
+  if (wal_fd == -1) {
+    err = gpg_error_from_syserror();
+    log_error(_("can't open '%s': %s\n"), wal_name, strerror(errno));
+    return err;
   }
+  return 0;
+}
 
-  /* See whether we reached the limit. */
-  if (cache_entries < MAX_CACHE_ENTRIES_SOFT) {
-    /* No: Put into cache.  */
-    r = (CACHE_CTRL)xmalloc(sizeof *r);
-    r->flags.used = 1;
-    r->recno = recno;
-    memcpy(r->data, data, TRUST_RECORD_LEN);
-    r->flags.dirty = 1;
-    r->next = cache_list;
-    cache_list = r;
-    cache_is_dirty = 1;
-    cache_entries++;
-    return 0;
+/* A simple FNV-1a hash to detect torn journal batches.  */
+static u32 wal_checksum(u32 h, const char *buf, size_t len) {
+  const byte *p = (const byte *)buf;
+
+  while (len--) {
+    h ^= *p++;
+    h *= 16777619;
   }
+  return h;
+}
+
+/*
+ * Append the changed records of page ONLY, or of all pages on the
+ * dirty list if ONLY is NULL, as one batch to the journal and flush
+ * it.  The number of journaled records is stored at R_COUNT.
+ *
+ * Returns: 0 on success or an error code.
+ */
+static gpg_error_t append_wal(CACHE_PAGE only, unsigned long *r_count) {
+  gpg_error_t err;
+  CACHE_PAGE r;
+  unsigned long count = 0, recno;
+  unsigned int idx;
+  size_t len;
+  char *buf, *p;
+  u32 sum = 2166136261U;
+  int n;
 
-  /* Cache is full: discard some clean entries.  */
-  if (clean_count) {
-    int n;
+  *r_count = 0;
+  err = open_wal();
+  if (err) return err;
 
-    /* We discard a third of the clean entries.  */
-    n = clean_count / 3;
-    if (!n) n = 1;
+  for (r = only ? only : cache_dirty_list; r; r = only ? NULL : r->dirty_next)
+    for (idx = 0; idx < TDBIO_PAGE_RECORDS; idx++)
+      if (bit_test(r->dirty, idx)) count++;
 
-    for (unused = NULL, r = cache_list; r; r = r->next) {
-      if (r->flags.used && !r->flags.dirty) {
-        if (!unused) unused = r;
-        r->flags.used = 0;
-        cache_entries--;
-        if (!--n) break;
+  len = (count + 1) * WAL_ENTRY_LEN;
+  buf = (char *)xtrymalloc(len);
+  if (!buf) return gpg_error_from_syserror();
+  p = buf;
+  for (r = only ? only : cache_dirty_list; r; r = only ? NULL : r->dirty_next)
+    for (idx = 0; idx < TDBIO_PAGE_RECORDS; idx++)
+      if (bit_test(r->dirty, idx)) {
+        recno = r->pageno * TDBIO_PAGE_RECORDS + idx;
+        ulongtobuf(p, recno);
+        memcpy(p + 4, r->data + idx * TRUST_RECORD_LEN, TRUST_RECORD_LEN);
+        p += WAL_ENTRY_LEN;
       }
-    }
+  sum = wal_checksum(sum, buf, count * WAL_ENTRY_LEN);
+  memset(p, 0, WAL_ENTRY_LEN);
+  ulongtobuf(p, WAL_COMMIT_RECNUM);
+  memcpy(p + 4, WAL_COMMIT_MAGIC, 8);
+  ulongtobuf(p + 12, count);
+  ulongtobuf(p + 16, sum);
+
+  n = write(wal_fd, buf, len);
+  if (n != (int)len) {
+    err = gpg_error_from_syserror();
+    log_error(_("%s: write failed (n=%d): %s\n"), wal_name, n,
+              strerror(errno));
+  } else if (fsync(wal_fd)) {
+    err = gpg_error_from_syserror();
+    log_error(_("%s: fsync failed: %s\n"), wal_name, strerror(errno));
+  }
+  xfree(buf);
+  if (!err) *r_count = count;
+  return err;
+}
 
-    /* Now put into the cache.  */
-    log_assert(unused);
-    r = unused;
-    r->flags.used = 1;
-    r->recno = recno;
-    memcpy(r->data, data, TRUST_RECORD_LEN);
-    r->flags.dirty = 1;
-    cache_is_dirty = 1;
-    cache_entries++;
-    return 0;
+/*
+ * Flush the trustdb to the disk and empty the journal.
+ *
+ * Returns: 0 on success or an error code.
+ */
+static gpg_error_t checkpoint_wal(void) {
+  gpg_error_t err;
+
+  if (wal_fd == -1) return 0;
+  if (fsync(db_fd)) {
+    err = gpg_error_from_syserror();
+    log_error(_("%s: fsync failed: %s\n"), db_name, strerror(errno));
+    return err;
+  }
+  if (ftruncate(wal_fd, 0)) {
+    err = gpg_error_from_syserror();
+    log_error(_("%s: truncate failed: %s\n"), wal_name, strerror(errno));
+    return err;
   }
+  wal_records = 0;
+  return 0;
+}
 
-  /* No clean entries: We have to flush some dirty entries.  */
-  if (in_transaction) {
-    /* But we can't do this while in a transaction.  Thus we
-     * increase the cache size instead.  */
-    if (cache_entries < MAX_CACHE_ENTRIES_HARD) {
-      if (opt.debug && !(cache_entries % 100))
-        log_debug("increasing tdbio cache size\n");
-      r = (CACHE_CTRL)xmalloc(sizeof *r);
-      r->flags.used = 1;
-      r->recno = recno;
-      memcpy(r->data, data, TRUST_RECORD_LEN);
-      r->flags.dirty = 1;
-      r->next = cache_list;
-      cache_list = r;
-      cache_is_dirty = 1;
-      cache_entries++;
-      return 0;
+/*
+ * Apply the committed batches of a journal left over by a crashed
+ * process to the trustdb.  The caller must hold the write lock.
+ */
+static void replay_wal(void) {
+  struct stat st;
+  char *buf;
+  size_t off, start, len;
+  unsigned long count, applied = 0, recno;
+  int fd, n;
+  u32 sum;
+
+  fd = open(wal_name, O_RDONLY | MY_O_BINARY);
+  if (fd == -1) return;
+  if (fstat(fd, &st) || !st.st_size) {
+    close(fd);
+    return;
+  }
+  len = st.st_size - st.st_size % WAL_ENTRY_LEN;
+  buf = (char *)xmalloc(len ? len : 1);
+  n = read(fd, buf, len);
+  close(fd);
+  if (n != (int)len) len = 0;
+
+  for (start = off = 0; off < len; off += WAL_ENTRY_LEN) {
+    if (buf32_to_ulong(buf + off) != WAL_COMMIT_RECNUM) continue;
+    count = (off - start) / WAL_ENTRY_LEN;
+    sum = wal_checksum(2166136261U, buf + start, off - start);
+    if (memcmp(buf + off + 4, WAL_COMMIT_MAGIC, 8) ||
+        buf32_to_ulong(buf + off + 12) != count ||
+        buf32_to_u32(buf + off + 16) != sum)
+      break; /* A torn batch; ignore the rest.  */
+    for (; start < off; start += WAL_ENTRY_LEN) {
+      recno = buf32_to_ulong(buf + start);
+      if (lseek(db_fd, recno * TRUST_RECORD_LEN, SEEK_SET) == -1 ||
+          write(db_fd, buf + start + 4, TRUST_RECORD_LEN) != TRUST_RECORD_LEN)
+        log_fatal(_("%s: replaying the journal failed: %s\n"), db_name,
+                  strerror(errno));
     }
-    /* Hard limit for the cache size reached.  */
-    log_info(_("trustdb transaction too large\n"));
-    return GPG_ERR_RESOURCE_LIMIT;
+    start = off + WAL_ENTRY_LEN;
+    applied += count;
   }
+  xfree(buf);
+
+  if (applied && !opt.quiet)
+    log_info(_("%s: recovered %lu records from the journal\n"), db_name,
+             applied);
+  if (!open_wal() && checkpoint_wal())
+    log_fatal(_("%s: replaying the journal failed\n"), db_name);
+}
+
+/*
+ * Journal and write back the changed records of page ONLY, or of all
+ * pages on the dirty list if ONLY is NULL.
+ *
+ * Returns: 0 on success or an error code.
+ */
+static int write_back_pages(CACHE_PAGE only) {
+  unsigned long count;
+  int rc;
 
-  if (dirty_count) {
-    int n;
+  rc = append_wal(only, &count);
+  if (rc) return rc;
+  if (only)
+    rc = write_cache_page(only);
+  else
+    while (!rc && cache_dirty_list) rc = write_cache_page(cache_dirty_list);
+  if (rc) return rc;
 
-    /* Discard some dirty entries. */
-    n = dirty_count / 5;
-    if (!n) n = 1;
+  wal_records += count;
+  if (wal_records >= WAL_CHECKPOINT_RECORDS) rc = checkpoint_wal();
+  return rc;
+}
 
-    take_write_lock();
-    for (unused = NULL, r = cache_list; r; r = r->next) {
-      if (r->flags.used && r->flags.dirty) {
-        int rc;
+/*
+ * Read the page R from the trustdb file.  Only records which are not
+ * yet in the cache are taken from the file.
+ *
+ * Returns: 0 on success or an error code.
+ */
+static int read_cache_page(CACHE_PAGE r) {
+  gpg_error_t err;
+  const char *src;
+  char *buf;
+  unsigned int idx;
+  int n;
 
-        rc = write_cache_item(r);
-        if (rc) return rc;
-        if (!unused) unused = r;
-        r->flags.used = 0;
-        cache_entries--;
-        if (!--n) break;
-      }
-    }
-    release_write_lock();
-
-    /* Now put into the cache.  */
-    log_assert(unused);
-    r = unused;
-    r->flags.used = 1;
-    r->recno = recno;
-    memcpy(r->data, data, TRUST_RECORD_LEN);
-    r->flags.dirty = 1;
-    cache_is_dirty = 1;
-    cache_entries++;
+#ifndef HAVE_W32_SYSTEM
+  src = map_db(r->pageno * TDBIO_PAGE_LEN, &n);
+  if (src) {
+    fill_cache_page(r, src, n);
     return 0;
   }
+#endif
 
-  /* We should never reach this.  */
-  BUG();
+  if (lseek(db_fd, r->pageno * TDBIO_PAGE_RECORDS * TRUST_RECORD_LEN,
+            SEEK_SET) == -1) {
+    err = gpg_error_from_syserror();
+    log_error(_("trustdb: lseek failed: %s\n"), strerror(errno));
+    return err;
+  }
+  buf = (char *)xmalloc(sizeof r->data);
+  n = read(db_fd, buf, sizeof r->data);
+  if (n < 0) {
+    err = gpg_error_from_syserror();
+    log_error(_("trustdb: read failed (n=%d): %s\n"), n, strerror(errno));
+    xfree(buf);
+    return err;
+  }
+  fill_cache_page(r, buf, n);
+  xfree(buf);
+  return 0;
+}
+
+/*
+ * Get the data of record RECNO, reading its page if needed.  On
+ * success a pointer into the cache is stored at R_DATA; the caller
+ * should copy the data.
+ *
+ * Returns: 0 on success, -1 on EOF, or an error code.
+ */
+static int get_record_from_cache(unsigned long recno, const char **r_data) {
+  CACHE_PAGE r;
+  unsigned int idx = recno % TDBIO_PAGE_RECORDS;
+  int rc;
+
+  rc = get_cache_page(recno / TDBIO_PAGE_RECORDS, &r);
+  if (rc) return rc;
+  if (!bit_test(r->present, idx)) {
+    rc = read_cache_page(r);
+    if (rc) return rc;
+    if (!bit_test(r->present, idx)) return -1; /* eof */
+  }
+  *r_data = r->data + idx * TRUST_RECORD_LEN;
+  return 0;
+}
+
+/*
+ * Update the cached copy of record RECNO with DATA, which has just
+ * been written to the file directly.
+ */
+static void update_cached_record(unsigned long recno, const char *data) {
+  CACHE_PAGE r;
+  unsigned int idx = recno % TDBIO_PAGE_RECORDS;
+
+  for (r = cache_table[(recno / TDBIO_PAGE_RECORDS) & (CACHE_BUCKETS - 1)]; r;
+       r = r->next)
+    if (r->pageno == recno / TDBIO_PAGE_RECORDS) {
+      memcpy(r->data + idx * TRUST_RECORD_LEN, data, TRUST_RECORD_LEN);
+      bit_set(r->present, idx);
+      return;
+    }
+}
+
+/*
+ * Put data into the cache.  This function may write back some
+ * changed records if the cache is filled up.
+ *
+ * Returns: 0 on success or an error code.
+ */
+static int put_record_into_cache(unsigned long recno, const char *data) {
+  CACHE_PAGE r;
+  unsigned int idx = recno % TDBIO_PAGE_RECORDS;
+  char *p;
+  int rc;
+
+  rc = get_cache_page(recno / TDBIO_PAGE_RECORDS, &r);
+  if (rc) return rc;
+
+  p = r->data + idx * TRUST_RECORD_LEN;
+  /* Unchanged records need not be written.  */
+  if (bit_test(r->present, idx) && !bit_test(r->dirty, idx) &&
+      !memcmp(p, data, TRUST_RECORD_LEN))
+    return 0;
+
+  memcpy(p, data, TRUST_RECORD_LEN);
+  bit_set(r->present, idx);
+  cache_mark_dirty(r, idx);
+  return 0;
 }
 
 /* Return true if the cache is dirty.  */
@@ -338,8 +725,8 @@ int tdbio_is_dirty() { return cache_is_dirty; }
  * Flush the cache.  This cannot be used while in a transaction.
  */
 int tdbio_sync() {
-  CACHE_CTRL r;
   int did_lock = 0;
+  int rc;
 
   if (db_fd == -1) open_db();
   if (in_transaction) log_bug("tdbio: syncing while in transaction\n");
@@ -348,16 +735,10 @@ int tdbio_sync() {
 
   if (!take_write_lock()) did_lock = 1;
 
-  for (r = cache_list; r; r = r->next) {
-    if (r->flags.used && r->flags.dirty) {
-      int rc = write_cache_item(r);
-      if (rc) return rc;
-    }
-  }
-  cache_is_dirty = 0;
+  rc = write_back_pages(NULL);
   if (did_lock) release_write_lock();
 
-  return 0;
+  return rc;
 }
 
 /********************************************************
@@ -366,6 +747,13 @@ int tdbio_sync() {
 
 /* The cleanup handler for this module.  */
 static void cleanup(void) {
+  /* Empty the journal if we wrote to it, but don't wait for the lock
+     here; the next process will then replay it.  */
+  if (wal_records && !cache_is_dirty && lockhandle &&
+      (is_locked || !dotlock_take(lockhandle, 0))) {
+    is_locked = 1;
+    checkpoint_wal();
+  }
   if (is_locked) {
     if (!dotlock_release(lockhandle)) is_locked = 0;
   }
@@ -466,6 +854,8 @@ int tdbio_set_dbname(ctrl_t ctrl, const char *new_dbname, int create,
 
   xfree(db_name);
   db_name = fname;
+  xfree(wal_name);
+  wal_name = xstrconcat(fname, ".wal", NULL);
 
   /* Quick check for (likely) case where there already is a
    * trustdb.gpg.  This check is not required in theory, but it helps
@@ -557,6 +947,7 @@ const char *tdbio_get_dbname() { return db_name; }
  */
 static void open_db() {
   TRUSTREC rec;
+  struct stat st;
 
   log_assert(db_fd == -1);
 
@@ -574,6 +965,14 @@ static void open_db() {
     log_fatal(_("can't open '%s': %s\n"), db_name, strerror(errno));
   register_secured_file(db_name);
 
+  /* Apply the records of a process which crashed while updating.  */
+  if (!stat(wal_name, &st) && st.st_size && !access(db_name, W_OK)) {
+    int did_lock = !take_write_lock();
+
+    replay_wal();
+    if (did_lock) release_write_lock();
+  }
+
   /* Read the version record. */
   if (tdbio_read_record(0, &rec, RECTYPE_VER))
     log_fatal(_("%s: invalid trustdb\n"), db_name);
@@ -1119,30 +1518,14 @@ void tdbio_dump_record(TRUSTREC *rec, estream_t fp) {
  * Return: 0 on success, -1 on EOF, or an error code.
  */
 int tdbio_read_record(unsigned long recnum, TRUSTREC *rec, int expected) {
-  byte readbuf[TRUST_RECORD_LEN];
   const byte *buf, *p;
   gpg_error_t err = 0;
-  int n, i;
+  int i;
 
   if (db_fd == -1) open_db();
 
-  buf = (const byte *)get_record_from_cache(recnum);
-  if (!buf) {
-    if (lseek(db_fd, recnum * TRUST_RECORD_LEN, SEEK_SET) == -1) {
-      err = gpg_error_from_syserror();
-      log_error(_("trustdb: lseek failed: %s\n"), strerror(errno));
-      return err;
-    }
-    n = read(db_fd, readbuf, TRUST_RECORD_LEN);
-    if (!n) {
-      return -1; /* eof */
-    } else if (n != TRUST_RECORD_LEN) {
-      err = gpg_error_from_syserror();
-      log_error(_("trustdb: read failed (n=%d): %s\n"), n, strerror(errno));
-      return err;
-    }
-    buf = readbuf;
-  }
+  err = get_record_from_cache(recnum, (const char **)&buf);
+  if (err) return err;
   rec->recnum = recnum;
   rec->dirty = 0;
   p = buf;
@@ -1444,7 +1827,8 @@ unsigned long tdbio_new_recnum(ctrl_t ctrl) {
         rc = gpg_error_from_syserror();
         log_error(_("trustdb rec %lu: write failed (n=%d): %s\n"), recnum, n,
                   strerror(errno));
-      }
+      } else
+        update_cached_record(recnum, (const char *)&rec);
     }
 
     if (rc)
@@ -23,6 +23,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include "../common/iobuf.h"
 #include "../common/status.h"
 #include "../common/util.h"
@@ -40,21 +42,6 @@
                           /* to make sure that a warning is displayed while */
                           /* creating a message */
 
-static unsigned len_without_trailing_chars(byte *line, unsigned len,
-                                           const char *trimchars) {
-  byte *p, *mark;
-  unsigned n;
-
-  for (mark = NULL, p = line, n = 0; n < len; n++, p++) {
-    if (strchr(trimchars, *p)) {
-      if (!mark) mark = p;
-    } else
-      mark = NULL;
-  }
-
-  return mark ? (mark - line) : len;
-}
-
 static int standard(text_filter_context_t *tfx, IOBUF a, byte *buf, size_t size,
                     size_t *ret_len) {
   int rc = 0;
@@ -66,8 +53,14 @@ static int standard(text_filter_context_t *tfx, IOBUF a, byte *buf, size_t size,
   while (!rc && len < size) {
     int lf_seen;
 
-    while (len < size && tfx->buffer_pos < tfx->buffer_len)
-      buf[len++] = tfx->buffer[tfx->buffer_pos++];
+    if (tfx->buffer_pos < tfx->buffer_len) {
+      size_t n = std::min<size_t>(size - len,
+                                  tfx->buffer_len - tfx->buffer_pos);
+
+      memcpy(buf + len, tfx->buffer + tfx->buffer_pos, n);
+      len += n;
+      tfx->buffer_pos += n;
+    }
     if (len >= size) continue;
 
     /* read the next line */
@@ -142,7 +135,8 @@ int copy_clearsig_text(IOBUF out, IOBUF inp, gcry_md_hd_t md) {
       gcry_md_putc(md, '\r');
       gcry_md_putc(md, '\n');
     }
-    gcry_md_write(md, buffer, len_without_trailing_chars(buffer, n, " \t\r\n"));
+    gcry_md_write(md, buffer,
+                  length_sans_trailing_chars(buffer, n, " \t\r\n"));
 
     pending_lf = buffer[n - 1] == '\n';
 
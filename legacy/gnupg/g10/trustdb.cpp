@@ -40,6 +40,10 @@
 #include "tdbio.h"
 #include "trustdb.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
 typedef struct key_item **KeyHashTable; /* see new_key_hash_table() */
 
 /*
@@ -51,6 +55,24 @@ struct key_array {
   KBNODE keyblock;
 };
 
+/*
+ * An in-memory index of the certifications in the keydb.  It is built
+ * while validate_keys scans the keydb for the first level and maps
+ * the key ID of a signer to the keys it has signed.  The following
+ * levels then only look at the keys signed by a key of the previous
+ * level instead of scanning the whole keydb again.
+ */
+struct cert_index {
+  struct signee {
+    u32 kid[2];
+    byte fpr[MAX_FINGERPRINT_LEN];
+    size_t fprlen;
+  };
+  int complete = 0;         /* Set after a full scan.  */
+  std::vector<signee> keys; /* In keydb order.  */
+  std::unordered_map<uint64_t, std::vector<size_t>> signed_by;
+};
+
 /* Control information for the trust DB.  */
 static struct {
   int init;
@@ -1361,14 +1383,196 @@ static int search_skipfnc(void *opaque, u32 *kid, int dummy_uid_no) {
   return test_key_hash_table((KeyHashTable)opaque, kid);
 }
 
+/*
+ * Add the certifications on KEYBLOCK to the index CIDX.
+ */
+static void index_keyblock(struct cert_index *cidx, kbnode_t keyblock) {
+  struct cert_index::signee key;
+  PKT_public_key *pk = keyblock->pkt->pkt.public_key;
+  kbnode_t node;
+  size_t idx = cidx->keys.size();
+
+  fingerprint_from_pk(pk, key.fpr, &key.fprlen);
+  keyid_from_pk(pk, key.kid);
+  cidx->keys.push_back(key);
+
+  for (node = keyblock; node; node = node->next)
+    if (node->pkt->pkttype == PKT_SIGNATURE) {
+      PKT_signature *sig = node->pkt->pkt.signature;
+      std::vector<size_t> *list;
+
+      if (sig->keyid[0] == key.kid[0] && sig->keyid[1] == key.kid[1])
+        continue;
+      list = &cidx->signed_by[((uint64_t)sig->keyid[0] << 32) | sig->keyid[1]];
+      if (list->empty() || list->back() != idx) list->push_back(idx);
+    } else if (node->pkt->pkttype == PKT_PUBLIC_SUBKEY)
+      break; /* Only user ID certifications are of interest.  */
+}
+
+/*
+ * Check the prepared KEYBLOCK against KLIST and, if any of its user
+ * IDs is signed by a key in klist, append it to the key_array at
+ * *R_KEYS which has *R_NKEYS used and *R_MAXKEYS allocated entries.
+ * On return KEYBLOCK has either been taken over or released.
+ */
+static void consider_keyblock(ctrl_t ctrl, kbnode_t keyblock,
+                              KeyHashTable full_trust, struct key_item *klist,
+                              u32 curtime, u32 *next_expire,
+                              struct key_array **r_keys, size_t *r_nkeys,
+                              size_t *r_maxkeys) {
+  PKT_public_key *pk;
+  u32 kid[2];
+
+  pk = keyblock->pkt->pkt.public_key;
+  keyid_from_pk(pk, kid);
+  if (test_key_hash_table(full_trust, kid)) {
+    /* Fetched before an earlier key of the batch with the same key
+       ID was marked.  */
+    release_kbnode(keyblock);
+    return;
+  }
+
+  if (pk->has_expired || pk->flags.revoked) {
+    /* it does not make sense to look further at those keys */
+    mark_keyblock_seen(full_trust, keyblock);
+  } else if (validate_one_keyblock(ctrl, keyblock, klist, curtime,
+                                   next_expire)) {
+    KBNODE node;
+
+    if (pk->expiredate && pk->expiredate >= curtime &&
+        pk->expiredate < *next_expire)
+      *next_expire = pk->expiredate;
+
+    if (*r_nkeys == *r_maxkeys) {
+      *r_maxkeys += 1000;
+      *r_keys =
+          (key_array *)xrealloc(*r_keys, (*r_maxkeys + 1) * sizeof **r_keys);
+    }
+    (*r_keys)[(*r_nkeys)++].keyblock = keyblock;
+
+    /* Optimization - if all uids are fully trusted, then we
+       never need to consider this key as a candidate again. */
+
+    for (node = keyblock; node; node = node->next)
+      if (node->pkt->pkttype == PKT_USER_ID && !(node->flag & 4)) break;
+
+    if (node == NULL) mark_keyblock_seen(full_trust, keyblock);
+
+    keyblock = NULL;
+  }
+
+  release_kbnode(keyblock);
+}
+
+/* The number of key blocks whose certifications are verified
+   together.  */
+#define VALIDATE_BATCH_KEYS 256
+
+static int klist_filter(void *opaque, PKT_signature *sig) {
+  return !!is_in_klist((struct key_item *)opaque, sig);
+}
+
+/*
+ * Prepare the key blocks in BATCH, verify their certifications by
+ * keys in KLIST in parallel and then pass them one after the other to
+ * consider_keyblock.  BATCH is emptied.
+ */
+static void consider_keyblocks(ctrl_t ctrl, std::vector<kbnode_t> &batch,
+                               KeyHashTable full_trust, struct key_item *klist,
+                               u32 curtime, u32 *next_expire,
+                               struct key_array **r_keys, size_t *r_nkeys,
+                               size_t *r_maxkeys) {
+  size_t i;
+
+  /* prepare the keyblocks for further processing */
+  for (i = 0; i < batch.size(); i++) {
+    merge_keys_and_selfsig(ctrl, batch[i]);
+    clear_kbnode_flags(batch[i]);
+  }
+  check_certs_batch(ctrl, batch.data(), batch.size(), klist_filter, klist);
+  for (i = 0; i < batch.size(); i++)
+    consider_keyblock(ctrl, batch[i], full_trust, klist, curtime, next_expire,
+                      r_keys, r_nkeys, r_maxkeys);
+  batch.clear();
+}
+
+/*
+ * Return a key_array of all suitable keys signed by a key from klist
+ * using the certification index CIDX, which has been filled by a
+ * previous call to validate_key_list.  Returns either a key_array or
+ * NULL in case of an error.  Caller hast to release the returned
+ * array.
+ */
+static struct key_array *validate_indexed_keys(
+    ctrl_t ctrl, KEYDB_HANDLE hd, struct cert_index *cidx,
+    KeyHashTable full_trust, struct key_item *klist, u32 curtime,
+    u32 *next_expire) {
+  struct key_array *keys;
+  size_t nkeys, maxkeys;
+  std::vector<size_t> candidates;
+  std::vector<kbnode_t> batch;
+  struct key_item *k;
+  size_t i;
+  int rc;
+
+  for (k = klist; k; k = k->next) {
+    auto it = cidx->signed_by.find(((uint64_t)k->kid[0] << 32) | k->kid[1]);
+    if (it != cidx->signed_by.end())
+      candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+  }
+  /* Process the keys in the same order as a full scan would.  */
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+
+  maxkeys = 1000;
+  keys = (key_array *)xmalloc((maxkeys + 1) * sizeof *keys);
+  nkeys = 0;
+
+  for (i = 0; i < candidates.size(); i++) {
+    struct cert_index::signee *key = &cidx->keys[candidates[i]];
+    KEYDB_SEARCH_DESC desc;
+    KBNODE keyblock = NULL;
+
+    if (test_key_hash_table(full_trust, key->kid)) continue;
+
+    memset(&desc, 0, sizeof desc);
+    desc.mode =
+        key->fprlen == 16 ? KEYDB_SEARCH_MODE_FPR16 : KEYDB_SEARCH_MODE_FPR20;
+    memcpy(desc.u.fpr, key->fpr, key->fprlen);
+    rc = keydb_search_reset(hd);
+    if (!rc) rc = keydb_search(hd, &desc, 1, NULL);
+    if (rc == GPG_ERR_NOT_FOUND) continue; /* Deleted meanwhile.  */
+    if (!rc) rc = keydb_get_keyblock(hd, &keyblock);
+    if (rc) {
+      log_error("keydb_search(fpr) failed: %s\n", gpg_strerror(rc));
+      for (auto kb : batch) release_kbnode(kb);
+      keys[nkeys].keyblock = NULL;
+      release_key_array(keys);
+      return NULL;
+    }
+    batch.push_back(keyblock);
+    if (batch.size() == VALIDATE_BATCH_KEYS)
+      consider_keyblocks(ctrl, batch, full_trust, klist, curtime, next_expire,
+                         &keys, &nkeys, &maxkeys);
+  }
+  consider_keyblocks(ctrl, batch, full_trust, klist, curtime, next_expire,
+                     &keys, &nkeys, &maxkeys);
+
+  keys[nkeys].keyblock = NULL;
+  return keys;
+}
+
 /*
  * Scan all keys and return a key_array of all suitable keys from
  * kllist.  The caller has to pass keydb handle so that we don't use
- * to create our own.  Returns either a key_array or NULL in case of
- * an error.  No results found are indicated by an empty array.
- * Caller hast to release the returned array.
+ * to create our own.  If CIDX is not NULL the certifications
+ * of all scanned keys are added to it.  Returns either a key_array or
+ * NULL in case of an error.  No results found are indicated by an
+ * empty array.  Caller hast to release the returned array.
  */
 static struct key_array *validate_key_list(ctrl_t ctrl, KEYDB_HANDLE hd,
+                                           struct cert_index *cidx,
                                            KeyHashTable full_trust,
                                            struct key_item *klist, u32 curtime,
                                            u32 *next_expire) {
@@ -1377,6 +1581,7 @@ static struct key_array *validate_key_list(ctrl_t ctrl, KEYDB_HANDLE hd,
   size_t nkeys, maxkeys;
   int rc;
   KEYDB_SEARCH_DESC desc;
+  std::vector<kbnode_t> batch;
 
   maxkeys = 1000;
   keys = (key_array *)xmalloc((maxkeys + 1) * sizeof *keys);
@@ -1396,6 +1601,7 @@ static struct key_array *validate_key_list(ctrl_t ctrl, KEYDB_HANDLE hd,
   rc = keydb_search(hd, &desc, 1, NULL);
   if (rc == GPG_ERR_NOT_FOUND) {
     keys[nkeys].keyblock = NULL;
+    if (cidx) cidx->complete = 1;
     return keys;
   }
   if (rc) {
@@ -1405,8 +1611,6 @@ static struct key_array *validate_key_list(ctrl_t ctrl, KEYDB_HANDLE hd,
 
   desc.mode = KEYDB_SEARCH_MODE_NEXT; /* change mode */
   do {
-    PKT_public_key *pk;
-
     rc = keydb_get_keyblock(hd, &keyblock);
     if (rc) {
       log_error("keydb_get_keyblock failed: %s\n", gpg_strerror(rc));
@@ -1421,40 +1625,12 @@ static struct key_array *validate_key_list(ctrl_t ctrl, KEYDB_HANDLE hd,
       continue;
     }
 
-    /* prepare the keyblock for further processing */
-    merge_keys_and_selfsig(ctrl, keyblock);
-    clear_kbnode_flags(keyblock);
-    pk = keyblock->pkt->pkt.public_key;
-    if (pk->has_expired || pk->flags.revoked) {
-      /* it does not make sense to look further at those keys */
-      mark_keyblock_seen(full_trust, keyblock);
-    } else if (validate_one_keyblock(ctrl, keyblock, klist, curtime,
-                                     next_expire)) {
-      KBNODE node;
-
-      if (pk->expiredate && pk->expiredate >= curtime &&
-          pk->expiredate < *next_expire)
-        *next_expire = pk->expiredate;
-
-      if (nkeys == maxkeys) {
-        maxkeys += 1000;
-        keys = (key_array *)xrealloc(keys, (maxkeys + 1) * sizeof *keys);
-      }
-      keys[nkeys++].keyblock = keyblock;
-
-      /* Optimization - if all uids are fully trusted, then we
-         never need to consider this key as a candidate again. */
-
-      for (node = keyblock; node; node = node->next)
-        if (node->pkt->pkttype == PKT_USER_ID && !(node->flag & 4)) break;
-
-      if (node == NULL) mark_keyblock_seen(full_trust, keyblock);
-
-      keyblock = NULL;
-    }
-
-    release_kbnode(keyblock);
+    if (cidx) index_keyblock(cidx, keyblock);
+    batch.push_back(keyblock);
     keyblock = NULL;
+    if (batch.size() == VALIDATE_BATCH_KEYS)
+      consider_keyblocks(ctrl, batch, full_trust, klist, curtime, next_expire,
+                         &keys, &nkeys, &maxkeys);
   } while (!(rc = keydb_search(hd, &desc, 1, NULL)));
 
   if (rc && rc != GPG_ERR_NOT_FOUND) {
@@ -1462,10 +1638,14 @@ static struct key_array *validate_key_list(ctrl_t ctrl, KEYDB_HANDLE hd,
     goto die;
   }
 
+  consider_keyblocks(ctrl, batch, full_trust, klist, curtime, next_expire,
+                     &keys, &nkeys, &maxkeys);
+  if (cidx) cidx->complete = 1;
   keys[nkeys].keyblock = NULL;
   return keys;
 
 die:
+  for (auto kb : batch) release_kbnode(kb);
   keys[nkeys].keyblock = NULL;
   release_key_array(keys);
   return NULL;
@@ -1512,7 +1692,8 @@ static void reset_trust_records(ctrl_t ctrl) {
  * Step 2: loop max_cert_times
  * Step 3:   if OWNERTRUST of any key in klist is undefined
  *             ask user to assign ownertrust
- * Step 4:   Loop over all keys in the keyDB which are not marked seen
+ * Step 4:   Loop over all keys in the keyDB which are not marked seen;
+ *           after the first pass only those signed by a key in klist
  * Step 5:     if key is revoked or expired
  *                mark key as seen
  *                continue loop at Step 4
@@ -1539,6 +1720,7 @@ static int validate_keys(ctrl_t ctrl, int interactive) {
   int depth;
   int ot_unknown, ot_undefined, ot_never, ot_marginal, ot_full, ot_ultimate;
   KeyHashTable stored, used, full_trust;
+  struct cert_index cidx;
   u32 start_time, next_expire;
 
   kdb = keydb_new();
@@ -1652,9 +1834,14 @@ static int validate_keys(ctrl_t ctrl, int interactive) {
       valids++;
     }
 
-    /* Find all keys which are signed by a key in kdlist */
-    keys = validate_key_list(ctrl, kdb, full_trust, klist, start_time,
-                             &next_expire);
+    /* Find all keys which are signed by a key in kdlist.  Only the
+       first level needs to scan the keydb.  */
+    if (cidx.complete)
+      keys = validate_indexed_keys(ctrl, kdb, &cidx, full_trust, klist,
+                                   start_time, &next_expire);
+    else
+      keys = validate_key_list(ctrl, kdb, &cidx, full_trust, klist,
+                               start_time, &next_expire);
     if (!keys) {
       log_error("validate_key_list failed\n");
       rc = GPG_ERR_GENERAL;
@@ -132,6 +132,7 @@ static int verify_one_file(ctrl_t ctrl, const char *name) {
   print_file_status(STATUS_FILE_START, name, 1);
   fp = iobuf_open(name);
   if (fp) iobuf_ioctl(fp, IOBUF_IOCTL_NO_CACHE, 1, NULL);
+  if (fp && opt.async_io) iobuf_ioctl(fp, IOBUF_IOCTL_ASYNC, 1, NULL);
   if (fp && is_secured_file(iobuf_get_fd(fp))) {
     iobuf_close(fp);
     fp = NULL;
@@ -171,7 +171,6 @@ struct membuf {
 
 struct keyboxblob_key {
   char fpr[20];
-  u32 off_kid;
   unsigned long off_kid_addr;
   u16 flags;
 };
@@ -184,12 +183,6 @@ struct keyboxblob_uid {
   byte validity;
 };
 
-struct keyid_list {
-  struct keyid_list *next;
-  int seqno;
-  byte kid[8];
-};
-
 struct fixup_list {
   struct fixup_list *next;
   u32 off;
@@ -200,6 +193,7 @@ struct keyboxblob {
   byte *blob;
   size_t bloblen;
   off_t fileoffset;
+  int is_view; /* BLOB points into a file mapping and is not owned.  */
 
   /* stuff used only by keybox_create_blob */
   unsigned char *serialbuf;
@@ -214,7 +208,6 @@ struct keyboxblob {
   struct fixup_list *fixups;
   int fixup_out_of_core;
 
-  struct keyid_list *temp_kids;
   struct membuf bufbuf; /* temporary store for the blob */
   struct membuf *buf;
 };
@@ -305,109 +298,6 @@ static void add_fixup(KEYBOXBLOB blob, u32 off, u32 val) {
   }
 }
 
-/*
-  OpenPGP specific stuff
-*/
-
-/* We must store the keyid at some place because we can't calculate
-   the offset yet. This is only used for v3 keyIDs.  Function returns
-   an index value for later fixup or -1 for out of core.  The value
-   must be a non-zero value. */
-static int pgp_temp_store_kid(KEYBOXBLOB blob,
-                              struct _keybox_openpgp_key_info *kinfo) {
-  struct keyid_list *k, *r;
-
-  k = (keyid_list *)xtrymalloc(sizeof *k);
-  if (!k) return -1;
-  memcpy(k->kid, kinfo->keyid, 8);
-  k->seqno = 0;
-  k->next = blob->temp_kids;
-  blob->temp_kids = k;
-  for (r = k; r; r = r->next) k->seqno++;
-
-  return k->seqno;
-}
-
-/* Helper for pgp_create_key_part.  */
-static gpg_error_t pgp_create_key_part_single(
-    KEYBOXBLOB blob, int n, struct _keybox_openpgp_key_info *kinfo) {
-  size_t fprlen;
-  int off;
-
-  fprlen = kinfo->fprlen;
-  if (fprlen > 20) fprlen = 20;
-  memcpy(blob->keys[n].fpr, kinfo->fpr, fprlen);
-  if (fprlen != 20) /* v3 fpr - shift right and fill with zeroes. */
-  {
-    memmove(blob->keys[n].fpr + 20 - fprlen, blob->keys[n].fpr, fprlen);
-    memset(blob->keys[n].fpr, 0, 20 - fprlen);
-    off = pgp_temp_store_kid(blob, kinfo);
-    if (off == -1) return gpg_error_from_syserror();
-    blob->keys[n].off_kid = off;
-  } else
-    blob->keys[n].off_kid = 0; /* Will be fixed up later */
-  blob->keys[n].flags = 0;
-  return 0;
-}
-
-static gpg_error_t pgp_create_key_part(KEYBOXBLOB blob,
-                                       keybox_openpgp_info_t info) {
-  gpg_error_t err;
-  int n = 0;
-  struct _keybox_openpgp_key_info *kinfo;
-
-  err = pgp_create_key_part_single(blob, n++, &info->primary);
-  if (err) return err;
-  if (info->nsubkeys)
-    for (kinfo = &info->subkeys; kinfo; kinfo = kinfo->next)
-      if ((err = pgp_create_key_part_single(blob, n++, kinfo))) return err;
-
-  assert(n == blob->nkeys);
-  return 0;
-}
-
-static void pgp_create_uid_part(KEYBOXBLOB blob, keybox_openpgp_info_t info) {
-  int n = 0;
-  struct _keybox_openpgp_uid_info *u;
-
-  if (info->nuids) {
-    for (u = &info->uids; u; u = u->next) {
-      blob->uids[n].off = u->off;
-      blob->uids[n].len = u->len;
-      blob->uids[n].flags = 0;
-      blob->uids[n].validity = 0;
-      n++;
-    }
-  }
-
-  assert(n == blob->nuids);
-}
-
-static void pgp_create_sig_part(KEYBOXBLOB blob, u32 *sigstatus) {
-  int n;
-
-  for (n = 0; n < blob->nsigs; n++) {
-    blob->sigs[n] = sigstatus ? sigstatus[n + 1] : 0;
-  }
-}
-
-static int pgp_create_blob_keyblock(KEYBOXBLOB blob, const unsigned char *image,
-                                    size_t imagelen) {
-  struct membuf *a = blob->buf;
-  int n;
-  u32 kbstart = a->len;
-
-  add_fixup(blob, 8, kbstart);
-
-  for (n = 0; n < blob->nuids; n++)
-    add_fixup(blob, blob->uids[n].off_addr, kbstart + blob->uids[n].off);
-
-  put_membuf(a, image, imagelen);
-
-  add_fixup(blob, 12, a->len - kbstart);
-  return 0;
-}
-
 /*
    X.509 specific stuff
  */
@@ -430,29 +320,6 @@ static int x509_create_blob_cert(KEYBOXBLOB blob, ksba_cert_t cert) {
   return 0;
 }
 
-/* Write a stored keyID out to the buffer */
-static void write_stored_kid(KEYBOXBLOB blob, int seqno) {
-  struct keyid_list *r;
-
-  for (r = blob->temp_kids; r; r = r->next) {
-    if (r->seqno == seqno) {
-      put_membuf(blob->buf, r->kid, 8);
-      return;
-    }
-  }
-  never_reached();
-}
-
-/* Release a list of key IDs */
-static void release_kid_list(struct keyid_list *kl) {
-  struct keyid_list *r, *r2;
-
-  for (r = kl; r; r = r2) {
-    r2 = r->next;
-    xfree(r);
-  }
-}
-
 static int create_blob_header(KEYBOXBLOB blob, int blobtype, int as_ephemeral) {
   struct membuf *a = blob->buf;
   int i;
@@ -504,23 +371,6 @@ static int create_blob_header(KEYBOXBLOB blob, int blobtype, int as_ephemeral) {
   put32(a, 0);                /* size of reserved space */
   /* reserved space (which is currently of size 0) */
 
-  /* space where we write keyIDs and other stuff so that the
-     pointers can actually point to somewhere */
-  if (blobtype == KEYBOX_BLOBTYPE_PGP) {
-    /* We need to store the keyids for all pgp v3 keys because those key
-       IDs are not part of the fingerprint.  While we are doing that, we
-       fixup all the keyID offsets */
-    for (i = 0; i < blob->nkeys; i++) {
-      if (blob->keys[i].off_kid) { /* this is a v3 one */
-        add_fixup(blob, blob->keys[i].off_kid_addr, a->len);
-        write_stored_kid(blob, blob->keys[i].off_kid);
-      } else { /* the better v4 key IDs - just store an offset 8 bytes back */
-        add_fixup(blob, blob->keys[i].off_kid_addr,
-                  blob->keys[i].off_kid_addr - 8);
-      }
-    }
-  }
-
   if (blobtype == KEYBOX_BLOBTYPE_X509) {
     /* We don't want to point to ASN.1 encoded UserIDs (DNs) but to
        the utf-8 string represenation of them */
@@ -543,7 +393,6 @@ static int create_blob_trailer(KEYBOXBLOB blob) {
 static int create_blob_finish(KEYBOXBLOB blob) {
   struct membuf *a = blob->buf;
   unsigned char *p;
-  unsigned char *pp;
   size_t n;
 
   /* Write a placeholder for the checksum */
@@ -581,80 +430,140 @@ static int create_blob_finish(KEYBOXBLOB blob) {
   /* Compute and store the SHA-1 checksum. */
   gcry_md_hash_buffer(GCRY_MD_SHA1, p + n - 20, p, n - 20);
 
-  pp = (unsigned char *)xtrymalloc(n);
-  if (!pp) {
-    xfree(p);
-    return gpg_error_from_syserror();
-  }
-  memcpy(pp, p, n);
-  xfree(p);
-  blob->blob = pp;
+  blob->blob = p;
   blob->bloblen = n;
 
   return 0;
 }
 
+/*
+  OpenPGP specific stuff
+*/
+
+/* The length of the fixed size parts of an OpenPGP blob: the header
+   up to the key table, the empty serial number, the counts and record
+   sizes of the user ID and signature tables, the trailer and the
+   checksum.  */
+#define PGP_BLOB_FIXED_LEN (20 + 2 + 4 + 4 + 20 + 20)
+
+static unsigned char *store16(unsigned char *p, u16 a) {
+  p[0] = a >> 8;
+  p[1] = a;
+  return p + 2;
+}
+
+static unsigned char *store32(unsigned char *p, u32 a) {
+  p[0] = a >> 24;
+  p[1] = a >> 16;
+  p[2] = a >> 8;
+  p[3] = a;
+  return p + 4;
+}
+
+/* Return the key after K in INFO, or NULL.  */
+static struct _keybox_openpgp_key_info *next_key(
+    keybox_openpgp_info_t info, struct _keybox_openpgp_key_info *k) {
+  if (k == &info->primary) return info->nsubkeys ? &info->subkeys : NULL;
+  return k->next;
+}
+
+/* Create the blob for the OpenPGP keyblock {IMAGE,IMAGELEN}, which
+   has been parsed into INFO.  Unlike the X.509 blobs, which are built
+   through a membuf, the size of the blob is computed first and the
+   blob is written in one pass without any fixups.  */
 gpg_error_t _keybox_create_openpgp_blob(KEYBOXBLOB *r_blob,
                                         keybox_openpgp_info_t info,
                                         const unsigned char *image,
                                         size_t imagelen, int as_ephemeral) {
-  gpg_error_t err;
   KEYBOXBLOB blob;
+  struct _keybox_openpgp_key_info *k;
+  struct _keybox_openpgp_uid_info *u;
+  unsigned char *buffer, *p, *kids;
+  size_t nkeys, nv3, kbstart, n;
+  unsigned int i;
 
   *r_blob = NULL;
 
+  /* The key IDs of v3 keys are not part of the fingerprint and are
+     stored in front of the keyblock.  */
+  nkeys = 1 + info->nsubkeys;
+  nv3 = 0;
+  for (k = &info->primary; k; k = next_key(info, k))
+    if (k->fprlen != 20) nv3++;
+
+  kbstart = PGP_BLOB_FIXED_LEN - 20 + 28 * nkeys + 12 * (size_t)info->nuids +
+            4 * (size_t)info->nsigs + 8 * nv3;
+  n = kbstart + imagelen + 20;
+  if (n > 0xffffffff || n < imagelen) return GPG_ERR_TOO_LARGE;
+
   blob = (KEYBOXBLOB)xtrycalloc(1, sizeof *blob);
   if (!blob) return gpg_error_from_syserror();
-
-  blob->nkeys = 1 + info->nsubkeys;
-  blob->keys = (keyboxblob_key *)xtrycalloc(blob->nkeys, sizeof *blob->keys);
-  if (!blob->keys) {
-    err = gpg_error_from_syserror();
-    goto leave;
+  buffer = (unsigned char *)xtrymalloc(n);
+  if (!buffer) {
+    gpg_error_t err = gpg_error_from_syserror();
+    xfree(blob);
+    return err;
   }
 
-  blob->nuids = info->nuids;
-  if (blob->nuids) {
-    blob->uids = (keyboxblob_uid *)xtrycalloc(blob->nuids, sizeof *blob->uids);
-    if (!blob->uids) {
-      err = gpg_error_from_syserror();
-      goto leave;
-    }
+  p = store32(buffer, n);
+  *p++ = KEYBOX_BLOBTYPE_PGP;
+  *p++ = 1;                             /* blob type version */
+  p = store16(p, as_ephemeral ? 2 : 0); /* blob flags */
+  p = store32(p, kbstart);
+  p = store32(p, imagelen);
+
+  p = store16(p, nkeys);
+  p = store16(p, 20 + 4 + 2 + 2); /* size of key info */
+  kids = buffer + kbstart - 8 * nv3;
+  for (k = &info->primary; k; k = next_key(info, k)) {
+    size_t fprlen = k->fprlen > 20 ? 20 : k->fprlen;
+
+    /* v3 fingerprints are shifted right and filled with zeroes.  */
+    memset(p, 0, 20 - fprlen);
+    memcpy(p + 20 - fprlen, k->fpr, fprlen);
+    if (fprlen != 20) {
+      memcpy(kids, k->keyid, 8);
+      p = store32(p + 20, kids - buffer);
+      kids += 8;
+    } else /* The v4 key ID is the end of the fingerprint.  */
+      p = store32(p + 20, p + 12 - buffer);
+    p = store16(p, 0); /* key flags */
+    p = store16(p, 0); /* reserved */
   }
 
-  blob->nsigs = info->nsigs;
-  if (blob->nsigs) {
-    blob->sigs = (u32 *)xtrycalloc(blob->nsigs, sizeof *blob->sigs);
-    if (!blob->sigs) {
-      err = gpg_error_from_syserror();
-      goto leave;
-    }
+  p = store16(p, 0); /* no serial number */
+
+  p = store16(p, info->nuids);
+  p = store16(p, 4 + 4 + 2 + 1 + 1); /* size of uid info */
+  for (i = 0, u = &info->uids; i < info->nuids; i++, u = u->next) {
+    p = store32(p, kbstart + u->off);
+    p = store32(p, u->len);
+    p = store16(p, 0); /* user ID flags */
+    *p++ = 0;          /* validity */
+    *p++ = 0;          /* reserved */
   }
 
-  err = pgp_create_key_part(blob, info);
-  if (err) goto leave;
-  pgp_create_uid_part(blob, info);
-  pgp_create_sig_part(blob, NULL);
+  p = store16(p, info->nsigs);
+  p = store16(p, 4); /* size of sig info */
+  memset(p, 0, 4 * (size_t)info->nsigs); /* not yet checked */
+  p += 4 * (size_t)info->nsigs;
 
-  init_membuf(&blob->bufbuf, 1024);
-  blob->buf = &blob->bufbuf;
-  err = create_blob_header(blob, KEYBOX_BLOBTYPE_PGP, as_ephemeral);
-  if (err) goto leave;
-  err = pgp_create_blob_keyblock(blob, image, imagelen);
-  if (err) goto leave;
-  err = create_blob_trailer(blob);
-  if (err) goto leave;
-  err = create_blob_finish(blob);
-  if (err) goto leave;
+  *p++ = 0;                         /* assigned ownertrust */
+  *p++ = 0;                         /* validity of all user IDs */
+  p = store16(p, 0);                /* reserved */
+  p = store32(p, 0);                /* time of next recheck */
+  p = store32(p, 0);                /* newest timestamp (none) */
+  p = store32(p, make_timestamp()); /* creation time */
+  p = store32(p, 0);                /* size of reserved space */
+  assert(p + 8 * nv3 == buffer + kbstart);
 
-leave:
-  release_kid_list(blob->temp_kids);
-  blob->temp_kids = NULL;
-  if (err)
-    _keybox_release_blob(blob);
-  else
-    *r_blob = blob;
-  return err;
+  memcpy(buffer + kbstart, image, imagelen);
+  gcry_md_hash_buffer(GCRY_MD_SHA1, buffer + n - 20, buffer, n - 20);
+
+  blob->blob = buffer;
+  blob->bloblen = n;
+  *r_blob = blob;
+  return 0;
 }
 
 /* Return an allocated string with the email address extracted from a
@@ -774,7 +683,6 @@ int _keybox_create_x509_blob(KEYBOXBLOB *r_blob, ksba_cert_t cert,
   }
 
   memcpy(blob->keys[0].fpr, sha1_digest, 20);
-  blob->keys[0].off_kid = 0; /* We don't have keyids */
   blob->keys[0].flags = 0;
 
   /* issuer and subject names */
@@ -805,8 +713,6 @@ int _keybox_create_x509_blob(KEYBOXBLOB *r_blob, ksba_cert_t cert,
   if (rc) goto leave;
 
 leave:
-  release_kid_list(blob->temp_kids);
-  blob->temp_kids = NULL;
   if (names) {
     for (i = 0; i < blob->nuids; i++) xfree(names[i]);
     xfree(names);
@@ -835,6 +741,43 @@ int _keybox_new_blob(KEYBOXBLOB *r_blob, unsigned char *image, size_t imagelen,
   return 0;
 }
 
+/* Store a blob at R_BLOB which refers to {IMAGE,IMAGELEN} without
+   copying it.  If R_BLOB holds such a view already, it is reused, so
+   that a scan over a file mapping does not allocate for every blob.  */
+int _keybox_new_blob_view(KEYBOXBLOB *r_blob, const unsigned char *image,
+                          size_t imagelen, off_t off) {
+  KEYBOXBLOB blob = *r_blob;
+
+  if (!blob || !blob->is_view) {
+    _keybox_release_blob(blob);
+    *r_blob = NULL;
+    blob = (KEYBOXBLOB)xtrycalloc(1, sizeof *blob);
+    if (!blob) return gpg_error_from_syserror();
+    blob->is_view = 1;
+  }
+
+  blob->blob = (byte *)image;
+  blob->bloblen = imagelen;
+  blob->fileoffset = off;
+  *r_blob = blob;
+  return 0;
+}
+
+/* Make BLOB own a copy of its image, so that it stays valid after the
+   file mapping it refers to is gone.  */
+gpg_error_t _keybox_own_blob(KEYBOXBLOB blob) {
+  byte *image;
+
+  if (!blob->is_view) return 0;
+
+  image = (byte *)xtrymalloc(blob->bloblen);
+  if (!image) return gpg_error_from_syserror();
+  memcpy(image, blob->blob, blob->bloblen);
+  blob->blob = image;
+  blob->is_view = 0;
+  return 0;
+}
+
 void _keybox_release_blob(KEYBOXBLOB blob) {
   int i;
   if (!blob) return;
@@ -847,7 +790,7 @@ void _keybox_release_blob(KEYBOXBLOB blob) {
   for (i = 0; i < blob->nuids; i++) xfree(blob->uids[i].name);
   xfree(blob->uids);
   xfree(blob->sigs);
-  xfree(blob->blob);
+  if (!blob->is_view) xfree(blob->blob);
   xfree(blob);
 }
 
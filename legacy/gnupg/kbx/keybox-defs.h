@@ -37,6 +37,7 @@
 #include "keybox.h"
 
 typedef struct keyboxblob *KEYBOXBLOB;
+typedef struct keybox_index_s *keybox_index_t;
 
 typedef struct keybox_name *KB_NAME;
 struct keybox_name {
@@ -62,6 +63,13 @@ struct keybox_name {
   /* Not yet used.  */
   int did_full_scan;
 
+  /* True if appended blobs are not merged into the index (see
+     keybox_set_append_only).  APPENDED counts the appended blobs and
+     DEAD_BYTES the length of the blobs they replaced.  */
+  int append_only;
+  unsigned long appended;
+  off_t dead_bytes;
+
   /* The name of the resource file. */
   char fname[1];
 };
@@ -86,6 +94,18 @@ struct keybox_handle {
     char *name;
     char *pattern;
   } word_match;
+  /* The sidecar index, if it has been found valid for FP.  */
+  keybox_index_t index;
+  /* The file FP mapped into memory.  While IMAGE is set, POS is the
+     read position and the position of FP is not used.  */
+  struct {
+    unsigned char *image;
+    size_t size;
+    off_t pos;
+  } map;
+  /* If set, keybox_search stops with GPG_ERR_CANCELED once this is
+     true (see keybox_set_cancel).  */
+  const std::atomic<bool> *cancel;
 };
 
 /* Openpgp helper structures. */
@@ -140,6 +160,9 @@ int _keybox_create_x509_blob(KEYBOXBLOB *r_blob, ksba_cert_t cert,
 
 int _keybox_new_blob(KEYBOXBLOB *r_blob, unsigned char *image, size_t imagelen,
                      off_t off);
+int _keybox_new_blob_view(KEYBOXBLOB *r_blob, const unsigned char *image,
+                          size_t imagelen, off_t off);
+gpg_error_t _keybox_own_blob(KEYBOXBLOB blob);
 void _keybox_release_blob(KEYBOXBLOB blob);
 const unsigned char *_keybox_get_blob_image(KEYBOXBLOB blob, size_t *n);
 off_t _keybox_get_blob_fileoffset(KEYBOXBLOB blob);
@@ -152,12 +175,39 @@ void _keybox_destroy_openpgp_info(keybox_openpgp_info_t info);
 
 /*-- keybox-file.c --*/
 int _keybox_read_blob(KEYBOXBLOB *r_blob, FILE *fp, int *skipped_deleted);
+void _keybox_map_file(KEYBOX_HANDLE hd);
+void _keybox_unmap_file(KEYBOX_HANDLE hd);
+int _keybox_read_mapped_blob(KEYBOXBLOB *r_blob, const unsigned char *image,
+                             size_t size, off_t *r_pos, int *skipped_deleted);
 int _keybox_write_blob(KEYBOXBLOB blob, FILE *fp);
 
+/*-- keybox-index.c --*/
+int _keybox_index_check(const char *fname, FILE *fp);
+gpg_error_t _keybox_index_build(const char *fname);
+gpg_error_t _keybox_index_prepare(const char *fname, int have_index,
+                                  const char *newfname, off_t off,
+                                  KEYBOXBLOB oldblob, KEYBOXBLOB newblob,
+                                  char **r_tmpname);
+void _keybox_index_commit(const char *fname, char *tmpname, int ok);
+void _keybox_index_touch(const char *fname, int valid);
+void _keybox_index_append(const char *fname, int valid, off_t off,
+                          KEYBOXBLOB blob);
+gpg_error_t _keybox_index_merge_tail(const char *fname, int always);
+gpg_error_t _keybox_index_open(keybox_index_t *r_index, const char *fname,
+                               FILE *fp);
+void _keybox_index_close(keybox_index_t index);
+int _keybox_index_valid(keybox_index_t index, FILE *fp);
+int _keybox_index_usable(KEYBOX_SEARCH_DESC *desc);
+gpg_error_t _keybox_index_next(keybox_index_t index, KEYBOX_SEARCH_DESC *desc,
+                               off_t pos, off_t *r_offset);
+
 /*-- keybox-search.c --*/
 gpg_error_t _keybox_get_flag_location(const unsigned char *buffer,
                                       size_t length, int what, size_t *flag_off,
                                       size_t *flag_size);
+int _keybox_get_x509_keygrip(KEYBOXBLOB blob, unsigned char *grip);
+int _keybox_get_uid_mailbox(const unsigned char *uid, size_t len, int x509,
+                            size_t *r_off, size_t *r_len);
 
 static inline int blob_get_type(KEYBOXBLOB blob) {
   const unsigned char *buffer;
@@ -23,7 +23,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#ifndef HAVE_W32_SYSTEM
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
+#include "../common/host2net.h"
 #include "keybox-defs.h"
 
 #define IMAGELEN_LIMIT (5 * 1024 * 1024)
@@ -94,6 +100,109 @@ again:
   return rc;
 }
 
+/* Map the open file of HD into memory, or map it again if its size
+   has changed.  Searches then look at the blobs in place instead of
+   reading and allocating a copy of each one.  The keybox is only ever
+   replaced by a rename or changed in place, never truncated, so the
+   mapping stays valid as long as the file is open.  If the file can
+   not be mapped, blobs are read from HD->FP as before.  */
+void _keybox_map_file(KEYBOX_HANDLE hd) {
+#ifndef HAVE_W32_SYSTEM
+  struct stat st;
+  void *image;
+  off_t pos;
+
+  if (!hd->fp || fstat(fileno(hd->fp), &st)) return;
+  if (hd->map.image && (size_t)st.st_size == hd->map.size) return;
+
+  _keybox_unmap_file(hd);
+  if (!st.st_size || (uintmax_t)st.st_size > SIZE_MAX) return;
+  pos = ftello(hd->fp);
+  if (pos == (off_t)-1) return;
+
+  image = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(hd->fp), 0);
+  if (image == MAP_FAILED) return;
+
+  hd->map.image = (unsigned char *)image;
+  hd->map.size = st.st_size;
+  hd->map.pos = pos;
+#else
+  (void)hd;
+#endif
+}
+
+/* Release the mapping of HD, if any, and move the position of HD->FP
+   to where reading stopped.  */
+void _keybox_unmap_file(KEYBOX_HANDLE hd) {
+#ifndef HAVE_W32_SYSTEM
+  if (!hd->map.image) return;
+
+  if (hd->fp) fseeko(hd->fp, hd->map.pos, SEEK_SET);
+  munmap(hd->map.image, hd->map.size);
+  hd->map.image = NULL;
+  hd->map.size = 0;
+  hd->map.pos = 0;
+#else
+  (void)hd;
+#endif
+}
+
+/* Like _keybox_read_blob, but read the blob at *R_POS of the file
+   mapped at {IMAGE,SIZE} and advance *R_POS.  The blob stored at
+   R_BLOB is a view into the mapping, and a view passed in R_BLOB is
+   reused.  Use _keybox_own_blob to keep it beyond the next read.  */
+int _keybox_read_mapped_blob(KEYBOXBLOB *r_blob, const unsigned char *image,
+                             size_t size, off_t *r_pos, int *skipped_deleted) {
+  const unsigned char *p;
+  size_t imagelen, left;
+  off_t off;
+  int type;
+
+  if (skipped_deleted) *skipped_deleted = 0;
+again:
+  off = *r_pos;
+  if (off < 0 || (size_t)off >= size) return -1; /* eof */
+
+  left = size - off;
+  if (left < 5) {
+    *r_pos = size;
+    return GPG_ERR_TOO_SHORT;
+  }
+
+  p = image + off;
+  imagelen = buf32_to_size_t(p);
+  type = p[4];
+  if (imagelen < 5) {
+    *r_pos = off + 5;
+    return GPG_ERR_TOO_SHORT;
+  }
+
+  if (!type) {
+    /* Special treatment for empty blobs. */
+    *r_pos = off + imagelen;
+    if (skipped_deleted) *skipped_deleted = 1;
+    goto again;
+  }
+
+  if (imagelen > IMAGELEN_LIMIT) /* Sanity check. */
+  {
+    /* Seek forward so that the caller may choose to ignore this
+       record.  */
+    *r_pos = off + imagelen;
+    return GPG_ERR_TOO_LARGE;
+  }
+
+  if (imagelen > left) {
+    *r_pos = size;
+    return GPG_ERR_TOO_SHORT;
+  }
+
+  *r_pos = off + imagelen;
+  if (!r_blob) return 0; /* This blob shall be skipped.  */
+
+  return _keybox_new_blob_view(r_blob, p, imagelen, off);
+}
+
 /* Write the block to the current file position */
 int _keybox_write_blob(KEYBOXBLOB blob, FILE *fp) {
   const unsigned char *image;
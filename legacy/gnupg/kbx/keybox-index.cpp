@@ -0,0 +1,1568 @@
+/* keybox-index.c - Sidecar index for keybox files
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+* The index file format
+
+   keybox_search has to look at every blob of a keybox.  The index
+   file FNAME.idx next to the keybox FNAME allows to find the blobs
+   with a given fingerprint or key id by binary search, and those
+   which may match a user ID search with the help of a trigram index.
+   For X.509 blobs, the issuer, issuer and serial number, subject and
+   keygrip lookups done by gpgsm while walking a certificate chain are
+   answered by binary search in a table of name hashes.  The same
+   table holds the hashes of the lower cased mail addresses of all
+   user IDs, so that an exact mail search is a single lookup.
+   The index only gives candidates; keybox_search still reads and
+   compares every candidate blob, so stale entries (for example of
+   blobs deleted in place) do no harm.  Missing entries would, and
+   thus the index is only used if it was written for exactly the
+   keybox file found on disk.  All integers are stored in network
+   byte order.
+
+   - b4   Magic 'KBXi'
+   - u32  Version number (5, or 6 if only a part of the keybox is
+          indexed).  Versions 1 to 4 lack the name table or its mail
+          records and are rebuilt.
+   - uint64_t  Size of the keybox file
+   - uint64_t  Modification time of the keybox file
+   - uint64_t  Inode number of the keybox file
+   - u32  NBLOBS, the number of indexed blobs
+   - u32  NFPRS, the number of fingerprint records
+   - u32  NKIDS, the number of key id records
+   - u32  NTRIGRAMS, the number of trigram records
+   - uint64_t  Length of the posting lists
+   - uint64_t  Version 6: the length of the indexed part of the keybox
+               file.  The blobs behind it have been appended since.
+               Version 5: RFU
+   - u32  NNAMES, the number of name records
+   - b4   RFU
+   - NBLOBS times:
+     - uint64_t  File offset of the blob.  The blobs are numbered in file
+            order; these numbers are used by the other tables.
+   - NFPRS times, sorted:
+     - b20  Fingerprint
+     - u32  Blob number
+   - NKIDS times, sorted:
+     - b4   Low 32 bits of the key id
+     - b4   High 32 bits of the key id
+     - u32  Blob number
+   - NNAMES times, sorted:
+     - b8   The first 8 bytes of the SHA-1 hash of a tag byte and the
+            looked up data: 'I' and the issuer, 'S' and the issuer, a
+            Nul and the serial number, 's' and the subject, 'g' and
+            the keygrip, or 'm' and a lower cased mail address
+     - u32  Blob number
+   - NTRIGRAMS times, sorted:
+     - u32  Trigram of lower cased user ID characters
+     - u32  Number of blobs in the posting list
+     - uint64_t  Offset of the posting list
+   - The posting lists: ascending blob numbers, each stored as the
+     difference to the previous one in 7 bit groups, least significant
+     group first, with the high bit set on all but the last group.
+
+   Updates of a keybox through blob_filecopy write a new index for the
+   new keybox file and rename it into place after the keybox.  If the
+   process dies in between, the old index does not match the new
+   keybox file and is ignored.  Updates in place, which only delete
+   blobs or change flags, just update the file identity.
+
+   Inserted and updated OpenPGP blobs are appended to the keybox
+   without updating the index.  The index then only covers the start
+   of the file and all blobs behind it are returned as candidates.
+   The process doing the appends remembers the keys of the appended
+   blobs, so that its own searches still don't have to read all of
+   them.  Once the tail grows too large, it is scanned and merged into
+   the index (see _keybox_index_merge_tail).  The version number makes
+   sure that older versions ignore such an index.  */
+
+#include <config.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <gcrypt.h>
+#include "../common/host2net.h"
+#include "../common/sysutils.h"
+#include "keybox-defs.h"
+
+#define get32(a) buf32_to_ulong((a))
+#define get16(a) buf16_to_ulong((a))
+
+#define INDEX_SUFFIX ".idx"
+#define INDEX_HEADER_LEN 72
+#define FPR_RECORD_LEN 24
+#define KID_RECORD_LEN 12
+#define NAME_RECORD_LEN 12
+#define TRIGRAM_RECORD_LEN 16
+
+/* The length of the unindexed tail of a keybox up to which it is not
+   merged into the index, see _keybox_index_merge_tail.  */
+#define MAX_TAIL_LEN (1024 * 1024)
+
+/* The identity of a keybox file, to detect whether an index belongs
+   to it.  */
+struct file_identity_s {
+  uint64_t size;
+  uint64_t mtime;
+  uint64_t inode;
+};
+
+struct fpr_record_s {
+  unsigned char key[20];
+  u32 blobno;
+};
+
+struct kid_record_s {
+  unsigned char key[8];
+  u32 blobno;
+};
+
+struct name_record_s {
+  unsigned char key[8];
+  u32 blobno;
+};
+
+/* The complete index in memory, used to create or update it.  */
+struct index_data_s {
+  std::vector<uint64_t> blobs;
+  std::vector<fpr_record_s> fprs;
+  std::vector<kid_record_s> kids;
+  std::vector<name_record_s> names;
+  /* The encoded posting list and its last blob number by trigram.  */
+  std::map<u32, std::pair<std::string, u32> > postings;
+};
+
+/* An open index used for searching.  */
+struct keybox_index_s {
+  FILE *fp;
+  struct file_identity_s identity;
+  /* The length of the indexed part of the keybox, or 0 if all of it
+     is indexed.  */
+  uint64_t covered;
+  u32 nblobs, nfprs, nkids, nnames, ntrigrams;
+  uint64_t postings_len;
+  off_t blobs_off, fprs_off, kids_off, names_off, trigrams_off, postings_off;
+
+  /* The name of the index file.  */
+  std::string name;
+
+  /* The decoded posting list of the last trigram looked up.  */
+  int have_cached;
+  u32 cached_trigram;
+  std::vector<u32> cached_list;
+};
+
+/* The blobs appended by this process behind the indexed part of a
+   keybox, see _keybox_index_append.  */
+struct index_tail_s {
+  /* The identity of the keybox file after the last append.  */
+  struct file_identity_s identity;
+  uint64_t covered;
+  /* The file offsets of the blobs, in ascending order.  */
+  std::vector<uint64_t> blobs;
+  /* The file offsets by fingerprint, by key id, the latter with the
+     low part first as in the index, and by name hash.  */
+  std::multimap<std::string, uint64_t> fprs;
+  std::multimap<std::string, uint64_t> kids;
+  std::multimap<std::string, uint64_t> names;
+};
+
+/* The tails by the name of the index file.  */
+static std::map<std::string, index_tail_s> index_tails;
+
+static void put32(unsigned char *p, u32 val) {
+  p[0] = val >> 24;
+  p[1] = val >> 16;
+  p[2] = val >> 8;
+  p[3] = val;
+}
+
+static void put64(unsigned char *p, uint64_t val) {
+  put32(p, (u32)(val >> 32));
+  put32(p + 4, (u32)val);
+}
+
+static uint64_t get64(const unsigned char *p) {
+  return ((uint64_t)buf32_to_u32(p) << 32) | buf32_to_u32(p + 4);
+}
+
+static std::string index_name(const char *fname) {
+  return std::string(fname) + INDEX_SUFFIX;
+}
+
+static void get_identity(const struct stat *st, struct file_identity_s *id) {
+  id->size = st->st_size;
+  id->mtime = st->st_mtime;
+  id->inode = st->st_ino;
+}
+
+static int same_identity(const struct file_identity_s *a,
+                         const struct file_identity_s *b) {
+  return (a->size == b->size && a->mtime == b->mtime && a->inode == b->inode);
+}
+
+static int read_at(FILE *fp, off_t off, void *buffer, size_t length) {
+  if (fseeko(fp, off, SEEK_SET)) return -1;
+  if (fread(buffer, length, 1, fp) != 1) return -1;
+  return 0;
+}
+
+/*
+   Extracting the indexed data from a blob.
+*/
+
+/* Call FNC for the fingerprint of every key in the blob.  */
+template <typename F>
+static void for_each_fpr(const unsigned char *buffer, size_t length, F fnc) {
+  size_t nkeys, keyinfolen, idx;
+
+  if (length < 40) return;
+  nkeys = get16(buffer + 16);
+  keyinfolen = get16(buffer + 18);
+  if (keyinfolen < 28) return;
+  if (20 + keyinfolen * nkeys > length) return;
+
+  for (idx = 0; idx < nkeys; idx++) fnc(buffer + 20 + idx * keyinfolen);
+}
+
+/* Call FNC with the start and length of every user ID in the blob
+   (for X.509 including the issuer).  */
+template <typename F>
+static void for_each_uid(const unsigned char *buffer, size_t length, F fnc) {
+  size_t pos, off, len;
+  size_t nkeys, keyinfolen;
+  size_t nuids, uidinfolen;
+  size_t nserial, idx;
+
+  if (length < 40) return;
+  nkeys = get16(buffer + 16);
+  keyinfolen = get16(buffer + 18);
+  if (keyinfolen < 28) return;
+  pos = 20 + keyinfolen * nkeys;
+  if (pos + 2 > length) return;
+
+  nserial = get16(buffer + pos);
+  pos += 2 + nserial;
+  if (pos + 4 > length) return;
+
+  nuids = get16(buffer + pos);
+  pos += 2;
+  uidinfolen = get16(buffer + pos);
+  pos += 2;
+  if (uidinfolen < 12) return;
+  if (pos + uidinfolen * nuids > length) return;
+
+  for (idx = 0; idx < nuids; idx++) {
+    off = get32(buffer + pos + idx * uidinfolen);
+    len = get32(buffer + pos + idx * uidinfolen + 4);
+    if (off + len > length) return;
+    fnc(buffer + off, len);
+  }
+}
+
+static u32 make_trigram(const unsigned char *p) {
+  return (((u32)ascii_tolower(p[0]) << 16) | ((u32)ascii_tolower(p[1]) << 8) |
+          (u32)ascii_tolower(p[2]));
+}
+
+/* Store the sorted trigrams of all user IDs in BLOB at TRIGRAMS.  */
+static void blob_trigrams(KEYBOXBLOB blob, std::vector<u32> &trigrams) {
+  const unsigned char *buffer;
+  size_t length;
+
+  trigrams.clear();
+  buffer = _keybox_get_blob_image(blob, &length);
+  for_each_uid(buffer, length, [&](const unsigned char *name, size_t len) {
+    size_t i;
+
+    for (i = 0; i + 3 <= len; i++) trigrams.push_back(make_trigram(name + i));
+  });
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+}
+
+/* Store the name hash of TAG, DATA of LENGTH bytes and, if EXTRA is
+   not NULL, a Nul and EXTRA of EXTRALEN bytes at KEY.  */
+static void make_name_key(unsigned char *key, char tag, const void *data,
+                          size_t length, const void *extra = NULL,
+                          size_t extralen = 0) {
+  unsigned char digest[20];
+  std::string buffer(1, tag);
+
+  buffer.append((const char *)data, length);
+  if (extra) {
+    buffer += '\0';
+    buffer.append((const char *)extra, extralen);
+  }
+  gcry_md_hash_buffer(GCRY_MD_SHA1, digest, buffer.data(), buffer.size());
+  memcpy(key, digest, 8);
+}
+
+/* Store the name hash of the mail address MBOX of LENGTH bytes at
+   KEY.  Mail addresses are compared case insensitive.  */
+static void make_mail_key(unsigned char *key, const void *mbox,
+                          size_t length) {
+  std::string buffer((const char *)mbox, length);
+
+  for (char &c : buffer) c = ascii_tolower(c);
+  make_name_key(key, 'm', buffer.data(), buffer.size());
+}
+
+/* Call FNC with the name hash of every mail address in BLOB (see
+   has_mail in keybox-search.c), and for X.509 of every lookup by
+   issuer, issuer and serial number, subject and keygrip which may
+   find BLOB.  */
+template <typename F>
+static void for_each_name(KEYBOXBLOB blob, F fnc) {
+  const unsigned char *buffer;
+  const unsigned char *serial = NULL;
+  size_t length, pos, nserial = 0;
+  unsigned char key[8];
+  unsigned char grip[20];
+  int x509, idx = 0;
+
+  x509 = blob_get_type(blob) == KEYBOX_BLOBTYPE_X509;
+  if (!x509 && blob_get_type(blob) != KEYBOX_BLOBTYPE_PGP) return;
+  buffer = _keybox_get_blob_image(blob, &length);
+  if (length < 40) return;
+
+  for_each_uid(buffer, length, [&](const unsigned char *name, size_t len) {
+    size_t off;
+
+    /* The first name of an X.509 blob is the issuer.  */
+    if ((!x509 || idx++) &&
+        _keybox_get_uid_mailbox(name, len, x509, &off, &len)) {
+      make_mail_key(key, name + off, len);
+      fnc(key);
+      /* X.509 searches don't strip a leading angle bracket, which
+         index_name_key always does.  */
+      if (x509 && len > 1 && name[off] == '<') {
+        make_mail_key(key, name + off + 1, len - 1);
+        fnc(key);
+      }
+    }
+  });
+  if (!x509) return;
+  idx = 0;
+
+  pos = 20 + get16(buffer + 18) * get16(buffer + 16);
+  if (pos + 2 <= length && pos + 2 + get16(buffer + pos) <= length) {
+    nserial = get16(buffer + pos);
+    serial = buffer + pos + 2;
+  }
+
+  /* The issuer comes first, then the subject.  Empty names never
+     match.  */
+  for_each_uid(buffer, length, [&](const unsigned char *name, size_t len) {
+    if (len && idx == 0) {
+      make_name_key(key, 'I', name, len);
+      fnc(key);
+      if (serial) {
+        make_name_key(key, 'S', name, len, serial, nserial);
+        fnc(key);
+      }
+    } else if (len && idx == 1) {
+      make_name_key(key, 's', name, len);
+      fnc(key);
+    }
+    idx++;
+  });
+
+  if (!_keybox_get_x509_keygrip(blob, grip)) {
+    make_name_key(key, 'g', grip, 20);
+    fnc(key);
+  }
+}
+
+static bool fpr_less(const fpr_record_s &a, const fpr_record_s &b) {
+  int cmp = memcmp(a.key, b.key, sizeof a.key);
+  return cmp < 0 || (!cmp && a.blobno < b.blobno);
+}
+
+static bool kid_less(const kid_record_s &a, const kid_record_s &b) {
+  int cmp = memcmp(a.key, b.key, sizeof a.key);
+  return cmp < 0 || (!cmp && a.blobno < b.blobno);
+}
+
+static bool name_less(const name_record_s &a, const name_record_s &b) {
+  int cmp = memcmp(a.key, b.key, sizeof a.key);
+  return cmp < 0 || (!cmp && a.blobno < b.blobno);
+}
+
+static void sort_keys(index_data_s &data) {
+  std::sort(data.fprs.begin(), data.fprs.end(), fpr_less);
+  std::sort(data.kids.begin(), data.kids.end(), kid_less);
+  std::sort(data.names.begin(), data.names.end(), name_less);
+}
+
+/* Add the fingerprints, key ids and name hashes of BLOB as blob
+   number BLOBNO to DATA, without sorting.  */
+static void add_keys(index_data_s &data, KEYBOXBLOB blob, u32 blobno) {
+  const unsigned char *buffer;
+  size_t length;
+
+  buffer = _keybox_get_blob_image(blob, &length);
+  for_each_fpr(buffer, length, [&](const unsigned char *fpr) {
+    fpr_record_s f;
+    kid_record_s k;
+
+    memcpy(f.key, fpr, 20);
+    f.blobno = blobno;
+    data.fprs.push_back(f);
+
+    /* The key id are the last 8 bytes of the fingerprint field (see
+       has_long_kid).  The low part comes first to allow searching
+       for short key ids.  */
+    memcpy(k.key, fpr + 16, 4);
+    memcpy(k.key + 4, fpr + 12, 4);
+    k.blobno = blobno;
+    data.kids.push_back(k);
+  });
+  for_each_name(blob, [&](const unsigned char *key) {
+    name_record_s r;
+
+    memcpy(r.key, key, 8);
+    r.blobno = blobno;
+    data.names.push_back(r);
+  });
+}
+
+static void encode_number(std::string &out, u32 val) {
+  while (val >= 0x80) {
+    out += (char)((val & 0x7f) | 0x80);
+    val >>= 7;
+  }
+  out += (char)val;
+}
+
+static void encode_list(std::pair<std::string, u32> &list,
+                        const std::vector<u32> &blobnos) {
+  u32 last = 0;
+
+  list.first.clear();
+  for (u32 blobno : blobnos) {
+    encode_number(list.first, blobno - last);
+    last = blobno;
+  }
+  list.second = last;
+}
+
+/* Return the number of blob numbers in the posting list LIST.  Every
+   number ends with a byte which has the high bit cleared.  */
+static u32 list_count(const std::pair<std::string, u32> &list) {
+  u32 count = 0;
+
+  for (char c : list.first)
+    if (!(c & 0x80)) count++;
+  return count;
+}
+
+static int decode_list(const unsigned char *p, size_t length, u32 count,
+                       std::vector<u32> &blobnos) {
+  const unsigned char *end = p + length;
+  u32 last = 0;
+
+  blobnos.clear();
+  while (count--) {
+    u32 val = 0;
+    int shift = 0;
+
+    do {
+      if (p == end || shift > 28) return -1;
+      val |= (u32)(*p & 0x7f) << shift;
+      shift += 7;
+    } while (*p++ & 0x80);
+    last += val;
+    blobnos.push_back(last);
+  }
+  return 0;
+}
+
+/* Decode the complete posting list LIST into BLOBNOS.  */
+static void decode_all(const std::pair<std::string, u32> &list,
+                       std::vector<u32> &blobnos) {
+  const unsigned char *p = (const unsigned char *)list.first.data();
+
+  decode_list(p, list.first.size(), list_count(list), blobnos);
+}
+
+/* Append BLOBNO, which must be larger than all blob numbers in DATA,
+   to the posting lists of TRIGRAMS.  */
+static void add_postings(index_data_s &data, const std::vector<u32> &trigrams,
+                         u32 blobno) {
+  for (u32 trigram : trigrams) {
+    auto &list = data.postings[trigram];
+
+    encode_number(list.first, blobno - list.second);
+    list.second = blobno;
+  }
+}
+
+/* Read the keybox FNAME from file offset START on and add the blobs
+   to its index in DATA.  */
+static gpg_error_t scan_keybox(const char *fname, index_data_s &data,
+                               off_t start) {
+  gpg_error_t err;
+  FILE *fp;
+  KEYBOXBLOB blob = NULL;
+  std::vector<u32> trigrams;
+
+  fp = fopen(fname, "rb");
+  if (!fp) return gpg_error_from_syserror();
+  if (start && fseeko(fp, start, SEEK_SET)) {
+    err = gpg_error_from_syserror();
+    fclose(fp);
+    return err;
+  }
+
+  for (;;) {
+    err = _keybox_read_blob(&blob, fp, NULL);
+    if (err == GPG_ERR_TOO_LARGE) continue; /* Never found by a search.  */
+    if (err) break;
+
+    if (blob_get_type(blob) != KEYBOX_BLOBTYPE_HEADER) {
+      u32 blobno = data.blobs.size();
+
+      data.blobs.push_back(_keybox_get_blob_fileoffset(blob));
+      add_keys(data, blob, blobno);
+      blob_trigrams(blob, trigrams);
+      add_postings(data, trigrams, blobno);
+    }
+    _keybox_release_blob(blob);
+    blob = NULL;
+  }
+  fclose(fp);
+  if (err != -1) return err;
+
+  sort_keys(data);
+  return 0;
+}
+
+/* Read the header of the index file FP.  */
+static gpg_error_t read_header(FILE *fp, keybox_index_s *index) {
+  unsigned char header[INDEX_HEADER_LEN];
+
+  if (read_at(fp, 0, header, sizeof header)) return GPG_ERR_TOO_SHORT;
+  if (memcmp(header, "KBXi", 4) ||
+      (get32(header + 4) != 5 && get32(header + 4) != 6))
+    return GPG_ERR_INV_OBJ;
+
+  index->identity.size = get64(header + 8);
+  index->identity.mtime = get64(header + 16);
+  index->identity.inode = get64(header + 24);
+  index->nblobs = get32(header + 32);
+  index->nfprs = get32(header + 36);
+  index->nkids = get32(header + 40);
+  index->ntrigrams = get32(header + 44);
+  index->postings_len = get64(header + 48);
+  index->covered = get32(header + 4) == 6 ? get64(header + 56) : 0;
+  if (get32(header + 4) == 6 && !index->covered) return GPG_ERR_INV_OBJ;
+  index->nnames = get32(header + 64);
+
+  index->blobs_off = INDEX_HEADER_LEN;
+  index->fprs_off = index->blobs_off + (off_t)8 * index->nblobs;
+  index->kids_off = index->fprs_off + (off_t)FPR_RECORD_LEN * index->nfprs;
+  index->names_off = index->kids_off + (off_t)KID_RECORD_LEN * index->nkids;
+  index->trigrams_off =
+      index->names_off + (off_t)NAME_RECORD_LEN * index->nnames;
+  index->postings_off =
+      index->trigrams_off + (off_t)TRIGRAM_RECORD_LEN * index->ntrigrams;
+  return 0;
+}
+
+/* Read LENGTH bytes at OFF of FP into BUFFER.  */
+static int read_block(FILE *fp, off_t off, std::vector<unsigned char> &buffer,
+                      size_t length) {
+  buffer.resize(length);
+  if (!length) return 0;
+  return read_at(fp, off, buffer.data(), length);
+}
+
+/* Read the complete index file FP into DATA.  A partial index is
+   only accepted if R_COVERED is not NULL; the length of the indexed
+   part of the keybox, or 0, is then stored there.  */
+static gpg_error_t load_index(FILE *fp, index_data_s &data,
+                              uint64_t *r_covered) {
+  keybox_index_s index;
+  std::vector<unsigned char> buffer;
+  std::vector<unsigned char> postings;
+  std::vector<u32> blobnos;
+  gpg_error_t err;
+  size_t i;
+
+  err = read_header(fp, &index);
+  if (err) return err;
+  if (r_covered)
+    *r_covered = index.covered;
+  else if (index.covered)
+    return GPG_ERR_NOT_SUPPORTED;
+
+  if (read_block(fp, index.blobs_off, buffer, (size_t)8 * index.nblobs))
+    return GPG_ERR_TOO_SHORT;
+  data.blobs.resize(index.nblobs);
+  for (i = 0; i < index.nblobs; i++) data.blobs[i] = get64(&buffer[8 * i]);
+
+  if (read_block(fp, index.fprs_off, buffer,
+                 (size_t)FPR_RECORD_LEN * index.nfprs))
+    return GPG_ERR_TOO_SHORT;
+  data.fprs.resize(index.nfprs);
+  for (i = 0; i < index.nfprs; i++) {
+    memcpy(data.fprs[i].key, &buffer[FPR_RECORD_LEN * i], 20);
+    data.fprs[i].blobno = get32(&buffer[FPR_RECORD_LEN * i + 20]);
+  }
+
+  if (read_block(fp, index.kids_off, buffer,
+                 (size_t)KID_RECORD_LEN * index.nkids))
+    return GPG_ERR_TOO_SHORT;
+  data.kids.resize(index.nkids);
+  for (i = 0; i < index.nkids; i++) {
+    memcpy(data.kids[i].key, &buffer[KID_RECORD_LEN * i], 8);
+    data.kids[i].blobno = get32(&buffer[KID_RECORD_LEN * i + 8]);
+  }
+
+  if (read_block(fp, index.names_off, buffer,
+                 (size_t)NAME_RECORD_LEN * index.nnames))
+    return GPG_ERR_TOO_SHORT;
+  data.names.resize(index.nnames);
+  for (i = 0; i < index.nnames; i++) {
+    memcpy(data.names[i].key, &buffer[NAME_RECORD_LEN * i], 8);
+    data.names[i].blobno = get32(&buffer[NAME_RECORD_LEN * i + 8]);
+  }
+
+  if (read_block(fp, index.trigrams_off, buffer,
+                 (size_t)TRIGRAM_RECORD_LEN * index.ntrigrams) ||
+      read_block(fp, index.postings_off, postings, index.postings_len))
+    return GPG_ERR_TOO_SHORT;
+  for (i = 0; i < index.ntrigrams; i++) {
+    const unsigned char *rec = &buffer[TRIGRAM_RECORD_LEN * i];
+    uint64_t off = get64(rec + 8);
+
+    if (off > index.postings_len ||
+        decode_list(postings.data() + off, index.postings_len - off,
+                    get32(rec + 4), blobnos))
+      return GPG_ERR_INV_OBJ;
+    encode_list(data.postings[get32(rec)], blobnos);
+  }
+  return 0;
+}
+
+/* Write DATA for a keybox with identity ID to the file TMPNAME.  */
+static gpg_error_t write_index(const std::string &tmpname,
+                               const struct file_identity_s *id,
+                               const index_data_s &data) {
+  unsigned char header[INDEX_HEADER_LEN];
+  std::vector<unsigned char> buffer;
+  std::vector<u32> counts;
+  uint64_t postings_len;
+  size_t i;
+  FILE *fp;
+  int ok;
+
+  counts.reserve(data.postings.size());
+  postings_len = 0;
+  for (const auto &item : data.postings) {
+    counts.push_back(list_count(item.second));
+    postings_len += item.second.first.size();
+  }
+
+  memset(header, 0, sizeof header);
+  memcpy(header, "KBXi", 4);
+  put32(header + 4, 5);
+  put64(header + 8, id->size);
+  put64(header + 16, id->mtime);
+  put64(header + 24, id->inode);
+  put32(header + 32, data.blobs.size());
+  put32(header + 36, data.fprs.size());
+  put32(header + 40, data.kids.size());
+  put32(header + 44, data.postings.size());
+  put64(header + 48, postings_len);
+  put32(header + 64, data.names.size());
+
+  fp = fopen(tmpname.c_str(), "wb");
+  if (!fp) return gpg_error_from_syserror();
+
+  ok = fwrite(header, sizeof header, 1, fp) == 1;
+  for (uint64_t off : data.blobs) {
+    unsigned char rec[8];
+
+    put64(rec, off);
+    ok = ok && fwrite(rec, sizeof rec, 1, fp) == 1;
+  }
+  for (const auto &f : data.fprs) {
+    unsigned char rec[FPR_RECORD_LEN];
+
+    memcpy(rec, f.key, 20);
+    put32(rec + 20, f.blobno);
+    ok = ok && fwrite(rec, sizeof rec, 1, fp) == 1;
+  }
+  for (const auto &k : data.kids) {
+    unsigned char rec[KID_RECORD_LEN];
+
+    memcpy(rec, k.key, 8);
+    put32(rec + 8, k.blobno);
+    ok = ok && fwrite(rec, sizeof rec, 1, fp) == 1;
+  }
+  for (const auto &r : data.names) {
+    unsigned char rec[NAME_RECORD_LEN];
+
+    memcpy(rec, r.key, 8);
+    put32(rec + 8, r.blobno);
+    ok = ok && fwrite(rec, sizeof rec, 1, fp) == 1;
+  }
+  postings_len = 0;
+  i = 0;
+  for (const auto &item : data.postings) {
+    unsigned char rec[TRIGRAM_RECORD_LEN];
+
+    put32(rec, item.first);
+    put32(rec + 4, counts[i++]);
+    put64(rec + 8, postings_len);
+    ok = ok && fwrite(rec, sizeof rec, 1, fp) == 1;
+    postings_len += item.second.first.size();
+  }
+  for (const auto &item : data.postings)
+    ok = ok && (item.second.first.empty() ||
+                fwrite(item.second.first.data(), item.second.first.size(), 1,
+                       fp) == 1);
+
+  if (fclose(fp)) ok = 0;
+  if (!ok) {
+    gpg_error_t err = gpg_error_from_syserror();
+    gnupg_remove(tmpname.c_str());
+    return err ? err : GPG_ERR_GENERAL;
+  }
+  return 0;
+}
+
+/* Return true if the index of FNAME belongs to the keybox file open
+   at FP.  */
+int _keybox_index_check(const char *fname, FILE *fp) {
+  keybox_index_s index;
+  struct file_identity_s id;
+  struct stat st;
+  FILE *idxfp;
+  int valid;
+
+  if (fstat(fileno(fp), &st)) return 0;
+  get_identity(&st, &id);
+
+  idxfp = fopen(index_name(fname).c_str(), "rb");
+  if (!idxfp) return 0;
+  valid = !read_header(idxfp, &index) && same_identity(&index.identity, &id);
+  fclose(idxfp);
+  return valid;
+}
+
+/* Create the index for the keybox FNAME.  */
+gpg_error_t _keybox_index_build(const char *fname) {
+  gpg_error_t err;
+  index_data_s data;
+  struct file_identity_s id, now;
+  struct stat st;
+  std::string name = index_name(fname);
+  std::string tmpname = name + ".tmp";
+
+  if (stat(fname, &st)) return gpg_error_from_syserror();
+  get_identity(&st, &id);
+
+  err = scan_keybox(fname, data, 0);
+  if (err) return err;
+
+  /* Don't write an index for a keybox changed while scanning.  */
+  if (stat(fname, &st)) return gpg_error_from_syserror();
+  get_identity(&st, &now);
+  if (!same_identity(&now, &id)) return GPG_ERR_EAGAIN;
+
+  err = write_index(tmpname, &id, data);
+  if (!err) err = gnupg_rename_file(tmpname.c_str(), name.c_str());
+  if (err) gnupg_remove(tmpname.c_str());
+  index_tails.erase(name);
+  return err;
+}
+
+/* Prepare the index for the new keybox file NEWFNAME, which results
+   from replacing the blob OLDBLOB at file offset OFF of the keybox
+   FNAME by NEWBLOB.  OLDBLOB is NULL for an insertion at the end and
+   NEWBLOB is NULL for a deletion.  If HAVE_INDEX is false, the old
+   index is not valid and a new one is built from NEWFNAME.  On
+   success the name of the new index file is stored at R_TMPNAME, to
+   be passed to _keybox_index_commit after NEWFNAME has been renamed
+   to FNAME.  */
+gpg_error_t _keybox_index_prepare(const char *fname, int have_index,
+                                  const char *newfname, off_t off,
+                                  KEYBOXBLOB oldblob, KEYBOXBLOB newblob,
+                                  char **r_tmpname) {
+  gpg_error_t err;
+  index_data_s data;
+  struct file_identity_s id;
+  struct stat st;
+  std::string name = index_name(fname);
+  std::string tmpname = name + ".tmp";
+  std::vector<u32> old_trigrams, new_trigrams;
+  u32 blobno;
+
+  *r_tmpname = NULL;
+  if (stat(newfname, &st)) return gpg_error_from_syserror();
+  get_identity(&st, &id);
+
+  if (have_index) {
+    FILE *fp = fopen(name.c_str(), "rb");
+
+    if (!fp) return gpg_error_from_syserror();
+    err = load_index(fp, data, NULL);
+    fclose(fp);
+    if (err) have_index = 0;
+  }
+
+  if (have_index && oldblob) {
+    /* Find the number of the replaced blob.  */
+    auto it = std::lower_bound(data.blobs.begin(), data.blobs.end(),
+                               (uint64_t)off);
+    if (it == data.blobs.end() || *it != (uint64_t)off) have_index = 0;
+  }
+
+  if (!have_index) {
+    data = index_data_s();
+    err = scan_keybox(newfname, data, 0);
+  } else if (!oldblob) {
+    /* Insertion at the end: the new blob gets the next number.  */
+    blobno = data.blobs.size();
+    data.blobs.push_back(off);
+    add_keys(data, newblob, blobno);
+    sort_keys(data);
+    blob_trigrams(newblob, new_trigrams);
+    add_postings(data, new_trigrams, blobno);
+    err = 0;
+  } else {
+    size_t oldlen, newlen = 0;
+    std::vector<u32> blobnos;
+    size_t i;
+
+    blobno = std::lower_bound(data.blobs.begin(), data.blobs.end(),
+                              (uint64_t)off) -
+             data.blobs.begin();
+    _keybox_get_blob_image(oldblob, &oldlen);
+    if (newblob) _keybox_get_blob_image(newblob, &newlen);
+
+    /* The blob keeps its number; the following blobs move.  */
+    for (i = blobno + 1; i < data.blobs.size(); i++)
+      data.blobs[i] = data.blobs[i] - oldlen + newlen;
+
+    data.fprs.erase(std::remove_if(data.fprs.begin(), data.fprs.end(),
+                                   [blobno](const fpr_record_s &f) {
+                                     return f.blobno == blobno;
+                                   }),
+                    data.fprs.end());
+    data.kids.erase(std::remove_if(data.kids.begin(), data.kids.end(),
+                                   [blobno](const kid_record_s &k) {
+                                     return k.blobno == blobno;
+                                   }),
+                    data.kids.end());
+    data.names.erase(std::remove_if(data.names.begin(), data.names.end(),
+                                    [blobno](const name_record_s &r) {
+                                      return r.blobno == blobno;
+                                    }),
+                     data.names.end());
+    if (newblob) {
+      add_keys(data, newblob, blobno);
+      sort_keys(data);
+      blob_trigrams(newblob, new_trigrams);
+    }
+
+    /* Only the posting lists of changed trigrams need to be touched.  */
+    blob_trigrams(oldblob, old_trigrams);
+    err = 0;
+    for (u32 trigram : old_trigrams) {
+      if (std::binary_search(new_trigrams.begin(), new_trigrams.end(),
+                             trigram))
+        continue;
+      auto &list = data.postings[trigram];
+      decode_all(list, blobnos);
+      blobnos.erase(std::remove(blobnos.begin(), blobnos.end(), blobno),
+                    blobnos.end());
+      if (blobnos.empty())
+        data.postings.erase(trigram);
+      else
+        encode_list(list, blobnos);
+    }
+    for (u32 trigram : new_trigrams) {
+      if (std::binary_search(old_trigrams.begin(), old_trigrams.end(),
+                             trigram))
+        continue;
+      auto &list = data.postings[trigram];
+      decode_all(list, blobnos);
+      blobnos.insert(std::lower_bound(blobnos.begin(), blobnos.end(), blobno),
+                     blobno);
+      encode_list(list, blobnos);
+    }
+  }
+  if (err) return err;
+
+  err = write_index(tmpname, &id, data);
+  if (err) return err;
+
+  *r_tmpname = (char *)xtrymalloc(tmpname.size() + 1);
+  if (*r_tmpname)
+    strcpy(*r_tmpname, tmpname.c_str());
+  else {
+    err = gpg_error_from_syserror();
+    gnupg_remove(tmpname.c_str());
+  }
+  return err;
+}
+
+/* Finish an update started by _keybox_index_prepare.  If OK is false
+   the update of the keybox failed and the new index is discarded.
+   Releases TMPNAME.  */
+void _keybox_index_commit(const char *fname, char *tmpname, int ok) {
+  if (!tmpname) return;
+
+  if (!ok || gnupg_rename_file(tmpname, index_name(fname).c_str()))
+    gnupg_remove(tmpname);
+  xfree(tmpname);
+  index_tails.erase(index_name(fname));
+}
+
+/* Write the file identity ID and the length COVERED of the indexed
+   part of the keybox to the header of the index file FP.  Returns
+   true on success.  */
+static int write_identity(FILE *fp, const struct file_identity_s *id,
+                          uint64_t covered) {
+  unsigned char buffer[28];
+
+  /* The length goes first, so that the new identity never comes with
+     a wrong one.  */
+  put64(buffer, covered);
+  if (covered &&
+      (fseeko(fp, 56, SEEK_SET) || fwrite(buffer, 8, 1, fp) != 1))
+    return 0;
+
+  put32(buffer, covered ? 6 : 5);
+  put64(buffer + 4, id->size);
+  put64(buffer + 12, id->mtime);
+  put64(buffer + 20, id->inode);
+  return !fseeko(fp, 4, SEEK_SET) && fwrite(buffer, sizeof buffer, 1, fp) == 1;
+}
+
+/* Return the tail of the index INDEX of the keybox with file identity
+   ID, or NULL if this process does not know the appended blobs.  */
+static index_tail_s *find_tail(const std::string &name,
+                               const keybox_index_s *index,
+                               const struct file_identity_s *id) {
+  auto it = index_tails.find(name);
+
+  if (it == index_tails.end() || it->second.covered != index->covered ||
+      !same_identity(&it->second.identity, id))
+    return NULL;
+  return &it->second;
+}
+
+/* Update the identity in the index of the keybox FNAME after a change
+   of the file.  If OFF is not -1, BLOB has been appended at file
+   offset OFF.  VALID tells whether the index was valid before the
+   change.  */
+static void update_identity(const char *fname, int valid, off_t off,
+                            KEYBOXBLOB blob) {
+  std::string name = index_name(fname);
+  keybox_index_s index;
+  struct file_identity_s id;
+  index_tail_s *tail = NULL;
+  struct stat st;
+  FILE *fp;
+  int ok;
+
+  if (!valid) return;
+  fp = fopen(name.c_str(), "r+b");
+  if (!fp) return;
+  ok = !read_header(fp, &index) && !stat(fname, &st);
+  if (ok) {
+    get_identity(&st, &id);
+    if (off != (off_t)-1 && !index.covered) {
+      /* The first append: everything before it is indexed.  */
+      index.covered = off;
+      tail = &index_tails[name];
+      *tail = index_tail_s();
+      tail->covered = off;
+    } else
+      tail = find_tail(name, &index, &index.identity);
+    ok = write_identity(fp, &id, index.covered);
+  }
+  if (fclose(fp)) ok = 0;
+  if (!ok) {
+    /* Make sure a stale index is never mistaken for a valid one.  */
+    gnupg_remove(name.c_str());
+    index_tails.erase(name);
+    return;
+  }
+  if (!tail) {
+    index_tails.erase(name);
+    return;
+  }
+
+  tail->identity = id;
+  if (off != (off_t)-1) {
+    const unsigned char *buffer;
+    size_t length;
+
+    tail->blobs.push_back(off);
+    buffer = _keybox_get_blob_image(blob, &length);
+    for_each_fpr(buffer, length, [&](const unsigned char *fpr) {
+      unsigned char kid[8];
+
+      memcpy(kid, fpr + 16, 4);
+      memcpy(kid + 4, fpr + 12, 4);
+      tail->fprs.emplace(std::string((const char *)fpr, 20), off);
+      tail->kids.emplace(std::string((const char *)kid, 8), off);
+    });
+    for_each_name(blob, [&](const unsigned char *key) {
+      tail->names.emplace(std::string((const char *)key, 8), off);
+    });
+  }
+}
+
+/* Record that the keybox FNAME has been changed in place, without
+   adding any blobs.  VALID tells whether the index was valid before
+   the change.  */
+void _keybox_index_touch(const char *fname, int valid) {
+  update_identity(fname, valid, -1, NULL);
+}
+
+/* Record that BLOB has been appended to the keybox FNAME at file
+   offset OFF.  The index is not updated but from now on only covers
+   the part of the file before the first appended blob.  VALID tells
+   whether the index was valid before the change.  */
+void _keybox_index_append(const char *fname, int valid, off_t off,
+                          KEYBOXBLOB blob) {
+  update_identity(fname, valid, off, blob);
+}
+
+/* Add the blobs behind the indexed part of the keybox FNAME to its
+   index, so that other processes don't have to read them for every
+   search.  Unless ALWAYS is true this is only done if the tail grew
+   larger than MAX_TAIL_LEN or an eighth of the indexed part.  Only
+   the tail of the keybox is read, unless there is no valid index;
+   then it is built from scratch, as blob_filecopy would do.  */
+gpg_error_t _keybox_index_merge_tail(const char *fname, int always) {
+  gpg_error_t err;
+  index_data_s data;
+  keybox_index_s index;
+  struct file_identity_s id, now;
+  struct stat st;
+  std::string name = index_name(fname);
+  std::string tmpname = name + ".tmp";
+  uint64_t covered = 0;
+  FILE *fp;
+
+  if (stat(fname, &st)) return gpg_error_from_syserror();
+  get_identity(&st, &id);
+
+  fp = fopen(name.c_str(), "rb");
+  if (!fp) return _keybox_index_build(fname);
+  if (read_header(fp, &index) || !same_identity(&index.identity, &id)) {
+    fclose(fp);
+    return _keybox_index_build(fname);
+  }
+  if (!index.covered ||
+      (!always && id.size - index.covered <= MAX_TAIL_LEN &&
+       id.size - index.covered <= index.covered / 8)) {
+    fclose(fp);
+    return 0;
+  }
+  err = load_index(fp, data, &covered);
+  fclose(fp);
+  if (!err) err = scan_keybox(fname, data, covered);
+  if (err) return _keybox_index_build(fname);
+
+  /* Don't write an index for a keybox changed while scanning.  */
+  if (stat(fname, &st)) return gpg_error_from_syserror();
+  get_identity(&st, &now);
+  if (!same_identity(&now, &id)) return GPG_ERR_EAGAIN;
+
+  err = write_index(tmpname, &id, data);
+  if (!err) err = gnupg_rename_file(tmpname.c_str(), name.c_str());
+  if (err) gnupg_remove(tmpname.c_str());
+  index_tails.erase(name);
+  return err;
+}
+
+/*
+   Searching with the index.
+*/
+
+/* Open the index of the keybox FNAME and store it at R_INDEX.  The
+   index is only returned if it belongs to the keybox file open at
+   FP.  */
+gpg_error_t _keybox_index_open(keybox_index_t *r_index, const char *fname,
+                               FILE *fp) {
+  gpg_error_t err;
+  keybox_index_s *index;
+
+  *r_index = NULL;
+  index = new (std::nothrow) keybox_index_s();
+  if (!index) return gpg_error_from_syserror();
+
+  index->name = index_name(fname);
+  index->fp = fopen(index->name.c_str(), "rb");
+  if (!index->fp) {
+    err = gpg_error_from_syserror();
+    delete index;
+    return err;
+  }
+  err = read_header(index->fp, index);
+  if (!err && !_keybox_index_valid(index, fp)) err = GPG_ERR_NOT_FOUND;
+  if (err) {
+    _keybox_index_close(index);
+    return err;
+  }
+  *r_index = index;
+  return 0;
+}
+
+void _keybox_index_close(keybox_index_t index) {
+  if (!index) return;
+  if (index->fp) fclose(index->fp);
+  delete index;
+}
+
+/* Return true if INDEX still belongs to the keybox file open at FP.  */
+int _keybox_index_valid(keybox_index_t index, FILE *fp) {
+  struct file_identity_s id;
+  struct stat st;
+
+  if (fstat(fileno(fp), &st)) return 0;
+  get_identity(&st, &id);
+  return same_identity(&index->identity, &id);
+}
+
+/* Return true if DESC can be answered with the index.  The trigrams
+   of the search string are stored at TRIGRAMS.  */
+static int index_trigrams(KEYBOX_SEARCH_DESC *desc,
+                          std::vector<u32> &trigrams) {
+  const unsigned char *name = (const unsigned char *)desc->u.name;
+  size_t namelen, i;
+
+  trigrams.clear();
+  if (!name) return 0;
+  namelen = strlen(desc->u.name);
+
+  /* For mail searches, the angle brackets are optional.  */
+  if (desc->mode == KEYDB_SEARCH_MODE_MAIL ||
+      desc->mode == KEYDB_SEARCH_MODE_MAILSUB) {
+    if (namelen && *name == '<') {
+      name++;
+      namelen--;
+    }
+    if (namelen && name[namelen - 1] == '>') namelen--;
+  }
+  if (namelen < 3) return 0;
+
+  for (i = 0; i + 3 <= namelen; i++) trigrams.push_back(make_trigram(name + i));
+  return 1;
+}
+
+/* Return true if DESC is an X.509 lookup or an exact mail search
+   which can be answered with the name table.  The name hash is stored
+   at KEY.  */
+static int index_name_key(KEYBOX_SEARCH_DESC *desc, unsigned char *key) {
+  switch (desc->mode) {
+    case KEYDB_SEARCH_MODE_ISSUER:
+      if (!desc->u.name) return 0;
+      make_name_key(key, 'I', desc->u.name, strlen(desc->u.name));
+      return 1;
+    case KEYDB_SEARCH_MODE_ISSUER_SN:
+      /* A serial number given as hex string (SNLEN -1) is converted
+         only by keybox_search.  */
+      if (!desc->u.name || !desc->sn || desc->snlen < 0) return 0;
+      make_name_key(key, 'S', desc->u.name, strlen(desc->u.name), desc->sn,
+                    desc->snlen);
+      return 1;
+    case KEYDB_SEARCH_MODE_SUBJECT:
+      if (!desc->u.name) return 0;
+      make_name_key(key, 's', desc->u.name, strlen(desc->u.name));
+      return 1;
+    case KEYDB_SEARCH_MODE_KEYGRIP:
+      make_name_key(key, 'g', desc->u.grip, 20);
+      return 1;
+    case KEYDB_SEARCH_MODE_MAIL: {
+      const char *name = desc->u.name;
+      size_t namelen;
+
+      /* The angle brackets are optional.  */
+      if (!name) return 0;
+      if (*name == '<') name++;
+      namelen = strlen(name);
+      if (namelen && name[namelen - 1] == '>') namelen--;
+      make_mail_key(key, name, namelen);
+      return 1;
+    }
+    default:
+      return 0;
+  }
+}
+
+/* Return true if DESC can be answered with the index.  */
+int _keybox_index_usable(KEYBOX_SEARCH_DESC *desc) {
+  std::vector<u32> trigrams;
+  unsigned char key[8];
+
+  switch (desc->mode) {
+    case KEYDB_SEARCH_MODE_FPR:
+    case KEYDB_SEARCH_MODE_FPR20:
+    case KEYDB_SEARCH_MODE_LONG_KID:
+    case KEYDB_SEARCH_MODE_SHORT_KID:
+      return 1;
+    case KEYDB_SEARCH_MODE_ISSUER:
+    case KEYDB_SEARCH_MODE_ISSUER_SN:
+    case KEYDB_SEARCH_MODE_SUBJECT:
+    case KEYDB_SEARCH_MODE_KEYGRIP:
+    case KEYDB_SEARCH_MODE_MAIL:
+      return index_name_key(desc, key);
+    case KEYDB_SEARCH_MODE_EXACT:
+    case KEYDB_SEARCH_MODE_SUBSTR:
+    case KEYDB_SEARCH_MODE_MAILSUB:
+      return index_trigrams(desc, trigrams);
+    default:
+      return 0;
+  }
+}
+
+/* Return the number of the first blob at or after file offset POS in
+   R_BLOBNO.  */
+static gpg_error_t first_blob_at(keybox_index_t index, off_t pos,
+                                 u32 *r_blobno) {
+  unsigned char buffer[8];
+  u32 lo = 0, hi = index->nblobs;
+
+  while (lo < hi) {
+    u32 mid = lo + (hi - lo) / 2;
+
+    if (read_at(index->fp, index->blobs_off + (off_t)8 * mid, buffer, 8))
+      return GPG_ERR_TOO_SHORT;
+    if (get64(buffer) < (uint64_t)pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  *r_blobno = lo;
+  return 0;
+}
+
+/* Find the first record of the sorted table at TABLE_OFF with NRECS
+   records of RECLEN bytes which is not less than KEY (of KEYLEN
+   bytes) followed by the blob number BLOBNO.  Stores the record
+   number at R_RECNO.  */
+static gpg_error_t find_record(keybox_index_t index, off_t table_off,
+                               u32 nrecs, size_t reclen,
+                               const unsigned char *key, size_t keylen,
+                               u32 blobno, u32 *r_recno) {
+  unsigned char buffer[FPR_RECORD_LEN];
+  u32 lo = 0, hi = nrecs;
+
+  while (lo < hi) {
+    u32 mid = lo + (hi - lo) / 2;
+    int cmp;
+
+    if (read_at(index->fp, table_off + (off_t)reclen * mid, buffer, reclen))
+      return GPG_ERR_TOO_SHORT;
+    cmp = memcmp(buffer, key, keylen);
+    if (!cmp && reclen - 4 == keylen)
+      cmp = get32(buffer + keylen) < blobno ? -1 : 1;
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  *r_recno = lo;
+  return 0;
+}
+
+/* Find the posting list of TRIGRAM and store its length at R_COUNT
+   and its offset at R_OFF.  Stores 0 at R_COUNT if there is none.  */
+static gpg_error_t find_trigram(keybox_index_t index, u32 trigram,
+                                u32 *r_count, uint64_t *r_off) {
+  unsigned char key[4];
+  unsigned char rec[TRIGRAM_RECORD_LEN];
+  gpg_error_t err;
+  u32 recno;
+
+  *r_count = 0;
+  put32(key, trigram);
+  err = find_record(index, index->trigrams_off, index->ntrigrams,
+                    TRIGRAM_RECORD_LEN, key, 4, 0, &recno);
+  if (err || recno == index->ntrigrams) return err;
+  if (read_at(index->fp,
+              index->trigrams_off + (off_t)TRIGRAM_RECORD_LEN * recno, rec,
+              sizeof rec))
+    return GPG_ERR_TOO_SHORT;
+  if (get32(rec) != trigram) return 0;
+  *r_count = get32(rec + 4);
+  *r_off = get64(rec + 8);
+  return 0;
+}
+
+/* Find the first record with KEY of KEYLEN bytes and a blob number
+   not less than FIRST in the sorted table at TABLE_OFF with NRECS
+   records of RECLEN bytes.  Stores the blob number at R_BLOBNO or
+   NBLOBS if there is none.  */
+static gpg_error_t next_by_key(keybox_index_t index, off_t table_off,
+                               u32 nrecs, size_t reclen,
+                               const unsigned char *key, size_t keylen,
+                               u32 first, u32 *r_blobno) {
+  unsigned char rec[FPR_RECORD_LEN];
+  gpg_error_t err;
+  u32 recno;
+
+  *r_blobno = index->nblobs;
+  err = find_record(index, table_off, nrecs, reclen, key, keylen, first,
+                    &recno);
+  if (err || recno == nrecs) return err;
+  if (read_at(index->fp, table_off + (off_t)reclen * recno, rec, reclen))
+    return GPG_ERR_TOO_SHORT;
+  if (!memcmp(rec, key, keylen)) *r_blobno = get32(rec + keylen);
+  return 0;
+}
+
+/* Find the first blob at or after blob number FIRST which may match
+   the user ID search DESC.  Stores the blob number at R_BLOBNO or
+   NBLOBS if there is none.  */
+static gpg_error_t next_by_name(keybox_index_t index, KEYBOX_SEARCH_DESC *desc,
+                                u32 first, u32 *r_blobno) {
+  std::vector<u32> trigrams;
+  gpg_error_t err;
+  u32 best = 0, best_count = 0;
+  uint64_t best_off = 0;
+
+  *r_blobno = index->nblobs;
+  if (!index_trigrams(desc, trigrams)) return GPG_ERR_NOT_SUPPORTED;
+
+  /* Every match contains all trigrams; the shortest posting list is
+     the one with the fewest candidates.  */
+  for (u32 trigram : trigrams) {
+    u32 count;
+    uint64_t off;
+
+    if (index->have_cached && index->cached_trigram == trigram) {
+      count = index->cached_list.size();
+      off = 0;
+    } else {
+      err = find_trigram(index, trigram, &count, &off);
+      if (err) return err;
+    }
+    if (!count) return 0; /* No blob has this trigram.  */
+    if (!best_count || count < best_count) {
+      best = trigram;
+      best_count = count;
+      best_off = off;
+    }
+  }
+
+  if (!index->have_cached || index->cached_trigram != best) {
+    std::vector<unsigned char> buffer;
+    off_t end;
+
+    /* Every number takes at most 5 bytes; the list may be shorter
+       than that at the end of the file.  */
+    if (fseeko(index->fp, 0, SEEK_END)) return gpg_error_from_syserror();
+    end = ftello(index->fp);
+    if (end < index->postings_off + (off_t)best_off)
+      return GPG_ERR_TOO_SHORT;
+    buffer.resize(std::min<uint64_t>((uint64_t)best_count * 5,
+                                end - index->postings_off - best_off) +
+                  1);
+    if (read_at(index->fp, index->postings_off + best_off, buffer.data(),
+                buffer.size() - 1))
+      return GPG_ERR_TOO_SHORT;
+    index->have_cached = 0;
+    if (decode_list(buffer.data(), buffer.size() - 1, best_count,
+                    index->cached_list))
+      return GPG_ERR_INV_OBJ;
+    index->have_cached = 1;
+    index->cached_trigram = best;
+  }
+
+  auto it = std::lower_bound(index->cached_list.begin(),
+                             index->cached_list.end(), first);
+  if (it != index->cached_list.end()) *r_blobno = *it;
+  return 0;
+}
+
+/* Find the first blob at or after file offset POS behind the indexed
+   part of the keybox that may match DESC, like _keybox_index_next.
+   Without a known tail, all blobs there may match.  */
+static gpg_error_t next_in_tail(keybox_index_t index,
+                                KEYBOX_SEARCH_DESC *desc, off_t pos,
+                                off_t *r_offset) {
+  index_tail_s *tail;
+  uint64_t best = (uint64_t)-1;
+  unsigned char key[8];
+
+  if (!index->covered) return -1;
+  if ((uint64_t)pos < index->covered) pos = index->covered;
+  if ((uint64_t)pos >= index->identity.size) return -1;
+
+  tail = find_tail(index->name, index, &index->identity);
+  if (!tail) {
+    *r_offset = pos;
+    return 0;
+  }
+
+  auto consider = [&](uint64_t off) {
+    if (off >= (uint64_t)pos && off < best) best = off;
+  };
+  switch (desc->mode) {
+    case KEYDB_SEARCH_MODE_FPR:
+    case KEYDB_SEARCH_MODE_FPR20: {
+      auto range =
+          tail->fprs.equal_range(std::string((const char *)desc->u.fpr, 20));
+      for (auto it = range.first; it != range.second; ++it)
+        consider(it->second);
+      break;
+    }
+
+    case KEYDB_SEARCH_MODE_LONG_KID: {
+      put32(key, desc->u.kid[1]);
+      put32(key + 4, desc->u.kid[0]);
+      auto range = tail->kids.equal_range(std::string((const char *)key, 8));
+      for (auto it = range.first; it != range.second; ++it)
+        consider(it->second);
+      break;
+    }
+
+    case KEYDB_SEARCH_MODE_SHORT_KID:
+      put32(key, desc->u.kid[1]);
+      for (auto it = tail->kids.lower_bound(std::string((const char *)key, 4));
+           it != tail->kids.end() && !memcmp(it->first.data(), key, 4); ++it)
+        consider(it->second);
+      break;
+
+    case KEYDB_SEARCH_MODE_ISSUER:
+    case KEYDB_SEARCH_MODE_ISSUER_SN:
+    case KEYDB_SEARCH_MODE_SUBJECT:
+    case KEYDB_SEARCH_MODE_KEYGRIP:
+    case KEYDB_SEARCH_MODE_MAIL: {
+      if (!index_name_key(desc, key)) return GPG_ERR_NOT_SUPPORTED;
+      auto range = tail->names.equal_range(std::string((const char *)key, 8));
+      for (auto it = range.first; it != range.second; ++it)
+        consider(it->second);
+      break;
+    }
+
+    default: {
+      /* User ID searches look at all appended blobs.  */
+      auto it =
+          std::lower_bound(tail->blobs.begin(), tail->blobs.end(), (uint64_t)pos);
+      if (it != tail->blobs.end()) best = *it;
+      break;
+    }
+  }
+
+  if (best == (uint64_t)-1) return -1;
+  *r_offset = best;
+  return 0;
+}
+
+/* Find the first blob at or after file offset POS that may match
+   DESC and store its file offset at R_OFFSET.  Returns -1 if there is
+   none and GPG_ERR_NOT_SUPPORTED if DESC can't be answered with the
+   index.  */
+gpg_error_t _keybox_index_next(keybox_index_t index, KEYBOX_SEARCH_DESC *desc,
+                               off_t pos, off_t *r_offset) {
+  gpg_error_t err;
+  unsigned char key[20];
+  unsigned char rec[FPR_RECORD_LEN];
+  unsigned char buffer[8];
+  u32 first, recno, blobno;
+
+  err = first_blob_at(index, pos, &first);
+  if (err) return err;
+  if (first == index->nblobs) return next_in_tail(index, desc, pos, r_offset);
+
+  switch (desc->mode) {
+    case KEYDB_SEARCH_MODE_FPR:
+    case KEYDB_SEARCH_MODE_FPR20:
+      err = next_by_key(index, index->fprs_off, index->nfprs, FPR_RECORD_LEN,
+                        desc->u.fpr, 20, first, &blobno);
+      if (err) return err;
+      break;
+
+    case KEYDB_SEARCH_MODE_LONG_KID:
+      put32(key, desc->u.kid[1]);
+      put32(key + 4, desc->u.kid[0]);
+      err = next_by_key(index, index->kids_off, index->nkids, KID_RECORD_LEN,
+                        key, 8, first, &blobno);
+      if (err) return err;
+      break;
+
+    case KEYDB_SEARCH_MODE_SHORT_KID:
+      /* The records with this low part are sorted by the high part
+         first, so look at all of them.  */
+      put32(key, desc->u.kid[1]);
+      err = find_record(index, index->kids_off, index->nkids, KID_RECORD_LEN,
+                        key, 4, 0, &recno);
+      if (err) return err;
+      blobno = index->nblobs;
+      for (; recno < index->nkids; recno++) {
+        if (read_at(index->fp, index->kids_off + (off_t)KID_RECORD_LEN * recno,
+                    rec, KID_RECORD_LEN))
+          return GPG_ERR_TOO_SHORT;
+        if (memcmp(rec, key, 4)) break;
+        if (get32(rec + 8) >= first && get32(rec + 8) < blobno)
+          blobno = get32(rec + 8);
+      }
+      break;
+
+    case KEYDB_SEARCH_MODE_ISSUER:
+    case KEYDB_SEARCH_MODE_ISSUER_SN:
+    case KEYDB_SEARCH_MODE_SUBJECT:
+    case KEYDB_SEARCH_MODE_KEYGRIP:
+    case KEYDB_SEARCH_MODE_MAIL:
+      if (!index_name_key(desc, key)) return GPG_ERR_NOT_SUPPORTED;
+      err = next_by_key(index, index->names_off, index->nnames,
+                        NAME_RECORD_LEN, key, 8, first, &blobno);
+      if (err) return err;
+      break;
+
+    case KEYDB_SEARCH_MODE_EXACT:
+    case KEYDB_SEARCH_MODE_SUBSTR:
+    case KEYDB_SEARCH_MODE_MAILSUB:
+      err = next_by_name(index, desc, first, &blobno);
+      if (err) return err;
+      break;
+
+    default:
+      return GPG_ERR_NOT_SUPPORTED;
+  }
+
+  if (blobno >= index->nblobs) return next_in_tail(index, desc, pos, r_offset);
+  if (read_at(index->fp, index->blobs_off + (off_t)8 * blobno, buffer, 8))
+    return GPG_ERR_TOO_SHORT;
+  *r_offset = get64(buffer);
+  return 0;
+}
@@ -51,6 +51,9 @@ gpg_error_t keybox_register_file(const char *fname, int secret,
   kr->lockhd = NULL;
   kr->is_locked = 0;
   kr->did_full_scan = 0;
+  kr->append_only = 0;
+  kr->appended = 0;
+  kr->dead_bytes = 0;
   /* keep a list of all issued pointers */
   kr->next = kb_names;
   kb_names = kr;
@@ -69,6 +72,13 @@ int keybox_is_writable(void *token) {
   return r ? !access(r->fname, W_OK) : 0;
 }
 
+/* Return the name of the file associated with TOKEN.  */
+const char *keybox_get_token_name(void *token) {
+  KB_NAME r = (KB_NAME)token;
+
+  return r ? r->fname : NULL;
+}
+
 static KEYBOX_HANDLE do_keybox_new(KB_NAME resource, int secret,
                                    int for_openpgp) {
   KEYBOX_HANDLE hd;
@@ -145,10 +155,12 @@ void keybox_release(KEYBOX_HANDLE hd) {
   }
   _keybox_release_blob(hd->found.blob);
   _keybox_release_blob(hd->saved_found.blob);
+  _keybox_unmap_file(hd);
   if (hd->fp) {
     fclose(hd->fp);
     hd->fp = NULL;
   }
+  _keybox_index_close(hd->index);
   xfree(hd->word_match.name);
   xfree(hd->word_match.pattern);
   xfree(hd);
@@ -186,6 +198,14 @@ int keybox_set_ephemeral(KEYBOX_HANDLE hd, int yes) {
   return 0;
 }
 
+/* Let keybox_search on HD stop early when the flag at CANCEL is set
+   by another thread.  The search then returns GPG_ERR_CANCELED and
+   the position of HD is undefined until keybox_search_reset is
+   called.  Pass NULL to remove the flag.  */
+void keybox_set_cancel(KEYBOX_HANDLE hd, const std::atomic<bool> *cancel) {
+  if (hd) hd->cancel = cancel;
+}
+
 /* Close the file of the resource identified by HD.  For consistent
    results this function closes the files of all handles pointing to
    the resource identified by HD.  */
@@ -197,6 +217,7 @@ void _keybox_close_file(KEYBOX_HANDLE hd) {
 
   for (idx = 0; idx < hd->kb->handle_table_size; idx++)
     if ((roverhd = hd->kb->handle_table[idx])) {
+      _keybox_unmap_file(roverhd);
       if (roverhd->fp) {
         fclose(roverhd->fp);
         roverhd->fp = NULL;
@@ -205,6 +226,21 @@ void _keybox_close_file(KEYBOX_HANDLE hd) {
   assert(!hd->fp);
 }
 
+/* Make sure the lock handle of KB has been created.  */
+static gpg_error_t create_lock(KB_NAME kb) {
+  gpg_error_t err;
+
+  if (kb->lockhd) return 0;
+
+  kb->lockhd = dotlock_create(kb->fname, 0);
+  if (!kb->lockhd) {
+    err = gpg_error_from_syserror();
+    log_info("can't allocate lock for '%s'\n", kb->fname);
+    return err;
+  }
+  return 0;
+}
+
 /*
  * Lock the keybox at handle HD, or unlock if YES is false.
  */
@@ -214,15 +250,8 @@ gpg_error_t keybox_lock(KEYBOX_HANDLE hd, int yes) {
 
   if (!keybox_is_writable(kb)) return 0;
 
-  /* Make sure the lock handle has been created.  */
-  if (!kb->lockhd) {
-    kb->lockhd = dotlock_create(kb->fname, 0);
-    if (!kb->lockhd) {
-      err = gpg_error_from_syserror();
-      log_info("can't allocate lock for '%s'\n", kb->fname);
-      return err;
-    }
-  }
+  err = create_lock(kb);
+  if (err) return err;
 
   if (yes) /* Take the lock.  */
   {
@@ -259,3 +288,32 @@ gpg_error_t keybox_lock(KEYBOX_HANDLE hd, int yes) {
 
   return err;
 }
+
+/*
+ * Take a shared lock on the keybox at handle HD to keep out writers
+ * while reading, or release it if YES is false.  The lock is shared
+ * by all handles of the keybox and granted if this process holds the
+ * lock taken by keybox_lock.
+ */
+gpg_error_t keybox_lock_shared(KEYBOX_HANDLE hd, int yes) {
+  gpg_error_t err;
+  KB_NAME kb = hd->kb;
+
+  /* Nobody can write to it, so there is nothing to keep out.  */
+  if (!keybox_is_writable(kb)) return 0;
+
+  err = create_lock(kb);
+  if (err) return err;
+
+  if (yes) {
+    if (dotlock_take_shared(kb->lockhd, -1)) {
+      err = gpg_error_from_syserror();
+      log_info("can't lock '%s'\n", kb->fname);
+    }
+  } else if (dotlock_release_shared(kb->lockhd)) {
+    err = gpg_error_from_syserror();
+    log_info("can't unlock '%s'\n", kb->fname);
+  }
+
+  return err;
+}
@@ -25,7 +25,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <gcrypt.h>
+#include <neopg/utils/workers.h>
 #include "../common/host2net.h"
 #include "../common/mbox-util.h"
 #include "keybox-defs.h"
@@ -40,6 +44,10 @@ struct sn_array_s {
   unsigned char *sn;
 };
 
+/* keybox_search_batch does not start a thread for less than this many
+   bytes of the keybox.  */
+#define BATCH_MIN_RANGE (256 * 1024)
+
 #define get32(a) buf32_to_ulong((a))
 #define get16(a) buf16_to_ulong((a))
 
@@ -326,6 +334,52 @@ static int blob_cmp_name(KEYBOXBLOB blob, int idx, const char *name,
   return 0; /* not found */
 }
 
+/* Find the mail address in the user ID of LEN bytes at UID.  For
+   X.509 it is the entire name in angle brackets, for OpenPGP the part
+   in angle brackets or the whole user ID if it looks like a mail
+   address.  Stores the offset and length of the address without the
+   brackets at R_OFF and R_LEN and returns true if there is one.  */
+int _keybox_get_uid_mailbox(const unsigned char *uid, size_t len, int x509,
+                            size_t *r_off, size_t *r_len) {
+  size_t off = 0, mylen = len, mypos;
+
+  if (x509) {
+    if (len < 2 || uid[0] != '<')
+      return 0; /* empty name or trailing 0 not stored */
+    len--;      /* one back */
+    if (len < 3 || uid[len] != '>')
+      return 0; /* not a proper email address */
+    off++;
+    len--;
+  } else /* OpenPGP.  */
+  {
+    /* We need to forward to the mailbox part.  */
+    for (; len && uid[off] != '<'; len--, off++)
+      ;
+    if (len < 2 || uid[off] != '<') {
+      /* Mailbox not explicitly given or too short.  Check whether the
+         entire string resembles a mailbox without the angle
+         brackets.  */
+      off = 0;
+      len = mylen;
+      if (!is_valid_mailbox_mem(uid, len)) return 0;
+    } else /* Seems to be standard user id with mail address.  */
+    {
+      off++; /* Point to first char of the mail address.  */
+      len--;
+      /* Search closing '>'.  */
+      for (mypos = off; len && uid[mypos] != '>'; len--, mypos++)
+        ;
+      if (!len || uid[mypos] != '>' || off == mypos)
+        return 0; /* Not a proper mail address.  */
+      len = mypos - off;
+    }
+  }
+  *r_off = off;
+  *r_len = len;
+  return 1;
+}
+
 /* Compare all email addresses of the subject.  With SUBSTR given as
    True a substring search is done in the mail address.  The X509 flag
    indicated whether the search is done on an X.509 blob.  */
@@ -370,48 +424,16 @@ static int blob_cmp_mail(KEYBOXBLOB blob, const char *name, size_t namelen,
      for the issuer name.  */
   for (idx = !!x509; idx < nuids; idx++) {
     size_t mypos = pos;
-    size_t mylen;
+    size_t mboxoff;
 
     mypos += idx * uidinfolen;
     off = get32(buffer + mypos);
     len = get32(buffer + mypos + 4);
     if (off + len > length)
       return 0; /* error: better stop here - out of bounds */
-    if (x509) {
-      if (len < 2 || buffer[off] != '<')
-        continue; /* empty name or trailing 0 not stored */
-      len--;      /* one back */
-      if (len < 3 || buffer[off + len] != '>')
-        continue; /* not a proper email address */
-      off++;
-      len--;
-    } else /* OpenPGP.  */
-    {
-      /* We need to forward to the mailbox part.  */
-      mypos = off;
-      mylen = len;
-      for (; len && buffer[off] != '<'; len--, off++)
-        ;
-      if (len < 2 || buffer[off] != '<') {
-        /* Mailbox not explicitly given or too short.  Restore
-           OFF and LEN and check whether the entire string
-           resembles a mailbox without the angle brackets.  */
-        off = mypos;
-        len = mylen;
-        if (!is_valid_mailbox_mem(buffer + off, len))
-          continue; /* Not a mail address. */
-      } else        /* Seems to be standard user id with mail address.  */
-      {
-        off++; /* Point to first char of the mail address.  */
-        len--;
-        /* Search closing '>'.  */
-        for (mypos = off; len && buffer[mypos] != '>'; len--, mypos++)
-          ;
-        if (!len || buffer[mypos] != '>' || off == mypos)
-          continue; /* Not a proper mail address.  */
-        len = mypos - off;
-      }
-    }
+    if (!_keybox_get_uid_mailbox(buffer + off, len, x509, &mboxoff, &len))
+      continue;
+    off += mboxoff;
 
     if (substr) {
       if (ascii_memcasemem(buffer + off, len, name, namelen))
@@ -424,11 +446,10 @@ static int blob_cmp_mail(KEYBOXBLOB blob, const char *name, size_t namelen,
   return 0; /* not found */
 }
 
-/* Return true if the key in BLOB matches the 20 bytes keygrip GRIP.
-   We don't have the keygrips as meta data, thus we need to parse the
-   certificate. Fixme: We might want to return proper error codes
-   instead of failing a search for invalid certificates etc.  */
-static int blob_x509_has_grip(KEYBOXBLOB blob, const unsigned char *grip) {
+/* Compute the 20 bytes keygrip of the X.509 certificate in BLOB and
+   store it at GRIP.  We don't have the keygrips as meta data, thus we
+   need to parse the certificate.  Returns 0 on success.  */
+int _keybox_get_x509_keygrip(KEYBOXBLOB blob, unsigned char *grip) {
   int rc;
   const unsigned char *buffer;
   size_t length;
@@ -437,18 +458,17 @@ static int blob_x509_has_grip(KEYBOXBLOB blob, const unsigned char *grip) {
   ksba_cert_t cert = NULL;
   ksba_sexp_t p = NULL;
   gcry_sexp_t s_pkey;
-  unsigned char array[20];
   unsigned char *rcp;
   size_t n;
 
   buffer = _keybox_get_blob_image(blob, &length);
-  if (length < 40) return 0; /* Too short. */
+  if (length < 40) return -1; /* Too short. */
   cert_off = get32(buffer + 8);
   cert_len = get32(buffer + 12);
-  if (cert_off + cert_len > length) return 0; /* Too short.  */
+  if (cert_off + cert_len > length) return -1; /* Too short.  */
 
   rc = ksba_reader_new(&reader);
-  if (rc) return 0; /* Problem with ksba. */
+  if (rc) return -1; /* Problem with ksba. */
   rc = ksba_reader_set_mem(reader, buffer + cert_off, cert_len);
   if (rc) goto failed;
   rc = ksba_cert_new(&cert);
@@ -464,19 +484,29 @@ static int blob_x509_has_grip(KEYBOXBLOB blob, const unsigned char *grip) {
     gcry_sexp_release(s_pkey);
     goto failed;
   }
-  rcp = gcry_pk_get_keygrip(s_pkey, array);
+  rcp = gcry_pk_get_keygrip(s_pkey, grip);
   gcry_sexp_release(s_pkey);
   if (!rcp) goto failed; /* Can't calculate keygrip. */
 
   xfree(p);
   ksba_cert_release(cert);
   ksba_reader_release(reader);
-  return !memcmp(array, grip, 20);
+  return 0;
 failed:
   xfree(p);
   ksba_cert_release(cert);
   ksba_reader_release(reader);
-  return 0;
+  return -1;
+}
+
+/* Return true if the key in BLOB matches the 20 bytes keygrip GRIP.
+   Fixme: We might want to return proper error codes instead of
+   failing a search for invalid certificates etc.  */
+static int blob_x509_has_grip(KEYBOXBLOB blob, const unsigned char *grip) {
+  unsigned char array[20];
+
+  if (_keybox_get_x509_keygrip(blob, array)) return 0;
+  return !memcmp(array, grip, 20);
 }
 
 /*
@@ -597,6 +627,115 @@ static void release_sn_array(struct sn_array_s *array, size_t size) {
   xfree(array);
 }
 
+/* Fill SN_ARRAY with the binary serial numbers of the NDESC
+   descriptors at DESC.  On error SN_ARRAY is released.  */
+static gpg_error_t convert_sn_array(KEYBOX_SEARCH_DESC *desc, size_t ndesc,
+                                    struct sn_array_s *sn_array) {
+  gpg_error_t err;
+  const unsigned char *s;
+  int i, odd;
+  size_t n, snlen;
+
+  for (n = 0; n < ndesc; n++) {
+    if (!desc[n].sn)
+      ;
+    else if (desc[n].snlen == -1) {
+      unsigned char *sn;
+
+      s = desc[n].sn;
+      for (i = 0; *s && *s != '/'; s++, i++)
+        ;
+      odd = (i & 1);
+      snlen = (i + 1) / 2;
+      sn_array[n].sn = (unsigned char *)xtrymalloc(snlen);
+      if (!sn_array[n].sn) {
+        err = gpg_error_from_syserror();
+        release_sn_array(sn_array, n);
+        return err;
+      }
+      sn_array[n].snlen = snlen;
+      sn = sn_array[n].sn;
+      s = desc[n].sn;
+      if (odd) {
+        *sn++ = xtoi_1(s);
+        s++;
+      }
+      for (; *s && *s != '/'; s += 2) *sn++ = xtoi_2(s);
+    } else {
+      const unsigned char *sn;
+
+      sn = desc[n].sn;
+      snlen = desc[n].snlen;
+      sn_array[n].sn = (unsigned char *)xtrymalloc(snlen);
+      if (!sn_array[n].sn) {
+        err = gpg_error_from_syserror();
+        release_sn_array(sn_array, n);
+        return err;
+      }
+      sn_array[n].snlen = snlen;
+      memcpy(sn_array[n].sn, sn, snlen);
+    }
+  }
+  return 0;
+}
+
+/* Check whether BLOB matches the descriptor DESC, using the converted
+   serial number SN if not NULL.  Returns 1 on a match, 0 if there is
+   none, and -1 for an invalid search mode.  R_PK_NO or R_UID_NO are
+   updated depending on the search mode.  */
+static int blob_matches(KEYBOXBLOB blob, KEYBOX_SEARCH_DESC *desc,
+                        struct sn_array_s *sn, int *r_pk_no, int *r_uid_no) {
+  switch (desc->mode) {
+    case KEYDB_SEARCH_MODE_NONE:
+      never_reached();
+      break;
+    case KEYDB_SEARCH_MODE_EXACT:
+      *r_uid_no = has_username(blob, desc->u.name, 0);
+      return !!*r_uid_no;
+    case KEYDB_SEARCH_MODE_MAIL:
+      *r_uid_no = has_mail(blob, desc->u.name, 0);
+      return !!*r_uid_no;
+    case KEYDB_SEARCH_MODE_MAILSUB:
+      *r_uid_no = has_mail(blob, desc->u.name, 1);
+      return !!*r_uid_no;
+    case KEYDB_SEARCH_MODE_SUBSTR:
+      *r_uid_no = has_username(blob, desc->u.name, 1);
+      return !!*r_uid_no;
+    case KEYDB_SEARCH_MODE_MAILEND:
+    case KEYDB_SEARCH_MODE_WORDS:
+      /* not yet implemented */
+      break;
+    case KEYDB_SEARCH_MODE_ISSUER:
+      return has_issuer(blob, desc->u.name);
+    case KEYDB_SEARCH_MODE_ISSUER_SN:
+      return has_issuer_sn(blob, desc->u.name, sn ? sn->sn : desc->sn,
+                           sn ? sn->snlen : desc->snlen);
+    case KEYDB_SEARCH_MODE_SN:
+      return has_sn(blob, sn ? sn->sn : desc->sn,
+                    sn ? sn->snlen : desc->snlen);
+    case KEYDB_SEARCH_MODE_SUBJECT:
+      return has_subject(blob, desc->u.name);
+    case KEYDB_SEARCH_MODE_SHORT_KID:
+      *r_pk_no = has_short_kid(blob, desc->u.kid[1]);
+      return !!*r_pk_no;
+    case KEYDB_SEARCH_MODE_LONG_KID:
+      *r_pk_no = has_long_kid(blob, desc->u.kid[0], desc->u.kid[1]);
+      return !!*r_pk_no;
+    case KEYDB_SEARCH_MODE_FPR:
+    case KEYDB_SEARCH_MODE_FPR20:
+      *r_pk_no = has_fingerprint(blob, desc->u.fpr);
+      return !!*r_pk_no;
+    case KEYDB_SEARCH_MODE_KEYGRIP:
+      return has_keygrip(blob, desc->u.grip);
+    case KEYDB_SEARCH_MODE_FIRST:
+    case KEYDB_SEARCH_MODE_NEXT:
+      return 1;
+    default:
+      return -1;
+  }
+  return 0;
+}
+
 /* Helper to open the file.  */
 static gpg_error_t open_file(KEYBOX_HANDLE hd) {
   hd->fp = fopen(hd->kb->fname, "rb");
@@ -622,7 +761,9 @@ gpg_error_t keybox_search_reset(KEYBOX_HANDLE hd) {
     hd->found.blob = NULL;
   }
 
-  if (hd->fp) {
+  if (hd->map.image)
+    hd->map.pos = 0;
+  else if (hd->fp) {
     if (fseeko(hd->fp, 0, SEEK_SET)) {
       /* Ooops.  Seek did not work.  Close so that the search will
        * open the file again.  */
@@ -645,7 +786,7 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
                           size_t *r_descindex, unsigned long *r_skipped) {
   gpg_error_t rc;
   size_t n;
-  int need_words, any_skip;
+  int need_words, any_skip, use_index;
   KEYBOXBLOB blob = NULL;
   struct sn_array_s *sn_array = NULL;
   int pk_no, uid_no;
@@ -663,7 +804,9 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
 
   /* figure out what information we need */
   need_words = any_skip = 0;
+  use_index = ndesc > 0;
   for (n = 0; n < ndesc; n++) {
+    if (!_keybox_index_usable(&desc[n])) use_index = 0;
     switch (desc[n].mode) {
       case KEYDB_SEARCH_MODE_WORDS:
         need_words = 1;
@@ -691,56 +834,26 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
       return rc;
     }
   }
+  _keybox_map_file(hd);
 
   /* Kludge: We need to convert an SN given as hexstring to its binary
      representation - in some cases we are not able to store it in the
      search descriptor, because due to the way we use it, it is not
      possible to free allocated memory. */
   if (sn_array) {
-    const unsigned char *s;
-    int i, odd;
-    size_t snlen;
+    rc = convert_sn_array(desc, ndesc, sn_array);
+    if (rc) return (hd->error = rc);
+  }
 
-    for (n = 0; n < ndesc; n++) {
-      if (!desc[n].sn)
-        ;
-      else if (desc[n].snlen == -1) {
-        unsigned char *sn;
-
-        s = desc[n].sn;
-        for (i = 0; *s && *s != '/'; s++, i++)
-          ;
-        odd = (i & 1);
-        snlen = (i + 1) / 2;
-        sn_array[n].sn = (unsigned char *)xtrymalloc(snlen);
-        if (!sn_array[n].sn) {
-          hd->error = gpg_error_from_syserror();
-          release_sn_array(sn_array, n);
-          return hd->error;
-        }
-        sn_array[n].snlen = snlen;
-        sn = sn_array[n].sn;
-        s = desc[n].sn;
-        if (odd) {
-          *sn++ = xtoi_1(s);
-          s++;
-        }
-        for (; *s && *s != '/'; s += 2) *sn++ = xtoi_2(s);
-      } else {
-        const unsigned char *sn;
-
-        sn = desc[n].sn;
-        snlen = desc[n].snlen;
-        sn_array[n].sn = (unsigned char *)xtrymalloc(snlen);
-        if (!sn_array[n].sn) {
-          hd->error = gpg_error_from_syserror();
-          release_sn_array(sn_array, n);
-          return hd->error;
-        }
-        sn_array[n].snlen = snlen;
-        memcpy(sn_array[n].sn, sn, snlen);
-      }
+  /* If all descriptors can be answered with the index, only the
+     candidate blobs it returns are read.  */
+  if (use_index) {
+    if (hd->index && !_keybox_index_valid(hd->index, hd->fp)) {
+      _keybox_index_close(hd->index);
+      hd->index = NULL;
     }
+    if (!hd->index) _keybox_index_open(&hd->index, hd->kb->fname, hd->fp);
+    use_index = !!hd->index;
   }
 
   pk_no = uid_no = 0;
@@ -748,9 +861,49 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
     unsigned int blobflags;
     int blobtype;
 
-    _keybox_release_blob(blob);
-    blob = NULL;
-    rc = _keybox_read_blob(&blob, hd->fp, NULL);
+    if (hd->cancel && hd->cancel->load(std::memory_order_relaxed)) {
+      rc = GPG_ERR_CANCELED;
+      break;
+    }
+
+    /* A view into the mapping is reused for the next blob.  */
+    if (!hd->map.image) {
+      _keybox_release_blob(blob);
+      blob = NULL;
+    }
+    if (use_index) {
+      off_t pos, off, next = -1;
+
+      pos = keybox_offset(hd);
+      rc = pos == (off_t)-1 ? gpg_error_from_syserror() : 0;
+      for (n = 0; !rc && n < ndesc; n++) {
+        rc = _keybox_index_next(hd->index, &desc[n], pos, &off);
+        if (!rc && (next == -1 || off < next)) next = off;
+        if (rc == -1) rc = 0;
+      }
+      if (rc) {
+        /* Continue without the broken index.  */
+        log_info("keybox '%s': index not usable: %s\n", hd->kb->fname,
+                 gpg_strerror(rc));
+        _keybox_index_close(hd->index);
+        hd->index = NULL;
+        use_index = 0;
+        if (pos == (off_t)-1) break;
+      } else if (next == -1) {
+        rc = -1;
+        break;
+      } else if (hd->map.image)
+        hd->map.pos = next;
+      else if (fseeko(hd->fp, next, SEEK_SET)) {
+        rc = gpg_error_from_syserror();
+        break;
+      }
+    }
+    if (hd->map.image)
+      rc = _keybox_read_mapped_blob(&blob, hd->map.image, hd->map.size,
+                                    &hd->map.pos, NULL);
+    else
+      rc = _keybox_read_blob(&blob, hd->fp, NULL);
     if (rc == GPG_ERR_TOO_LARGE) {
       ++*r_skipped;
       continue; /* Skip too large records.  */
@@ -767,73 +920,10 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
       continue; /* Not in ephemeral mode but blob is flagged ephemeral.  */
 
     for (n = 0; n < ndesc; n++) {
-      switch (desc[n].mode) {
-        case KEYDB_SEARCH_MODE_NONE:
-          never_reached();
-          break;
-        case KEYDB_SEARCH_MODE_EXACT:
-          uid_no = has_username(blob, desc[n].u.name, 0);
-          if (uid_no) goto found;
-          break;
-        case KEYDB_SEARCH_MODE_MAIL:
-          uid_no = has_mail(blob, desc[n].u.name, 0);
-          if (uid_no) goto found;
-          break;
-        case KEYDB_SEARCH_MODE_MAILSUB:
-          uid_no = has_mail(blob, desc[n].u.name, 1);
-          if (uid_no) goto found;
-          break;
-        case KEYDB_SEARCH_MODE_SUBSTR:
-          uid_no = has_username(blob, desc[n].u.name, 1);
-          if (uid_no) goto found;
-          break;
-        case KEYDB_SEARCH_MODE_MAILEND:
-        case KEYDB_SEARCH_MODE_WORDS:
-          /* not yet implemented */
-          break;
-        case KEYDB_SEARCH_MODE_ISSUER:
-          if (has_issuer(blob, desc[n].u.name)) goto found;
-          break;
-        case KEYDB_SEARCH_MODE_ISSUER_SN:
-          if (has_issuer_sn(blob, desc[n].u.name,
-                            sn_array ? sn_array[n].sn : desc[n].sn,
-                            sn_array ? sn_array[n].snlen : desc[n].snlen))
-            goto found;
-          break;
-        case KEYDB_SEARCH_MODE_SN:
-          if (has_sn(blob, sn_array ? sn_array[n].sn : desc[n].sn,
-                     sn_array ? sn_array[n].snlen : desc[n].snlen))
-            goto found;
-          break;
-        case KEYDB_SEARCH_MODE_SUBJECT:
-          if (has_subject(blob, desc[n].u.name)) goto found;
-          break;
-        case KEYDB_SEARCH_MODE_SHORT_KID:
-          pk_no = has_short_kid(blob, desc[n].u.kid[1]);
-          if (pk_no) goto found;
-          break;
-        case KEYDB_SEARCH_MODE_LONG_KID:
-          pk_no = has_long_kid(blob, desc[n].u.kid[0], desc[n].u.kid[1]);
-          if (pk_no) goto found;
-          break;
-        case KEYDB_SEARCH_MODE_FPR:
-        case KEYDB_SEARCH_MODE_FPR20:
-          pk_no = has_fingerprint(blob, desc[n].u.fpr);
-          if (pk_no) goto found;
-          break;
-        case KEYDB_SEARCH_MODE_KEYGRIP:
-          if (has_keygrip(blob, desc[n].u.grip)) goto found;
-          break;
-        case KEYDB_SEARCH_MODE_FIRST:
-          goto found;
-          break;
-        case KEYDB_SEARCH_MODE_NEXT:
-          goto found;
-          break;
-        default:
-          rc = GPG_ERR_INV_VALUE;
-          goto found;
-      }
+      int match = blob_matches(blob, &desc[n], sn_array ? &sn_array[n] : NULL,
+                               &pk_no, &uid_no);
+      if (match < 0) rc = GPG_ERR_INV_VALUE;
+      if (match) goto found;
     }
     continue;
   found:
@@ -850,6 +940,9 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
     if (n == ndesc) break; /* got it */
   }
 
+  /* The result must outlive the mapping.  */
+  if (!rc) rc = _keybox_own_blob(blob);
+
   if (!rc) {
     hd->found.blob = blob;
     hd->found.pk_no = pk_no;
@@ -857,6 +950,8 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
   } else if (rc == -1 || rc == GPG_ERR_EOF) {
     _keybox_release_blob(blob);
     hd->eof = 1;
+  } else if (rc == GPG_ERR_CANCELED) {
+    _keybox_release_blob(blob); /* Not an error state of HD.  */
   } else {
     _keybox_release_blob(blob);
     hd->error = rc;
@@ -867,6 +962,210 @@ gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
   return rc;
 }
 
+/* Return true if keybox_search can answer all NDESC descriptors at
+   DESC with the sidecar index, so that it does not need to read every
+   blob (provided that the keybox has a valid index).  */
+int keybox_search_indexable(KEYBOX_SEARCH_DESC *desc, size_t ndesc) {
+  size_t n;
+
+  for (n = 0; n < ndesc; n++)
+    if (!_keybox_index_usable(&desc[n])) return 0;
+  return ndesc > 0;
+}
+
+/* A match found by keybox_search_batch, with the first key id of the
+   blob for the skip function.  */
+struct batch_hit_s {
+  struct keybox_batch_match_s match;
+  int have_kid;
+  u32 kid[2];
+};
+
+/* The part of the keybox scanned by one thread of
+   keybox_search_batch.  */
+struct batch_range_s {
+  off_t start;
+  off_t end;
+  gpg_error_t err;
+  unsigned long skipped;
+  std::vector<batch_hit_s> hits;
+};
+
+/* Match the blobs in RANGE of HD against all descriptors.  Without a
+   file mapping, the whole file is read from HD->FP instead.  */
+static void batch_scan_range(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
+                             size_t ndesc, struct sn_array_s *sn_array,
+                             keybox_blobtype_t want_blobtype,
+                             struct batch_range_s *range) {
+  gpg_error_t rc;
+  KEYBOXBLOB blob = NULL;
+  off_t pos = range->start;
+  size_t n;
+
+  for (;;) {
+    int blobtype;
+
+    if (hd->map.image)
+      rc = _keybox_read_mapped_blob(&blob, hd->map.image, range->end, &pos,
+                                    NULL);
+    else {
+      _keybox_release_blob(blob);
+      blob = NULL;
+      rc = _keybox_read_blob(&blob, hd->fp, NULL);
+    }
+    if (rc == GPG_ERR_TOO_LARGE) {
+      range->skipped++;
+      continue; /* Skip too large records.  */
+    }
+    if (rc) break;
+
+    blobtype = blob_get_type(blob);
+    if (blobtype == KEYBOX_BLOBTYPE_HEADER) continue;
+    if (want_blobtype && blobtype != want_blobtype) continue;
+    if (!hd->ephemeral && (blob_get_blob_flags(blob) & 2))
+      continue; /* Not in ephemeral mode but blob is flagged ephemeral.  */
+
+    for (n = 0; n < ndesc; n++) {
+      struct batch_hit_s hit;
+      int match;
+
+      hit.match.descidx = n;
+      hit.match.pk_no = hit.match.uid_no = 0;
+      match = blob_matches(blob, &desc[n], sn_array ? &sn_array[n] : NULL,
+                           &hit.match.pk_no, &hit.match.uid_no);
+      if (match < 0) {
+        rc = GPG_ERR_INV_VALUE;
+        break;
+      }
+      if (!match) continue;
+
+      hit.match.offset = _keybox_get_blob_fileoffset(blob);
+      hit.have_kid = blob_get_first_keyid(blob, hit.kid);
+      range->hits.push_back(hit);
+    }
+    if (rc) break;
+  }
+  _keybox_release_blob(blob);
+  range->err = rc == (gpg_error_t)-1 ? 0 : rc;
+}
+
+/* Search HD for all NDESC descriptors at DESC in one pass, and store
+   an array with every match at R_MATCHES and its length at
+   R_NMATCHES.  The matches are sorted by descriptor and then by file
+   offset.  Unlike keybox_search, a blob is reported for every
+   descriptor it matches, and the skip function of a descriptor only
+   applies to its own matches.  The keybox is split into up to NTHREADS
+   ranges (one per CPU if NTHREADS is 0), which are scanned in
+   parallel.  Finding nothing is not an error.  The array must be
+   released with xfree, and the search position of HD is reset as by
+   keybox_search_reset.  */
+gpg_error_t keybox_search_batch(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
+                                size_t ndesc, keybox_blobtype_t want_blobtype,
+                                int nthreads,
+                                struct keybox_batch_match_s **r_matches,
+                                size_t *r_nmatches, unsigned long *r_skipped) {
+  gpg_error_t rc;
+  size_t n;
+  struct sn_array_s *sn_array = NULL;
+  std::vector<batch_range_s> ranges;
+  std::vector<keybox_batch_match_s> matches;
+
+  if (!hd || !r_matches || !r_nmatches) return GPG_ERR_INV_VALUE;
+  *r_matches = NULL;
+  *r_nmatches = 0;
+
+  keybox_search_reset(hd);
+  if (!hd->fp) {
+    rc = open_file(hd);
+    if (rc) return rc;
+  }
+  _keybox_map_file(hd);
+
+  for (n = 0; n < ndesc; n++)
+    if (desc[n].snlen == -1) {
+      sn_array = (sn_array_s *)xtrycalloc(ndesc, sizeof *sn_array);
+      if (!sn_array) return gpg_error_from_syserror();
+      rc = convert_sn_array(desc, ndesc, sn_array);
+      if (rc) return rc;
+      break;
+    }
+
+  if (nthreads <= 0) nthreads = NeoPG::hardware_threads();
+  if (!hd->map.image)
+    nthreads = 1;
+  else if (hd->map.size / BATCH_MIN_RANGE < (size_t)nthreads)
+    nthreads = hd->map.size / BATCH_MIN_RANGE;
+  if (nthreads < 1) nthreads = 1;
+
+  /* Split the file at blob boundaries into ranges of about the same
+     size.  Walking the length fields is cheap compared to matching.
+     A broken length ends the walk; the last range then reports the
+     error.  */
+  ranges.resize(1);
+  ranges[0].start = 0;
+  if (hd->map.image) {
+    const unsigned char *image = hd->map.image;
+    size_t size = hd->map.size;
+    size_t pos = 0;
+
+    while (ranges.size() < (size_t)nthreads && size - pos >= 5) {
+      size_t len = buf32_to_size_t(image + pos);
+
+      if (len < 5 || len > size - pos) break;
+      pos += len;
+      if (pos >= size / nthreads * ranges.size() && pos < size) {
+        ranges.back().end = pos;
+        ranges.resize(ranges.size() + 1);
+        ranges.back().start = pos;
+      }
+    }
+    ranges.back().end = size;
+  }
+  for (auto &range : ranges) {
+    range.err = 0;
+    range.skipped = 0;
+  }
+
+  NeoPG::parallel_for(ranges.size(), ranges.size(), [&](size_t idx) {
+    batch_scan_range(hd, desc, ndesc, sn_array, want_blobtype, &ranges[idx]);
+  });
+
+  /* The skip functions are not meant to be called concurrently.  */
+  rc = 0;
+  for (auto &range : ranges) {
+    if (!rc) rc = range.err;
+    if (r_skipped) *r_skipped += range.skipped;
+    for (auto &hit : range.hits) {
+      KEYBOX_SEARCH_DESC *d = &desc[hit.match.descidx];
+
+      if (d->skipfnc && hit.have_kid &&
+          d->skipfnc(d->skipfncvalue, hit.kid, hit.match.uid_no))
+        continue;
+      matches.push_back(hit.match);
+    }
+  }
+  std::stable_sort(matches.begin(), matches.end(),
+                   [](const keybox_batch_match_s &a,
+                      const keybox_batch_match_s &b) {
+                     return a.descidx < b.descidx;
+                   });
+
+  if (!rc && !matches.empty()) {
+    *r_matches = (keybox_batch_match_s *)xtrymalloc(matches.size() *
+                                                    sizeof **r_matches);
+    if (!*r_matches)
+      rc = gpg_error_from_syserror();
+    else {
+      memcpy(*r_matches, matches.data(), matches.size() * sizeof **r_matches);
+      *r_nmatches = matches.size();
+    }
+  }
+
+  if (sn_array) release_sn_array(sn_array, ndesc);
+  keybox_search_reset(hd);
+  return rc;
+}
+
 /*
    Functions to return a certificate or a keyblock.  To be used after
    a successful search operation.
@@ -977,7 +1276,91 @@ int keybox_get_flags(KEYBOX_HANDLE hd, int what, int idx, unsigned int *value) {
   return ec ? ec : 0;
 }
 
+/* Return the keys and user IDs of the last found OpenPGP blob at
+ * R_INFO without parsing the keyblock.  The blob records only the
+ * fingerprints, key IDs and user ID strings.  On success the caller
+ * must release *R_INFO with keybox_release_keyinfo.  */
+gpg_error_t keybox_get_keyinfo(KEYBOX_HANDLE hd, keybox_keyinfo_t *r_info) {
+  const unsigned char *buffer;
+  size_t length;
+  size_t pos, off, len, nserial, namelen;
+  size_t nkeys, keyinfolen, nuids, uidinfolen;
+  keybox_keyinfo_t info;
+  char *p;
+  size_t i;
+
+  *r_info = NULL;
+
+  if (!hd) return GPG_ERR_INV_VALUE;
+  if (!hd->found.blob) return GPG_ERR_NOTHING_FOUND;
+
+  if (blob_get_type(hd->found.blob) != KEYBOX_BLOBTYPE_PGP)
+    return GPG_ERR_WRONG_BLOB_TYPE;
+
+  buffer = _keybox_get_blob_image(hd->found.blob, &length);
+  if (length < 40) return GPG_ERR_TOO_SHORT;
+
+  nkeys = get16(buffer + 16);
+  keyinfolen = get16(buffer + 18);
+  if (!nkeys || keyinfolen < 28) return GPG_ERR_INV_OBJ;
+  pos = 20 + keyinfolen * nkeys;
+  if (pos + 2 > length) return GPG_ERR_TOO_SHORT;
+  nserial = get16(buffer + pos);
+  pos += 2 + nserial;
+  if (pos + 4 > length) return GPG_ERR_TOO_SHORT;
+  nuids = get16(buffer + pos);
+  uidinfolen = get16(buffer + pos + 2);
+  if (uidinfolen < 12) return GPG_ERR_INV_OBJ;
+  pos += 4;
+  if (pos + uidinfolen * nuids > length) return GPG_ERR_TOO_SHORT;
+
+  /* Check the offsets and compute the space needed for the names.  */
+  for (i = 0; i < nkeys; i++) {
+    off = get32(buffer + 20 + i * keyinfolen + 20);
+    if (!off || off + 8 > length) return GPG_ERR_INV_OBJ;
+  }
+  namelen = 0;
+  for (i = 0; i < nuids; i++) {
+    off = get32(buffer + pos + i * uidinfolen);
+    len = get32(buffer + pos + i * uidinfolen + 4);
+    if (off > length || len > length - off) return GPG_ERR_TOO_SHORT;
+    namelen += len;
+  }
+
+  info = (keybox_keyinfo_t)xtrymalloc(
+      sizeof *info + nuids * sizeof *info->uids + nkeys * sizeof *info->keys +
+      namelen);
+  if (!info) return gpg_error_from_syserror();
+  info->nkeys = nkeys;
+  info->nuids = nuids;
+  info->uids = (struct keybox_keyinfo_uid_s *)(info + 1);
+  info->keys = (struct keybox_keyinfo_key_s *)(info->uids + nuids);
+  p = (char *)(info->keys + nkeys);
+
+  for (i = 0; i < nkeys; i++) {
+    const unsigned char *keyinfo = buffer + 20 + i * keyinfolen;
+
+    memcpy(info->keys[i].fpr, keyinfo, 20);
+    memcpy(info->keys[i].keyid, buffer + get32(keyinfo + 20), 8);
+  }
+  for (i = 0; i < nuids; i++) {
+    off = get32(buffer + pos + i * uidinfolen);
+    len = get32(buffer + pos + i * uidinfolen + 4);
+    memcpy(p, buffer + off, len);
+    info->uids[i].name = p;
+    info->uids[i].len = len;
+    p += len;
+  }
+
+  *r_info = info;
+  return 0;
+}
+
+/* Release INFO as returned by keybox_get_keyinfo.  */
+void keybox_release_keyinfo(keybox_keyinfo_t info) { xfree(info); }
+
 off_t keybox_offset(KEYBOX_HANDLE hd) {
+  if (hd->map.image) return hd->map.pos;
   if (!hd->fp) return 0;
   return ftello(hd->fp);
 }
@@ -998,6 +1381,11 @@ gpg_error_t keybox_seek(KEYBOX_HANDLE hd, off_t offset) {
     if (err) return err;
   }
 
+  if (hd->map.image) {
+    hd->map.pos = offset;
+    return 0;
+  }
+
   err = fseeko(hd->fp, offset, SEEK_SET);
   hd->error = gpg_error_from_errno(err);
 
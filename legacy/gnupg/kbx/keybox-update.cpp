@@ -23,9 +23,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "../common/host2net.h"
 #include "../common/sysutils.h"
 #include "keybox-defs.h"
@@ -36,6 +40,10 @@
 #define FILECOPY_DELETE 2
 #define FILECOPY_UPDATE 3
 
+#if defined(HAVE_DOSISH_SYSTEM) && !defined(ftruncate)
+#define ftruncate chsize
+#endif
+
 static int create_tmp_file(const char *tempel, char **r_bakfname,
                            char **r_tmpfname, FILE **r_fp) {
   gpg_error_t err;
@@ -112,8 +120,12 @@ static int blob_filecopy(int mode, const char *fname, KEYBOXBLOB blob,
   int rc = 0;
   char *bakfname = NULL;
   char *tmpfname = NULL;
+  char *idxfname = NULL;
   char buffer[4096]; /* (Must be at least 32 bytes) */
   int nread, nbytes;
+  int have_index = 0;
+  off_t blob_offset = 0;
+  KEYBOXBLOB oldblob = NULL;
 
   /* Open the source file. Because we do a rename, we have to check the
      permissions of the file */
@@ -140,6 +152,8 @@ static int blob_filecopy(int mode, const char *fname, KEYBOXBLOB blob,
 
     if (fclose(newfp)) return gpg_error_from_syserror();
 
+    _keybox_index_build(fname);
+
     /*        if (chmod( fname, S_IRUSR | S_IWUSR )) */
     /*          { */
     /*            log_debug ("%s: chmod failed: %s\n", fname, strerror(errno) );
@@ -153,6 +167,7 @@ static int blob_filecopy(int mode, const char *fname, KEYBOXBLOB blob,
     rc = gpg_error_from_syserror();
     goto leave;
   }
+  have_index = _keybox_index_check(fname, fp);
 
   /* Create the new file.  On success NEWFP is initialized.  */
   rc = create_tmp_file(fname, &bakfname, &tmpfname, &newfp);
@@ -180,6 +195,7 @@ static int blob_filecopy(int mode, const char *fname, KEYBOXBLOB blob,
         fclose(newfp);
         goto leave;
       }
+      blob_offset += nread;
     }
     if (ferror(fp)) {
       rc = gpg_error_from_syserror();
@@ -215,13 +231,14 @@ static int blob_filecopy(int mode, const char *fname, KEYBOXBLOB blob,
       goto leave;
     }
 
-    /* Skip this blob. */
-    rc = _keybox_read_blob(NULL, fp, NULL);
+    /* Skip this blob.  It is kept to update the index.  */
+    rc = _keybox_read_blob(&oldblob, fp, NULL);
     if (rc) {
       fclose(fp);
       fclose(newfp);
-      return rc;
+      goto leave;
     }
+    blob_offset = _keybox_get_blob_fileoffset(oldblob);
   }
 
   /* Do an insert or update. */
@@ -230,7 +247,7 @@ static int blob_filecopy(int mode, const char *fname, KEYBOXBLOB blob,
     if (rc) {
       fclose(fp);
       fclose(newfp);
-      return rc;
+      goto leave;
     }
   }
 
@@ -263,14 +280,114 @@ static int blob_filecopy(int mode, const char *fname, KEYBOXBLOB blob,
     goto leave;
   }
 
+  /* The index for the new file is written first and renamed after the
+     keybox.  Failing to write it just leaves the keybox unindexed.  */
+  _keybox_index_prepare(fname, have_index, tmpfname, blob_offset, oldblob,
+                        mode == FILECOPY_DELETE ? NULL : blob, &idxfname);
+
   rc = rename_tmp_file(bakfname, tmpfname, fname, secret);
+  _keybox_index_commit(fname, idxfname, !rc);
 
 leave:
+  _keybox_release_blob(oldblob);
   xfree(bakfname);
   xfree(tmpfname);
   return rc;
 }
 
+/* Append BLOB to the existing keybox FNAME.  This replaces
+   blob_filecopy for all but secret keyboxes.  Returns GPG_ERR_ENOENT
+   if the file does not exist.  */
+static gpg_error_t blob_append(const char *fname, KEYBOXBLOB blob,
+                               int for_openpgp) {
+  unsigned char header[8];
+  gpg_error_t rc = 0;
+  int have_index;
+  off_t off = 0;
+  FILE *fp;
+
+  fp = fopen(fname, "r+b");
+  if (!fp) return errno == ENOENT ? GPG_ERR_ENOENT : gpg_error_from_syserror();
+  have_index = _keybox_index_check(fname, fp);
+
+  /* Make sure that the openpgp flag is set in the header, as
+     blob_filecopy does.  */
+  if (for_openpgp && fread(header, sizeof header, 1, fp) == 1 &&
+      header[4] == KEYBOX_BLOBTYPE_HEADER && !(header[7] & 0x02)) {
+    if (fseeko(fp, 7, SEEK_SET) || putc(header[7] | 0x02, fp) == EOF)
+      rc = gpg_error_from_syserror();
+  }
+
+  if (!rc && (fseeko(fp, 0, SEEK_END) || (off = ftello(fp)) == (off_t)-1))
+    rc = gpg_error_from_syserror();
+  if (!rc) {
+    rc = _keybox_write_blob(blob, fp);
+    if (!rc && fflush(fp)) rc = gpg_error_from_syserror();
+    if (rc) {
+      /* Don't leave a partial blob behind.  */
+      fflush(fp);
+      if (ftruncate(fileno(fp), off))
+        log_error("keybox '%s': can't truncate: %s\n", fname,
+                  strerror(errno));
+    }
+  }
+  if (fclose(fp) && !rc) rc = gpg_error_from_syserror();
+
+  if (rc)
+    _keybox_index_touch(fname, have_index);
+  else
+    _keybox_index_append(fname, have_index, off, blob);
+  return rc;
+}
+
+/* Mark the blob at file offset OFF of the keybox FNAME as deleted.  */
+static gpg_error_t delete_blob_at(const char *fname, off_t off) {
+  gpg_error_t rc;
+  int have_index;
+  FILE *fp;
+
+  fp = fopen(fname, "r+b");
+  if (!fp) return gpg_error_from_syserror();
+  have_index = _keybox_index_check(fname, fp);
+
+  /* The index may keep pointing to the deleted blob; searches verify
+     every candidate anyway.  */
+  if (fseeko(fp, off + 4, SEEK_SET))
+    rc = gpg_error_from_syserror();
+  else if (putc(0, fp) == EOF)
+    rc = gpg_error_from_syserror();
+  else
+    rc = 0;
+
+  if (fclose(fp)) {
+    if (!rc) rc = gpg_error_from_syserror();
+  }
+  _keybox_index_touch(fname, have_index);
+
+  return rc;
+}
+
+/* Insert BLOB into the keybox of HD.  The blob is appended, so that
+   the cost does not depend on the size of the keybox.  Secret
+   keyboxes and new files are still written by blob_filecopy.  */
+static gpg_error_t insert_blob(KEYBOX_HANDLE hd, KEYBOXBLOB blob,
+                               int for_openpgp) {
+  const char *fname = hd->kb->fname;
+  gpg_error_t err = GPG_ERR_ENOENT;
+
+  if (!hd->secret) {
+    err = blob_append(fname, blob, for_openpgp);
+    if (!err && hd->kb->append_only)
+      hd->kb->appended++;
+    else if (!err)
+      _keybox_index_merge_tail(fname, 0);
+  }
+  if (err == GPG_ERR_ENOENT)
+    err = blob_filecopy(FILECOPY_INSERT, fname, blob, hd->secret,
+                        for_openpgp, 0);
+  return err;
+}
+
 /* Insert the OpenPGP keyblock {IMAGE,IMAGELEN} into HD. */
 gpg_error_t keybox_insert_keyblock(KEYBOX_HANDLE hd, const void *image,
                                    size_t imagelen) {
@@ -298,7 +415,7 @@ gpg_error_t keybox_insert_keyblock(KEYBOX_HANDLE hd, const void *image,
       &blob, &info, (const unsigned char *)(image), imagelen, hd->ephemeral);
   _keybox_destroy_openpgp_info(&info);
   if (!err) {
-    err = blob_filecopy(FILECOPY_INSERT, fname, blob, hd->secret, 1, 0);
+    err = insert_blob(hd, blob, 1);
     _keybox_release_blob(blob);
     /*    if (!rc && !hd->secret && kb_offtbl) */
     /*      { */
@@ -315,6 +432,7 @@ gpg_error_t keybox_update_keyblock(KEYBOX_HANDLE hd, const void *image,
   gpg_error_t err;
   const char *fname;
   off_t off;
+  size_t oldlen;
   KEYBOXBLOB blob;
   size_t nparsed;
   struct _keybox_openpgp_info info;
@@ -328,6 +446,7 @@ gpg_error_t keybox_update_keyblock(KEYBOX_HANDLE hd, const void *image,
 
   off = _keybox_get_blob_fileoffset(hd->found.blob);
   if (off == (off_t)-1) return GPG_ERR_GENERAL;
+  _keybox_get_blob_image(hd->found.blob, &oldlen);
 
   /* Close this the file so that we do no mess up the position for a
      next search.  */
@@ -342,8 +461,20 @@ gpg_error_t keybox_update_keyblock(KEYBOX_HANDLE hd, const void *image,
       &blob, &info, (const unsigned char *)(image), imagelen, hd->ephemeral);
   _keybox_destroy_openpgp_info(&info);
 
-  /* Update the keyblock.  */
-  if (!err) {
+  /* Update the keyblock.  The new blob is appended before the old one
+     is marked as deleted in place, so that a crash in between leaves a
+     duplicate instead of losing the key.  The space of the old blob is
+     reclaimed by keybox_compact.  */
+  if (!err && !hd->secret) {
+    err = blob_append(fname, blob, 1);
+    if (!err) err = delete_blob_at(fname, off);
+    if (!err && hd->kb->append_only) {
+      hd->kb->appended++;
+      hd->kb->dead_bytes += oldlen;
+    } else if (!err)
+      _keybox_index_merge_tail(fname, 0);
+    _keybox_release_blob(blob);
+  } else if (!err) {
     err = blob_filecopy(FILECOPY_UPDATE, fname, blob, hd->secret, 1, off);
     _keybox_release_blob(blob);
   }
@@ -368,7 +499,7 @@ int keybox_insert_cert(KEYBOX_HANDLE hd, ksba_cert_t cert,
 
   rc = _keybox_create_x509_blob(&blob, cert, sha1_digest, hd->ephemeral);
   if (!rc) {
-    rc = blob_filecopy(FILECOPY_INSERT, fname, blob, hd->secret, 0, 0);
+    rc = insert_blob(hd, blob, 0);
     _keybox_release_blob(blob);
     /*    if (!rc && !hd->secret && kb_offtbl) */
     /*      { */
@@ -397,6 +528,7 @@ int keybox_set_flags(KEYBOX_HANDLE hd, int what, int idx, unsigned int value) {
   size_t flag_pos, flag_size;
   const unsigned char *buffer;
   size_t length;
+  int have_index = 0;
 
   (void)idx; /* Not yet used.  */
 
@@ -419,6 +551,7 @@ int keybox_set_flags(KEYBOX_HANDLE hd, int what, int idx, unsigned int value) {
   _keybox_close_file(hd);
   fp = fopen(hd->kb->fname, "r+b");
   if (!fp) return gpg_error_from_syserror();
+  have_index = _keybox_index_check(fname, fp);
 
   ec = 0;
   if (fseeko(fp, off, SEEK_SET))
@@ -447,6 +580,7 @@ int keybox_set_flags(KEYBOX_HANDLE hd, int what, int idx, unsigned int value) {
   if (fclose(fp)) {
     if (!ec) ec = gpg_error_from_syserror();
   }
+  _keybox_index_touch(fname, have_index);
 
   return ec;
 }
@@ -454,8 +588,6 @@ int keybox_set_flags(KEYBOX_HANDLE hd, int what, int idx, unsigned int value) {
 int keybox_delete(KEYBOX_HANDLE hd) {
   off_t off;
   const char *fname;
-  FILE *fp;
-  int rc;
 
   if (!hd) return GPG_ERR_INV_VALUE;
   if (!hd->found.blob) return GPG_ERR_NOTHING_FOUND;
@@ -465,24 +597,38 @@ int keybox_delete(KEYBOX_HANDLE hd) {
 
   off = _keybox_get_blob_fileoffset(hd->found.blob);
   if (off == (off_t)-1) return GPG_ERR_GENERAL;
-  off += 4;
 
   _keybox_close_file(hd);
-  fp = fopen(hd->kb->fname, "r+b");
-  if (!fp) return gpg_error_from_syserror();
-
-  if (fseeko(fp, off, SEEK_SET))
-    rc = gpg_error_from_syserror();
-  else if (putc(0, fp) == EOF)
-    rc = gpg_error_from_syserror();
-  else
-    rc = 0;
+  return delete_blob_at(fname, off);
+}
 
-  if (fclose(fp)) {
-    if (!rc) rc = gpg_error_from_syserror();
+/* Set R_EXPIRED if the blob {BUFFER,LENGTH} is flagged as ephemeral
+   and was created before CUT_TIME.  */
+static gpg_error_t check_ephemeral_expired(const unsigned char *buffer,
+                                           size_t length, u32 cut_time,
+                                           int *r_expired) {
+  unsigned int blobflags;
+  size_t pos, size;
+  u32 created_at;
+
+  *r_expired = 0;
+  if (_keybox_get_flag_location(buffer, length, KEYBOX_FLAG_BLOB, &pos,
+                                &size) ||
+      size != 2)
+    return GPG_ERR_BUG;
+  blobflags = buf16_to_uint(buffer + pos);
+  if ((blobflags & KEYBOX_FLAG_BLOB_EPHEMERAL)) {
+    /* This is an ephemeral blob. */
+    if (_keybox_get_flag_location(buffer, length, KEYBOX_FLAG_CREATED_AT,
+                                  &pos, &size) ||
+        size != 4)
+      created_at = 0; /* oops. */
+    else
+      created_at = buf32_to_u32(buffer + pos);
+
+    if (created_at && created_at < cut_time) *r_expired = 1;
   }
-
-  return rc;
+  return 0;
 }
 
 /* Compress the keybox file.  This should be run with the file
@@ -557,10 +703,9 @@ int keybox_compress(KEYBOX_HANDLE hd) {
   skipped_deleted = 0;
   for (rc = 0; !(read_rc = _keybox_read_blob(&blob, fp, &skipped_deleted));
        _keybox_release_blob(blob), blob = NULL) {
-    unsigned int blobflags;
     const unsigned char *buffer;
-    size_t length, pos, size;
-    u32 created_at;
+    size_t length;
+    int expired;
 
     if (skipped_deleted) any_changes = 1;
     buffer = _keybox_get_blob_image(blob, &length);
@@ -586,26 +731,11 @@ int keybox_compress(KEYBOX_HANDLE hd) {
       continue;
     }
 
-    if (_keybox_get_flag_location(buffer, length, KEYBOX_FLAG_BLOB, &pos,
-                                  &size) ||
-        size != 2) {
-      rc = GPG_ERR_BUG;
-      break;
-    }
-    blobflags = buf16_to_uint(buffer + pos);
-    if ((blobflags & KEYBOX_FLAG_BLOB_EPHEMERAL)) {
-      /* This is an ephemeral blob. */
-      if (_keybox_get_flag_location(buffer, length, KEYBOX_FLAG_CREATED_AT,
-                                    &pos, &size) ||
-          size != 4)
-        created_at = 0; /* oops. */
-      else
-        created_at = buf32_to_u32(buffer + pos);
-
-      if (created_at && created_at < cut_time) {
-        any_changes = 1;
-        continue; /* Skip this blob. */
-      }
+    rc = check_ephemeral_expired(buffer, length, cut_time, &expired);
+    if (rc) break;
+    if (expired) {
+      any_changes = 1;
+      continue; /* Skip this blob. */
     }
 
     rc = _keybox_write_blob(blob, newfp);
@@ -629,7 +759,201 @@ int keybox_compress(KEYBOX_HANDLE hd) {
   else
     rc = rename_tmp_file(bakfname, tmpfname, fname, hd->secret);
 
+  /* Rebuild the index if it does not match the compressed file.  */
+  if (!rc && (fp = fopen(fname, "rb"))) {
+    int have_index = _keybox_index_check(fname, fp);
+
+    fclose(fp);
+    if (!have_index) _keybox_index_build(fname);
+  }
+
   xfree(bakfname);
   xfree(tmpfname);
   return rc;
 }
+
+/* A live blob copied by keybox_compact.  */
+struct compact_blob_s {
+  unsigned char fpr[20]; /* Of the primary key, or zero.  */
+  off_t off;
+  size_t len;
+};
+
+static bool compact_blob_less(const compact_blob_s &a,
+                              const compact_blob_s &b) {
+  int cmp = memcmp(a.fpr, b.fpr, sizeof a.fpr);
+
+  return cmp < 0 || (!cmp && a.off < b.off);
+}
+
+/* Rewrite the keybox file with only the live blobs, sorted by the
+   fingerprint of their primary key.  Deleted blobs, expired ephemeral
+   blobs and extra header blobs are dropped, like keybox_compress does,
+   but the file is always rewritten.  The sorted order keeps related
+   blobs close together for searches through the index, which is
+   rebuilt.  On success the number of bytes saved is stored at
+   R_RECLAIMED.  This should be run with the file locked.  */
+gpg_error_t keybox_compact(KEYBOX_HANDLE hd, off_t *r_reclaimed) {
+  gpg_error_t rc;
+  const char *fname;
+  FILE *fp = NULL;
+  FILE *newfp = NULL;
+  char *bakfname = NULL;
+  char *tmpfname = NULL;
+  KEYBOXBLOB blob = NULL;
+  std::vector<compact_blob_s> blobs;
+  std::vector<unsigned char> buffer;
+  off_t oldsize, newsize;
+  int first_blob = 1;
+  u32 cut_time;
+
+  if (r_reclaimed) *r_reclaimed = 0;
+  if (!hd) return GPG_ERR_INV_HANDLE;
+  if (!hd->kb) return GPG_ERR_INV_HANDLE;
+  if (hd->secret) return GPG_ERR_NOT_IMPLEMENTED;
+  fname = hd->kb->fname;
+  if (!fname) return GPG_ERR_INV_HANDLE;
+
+  _keybox_close_file(hd);
+
+  /* Open the source file. Because we do a rename, we have to check the
+     permissions of the file */
+  if (access(fname, W_OK)) return gpg_error_from_syserror();
+
+  fp = fopen(fname, "rb");
+  if (!fp) return gpg_error_from_syserror();
+
+  rc = create_tmp_file(fname, &bakfname, &tmpfname, &newfp);
+  if (rc) {
+    fclose(fp);
+    return rc;
+  }
+
+  /* Collect the live blobs.  _keybox_read_blob skips deleted ones.
+     The header comes first and is written right away.  */
+  cut_time = time(NULL) - 86400;
+  while (!(rc = _keybox_read_blob(&blob, fp, NULL))) {
+    const unsigned char *image;
+    size_t length;
+    int expired;
+
+    image = _keybox_get_blob_image(blob, &length);
+    if (length > 4 && image[4] == KEYBOX_BLOBTYPE_HEADER) {
+      if (first_blob) {
+        _keybox_update_header_blob(blob, hd->for_openpgp);
+        rc = _keybox_write_blob(blob, newfp);
+      }
+    } else {
+      if (first_blob) rc = _keybox_write_header_blob(newfp, hd->for_openpgp);
+      if (!rc) rc = check_ephemeral_expired(image, length, cut_time, &expired);
+      if (!rc && !expired) {
+        compact_blob_s item;
+
+        memset(item.fpr, 0, sizeof item.fpr);
+        if (length >= 40 && buf16_to_uint(image + 16) &&
+            buf16_to_uint(image + 18) >= 28)
+          memcpy(item.fpr, image + 20, sizeof item.fpr);
+        item.off = _keybox_get_blob_fileoffset(blob);
+        item.len = length;
+        blobs.push_back(item);
+      }
+    }
+    first_blob = 0;
+    _keybox_release_blob(blob);
+    blob = NULL;
+    if (rc) goto leave;
+  }
+  if (rc != -1) goto leave;
+  if (first_blob) {
+    rc = _keybox_write_header_blob(newfp, hd->for_openpgp);
+    if (rc) goto leave;
+  }
+
+  oldsize = ftello(fp);
+  if (oldsize == (off_t)-1) {
+    rc = gpg_error_from_syserror();
+    goto leave;
+  }
+
+  /* Copy the blobs in fingerprint order.  */
+  std::sort(blobs.begin(), blobs.end(), compact_blob_less);
+  for (auto &item : blobs) {
+    buffer.resize(item.len);
+    if (fseeko(fp, item.off, SEEK_SET) ||
+        fread(buffer.data(), item.len, 1, fp) != 1 ||
+        fwrite(buffer.data(), item.len, 1, newfp) != 1) {
+      rc = gpg_error_from_syserror();
+      goto leave;
+    }
+  }
+
+  newsize = ftello(newfp);
+  if (newsize == (off_t)-1) {
+    rc = gpg_error_from_syserror();
+    goto leave;
+  }
+  if (fclose(newfp)) {
+    rc = gpg_error_from_syserror();
+    newfp = NULL;
+    goto leave;
+  }
+  newfp = NULL;
+  fclose(fp);
+  fp = NULL;
+
+  /* Whatever happens, the temporary file must not be removed any
+     more: it may be the only copy of the keybox.  */
+  rc = rename_tmp_file(bakfname, tmpfname, fname, hd->secret);
+  xfree(tmpfname);
+  tmpfname = NULL;
+  if (!rc) {
+    _keybox_index_build(fname);
+    if (r_reclaimed) *r_reclaimed = oldsize - newsize;
+  }
+
+leave:
+  _keybox_release_blob(blob);
+  if (fp) fclose(fp);
+  if (newfp) fclose(newfp);
+  if (rc && tmpfname) gnupg_remove(tmpfname);
+  xfree(bakfname);
+  xfree(tmpfname);
+  return rc;
+}
+
+/* Switch the keybox of HD to append only updates if YES is true, or
+   back to normal updates.  Inserted and updated keyblocks are always
+   appended to the file and the replaced ones are marked as deleted,
+   but in append only mode the index is not brought up to date and
+   the space of the replaced blobs is accounted for.  When switching
+   back, the file is compacted if the replaced blobs take up a
+   sizeable part of it; otherwise just the appended blobs are added to
+   the index.  The caller should hold the lock for the whole time.  */
+gpg_error_t keybox_set_append_only(KEYBOX_HANDLE hd, int yes) {
+  gpg_error_t err = 0;
+  struct stat st;
+  KB_NAME kb;
+
+  if (!hd || !hd->kb) return GPG_ERR_INV_HANDLE;
+  kb = hd->kb;
+
+  if (yes) {
+    if (hd->secret) return GPG_ERR_NOT_IMPLEMENTED;
+    kb->append_only = 1;
+    return 0;
+  }
+  if (!kb->append_only) return 0;
+
+  kb->append_only = 0;
+  if (kb->appended) {
+    _keybox_close_file(hd);
+    if (kb->dead_bytes && !stat(kb->fname, &st) &&
+        kb->dead_bytes >= st.st_size / 4)
+      err = keybox_compact(hd, NULL);
+    else
+      _keybox_index_merge_tail(kb->fname, 1);
+  }
+  kb->appended = 0;
+  kb->dead_bytes = 0;
+  return err;
+}
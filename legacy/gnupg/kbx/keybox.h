@@ -25,6 +25,8 @@
 
 #include <ksba.h>
 
+#include <atomic>
+
 typedef struct keybox_handle *KEYBOX_HANDLE;
 
 typedef enum {
@@ -54,6 +56,7 @@ typedef enum {
 /*-- keybox-init.c --*/
 gpg_error_t keybox_register_file(const char *fname, int secret, void **r_token);
 int keybox_is_writable(void *token);
+const char *keybox_get_token_name(void *token);
 
 KEYBOX_HANDLE keybox_new_openpgp(void *token, int secret);
 KEYBOX_HANDLE keybox_new_x509(void *token, int secret);
@@ -62,8 +65,10 @@ void keybox_push_found_state(KEYBOX_HANDLE hd);
 void keybox_pop_found_state(KEYBOX_HANDLE hd);
 const char *keybox_get_resource_name(KEYBOX_HANDLE hd);
 int keybox_set_ephemeral(KEYBOX_HANDLE hd, int yes);
+void keybox_set_cancel(KEYBOX_HANDLE hd, const std::atomic<bool> *cancel);
 
 gpg_error_t keybox_lock(KEYBOX_HANDLE hd, int yes);
+gpg_error_t keybox_lock_shared(KEYBOX_HANDLE hd, int yes);
 
 /*-- keybox-file.c --*/
 /* Fixme: This function does not belong here: Provide a better
@@ -80,6 +85,40 @@ gpg_error_t keybox_search_reset(KEYBOX_HANDLE hd);
 gpg_error_t keybox_search(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
                           size_t ndesc, keybox_blobtype_t want_blobtype,
                           size_t *r_descindex, unsigned long *r_skipped);
+int keybox_search_indexable(KEYBOX_SEARCH_DESC *desc, size_t ndesc);
+
+/* A match returned by keybox_search_batch.  */
+struct keybox_batch_match_s {
+  size_t descidx; /* The index of the matching descriptor.  */
+  off_t offset;   /* The offset of the blob, for use with keybox_seek.  */
+  int pk_no;
+  int uid_no;
+};
+gpg_error_t keybox_search_batch(KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc,
+                                size_t ndesc, keybox_blobtype_t want_blobtype,
+                                int nthreads,
+                                struct keybox_batch_match_s **r_matches,
+                                size_t *r_nmatches, unsigned long *r_skipped);
+
+/* The keys and user IDs recorded in the blob of an OpenPGP keyblock,
+   as returned by keybox_get_keyinfo.  */
+struct keybox_keyinfo_key_s {
+  unsigned char fpr[20];
+  unsigned char keyid[8];
+};
+struct keybox_keyinfo_uid_s {
+  const char *name; /* Not nul terminated.  */
+  size_t len;
+};
+struct keybox_keyinfo_s {
+  unsigned int nkeys; /* The primary key followed by the subkeys.  */
+  unsigned int nuids; /* Only user ID packets, no attributes.  */
+  struct keybox_keyinfo_key_s *keys;
+  struct keybox_keyinfo_uid_s *uids;
+};
+typedef struct keybox_keyinfo_s *keybox_keyinfo_t;
+gpg_error_t keybox_get_keyinfo(KEYBOX_HANDLE hd, keybox_keyinfo_t *r_info);
+void keybox_release_keyinfo(keybox_keyinfo_t info);
 
 off_t keybox_offset(KEYBOX_HANDLE hd);
 gpg_error_t keybox_seek(KEYBOX_HANDLE hd, off_t offset);
@@ -99,6 +138,8 @@ int keybox_set_flags(KEYBOX_HANDLE hd, int what, int idx, unsigned int value);
 
 int keybox_delete(KEYBOX_HANDLE hd);
 int keybox_compress(KEYBOX_HANDLE hd);
+gpg_error_t keybox_compact(KEYBOX_HANDLE hd, off_t *r_reclaimed);
+gpg_error_t keybox_set_append_only(KEYBOX_HANDLE hd, int yes);
 
 /*-- keybox-util.c --*/
 void keybox_set_malloc_hooks(void *(*new_alloc_func)(size_t n),
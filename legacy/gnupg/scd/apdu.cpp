@@ -20,6 +20,7 @@
 
 #include <config.h>
 
+#include <chrono>
 #include <mutex>
 
 #include <assert.h>
@@ -111,7 +112,18 @@ struct reader_table_s {
   size_t atrlen; /* A zero length indicates that the ATR has
                     not yet been read; i.e. the card is not
                     ready for use. */
-  std::mutex lock;
+
+  /* Transfer statistics, logged in verbose mode when the reader is
+     closed.  They give the per-APDU latency of a reader model.  */
+  struct {
+    unsigned long apdus;     /* APDUs sent by the applications.  */
+    unsigned long exchanges; /* Round trips to the reader.  */
+    double seconds;          /* Time spent in these round trips.  */
+  } stats;
+
+  /* Recursive so that apdu_begin_transaction can hold the slot over
+     several APDUs.  */
+  std::recursive_mutex lock;
 };
 typedef struct reader_table_s *reader_table_t;
 
@@ -172,10 +184,22 @@ static int new_reader_slot(void) {
   reader_table[reader].is_spr532 = 0;
   reader_table[reader].pinpad_varlen_supported = 0;
   reader_table[reader].require_get_status = 1;
+  memset(&reader_table[reader].stats, 0, sizeof reader_table[reader].stats);
 
   return reader;
 }
 
+static void dump_reader_stats(int slot) {
+  reader_table_t slotp = reader_table + slot;
+
+  if (!opt.verbose || !slotp->stats.exchanges) return;
+
+  log_info("slot %d (%s): %lu APDUs in %lu exchanges, %.2f ms per exchange\n",
+           slot, slotp->rdrname ? slotp->rdrname : "unknown",
+           slotp->stats.apdus, slotp->stats.exchanges,
+           slotp->stats.seconds * 1000 / slotp->stats.exchanges);
+}
+
 static void dump_reader_status(int slot) {
   if (!opt.verbose) return;
 
@@ -870,6 +894,7 @@ int apdu_close_reader(int slot) {
       log_debug("leave: apdu_close_reader => SW_HOST_NO_DRIVER\n");
     return SW_HOST_NO_DRIVER;
   }
+  dump_reader_stats(slot);
   sw = apdu_disconnect(slot);
   if (sw) {
     /*
@@ -1187,14 +1212,25 @@ int apdu_pinpad_modify(int slot, int klasse, int ins, int p0, int p1,
 static int send_apdu(int slot, unsigned char *apdu, size_t apdulen,
                      unsigned char *buffer, size_t *buflen,
                      pininfo_t *pininfo) {
+  reader_table_t slotp;
+  int rc;
+
   if (slot < 0 || slot >= MAX_READER || !reader_table[slot].used)
     return SW_HOST_NO_DRIVER;
+  slotp = reader_table + slot;
 
-  if (reader_table[slot].send_apdu_reader)
-    return reader_table[slot].send_apdu_reader(slot, apdu, apdulen, buffer,
-                                               buflen, pininfo);
-  else
-    return SW_HOST_NOT_SUPPORTED;
+  if (!slotp->send_apdu_reader) return SW_HOST_NOT_SUPPORTED;
+
+  auto start = std::chrono::steady_clock::now();
+  rc = slotp->send_apdu_reader(slot, apdu, apdulen, buffer, buflen, pininfo);
+  /* Pinpad entry measures the user, not the reader.  */
+  if (!pininfo) {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    slotp->stats.exchanges++;
+    slotp->stats.seconds += elapsed.count();
+  }
+  return rc;
 }
 
 /* Core APDU tranceiver function. Parameters are described at
@@ -1308,6 +1344,7 @@ static int send_le(int slot, int klasse, int ins, int p0, int p1, int lc,
     xfree(result_buffer);
     return sw;
   }
+  reader_table[slot].stats.apdus++;
 
   do {
     if (use_extended_length) {
@@ -1496,6 +1533,25 @@ static int send_le(int slot, int klasse, int ins, int p0, int p1, int lc,
   return sw;
 }
 
+/* Keep SLOT locked for a sequence of APDUs until the matching
+   apdu_end_transaction.  This keeps status polls and other
+   connections from going to the reader between the commands of a
+   multi-APDU operation.  Transactions may be nested.  Do not hold a
+   transaction while waiting for the user.  */
+int apdu_begin_transaction(int slot) {
+  if (slot < 0 || slot >= MAX_READER || !reader_table[slot].used)
+    return SW_HOST_NO_DRIVER;
+
+  return lock_slot(slot);
+}
+
+int apdu_end_transaction(int slot) {
+  if (slot < 0 || slot >= MAX_READER) return SW_HOST_NO_DRIVER;
+
+  unlock_slot(slot);
+  return 0;
+}
+
 /* Send an APDU to the card in SLOT.  The APDU is created from all
    given parameters: KLASSE, INS, P0, P1, LC, DATA, LE.  A value of -1
    for LC won't sent this field and the data field; in this case DATA
@@ -1606,6 +1662,7 @@ int apdu_send_direct(int slot, size_t extended_length,
     xfree(result_buffer);
     return sw;
   }
+  reader_table[slot].stats.apdus++;
 
   resultlen = result_buffer_size;
   rc = send_apdu(slot, apdu, apdulen, result, &resultlen, NULL);
@@ -121,6 +121,8 @@ int apdu_pinpad_verify(int slot, int klasse, int ins, int p0, int p1,
                        pininfo_t *pininfo);
 int apdu_pinpad_modify(int slot, int klasse, int ins, int p0, int p1,
                        pininfo_t *pininfo);
+int apdu_begin_transaction(int slot);
+int apdu_end_transaction(int slot);
 int apdu_send_simple(int slot, int extended_mode, int klasse, int ins, int p0,
                      int p1, int lc, const char *data);
 int apdu_send(int slot, int extended_mode, int klasse, int ins, int p0, int p1,
@@ -22,6 +22,9 @@
 #pragma once
 
 #include <mutex>
+#include <string>
+
+#include <time.h>
 
 #include <ksba.h>
 
@@ -61,6 +64,13 @@ struct app_ctx_s {
   unsigned int did_chv2{0};
   unsigned int did_chv3{0};
   struct app_local_s *app_local{nullptr}; /* Local to the application. */
+
+  /* Used by --balance-cards.  The public keys of the card as returned
+     by readkey, read on first use, and the health of the card.  */
+  std::string balance_key[3];
+  unsigned int failures{0};      /* Card errors in a row.  */
+  time_t unhealthy_until{0};     /* Do not use for balancing before.  */
+
   struct {
     void (*deinit)(app_t app);
     gpg_error_t (*learn_status)(app_t app, ctrl_t ctrl, unsigned int flags);
@@ -161,6 +161,14 @@ struct app_local_s {
                            implicitly available.  */
   } pk[3];
 
+  /* The signature counter (DO 0x93).  It is read from the card once
+     and then incremented locally for each signature we make, so that
+     signing does not need an extra GET DATA.  */
+  struct {
+    unsigned int valid : 1;
+    unsigned long value;
+  } sig_counter;
+
   unsigned char status_indicator; /* The card status indicator.  */
 
   unsigned int manufacturer : 16; /* Manufacturer ID from the s/n.  */
@@ -358,6 +366,8 @@ static void flush_cache_after_error(app_t app) {
   for (i = 0; data_objects[i].tag; i++)
     if (data_objects[i].flush_on_error)
       flush_cache_item(app, data_objects[i].tag);
+
+  if (app->app_local) app->app_local->sig_counter.valid = 0;
 }
 
 /* Flush the entire cache. */
@@ -370,6 +380,7 @@ static void flush_cache(app_t app) {
       xfree(c);
     }
     app->app_local->cache = NULL;
+    app->app_local->sig_counter.valid = 0;
   }
 }
 
@@ -908,6 +919,12 @@ static gpg_error_t do_getattr(app_t app, ctrl_t ctrl, const char *name) {
       char numbuf[50];
 
       sprintf(numbuf, "%lu", convert_sig_counter_value(value, valuelen));
+      if (valuelen == 3) {
+        /* Resync our copy with the card.  */
+        app->app_local->sig_counter.value =
+            convert_sig_counter_value(value, valuelen);
+        app->app_local->sig_counter.valid = 1;
+      }
       send_status_info(ctrl, table[idx].name, numbuf, strlen(numbuf), NULL, 0);
     } else if (table[idx].special == 3) {
       if (valuelen >= 60)
@@ -1530,8 +1547,14 @@ leave:
 
 /* Handle the LEARN command for OpenPGP.  */
 static gpg_error_t do_learn_status(app_t app, ctrl_t ctrl, unsigned int flags) {
+  gpg_error_t err;
+
   (void)flags;
 
+  /* This reads a couple of DOs without user interaction.  */
+  err = iso7816_begin_transaction(app->slot);
+  if (err) return err;
+
   do_getattr(app, ctrl, "EXTCAP");
   do_getattr(app, ctrl, "DISP-NAME");
   do_getattr(app, ctrl, "DISP-LANG");
@@ -1554,6 +1577,8 @@ static gpg_error_t do_learn_status(app_t app, ctrl_t ctrl, unsigned int flags) {
   send_keypair_info(app, ctrl, 3);
   /* Note: We do not send the Cardholder Certificate, because that is
      relatively long and for OpenPGP applications not really needed.  */
+
+  iso7816_end_transaction(app->slot);
   return 0;
 }
 
@@ -3432,16 +3457,26 @@ static unsigned long convert_sig_counter_value(const unsigned char *value,
   return ul;
 }
 
+/* Return the signature counter.  The card is only asked if we do not
+   know the value yet; it is then tracked by do_sign.  */
 static unsigned long get_sig_counter(app_t app) {
   void *relptr;
   unsigned char *value;
   size_t valuelen;
   unsigned long ul;
 
+  if (app->app_local->sig_counter.valid)
+    return app->app_local->sig_counter.value;
+
   relptr = get_one_do(app, 0x0093, &value, &valuelen, NULL);
   if (!relptr) return 0;
   ul = convert_sig_counter_value(value, valuelen);
   xfree(relptr);
+
+  if (valuelen == 3) {
+    app->app_local->sig_counter.value = ul;
+    app->app_local->sig_counter.valid = 1;
+  }
   return ul;
 }
 
@@ -3700,6 +3735,10 @@ static gpg_error_t do_sign(app_t app, const char *keyidstr, int hashalgo,
   }
   rc = iso7816_compute_ds(app->slot, exmode, data, datalen, le_value, outdata,
                           outdatalen);
+  if (!rc && app->app_local->sig_counter.valid)
+    app->app_local->sig_counter.value++;
+  else if (rc)
+    app->app_local->sig_counter.valid = 0;
   return rc;
 }
 
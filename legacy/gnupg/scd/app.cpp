@@ -36,6 +36,14 @@
 static std::mutex app_list_lock;
 static app_t app_top;
 
+/* Protects the balance_key fields of all applications.  It is never
+   held while taking another lock.  */
+static std::mutex balance_lock;
+
+/* The OpenPGP key references used with --balance-cards.  */
+static const char *const balance_keyref[3] = {"OPENPGP.1", "OPENPGP.2",
+                                              "OPENPGP.3"};
+
 static void print_progress_line(void *opaque, const char *what, int pc, int cur,
                                 int tot) {
   ctrl_t ctrl = (ctrl_t)opaque;
@@ -66,6 +74,138 @@ static void unlock_app(app_t app) {
   app->lock.unlock();
 }
 
+/* Like lock_app but return false at once if APP is in use.  */
+static int trylock_app(app_t app, ctrl_t ctrl) {
+  if (!app->lock.try_lock()) return 0;
+  apdu_set_progress_cb(app->slot, print_progress_line, ctrl);
+  return 1;
+}
+
+/* Return a copy of the public key KEYNO of the locked APP, reading it
+   from the card on first use.  An empty string is returned if the
+   key is not available.  */
+static std::string get_balance_key(app_t app, int keyno) {
+  unsigned char *pk;
+  size_t pklen;
+
+  {
+    std::lock_guard<std::mutex> lock(balance_lock);
+    if (!app->balance_key[keyno].empty()) return app->balance_key[keyno];
+  }
+
+  if (!app->fnc.readkey ||
+      app->fnc.readkey(app, 0, balance_keyref[keyno], &pk, &pklen))
+    return std::string();
+
+  std::lock_guard<std::mutex> lock(balance_lock);
+  app->balance_key[keyno].assign((char *)pk, pklen);
+  xfree(pk);
+  return app->balance_key[keyno];
+}
+
+/* Forget the keys of APP after it may have been changed.  */
+static void flush_balance_keys(app_t app) {
+  int i;
+
+  std::lock_guard<std::mutex> lock(balance_lock);
+  for (i = 0; i < 3; i++) app->balance_key[i].clear();
+}
+
+/* Lock and return the application for an operation with the OpenPGP
+   key KEYNO (0..2) which has been requested on APP.  With
+   --balance-cards this may be another OpenPGP card holding the same
+   key: the cards take turns, busy cards are skipped and cards which
+   failed recently are left alone for a while.  If nobody else is
+   available we wait for APP.  KEYIDSTR is updated for use with the
+   returned application.  */
+static app_t lock_balanced_app(app_t app, ctrl_t ctrl, int keyno,
+                               const char **keyidstr) {
+  static unsigned int turn;
+  std::string key;
+  app_t a, pick = NULL;
+  unsigned int count, n, i;
+  time_t now;
+
+  if (!opt.balance_cards || !app->apptype || strcmp(app->apptype, "OPENPGP")) {
+    lock_app(app, ctrl);
+    return app;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(balance_lock);
+    key = app->balance_key[keyno];
+  }
+  if (key.empty()) {
+    /* First use of this card; learn its key.  */
+    lock_app(app, ctrl);
+    get_balance_key(app, keyno);
+    return app;
+  }
+
+  now = time(NULL);
+  {
+    std::lock_guard<std::mutex> lock(app_list_lock);
+    for (count = 0, a = app_top; a; a = a->next) count++;
+
+    for (n = 0; n < count && !pick; n++) {
+      for (i = 0, a = app_top; i < (turn + n) % count; i++) a = a->next;
+
+      if (a->reset_requested || a->unhealthy_until > now) continue;
+      if (a != app && (!a->apptype || strcmp(a->apptype, app->apptype)))
+        continue;
+      if (!trylock_app(a, ctrl)) continue;
+      if (a == app || get_balance_key(a, keyno) == key) {
+        pick = a;
+        turn = (turn + n + 1) % count;
+      } else
+        unlock_app(a);
+    }
+  }
+
+  if (!pick) {
+    lock_app(app, ctrl);
+    return app;
+  }
+
+  if (pick != app) {
+    if (opt.verbose) log_info("balancing operation to slot %d\n", pick->slot);
+    /* The serial number of APP would not match; refer to the key by
+       its number.  "OPENPGP.3" for signing is passed as is.  */
+    if (*keyidstr && strncmp(*keyidstr, "OPENPGP.", 8))
+      *keyidstr = balance_keyref[keyno];
+  }
+  return pick;
+}
+
+/* Record the result ERR of an operation on APP for --balance-cards.
+   APP must be locked.  */
+static void update_health(app_t app, gpg_error_t err) {
+  unsigned int backoff;
+
+  switch (err) {
+    case 0:
+      app->failures = 0;
+      break;
+    case GPG_ERR_CARD:
+    case GPG_ERR_CARD_REMOVED:
+    case GPG_ERR_CARD_NOT_PRESENT:
+    case GPG_ERR_CARD_RESET:
+    case GPG_ERR_EIO:
+    case GPG_ERR_ENODEV:
+    case GPG_ERR_TIMEOUT:
+      if (app->failures < 6) app->failures++;
+      backoff = 1u << app->failures;
+      app->unhealthy_until = time(NULL) + backoff;
+      if (opt.balance_cards)
+        log_info("slot %d failed, not using it for %u seconds\n", app->slot,
+                 backoff);
+      break;
+    default:
+      /* Errors like a wrong PIN do not affect the card's health.  */
+      break;
+  }
+}
+
 /* This function may be called to print information pertaining to the
    current state of this module to the log. */
 void app_dump_state(void) {
@@ -534,10 +674,11 @@ gpg_error_t app_sign(app_t app, ctrl_t ctrl, const char *keyidstr, int hashalgo,
     return GPG_ERR_INV_VALUE;
   if (!app->ref_count) return GPG_ERR_CARD_NOT_INITIALIZED;
   if (!app->fnc.sign) return GPG_ERR_UNSUPPORTED_OPERATION;
-  err = lock_app(app, ctrl);
-  if (err) return err;
+  app = lock_balanced_app(
+      app, ctrl, keyidstr && !strcmp(keyidstr, "OPENPGP.3") ? 2 : 0, &keyidstr);
   err = app->fnc.sign(app, keyidstr, hashalgo, pincb, pincb_arg, indata,
                       indatalen, outdata, outdatalen);
+  update_health(app, err);
   unlock_app(app);
   if (opt.verbose) log_info("operation sign result: %s\n", gpg_strerror(err));
   return err;
@@ -557,10 +698,10 @@ gpg_error_t app_auth(app_t app, ctrl_t ctrl, const char *keyidstr,
     return GPG_ERR_INV_VALUE;
   if (!app->ref_count) return GPG_ERR_CARD_NOT_INITIALIZED;
   if (!app->fnc.auth) return GPG_ERR_UNSUPPORTED_OPERATION;
-  err = lock_app(app, ctrl);
-  if (err) return err;
+  app = lock_balanced_app(app, ctrl, 2, &keyidstr);
   err = app->fnc.auth(app, keyidstr, pincb, pincb_arg, indata, indatalen,
                       outdata, outdatalen);
+  update_health(app, err);
   unlock_app(app);
   if (opt.verbose) log_info("operation auth result: %s\n", gpg_strerror(err));
   return err;
@@ -582,10 +723,10 @@ gpg_error_t app_decipher(app_t app, ctrl_t ctrl, const char *keyidstr,
     return GPG_ERR_INV_VALUE;
   if (!app->ref_count) return GPG_ERR_CARD_NOT_INITIALIZED;
   if (!app->fnc.decipher) return GPG_ERR_UNSUPPORTED_OPERATION;
-  err = lock_app(app, ctrl);
-  if (err) return err;
+  app = lock_balanced_app(app, ctrl, 1, &keyidstr);
   err = app->fnc.decipher(app, keyidstr, pincb, pincb_arg, indata, indatalen,
                           outdata, outdatalen, r_info);
+  update_health(app, err);
   unlock_app(app);
   if (opt.verbose)
     log_info("operation decipher result: %s\n", gpg_strerror(err));
@@ -627,6 +768,7 @@ gpg_error_t app_writekey(app_t app, ctrl_t ctrl, const char *keyidstr,
   if (err) return err;
   err = app->fnc.writekey(app, ctrl, keyidstr, flags, pincb, pincb_arg, keydata,
                           keydatalen);
+  flush_balance_keys(app);
   unlock_app(app);
   if (opt.verbose)
     log_info("operation writekey result: %s\n", gpg_strerror(err));
@@ -647,6 +789,7 @@ gpg_error_t app_genkey(app_t app, ctrl_t ctrl, const char *keynostr,
   if (err) return err;
   err =
       app->fnc.genkey(app, ctrl, keynostr, flags, createtime, pincb, pincb_arg);
+  flush_balance_keys(app);
   unlock_app(app);
   if (opt.verbose) log_info("operation genkey result: %s\n", gpg_strerror(err));
   return err;
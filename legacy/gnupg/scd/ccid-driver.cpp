@@ -769,6 +769,14 @@ static int parse_ccid_descriptor(ccid_driver_t handle,
 
   us = convert_le_u32(buf + 44);
   DEBUGOUT_1("  dwMaxCCIDMsgLen     %5u\n", us);
+  /* Larger messages save round trips for chained APDUs, but they
+     must fit into our buffers.  Some readers report nonsense here.  */
+  if (us > CCID_MAX_BUF)
+    us = CCID_MAX_BUF;
+  else if (us < 10 + 5) {
+    DEBUGOUT("    WARNING: dwMaxCCIDMsgLen too small, assuming 271\n");
+    us = 10 + 261;
+  }
   handle->max_ccid_msglen = us;
 
   DEBUGOUT("  bClassGetResponse    ");
@@ -279,6 +279,15 @@ gpg_error_t iso7816_apdu_direct(int slot, const void *apdudata,
   return map_sw(sw);
 }
 
+/* Send the following commands to SLOT as one transaction; see
+   apdu_begin_transaction.  Each call must be matched by a call to
+   iso7816_end_transaction.  */
+gpg_error_t iso7816_begin_transaction(int slot) {
+  return iso7816_map_sw(apdu_begin_transaction(slot));
+}
+
+void iso7816_end_transaction(int slot) { apdu_end_transaction(slot); }
+
 /* Check whether the reader supports the ISO command code COMMAND on
    the pinpad.  Returns 0 on success.  */
 gpg_error_t iso7816_check_pinpad(int slot, int command, pininfo_t *pininfo) {
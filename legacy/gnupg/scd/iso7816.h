@@ -52,6 +52,8 @@ gpg_error_t iso7816_select_path(int slot, const unsigned short *path,
                                 size_t pathlen);
 gpg_error_t iso7816_list_directory(int slot, int list_dirs,
                                    unsigned char **result, size_t *resultlen);
+gpg_error_t iso7816_begin_transaction(int slot);
+void iso7816_end_transaction(int slot);
 gpg_error_t iso7816_apdu_direct(int slot, const void *apdudata,
                                 size_t apdudatalen, int handle_more,
                                 unsigned char **result, size_t *resultlen);
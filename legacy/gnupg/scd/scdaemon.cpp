@@ -86,6 +86,7 @@ enum cmd_and_opt_values {
   oDisableOpenSC,
   oDisablePinpad,
   oEnablePinpadVarlen,
+  oBalanceCards,
 };
 
 static ARGPARSE_OPTS opts[] = {
@@ -125,6 +126,8 @@ static ARGPARSE_OPTS opts[] = {
 
     ARGPARSE_s_n(oEnablePinpadVarlen, "enable-pinpad-varlen",
                  N_("use variable length input for pinpad")),
+    ARGPARSE_s_n(oBalanceCards, "balance-cards",
+                 N_("spread operations over all cards holding the key")),
     ARGPARSE_s_s(oHomedir, "homedir", "@"),
 
     ARGPARSE_end()};
@@ -443,6 +446,10 @@ next_pass:
         opt.enable_pinpad_varlen = 1;
         break;
 
+      case oBalanceCards:
+        opt.balance_cards = 1;
+        break;
+
       default:
         pargs.err = configfp ? ARGPARSE_PRINT_WARNING : ARGPARSE_PRINT_ERROR;
         break;
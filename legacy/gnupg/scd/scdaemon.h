@@ -49,6 +49,7 @@ struct {
   int disable_pinpad;         /* Do not use a pinpad. */
   int enable_pinpad_varlen;   /* Use variable length input for pinpad. */
   unsigned long card_timeout; /* Disconnect after N seconds of inactivity.  */
+  int balance_cards;          /* Spread operations over cards with a key.  */
 } scd_opt;
 #define opt scd_opt
 
@@ -28,6 +28,10 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <map>
+#include <mutex>
+#include <string>
+
 #include <gcrypt.h>
 #include <ksba.h>
 #include "gpgsm.h"
@@ -52,6 +56,22 @@ struct chain_item_s {
 };
 typedef struct chain_item_s *chain_item_t;
 
+/* The results of gpgsm_validate_chain for sessions which set
+   CACHE_CHAINS, by fingerprint of the certificate and the validation
+   flags.  A result is used for CHAIN_CACHE_TTL seconds.  The check
+   time only matters if the chain model was used.  */
+#define CHAIN_CACHE_TTL 300
+#define CHAIN_CACHE_SIZE 4096
+struct chain_cache_item_s {
+  time_t stored;
+  int rc;
+  ksba_isotime_t checktime;
+  ksba_isotime_t exptime;
+  unsigned int retflags;
+};
+static std::map<std::string, chain_cache_item_s> chain_cache;
+static std::mutex chain_cache_lock;
+
 static int is_root_cert(ksba_cert_t cert, const char *issuerdn,
                         const char *subjectdn);
 
@@ -1500,6 +1520,79 @@ leave:
   return rc;
 }
 
+/* Return the key of CERT validated with FLAGS in the chain cache.  */
+static std::string chain_cache_key(ksba_cert_t cert, unsigned int flags) {
+  unsigned char fpr[20];
+  char numbuf[20];
+
+  gpgsm_get_fingerprint(cert, GCRY_MD_SHA1, fpr, NULL);
+  snprintf(numbuf, sizeof numbuf, "%u", flags);
+  return std::string((const char *)fpr, 20) + numbuf;
+}
+
+/* Look up the result of validating CERT with FLAGS and CHECKTIME in
+   the chain cache.  Returns true if found.  */
+static int chain_cache_get(const std::string &key,
+                           const ksba_isotime_t checktime, int *r_rc,
+                           ksba_isotime_t r_exptime, unsigned int *retflags) {
+  std::lock_guard<std::mutex> lock(chain_cache_lock);
+  ksba_isotime_t current_time;
+  auto it = chain_cache.find(key);
+
+  if (it == chain_cache.end()) return 0;
+  const chain_cache_item_s &item = it->second;
+
+  gnupg_get_isotime(current_time);
+  if (item.stored + CHAIN_CACHE_TTL < time(NULL) ||
+      (!item.rc && *item.exptime && strcmp(item.exptime, current_time) < 0) ||
+      ((item.retflags & VALIDATE_FLAG_CHAIN_MODEL) &&
+       strcmp(item.checktime, checktime ? checktime : ""))) {
+    chain_cache.erase(it);
+    return 0;
+  }
+
+  *r_rc = item.rc;
+  if (r_exptime) gnupg_copy_time(r_exptime, item.exptime);
+  *retflags = item.retflags;
+  return 1;
+}
+
+/* Store the result RC of validating a certificate in the chain
+   cache.  Errors which may go away by themselves, for example if the
+   dirmngr could not be reached, are not cached.  */
+static void chain_cache_put(const std::string &key,
+                            const ksba_isotime_t checktime, int rc,
+                            const ksba_isotime_t exptime,
+                            unsigned int retflags) {
+  std::lock_guard<std::mutex> lock(chain_cache_lock);
+  chain_cache_item_s item;
+
+  switch (rc) {
+    case 0:
+    case GPG_ERR_CERT_EXPIRED:
+    case GPG_ERR_CERT_REVOKED:
+    case GPG_ERR_BAD_CERT:
+    case GPG_ERR_BAD_CERT_CHAIN:
+    case GPG_ERR_BAD_CA_CERT:
+    case GPG_ERR_NOT_TRUSTED:
+      break;
+    default:
+      return;
+  }
+
+  if (chain_cache.size() >= CHAIN_CACHE_SIZE) chain_cache.clear();
+
+  item.stored = time(NULL);
+  item.rc = rc;
+  *item.checktime = 0;
+  if (checktime && strlen(checktime) < sizeof item.checktime)
+    strcpy(item.checktime, checktime);
+  *item.exptime = 0;
+  if (exptime) gnupg_copy_time(item.exptime, exptime);
+  item.retflags = retflags;
+  chain_cache[key] = item;
+}
+
 /* Validate a certificate chain.  For a description see
    do_validate_chain.  This function is a wrapper to handle a root
    certificate with the chain_model flag set.  If RETFLAGS is not
@@ -1520,6 +1613,8 @@ int gpgsm_validate_chain(ctrl_t ctrl, ksba_cert_t cert,
   int rc;
   struct rootca_flags_s rootca_flags;
   unsigned int dummy_retflags;
+  ksba_isotime_t exptime;
+  std::string cache_key;
 
   if (!retflags) retflags = &dummy_retflags;
 
@@ -1534,6 +1629,17 @@ int gpgsm_validate_chain(ctrl_t ctrl, ksba_cert_t cert,
      RETFLAGS.  */
   *retflags = (flags & VALIDATE_FLAG_CHAIN_MODEL);
 
+  /* Messages signed by the same certificate need to validate the
+     chain only once.  */
+  if (ctrl->cache_chains && !listmode) {
+    cache_key = chain_cache_key(cert, flags);
+    if (chain_cache_get(cache_key, checktime, &rc, r_exptime, retflags)) {
+      if (DBG_CACHE) log_debug("validate_chain: cached result: rc=%d\n", rc);
+      goto leave;
+    }
+    if (!r_exptime) r_exptime = exptime;
+  }
+
   memset(&rootca_flags, 0, sizeof rootca_flags);
 
   rc = do_validate_chain(ctrl, cert, checktime, r_exptime, listmode, listfp,
@@ -1549,6 +1655,10 @@ int gpgsm_validate_chain(ctrl_t ctrl, ksba_cert_t cert,
     *retflags |= VALIDATE_FLAG_CHAIN_MODEL;
   }
 
+  if (!cache_key.empty())
+    chain_cache_put(cache_key, checktime, rc, r_exptime, *retflags);
+
+leave:
   if (opt.verbose)
     do_list(0, listmode, listfp, _("validation model used: %s"),
             (*retflags & VALIDATE_FLAG_STEED)
@@ -350,8 +350,16 @@ int gpgsm_add_to_certlist(ctrl_t ctrl, const char *name, int secret,
             xfree(p);
           }
         }
-        if (!rc)
+        if (!rc) {
+          /* A list server adds the same recipients for every message,
+             so reuse their validation results for a while.  Not with
+             OCSP, whose answers are meant to be fresh.  */
+          int cache_chains = ctrl->cache_chains;
+
+          if (!secret && !ctrl->use_ocsp) ctrl->cache_chains = 1;
           rc = gpgsm_validate_chain(ctrl, cert, "", NULL, 0, NULL, 0, NULL);
+          ctrl->cache_chains = cache_chains;
+        }
         if (!rc) {
           certlist_t cl = (certlist_t)xtrycalloc(1, sizeof *cl);
           if (!cl)
@@ -33,6 +33,10 @@
 
 #include <botan/mem_ops.h>
 
+#include <vector>
+
+#include <neopg/utils/workers.h>
+
 #include "../common/compliance.h"
 #include "keydb.h"
 
@@ -59,6 +63,13 @@ struct encrypt_cb_parm_s {
   int buflen;
 };
 
+/* The session key encrypted for one recipient.  */
+struct recipient_job_s {
+  ksba_cert_t cert;
+  unsigned char *encval;
+  int rc;
+};
+
 /* Initialize the data encryption key (session key). */
 static int init_dek(DEK dek) {
   int rc = 0, mode, i;
@@ -193,6 +204,18 @@ static int encrypt_dek(const DEK dek, ksba_cert_t cert,
   return rc;
 }
 
+/* Encrypt DEK for all JOBS with opt.jobs threads.  The public key
+   operations of a message to many recipients take much longer than
+   encrypting the content.  */
+static void encrypt_dek_batch(const DEK dek,
+                              std::vector<recipient_job_s> &jobs) {
+  NeoPG::parallel_for(jobs.size(), opt.jobs > 1 ? opt.jobs : 1,
+                      [&](size_t i) {
+                        recipient_job_s &job = jobs[i];
+                        job.rc = encrypt_dek(dek, job.cert, &job.encval);
+                      });
+}
+
 /* do the actual encryption */
 static int encrypt_cb(void *cb_value, char *buffer, size_t count,
                       size_t *nread) {
@@ -209,20 +232,13 @@ static int encrypt_cb(void *cb_value, char *buffer, size_t count,
   if (count < blklen) BUG();
 
   if (!parm->eof_seen) { /* fillup the buffer */
-    p = parm->buffer;
-    for (n = parm->buflen; n < parm->bufsize; n++) {
-      int c = es_getc(parm->fp);
-      if (c == EOF) {
-        if (es_ferror(parm->fp)) {
-          parm->readerror = errno;
-          return -1;
-        }
-        parm->eof_seen = 1;
-        break;
-      }
-      p[n] = c;
+    if (es_read(parm->fp, parm->buffer + parm->buflen,
+                parm->bufsize - parm->buflen, &n)) {
+      parm->readerror = errno;
+      return -1;
     }
-    parm->buflen = n;
+    if (!n || es_feof(parm->fp)) parm->eof_seen = 1;
+    parm->buflen += n;
   }
 
   n = parm->buflen < count ? parm->buflen : count;
@@ -269,6 +285,7 @@ int gpgsm_encrypt(ctrl_t ctrl, certlist_t recplist, int data_fd,
   certlist_t cl;
   int count;
   int compliant;
+  std::vector<recipient_job_s> jobs;
 
   memset(&encparm, 0, sizeof encparm);
 
@@ -374,8 +391,8 @@ int gpgsm_encrypt(ctrl_t ctrl, certlist_t recplist, int data_fd,
   }
 
   encparm.dek = dek;
-  /* Use a ~8k (AES) or ~4k (3DES) buffer */
-  encparm.bufsize = 500 * dek->ivlen;
+  /* Use a buffer of the I/O buffer size, rounded to whole blocks.  */
+  encparm.bufsize = gnupg_ksba_get_io_buffer_size() / dek->ivlen * dek->ivlen;
   encparm.buffer = (unsigned char *)xtrymalloc(encparm.bufsize);
   if (!encparm.buffer) {
     rc = gpg_error_from_syserror();
@@ -388,7 +405,6 @@ int gpgsm_encrypt(ctrl_t ctrl, certlist_t recplist, int data_fd,
   /* Gather certificates of recipients, encrypt the session key for
      each and store them in the CMS object */
   for (recpno = 0, cl = recplist; cl; recpno++, cl = cl->next) {
-    unsigned char *encval;
     unsigned int nbits;
     int pk_algo;
 
@@ -411,23 +427,31 @@ int gpgsm_encrypt(ctrl_t ctrl, certlist_t recplist, int data_fd,
         !gnupg_pk_is_compliant(CO_DE_VS, pk_algo, NULL, nbits, NULL))
       compliant = 0;
 
-    rc = encrypt_dek(dek, cl->cert, &encval);
+    jobs.push_back({cl->cert, NULL, 0});
+  }
+
+  encrypt_dek_batch(dek, jobs);
+
+  for (recpno = 0; (size_t)recpno < jobs.size(); recpno++) {
+    recipient_job_s &job = jobs[recpno];
+
+    rc = job.rc;
     if (rc) {
       log_error("encryption failed for recipient no. %d: %s\n", recpno,
                 gpg_strerror(rc));
       goto leave;
     }
 
-    err = ksba_cms_add_recipient(cms, cl->cert);
+    err = ksba_cms_add_recipient(cms, job.cert);
     if (err) {
       log_error("ksba_cms_add_recipient failed: %s\n", gpg_strerror(err));
       rc = err;
-      xfree(encval);
       goto leave;
     }
 
-    err = ksba_cms_set_enc_val(cms, recpno, encval);
-    xfree(encval);
+    err = ksba_cms_set_enc_val(cms, recpno, job.encval);
+    xfree(job.encval);
+    job.encval = NULL;
     if (err) {
       log_error("ksba_cms_set_enc_val failed: %s\n", gpg_strerror(err));
       rc = err;
@@ -471,5 +495,6 @@ leave:
   Botan::deallocate_memory(dek, 1, sizeof(*dek));
   es_fclose(data_fp);
   xfree(encparm.buffer);
+  for (auto &job : jobs) xfree(job.encval);
   return rc;
 }
@@ -67,6 +67,7 @@ enum cmd_and_opt_values {
   aDeleteKey,
   aImport,
   aVerify,
+  aVerifyFiles,
   aListExternalKeys,
   aListChain,
   aSendKeys,
@@ -174,7 +175,9 @@ enum cmd_and_opt_values {
   oDisablePubkeyAlgo,
   oIgnoreTimeConflict,
   oNoCommonCertsImport,
-  oIgnoreCertExtension
+  oIgnoreCertExtension,
+  oJobs,
+  oIoBufferSize
 };
 
 static ARGPARSE_OPTS opts[] = {
@@ -190,6 +193,7 @@ static ARGPARSE_OPTS opts[] = {
        cipher")),*/
     ARGPARSE_c(aDecrypt, "decrypt", N_("decrypt data (default)")),
     ARGPARSE_c(aVerify, "verify", N_("verify a signature")),
+    ARGPARSE_c(aVerifyFiles, "verify-files", "@"),
     ARGPARSE_c(aListKeys, "list-keys", N_("list keys")),
     ARGPARSE_c(aListExternalKeys, "list-external-keys",
                N_("list external keys")),
@@ -261,6 +265,8 @@ static ARGPARSE_OPTS opts[] = {
     ARGPARSE_s_n(oEnableOCSP, "enable-ocsp", N_("check validity using OCSP")),
 
     ARGPARSE_s_s(oValidationModel, "validation-model", "@"),
+    ARGPARSE_s_i(oJobs, "jobs", "@"),
+    ARGPARSE_s_i(oIoBufferSize, "io-buffer-size", "@"),
 
     ARGPARSE_s_i(oIncludeCerts, "include-certs",
                  N_("|N|number of certificates to include")),
@@ -871,6 +877,7 @@ next_pass:
       case aSign:
       case aClearsign:
       case aVerify:
+      case aVerifyFiles:
         set_cmd(&cmd, (cmd_and_opt_values)(pargs.r_opt));
         break;
 
@@ -1199,6 +1206,14 @@ next_pass:
         add_to_strlist(&opt.ignored_cert_extensions, pargs.r.ret_str);
         break;
 
+      case oJobs:
+        opt.jobs = pargs.r.ret_int;
+        break;
+
+      case oIoBufferSize:
+        if (pargs.r.ret_int > 0) gnupg_ksba_set_io_buffer_size(pargs.r.ret_int);
+        break;
+
       case oCompliance: {
         struct gnupg_compliance_option compliance_options[] = {
             {"de-vs", CO_DE_VS}};
@@ -1502,6 +1517,10 @@ next_pass:
       es_fclose(fp);
     } break;
 
+    case aVerifyFiles:
+      gpgsm_verify_files(&ctrl, argc, argv);
+      break;
+
     case aDecrypt: {
       estream_t fp = open_es_fwrite(opt.outfile ? opt.outfile : "-");
 
@@ -114,6 +114,8 @@ struct {
   strlist_t ignored_cert_extensions;
 
   enum gnupg_compliance_mode compliance;
+
+  int jobs; /* Number of threads for --verify-files and --import.  */
 } gpgsm_opt;
 #define opt gpgsm_opt
 
@@ -137,6 +139,9 @@ struct {
 /* Forward declaration for an object defined in server.c */
 struct server_local_s;
 
+/* Forward declaration for an object defined in verify.c */
+struct verify_batch_s;
+
 /* Session control object.  This object is passed down to most
    functions.  Note that the default values for it are set by
    gpgsm_init_default_ctrl(). */
@@ -172,6 +177,13 @@ struct server_control_s {
                            1 := chain model,
                            2 := STEED model. */
   int offline;          /* If true gpgsm won't do any network access.  */
+
+  estream_t status_stream; /* If not NULL, status lines are written to
+                              this stream instead of STATUS_FD.  */
+  struct verify_batch_s *batch; /* The batch verification this session
+                                   belongs to, or NULL.  */
+  int cache_chains;             /* Cache the results of
+                                   gpgsm_validate_chain.  */
 };
 typedef struct server_control_s *ctrl_t;
 
@@ -208,6 +220,7 @@ gpg_error_t gpgsm_status_with_err_code(ctrl_t ctrl, int no, const char *text,
 gpg_error_t gpgsm_status_with_error(ctrl_t ctrl, int no, const char *text,
                                     gpg_error_t err);
 gpg_error_t gpgsm_proxy_pinentry_notify(ctrl_t ctrl, const unsigned char *line);
+void gpgsm_status_write(ctrl_t ctrl, const void *buffer, size_t length);
 
 /*-- fingerprint --*/
 unsigned char *gpgsm_get_fingerprint(ksba_cert_t cert, int algo,
@@ -305,6 +318,7 @@ int gpgsm_delete(ctrl_t ctrl, strlist_t names);
 
 /*-- verify.c --*/
 int gpgsm_verify(ctrl_t ctrl, int in_fd, int data_fd, estream_t out_fp);
+int gpgsm_verify_files(ctrl_t ctrl, int nfiles, char **files);
 
 /*-- sign.c --*/
 int gpgsm_get_default_cert(ctrl_t ctrl, ksba_cert_t *r_cert);
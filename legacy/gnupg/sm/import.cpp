@@ -26,10 +26,16 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <new>
+#include <string>
+#include <vector>
+
 #include <gcrypt.h>
 #include <ksba.h>
 #include "gpgsm.h"
 
+#include <neopg/utils/workers.h>
+
 #include "../common/exechelp.h"
 #include "../common/membuf.h"
 #include "../common/sysutils.h"
@@ -59,8 +65,33 @@ struct rsa_secret_key_s {
   gcry_mpi_t u; /* inverse of p mod q. */
 };
 
+/* A PKCS#12 object read by parse_p12.  Decrypting it is the
+   expensive part of the import and does not need the key database or
+   the agent, so that it may be done by another thread.  */
+struct p12_job_s {
+  char *buffer;  /* The object, allocated by get_membuf.  */
+  size_t offset; /* The start of the ASN.1 data in BUFFER.  */
+  size_t length; /* The length of BUFFER.  */
+  char *passphrase;
+
+  /* The results of decrypt_p12.  */
+  gcry_mpi_t *kparms;
+  int bad_pass;
+  std::vector<std::string> certs; /* The DER encoded certificates.  */
+};
+
+/* PKCS#12 objects collected by gpgsm_import_files.  They are
+   decrypted in parallel and then stored in the order they were
+   read.  */
+struct p12_batch_s {
+  std::vector<p12_job_s *> jobs;
+};
+
 static gpg_error_t parse_p12(ctrl_t ctrl, ksba_reader_t reader,
-                             struct stats_s *stats);
+                             struct stats_s *stats,
+                             struct p12_batch_s *batch);
+static gpg_error_t import_p12_batch(ctrl_t ctrl, struct stats_s *stats,
+                                    struct p12_batch_s *batch);
 
 static void print_imported_status(ctrl_t ctrl, ksba_cert_t cert, int new_cert) {
   char *fpr;
@@ -209,7 +240,10 @@ static void check_and_store(ctrl_t ctrl, struct stats_s *stats,
   }
 }
 
-static int import_one(ctrl_t ctrl, struct stats_s *stats, int in_fd) {
+/* Import the certificates and keys from IN_FD.  If BATCH is not
+   NULL, PKCS#12 objects are only read and added to BATCH.  */
+static int import_one(ctrl_t ctrl, struct stats_s *stats, int in_fd,
+                      struct p12_batch_s *batch) {
   int rc;
   gnupg_ksba_io_t b64reader = NULL;
   ksba_reader_t reader;
@@ -282,7 +316,7 @@ static int import_one(ctrl_t ctrl, struct stats_s *stats, int in_fd) {
         any = 1;
     } else if (ct == KSBA_CT_PKCS12) {
       /* This seems to be a pkcs12 message. */
-      rc = parse_p12(ctrl, reader, stats);
+      rc = parse_p12(ctrl, reader, stats, batch);
       if (!rc) any = 1;
     } else if (ct ==
                KSBA_CT_NONE) { /* Failed to identify this message - assume a
@@ -423,7 +457,7 @@ int gpgsm_import(ctrl_t ctrl, int in_fd, int reimport_mode) {
   if (reimport_mode)
     rc = reimport_one(ctrl, &stats, in_fd);
   else
-    rc = import_one(ctrl, &stats, in_fd);
+    rc = import_one(ctrl, &stats, in_fd, NULL);
   print_imported_summary(ctrl, &stats);
   /* If we never printed an error message do it now so that a command
      line invocation will return with an error (log_error keeps a
@@ -437,18 +471,25 @@ int gpgsm_import_files(ctrl_t ctrl, int nfiles, char **files,
                        int (*of)(const char *fname)) {
   int rc = 0;
   struct stats_s stats;
+  struct p12_batch_s batch;
 
   memset(&stats, 0, sizeof stats);
 
   if (!nfiles)
-    rc = import_one(ctrl, &stats, 0);
+    rc = import_one(ctrl, &stats, 0, NULL);
   else {
+    /* With several files, the PKCS#12 objects are imported after all
+       files have been read.  */
     for (; nfiles && !rc; nfiles--, files++) {
       int fd = of(*files);
-      rc = import_one(ctrl, &stats, fd);
+      rc = import_one(ctrl, &stats, fd, &batch);
       close(fd);
       if (rc == -1) rc = 0;
     }
+    if (!batch.jobs.empty()) {
+      gpg_error_t err = import_p12_batch(ctrl, &stats, &batch);
+      if (!rc) rc = err;
+    }
   }
   print_imported_summary(ctrl, &stats);
   /* If we never printed an error message do it now so that a command
@@ -535,108 +576,71 @@ static gpg_error_t rsa_key_check(struct rsa_secret_key_s *skey) {
   return err ? GPG_ERR_BAD_SECKEY : 0;
 }
 
-/* Object passed to store_cert_cb.  */
-struct store_cert_parm_s {
-  gpg_error_t err;       /* First error seen.  */
-  struct stats_s *stats; /* The stats object.  */
-  ctrl_t ctrl;           /* The control object.  */
-};
+/* Helper for p12_parse to collect the DER encoded certificate
+   CERTDATA of length CERTDATALEN.  */
+static void collect_cert_cb(void *opaque, const unsigned char *certdata,
+                            size_t certdatalen) {
+  struct p12_job_s *job = (p12_job_s *)opaque;
 
-/* Helper to store the DER encoded certificate CERTDATA of length
-   CERTDATALEN.  */
-static void store_cert_cb(void *opaque, const unsigned char *certdata,
-                          size_t certdatalen) {
-  struct store_cert_parm_s *parm = (store_cert_parm_s *)opaque;
-  gpg_error_t err;
-  ksba_cert_t cert;
+  job->certs.emplace_back((const char *)certdata, certdatalen);
+}
 
-  err = ksba_cert_new(&cert);
-  if (err) {
-    if (!parm->err) parm->err = err;
-    return;
+static void release_p12_job(struct p12_job_s *job) {
+  int i;
+
+  if (!job) return;
+  if (job->kparms) {
+    for (i = 0; i < 8; i++) gcry_mpi_release(job->kparms[i]);
+    gcry_free(job->kparms);
   }
+  xfree(job->passphrase);
+  xfree(job->buffer);
+  delete job;
+}
 
-  err = ksba_cert_init_from_mem(cert, certdata, certdatalen);
-  if (err) {
-    log_error("failed to parse a certificate: %s\n", gpg_strerror(err));
-    if (!parm->err) parm->err = err;
-  } else
-    check_and_store(parm->ctrl, parm->stats, cert, 0);
-  ksba_cert_release(cert);
+/* Decrypt the PKCS#12 object of JOB.  This may run in any thread.  */
+static void decrypt_p12(struct p12_job_s *job) {
+  job->kparms = p12_parse(
+      (const unsigned char *)(job->buffer + job->offset),
+      job->length - job->offset, job->passphrase, collect_cert_cb, job,
+      &job->bad_pass);
+
+  xfree(job->passphrase);
+  job->passphrase = NULL;
 }
 
-/* Assume that the reader is at a pkcs#12 message and try to import
-   certificates from that stupid format.  We will transfer secret
-   keys to the agent.  */
-static gpg_error_t parse_p12(ctrl_t ctrl, ksba_reader_t reader,
-                             struct stats_s *stats) {
+/* Store the certificates and transfer the secret key of the
+   decrypted PKCS#12 object of JOB to the agent.  */
+static gpg_error_t store_p12(ctrl_t ctrl, struct stats_s *stats,
+                             struct p12_job_s *job) {
   gpg_error_t err = 0;
-  char buffer[1024];
-  size_t ntotal, nread;
-  membuf_t p12mbuf;
-  char *p12buffer = NULL;
-  size_t p12buflen;
-  size_t p12bufoff;
-  gcry_mpi_t *kparms = NULL;
+  gpg_error_t cert_err = 0;
   struct rsa_secret_key_s sk;
-  char *passphrase = NULL;
+  gcry_mpi_t *kparms = job->kparms;
   unsigned char *key = NULL;
   size_t keylen;
   gcry_sexp_t s_key = NULL;
   unsigned char grip[20];
-  int bad_pass = 0;
   int i;
-  struct store_cert_parm_s store_cert_parm;
 
-  memset(&store_cert_parm, 0, sizeof store_cert_parm);
-  store_cert_parm.ctrl = ctrl;
-  store_cert_parm.stats = stats;
+  for (const auto &der : job->certs) {
+    ksba_cert_t cert;
 
-  init_membuf(&p12mbuf, 4096);
-  ntotal = 0;
-  while (!(err = ksba_reader_read(reader, buffer, sizeof buffer, &nread))) {
-    if (ntotal >= MAX_P12OBJ_SIZE * 1024) {
-      /* Arbitrary limit to avoid DoS attacks. */
-      err = GPG_ERR_TOO_LARGE;
-      log_error("pkcs#12 object is larger than %dk\n", MAX_P12OBJ_SIZE);
-      break;
+    err = ksba_cert_new(&cert);
+    if (err) {
+      if (!cert_err) cert_err = err;
+      continue;
     }
-    put_membuf(&p12mbuf, buffer, nread);
-    ntotal += nread;
-  }
-  if (err == GPG_ERR_EOF) err = 0;
-  if (!err) {
-    p12buffer = (char *)get_membuf(&p12mbuf, &p12buflen);
-    if (!p12buffer) err = gpg_error_from_syserror();
-  }
-  if (err) {
-    log_error(_("error reading input: %s\n"), gpg_strerror(err));
-    goto leave;
-  }
-
-  /* GnuPG 2.0.4 accidentally created binary P12 files with the string
-     "The passphrase is %s encoded.\n\n" prepended to the ASN.1 data.
-     We fix that here.  */
-  if (p12buflen > 29 && !memcmp(p12buffer, "The passphrase is ", 18)) {
-    for (p12bufoff = 18; p12bufoff < p12buflen && p12buffer[p12bufoff] != '\n';
-         p12bufoff++)
-      ;
-    p12bufoff++;
-    if (p12bufoff < p12buflen && p12buffer[p12bufoff] == '\n') p12bufoff++;
-  } else
-    p12bufoff = 0;
-
-  err = gpgsm_agent_ask_passphrase(
-      ctrl, "Please enter the passphrase to unprotect the PKCS#12 object.", 0,
-      &passphrase);
-  if (err) goto leave;
 
-  kparms = p12_parse((const unsigned char *)(p12buffer + p12bufoff),
-                     p12buflen - p12bufoff, passphrase, store_cert_cb,
-                     &store_cert_parm, &bad_pass);
-
-  xfree(passphrase);
-  passphrase = NULL;
+    err = ksba_cert_init_from_mem(cert, der.data(), der.size());
+    if (err) {
+      log_error("failed to parse a certificate: %s\n", gpg_strerror(err));
+      if (!cert_err) cert_err = err;
+    } else
+      check_and_store(ctrl, stats, cert, 0);
+    ksba_cert_release(cert);
+  }
+  err = 0;
 
   if (!kparms) {
     log_error("error parsing or decrypting the PKCS#12 file\n");
@@ -674,7 +678,7 @@ static gpg_error_t parse_p12(ctrl_t ctrl, ksba_reader_t reader,
                         sk.n, sk.e, sk.d, sk.p, sk.q, sk.u, NULL);
   for (i = 0; i < 8; i++) gcry_mpi_release(kparms[i]);
   gcry_free(kparms);
-  kparms = NULL;
+  job->kparms = NULL;
   if (err) {
     log_error("failed to create S-expression from key: %s\n",
               gpg_strerror(err));
@@ -716,21 +720,13 @@ static gpg_error_t parse_p12(ctrl_t ctrl, ksba_reader_t reader,
      a possible error from parsing the certificates.  We do this after
      storing the secret keys so that a bad certificate does not
      inhibit our chance to store the secret key.  */
-  if (!err && store_cert_parm.err) err = store_cert_parm.err;
+  if (!err && cert_err) err = cert_err;
 
 leave:
-  if (kparms) {
-    for (i = 0; i < 8; i++) gcry_mpi_release(kparms[i]);
-    gcry_free(kparms);
-    kparms = NULL;
-  }
   xfree(key);
   gcry_sexp_release(s_key);
-  xfree(passphrase);
-  xfree(get_membuf(&p12mbuf, NULL));
-  xfree(p12buffer);
 
-  if (bad_pass) {
+  if (job->bad_pass) {
     /* We only write a plain error code and not direct
        BAD_PASSPHRASE because the pkcs12 parser might issue this
        message multiple times, BAD_PASSPHRASE in general requires a
@@ -742,3 +738,110 @@ leave:
 
   return err;
 }
+
+/* Decrypt the PKCS#12 objects of BATCH with opt.jobs threads and
+   import them.  Returns the first error.  */
+static gpg_error_t import_p12_batch(ctrl_t ctrl, struct stats_s *stats,
+                                    struct p12_batch_s *batch) {
+  gpg_error_t err, first_err = 0;
+
+  NeoPG::parallel_for(batch->jobs.size(), opt.jobs > 1 ? opt.jobs : 1,
+                      [batch](size_t n) { decrypt_p12(batch->jobs[n]); });
+
+  for (auto job : batch->jobs) {
+    err = store_p12(ctrl, stats, job);
+    if (err && !first_err) first_err = err;
+    release_p12_job(job);
+  }
+  batch->jobs.clear();
+  return first_err;
+}
+
+/* Assume that the reader is at a pkcs#12 message and try to import
+   certificates from that stupid format.  We will transfer secret
+   keys to the agent.  If BATCH is not NULL, the message is only read
+   and added to BATCH.  */
+static gpg_error_t parse_p12(ctrl_t ctrl, ksba_reader_t reader,
+                             struct stats_s *stats,
+                             struct p12_batch_s *batch) {
+  gpg_error_t err = 0;
+  char buffer[1024];
+  size_t ntotal, nread;
+  membuf_t p12mbuf;
+  char *p12buffer = NULL;
+  size_t p12buflen;
+  size_t p12bufoff;
+  char *passphrase = NULL;
+  struct p12_job_s *job;
+
+  init_membuf(&p12mbuf, 4096);
+  ntotal = 0;
+  while (!(err = ksba_reader_read(reader, buffer, sizeof buffer, &nread))) {
+    if (ntotal >= MAX_P12OBJ_SIZE * 1024) {
+      /* Arbitrary limit to avoid DoS attacks. */
+      err = GPG_ERR_TOO_LARGE;
+      log_error("pkcs#12 object is larger than %dk\n", MAX_P12OBJ_SIZE);
+      break;
+    }
+    put_membuf(&p12mbuf, buffer, nread);
+    ntotal += nread;
+  }
+  if (err == GPG_ERR_EOF) err = 0;
+  if (!err) {
+    p12buffer = (char *)get_membuf(&p12mbuf, &p12buflen);
+    if (!p12buffer) err = gpg_error_from_syserror();
+  }
+  if (err) {
+    log_error(_("error reading input: %s\n"), gpg_strerror(err));
+    goto leave;
+  }
+
+  /* GnuPG 2.0.4 accidentally created binary P12 files with the string
+     "The passphrase is %s encoded.\n\n" prepended to the ASN.1 data.
+     We fix that here.  */
+  if (p12buflen > 29 && !memcmp(p12buffer, "The passphrase is ", 18)) {
+    for (p12bufoff = 18; p12bufoff < p12buflen && p12buffer[p12bufoff] != '\n';
+         p12bufoff++)
+      ;
+    p12bufoff++;
+    if (p12bufoff < p12buflen && p12buffer[p12bufoff] == '\n') p12bufoff++;
+  } else
+    p12bufoff = 0;
+
+  err = gpgsm_agent_ask_passphrase(
+      ctrl, "Please enter the passphrase to unprotect the PKCS#12 object.", 0,
+      &passphrase);
+  if (err) goto leave;
+
+  job = new (std::nothrow) p12_job_s();
+  if (!job) {
+    err = gpg_error_from_syserror();
+    goto leave;
+  }
+  job->buffer = p12buffer;
+  job->offset = p12bufoff;
+  job->length = p12buflen;
+  job->passphrase = passphrase;
+  p12buffer = NULL;
+  passphrase = NULL;
+
+  if (batch) {
+    try {
+      batch->jobs.push_back(job);
+    } catch (const std::bad_alloc &) {
+      release_p12_job(job);
+      err = GPG_ERR_ENOMEM;
+    }
+    goto leave;
+  }
+
+  decrypt_p12(job);
+  err = store_p12(ctrl, stats, job);
+  release_p12_job(job);
+
+leave:
+  xfree(passphrase);
+  xfree(get_membuf(&p12mbuf, NULL));
+  xfree(p12buffer);
+  return err;
+}
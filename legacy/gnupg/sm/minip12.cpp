@@ -35,6 +35,8 @@
 
 #include <botan/hash.h>
 #include <boost/locale.hpp>
+#include <algorithm>
+#include <vector>
 
 #include "../common/logging.h"
 #include "minip12.h"
@@ -297,6 +299,8 @@ static int string_to_key(int id, char *salt, size_t saltlen, int iter,
   gcry_mpi_t num_b1 = NULL;
   int pwlen;
   unsigned char buf_b[64], buf_i[128], *p;
+  unsigned char hash[20];
+  std::unique_ptr<Botan::HashFunction> sha1;
   size_t cur_keylen;
   size_t n;
 
@@ -322,29 +326,34 @@ static int string_to_key(int id, char *salt, size_t saltlen, int iter,
       j = 0;
   }
 
+  /* BUF_B holds the diversifier D, made of the byte ID.  */
+  sha1 = Botan::HashFunction::create_or_throw("SHA-1");
+  memset(buf_b, id, 64);
   for (;;) {
-    std::unique_ptr<Botan::HashFunction> sha1 =
-        Botan::HashFunction::create_or_throw("SHA-1");
-    Botan::secure_vector<uint8_t> hash;
-
-    uint8_t id_ = (uint8_t)id;
-    for (i = 0; i < 64; i++) sha1->update(&id_, 1);
+    /* The iterations hash the previous digest in place, without
+       creating a new hash context or buffer each time.  */
+    sha1->update(buf_b, 64);
     sha1->update(buf_i, 128);
-    hash = sha1->final();
+    sha1->final(hash);
     for (i = 1; i < iter; i++) {
-      hash = sha1->process(hash.data(), hash.size());
+      sha1->update(hash, 20);
+      sha1->final(hash);
     }
 
     for (i = 0; i < 20 && cur_keylen < req_keylen; i++)
       keybuf[cur_keylen++] = hash[i];
     if (cur_keylen == req_keylen) {
       gcry_mpi_release(num_b1);
+      wipememory(hash, sizeof hash);
+      wipememory(buf_i, sizeof buf_i);
       return 0; /* ready */
     }
 
     /* need more bytes. */
     for (i = 0; i < 64; i++) buf_b[i] = hash[i % 20];
+    gcry_mpi_release(num_b1);
     rc = gcry_mpi_scan(&num_b1, GCRYMPI_FMT_USG, buf_b, 64, &n);
+    memset(buf_b, id, 64);
     if (rc) {
       log_error("gcry_mpi_scan failed: %s\n", gpg_strerror(rc));
       return -1;
@@ -502,10 +511,20 @@ static void decrypt_block(const void *ciphertext, unsigned char *plaintext,
       "IBM850",     "EUC-JP",      "BIG5",       NULL};
   int charsetidx = 0;
   Botan::secure_vector<uint8_t> convertedpw;
+  std::vector<Botan::secure_vector<uint8_t> > tried;
 
-  for (charsetidx = 0; charsets[charsetidx]; charsetidx++) {
+  /* The first entry is NULL as well, so don't stop at it.  */
+  for (charsetidx = 0; !charsetidx || charsets[charsetidx]; charsetidx++) {
     bool original_pw = !charsets[charsetidx];
-    if (!original_pw) convertedpw = convert_password(pw, charsets[charsetidx]);
+    if (!original_pw) {
+      convertedpw = convert_password(pw, charsets[charsetidx]);
+      /* Most passphrases look the same in many charsets; each
+         distinct one needs to go through the KDF only once.  */
+      if (!strcmp((char *)convertedpw.data(), pw) ||
+          std::find(tried.begin(), tried.end(), convertedpw) != tried.end())
+        continue;
+      tried.push_back(convertedpw);
+    }
     memcpy(plaintext, ciphertext, length);
     crypt_block(plaintext, length, salt, saltlen, iter, iv, ivlen,
                 original_pw ? pw : (char *)convertedpw.data(), cipher_algo, 0);
@@ -995,6 +995,36 @@ void gpgsm_server(certlist_t default_recplist) {
   assuan_release(ctx);
 }
 
+/* Return the stream for status output in non-server mode.  */
+static FILE *get_statusfp(ctrl_t ctrl) {
+  if (!statusfp) {
+    if (ctrl->status_fd == 1)
+      statusfp = stdout;
+    else if (ctrl->status_fd == 2)
+      statusfp = stderr;
+    else
+      statusfp = fdopen(ctrl->status_fd, "w");
+
+    if (!statusfp) {
+      log_fatal("can't open fd %d for status output: %s\n", ctrl->status_fd,
+                strerror(errno));
+    }
+  }
+  return statusfp;
+}
+
+/* Write the status lines collected in BUFFER of LENGTH bytes to the
+   status output in non-server mode.  */
+void gpgsm_status_write(ctrl_t ctrl, const void *buffer, size_t length) {
+  FILE *fp;
+
+  if (!ctrl->no_server || ctrl->status_fd == -1 || !length) return;
+
+  fp = get_statusfp(ctrl);
+  fwrite(buffer, length, 1, fp);
+  fflush(fp);
+}
+
 gpg_error_t gpgsm_status2(ctrl_t ctrl, int no, ...) {
   gpg_error_t err = 0;
   va_list arg_ptr;
@@ -1004,37 +1034,43 @@ gpg_error_t gpgsm_status2(ctrl_t ctrl, int no, ...) {
 
   if (ctrl->no_server && ctrl->status_fd == -1)
     ; /* No status wanted. */
-  else if (ctrl->no_server) {
-    if (!statusfp) {
-      if (ctrl->status_fd == 1)
-        statusfp = stdout;
-      else if (ctrl->status_fd == 2)
-        statusfp = stderr;
-      else
-        statusfp = fdopen(ctrl->status_fd, "w");
-
-      if (!statusfp) {
-        log_fatal("can't open fd %d for status output: %s\n", ctrl->status_fd,
-                  strerror(errno));
+  else if (ctrl->no_server && ctrl->status_stream) {
+    estream_t fp = ctrl->status_stream;
+
+    es_fputs("[GNUPG:] ", fp);
+    es_fputs(get_status_string(no), fp);
+
+    while ((text = va_arg(arg_ptr, const char *))) {
+      es_putc(' ', fp);
+      for (; *text; text++) {
+        if (*text == '\n')
+          es_fputs("\\n", fp);
+        else if (*text == '\r')
+          es_fputs("\\r", fp);
+        else
+          es_putc(*(const byte *)text, fp);
       }
     }
+    es_putc('\n', fp);
+  } else if (ctrl->no_server) {
+    FILE *fp = get_statusfp(ctrl);
 
-    fputs("[GNUPG:] ", statusfp);
-    fputs(get_status_string(no), statusfp);
+    fputs("[GNUPG:] ", fp);
+    fputs(get_status_string(no), fp);
 
     while ((text = va_arg(arg_ptr, const char *))) {
-      putc(' ', statusfp);
+      putc(' ', fp);
       for (; *text; text++) {
         if (*text == '\n')
-          fputs("\\n", statusfp);
+          fputs("\\n", fp);
         else if (*text == '\r')
-          fputs("\\r", statusfp);
+          fputs("\\r", fp);
         else
-          putc(*(const byte *)text, statusfp);
+          putc(*(const byte *)text, fp);
       }
     }
-    putc('\n', statusfp);
-    fflush(statusfp);
+    putc('\n', fp);
+    fflush(fp);
   } else {
     assuan_context_t ctx = ctrl->server_local->assuan_ctx;
     char buf[950], *p;
@@ -24,16 +24,47 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include <gcrypt.h>
 #include <ksba.h>
 #include "gpgsm.h"
 
+#include <neopg/utils/workers.h>
+
 #include "../common/compliance.h"
 #include "keydb.h"
 
+/* The state shared by the threads of gpgsm_verify_files.  */
+struct verify_batch_s {
+  /* The key database, the agent and the dirmngr connections are used
+     by one thread at a time.  */
+  std::mutex lock;
+  /* Serializes writing the status lines of a message.  */
+  std::mutex output_lock;
+  std::vector<std::string> files;
+  std::atomic<size_t> next{0};
+};
+
+/* Take the lock of the batch CTRL belongs to before using the key
+   database, the agent or the dirmngr.  */
+static void lock_batch(ctrl_t ctrl, int *locked) {
+  if (ctrl->batch && !*locked) ctrl->batch->lock.lock();
+  *locked = 1;
+}
+
+static void unlock_batch(ctrl_t ctrl, int *locked) {
+  if (ctrl->batch && *locked) ctrl->batch->lock.unlock();
+  *locked = 0;
+}
+
 static char *strtimestamp_r(ksba_isotime_t atime) {
   char *buffer = (char *)xmalloc(15);
 
@@ -90,8 +121,11 @@ int gpgsm_verify(ctrl_t ctrl, int in_fd, int data_fd, estream_t out_fp) {
   int is_detached;
   estream_t in_fp = NULL;
   char *p;
+  int locked = 0;
 
+  lock_batch(ctrl, &locked);
   kh = sm_keydb_new();
+  unlock_batch(ctrl, &locked);
   if (!kh) {
     log_error(_("failed to allocate keyDB handle\n"));
     rc = GPG_ERR_GENERAL;
@@ -315,6 +349,7 @@ int gpgsm_verify(ctrl_t ctrl, int in_fd, int data_fd, estream_t out_fp) {
       sigval_hash_algo = algo; /* Fallback used e.g. with old libksba. */
 
     /* Find the certificate of the signer */
+    lock_batch(ctrl, &locked);
     sm_keydb_search_reset(kh);
     rc = sm_keydb_search_issuer_sn(ctrl, kh, issuer, serial);
     if (rc) {
@@ -337,6 +372,7 @@ int gpgsm_verify(ctrl_t ctrl, int in_fd, int data_fd, estream_t out_fp) {
       log_error("failed to get cert: %s\n", gpg_strerror(rc));
       goto next_signer;
     }
+    unlock_batch(ctrl, &locked);
 
     /* Check compliance.  */
     {
@@ -439,9 +475,11 @@ int gpgsm_verify(ctrl_t ctrl, int in_fd, int data_fd, estream_t out_fp) {
     }
 
     if (DBG_X509) log_debug("signature okay - checking certs\n");
+    lock_batch(ctrl, &locked);
     rc =
         gpgsm_validate_chain(ctrl, cert, *sigtime ? sigtime : "19700101T000000",
                              keyexptime, 0, NULL, 0, &verifyflags);
+    unlock_batch(ctrl, &locked);
     {
       char *fpr, *buf, *tstr;
 
@@ -491,6 +529,7 @@ int gpgsm_verify(ctrl_t ctrl, int in_fd, int data_fd, estream_t out_fp) {
                                                                  : "0 shell");
 
   next_signer:
+    unlock_batch(ctrl, &locked);
     rc = 0;
     xfree(issuer);
     xfree(serial);
@@ -505,7 +544,9 @@ leave:
   ksba_cms_release(cms);
   gnupg_ksba_destroy_reader(b64reader);
   gnupg_ksba_destroy_writer(b64writer);
+  lock_batch(ctrl, &locked);
   sm_keydb_release(kh);
+  unlock_batch(ctrl, &locked);
   gcry_md_close(data_md);
   es_fclose(in_fp);
 
@@ -517,3 +558,89 @@ leave:
 
   return rc;
 }
+
+/* Verify the signature in the file NAME for the batch of CTRL and
+   write its status lines in one piece.  */
+static void verify_one_file(ctrl_t ctrl, const char *name) {
+  estream_t status_fp;
+  void *buffer;
+  size_t length;
+  int fd;
+
+  status_fp = es_fopenmem(0, "w+b");
+  if (!status_fp) {
+    log_error("error allocating memory buffer: %s\n",
+              gpg_strerror(gpg_error_from_syserror()));
+    return;
+  }
+  ctrl->status_stream = status_fp;
+
+  gpgsm_status2(ctrl, STATUS_FILE_START, "1", name, NULL);
+  fd = open(name, O_RDONLY);
+  if (fd == -1) {
+    log_error(_("can't open '%s': %s\n"), name,
+              gpg_strerror(gpg_error_from_syserror()));
+    gpgsm_status2(ctrl, STATUS_FILE_ERROR, "1", name, NULL);
+  } else {
+    gpgsm_verify(ctrl, fd, -1, NULL);
+    close(fd);
+    gpgsm_status(ctrl, STATUS_FILE_DONE, NULL);
+  }
+
+  ctrl->status_stream = NULL;
+  if (es_fclose_snatch(status_fp, &buffer, &length)) {
+    log_error("error snatching memory buffer: %s\n",
+              gpg_strerror(gpg_error_from_syserror()));
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(ctrl->batch->output_lock);
+    gpgsm_status_write(ctrl, buffer, length);
+  }
+  es_free(buffer);
+}
+
+/* Verify the files of BATCH with a copy of the session CTRL.  */
+static void verify_files_worker(ctrl_t ctrl, struct verify_batch_s *batch) {
+  struct server_control_s wctrl = *ctrl;
+  size_t n;
+
+  wctrl.batch = batch;
+  wctrl.cache_chains = 1;
+  while ((n = batch->next++) < batch->files.size())
+    verify_one_file(&wctrl, batch->files[n].c_str());
+}
+
+/* Verify each of the NFILES files with a non-detached signature in
+   FILES or, if NFILES is 0, the files named on the lines read from
+   stdin.  The files are verified by opt.jobs threads, which
+   share the results of the certificate chain validation.  The status
+   lines of each file are written together, starting with FILE_START
+   and ending with FILE_DONE or FILE_ERROR.  */
+int gpgsm_verify_files(ctrl_t ctrl, int nfiles, char **files) {
+  struct verify_batch_s batch;
+  size_t jobs;
+  int i;
+
+  if (!nfiles) {
+    char line[2048];
+    unsigned int lno = 0;
+
+    while (fgets(line, DIM(line), stdin)) {
+      lno++;
+      if (!*line || line[strlen(line) - 1] != '\n') {
+        log_error(_("input line %u too long or missing LF\n"), lno);
+        return GPG_ERR_GENERAL;
+      }
+      line[strlen(line) - 1] = 0;
+      batch.files.push_back(line);
+    }
+  } else
+    for (i = 0; i < nfiles; i++) batch.files.push_back(files[i]);
+
+  jobs = opt.jobs > 1 ? opt.jobs : 1;
+  if (jobs > batch.files.size()) jobs = batch.files.size();
+  NeoPG::run_workers(jobs,
+                     [&](size_t) { verify_files_worker(ctrl, &batch); });
+  return 0;
+}
@@ -0,0 +1,248 @@
+#!/bin/sh
+# NeoPG - end-to-end gpg benchmark
+# Copyright 2018 The NeoPG developers
+#
+# NeoPG is released under the Simplified BSD License (see license.txt)
+
+# Usage: gpg_benchmark.sh NEOPG [OUTPUT]
+#
+# Run sign, verify, encrypt and decrypt over payloads, and import, export,
+# list-keys and check-sigs over keyrings, with "NEOPG gpg2" in throwaway
+# home directories.  The results (latency percentiles, throughput and peak
+# resident set size per operation) are written as JSON to OUTPUT, or to
+# stdout.  Progress goes to stderr.
+#
+# The environment controls what is measured:
+#
+#   BENCH_KEYS      keyring sizes in keys (default: 1000)
+#   BENCH_PAYLOADS  payload sizes, with K, M or G (default: 1K 1M 64M)
+#   BENCH_RUNS      runs per operation (default: 5)
+#   BENCH_CACHE     directory for the generated keyrings (default:
+#                   ~/.cache/neopg-benchmark)
+#
+# For example, BENCH_KEYS="1000 100000 1000000" BENCH_PAYLOADS="1K 1G 10G".
+#
+# The keyrings are generated once and then reused from BENCH_CACHE, so
+# results of different builds are measured against the same keys.
+# Generating a keyring creates every key with gpg2, which takes a long time
+# for a million keys.  Payloads are a fixed text pattern and compression is
+# disabled, so the payload content does not affect the results.  Peak RSS
+# needs GNU time as /usr/bin/time, and is null without it.
+
+set -e
+
+neopg=$1
+output=${2:--}
+
+if [ -z "$neopg" ]; then
+  echo "usage: $0 NEOPG [OUTPUT]" >&2
+  exit 2
+fi
+
+keys=${BENCH_KEYS:-1000}
+payloads=${BENCH_PAYLOADS:-1K 1M 64M}
+runs=${BENCH_RUNS:-5}
+cache=${BENCH_CACHE:-${HOME:-/tmp}/.cache/neopg-benchmark}
+
+work=$(mktemp -d "${TMPDIR:-/tmp}/neopg-benchmark.XXXXXX")
+trap 'rm -rf "$work"' EXIT INT TERM
+mkdir -p "$cache"
+
+if /usr/bin/time -f %M -o "$work/rss" true > /dev/null 2>&1; then
+  gnu_time=yes
+else
+  gnu_time=no
+fi
+
+log() {
+  echo "$*" >&2
+}
+
+now_ns() {
+  date +%s%N
+}
+
+# Print the number of bytes in a size like 64M.
+parse_size() {
+  case $1 in
+    *K) echo $(( ${1%K} * 1024 )) ;;
+    *M) echo $(( ${1%M} * 1024 * 1024 )) ;;
+    *G) echo $(( ${1%G} * 1024 * 1024 * 1024 )) ;;
+    *) echo "$1" ;;
+  esac
+}
+
+# Create an empty home directory and print its name.
+new_home() {
+  home=$(mktemp -d "$work/home.XXXXXX")
+  chmod 700 "$home"
+  echo "$home"
+}
+
+gpg() {
+  home=$1
+  shift
+  "$neopg" gpg2 --homedir "$home" --batch --no-tty --quiet \
+    --trust-model always --compress-algo none "$@"
+}
+
+# Generate a keyring of $1 keys (Ed25519 with a Curve25519 subkey), and
+# store the public keys in the cache.
+make_keyring() {
+  count=$1
+  file=$cache/keyring-$count.gpg
+  [ -s "$file" ] && return
+  log "generating keyring of $count keys (cached in $cache)"
+  home=$(new_home)
+  awk -v count="$count" 'BEGIN {
+    for (i = 0; i < count; i++) {
+      print "Key-Type: EdDSA"
+      print "Key-Curve: ed25519"
+      print "Subkey-Type: ECDH"
+      print "Subkey-Curve: cv25519"
+      printf "Name-Real: Benchmark Key %d\n", i
+      printf "Name-Email: bench-%d@example.org\n", i
+      print "Expire-Date: 0"
+      print "%no-protection"
+      print "%commit"
+    }
+  }' > "$home/params"
+  gpg "$home" --gen-key "$home/params"
+  gpg "$home" --export > "$file.tmp"
+  mv "$file.tmp" "$file"
+  rm -rf "$home"
+}
+
+# Generate the key for the payload operations, and store it in the cache.
+make_signer() {
+  [ -s "$cache/signer.sec.gpg" ] && return
+  log "generating signing key (cached in $cache)"
+  home=$(new_home)
+  gpg "$home" --quick-gen-key --passphrase '' \
+    "Benchmark Signer <signer@example.org>" rsa3072 default never
+  gpg "$home" --export-secret-keys > "$cache/signer.sec.gpg.tmp"
+  mv "$cache/signer.sec.gpg.tmp" "$cache/signer.sec.gpg"
+  rm -rf "$home"
+}
+
+results="$work/results"
+: > "$results"
+
+# Usage: measure OPERATION KEYS BYTES SETUP COMMAND...
+#
+# Run COMMAND $runs times with stdout discarded, preceded by the shell
+# command SETUP (which is not measured), and append the results to
+# $results.  KEYS and BYTES describe the input (BYTES is used for the
+# throughput).
+measure() {
+  operation=$1
+  nkeys=$2
+  bytes=$3
+  setup=$4
+  shift 4
+  log "$operation (keys: $nkeys, bytes: $bytes)"
+  : > "$work/latencies"
+  rss=0
+  i=0
+  while [ "$i" -lt "$runs" ]; do
+    eval "$setup"
+    start=$(now_ns)
+    if [ "$gnu_time" = yes ]; then
+      /usr/bin/time -f %M -o "$work/rss" "$@" > /dev/null
+    else
+      "$@" > /dev/null
+    fi
+    end=$(now_ns)
+    echo $(( (end - start) / 1000 )) >> "$work/latencies"
+    if [ "$gnu_time" = yes ]; then
+      run_rss=$(tail -n 1 "$work/rss")
+      if [ "$run_rss" -gt "$rss" ]; then rss=$run_rss; fi
+    fi
+    i=$((i + 1))
+  done
+  [ "$gnu_time" = yes ] || rss=null
+
+  sort -n "$work/latencies" | awk -v op="$operation" -v keys="$nkeys" \
+    -v bytes="$bytes" -v rss="$rss" '
+    function pct(p,  idx) {
+      idx = int(p / 100 * NR + 0.999999)
+      if (idx < 1) idx = 1
+      return v[idx]
+    }
+    { v[NR] = $1; sum += $1 }
+    END {
+      mean = sum / NR
+      printf "{\"operation\":\"%s\",\"keys\":%d,\"bytes\":%.0f,", op, keys, \
+        bytes
+      printf "\"runs\":%d,\"latency_us\":{\"min\":%d,\"p50\":%d,", NR, \
+        v[1], pct(50)
+      printf "\"p90\":%d,\"p99\":%d,\"max\":%d,\"mean\":%.0f},", pct(90), \
+        pct(99), v[NR], mean
+      if (bytes > 0 && mean > 0)
+        printf "\"mb_per_second\":%.3f,", bytes / mean
+      else
+        printf "\"mb_per_second\":null,"
+      printf "\"peak_rss_kb\":%s}\n", rss
+    }' >> "$results"
+}
+
+# Payload operations, with the signing key as the only key.
+make_signer
+home=$(new_home)
+gpg "$home" --import "$cache/signer.sec.gpg" 2> /dev/null
+for size in $payloads; do
+  bytes=$(parse_size "$size")
+  payload=$work/payload
+  yes "NeoPG benchmark payload 0123456789abcdefghijklmnopqrstuvwxyz" |
+    head -c "$bytes" > "$payload"
+
+  measure sign 1 "$bytes" "" \
+    gpg "$home" --yes -u signer@example.org -o "$payload.sig" \
+    --detach-sign "$payload"
+  measure verify 1 "$bytes" "" \
+    gpg "$home" --verify "$payload.sig" "$payload"
+  measure encrypt 1 "$bytes" "" \
+    gpg "$home" --yes -r signer@example.org -o "$payload.gpg" \
+    --encrypt "$payload"
+  measure decrypt 1 "$bytes" "" \
+    gpg "$home" --yes -o /dev/null --decrypt "$payload.gpg"
+  rm -f "$payload" "$payload.sig" "$payload.gpg"
+done
+rm -rf "$home"
+
+# Keyring operations.  Import starts with an empty keyring every time.
+for count in $keys; do
+  make_keyring "$count"
+  keyring=$cache/keyring-$count.gpg
+  bytes=$(wc -c < "$keyring")
+
+  measure import "$count" "$bytes" 'rm -rf "$work/import"; \
+    mkdir -m 700 "$work/import"' \
+    gpg "$work/import" --import "$keyring"
+  home=$work/import
+  measure export "$count" "$bytes" "" \
+    gpg "$home" --export
+  measure list-keys "$count" 0 "" \
+    gpg "$home" --with-colons --list-keys
+  measure check-sigs "$count" 0 "" \
+    gpg "$home" --with-colons --check-sigs
+  rm -rf "$work/import"
+done
+
+version=$("$neopg" version 2> /dev/null | head -n 1 | tr -d '"\\')
+host=$(uname -srm | tr -d '"\\')
+cpus=$(getconf _NPROCESSORS_ONLN 2> /dev/null || echo null)
+
+report() {
+  printf '{"version":"%s","host":"%s","cpus":%s,"runs":%d,"results":[' \
+    "$version" "$host" "$cpus" "$runs"
+  awk 'NR > 1 { printf "," } { printf "%s", $0 }' "$results"
+  printf ']}\n'
+}
+
+if [ "$output" = - ]; then
+  report
+else
+  report > "$output"
+  log "results written to $output"
+fi
@@ -98,8 +98,92 @@ static int readline(assuan_context_t ctx, char *buf, size_t buflen,
   return 0;
 }
 
-/* Read a line with buffering of partial lines.  Function returns an
-   Assuan error.  */
+/* Pass the line just read to the I/O monitor and log it.  */
+static void monitor_inbound_line(assuan_context_t ctx) {
+  unsigned monitor_result = 0;
+
+  if (ctx->io_monitor)
+    monitor_result = ctx->io_monitor(ctx, ctx->io_monitor_data, 0,
+                                     ctx->inbound.line, ctx->inbound.linelen);
+  if (monitor_result & ASSUAN_IO_MONITOR_IGNORE) {
+    ctx->inbound.linelen = 0;
+    ctx->inbound.frame.ready = 0;
+  }
+
+  if (!(monitor_result & ASSUAN_IO_MONITOR_NOLOG))
+    _assuan_log_control_channel(ctx, 0, NULL, ctx->inbound.line,
+                                ctx->inbound.linelen, NULL, 0);
+}
+
+/* Read the rest of the payload of the binary data frame.  On EAGAIN
+   the frame stays incomplete and the next call continues it.  */
+static gpg_error_t read_frame(assuan_context_t ctx) {
+  char *payload = ctx->inbound.frame.buffer + 2;
+
+  while (ctx->inbound.frame.nread < ctx->inbound.frame.length) {
+    ssize_t n = ctx->engine.readfnc(ctx, payload + ctx->inbound.frame.nread,
+                                    ctx->inbound.frame.length -
+                                        ctx->inbound.frame.nread);
+
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return gpg_error_from_syserror();
+    } else if (!n) {
+      ctx->inbound.eof = 1;
+      ctx->inbound.frame.length = ctx->inbound.frame.nread = 0;
+      _assuan_log_control_channel(ctx, 0, "incomplete frame", NULL, 0, NULL,
+                                  0);
+      return GPG_ERR_ASS_INCOMPLETE_LINE;
+    }
+    ctx->inbound.frame.nread += n;
+  }
+
+  payload[ctx->inbound.frame.length] = 0;
+  ctx->inbound.frame.ready = 1;
+  return 0;
+}
+
+/* The line just read is the header "B <n>" of a binary data frame.
+   Take as much of the payload from the attic as is there and read
+   the rest.  */
+static gpg_error_t start_frame(assuan_context_t ctx) {
+  const char *s = ctx->inbound.line + 2;
+  unsigned long length;
+  char *endp;
+  size_t n;
+
+  if (*s < '0' || *s > '9') return GPG_ERR_ASS_SYNTAX;
+  length = strtoul(s, &endp, 10);
+  if (*endp || !length) return GPG_ERR_ASS_SYNTAX;
+  if (length > FRAMELENGTH) return GPG_ERR_ASS_LINE_TOO_LONG;
+
+  if (!ctx->inbound.frame.buffer) {
+    ctx->inbound.frame.buffer =
+        (char *)_assuan_malloc(ctx, 2 + FRAMELENGTH + 1);
+    if (!ctx->inbound.frame.buffer) return gpg_error_from_syserror();
+    memcpy(ctx->inbound.frame.buffer, "D ", 2);
+  }
+
+  n = ctx->inbound.attic.linelen;
+  if (n > length) n = length;
+  memcpy(ctx->inbound.frame.buffer + 2, ctx->inbound.attic.line, n);
+  ctx->inbound.attic.linelen -= n;
+  memmove(ctx->inbound.attic.line, ctx->inbound.attic.line + n,
+          ctx->inbound.attic.linelen);
+  ctx->inbound.attic.pending =
+      mymemrchr(ctx->inbound.attic.line, '\n', ctx->inbound.attic.linelen)
+          ? 1
+          : 0;
+
+  ctx->inbound.frame.length = length;
+  ctx->inbound.frame.nread = n;
+  return read_frame(ctx);
+}
+
+/* Read a line with buffering of partial lines.  Once binary data has
+   been negotiated, a line "B <n>" is followed by N bytes of payload,
+   which are read into INBOUND.FRAME.  Function returns an Assuan
+   error.  */
 gpg_error_t _assuan_read_line(assuan_context_t ctx) {
   gpg_error_t rc = 0;
   char *line = ctx->inbound.line;
@@ -108,6 +192,16 @@ gpg_error_t _assuan_read_line(assuan_context_t ctx) {
 
   if (ctx->inbound.eof) return GPG_ERR_EOF;
 
+  if (ctx->inbound.frame.nread < ctx->inbound.frame.length) {
+    /* Continue a frame interrupted by EAGAIN.  */
+    rc = read_frame(ctx);
+    if (rc) return rc;
+    monitor_inbound_line(ctx);
+    return 0;
+  }
+  ctx->inbound.frame.ready = 0;
+  ctx->inbound.frame.length = ctx->inbound.frame.nread = 0;
+
   atticlen = ctx->inbound.attic.linelen;
   if (atticlen) {
     memcpy(line, ctx->inbound.attic.line, atticlen);
@@ -158,7 +252,6 @@ gpg_error_t _assuan_read_line(assuan_context_t ctx) {
   if (!endp) endp = (char *)memchr(line, '\n', nread);
 
   if (endp) {
-    unsigned monitor_result;
     int n = endp - line + 1;
 
     if (n < nread)
@@ -177,15 +270,12 @@ gpg_error_t _assuan_read_line(assuan_context_t ctx) {
 
     ctx->inbound.linelen = endp - line;
 
-    monitor_result = 0;
-    if (ctx->io_monitor)
-      monitor_result = ctx->io_monitor(ctx, ctx->io_monitor_data, 0,
-                                       ctx->inbound.line, ctx->inbound.linelen);
-    if (monitor_result & ASSUAN_IO_MONITOR_IGNORE) ctx->inbound.linelen = 0;
+    if (ctx->flags.binary_data && line[0] == 'B' && line[1] == ' ') {
+      rc = start_frame(ctx);
+      if (rc) return rc;
+    }
 
-    if (!(monitor_result & ASSUAN_IO_MONITOR_NOLOG))
-      _assuan_log_control_channel(ctx, 0, NULL, ctx->inbound.line,
-                                  ctx->inbound.linelen, NULL, 0);
+    monitor_inbound_line(ctx);
     return 0;
   } else {
     _assuan_log_control_channel(ctx, 0, "invalid line", NULL, 0, NULL, 0);
@@ -284,8 +374,77 @@ gpg_error_t assuan_write_line(assuan_context_t ctx, const char *line) {
   return _assuan_write_line(ctx, NULL, line, len);
 }
 
+/* Write LENGTH bytes at DATA as one binary data frame.  Returns 0 on
+   success or sets OUTBOUND.DATA.ERROR and returns -1.  */
+static int write_frame(assuan_context_t ctx, const char *data,
+                       size_t length) {
+  char header[30];
+  int headerlen;
+  unsigned int monitor_result;
+
+  headerlen = snprintf(header, sizeof header, "B %u", (unsigned int)length);
+
+  monitor_result = 0;
+  if (ctx->io_monitor)
+    monitor_result =
+        ctx->io_monitor(ctx, ctx->io_monitor_data, 1, header, headerlen);
+  if (!(monitor_result & ASSUAN_IO_MONITOR_NOLOG))
+    _assuan_log_control_channel(ctx, 1, NULL, header, headerlen, NULL, 0);
+  if (monitor_result & ASSUAN_IO_MONITOR_IGNORE) return 0;
+
+  header[headerlen++] = '\n';
+  if (writen(ctx, header, headerlen) || writen(ctx, data, length)) {
+    ctx->outbound.data.error = gpg_error_from_syserror();
+    return -1;
+  }
+  return 0;
+}
+
+/* Write out the data in buffer as binary data frames of up to
+   FRAMELENGTH bytes.  Full frames are written straight from BUFFER,
+   the rest is kept until the frame is full or flushed.  */
+static int write_data_frames(assuan_context_t ctx, const char *buffer,
+                             size_t orig_size) {
+  size_t size = orig_size;
+  size_t n;
+
+  if (ctx->outbound.data.linelen) _assuan_cookie_write_flush(ctx);
+
+  while (size && !ctx->outbound.data.error) {
+    if (!ctx->outbound.data.framelen && size >= FRAMELENGTH) {
+      if (write_frame(ctx, buffer, FRAMELENGTH)) break;
+      buffer += FRAMELENGTH;
+      size -= FRAMELENGTH;
+      continue;
+    }
+
+    if (!ctx->outbound.data.frame) {
+      ctx->outbound.data.frame = (char *)_assuan_malloc(ctx, FRAMELENGTH);
+      if (!ctx->outbound.data.frame) {
+        ctx->outbound.data.error = gpg_error_from_syserror();
+        break;
+      }
+    }
+
+    n = FRAMELENGTH - ctx->outbound.data.framelen;
+    if (n > size) n = size;
+    memcpy(ctx->outbound.data.frame + ctx->outbound.data.framelen, buffer, n);
+    ctx->outbound.data.framelen += n;
+    buffer += n;
+    size -= n;
+
+    if (ctx->outbound.data.framelen == FRAMELENGTH) {
+      ctx->outbound.data.framelen = 0;
+      write_frame(ctx, ctx->outbound.data.frame, FRAMELENGTH);
+    }
+  }
+
+  return ctx->outbound.data.error ? 0 : (int)orig_size;
+}
+
 /* Write out the data in buffer as datalines with line wrapping and
-   percent escaping.  This function is used for GNU's custom streams. */
+   percent escaping, or as binary data frames if the peer agreed to
+   them.  This function is used for GNU's custom streams. */
 int _assuan_cookie_write_data(void *cookie, const char *buffer,
                               size_t orig_size) {
   assuan_context_t ctx = (assuan_context_t)cookie;
@@ -295,6 +454,9 @@ int _assuan_cookie_write_data(void *cookie, const char *buffer,
 
   if (ctx->outbound.data.error) return 0;
 
+  if (ctx->flags.binary_data)
+    return write_data_frames(ctx, buffer, orig_size);
+
   line = ctx->outbound.data.line;
   linelen = ctx->outbound.data.linelen;
   line += linelen;
@@ -358,6 +520,13 @@ int _assuan_cookie_write_flush(void *cookie) {
 
   if (ctx->outbound.data.error) return 0;
 
+  if (ctx->outbound.data.framelen) {
+    size_t framelen = ctx->outbound.data.framelen;
+
+    ctx->outbound.data.framelen = 0;
+    if (write_frame(ctx, ctx->outbound.data.frame, framelen)) return 0;
+  }
+
   line = ctx->outbound.data.line;
   linelen = ctx->outbound.data.linelen;
   line += linelen;
@@ -391,7 +560,9 @@ int _assuan_cookie_write_flush(void *cookie) {
  *
  * This function may be used by the server or the client to send data
  * lines.  The data will be escaped as required by the Assuan protocol
- * and may get buffered until a line is full.  To force sending the
+ * and may get buffered until a line is full.  After
+ * assuan_negotiate_binary_data it is sent unescaped in frames of up to
+ * 64 KiB instead.  To force sending the
  * data out @buffer may be passed as NULL (in which case @length must
  * also be 0); however when used by a client this flush operation does
  * also send the terminating "END" command to terminate the response on
@@ -44,6 +44,12 @@
 
 #define LINELENGTH ASSUAN_LINELENGTH
 
+/* The largest payload of a binary data frame ("B <n>" followed by N
+   raw bytes), which replaces D lines once negotiated with the OPTION
+   command below.  */
+#define FRAMELENGTH 65536
+#define BINARY_DATA_OPTION "assuan-binary-data"
+
 struct cmdtbl_s {
   const char *name;
   assuan_handler_t handler;
@@ -75,6 +81,7 @@ struct assuan_context_s {
     unsigned int convey_comments : 1;
     unsigned int no_logging : 1;
     unsigned int force_close : 1;
+    unsigned int binary_data : 1; /* Peer accepts binary data frames.  */
   } flags;
 
   /* If set, this is called right before logging an I/O line.  */
@@ -135,6 +142,14 @@ struct assuan_context_s {
       int linelen;
       int pending; /* i.e. at least one line is available in the attic */
     } attic;
+    /* The payload of a binary data frame.  The buffer starts with
+       "D " so that the frame can be handed out like a data line.  */
+    struct {
+      char *buffer;
+      size_t length; /* of the payload.  */
+      size_t nread;  /* Less than LENGTH while the frame is read.  */
+      int ready;     /* Set if the last line read was a frame header.  */
+    } frame;
   } inbound;
 
   struct {
@@ -144,6 +159,8 @@ struct assuan_context_s {
       char line[LINELENGTH];
       int linelen;
       int error;
+      char *frame; /* Buffered payload of a binary data frame.  */
+      size_t framelen;
     } data;
   } outbound;
 
@@ -106,6 +106,15 @@ static gpg_error_t std_handler_option(assuan_context_t ctx, char *line) {
                         set_error(ctx, GPG_ERR_ASS_SYNTAX,
                                   "option should not begin with one dash"));
 
+  /* Our own option to switch data to binary frames.  An old server
+     passes it to the application, which either rejects it or replies
+     with a plain OK, so the client keeps using D lines.  */
+  if (!strcmp(key, BINARY_DATA_OPTION)) {
+    gpg_error_t err = assuan_set_okay_line(ctx, BINARY_DATA_OPTION);
+    if (!err) ctx->flags.binary_data = 1;
+    return PROCESS_DONE(ctx, err);
+  }
+
   if (ctx->option_handler_fnc)
     return PROCESS_DONE(ctx, ctx->option_handler_fnc(ctx, key, value));
   return PROCESS_DONE(ctx, 0);
@@ -461,6 +470,11 @@ static gpg_error_t dispatch_command(assuan_context_t ctx, char *line,
   /* Note that as this function is invoked by assuan_process_next as
      well, we need to hide non-critical errors with PROCESS_DONE.  */
 
+  if (ctx->inbound.frame.ready) /* binary data outside of an inquire */
+    return PROCESS_DONE(ctx, handle_data_line(ctx,
+                                              ctx->inbound.frame.buffer + 2,
+                                              ctx->inbound.frame.length));
+
   if (*line == 'D' && line[1] == ' ') /* divert to special handler */
     /* FIXME: Depending on the final implementation of
        handle_data_line, this may be wrong here.  For example, if a
@@ -580,6 +594,7 @@ static gpg_error_t process_next(assuan_context_t ctx) {
 
     ctx->outbound.data.error = 0;
     ctx->outbound.data.linelen = 0;
+    ctx->outbound.data.framelen = 0;
     /* Dispatch command and return reply.  */
     ctx->in_process_next = 1;
     rc = dispatch_command(ctx, ctx->inbound.line, ctx->inbound.linelen);
@@ -637,6 +652,7 @@ static gpg_error_t process_request(assuan_context_t ctx) {
   ctx->in_command = 1;
   ctx->outbound.data.error = 0;
   ctx->outbound.data.linelen = 0;
+  ctx->outbound.data.framelen = 0;
   /* dispatch command and return reply */
   rc = dispatch_command(ctx, ctx->inbound.line, ctx->inbound.linelen);
 
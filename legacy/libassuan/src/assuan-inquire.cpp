@@ -175,6 +175,11 @@ gpg_error_t assuan_inquire(assuan_context_t ctx, const char *keyword,
       rc = GPG_ERR_ASS_CANCELED;
       goto out;
     }
+    if (ctx->inbound.frame.ready && !nodataexpected) {
+      put_membuf(ctx, &mb, ctx->inbound.frame.buffer + 2,
+                 ctx->inbound.frame.length);
+      continue;
+    }
     if ((line[0] != 'D' && line[0] != 'd') || line[1] != ' ' ||
         nodataexpected) {
       rc = GPG_ERR_ASS_UNEXPECTED_CMD;
@@ -252,6 +257,16 @@ gpg_error_t _assuan_inquire_ext_cb(assuan_context_t ctx) {
     goto out;
   }
 
+  if (ctx->inbound.frame.ready && mb) {
+    put_membuf(ctx, mb, ctx->inbound.frame.buffer + 2,
+               ctx->inbound.frame.length);
+    if (mb->too_large) {
+      rc = GPG_ERR_ASS_TOO_MUCH_DATA;
+      goto out;
+    }
+    return 0;
+  }
+
   if ((line[0] != 'D' && line[0] != 'd') || line[1] != ' ' || mb == NULL) {
     rc = GPG_ERR_ASS_UNEXPECTED_CMD;
     goto out;
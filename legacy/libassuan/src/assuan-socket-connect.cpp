@@ -0,0 +1,120 @@
+/* assuan-socket-connect.c - Assuan socket based client
+   Copyright (C) 2002, 2003, 2004, 2009 Free Software Foundation, Inc.
+
+   This file is part of Assuan.
+
+   Assuan is free software; you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   Assuan is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#ifndef HAVE_W32_SYSTEM
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "assuan-defs.h"
+#include "debug.h"
+
+/* Hacks for Slowaris.  */
+#ifndef PF_LOCAL
+#ifdef PF_UNIX
+#define PF_LOCAL PF_UNIX
+#else
+#define PF_LOCAL AF_UNIX
+#endif
+#endif
+#ifndef AF_LOCAL
+#define AF_LOCAL AF_UNIX
+#endif
+
+/* Make a connection to the Unix domain socket NAME and return a new
+   Assuan context in CTX.  SERVER_PID is currently not used but may
+   become handy in the future.  With ASSUAN_SOCKET_CONNECT_FDPASSING
+   in FLAGS, sendmsg and recvmsg are used for passing descriptors.  */
+gpg_error_t assuan_socket_connect(assuan_context_t ctx, const char *name,
+                                  pid_t server_pid, unsigned int flags) {
+#ifdef HAVE_W32_SYSTEM
+  (void)ctx;
+  (void)name;
+  (void)server_pid;
+  (void)flags;
+  return GPG_ERR_NOT_IMPLEMENTED;
+#else
+  gpg_error_t err;
+  struct sockaddr_un srvr_addr;
+  assuan_response_t response;
+  int off;
+  int fd;
+
+  TRACE_BEG2(ctx, ASSUAN_LOG_CTX, "assuan_socket_connect", ctx,
+             "name=%s, flags=0x%x", name ? name : "(null)", flags);
+
+  (void)server_pid;
+
+  if (!ctx || !name) return TRACE_ERR(GPG_ERR_ASS_INV_VALUE);
+  if (strlen(name) + 1 >= sizeof srvr_addr.sun_path)
+    return TRACE_ERR(GPG_ERR_ASS_INV_VALUE);
+
+  fd = _assuan_socket(ctx, PF_LOCAL, SOCK_STREAM, 0);
+  if (fd == -1) {
+    TRACE_LOG1("can't create socket: %s", strerror(errno));
+    return TRACE_ERR(GPG_ERR_ASS_GENERAL);
+  }
+
+  memset(&srvr_addr, 0, sizeof srvr_addr);
+  srvr_addr.sun_family = AF_LOCAL;
+  strcpy(srvr_addr.sun_path, name);
+
+  if (_assuan_connect(ctx, fd, (struct sockaddr *)&srvr_addr,
+                      sizeof srvr_addr) == -1) {
+    TRACE_LOG2("can't connect to `%s': %s", name, strerror(errno));
+    _assuan_close(ctx, fd);
+    return TRACE_ERR(GPG_ERR_ASS_CONNECT_FAILED);
+  }
+
+  ctx->engine.release = _assuan_client_release;
+  ctx->engine.readfnc = _assuan_simple_read;
+  ctx->engine.writefnc = _assuan_simple_write;
+  ctx->engine.sendfd = NULL;
+  ctx->engine.receivefd = NULL;
+  ctx->finish_handler = _assuan_client_finish;
+  ctx->max_accepts = 1;
+  ctx->accept_handler = NULL;
+  ctx->inbound.fd = fd;
+  ctx->outbound.fd = fd;
+  ctx->pid = ASSUAN_INVALID_PID;
+
+  if (flags & ASSUAN_SOCKET_CONNECT_FDPASSING) _assuan_init_uds_io(ctx);
+
+  /* Initial handshake.  */
+  err = _assuan_read_from_server(ctx, &response, &off, 0);
+  if (err)
+    TRACE_LOG1("can't connect to server: %s", gpg_strerror(err));
+  else if (response != ASSUAN_RESPONSE_OK) {
+    TRACE_LOG1("can't connect to server: `%s'", ctx->inbound.line);
+    err = GPG_ERR_ASS_CONNECT_FAILED;
+  }
+
+  if (err) _assuan_reset(ctx);
+  return TRACE_ERR(err);
+#endif /*!HAVE_W32_SYSTEM*/
+}
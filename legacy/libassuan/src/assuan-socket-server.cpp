@@ -0,0 +1,64 @@
+/* assuan-socket-server.c - Assuan socket based server
+   Copyright (C) 2002, 2007, 2009 Free Software Foundation, Inc.
+
+   This file is part of Assuan.
+
+   Assuan is free software; you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as
+   published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   Assuan is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "assuan-defs.h"
+#include "debug.h"
+
+/* Initialize a server for the connection FD, which must have been
+   accepted by the caller already; i.e. ASSUAN_SOCKET_SERVER_ACCEPTED
+   is required in FLAGS.  Each connection gets its own context, so
+   several connections may be served by separate threads.  With
+   ASSUAN_SOCKET_SERVER_FDPASSING, descriptors may be passed over the
+   connection.  The descriptor is closed when CTX is released.  */
+gpg_error_t assuan_init_socket_server(assuan_context_t ctx, assuan_fd_t fd,
+                                      unsigned int flags) {
+  gpg_error_t rc;
+  TRACE_BEG2(ctx, ASSUAN_LOG_CTX, "assuan_init_socket_server", ctx,
+             "fd=0x%x, flags=0x%x", fd, flags);
+
+  if (!(flags & ASSUAN_SOCKET_SERVER_ACCEPTED) || fd == ASSUAN_INVALID_FD)
+    return TRACE_ERR(GPG_ERR_ASS_INV_VALUE);
+
+  rc = _assuan_register_std_commands(ctx);
+  if (rc) return TRACE_ERR(rc);
+
+  ctx->is_server = 1;
+  ctx->engine.release = _assuan_server_release;
+  ctx->engine.readfnc = _assuan_simple_read;
+  ctx->engine.writefnc = _assuan_simple_write;
+  ctx->engine.sendfd = NULL;
+  ctx->engine.receivefd = NULL;
+  ctx->max_accepts = 1;
+  ctx->pid = ASSUAN_INVALID_PID;
+  ctx->accept_handler = NULL;
+  ctx->finish_handler = _assuan_server_finish;
+  ctx->inbound.fd = fd;
+  ctx->outbound.fd = fd;
+
+  if (flags & ASSUAN_SOCKET_SERVER_FDPASSING) _assuan_init_uds_io(ctx);
+
+  return TRACE_SUC();
+}
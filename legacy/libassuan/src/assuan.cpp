@@ -131,10 +131,18 @@ void assuan_release(assuan_context_t ctx) {
   TRACE(ctx, ASSUAN_LOG_CTX, "assuan_release", ctx);
 
   _assuan_reset(ctx);
-  /* None of the members that are our responsibility requires
-     deallocation.  To avoid sensitive data in the line buffers we
-     wipe them out, though.  Note that we can't wipe the entire
-     context because it also has a pointer to the actual free().  */
+  /* Only the frame buffers need to be deallocated.  To avoid
+     sensitive data in them and in the line buffers we wipe them out.
+     Note that we can't wipe the entire context because it also has a
+     pointer to the actual free().  */
+  if (ctx->inbound.frame.buffer) {
+    wipememory(ctx->inbound.frame.buffer, 2 + FRAMELENGTH + 1);
+    _assuan_free(ctx, ctx->inbound.frame.buffer);
+  }
+  if (ctx->outbound.data.frame) {
+    wipememory(ctx->outbound.data.frame, FRAMELENGTH);
+    _assuan_free(ctx, ctx->outbound.data.frame);
+  }
   wipememory(&ctx->inbound, sizeof ctx->inbound);
   wipememory(&ctx->outbound, sizeof ctx->outbound);
   _assuan_free(ctx, ctx);
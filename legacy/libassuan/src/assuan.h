@@ -170,6 +170,10 @@ typedef unsigned int assuan_flag_t;
 #define ASSUAN_NO_LOGGING 5
 /* This flag forces a connection close.  */
 #define ASSUAN_FORCE_CLOSE 6
+/* This flag is set once assuan_negotiate_binary_data succeeded, or
+   the client asked for binary data frames on a server context.  It
+   can only be queried.  */
+#define ASSUAN_BINARY_DATA 7
 
 /* For context CTX, set the flag FLAG to VALUE.  Values for flags
    are usually 1 or 0 but certain flags might allow for other values;
@@ -317,6 +321,12 @@ gpg_error_t assuan_close_output_fd(assuan_context_t ctx);
 gpg_error_t assuan_init_pipe_server(assuan_context_t ctx,
                                     assuan_fd_t filedes[2]);
 
+/*-- assuan-socket-server.c --*/
+#define ASSUAN_SOCKET_SERVER_FDPASSING 1
+#define ASSUAN_SOCKET_SERVER_ACCEPTED 2
+gpg_error_t assuan_init_socket_server(assuan_context_t ctx, assuan_fd_t fd,
+                                      unsigned int flags);
+
 /*-- assuan-pipe-connect.c --*/
 #define ASSUAN_PIPE_CONNECT_FDPASSING 1
 #define ASSUAN_PIPE_CONNECT_DETACHED 128
@@ -325,6 +335,11 @@ gpg_error_t assuan_pipe_connect(assuan_context_t ctx, const char *name,
                                 void (*atfork)(void *, int), void *atforkvalue,
                                 unsigned int flags);
 
+/*-- assuan-socket-connect.c --*/
+#define ASSUAN_SOCKET_CONNECT_FDPASSING 1
+gpg_error_t assuan_socket_connect(assuan_context_t ctx, const char *name,
+                                  pid_t server_pid, unsigned int flags);
+
 /*-- context.c --*/
 pid_t assuan_get_pid(assuan_context_t ctx);
 
@@ -353,6 +368,17 @@ gpg_error_t assuan_transact(
     gpg_error_t (*inquire_cb)(void *, const char *), void *inquire_cb_arg,
     gpg_error_t (*status_cb)(void *, const char *), void *status_cb_arg);
 
+/* Send several simple commands at once and read their responses in
+   order.  */
+gpg_error_t assuan_transact_pipelined(
+    assuan_context_t ctx, const char *const *commands, int ncommands,
+    gpg_error_t *r_errors, gpg_error_t (*status_cb)(void *, const char *),
+    void *status_cb_arg);
+
+/* Ask the server to send and accept data in binary frames instead of
+   escaped D lines.  An old server leaves the connection unchanged.  */
+gpg_error_t assuan_negotiate_binary_data(assuan_context_t ctx);
+
 /*-- assuan-inquire.c --*/
 gpg_error_t assuan_inquire(assuan_context_t ctx, const char *keyword,
                            unsigned char **r_buffer, size_t *r_length,
@@ -57,7 +57,8 @@ void _assuan_client_release(assuan_context_t ctx) {
   _assuan_client_finish(ctx);
 }
 
-/* This function also does deescaping for data lines.  */
+/* This function also does deescaping for data lines.  A binary data
+   frame is returned like a data line.  */
 gpg_error_t assuan_client_read_response(assuan_context_t ctx, char **line_r,
                                         int *linelen_r) {
   gpg_error_t rc;
@@ -76,6 +77,12 @@ gpg_error_t assuan_client_read_response(assuan_context_t ctx, char **line_r,
     linelen = ctx->inbound.linelen;
   } while (!linelen);
 
+  if (ctx->inbound.frame.ready) {
+    *line_r = ctx->inbound.frame.buffer;
+    *linelen_r = ctx->inbound.frame.length + 2;
+    return 0;
+  }
+
   /* For data lines, we deescape immediately.  The user will never
      have to worry about it.  */
   if (linelen >= 1 && line[0] == 'D' && line[1] == ' ') {
@@ -204,8 +211,13 @@ again:
                                 ctx->flags.convey_comments);
   if (rc) return rc; /* error reading from server */
 
-  line = ctx->inbound.line + off;
-  linelen = ctx->inbound.linelen - off;
+  if (ctx->inbound.frame.ready) {
+    line = ctx->inbound.frame.buffer + off;
+    linelen = ctx->inbound.frame.length + 2 - off;
+  } else {
+    line = ctx->inbound.line + off;
+    linelen = ctx->inbound.linelen - off;
+  }
 
   if (response == ASSUAN_RESPONSE_ERROR)
     rc = atoi(line);
@@ -254,3 +266,90 @@ again:
 
   return rc;
 }
+
+/* Send the NCOMMANDS lines in COMMANDS to the server without waiting
+   and then read the responses, which come back in the same order.
+   This saves a round-trip per command for simple setup commands.
+   Status lines are passed to STATUS_CB.  A command which sends data
+   fails with GPG_ERR_ASS_NO_DATA_CB.  Only the last command may
+   inquire anything; the inquiry is answered with END and the command
+   fails with GPG_ERR_ASS_NO_INQUIRE_CB.  An inquiry from an earlier
+   command would be answered by the commands already sent, so it is
+   returned as a connection error.
+
+   If R_ERRORS is not NULL, the result of each command is stored
+   there and only errors from the connection are returned.  Otherwise
+   the first error of any command is returned.  */
+gpg_error_t assuan_transact_pipelined(
+    assuan_context_t ctx, const char *const *commands, int ncommands,
+    gpg_error_t *r_errors, gpg_error_t (*status_cb)(void *, const char *),
+    void *status_cb_arg) {
+  gpg_error_t rc, err, pending, first = 0;
+  assuan_response_t response;
+  int off, i;
+  char *line;
+
+  if (!ctx || ncommands < 0) return GPG_ERR_ASS_INV_VALUE;
+
+  for (i = 0; i < ncommands; i++) {
+    rc = assuan_write_line(ctx, commands[i]);
+    if (rc) return rc;
+  }
+
+  pending = 0;
+  for (i = 0; i < ncommands;) {
+    rc = _assuan_read_from_server(ctx, &response, &off, 0);
+    if (rc) return rc;
+    line = ctx->inbound.line + off;
+
+    if (response == ASSUAN_RESPONSE_OK)
+      err = pending;
+    else if (response == ASSUAN_RESPONSE_ERROR)
+      err = atoi(line);
+    else {
+      if (response == ASSUAN_RESPONSE_STATUS) {
+        if (status_cb && !pending) pending = status_cb(status_cb_arg, line);
+      } else if (response == ASSUAN_RESPONSE_INQUIRE) {
+        if (i < ncommands - 1) return GPG_ERR_ASS_NO_INQUIRE_CB;
+        rc = assuan_write_line(ctx, "END");
+        if (rc) return rc;
+        if (!pending) pending = GPG_ERR_ASS_NO_INQUIRE_CB;
+      } else if (!pending)
+        pending = GPG_ERR_ASS_NO_DATA_CB;
+      continue;
+    }
+
+    if (r_errors) r_errors[i] = err;
+    if (!first) first = err;
+    pending = 0;
+    i++;
+  }
+
+  return r_errors ? 0 : first;
+}
+
+/* Ask the server to switch data to binary frames.  A server which
+   knows the option replies with "OK assuan-binary-data"; an old one
+   rejects it or replies with a plain OK, and data stays in D lines.
+   Only I/O errors are returned.  */
+gpg_error_t assuan_negotiate_binary_data(assuan_context_t ctx) {
+  gpg_error_t rc;
+  assuan_response_t response;
+  int off;
+
+  if (!ctx || ctx->is_server) return GPG_ERR_ASS_INV_VALUE;
+  if (ctx->flags.binary_data) return 0;
+
+  rc = assuan_write_line(ctx, "OPTION " BINARY_DATA_OPTION);
+  if (rc) return rc;
+
+  do
+    rc = _assuan_read_from_server(ctx, &response, &off, 0);
+  while (!rc && response == ASSUAN_RESPONSE_STATUS);
+  if (rc) return rc;
+
+  if (response == ASSUAN_RESPONSE_OK &&
+      !strcmp(ctx->inbound.line + off, BINARY_DATA_OPTION))
+    ctx->flags.binary_data = 1;
+  return 0;
+}
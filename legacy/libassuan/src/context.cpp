@@ -104,9 +104,14 @@ int assuan_get_flag(assuan_context_t ctx, assuan_flag_t flag) {
     case ASSUAN_FORCE_CLOSE:
       res = ctx->flags.force_close;
       break;
+
+    case ASSUAN_BINARY_DATA:
+      res = ctx->flags.binary_data;
+      break;
   }
 
-  return TRACE_SUC1("flag_value=%i", res);
+  TRACE_SUC1("flag_value=%i", res);
+  return res;
 }
 
 /* Same as assuan_set_flag (ctx, ASSUAN_CONFIDENTIAL, 1).  */
@@ -32,6 +32,7 @@
 #endif /*HAVE_GETRLIMIT*/
 #if __linux__
 #include <dirent.h>
+#include <sys/syscall.h>
 #endif /*__linux__ */
 
 #include "assuan-defs.h"
@@ -196,6 +197,54 @@ static int get_max_fds(void) {
   return max_fds;
 }
 
+/* Close the file descriptors FIRST to LAST, or all from FIRST on if
+ * LAST is -1.  MAX_FD caches the result of get_max_fds and is
+ * initialized to -1 by the caller; it is only needed if the system
+ * can't close a range of descriptors at once.  */
+static void close_fd_range(int first, int last, int *max_fd) {
+  int fd;
+
+  if (last != -1 && last < first) return;
+
+#if defined(__linux__) && defined(SYS_close_range)
+  /* Linux 5.9 and later.  */
+  if (!syscall(SYS_close_range, (unsigned int)first,
+               last == -1 ? ~0U : (unsigned int)last, 0))
+    return;
+#elif defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || \
+    defined(__sun)
+  if (last == -1) {
+    closefrom(first);
+    return;
+  }
+#endif
+
+  if (*max_fd == -1) *max_fd = get_max_fds();
+  if (last == -1 || last >= *max_fd) last = *max_fd - 1;
+  for (fd = first; fd <= last; fd++) close(fd);
+}
+
+/* Close all file descriptors except for stdin, stdout, stderr and
+ * those in the list FD_CHILD_LIST, which is terminated by -1 and may
+ * be NULL.  The list is not sorted, so the gaps between its entries
+ * are found by looking for the next larger one each time.  */
+static void close_unused_fds(assuan_fd_t *fd_child_list) {
+  assuan_fd_t *fdp;
+  int first = STDERR_FILENO + 1;
+  int next;
+  int max_fd = -1;
+
+  for (;;) {
+    next = -1;
+    if (fd_child_list)
+      for (fdp = fd_child_list; *fdp != -1; fdp++)
+        if (*fdp >= first && (next == -1 || *fdp < next)) next = *fdp;
+    close_fd_range(first, next == -1 ? -1 : next - 1, &max_fd);
+    if (next == -1) break;
+    first = next + 1;
+  }
+}
+
 int __assuan_spawn(assuan_context_t ctx, pid_t *r_pid, const char *name,
                    const char **argv, assuan_fd_t fd_in, assuan_fd_t fd_out,
                    assuan_fd_t *fd_child_list,
@@ -208,8 +257,6 @@ int __assuan_spawn(assuan_context_t ctx, pid_t *r_pid, const char *name,
 
   if (pid == 0) {
     /* Child process (server side).  */
-    int i;
-    int n;
     char errbuf[512];
     int *fdp;
     int fdnul;
@@ -260,17 +307,7 @@ int __assuan_spawn(assuan_context_t ctx, pid_t *r_pid, const char *name,
 
     /* Close all files which will not be duped and are not in the
        fd_child_list. */
-    n = get_max_fds();
-    for (i = 0; i < n; i++) {
-      if (i == STDIN_FILENO || i == STDOUT_FILENO || i == STDERR_FILENO)
-        continue;
-      fdp = fd_child_list;
-      if (fdp) {
-        while (*fdp != -1 && *fdp != i) fdp++;
-      }
-
-      if (!(fdp && *fdp != -1)) close(i);
-    }
+    close_unused_fds(fd_child_list);
     gpg_err_set_errno(0);
 
     if (!name) {
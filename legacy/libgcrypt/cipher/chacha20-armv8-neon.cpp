@@ -0,0 +1,110 @@
+/* chacha20-armv8-neon.c - ARMv8 NEON ChaCha20
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * As in chacha20-intel-simd.c, vector register J holds word J of four
+ * consecutive blocks.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chacha20-internal.h"
+#include "g10lib.h"
+
+#ifdef USE_CHACHA20_NEON
+
+#include <arm_neon.h>
+
+#define ROL(a, n) vsriq_n_u32(vshlq_n_u32(a, n), a, 32 - (n))
+#define ROL16(a) vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(a)))
+
+#define QUARTERROUND(a, b, c, d)          \
+  do {                                    \
+    a = vaddq_u32(a, b);                  \
+    d = ROL16(veorq_u32(d, a));           \
+    c = vaddq_u32(c, d);                  \
+    b = ROL(veorq_u32(b, c), 12);         \
+    a = vaddq_u32(a, b);                  \
+    d = ROL(veorq_u32(d, a), 8);          \
+    c = vaddq_u32(c, d);                  \
+    b = ROL(veorq_u32(b, c), 7);          \
+  } while (0)
+
+/* Encrypt NBLKS blocks, four at a time.  The caller must have checked
+   for HWF_ARM_NEON.  */
+unsigned int _gcry_chacha20_neon_blocks4(u32 *input, byte *dst,
+                                         const byte *src, size_t nblks) {
+  uint32x4_t x[16], s[16];
+  uint32x4x2_t t0, t1;
+  u32 lo[4], hi[4];
+  int i, round, g;
+
+  for (; nblks >= 4; nblks -= 4) {
+    chacha20_counters(input, lo, hi, 4);
+    for (i = 0; i < 16; i++) s[i] = vdupq_n_u32(input[i]);
+    s[12] = vld1q_u32(lo);
+    s[13] = vld1q_u32(hi);
+    for (i = 0; i < 16; i++) x[i] = s[i];
+
+    for (round = 0; round < 20; round += 2) {
+      QUARTERROUND(x[0], x[4], x[8], x[12]);
+      QUARTERROUND(x[1], x[5], x[9], x[13]);
+      QUARTERROUND(x[2], x[6], x[10], x[14]);
+      QUARTERROUND(x[3], x[7], x[11], x[15]);
+      QUARTERROUND(x[0], x[5], x[10], x[15]);
+      QUARTERROUND(x[1], x[6], x[11], x[12]);
+      QUARTERROUND(x[2], x[7], x[8], x[13]);
+      QUARTERROUND(x[3], x[4], x[9], x[14]);
+    }
+
+    for (i = 0; i < 16; i++) x[i] = vaddq_u32(x[i], s[i]);
+
+    /* Transpose words 4G to 4G + 3 of the four blocks.  */
+    for (g = 0; g < 4; g++) {
+      uint32x4_t blk[4];
+      int b;
+
+      t0 = vtrnq_u32(x[4 * g], x[4 * g + 1]);
+      t1 = vtrnq_u32(x[4 * g + 2], x[4 * g + 3]);
+      blk[0] = vcombine_u32(vget_low_u32(t0.val[0]), vget_low_u32(t1.val[0]));
+      blk[1] = vcombine_u32(vget_low_u32(t0.val[1]), vget_low_u32(t1.val[1]));
+      blk[2] =
+          vcombine_u32(vget_high_u32(t0.val[0]), vget_high_u32(t1.val[0]));
+      blk[3] =
+          vcombine_u32(vget_high_u32(t0.val[1]), vget_high_u32(t1.val[1]));
+      for (b = 0; b < 4; b++) {
+        const byte *in = src + 64 * b + 16 * g;
+        byte *out = dst + 64 * b + 16 * g;
+        vst1q_u8(out, veorq_u8(vld1q_u8(in), vreinterpretq_u8_u32(blk[b])));
+      }
+    }
+
+    src += 4 * 64;
+    dst += 4 * 64;
+  }
+
+  /* Clear the key stream from the registers and the stack.  */
+  for (i = 0; i < 16; i++) x[i] = s[i] = vdupq_n_u32(0);
+  t0.val[0] = t0.val[1] = t1.val[0] = t1.val[1] = x[0];
+  __asm__ volatile("" : : "m"(x), "m"(s) : "memory");
+  return 0;
+}
+
+#endif /* USE_CHACHA20_NEON */
@@ -0,0 +1,304 @@
+/* chacha20-intel-simd.c - SSSE3, AVX2 and AVX-512 ChaCha20
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The blocks are computed side by side: vector register J holds word
+ * J of the state of 4 (SSSE3), 8 (AVX2) or 16 (AVX-512) consecutive
+ * blocks, so the rounds need no shuffles.  At the end, the words are
+ * transposed into blocks, four words of four blocks at a time in each
+ * 128 bit lane.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chacha20-internal.h"
+#include "g10lib.h"
+
+#ifdef USE_CHACHA20_SSSE3
+
+#include <immintrin.h>
+
+/* The rounds for an instruction set, with V the vector type and ADD,
+   XOR, ROL16, ROL12, ROL8 and ROL7 the operations on it.  */
+#define QUARTERROUND(a, b, c, d) \
+  do {                           \
+    a = ADD(a, b);               \
+    d = ROL16(XOR(d, a));        \
+    c = ADD(c, d);               \
+    b = ROL12(XOR(b, c));        \
+    a = ADD(a, b);               \
+    d = ROL8(XOR(d, a));         \
+    c = ADD(c, d);               \
+    b = ROL7(XOR(b, c));         \
+  } while (0)
+
+#define ROUNDS(x)                                \
+  do {                                           \
+    int round;                                   \
+    for (round = 0; round < 20; round += 2) {    \
+      QUARTERROUND(x[0], x[4], x[8], x[12]);     \
+      QUARTERROUND(x[1], x[5], x[9], x[13]);     \
+      QUARTERROUND(x[2], x[6], x[10], x[14]);    \
+      QUARTERROUND(x[3], x[7], x[11], x[15]);    \
+      QUARTERROUND(x[0], x[5], x[10], x[15]);    \
+      QUARTERROUND(x[1], x[6], x[11], x[12]);    \
+      QUARTERROUND(x[2], x[7], x[8], x[13]);     \
+      QUARTERROUND(x[3], x[4], x[9], x[14]);     \
+    }                                            \
+  } while (0)
+
+/* Transpose the 4x4 words A, B, C and D in each 128 bit lane, with
+   UNPACKLO32 etc. the unpack operations.  */
+#define TRANSPOSE4(a, b, c, d)       \
+  do {                               \
+    t0 = UNPACKLO32(a, b);           \
+    t1 = UNPACKLO32(c, d);           \
+    t2 = UNPACKHI32(a, b);           \
+    t3 = UNPACKHI32(c, d);           \
+    a = UNPACKLO64(t0, t1);          \
+    b = UNPACKHI64(t0, t1);          \
+    c = UNPACKLO64(t2, t3);          \
+    d = UNPACKHI64(t2, t3);          \
+  } while (0)
+
+#define ADD(a, b) _mm_add_epi32(a, b)
+#define XOR(a, b) _mm_xor_si128(a, b)
+#define ROL_SHIFT(a, n) \
+  _mm_or_si128(_mm_slli_epi32(a, n), _mm_srli_epi32(a, 32 - (n)))
+#define ROL16(a) _mm_shuffle_epi8(a, rol16)
+#define ROL12(a) ROL_SHIFT(a, 12)
+#define ROL8(a) _mm_shuffle_epi8(a, rol8)
+#define ROL7(a) ROL_SHIFT(a, 7)
+#define UNPACKLO32(a, b) _mm_unpacklo_epi32(a, b)
+#define UNPACKHI32(a, b) _mm_unpackhi_epi32(a, b)
+#define UNPACKLO64(a, b) _mm_unpacklo_epi64(a, b)
+#define UNPACKHI64(a, b) _mm_unpackhi_epi64(a, b)
+
+/* Encrypt NBLKS blocks, four at a time.  The caller must have checked
+   for HWF_INTEL_SSSE3.  */
+unsigned int __attribute__((target("ssse3")))
+_gcry_chacha20_ssse3_blocks4(u32 *input, byte *dst, const byte *src,
+                             size_t nblks) {
+  const __m128i rol16 =
+      _mm_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+  const __m128i rol8 =
+      _mm_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+  __m128i x[16], s[16], t0, t1, t2, t3;
+  u32 lo[4], hi[4];
+  int i, g, b;
+
+  for (; nblks >= 4; nblks -= 4) {
+    chacha20_counters(input, lo, hi, 4);
+    for (i = 0; i < 16; i++) s[i] = _mm_set1_epi32(input[i]);
+    s[12] = _mm_loadu_si128((const __m128i *)lo);
+    s[13] = _mm_loadu_si128((const __m128i *)hi);
+    for (i = 0; i < 16; i++) x[i] = s[i];
+
+    ROUNDS(x);
+
+    for (i = 0; i < 16; i++) x[i] = ADD(x[i], s[i]);
+    for (g = 0; g < 4; g++)
+      TRANSPOSE4(x[4 * g], x[4 * g + 1], x[4 * g + 2], x[4 * g + 3]);
+
+    /* Block B is in X[B], X[4 + B], X[8 + B] and X[12 + B].  */
+    for (b = 0; b < 4; b++)
+      for (g = 0; g < 4; g++) {
+        const __m128i *in = (const __m128i *)(src + 64 * b + 16 * g);
+        __m128i *out = (__m128i *)(dst + 64 * b + 16 * g);
+        _mm_storeu_si128(out, XOR(_mm_loadu_si128(in), x[4 * g + b]));
+      }
+
+    src += 4 * 64;
+    dst += 4 * 64;
+  }
+
+  /* Clear the key stream from the registers and the stack.  */
+  for (i = 0; i < 16; i++) x[i] = s[i] = _mm_setzero_si128();
+  t0 = t1 = t2 = t3 = x[0];
+  __asm__ volatile("" : : "m"(x), "m"(s) : "memory");
+  return 0;
+}
+
+#undef ADD
+#undef XOR
+#undef ROL_SHIFT
+#undef ROL16
+#undef ROL12
+#undef ROL8
+#undef ROL7
+#undef UNPACKLO32
+#undef UNPACKHI32
+#undef UNPACKLO64
+#undef UNPACKHI64
+
+#endif /* USE_CHACHA20_SSSE3 */
+
+#ifdef USE_CHACHA20_AVX2
+
+#define ADD(a, b) _mm256_add_epi32(a, b)
+#define XOR(a, b) _mm256_xor_si256(a, b)
+#define ROL_SHIFT(a, n) \
+  _mm256_or_si256(_mm256_slli_epi32(a, n), _mm256_srli_epi32(a, 32 - (n)))
+#define ROL16(a) _mm256_shuffle_epi8(a, rol16)
+#define ROL12(a) ROL_SHIFT(a, 12)
+#define ROL8(a) _mm256_shuffle_epi8(a, rol8)
+#define ROL7(a) ROL_SHIFT(a, 7)
+#define UNPACKLO32(a, b) _mm256_unpacklo_epi32(a, b)
+#define UNPACKHI32(a, b) _mm256_unpackhi_epi32(a, b)
+#define UNPACKLO64(a, b) _mm256_unpacklo_epi64(a, b)
+#define UNPACKHI64(a, b) _mm256_unpackhi_epi64(a, b)
+
+/* Encrypt NBLKS blocks, eight at a time.  The caller must have
+   checked for HWF_INTEL_AVX2.  */
+unsigned int __attribute__((target("avx2")))
+_gcry_chacha20_avx2_blocks8(u32 *input, byte *dst, const byte *src,
+                            size_t nblks) {
+  const __m256i rol16 = _mm256_set_epi8(
+      13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2, 13, 12, 15, 14, 9,
+      8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+  const __m256i rol8 = _mm256_set_epi8(
+      14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3, 14, 13, 12, 15, 10,
+      9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+  __m256i x[16], s[16], t0, t1, t2, t3;
+  u32 lo[8], hi[8];
+  int i, g, b;
+
+  for (; nblks >= 8; nblks -= 8) {
+    chacha20_counters(input, lo, hi, 8);
+    for (i = 0; i < 16; i++) s[i] = _mm256_set1_epi32(input[i]);
+    s[12] = _mm256_loadu_si256((const __m256i *)lo);
+    s[13] = _mm256_loadu_si256((const __m256i *)hi);
+    for (i = 0; i < 16; i++) x[i] = s[i];
+
+    ROUNDS(x);
+
+    for (i = 0; i < 16; i++) x[i] = ADD(x[i], s[i]);
+    for (g = 0; g < 4; g++)
+      TRANSPOSE4(x[4 * g], x[4 * g + 1], x[4 * g + 2], x[4 * g + 3]);
+
+    /* The low lanes of X[B], X[4 + B], X[8 + B] and X[12 + B] hold
+       block B, and the high lanes block 4 + B.  */
+    for (b = 0; b < 4; b++)
+      for (g = 0; g < 4; g += 2) {
+        __m256i lo_blk =
+            _mm256_permute2x128_si256(x[4 * g + b], x[4 * g + 4 + b], 0x20);
+        __m256i hi_blk =
+            _mm256_permute2x128_si256(x[4 * g + b], x[4 * g + 4 + b], 0x31);
+        const __m256i *in0 = (const __m256i *)(src + 64 * b + 16 * g);
+        const __m256i *in1 = (const __m256i *)(src + 64 * (4 + b) + 16 * g);
+        __m256i *out0 = (__m256i *)(dst + 64 * b + 16 * g);
+        __m256i *out1 = (__m256i *)(dst + 64 * (4 + b) + 16 * g);
+        _mm256_storeu_si256(out0, XOR(_mm256_loadu_si256(in0), lo_blk));
+        _mm256_storeu_si256(out1, XOR(_mm256_loadu_si256(in1), hi_blk));
+      }
+
+    src += 8 * 64;
+    dst += 8 * 64;
+  }
+
+  for (i = 0; i < 16; i++) x[i] = s[i] = _mm256_setzero_si256();
+  t0 = t1 = t2 = t3 = x[0];
+  __asm__ volatile("" : : "m"(x), "m"(s) : "memory");
+  _mm256_zeroall();
+  return 0;
+}
+
+#undef ADD
+#undef XOR
+#undef ROL_SHIFT
+#undef ROL16
+#undef ROL12
+#undef ROL8
+#undef ROL7
+#undef UNPACKLO32
+#undef UNPACKHI32
+#undef UNPACKLO64
+#undef UNPACKHI64
+
+#endif /* USE_CHACHA20_AVX2 */
+
+#ifdef USE_CHACHA20_AVX512
+
+/* AVX-512 has a rotate instruction.  */
+#define ADD(a, b) _mm512_add_epi32(a, b)
+#define XOR(a, b) _mm512_xor_si512(a, b)
+#define ROL16(a) _mm512_rol_epi32(a, 16)
+#define ROL12(a) _mm512_rol_epi32(a, 12)
+#define ROL8(a) _mm512_rol_epi32(a, 8)
+#define ROL7(a) _mm512_rol_epi32(a, 7)
+#define UNPACKLO32(a, b) _mm512_unpacklo_epi32(a, b)
+#define UNPACKHI32(a, b) _mm512_unpackhi_epi32(a, b)
+#define UNPACKLO64(a, b) _mm512_unpacklo_epi64(a, b)
+#define UNPACKHI64(a, b) _mm512_unpackhi_epi64(a, b)
+
+/* Encrypt NBLKS blocks, sixteen at a time.  The caller must have
+   checked for HWF_INTEL_AVX512.  */
+unsigned int __attribute__((target("avx512f")))
+_gcry_chacha20_avx512_blocks16(u32 *input, byte *dst, const byte *src,
+                               size_t nblks) {
+  __m512i x[16], s[16], t0, t1, t2, t3;
+  u32 lo[16], hi[16];
+  int i, g, b, l;
+
+  for (; nblks >= 16; nblks -= 16) {
+    chacha20_counters(input, lo, hi, 16);
+    for (i = 0; i < 16; i++) s[i] = _mm512_set1_epi32(input[i]);
+    s[12] = _mm512_loadu_si512(lo);
+    s[13] = _mm512_loadu_si512(hi);
+    for (i = 0; i < 16; i++) x[i] = s[i];
+
+    ROUNDS(x);
+
+    for (i = 0; i < 16; i++) x[i] = ADD(x[i], s[i]);
+    for (g = 0; g < 4; g++)
+      TRANSPOSE4(x[4 * g], x[4 * g + 1], x[4 * g + 2], x[4 * g + 3]);
+
+    /* Lane L of X[B], X[4 + B], X[8 + B] and X[12 + B] holds block
+       4 * L + B.  Gather the four lanes of each block.  */
+    for (b = 0; b < 4; b++) {
+      __m512i w01lo = _mm512_shuffle_i32x4(x[b], x[4 + b], 0x44);
+      __m512i w23lo = _mm512_shuffle_i32x4(x[8 + b], x[12 + b], 0x44);
+      __m512i w01hi = _mm512_shuffle_i32x4(x[b], x[4 + b], 0xee);
+      __m512i w23hi = _mm512_shuffle_i32x4(x[8 + b], x[12 + b], 0xee);
+      __m512i blk[4];
+
+      blk[0] = _mm512_shuffle_i32x4(w01lo, w23lo, 0x88);
+      blk[1] = _mm512_shuffle_i32x4(w01lo, w23lo, 0xdd);
+      blk[2] = _mm512_shuffle_i32x4(w01hi, w23hi, 0x88);
+      blk[3] = _mm512_shuffle_i32x4(w01hi, w23hi, 0xdd);
+      for (l = 0; l < 4; l++) {
+        const byte *in = src + 64 * (4 * l + b);
+        byte *out = dst + 64 * (4 * l + b);
+        _mm512_storeu_si512(out, XOR(_mm512_loadu_si512(in), blk[l]));
+      }
+    }
+
+    src += 16 * 64;
+    dst += 16 * 64;
+  }
+
+  for (i = 0; i < 16; i++) x[i] = s[i] = _mm512_setzero_si512();
+  t0 = t1 = t2 = t3 = x[0];
+  __asm__ volatile("" : : "m"(x), "m"(s) : "memory");
+  _mm256_zeroall();
+  return 0;
+}
+
+#endif /* USE_CHACHA20_AVX512 */
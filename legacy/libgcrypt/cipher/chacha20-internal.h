@@ -0,0 +1,101 @@
+/* chacha20-internal.h - ChaCha20 definitions shared with the SIMD code
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef G10_CHACHA20_INTERNAL_H
+#define G10_CHACHA20_INTERNAL_H
+
+#include <config.h>
+#include "types.h"
+
+#define CHACHA20_MIN_KEY_SIZE 16 /* Bytes.  */
+#define CHACHA20_MAX_KEY_SIZE 32 /* Bytes.  */
+#define CHACHA20_BLOCK_SIZE 64   /* Bytes.  */
+#define CHACHA20_MIN_IV_SIZE 8   /* Bytes.  */
+#define CHACHA20_MAX_IV_SIZE 12  /* Bytes.  */
+#define CHACHA20_CTR_SIZE 16     /* Bytes.  */
+
+/* USE_CHACHA20_SSSE3, USE_CHACHA20_AVX2 and USE_CHACHA20_AVX512
+   indicate whether to compile the 4, 8 and 16 block x86 code in
+   chacha20-intel-simd.c.  Like the SHA extensions code, it only needs
+   the compiler intrinsics.  */
+#undef USE_CHACHA20_SSSE3
+#undef USE_CHACHA20_AVX2
+#undef USE_CHACHA20_AVX512
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (__GNUC__ >= 5 || defined(__clang__))
+#define USE_CHACHA20_SSSE3 1
+#define USE_CHACHA20_AVX2 1
+#if defined(__x86_64__) && (__GNUC__ >= 6 || defined(__clang__))
+#define USE_CHACHA20_AVX512 1
+#endif
+#endif
+
+/* USE_CHACHA20_NEON indicates whether to compile the 4 block ARMv8
+   NEON code in chacha20-armv8-neon.c.  */
+#undef USE_CHACHA20_NEON
+#if defined(__AARCH64EL__) && defined(__GNUC__) && __GNUC__ >= 6
+#define USE_CHACHA20_NEON 1
+#endif
+
+typedef struct {
+  /* The constants, the key, the block counter (words 12 and 13, or
+     only 12 with a 96 bit nonce) and the nonce.  */
+  u32 input[16];
+  /* The key stream of the last block, of which UNUSED bytes at the
+     end have not been used yet.  */
+  byte pad[CHACHA20_BLOCK_SIZE];
+  unsigned int unused;
+  unsigned int use_ssse3 : 1;
+  unsigned int use_avx2 : 1;
+  unsigned int use_avx512 : 1;
+  unsigned int use_neon : 1;
+} CHACHA20_context_t;
+
+/* Encrypt NBLKS blocks from SRC to DST with the key stream for the
+   state INPUT, and advance the block counter in INPUT.  NBLKS must be
+   a multiple of the number of blocks the function handles at once,
+   and SRC may be the same as DST.  The functions return the number of
+   bytes of stack to burn.  */
+unsigned int _gcry_chacha20_ssse3_blocks4(u32 *input, byte *dst,
+                                          const byte *src, size_t nblks);
+unsigned int _gcry_chacha20_avx2_blocks8(u32 *input, byte *dst,
+                                         const byte *src, size_t nblks);
+unsigned int _gcry_chacha20_avx512_blocks16(u32 *input, byte *dst,
+                                            const byte *src, size_t nblks);
+unsigned int _gcry_chacha20_neon_blocks4(u32 *input, byte *dst,
+                                         const byte *src, size_t nblks);
+
+/* Store the counters of the N blocks starting at the counter in INPUT
+   into LO and HI (words 12 and 13 of each block), and advance the
+   counter in INPUT by N.  The counter is 64 bits wide, as with the 64
+   bit nonce.  */
+static inline void chacha20_counters(u32 *input, u32 *lo, u32 *hi,
+                                     unsigned int n) {
+  u64 ctr = ((u64)input[13] << 32) | input[12];
+  unsigned int i;
+
+  for (i = 0; i < n; i++, ctr++) {
+    lo[i] = (u32)ctr;
+    hi[i] = (u32)(ctr >> 32);
+  }
+  input[12] = (u32)ctr;
+  input[13] = (u32)(ctr >> 32);
+}
+
+#endif /* G10_CHACHA20_INTERNAL_H */
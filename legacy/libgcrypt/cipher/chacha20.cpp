@@ -0,0 +1,377 @@
+/* chacha20.c - Bernstein's ChaCha20 cipher
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * For a description of the algorithm, see:
+ *   http://cr.yp.to/chacha.html
+ *   RFC 8439, ChaCha20 and Poly1305 for IETF Protocols
+ *
+ * The key stream is generated for 16, 8 or 4 blocks at once by the
+ * AVX-512, AVX2, SSSE3 or NEON code where available, and one block at
+ * a time by the generic code.  The counter and nonce layout is that of
+ * the 64 bit nonce, with the 96 bit nonce of RFC 8439 taking the high
+ * word of the counter.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bithelp.h"
+#include "bufhelp.h"
+#include "chacha20-internal.h"
+#include "cipher.h"
+#include "g10lib.h"
+#include "types.h"
+
+static const char *selftest(void);
+
+#define QUARTERROUND(a, b, c, d) \
+  do {                           \
+    a += b;                      \
+    d = rol(d ^ a, 16);          \
+    c += d;                      \
+    b = rol(b ^ c, 12);          \
+    a += b;                      \
+    d = rol(d ^ a, 8);           \
+    c += d;                      \
+    b = rol(b ^ c, 7);           \
+  } while (0)
+
+/* Compute the key stream block for the state INPUT into PAD and
+   advance the block counter.  */
+static unsigned int chacha20_block(u32 *input, byte *pad) {
+  u32 x[16];
+  int i;
+
+  for (i = 0; i < 16; i++) x[i] = input[i];
+
+  for (i = 0; i < 20; i += 2) {
+    QUARTERROUND(x[0], x[4], x[8], x[12]);
+    QUARTERROUND(x[1], x[5], x[9], x[13]);
+    QUARTERROUND(x[2], x[6], x[10], x[14]);
+    QUARTERROUND(x[3], x[7], x[11], x[15]);
+    QUARTERROUND(x[0], x[5], x[10], x[15]);
+    QUARTERROUND(x[1], x[6], x[11], x[12]);
+    QUARTERROUND(x[2], x[7], x[8], x[13]);
+    QUARTERROUND(x[3], x[4], x[9], x[14]);
+  }
+
+  for (i = 0; i < 16; i++) buf_put_le32(pad + 4 * i, x[i] + input[i]);
+
+  input[12]++;
+  input[13] += !input[12];
+
+  return sizeof(x) + 4 * sizeof(void *);
+}
+
+#undef QUARTERROUND
+
+/* Encrypt NBLKS whole blocks from SRC to DST with the generic code.  */
+static unsigned int chacha20_blocks(u32 *input, byte *dst, const byte *src,
+                                    size_t nblks) {
+  byte pad[CHACHA20_BLOCK_SIZE];
+  unsigned int burn = 0;
+
+  for (; nblks; nblks--) {
+    burn = chacha20_block(input, pad);
+    buf_xor(dst, src, pad, CHACHA20_BLOCK_SIZE);
+    dst += CHACHA20_BLOCK_SIZE;
+    src += CHACHA20_BLOCK_SIZE;
+  }
+  wipememory(pad, sizeof pad);
+
+  return burn ? burn + sizeof(pad) + 4 * sizeof(void *) : 0;
+}
+
+static void chacha20_keysetup(CHACHA20_context_t *ctx, const byte *key,
+                              unsigned int keylen) {
+  /* "expand 32-byte k" or "expand 16-byte k".  */
+  ctx->input[0] = 0x61707865;
+  ctx->input[1] = keylen == CHACHA20_MAX_KEY_SIZE ? 0x3320646e : 0x3120646e;
+  ctx->input[2] = keylen == CHACHA20_MAX_KEY_SIZE ? 0x79622d32 : 0x79622d36;
+  ctx->input[3] = 0x6b206574;
+
+  ctx->input[4] = buf_get_le32(key + 0);
+  ctx->input[5] = buf_get_le32(key + 4);
+  ctx->input[6] = buf_get_le32(key + 8);
+  ctx->input[7] = buf_get_le32(key + 12);
+
+  /* A 128 bit key is used twice.  */
+  if (keylen == CHACHA20_MAX_KEY_SIZE) key += 16;
+  ctx->input[8] = buf_get_le32(key + 0);
+  ctx->input[9] = buf_get_le32(key + 4);
+  ctx->input[10] = buf_get_le32(key + 8);
+  ctx->input[11] = buf_get_le32(key + 12);
+}
+
+static void chacha20_ivsetup(CHACHA20_context_t *ctx, const byte *iv,
+                             size_t ivlen) {
+  if (ivlen == CHACHA20_CTR_SIZE) {
+    ctx->input[12] = buf_get_le32(iv + 0);
+    ctx->input[13] = buf_get_le32(iv + 4);
+    ctx->input[14] = buf_get_le32(iv + 8);
+    ctx->input[15] = buf_get_le32(iv + 12);
+  } else if (ivlen == CHACHA20_MAX_IV_SIZE) {
+    ctx->input[12] = 0;
+    ctx->input[13] = buf_get_le32(iv + 0);
+    ctx->input[14] = buf_get_le32(iv + 4);
+    ctx->input[15] = buf_get_le32(iv + 8);
+  } else if (ivlen == CHACHA20_MIN_IV_SIZE) {
+    ctx->input[12] = 0;
+    ctx->input[13] = 0;
+    ctx->input[14] = buf_get_le32(iv + 0);
+    ctx->input[15] = buf_get_le32(iv + 4);
+  } else {
+    ctx->input[12] = 0;
+    ctx->input[13] = 0;
+    ctx->input[14] = 0;
+    ctx->input[15] = 0;
+  }
+}
+
+static void chacha20_setiv(void *context, const byte *iv, size_t ivlen) {
+  CHACHA20_context_t *ctx = (CHACHA20_context_t *)context;
+
+  /* 64 and 96 bit nonces are defined, and the 128 bit form sets the
+     counter as well.  */
+  if (iv && ivlen != CHACHA20_MAX_IV_SIZE && ivlen != CHACHA20_MIN_IV_SIZE &&
+      ivlen != CHACHA20_CTR_SIZE)
+    log_info("WARNING: chacha20_setiv: bad ivlen=%u\n", (u32)ivlen);
+
+  if (iv && (ivlen == CHACHA20_MAX_IV_SIZE || ivlen == CHACHA20_MIN_IV_SIZE ||
+             ivlen == CHACHA20_CTR_SIZE))
+    chacha20_ivsetup(ctx, iv, ivlen);
+  else
+    chacha20_ivsetup(ctx, NULL, 0);
+
+  /* Reset the unused pad bytes counter.  */
+  ctx->unused = 0;
+}
+
+/* Select the SIMD code for the CPU.  */
+static void chacha20_select_impl(CHACHA20_context_t *ctx) {
+  unsigned int features = _gcry_get_hw_features();
+
+  ctx->use_ssse3 = 0;
+  ctx->use_avx2 = 0;
+  ctx->use_avx512 = 0;
+  ctx->use_neon = 0;
+#ifdef USE_CHACHA20_SSSE3
+  ctx->use_ssse3 = (features & HWF_INTEL_SSSE3) != 0;
+#endif
+#ifdef USE_CHACHA20_AVX2
+  ctx->use_avx2 = (features & HWF_INTEL_AVX2) != 0;
+#endif
+#ifdef USE_CHACHA20_AVX512
+  ctx->use_avx512 = (features & HWF_INTEL_AVX512) != 0;
+#endif
+#ifdef USE_CHACHA20_NEON
+  ctx->use_neon = (features & HWF_ARM_NEON) != 0;
+#endif
+  (void)features;
+}
+
+static gpg_error_t chacha20_do_setkey(CHACHA20_context_t *ctx,
+                                      const byte *key, unsigned int keylen) {
+  static int initialized;
+  static const char *selftest_failed;
+
+  if (!initialized) {
+    initialized = 1;
+    selftest_failed = selftest();
+    if (selftest_failed) log_error("CHACHA20 selftest failed (%s)\n",
+                                   selftest_failed);
+  }
+  if (selftest_failed) return GPG_ERR_SELFTEST_FAILED;
+
+  if (keylen != CHACHA20_MAX_KEY_SIZE && keylen != CHACHA20_MIN_KEY_SIZE)
+    return GPG_ERR_INV_KEYLEN;
+
+  chacha20_select_impl(ctx);
+
+  chacha20_keysetup(ctx, key, keylen);
+
+  /* We default to a zero nonce.  */
+  chacha20_setiv(ctx, NULL, 0);
+
+  return 0;
+}
+
+static gpg_error_t chacha20_setkey(void *context, const byte *key,
+                                   unsigned int keylen) {
+  CHACHA20_context_t *ctx = (CHACHA20_context_t *)context;
+  gpg_error_t rc = chacha20_do_setkey(ctx, key, keylen);
+  _gcry_burn_stack(4 + sizeof(void *) + 4 * sizeof(void *));
+  return rc;
+}
+
+static void chacha20_encrypt_stream(void *context, byte *outbuf,
+                                    const byte *inbuf, size_t length) {
+  CHACHA20_context_t *ctx = (CHACHA20_context_t *)context;
+  unsigned int burn = 0, nburn;
+  size_t nblks;
+
+  if (!length) return;
+
+  /* Use the rest of the last key stream block first.  */
+  if (ctx->unused) {
+    byte *p = ctx->pad + CHACHA20_BLOCK_SIZE - ctx->unused;
+    size_t n = ctx->unused < length ? ctx->unused : length;
+
+    buf_xor(outbuf, inbuf, p, n);
+    length -= n;
+    outbuf += n;
+    inbuf += n;
+    ctx->unused -= n;
+    if (!length) return;
+  }
+
+#ifdef USE_CHACHA20_AVX512
+  if (ctx->use_avx512 && length >= CHACHA20_BLOCK_SIZE * 16) {
+    nblks = (length / CHACHA20_BLOCK_SIZE) & ~(size_t)15;
+    nburn = _gcry_chacha20_avx512_blocks16(ctx->input, outbuf, inbuf, nblks);
+    burn = nburn > burn ? nburn : burn;
+    length -= nblks * CHACHA20_BLOCK_SIZE;
+    outbuf += nblks * CHACHA20_BLOCK_SIZE;
+    inbuf += nblks * CHACHA20_BLOCK_SIZE;
+  }
+#endif
+
+#ifdef USE_CHACHA20_AVX2
+  if (ctx->use_avx2 && length >= CHACHA20_BLOCK_SIZE * 8) {
+    nblks = (length / CHACHA20_BLOCK_SIZE) & ~(size_t)7;
+    nburn = _gcry_chacha20_avx2_blocks8(ctx->input, outbuf, inbuf, nblks);
+    burn = nburn > burn ? nburn : burn;
+    length -= nblks * CHACHA20_BLOCK_SIZE;
+    outbuf += nblks * CHACHA20_BLOCK_SIZE;
+    inbuf += nblks * CHACHA20_BLOCK_SIZE;
+  }
+#endif
+
+#ifdef USE_CHACHA20_SSSE3
+  if (ctx->use_ssse3 && length >= CHACHA20_BLOCK_SIZE * 4) {
+    nblks = (length / CHACHA20_BLOCK_SIZE) & ~(size_t)3;
+    nburn = _gcry_chacha20_ssse3_blocks4(ctx->input, outbuf, inbuf, nblks);
+    burn = nburn > burn ? nburn : burn;
+    length -= nblks * CHACHA20_BLOCK_SIZE;
+    outbuf += nblks * CHACHA20_BLOCK_SIZE;
+    inbuf += nblks * CHACHA20_BLOCK_SIZE;
+  }
+#endif
+
+#ifdef USE_CHACHA20_NEON
+  if (ctx->use_neon && length >= CHACHA20_BLOCK_SIZE * 4) {
+    nblks = (length / CHACHA20_BLOCK_SIZE) & ~(size_t)3;
+    nburn = _gcry_chacha20_neon_blocks4(ctx->input, outbuf, inbuf, nblks);
+    burn = nburn > burn ? nburn : burn;
+    length -= nblks * CHACHA20_BLOCK_SIZE;
+    outbuf += nblks * CHACHA20_BLOCK_SIZE;
+    inbuf += nblks * CHACHA20_BLOCK_SIZE;
+  }
+#endif
+
+  if (length >= CHACHA20_BLOCK_SIZE) {
+    nblks = length / CHACHA20_BLOCK_SIZE;
+    nburn = chacha20_blocks(ctx->input, outbuf, inbuf, nblks);
+    burn = nburn > burn ? nburn : burn;
+    length -= nblks * CHACHA20_BLOCK_SIZE;
+    outbuf += nblks * CHACHA20_BLOCK_SIZE;
+    inbuf += nblks * CHACHA20_BLOCK_SIZE;
+  }
+
+  /* Keep the rest of the key stream of a partial block.  */
+  if (length) {
+    nburn = chacha20_block(ctx->input, ctx->pad);
+    burn = nburn > burn ? nburn : burn;
+    buf_xor(outbuf, inbuf, ctx->pad, length);
+    ctx->unused = CHACHA20_BLOCK_SIZE - length;
+  }
+
+  if (burn) _gcry_burn_stack(burn);
+}
+
+static const char *selftest(void) {
+  /* The key and nonce of RFC 8439, 2.8.2.  The first 32 bytes of the
+     key stream block with the counter at 0 are the Poly1305 key of
+     that example.  */
+  static const byte key[CHACHA20_MAX_KEY_SIZE] = {
+      0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a,
+      0x8b, 0x8c, 0x8d, 0x8e, 0x8f, 0x90, 0x91, 0x92, 0x93, 0x94, 0x95,
+      0x96, 0x97, 0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f};
+  static const byte nonce[CHACHA20_MAX_IV_SIZE] = {
+      0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47};
+  static const byte expected[CHACHA20_BLOCK_SIZE] = {
+      0x7b, 0xac, 0x2b, 0x25, 0x2d, 0xb4, 0x47, 0xaf, 0x09, 0xb6, 0x7a,
+      0x55, 0xa4, 0xe9, 0x55, 0x84, 0x0a, 0xe1, 0xd6, 0x73, 0x10, 0x75,
+      0xd9, 0xeb, 0x2a, 0x93, 0x75, 0x78, 0x3e, 0xd5, 0x53, 0xff, 0xa2,
+      0x7e, 0xcc, 0xde, 0xad, 0xdb, 0x4d, 0xb4, 0xd1, 0x17, 0x9c, 0xe4,
+      0xc9, 0x0b, 0x43, 0xd8, 0xbc, 0xb7, 0x94, 0x8c, 0x4b, 0x4b, 0x7d,
+      0x8b, 0x7d, 0xf6, 0x27, 0x39, 0x32, 0xa4, 0x69, 0x16};
+  CHACHA20_context_t ctx;
+  byte block[CHACHA20_BLOCK_SIZE];
+  /* Enough for each of the bulk functions and a partial block.  */
+  byte buf[CHACHA20_BLOCK_SIZE * (16 + 8 + 4 + 3) + 13];
+  size_t i;
+
+  memset(&ctx, 0, sizeof ctx);
+  chacha20_keysetup(&ctx, key, sizeof key);
+  chacha20_ivsetup(&ctx, nonce, sizeof nonce);
+  memset(block, 0, sizeof block);
+  chacha20_blocks(ctx.input, block, block, 1);
+  if (memcmp(block, expected, sizeof block))
+    return "ChaCha20 test vector failed.";
+
+  /* The SIMD code, used for long inputs, must produce the same key
+     stream as the generic code, which is used byte by byte to decrypt
+     again.  The block counter wraps into the high word.  */
+  chacha20_select_impl(&ctx);
+  for (i = 0; i < sizeof buf; i++) buf[i] = (byte)i;
+  ctx.input[12] = 0xfffffffa;
+  ctx.input[13] = 0;
+  ctx.unused = 0;
+  chacha20_encrypt_stream(&ctx, buf, buf, sizeof buf);
+  ctx.input[12] = 0xfffffffa;
+  ctx.input[13] = 0;
+  ctx.unused = 0;
+  for (i = 0; i < sizeof buf; i++)
+    chacha20_encrypt_stream(&ctx, buf + i, buf + i, 1);
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != (byte)i) return "ChaCha20 bulk encryption failed.";
+
+  return NULL;
+}
+
+gcry_cipher_spec_t _gcry_cipher_spec_chacha20 = {
+    GCRY_CIPHER_CHACHA20,
+    {0, 0}, /* flags */
+    "CHACHA20",
+    NULL, /* aliases */
+    NULL, /* oids */
+    1,    /* blocksize in bytes. */
+    CHACHA20_MAX_KEY_SIZE * 8, /* standard key length in bits. */
+    sizeof(CHACHA20_context_t),
+    chacha20_setkey,
+    NULL,
+    NULL,
+    chacha20_encrypt_stream,
+    chacha20_encrypt_stream,
+    NULL,
+    NULL,
+    chacha20_setiv};
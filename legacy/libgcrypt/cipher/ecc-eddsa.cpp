@@ -547,7 +547,7 @@ gpg_error_t _gcry_ecc_eddsa_sign(gcry_mpi_t input, ECC_secret_key *skey,
       goto leave;
     }
   } else {
-    _gcry_mpi_ec_mul_point(&Q, a, &skey->E.G, ctx);
+    _gcry_mpi_ec_mul_base(&Q, a, &skey->E.G, ctx);
     rc = _gcry_ecc_eddsa_encodepoint(&Q, ctx, x, y, 0, &encpk, &encpklen);
     if (rc) goto leave;
     if (DBG_CIPHER) log_printhex("  e_pk", encpk, encpklen);
@@ -568,7 +568,9 @@ gpg_error_t _gcry_ecc_eddsa_sign(gcry_mpi_t input, ECC_secret_key *skey,
   reverse_buffer(digest, 64);
   if (DBG_CIPHER) log_printhex("     r", digest, 64);
   _gcry_mpi_set_buffer(r, digest, 64, 0);
-  _gcry_mpi_ec_mul_point(&I, r, &skey->E.G, ctx);
+  /* G has order n; reducing R first keeps it within the base table.  */
+  mpi_mod(r, r, skey->E.n);
+  _gcry_mpi_ec_mul_base(&I, r, &skey->E.G, ctx);
   if (DBG_CIPHER) log_printpnt("   r", &I, ctx);
 
   /* Convert R into affine coordinates and apply encoding.  */
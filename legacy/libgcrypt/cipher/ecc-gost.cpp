@@ -82,7 +82,7 @@ gpg_error_t _gcry_ecc_gost_sign(gcry_mpi_t input, ECC_secret_key *skey,
       mpi_free(k);
       k = _gcry_dsa_gen_k(skey->E.n);
 
-      _gcry_mpi_ec_mul_point(&I, k, &skey->E.G, ctx);
+      _gcry_mpi_ec_mul_base(&I, k, &skey->E.G, ctx);
       if (_gcry_mpi_ec_get_affine(x, NULL, &I, ctx)) {
         if (DBG_CIPHER)
           log_debug("ecc sign: Failed to get affine coordinates\n");
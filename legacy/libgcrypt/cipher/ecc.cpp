@@ -1219,8 +1219,9 @@ static gpg_error_t ecc_encrypt_raw(gcry_sexp_t *r_ciph, gcry_sexp_t s_data,
       }
     }
 
-    /* R = kG */
-    _gcry_mpi_ec_mul_point(&R, data, &pk.E.G, ec);
+    /* R = kG.  K is a fresh ephemeral scalar for each encryption, so
+       use the precomputed multiples of the generator.  */
+    _gcry_mpi_ec_mul_base(&R, data, &pk.E.G, ec);
 
     if (_gcry_mpi_ec_get_affine(x, y, &R, ec)) {
       rc = GPG_ERR_INV_DATA;
@@ -25,6 +25,7 @@
 #include <stdint.h>
 #endif
 
+#include "bufhelp.h"
 #include "g10lib.h"
 #include "hash-common.h"
 
@@ -144,3 +145,53 @@ void _gcry_md_block_write(void *context, const void *inbuf_arg, size_t inlen) {
   for (; inlen && hd->count < blocksize; inlen--)
     hd->buf[hd->count++] = *inbuf++;
 }
+
+#ifdef USE_MD_MULTI
+
+#if defined(__x86_64__) || defined(__i386__)
+int _gcry_md_multi_avx2 = __builtin_cpu_supports("avx2");
+#else
+int _gcry_md_multi_avx2 = 0;
+#endif
+
+/* Flush the block context HD of a hash with a 64 byte block and a big
+   endian 64 bit bit count at the end of the padding, like SHA-1 and
+   SHA-256, and store the remaining data of HD together with the
+   padding at BLKS, which must have room for two blocks.  HD itself is
+   not changed further.  Returns the number of blocks at BLKS.  */
+unsigned int _gcry_md_block_pad_be64(gcry_md_block_ctx_t *hd,
+                                     unsigned char *blks) {
+  u32 t, th, msb, lsb;
+  unsigned int n;
+
+  _gcry_md_block_write(hd, NULL, 0); /* flush */
+
+  t = hd->nblocks;
+  if (sizeof t == sizeof hd->nblocks)
+    th = hd->nblocks_high;
+  else
+    th = hd->nblocks >> 32;
+
+  /* multiply by 64 to make a byte count */
+  lsb = t << 6;
+  msb = (th << 6) | (t >> 26);
+  /* add the count */
+  t = lsb;
+  if ((lsb += hd->count) < t) msb++;
+  /* multiply by 8 to make a bit count */
+  t = lsb;
+  lsb <<= 3;
+  msb <<= 3;
+  msb |= t >> 29;
+
+  n = hd->count < 56 ? 1 : 2;
+  memcpy(blks, hd->buf, hd->count);
+  blks[hd->count] = 0x80;
+  memset(blks + hd->count + 1, 0, n * 64 - 8 - hd->count - 1);
+  buf_put_be32(blks + n * 64 - 8, msb);
+  buf_put_be32(blks + n * 64 - 4, lsb);
+
+  return n;
+}
+
+#endif /*USE_MD_MULTI*/
@@ -51,4 +51,22 @@ typedef struct gcry_md_block_ctx {
 
 void _gcry_md_block_write(void *context, const void *inbuf_arg, size_t inlen);
 
+/* Multi-buffer transforms.  These run the compression function of
+   SHA-1 and SHA-256 for MD_MULTI_LANES independent contexts at once,
+   with one 32 bit lane of a vector register per context.  They are
+   used by gcry_md_final_batch.  */
+#undef USE_MD_MULTI
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#define USE_MD_MULTI 1
+#define MD_MULTI_LANES 8
+
+typedef u32 md_multi_u32 __attribute__((vector_size(4 * MD_MULTI_LANES)));
+
+/* Set if the CPU supports AVX2, so that one vector is one register.  */
+extern int _gcry_md_multi_avx2;
+
+unsigned int _gcry_md_block_pad_be64(gcry_md_block_ctx_t *hd,
+                                     unsigned char *blks);
+#endif /*USE_MD_MULTI*/
+
 #endif /*GCRY_HASH_COMMON_H*/
@@ -19,6 +19,9 @@
  */
 
 #include <config.h>
+
+#include <algorithm>
+
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,6 +31,17 @@
 #include "g10lib.h"
 #include "kdf-internal.h"
 
+#include <neopg/utils/workers.h>
+
+/* The iterated and salted S2K hashes the salt and the passphrase over
+   and over.  To do that with large writes, which the hash functions
+   process many blocks at a time, the pattern is repeated in a buffer
+   of about this size.  */
+#define S2K_CHUNK_SIZE 8192
+
+/* The batch functions use up to this many threads.  */
+#define KDF_MAX_THREADS 16
+
 /* Transform a passphrase into a suitable key of length KEYSIZE and
    store this key in the caller provided buffer KEYBUFFER.  The caller
    must provide an HASHALGO, a valid ALGO and depending on that algo a
@@ -43,6 +57,8 @@ static gpg_error_t openpgp_s2k(const void *passphrase, size_t passphraselen,
   int pass, i;
   int used = 0;
   int secmode;
+  unsigned char *chunk = NULL;
+  size_t chunklen = 0;
 
   if ((algo == GCRY_KDF_SALTED_S2K || algo == GCRY_KDF_ITERSALTED_S2K) &&
       (!salt || saltlen != 8))
@@ -53,6 +69,28 @@ static gpg_error_t openpgp_s2k(const void *passphrase, size_t passphraselen,
   ec = _gcry_md_open(&md, hashalgo, secmode ? GCRY_MD_FLAG_SECURE : 0);
   if (ec) return ec;
 
+  if (algo == GCRY_KDF_ITERSALTED_S2K &&
+      iterations > 2 * (passphraselen + 8)) {
+    size_t len2 = passphraselen + 8;
+    size_t n;
+
+    /* The hashed data is a prefix of the salt and the passphrase
+       repeated, so it can be written from a buffer which holds a
+       whole number of repetitions.  */
+    chunklen = std::max((size_t)1, (size_t)S2K_CHUNK_SIZE / len2) * len2;
+    chunk = (unsigned char *)(secmode ? xtrymalloc_secure(chunklen)
+                                      : xtrymalloc(chunklen));
+    if (!chunk) {
+      ec = gpg_error_from_syserror();
+      _gcry_md_close(md);
+      return ec;
+    }
+    for (n = 0; n < chunklen; n += len2) {
+      memcpy(chunk + n, salt, 8);
+      memcpy(chunk + n + 8, passphrase, passphraselen);
+    }
+  }
+
   for (pass = 0; used < keysize; pass++) {
     if (pass) {
       _gcry_md_reset(md);
@@ -69,12 +107,23 @@ static gpg_error_t openpgp_s2k(const void *passphrase, size_t passphraselen,
         if (count < len2) count = len2;
       }
 
+      if (chunk) {
+        while (count > chunklen) {
+          _gcry_md_write(md, chunk, chunklen);
+          count -= chunklen;
+        }
+        _gcry_md_write(md, chunk, count);
+        count = 0;
+      }
+
       while (count > len2) {
         _gcry_md_write(md, salt, saltlen);
         _gcry_md_write(md, passphrase, passphraselen);
         count -= len2;
       }
-      if (count < saltlen)
+      if (!count)
+        ;
+      else if (count < saltlen)
         _gcry_md_write(md, salt, count);
       else {
         _gcry_md_write(md, salt, saltlen);
@@ -91,6 +140,10 @@ static gpg_error_t openpgp_s2k(const void *passphrase, size_t passphraselen,
     used += i;
   }
   _gcry_md_close(md);
+  if (chunk) {
+    wipememory(chunk, chunklen);
+    xfree(chunk);
+  }
   return 0;
 }
 
@@ -268,3 +321,30 @@ gpg_error_t gcry_kdf_derive(const void *passphrase, size_t passphraselen,
 leave:
   return ec;
 }
+
+/* Run the NJOBS key derivations at JOBS, all with ALGO and SUBALGO,
+   like gcry_kdf_derive.  The result of each job is stored in its ERR
+   field.  The jobs are independent, so they are handed out to several
+   threads; this is meant for trying many keys or unlocking many
+   objects at once.  Returns the error of the first failed job or
+   0.  */
+gpg_error_t gcry_kdf_derive_batch(int algo, int subalgo, gcry_kdf_job_t *jobs,
+                                  size_t njobs) {
+  size_t nthreads;
+  size_t i;
+
+  if (!jobs && njobs) return GPG_ERR_INV_ARG;
+
+  nthreads = std::min(NeoPG::hardware_threads(), (size_t)KDF_MAX_THREADS);
+  NeoPG::parallel_for(njobs, nthreads, [&](size_t idx) {
+    gcry_kdf_job_t *job = &jobs[idx];
+
+    job->err = gcry_kdf_derive(job->passphrase, job->passphraselen, algo,
+                               subalgo, job->salt, job->saltlen,
+                               job->iterations, job->keysize, job->keybuffer);
+  });
+
+  for (i = 0; i < njobs; i++)
+    if (jobs[i].err) return jobs[i].err;
+  return 0;
+}
@@ -21,6 +21,7 @@
 
 #include <config.h>
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -127,6 +128,90 @@ static int md_digest_length(int algo);
 static void md_start_debug(gcry_md_hd_t a, const char *suffix);
 static void md_stop_debug(gcry_md_hd_t a);
 
+/* The blocks of closed handles and digest entries that are not in
+   secure memory (which has its own cache) are kept in free lists of
+   the thread, one per block size, and reused by md_open, md_enable
+   and md_copy.  They are wiped before they enter a list.  */
+#define MD_CACHE_SIZES 8
+#define MD_CACHE_DEPTH 8
+
+struct md_cache_block {
+  struct md_cache_block *next;
+};
+
+struct md_cache {
+  struct {
+    size_t size;
+    unsigned int count;
+    struct md_cache_block *head;
+  } lists[MD_CACHE_SIZES] = {};
+  /* Set once the thread exits, for handles closed by later
+     destructors.  */
+  bool gone = false;
+
+  ~md_cache();
+};
+
+static thread_local struct md_cache md_cache;
+
+md_cache::~md_cache() {
+  struct md_cache_block *block;
+  int i;
+
+  gone = true;
+  for (i = 0; i < MD_CACHE_SIZES; i++)
+    while ((block = lists[i].head)) {
+      lists[i].head = block->next;
+      xfree(block);
+    }
+}
+
+/* Allocate SIZE bytes for a handle or digest entry, in secure memory
+   if SECURE is set.  */
+static void *md_alloc(size_t size, int secure) {
+  struct md_cache *cache = &md_cache;
+  struct md_cache_block *block;
+  int i;
+
+  if (secure) return xtrymalloc_secure(size);
+  if (!cache->gone)
+    for (i = 0; i < MD_CACHE_SIZES; i++)
+      if (cache->lists[i].size == size && (block = cache->lists[i].head)) {
+        cache->lists[i].head = block->next;
+        cache->lists[i].count--;
+        return block;
+      }
+  return xtrymalloc(size);
+}
+
+/* Wipe and release the block P of SIZE bytes allocated by
+   md_alloc.  */
+static void md_free(void *p, size_t size, int secure) {
+  struct md_cache *cache = &md_cache;
+  struct md_cache_block *block;
+  int i, unused = -1;
+
+  wipememory(p, size);
+  if (!secure && !cache->gone) {
+    for (i = 0; i < MD_CACHE_SIZES; i++) {
+      if (cache->lists[i].size == size) break;
+      if (unused < 0 && !cache->lists[i].count) unused = i;
+    }
+    if (i == MD_CACHE_SIZES && unused >= 0) {
+      i = unused;
+      cache->lists[i].size = size;
+    }
+    if (i < MD_CACHE_SIZES && cache->lists[i].count < MD_CACHE_DEPTH) {
+      block = (struct md_cache_block *)p;
+      block->next = cache->lists[i].head;
+      cache->lists[i].head = block;
+      cache->lists[i].count++;
+      return;
+    }
+  }
+  xfree(p);
+}
+
 static int map_algo(int algo) { return algo; }
 
 /* Return the spec structure for the hash algorithm ALGO.  For an
@@ -269,10 +354,7 @@ static gpg_error_t md_open(gcry_md_hd_t *h, int algo, unsigned int flags) {
       sizeof(PROPERLY_ALIGNED_TYPE);
 
   /* Allocate and set the Context pointer to the private data */
-  if (secure)
-    hd = (gcry_md_hd_t)xtrymalloc_secure(n + sizeof(struct gcry_md_context));
-  else
-    hd = (gcry_md_hd_t)xtrymalloc(n + sizeof(struct gcry_md_context));
+  hd = (gcry_md_hd_t)md_alloc(n + sizeof(struct gcry_md_context), secure);
 
   if (!hd) err = gpg_error_from_errno(errno);
 
@@ -348,10 +430,7 @@ static gpg_error_t md_enable(gcry_md_hd_t hd, int algorithm) {
          sizeof(entry->context));
 
     /* And allocate a new list entry. */
-    if (h->flags.secure)
-      entry = (GcryDigestEntry *)xtrymalloc_secure(size);
-    else
-      entry = (GcryDigestEntry *)xtrymalloc(size);
+    entry = (GcryDigestEntry *)md_alloc(size, h->flags.secure);
 
     if (!entry)
       err = gpg_error_from_errno(errno);
@@ -385,10 +464,8 @@ static gpg_error_t md_copy(gcry_md_hd_t ahd, gcry_md_hd_t *b_hd) {
   if (ahd->bufpos) md_write(ahd, NULL, 0);
 
   n = (char *)ahd->ctx - (char *)ahd;
-  if (a->flags.secure)
-    bhd = (gcry_md_hd_t)xtrymalloc_secure(n + sizeof(struct gcry_md_context));
-  else
-    bhd = (gcry_md_hd_t)xtrymalloc(n + sizeof(struct gcry_md_context));
+  bhd = (gcry_md_hd_t)md_alloc(n + sizeof(struct gcry_md_context),
+                               a->flags.secure);
 
   if (!bhd) {
     err = gpg_error_from_syserror();
@@ -408,10 +485,7 @@ static gpg_error_t md_copy(gcry_md_hd_t ahd, gcry_md_hd_t *b_hd) {
   /* Copy the complete list of algorithms.  The copied list is
      reversed, but that doesn't matter. */
   for (ar = a->list; ar; ar = ar->next) {
-    if (a->flags.secure)
-      br = (GcryDigestEntry *)xtrymalloc_secure(ar->actual_struct_size);
-    else
-      br = (GcryDigestEntry *)xtrymalloc(ar->actual_struct_size);
+    br = (GcryDigestEntry *)md_alloc(ar->actual_struct_size, a->flags.secure);
     if (!br) {
       err = gpg_error_from_syserror();
       md_close(bhd);
@@ -439,6 +513,41 @@ gpg_error_t _gcry_md_copy(gcry_md_hd_t *handle, gcry_md_hd_t hd) {
   return rc;
 }
 
+/* Copy the state of the digest object SRC into DST, which must have
+   been opened with the same flags and have the same algorithms
+   enabled.  Unlike _gcry_md_copy, this does not allocate, so a
+   checkpoint of a common prefix can be restored cheaply.  */
+gpg_error_t _gcry_md_copy_state(gcry_md_hd_t dst, gcry_md_hd_t src) {
+  struct gcry_md_context *a = src->ctx;
+  struct gcry_md_context *b = dst->ctx;
+  GcryDigestEntry *ar, *br;
+  size_t na = 0, nb = 0;
+
+  if (a->flags.secure != b->flags.secure || a->flags.hmac != b->flags.hmac ||
+      a->flags.bugemu1 != b->flags.bugemu1)
+    return GPG_ERR_INV_ARG;
+  for (ar = a->list; ar; ar = ar->next) na++;
+  for (br = b->list; br; br = br->next) {
+    for (ar = a->list; ar; ar = ar->next)
+      if (ar->spec == br->spec) break;
+    if (!ar || ar->actual_struct_size != br->actual_struct_size)
+      return GPG_ERR_INV_ARG;
+    nb++;
+  }
+  if (na != nb) return GPG_ERR_INV_ARG;
+
+  if (src->bufpos) md_write(src, NULL, 0);
+  for (br = b->list; br; br = br->next) {
+    for (ar = a->list; ar->spec != br->spec; ar = ar->next)
+      ;
+    memcpy(&br->context, &ar->context,
+           ar->actual_struct_size - offsetof(GcryDigestEntry, context));
+  }
+  dst->bufpos = 0;
+  b->flags.finalized = a->flags.finalized;
+  return 0;
+}
+
 /*
  * Reset all contexts and discard any buffered stuff.  This may be used
  * instead of a md_close(); md_open().
@@ -468,12 +577,10 @@ static void md_close(gcry_md_hd_t a) {
   if (a->ctx->debug) md_stop_debug(a);
   for (r = a->ctx->list; r; r = r2) {
     r2 = r->next;
-    wipememory(r, r->actual_struct_size);
-    xfree(r);
+    md_free(r, r->actual_struct_size, a->ctx->flags.secure);
   }
 
-  wipememory(a, a->ctx->actual_handle_size);
-  xfree(a);
+  md_free(a, a->ctx->actual_handle_size, a->ctx->flags.secure);
 }
 
 void _gcry_md_close(gcry_md_hd_t hd) { md_close(hd); }
@@ -541,6 +648,66 @@ static void md_final(gcry_md_hd_t a) {
   }
 }
 
+/* The number of contexts collected for one call of a final_multi
+   function and the number of algorithms collected at the same time by
+   _gcry_md_final_batch.  */
+#define MD_BATCH_SIZE 8
+#define MD_BATCH_GROUPS 4
+
+/* Finalize the N handles at HDS, like _gcry_md_final does for each of
+   them.  Handles with only one algorithm enabled, which also provides
+   a final_multi function, are finalized together with other handles
+   of the same algorithm.  */
+void _gcry_md_final_batch(gcry_md_hd_t *hds, size_t n) {
+  struct {
+    gcry_md_final_multi_t final_multi;
+    void *c[MD_BATCH_SIZE];
+    size_t n;
+  } groups[MD_BATCH_GROUPS];
+  size_t i, k;
+
+  for (k = 0; k < MD_BATCH_GROUPS; k++) groups[k].n = 0;
+
+  for (i = 0; i < n; i++) {
+    gcry_md_hd_t a = hds[i];
+    GcryDigestEntry *r = a->ctx->list;
+
+    if (a->ctx->flags.finalized) continue;
+
+    if (!r || r->next || !r->spec->final_multi || a->ctx->flags.hmac ||
+        a->ctx->debug) {
+      md_final(a);
+      continue;
+    }
+
+    if (a->bufpos) md_write(a, NULL, 0);
+    a->ctx->flags.finalized = 1;
+
+    /* Find the group of the algorithm or start a new one.  If all
+       groups are in use, the first one is flushed.  */
+    for (k = 0; k < MD_BATCH_GROUPS; k++)
+      if (groups[k].n && groups[k].final_multi == r->spec->final_multi)
+        break;
+    if (k == MD_BATCH_GROUPS)
+      for (k = 0; k < MD_BATCH_GROUPS; k++)
+        if (!groups[k].n) break;
+    if (k == MD_BATCH_GROUPS) {
+      k = 0;
+      groups[k].final_multi(groups[k].c, groups[k].n);
+      groups[k].n = 0;
+    }
+    groups[k].final_multi = r->spec->final_multi;
+    groups[k].c[groups[k].n++] = &r->context.c;
+    if (groups[k].n == MD_BATCH_SIZE) {
+      groups[k].final_multi(groups[k].c, groups[k].n);
+      groups[k].n = 0;
+    }
+  }
+
+  for (k = 0; k < MD_BATCH_GROUPS; k++)
+    if (groups[k].n) groups[k].final_multi(groups[k].c, groups[k].n);
+}
+
 static gpg_error_t md_setkey(gcry_md_hd_t h, const unsigned char *key,
                              size_t keylen) {
   gpg_error_t rc = 0;
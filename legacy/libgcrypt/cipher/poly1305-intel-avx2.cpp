@@ -0,0 +1,217 @@
+/* poly1305-intel-avx2.c - AVX2 Poly1305
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The message blocks m_1, ..., m_n are split into four interleaved
+ * sequences, one for each 64 bit lane: lane K accumulates the blocks
+ * m_{4i+K} with Horner's rule in r^4.  For the last four blocks, lane
+ * K multiplies by r^(4-K) instead, so that the sum of the lanes is
+ * the same as the sequential computation.  The limbs are in radix
+ * 2^26, as in the reference code, so the products fit into the 64
+ * bit lanes of VPMULUDQ.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "poly1305-internal.h"
+
+#ifdef POLY1305_USE_INTEL_AVX2
+
+#include <immintrin.h>
+
+/* Set OUT to A * R mod 2^130 - 5, with partially reduced limbs.  */
+static void poly1305_mul_ref(u32 out[5], const u32 a[5], const u32 r[5]) {
+  u32 s1 = r[1] * 5, s2 = r[2] * 5, s3 = r[3] * 5, s4 = r[4] * 5;
+  u64 d0, d1, d2, d3, d4;
+  u32 c;
+
+  d0 = ((u64)a[0] * r[0]) + ((u64)a[1] * s4) + ((u64)a[2] * s3) +
+       ((u64)a[3] * s2) + ((u64)a[4] * s1);
+  d1 = ((u64)a[0] * r[1]) + ((u64)a[1] * r[0]) + ((u64)a[2] * s4) +
+       ((u64)a[3] * s3) + ((u64)a[4] * s2);
+  d2 = ((u64)a[0] * r[2]) + ((u64)a[1] * r[1]) + ((u64)a[2] * r[0]) +
+       ((u64)a[3] * s4) + ((u64)a[4] * s3);
+  d3 = ((u64)a[0] * r[3]) + ((u64)a[1] * r[2]) + ((u64)a[2] * r[1]) +
+       ((u64)a[3] * r[0]) + ((u64)a[4] * s4);
+  d4 = ((u64)a[0] * r[4]) + ((u64)a[1] * r[3]) + ((u64)a[2] * r[2]) +
+       ((u64)a[3] * r[1]) + ((u64)a[4] * r[0]);
+
+  c = (u32)(d0 >> 26);
+  out[0] = (u32)d0 & 0x3ffffff;
+  d1 += c;
+  c = (u32)(d1 >> 26);
+  out[1] = (u32)d1 & 0x3ffffff;
+  d2 += c;
+  c = (u32)(d2 >> 26);
+  out[2] = (u32)d2 & 0x3ffffff;
+  d3 += c;
+  c = (u32)(d3 >> 26);
+  out[3] = (u32)d3 & 0x3ffffff;
+  d4 += c;
+  c = (u32)(d4 >> 26);
+  out[4] = (u32)d4 & 0x3ffffff;
+  out[0] += c * 5;
+  c = out[0] >> 26;
+  out[0] &= 0x3ffffff;
+  out[1] += c;
+}
+
+/* Multiply the lanes of H by the lanes of R (with S = 5 * R) and
+   partially reduce the result.  */
+#define MUL_REDUCE(h, r, s)                                             \
+  do {                                                                  \
+    d0 = _mm256_add_epi64(                                              \
+        _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[0]), \
+                                          _mm256_mul_epu32(h[1], s[4])), \
+                         _mm256_add_epi64(_mm256_mul_epu32(h[2], s[3]), \
+                                          _mm256_mul_epu32(h[3], s[2]))), \
+        _mm256_mul_epu32(h[4], s[1]));                                  \
+    d1 = _mm256_add_epi64(                                              \
+        _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[1]), \
+                                          _mm256_mul_epu32(h[1], r[0])), \
+                         _mm256_add_epi64(_mm256_mul_epu32(h[2], s[4]), \
+                                          _mm256_mul_epu32(h[3], s[3]))), \
+        _mm256_mul_epu32(h[4], s[2]));                                  \
+    d2 = _mm256_add_epi64(                                              \
+        _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[2]), \
+                                          _mm256_mul_epu32(h[1], r[1])), \
+                         _mm256_add_epi64(_mm256_mul_epu32(h[2], r[0]), \
+                                          _mm256_mul_epu32(h[3], s[4]))), \
+        _mm256_mul_epu32(h[4], s[3]));                                  \
+    d3 = _mm256_add_epi64(                                              \
+        _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[3]), \
+                                          _mm256_mul_epu32(h[1], r[2])), \
+                         _mm256_add_epi64(_mm256_mul_epu32(h[2], r[1]), \
+                                          _mm256_mul_epu32(h[3], r[0]))), \
+        _mm256_mul_epu32(h[4], s[4]));                                  \
+    d4 = _mm256_add_epi64(                                              \
+        _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[4]), \
+                                          _mm256_mul_epu32(h[1], r[3])), \
+                         _mm256_add_epi64(_mm256_mul_epu32(h[2], r[2]), \
+                                          _mm256_mul_epu32(h[3], r[1]))), \
+        _mm256_mul_epu32(h[4], r[0]));                                  \
+    d1 = _mm256_add_epi64(d1, _mm256_srli_epi64(d0, 26));               \
+    h[0] = _mm256_and_si256(d0, mask26);                                \
+    d2 = _mm256_add_epi64(d2, _mm256_srli_epi64(d1, 26));               \
+    h[1] = _mm256_and_si256(d1, mask26);                                \
+    d3 = _mm256_add_epi64(d3, _mm256_srli_epi64(d2, 26));               \
+    h[2] = _mm256_and_si256(d2, mask26);                                \
+    d4 = _mm256_add_epi64(d4, _mm256_srli_epi64(d3, 26));               \
+    h[3] = _mm256_and_si256(d3, mask26);                                \
+    c = _mm256_srli_epi64(d4, 26);                                      \
+    h[4] = _mm256_and_si256(d4, mask26);                                \
+    h[0] = _mm256_add_epi64(                                            \
+        h[0], _mm256_add_epi64(c, _mm256_slli_epi64(c, 2)));            \
+    h[1] = _mm256_add_epi64(h[1], _mm256_srli_epi64(h[0], 26));         \
+    h[0] = _mm256_and_si256(h[0], mask26);                              \
+  } while (0)
+
+/* Add the four blocks at M to the lanes of H.  */
+#define ADD_BLOCKS(h, m)                                                   \
+  do {                                                                     \
+    __m256i v0 = _mm256_loadu_si256((const __m256i *)(m));                 \
+    __m256i v1 = _mm256_loadu_si256((const __m256i *)((m) + 32));          \
+    __m256i lo = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(v0, v1),   \
+                                          _MM_SHUFFLE(3, 1, 2, 0));        \
+    __m256i hi = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(v0, v1),   \
+                                          _MM_SHUFFLE(3, 1, 2, 0));        \
+    h[0] = _mm256_add_epi64(h[0], _mm256_and_si256(lo, mask26));           \
+    h[1] = _mm256_add_epi64(                                               \
+        h[1], _mm256_and_si256(_mm256_srli_epi64(lo, 26), mask26));        \
+    h[2] = _mm256_add_epi64(                                               \
+        h[2], _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(lo, 52),  \
+                                               _mm256_slli_epi64(hi, 12)), \
+                               mask26));                                   \
+    h[3] = _mm256_add_epi64(                                               \
+        h[3], _mm256_and_si256(_mm256_srli_epi64(hi, 14), mask26));        \
+    h[4] = _mm256_add_epi64(                                               \
+        h[4], _mm256_or_si256(_mm256_srli_epi64(hi, 40), hibit));          \
+  } while (0)
+
+unsigned int __attribute__((target("avx2")))
+_gcry_poly1305_intel_avx2_blocks(poly1305_state_avx2_t *st, const byte *m,
+                                 size_t bytes) {
+  const __m256i mask26 = _mm256_set1_epi64x(0x3ffffff);
+  const __m256i hibit = _mm256_set1_epi64x(1 << 24);
+  const u32 *rp[4];
+  __m256i h[5], r[5], s[5], d0, d1, d2, d3, d4, c;
+  u64 sum[5], lanes[4];
+  u32 t;
+  int i;
+
+  if (!st->have_powers) {
+    poly1305_mul_ref(st->rpow[0], st->ref.r, st->ref.r);
+    poly1305_mul_ref(st->rpow[1], st->rpow[0], st->ref.r);
+    poly1305_mul_ref(st->rpow[2], st->rpow[0], st->rpow[0]);
+    st->have_powers = 1;
+  }
+
+  /* The accumulator starts in lane 0.  */
+  for (i = 0; i < 5; i++) {
+    h[i] = _mm256_set_epi64x(0, 0, 0, st->ref.h[i]);
+    r[i] = _mm256_set1_epi64x(st->rpow[2][i]);
+    s[i] = _mm256_set1_epi64x(st->rpow[2][i] * 5);
+  }
+
+  for (;;) {
+    ADD_BLOCKS(h, m);
+    m += 64;
+    bytes -= 64;
+    if (bytes < 64) break;
+    MUL_REDUCE(h, r, s);
+  }
+
+  /* Lane K multiplies by r^(4-K).  */
+  rp[0] = st->rpow[2];
+  rp[1] = st->rpow[1];
+  rp[2] = st->rpow[0];
+  rp[3] = st->ref.r;
+  for (i = 0; i < 5; i++) {
+    r[i] = _mm256_set_epi64x(rp[3][i], rp[2][i], rp[1][i], rp[0][i]);
+    s[i] = _mm256_set_epi64x(rp[3][i] * 5, rp[2][i] * 5, rp[1][i] * 5,
+                             rp[0][i] * 5);
+  }
+  MUL_REDUCE(h, r, s);
+
+  /* Sum up the lanes and carry.  */
+  for (i = 0; i < 5; i++) {
+    _mm256_storeu_si256((__m256i *)lanes, h[i]);
+    sum[i] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+  for (i = 0; i < 4; i++) {
+    sum[i + 1] += sum[i] >> 26;
+    sum[i] &= 0x3ffffff;
+  }
+  t = (u32)(sum[4] >> 26);
+  sum[4] &= 0x3ffffff;
+  sum[0] += (u64)t * 5;
+  sum[1] += sum[0] >> 26;
+  sum[0] &= 0x3ffffff;
+  for (i = 0; i < 5; i++) st->ref.h[i] = (u32)sum[i];
+
+  for (i = 0; i < 5; i++) h[i] = r[i] = s[i] = _mm256_setzero_si256();
+  d0 = d1 = d2 = d3 = d4 = c = h[0];
+  wipememory(lanes, sizeof(lanes));
+  __asm__ volatile("" : : "m"(h), "m"(r), "m"(s) : "memory");
+  _mm256_zeroall();
+  return sizeof(sum) + sizeof(lanes) + 4 * sizeof(void *);
+}
+
+#endif /* POLY1305_USE_INTEL_AVX2 */
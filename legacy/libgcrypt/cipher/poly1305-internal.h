@@ -77,6 +77,16 @@
 #define POLY1305_NEON_ALIGNMENT 16
 #endif
 
+/* POLY1305_USE_INTEL_AVX2 indicates whether to compile the AVX2 code
+   in poly1305-intel-avx2.c.  It extends the reference implementation,
+   and only needs the compiler intrinsics.  */
+#undef POLY1305_USE_INTEL_AVX2
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    (__GNUC__ >= 5 || defined(__clang__)) && !defined(POLY1305_USE_SSE2)
+#define POLY1305_USE_INTEL_AVX2 1
+#define POLY1305_INTEL_AVX2_STATESIZE 128
+#endif
+
 /* Largest block-size used in any implementation (optimized implementations
  * might use block-size multiple of 16). */
 #ifdef POLY1305_USE_AVX2
@@ -96,6 +106,8 @@
 #define POLY1305_LARGEST_STATESIZE POLY1305_NEON_STATESIZE
 #elif defined(POLY1305_USE_SSE2)
 #define POLY1305_LARGEST_STATESIZE POLY1305_SSE2_STATESIZE
+#elif defined(POLY1305_USE_INTEL_AVX2)
+#define POLY1305_LARGEST_STATESIZE POLY1305_INTEL_AVX2_STATESIZE
 #else
 #define POLY1305_LARGEST_STATESIZE POLY1305_REF_STATESIZE
 #endif
@@ -131,6 +143,31 @@ typedef struct poly1305_ops_s {
                              byte mac[POLY1305_TAGLEN]) OPS_FUNC_ABI;
 } poly1305_ops_t;
 
+/* The state of the reference implementation.  The limbs of R and H
+   are in radix 2^26.  */
+typedef struct poly1305_state_ref32_s {
+  u32 r[5];
+  u32 h[5];
+  u32 pad[4];
+  byte final;
+} poly1305_state_ref32_t;
+
+#ifdef POLY1305_USE_INTEL_AVX2
+/* The state of the AVX2 implementation: the reference state, and the
+   powers r^2, r^3 and r^4 once they are needed.  */
+typedef struct poly1305_state_avx2_s {
+  poly1305_state_ref32_t ref;
+  u32 rpow[3][5];
+  int have_powers;
+} poly1305_state_avx2_t;
+
+/* Process BYTES bytes at M, a multiple of 64, four blocks at a time.
+   The caller must have checked for HWF_INTEL_AVX2.  Return the number
+   of bytes of stack to burn.  */
+unsigned int _gcry_poly1305_intel_avx2_blocks(poly1305_state_avx2_t *st,
+                                              const byte *m, size_t bytes);
+#endif
+
 typedef struct poly1305_context_s {
   byte state[POLY1305_LARGEST_STATESIZE + POLY1305_STATE_ALIGNMENT];
   byte buffer[POLY1305_LARGEST_BLOCKSIZE];
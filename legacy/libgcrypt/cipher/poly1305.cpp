@@ -101,13 +101,6 @@ static const poly1305_ops_t poly1305_armv7_neon_ops = {
  * multiplication and 64 bit addition.
  */
 
-typedef struct poly1305_state_ref32_s {
-  u32 r[5];
-  u32 h[5];
-  u32 pad[4];
-  byte final;
-} poly1305_state_ref32_t;
-
 #ifndef POLY1305_USE_SSE2
 static OPS_FUNC_ABI void poly1305_init_ext_ref32(void *state,
                                                  const poly1305_key_t *key) {
@@ -339,6 +332,57 @@ static OPS_FUNC_ABI unsigned int poly1305_finish_ext_ref32(
 }
 #endif /* !POLY1305_USE_SSE2*/
 
+#ifdef POLY1305_USE_INTEL_AVX2
+/* Below this many bytes, the reference code is used, as each call of
+   the AVX2 code sums up the lanes at the end.  */
+#define POLY1305_INTEL_AVX2_MIN_BYTES 256
+
+static OPS_FUNC_ABI void poly1305_init_ext_avx2(void *state,
+                                                const poly1305_key_t *key) {
+  poly1305_state_avx2_t *st = (poly1305_state_avx2_t *)state;
+
+  gcry_assert(sizeof(*st) + POLY1305_STATE_ALIGNMENT <=
+              sizeof(((poly1305_context_t *)0)->state));
+
+  poly1305_init_ext_ref32(&st->ref, key);
+  st->have_powers = 0;
+}
+
+static OPS_FUNC_ABI unsigned int poly1305_blocks_avx2(void *state,
+                                                      const byte *m,
+                                                      size_t bytes) {
+  poly1305_state_avx2_t *st = (poly1305_state_avx2_t *)state;
+  unsigned int burn = 0;
+
+  if (!st->ref.final && bytes >= POLY1305_INTEL_AVX2_MIN_BYTES) {
+    size_t want = bytes & ~(size_t)63;
+
+    burn = _gcry_poly1305_intel_avx2_blocks(st, m, want);
+    m += want;
+    bytes -= want;
+  }
+  if (bytes) {
+    unsigned int nburn = poly1305_blocks_ref32(&st->ref, m, bytes);
+    burn = nburn > burn ? nburn : burn;
+  }
+  return burn;
+}
+
+static OPS_FUNC_ABI unsigned int poly1305_finish_ext_avx2(
+    void *state, const byte *m, size_t remaining, byte mac[POLY1305_TAGLEN]) {
+  poly1305_state_avx2_t *st = (poly1305_state_avx2_t *)state;
+  unsigned int burn = poly1305_finish_ext_ref32(&st->ref, m, remaining, mac);
+
+  wipememory(st->rpow, sizeof(st->rpow));
+  st->have_powers = 0;
+  return burn;
+}
+
+static const poly1305_ops_t poly1305_intel_avx2_ops = {
+    POLY1305_REF_BLOCKSIZE, poly1305_init_ext_avx2, poly1305_blocks_avx2,
+    poly1305_finish_ext_avx2};
+#endif /* POLY1305_USE_INTEL_AVX2 */
+
 static inline void *poly1305_get_state(poly1305_context_t *ctx) {
   byte *c = ctx->state;
   c += POLY1305_STATE_ALIGNMENT - 1;
@@ -417,6 +461,10 @@ gpg_error_t _gcry_poly1305_init(poly1305_context_t *ctx, const byte *key,
   if (selftest_failed) return GPG_ERR_SELFTEST_FAILED;
 
   ctx->ops = &poly1305_default_ops;
+#ifdef POLY1305_USE_INTEL_AVX2
+  if (_gcry_get_hw_features() & HWF_INTEL_AVX2)
+    ctx->ops = &poly1305_intel_avx2_ops;
+#endif
 
   buf_cpy(keytmp.b, key, POLY1305_KEYLEN);
   poly1305_init(ctx, &keytmp);
@@ -21,6 +21,8 @@
 
 #include <config.h>
 
+#include <algorithm>
+#include <atomic>
 #include <mutex>
 
 #include <errno.h>
@@ -32,6 +34,8 @@
 #include "g10lib.h"
 #include "mpi.h"
 
+#include <neopg/utils/workers.h>
+
 static gcry_mpi_t gen_prime(unsigned int nbits, int secret,
                             int (*extra_check)(void *, gcry_mpi_t),
                             void *extra_check_arg);
@@ -181,8 +185,14 @@ void _gcry_register_primegen_progress(void (*cb)(void *, const char *, int, int,
   progress_cb_data = cb_data;
 }
 
+/* Serializes the progress callbacks of the prime search threads.  */
+static std::mutex progress_lock;
+
 static void progress(int c) {
-  if (progress_cb) progress_cb(progress_cb_data, "primegen", c, 0, 0);
+  if (progress_cb) {
+    std::lock_guard<std::mutex> lock(progress_lock);
+    progress_cb(progress_cb_data, "primegen", c, 0, 0);
+  }
 }
 
 /****************
@@ -580,21 +590,19 @@ gpg_error_t _gcry_generate_elg_prime(int mode, unsigned pbits, unsigned qbits,
                                  ret_factors, 0, 0, NULL, NULL);
 }
 
-static gcry_mpi_t gen_prime(unsigned int nbits, int secret,
-                            int (*extra_check)(void *, gcry_mpi_t),
-                            void *extra_check_arg) {
+/* Search for a prime of NBITS starting at random candidates.  This is
+   the core of gen_prime.  If STOP is not NULL, the search is
+   abandoned and NULL is returned as soon as STOP is set.  */
+static gcry_mpi_t gen_prime_search(unsigned int nbits, int secret,
+                                   int (*extra_check)(void *, gcry_mpi_t),
+                                   void *extra_check_arg,
+                                   const std::atomic<int> *stop) {
   gcry_mpi_t prime, ptest, pminus1, val_2, val_3, result;
   int i;
   unsigned int x, step;
   unsigned int count1, count2;
   int *mods;
 
-  /*   if (  DBG_CIPHER ) */
-  /*     log_debug ("generate a prime of %u bits ", nbits ); */
-
-  if (nbits < 16)
-    log_fatal("can't generate a prime with less than %d bits\n", 16);
-
   mods = (int *)xmalloc(no_of_small_prime_numbers * sizeof *mods);
   /* Make nbits fit into gcry_mpi_t implementation. */
   val_2 = mpi_alloc_set_ui(2);
@@ -604,7 +612,7 @@ static gcry_mpi_t gen_prime(unsigned int nbits, int secret,
   pminus1 = mpi_alloc_like(prime);
   ptest = mpi_alloc_like(prime);
   count1 = count2 = 0;
-  for (;;) { /* try forvever */
+  while (!stop || !*stop) { /* try forvever */
     int dotcount = 0;
 
     /* generate a random number */
@@ -632,6 +640,9 @@ static gcry_mpi_t gen_prime(unsigned int nbits, int secret,
       }
       if (x) continue; /* Found a multiple of an already known prime. */
 
+      /* Another thread found a prime.  */
+      if (stop && *stop) break;
+
       mpi_add_ui(ptest, prime, step);
 
       /* Do a fast Fermat test now. */
@@ -670,6 +681,72 @@ static gcry_mpi_t gen_prime(unsigned int nbits, int secret,
     }
     progress(':'); /* restart with a new random value */
   }
+
+  mpi_free(val_2);
+  mpi_free(val_3);
+  mpi_free(result);
+  mpi_free(pminus1);
+  mpi_free(prime);
+  mpi_free(ptest);
+  xfree(mods);
+  return NULL;
+}
+
+/* Primes with at least this many bits are searched for by several
+   threads.  Below that, starting the threads costs more than the
+   search.  */
+#define PRIME_PARALLEL_MIN_BITS 1024
+#define PRIME_MAX_THREADS 16
+
+/* Generate a prime of NBITS.  If EXTRA_CHECK is not NULL, it is
+   called with EXTRA_CHECK_ARG for each probable prime and rejects it
+   by returning true; it may be called from several threads at once.
+
+   The expected number of candidates to test grows with the size of
+   the prime, so for large primes each available core runs its own
+   search from independent random starting points.  The first prime
+   found is returned and the other searches are abandoned.  */
+static gcry_mpi_t gen_prime(unsigned int nbits, int secret,
+                            int (*extra_check)(void *, gcry_mpi_t),
+                            void *extra_check_arg) {
+  std::atomic<int> stop(0);
+  std::mutex result_lock;
+  gcry_mpi_t result = NULL;
+  size_t nthreads;
+
+  /*   if (  DBG_CIPHER ) */
+  /*     log_debug ("generate a prime of %u bits ", nbits ); */
+
+  if (nbits < 16)
+    log_fatal("can't generate a prime with less than %d bits\n", 16);
+
+  nthreads = NeoPG::hardware_threads();
+  if (nbits < PRIME_PARALLEL_MIN_BITS) nthreads = 1;
+  nthreads = std::min(nthreads, (size_t)PRIME_MAX_THREADS);
+  if (nthreads == 1)
+    return gen_prime_search(nbits, secret, extra_check, extra_check_arg, NULL);
+
+  auto worker = [&](size_t) {
+    gcry_mpi_t prime;
+
+    prime = gen_prime_search(nbits, secret, extra_check, extra_check_arg,
+                             &stop);
+    if (!prime) return;
+
+    std::lock_guard<std::mutex> lock(result_lock);
+    if (result)
+      mpi_free(prime);
+    else {
+      result = prime;
+      stop = 1;
+    }
+  };
+
+  /* If a thread can't be created, the search just runs on fewer
+     threads.  */
+  NeoPG::run_workers(nthreads, worker);
+
+  return result;
 }
 
 /****************
@@ -399,6 +399,25 @@ leave:
   return rc;
 }
 
+/* Check the signatures of the NJOBS jobs at JOBS like _gcry_pk_verify
+   and store the result of each in its ERR field.  This runs in the
+   calling thread; callers with many signatures give a batch to each
+   of their threads.  The Montgomery contexts of RSA moduli are cached,
+   so jobs by the same RSA key only set up the first one.  Returns the
+   error of the first failed job or 0.  */
+gpg_error_t _gcry_pk_verify_batch(gcry_pk_verify_job_t *jobs, size_t njobs) {
+  gpg_error_t rc = 0;
+  size_t i;
+
+  if (!jobs && njobs) return GPG_ERR_INV_ARG;
+
+  for (i = 0; i < njobs; i++) {
+    jobs[i].err = _gcry_pk_verify(jobs[i].sigval, jobs[i].data, jobs[i].pkey);
+    if (jobs[i].err && !rc) rc = jobs[i].err;
+  }
+  return rc;
+}
+
 /*
    Test a key.
 
@@ -0,0 +1,195 @@
+/* rijndael-aesni-cfb.c - AES-NI and VAES accelerated CFB decryption
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * CFB decryption computes P[i] = E(C[i-1]) ^ C[i], so unlike CFB
+ * encryption all the block cipher calls of a run of blocks are
+ * independent.  These functions keep eight (AES-NI) or sixteen (VAES)
+ * blocks in flight to hide the latency of the AESENC instruction.
+ * Only the encryption key schedule in the generic layout is needed,
+ * which is the byte order AESENC expects.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "g10lib.h"
+#include "rijndael-internal.h"
+#include "types.h"
+
+#ifdef USE_AESNI_CFB
+
+#include <immintrin.h>
+
+#define RK(r) _mm_loadu_si128((const __m128i *)ctx->keyschenc32[r])
+#define LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define STORE(p, x) _mm_storeu_si128((__m128i *)(p), x)
+
+/* Decrypt NBLOCKS blocks, eight at a time, and return the new IV.
+   OUTBUF may be the same as INBUF: the input blocks of the cipher are
+   read before any output is written, and each ciphertext block for
+   the final XOR is loaded right before the output block at the same
+   position is stored.  */
+static inline __attribute__((always_inline, target("aes,sse2"))) __m128i
+aesni_cfb_dec_blocks(const RIJNDAEL_context *ctx, unsigned char *outbuf,
+                     const unsigned char *inbuf, __m128i iv, size_t nblocks) {
+  const int rounds = ctx->rounds;
+  __m128i b0, b1, b2, b3, b4, b5, b6, b7, k;
+  int r;
+
+  for (; nblocks >= 8; nblocks -= 8) {
+    k = RK(0);
+    b0 = _mm_xor_si128(iv, k);
+    b1 = _mm_xor_si128(LOAD(inbuf + 0 * 16), k);
+    b2 = _mm_xor_si128(LOAD(inbuf + 1 * 16), k);
+    b3 = _mm_xor_si128(LOAD(inbuf + 2 * 16), k);
+    b4 = _mm_xor_si128(LOAD(inbuf + 3 * 16), k);
+    b5 = _mm_xor_si128(LOAD(inbuf + 4 * 16), k);
+    b6 = _mm_xor_si128(LOAD(inbuf + 5 * 16), k);
+    b7 = _mm_xor_si128(LOAD(inbuf + 6 * 16), k);
+    iv = LOAD(inbuf + 7 * 16);
+
+    for (r = 1; r < rounds; r++) {
+      k = RK(r);
+      b0 = _mm_aesenc_si128(b0, k);
+      b1 = _mm_aesenc_si128(b1, k);
+      b2 = _mm_aesenc_si128(b2, k);
+      b3 = _mm_aesenc_si128(b3, k);
+      b4 = _mm_aesenc_si128(b4, k);
+      b5 = _mm_aesenc_si128(b5, k);
+      b6 = _mm_aesenc_si128(b6, k);
+      b7 = _mm_aesenc_si128(b7, k);
+    }
+
+    k = RK(rounds);
+    STORE(outbuf + 0 * 16,
+          _mm_aesenclast_si128(b0, _mm_xor_si128(k, LOAD(inbuf + 0 * 16))));
+    STORE(outbuf + 1 * 16,
+          _mm_aesenclast_si128(b1, _mm_xor_si128(k, LOAD(inbuf + 1 * 16))));
+    STORE(outbuf + 2 * 16,
+          _mm_aesenclast_si128(b2, _mm_xor_si128(k, LOAD(inbuf + 2 * 16))));
+    STORE(outbuf + 3 * 16,
+          _mm_aesenclast_si128(b3, _mm_xor_si128(k, LOAD(inbuf + 3 * 16))));
+    STORE(outbuf + 4 * 16,
+          _mm_aesenclast_si128(b4, _mm_xor_si128(k, LOAD(inbuf + 4 * 16))));
+    STORE(outbuf + 5 * 16,
+          _mm_aesenclast_si128(b5, _mm_xor_si128(k, LOAD(inbuf + 5 * 16))));
+    STORE(outbuf + 6 * 16,
+          _mm_aesenclast_si128(b6, _mm_xor_si128(k, LOAD(inbuf + 6 * 16))));
+    STORE(outbuf + 7 * 16, _mm_aesenclast_si128(b7, _mm_xor_si128(k, iv)));
+
+    outbuf += 8 * 16;
+    inbuf += 8 * 16;
+  }
+
+  for (; nblocks; nblocks--) {
+    b0 = _mm_xor_si128(iv, RK(0));
+    for (r = 1; r < rounds; r++) b0 = _mm_aesenc_si128(b0, RK(r));
+    iv = LOAD(inbuf);
+    STORE(outbuf, _mm_aesenclast_si128(b0, _mm_xor_si128(RK(rounds), iv)));
+    outbuf += 16;
+    inbuf += 16;
+  }
+
+  return iv;
+}
+
+/* Bulk CFB decryption of NBLOCKS blocks with AES-NI.  IV is updated
+   to the last ciphertext block.  The caller must have checked for
+   HWF_INTEL_AESNI.  */
+void __attribute__((target("aes,sse2")))
+_gcry_aes_aesni_intrin_cfb_dec(const RIJNDAEL_context *ctx,
+                               unsigned char *outbuf,
+                               const unsigned char *inbuf, unsigned char *iv,
+                               size_t nblocks) {
+  STORE(iv, aesni_cfb_dec_blocks(ctx, outbuf, inbuf, LOAD(iv), nblocks));
+}
+
+#ifdef USE_VAES_CFB
+
+#define RK2(r) _mm256_broadcastsi128_si256(RK(r))
+#define LOAD2(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE2(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+
+/* The last round of the blocks in register B, which is output pair I,
+   folded with the XOR of the ciphertext.  */
+#define LAST2(i, b)                                              \
+  STORE2(outbuf + (i)*32,                                        \
+         _mm256_aesenclast_epi128(                               \
+             b, _mm256_xor_si256(k, LOAD2(inbuf + (i)*32))))
+
+/* Bulk CFB decryption of NBLOCKS blocks with VAES, sixteen blocks at
+   a time in eight 256 bit registers.  The input blocks of the cipher
+   are the ciphertext shifted by one block, so apart from the first
+   register each of them is a single unaligned load.  The caller must
+   have checked for HWF_INTEL_VAES and HWF_INTEL_AESNI.  */
+void __attribute__((target("vaes,avx2,aes")))
+_gcry_aes_vaes_cfb_dec(const RIJNDAEL_context *ctx, unsigned char *outbuf,
+                       const unsigned char *inbuf, unsigned char *iv_arg,
+                       size_t nblocks) {
+  const int rounds = ctx->rounds;
+  __m256i b0, b1, b2, b3, b4, b5, b6, b7, k;
+  __m128i iv = LOAD(iv_arg);
+  int r;
+
+  for (; nblocks >= 16; nblocks -= 16) {
+    k = RK2(0);
+    b0 = _mm256_inserti128_si256(_mm256_castsi128_si256(iv), LOAD(inbuf), 1);
+    b0 = _mm256_xor_si256(b0, k);
+    b1 = _mm256_xor_si256(LOAD2(inbuf + 1 * 32 - 16), k);
+    b2 = _mm256_xor_si256(LOAD2(inbuf + 2 * 32 - 16), k);
+    b3 = _mm256_xor_si256(LOAD2(inbuf + 3 * 32 - 16), k);
+    b4 = _mm256_xor_si256(LOAD2(inbuf + 4 * 32 - 16), k);
+    b5 = _mm256_xor_si256(LOAD2(inbuf + 5 * 32 - 16), k);
+    b6 = _mm256_xor_si256(LOAD2(inbuf + 6 * 32 - 16), k);
+    b7 = _mm256_xor_si256(LOAD2(inbuf + 7 * 32 - 16), k);
+    iv = LOAD(inbuf + 15 * 16);
+
+    for (r = 1; r < rounds; r++) {
+      k = RK2(r);
+      b0 = _mm256_aesenc_epi128(b0, k);
+      b1 = _mm256_aesenc_epi128(b1, k);
+      b2 = _mm256_aesenc_epi128(b2, k);
+      b3 = _mm256_aesenc_epi128(b3, k);
+      b4 = _mm256_aesenc_epi128(b4, k);
+      b5 = _mm256_aesenc_epi128(b5, k);
+      b6 = _mm256_aesenc_epi128(b6, k);
+      b7 = _mm256_aesenc_epi128(b7, k);
+    }
+
+    k = RK2(rounds);
+    LAST2(0, b0);
+    LAST2(1, b1);
+    LAST2(2, b2);
+    LAST2(3, b3);
+    LAST2(4, b4);
+    LAST2(5, b5);
+    LAST2(6, b6);
+    LAST2(7, b7);
+
+    outbuf += 16 * 16;
+    inbuf += 16 * 16;
+  }
+
+  STORE(iv_arg, aesni_cfb_dec_blocks(ctx, outbuf, inbuf, iv, nblocks));
+}
+
+#endif /*USE_VAES_CFB*/
+
+#endif /*USE_AESNI_CFB*/
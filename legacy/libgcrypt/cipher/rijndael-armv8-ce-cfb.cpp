@@ -0,0 +1,119 @@
+/* rijndael-armv8-ce-cfb.c - ARMv8 Crypto Extension CFB decryption
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The AArch64 counterpart of rijndael-aesni-cfb.c: eight independent
+ * blocks are encrypted at a time with AESE and AESMC, using the
+ * generic encryption key schedule.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "g10lib.h"
+#include "rijndael-internal.h"
+#include "types.h"
+
+#ifdef USE_ARM_CE_CFB
+
+#include <arm_neon.h>
+
+/* One full round on block B with round key K.  AESE does AddRoundKey,
+   SubBytes and ShiftRows, AESMC the MixColumns step.  */
+#define ROUND(b, k) b = vaesmcq_u8(vaeseq_u8(b, k))
+
+/* Bulk CFB decryption of NBLOCKS blocks.  IV is updated to the last
+   ciphertext block.  OUTBUF may be the same as INBUF.  The caller must
+   have checked for HWF_ARM_AES.  */
+void __attribute__((target("+crypto")))
+_gcry_aes_armv8_ce_intrin_cfb_dec(const RIJNDAEL_context *ctx,
+                                  unsigned char *outbuf,
+                                  const unsigned char *inbuf,
+                                  unsigned char *iv_arg, size_t nblocks) {
+  const int rounds = ctx->rounds;
+  uint8x16_t k[MAXROUNDS + 1];
+  uint8x16_t b0, b1, b2, b3, b4, b5, b6, b7;
+  uint8x16_t iv = vld1q_u8(iv_arg);
+  int r;
+
+  for (r = 0; r <= rounds; r++) k[r] = vld1q_u8(ctx->keyschenc[r][0]);
+
+  for (; nblocks >= 8; nblocks -= 8) {
+    b0 = iv;
+    b1 = vld1q_u8(inbuf + 0 * 16);
+    b2 = vld1q_u8(inbuf + 1 * 16);
+    b3 = vld1q_u8(inbuf + 2 * 16);
+    b4 = vld1q_u8(inbuf + 3 * 16);
+    b5 = vld1q_u8(inbuf + 4 * 16);
+    b6 = vld1q_u8(inbuf + 5 * 16);
+    b7 = vld1q_u8(inbuf + 6 * 16);
+    iv = vld1q_u8(inbuf + 7 * 16);
+
+    for (r = 0; r < rounds - 1; r++) {
+      ROUND(b0, k[r]);
+      ROUND(b1, k[r]);
+      ROUND(b2, k[r]);
+      ROUND(b3, k[r]);
+      ROUND(b4, k[r]);
+      ROUND(b5, k[r]);
+      ROUND(b6, k[r]);
+      ROUND(b7, k[r]);
+    }
+
+    /* The last round has no MixColumns.  */
+    b0 = veorq_u8(vaeseq_u8(b0, k[r]), k[r + 1]);
+    b1 = veorq_u8(vaeseq_u8(b1, k[r]), k[r + 1]);
+    b2 = veorq_u8(vaeseq_u8(b2, k[r]), k[r + 1]);
+    b3 = veorq_u8(vaeseq_u8(b3, k[r]), k[r + 1]);
+    b4 = veorq_u8(vaeseq_u8(b4, k[r]), k[r + 1]);
+    b5 = veorq_u8(vaeseq_u8(b5, k[r]), k[r + 1]);
+    b6 = veorq_u8(vaeseq_u8(b6, k[r]), k[r + 1]);
+    b7 = veorq_u8(vaeseq_u8(b7, k[r]), k[r + 1]);
+
+    vst1q_u8(outbuf + 0 * 16, veorq_u8(b0, vld1q_u8(inbuf + 0 * 16)));
+    vst1q_u8(outbuf + 1 * 16, veorq_u8(b1, vld1q_u8(inbuf + 1 * 16)));
+    vst1q_u8(outbuf + 2 * 16, veorq_u8(b2, vld1q_u8(inbuf + 2 * 16)));
+    vst1q_u8(outbuf + 3 * 16, veorq_u8(b3, vld1q_u8(inbuf + 3 * 16)));
+    vst1q_u8(outbuf + 4 * 16, veorq_u8(b4, vld1q_u8(inbuf + 4 * 16)));
+    vst1q_u8(outbuf + 5 * 16, veorq_u8(b5, vld1q_u8(inbuf + 5 * 16)));
+    vst1q_u8(outbuf + 6 * 16, veorq_u8(b6, vld1q_u8(inbuf + 6 * 16)));
+    vst1q_u8(outbuf + 7 * 16, veorq_u8(b7, iv));
+
+    outbuf += 8 * 16;
+    inbuf += 8 * 16;
+  }
+
+  for (; nblocks; nblocks--) {
+    b0 = iv;
+    for (r = 0; r < rounds - 1; r++) ROUND(b0, k[r]);
+    b0 = veorq_u8(vaeseq_u8(b0, k[r]), k[r + 1]);
+    iv = vld1q_u8(inbuf);
+    vst1q_u8(outbuf, veorq_u8(b0, iv));
+    outbuf += 16;
+    inbuf += 16;
+  }
+
+  vst1q_u8(iv_arg, iv);
+
+  wipememory(k, sizeof(k));
+}
+
+#undef ROUND
+
+#endif /*USE_ARM_CE_CFB*/
@@ -99,6 +99,27 @@
 #endif
 #endif /* ENABLE_ARM_CRYPTO_SUPPORT */
 
+/* USE_AESNI_CFB indicates whether to compile the AES-NI CFB decryption
+   in rijndael-aesni-cfb.c, and USE_VAES_CFB whether to add the VAES
+   variant there.  Unlike USE_AESNI, these only need the compiler
+   intrinsics and work on the generic key schedule.  */
+#undef USE_AESNI_CFB
+#undef USE_VAES_CFB
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (__GNUC__ >= 5 || defined(__clang__))
+#define USE_AESNI_CFB 1
+#if defined(__x86_64__) && (__GNUC__ >= 8 || defined(__clang__))
+#define USE_VAES_CFB 1
+#endif
+#endif
+
+/* USE_ARM_CE_CFB indicates whether to compile the ARMv8 Crypto
+   Extension CFB decryption in rijndael-armv8-ce-cfb.c.  */
+#undef USE_ARM_CE_CFB
+#if defined(__AARCH64EL__) && defined(__GNUC__) && __GNUC__ >= 6
+#define USE_ARM_CE_CFB 1
+#endif
+
 struct RIJNDAEL_context_s;
 
 typedef unsigned int (*rijndael_cryptfn_t)(const struct RIJNDAEL_context_s *ctx,
@@ -145,6 +166,15 @@ typedef struct RIJNDAEL_context_s {
 #ifdef USE_ARM_CE
   unsigned int use_arm_ce : 1; /* ARMv8 CE shall be used.  */
 #endif                         /*USE_ARM_CE*/
+#ifdef USE_AESNI_CFB
+  unsigned int use_aesni_cfb : 1; /* AES-NI CFB decryption.  */
+#endif                            /*USE_AESNI_CFB*/
+#ifdef USE_VAES_CFB
+  unsigned int use_vaes_cfb : 1; /* VAES CFB decryption.  */
+#endif                           /*USE_VAES_CFB*/
+#ifdef USE_ARM_CE_CFB
+  unsigned int use_arm_ce_cfb : 1; /* ARMv8 CE CFB decryption.  */
+#endif                             /*USE_ARM_CE_CFB*/
   rijndael_cryptfn_t encrypt_fn;
   rijndael_cryptfn_t decrypt_fn;
   rijndael_prefetchfn_t prefetch_enc_fn;
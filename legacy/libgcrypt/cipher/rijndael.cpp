@@ -203,6 +203,26 @@ extern void _gcry_aes_armv8_ce_ocb_auth(gcry_cipher_hd_t c,
                                         const void *abuf_arg, size_t nblocks);
 #endif /*USE_ARM_ASM*/
 
+#ifdef USE_AESNI_CFB
+extern void _gcry_aes_aesni_intrin_cfb_dec(const RIJNDAEL_context *ctx,
+                                           unsigned char *outbuf,
+                                           const unsigned char *inbuf,
+                                           unsigned char *iv, size_t nblocks);
+#endif /*USE_AESNI_CFB*/
+#ifdef USE_VAES_CFB
+extern void _gcry_aes_vaes_cfb_dec(const RIJNDAEL_context *ctx,
+                                   unsigned char *outbuf,
+                                   const unsigned char *inbuf,
+                                   unsigned char *iv, size_t nblocks);
+#endif /*USE_VAES_CFB*/
+#ifdef USE_ARM_CE_CFB
+extern void _gcry_aes_armv8_ce_intrin_cfb_dec(const RIJNDAEL_context *ctx,
+                                              unsigned char *outbuf,
+                                              const unsigned char *inbuf,
+                                              unsigned char *iv,
+                                              size_t nblocks);
+#endif /*USE_ARM_CE_CFB*/
+
 static unsigned int do_encrypt(const RIJNDAEL_context *ctx, unsigned char *bx,
                                const unsigned char *ax);
 static unsigned int do_decrypt(const RIJNDAEL_context *ctx, unsigned char *bx,
@@ -246,7 +266,7 @@ static gpg_error_t do_setkey(RIJNDAEL_context *ctx, const byte *key,
   int i, j, r, t, rconpointer = 0;
   int KC;
 #if defined(USE_AESNI) || defined(USE_PADLOCK) || defined(USE_SSSE3) || \
-    defined(USE_ARM_CE)
+    defined(USE_ARM_CE) || defined(USE_AESNI_CFB) || defined(USE_ARM_CE_CFB)
   unsigned int hwfeatures;
 #endif
 
@@ -265,7 +285,7 @@ static gpg_error_t do_setkey(RIJNDAEL_context *ctx, const byte *key,
   ctx->rounds = rounds;
 
 #if defined(USE_AESNI) || defined(USE_PADLOCK) || defined(USE_SSSE3) || \
-    defined(USE_ARM_CE)
+    defined(USE_ARM_CE) || defined(USE_AESNI_CFB) || defined(USE_ARM_CE_CFB)
   hwfeatures = _gcry_get_hw_features();
 #endif
 
@@ -282,6 +302,15 @@ static gpg_error_t do_setkey(RIJNDAEL_context *ctx, const byte *key,
 #ifdef USE_ARM_CE
   ctx->use_arm_ce = 0;
 #endif
+#ifdef USE_AESNI_CFB
+  ctx->use_aesni_cfb = 0;
+#endif
+#ifdef USE_VAES_CFB
+  ctx->use_vaes_cfb = 0;
+#endif
+#ifdef USE_ARM_CE_CFB
+  ctx->use_arm_ce_cfb = 0;
+#endif
 
   if (0) {
     ;
@@ -427,6 +456,18 @@ static gpg_error_t do_setkey(RIJNDAEL_context *ctx, const byte *key,
 #undef tk_u32
 #undef k_u32
     wipememory(&tkk, sizeof(tkk));
+
+    /* The bulk CFB decryption only needs this key schedule.  */
+#ifdef USE_AESNI_CFB
+    ctx->use_aesni_cfb = !!(hwfeatures & HWF_INTEL_AESNI);
+#endif
+#ifdef USE_VAES_CFB
+    ctx->use_vaes_cfb = ((hwfeatures & HWF_INTEL_AESNI) &&
+                         (hwfeatures & HWF_INTEL_VAES));
+#endif
+#ifdef USE_ARM_CE_CFB
+    ctx->use_arm_ce_cfb = !!(hwfeatures & HWF_ARM_AES);
+#endif
   }
 
   return 0;
@@ -1056,6 +1097,24 @@ void _gcry_aes_cfb_dec(void *context, unsigned char *iv, void *outbuf_arg,
     burn_depth = 0;
   }
 #endif /*USE_ARM_CE*/
+#ifdef USE_VAES_CFB
+  else if (ctx->use_vaes_cfb) {
+    _gcry_aes_vaes_cfb_dec(ctx, outbuf, inbuf, iv, nblocks);
+    burn_depth = 0;
+  }
+#endif /*USE_VAES_CFB*/
+#ifdef USE_AESNI_CFB
+  else if (ctx->use_aesni_cfb) {
+    _gcry_aes_aesni_intrin_cfb_dec(ctx, outbuf, inbuf, iv, nblocks);
+    burn_depth = 0;
+  }
+#endif /*USE_AESNI_CFB*/
+#ifdef USE_ARM_CE_CFB
+  else if (ctx->use_arm_ce_cfb) {
+    _gcry_aes_armv8_ce_intrin_cfb_dec(ctx, outbuf, inbuf, iv, nblocks);
+    burn_depth = 0;
+  }
+#endif /*USE_ARM_CE_CFB*/
   else {
     rijndael_cryptfn_t encrypt_fn = ctx->encrypt_fn;
 
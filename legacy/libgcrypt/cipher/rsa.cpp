@@ -24,6 +24,9 @@
 */
 
 #include <config.h>
+
+#include <mutex>
+
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -800,25 +803,6 @@ static int check_secret_key(RSA_secret_key *sk) {
   return !rc;
 }
 
-/****************
- * Public key operation. Encrypt INPUT with PKEY and put result into OUTPUT.
- *
- *	c = m^e mod n
- *
- * Where c is OUTPUT, m is INPUT and e,n are elements of PKEY.
- */
-static void public_x(gcry_mpi_t output, gcry_mpi_t input,
-                     RSA_public_key *pkey) {
-  if (output == input) /* powm doesn't like output and input the same */
-  {
-    gcry_mpi_t x = mpi_alloc(mpi_get_nlimbs(input) * 2);
-    mpi_powm(x, input, pkey->e, pkey->n);
-    mpi_set(output, x);
-    mpi_free(x);
-  } else
-    mpi_powm(output, input, pkey->e, pkey->n);
-}
-
 #if 0
 static void
 stronger_key_check ( RSA_secret_key *skey )
@@ -882,13 +866,137 @@ stronger_key_check ( RSA_secret_key *skey )
 }
 #endif
 
+/* Montgomery contexts for the moduli of recently used keys, most
+   recently used first.  Repeated operations with the same key thus
+   skip the setup of the context.  Entries are reference counted so
+   that an entry can be evicted while another thread still uses it.
+   Public keys have their own cache, so that verifying many signatures
+   does not evict the contexts of the secret keys.  */
+#define RSA_MONT_CACHE_SIZE 8
+
+struct rsa_mont_s {
+  gcry_mpi_t mod; /* A copy of the modulus.  */
+  mpi_mont_t ctx;
+  unsigned int refs;
+};
+
+struct rsa_mont_cache_s {
+  struct rsa_mont_s *entries[RSA_MONT_CACHE_SIZE];
+};
+
+static std::mutex rsa_mont_lock;
+static struct rsa_mont_cache_s rsa_mont_secret;
+static struct rsa_mont_cache_s rsa_mont_public;
+
+/* Drop a reference to ENTRY.  Must be called with RSA_MONT_LOCK held.  */
+static void rsa_mont_unref(struct rsa_mont_s *entry) {
+  if (!entry || --entry->refs) return;
+  mpi_free(entry->mod);
+  mpi_mont_free(entry->ctx);
+  xfree(entry);
+}
+
+/* Move the entry at index I of CACHE to the front and return it with
+   a new reference.  Must be called with RSA_MONT_LOCK held.  */
+static struct rsa_mont_s *rsa_mont_use(struct rsa_mont_cache_s *cache,
+                                       int i) {
+  struct rsa_mont_s *entry = cache->entries[i];
+
+  memmove(cache->entries + 1, cache->entries, i * sizeof *cache->entries);
+  cache->entries[0] = entry;
+  entry->refs++;
+  return entry;
+}
+
+/* Return a referenced Montgomery context for MOD from CACHE, creating
+   it if needed, or NULL if MOD is not odd.  */
+static struct rsa_mont_s *rsa_mont_get(struct rsa_mont_cache_s *cache,
+                                       gcry_mpi_t mod) {
+  struct rsa_mont_s *entry;
+  int i;
+
+  {
+    std::lock_guard<std::mutex> lock(rsa_mont_lock);
+    for (i = 0; i < RSA_MONT_CACHE_SIZE && cache->entries[i]; i++)
+      if (!mpi_cmp(cache->entries[i]->mod, mod)) return rsa_mont_use(cache, i);
+  }
+
+  /* Do the precomputation without holding the lock.  */
+  entry = (struct rsa_mont_s *)xtrycalloc(1, sizeof *entry);
+  if (!entry) return NULL;
+  entry->ctx = mpi_mont_init(mod);
+  if (!entry->ctx) {
+    xfree(entry);
+    return NULL;
+  }
+  entry->mod = mpi_copy(mod);
+  entry->refs = 1;
+
+  std::lock_guard<std::mutex> lock(rsa_mont_lock);
+  for (i = 0; i < RSA_MONT_CACHE_SIZE && cache->entries[i]; i++)
+    if (!mpi_cmp(cache->entries[i]->mod, mod)) {
+      /* Another thread was faster.  */
+      rsa_mont_unref(entry);
+      return rsa_mont_use(cache, i);
+    }
+  rsa_mont_unref(cache->entries[RSA_MONT_CACHE_SIZE - 1]);
+  memmove(cache->entries + 1, cache->entries,
+          (RSA_MONT_CACHE_SIZE - 1) * sizeof *cache->entries);
+  cache->entries[0] = entry;
+  entry->refs++;
+  return entry;
+}
+
+/* RES = BASE ^ EXPO mod MOD, where MOD belongs to a secret key.  */
+static void rsa_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
+                     gcry_mpi_t mod) {
+  struct rsa_mont_s *entry = rsa_mont_get(&rsa_mont_secret, mod);
+
+  if (!entry) {
+    mpi_powm(res, base, expo, mod);
+    return;
+  }
+  mpi_powm_mont(res, base, expo, entry->ctx);
+
+  std::lock_guard<std::mutex> lock(rsa_mont_lock);
+  rsa_mont_unref(entry);
+}
+
+/****************
+ * Public key operation. Encrypt INPUT with PKEY and put result into OUTPUT.
+ *
+ *	c = m^e mod n
+ *
+ * Where c is OUTPUT, m is INPUT and e,n are elements of PKEY.  The
+ * exponent is public, so this uses the variable time exponentiation,
+ * which is much faster for small exponents like 65537.
+ */
+static void public_x(gcry_mpi_t output, gcry_mpi_t input,
+                     RSA_public_key *pkey) {
+  struct rsa_mont_s *entry = rsa_mont_get(&rsa_mont_public, pkey->n);
+
+  if (entry) {
+    mpi_powm_mont_pub(output, input, pkey->e, entry->ctx);
+
+    std::lock_guard<std::mutex> lock(rsa_mont_lock);
+    rsa_mont_unref(entry);
+  } else if (output == input) /* powm doesn't like output and input the same */
+  {
+    gcry_mpi_t x = mpi_alloc(mpi_get_nlimbs(input) * 2);
+    mpi_powm(x, input, pkey->e, pkey->n);
+    mpi_set(output, x);
+    mpi_free(x);
+  } else
+    mpi_powm(output, input, pkey->e, pkey->n);
+}
+
 /* Secret key operation - standard version.
  *
  *	m = c^d mod n
  */
 static void secret_core_std(gcry_mpi_t M, gcry_mpi_t C, gcry_mpi_t D,
                             gcry_mpi_t N) {
-  mpi_powm(M, C, D, N);
+  rsa_powm(M, C, D, N);
 }
 
 /* Secret key operation - using the CRT.
@@ -920,7 +1028,7 @@ static void secret_core_crt(gcry_mpi_t M, gcry_mpi_t C, gcry_mpi_t D,
   mpi_mul(D_blind, h, r);
   mpi_fdiv_r(h, D, h);
   mpi_add(D_blind, D_blind, h);
-  mpi_powm(m1, C, D_blind, P);
+  rsa_powm(m1, C, D_blind, P);
 
   /* d_blind = (d mod (q-1)) + (q-1) * r            */
   /* m2 = c ^ d_blind mod q */
@@ -930,7 +1038,7 @@ static void secret_core_crt(gcry_mpi_t M, gcry_mpi_t C, gcry_mpi_t D,
   mpi_mul(D_blind, h, r);
   mpi_fdiv_r(h, D, h);
   mpi_add(D_blind, D_blind, h);
-  mpi_powm(m2, C, D_blind, Q);
+  rsa_powm(m2, C, D_blind, Q);
 
   mpi_free(r);
   mpi_free(D_blind);
@@ -42,6 +42,11 @@
 
 #include <assert.h>
 #include <config.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
 #include <stdlib.h>
 #include <string.h>
 
@@ -49,6 +54,20 @@
 #include "g10lib.h"
 #include "kdf-internal.h"
 
+#include <neopg/utils/workers.h>
+
+/* USE_SSE2 indicates whether to compile the SSE2 version of ROMix.  */
+#undef USE_SSE2
+#if defined(__SSE2__) && defined(__GNUC__)
+#define USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/* The lanes of scrypt (the parallelization parameter P) are
+   independent, so they are mixed on up to this many threads.  Each
+   thread needs its own N * 128 * R bytes of scratch memory.  */
+#define SCRYPT_MAX_THREADS 16
+
 /* We really need a 64 bit type for this code.  */
 #define SALSA20_INPUT_LENGTH 16
 
@@ -70,6 +89,7 @@
     x0 ^= ROTL32(18, x3 + x2); \
   } while (0)
 
+#ifndef USE_SSE2
 static void salsa20_core(u32 *dst, const u32 *src, unsigned int rounds) {
   u32 x[SALSA20_INPUT_LENGTH];
   unsigned i;
@@ -215,6 +235,175 @@ static void scrypt_ro_mix(u32 r, unsigned char *B, u64 N, unsigned char *tmp1,
 #endif
 }
 
+#endif /*!USE_SSE2*/
+
+#ifdef USE_SSE2
+/* The SSE2 version keeps each 64 byte block in four registers, with
+   the words permuted so that the columns of the Salsa20 matrix are
+   the diagonals of the registers.  The quarter rounds on the columns
+   then need no shuffles at all and those on the rows need three.  The
+   whole ROMix loop works on the permuted blocks.  */
+
+#define SSE_ROTL32(x, n) \
+  _mm_xor_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32 - (n)))
+
+/* X = Salsa20/8 (X).  */
+static void salsa20_8_sse2(__m128i X[4]) {
+  __m128i x0 = X[0], x1 = X[1], x2 = X[2], x3 = X[3];
+  int i;
+
+  for (i = 0; i < 8; i += 2) {
+    /* Columns.  */
+    x1 = _mm_xor_si128(x1, SSE_ROTL32(_mm_add_epi32(x0, x3), 7));
+    x2 = _mm_xor_si128(x2, SSE_ROTL32(_mm_add_epi32(x1, x0), 9));
+    x3 = _mm_xor_si128(x3, SSE_ROTL32(_mm_add_epi32(x2, x1), 13));
+    x0 = _mm_xor_si128(x0, SSE_ROTL32(_mm_add_epi32(x3, x2), 18));
+
+    x1 = _mm_shuffle_epi32(x1, 0x93);
+    x2 = _mm_shuffle_epi32(x2, 0x4e);
+    x3 = _mm_shuffle_epi32(x3, 0x39);
+
+    /* Rows.  */
+    x3 = _mm_xor_si128(x3, SSE_ROTL32(_mm_add_epi32(x0, x1), 7));
+    x2 = _mm_xor_si128(x2, SSE_ROTL32(_mm_add_epi32(x3, x0), 9));
+    x1 = _mm_xor_si128(x1, SSE_ROTL32(_mm_add_epi32(x2, x3), 13));
+    x0 = _mm_xor_si128(x0, SSE_ROTL32(_mm_add_epi32(x1, x2), 18));
+
+    x1 = _mm_shuffle_epi32(x1, 0x39);
+    x2 = _mm_shuffle_epi32(x2, 0x4e);
+    x3 = _mm_shuffle_epi32(x3, 0x93);
+  }
+
+  X[0] = _mm_add_epi32(X[0], x0);
+  X[1] = _mm_add_epi32(X[1], x1);
+  X[2] = _mm_add_epi32(X[2], x2);
+  X[3] = _mm_add_epi32(X[3], x3);
+}
+
+/* OUT = ScryptBlockMix (IN), on the permuted blocks.  */
+static void scrypt_block_mix_sse2(u32 r, const __m128i *in, __m128i *out) {
+  __m128i X[4];
+  u32 i;
+  int k;
+
+  for (k = 0; k < 4; k++) X[k] = in[(2 * r - 1) * 4 + k];
+
+  for (i = 0; i < 2 * r; i++) {
+    for (k = 0; k < 4; k++) X[k] = _mm_xor_si128(X[k], in[i * 4 + k]);
+    salsa20_8_sse2(X);
+    /* The even blocks go to the first half and the odd ones to the
+       second half of the output.  */
+    for (k = 0; k < 4; k++) out[((i & 1) * r + i / 2) * 4 + k] = X[k];
+  }
+}
+
+/* Same as scrypt_ro_mix.  TMP1 must hold N * 128 * R bytes and TMP2
+   256 * R bytes, both aligned to 16 bytes.  */
+static void scrypt_ro_mix_sse2(u32 r, unsigned char *B, u64 N, __m128i *tmp1,
+                               __m128i *tmp2) {
+  const size_t nvec = 8 * r; /* Vectors in a 128 * R byte block.  */
+  __m128i *X = tmp2, *Y = tmp2 + nvec, *T;
+  u32 *x32;
+  u64 i, j;
+  size_t k;
+  int w;
+
+  /* X = B, with the words of each 64 byte block permuted.  */
+  x32 = (u32 *)X;
+  for (k = 0; k < 2 * r; k++)
+    for (w = 0; w < 16; w++)
+      x32[k * 16 + w] = buf_get_le32(&B[(k * 16 + (w * 5 % 16)) * 4]);
+
+  for (i = 0; i < N; i++) {
+    memcpy(&tmp1[i * nvec], X, nvec * sizeof *X);
+    scrypt_block_mix_sse2(r, X, Y);
+    T = X, X = Y, Y = T;
+  }
+
+  for (i = 0; i < N; i++) {
+    /* Integerify (X) takes the first two words of the last block,
+       which are at the permuted positions 0 and 13.  */
+    x32 = (u32 *)&X[(2 * r - 1) * 4];
+    j = (((u64)x32[13] << 32) | x32[0]) % N;
+
+    for (k = 0; k < nvec; k++)
+      X[k] = _mm_xor_si128(X[k], tmp1[j * nvec + k]);
+    scrypt_block_mix_sse2(r, X, Y);
+    T = X, X = Y, Y = T;
+  }
+
+  x32 = (u32 *)X;
+  for (k = 0; k < 2 * r; k++)
+    for (w = 0; w < 16; w++)
+      buf_put_le32(&B[(k * 16 + (w * 5 % 16)) * 4], x32[k * 16 + w]);
+}
+#endif /*USE_SSE2*/
+
+/* The scratch memory of one thread mixing lanes.  */
+struct scrypt_scratch {
+  void *mem;
+  unsigned char *tmp1;
+  unsigned char *tmp2;
+};
+
+static int scrypt_scratch_alloc(struct scrypt_scratch *s, u64 N, size_t r128) {
+  /* TMP2 holds two blocks for the SSE2 version.  Both are aligned to
+     16 bytes.  */
+  s->mem = xtrymalloc(N * r128 + 2 * r128 + 15);
+  if (!s->mem) return -1;
+  s->tmp1 = (unsigned char *)(((uintptr_t)s->mem + 15) & ~(uintptr_t)15);
+  s->tmp2 = s->tmp1 + N * r128;
+  return 0;
+}
+
+static void scrypt_scratch_free(struct scrypt_scratch *s) {
+  xfree(s->mem);
+  s->mem = NULL;
+}
+
+static void scrypt_lane(u32 r, unsigned char *B, u64 N,
+                        struct scrypt_scratch *s) {
+#ifdef USE_SSE2
+  scrypt_ro_mix_sse2(r, B, N, (__m128i *)s->tmp1, (__m128i *)s->tmp2);
+#else
+  scrypt_ro_mix(r, B, N, s->tmp1, s->tmp2);
+#endif
+}
+
+/* Mix the P lanes at B, each of R128 bytes.  The lanes are handed out
+   to the threads one by one.  */
+static gpg_error_t scrypt_mix_lanes(u32 r, unsigned char *B, u32 p, u64 N,
+                                    size_t r128) {
+  std::vector<struct scrypt_scratch> scratch;
+  std::atomic<u32> next(0);
+  struct scrypt_scratch s;
+  size_t nthreads;
+  size_t i;
+
+  nthreads = NeoPG::hardware_threads();
+  nthreads = std::min(nthreads, (size_t)std::min(p, (u32)SCRYPT_MAX_THREADS));
+
+  /* The scratch memory dominates, so use fewer threads if we can't
+     get it for all of them.  */
+  for (i = 0; i < nthreads; i++) {
+    if (scrypt_scratch_alloc(&s, N, r128)) break;
+    scratch.push_back(s);
+  }
+  if (scratch.empty()) return gpg_error_from_syserror();
+
+  /* If a thread can't be created, the lanes are mixed on fewer
+     threads.  */
+  NeoPG::run_workers(scratch.size(), [&](size_t idx) {
+    u32 lane;
+
+    while ((lane = next++) < p)
+      scrypt_lane(r, &B[lane * r128], N, &scratch[idx]);
+  });
+
+  for (auto &ws : scratch) scrypt_scratch_free(&ws);
+  return 0;
+}
+
 /*
  *
  */
@@ -227,10 +416,7 @@ gpg_error_t _gcry_kdf_scrypt(const unsigned char *passwd, size_t passwdlen,
   u32 p = iterations; /* Parallelization parameter.  */
 
   gpg_error_t ec;
-  u32 i;
   unsigned char *B = NULL;
-  unsigned char *tmp1 = NULL;
-  unsigned char *tmp2 = NULL;
   size_t r128;
   size_t nbytes;
 
@@ -252,8 +438,8 @@ gpg_error_t _gcry_kdf_scrypt(const unsigned char *passwd, size_t passwdlen,
   nbytes = N * r128;
   if (r128 && nbytes / r128 != N) return GPG_ERR_ENOMEM;
 
-  nbytes = 64 + r128;
-  if (nbytes < r128) return GPG_ERR_ENOMEM;
+  nbytes = N * r128 + 2 * r128 + 15;
+  if (nbytes < N * r128) return GPG_ERR_ENOMEM;
 
   B = (unsigned char *)xtrymalloc(p * r128);
   if (!B) {
@@ -261,30 +447,16 @@ gpg_error_t _gcry_kdf_scrypt(const unsigned char *passwd, size_t passwdlen,
     goto leave;
   }
 
-  tmp1 = (unsigned char *)xtrymalloc(N * r128);
-  if (!tmp1) {
-    ec = gpg_error_from_syserror();
-    goto leave;
-  }
-
-  tmp2 = (unsigned char *)xtrymalloc(64 + r128);
-  if (!tmp2) {
-    ec = gpg_error_from_syserror();
-    goto leave;
-  }
-
   ec = _gcry_kdf_pkdf2(passwd, passwdlen, GCRY_MD_SHA256, salt, saltlen,
                        1 /* iterations */, p * r128, B);
 
-  for (i = 0; !ec && i < p; i++) scrypt_ro_mix(r, &B[i * r128], N, tmp1, tmp2);
+  if (!ec) ec = scrypt_mix_lanes(r, B, p, N, r128);
 
-  for (i = 0; !ec && i < p; i++)
+  if (!ec)
     ec = _gcry_kdf_pkdf2(passwd, passwdlen, GCRY_MD_SHA256, B, p * r128,
                          1 /* iterations */, dkLen, DK);
 
 leave:
-  xfree(tmp2);
-  xfree(tmp1);
   xfree(B);
 
   return ec;
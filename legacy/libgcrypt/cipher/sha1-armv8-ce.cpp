@@ -0,0 +1,105 @@
+/* sha1-armv8-ce.c - ARMv8 Crypto Extension SHA-1 transform
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "g10lib.h"
+
+/* USE_ARM_CE indicates whether to enable ARMv8 Crypto Extension code.
+ * This must match the definition in sha1.c.  */
+#undef USE_ARM_CE
+#if defined(__AARCH64EL__) && defined(__GNUC__) && __GNUC__ >= 6
+#define USE_ARM_CE 1
+#endif
+
+#ifdef USE_ARM_CE
+
+#include <arm_neon.h>
+
+/* Four rounds G*4 to G*4+3, using the message words in WC.  The next
+   three groups are in W1 to W3; SHA1SU0 and SHA1SU1 replace WC by the
+   message words for the group G + 4.  F is the SHA1C, SHA1P or SHA1M
+   instruction for the round function and K the round constant.  */
+#define ROUNDS4(g, f, k, wc, w1, w2, w3)                           \
+  do {                                                             \
+    tmp = vaddq_u32(wc, vdupq_n_u32(k));                           \
+    if (g < 16) wc = vsha1su1q_u32(vsha1su0q_u32(wc, w1, w2), w3); \
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));                      \
+    abcd = f(abcd, e, tmp);                                        \
+    e = e1;                                                        \
+  } while (0)
+
+/* Transform NBLKS blocks of 64 bytes at DATA into the SHA-1 state
+   STATE (the chaining variables h0 to h4).  The caller must have
+   checked for HWF_ARM_SHA1.  */
+unsigned int __attribute__((target("+crypto")))
+_gcry_sha1_transform_armv8_ce(void *state, const unsigned char *data,
+                              size_t nblks) {
+  u32 *h = (u32 *)state;
+  uint32x4_t abcd, save, tmp, w0, w1, w2, w3;
+  uint32_t e, e1, e_save;
+
+  abcd = vld1q_u32(h);
+  e = h[4];
+
+  for (; nblks; nblks--, data += 64) {
+    save = abcd;
+    e_save = e;
+
+    w0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 0)));
+    w1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+    w2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+    w3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+    ROUNDS4(0, vsha1cq_u32, 0x5a827999, w0, w1, w2, w3);
+    ROUNDS4(1, vsha1cq_u32, 0x5a827999, w1, w2, w3, w0);
+    ROUNDS4(2, vsha1cq_u32, 0x5a827999, w2, w3, w0, w1);
+    ROUNDS4(3, vsha1cq_u32, 0x5a827999, w3, w0, w1, w2);
+    ROUNDS4(4, vsha1cq_u32, 0x5a827999, w0, w1, w2, w3);
+    ROUNDS4(5, vsha1pq_u32, 0x6ed9eba1, w1, w2, w3, w0);
+    ROUNDS4(6, vsha1pq_u32, 0x6ed9eba1, w2, w3, w0, w1);
+    ROUNDS4(7, vsha1pq_u32, 0x6ed9eba1, w3, w0, w1, w2);
+    ROUNDS4(8, vsha1pq_u32, 0x6ed9eba1, w0, w1, w2, w3);
+    ROUNDS4(9, vsha1pq_u32, 0x6ed9eba1, w1, w2, w3, w0);
+    ROUNDS4(10, vsha1mq_u32, 0x8f1bbcdc, w2, w3, w0, w1);
+    ROUNDS4(11, vsha1mq_u32, 0x8f1bbcdc, w3, w0, w1, w2);
+    ROUNDS4(12, vsha1mq_u32, 0x8f1bbcdc, w0, w1, w2, w3);
+    ROUNDS4(13, vsha1mq_u32, 0x8f1bbcdc, w1, w2, w3, w0);
+    ROUNDS4(14, vsha1mq_u32, 0x8f1bbcdc, w2, w3, w0, w1);
+    ROUNDS4(15, vsha1pq_u32, 0xca62c1d6, w3, w0, w1, w2);
+    ROUNDS4(16, vsha1pq_u32, 0xca62c1d6, w0, w1, w2, w3);
+    ROUNDS4(17, vsha1pq_u32, 0xca62c1d6, w1, w2, w3, w0);
+    ROUNDS4(18, vsha1pq_u32, 0xca62c1d6, w2, w3, w0, w1);
+    ROUNDS4(19, vsha1pq_u32, 0xca62c1d6, w3, w0, w1, w2);
+
+    abcd = vaddq_u32(abcd, save);
+    e += e_save;
+  }
+
+  vst1q_u32(h, abcd);
+  h[4] = e;
+
+  /* The message and the state are only kept in registers.  */
+  return 0;
+}
+
+#endif /*USE_ARM_CE*/
@@ -0,0 +1,120 @@
+/* sha1-intel-shaext.c - SHAEXT accelerated SHA-1 transform function
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "g10lib.h"
+
+/* USE_SHAEXT indicates whether to compile with Intel SHA Extensions
+ * code.  This must match the definition in sha1.c.  */
+#undef USE_SHAEXT
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (__GNUC__ >= 5 || defined(__clang__))
+#define USE_SHAEXT 1
+#endif
+
+#ifdef USE_SHAEXT
+
+#include <immintrin.h>
+
+/* Four rounds G*4 to G*4+3, using the message words in WC, where WP,
+   WPP and WN hold the words of the previous two and the next group.
+   EC receives the fifth chaining variable of these rounds, EN the one
+   for the next group.  SHA1MSG1, XOR and SHA1MSG2 compute the message
+   words for the group G + 4 over the next groups.  */
+#define ROUNDS4(g, wpp, wp, wc, wn, ec, en)                 \
+  do {                                                      \
+    if (g == 0)                                             \
+      ec = _mm_add_epi32(ec, wc);                           \
+    else                                                    \
+      ec = _mm_sha1nexte_epu32(ec, wc);                     \
+    en = abcd;                                              \
+    if (g >= 3 && g <= 18) wn = _mm_sha1msg2_epu32(wn, wc); \
+    abcd = _mm_sha1rnds4_epu32(abcd, ec, g / 5);            \
+    if (g >= 1 && g <= 16) wp = _mm_sha1msg1_epu32(wp, wc); \
+    if (g >= 2 && g <= 17) wpp = _mm_xor_si128(wpp, wc);    \
+  } while (0)
+
+/* Transform NBLKS blocks of 64 bytes at DATA into the SHA-1 state
+   STATE (the chaining variables h0 to h4).  The caller must have
+   checked for HWF_INTEL_SHAEXT.  */
+unsigned int __attribute__((target("sha,sse4.1,ssse3")))
+_gcry_sha1_transform_intel_shaext(void *state, const unsigned char *data,
+                                  size_t nblks) {
+  const __m128i bswap =
+      _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  u32 *h = (u32 *)state;
+  __m128i abcd, abcd_save, e0, e0_save, e1;
+  __m128i w0, w1, w2, w3;
+
+  /* The instructions want A in the most significant word.  */
+  abcd = _mm_loadu_si128((const __m128i *)h);
+  abcd = _mm_shuffle_epi32(abcd, 0x1b);
+  e0 = _mm_set_epi32(h[4], 0, 0, 0);
+
+  for (; nblks; nblks--, data += 64) {
+    abcd_save = abcd;
+    e0_save = e0;
+
+    w0 = _mm_loadu_si128((const __m128i *)(data + 0));
+    w1 = _mm_loadu_si128((const __m128i *)(data + 16));
+    w2 = _mm_loadu_si128((const __m128i *)(data + 32));
+    w3 = _mm_loadu_si128((const __m128i *)(data + 48));
+    w0 = _mm_shuffle_epi8(w0, bswap);
+    w1 = _mm_shuffle_epi8(w1, bswap);
+    w2 = _mm_shuffle_epi8(w2, bswap);
+    w3 = _mm_shuffle_epi8(w3, bswap);
+
+    ROUNDS4(0, w2, w3, w0, w1, e0, e1);
+    ROUNDS4(1, w3, w0, w1, w2, e1, e0);
+    ROUNDS4(2, w0, w1, w2, w3, e0, e1);
+    ROUNDS4(3, w1, w2, w3, w0, e1, e0);
+    ROUNDS4(4, w2, w3, w0, w1, e0, e1);
+    ROUNDS4(5, w3, w0, w1, w2, e1, e0);
+    ROUNDS4(6, w0, w1, w2, w3, e0, e1);
+    ROUNDS4(7, w1, w2, w3, w0, e1, e0);
+    ROUNDS4(8, w2, w3, w0, w1, e0, e1);
+    ROUNDS4(9, w3, w0, w1, w2, e1, e0);
+    ROUNDS4(10, w0, w1, w2, w3, e0, e1);
+    ROUNDS4(11, w1, w2, w3, w0, e1, e0);
+    ROUNDS4(12, w2, w3, w0, w1, e0, e1);
+    ROUNDS4(13, w3, w0, w1, w2, e1, e0);
+    ROUNDS4(14, w0, w1, w2, w3, e0, e1);
+    ROUNDS4(15, w1, w2, w3, w0, e1, e0);
+    ROUNDS4(16, w2, w3, w0, w1, e0, e1);
+    ROUNDS4(17, w3, w0, w1, w2, e1, e0);
+    ROUNDS4(18, w0, w1, w2, w3, e0, e1);
+    ROUNDS4(19, w1, w2, w3, w0, e1, e0);
+
+    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  abcd = _mm_shuffle_epi32(abcd, 0x1b);
+  _mm_storeu_si128((__m128i *)h, abcd);
+  h[4] = _mm_extract_epi32(e0, 3);
+
+  /* The message and the state are only kept in registers.  */
+  return 0;
+}
+
+#endif /*USE_SHAEXT*/
@@ -75,19 +75,19 @@
 #endif
 #endif
 
-/* USE_ARM_CE indicates whether to enable ARMv8 Crypto Extension assembly
- * code. */
+/* USE_ARM_CE indicates whether to enable ARMv8 Crypto Extension code.
+ * This must match the definition in sha1-armv8-ce.c.  */
 #undef USE_ARM_CE
-#ifdef ENABLE_ARM_CRYPTO_SUPPORT
-#if defined(HAVE_ARM_ARCH_V6) && defined(__ARMEL__) && \
-    defined(HAVE_COMPATIBLE_GCC_ARM_PLATFORM_AS) &&    \
-    defined(HAVE_GCC_INLINE_ASM_AARCH32_CRYPTO)
-#define USE_ARM_CE 1
-#elif defined(__AARCH64EL__) &&                         \
-    defined(HAVE_COMPATIBLE_GCC_AARCH64_PLATFORM_AS) && \
-    defined(HAVE_GCC_INLINE_ASM_AARCH64_CRYPTO)
+#if defined(__AARCH64EL__) && defined(__GNUC__) && __GNUC__ >= 6
 #define USE_ARM_CE 1
 #endif
+
+/* USE_SHAEXT indicates whether to compile with Intel SHA Extensions
+ * code.  This must match the definition in sha1-intel-shaext.c.  */
+#undef USE_SHAEXT
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (__GNUC__ >= 5 || defined(__clang__))
+#define USE_SHAEXT 1
 #endif
 
 /* A macro to test whether P is properly aligned for an u32 type.
@@ -103,6 +103,7 @@ static unsigned int transform(void *c, const unsigned char *data, size_t nblks);
 
 static void sha1_init(void *context, unsigned int flags) {
   SHA1_CONTEXT *hd = (SHA1_CONTEXT *)context;
+  unsigned int features;
 
   (void)flags;
 
@@ -117,6 +118,17 @@ static void sha1_init(void *context, unsigned int flags) {
   hd->bctx.count = 0;
   hd->bctx.blocksize = 64;
   hd->bctx.bwrite = transform;
+
+  /* Select the transform from the hardware features.  */
+  features = _gcry_get_hw_features();
+  hd->use_ssse3 = 0;
+  hd->use_avx = 0;
+  hd->use_bmi2 = 0;
+  hd->use_neon = 0;
+  hd->use_arm_ce = (features & HWF_ARM_SHA1) != 0;
+  hd->use_shaext = (features & HWF_INTEL_SHAEXT) &&
+                   (features & HWF_INTEL_SSE4_1) &&
+                   (features & HWF_INTEL_SSSE3);
 }
 
 /*
@@ -157,6 +169,12 @@ unsigned int _gcry_sha1_transform_armv8_ce(void *state,
                                            size_t nblks);
 #endif
 
+#ifdef USE_SHAEXT
+unsigned int _gcry_sha1_transform_intel_shaext(void *state,
+                                               const unsigned char *data,
+                                               size_t nblks);
+#endif
+
 /*
  * Transform NBLOCKS of each 64 bytes (16 32-bit words) at DATA.
  */
@@ -268,6 +286,66 @@ static unsigned int transform_blk(void *ctx, const unsigned char *data) {
   return /* burn_stack */ 88 + 4 * sizeof(void *);
 }
 
+#ifdef USE_MD_MULTI
+/* The multi-buffer variant of transform_blk.  STATE holds the five
+   chaining variables and X the 16 words of the message block, each
+   as one vector with a lane per context.  */
+#define VROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static inline __attribute__((always_inline)) void transform_multi_body(
+    md_multi_u32 *state, md_multi_u32 *x) {
+  md_multi_u32 a, b, c, d, e, tm;
+  int i;
+
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+
+  for (i = 0; i < 80; i++) {
+    if (i >= 16) {
+      tm = x[i & 0x0f] ^ x[(i - 14) & 0x0f] ^ x[(i - 8) & 0x0f] ^
+           x[(i - 3) & 0x0f];
+      x[i & 0x0f] = VROL(tm, 1);
+    }
+    if (i < 20)
+      tm = F1(b, c, d) + (u32)K1;
+    else if (i < 40)
+      tm = F2(b, c, d) + (u32)K2;
+    else if (i < 60)
+      tm = F3(b, c, d) + (u32)K3;
+    else
+      tm = F4(b, c, d) + (u32)K4;
+    tm += VROL(a, 5) + e + x[i & 0x0f];
+    e = d;
+    d = c;
+    c = VROL(b, 30);
+    b = a;
+    a = tm;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+static void transform_multi(md_multi_u32 *state, md_multi_u32 *x) {
+  transform_multi_body(state, x);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static __attribute__((target("avx2"))) void transform_multi_avx2(
+    md_multi_u32 *state, md_multi_u32 *x) {
+  transform_multi_body(state, x);
+}
+#endif
+
+#undef VROL
+#endif /*USE_MD_MULTI*/
+
 /* Assembly implementations use SystemV ABI, ABI conversion and additional
  * stack to store XMM6-XMM15 needed on Win64. */
 #undef ASM_FUNC_ABI
@@ -305,6 +383,10 @@ static unsigned int transform(void *ctx, const unsigned char *data,
   SHA1_CONTEXT *hd = (SHA1_CONTEXT *)ctx;
   unsigned int burn;
 
+#ifdef USE_SHAEXT
+  if (hd->use_shaext)
+    return _gcry_sha1_transform_intel_shaext(&hd->h0, data, nblks);
+#endif
 #ifdef USE_BMI2
   if (hd->use_bmi2)
     return _gcry_sha1_transform_amd64_avx_bmi2(&hd->h0, data, nblks) +
@@ -436,6 +518,102 @@ static void sha1_final(void *context) {
 #undef X
 }
 
+#ifdef USE_MD_MULTI
+/* Finalize the N contexts at CONTEXTS, with N at most MD_MULTI_LANES,
+   like sha1_final.  Each context has one or two blocks left; lanes
+   with only one block keep their state while the others process the
+   second block.  */
+static void sha1_final_lanes(void **contexts, size_t n) {
+  unsigned char blks[MD_MULTI_LANES][128];
+  unsigned int nblks[MD_MULTI_LANES];
+  md_multi_u32 state[5], prev[5], x[16];
+  unsigned int maxblks = 0;
+  unsigned int blk, i;
+  size_t lane;
+
+  memset(state, 0, sizeof state);
+  for (lane = 0; lane < MD_MULTI_LANES; lane++) {
+    if (lane < n) {
+      SHA1_CONTEXT *hd = (SHA1_CONTEXT *)contexts[lane];
+      const u32 *h = &hd->h0;
+
+      nblks[lane] = _gcry_md_block_pad_be64(&hd->bctx, blks[lane]);
+      for (i = 0; i < 5; i++) state[i][lane] = h[i];
+    } else {
+      nblks[lane] = 0;
+      memset(blks[lane], 0, sizeof blks[lane]);
+    }
+    if (nblks[lane] > maxblks) maxblks = nblks[lane];
+  }
+
+  for (blk = 0; blk < maxblks; blk++) {
+    memcpy(prev, state, sizeof state);
+    for (i = 0; i < 16; i++)
+      for (lane = 0; lane < MD_MULTI_LANES; lane++)
+        x[i][lane] = buf_get_be32(blks[lane] + blk * 64 + i * 4);
+#if defined(__x86_64__) || defined(__i386__)
+    if (_gcry_md_multi_avx2)
+      transform_multi_avx2(state, x);
+    else
+#endif
+      transform_multi(state, x);
+    for (lane = 0; lane < MD_MULTI_LANES; lane++)
+      if (blk >= nblks[lane])
+        for (i = 0; i < 5; i++) state[i][lane] = prev[i][lane];
+  }
+
+  for (lane = 0; lane < n; lane++) {
+    SHA1_CONTEXT *hd = (SHA1_CONTEXT *)contexts[lane];
+    u32 *h = &hd->h0;
+
+    for (i = 0; i < 5; i++) {
+      h[i] = state[i][lane];
+      buf_put_be32(hd->bctx.buf + i * 4, h[i]);
+    }
+  }
+
+  wipememory(blks, sizeof blks);
+  wipememory(x, sizeof x);
+  wipememory(prev, sizeof prev);
+  _gcry_burn_stack(22 * sizeof(md_multi_u32));
+}
+
+/* Return true if HD uses a hardware transform.  The lanes are not
+   faster than these.  */
+static int sha1_hw_transform(void *context) {
+  SHA1_CONTEXT *hd = (SHA1_CONTEXT *)context;
+
+  (void)hd;
+#ifdef USE_SHAEXT
+  if (hd->use_shaext) return 1;
+#endif
+#ifdef USE_ARM_CE
+  if (hd->use_arm_ce) return 1;
+#endif
+  return 0;
+}
+
+/* Finalize the N contexts at CONTEXTS.  This is the same as calling
+   sha1_final for each of them.  */
+static void sha1_final_multi(void **contexts, size_t n) {
+  size_t k;
+
+  if (n && sha1_hw_transform(contexts[0])) {
+    for (; n; contexts++, n--) sha1_final(contexts[0]);
+    return;
+  }
+
+  for (; n >= 2; contexts += k, n -= k) {
+    k = n < MD_MULTI_LANES ? n : MD_MULTI_LANES;
+    sha1_final_lanes(contexts, k);
+  }
+  if (n) sha1_final(contexts[0]);
+}
+#define SHA1_FINAL_MULTI sha1_final_multi
+#else
+#define SHA1_FINAL_MULTI NULL
+#endif /*USE_MD_MULTI*/
+
 static unsigned char *sha1_read(void *context) {
   SHA1_CONTEXT *hd = (SHA1_CONTEXT *)context;
 
@@ -557,4 +735,5 @@ gcry_md_spec_t _gcry_digest_spec_sha1 = {GCRY_MD_SHA1,
                                          sha1_read,
                                          NULL,
                                          sizeof(SHA1_CONTEXT),
-                                         run_selftests};
+                                         run_selftests,
+                                         SHA1_FINAL_MULTI};
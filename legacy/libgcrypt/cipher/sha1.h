@@ -30,6 +30,7 @@ typedef struct {
   unsigned int use_bmi2 : 1;
   unsigned int use_neon : 1;
   unsigned int use_arm_ce : 1;
+  unsigned int use_shaext : 1;
 } SHA1_CONTEXT;
 
 void _gcry_sha1_mixblock_init(SHA1_CONTEXT *hd);
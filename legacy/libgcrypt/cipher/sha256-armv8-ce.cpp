@@ -0,0 +1,113 @@
+/* sha256-armv8-ce.c - ARMv8 Crypto Extension SHA-256 transform
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "g10lib.h"
+
+/* USE_ARM_CE indicates whether to enable ARMv8 Crypto Extension code.
+ * This must match the definition in sha256.c.  */
+#undef USE_ARM_CE
+#if defined(__AARCH64EL__) && defined(__GNUC__) && __GNUC__ >= 6
+#define USE_ARM_CE 1
+#endif
+
+#ifdef USE_ARM_CE
+
+#include <arm_neon.h>
+
+static const u32 K[64] __attribute__((aligned(16))) = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/* Four rounds G*4 to G*4+3, using the message words in WC.  The next
+   three groups are in W1 to W3; SHA256SU0 and SHA256SU1 replace WC by
+   the message words for the group G + 4.  */
+#define ROUNDS4(g, wc, w1, w2, w3)                                     \
+  do {                                                                 \
+    tmp = vaddq_u32(wc, vld1q_u32(&K[g * 4]));                         \
+    if (g < 12) wc = vsha256su1q_u32(vsha256su0q_u32(wc, w1), w2, w3); \
+    prev = state0;                                                     \
+    state0 = vsha256hq_u32(state0, state1, tmp);                       \
+    state1 = vsha256h2q_u32(state1, prev, tmp);                        \
+  } while (0)
+
+/* Transform NUM_BLKS blocks of 64 bytes at INPUT_DATA into the SHA-256
+   state STATE (the chaining variables h0 to h7).  The caller must have
+   checked for HWF_ARM_SHA2.  */
+unsigned int __attribute__((target("+crypto")))
+_gcry_sha256_transform_armv8_ce(u32 state[8], const void *input_data,
+                                size_t num_blks) {
+  const unsigned char *data = (const unsigned char *)input_data;
+  uint32x4_t state0, state1, save0, save1;
+  uint32x4_t prev, tmp, w0, w1, w2, w3;
+
+  state0 = vld1q_u32(&state[0]);
+  state1 = vld1q_u32(&state[4]);
+
+  for (; num_blks; num_blks--, data += 64) {
+    save0 = state0;
+    save1 = state1;
+
+    w0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 0)));
+    w1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+    w2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+    w3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+    ROUNDS4(0, w0, w1, w2, w3);
+    ROUNDS4(1, w1, w2, w3, w0);
+    ROUNDS4(2, w2, w3, w0, w1);
+    ROUNDS4(3, w3, w0, w1, w2);
+    ROUNDS4(4, w0, w1, w2, w3);
+    ROUNDS4(5, w1, w2, w3, w0);
+    ROUNDS4(6, w2, w3, w0, w1);
+    ROUNDS4(7, w3, w0, w1, w2);
+    ROUNDS4(8, w0, w1, w2, w3);
+    ROUNDS4(9, w1, w2, w3, w0);
+    ROUNDS4(10, w2, w3, w0, w1);
+    ROUNDS4(11, w3, w0, w1, w2);
+    ROUNDS4(12, w0, w1, w2, w3);
+    ROUNDS4(13, w1, w2, w3, w0);
+    ROUNDS4(14, w2, w3, w0, w1);
+    ROUNDS4(15, w3, w0, w1, w2);
+
+    state0 = vaddq_u32(state0, save0);
+    state1 = vaddq_u32(state1, save1);
+  }
+
+  vst1q_u32(&state[0], state0);
+  vst1q_u32(&state[4], state1);
+
+  /* The message and the state are only kept in registers.  */
+  return 0;
+}
+
+#endif /*USE_ARM_CE*/
@@ -0,0 +1,135 @@
+/* sha256-intel-shaext.c - SHAEXT accelerated SHA-256 transform function
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "g10lib.h"
+
+/* USE_SHAEXT indicates whether to compile with Intel SHA Extensions
+ * code.  This must match the definition in sha256.c.  */
+#undef USE_SHAEXT
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (__GNUC__ >= 5 || defined(__clang__))
+#define USE_SHAEXT 1
+#endif
+
+#ifdef USE_SHAEXT
+
+#include <immintrin.h>
+
+static const u32 K[64] __attribute__((aligned(16))) = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/* Four rounds G*4 to G*4+3, using the message words in WC, where WP
+   and WN hold the words of the previous and the next group.
+   SHA256MSG1 and SHA256MSG2 compute the message words for the group
+   G + 4 on the way.  */
+#define ROUNDS4(g, wp, wc, wn)                                \
+  do {                                                        \
+    msg = _mm_load_si128((const __m128i *)&K[g * 4]);         \
+    msg = _mm_add_epi32(wc, msg);                             \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);      \
+    if (g >= 3 && g <= 14) {                                  \
+      tmp = _mm_alignr_epi8(wc, wp, 4);                       \
+      wn = _mm_add_epi32(wn, tmp);                            \
+      wn = _mm_sha256msg2_epu32(wn, wc);                      \
+    }                                                         \
+    msg = _mm_shuffle_epi32(msg, 0x0e);                       \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);      \
+    if (g >= 1 && g <= 12) wp = _mm_sha256msg1_epu32(wp, wc); \
+  } while (0)
+
+/* Transform NBLKS blocks of 64 bytes at DATA into the SHA-256 state
+   STATE (the chaining variables h0 to h7).  The caller must have
+   checked for HWF_INTEL_SHAEXT.  */
+unsigned int __attribute__((target("sha,sse4.1,ssse3")))
+_gcry_sha256_transform_intel_shaext(u32 state[8], const unsigned char *data,
+                                    size_t nblks) {
+  const __m128i bswap =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i state0, state1, abef, cdgh;
+  __m128i msg, tmp, w0, w1, w2, w3;
+
+  /* The instructions want the state as ABEF and CDGH.  */
+  tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+  state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+  tmp = _mm_shuffle_epi32(tmp, 0xb1);          /* CDAB */
+  state1 = _mm_shuffle_epi32(state1, 0x1b);    /* EFGH */
+  state0 = _mm_alignr_epi8(tmp, state1, 8);    /* ABEF */
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0); /* CDGH */
+
+  for (; nblks; nblks--, data += 64) {
+    abef = state0;
+    cdgh = state1;
+
+    w0 = _mm_loadu_si128((const __m128i *)(data + 0));
+    w1 = _mm_loadu_si128((const __m128i *)(data + 16));
+    w2 = _mm_loadu_si128((const __m128i *)(data + 32));
+    w3 = _mm_loadu_si128((const __m128i *)(data + 48));
+    w0 = _mm_shuffle_epi8(w0, bswap);
+    w1 = _mm_shuffle_epi8(w1, bswap);
+    w2 = _mm_shuffle_epi8(w2, bswap);
+    w3 = _mm_shuffle_epi8(w3, bswap);
+
+    ROUNDS4(0, w3, w0, w1);
+    ROUNDS4(1, w0, w1, w2);
+    ROUNDS4(2, w1, w2, w3);
+    ROUNDS4(3, w2, w3, w0);
+    ROUNDS4(4, w3, w0, w1);
+    ROUNDS4(5, w0, w1, w2);
+    ROUNDS4(6, w1, w2, w3);
+    ROUNDS4(7, w2, w3, w0);
+    ROUNDS4(8, w3, w0, w1);
+    ROUNDS4(9, w0, w1, w2);
+    ROUNDS4(10, w1, w2, w3);
+    ROUNDS4(11, w2, w3, w0);
+    ROUNDS4(12, w3, w0, w1);
+    ROUNDS4(13, w0, w1, w2);
+    ROUNDS4(14, w1, w2, w3);
+    ROUNDS4(15, w2, w3, w0);
+
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1b);       /* FEBA */
+  state1 = _mm_shuffle_epi32(state1, 0xb1);    /* DCHG */
+  state0 = _mm_blend_epi16(tmp, state1, 0xf0); /* DCBA */
+  state1 = _mm_alignr_epi8(state1, tmp, 8);    /* HGFE */
+  _mm_storeu_si128((__m128i *)&state[0], state0);
+  _mm_storeu_si128((__m128i *)&state[4], state1);
+
+  /* The message and the state are only kept in registers.  */
+  return 0;
+}
+
+#endif /*USE_SHAEXT*/
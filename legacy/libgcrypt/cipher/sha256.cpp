@@ -75,19 +75,19 @@
 #define USE_AVX2 1
 #endif
 
-/* USE_ARM_CE indicates whether to enable ARMv8 Crypto Extension assembly
- * code. */
+/* USE_ARM_CE indicates whether to enable ARMv8 Crypto Extension code.
+ * This must match the definition in sha256-armv8-ce.c.  */
 #undef USE_ARM_CE
-#ifdef ENABLE_ARM_CRYPTO_SUPPORT
-#if defined(HAVE_ARM_ARCH_V6) && defined(__ARMEL__) && \
-    defined(HAVE_COMPATIBLE_GCC_ARM_PLATFORM_AS) &&    \
-    defined(HAVE_GCC_INLINE_ASM_AARCH32_CRYPTO)
-#define USE_ARM_CE 1
-#elif defined(__AARCH64EL__) &&                         \
-    defined(HAVE_COMPATIBLE_GCC_AARCH64_PLATFORM_AS) && \
-    defined(HAVE_GCC_INLINE_ASM_AARCH64_CRYPTO)
+#if defined(__AARCH64EL__) && defined(__GNUC__) && __GNUC__ >= 6
 #define USE_ARM_CE 1
 #endif
+
+/* USE_SHAEXT indicates whether to compile with Intel SHA Extensions
+ * code.  This must match the definition in sha256-intel-shaext.c.  */
+#undef USE_SHAEXT
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (__GNUC__ >= 5 || defined(__clang__))
+#define USE_SHAEXT 1
 #endif
 
 typedef struct {
@@ -105,10 +105,35 @@ typedef struct {
 #ifdef USE_ARM_CE
   unsigned int use_arm_ce : 1;
 #endif
+#ifdef USE_SHAEXT
+  unsigned int use_shaext : 1;
+#endif
 } SHA256_CONTEXT;
 
 static unsigned int transform(void *c, const unsigned char *data, size_t nblks);
 
+/* Select the transform for HD from the hardware features.  */
+static void sha256_common_init(SHA256_CONTEXT *hd) {
+#if defined(USE_ARM_CE) || defined(USE_SHAEXT)
+  unsigned int features = _gcry_get_hw_features();
+#endif
+
+  hd->bctx.nblocks = 0;
+  hd->bctx.nblocks_high = 0;
+  hd->bctx.count = 0;
+  hd->bctx.blocksize = 64;
+  hd->bctx.bwrite = transform;
+
+#ifdef USE_ARM_CE
+  hd->use_arm_ce = (features & HWF_ARM_SHA2) != 0;
+#endif
+#ifdef USE_SHAEXT
+  hd->use_shaext = (features & HWF_INTEL_SHAEXT) &&
+                   (features & HWF_INTEL_SSE4_1) &&
+                   (features & HWF_INTEL_SSSE3);
+#endif
+}
+
 static void sha256_init(void *context, unsigned int flags) {
   SHA256_CONTEXT *hd = (SHA256_CONTEXT *)context;
 
@@ -123,11 +148,7 @@ static void sha256_init(void *context, unsigned int flags) {
   hd->h6 = 0x1f83d9ab;
   hd->h7 = 0x5be0cd19;
 
-  hd->bctx.nblocks = 0;
-  hd->bctx.nblocks_high = 0;
-  hd->bctx.count = 0;
-  hd->bctx.blocksize = 64;
-  hd->bctx.bwrite = transform;
+  sha256_common_init(hd);
 }
 
 static void sha224_init(void *context, unsigned int flags) {
@@ -144,11 +165,7 @@ static void sha224_init(void *context, unsigned int flags) {
   hd->h6 = 0x64f98fa7;
   hd->h7 = 0xbefa4fa4;
 
-  hd->bctx.nblocks = 0;
-  hd->bctx.nblocks_high = 0;
-  hd->bctx.count = 0;
-  hd->bctx.blocksize = 64;
-  hd->bctx.bwrite = transform;
+  sha256_common_init(hd);
 }
 
 /*
@@ -182,21 +199,21 @@ static void sha224_init(void *context, unsigned int flags) {
   (w[i & 0x0f] = S1(w[(i - 2) & 0x0f]) + w[(i - 7) & 0x0f] + \
                  S0(w[(i - 15) & 0x0f]) + w[(i - 16) & 0x0f])
 
+static const u32 K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
 static unsigned int transform_blk(void *ctx, const unsigned char *data) {
   SHA256_CONTEXT *hd = (SHA256_CONTEXT *)ctx;
-  static const u32 K[64] = {
-      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
-      0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
-      0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
-      0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
-      0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
-      0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
-      0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
-      0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-      0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
-
   u32 a, b, c, d, e, f, g, h, t1, t2;
   u32 w[16];
 
@@ -292,6 +309,74 @@ static unsigned int transform_blk(void *ctx, const unsigned char *data) {
 #undef S1
 #undef R
 
+#ifdef USE_MD_MULTI
+/* The multi-buffer variant of transform_blk.  STATE holds the eight
+   chaining variables and W the 16 words of the message block, each
+   as one vector with a lane per context.  */
+#define VROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define VSum0(x) (VROR(x, 2) ^ VROR(x, 13) ^ VROR(x, 22))
+#define VSum1(x) (VROR(x, 6) ^ VROR(x, 11) ^ VROR(x, 25))
+#define VS0(x) (VROR((x), 7) ^ VROR((x), 18) ^ ((x) >> 3))
+#define VS1(x) (VROR((x), 17) ^ VROR((x), 19) ^ ((x) >> 10))
+
+static inline __attribute__((always_inline)) void transform_multi_body(
+    md_multi_u32 *state, md_multi_u32 *w) {
+  md_multi_u32 a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+  f = state[5];
+  g = state[6];
+  h = state[7];
+
+  for (i = 0; i < 64; i++) {
+    if (i >= 16)
+      w[i & 0x0f] += VS1(w[(i - 2) & 0x0f]) + w[(i - 7) & 0x0f] +
+                     VS0(w[(i - 15) & 0x0f]);
+    t1 = h + VSum1(e) + Cho(e, f, g) + K[i] + w[i & 0x0f];
+    t2 = VSum0(a) + Maj(a, b, c);
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+static void transform_multi(md_multi_u32 *state, md_multi_u32 *w) {
+  transform_multi_body(state, w);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static __attribute__((target("avx2"))) void transform_multi_avx2(
+    md_multi_u32 *state, md_multi_u32 *w) {
+  transform_multi_body(state, w);
+}
+#endif
+
+#undef VROR
+#undef VSum0
+#undef VSum1
+#undef VS0
+#undef VS1
+#endif /*USE_MD_MULTI*/
+
 /* Assembly implementations use SystemV ABI, ABI conversion and additional
  * stack to store XMM6-XMM15 needed on Win64. */
 #undef ASM_FUNC_ABI
@@ -330,11 +415,22 @@ unsigned int _gcry_sha256_transform_armv8_ce(u32 state[8],
                                              size_t num_blks);
 #endif
 
+#ifdef USE_SHAEXT
+unsigned int _gcry_sha256_transform_intel_shaext(u32 state[8],
+                                                 const unsigned char *data,
+                                                 size_t nblks);
+#endif
+
 static unsigned int transform(void *ctx, const unsigned char *data,
                               size_t nblks) {
   SHA256_CONTEXT *hd = (SHA256_CONTEXT *)ctx;
   unsigned int burn;
 
+#ifdef USE_SHAEXT
+  if (hd->use_shaext)
+    return _gcry_sha256_transform_intel_shaext(&hd->h0, data, nblks);
+#endif
+
 #ifdef USE_AVX2
   if (hd->use_avx2)
     return _gcry_sha256_transform_amd64_avx2(data, &hd->h0, nblks) +
@@ -439,6 +535,102 @@ static void sha256_final(void *context) {
 #undef X
 }
 
+#ifdef USE_MD_MULTI
+/* Finalize the N contexts at CONTEXTS, with N at most MD_MULTI_LANES,
+   like sha256_final.  Each context has one or two blocks left; lanes
+   with only one block keep their state while the others process the
+   second block.  */
+static void sha256_final_lanes(void **contexts, size_t n) {
+  unsigned char blks[MD_MULTI_LANES][128];
+  unsigned int nblks[MD_MULTI_LANES];
+  md_multi_u32 state[8], prev[8], w[16];
+  unsigned int maxblks = 0;
+  unsigned int blk, i;
+  size_t lane;
+
+  memset(state, 0, sizeof state);
+  for (lane = 0; lane < MD_MULTI_LANES; lane++) {
+    if (lane < n) {
+      SHA256_CONTEXT *hd = (SHA256_CONTEXT *)contexts[lane];
+      const u32 *h = &hd->h0;
+
+      nblks[lane] = _gcry_md_block_pad_be64(&hd->bctx, blks[lane]);
+      for (i = 0; i < 8; i++) state[i][lane] = h[i];
+    } else {
+      nblks[lane] = 0;
+      memset(blks[lane], 0, sizeof blks[lane]);
+    }
+    if (nblks[lane] > maxblks) maxblks = nblks[lane];
+  }
+
+  for (blk = 0; blk < maxblks; blk++) {
+    memcpy(prev, state, sizeof state);
+    for (i = 0; i < 16; i++)
+      for (lane = 0; lane < MD_MULTI_LANES; lane++)
+        w[i][lane] = buf_get_be32(blks[lane] + blk * 64 + i * 4);
+#if defined(__x86_64__) || defined(__i386__)
+    if (_gcry_md_multi_avx2)
+      transform_multi_avx2(state, w);
+    else
+#endif
+      transform_multi(state, w);
+    for (lane = 0; lane < MD_MULTI_LANES; lane++)
+      if (blk >= nblks[lane])
+        for (i = 0; i < 8; i++) state[i][lane] = prev[i][lane];
+  }
+
+  for (lane = 0; lane < n; lane++) {
+    SHA256_CONTEXT *hd = (SHA256_CONTEXT *)contexts[lane];
+    u32 *h = &hd->h0;
+
+    for (i = 0; i < 8; i++) {
+      h[i] = state[i][lane];
+      buf_put_be32(hd->bctx.buf + i * 4, h[i]);
+    }
+  }
+
+  wipememory(blks, sizeof blks);
+  wipememory(w, sizeof w);
+  wipememory(prev, sizeof prev);
+  _gcry_burn_stack(26 * sizeof(md_multi_u32));
+}
+
+/* Return true if HD uses a hardware transform.  The lanes are not
+   faster than these.  */
+static int sha256_hw_transform(void *context) {
+  SHA256_CONTEXT *hd = (SHA256_CONTEXT *)context;
+
+  (void)hd;
+#ifdef USE_SHAEXT
+  if (hd->use_shaext) return 1;
+#endif
+#ifdef USE_ARM_CE
+  if (hd->use_arm_ce) return 1;
+#endif
+  return 0;
+}
+
+/* Finalize the N contexts at CONTEXTS.  This is the same as calling
+   sha256_final for each of them.  */
+static void sha256_final_multi(void **contexts, size_t n) {
+  size_t k;
+
+  if (n && sha256_hw_transform(contexts[0])) {
+    for (; n; contexts++, n--) sha256_final(contexts[0]);
+    return;
+  }
+
+  for (; n >= 2; contexts += k, n -= k) {
+    k = n < MD_MULTI_LANES ? n : MD_MULTI_LANES;
+    sha256_final_lanes(contexts, k);
+  }
+  if (n) sha256_final(contexts[0]);
+}
+#define SHA256_FINAL_MULTI sha256_final_multi
+#else
+#define SHA256_FINAL_MULTI NULL
+#endif /*USE_MD_MULTI*/
+
 static byte *sha256_read(void *context) {
   SHA256_CONTEXT *hd = (SHA256_CONTEXT *)context;
 
@@ -606,7 +798,8 @@ gcry_md_spec_t _gcry_digest_spec_sha224 = {GCRY_MD_SHA224,
                                            sha256_read,
                                            NULL,
                                            sizeof(SHA256_CONTEXT),
-                                           run_selftests};
+                                           run_selftests,
+                                           SHA256_FINAL_MULTI};
 
 gcry_md_spec_t _gcry_digest_spec_sha256 = {GCRY_MD_SHA256,
                                            {0, 1},
@@ -621,4 +814,5 @@ gcry_md_spec_t _gcry_digest_spec_sha256 = {GCRY_MD_SHA256,
                                            sha256_read,
                                            NULL,
                                            sizeof(SHA256_CONTEXT),
-                                           run_selftests};
+                                           run_selftests,
+                                           SHA256_FINAL_MULTI};
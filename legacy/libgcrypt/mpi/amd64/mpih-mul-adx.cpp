@@ -0,0 +1,160 @@
+/* mpih-mul-adx.c  -  MPI helper functions for x86-64 with BMI2 and ADX
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * These replace the inner loops of the generic mpih-mul1.c and
+ * mpih-mul2.c on CPUs which have MULX (BMI2), ADCX and ADOX (ADX).
+ * MULX does not touch the flags, so the carry of the product chain can
+ * be kept in OF and the carry of the accumulation in CF, and the loops
+ * only use LEA and JRCXZ for bookkeeping.  The loops are unrolled four
+ * times; the remaining S1_SIZE % 4 limbs are handled first.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mpi-internal.h"
+
+#ifdef USE_MPIH_AMD64_ADX
+
+#include <cpuid.h>
+
+static int detect_adx(void) {
+  unsigned int eax, ebx, ecx, edx;
+
+  /* Allow to compare against the generic code.  */
+  if (getenv("GCRYPT_GENERIC_MPIH")) return 0;
+
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return 0;
+
+  /* BMI2 is bit 8 and ADX is bit 19 of EBX.  */
+  return (ebx & (1 << 8)) && (ebx & (1 << 19));
+}
+
+int _gcry_mpih_use_adx = detect_adx();
+
+mpi_limb_t _gcry_mpih_mul_1_adx(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                mpi_size_t s1_size, mpi_limb_t s2_limb) {
+  mpi_limb_t rem = s1_size & 3;
+  mpi_limb_t blocks = s1_size >> 2;
+  mpi_limb_t cy, lo, hi;
+
+  __asm__ volatile(
+      "xorl %k[cy], %k[cy]\n\t"
+      "movq %[rem], %%rcx\n\t"
+      "jrcxz 2f\n"
+      "1:\n\t"
+      "mulx (%[up]), %[lo], %[hi]\n\t"
+      "adcx %[cy], %[lo]\n\t"
+      "movq %[lo], (%[rp])\n\t"
+      "movq %[hi], %[cy]\n\t"
+      "leaq 8(%[up]), %[up]\n\t"
+      "leaq 8(%[rp]), %[rp]\n\t"
+      "leaq -1(%%rcx), %%rcx\n\t"
+      "jrcxz 2f\n\t"
+      "jmp 1b\n"
+      "2:\n\t"
+      "movq %[blocks], %%rcx\n\t"
+      "jrcxz 4f\n"
+      "3:\n\t"
+      "mulx (%[up]), %[lo], %[hi]\n\t"
+      "adcx %[cy], %[lo]\n\t"
+      "movq %[lo], (%[rp])\n\t"
+      "mulx 8(%[up]), %[lo], %[cy]\n\t"
+      "adcx %[hi], %[lo]\n\t"
+      "movq %[lo], 8(%[rp])\n\t"
+      "mulx 16(%[up]), %[lo], %[hi]\n\t"
+      "adcx %[cy], %[lo]\n\t"
+      "movq %[lo], 16(%[rp])\n\t"
+      "mulx 24(%[up]), %[lo], %[cy]\n\t"
+      "adcx %[hi], %[lo]\n\t"
+      "movq %[lo], 24(%[rp])\n\t"
+      "leaq 32(%[up]), %[up]\n\t"
+      "leaq 32(%[rp]), %[rp]\n\t"
+      "leaq -1(%%rcx), %%rcx\n\t"
+      "jrcxz 4f\n\t"
+      "jmp 3b\n"
+      "4:\n\t"
+      "movl $0, %k[lo]\n\t"
+      "adcx %[lo], %[cy]\n\t"
+      : [cy] "=&r"(cy), [lo] "=&r"(lo), [hi] "=&r"(hi), [rp] "+r"(res_ptr),
+        [up] "+r"(s1_ptr)
+      : "d"(s2_limb), [rem] "r"(rem), [blocks] "r"(blocks)
+      : "rcx", "cc", "memory");
+
+  return cy;
+}
+
+mpi_limb_t _gcry_mpih_addmul_1_adx(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                   mpi_size_t s1_size, mpi_limb_t s2_limb) {
+  mpi_limb_t rem = s1_size & 3;
+  mpi_limb_t blocks = s1_size >> 2;
+  mpi_limb_t cy, lo, hi;
+
+  __asm__ volatile(
+      "xorl %k[cy], %k[cy]\n\t"
+      "movq %[rem], %%rcx\n\t"
+      "jrcxz 2f\n"
+      "1:\n\t"
+      "mulx (%[up]), %[lo], %[hi]\n\t"
+      "adox %[cy], %[lo]\n\t"
+      "adcx (%[rp]), %[lo]\n\t"
+      "movq %[lo], (%[rp])\n\t"
+      "movq %[hi], %[cy]\n\t"
+      "leaq 8(%[up]), %[up]\n\t"
+      "leaq 8(%[rp]), %[rp]\n\t"
+      "leaq -1(%%rcx), %%rcx\n\t"
+      "jrcxz 2f\n\t"
+      "jmp 1b\n"
+      "2:\n\t"
+      "movq %[blocks], %%rcx\n\t"
+      "jrcxz 4f\n"
+      "3:\n\t"
+      "mulx (%[up]), %[lo], %[hi]\n\t"
+      "adox %[cy], %[lo]\n\t"
+      "adcx (%[rp]), %[lo]\n\t"
+      "movq %[lo], (%[rp])\n\t"
+      "mulx 8(%[up]), %[lo], %[cy]\n\t"
+      "adox %[hi], %[lo]\n\t"
+      "adcx 8(%[rp]), %[lo]\n\t"
+      "movq %[lo], 8(%[rp])\n\t"
+      "mulx 16(%[up]), %[lo], %[hi]\n\t"
+      "adox %[cy], %[lo]\n\t"
+      "adcx 16(%[rp]), %[lo]\n\t"
+      "movq %[lo], 16(%[rp])\n\t"
+      "mulx 24(%[up]), %[lo], %[cy]\n\t"
+      "adox %[hi], %[lo]\n\t"
+      "adcx 24(%[rp]), %[lo]\n\t"
+      "movq %[lo], 24(%[rp])\n\t"
+      "leaq 32(%[up]), %[up]\n\t"
+      "leaq 32(%[rp]), %[rp]\n\t"
+      "leaq -1(%%rcx), %%rcx\n\t"
+      "jrcxz 4f\n\t"
+      "jmp 3b\n"
+      "4:\n\t"
+      "movl $0, %k[lo]\n\t"
+      "adox %[lo], %[cy]\n\t"
+      "adcx %[lo], %[cy]\n\t"
+      : [cy] "=&r"(cy), [lo] "=&r"(lo), [hi] "=&r"(hi), [rp] "+r"(res_ptr),
+        [up] "+r"(s1_ptr)
+      : "d"(s2_limb), [rem] "r"(rem), [blocks] "r"(blocks)
+      : "rcx", "cc", "memory");
+
+  return cy;
+}
+
+#endif /*USE_MPIH_AMD64_ADX*/
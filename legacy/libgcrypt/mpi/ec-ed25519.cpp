@@ -28,4 +28,50 @@
 #include "longlong.h"
 #include "mpi-internal.h"
 
-void _gcry_mpi_ec_ed25519_mod(gcry_mpi_t a) { (void)a; }
+#include "ec-internal.h"
+
+/* R = A mod P with P = 2^255 - 19.  Because 2^256 = 38 (mod P), the
+   upper half of A is folded into the lower half with a factor of 38,
+   and bit 255 and above with a factor of 19.  */
+void _gcry_mpi_ec_ed25519_reduce(u32 *r, const u32 *a) {
+  u32 s[8];
+  u32 mask;
+  u64 t;
+  int i;
+
+  t = 0;
+  for (i = 0; i < 8; i++) {
+    t += (u64)a[i] + 38 * (u64)a[i + 8];
+    r[i] = (u32)t;
+    t >>= 32;
+  }
+
+  /* T is at most 39.  */
+  t = ((t << 1) | (r[7] >> 31)) * 19;
+  r[7] &= 0x7fffffff;
+  for (i = 0; i < 8; i++) {
+    t += r[i];
+    r[i] = (u32)t;
+    t >>= 32;
+  }
+
+  /* R is now below 2^255 + 19 * 79, fold bit 255 once more.  */
+  t = (r[7] >> 31) * 19;
+  r[7] &= 0x7fffffff;
+  for (i = 0; i < 8; i++) {
+    t += r[i];
+    r[i] = (u32)t;
+    t >>= 32;
+  }
+
+  /* R is below 2^255.  It is at least P iff R + 19 has bit 255 set.  */
+  t = 19;
+  for (i = 0; i < 8; i++) {
+    t += r[i];
+    s[i] = (u32)t;
+    t >>= 32;
+  }
+  mask = 0 - (s[7] >> 31);
+  s[7] &= 0x7fffffff;
+  for (i = 0; i < 8; i++) r[i] = (s[i] & mask) | (r[i] & ~mask);
+}
@@ -20,6 +20,10 @@
 #ifndef GCRY_EC_INTERNAL_H
 #define GCRY_EC_INTERNAL_H
 
-void _gcry_mpi_ec_ed25519_mod(gcry_mpi_t a);
+/* Dedicated reduction for a few 256 bit fields.  R receives the 8
+   words of A mod P, where A is given as 16 little-endian 32 bit
+   words.  The functions run in constant time.  */
+void _gcry_mpi_ec_ed25519_reduce(u32 *r, const u32 *a);
+void _gcry_mpi_ec_nist256_reduce(u32 *r, const u32 *a);
 
 #endif /*GCRY_EC_INTERNAL_H*/
@@ -0,0 +1,104 @@
+/* ec-nist.c -  NIST optimized elliptic curve functions
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "context.h"
+#include "ec-context.h"
+#include "ec-internal.h"
+#include "g10lib.h"
+#include "mpi-internal.h"
+
+/* The prime of NIST P-256 as little-endian 32 bit words.  */
+static const u32 p256[8] = {0xffffffff, 0xffffffff, 0xffffffff, 0x00000000,
+                            0x00000000, 0x00000000, 0x00000001, 0xffffffff};
+
+/* R = A mod P for P = 2^256 - 2^224 + 2^192 + 2^96 - 1, using the
+   word-wise reduction from FIPS 186-4, D.2.3:
+
+     R = T + 2 S1 + 2 S2 + S3 + S4 - D1 - D2 - D3 - D4
+
+   The words are summed with a signed carry, the carry out of word 7 is
+   folded back with 2^256 = 2^224 - 2^192 - 2^96 + 1 (mod P), and P is
+   subtracted once more if needed.  */
+void _gcry_mpi_ec_nist256_reduce(u32 *r, const u32 *a) {
+#define A(i) ((int64_t)a[i])
+  u32 s[8];
+  u32 mask;
+  int64_t t, c;
+  int i, k;
+
+  t = A(0) + A(8) + A(9) - A(11) - A(12) - A(13) - A(14);
+  r[0] = (u32)t;
+  t >>= 32;
+  t += A(1) + A(9) + A(10) - A(12) - A(13) - A(14) - A(15);
+  r[1] = (u32)t;
+  t >>= 32;
+  t += A(2) + A(10) + A(11) - A(13) - A(14) - A(15);
+  r[2] = (u32)t;
+  t >>= 32;
+  t += A(3) + 2 * (A(11) + A(12)) + A(13) - A(15) - A(8) - A(9);
+  r[3] = (u32)t;
+  t >>= 32;
+  t += A(4) + 2 * (A(12) + A(13)) + A(14) - A(9) - A(10);
+  r[4] = (u32)t;
+  t >>= 32;
+  t += A(5) + 2 * (A(13) + A(14)) + A(15) - A(10) - A(11);
+  r[5] = (u32)t;
+  t >>= 32;
+  t += A(6) + A(13) + 3 * A(14) + 2 * A(15) - A(8) - A(9);
+  r[6] = (u32)t;
+  t >>= 32;
+  t += A(7) + A(8) + 3 * A(15) - A(10) - A(11) - A(12) - A(13);
+  r[7] = (u32)t;
+  t >>= 32;
+#undef A
+
+  /* The carry is small (between -5 and 7).  Folding it in may carry
+     out once more, but the result of that is close enough to 0 or
+     2^256 that the second round can not.  */
+  for (k = 0; k < 2; k++) {
+    c = t;
+    t = (int64_t)r[0] + c;
+    r[0] = (u32)t;
+    t >>= 32;
+    for (i = 1; i < 8; i++) {
+      t += r[i];
+      if (i == 3 || i == 6)
+        t -= c;
+      else if (i == 7)
+        t += c;
+      r[i] = (u32)t;
+      t >>= 32;
+    }
+  }
+
+  /* R is below 2^256 < 2P.  Subtract P unless that borrows.  */
+  t = 0;
+  for (i = 0; i < 8; i++) {
+    t += (int64_t)r[i] - p256[i];
+    s[i] = (u32)t;
+    t >>= 32;
+  }
+  mask = (u32)t;
+  for (i = 0; i < 8; i++) r[i] = (r[i] & mask) | (s[i] & ~mask);
+}
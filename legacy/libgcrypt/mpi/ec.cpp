@@ -19,9 +19,13 @@
  */
 
 #include <config.h>
+
+#include <mutex>
+
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "context.h"
 #include "ec-context.h"
@@ -134,6 +138,14 @@ static void point_swap_cond(mpi_point_t d, mpi_point_t s, unsigned long swap,
   mpi_swap_cond(d->z, s->z, swap);
 }
 
+/* Set D to S if SET is 1, in constant time.  Both points need to be
+   resized with point_resize.  */
+static void point_set_cond(mpi_point_t d, mpi_point_t s, unsigned long set) {
+  mpi_set_cond(d->x, s->x, set);
+  mpi_set_cond(d->y, s->y, set);
+  mpi_set_cond(d->z, s->z, set);
+}
+
 /* Set the projective coordinates from POINT into X, Y, and Z.  If a
    coordinate is not required, X, Y, or Z may be passed as NULL.  */
 void _gcry_mpi_point_get(gcry_mpi_t x, gcry_mpi_t y, gcry_mpi_t z,
@@ -203,11 +215,54 @@ mpi_point_t _gcry_mpi_point_snatch_set(mpi_point_t point, gcry_mpi_t x,
   return point;
 }
 
+/* The dedicated field arithmetic works on 256 bit values held as
+   little-endian arrays of 32 bit words, which keeps it independent of
+   the limb size and free of memory allocation.  */
+#define EC_FAST_WORDS 8
+#define EC_WORDS_PER_LIMB (BYTES_PER_MPI_LIMB / 4)
+#define EC_FAST_LIMBS (EC_FAST_WORDS / EC_WORDS_PER_LIMB)
+
+/* Store the NWORDS low words of A at R.  A must not be negative.  */
+static void ec_fast_load(u32 *r, gcry_mpi_t a, int nwords) {
+  int i, n;
+
+  for (i = 0; i < nwords; i++) {
+    n = i / EC_WORDS_PER_LIMB;
+    r[i] = n < a->nlimbs
+               ? (u32)(a->d[n] >> (32 * (i % EC_WORDS_PER_LIMB)))
+               : 0;
+  }
+}
+
+/* W = R, where R is a value of EC_FAST_WORDS words.  */
+static void ec_fast_store(gcry_mpi_t w, const u32 *r) {
+  int i;
+
+  if (w->alloced < EC_FAST_LIMBS) mpi_resize(w, EC_FAST_LIMBS);
+  for (i = 0; i < EC_FAST_LIMBS; i++) w->d[i] = 0;
+  for (i = 0; i < EC_FAST_WORDS; i++)
+    w->d[i / EC_WORDS_PER_LIMB] |= (mpi_limb_t)r[i]
+                                   << (32 * (i % EC_WORDS_PER_LIMB));
+  w->nlimbs = EC_FAST_LIMBS;
+  w->sign = 0;
+  MPN_NORMALIZE(w->d, w->nlimbs);
+}
+
+/* Return true if W can be handled by the dedicated field arithmetic
+   and has at most NLIMBS limbs.  */
+static int ec_fast_p(gcry_mpi_t w, mpi_ec_t ec, int nlimbs) {
+  return ec->t.fast_reduce && !w->sign && w->nlimbs <= nlimbs;
+}
+
 /* W = W mod P.  */
 static void ec_mod(gcry_mpi_t w, mpi_ec_t ec) {
-  if (0 && ec->dialect == ECC_DIALECT_ED25519)
-    _gcry_mpi_ec_ed25519_mod(w);
-  else if (ec->t.p_barrett)
+  if (ec_fast_p(w, ec, 2 * EC_FAST_LIMBS)) {
+    u32 a[2 * EC_FAST_WORDS], r[EC_FAST_WORDS];
+
+    ec_fast_load(a, w, 2 * EC_FAST_WORDS);
+    ec->t.fast_reduce(r, a);
+    ec_fast_store(w, r);
+  } else if (ec->t.p_barrett)
     _gcry_mpi_mod_barrett(w, w, ec->t.p_barrett);
   else
     _gcry_mpi_mod(w, w, ec->p);
@@ -225,6 +280,32 @@ static void ec_subm(gcry_mpi_t w, gcry_mpi_t u, gcry_mpi_t v, mpi_ec_t ec) {
 }
 
 static void ec_mulm(gcry_mpi_t w, gcry_mpi_t u, gcry_mpi_t v, mpi_ec_t ctx) {
+  if (ec_fast_p(u, ctx, EC_FAST_LIMBS) && ec_fast_p(v, ctx, EC_FAST_LIMBS)) {
+    /* Schoolbook multiplication into a local buffer.  Unlike mpi_mul
+       this does not allocate when W is the same as U or V, and its
+       running time does not depend on the values.  */
+    u32 a[EC_FAST_WORDS], b[EC_FAST_WORDS];
+    u32 c[2 * EC_FAST_WORDS], r[EC_FAST_WORDS];
+    u64 t;
+    int i, j;
+
+    ec_fast_load(a, u, EC_FAST_WORDS);
+    ec_fast_load(b, v, EC_FAST_WORDS);
+    for (i = 0; i < EC_FAST_WORDS; i++) c[i] = 0;
+    for (i = 0; i < EC_FAST_WORDS; i++) {
+      t = 0;
+      for (j = 0; j < EC_FAST_WORDS; j++) {
+        t += (u64)a[i] * b[j] + c[i + j];
+        c[i + j] = (u32)t;
+        t >>= 32;
+      }
+      c[i + EC_FAST_WORDS] = (u32)t;
+    }
+    ctx->t.fast_reduce(r, c);
+    ec_fast_store(w, r);
+    return;
+  }
+
   mpi_mul(w, u, v);
   ec_mod(w, ctx);
 }
@@ -296,6 +377,26 @@ static gcry_mpi_t ec_get_two_inv_p(mpi_ec_t ec) {
   return ec->t.two_inv_p;
 }
 
+/* Select the dedicated reduction for the field of CTX, if there is
+   one.  Curve25519 and Ed25519 share their field.  */
+static void ec_fast_init(mpi_ec_t ctx) {
+  static const u32 p25519[EC_FAST_WORDS] = {
+      0xffffffed, 0xffffffff, 0xffffffff, 0xffffffff,
+      0xffffffff, 0xffffffff, 0xffffffff, 0x7fffffff};
+  static const u32 p256[EC_FAST_WORDS] = {
+      0xffffffff, 0xffffffff, 0xffffffff, 0x00000000,
+      0x00000000, 0x00000000, 0x00000001, 0xffffffff};
+  u32 w[EC_FAST_WORDS];
+
+  ctx->t.fast_reduce = NULL;
+  if (ctx->p->sign || ctx->p->nlimbs != EC_FAST_LIMBS) return;
+  ec_fast_load(w, ctx->p, EC_FAST_WORDS);
+  if (!memcmp(w, p25519, sizeof w))
+    ctx->t.fast_reduce = _gcry_mpi_ec_ed25519_reduce;
+  else if (!memcmp(w, p256, sizeof w))
+    ctx->t.fast_reduce = _gcry_mpi_ec_nist256_reduce;
+}
+
 /* This function initialized a context for elliptic curve based on the
    field GF(p).  P is the prime specifying this field, A is the first
    coefficient.  CTX is expected to be zeroized.  */
@@ -304,6 +405,7 @@ static void ec_p_init(mpi_ec_t ctx, enum gcry_mpi_ec_models model,
                       gcry_mpi_t a, gcry_mpi_t b) {
   int i;
   static int use_barrett;
+  static int use_generic;
 
   if (!use_barrett) {
     if (getenv("GCRYPT_BARRETT"))
@@ -312,6 +414,14 @@ static void ec_p_init(mpi_ec_t ctx, enum gcry_mpi_ec_models model,
       use_barrett = -1;
   }
 
+  /* Allow to compare against the generic field arithmetic.  */
+  if (!use_generic) {
+    if (getenv("GCRYPT_GENERIC_EC"))
+      use_generic = 1;
+    else
+      use_generic = -1;
+  }
+
   /* Fixme: Do we want to check some constraints? e.g.  a < p  */
 
   ctx->model = model;
@@ -326,30 +436,13 @@ static void ec_p_init(mpi_ec_t ctx, enum gcry_mpi_ec_models model,
   ctx->b = mpi_copy(b);
 
   ctx->t.p_barrett = use_barrett > 0 ? _gcry_mpi_barrett_init(ctx->p, 0) : NULL;
+  if (use_generic < 0) ec_fast_init(ctx);
 
   _gcry_mpi_ec_get_reset(ctx);
 
   /* Allocate scratch variables.  */
   for (i = 0; i < DIM(ctx->t.scratch); i++)
     ctx->t.scratch[i] = mpi_alloc_like(ctx->p);
-
-  /* Prepare for fast reduction.  */
-  /* FIXME: need a test for NIST values.  However it does not gain us
-     any real advantage, for 384 bits it is actually slower than using
-     mpi_mulm.  */
-  /*   ctx->nist_nbits = mpi_get_nbits (ctx->p); */
-  /*   if (ctx->nist_nbits == 192) */
-  /*     { */
-  /*       for (i=0; i < 4; i++) */
-  /*         ctx->s[i] = mpi_new (192); */
-  /*       ctx->c    = mpi_new (192*2); */
-  /*     } */
-  /*   else if (ctx->nist_nbits == 384) */
-  /*     { */
-  /*       for (i=0; i < 10; i++) */
-  /*         ctx->s[i] = mpi_new (384); */
-  /*       ctx->c    = mpi_new (384*2); */
-  /*     } */
 }
 
 static void ec_deinit(void *opaque) {
@@ -1232,6 +1325,183 @@ void _gcry_mpi_ec_mul_point(mpi_point_t result, gcry_mpi_t scalar,
   mpi_free(k);
 }
 
+/* Fixed-base scalar multiplication.  For a base point we keep a table
+   with the multiples  j * 2^(W*i) * BASE  for all windows I of the
+   scalar and all digits J from 1 to 2^W - 1, in affine coordinates.
+   The product is then the sum of one table entry per window and needs
+   no point doublings at all.  Tables are built on first use and kept
+   for the lifetime of the process.  */
+#define EC_BASE_WINDOW 4
+#define EC_BASE_DIGITS ((1 << EC_BASE_WINDOW) - 1)
+#define EC_BASE_MAX_TABLES 4
+
+struct ec_base_table_s {
+  enum gcry_mpi_ec_models model;
+  enum ecc_dialects dialect;
+  gcry_mpi_t p, a, b;
+  mpi_point_struct base;
+  unsigned int nwindows;
+  mpi_point_t points; /* NWINDOWS * EC_BASE_DIGITS entries.  */
+};
+
+static std::mutex ec_base_lock;
+static struct ec_base_table_s *ec_base_tables[EC_BASE_MAX_TABLES];
+
+/* Return true if TBL is the table for BASE on the curve CTX.  */
+static int ec_base_table_match(struct ec_base_table_s *tbl, mpi_point_t base,
+                               mpi_ec_t ctx) {
+  return (tbl->model == ctx->model && tbl->dialect == ctx->dialect &&
+          !mpi_cmp(tbl->p, ctx->p) && !mpi_cmp(tbl->a, ctx->a) &&
+          !mpi_cmp(tbl->b, ctx->b) && !mpi_cmp(tbl->base.x, base->x) &&
+          !mpi_cmp(tbl->base.y, base->y) && !mpi_cmp(tbl->base.z, base->z));
+}
+
+static void ec_base_table_free(struct ec_base_table_s *tbl) {
+  unsigned int i;
+
+  if (!tbl) return;
+  mpi_free(tbl->p);
+  mpi_free(tbl->a);
+  mpi_free(tbl->b);
+  point_free(&tbl->base);
+  if (tbl->points) {
+    for (i = 0; i < tbl->nwindows * EC_BASE_DIGITS; i++)
+      point_free(&tbl->points[i]);
+    xfree(tbl->points);
+  }
+  xfree(tbl);
+}
+
+/* Build the table for BASE on the curve CTX.  Returns NULL on error.  */
+static struct ec_base_table_s *ec_base_table_new(mpi_point_t base,
+                                                 mpi_ec_t ctx) {
+  struct ec_base_table_s *tbl;
+  mpi_point_struct cur, acc;
+  mpi_point_t q;
+  unsigned int i, j;
+  int failed = 0;
+
+  tbl = (struct ec_base_table_s *)xtrycalloc(1, sizeof *tbl);
+  if (!tbl) return NULL;
+  tbl->model = ctx->model;
+  tbl->dialect = ctx->dialect;
+  tbl->p = mpi_copy(ctx->p);
+  tbl->a = mpi_copy(ctx->a);
+  tbl->b = mpi_copy(ctx->b);
+  point_init(&tbl->base);
+  point_set(&tbl->base, base);
+  /* One more bit because the group order may exceed P.  */
+  tbl->nwindows = (ctx->nbits + 1 + EC_BASE_WINDOW - 1) / EC_BASE_WINDOW;
+  tbl->points = (mpi_point_t)xtrycalloc(tbl->nwindows * EC_BASE_DIGITS,
+                                        sizeof *tbl->points);
+  if (!tbl->points) {
+    ec_base_table_free(tbl);
+    return NULL;
+  }
+
+  point_init(&cur);
+  point_init(&acc);
+  point_set(&cur, base);
+  for (i = 0; i < tbl->nwindows && !failed; i++) {
+    point_set(&acc, &cur);
+    for (j = 0; j < EC_BASE_DIGITS && !failed; j++) {
+      if (j) _gcry_mpi_ec_add_points(&acc, &acc, &cur, ctx);
+      q = &tbl->points[i * EC_BASE_DIGITS + j];
+      point_init(q);
+      point_resize(q, ctx);
+      if (_gcry_mpi_ec_get_affine(q->x, q->y, &acc, ctx))
+        failed = 1;
+      else
+        mpi_set_ui(q->z, 1);
+    }
+    for (j = 0; j < EC_BASE_WINDOW; j++)
+      _gcry_mpi_ec_dup_point(&cur, &cur, ctx);
+  }
+  point_free(&cur);
+  point_free(&acc);
+
+  if (failed) {
+    /* Only partly initialized; the remaining entries are zero.  */
+    ec_base_table_free(tbl);
+    return NULL;
+  }
+  return tbl;
+}
+
+/* Return the table for BASE on the curve CTX, building it if there
+   is room for another one.  Returns NULL if no table is available.  */
+static struct ec_base_table_s *ec_base_table_get(mpi_point_t base,
+                                                 mpi_ec_t ctx) {
+  unsigned int i;
+
+  std::lock_guard<std::mutex> lock(ec_base_lock);
+  for (i = 0; i < EC_BASE_MAX_TABLES && ec_base_tables[i]; i++)
+    if (ec_base_table_match(ec_base_tables[i], base, ctx))
+      return ec_base_tables[i];
+
+  if (i == EC_BASE_MAX_TABLES) return NULL;
+  ec_base_tables[i] = ec_base_table_new(base, ctx);
+  return ec_base_tables[i];
+}
+
+/* Scalar multiplication with a fixed point BASE, e.g. the generator
+   of the curve.  This is like _gcry_mpi_ec_mul_point but uses a table
+   of precomputed multiples of BASE, which makes it several times
+   faster.  If SCALAR is in secure memory the table is accessed in
+   constant time and an addition is done for every window.  */
+void _gcry_mpi_ec_mul_base(mpi_point_t result, gcry_mpi_t scalar,
+                           mpi_point_t base, mpi_ec_t ctx) {
+  struct ec_base_table_s *tbl = NULL;
+  mpi_point_struct sel, tmp;
+  mpi_point_t row;
+  unsigned int i, j, b, digit, want;
+  int secure;
+
+  if (ctx->model != MPI_EC_MONTGOMERY && !mpi_has_sign(scalar))
+    tbl = ec_base_table_get(base, ctx);
+  if (!tbl || mpi_get_nbits(scalar) > tbl->nwindows * EC_BASE_WINDOW) {
+    _gcry_mpi_ec_mul_point(result, scalar, base, ctx);
+    return;
+  }
+
+  secure = mpi_is_secure(scalar);
+  if (ctx->model == MPI_EC_WEIERSTRASS) {
+    mpi_set_ui(result->x, 1);
+    mpi_set_ui(result->y, 1);
+    mpi_set_ui(result->z, 0);
+  } else {
+    mpi_set_ui(result->x, 0);
+    mpi_set_ui(result->y, 1);
+    mpi_set_ui(result->z, 1);
+  }
+  point_resize(result, ctx);
+
+  point_init(&sel);
+  point_init(&tmp);
+  point_resize(&sel, ctx);
+  point_resize(&tmp, ctx);
+
+  for (i = 0; i < tbl->nwindows; i++) {
+    row = &tbl->points[i * EC_BASE_DIGITS];
+    for (digit = 0, b = 0; b < EC_BASE_WINDOW; b++)
+      digit |= mpi_test_bit(scalar, i * EC_BASE_WINDOW + b) << b;
+
+    if (secure) {
+      /* Load entry DIGIT (or 1 for a zero digit) by looking at all of
+         them, add it, and keep the sum only for a non-zero digit.  */
+      want = digit + (digit == 0);
+      for (j = 0; j < EC_BASE_DIGITS; j++)
+        point_set_cond(&sel, &row[j], (j + 1) == want);
+      _gcry_mpi_ec_add_points(&tmp, result, &sel, ctx);
+      point_swap_cond(result, &tmp, digit != 0, ctx);
+    } else if (digit)
+      _gcry_mpi_ec_add_points(result, result, &row[digit - 1], ctx);
+  }
+
+  point_free(&sel);
+  point_free(&tmp);
+}
+
 /* Return true if POINT is on the curve described by CTX.  */
 int _gcry_mpi_ec_curve_point(gcry_mpi_point_t point, mpi_ec_t ctx) {
   int res = 0;
@@ -123,6 +123,7 @@ void _gcry_mpi_tdiv_qr(gcry_mpi_t quot, gcry_mpi_t rem, gcry_mpi_t num,
   mpi_limb_t q_limb;
   mpi_ptr_t marker[5];
   unsigned int marker_nlimbs[5];
+  int marker_secure[5];
   int markidx = 0;
 
   /* Ensure space is enough for quotient and remainder.
@@ -178,7 +179,10 @@ void _gcry_mpi_tdiv_qr(gcry_mpi_t quot, gcry_mpi_t rem, gcry_mpi_t num,
      * numerator would be gradually overwritten by the quotient limbs.  */
     if (qp == np) { /* Copy NP object to temporary space.  */
       marker_nlimbs[markidx] = nsize;
-      np = marker[markidx++] = mpi_alloc_limb_space(nsize, mpi_is_secure(quot));
+      marker_secure[markidx] = mpi_is_secure(quot);
+      np = marker[markidx] =
+          _gcry_mpi_scratch_alloc(nsize, marker_secure[markidx]);
+      markidx++;
       MPN_COPY(np, qp, nsize);
     }
   } else /* Put quotient at top of remainder. */
@@ -198,7 +202,10 @@ void _gcry_mpi_tdiv_qr(gcry_mpi_t quot, gcry_mpi_t rem, gcry_mpi_t num,
      * the most significant word.  Use temporary storage not to clobber
      * the original contents of the denominator.  */
     marker_nlimbs[markidx] = dsize;
-    tp = marker[markidx++] = mpi_alloc_limb_space(dsize, mpi_is_secure(den));
+    marker_secure[markidx] = mpi_is_secure(den);
+    tp = marker[markidx] =
+        _gcry_mpi_scratch_alloc(dsize, marker_secure[markidx]);
+    markidx++;
     _gcry_mpih_lshift(tp, dp, dsize, normalization_steps);
     dp = tp;
 
@@ -218,7 +225,10 @@ void _gcry_mpi_tdiv_qr(gcry_mpi_t quot, gcry_mpi_t rem, gcry_mpi_t num,
       mpi_ptr_t tp;
 
       marker_nlimbs[markidx] = dsize;
-      tp = marker[markidx++] = mpi_alloc_limb_space(dsize, mpi_is_secure(den));
+      marker_secure[markidx] = mpi_is_secure(den);
+      tp = marker[markidx] =
+          _gcry_mpi_scratch_alloc(dsize, marker_secure[markidx]);
+      markidx++;
       MPN_COPY(tp, dp, dsize);
       dp = tp;
     }
@@ -254,7 +264,8 @@ void _gcry_mpi_tdiv_qr(gcry_mpi_t quot, gcry_mpi_t rem, gcry_mpi_t num,
   rem->sign = sign_remainder;
   while (markidx) {
     markidx--;
-    _gcry_mpi_free_limb_space(marker[markidx], marker_nlimbs[markidx]);
+    _gcry_mpi_scratch_free(marker[markidx], marker_nlimbs[markidx],
+                           marker_secure[markidx]);
   }
 }
 
@@ -67,6 +67,27 @@ typedef signed short int mpi_limb_signed_t;
 #define KARATSUBA_THRESHOLD 2
 #endif
 
+/* Use the MULX/ADCX/ADOX kernels from amd64/mpih-mul-adx.c if the CPU
+ * supports them.  They are written for the LP64 ABI.  */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__ILP32__) && \
+    BYTES_PER_MPI_LIMB == 8
+#define USE_MPIH_AMD64_ADX 1
+#endif
+
+/* The ADX kernels make the schoolbook multiplication about three times
+ * faster, which moves the point where Karatsuba starts to pay off from
+ * 16 to about 24 limbs.  */
+#ifndef KARATSUBA_THRESHOLD_ADX
+#define KARATSUBA_THRESHOLD_ADX 24
+#endif
+
+#ifdef USE_MPIH_AMD64_ADX
+#define MPIH_KARATSUBA_THRESHOLD \
+  (_gcry_mpih_use_adx ? KARATSUBA_THRESHOLD_ADX : KARATSUBA_THRESHOLD)
+#else
+#define MPIH_KARATSUBA_THRESHOLD KARATSUBA_THRESHOLD
+#endif
+
 typedef mpi_limb_t *mpi_ptr_t; /* pointer to a limb */
 typedef int mpi_size_t;        /* (must be a signed type) */
 
@@ -122,7 +143,7 @@ typedef int mpi_size_t;        /* (must be a signed type) */
 
 #define MPN_MUL_N_RECURSE(prodp, up, vp, size, tspace) \
   do {                                                 \
-    if ((size) < KARATSUBA_THRESHOLD)                  \
+    if ((size) < MPIH_KARATSUBA_THRESHOLD)             \
       mul_n_basecase(prodp, up, vp, size);             \
     else                                               \
       mul_n(prodp, up, vp, size, tspace);              \
@@ -163,6 +184,8 @@ typedef int mpi_size_t;        /* (must be a signed type) */
 #define mpi_alloc_limb_space(n, f) _gcry_mpi_alloc_limb_space((n), (f))
 mpi_ptr_t _gcry_mpi_alloc_limb_space(unsigned nlimbs, int sec);
 void _gcry_mpi_free_limb_space(mpi_ptr_t a, unsigned int nlimbs);
+mpi_ptr_t _gcry_mpi_scratch_alloc(unsigned int nlimbs, int secure);
+void _gcry_mpi_scratch_free(mpi_ptr_t a, unsigned int nlimbs, int secure);
 void _gcry_mpi_assign_limb_space(gcry_mpi_t a, mpi_ptr_t ap, unsigned nlimbs);
 
 /*-- mpi-bit.c --*/
@@ -199,9 +222,11 @@ struct karatsuba_ctx {
   struct karatsuba_ctx *next;
   mpi_ptr_t tspace;
   unsigned int tspace_nlimbs;
+  int tspace_secure;
   mpi_size_t tspace_size;
   mpi_ptr_t tp;
   unsigned int tp_nlimbs;
+  int tp_secure;
   mpi_size_t tp_size;
 };
 
@@ -227,6 +252,15 @@ void _gcry_mpih_mul_karatsuba_case(mpi_ptr_t prodp, mpi_ptr_t up,
 mpi_limb_t _gcry_mpih_mul_1(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
                             mpi_size_t s1_size, mpi_limb_t s2_limb);
 
+/*-- amd64/mpih-mul-adx.c --*/
+#ifdef USE_MPIH_AMD64_ADX
+extern int _gcry_mpih_use_adx;
+mpi_limb_t _gcry_mpih_mul_1_adx(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                mpi_size_t s1_size, mpi_limb_t s2_limb);
+mpi_limb_t _gcry_mpih_addmul_1_adx(mpi_ptr_t res_ptr, mpi_ptr_t s1_ptr,
+                                   mpi_size_t s1_size, mpi_limb_t s2_limb);
+#endif
+
 /*-- mpih-div.c --*/
 mpi_limb_t _gcry_mpih_mod_1(mpi_ptr_t dividend_ptr, mpi_size_t dividend_size,
                             mpi_limb_t divisor_limb);
@@ -105,6 +105,7 @@ void _gcry_mpi_mul(gcry_mpi_t w, gcry_mpi_t u, gcry_mpi_t v) {
   int assign_wp = 0;
   mpi_ptr_t tmp_limb = NULL;
   unsigned int tmp_limb_nlimbs = 0;
+  int tmp_limb_secure = 0;
 
   if (u->nlimbs < v->nlimbs) { /* Swap U and V. */
     usize = v->nlimbs;
@@ -149,7 +150,8 @@ void _gcry_mpi_mul(gcry_mpi_t w, gcry_mpi_t u, gcry_mpi_t v) {
     if (wp == up) {
       /* W and U are identical.  Allocate temporary space for U.	*/
       tmp_limb_nlimbs = usize;
-      up = tmp_limb = mpi_alloc_limb_space(usize, usecure);
+      tmp_limb_secure = usecure;
+      up = tmp_limb = _gcry_mpi_scratch_alloc(usize, usecure);
       /* Is V identical too?  Keep it identical with U.  */
       if (wp == vp) vp = up;
       /* Copy to the temporary space.  */
@@ -157,7 +159,8 @@ void _gcry_mpi_mul(gcry_mpi_t w, gcry_mpi_t u, gcry_mpi_t v) {
     } else if (wp == vp) {
       /* W and V are identical.  Allocate temporary space for V.	*/
       tmp_limb_nlimbs = vsize;
-      vp = tmp_limb = mpi_alloc_limb_space(vsize, vsecure);
+      tmp_limb_secure = vsecure;
+      vp = tmp_limb = _gcry_mpi_scratch_alloc(vsize, vsecure);
       /* Copy to the temporary space.  */
       MPN_COPY(vp, wp, vsize);
     }
@@ -182,7 +185,8 @@ void _gcry_mpi_mul(gcry_mpi_t w, gcry_mpi_t u, gcry_mpi_t v) {
   }
   w->nlimbs = wsize;
   w->sign = sign_product;
-  if (tmp_limb) _gcry_mpi_free_limb_space(tmp_limb, tmp_limb_nlimbs);
+  if (tmp_limb)
+    _gcry_mpi_scratch_free(tmp_limb, tmp_limb_nlimbs, tmp_limb_secure);
 }
 
 void _gcry_mpi_mulm(gcry_mpi_t w, gcry_mpi_t u, gcry_mpi_t v, gcry_mpi_t m) {
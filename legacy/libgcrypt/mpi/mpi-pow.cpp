@@ -100,8 +100,8 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
      required by mpn_divrem.  This will make the intermediate values
      in the calculation slightly larger, but the correct result is
      obtained after a final reduction using the original MOD value. */
-  mp_nlimbs = msec ? msize : 0;
-  mp = mp_marker = mpi_alloc_limb_space(msize, msec);
+  mp_nlimbs = msize;
+  mp = mp_marker = _gcry_mpi_scratch_alloc(msize, msec);
   count_leading_zeros(mod_shift_cnt, mod->d[msize - 1]);
   if (mod_shift_cnt)
     _gcry_mpih_lshift(mp, mod->d, msize, mod_shift_cnt);
@@ -115,8 +115,8 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
 
        Allocate (BSIZE + 1) with space for remainder and quotient.
        (The quotient is (bsize - msize + 1) limbs.)  */
-    bp_nlimbs = bsec ? (bsize + 1) : 0;
-    bp = bp_marker = mpi_alloc_limb_space(bsize + 1, bsec);
+    bp_nlimbs = bsize + 1;
+    bp = bp_marker = _gcry_mpi_scratch_alloc(bsize + 1, bsec);
     MPN_COPY(bp, base->d, bsize);
     /* We don't care about the quotient, store it above the
      * remainder, at BP + MSIZE.  */
@@ -138,21 +138,21 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
   if (rp == bp) {
     /* RES and BASE are identical.  Allocate temp. space for BASE.  */
     gcry_assert(!bp_marker);
-    bp_nlimbs = bsec ? bsize : 0;
-    bp = bp_marker = mpi_alloc_limb_space(bsize, bsec);
+    bp_nlimbs = bsize;
+    bp = bp_marker = _gcry_mpi_scratch_alloc(bsize, bsec);
     MPN_COPY(bp, rp, bsize);
   }
   if (rp == ep) {
     /* RES and EXPO are identical.  Allocate temp. space for EXPO.  */
-    ep_nlimbs = esec ? esize : 0;
-    ep = ep_marker = mpi_alloc_limb_space(esize, esec);
+    ep_nlimbs = esize;
+    ep = ep_marker = _gcry_mpi_scratch_alloc(esize, esec);
     MPN_COPY(ep, rp, esize);
   }
   if (rp == mp) {
     /* RES and MOD are identical.  Allocate temporary space for MOD.*/
     gcry_assert(!mp_marker);
-    mp_nlimbs = msec ? msize : 0;
-    mp = mp_marker = mpi_alloc_limb_space(msize, msec);
+    mp_nlimbs = msize;
+    mp = mp_marker = _gcry_mpi_scratch_alloc(msize, msec);
     MPN_COPY(mp, rp, msize);
   }
 
@@ -175,8 +175,8 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
     struct karatsuba_ctx karactx;
     struct gcry_mpi w, u;
 
-    xp_nlimbs = msec ? size : 0;
-    xp = xp_marker = mpi_alloc_limb_space(size, msec);
+    xp_nlimbs = size;
+    xp = xp_marker = _gcry_mpi_scratch_alloc(size, msec);
 
     w.sign = u.sign = 0;
     w.flags = u.flags = 0;
@@ -206,16 +206,16 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
         mpi_size_t xsize;
 
         /*mpih_mul_n(xp, rp, rp, rsize);*/
-        if (rsize < KARATSUBA_THRESHOLD)
+        if (rsize < MPIH_KARATSUBA_THRESHOLD)
           _gcry_mpih_sqr_n_basecase(xp, rp, rsize);
         else {
           if (!tspace) {
             tsize = 2 * rsize;
-            tspace = mpi_alloc_limb_space(tsize, 0);
+            tspace = _gcry_mpi_scratch_alloc(tsize, 0);
           } else if (tsize < (2 * rsize)) {
-            _gcry_mpi_free_limb_space(tspace, 0);
+            _gcry_mpi_scratch_free(tspace, tsize, 0);
             tsize = 2 * rsize;
-            tspace = mpi_alloc_limb_space(tsize, 0);
+            tspace = _gcry_mpi_scratch_alloc(tsize, 0);
           }
           _gcry_mpih_sqr_n(xp, rp, rsize, tspace);
         }
@@ -239,7 +239,7 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
          * memory and we can thus assume it is a secret exponent.  */
         if (esec || (mpi_limb_signed_t)e < 0) {
           /*mpih_mul( xp, rp, rsize, bp, bsize );*/
-          if (bsize < KARATSUBA_THRESHOLD)
+          if (bsize < MPIH_KARATSUBA_THRESHOLD)
             _gcry_mpih_mul(xp, rp, rsize, bp, bsize);
           else
             _gcry_mpih_mul_karatsuba_case(xp, rp, rsize, bp, bsize, &karactx);
@@ -308,11 +308,11 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
   res->sign = rsign;
 
 leave:
-  if (mp_marker) _gcry_mpi_free_limb_space(mp_marker, mp_nlimbs);
-  if (bp_marker) _gcry_mpi_free_limb_space(bp_marker, bp_nlimbs);
-  if (ep_marker) _gcry_mpi_free_limb_space(ep_marker, ep_nlimbs);
-  if (xp_marker) _gcry_mpi_free_limb_space(xp_marker, xp_nlimbs);
-  if (tspace) _gcry_mpi_free_limb_space(tspace, 0);
+  if (mp_marker) _gcry_mpi_scratch_free(mp_marker, mp_nlimbs, msec);
+  if (bp_marker) _gcry_mpi_scratch_free(bp_marker, bp_nlimbs, bsec);
+  if (ep_marker) _gcry_mpi_scratch_free(ep_marker, ep_nlimbs, esec);
+  if (xp_marker) _gcry_mpi_scratch_free(xp_marker, xp_nlimbs, msec);
+  if (tspace) _gcry_mpi_scratch_free(tspace, tsize, 0);
 }
 #else
 /**
@@ -334,7 +334,7 @@ static void mul_mod(mpi_ptr_t xp, mpi_size_t *xsize_p, mpi_ptr_t rp,
                     mpi_size_t rsize, mpi_ptr_t sp, mpi_size_t ssize,
                     mpi_ptr_t mp, mpi_size_t msize,
                     struct karatsuba_ctx *karactx_p) {
-  if (ssize < KARATSUBA_THRESHOLD)
+  if (ssize < MPIH_KARATSUBA_THRESHOLD)
     _gcry_mpih_mul(xp, rp, rsize, sp, ssize);
   else
     _gcry_mpih_mul_karatsuba_case(xp, rp, rsize, sp, ssize, karactx_p);
@@ -431,8 +431,8 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
      required by mpn_divrem.  This will make the intermediate values
      in the calculation slightly larger, but the correct result is
      obtained after a final reduction using the original MOD value. */
-  mp_nlimbs = msec ? msize : 0;
-  mp = mp_marker = mpi_alloc_limb_space(msize, msec);
+  mp_nlimbs = msize;
+  mp = mp_marker = _gcry_mpi_scratch_alloc(msize, msec);
   count_leading_zeros(mod_shift_cnt, mod->d[msize - 1]);
   if (mod_shift_cnt)
     _gcry_mpih_lshift(mp, mod->d, msize, mod_shift_cnt);
@@ -446,8 +446,8 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
 
        Allocate (BSIZE + 1) with space for remainder and quotient.
        (The quotient is (bsize - msize + 1) limbs.)  */
-    bp_nlimbs = bsec ? (bsize + 1) : 0;
-    bp = bp_marker = mpi_alloc_limb_space(bsize + 1, bsec);
+    bp_nlimbs = bsize + 1;
+    bp = bp_marker = _gcry_mpi_scratch_alloc(bsize + 1, bsec);
     MPN_COPY(bp, base->d, bsize);
     /* We don't care about the quotient, store it above the
      * remainder, at BP + MSIZE.  */
@@ -470,14 +470,14 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
   if (rp == bp) {
     /* RES and BASE are identical.  Allocate temp. space for BASE.  */
     gcry_assert(!bp_marker);
-    bp_nlimbs = bsec ? bsize : 0;
-    bp = bp_marker = mpi_alloc_limb_space(bsize, bsec);
+    bp_nlimbs = bsize;
+    bp = bp_marker = _gcry_mpi_scratch_alloc(bsize, bsec);
     MPN_COPY(bp, rp, bsize);
   }
   if (rp == ep) {
     /* RES and EXPO are identical.  Allocate temp. space for EXPO.  */
-    ep_nlimbs = esec ? esize : 0;
-    ep = ep_marker = mpi_alloc_limb_space(esize, esec);
+    ep_nlimbs = esize;
+    ep = ep_marker = _gcry_mpi_scratch_alloc(esize, esec);
     MPN_COPY(ep, rp, esize);
   }
 
@@ -498,8 +498,8 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
     struct karatsuba_ctx karactx;
     mpi_ptr_t tp;
 
-    xp_nlimbs = msec ? size : 0;
-    xp = xp_marker = mpi_alloc_limb_space(size, msec);
+    xp_nlimbs = size;
+    xp = xp_marker = _gcry_mpi_scratch_alloc(size, msec);
 
     memset(&karactx, 0, sizeof karactx);
     negative_result = (ep[0] & 1) && bsign;
@@ -507,7 +507,7 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
     /* Precompute PRECOMP[], BASE^(2 * i + 1), BASE^1, ^3, ^5, ... */
     if (W > 1) /* X := BASE^2 */
       mul_mod(xp, &xsize, bp, bsize, bp, bsize, mp, msize, &karactx);
-    base_u = precomp[0] = mpi_alloc_limb_space(bsize, esec);
+    base_u = precomp[0] = _gcry_mpi_scratch_alloc(bsize, esec);
     base_u_size = max_u_size = precomp_size[0] = bsize;
     MPN_COPY(precomp[0], bp, bsize);
     for (i = 1; i < (1 << (W - 1)); i++) { /* PRECOMP[i] = BASE^(2 * i + 1) */
@@ -517,14 +517,14 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
       else
         mul_mod(rp, &rsize, base_u, base_u_size, xp, xsize, mp, msize,
                 &karactx);
-      base_u = precomp[i] = mpi_alloc_limb_space(rsize, esec);
+      base_u = precomp[i] = _gcry_mpi_scratch_alloc(rsize, esec);
       base_u_size = precomp_size[i] = rsize;
       if (max_u_size < base_u_size) max_u_size = base_u_size;
       MPN_COPY(precomp[i], rp, rsize);
     }
 
     if (msize > max_u_size) max_u_size = msize;
-    base_u = mpi_alloc_limb_space(max_u_size, esec);
+    base_u = _gcry_mpi_scratch_alloc(max_u_size, esec);
     MPN_ZERO(base_u, max_u_size);
 
     i = esize - 1;
@@ -666,8 +666,8 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
 
     _gcry_mpih_release_karatsuba_ctx(&karactx);
     for (i = 0; i < (1 << (W - 1)); i++)
-      _gcry_mpi_free_limb_space(precomp[i], esec ? precomp_size[i] : 0);
-    _gcry_mpi_free_limb_space(base_u, esec ? max_u_size : 0);
+      _gcry_mpi_scratch_free(precomp[i], precomp_size[i], esec);
+    _gcry_mpi_scratch_free(base_u, max_u_size, esec);
   }
 
   /* Fixup for negative results.  */
@@ -683,9 +683,287 @@ void _gcry_mpi_powm(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
   res->sign = rsign;
 
 leave:
-  if (mp_marker) _gcry_mpi_free_limb_space(mp_marker, mp_nlimbs);
-  if (bp_marker) _gcry_mpi_free_limb_space(bp_marker, bp_nlimbs);
-  if (ep_marker) _gcry_mpi_free_limb_space(ep_marker, ep_nlimbs);
-  if (xp_marker) _gcry_mpi_free_limb_space(xp_marker, xp_nlimbs);
+  if (mp_marker) _gcry_mpi_scratch_free(mp_marker, mp_nlimbs, msec);
+  if (bp_marker) _gcry_mpi_scratch_free(bp_marker, bp_nlimbs, bsec);
+  if (ep_marker) _gcry_mpi_scratch_free(ep_marker, ep_nlimbs, esec);
+  if (xp_marker) _gcry_mpi_scratch_free(xp_marker, xp_nlimbs, msec);
 }
 #endif
+
+/* Context for Montgomery multiplication modulo an odd M.  It only
+   holds constants and may thus be shared by several threads.  */
+struct mont_ctx_s {
+  mpi_size_t n;    /* The number of limbs of M.  */
+  int secure;      /* True if M is in secure memory.  */
+  mpi_ptr_t mp;    /* M.  */
+  mpi_ptr_t rr;    /* R^2 mod M with R = 2^(N * BITS_PER_MPI_LIMB).  */
+  mpi_limb_t minv; /* -M^(-1) mod 2^BITS_PER_MPI_LIMB.  */
+};
+
+/* Return a new context for exponentiation modulo M using Montgomery
+   multiplication, or NULL if M is not odd and positive.  M may be
+   changed afterwards.  The context needs to be released using
+   _gcry_mpi_mont_free.  */
+mpi_mont_t _gcry_mpi_mont_init(gcry_mpi_t m) {
+  mpi_mont_t ctx;
+  gcry_mpi_t tmp;
+  mpi_limb_t inv;
+  mpi_size_t n;
+  int i;
+
+  mpi_normalize(m);
+  n = m->nlimbs;
+  if (!n || m->sign || !(m->d[0] & 1)) return NULL;
+
+  ctx = (mpi_mont_t)xcalloc(1, sizeof *ctx);
+  ctx->n = n;
+  ctx->secure = mpi_is_secure(m);
+  ctx->mp = mpi_alloc_limb_space(n, ctx->secure);
+  MPN_COPY(ctx->mp, m->d, n);
+
+  /* Newton iteration for the inverse; each step doubles the number of
+     correct low bits, starting with 3 because M*M = 1 (mod 8).  */
+  inv = m->d[0];
+  for (i = 3; i < BITS_PER_MPI_LIMB; i *= 2) inv *= 2 - m->d[0] * inv;
+  ctx->minv = 0 - inv;
+
+  tmp = ctx->secure ? mpi_alloc_secure(2 * n + 1) : mpi_alloc(2 * n + 1);
+  mpi_set_ui(tmp, 1);
+  mpi_lshift_limbs(tmp, 2 * n);
+  mpi_fdiv_r(tmp, tmp, m);
+  ctx->rr = mpi_alloc_limb_space(n, ctx->secure);
+  MPN_ZERO(ctx->rr, n);
+  MPN_COPY(ctx->rr, tmp->d, tmp->nlimbs);
+  mpi_free(tmp);
+
+  return ctx;
+}
+
+void _gcry_mpi_mont_free(mpi_mont_t ctx) {
+  if (ctx) {
+    _gcry_mpi_free_limb_space(ctx->mp, ctx->secure ? ctx->n : 0);
+    _gcry_mpi_free_limb_space(ctx->rr, ctx->secure ? ctx->n : 0);
+    xfree(ctx);
+  }
+}
+
+/* RP = AP * BP / R mod M, where AP and BP have N limbs and are below
+   M.  TP is scratch space of 2N limbs.  The running time does not
+   depend on the values.  */
+static void mont_mul(mpi_ptr_t rp, mpi_ptr_t ap, mpi_ptr_t bp,
+                     mpi_mont_t ctx, mpi_ptr_t tp,
+                     struct karatsuba_ctx *karactx) {
+  mpi_size_t n = ctx->n;
+  mpi_size_t i;
+  mpi_limb_t cy, hc, x, borrow, mask;
+
+  if (n < MPIH_KARATSUBA_THRESHOLD)
+    _gcry_mpih_mul(tp, ap, n, bp, n);
+  else
+    _gcry_mpih_mul_karatsuba_case(tp, ap, n, bp, n, karactx);
+
+  /* Clear the low limbs one by one by adding multiples of M.  HC is
+     the carry out of the top limb reached so far.  */
+  hc = 0;
+  for (i = 0; i < n; i++) {
+    cy = _gcry_mpih_addmul_1(tp + i, ctx->mp, n, tp[i] * ctx->minv);
+    x = tp[i + n] + cy;
+    cy = x < cy;
+    tp[i + n] = x + hc;
+    hc = cy + (tp[i + n] < hc);
+  }
+
+  /* The result HC:TP[N..2N-1] is below 2M.  Subtract M unless that
+     would borrow from a zero HC.  */
+  borrow = _gcry_mpih_sub_n(rp, tp + n, ctx->mp, n);
+  mask = 0 - (mpi_limb_t)(borrow > hc);
+  for (i = 0; i < n; i++) rp[i] ^= (rp[i] ^ tp[n + i]) & mask;
+}
+
+/****************
+ * RES = BASE ^ EXPO mod M, with CTX describing M.
+ *
+ * This is a fixed window exponentiation using Montgomery
+ * multiplication.  As in _gcry_mpi_powm, squaring is done with the
+ * multiplication routine, and the window table is read completely for
+ * every window, so that neither the memory access pattern nor the
+ * sequence of operations depend on EXPO.
+ */
+void _gcry_mpi_powm_mont(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
+                         mpi_mont_t ctx) {
+  mpi_size_t n = ctx->n;
+  mpi_size_t i, j, k, bsize;
+  unsigned int nbits, nwin, w, nentries, digit;
+  int sec, negative_result;
+  mpi_ptr_t space, table, tp, ap, sp, one, bp;
+  unsigned int nspace;
+  struct karatsuba_ctx karactx;
+  gcry_mpi_t b = NULL;
+  mpi_limb_t mask;
+
+  nbits = mpi_get_nbits(expo);
+  if (nbits > 512)
+    w = 5;
+  else if (nbits > 128)
+    w = 4;
+  else
+    w = 1;
+  nentries = 1 << w;
+  nwin = (nbits + w - 1) / w;
+
+  sec = ctx->secure || mpi_is_secure(base) || mpi_is_secure(expo);
+  negative_result = base->sign && mpi_test_bit(expo, 0);
+
+  /* Montgomery multiplication only needs the product of its inputs to
+     be below R * M, thus BASE needs to be reduced only if it has more
+     limbs than M.  */
+  bp = base->d;
+  bsize = base->nlimbs;
+  if (bsize > n) {
+    struct gcry_mpi m;
+
+    m.alloced = m.nlimbs = n;
+    m.sign = m.flags = 0;
+    m.d = ctx->mp;
+    b = sec ? mpi_alloc_secure(n) : mpi_alloc(n);
+    mpi_tdiv_r(b, base, &m);
+    bp = b->d;
+    bsize = b->nlimbs;
+  }
+
+  /* The window table, a product, the accumulator, the selected table
+     entry and the constant 1.  */
+  nspace = (nentries + 5) * n;
+  space = _gcry_mpi_scratch_alloc(nspace, sec);
+  table = space;
+  tp = table + nentries * n;
+  ap = tp + 2 * n;
+  sp = ap + n;
+  one = sp + n;
+  memset(&karactx, 0, sizeof karactx);
+
+  MPN_ZERO(one, n);
+  one[0] = 1;
+  MPN_ZERO(sp, n);
+  MPN_COPY(sp, bp, bsize);
+
+  /* TABLE[K] = BASE^K * R mod M.  */
+  mont_mul(table, one, ctx->rr, ctx, tp, &karactx);
+  mont_mul(table + n, sp, ctx->rr, ctx, tp, &karactx);
+  for (k = 2; k < nentries; k++)
+    mont_mul(table + k * n, table + (k - 1) * n, table + n, ctx, tp,
+             &karactx);
+
+  MPN_COPY(ap, table, n);
+  for (i = nwin; i-- > 0;) {
+    if (i != nwin - 1)
+      for (j = 0; j < w; j++) mont_mul(ap, ap, ap, ctx, tp, &karactx);
+
+    for (digit = 0, j = 0; j < w; j++)
+      digit |= mpi_test_bit(expo, i * w + j) << j;
+
+    for (k = 0; k < nentries; k++) {
+      mask = 0 - (mpi_limb_t)(k == digit);
+      for (j = 0; j < n; j++) sp[j] ^= (sp[j] ^ table[k * n + j]) & mask;
+    }
+    mont_mul(ap, ap, sp, ctx, tp, &karactx);
+  }
+
+  /* Convert back from the Montgomery representation.  */
+  mont_mul(ap, ap, one, ctx, tp, &karactx);
+
+  i = n;
+  MPN_NORMALIZE(ap, i);
+  if (negative_result && i) _gcry_mpih_sub_n(ap, ctx->mp, ap, n);
+
+  RESIZE_IF_NEEDED(res, n);
+  MPN_COPY(res->d, ap, n);
+  res->nlimbs = n;
+  res->sign = 0;
+  MPN_NORMALIZE(res->d, res->nlimbs);
+
+  _gcry_mpih_release_karatsuba_ctx(&karactx);
+  _gcry_mpi_scratch_free(space, nspace, sec);
+  mpi_free(b);
+}
+
+/****************
+ * RES = BASE ^ EXPO mod M, with CTX describing M, for a public EXPO.
+ *
+ * This is a plain left-to-right square-and-multiply without a window
+ * table, thus the common exponent 65537 takes 16 squarings and a
+ * single multiplication.  The running time depends on EXPO, so this
+ * must not be used with secret exponents.
+ */
+void _gcry_mpi_powm_mont_pub(gcry_mpi_t res, gcry_mpi_t base, gcry_mpi_t expo,
+                             mpi_mont_t ctx) {
+  mpi_size_t n = ctx->n;
+  mpi_size_t i, bsize;
+  unsigned int nbits;
+  int sec, negative_result;
+  mpi_ptr_t space, tp, ap, sp, one, bp;
+  unsigned int nspace;
+  struct karatsuba_ctx karactx;
+  gcry_mpi_t b = NULL;
+
+  nbits = mpi_get_nbits(expo);
+  sec = ctx->secure || mpi_is_secure(base);
+  negative_result = base->sign && mpi_test_bit(expo, 0);
+
+  /* See _gcry_mpi_powm_mont.  */
+  bp = base->d;
+  bsize = base->nlimbs;
+  if (bsize > n) {
+    struct gcry_mpi m;
+
+    m.alloced = m.nlimbs = n;
+    m.sign = m.flags = 0;
+    m.d = ctx->mp;
+    b = sec ? mpi_alloc_secure(n) : mpi_alloc(n);
+    mpi_tdiv_r(b, base, &m);
+    bp = b->d;
+    bsize = b->nlimbs;
+  }
+
+  /* A product, the accumulator, the base and the constant 1.  */
+  nspace = 5 * n;
+  space = _gcry_mpi_scratch_alloc(nspace, sec);
+  tp = space;
+  ap = tp + 2 * n;
+  sp = ap + n;
+  one = sp + n;
+  memset(&karactx, 0, sizeof karactx);
+
+  MPN_ZERO(one, n);
+  one[0] = 1;
+  MPN_ZERO(sp, n);
+  MPN_COPY(sp, bp, bsize);
+
+  /* SP = BASE * R mod M, and AP starts with the top bit of EXPO.  */
+  mont_mul(sp, sp, ctx->rr, ctx, tp, &karactx);
+  if (nbits)
+    MPN_COPY(ap, sp, n);
+  else
+    mont_mul(ap, one, ctx->rr, ctx, tp, &karactx);
+  for (i = (mpi_size_t)nbits - 1; i-- > 0;) {
+    mont_mul(ap, ap, ap, ctx, tp, &karactx);
+    if (mpi_test_bit(expo, i)) mont_mul(ap, ap, sp, ctx, tp, &karactx);
+  }
+
+  /* Convert back from the Montgomery representation.  */
+  mont_mul(ap, ap, one, ctx, tp, &karactx);
+
+  i = n;
+  MPN_NORMALIZE(ap, i);
+  if (negative_result && i) _gcry_mpih_sub_n(ap, ctx->mp, ap, n);
+
+  RESIZE_IF_NEEDED(res, n);
+  MPN_COPY(res->d, ap, n);
+  res->nlimbs = n;
+  res->sign = 0;
+  MPN_NORMALIZE(res->d, res->nlimbs);
+
+  _gcry_mpih_release_karatsuba_ctx(&karactx);
+  _gcry_mpi_scratch_free(space, nspace, sec);
+  mpi_free(b);
+}
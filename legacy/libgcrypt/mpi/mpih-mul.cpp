@@ -35,7 +35,7 @@
 
 #define MPN_MUL_N_RECURSE(prodp, up, vp, size, tspace) \
   do {                                                 \
-    if ((size) < KARATSUBA_THRESHOLD)                  \
+    if ((size) < MPIH_KARATSUBA_THRESHOLD)             \
       mul_n_basecase(prodp, up, vp, size);             \
     else                                               \
       mul_n(prodp, up, vp, size, tspace);              \
@@ -43,7 +43,7 @@
 
 #define MPN_SQR_N_RECURSE(prodp, up, size, tspace) \
   do {                                             \
-    if ((size) < KARATSUBA_THRESHOLD)              \
+    if ((size) < MPIH_KARATSUBA_THRESHOLD)         \
       _gcry_mpih_sqr_n_basecase(prodp, up, size);  \
     else                                           \
       _gcry_mpih_sqr_n(prodp, up, size, tspace);   \
@@ -319,24 +319,24 @@ void _gcry_mpih_mul_n(mpi_ptr_t prodp, mpi_ptr_t up, mpi_ptr_t vp,
   int secure;
 
   if (up == vp) {
-    if (size < KARATSUBA_THRESHOLD)
+    if (size < MPIH_KARATSUBA_THRESHOLD)
       _gcry_mpih_sqr_n_basecase(prodp, up, size);
     else {
       mpi_ptr_t tspace;
       secure = _gcry_is_secure(up);
-      tspace = mpi_alloc_limb_space(2 * size, secure);
+      tspace = _gcry_mpi_scratch_alloc(2 * size, secure);
       _gcry_mpih_sqr_n(prodp, up, size, tspace);
-      _gcry_mpi_free_limb_space(tspace, 2 * size);
+      _gcry_mpi_scratch_free(tspace, 2 * size, secure);
     }
   } else {
-    if (size < KARATSUBA_THRESHOLD)
+    if (size < MPIH_KARATSUBA_THRESHOLD)
       mul_n_basecase(prodp, up, vp, size);
     else {
       mpi_ptr_t tspace;
       secure = _gcry_is_secure(up) || _gcry_is_secure(vp);
-      tspace = mpi_alloc_limb_space(2 * size, secure);
+      tspace = _gcry_mpi_scratch_alloc(2 * size, secure);
       mul_n(prodp, up, vp, size, tspace);
-      _gcry_mpi_free_limb_space(tspace, 2 * size);
+      _gcry_mpi_scratch_free(tspace, 2 * size, secure);
     }
   }
 }
@@ -348,10 +348,12 @@ void _gcry_mpih_mul_karatsuba_case(mpi_ptr_t prodp, mpi_ptr_t up,
   mpi_limb_t cy;
 
   if (!ctx->tspace || ctx->tspace_size < vsize) {
-    if (ctx->tspace) _gcry_mpi_free_limb_space(ctx->tspace, ctx->tspace_nlimbs);
+    if (ctx->tspace)
+      _gcry_mpi_scratch_free(ctx->tspace, ctx->tspace_nlimbs,
+                             ctx->tspace_secure);
     ctx->tspace_nlimbs = 2 * vsize;
-    ctx->tspace = mpi_alloc_limb_space(
-        2 * vsize, (_gcry_is_secure(up) || _gcry_is_secure(vp)));
+    ctx->tspace_secure = _gcry_is_secure(up) || _gcry_is_secure(vp);
+    ctx->tspace = _gcry_mpi_scratch_alloc(2 * vsize, ctx->tspace_secure);
     ctx->tspace_size = vsize;
   }
 
@@ -362,10 +364,11 @@ void _gcry_mpih_mul_karatsuba_case(mpi_ptr_t prodp, mpi_ptr_t up,
   usize -= vsize;
   if (usize >= vsize) {
     if (!ctx->tp || ctx->tp_size < vsize) {
-      if (ctx->tp) _gcry_mpi_free_limb_space(ctx->tp, ctx->tp_nlimbs);
+      if (ctx->tp)
+        _gcry_mpi_scratch_free(ctx->tp, ctx->tp_nlimbs, ctx->tp_secure);
       ctx->tp_nlimbs = 2 * vsize;
-      ctx->tp = mpi_alloc_limb_space(
-          2 * vsize, (_gcry_is_secure(up) || _gcry_is_secure(vp)));
+      ctx->tp_secure = _gcry_is_secure(up) || _gcry_is_secure(vp);
+      ctx->tp = _gcry_mpi_scratch_alloc(2 * vsize, ctx->tp_secure);
       ctx->tp_size = vsize;
     }
 
@@ -380,7 +383,7 @@ void _gcry_mpih_mul_karatsuba_case(mpi_ptr_t prodp, mpi_ptr_t up,
   }
 
   if (usize) {
-    if (usize < KARATSUBA_THRESHOLD) {
+    if (usize < MPIH_KARATSUBA_THRESHOLD) {
       _gcry_mpih_mul(ctx->tspace, vp, vsize, up, usize);
     } else {
       if (!ctx->next) {
@@ -398,12 +401,16 @@ void _gcry_mpih_mul_karatsuba_case(mpi_ptr_t prodp, mpi_ptr_t up,
 void _gcry_mpih_release_karatsuba_ctx(struct karatsuba_ctx *ctx) {
   struct karatsuba_ctx *ctx2;
 
-  if (ctx->tp) _gcry_mpi_free_limb_space(ctx->tp, ctx->tp_nlimbs);
-  if (ctx->tspace) _gcry_mpi_free_limb_space(ctx->tspace, ctx->tspace_nlimbs);
+  if (ctx->tp) _gcry_mpi_scratch_free(ctx->tp, ctx->tp_nlimbs, ctx->tp_secure);
+  if (ctx->tspace)
+    _gcry_mpi_scratch_free(ctx->tspace, ctx->tspace_nlimbs, ctx->tspace_secure);
   for (ctx = ctx->next; ctx; ctx = ctx2) {
     ctx2 = ctx->next;
-    if (ctx->tp) _gcry_mpi_free_limb_space(ctx->tp, ctx->tp_nlimbs);
-    if (ctx->tspace) _gcry_mpi_free_limb_space(ctx->tspace, ctx->tspace_nlimbs);
+    if (ctx->tp)
+      _gcry_mpi_scratch_free(ctx->tp, ctx->tp_nlimbs, ctx->tp_secure);
+    if (ctx->tspace)
+      _gcry_mpi_scratch_free(ctx->tspace, ctx->tspace_nlimbs,
+                             ctx->tspace_secure);
     xfree(ctx);
   }
 }
@@ -429,7 +436,7 @@ mpi_limb_t _gcry_mpih_mul(mpi_ptr_t prodp, mpi_ptr_t up, mpi_size_t usize,
   mpi_limb_t cy;
   struct karatsuba_ctx ctx;
 
-  if (vsize < KARATSUBA_THRESHOLD) {
+  if (vsize < MPIH_KARATSUBA_THRESHOLD) {
     mpi_size_t i;
     mpi_limb_t v_limb;
 
@@ -124,6 +124,96 @@ void _gcry_mpi_free_limb_space(mpi_ptr_t a, unsigned int nlimbs) {
   }
 }
 
+/* Limb space for temporaries that do not outlive an operation is
+   taken with _gcry_mpi_scratch_alloc and given back, wiped, with
+   _gcry_mpi_scratch_free.  Blocks in standard memory are kept in a
+   cache of the thread, one free list per power of two size, so that
+   the next operation of a similar size does not go to the allocator.
+   Secure memory is not cached here, as secmem.cpp has its own thread
+   cache, which must also outlive this one.  */
+#define MPI_SCRATCH_MIN_LIMBS 8
+#define MPI_SCRATCH_CLASSES 10 /* Up to 4096 limbs.  */
+#define MPI_SCRATCH_DEPTH 4
+
+struct mpi_scratch_block {
+  struct mpi_scratch_block *next;
+};
+
+struct mpi_scratch_cache {
+  struct mpi_scratch_block *head[MPI_SCRATCH_CLASSES] = {};
+  unsigned int count[MPI_SCRATCH_CLASSES] = {};
+  /* Set once the thread exits.  */
+  bool gone = false;
+
+  ~mpi_scratch_cache();
+};
+
+static thread_local struct mpi_scratch_cache mpi_scratch_cache;
+
+mpi_scratch_cache::~mpi_scratch_cache() {
+  struct mpi_scratch_block *block;
+  int c;
+
+  gone = true;
+  for (c = 0; c < MPI_SCRATCH_CLASSES; c++)
+    while ((block = head[c])) {
+      head[c] = block->next;
+      xfree(block);
+    }
+}
+
+/* Return the size class for NLIMBS limbs, or -1 if there is none.  */
+static int scratch_class(unsigned int nlimbs) {
+  unsigned int size = MPI_SCRATCH_MIN_LIMBS;
+  int c = 0;
+
+  while (size < nlimbs && c < MPI_SCRATCH_CLASSES) {
+    size <<= 1;
+    c++;
+  }
+  return c < MPI_SCRATCH_CLASSES ? c : -1;
+}
+
+/* Allocate NLIMBS limbs of scratch space, in secure memory if SECURE
+   is set.  The space must be released with _gcry_mpi_scratch_free
+   and the same NLIMBS and SECURE.  */
+mpi_ptr_t _gcry_mpi_scratch_alloc(unsigned int nlimbs, int secure) {
+  struct mpi_scratch_cache *cache = &mpi_scratch_cache;
+  struct mpi_scratch_block *block;
+  int c = scratch_class(nlimbs);
+
+  if (secure || c < 0 || cache->gone)
+    return mpi_alloc_limb_space(nlimbs, secure);
+
+  block = cache->head[c];
+  if (block) {
+    cache->head[c] = block->next;
+    cache->count[c]--;
+    return (mpi_ptr_t)block;
+  }
+  return mpi_alloc_limb_space(MPI_SCRATCH_MIN_LIMBS << c, 0);
+}
+
+/* Wipe and release the scratch space A of NLIMBS limbs.  */
+void _gcry_mpi_scratch_free(mpi_ptr_t a, unsigned int nlimbs, int secure) {
+  struct mpi_scratch_cache *cache = &mpi_scratch_cache;
+  struct mpi_scratch_block *block;
+  int c = scratch_class(nlimbs);
+
+  if (!a) return;
+  if (secure || c < 0 || cache->gone ||
+      cache->count[c] >= MPI_SCRATCH_DEPTH) {
+    _gcry_mpi_free_limb_space(a, nlimbs);
+    return;
+  }
+
+  wipememory(a, nlimbs * sizeof(mpi_limb_t));
+  block = (struct mpi_scratch_block *)(void *)a;
+  block->next = cache->head[c];
+  cache->head[c] = block;
+  cache->count[c]++;
+}
+
 void _gcry_mpi_assign_limb_space(gcry_mpi_t a, mpi_ptr_t ap,
                                  unsigned int nlimbs) {
   _gcry_mpi_free_limb_space(a->d, a->alloced);
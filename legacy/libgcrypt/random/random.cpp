@@ -32,7 +32,7 @@
 
 /* Add BUFLEN bytes from BUF to the internal random pool.  */
 gpg_error_t _gcry_random_add_bytes(const void *buf, size_t buflen) {
-  NeoPG::rng()->add_entropy((Botan::byte *)buf, buflen);
+  NeoPG::add_entropy((const uint8_t *)buf, buflen);
   return 0;
 }
 
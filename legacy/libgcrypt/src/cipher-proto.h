@@ -188,6 +188,9 @@ typedef void (*gcry_md_write_t)(void *c, const void *buf, size_t nbytes);
 /* Type for the md_final function.  */
 typedef void (*gcry_md_final_t)(void *c);
 
+/* Type for the md_final_multi function.  */
+typedef void (*gcry_md_final_multi_t)(void **c, size_t n);
+
 /* Type for the md_read function.  */
 typedef unsigned char *(*gcry_md_read_t)(void *c);
 
@@ -215,6 +218,7 @@ typedef struct gcry_md_spec {
   gcry_md_extract_t extract;
   size_t contextsize; /* allocate this amount of context */
   selftest_func_t selftest;
+  gcry_md_final_multi_t final_multi; /* Finalize several contexts.  */
 } gcry_md_spec_t;
 
 #endif /*G10_CIPHER_PROTO_H*/
@@ -61,10 +61,9 @@ struct mpi_ec_ctx_s {
     /* Scratch variables.  */
     gcry_mpi_t scratch[11];
 
-    /* Helper for fast reduction.  */
-    /*   int nist_nbits; /\* If this is a NIST curve, the # of bits.  *\/ */
-    /*   gcry_mpi_t s[10]; */
-    /*   gcry_mpi_t c; */
+    /* Dedicated reduction for the field of this curve or NULL.  It
+       maps 16 words of input to 8 words of output; see ec-internal.h.  */
+    void (*fast_reduce)(u32 *r, const u32 *a);
   } t;
 };
 
@@ -85,6 +85,7 @@ gpg_error_t _gcry_pk_sign(gcry_sexp_t *result, gcry_sexp_t data,
                           gcry_sexp_t skey);
 gpg_error_t _gcry_pk_verify(gcry_sexp_t sigval, gcry_sexp_t data,
                             gcry_sexp_t pkey);
+gpg_error_t _gcry_pk_verify_batch(gcry_pk_verify_job_t *jobs, size_t njobs);
 gpg_error_t _gcry_pk_testkey(gcry_sexp_t key);
 gpg_error_t _gcry_pk_genkey(gcry_sexp_t *r_key, gcry_sexp_t s_parms);
 gpg_error_t _gcry_pk_ctl(int cmd, void *buffer, size_t buflen);
@@ -104,6 +105,7 @@ gpg_error_t _gcry_md_open(gcry_md_hd_t *h, int algo, unsigned int flags);
 void _gcry_md_close(gcry_md_hd_t hd);
 gpg_error_t _gcry_md_enable(gcry_md_hd_t hd, int algo);
 gpg_error_t _gcry_md_copy(gcry_md_hd_t *bhd, gcry_md_hd_t ahd);
+gpg_error_t _gcry_md_copy_state(gcry_md_hd_t dst, gcry_md_hd_t src);
 void _gcry_md_reset(gcry_md_hd_t hd);
 gpg_error_t _gcry_md_ctl(gcry_md_hd_t hd, int cmd, void *buffer, size_t buflen);
 void _gcry_md_write(gcry_md_hd_t hd, const void *buffer, size_t length);
@@ -114,6 +116,7 @@ void _gcry_md_hash_buffer(int algo, void *digest, const void *buffer,
                           size_t length);
 gpg_error_t _gcry_md_hash_buffers(int algo, unsigned int flags, void *digest,
                                   const gcry_buffer_t *iov, int iovcnt);
+void _gcry_md_final_batch(gcry_md_hd_t *hds, size_t n);
 int _gcry_md_get_algo(gcry_md_hd_t hd);
 unsigned int _gcry_md_get_algo_dlen(int algo);
 int _gcry_md_is_enabled(gcry_md_hd_t a, int algo);
@@ -926,6 +926,20 @@ gpg_error_t gcry_pk_sign(gcry_sexp_t *result, gcry_sexp_t data,
 gpg_error_t gcry_pk_verify(gcry_sexp_t sigval, gcry_sexp_t data,
                            gcry_sexp_t pkey);
 
+/* One signature check of a batch for gcry_pk_verify_batch.  The
+   fields are the arguments of gcry_pk_verify, and ERR receives its
+   result.  */
+typedef struct gcry_pk_verify_job {
+  gcry_sexp_t sigval;
+  gcry_sexp_t data;
+  gcry_sexp_t pkey;
+  gpg_error_t err;
+} gcry_pk_verify_job_t;
+
+/* Check the signatures of the NJOBS jobs at JOBS in the calling
+   thread.  Returns the error of the first failed job.  */
+gpg_error_t gcry_pk_verify_batch(gcry_pk_verify_job_t *jobs, size_t njobs);
+
 /* Check that private KEY is sane. */
 gpg_error_t gcry_pk_testkey(gcry_sexp_t key);
 
@@ -1058,6 +1072,10 @@ gpg_error_t gcry_md_enable(gcry_md_hd_t hd, int algo);
 /* Create a new digest object as an exact copy of the object HD.  */
 gpg_error_t gcry_md_copy(gcry_md_hd_t *bhd, gcry_md_hd_t ahd);
 
+/* Copy the state of the digest object SRC into the digest object DST,
+   which must have the same flags and algorithms.  */
+gpg_error_t gcry_md_copy_state(gcry_md_hd_t dst, gcry_md_hd_t src);
+
 /* Reset the digest object HD to its initial state.  */
 void gcry_md_reset(gcry_md_hd_t hd);
 
@@ -1090,6 +1108,11 @@ void gcry_md_hash_buffer(int algo, void *digest, const void *buffer,
 gpg_error_t gcry_md_hash_buffers(int algo, unsigned int flags, void *digest,
                                  const gcry_buffer_t *iov, int iovcnt);
 
+/* Finalize the N message digest handles at HDS, like gcry_md_final
+   does for each of them.  SHA-1 and SHA-256 handles are finalized
+   several at a time, so this is faster for many short messages.  */
+void gcry_md_final_batch(gcry_md_hd_t *hds, size_t n);
+
 /* Retrieve the algorithm used with HD.  This does not work reliable
    if more than one algorithm is enabled in HD. */
 int gcry_md_get_algo(gcry_md_hd_t hd);
@@ -1297,6 +1320,25 @@ gpg_error_t gcry_kdf_derive(const void *passphrase, size_t passphraselen,
                             size_t saltlen, unsigned long iterations,
                             size_t keysize, void *keybuffer);
 
+/* One key derivation of a batch for gcry_kdf_derive_batch.  The fields
+   are the arguments of gcry_kdf_derive, and ERR receives its
+   result.  */
+typedef struct gcry_kdf_job {
+  const void *passphrase;
+  size_t passphraselen;
+  const void *salt;
+  size_t saltlen;
+  unsigned long iterations;
+  size_t keysize;
+  void *keybuffer;
+  gpg_error_t err;
+} gcry_kdf_job_t;
+
+/* Derive the keys of the NJOBS jobs at JOBS with ALGO and SUBALGO, on
+   several threads.  Returns the error of the first failed job.  */
+gpg_error_t gcry_kdf_derive_batch(int algo, int subalgo, gcry_kdf_job_t *jobs,
+                                  size_t njobs);
+
 /************************************
  *                                  *
  *   Random Generating Functions    *
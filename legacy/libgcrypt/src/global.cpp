@@ -71,6 +71,7 @@ static void global_init(void) {
   if (err) goto fail;
   err = _gcry_mpi_init();
   if (err) goto fail;
+  _gcry_detect_hw_features();
 
   return;
 
@@ -168,6 +169,16 @@ static void print_config(const char *what, gpgrt_stream_t fp) {
 
   if (!what || !strcmp(what, "mpi-asm"))
     gpgrt_fprintf(fp, "mpi-asm:%s:\n", _gcry_mpi_get_hw_config());
+
+  if (!what || !strcmp(what, "hwflist")) {
+    unsigned int hwfeatures, afeature;
+
+    hwfeatures = _gcry_get_hw_features();
+    gpgrt_fprintf(fp, "hwflist:");
+    for (i = 0; (s = _gcry_enum_hw_features(i, &afeature)); i++)
+      if ((hwfeatures & afeature)) gpgrt_fprintf(fp, "%s:", s);
+    gpgrt_fprintf(fp, "\n");
+  }
 }
 
 /* Command dispatcher function, acting as general control
@@ -279,6 +290,11 @@ gpg_error_t _gcry_vcontrol(enum gcry_ctl_cmds cmd, va_list arg_ptr) {
           (_gcry_secmem_get_flags() | GCRY_SECMEM_FLAG_NO_PRIV_DROP));
       break;
 
+    case GCRYCTL_DISABLE_HWF: {
+      const char *name = va_arg(arg_ptr, const char *);
+      rc = _gcry_disable_hw_feature(name);
+    } break;
+
     default:
       rc = GPG_ERR_INV_OP;
   }
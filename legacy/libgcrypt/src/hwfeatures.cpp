@@ -0,0 +1,133 @@
+/* hwfeatures.c - Detect hardware features.
+ * Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of Libgcrypt.
+ *
+ * Libgcrypt is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * Libgcrypt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "g10lib.h"
+
+#include <neopg/crypto/cpu.h>
+
+/* The names of the features, as used by GCRYCTL_DISABLE_HWF.  */
+static struct {
+  unsigned int flag;
+  const char *desc;
+} hwflist[] = {{HWF_PADLOCK_RNG, "padlock-rng"},
+               {HWF_PADLOCK_AES, "padlock-aes"},
+               {HWF_PADLOCK_SHA, "padlock-sha"},
+               {HWF_PADLOCK_MMUL, "padlock-mmul"},
+               {HWF_INTEL_CPU, "intel-cpu"},
+               {HWF_INTEL_FAST_SHLD, "intel-fast-shld"},
+               {HWF_INTEL_BMI2, "intel-bmi2"},
+               {HWF_INTEL_SSSE3, "intel-ssse3"},
+               {HWF_INTEL_SSE4_1, "intel-sse4.1"},
+               {HWF_INTEL_PCLMUL, "intel-pclmul"},
+               {HWF_INTEL_AESNI, "intel-aesni"},
+               {HWF_INTEL_RDRAND, "intel-rdrand"},
+               {HWF_INTEL_AVX, "intel-avx"},
+               {HWF_INTEL_AVX2, "intel-avx2"},
+               {HWF_INTEL_FAST_VPGATHER, "intel-fast-vpgather"},
+               {HWF_INTEL_RDTSC, "intel-rdtsc"},
+               {HWF_INTEL_SHAEXT, "intel-shaext"},
+               {HWF_INTEL_VAES, "intel-vaes"},
+               {HWF_INTEL_AVX512, "intel-avx512"},
+               {HWF_ARM_NEON, "arm-neon"},
+               {HWF_ARM_AES, "arm-aes"},
+               {HWF_ARM_SHA1, "arm-sha1"},
+               {HWF_ARM_SHA2, "arm-sha2"},
+               {HWF_ARM_PMULL, "arm-pmull"}};
+
+/* The features disabled with GCRYCTL_DISABLE_HWF.  This is only
+   changed during initialization, before any threads are started.  */
+static unsigned int disabled_hw_features;
+
+/* The detection is shared with NeoPG, so NEOPG_CPU_DISABLE applies to
+   both.  */
+static const struct {
+  NeoPG::CpuFeature feature;
+  unsigned int flag;
+} neopg_features[] = {{NeoPG::CpuFeature::BMI2, HWF_INTEL_BMI2},
+                      {NeoPG::CpuFeature::SSSE3, HWF_INTEL_SSSE3},
+                      {NeoPG::CpuFeature::SSE41, HWF_INTEL_SSE4_1},
+                      {NeoPG::CpuFeature::PCLMUL, HWF_INTEL_PCLMUL},
+                      {NeoPG::CpuFeature::AESNI, HWF_INTEL_AESNI},
+                      {NeoPG::CpuFeature::RDRAND, HWF_INTEL_RDRAND},
+                      {NeoPG::CpuFeature::AVX, HWF_INTEL_AVX},
+                      {NeoPG::CpuFeature::AVX2, HWF_INTEL_AVX2},
+                      {NeoPG::CpuFeature::SHA, HWF_INTEL_SHAEXT},
+                      {NeoPG::CpuFeature::VAES, HWF_INTEL_VAES},
+                      {NeoPG::CpuFeature::AVX512F, HWF_INTEL_AVX512},
+                      {NeoPG::CpuFeature::NEON, HWF_ARM_NEON},
+                      {NeoPG::CpuFeature::ARM_AES, HWF_ARM_AES},
+                      {NeoPG::CpuFeature::ARM_SHA1, HWF_ARM_SHA1},
+                      {NeoPG::CpuFeature::ARM_SHA2, HWF_ARM_SHA2},
+                      {NeoPG::CpuFeature::ARM_PMULL, HWF_ARM_PMULL}};
+
+static unsigned int detect_hw_features(void) {
+  NeoPG::CpuFeatures available = NeoPG::cpu_features();
+  unsigned int features = 0;
+  size_t i;
+
+  for (i = 0; i < DIM(neopg_features); i++)
+    if (available.contains(neopg_features[i].feature))
+      features |= neopg_features[i].flag;
+  return features;
+}
+
+/* Disable a feature by name.  This only affects the contexts set up
+   afterwards, so it should be called during initialization.  */
+gpg_error_t _gcry_disable_hw_feature(const char *name) {
+  size_t i;
+
+  if (!strcmp(name, "all")) {
+    disabled_hw_features = ~0;
+    return 0;
+  }
+
+  for (i = 0; i < DIM(hwflist); i++)
+    if (!strcmp(hwflist[i].desc, name)) {
+      disabled_hw_features |= hwflist[i].flag;
+      return 0;
+    }
+  return GPG_ERR_INV_NAME;
+}
+
+/* Return a bit vector describing the available hardware features.
+   The HWF_ constants are used to test for them.  The CPU is only
+   examined on the first call.  */
+unsigned int _gcry_get_hw_features(void) {
+  static const unsigned int hw_features = detect_hw_features();
+
+  return hw_features & ~disabled_hw_features;
+}
+
+/* Enumerate all features.  The caller is expected to start with an
+   IDX of 0 and then increment IDX until NULL is returned.  */
+const char *_gcry_enum_hw_features(int idx, unsigned int *r_feature) {
+  if (idx < 0 || (size_t)idx >= DIM(hwflist)) return NULL;
+  if (r_feature) *r_feature = hwflist[idx].flag;
+  return hwflist[idx].desc;
+}
+
+/* Detect the available hardware features.  This is done lazily by
+   _gcry_get_hw_features, so calling this early is only needed to
+   make sure that the detection does not happen later in a thread.  */
+void _gcry_detect_hw_features(void) { (void)_gcry_get_hw_features(); }
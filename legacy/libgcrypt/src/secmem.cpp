@@ -21,6 +21,7 @@
 
 #include <config.h>
 
+#include <atomic>
 #include <mutex>
 
 #include <errno.h>
@@ -51,16 +52,39 @@
 #define STANDARD_POOL_SIZE 32768
 #define DEFAULT_PAGE_SIZE 4096
 
+/* The maximum number of locked pools added when the main pool is
+   exhausted.  Each of them is twice the size of the previous one.  */
+#define MAX_GROWN_POOLS 8
+
 typedef struct memblock {
-  unsigned size; /* Size of the memory available to the
-                    user.  */
-  int flags;     /* See below.  */
+  unsigned size;      /* Size of the memory available to the
+                         user.  */
+  unsigned prev_size; /* Size of the preceding block, if any.  */
+  int flags;          /* See below.  */
   PROPERLY_ALIGNED_TYPE aligned;
 } memblock_t;
 
 /* This flag specifies that the memory block is in use.  */
 #define MB_FLAG_ACTIVE (1 << 0)
 
+/* A free block is kept in the free list of its size class.  The links
+   are stored in the memory of the block, which is why blocks are never
+   smaller than MB_MIN_SIZE.  */
+typedef struct mb_links {
+  struct memblock *next;
+  struct memblock *prev;
+} mb_links_t;
+
+#define MB_LINKS(mb) ((mb_links_t *)(void *)&(mb)->aligned)
+
+/* Block sizes are a multiple of MB_MIN_SIZE.  Sizes up to 32 steps of
+   that each have their own class, so that any block in such a list
+   fits a request of the class.  Larger sizes are grouped by powers of
+   two and need a first-fit search in their list.  */
+#define MB_MIN_SIZE 32
+#define MB_SMALL_CLASSES 32
+#define MB_CLASSES 64
+
 /* An object describing a memory pool.  */
 typedef struct pooldesc_s {
   /* A link to the next pool.  This is used to connect the overflow
@@ -80,9 +104,18 @@ typedef struct pooldesc_s {
   /* Flag indicating whether MEM is mmapped.  */
   volatile int is_mmapped;
 
+  /* Flag indicating an overflow pool, which is neither locked nor
+   * mmapped and only used for xmalloc style allocations.  */
+  int is_overflow;
+
   /* The number of allocated bytes and the number of used blocks in
    * this pool.  */
   unsigned int cur_alloced, cur_blocks;
+
+  /* The free blocks by size class, and a bit for each non-empty
+   * list.  */
+  memblock_t *free_list[MB_CLASSES];
+  uint64_t free_bits;
 } pooldesc_t;
 
 /* The pool of secure memory.  This is the head of a linked list with
@@ -99,9 +132,43 @@ static int suspend_warning;
 static int no_mlock;
 static int no_priv_drop;
 
+/* The locked pools added so far, and the size of the last one.  */
+static int grown_pools;
+static size_t grown_size;
+
 /* Lock protecting accesses to the memory pools.  */
 std::mutex secmem_lock;
 
+/* Freed blocks up to SECMEM_CACHE_CLASSES size classes are kept in a
+   cache of the thread, and allocations of these sizes are served from
+   there without taking SECMEM_LOCK.  The blocks are wiped before they
+   enter the cache and stay active in their pool, so that the cache
+   only needs to be limited to keep the other threads from running
+   out of secure memory.  */
+#define SECMEM_CACHE_CLASSES 16
+#define SECMEM_CACHE_BYTES 2048
+
+struct secmem_cache {
+  memblock_t *head[SECMEM_CACHE_CLASSES] = {};
+  size_t bytes = 0;
+  unsigned int generation = 0;
+
+  ~secmem_cache();
+};
+
+static thread_local struct secmem_cache secmem_cache;
+
+/* Incremented by _gcry_secmem_term, which invalidates the thread
+   caches.  Starts at 1, so that a fresh cache has to pick it up.  */
+static std::atomic<unsigned int> secmem_generation(1);
+
+/* Counters shown by _gcry_secmem_dump_stats.  The ones of the thread
+   caches are atomic, the others are protected by SECMEM_LOCK.  */
+static struct {
+  unsigned long allocs, frees, grow_failures;
+  std::atomic<unsigned long> cache_allocs, cache_frees;
+} secmem_stats;
+
 /* Convenient macros.  */
 #define SECMEM_LOCK secmem_lock.lock()
 #define SECMEM_UNLOCK secmem_lock.unlock()
@@ -152,72 +219,243 @@ static memblock_t *mb_get_next(pooldesc_t *pool, memblock_t *mb) {
 /* Return the block preceding MB or NULL, if MB is the first
    block.  */
 static memblock_t *mb_get_prev(pooldesc_t *pool, memblock_t *mb) {
-  memblock_t *mb_prev, *mb_next;
+  if (mb == pool->mem) return NULL;
+
+  return (memblock_t *)(void *)((char *)mb - BLOCK_HEAD_SIZE - mb->prev_size);
+}
 
-  if (mb == pool->mem)
-    mb_prev = NULL;
+/* Return the size class of blocks of SIZE bytes.  */
+static unsigned int mb_class(size_t size) {
+  unsigned int c;
+
+  if (size < MB_MIN_SIZE * (MB_SMALL_CLASSES + 1))
+    return size / MB_MIN_SIZE - 1;
+
+  c = MB_SMALL_CLASSES;
+  for (size >>= 11; size && c < MB_CLASSES - 1; size >>= 1) c++;
+  return c;
+}
+
+/* Put the free block MB into the free list of its class.  */
+static void mb_insert(pooldesc_t *pool, memblock_t *mb) {
+  unsigned int c = mb_class(mb->size);
+
+  MB_LINKS(mb)->prev = NULL;
+  MB_LINKS(mb)->next = pool->free_list[c];
+  if (pool->free_list[c]) MB_LINKS(pool->free_list[c])->prev = mb;
+  pool->free_list[c] = mb;
+  pool->free_bits |= (uint64_t)1 << c;
+}
+
+/* Take the free block MB out of its free list.  */
+static void mb_remove(pooldesc_t *pool, memblock_t *mb) {
+  unsigned int c = mb_class(mb->size);
+  memblock_t *next = MB_LINKS(mb)->next;
+  memblock_t *prev = MB_LINKS(mb)->prev;
+
+  if (next) MB_LINKS(next)->prev = prev;
+  if (prev)
+    MB_LINKS(prev)->next = next;
   else {
-    mb_prev = (memblock_t *)pool->mem;
-    while (1) {
-      mb_next = mb_get_next(pool, mb_prev);
-      if (mb_next == mb)
-        break;
-      else
-        mb_prev = mb_next;
-    }
+    pool->free_list[c] = next;
+    if (!next) pool->free_bits &= ~((uint64_t)1 << c);
   }
+}
+
+/* Set the size of block MB and tell the following block about it.  */
+static void mb_set_size(pooldesc_t *pool, memblock_t *mb, size_t size) {
+  memblock_t *mb_next;
+
+  mb->size = size;
+  mb_next = mb_get_next(pool, mb);
+  if (mb_next) mb_next->prev_size = size;
+}
+
+/* Initialize the first memory block of the fresh pool POOL.  */
+static void mb_init_pool(pooldesc_t *pool) {
+  memblock_t *mb = (memblock_t *)pool->mem;
 
-  return mb_prev;
+  memset(pool->free_list, 0, sizeof pool->free_list);
+  pool->free_bits = 0;
+
+  mb->size = pool->size - BLOCK_HEAD_SIZE;
+  mb->prev_size = 0;
+  mb->flags = 0;
+  mb_insert(pool, mb);
 }
 
-/* If the preceding block of MB and/or the following block of MB
-   exist and are not active, merge them to form a bigger block.  */
+/* Merge the block MB, which is no longer active, with the preceding
+   and the following block if they are free, and put the result into
+   its free list.  Free blocks are never adjacent, so this keeps the
+   pool fully coalesced.  */
 static void mb_merge(pooldesc_t *pool, memblock_t *mb) {
   memblock_t *mb_prev, *mb_next;
+  size_t size = mb->size;
 
   mb_prev = mb_get_prev(pool, mb);
   mb_next = mb_get_next(pool, mb);
 
   if (mb_prev && (!(mb_prev->flags & MB_FLAG_ACTIVE))) {
-    mb_prev->size += BLOCK_HEAD_SIZE + mb->size;
+    mb_remove(pool, mb_prev);
+    size += BLOCK_HEAD_SIZE + mb_prev->size;
     mb = mb_prev;
   }
-  if (mb_next && (!(mb_next->flags & MB_FLAG_ACTIVE)))
-    mb->size += BLOCK_HEAD_SIZE + mb_next->size;
+  if (mb_next && (!(mb_next->flags & MB_FLAG_ACTIVE))) {
+    mb_remove(pool, mb_next);
+    size += BLOCK_HEAD_SIZE + mb_next->size;
+  }
+
+  mb_set_size(pool, mb, size);
+  mb_insert(pool, mb);
 }
 
-/* Return a new block, which can hold SIZE bytes.  */
-static memblock_t *mb_get_new(pooldesc_t *pool, memblock_t *block,
-                              size_t size) {
-  memblock_t *mb, *mb_split;
+/* Return a new block, which can hold SIZE bytes.  SIZE must be a
+   multiple of MB_MIN_SIZE.  */
+static memblock_t *mb_get_new(pooldesc_t *pool, size_t size) {
+  memblock_t *mb = NULL, *mb_split;
+  unsigned int c = mb_class(size);
+  uint64_t bits;
+
+  /* A large class may hold blocks which are too small.  */
+  if (c >= MB_SMALL_CLASSES)
+    for (mb = pool->free_list[c]; mb; mb = MB_LINKS(mb)->next)
+      if (mb->size >= size) break;
+
+  /* Any block of the class itself (if small) or a larger class fits.  */
+  if (!mb) {
+    bits = pool->free_bits;
+    if (c >= MB_SMALL_CLASSES) bits &= ~((uint64_t)1 << c);
+    bits &= ~(((uint64_t)1 << c) - 1);
+    if (bits) mb = pool->free_list[__builtin_ctzll(bits)];
+  }
 
-  for (mb = block; ptr_into_pool_p(pool, mb); mb = mb_get_next(pool, mb))
-    if (!(mb->flags & MB_FLAG_ACTIVE) && mb->size >= size) {
-      /* Found a free block.  */
-      mb->flags |= MB_FLAG_ACTIVE;
+  if (!mb) {
+    gpg_err_set_errno(ENOMEM);
+    return NULL;
+  }
 
-      if (mb->size - size > BLOCK_HEAD_SIZE) {
-        /* Split block.  */
+  /* Found a free block.  */
+  mb_remove(pool, mb);
+  mb->flags |= MB_FLAG_ACTIVE;
+
+  if (mb->size - size >= BLOCK_HEAD_SIZE + MB_MIN_SIZE) {
+    /* Split block.  The rest is free and, as its neighbours are not,
+       goes right into a free list.  */
+    mb_split = (memblock_t *)(void *)(((char *)mb) + BLOCK_HEAD_SIZE + size);
+    mb_split->flags = 0;
+    mb_split->prev_size = size;
+    mb_set_size(pool, mb_split, mb->size - size - BLOCK_HEAD_SIZE);
+    mb->size = size;
+    mb_insert(pool, mb_split);
+  }
 
-        mb_split =
-            (memblock_t *)(void *)(((char *)mb) + BLOCK_HEAD_SIZE + size);
-        mb_split->size = mb->size - size - BLOCK_HEAD_SIZE;
-        mb_split->flags = 0;
+  return mb;
+}
 
-        mb->size = size;
+/* Wipe out the memory of the block MB.  */
+static void mb_wipe(memblock_t *mb) {
+  char *p = (char *)mb + BLOCK_HEAD_SIZE;
 
-        mb_merge(pool, mb_split);
-      }
+  /* This does not make much sense: probably this memory is held in the
+   * cache. We do it anyway: */
+  wipememory2(p, 0xff, mb->size);
+  wipememory2(p, 0xaa, mb->size);
+  wipememory2(p, 0x55, mb->size);
+  wipememory2(p, 0x00, mb->size);
+}
 
-      break;
-    }
+/* Return the pool holding P, or NULL.  This does not need the lock,
+   see _gcry_private_is_secure.  */
+static pooldesc_t *find_pool(const void *p) {
+  pooldesc_t *pool;
 
-  if (!ptr_into_pool_p(pool, mb)) {
-    gpg_err_set_errno(ENOMEM);
-    mb = NULL;
+  for (pool = &mainpool; pool; pool = pool->next)
+    if (pool->okay && ptr_into_pool_p(pool, p)) return pool;
+
+  return NULL;
+}
+
+/* Release the active, already wiped block MB of POOL.  */
+static void mb_release(pooldesc_t *pool, memblock_t *mb) {
+  stats_update(pool, 0, mb->size);
+  secmem_stats.frees++;
+
+  mb->flags &= ~MB_FLAG_ACTIVE;
+  mb_merge(pool, mb);
+}
+
+/* Return the cache of the thread, emptied if the pools were released
+   since it was last used.  */
+static struct secmem_cache *get_cache(void) {
+  struct secmem_cache *cache = &secmem_cache;
+  unsigned int generation = secmem_generation.load(std::memory_order_acquire);
+
+  if (cache->generation != generation) {
+    memset(cache->head, 0, sizeof cache->head);
+    cache->bytes = 0;
+    cache->generation = generation;
   }
+  return cache;
+}
 
-  return mb;
+/* Give the blocks in CACHE back to their pools.  Expected to be called
+   with the secmem lock held.  */
+static void flush_cache(struct secmem_cache *cache) {
+  memblock_t *mb;
+  pooldesc_t *pool;
+  int c;
+
+  for (c = 0; c < SECMEM_CACHE_CLASSES; c++)
+    while ((mb = cache->head[c])) {
+      cache->head[c] = MB_LINKS(mb)->next;
+      pool = find_pool(mb);
+      if (pool) mb_release(pool, mb);
+    }
+  cache->bytes = 0;
+}
+
+/* Return the blocks of an exiting thread to the pools.  */
+secmem_cache::~secmem_cache() {
+  if (!bytes || generation != secmem_generation.load()) return;
+  std::lock_guard<std::mutex> lock(secmem_lock);
+  flush_cache(this);
+}
+
+/* Take a block for SIZE bytes, a multiple of MB_MIN_SIZE, from the
+   cache of the thread.  */
+static void *cache_get(size_t size) {
+  struct secmem_cache *cache;
+  unsigned int c = size / MB_MIN_SIZE - 1;
+  memblock_t *mb;
+
+  if (c >= SECMEM_CACHE_CLASSES) return NULL;
+  cache = get_cache();
+  mb = cache->head[c];
+  if (!mb) return NULL;
+
+  cache->head[c] = MB_LINKS(mb)->next;
+  cache->bytes -= mb->size;
+  secmem_stats.cache_allocs.fetch_add(1, std::memory_order_relaxed);
+  return &mb->aligned.c;
+}
+
+/* Put the wiped block MB of POOL into the cache of the thread.
+   Return true if it was taken.  */
+static int cache_put(pooldesc_t *pool, memblock_t *mb) {
+  struct secmem_cache *cache;
+  unsigned int c = mb->size / MB_MIN_SIZE - 1;
+
+  /* Blocks of the overflow pools must not be handed out for
+     allocations which are not xmalloc style.  */
+  if (pool->is_overflow || c >= SECMEM_CACHE_CLASSES) return 0;
+  cache = get_cache();
+  if (cache->bytes + mb->size > SECMEM_CACHE_BYTES) return 0;
+
+  MB_LINKS(mb)->next = cache->head[c];
+  cache->head[c] = mb;
+  cache->bytes += mb->size;
+  secmem_stats.cache_frees.fetch_add(1, std::memory_order_relaxed);
+  return 1;
 }
 
 /* Print a warning message.  */
@@ -344,8 +582,6 @@ static void lock_pool_pages(void *p, size_t n) {
 
 /* Initialize POOL.  */
 static void init_pool(pooldesc_t *pool, size_t n) {
-  memblock_t *mb;
-
   pool->size = n;
 
   if (disable_secmem) log_bug("secure memory is disabled");
@@ -397,10 +633,59 @@ static void init_pool(pooldesc_t *pool, size_t n) {
       pool->okay = 1;
   }
 
-  /* Initialize first memory block.  */
-  mb = (memblock_t *)pool->mem;
-  mb->size = pool->size - BLOCK_HEAD_SIZE;
-  mb->flags = 0;
+  mb_init_pool(pool);
+}
+
+/* Add a locked pool which can hold SIZE bytes after the main pool.
+   This is expected to be called with the secmem lock held.  */
+static pooldesc_t *add_locked_pool(size_t size) {
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+  pooldesc_t *pool;
+  size_t pgsize;
+  long int pgsize_val;
+
+  if (grown_pools >= MAX_GROWN_POOLS || !mainpool.okay) return NULL;
+
+  pgsize_val = sysconf(_SC_PAGESIZE);
+  pgsize =
+      (pgsize_val != -1 && pgsize_val > 0) ? pgsize_val : DEFAULT_PAGE_SIZE;
+
+  pool = (pooldesc_t *)calloc(1, sizeof *pool);
+  if (!pool) return NULL;
+  pool->size = 2 * (grown_size ? grown_size : mainpool.size);
+  if (pool->size < size + BLOCK_HEAD_SIZE) pool->size = size + BLOCK_HEAD_SIZE;
+  pool->size = (pool->size + pgsize - 1) & ~(pgsize - 1);
+
+  pool->mem = mmap(0, pool->size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pool->mem == (void *)-1) {
+    free(pool);
+    secmem_stats.grow_failures++;
+    return NULL;
+  }
+  /* If the main pool is locked, a pool which can't be locked is not
+     used.  That happens when RLIMIT_MEMLOCK is reached.  */
+  if (!no_mlock && !not_locked && mlock(pool->mem, pool->size)) {
+    munmap(pool->mem, pool->size);
+    free(pool);
+    secmem_stats.grow_failures++;
+    return NULL;
+  }
+  pool->is_mmapped = 1;
+  mb_init_pool(pool);
+  pool->okay = 1;
+
+  /* See the overflow pools for why this is done last.  */
+  pool->next = mainpool.next;
+  mainpool.next = pool;
+
+  grown_pools++;
+  grown_size = pool->size;
+  return pool;
+#else
+  (void)size;
+  return NULL;
+#endif
 }
 
 void _gcry_secmem_set_flags(unsigned flags) {
@@ -483,6 +768,25 @@ gpg_error_t _gcry_secmem_module_init() {
   return 0;
 }
 
+/* Return a new block for SIZE bytes from the main pool or the locked
+ * pools added to it, and with XHINT set also from the overflow pools.
+ * The pool of the block is stored at R_POOL.  */
+static memblock_t *pools_get_new(size_t size, int xhint, pooldesc_t **r_pool) {
+  pooldesc_t *pool;
+  memblock_t *mb;
+
+  for (pool = &mainpool; pool; pool = pool->next) {
+    if (!pool->okay || (pool->is_overflow && !xhint)) continue;
+    mb = mb_get_new(pool, size);
+    if (mb) {
+      *r_pool = pool;
+      return mb;
+    }
+  }
+
+  return NULL;
+}
+
 static void *_gcry_secmem_malloc_internal(size_t size, int xhint) {
   pooldesc_t *pool;
   memblock_t *mb;
@@ -508,22 +812,20 @@ static void *_gcry_secmem_malloc_internal(size_t size, int xhint) {
   /* Blocks are always a multiple of 32. */
   size = ((size + 31) / 32) * 32;
 
-  mb = mb_get_new(pool, (memblock_t *)pool->mem, size);
-  if (mb) {
-    stats_update(pool, mb->size, 0);
-    return &mb->aligned.c;
+  mb = pools_get_new(size, xhint, &pool);
+
+  /* Before adding a pool, take back the blocks cached by this
+   * thread.  */
+  if (!mb && get_cache()->bytes) {
+    flush_cache(get_cache());
+    mb = pools_get_new(size, xhint, &pool);
   }
 
+  if (!mb && (pool = add_locked_pool(size))) mb = mb_get_new(pool, size);
+
   /* If we are called from xmalloc style function resort to the
    * overflow pools to return memory.  */
-  if (xhint) {
-    for (pool = pool->next; pool; pool = pool->next) {
-      mb = mb_get_new(pool, (memblock_t *)pool->mem, size);
-      if (mb) {
-        stats_update(pool, mb->size, 0);
-        return &mb->aligned.c;
-      }
-    }
+  if (!mb && xhint) {
     /* Allocate a new overflow pool.  We put a new pool right after
      * the mainpool so that the next allocation will happen in that
      * pool and not in one of the older pools.  When this new pool
@@ -531,13 +833,15 @@ static void *_gcry_secmem_malloc_internal(size_t size, int xhint) {
     pool = (pooldesc_t *)calloc(1, sizeof *pool);
     if (!pool) return NULL; /* Not enough memory for a new pool descriptor.  */
     pool->size = STANDARD_POOL_SIZE;
+    if (pool->size < size + BLOCK_HEAD_SIZE)
+      pool->size = size + BLOCK_HEAD_SIZE;
     pool->mem = malloc(pool->size);
-    if (!pool->mem)
+    if (!pool->mem) {
+      free(pool);
       return NULL; /* Not enough memory available for a new pool.  */
-    /* Initialize first memory block.  */
-    mb = (memblock_t *)pool->mem;
-    mb->size = pool->size - BLOCK_HEAD_SIZE;
-    mb->flags = 0;
+    }
+    pool->is_overflow = 1;
+    mb_init_pool(pool);
 
     pool->okay = 1;
 
@@ -551,20 +855,24 @@ static void *_gcry_secmem_malloc_internal(size_t size, int xhint) {
     if (!pool->next) print_warn();
 
     /* Allocate.  */
-    mb = mb_get_new(pool, (memblock_t *)pool->mem, size);
-    if (mb) {
-      stats_update(pool, mb->size, 0);
-      return &mb->aligned.c;
-    }
+    mb = mb_get_new(pool, size);
   }
 
-  return NULL;
+  if (!mb) return NULL;
+
+  stats_update(pool, mb->size, 0);
+  secmem_stats.allocs++;
+  return &mb->aligned.c;
 }
 
 /* Allocate a block from the secmem of SIZE.  With XHINT set assume
  * that the caller is a xmalloc style function.  */
 void *_gcry_secmem_malloc(size_t size, int xhint) {
   void *p;
+
+  p = cache_get(((size + 31) / 32) * 32);
+  if (p) return p;
+
   std::lock_guard<std::mutex> lock(secmem_lock);
   p = _gcry_secmem_malloc_internal(size, xhint);
   return p;
@@ -573,44 +881,36 @@ void *_gcry_secmem_malloc(size_t size, int xhint) {
 static int _gcry_secmem_free_internal(void *a) {
   pooldesc_t *pool;
   memblock_t *mb;
-  int size;
 
-  for (pool = &mainpool; pool; pool = pool->next)
-    if (pool->okay && ptr_into_pool_p(pool, a)) break;
+  pool = find_pool(a);
   if (!pool) return 0; /* A does not belong to use.  */
 
   mb = ADDR_TO_BLOCK(a);
-  size = mb->size;
-
-/* This does not make much sense: probably this memory is held in the
- * cache. We do it anyway: */
-#define MB_WIPE_OUT(byte) \
-  wipememory2(((char *)mb + BLOCK_HEAD_SIZE), (byte), size);
-
-  MB_WIPE_OUT(0xff);
-  MB_WIPE_OUT(0xaa);
-  MB_WIPE_OUT(0x55);
-  MB_WIPE_OUT(0x00);
-
-  /* Update stats.  */
-  stats_update(pool, 0, size);
-
-  mb->flags &= ~MB_FLAG_ACTIVE;
-
-  mb_merge(pool, mb);
+  mb_wipe(mb);
+  mb_release(pool, mb);
 
   return 1; /* Freed.  */
 }
 
 /* Wipe out and release memory.  Returns true if this function
- * actually released A.  */
+ * actually released A.  Small blocks go to the cache of the thread,
+ * which does not need the lock.  */
 int _gcry_secmem_free(void *a) {
-  int mine;
+  pooldesc_t *pool;
+  memblock_t *mb;
 
   if (!a) return 1; /* Tell caller that we handled it.  */
+
+  pool = find_pool(a);
+  if (!pool) return 0; /* A does not belong to use.  */
+
+  mb = ADDR_TO_BLOCK(a);
+  mb_wipe(mb);
+  if (cache_put(pool, mb)) return 1;
+
   std::lock_guard<std::mutex> lock(secmem_lock);
-  mine = _gcry_secmem_free_internal(a);
-  return mine;
+  mb_release(pool, mb);
+  return 1;
 }
 
 static void *_gcry_secmem_realloc_internal(void *p, size_t newsize, int xhint) {
@@ -692,6 +992,11 @@ void _gcry_secmem_term() {
   }
   mainpool.next = NULL;
   not_locked = 0;
+  grown_pools = 0;
+  grown_size = 0;
+
+  /* The blocks in the thread caches are gone.  */
+  secmem_generation++;
 }
 
 /* Print stats of the secmem allocator.  With EXTENDED passwed as true
@@ -708,4 +1013,10 @@ void _gcry_secmem_dump_stats() {
                pool == &mainpool ? "secmem usage:" : "", pool->cur_alloced,
                (unsigned long)pool->size, pool->cur_blocks);
   }
+  log_info("%-13s %lu allocations, %lu releases\n", "secmem calls:",
+           secmem_stats.allocs, secmem_stats.frees);
+  log_info("%-13s %lu allocations, %lu releases\n", "thread cache:",
+           secmem_stats.cache_allocs.load(), secmem_stats.cache_frees.load());
+  log_info("%-13s %d locked pools added, %lu failed\n", "secmem grow:",
+           grown_pools, secmem_stats.grow_failures);
 }
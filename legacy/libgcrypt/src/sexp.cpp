@@ -373,69 +373,166 @@ gcry_sexp_t _gcry_sexp_prepend(const gcry_sexp_t a, const gcry_sexp_t n) {
   return NULL;
 }
 
-/****************
- * Locate token in a list. The token must be the car of a sublist.
- * Returns: A new list with this sublist or NULL if not found.
- */
-gcry_sexp_t _gcry_sexp_find_token(const gcry_sexp_t list, const char *tok,
-                                  size_t toklen) {
-  const byte *p;
+/* Borrowed views.  Functions which only need to look at parts of an
+   S-expression work on the range [BEGIN,END) of its buffer instead of
+   copying the parts into new objects.  The views are valid as long as
+   the S-expression is.  */
+
+/* Return the end of the list starting with the ST_OPEN at P, that is
+   the byte after the matching ST_CLOSE.  */
+static const byte *skip_list(const byte *p) {
   DATALEN n;
+  int level = 0;
 
-  if (!list) return NULL;
+  do {
+    if (*p == ST_DATA) {
+      memcpy(&n, ++p, sizeof n);
+      p += sizeof n + n;
+      continue;
+    } else if (*p == ST_OPEN)
+      level++;
+    else if (*p == ST_CLOSE)
+      level--;
+    else if (*p == ST_STOP)
+      BUG();
+    p++;
+  } while (level);
 
-  if (!toklen) toklen = strlen(tok);
+  return p;
+}
 
-  p = list->d;
-  while (*p != ST_STOP) {
-    if (*p == ST_OPEN && p[1] == ST_DATA) {
-      const byte *head = p;
+/* Return the start of the first sublist in [BEGIN,END) whose car is
+   the token TOK of TOKLEN bytes, or NULL if there is none.  END may be
+   NULL to search up to the ST_STOP.  */
+static const byte *view_find_token(const byte *begin, const byte *end,
+                                   const char *tok, size_t toklen) {
+  const byte *p = begin;
+  DATALEN n;
 
-      p += 2;
-      memcpy(&n, p, sizeof n);
+  while ((!end || p < end) && *p != ST_STOP) {
+    if (*p == ST_OPEN && p[1] == ST_DATA) {
+      memcpy(&n, p + 2, sizeof n);
+      if (n == toklen && !memcmp(p + 2 + sizeof n, tok, toklen)) return p;
+      p += 2 + sizeof n + n;
+    } else if (*p == ST_DATA) {
+      memcpy(&n, ++p, sizeof n);
       p += sizeof n;
-      if (n == toklen && !memcmp(p, tok, toklen)) { /* found it */
-        gcry_sexp_t newlist;
-        byte *d;
-        int level = 1;
-
-        /* Look for the end of the list.  */
-        for (p += n; level; p++) {
-          if (*p == ST_DATA) {
-            memcpy(&n, ++p, sizeof n);
-            p += sizeof n + n;
-            p--; /* Compensate for later increment. */
-          } else if (*p == ST_OPEN) {
-            level++;
-          } else if (*p == ST_CLOSE) {
-            level--;
-          } else if (*p == ST_STOP) {
-            BUG();
-          }
-        }
-        n = p - head;
+      p += n;
+    } else
+      p++;
+  }
+  return NULL;
+}
+
+/* An index of the sublists of a view by their car, so that looking up
+   several tokens takes one walk over the view.  It records the first
+   sublist of each token, which is the one view_find_token returns.
+   The index is meant to live on the stack of a single request.  If
+   there are more distinct tokens than fit, indexing stops at REST and
+   lookups which miss walk the view from there.  */
+#define SEXP_INDEX_SLOTS 64
+
+struct sexp_index {
+  struct {
+    const byte *tok;
+    DATALEN toklen;
+    const byte *list;
+  } slot[SEXP_INDEX_SLOTS];
+  const byte *rest, *end;
+};
 
-        newlist = (gcry_sexp_t)xtrymalloc(sizeof *newlist + n);
-        if (!newlist) {
-          /* No way to return an error code, so we can only
-             return Not Found. */
-          return NULL;
+static unsigned int sexp_index_hash(const byte *tok, size_t toklen) {
+  unsigned int h = 2166136261u;
+
+  while (toklen--) h = (h ^ *tok++) * 16777619u;
+  return h;
+}
+
+static void sexp_index_init(struct sexp_index *idx, const byte *begin,
+                            const byte *end) {
+  const byte *p = begin;
+  unsigned int h, used = 0;
+  DATALEN n;
+
+  memset(idx->slot, 0, sizeof idx->slot);
+  idx->rest = NULL;
+  idx->end = end;
+
+  while ((!end || p < end) && *p != ST_STOP) {
+    if (*p == ST_OPEN && p[1] == ST_DATA) {
+      memcpy(&n, p + 2, sizeof n);
+      h = sexp_index_hash(p + 2 + sizeof n, n);
+      for (;; h++) {
+        h %= SEXP_INDEX_SLOTS;
+        if (!idx->slot[h].list) {
+          /* Keep a quarter of the slots free.  */
+          if (4 * (used + 1) > 3 * SEXP_INDEX_SLOTS) {
+            idx->rest = p;
+            return;
+          }
+          idx->slot[h].tok = p + 2 + sizeof n;
+          idx->slot[h].toklen = n;
+          idx->slot[h].list = p;
+          used++;
+          break;
         }
-        d = newlist->d;
-        memcpy(d, head, n);
-        d += n;
-        *d++ = ST_STOP;
-        return normalize(newlist);
+        if (idx->slot[h].toklen == n &&
+            !memcmp(idx->slot[h].tok, p + 2 + sizeof n, n))
+          break; /* Not the first one.  */
       }
-      p += n;
+      p += 2 + sizeof n + n;
     } else if (*p == ST_DATA) {
       memcpy(&n, ++p, sizeof n);
-      p += sizeof n;
-      p += n;
+      p += sizeof n + n;
     } else
       p++;
   }
-  return NULL;
+}
+
+/* Same as view_find_token for the view of IDX.  */
+static const byte *sexp_index_find(const struct sexp_index *idx,
+                                   const char *tok, size_t toklen) {
+  unsigned int h = sexp_index_hash((const byte *)tok, toklen);
+
+  for (;; h++) {
+    h %= SEXP_INDEX_SLOTS;
+    if (!idx->slot[h].list) break;
+    if (idx->slot[h].toklen == toklen &&
+        !memcmp(idx->slot[h].tok, tok, toklen))
+      return idx->slot[h].list;
+  }
+
+  if (!idx->rest) return NULL;
+  return view_find_token(idx->rest, idx->end, tok, toklen);
+}
+
+/****************
+ * Locate token in a list. The token must be the car of a sublist.
+ * Returns: A new list with this sublist or NULL if not found.
+ */
+gcry_sexp_t _gcry_sexp_find_token(const gcry_sexp_t list, const char *tok,
+                                  size_t toklen) {
+  const byte *head;
+  gcry_sexp_t newlist;
+  size_t n;
+
+  if (!list) return NULL;
+
+  if (!toklen) toklen = strlen(tok);
+
+  head = view_find_token(list->d, NULL, tok, toklen);
+  if (!head) return NULL;
+
+  n = skip_list(head) - head;
+  newlist = (gcry_sexp_t)xtrymalloc(sizeof *newlist + n);
+  if (!newlist) {
+    /* No way to return an error code, so we can only
+       return Not Found. */
+    return NULL;
+  }
+  memcpy(newlist->d, head, n);
+  newlist->d[n] = ST_STOP;
+  return normalize(newlist);
 }
 
 /****************
@@ -573,18 +670,16 @@ gcry_sexp_t _gcry_sexp_car(const gcry_sexp_t list) {
   return _gcry_sexp_nth(list, 0);
 }
 
-/* Helper to get data from the car.  The returned value is valid as
-   long as the list is not modified. */
-static const char *do_sexp_nth_data(const gcry_sexp_t list, int number,
-                                    size_t *datalen) {
-  const byte *p;
+/* Helper to get data from the car of the view starting at P and
+   ending before END, which may be NULL for a whole S-expression.  The
+   returned value is valid as long as the list is not modified. */
+static const char *view_nth_data(const byte *p, const byte *end, int number,
+                                 size_t *datalen) {
   DATALEN n;
   int level = 0;
 
   *datalen = 0;
-  if (!list) return NULL;
 
-  p = list->d;
   if (*p == ST_OPEN)
     p++; /* Yep, a list. */
   else if (number)
@@ -606,6 +701,7 @@ static const char *do_sexp_nth_data(const gcry_sexp_t list, int number,
       return NULL;
     }
     p++;
+    if (end && p >= end) return NULL;
   }
 
   /* If this is data, return it.  */
@@ -618,6 +714,16 @@ static const char *do_sexp_nth_data(const gcry_sexp_t list, int number,
   return NULL;
 }
 
+/* Helper to get data from the car.  The returned value is valid as
+   long as the list is not modified. */
+static const char *do_sexp_nth_data(const gcry_sexp_t list, int number,
+                                    size_t *datalen) {
+  *datalen = 0;
+  if (!list) return NULL;
+
+  return view_nth_data(list->d, NULL, number, datalen);
+}
+
 /* Get data from the car.  The returned value is valid as long as the
    list is not modified.  */
 const char *_gcry_sexp_nth_data(const gcry_sexp_t list, int number,
@@ -629,14 +735,14 @@ const char *_gcry_sexp_nth_data(const gcry_sexp_t list, int number,
    The returned value is a malloced buffer and needs to be freed by
    the caller.  This is basically the same as gcry_sexp_nth_data but
    with an allocated result. */
-void *_gcry_sexp_nth_buffer(const gcry_sexp_t list, int number,
-                            size_t *rlength) {
+static void *view_nth_buffer(const byte *p, const byte *end, int number,
+                             size_t *rlength) {
   const char *s;
   size_t n;
   char *buf;
 
   *rlength = 0;
-  s = do_sexp_nth_data(list, number, &n);
+  s = view_nth_data(p, end, number, &n);
   if (!s || !n) return NULL;
   buf = (char *)xtrymalloc(n);
   if (!buf) return NULL;
@@ -645,6 +751,14 @@ void *_gcry_sexp_nth_buffer(const gcry_sexp_t list, int number,
   return buf;
 }
 
+void *_gcry_sexp_nth_buffer(const gcry_sexp_t list, int number,
+                            size_t *rlength) {
+  *rlength = 0;
+  if (!list) return NULL;
+
+  return view_nth_buffer(list->d, NULL, number, rlength);
+}
+
 /* Get a string from the car.  The returned value is a malloced string
    and needs to be freed by the caller.  */
 char *_gcry_sexp_nth_string(const gcry_sexp_t list, int number) {
@@ -661,20 +775,20 @@ char *_gcry_sexp_nth_string(const gcry_sexp_t list, int number) {
   return buf;
 }
 
-/*
- * Get a MPI from the car
- */
-gcry_mpi_t _gcry_sexp_nth_mpi(gcry_sexp_t list, int number, int mpifmt) {
+/* Get a MPI from the car of a view.  An opaque MPI is allocated in
+   secure memory if SECURE is set.  */
+static gcry_mpi_t view_nth_mpi(const byte *begin, const byte *end, int number,
+                               int mpifmt, int secure) {
   size_t n;
   gcry_mpi_t a;
 
   if (mpifmt == GCRYMPI_FMT_OPAQUE) {
     char *p;
 
-    p = (char *)_gcry_sexp_nth_buffer(list, number, &n);
+    p = (char *)view_nth_buffer(begin, end, number, &n);
     if (!p) return NULL;
 
-    a = _gcry_is_secure(list) ? _gcry_mpi_snew(0) : _gcry_mpi_new(0);
+    a = secure ? _gcry_mpi_snew(0) : _gcry_mpi_new(0);
     if (a)
       mpi_set_opaque(a, p, n * 8);
     else
@@ -684,7 +798,7 @@ gcry_mpi_t _gcry_sexp_nth_mpi(gcry_sexp_t list, int number, int mpifmt) {
 
     if (!mpifmt) mpifmt = GCRYMPI_FMT_STD;
 
-    s = do_sexp_nth_data(list, number, &n);
+    s = view_nth_data(begin, end, number, &n);
     if (!s) return NULL;
 
     if (_gcry_mpi_scan(&a, (gcry_mpi_format)(mpifmt), s, n, NULL)) return NULL;
@@ -693,6 +807,15 @@ gcry_mpi_t _gcry_sexp_nth_mpi(gcry_sexp_t list, int number, int mpifmt) {
   return a;
 }
 
+/*
+ * Get a MPI from the car
+ */
+gcry_mpi_t _gcry_sexp_nth_mpi(gcry_sexp_t list, int number, int mpifmt) {
+  if (!list) return NULL;
+
+  return view_nth_mpi(list->d, NULL, number, mpifmt, _gcry_is_secure(list));
+}
+
 /****************
  * Get the CDR
  */
@@ -910,6 +1033,86 @@ static size_t unquote_string(const char *string, size_t length,
  * common operation gcry_sexp_cdr_mpi() will always return a secure MPI
  * regardless whether it is needed or not.
  */
+/* Scan the strictly canonical encoded S-expression in BUFFER of
+   LENGTH, which may only consist of parentheses and "N:" prefixed
+   data.  This is what most callers pass in, and it is converted with
+   a first pass to validate the input and compute the size of the
+   internal representation and a second pass to fill a single buffer
+   of that size.  Returns false if the input strays from this form;
+   the caller then uses the general parser, which also takes care of
+   the error reporting.  Otherwise the result is stored at RETSEXP and
+   the error code at R_ERR.  */
+static int sscan_canonical(gcry_sexp_t *retsexp, const char *buffer,
+                           size_t length, gpg_error_t *r_err) {
+  const unsigned char *p = (const unsigned char *)buffer;
+  const unsigned char *pend = p + length;
+  size_t size = 1; /* ST_STOP */
+  size_t datalen;
+  int level = 0;
+  gcry_sexp_t sexp;
+  byte *d;
+
+  while (p < pend) {
+    if (*p == '(') {
+      level++;
+      size++;
+      p++;
+    } else if (*p == ')') {
+      if (!level) return 0;
+      level--;
+      size++;
+      p++;
+    } else if (*p >= '1' && *p <= '9') {
+      for (datalen = 0; p < pend && digitp(p); p++) {
+        datalen = datalen * 10 + atoi_1(p);
+        if (datalen > 0xffff) return 0;
+      }
+      if (p == pend || *p != ':' || datalen > (size_t)(pend - p - 1))
+        return 0;
+      p += 1 + datalen;
+      size += 1 + sizeof(DATALEN) + datalen;
+    } else
+      return 0;
+  }
+  if (level) return 0;
+
+  if (_gcry_is_secure(buffer))
+    sexp = (gcry_sexp_t)xtrymalloc_secure(sizeof *sexp + size - 1);
+  else
+    sexp = (gcry_sexp_t)xtrymalloc(sizeof *sexp + size - 1);
+  if (!sexp) {
+    *r_err = gpg_error_from_errno(errno);
+    return 1;
+  }
+
+  d = sexp->d;
+  for (p = (const unsigned char *)buffer; p < pend;) {
+    if (*p == '(') {
+      *d++ = ST_OPEN;
+      p++;
+    } else if (*p == ')') {
+      *d++ = ST_CLOSE;
+      p++;
+    } else {
+      DATALEN n;
+
+      for (datalen = 0; *p != ':'; p++) datalen = datalen * 10 + atoi_1(p);
+      n = datalen;
+      *d++ = ST_DATA;
+      memcpy(d, &n, sizeof n);
+      d += sizeof n;
+      memcpy(d, p + 1, datalen);
+      d += datalen;
+      p += 1 + datalen;
+    }
+  }
+  *d = ST_STOP;
+
+  *retsexp = normalize(sexp);
+  *r_err = 0;
+  return 1;
+}
+
 static gpg_error_t do_vsexp_sscan(gcry_sexp_t *retsexp, size_t *erroff,
                                   const char *buffer, size_t length,
                                   int argflag, void **arg_list,
@@ -943,6 +1146,11 @@ static gpg_error_t do_vsexp_sscan(gcry_sexp_t *retsexp, size_t *erroff,
 
   if (!erroff) erroff = &dummy_erroff;
 
+  if (!argflag && sscan_canonical(retsexp, buffer, length, &err)) {
+    if (err) *erroff = 0;
+    return err;
+  }
+
 /* Depending on whether ARG_LIST is non-zero or not, this macro gives
    us the next argument, either from the variable argument list as
    specified by ARG_PTR or from the argument array ARG_LIST.  */
@@ -1887,9 +2095,11 @@ gpg_error_t _gcry_sexp_vextract_param(gcry_sexp_t sexp, const char *path,
   gcry_mpi_t *array[20];
   char arrayisdesc[20];
   int idx;
-  gcry_sexp_t l1;
   int mode = '+'; /* Default to GCRYMPI_FMT_USG.  */
-  gcry_sexp_t freethis = NULL;
+  static const byte empty_sexp[1] = {ST_STOP};
+  const byte *begin, *end, *l1, *l1_end;
+  struct sexp_index index;
+  int use_index;
 
   memset(arrayisdesc, 0, sizeof arrayisdesc);
 
@@ -1920,7 +2130,10 @@ gpg_error_t _gcry_sexp_vextract_param(gcry_sexp_t sexp, const char *path,
   if (va_arg(arg_ptr, gcry_mpi_t *))
     return GPG_ERR_INV_ARG; /* Not enough list elemends.  */
 
-  /* Drill down.  */
+  /* Drill down.  This and the lookups below work on borrowed views
+     into SEXP and don't copy the sublists.  */
+  begin = sexp ? sexp->d : empty_sexp;
+  end = NULL;
   while (path && *path) {
     size_t n;
 
@@ -1929,22 +2142,24 @@ gpg_error_t _gcry_sexp_vextract_param(gcry_sexp_t sexp, const char *path,
       rc = GPG_ERR_NOT_FOUND;
       goto cleanup;
     }
-    n = s ? s - path : 0;
-    l1 = _gcry_sexp_find_token(sexp, path, n);
+    n = s ? s - path : strlen(path);
+    l1 = view_find_token(begin, end, path, n);
     if (!l1) {
       rc = GPG_ERR_NOT_FOUND;
       goto cleanup;
     }
-    sexp = l1;
-    l1 = NULL;
-    sexp_release(freethis);
-    freethis = sexp;
-    if (n)
+    begin = l1;
+    end = skip_list(l1);
+    if (s)
       path += n + 1;
     else
       path = NULL;
   }
 
+  /* With more than one parameter, look them up in an index.  */
+  use_index = idx > 1;
+  if (use_index) sexp_index_init(&index, begin, end);
+
   /* Now extract all parameters.  */
   for (s = list, idx = 0; *s; s++) {
     if (*s == '&' || *s == '+' || *s == '-' || *s == '/')
@@ -1963,10 +2178,13 @@ gpg_error_t _gcry_sexp_vextract_param(gcry_sexp_t sexp, const char *path,
           rc = GPG_ERR_SYNTAX;
           goto cleanup;
         }
-        l1 = _gcry_sexp_find_token(sexp, s, s2 - s);
+        l1 = use_index ? sexp_index_find(&index, s, s2 - s)
+                       : view_find_token(begin, end, s, s2 - s);
         s = s2;
       } else
-        l1 = _gcry_sexp_find_token(sexp, s, 1);
+        l1 = use_index ? sexp_index_find(&index, s, 1)
+                       : view_find_token(begin, end, s, 1);
+      l1_end = l1 ? skip_list(l1) : NULL;
 
       if (!l1 && s[1] == '?') {
         /* Optional element not found.  */
@@ -1990,7 +2208,7 @@ gpg_error_t _gcry_sexp_vextract_param(gcry_sexp_t sexp, const char *path,
             const char *pbuf;
             size_t nbuf;
 
-            pbuf = _gcry_sexp_nth_data(l1, 1, &nbuf);
+            pbuf = view_nth_data(l1, l1_end, 1, &nbuf);
             if (!pbuf || !nbuf) {
               rc = GPG_ERR_INV_OBJ;
               goto cleanup;
@@ -2003,7 +2221,7 @@ gpg_error_t _gcry_sexp_vextract_param(gcry_sexp_t sexp, const char *path,
             spec->len = nbuf;
             arrayisdesc[idx] = 1;
           } else {
-            spec->data = _gcry_sexp_nth_buffer(l1, 1, &spec->size);
+            spec->data = view_nth_buffer(l1, l1_end, 1, &spec->size);
             if (!spec->data) {
               rc = GPG_ERR_INV_OBJ; /* Or out of core.  */
               goto cleanup;
@@ -2013,13 +2231,11 @@ gpg_error_t _gcry_sexp_vextract_param(gcry_sexp_t sexp, const char *path,
             arrayisdesc[idx] = 2;
           }
         } else if (mode == '/')
-          *array[idx] = _gcry_sexp_nth_mpi(l1, 1, GCRYMPI_FMT_OPAQUE);
+          *array[idx] = view_nth_mpi(l1, l1_end, 1, GCRYMPI_FMT_OPAQUE, 0);
         else if (mode == '-')
-          *array[idx] = _gcry_sexp_nth_mpi(l1, 1, GCRYMPI_FMT_STD);
+          *array[idx] = view_nth_mpi(l1, l1_end, 1, GCRYMPI_FMT_STD, 0);
         else
-          *array[idx] = _gcry_sexp_nth_mpi(l1, 1, GCRYMPI_FMT_USG);
-        sexp_release(l1);
-        l1 = NULL;
+          *array[idx] = view_nth_mpi(l1, l1_end, 1, GCRYMPI_FMT_USG, 0);
         if (!*array[idx]) {
           rc = GPG_ERR_INV_OBJ; /* Conversion failed.  */
           goto cleanup;
@@ -2029,12 +2245,9 @@ gpg_error_t _gcry_sexp_vextract_param(gcry_sexp_t sexp, const char *path,
     }
   }
 
-  sexp_release(freethis);
   return 0;
 
 cleanup:
-  sexp_release(freethis);
-  sexp_release(l1);
   while (idx--) {
     if (!arrayisdesc[idx]) {
       _gcry_mpi_release(*array[idx]);
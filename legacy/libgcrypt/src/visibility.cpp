@@ -600,6 +600,10 @@ gpg_error_t gcry_pk_verify(gcry_sexp_t sigval, gcry_sexp_t data,
   return _gcry_pk_verify(sigval, data, pkey);
 }
 
+gpg_error_t gcry_pk_verify_batch(gcry_pk_verify_job_t *jobs, size_t njobs) {
+  return _gcry_pk_verify_batch(jobs, njobs);
+}
+
 gpg_error_t gcry_pk_testkey(gcry_sexp_t key) { return _gcry_pk_testkey(key); }
 
 gpg_error_t gcry_pk_genkey(gcry_sexp_t *r_key, gcry_sexp_t s_parms) {
@@ -657,6 +661,10 @@ gpg_error_t gcry_md_copy(gcry_md_hd_t *bhd, gcry_md_hd_t ahd) {
   return _gcry_md_copy(bhd, ahd);
 }
 
+gpg_error_t gcry_md_copy_state(gcry_md_hd_t dst, gcry_md_hd_t src) {
+  return _gcry_md_copy_state(dst, src);
+}
+
 void gcry_md_reset(gcry_md_hd_t hd) { _gcry_md_reset(hd); }
 
 gpg_error_t gcry_md_ctl(gcry_md_hd_t hd, int cmd, void *buffer, size_t buflen) {
@@ -686,6 +694,10 @@ gpg_error_t gcry_md_hash_buffers(int algo, unsigned int flags, void *digest,
   return _gcry_md_hash_buffers(algo, flags, digest, iov, iovcnt);
 }
 
+void gcry_md_final_batch(gcry_md_hd_t *hds, size_t n) {
+  _gcry_md_final_batch(hds, n);
+}
+
 int gcry_md_get_algo(gcry_md_hd_t hd) { return _gcry_md_get_algo(hd); }
 
 unsigned int gcry_md_get_algo_dlen(int algo) {
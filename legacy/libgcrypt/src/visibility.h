@@ -71,6 +71,7 @@ MARK_VISIBLEX(gcry_md_algo_info)
 MARK_VISIBLEX(gcry_md_algo_name)
 MARK_VISIBLEX(gcry_md_close)
 MARK_VISIBLEX(gcry_md_copy)
+MARK_VISIBLEX(gcry_md_copy_state)
 MARK_VISIBLEX(gcry_md_ctl)
 MARK_VISIBLEX(gcry_md_enable)
 MARK_VISIBLEX(gcry_md_get)
@@ -78,6 +79,7 @@ MARK_VISIBLEX(gcry_md_get_algo)
 MARK_VISIBLEX(gcry_md_get_algo_dlen)
 MARK_VISIBLEX(gcry_md_hash_buffer)
 MARK_VISIBLEX(gcry_md_hash_buffers)
+MARK_VISIBLEX(gcry_md_final_batch)
 MARK_VISIBLEX(gcry_md_info)
 MARK_VISIBLEX(gcry_md_is_enabled)
 MARK_VISIBLEX(gcry_md_is_secure)
@@ -138,6 +140,7 @@ MARK_VISIBLEX(gcry_pk_map_name)
 MARK_VISIBLEX(gcry_pk_sign)
 MARK_VISIBLEX(gcry_pk_testkey)
 MARK_VISIBLEX(gcry_pk_verify)
+MARK_VISIBLEX(gcry_pk_verify_batch)
 MARK_VISIBLEX(gcry_pubkey_get_sexp)
 
 MARK_VISIBLEX(gcry_random_add_bytes)
@@ -5478,7 +5478,7 @@ static void fillbuf_count(char *buf, size_t buflen, unsigned char pos) {
 static void check_one_md(int algo, const char *data, int len,
                          const char *expect, int elen, const char *key,
                          int klen) {
-  gcry_md_hd_t hd, hd2;
+  gcry_md_hd_t hd, hd2, hd3;
   unsigned char *p;
   int mdlen;
   int i;
@@ -5559,6 +5559,18 @@ static void check_one_md(int algo, const char *data, int len,
     fail("algo %d, gcry_md_copy failed: %s\n", algo, gpg_strerror(err));
   }
 
+  /* Restore the state into a handle that has hashed something else.  */
+  if (!xof && !gcry_md_open(&hd3, algo, 0)) {
+    gcry_md_write(hd3, "x", 1);
+    err = gcry_md_copy_state(hd3, hd);
+    if (err)
+      fail("algo %d, gcry_md_copy_state failed: %s\n", algo,
+           gpg_strerror(err));
+    else if (memcmp(gcry_md_read(hd3, algo), expect, mdlen))
+      fail("algo %d, digest mismatch after gcry_md_copy_state\n", algo);
+    gcry_md_close(hd3);
+  }
+
   gcry_md_close(hd);
 
   if (!xof) {
@@ -8331,6 +8343,8 @@ static void check_mac(void) {
 static void verify_one_signature(gcry_sexp_t pkey, gcry_sexp_t hash,
                                  gcry_sexp_t badhash, gcry_sexp_t sig) {
   gcry_error_t rc;
+  gcry_pk_verify_job_t jobs[3] = {
+      {sig, hash, pkey, 0}, {sig, badhash, pkey, 0}, {sig, hash, pkey, 0}};
 
   rc = gcry_pk_verify(sig, hash, pkey);
   if (rc) fail("gcry_pk_verify failed: %s\n", gpg_strerror(rc));
@@ -8338,6 +8352,11 @@ static void verify_one_signature(gcry_sexp_t pkey, gcry_sexp_t hash,
   if (gcry_err_code(rc) != GPG_ERR_BAD_SIGNATURE)
     fail("gcry_pk_verify failed to detect a bad signature: %s\n",
          gpg_strerror(rc));
+
+  rc = gcry_pk_verify_batch(jobs, DIM(jobs));
+  if (gcry_err_code(rc) != GPG_ERR_BAD_SIGNATURE || jobs[0].err ||
+      gcry_err_code(jobs[1].err) != GPG_ERR_BAD_SIGNATURE || jobs[2].err)
+    fail("gcry_pk_verify_batch failed: %s\n", gpg_strerror(rc));
 }
 
 /* Test the public key sign function using the private ket SKEY. PKEY
@@ -1560,6 +1560,12 @@ int main(int argc, char **argv) {
       no_blinding = 1;
       argc--;
       argv++;
+    } else if (!strcmp(*argv, "--generic-ec")) {
+      /* Disable the dedicated field arithmetic for P-256 and Ed25519
+         to compare it against the generic code.  */
+      setenv("GCRYPT_GENERIC_EC", "1", 1);
+      argc--;
+      argv++;
     } else if (!strcmp(*argv, "--large-buffers")) {
       large_buffers = 1;
       argc--;
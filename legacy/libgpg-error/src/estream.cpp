@@ -81,6 +81,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifndef HAVE_W32_SYSTEM
+#include <sys/uio.h>
+#endif
 #ifdef HAVE_W32_SYSTEM
 #ifdef HAVE_WINSOCK2_H
 #include <winsock2.h>
@@ -764,6 +767,46 @@ static int func_fd_seek(void *cookie, gpgrt_off_t *offset, int whence) {
   return err;
 }
 
+/*
+ * The IOCTL function for fd objects.
+ */
+static int func_fd_ioctl(void *cookie, int cmd, void *ptr, size_t *len) {
+  int ret;
+
+#ifndef HAVE_W32_SYSTEM
+  if (cmd == COOKIE_IOCTL_WRITEV) {
+    /* Write the *LEN buffers described by the iovec array PTR with
+       one system call and return the number of bytes written at
+       *LEN.  */
+    estream_cookie_fd_t file_cookie = (estream_cookie_fd_t)cookie;
+    struct iovec *iov = (struct iovec *)ptr;
+    gpgrt_ssize_t bytes_written;
+    size_t n;
+
+    if (IS_INVALID_FD(file_cookie->fd)) {
+      for (bytes_written = 0, n = 0; n < *len; n++)
+        bytes_written += iov[n].iov_len;
+    } else {
+      do {
+        bytes_written = writev(file_cookie->fd, iov, (int)*len);
+      } while (bytes_written == -1 && errno == EINTR);
+    }
+    if (bytes_written == -1)
+      ret = -1;
+    else {
+      *len = bytes_written;
+      ret = 0;
+    }
+  } else
+#endif /*!HAVE_W32_SYSTEM*/
+  {
+    _set_errno(EINVAL);
+    ret = -1;
+  }
+
+  return ret;
+}
+
 /*
  * The destroy function for fd objects.
  */
@@ -793,7 +836,7 @@ static struct cookie_io_functions_s estream_functions_fd = {
     {
         func_fd_read, func_fd_write, func_fd_seek, func_fd_destroy,
     },
-    NULL};
+    func_fd_ioctl};
 
 /*
  * Implementation of W32 handle based I/O.
@@ -1327,6 +1370,51 @@ static int fill_stream(estream_t stream) {
   return err;
 }
 
+/* Read up to BYTES_TO_READ bytes from the backend of STREAM into
+   BUFFER, bypassing the empty container of STREAM.  The number of
+   bytes read is stored at BYTES_READ; the indicators are updated like
+   fill_stream does.  */
+static int read_direct(estream_t stream, unsigned char *buffer,
+                       size_t bytes_to_read, size_t *bytes_read) {
+  gpgrt_cookie_read_function_t func_read = stream->intern->func_read;
+  gpgrt_ssize_t ret;
+  int err;
+
+  assert(stream->data_offset == stream->data_len);
+  stream->intern->offset += stream->data_len;
+  stream->data_len = 0;
+  stream->data_offset = 0;
+
+  *bytes_read = 0;
+  if (!func_read) {
+    _set_errno(EOPNOTSUPP);
+    err = -1;
+  } else {
+    ret = (*func_read)(stream->intern->cookie, buffer, bytes_to_read);
+    if (ret == -1) {
+      err = -1;
+#if EWOULDBLOCK != EAGAIN
+      if (errno == EWOULDBLOCK) _set_errno(EAGAIN);
+#endif
+    } else {
+      *bytes_read = ret;
+      err = 0;
+    }
+  }
+
+  if (err) {
+    if (errno != EAGAIN) {
+      if (errno == EPIPE) stream->intern->indicators.hup = 1;
+      stream->intern->indicators.err = 1;
+    }
+  } else if (!*bytes_read)
+    stream->intern->indicators.eof = 1;
+
+  stream->intern->offset += *bytes_read;
+
+  return err;
+}
+
 static int flush_stream(estream_t stream) {
   gpgrt_cookie_write_function_t func_write = stream->intern->func_write;
   int err;
@@ -1656,6 +1744,20 @@ static int do_read_fbf(estream_t _GPGRT__RESTRICT stream,
   err = 0;
 
   while ((bytes_to_read - data_read) && (!err)) {
+    if (stream->data_offset == stream->data_len &&
+        (bytes_to_read - data_read >= stream->buffer_size ||
+         stream->intern->kind == BACKEND_MEM)) {
+      /* The container is empty and the request would not fit into
+         it anyway, or copying it through the container would be a
+         second memcpy of a memory object: Read directly into the
+         caller's buffer.  */
+      err = read_direct(stream, buffer + data_read, bytes_to_read - data_read,
+                        &data_to_read);
+      if (!err && !data_to_read) break;
+      data_read += data_to_read;
+      continue;
+    }
+
     if (stream->data_offset == stream->data_len) {
       /* Nothing more to read in current container, try to
          fill container with new data.  */
@@ -1875,6 +1977,75 @@ out:
   return err;
 }
 
+/*
+ * Write the data buffered in STREAM followed by BYTES_TO_WRITE bytes
+ * from BUFFER, storing the amount of bytes written from BUFFER at
+ * BYTES_WRITTEN.  For fd based streams both parts are handed to a
+ * single writev.
+ */
+static int write_through(estream_t _GPGRT__RESTRICT stream,
+                         const unsigned char *_GPGRT__RESTRICT buffer,
+                         size_t bytes_to_write,
+                         size_t *_GPGRT__RESTRICT bytes_written) {
+  size_t data_written;
+  size_t n;
+  int err;
+
+  data_written = 0;
+  err = 0;
+
+#ifndef HAVE_W32_SYSTEM
+  if (stream->intern->kind == BACKEND_FD && !stream->data_flushed) {
+    cookie_ioctl_function_t func_ioctl = stream->intern->func_ioctl;
+    struct iovec iov[2];
+
+    while (stream->data_offset) {
+      iov[0].iov_base = stream->buffer;
+      iov[0].iov_len = stream->data_offset;
+      iov[1].iov_base = (void *)(buffer + data_written);
+      iov[1].iov_len = bytes_to_write - data_written;
+      n = DIM(iov);
+      if ((*func_ioctl)(stream->intern->cookie, COOKIE_IOCTL_WRITEV, iov,
+                        &n)) {
+        err = -1;
+#if EWOULDBLOCK != EAGAIN
+        if (errno == EWOULDBLOCK) _set_errno(EAGAIN);
+#endif
+        if (errno != EAGAIN) {
+          if (errno == EPIPE) stream->intern->indicators.hup = 1;
+          stream->intern->indicators.err = 1;
+        }
+        goto out;
+      }
+
+      if (n < stream->data_offset) {
+        /* Short write; keep the rest of the container.  */
+        memmove(stream->buffer, stream->buffer + n, stream->data_offset - n);
+        stream->data_offset -= n;
+        stream->intern->offset += n;
+      } else {
+        n -= stream->data_offset;
+        stream->intern->offset += stream->data_offset + n;
+        stream->data_offset = 0;
+        data_written += n;
+      }
+    }
+  }
+#endif /*!HAVE_W32_SYSTEM*/
+
+  if (stream->data_offset) err = flush_stream(stream);
+
+  if (!err && data_written < bytes_to_write) {
+    err = es_write_nbf(stream, buffer + data_written,
+                       bytes_to_write - data_written, &n);
+    data_written += n;
+  }
+
+out:
+  *bytes_written = data_written;
+  return err;
+}
+
 /*
  * Write BYTES_TO_WRITE bytes from BUFFER into STREAM in
  * fully-buffered-mode, storing the amount of bytes written at
@@ -1892,6 +2063,21 @@ static int es_write_fbf(estream_t _GPGRT__RESTRICT stream,
   data_written = 0;
   err = 0;
 
+  if (bytes_to_write > stream->buffer_size - stream->data_offset &&
+      bytes_to_write >= stream->buffer_size) {
+    /* Copying the data through the container would only cut it into
+       container sized writes.  Write the buffered data and then all
+       of BUFFER, in one go if the backend supports that.  */
+    err = write_through(stream, buffer, bytes_to_write, bytes_written);
+    return err;
+  }
+
+  if (!stream->data_offset && stream->intern->kind == BACKEND_MEM) {
+    /* The memory backend copies the data itself; buffering it in the
+       container first only adds another memcpy.  */
+    return es_write_nbf(stream, buffer, bytes_to_write, bytes_written);
+  }
+
   while ((bytes_to_write - data_written) && (!err)) {
     if (stream->data_offset == stream->buffer_size)
       /* Container full, flush buffer.  */
@@ -2203,17 +2389,22 @@ static int es_set_buffering(estream_t _GPGRT__RESTRICT stream,
     if (buffer)
       buffer_new = buffer;
     else {
-      if (!size) size = BUFSIZ;
-      buffer_new = mem_alloc(size);
-      if (!buffer_new) {
-        err = -1;
-        goto out;
+      if (!size) size = BUFFER_BLOCK_SIZE;
+      if (size <= BUFFER_BLOCK_SIZE)
+        buffer_new = stream->intern->buffer;
+      else {
+        buffer_new = mem_alloc(size);
+        if (!buffer_new) {
+          err = -1;
+          goto out;
+        }
       }
     }
 
     stream->buffer = (unsigned char *)buffer_new;
     stream->buffer_size = size;
-    if (!buffer) stream->intern->deallocate_buffer = 1;
+    if (!buffer && buffer_new != stream->intern->buffer)
+      stream->intern->deallocate_buffer = 1;
   }
   stream->intern->strategy = mode;
   err = 0;
@@ -20,7 +20,7 @@
 /* libgcrypt */
 
 /* List of available cipher algorithms */
-#define LIBGCRYPT_CIPHERS "blowfish:cast5:des:aes:twofish:rfc2268:camellia:idea"
+#define LIBGCRYPT_CIPHERS "blowfish:cast5:des:aes:twofish:rfc2268:camellia:idea:chacha20"
 
 /* List of available digest algorithms */
 #define LIBGCRYPT_DIGESTS "crc:md4:md5:rmd160:sha1:sha256:sha512:sha3:whirlpool"
@@ -45,6 +45,9 @@
 /* Defined if this module should be included */
 #define USE_CAST5 1
 
+/* Defined if this module should be included */
+#define USE_CHACHA20 1
+
 /* Defined if this module should be included */
 #define USE_CRC 1
 
@@ -44,6 +44,7 @@ void _gpgrt_free(void *a);
 typedef int (*cookie_ioctl_function_t)(void *cookie, int cmd, void *ptr,
                                        size_t *len);
 #define COOKIE_IOCTL_SNATCH_BUFFER 1
+#define COOKIE_IOCTL_WRITEV 2
 
 /* An internal variant of gpgrt_cookie_close_function_t with a slot
    for the ioctl function.  */
@@ -73,7 +74,14 @@ typedef struct notify_list_s *notify_list_t;
  * Buffer management layer.
  */
 
+/* BUFSIZ is as small as 512 on some systems; we want at least a few
+   KiB so that the status and Assuan lines of a command end up in one
+   system call.  Use es_setvbuf to pick a size for a single stream.  */
+#if BUFSIZ < 8192
+#define BUFFER_BLOCK_SIZE 8192
+#else
 #define BUFFER_BLOCK_SIZE BUFSIZ
+#endif
 #define BUFFER_UNREAD_SIZE 16
 
 /*
@@ -37,6 +37,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <mutex>
 
 #ifdef BUILD_GENTOOLS
 #include "gen-help.h"
@@ -1008,6 +1009,68 @@ static AsnNode do_expand_tree(AsnNode src_root, AsnNode s, int depth) {
   return first;
 }
 
+/* The expanded types of the shared parse trees.  Expanding a type
+   resolves every identifier in it by name, but the result only
+   depends on the parse tree and the type.  For the trees of the
+   built-in modules, which are shared and never change, each type is
+   expanded only once and later requests copy the expanded tree.  */
+struct expanded_type {
+  struct expanded_type *next;
+  AsnNode parse_tree;
+  AsnNode root;
+  char name[1];
+};
+static AsnNode shared_trees[4];
+static struct expanded_type *expanded_types;
+static std::mutex expanded_types_lock;
+
+/* Mark PARSE_TREE as shared, so that _ksba_asn_expand_tree may keep
+   the types expanded from it.  PARSE_TREE must never be modified or
+   released afterwards.  */
+void _ksba_asn_share_tree(AsnNode parse_tree) {
+  std::lock_guard<std::mutex> lock(expanded_types_lock);
+  size_t i;
+
+  for (i = 0; i < DIM(shared_trees); i++)
+    if (!shared_trees[i] || shared_trees[i] == parse_tree) {
+      shared_trees[i] = parse_tree;
+      return;
+    }
+}
+
+/* Return the expanded type NAME of the shared tree PARSE_TREE or NULL
+   if PARSE_TREE is not shared.  The returned tree must not be
+   modified.  */
+static AsnNode find_expanded_type(AsnNode parse_tree, const char *name) {
+  std::lock_guard<std::mutex> lock(expanded_types_lock);
+  struct expanded_type *et;
+  AsnNode root;
+  size_t i;
+
+  for (i = 0; i < DIM(shared_trees); i++)
+    if (shared_trees[i] == parse_tree) break;
+  if (i == DIM(shared_trees)) return NULL;
+
+  for (et = expanded_types; et; et = et->next)
+    if (et->parse_tree == parse_tree && !strcmp(et->name, name))
+      return et->root;
+
+  root = find_node(parse_tree, name, 1);
+  if (!root) return NULL;
+  et = (struct expanded_type *)xtrymalloc(sizeof *et + strlen(name));
+  if (!et) return NULL;
+  et->root = do_expand_tree(parse_tree, root, 0);
+  if (!et->root) {
+    xfree(et);
+    return NULL;
+  }
+  et->parse_tree = parse_tree;
+  strcpy(et->name, name);
+  et->next = expanded_types;
+  expanded_types = et;
+  return et->root;
+}
+
 /* Expand the syntax tree so that all references are resolved and we
    are able to store values right in the tree (except for set/sequence
    of).  This expanded tree is also an requirement for doing the DER
@@ -1017,6 +1080,9 @@ static AsnNode do_expand_tree(AsnNode src_root, AsnNode s, int depth) {
 AsnNode _ksba_asn_expand_tree(AsnNode parse_tree, const char *name) {
   AsnNode root;
 
+  if (name && (root = find_expanded_type(parse_tree, name)))
+    return copy_tree(root, root);
+
   root = name ? find_node(parse_tree, name, 1) : parse_tree;
   return do_expand_tree(parse_tree, root, 0);
 }
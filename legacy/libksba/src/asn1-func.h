@@ -33,6 +33,10 @@
 #ifndef ASN1_FUNC_H
 #define ASN1_FUNC_H
 
+#ifndef BUILD_GENTOOLS
+#include "ksba.h"
+#endif
+
 typedef enum {
   TYPE_NONE = 0,
   TYPE_BOOLEAN = 1,
@@ -166,6 +170,7 @@ struct asn_node_struct {
 struct ksba_asn_tree_s {
   AsnNode parse_tree;
   AsnNode node_list; /* for easier release of all nodes */
+  int is_shared;     /* Owned by _ksba_asn_get_module; do not release.  */
   char filename[1];
 };
 
@@ -193,6 +198,7 @@ int _ksba_asn_expand_object_id(AsnNode node);
 void _ksba_asn_set_default_tag(AsnNode node);
 void _ksba_asn_type_set_config(AsnNode node);
 AsnNode _ksba_asn_expand_tree(AsnNode parse_tree, const char *name);
+void _ksba_asn_share_tree(AsnNode parse_tree);
 AsnNode _ksba_asn_insert_copy(AsnNode node);
 
 int _ksba_asn_is_primitive(node_type_t type);
@@ -207,6 +213,10 @@ int _ksba_asn_delete_structure(AsnNode root);
 
 /*-- asn2-func.c --*/
 /*(functions are all declared in ksba.h)*/
+#ifndef BUILD_GENTOOLS
+gpg_error_t _ksba_asn_get_module(const char *mod_name,
+                                 ksba_asn_tree_t *result);
+#endif
 
 /*-- asn1-tables.c (generated) --*/
 const static_asn *_ksba_asn_lookup_table(const char *name,
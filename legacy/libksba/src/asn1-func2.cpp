@@ -42,11 +42,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <mutex>
 
-#include "asn1-func.h"
 #include "ksba.h"
 #include "util.h"
 
+#include "asn1-func.h"
+
 static AsnNode set_right(AsnNode node, AsnNode right) {
   if (node == NULL) return node;
 
@@ -175,6 +177,7 @@ gpg_error_t ksba_asn_create_tree(const char *mod_name,
     else {
       tree->parse_tree = pointer;
       tree->node_list = p;
+      tree->is_shared = 0;
       strcpy(tree->filename, mod_name);
       *result = tree;
       rc = 0;
@@ -186,3 +189,39 @@ gpg_error_t ksba_asn_create_tree(const char *mod_name,
 
   return rc;
 }
+
+/* The modules compiled into the library.  Each one is created from
+   the static tables on first use and then kept for the lifetime of
+   the process.  The parse trees are never modified, so they can be
+   used by all decoders and encoders, even in different threads.  */
+static struct {
+  const char *name;
+  ksba_asn_tree_t tree;
+} shared_modules[] = {{"tmttv2", NULL}, {"cms", NULL}};
+static std::mutex shared_modules_lock;
+
+/* Return the shared tree of the built-in module MOD_NAME at RESULT.
+   This is the same as ksba_asn_create_tree, but the tree is created
+   only once; ksba_asn_tree_release does nothing for it.  */
+gpg_error_t _ksba_asn_get_module(const char *mod_name,
+                                 ksba_asn_tree_t *result) {
+  std::lock_guard<std::mutex> lock(shared_modules_lock);
+  gpg_error_t err;
+  size_t i;
+
+  if (!result || !mod_name) return GPG_ERR_INV_VALUE;
+  *result = NULL;
+
+  for (i = 0; i < DIM(shared_modules); i++)
+    if (!strcmp(shared_modules[i].name, mod_name)) break;
+  if (i == DIM(shared_modules)) return ksba_asn_create_tree(mod_name, result);
+
+  if (!shared_modules[i].tree) {
+    err = ksba_asn_create_tree(mod_name, &shared_modules[i].tree);
+    if (err) return err;
+    shared_modules[i].tree->is_shared = 1;
+    _ksba_asn_share_tree(shared_modules[i].tree->parse_tree);
+  }
+  *result = shared_modules[i].tree;
+  return 0;
+}
@@ -2316,6 +2316,7 @@ int ksba_asn_parse_file(const char *file_name, ksba_asn_tree_t *result,
                                     (file_name ? strlen(file_name) : 1));
     tree->parse_tree = parsectl.parse_tree;
     tree->node_list = parsectl.all_nodes;
+    tree->is_shared = 0;
     strcpy(tree->filename, file_name ? file_name : "-");
     *result = tree;
   }
@@ -2325,7 +2326,7 @@ int ksba_asn_parse_file(const char *file_name, ksba_asn_tree_t *result,
 }
 
 void ksba_asn_tree_release(ksba_asn_tree_t tree) {
-  if (!tree) return;
+  if (!tree || tree->is_shared) return;
   release_all_nodes(tree->node_list);
   tree->node_list = NULL;
   xfree(tree);
@@ -1017,6 +1017,7 @@ ksba_asn_parse_file (const char *file_name, ksba_asn_tree_t *result, int debug)
       tree = xmalloc ( sizeof *tree + (file_name? strlen (file_name):1) );
       tree->parse_tree = parsectl.parse_tree;
       tree->node_list = parsectl.all_nodes;
+      tree->is_shared = 0;
       strcpy (tree->filename, file_name? file_name:"-");
       *result = tree;
     }
@@ -1029,7 +1030,7 @@ ksba_asn_parse_file (const char *file_name, ksba_asn_tree_t *result, int debug)
 void
 ksba_asn_tree_release (ksba_asn_tree_t tree)
 {
-  if (!tree)
+  if (!tree || tree->is_shared)
     return;
   release_all_nodes (tree->node_list);
   tree->node_list = NULL;
@@ -55,6 +55,31 @@ static const char oidstr_extKeyUsage[] = "2.5.29.37";
 static const char oidstr_authorityInfoAccess[] = "1.3.6.1.5.5.7.1.1";
 static const char oidstr_subjectInfoAccess[] = "1.3.6.1.5.5.7.1.11";
 
+/* The names of the nodes in enum cert_node_id.  */
+static const char *const cert_node_names[CERT_NODE_COUNT] = {
+    "Certificate",
+    "Certificate.tbsCertificate",
+    "Certificate.signatureAlgorithm",
+    "Certificate.tbsCertificate.serialNumber",
+    "Certificate.tbsCertificate.issuer",
+    "Certificate.tbsCertificate.subject",
+    "Certificate.tbsCertificate.validity.notBefore",
+    "Certificate.tbsCertificate.validity.notAfter",
+    "Certificate.tbsCertificate.subjectPublicKeyInfo",
+    "Certificate.tbsCertificate.extensions.."};
+
+/* Return the node ID of the initialized certificate CERT.  The tree
+   is only searched on the first call for each node; certcache and
+   the chain validation ask for the same few nodes over and over.  */
+static AsnNode cert_node(ksba_cert_t cert, enum cert_node_id id) {
+  if (!(cert->cache.nodes_valid & (1u << id))) {
+    cert->cache.nodes[id] =
+        _ksba_asn_find_node(cert->root, cert_node_names[id]);
+    cert->cache.nodes_valid |= 1u << id;
+  }
+  return cert->cache.nodes[id];
+}
+
 /**
  * ksba_cert_new:
  *
@@ -107,6 +132,8 @@ void ksba_cert_release(ksba_cert_t cert) {
   }
 
   xfree(cert->cache.digest_algo);
+  xfree(cert->cache.issuer_dn);
+  xfree(cert->cache.subject_dn);
   if (cert->cache.extns_valid) {
     for (i = 0; i < cert->cache.n_extns; i++) xfree(cert->cache.extns[i].oid);
     xfree(cert->cache.extns);
@@ -232,8 +259,9 @@ gpg_error_t ksba_cert_read_der(ksba_cert_t cert, ksba_reader_t reader) {
   ksba_asn_tree_release(cert->asn_tree);
   cert->root = NULL;
   cert->asn_tree = NULL;
+  cert->cache.nodes_valid = 0;
 
-  err = ksba_asn_create_tree("tmttv2", &cert->asn_tree);
+  err = _ksba_asn_get_module("tmttv2", &cert->asn_tree);
   if (err) goto leave;
 
   decoder = _ksba_ber_decoder_new();
@@ -281,7 +309,7 @@ const unsigned char *ksba_cert_get_image(ksba_cert_t cert, size_t *r_length) {
   if (!cert) return NULL;
   if (!cert->initialized) return NULL;
 
-  n = _ksba_asn_find_node(cert->root, "Certificate");
+  n = cert_node(cert, CERT_NODE_CERTIFICATE);
   if (!n) return NULL;
 
   if (n->off == -1) {
@@ -326,8 +354,7 @@ gpg_error_t ksba_cert_hash(ksba_cert_t cert, int what,
   if (!cert /*|| !hasher*/) return GPG_ERR_INV_VALUE;
   if (!cert->initialized) return GPG_ERR_NO_DATA;
 
-  n = _ksba_asn_find_node(
-      cert->root, what == 1 ? "Certificate.tbsCertificate" : "Certificate");
+  n = cert_node(cert, what == 1 ? CERT_NODE_TBS : CERT_NODE_CERTIFICATE);
   if (!n) return GPG_ERR_NO_VALUE; /* oops - should be there */
   if (n->off == -1) {
     /*        fputs ("ksba_cert_hash problem at node:\n", stderr); */
@@ -375,7 +402,7 @@ const char *ksba_cert_get_digest_algo(ksba_cert_t cert) {
   /*   else  */
   /*     cert->cache.digest_algo = algo; */
 
-  n = _ksba_asn_find_node(cert->root, "Certificate.signatureAlgorithm");
+  n = cert_node(cert, CERT_NODE_SIG_ALGO);
   if (!n || n->off == -1) {
     algo = NULL;
     err = GPG_ERR_UNKNOWN_ALGORITHM;
@@ -408,8 +435,7 @@ ksba_sexp_t ksba_cert_get_serial(ksba_cert_t cert) {
 
   if (!cert || !cert->initialized) return NULL;
 
-  n = _ksba_asn_find_node(cert->root,
-                          "Certificate.tbsCertificate.serialNumber");
+  n = cert_node(cert, CERT_NODE_SERIAL);
   if (!n) return NULL; /* oops - should be there */
 
   if (n->off == -1) {
@@ -437,8 +463,7 @@ gpg_error_t _ksba_cert_get_serial_ptr(ksba_cert_t cert,
   asn_node_t n;
 
   if (!cert || !cert->initialized || !ptr || !length) return GPG_ERR_INV_VALUE;
-  n = _ksba_asn_find_node(cert->root,
-                          "Certificate.tbsCertificate.serialNumber");
+  n = cert_node(cert, CERT_NODE_SERIAL);
   if (!n || n->off == -1) return GPG_ERR_NO_VALUE;
 
   *ptr = cert->image + n->off + n->nhdr;
@@ -455,7 +480,7 @@ gpg_error_t _ksba_cert_get_subject_dn_ptr(ksba_cert_t cert,
 
   if (!cert || !cert->initialized || !ptr || !length) return GPG_ERR_INV_VALUE;
 
-  n = _ksba_asn_find_node(cert->root, "Certificate.tbsCertificate.subject");
+  n = cert_node(cert, CERT_NODE_SUBJECT);
   if (!n || !n->down) return GPG_ERR_NO_VALUE; /* oops - should be there */
   n = n->down;                                 /* dereference the choice node */
   if (n->off == -1) return GPG_ERR_NO_VALUE;
@@ -481,16 +506,21 @@ static gpg_error_t get_name(ksba_cert_t cert, int idx, int use_subject,
   *result = NULL;
   if (!idx) { /* Get the required DN */
     AsnNode n;
+    char **cached;
 
-    n = _ksba_asn_find_node(
-        cert->root, (use_subject ? "Certificate.tbsCertificate.subject"
-                                 : "Certificate.tbsCertificate.issuer"));
-    if (!n || !n->down) return GPG_ERR_NO_VALUE; /* oops - should be there */
-    n = n->down; /* dereference the choice node */
-    if (n->off == -1) return GPG_ERR_NO_VALUE;
+    /* The DN is converted only once and then copied.  */
+    cached = use_subject ? &cert->cache.subject_dn : &cert->cache.issuer_dn;
+    if (!*cached) {
+      n = cert_node(cert, use_subject ? CERT_NODE_SUBJECT : CERT_NODE_ISSUER);
+      if (!n || !n->down) return GPG_ERR_NO_VALUE; /* oops - should be there */
+      n = n->down; /* dereference the choice node */
+      if (n->off == -1) return GPG_ERR_NO_VALUE;
 
-    err = _ksba_dn_to_str(cert->image, n, &p);
-    if (err) return err;
+      err = _ksba_dn_to_str(cert->image, n, cached);
+      if (err) return err;
+    }
+    p = xtrystrdup(*cached);
+    if (!p) return gpg_error_from_errno(errno);
     *result = p;
     return 0;
   }
@@ -645,10 +675,7 @@ gpg_error_t ksba_cert_get_validity(ksba_cert_t cert, int what,
   *timebuf = 0;
   if (!cert->initialized) return GPG_ERR_NO_DATA;
 
-  n = _ksba_asn_find_node(cert->root,
-                          what == 0
-                              ? "Certificate.tbsCertificate.validity.notBefore"
-                              : "Certificate.tbsCertificate.validity.notAfter");
+  n = cert_node(cert, what == 0 ? CERT_NODE_NOT_BEFORE : CERT_NODE_NOT_AFTER);
   if (!n) return 0; /* no value available */
 
   /* Fixme: We should remove the choice node and don't use this ugly hack */
@@ -674,9 +701,7 @@ ksba_sexp_t ksba_cert_get_public_key(ksba_cert_t cert) {
   if (!cert) return NULL;
   if (!cert->initialized) return NULL;
 
-  n = _ksba_asn_find_node(cert->root,
-                          "Certificate"
-                          ".tbsCertificate.subjectPublicKeyInfo");
+  n = cert_node(cert, CERT_NODE_PUBKEY);
   if (!n) {
     cert->last_error = GPG_ERR_NO_VALUE;
     return NULL;
@@ -701,8 +726,7 @@ gpg_error_t _ksba_cert_get_public_key_ptr(ksba_cert_t cert,
 
   if (!cert || !cert->initialized || !ptr || !length) return GPG_ERR_INV_VALUE;
 
-  n = _ksba_asn_find_node(cert->root,
-                          "Certificate.tbsCertificate.subjectPublicKeyInfo");
+  n = cert_node(cert, CERT_NODE_PUBKEY);
   if (!n || !n->down || !n->down->right)
     return GPG_ERR_NO_VALUE; /* oops - should be there */
   n = n->down->right;
@@ -727,7 +751,7 @@ ksba_sexp_t ksba_cert_get_sig_val(ksba_cert_t cert) {
   if (!cert) return NULL;
   if (!cert->initialized) return NULL;
 
-  n = _ksba_asn_find_node(cert->root, "Certificate.signatureAlgorithm");
+  n = cert_node(cert, CERT_NODE_SIG_ALGO);
   if (!n) {
     cert->last_error = GPG_ERR_NO_VALUE;
     return NULL;
@@ -760,8 +784,7 @@ static gpg_error_t read_extensions(ksba_cert_t cert) {
   assert(!cert->cache.extns_valid);
   assert(!cert->cache.extns);
 
-  start = _ksba_asn_find_node(cert->root,
-                              "Certificate.tbsCertificate.extensions..");
+  start = cert_node(cert, CERT_NODE_EXTNS);
   for (count = 0, n = start; n; n = n->right) count++;
   if (!count) {
     cert->cache.n_extns = 0;
@@ -833,6 +856,46 @@ gpg_error_t ksba_cert_get_extension(ksba_cert_t cert, int idx,
   return 0;
 }
 
+/* Store the index of the extension OID of CERT at R_IDX.  Return
+   GPG_ERR_NO_DATA if there is no such extension and GPG_ERR_DUP_VALUE
+   if there is more than one.  The result of the search is kept in the
+   cache field MEMO of CERT (see struct ksba_cert_s).  */
+static gpg_error_t find_unique_extension(ksba_cert_t cert, const char *oid,
+                                         int *memo, int *r_idx) {
+  gpg_error_t err;
+  const char *tmpoid;
+  int idx;
+
+  if (!*memo) {
+    for (idx = 0;
+         !(err = ksba_cert_get_extension(cert, idx, &tmpoid, NULL, NULL, NULL));
+         idx++) {
+      if (!strcmp(tmpoid, oid)) break;
+    }
+    if (err == GPG_ERR_EOF || err == GPG_ERR_NO_VALUE)
+      *memo = -1; /* not available */
+    else if (err)
+      return err;
+    else {
+      *memo = idx + 1;
+      /* Check that there is only one */
+      for (idx++; !(err = ksba_cert_get_extension(cert, idx, &tmpoid, NULL,
+                                                  NULL, NULL));
+           idx++) {
+        if (!strcmp(tmpoid, oid)) {
+          *memo = -2;
+          break;
+        }
+      }
+    }
+  }
+
+  if (*memo == -1) return GPG_ERR_NO_DATA;
+  if (*memo == -2) return GPG_ERR_DUP_VALUE;
+  *r_idx = *memo - 1;
+  return 0;
+}
+
 /* Return information on the basicConstraint (2.5.19.19) of CERT.
    R_CA receives true if this is a CA and only in that case R_PATHLEN
    is set to the maximim certification path length or -1 if there is
@@ -1451,21 +1514,11 @@ gpg_error_t ksba_cert_get_auth_key_id(ksba_cert_t cert, ksba_sexp_t *r_keyid,
   *r_name = NULL;
   *r_serial = NULL;
 
-  for (idx = 0;
-       !(err = ksba_cert_get_extension(cert, idx, &oid, &crit, &off, &derlen));
-       idx++) {
-    if (!strcmp(oid, oidstr_authorityKeyIdentifier)) break;
-  }
-  if (err == GPG_ERR_EOF || err == GPG_ERR_NO_VALUE)
-    return GPG_ERR_NO_DATA; /* not available */
+  err = find_unique_extension(cert, oidstr_authorityKeyIdentifier,
+                              &cert->cache.akid_idx, &idx);
+  if (err) return err;
+  err = ksba_cert_get_extension(cert, idx, &oid, &crit, &off, &derlen);
   if (err) return err;
-
-  /* check that there is only one */
-  for (idx++;
-       !(err = ksba_cert_get_extension(cert, idx, &oid, NULL, NULL, NULL));
-       idx++) {
-    if (!strcmp(oid, oidstr_authorityKeyIdentifier)) return GPG_ERR_DUP_VALUE;
-  }
 
   der = cert->image + off;
 
@@ -1551,7 +1604,8 @@ build_keyid:
    R_CRIT is not NULL, the critical extension flag will be stored at
    that address. */
 static gpg_error_t get_simple_octet_string_ext(ksba_cert_t cert,
-                                               const char *oid, int *r_crit,
+                                               const char *oid, int *memo,
+                                               int *r_crit,
                                                ksba_sexp_t *r_data) {
   gpg_error_t err;
   const char *tmpoid;
@@ -1565,22 +1619,10 @@ static gpg_error_t get_simple_octet_string_ext(ksba_cert_t cert,
   if (!r_data) return GPG_ERR_INV_VALUE;
   *r_data = NULL;
 
-  for (idx = 0; !(err = ksba_cert_get_extension(cert, idx, &tmpoid, &crit, &off,
-                                                &derlen));
-       idx++) {
-    if (!strcmp(tmpoid, oid)) break;
-  }
-  if (err) {
-    if (err == GPG_ERR_EOF || err == GPG_ERR_NO_VALUE) return GPG_ERR_NO_DATA;
-    return err;
-  }
-
-  /* Check that there is only one */
-  for (idx++;
-       !(err = ksba_cert_get_extension(cert, idx, &tmpoid, NULL, NULL, NULL));
-       idx++) {
-    if (!strcmp(tmpoid, oid)) return GPG_ERR_DUP_VALUE;
-  }
+  err = find_unique_extension(cert, oid, memo, &idx);
+  if (err) return err;
+  err = ksba_cert_get_extension(cert, idx, &tmpoid, &crit, &off, &derlen);
+  if (err) return err;
 
   der = cert->image + off;
 
@@ -1612,8 +1654,8 @@ static gpg_error_t get_simple_octet_string_ext(ksba_cert_t cert,
    this is extension is stored there. */
 gpg_error_t ksba_cert_get_subj_key_id(ksba_cert_t cert, int *r_crit,
                                       ksba_sexp_t *r_keyid) {
-  return get_simple_octet_string_ext(cert, oidstr_subjectKeyIdentifier, r_crit,
-                                     r_keyid);
+  return get_simple_octet_string_ext(cert, oidstr_subjectKeyIdentifier,
+                                     &cert->cache.skid_idx, r_crit, r_keyid);
 }
 
 /* MODE 0 := authorityInfoAccess
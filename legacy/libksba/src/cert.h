@@ -40,6 +40,23 @@ struct cert_extn_info {
   int off, len;
 };
 
+/* The nodes of the certificate tree which are looked up by their
+   names.  Each one is looked up only on first use and then kept in
+   the cache of the certificate object.  */
+enum cert_node_id {
+  CERT_NODE_CERTIFICATE,
+  CERT_NODE_TBS,
+  CERT_NODE_SIG_ALGO,
+  CERT_NODE_SERIAL,
+  CERT_NODE_ISSUER,
+  CERT_NODE_SUBJECT,
+  CERT_NODE_NOT_BEFORE,
+  CERT_NODE_NOT_AFTER,
+  CERT_NODE_PUBKEY,
+  CERT_NODE_EXTNS,
+  CERT_NODE_COUNT
+};
+
 /* An object to store user supplied data to be associated with a
    certificates.  This is implemented as a linked list with the
    constrained that a given key may only occur once. */
@@ -95,6 +112,15 @@ struct ksba_cert_s {
     int extns_valid;
     int n_extns;
     struct cert_extn_info *extns;
+    unsigned int nodes_valid; /* Bit N set if NODES[N] has been set. */
+    AsnNode nodes[CERT_NODE_COUNT];
+    char *issuer_dn;  /* The issuer DN as a string or NULL.  */
+    char *subject_dn; /* The subject DN as a string or NULL.  */
+    /* The index plus one of the subject and authority key identifier
+       extensions, 0 if not yet looked up, -1 if not available and -2
+       if there is more than one.  */
+    int skid_idx;
+    int akid_idx;
   } cache;
 };
 
@@ -43,6 +43,7 @@
 #include "convert.h"
 #include "der-encoder.h"
 #include "keyinfo.h"
+#include "reader.h"
 #include "sexp-parse.h"
 
 static gpg_error_t ct_parse_data(ksba_cms_t cms);
@@ -87,24 +88,87 @@ static const char oid_signingTime[9] = {'\x2A', '\x86', '\x48', '\x86', '\xF7',
 
 static const char oidstr_smimeCapabilities[] = "1.2.840.113549.1.9.15";
 
-/* Helper for read_and_hash_cont().  */
-static gpg_error_t read_hash_block(ksba_cms_t cms, unsigned long nleft) {
+/* The size of the window used to move the content from the reader
+   to the writer.  The content of an enveloped or signed message may
+   be arbitrary large; it is never kept in memory as a whole but
+   streamed through this fixed window, one segment at a time.  */
+#define CONT_WINDOW_SIZE 65536
+
+/* Move NLEFT bytes from the reader to the writer and hash them if
+   HASH is set and a hash function has been set.  The writer may be
+   NULL to just do the hashing.  If the reader has the bytes in
+   memory they are handed to the consumers directly, otherwise they
+   are read into WINDOW, a buffer of CONT_WINDOW_SIZE bytes.  */
+static gpg_error_t copy_cont_segment(ksba_cms_t cms, int hash,
+                                     unsigned long nleft, char *window) {
   gpg_error_t err;
-  char buffer[4096];
+  const unsigned char *p;
   size_t n, nread;
 
   while (nleft) {
-    n = nleft < sizeof(buffer) ? nleft : sizeof(buffer);
-    err = ksba_reader_read(cms->reader, buffer, n, &nread);
+    n = nleft < CONT_WINDOW_SIZE ? nleft : CONT_WINDOW_SIZE;
+    err = _ksba_reader_map(cms->reader, n, &p, &nread);
+    if (err == GPG_ERR_NOT_IMPLEMENTED) {
+      err = ksba_reader_read(cms->reader, window, n, &nread);
+      p = (const unsigned char *)window;
+    }
     if (err) return err;
     nleft -= nread;
-    if (cms->hash_fnc) cms->hash_fnc(cms->hash_fnc_arg, buffer, nread);
-    if (cms->writer) err = ksba_writer_write(cms->writer, buffer, nread);
+    if (hash && cms->hash_fnc) cms->hash_fnc(cms->hash_fnc_arg, p, nread);
+    if (cms->writer) err = ksba_writer_write(cms->writer, p, nread);
     if (err) return err;
   }
   return 0;
 }
 
+/* Move the segments of a constructed octet string up to its end tag
+   from the reader to the writer.  Only primitive segments are
+   allowed.  */
+static gpg_error_t copy_cont_segments(ksba_cms_t cms, int hash,
+                                      char *window) {
+  gpg_error_t err;
+  struct tag_info ti;
+
+  for (;;) {
+    err = _ksba_ber_read_tl(cms->reader, &ti);
+    if (err) return err;
+    if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
+        !ti.is_constructed) {
+      err = copy_cont_segment(cms, hash, ti.length, window);
+      if (err) return err;
+    } else if (ti.klasse == CLASS_UNIVERSAL && !ti.tag && !ti.is_constructed)
+      return 0; /* ready with this chunk */
+    else
+      return GPG_ERR_ENCODING_PROBLEM;
+  }
+}
+
+/* Move the content with indefinite length encoding, which is a
+   sequence of primitive or constructed octet strings terminated by an
+   end tag, from the reader to the writer.  */
+static gpg_error_t copy_ndef_cont(ksba_cms_t cms, int hash, char *window) {
+  gpg_error_t err;
+  struct tag_info ti;
+
+  for (;;) {
+    err = _ksba_ber_read_tl(cms->reader, &ti);
+    if (err) return err;
+
+    if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
+        !ti.is_constructed) { /* next chunk */
+      err = copy_cont_segment(cms, hash, ti.length, window);
+      if (err) return err;
+    } else if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
+               ti.is_constructed) { /* next chunk is constructed */
+      err = copy_cont_segments(cms, hash, window);
+      if (err) return err;
+    } else if (ti.klasse == CLASS_UNIVERSAL && !ti.tag && !ti.is_constructed)
+      return 0; /* ready */
+    else
+      return GPG_ERR_ENCODING_PROBLEM;
+  }
+}
+
 /* Copy all the bytes from the reader to the writer and hash them if a
    a hash function has been set.  The writer may be NULL to just do
    the hashing */
@@ -112,39 +176,14 @@ static gpg_error_t read_and_hash_cont(ksba_cms_t cms) {
   gpg_error_t err = 0;
   unsigned long nleft;
   struct tag_info ti;
+  char *window;
 
-  if (cms->inner_cont_ndef) {
-    for (;;) {
-      err = _ksba_ber_read_tl(cms->reader, &ti);
-      if (err) return err;
+  window = (char *)xtrymalloc(CONT_WINDOW_SIZE);
+  if (!window) return GPG_ERR_ENOMEM;
 
-      if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
-          !ti.is_constructed) { /* next chunk */
-        nleft = ti.length;
-        err = read_hash_block(cms, nleft);
-        if (err) return err;
-      } else if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
-                 ti.is_constructed) { /* next chunk is constructed */
-        for (;;) {
-          err = _ksba_ber_read_tl(cms->reader, &ti);
-          if (err) return err;
-          if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
-              !ti.is_constructed) {
-            nleft = ti.length;
-            err = read_hash_block(cms, nleft);
-            if (err) return err;
-          } else if (ti.klasse == CLASS_UNIVERSAL && !ti.tag &&
-                     !ti.is_constructed)
-            break; /* ready with this chunk */
-          else
-            return GPG_ERR_ENCODING_PROBLEM;
-        }
-      } else if (ti.klasse == CLASS_UNIVERSAL && !ti.tag && !ti.is_constructed)
-        return 0; /* ready */
-      else
-        return GPG_ERR_ENCODING_PROBLEM;
-    }
-  } else {
+  if (cms->inner_cont_ndef)
+    err = copy_ndef_cont(cms, 1, window);
+  else {
     /* This is basically the same as above but we allow for
        arbitrary types.  Not sure whether it is really needed but
        right in the beginning of gnupg 1.9 we had at least one
@@ -156,128 +195,77 @@ static gpg_error_t read_and_hash_cont(ksba_cms_t cms) {
     nleft = cms->inner_cont_len;
     /* First read the octet string but allow all types here */
     err = _ksba_ber_read_tl(cms->reader, &ti);
-    if (err) return err;
-    if (nleft < ti.nhdr) return GPG_ERR_ENCODING_PROBLEM;
-    nleft -= ti.nhdr;
-
-    if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
-        ti.is_constructed) { /* Next chunk is constructed */
-      for (;;) {
-        err = _ksba_ber_read_tl(cms->reader, &ti);
-        if (err) return err;
-        if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
-            !ti.is_constructed) {
-          nleft = ti.length;
-          err = read_hash_block(cms, nleft);
-          if (err) return err;
-        } else if (ti.klasse == CLASS_UNIVERSAL && !ti.tag &&
-                   !ti.is_constructed)
-          break; /* Ready with this chunk */
-        else
-          return GPG_ERR_ENCODING_PROBLEM;
-      }
-    } else if (ti.klasse == CLASS_UNIVERSAL && !ti.tag && !ti.is_constructed)
-      return 0; /* ready */
-    else {
-      err = read_hash_block(cms, nleft);
-      if (err) return err;
+    if (!err && nleft < ti.nhdr) err = GPG_ERR_ENCODING_PROBLEM;
+    if (!err) {
+      nleft -= ti.nhdr;
+      if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
+          ti.is_constructed) /* Next chunk is constructed */
+        err = copy_cont_segments(cms, 1, window);
+      else if (ti.klasse == CLASS_UNIVERSAL && !ti.tag && !ti.is_constructed)
+        ; /* ready */
+      else
+        err = copy_cont_segment(cms, 1, nleft, window);
     }
   }
-  return 0;
+
+  xfree(window);
+  return err;
 }
 
 /* Copy all the encrypted bytes from the reader to the writer.
    Handles indefinite length encoding */
 static gpg_error_t read_encrypted_cont(ksba_cms_t cms) {
-  gpg_error_t err = 0;
-  unsigned long nleft;
-  char buffer[4096];
-  size_t n, nread;
+  gpg_error_t err;
+  char *window;
 
-  if (cms->inner_cont_ndef) {
-    struct tag_info ti;
+  window = (char *)xtrymalloc(CONT_WINDOW_SIZE);
+  if (!window) return GPG_ERR_ENOMEM;
 
-    /* fixme: this ist mostly a duplicate of the code in
-       read_and_hash_cont(). */
-    for (;;) {
-      err = _ksba_ber_read_tl(cms->reader, &ti);
-      if (err) return err;
+  if (cms->inner_cont_ndef)
+    err = copy_ndef_cont(cms, 0, window);
+  else
+    err = copy_cont_segment(cms, 0, cms->inner_cont_len, window);
 
-      if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
-          !ti.is_constructed) { /* next chunk */
-        nleft = ti.length;
-        while (nleft) {
-          n = nleft < sizeof(buffer) ? nleft : sizeof(buffer);
-          err = ksba_reader_read(cms->reader, buffer, n, &nread);
-          if (err) return err;
-          nleft -= nread;
-          err = ksba_writer_write(cms->writer, buffer, nread);
-          if (err) return err;
-        }
-      } else if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
-                 ti.is_constructed) { /* next chunk is constructed */
-        for (;;) {
-          err = _ksba_ber_read_tl(cms->reader, &ti);
-          if (err) return err;
-          if (ti.klasse == CLASS_UNIVERSAL && ti.tag == TYPE_OCTET_STRING &&
-              !ti.is_constructed) {
-            nleft = ti.length;
-            while (nleft) {
-              n = nleft < sizeof(buffer) ? nleft : sizeof(buffer);
-              err = ksba_reader_read(cms->reader, buffer, n, &nread);
-              if (err) return err;
-              nleft -= nread;
-              if (cms->writer)
-                err = ksba_writer_write(cms->writer, buffer, nread);
-              if (err) return err;
-            }
-          } else if (ti.klasse == CLASS_UNIVERSAL && !ti.tag &&
-                     !ti.is_constructed)
-            break; /* ready with this chunk */
-          else
-            return GPG_ERR_ENCODING_PROBLEM;
-        }
-      } else if (ti.klasse == CLASS_UNIVERSAL && !ti.tag && !ti.is_constructed)
-        return 0; /* ready */
-      else
-        return GPG_ERR_ENCODING_PROBLEM;
-    }
-  } else {
-    nleft = cms->inner_cont_len;
-    while (nleft) {
-      n = nleft < sizeof(buffer) ? nleft : sizeof(buffer);
-      err = ksba_reader_read(cms->reader, buffer, n, &nread);
-      if (err) return err;
-      nleft -= nread;
-      err = ksba_writer_write(cms->writer, buffer, nread);
-      if (err) return err;
-    }
-  }
-  return 0;
+  xfree(window);
+  return err;
 }
 
 /* copy data from reader to writer.  Assume that it is an octet string
-   and insert undefinite length headers where needed */
+   and insert undefinite length headers where needed.  Segments of up
+   to CONT_WINDOW_SIZE bytes are taken straight from the reader's
+   buffer if it has one, otherwise they are read into a window.  */
 static gpg_error_t write_encrypted_cont(ksba_cms_t cms) {
   gpg_error_t err = 0;
-  char buffer[4096];
+  const unsigned char *p;
+  char *window;
   size_t nread;
 
+  window = (char *)xtrymalloc(CONT_WINDOW_SIZE);
+  if (!window) return GPG_ERR_ENOMEM;
+
   /* we do it the simple way: the parts are made up from the chunks we
      got from the read function.
 
      Fixme: We should write the tag here, and write a definite length
      header if everything fits into our local buffer.  Actually pretty
      simple to do, but I am too lazy right now. */
-  while (
-      !(err = ksba_reader_read(cms->reader, buffer, sizeof buffer, &nread))) {
+  for (;;) {
+    err = _ksba_reader_map(cms->reader, CONT_WINDOW_SIZE, &p, &nread);
+    if (err == GPG_ERR_NOT_IMPLEMENTED) {
+      err = ksba_reader_read(cms->reader, window, CONT_WINDOW_SIZE, &nread);
+      p = (const unsigned char *)window;
+    }
+    if (err) break;
+    if (!nread) continue;
     err = _ksba_ber_write_tl(cms->writer, TYPE_OCTET_STRING, CLASS_UNIVERSAL, 0,
                              nread);
-    if (!err) err = ksba_writer_write(cms->writer, buffer, nread);
+    if (!err) err = ksba_writer_write(cms->writer, p, nread);
+    if (err) break;
   }
   if (err == GPG_ERR_EOF) /* write the end tag */
     err = _ksba_ber_write_tl(cms->writer, 0, (tag_class)(0), 0, 0);
 
+  xfree(window);
   return err;
 }
 
@@ -1910,7 +1898,7 @@ static gpg_error_t build_signed_data_attributes(ksba_cms_t cms) {
 
   /* Now we have to prepare the signer info.  For now we will just build the
      signedAttributes, so that the user can do the signature calculation */
-  err = ksba_asn_create_tree("cms", &cms_tree);
+  err = _ksba_asn_get_module("cms", &cms_tree);
   if (err) return err;
 
   certlist = cms->cert_list;
@@ -2144,7 +2132,7 @@ static gpg_error_t build_signed_data_rest(ksba_cms_t cms) {
   AsnNode root = NULL;
 
   /* Now we can really write the signer info */
-  err = ksba_asn_create_tree("cms", &cms_tree);
+  err = _ksba_asn_get_module("cms", &cms_tree);
   if (err) return err;
 
   certlist = cms->cert_list;
@@ -2419,7 +2407,7 @@ static gpg_error_t build_enveloped_data_header(ksba_cms_t cms) {
      for SPHINX */
 
   /* Now we write the recipientInfo */
-  err = ksba_asn_create_tree("cms", &cms_tree);
+  err = _ksba_asn_get_module("cms", &cms_tree);
   if (err) return err;
 
   certlist = cms->cert_list;
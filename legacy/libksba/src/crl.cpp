@@ -572,7 +572,7 @@ static gpg_error_t create_and_run_decoder(ksba_reader_t reader,
   ksba_asn_tree_t crl_tree;
   BerDecoder decoder;
 
-  err = ksba_asn_create_tree("tmttv2", &crl_tree);
+  err = _ksba_asn_get_module("tmttv2", &crl_tree);
   if (err) return err;
 
   decoder = _ksba_ber_decoder_new();
@@ -411,6 +411,7 @@ gpg_error_t ksba_reader_set_file(ksba_reader_t r, FILE *fp);
 gpg_error_t ksba_reader_set_cb(ksba_reader_t r,
                                int (*cb)(void *, char *, size_t, size_t *),
                                void *cb_value);
+gpg_error_t ksba_reader_set_bufsize(ksba_reader_t r, size_t size);
 
 gpg_error_t ksba_reader_read(ksba_reader_t r, char *buffer, size_t length,
                              size_t *nread);
@@ -431,6 +432,7 @@ gpg_error_t ksba_writer_set_cb(ksba_writer_t w,
                                int (*cb)(void *, const void *, size_t),
                                void *cb_value);
 gpg_error_t ksba_writer_set_mem(ksba_writer_t w, size_t initial_size);
+gpg_error_t ksba_writer_set_bufsize(ksba_writer_t w, size_t size);
 const void *ksba_writer_get_mem(ksba_writer_t w, size_t *nbytes);
 void *ksba_writer_snatch_mem(ksba_writer_t w, size_t *nbytes);
 gpg_error_t ksba_writer_set_filter(
@@ -69,6 +69,7 @@ void ksba_reader_release(ksba_reader_t r) {
   }
   if (r->type == READER_TYPE_MEM) xfree(r->u.mem.buffer);
   xfree(r->unread.buf);
+  xfree(r->input.buf);
   xfree(r);
 }
 
@@ -93,7 +94,9 @@ gpg_error_t ksba_reader_set_release_notify(ksba_reader_t r,
    the logical end of one part of a file.  If BUFFER and BUFLEN are
    not NULL, possible unread data is copied to a newly allocated
    buffer and this buffer is assigned to BUFFER, BUFLEN will be set to
-   the length of the unread bytes. */
+   the length of the unread bytes.  Bytes already in the read-ahead
+   buffer (see ksba_reader_set_bufsize) are kept; they have not been
+   seen by the upper layer and are returned by the next read. */
 gpg_error_t ksba_reader_clear(ksba_reader_t r, unsigned char **buffer,
                               size_t *buflen) {
   size_t n;
@@ -238,6 +241,55 @@ gpg_error_t ksba_reader_set_cb(ksba_reader_t r,
   return 0;
 }
 
+/**
+ * ksba_reader_set_bufsize:
+ * @r: Reader object
+ * @size: Size of the read-ahead buffer
+ *
+ * Let a reader initialized with ksba_reader_set_cb ask the callback
+ * for @size bytes at a time and keep them in a buffer, instead of
+ * invoking the callback for every read.  The parsers read the BER
+ * headers a few bytes at a time, so this saves most callback
+ * invocations.  Reads of at least @size bytes bypass the buffer.  A
+ * @size of %0 disables read-ahead, which is the default.
+ *
+ * Return value: 0 on success or an error code.  %GPG_ERR_CONFLICT is
+ * returned if the buffer still holds bytes.
+ **/
+gpg_error_t ksba_reader_set_bufsize(ksba_reader_t r, size_t size) {
+  unsigned char *p = NULL;
+
+  if (!r) return GPG_ERR_INV_VALUE;
+  if (r->input.length > r->input.readpos) return GPG_ERR_CONFLICT;
+
+  if (size) {
+    p = (unsigned char *)xtrymalloc(size);
+    if (!p) return gpg_error_from_errno(errno);
+  }
+  xfree(r->input.buf);
+  r->input.buf = p;
+  r->input.size = size;
+  r->input.length = r->input.readpos = 0;
+  return 0;
+}
+
+/* Fill the read-ahead buffer of the callback reader R, which must be
+   empty.  Returns 0 on success, even if the callback has no bytes
+   available right now, or GPG_ERR_EOF.  */
+static gpg_error_t fill_input(ksba_reader_t r) {
+  size_t n;
+
+  r->input.length = r->input.readpos = 0;
+  if (r->eof) return GPG_ERR_EOF;
+  if (r->u.cb.fnc(r->u.cb.value, (char *)r->input.buf, r->input.size, &n)) {
+    r->eof = 1;
+    return GPG_ERR_EOF;
+  }
+  if (n > r->input.size) return GPG_ERR_BUG;
+  r->input.length = n;
+  return 0;
+}
+
 /**
  * ksba_reader_read:
  * @r: Readder object
@@ -254,7 +306,8 @@ gpg_error_t ksba_reader_set_cb(ksba_reader_t r,
  * the number of bytes available and does not move the read pointer.
  * This does only work for objects initialized from memory; if the
  * object is not capable of this it will return the error
- * GPG_ERR_NOT_IMPLEMENTED
+ * GPG_ERR_NOT_IMPLEMENTED.  Callback readers return the number of
+ * bytes they have buffered, if there are any.
  *
  * Return value: 0 on success, GPG_ERR_EOF or another error code
  **/
@@ -265,6 +318,12 @@ gpg_error_t ksba_reader_read(ksba_reader_t r, char *buffer, size_t length,
   if (!r || !nread) return GPG_ERR_INV_VALUE;
 
   if (!buffer) {
+    if (r->type == READER_TYPE_CB) {
+      *nread = r->input.length - r->input.readpos;
+      if (r->unread.buf) *nread += r->unread.length - r->unread.readpos;
+      if (*nread) return 0;
+      return r->eof ? GPG_ERR_EOF : GPG_ERR_NOT_IMPLEMENTED;
+    }
     if (r->type != READER_TYPE_MEM) return GPG_ERR_NOT_IMPLEMENTED;
     *nread = r->u.mem.size - r->u.mem.readpos;
     if (r->unread.buf) *nread += r->unread.length - r->unread.readpos;
@@ -324,17 +383,82 @@ gpg_error_t ksba_reader_read(ksba_reader_t r, char *buffer, size_t length,
       if (!n) return GPG_ERR_EOF;
     }
   } else if (r->type == READER_TYPE_CB) {
-    if (r->eof) return GPG_ERR_EOF;
+    if (r->input.length == r->input.readpos) {
+      if (r->eof) return GPG_ERR_EOF;
+
+      if (length >= r->input.size) {
+        /* No read-ahead or a large read: use the caller's buffer.  */
+        if (r->u.cb.fnc(r->u.cb.value, buffer, length, nread)) {
+          *nread = 0;
+          r->eof = 1;
+          return GPG_ERR_EOF;
+        }
+        r->nread += *nread;
+        return 0;
+      }
+      if (fill_input(r)) return GPG_ERR_EOF;
+    }
 
-    if (r->u.cb.fnc(r->u.cb.value, buffer, length, nread)) {
-      *nread = 0;
+    /* Bytes in the buffer are returned even after an EOF.  */
+    nbytes = r->input.length - r->input.readpos;
+    if (nbytes > length) nbytes = length;
+    memcpy(buffer, r->input.buf + r->input.readpos, nbytes);
+    r->input.readpos += nbytes;
+    *nread = nbytes;
+    r->nread += nbytes;
+  } else
+    return GPG_ERR_BUG;
+
+  return 0;
+}
+
+/* Return in R_BUF a pointer to up to LENGTH bytes of the input which
+   are already in memory and consume them, so that they can be handed
+   to the consumer without copying them into another buffer first.
+   The number of bytes is returned in R_LEN; it may be less than
+   LENGTH.  The pointer is only valid until the next operation on R.
+   For callback readers with a read-ahead buffer, the buffer is
+   filled if it is empty, and R_LEN may be 0 if the callback had no
+   bytes available.  GPG_ERR_NOT_IMPLEMENTED is returned if R does not
+   read from memory, has no read-ahead buffer and nothing has been
+   pushed back; ksba_reader_read should be used then.  */
+gpg_error_t _ksba_reader_map(ksba_reader_t r, size_t length,
+                             const unsigned char **r_buf, size_t *r_len) {
+  size_t nbytes;
+
+  if (!r || !r_buf || !r_len) return GPG_ERR_INV_VALUE;
+  *r_buf = NULL;
+  *r_len = 0;
+
+  if (r->unread.buf && r->unread.length) {
+    nbytes = r->unread.length - r->unread.readpos;
+    if (!nbytes) return GPG_ERR_BUG;
+    if (nbytes > length) nbytes = length;
+    *r_buf = r->unread.buf + r->unread.readpos;
+    r->unread.readpos += nbytes;
+    if (r->unread.readpos == r->unread.length)
+      r->unread.readpos = r->unread.length = 0;
+  } else if (r->type == READER_TYPE_MEM) {
+    nbytes = r->u.mem.size - r->u.mem.readpos;
+    if (!nbytes) {
       r->eof = 1;
       return GPG_ERR_EOF;
     }
-    r->nread += *nread;
+    if (nbytes > length) nbytes = length;
+    *r_buf = r->u.mem.buffer + r->u.mem.readpos;
+    r->u.mem.readpos += nbytes;
+  } else if (r->type == READER_TYPE_CB && r->input.size) {
+    if (r->input.length == r->input.readpos && fill_input(r))
+      return GPG_ERR_EOF;
+    nbytes = r->input.length - r->input.readpos;
+    if (nbytes > length) nbytes = length;
+    *r_buf = r->input.buf + r->input.readpos;
+    r->input.readpos += nbytes;
   } else
-    return GPG_ERR_BUG;
+    return GPG_ERR_NOT_IMPLEMENTED;
 
+  *r_len = nbytes;
+  r->nread += nbytes;
   return 0;
 }
 
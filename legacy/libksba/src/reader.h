@@ -51,6 +51,12 @@ struct ksba_reader_s {
     size_t length;  /* used size */
     size_t readpos; /* offset where to start the next read */
   } unread;
+  struct {
+    unsigned char *buf; /* read-ahead buffer for READER_TYPE_CB */
+    size_t size;        /* allocated size */
+    size_t length;      /* used size */
+    size_t readpos;     /* offset where to start the next read */
+  } input;
   enum reader_type type;
   union {
     struct {
@@ -69,4 +75,7 @@ struct ksba_reader_s {
   void *notify_cb_value;
 };
 
+gpg_error_t _ksba_reader_map(ksba_reader_t r, size_t length,
+                             const unsigned char **r_buf, size_t *r_len);
+
 #endif /*READER_H*/
@@ -71,6 +71,7 @@ void ksba_writer_release(ksba_writer_t w) {
     notify_fnc(w->notify_cb_value, w);
   }
   if (w->type == WRITER_TYPE_MEM) xfree(w->u.mem.buffer);
+  xfree(w->filter_buf);
   xfree(w);
 }
 
@@ -189,6 +190,32 @@ gpg_error_t ksba_writer_set_mem(ksba_writer_t w, size_t initial_size) {
   return 0;
 }
 
+/**
+ * ksba_writer_set_bufsize:
+ * @w: Writer object
+ * @size: Size of the filter output buffer
+ *
+ * Let the filter set with ksba_writer_set_filter produce up to @size
+ * bytes at a time, so that large writes are passed on in large
+ * chunks.  A @size of %0 restores the default of 4096 bytes.
+ *
+ * Return value: 0 on success or an error code
+ **/
+gpg_error_t ksba_writer_set_bufsize(ksba_writer_t w, size_t size) {
+  unsigned char *p = NULL;
+
+  if (!w) return GPG_ERR_INV_VALUE;
+
+  if (size) {
+    p = (unsigned char *)xtrymalloc(size);
+    if (!p) return gpg_error_from_errno(errno);
+  }
+  xfree(w->filter_buf);
+  w->filter_buf = p;
+  w->filter_bufsize = size;
+  return 0;
+}
+
 /* Return the pointer to the memory and the size of it.  This pointer
    is valid as long as the writer object is valid and no write
    operations takes place (because they might reallocate the buffer).
@@ -306,15 +333,16 @@ gpg_error_t ksba_writer_write(ksba_writer_t w, const void *buffer,
   if (!buffer) return GPG_ERR_NOT_IMPLEMENTED;
 
   if (w->filter) {
-    char outbuf[4096];
+    char buf4k[4096];
+    char *outbuf = w->filter_buf ? (char *)w->filter_buf : buf4k;
+    size_t outsize = w->filter_buf ? w->filter_bufsize : sizeof buf4k;
     size_t nin, nout;
     const char *p = (const char *)buffer;
 
     while (length) {
-      err = w->filter(w->filter_arg, p, length, &nin, outbuf, sizeof(outbuf),
-                      &nout);
+      err = w->filter(w->filter_arg, p, length, &nin, outbuf, outsize, &nout);
       if (err) break;
-      if (nin > length || nout > sizeof(outbuf))
+      if (nin > length || nout > outsize)
         return GPG_ERR_BUG; /* tsss, someone else made an error */
       err = do_writer_write(w, outbuf, nout);
       if (err) break;
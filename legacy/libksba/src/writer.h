@@ -50,6 +50,8 @@ struct ksba_writer_s {
   gpg_error_t (*filter)(void *, const void *, size_t, size_t *, void *, size_t,
                         size_t *);
   void *filter_arg;
+  unsigned char *filter_buf; /* output buffer for the filter */
+  size_t filter_bufsize;     /* its size; 0 for the default */
 
   union {
     int fd;     /* for WRITER_TYPE_FD */
@@ -5,6 +5,7 @@
 int oid_main(int argc, char* argv[]);
 int crl_parser_main(int argc, char* argv[]);
 int dnparser_main(int argc, char* argv[]);
+int reader_main(int argc, char* argv[]);
 
 TEST(KsbaTest, oid) {
   int result = oid_main(0, NULL);
@@ -20,3 +21,8 @@ TEST(KsbaTest, dnparser) {
   int result = dnparser_main(0, NULL);
   ASSERT_EQ(result, 0);
 }
+
+TEST(KsbaTest, reader) {
+  int result = reader_main(0, NULL);
+  ASSERT_EQ(result, 0);
+}
@@ -0,0 +1,178 @@
+/* t-reader.c - Test for the reader object
+ *      Copyright (C) 2018 The NeoPG developers
+ *
+ * This file is part of KSBA.
+ *
+ * KSBA is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * KSBA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/ksba.h"
+#include "t-common.h"
+
+#define DATALEN 10000
+#define BUFSIZE 4096
+
+struct cb_parm_s {
+  const unsigned char *data;
+  size_t length;
+  size_t readpos;
+  int ncalls;
+};
+
+static int read_cb(void *cb_value, char *buffer, size_t count, size_t *nread) {
+  struct cb_parm_s *parm = (struct cb_parm_s *)cb_value;
+  size_t n = parm->length - parm->readpos;
+
+  parm->ncalls++;
+  *nread = 0;
+  if (!n) return -1; /* eof */
+  if (n > count) n = count;
+  memcpy(buffer, parm->data + parm->readpos, n);
+  parm->readpos += n;
+  *nread = n;
+  return 0;
+}
+
+static void make_data(unsigned char *data) {
+  int i;
+
+  for (i = 0; i < DATALEN; i++) data[i] = (unsigned char)(i * 7 + (i >> 8));
+}
+
+static ksba_reader_t new_reader(struct cb_parm_s *parm,
+                                const unsigned char *data) {
+  ksba_reader_t r;
+  gpg_error_t err;
+
+  memset(parm, 0, sizeof *parm);
+  parm->data = data;
+  parm->length = DATALEN;
+  err = ksba_reader_new(&r);
+  fail_if_err(err);
+  err = ksba_reader_set_cb(r, read_cb, parm);
+  fail_if_err(err);
+  err = ksba_reader_set_bufsize(r, BUFSIZE);
+  fail_if_err(err);
+  return r;
+}
+
+/* Small reads are served from the read-ahead buffer.  */
+static void test_small_reads(void) {
+  static unsigned char data[DATALEN];
+  unsigned char buf[DATALEN];
+  struct cb_parm_s parm;
+  ksba_reader_t r;
+  gpg_error_t err;
+  size_t n, total;
+  int i;
+
+  make_data(data);
+  r = new_reader(&parm, data);
+
+  for (i = 0; i < 100; i++) {
+    err = ksba_reader_read(r, (char *)buf + i, 1, &n);
+    fail_if_err(err);
+    if (n != 1) fail("short read");
+  }
+  if (memcmp(buf, data, 100)) fail("wrong data");
+  if (parm.ncalls != 1) fail("callback not buffered");
+
+  err = ksba_reader_read(r, NULL, 0, &n);
+  fail_if_err(err);
+  if (n != BUFSIZE - 100) fail("wrong number of buffered bytes");
+  if (ksba_reader_set_bufsize(r, 2 * BUFSIZE) != GPG_ERR_CONFLICT)
+    fail("buffer resized while in use");
+
+  err = ksba_reader_unread(r, buf + 90, 10);
+  fail_if_err(err);
+  if (ksba_reader_tell(r) != 90) fail("wrong position after unread");
+
+  for (total = 90; !(err = ksba_reader_read(r, (char *)buf + total,
+                                            DATALEN - total, &n));)
+    total += n;
+  if (err != GPG_ERR_EOF) fail_if_err(err);
+  if (total != DATALEN || memcmp(buf, data, DATALEN)) fail("wrong data");
+  if (ksba_reader_tell(r) != DATALEN) fail("wrong position at eof");
+
+  ksba_reader_release(r);
+}
+
+/* Reads of at least the buffer size bypass the buffer.  */
+static void test_large_reads(void) {
+  static unsigned char data[DATALEN];
+  unsigned char buf[DATALEN];
+  struct cb_parm_s parm;
+  ksba_reader_t r;
+  gpg_error_t err;
+  size_t n;
+
+  make_data(data);
+  r = new_reader(&parm, data);
+
+  err = ksba_reader_read(r, (char *)buf, 2 * BUFSIZE, &n);
+  fail_if_err(err);
+  if (n != 2 * BUFSIZE || memcmp(buf, data, n)) fail("wrong data");
+  if (ksba_reader_read(r, NULL, 0, &n) != GPG_ERR_NOT_IMPLEMENTED)
+    fail("large read was buffered");
+
+  err = ksba_reader_read(r, (char *)buf, 10, &n);
+  fail_if_err(err);
+  if (n != 10 || memcmp(buf, data + 2 * BUFSIZE, n)) fail("wrong data");
+  if (parm.ncalls != 2) fail("wrong number of callbacks");
+
+  ksba_reader_release(r);
+}
+
+/* Clearing the EOF keeps the bytes not yet returned.  */
+static void test_clear(void) {
+  static unsigned char data[DATALEN];
+  unsigned char buf[DATALEN];
+  struct cb_parm_s parm;
+  ksba_reader_t r;
+  gpg_error_t err;
+  size_t n, total;
+
+  make_data(data);
+  r = new_reader(&parm, data);
+
+  err = ksba_reader_read(r, (char *)buf, 1, &n);
+  fail_if_err(err);
+  err = ksba_reader_clear(r, NULL, NULL);
+  fail_if_err(err);
+
+  for (total = 1; !(err = ksba_reader_read(r, (char *)buf + total,
+                                           DATALEN - total, &n));)
+    total += n;
+  if (err != GPG_ERR_EOF) fail_if_err(err);
+  if (total != DATALEN || memcmp(buf, data, DATALEN)) fail("wrong data");
+
+  ksba_reader_release(r);
+}
+
+int reader_main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+
+  test_small_reads();
+  test_large_reads();
+  test_clear();
+
+  return 0;
+}
@@ -5,62 +5,59 @@
 */
 
 #include <iostream>
+#include <stdexcept>
 
-#include <botan/filters.h>
+#include <botan/exceptn.h>
 
 #include <neopg-tool/cli/armor_command.h>
+#include <neopg-tool/io/file_io.h>
+
+#include <neopg/openpgp/armor.h>
 
 namespace NeoPG {
 
 void ArmorCommand::encode() {
-  bool has_title = !m_title.empty();
-
   if (m_files.empty()) m_files.emplace_back("-");
 
   for (auto& file : m_files) {
-    Botan::Filter* sink = (file == "-")
-                              ? new Botan::DataSink_Stream(std::cout)
-                              : new Botan::DataSink_Stream(file + ".asc", true);
-
-    const int PGP_WIDTH{64};
-    Botan::Pipe pipe(new Botan::Fork(
-        new Botan::Chain(new Botan::Base64_Encoder(true, PGP_WIDTH), sink),
-        new Botan::Chain(new Botan::Hash_Filter("CRC24"),
-                         new Botan::Base64_Encoder())));
-
-    if (has_title) {
-      std::stringstream header_;
-      header_ << "-----BEGIN " << m_title << "-----\n\n";
-      const auto header = header_.str();
-      sink->write((uint8_t*)header.data(), header.size());
-    }
-
-    if (file == "-") {
-      Botan::DataSource_Stream in{std::cin};
-      pipe.process_msg(in);
-    } else {
-      Botan::DataSource_Stream in{file, true};
-      pipe.process_msg(in);
-    }
-
-    if (m_crc24) {
-      std::stringstream crc_;
-      crc_ << "=" << pipe.read_all_as_string(1) << "\n";
-      const auto crc = crc_.str();
-      sink->write((uint8_t*)crc.data(), crc.size());
-    }
-
-    if (has_title) {
-      std::stringstream footer_;
-      footer_ << "-----END " << m_title << "-----\n";
-      const auto footer = footer_.str();
-      sink->write((uint8_t*)footer.data(), footer.size());
-    }
+    InputFile in{file};
+    OutputFile out{file == "-" ? file : file + ".asc"};
+
+    ArmorEncoder armor{out.stream(), m_title, m_crc24};
+    in.for_each_block([&armor](const uint8_t* data, size_t length) {
+      armor.write(data, length);
+    });
+    armor.finish();
+    out.flush();
   }
 }
 
 void ArmorCommand::decode() {
-  // TODO
+  if (m_files.empty()) m_files.emplace_back("-");
+
+  for (auto& file : m_files) {
+    // Like "gpg --dearmor", write FILE.asc to FILE, and others to FILE.gpg.
+    const std::string suffix{".asc"};
+    std::string out_name = file + ".gpg";
+    if (file.size() > suffix.size() &&
+        file.compare(file.size() - suffix.size(), suffix.size(), suffix) == 0)
+      out_name = file.substr(0, file.size() - suffix.size());
+
+    InputFile in{file};
+    OutputFile out{file == "-" ? file : out_name};
+
+    ArmorDecoder armor{out.stream()};
+    try {
+      in.for_each_block([&armor](const uint8_t* data, size_t length) {
+        armor.write(reinterpret_cast<const char*>(data), length);
+      });
+      armor.finish();
+    } catch (const std::runtime_error& exc) {
+      std::cerr << "neopg armor: " << file << ": " << exc.what() << "\n";
+      throw CLI::RuntimeError(1);
+    }
+    out.flush();
+  }
 }
 
 void ArmorCommand::run() {
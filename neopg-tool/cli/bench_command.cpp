@@ -0,0 +1,424 @@
+// NeoPG bench command (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg-tool/cli/bench_command.h>
+
+#include <neopg/crypto/rng.h>
+#include <neopg/openpgp/armor.h>
+#include <neopg/openpgp/raw_packet.h>
+#include <neopg/parser/openpgp.h>
+#include <neopg/utils/stream.h>
+
+#include <botan/compression.h>
+#include <botan/exceptn.h>
+#include <botan/hash.h>
+#include <botan/pk_algs.h>
+#include <botan/pubkey.h>
+
+#include <tao/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace NeoPG {
+
+namespace {
+
+// One benchmark operation.  Returns the number of input bytes processed, or
+// 0 for operations that are only counted.
+using Operation = std::function<uint64_t()>;
+
+// Create the operation (with its own state) for one thread.  This is called
+// on the thread that runs the operation.
+using OperationFactory = std::function<Operation()>;
+
+struct Measurement {
+  uint64_t m_ops{0};
+  uint64_t m_bytes{0};
+  double m_seconds{0};
+};
+
+// Run an operation from factory on each of threads threads, until
+// min_time seconds have passed.  Every thread runs at least once.
+Measurement measure(size_t threads, double min_time,
+                    const OperationFactory& factory) {
+  using clock = std::chrono::steady_clock;
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t ready = 0;
+  bool go = false;
+  std::atomic<bool> stop{false};
+  std::vector<Measurement> results(threads);
+  std::vector<std::exception_ptr> errors(threads);
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < threads; i++)
+    workers.emplace_back([&, i]() {
+      Operation op;
+      try {
+        op = factory();
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready++;
+        cond.notify_all();
+        cond.wait(lock, [&go]() { return go; });
+      }
+      if (errors[i]) return;
+      try {
+        do {
+          results[i].m_bytes += op();
+          results[i].m_ops++;
+        } while (!stop);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+
+  // Setup is not measured.
+  clock::time_point start;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&ready, threads]() { return ready == threads; });
+    start = clock::now();
+    go = true;
+    cond.notify_all();
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(min_time));
+  stop = true;
+  for (auto& worker : workers) worker.join();
+
+  Measurement total;
+  total.m_seconds =
+      std::chrono::duration<double>(clock::now() - start).count();
+  for (size_t i = 0; i < threads; i++) {
+    if (errors[i]) std::rethrow_exception(errors[i]);
+    total.m_ops += results[i].m_ops;
+    total.m_bytes += results[i].m_bytes;
+  }
+  return total;
+}
+
+class NullSink : public RawPacketRefSink {
+ public:
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override {}
+  void start_packet(const PacketHeader& header) override {}
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override {}
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override {}
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override {}
+};
+
+// A synthetic keyring of count keys, with the packet sizes of a V4 RSA-2048
+// key with one user ID and an encryption subkey.  Only the framing is
+// realistic, the packet contents are not.
+std::string synthetic_keyring(size_t count) {
+  std::string out;
+  for (size_t i = 0; i < count; i++) {
+    std::string id = std::to_string(i);
+    RawPacket{PacketType::PublicKey, std::string(270, 'k') + id}.write(out);
+    RawPacket{PacketType::UserId, "Test User " + id + " <test@example.org>"}
+        .write(out);
+    RawPacket{PacketType::Signature, std::string(300, 's') + id}.write(out);
+    RawPacket{PacketType::PublicSubkey, std::string(270, 'k') + id}.write(out);
+    RawPacket{PacketType::Signature, std::string(290, 's') + id}.write(out);
+  }
+  return out;
+}
+
+// The hash functions of "neopg hash list", with typical parameters.
+const std::vector<std::string> HASHES = {
+    "SHA-160",      "SHA-224",      "SHA-256",     "SHA-384",
+    "SHA-512",      "SHA-512-256",  "RIPEMD-160",  "Whirlpool",
+    "MD5",          "MD4",          "GOST-34.11",  "Adler32",
+    "CRC24",        "CRC32",        "Tiger",       "Skein-512",
+    "Blake2b(512)", "Keccak-1600",  "SHA-3(256)",  "SHAKE-128(256)",
+    "Streebog-256", "Streebog-512", "SM3"};
+
+// The algorithms of "neopg compress list".
+const std::vector<std::string> COMPRESSIONS = {"zlib", "gzip", "deflate",
+                                               "bzip2", "lzma"};
+
+// Public key algorithms and their parameters for sign and verify.
+struct KeyAlgorithm {
+  const char* m_name;
+  const char* m_algo;
+  const char* m_params;
+  const char* m_padding;
+};
+
+const std::vector<KeyAlgorithm> KEY_ALGORITHMS = {
+    {"RSA-2048", "RSA", "2048", "EMSA3(SHA-256)"},
+    {"RSA-4096", "RSA", "4096", "EMSA3(SHA-256)"},
+    {"DSA-2048", "DSA", "dsa/botan/2048", "EMSA1(SHA-256)"},
+    {"ECDSA-P256", "ECDSA", "secp256r1", "EMSA1(SHA-256)"},
+    {"ECDSA-P384", "ECDSA", "secp384r1", "EMSA1(SHA-384)"},
+    {"Ed25519", "Ed25519", "", "Pure"}};
+
+const std::set<std::string> CATEGORIES = {"hash",   "compress", "armor",
+                                          "parser", "rng",      "sign"};
+
+class Bench {
+ public:
+  Bench(double min_time, const std::vector<unsigned int>& threads)
+      : m_min_time(min_time), m_threads(threads) {}
+
+  // Measure the operations created by factory with all thread counts.
+  void run(const std::string& category, const std::string& name,
+           const OperationFactory& factory) {
+    for (auto threads : m_threads) {
+      Measurement result = measure(threads, m_min_time, factory);
+      tao::json::value entry = {
+          {"category", category},
+          {"name", name},
+          {"threads", threads},
+          {"ops", result.m_ops},
+          {"seconds", result.m_seconds},
+          {"ops_per_second", result.m_ops / result.m_seconds}};
+      if (result.m_bytes)
+        entry["mb_per_second"] = result.m_bytes / result.m_seconds / 1e6;
+      m_results.emplace_back(std::move(entry));
+      std::cerr << category << "/" << name << " (" << threads
+                << " threads): " << result.m_ops / result.m_seconds
+                << " ops/s\n";
+    }
+  }
+
+  // Report that name in category is not available.
+  void skip(const std::string& category, const std::string& name,
+            const std::string& reason) {
+    std::cerr << category << "/" << name << ": skipped: " << reason << "\n";
+  }
+
+  tao::json::value results() const { return tao::json::value(m_results); }
+
+ private:
+  double m_min_time;
+  std::vector<unsigned int> m_threads;
+  std::vector<tao::json::value> m_results;
+};
+
+void bench_hashes(Bench& bench, const std::string& data) {
+  for (const auto& name : HASHES) {
+    if (!Botan::HashFunction::create(name)) {
+      bench.skip("hash", name, "not available");
+      continue;
+    }
+    bench.run("hash", name, [&name, &data]() -> Operation {
+      std::shared_ptr<Botan::HashFunction> hash{
+          Botan::HashFunction::create_or_throw(name)};
+      return [hash, &data]() {
+        hash->update(reinterpret_cast<const uint8_t*>(data.data()),
+                     data.size());
+        hash->final();
+        return data.size();
+      };
+    });
+  }
+}
+
+void bench_compressions(Bench& bench, const std::string& data) {
+  for (const auto& name : COMPRESSIONS) {
+    std::unique_ptr<Botan::Compression_Algorithm> probe{
+        Botan::make_compressor(name)};
+    if (!probe) {
+      bench.skip("compress", name, "not available");
+      continue;
+    }
+    Botan::secure_vector<uint8_t> compressed(data.begin(), data.end());
+    probe->start();
+    probe->finish(compressed);
+
+    bench.run("compress", name + "/compress", [&name, &data]() -> Operation {
+      std::shared_ptr<Botan::Compression_Algorithm> compressor{
+          Botan::make_compressor(name)};
+      return [compressor, &data]() {
+        Botan::secure_vector<uint8_t> buffer(data.begin(), data.end());
+        compressor->start();
+        compressor->finish(buffer);
+        return data.size();
+      };
+    });
+    // Throughput is measured in uncompressed bytes, too.
+    bench.run("compress", name + "/decompress",
+              [&name, &data, &compressed]() -> Operation {
+                std::shared_ptr<Botan::Decompression_Algorithm> decompressor{
+                    Botan::make_decompressor(name)};
+                return [decompressor, &data, &compressed]() {
+                  Botan::secure_vector<uint8_t> buffer{compressed};
+                  decompressor->start();
+                  decompressor->finish(buffer);
+                  return data.size();
+                };
+              });
+  }
+}
+
+void bench_armor(Bench& bench, const std::string& data) {
+  std::string armored;
+  {
+    BufferStream out{armored};
+    ArmorEncoder armor{out, "PGP PUBLIC KEY BLOCK"};
+    armor.write(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    armor.finish();
+  }
+
+  bench.run("armor", "encode", [&data]() -> Operation {
+    return [&data]() {
+      CountingStream out;
+      ArmorEncoder armor{out, "PGP PUBLIC KEY BLOCK"};
+      armor.write(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+      armor.finish();
+      return data.size();
+    };
+  });
+  bench.run("armor", "decode", [&data, &armored]() -> Operation {
+    return [&data, &armored]() {
+      CountingStream out;
+      ArmorDecoder armor{out};
+      armor.write(armored.data(), armored.size());
+      armor.finish();
+      return data.size();
+    };
+  });
+}
+
+void bench_parser(Bench& bench) {
+  const std::string keyring = synthetic_keyring(1000);
+  bench.run("parser", "keyring-1000-keys", [&keyring]() -> Operation {
+    return [&keyring]() {
+      NullSink sink;
+      RawPacketParser parser{sink};
+      parser.process(keyring.data(), keyring.size());
+      return keyring.size();
+    };
+  });
+}
+
+void bench_rng(Bench& bench, size_t size) {
+  bench.run("rng", "rng", [size]() -> Operation {
+    // The generator of the benchmark thread.
+    Botan::RandomNumberGenerator* generator = rng();
+    std::shared_ptr<std::vector<uint8_t>> buffer =
+        std::make_shared<std::vector<uint8_t>>(size);
+    return [generator, buffer]() {
+      generator->randomize(buffer->data(), buffer->size());
+      return buffer->size();
+    };
+  });
+}
+
+void bench_sign(Bench& bench) {
+  const std::vector<uint8_t> message(64, 0x42);
+  for (const auto& algo : KEY_ALGORITHMS) {
+    std::shared_ptr<Botan::Private_Key> key;
+    try {
+      key = Botan::create_private_key(algo.m_algo, *rng(), algo.m_params);
+    } catch (const std::exception& exc) {
+      bench.skip("sign", algo.m_name, exc.what());
+      continue;
+    }
+    if (!key) {
+      bench.skip("sign", algo.m_name, "not available");
+      continue;
+    }
+
+    std::vector<uint8_t> signature;
+    {
+      Botan::PK_Signer signer{*key, *rng(), algo.m_padding};
+      signature = signer.sign_message(message, *rng());
+    }
+
+    bench.run("sign", std::string(algo.m_name) + "/sign",
+              [&key, &algo, &message]() -> Operation {
+                Botan::RandomNumberGenerator* generator = rng();
+                std::shared_ptr<Botan::PK_Signer> signer =
+                    std::make_shared<Botan::PK_Signer>(*key, *generator,
+                                                       algo.m_padding);
+                return [signer, generator, &message]() {
+                  signer->sign_message(message, *generator);
+                  return 0;
+                };
+              });
+    bench.run("sign", std::string(algo.m_name) + "/verify",
+              [&key, &algo, &message, &signature]() -> Operation {
+                std::shared_ptr<Botan::PK_Verifier> verifier =
+                    std::make_shared<Botan::PK_Verifier>(*key,
+                                                         algo.m_padding);
+                return [verifier, &message, &signature]() {
+                  if (!verifier->verify_message(message, signature))
+                    throw std::runtime_error("signature did not verify");
+                  return 0;
+                };
+              });
+  }
+}
+
+}  // namespace
+
+void BenchCommand::run() {
+  if (m_min_time <= 0)
+    throw CLI::ValidationError("--min-time", "must be positive");
+  if (m_size == 0) throw CLI::ValidationError("--size", "must be positive");
+  for (const auto& category : m_only)
+    if (!CATEGORIES.count(category))
+      throw CLI::ValidationError("--only", "unknown category " + category);
+  for (auto threads : m_threads)
+    if (threads == 0)
+      throw CLI::ValidationError("--threads", "must be positive");
+
+  unsigned int hardware = std::thread::hardware_concurrency();
+  std::vector<unsigned int> threads = m_threads;
+  if (threads.empty()) {
+    threads.push_back(1);
+    if (hardware > 1) threads.push_back(hardware);
+  }
+
+  auto enabled = [this](const std::string& category) {
+    return m_only.empty() || std::find(m_only.begin(), m_only.end(),
+                                       category) != m_only.end();
+  };
+
+  // The bulk input is keyring data, which compresses like real OpenPGP
+  // data would.
+  std::string data;
+  const std::string keyring = synthetic_keyring(100);
+  while (data.size() < m_size) data += keyring;
+  data.resize(m_size);
+
+  Bench bench{m_min_time, threads};
+  if (enabled("hash")) bench_hashes(bench, data);
+  if (enabled("compress")) bench_compressions(bench, data);
+  if (enabled("armor")) bench_armor(bench, data);
+  if (enabled("parser")) bench_parser(bench);
+  if (enabled("rng")) bench_rng(bench, m_size);
+  if (enabled("sign")) bench_sign(bench);
+
+  const tao::json::value report = {{"hardware_threads", hardware},
+                                   {"min_time", m_min_time},
+                                   {"input_size", m_size},
+                                   {"results", bench.results()}};
+  std::cout << tao::json::to_string(report) << "\n";
+}
+
+}  // Namespace NeoPG
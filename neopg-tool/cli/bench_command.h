@@ -0,0 +1,49 @@
+// NeoPG bench command
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#pragma once
+
+#include <neopg-tool/cli/command.h>
+
+#include <string>
+#include <vector>
+
+namespace NeoPG {
+
+/// Measure the throughput of the cryptographic and OpenPGP building blocks
+/// on this machine, and write the results as JSON to stdout.
+///
+/// Every benchmark runs for at least --min-time seconds with each of the
+/// --threads thread counts.  Each thread has its own state (hash object,
+/// compressor, signer, random number generator), so the results show how
+/// the operation scales with the number of cores.  Throughput is reported
+/// as operations per second, and for the bulk operations in MB/s (10^6
+/// bytes per second) of input.
+class BenchCommand : public Command {
+ public:
+  double m_min_time{0.5};
+  std::vector<unsigned int> m_threads;
+  std::vector<std::string> m_only;
+  size_t m_size{1024 * 1024};
+
+  void run() override;
+  BenchCommand(CLI::App& app, const std::string& flag,
+               const std::string& description,
+               const std::string& group_name = "")
+      : Command(app, flag, description, group_name) {
+    m_cmd.add_option("--min-time", m_min_time,
+                     "minimum seconds per measurement", true);
+    m_cmd.add_option("--threads", m_threads,
+                     "thread counts to measure (default: 1 and all cores)");
+    m_cmd.add_option("--only", m_only,
+                     "categories to run (hash, compress, armor, parser, rng, "
+                     "sign)");
+    m_cmd.add_option("--size", m_size,
+                     "input size in bytes for the bulk operations", true);
+  }
+  virtual ~BenchCommand() {}
+};
+
+}  // Namespace NeoPG
@@ -4,27 +4,134 @@
    NeoPG is released under the Simplified BSD License (see license.txt)
 */
 
-#include <iostream>
+#include <string>
 
-#include <botan/filters.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#include <botan/exceptn.h>
 
 #include <neopg-tool/cli/cat_command.h>
+#include <neopg-tool/io/file_io.h>
 
 namespace NeoPG {
 
-void CatCommand::run() {
-  Botan::Pipe pipe(new Botan::DataSink_Stream(std::cout));
+namespace {
+
+// The most bytes to transfer with one system call.
+const size_t TRANSFER_SIZE = 1 << 30;
+
+#ifndef _WIN32
+
+[[noreturn]] void error(const std::string& what, const std::string& file) {
+  throw Botan::Stream_IO_Error(what + " file " + file);
+}
+
+// Run transfer until the end of the input.  If the first call fails because
+// the files are not supported, or returns 0 (as copy_file_range does for
+// some pseudo files), nothing was copied and false is returned, so the
+// caller can try the next method.
+template <typename Transfer>
+bool transfer_all(Transfer transfer, const std::string& file) {
+  bool first = true;
+  while (true) {
+    ssize_t count = transfer();
+    if (count > 0) {
+      first = false;
+      continue;
+    }
+    if (count == 0) return !first;
+    if (errno == EINTR) continue;
+    if (first && (errno == EINVAL || errno == ENOSYS || errno == EXDEV ||
+                  errno == EBADF || errno == EOPNOTSUPP))
+      return false;
+    error("DataSink: Failure copying", file);
+  }
+}
+
+#endif
 
+// Copy through user space, in blocks or from the mapped file.
+void copy_buffered(InputFile& in, OutputFile& out) {
+  in.for_each_block([&out](const uint8_t* data, size_t length) {
+    out.write(data, length);
+  });
+  out.flush();
+}
+
+#ifndef _WIN32
+
+// Copy from in to out, in the kernel if possible: copy_file_range between
+// regular files (which can share extents on some file systems), sendfile
+// from a regular file, and splice from or to a pipe.
+void copy_fd(InputFile& in_file, OutputFile& out_file) {
+  int in = in_file.fd();
+  int out = out_file.fd();
+  const std::string& file = in_file.name();
+  struct stat in_st, out_st;
+  bool in_reg = fstat(in, &in_st) == 0 && S_ISREG(in_st.st_mode);
+  bool in_pipe = !in_reg && S_ISFIFO(in_st.st_mode);
+  bool out_reg = fstat(out, &out_st) == 0 && S_ISREG(out_st.st_mode);
+  bool out_pipe = !out_reg && S_ISFIFO(out_st.st_mode);
+
+#ifdef __linux__
+#ifdef SYS_copy_file_range
+  if (in_reg && out_reg && transfer_all(
+                               [in, out]() {
+                                 return syscall(SYS_copy_file_range, in,
+                                                nullptr, out, nullptr,
+                                                TRANSFER_SIZE, 0);
+                               },
+                               file))
+    return;
+#endif
+  if (in_reg &&
+      transfer_all(
+          [in, out]() { return sendfile(out, in, nullptr, TRANSFER_SIZE); },
+          file))
+    return;
+  if ((in_pipe || out_pipe) &&
+      transfer_all(
+          [in, out]() {
+            return splice(in, nullptr, out, nullptr, TRANSFER_SIZE,
+                          SPLICE_F_MOVE | SPLICE_F_MORE);
+          },
+          file))
+    return;
+#else
+  (void)in_pipe;
+  (void)out_reg;
+  (void)out_pipe;
+#endif
+  copy_buffered(in_file, out_file);
+}
+
+#endif
+
+}  // namespace
+
+void CatCommand::run() {
   if (m_files.empty()) m_files.emplace_back("-");
 
+  // The files are written to the file descriptor directly.
+  OutputFile out{"-"};
+
   for (auto& file : m_files) {
-    if (file == "-") {
-      Botan::DataSource_Stream in{std::cin};
-      pipe.process_msg(in);
-    } else {
-      Botan::DataSource_Stream in{file, true};
-      pipe.process_msg(in);
-    }
+    InputFile in{file};
+#ifndef _WIN32
+    copy_fd(in, out);
+#else
+    copy_buffered(in, out);
+#endif
   }
 }
 
@@ -4,13 +4,24 @@
 // NeoPG is released under the Simplified BSD License (see license.txt)
 
 #include <neopg-tool/cli/compress_command.h>
+#include <neopg-tool/io/file_io.h>
 
 #include <botan/comp_filter.h>
 #include <botan/compression.h>
-#include <botan/filters.h>
+#include <botan/exceptn.h>
+#include <botan/secmem.h>
 
+#include <tao/json.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
 
 namespace NeoPG {
 
@@ -38,31 +49,154 @@ static const std::map<std::string, std::string> algo_to_suffix = {
     {"Bzip2_Compression", ".bz2"},
     {"Lzma_Compression", ".xz"}};
 
-void CompressCommand::run() {
-  bool multi_files = false;
+// Formats whose streams can be concatenated, and are still decoded as one
+// by the standard tools (gzip members, bzip2 and xz streams).
+static const std::set<std::string> multi_stream_algos = {
+    "Gzip_Compression", "Bzip2_Compression", "Lzma_Compression"};
+
+namespace {
+
+// Input is read in chunks of this size.
+const size_t READ_BUFFER_SIZE = AlignedBuffer::DEFAULT_SIZE;
+
+struct Totals {
+  uint64_t m_in{0};
+  uint64_t m_out{0};
+};
+
+// Read up to size bytes.  Less is only returned at the end of the input.
+size_t read_block(InputFile& in, Botan::secure_vector<uint8_t>& buffer,
+                  size_t size) {
+  buffer.resize(size);
+  buffer.resize(in.read(buffer.data(), size));
+  return buffer.size();
+}
+
+void write_block(OutputFile& out, const Botan::secure_vector<uint8_t>& data,
+                 Totals& totals) {
+  out.write(data.data(), data.size());
+  totals.m_out += data.size();
+}
+
+// Run a (de)compressor over the input, one chunk at a time.
+template <typename Transform, typename... Args>
+void transform_stream(Transform& transform, InputFile& in, OutputFile& out,
+                      Totals& totals, Args... args) {
+  transform.start(args...);
+  Botan::secure_vector<uint8_t> buffer;
+  while (true) {
+    size_t count = read_block(in, buffer, READ_BUFFER_SIZE);
+    totals.m_in += count;
+    if (count < READ_BUFFER_SIZE) {
+      transform.finish(buffer);
+      write_block(out, buffer, totals);
+      return;
+    }
+    transform.update(buffer);
+    write_block(out, buffer, totals);
+  }
+}
+
+// Compress blocks of the input independently on several threads, and write
+// them as consecutive streams.  A batch of one block per thread is read,
+// compressed and written at a time.
+void compress_parallel(const std::string& algo, int level, size_t threads,
+                       size_t block_size, InputFile& in, OutputFile& out,
+                       Totals& totals) {
+  std::vector<std::unique_ptr<Botan::Compression_Algorithm>> compressors;
+  for (size_t i = 0; i < threads; i++)
+    compressors.emplace_back(Botan::make_compressor(algo));
 
+  std::vector<Botan::secure_vector<uint8_t>> blocks(threads);
+  bool eof = false;
+  bool first = true;
+  while (!eof) {
+    size_t count = 0;
+    for (auto& block : blocks) {
+      size_t length = read_block(in, block, block_size);
+      totals.m_in += length;
+      if (length < block_size) eof = true;
+      // Empty input still gets one (empty) stream.
+      if (length || (first && count == 0)) count++;
+      if (eof) break;
+    }
+    first = false;
+
+    std::vector<std::exception_ptr> errors(count);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < count; i++)
+      workers.emplace_back([i, level, &compressors, &blocks, &errors]() {
+        try {
+          compressors[i]->start(level);
+          compressors[i]->finish(blocks[i]);
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+    for (auto& worker : workers) worker.join();
+
+    for (size_t i = 0; i < count; i++) {
+      if (errors[i]) std::rethrow_exception(errors[i]);
+      write_block(out, blocks[i], totals);
+    }
+  }
+}
+
+}  // namespace
+
+void CompressCommand::run() {
   if (!m_cmd.get_subcommands().empty()) return;
 
   if (m_files.empty()) m_files.emplace_back("-");
+  if (m_block_size == 0)
+    throw CLI::ValidationError("--block-size", "must be positive");
 
   std::unique_ptr<Botan::Compression_Algorithm> compressor{
       Botan::make_compressor(m_algo)};
   if (!compressor) throw Botan::Lookup_Error("Compression", m_algo, "");
   const std::string suffix(algo_to_suffix.at(compressor->name()));
 
+  size_t threads = m_threads ? m_threads : std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  // Zlib and raw deflate can not be split into independent streams.
+  bool parallel = !m_decode && threads > 1 &&
+                  multi_stream_algos.count(compressor->name());
+
+  std::unique_ptr<Botan::Decompression_Algorithm> decompressor;
+  if (m_decode) {
+    decompressor.reset(Botan::make_decompressor(m_algo));
+    if (!decompressor) throw Botan::Lookup_Error("Decompression", m_algo, "");
+  }
+
+  Totals totals;
+  auto start = std::chrono::steady_clock::now();
   for (auto& file : m_files) {
-    std::unique_ptr<Botan::DataSource_Stream> source{
-        (file == "-") ? new Botan::DataSource_Stream{std::cin}
-                      : new Botan::DataSource_Stream{file, true}};
-    Botan::Filter* compress =
-        m_decode
-            ? (Botan::Filter*)new Botan::Decompression_Filter(m_algo)
-            : (Botan::Filter*)new Botan::Compression_Filter(m_algo, m_level);
-    Botan::Filter* sink = (file == "-")
-                              ? new Botan::DataSink_Stream(std::cout)
-                              : new Botan::DataSink_Stream(file + suffix, true);
-    Botan::Pipe pipe{compress, sink};
-    pipe.process_msg(*source);
+    InputFile in{file};
+    OutputFile out{file == "-" ? file : file + suffix};
+
+    if (m_decode)
+      transform_stream(*decompressor, in, out, totals);
+    else if (parallel)
+      compress_parallel(m_algo, m_level, threads, m_block_size, in, out,
+                        totals);
+    else
+      transform_stream(*compressor, in, out, totals, m_level);
+    out.flush();
+  }
+
+  if (m_stats) {
+    using seconds = std::chrono::duration<double>;
+    double elapsed =
+        std::chrono::duration_cast<seconds>(std::chrono::steady_clock::now() -
+                                            start)
+            .count();
+    const tao::json::value stats = {
+        {"input_bytes", totals.m_in},
+        {"output_bytes", totals.m_out},
+        {"seconds", elapsed},
+        {"input_bytes_per_second", elapsed > 0 ? totals.m_in / elapsed : 0.0},
+        {"threads", parallel ? threads : 1}};
+    std::cerr << tao::json::to_string(stats) << "\n";
   }
 }
 
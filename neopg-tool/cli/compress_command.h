@@ -18,12 +18,24 @@ class ListCompressCommand : public Command {
   void run();
 };
 
+/// Compress or decompress files.
+///
+/// With --threads, gzip, bzip2 and xz input is split into blocks of
+/// --block-size bytes that are compressed independently and written as
+/// consecutive gzip members or bzip2/xz streams, which the standard tools
+/// decode like one stream.  Zlib and deflate data can not be concatenated,
+/// so they are always compressed on one thread.
 class CompressCommand : public Command {
  public:
+  static const size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024;
+
   std::vector<std::string> m_files;
   std::string m_algo{"gz"};
   int m_level = 0;
   bool m_decode = false;
+  unsigned int m_threads = 1;
+  size_t m_block_size = DEFAULT_BLOCK_SIZE;
+  bool m_stats = false;
   const std::string group = "Commands";
   ListCompressCommand cmd_list;
 
@@ -38,6 +50,14 @@ class CompressCommand : public Command {
     m_cmd.add_option("file", m_files, "file to hash");
     m_cmd.add_option("--algo", m_algo, "compression function", true);
     m_cmd.add_option("--level", m_level, "compression level (0 default, 1-9)");
+    m_cmd.add_option("--threads", m_threads,
+                     "compress blocks on this many threads (0 uses all "
+                     "cores)",
+                     true);
+    m_cmd.add_option("--block-size", m_block_size,
+                     "block size in bytes for --threads", true);
+    m_cmd.add_flag("--stats", m_stats,
+                   "print throughput statistics as JSON to stderr");
   }
 };
 
@@ -4,15 +4,143 @@
    NeoPG is released under the Simplified BSD License (see license.txt)
 */
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <functional>
 #include <iostream>
-
-#include <botan/filters.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <botan/exceptn.h>
 #include <botan/hash.h>
+#include <botan/hex.h>
 
 #include <neopg-tool/cli/hash_command.h>
+#include <neopg-tool/io/file_io.h>
 
 namespace NeoPG {
 
+namespace {
+
+// Files are read in chunks of this size, and files that are at least this
+// large are mapped into memory instead.
+const size_t READ_BUFFER_SIZE = AlignedBuffer::DEFAULT_SIZE;
+
+using digest_t = Botan::secure_vector<uint8_t>;
+using hashes_t = std::vector<std::unique_ptr<Botan::HashFunction>>;
+
+digest_t hash_file(const std::string& file, Botan::HashFunction& hash) {
+  InputFile in{file};
+  if (in.map(READ_BUFFER_SIZE)) {
+    hash.update(in.data(), in.size());
+    return hash.final();
+  }
+
+  AlignedBuffer buffer{READ_BUFFER_SIZE};
+  size_t count;
+  do {
+    count = in.read(buffer.data(), buffer.size());
+    hash.update(buffer.data(), count);
+  } while (count == buffer.size());
+  return hash.final();
+}
+
+// Run job(idx, hash) for all idx < count on up to hashes.size() threads, one
+// hash object per thread.
+void parallel_for(
+    size_t count, hashes_t& hashes,
+    const std::function<void(size_t, Botan::HashFunction&)>& job) {
+  size_t threads = std::min(count, hashes.size());
+  if (threads <= 1) {
+    for (size_t idx = 0; idx < count; idx++) job(idx, *hashes.front());
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < threads; i++)
+    workers.emplace_back(
+        [count, &next, &job](Botan::HashFunction& hash) {
+          size_t idx;
+          while ((idx = next++) < count) job(idx, hash);
+        },
+        std::ref(*hashes[i]));
+  for (auto& thread : workers) thread.join();
+}
+
+void update_be64(Botan::HashFunction& hash, uint64_t value) {
+  uint8_t buffer[8];
+  for (int i = 0; i < 8; i++) buffer[i] = value >> (56 - 8 * i);
+  hash.update(buffer, sizeof(buffer));
+}
+
+// The tree digest, see HashCommand.
+digest_t tree_hash_file(const std::string& file, size_t chunk_size,
+                        hashes_t& hashes) {
+  std::vector<std::pair<const uint8_t*, size_t>> chunks;
+  std::vector<digest_t> leaves;
+  uint64_t total = 0;
+
+  auto hash_chunks = [&chunks, &leaves, &hashes]() {
+    size_t first = leaves.size();
+    leaves.resize(first + chunks.size());
+    parallel_for(chunks.size(), hashes,
+                 [first, &chunks, &leaves](size_t idx,
+                                           Botan::HashFunction& hash) {
+                   const uint8_t prefix = 0x00;
+                   hash.update(&prefix, 1);
+                   hash.update(chunks[idx].first, chunks[idx].second);
+                   leaves[first + idx] = hash.final();
+                 });
+    chunks.clear();
+  };
+
+  InputFile in{file};
+  if (in.map(chunk_size)) {
+    for (size_t offset = 0; offset < in.size(); offset += chunk_size)
+      chunks.emplace_back(in.data() + offset,
+                          std::min(chunk_size, in.size() - offset));
+    total = in.size();
+    hash_chunks();
+  } else {
+    // Read as many chunks as there are hash objects, then hash them.
+    std::vector<std::vector<uint8_t>> buffers(hashes.size());
+    bool eof = false;
+    while (!eof) {
+      for (auto& buffer : buffers) {
+        buffer.resize(chunk_size);
+        size_t count = in.read(buffer.data(), chunk_size);
+        if (count) chunks.emplace_back(buffer.data(), count);
+        total += count;
+        if (count < chunk_size) {
+          eof = true;
+          break;
+        }
+      }
+      hash_chunks();
+    }
+  }
+
+  Botan::HashFunction& hash = *hashes.front();
+  const uint8_t prefix = 0x01;
+  hash.update(&prefix, 1);
+  update_be64(hash, chunk_size);
+  update_be64(hash, total);
+  for (auto& leaf : leaves) hash.update(leaf.data(), leaf.size());
+  return hash.final();
+}
+
+}  // namespace
+
 void ListHashCommand::run() {
   std::cout << "Any Botan-compatible algorithm specifier can be used:\n\n";
 #if defined(BOTAN_HAS_SHA1)
@@ -106,11 +234,149 @@ void ListHashCommand::run() {
 #endif
 }
 
+void HashCommand::digest_files(
+    const std::vector<std::string>& files,
+    const std::function<void(size_t idx, const digest_t* digest,
+                             std::exception_ptr error)>& result) {
+  size_t jobs = m_jobs ? m_jobs : std::thread::hardware_concurrency();
+  jobs = std::max<size_t>(1, jobs);
+
+  // Every worker gets its own hash object.  Creating them here reports an
+  // unknown algorithm before any file is read.
+  hashes_t hashes;
+  hashes.emplace_back(Botan::HashFunction::create_or_throw(m_algo));
+  if (!m_tree) jobs = std::min(jobs, files.size());
+  while (hashes.size() < jobs) hashes.emplace_back(hashes.front()->clone());
+
+  if (m_tree || jobs == 1) {
+    // In tree mode, the chunks of each file are hashed in parallel.
+    for (size_t idx = 0; idx < files.size(); idx++) {
+      digest_t digest;
+      std::exception_ptr error;
+      try {
+        digest = m_tree ? tree_hash_file(files[idx], m_chunk_size, hashes)
+                        : hash_file(files[idx], *hashes.front());
+      } catch (...) {
+        error = std::current_exception();
+      }
+      result(idx, error ? nullptr : &digest, error);
+    }
+    return;
+  }
+
+  // Workers take the next file from a shared counter, and the results are
+  // passed on in input order as soon as they are available.
+  struct Result {
+    bool m_done{false};
+    digest_t m_digest;
+    std::exception_ptr m_error;
+  };
+  std::vector<Result> results(files.size());
+  std::atomic<size_t> next{0};
+  std::mutex mutex;
+  std::condition_variable done;
+
+  auto worker = [&files, &results, &next, &mutex,
+                 &done](Botan::HashFunction& hash) {
+    size_t idx;
+    while ((idx = next++) < files.size()) {
+      digest_t digest;
+      std::exception_ptr error;
+      try {
+        digest = hash_file(files[idx], hash);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      results[idx].m_digest = std::move(digest);
+      results[idx].m_error = error;
+      results[idx].m_done = true;
+      done.notify_all();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (auto& hash : hashes) workers.emplace_back(worker, std::ref(*hash));
+
+  std::exception_ptr error;
+  for (size_t idx = 0; idx < files.size(); idx++) {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&results, idx]() { return results[idx].m_done; });
+    lock.unlock();
+    try {
+      result(idx, results[idx].m_error ? nullptr : &results[idx].m_digest,
+             results[idx].m_error);
+    } catch (...) {
+      // Stop the workers after their current file.
+      error = std::current_exception();
+      next = files.size();
+      break;
+    }
+    digest_t().swap(results[idx].m_digest);
+  }
+
+  for (auto& thread : workers) thread.join();
+  if (error) std::rethrow_exception(error);
+}
+
+void HashCommand::verify() {
+  std::ifstream manifest{m_verify};
+  if (!manifest)
+    throw Botan::Stream_IO_Error("DataSource: Failure opening file " +
+                                 m_verify);
+
+  // Lines are "DIGEST FILE", as written by neopg hash.  The "DIGEST  FILE"
+  // and "DIGEST *FILE" forms of sha256sum and friends are accepted, too.
+  std::vector<std::string> digests;
+  std::vector<std::string> files;
+  std::string line;
+  while (std::getline(manifest, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty()) continue;
+    size_t pos = line.find(' ');
+    if (pos == std::string::npos || pos == 0 || pos + 1 == line.size())
+      throw CLI::ValidationError("--verify", "invalid manifest line: " + line);
+    std::string file = line.substr(pos + 1);
+    if (file.size() > 1 && (file[0] == ' ' || file[0] == '*'))
+      file = file.substr(1);
+    std::string digest = line.substr(0, pos);
+    std::transform(digest.begin(), digest.end(), digest.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    digests.emplace_back(std::move(digest));
+    files.emplace_back(std::move(file));
+  }
+
+  OutputFile out{"-"};
+  size_t failed = 0;
+  digest_files(files, [&digests, &files, &failed, &out](
+                          size_t idx, const digest_t* digest,
+                          std::exception_ptr error) {
+    bool ok = digest && Botan::hex_encode(*digest, false) == digests[idx];
+    out.stream() << files[idx] << ": " << (ok ? "OK" : "FAILED") << "\n";
+    if (!ok) failed++;
+  });
+  out.flush();
+
+  if (failed) {
+    std::cerr << "neopg hash: " << failed << " of " << files.size()
+              << " digests did not match\n";
+    throw CLI::RuntimeError(1);
+  }
+}
+
 void HashCommand::run() {
   bool multi_files = false;
 
   if (!m_cmd.get_subcommands().empty()) return;
 
+  if (m_chunk_size == 0)
+    throw CLI::ValidationError("--chunk-size", "must be positive");
+
+  if (!m_verify.empty()) {
+    verify();
+    return;
+  }
+
   if (m_files.empty())
     m_files.emplace_back("-");
   else if (m_files.size() > 1) {
@@ -118,21 +384,18 @@ void HashCommand::run() {
     multi_files = true;
   }
 
-  Botan::Pipe pipe{
-      new Botan::Hash_Filter(m_algo),
-      m_raw ? nullptr : new Botan::Hex_Encoder(Botan::Hex_Encoder::Lowercase),
-      new Botan::DataSink_Stream(std::cout)};
-
-  for (auto& file : m_files) {
-    if (file == "-") {
-      Botan::DataSource_Stream in{std::cin};
-      pipe.process_msg(in);
-    } else {
-      Botan::DataSource_Stream in{file, true};
-      pipe.process_msg(in);
-    }
-    if (multi_files) std::cout << " " << file << "\n";
-  }
+  OutputFile out{"-"};
+  digest_files(m_files, [this, multi_files, &out](size_t idx,
+                                                  const digest_t* digest,
+                                                  std::exception_ptr error) {
+    if (error) std::rethrow_exception(error);
+    if (m_raw)
+      out.write(digest->data(), digest->size());
+    else
+      out.stream() << Botan::hex_encode(*digest, false);
+    if (multi_files) out.stream() << " " << m_files[idx] << "\n";
+  });
+  out.flush();
 }
 
 }  // Namespace NeoPG
@@ -8,6 +8,13 @@
 
 #include <neopg-tool/cli/command.h>
 
+#include <botan/secmem.h>
+
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
 namespace NeoPG {
 
 class ListHashCommand : public Command {
@@ -19,11 +26,29 @@ class ListHashCommand : public Command {
   void run();
 };
 
+/// Hash files, optionally in parallel.
+///
+/// With --tree, every file is split into chunks of --chunk-size bytes (the
+/// last one can be shorter), which are hashed in parallel.  The digest is
+///
+///     leaf[i] = H(0x00 || chunk[i])
+///     digest  = H(0x01 || BE64(chunk size) || BE64(file size) ||
+///                 leaf[0] || ... || leaf[n-1])
+///
+/// where H is the --algo hash function and BE64 is a 64-bit big-endian
+/// integer.  An empty file has no leaves.  The digest depends on the chunk
+/// size, so the same chunk size must be used to verify it.
 class HashCommand : public Command {
  public:
+  static const size_t DEFAULT_CHUNK_SIZE = 8 * 1024 * 1024;
+
   std::vector<std::string> m_files;
   std::string m_algo{"SHA-256"};
   bool m_raw = false;
+  unsigned int m_jobs = 1;
+  bool m_tree = false;
+  size_t m_chunk_size = DEFAULT_CHUNK_SIZE;
+  std::string m_verify;
   const std::string group = "Commands";
   ListHashCommand cmd_list;
 
@@ -36,8 +61,29 @@ class HashCommand : public Command {
     m_cmd.add_option("file", m_files, "file to hash");
     m_cmd.add_option("--algo", m_algo, "hash function", true);
     m_cmd.add_flag("--raw", m_raw, "output as binary instead hex encoded");
+    m_cmd.add_option("-j,--jobs", m_jobs,
+                     "number of files to hash concurrently (0 uses all cores)",
+                     true);
+    m_cmd.add_flag("--tree", m_tree,
+                   "hash chunks of each file in parallel (tree digest)");
+    m_cmd.add_option("--chunk-size", m_chunk_size,
+                     "chunk size in bytes for --tree", true);
+    m_cmd.add_option("--verify", m_verify,
+                     "check the files and digests listed in a manifest")
+        ->set_type_name("MANIFEST");
   }
   virtual ~HashCommand() {}
+
+ private:
+  /// Hash \p files and call \p result for each, in order.  \p digest is
+  /// nullptr if the file could not be read, and \p error is set instead.
+  void digest_files(
+      const std::vector<std::string>& files,
+      const std::function<void(size_t idx,
+                               const Botan::secure_vector<uint8_t>* digest,
+                               std::exception_ptr error)>& result);
+
+  void verify();
 };
 
 }  // Namespace NeoPG
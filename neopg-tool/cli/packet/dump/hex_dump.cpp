@@ -5,6 +5,8 @@
 
 #include <neopg-tool/cli/packet/dump/hex_dump.h>
 
+#include <neopg/utils/hex.h>
+
 #include <neopg/openpgp/public_key/data/v3_public_key_data.h>
 #include <neopg/openpgp/public_key/data/v4_public_key_data.h>
 
@@ -58,11 +60,10 @@
 
 #include <neopg/openpgp/user_attribute/subpacket/image_attribute_subpacket.h>
 
-#include <neopg/utils/stream.h>
+#include <neopg/utils/byte_writer.h>
 
 #include <botan/data_snk.h>
 #include <botan/data_src.h>
-#include <botan/hex.h>
 
 #include <botan/ber_dec.h>
 #include <botan/oids.h>
@@ -75,6 +76,7 @@
 
 #include <tao/json.hpp>
 
+#include <algorithm>
 #include <iostream>
 
 using namespace NeoPG;
@@ -86,6 +88,9 @@ class HexDump::Formatter {
   size_t m_offset{0};
   std::ostream& m_out;
 
+  /// Show at most this many bytes of each field (0 shows all).
+  size_t m_max_bytes{0};
+
   void header(const PacketHeader* header, const std::string& comment);
   void comment(const std::string& comment);
   void hex(const std::vector<uint8_t>& raw);
@@ -104,8 +109,15 @@ class HexDump::Formatter {
   void hex(const SignatureSubpacket* subpacket);
   void hex(const V4SignatureSubpacketData* subpackets,
            const std::string& comment);
-  Formatter(std::ostream& out, uint64_t offset = 0)
-      : m_out{out}, m_offset{offset} {};
+  Formatter(std::ostream& out, uint64_t offset = 0, size_t max_bytes = 0)
+      : m_out{out}, m_offset{offset}, m_max_bytes{max_bytes} {};
+
+ private:
+  /// Write one line with \p left (at most LINELEN) bytes at \p data.
+  void line(const uint8_t* data, size_t left, const std::string& comment);
+
+  /// The line being formatted, reused to avoid allocations.
+  std::string m_line;
 };
 
 void HexDump::Formatter::header(const PacketHeader* header,
@@ -120,7 +132,7 @@ void HexDump::Formatter::header(const PacketHeader* header,
       assert(hdr != nullptr);
       auto length = hdr->length();
 
-      std::stringstream hdr_raw;
+      ByteWriter hdr_raw;
       hdr->write(hdr_raw);
       hex(hdr_raw.str(),
           fmt::format("{:s} ({:d}, old, length {:d})", name,
@@ -131,7 +143,7 @@ void HexDump::Formatter::header(const PacketHeader* header,
       assert(hdr != nullptr);
       auto length = hdr->length();
 
-      std::stringstream hdr_raw;
+      ByteWriter hdr_raw;
       hdr->write(hdr_raw);
       hex(hdr_raw.str(),
           fmt::format("{:s} ({:d}, new, length {:d})", name,
@@ -150,46 +162,64 @@ void HexDump::Formatter::comment(const std::string& comment) {
 
 void HexDump::Formatter::hex(const std::string& raw) { hex(raw, ""); }
 
-static std::string _escaped(const uint8_t* in, size_t sz) {
-  std::string result;
-  for (size_t i = 0; i < sz; i++) {
-    auto chr = (char)(in[i]);
-    if (std::isgraph(chr))
-      result.push_back(chr);
+void HexDump::Formatter::line(const uint8_t* data, size_t left,
+                              const std::string& comment) {
+  // The offset has at least 8 digits.
+  uint8_t offset[8];
+  for (int i = 0; i < 8; i++)
+    offset[i] = static_cast<uint8_t>(uint64_t{m_offset} >> (56 - 8 * i));
+  char digits[2 * LINELEN];
+  hex_encode(offset, sizeof(offset), digits, false);
+  size_t skip = 0;
+  while (skip < 8 && digits[skip] == '0') skip++;
+  m_line.assign(digits + skip, 16 - skip);
+  m_line.push_back(':');
+  m_out << rang::fg::gray << m_line << rang::style::reset;
+
+  hex_encode(data, left, digits, false);
+  m_line.clear();
+  for (size_t i = 0; i < left; i++) {
+    m_line.push_back(' ');
+    m_line.append(digits + 2 * i, 2);
+  }
+  m_line.append((LINELEN - left) * 3 + 2, ' ');
+  m_out << m_line;
+
+  m_line.clear();
+  for (size_t i = 0; i < left; i++) {
+    const uint8_t chr = data[i];
+    // Like std::isgraph in the C locale.
+    if (chr > ' ' && chr < 0x7f)
+      m_line.push_back(static_cast<char>(chr));
     else if (chr == ' ')
-      result.append("␣");
+      m_line.append("␣");
     else
-      result.append("⬚");
+      m_line.append("⬚");
   }
-  return result;
-}
+  m_line.append(LINELEN - left, ' ');
+  m_out << rang::fg::gray << m_line << rang::style::reset;
 
-static void _line(std::ostream& out, size_t& offset, const std::string& raw,
-                  size_t& idx, const std::string& comment) {
-  auto left = raw.size() - idx;
-  if (left >= LINELEN) left = LINELEN;
-
-  auto data = reinterpret_cast<const uint8_t*>(raw.data() + idx);
-  out << rang::fg::gray << fmt::format("{:08x}:", offset) << rang::style::reset;
-  for (int i = 0; i < left; i++) out << fmt::format(" {:02x}", data[i]);
-  out << std::string((LINELEN - left) * 3 + 2, ' ');
-  out << rang::fg::gray << _escaped(data, left)
-      << std::string(LINELEN - left, ' ') << rang::style::reset;
-
-  if (comment != "") out << " ; " << comment;
-  out << "\n";
-  offset += left;
-  idx += left;
+  if (comment != "") m_out << " ; " << comment;
+  m_out << "\n";
+  m_offset += left;
 }
 
 void HexDump::Formatter::hex(const std::string& raw,
                              const std::string& comment) {
-  auto left{raw.size()};
-  size_t idx{0};
-
-  _line(m_out, m_offset, raw, idx, comment);
-  while (idx < raw.size()) {
-    _line(m_out, m_offset, raw, idx, "");
+  auto data = reinterpret_cast<const uint8_t*>(raw.data());
+  size_t shown = raw.size();
+  if (m_max_bytes && shown > m_max_bytes) shown = m_max_bytes;
+
+  size_t idx = std::min(shown, size_t{LINELEN});
+  line(data, idx, comment);
+  while (idx < shown) {
+    size_t left = std::min(shown - idx, size_t{LINELEN});
+    line(data + idx, left, "");
+    idx += left;
+  }
+  if (shown < raw.size()) {
+    this->comment(fmt::format("... {:d} more bytes", raw.size() - shown));
+    m_offset += raw.size() - shown;
   }
 }
 
@@ -235,7 +265,7 @@ void HexDump::Formatter::hex(uint32_t val, const std::string& comment) {
 void HexDump::Formatter::hex(const MultiprecisionInteger& val,
                              const std::string& comment) {
   hex(val.m_length, fmt::format("{:s} ({:d} bits)", comment, val.m_length));
-  hex(val.m_bits);
+  hex(val.m_bits.to_vector());
 }
 
 void HexDump::Formatter::hex(const ObjectIdentifier& val,
@@ -243,7 +273,8 @@ void HexDump::Formatter::hex(const ObjectIdentifier& val,
   const std::string oidstr = val.as_string();
   Botan::OID oid(oidstr);
   hex(static_cast<uint8_t>(val.m_data.size()), comment);
-  hex(val.m_data, fmt::format("{:s} = {:s}", oidstr, Botan::OIDS::lookup(oid)));
+  hex(val.m_data.to_vector(),
+      fmt::format("{:s} = {:s}", oidstr, Botan::OIDS::lookup(oid)));
 }
 
 void HexDump::Formatter::hex(const PublicKeyAlgorithm& val,
@@ -262,7 +293,7 @@ void HexDump::Formatter::hex(const HashAlgorithm& val,
 }
 
 void HexDump::Formatter::hex(const SignatureSubpacket* subpacket) {
-  std::stringstream raw_stream;
+  ByteWriter raw_stream;
   subpacket->write(raw_stream);
   auto raw = raw_stream.str();
 
@@ -340,16 +371,16 @@ void HexDump::Formatter::hex(const SignatureSubpacket* subpacket) {
       hex(raw, fmt::format("- revocation key: c={:02x} a={:d} f={:s}",
                            static_cast<int>(sub->m_class),
                            static_cast<int>(sub->m_algorithm),
-                           Botan::hex_encode(sub->m_fingerprint.data(),
-                                             sub->m_fingerprint.size())));
+                           hex_encode(sub->m_fingerprint.data(),
+                                      sub->m_fingerprint.size())));
 
     } break;
     case SignatureSubpacketType::Issuer: {
       auto sub = dynamic_cast<const IssuerSubpacket*>(subpacket);
       assert(sub != nullptr);
       hex(raw, fmt::format("- issuer key ID {:s}",
-                           Botan::hex_encode(sub->m_issuer.data(),
-                                             sub->m_issuer.size())));
+                           hex_encode(sub->m_issuer.data(),
+                                      sub->m_issuer.size())));
     } break;
     case SignatureSubpacketType::NotationData: {
       auto sub = dynamic_cast<const NotationDataSubpacket*>(subpacket);
@@ -385,8 +416,8 @@ void HexDump::Formatter::hex(const SignatureSubpacket* subpacket) {
       auto sub = dynamic_cast<const KeyServerPreferencesSubpacket*>(subpacket);
       assert(sub != nullptr);
       hex(raw, fmt::format("- keyserver preferences: {:s}",
-                           Botan::hex_encode(sub->m_flags.data(),
-                                             sub->m_flags.size())));
+                           hex_encode(sub->m_flags.data(),
+                                      sub->m_flags.size())));
     } break;
     case SignatureSubpacketType::PreferredKeyServer: {
       auto sub = dynamic_cast<const PreferredKeyServerSubpacket*>(subpacket);
@@ -411,8 +442,8 @@ void HexDump::Formatter::hex(const SignatureSubpacket* subpacket) {
       auto sub = dynamic_cast<const KeyFlagsSubpacket*>(subpacket);
       assert(sub != nullptr);
       hex(raw, fmt::format("- key flags: {:s}",
-                           Botan::hex_encode(sub->m_flags.data(),
-                                             sub->m_flags.size())));
+                           hex_encode(sub->m_flags.data(),
+                                      sub->m_flags.size())));
 
     } break;
     case SignatureSubpacketType::SignersUserId: {
@@ -434,8 +465,8 @@ void HexDump::Formatter::hex(const SignatureSubpacket* subpacket) {
       auto sub = dynamic_cast<const FeaturesSubpacket*>(subpacket);
       assert(sub != nullptr);
       hex(raw, fmt::format("- features: {:s}",
-                           Botan::hex_encode(sub->m_features.data(),
-                                             sub->m_features.size())));
+                           hex_encode(sub->m_features.data(),
+                                      sub->m_features.size())));
 
     } break;
     case SignatureSubpacketType::SignatureTarget: {
@@ -446,7 +477,7 @@ void HexDump::Formatter::hex(const SignatureSubpacket* subpacket) {
                    "{:d}), digest ",
                    static_cast<uint8_t>(sub->m_public_key_algorithm),
                    static_cast<uint8_t>(sub->m_hash_algorithm),
-                   Botan::hex_encode(sub->m_hash.data(), sub->m_hash.size())));
+                   hex_encode(sub->m_hash.data(), sub->m_hash.size())));
 
     } break;
     case SignatureSubpacketType::EmbeddedSignature: {
@@ -503,13 +534,13 @@ void HexDump::Formatter::hex(const SignatureSubpacket* subpacket) {
 
 void HexDump::Formatter::hex(const V4SignatureSubpacketData* subpackets,
                              const std::string& comment) {
-  CountingStream cnt;
+  ByteWriter cnt{nullptr};
   subpackets->write(cnt);
-  auto bytes = cnt.bytes_written();
+  auto bytes = cnt.size();
   hex(static_cast<uint16_t>(bytes), comment);
 
-  for (const auto& subpacket : subpackets->m_subpackets) {
-    hex(subpacket.get());
+  for (size_t i = 0; i < subpackets->count(); i++) {
+    hex(subpackets->at(i));
   }
 }
 
@@ -520,7 +551,7 @@ static void output_public_key_data(HexDump::Formatter* fmt,
   fmt->hex(
       static_cast<uint8_t>(pub->version()),
       fmt::format("version {:d}, key id {:s}", static_cast<int>(pub->version()),
-                  Botan::hex_encode(keyid.data(), keyid.size())));
+                  hex_encode(keyid.data(), keyid.size())));
   PublicKeyMaterial* key = nullptr;
   switch (pub->version()) {
     case PublicKeyVersion::V2:
@@ -686,12 +717,14 @@ std::unique_ptr<T> make_unique(Args&&... args) {
 
 HexDump::~HexDump() = default;
 
-HexDump::HexDump(std::ostream& out) : DumpPacketSink(out) {}
+HexDump::HexDump(std::ostream& out, size_t max_bytes)
+    : DumpPacketSink(out), m_max_bytes{max_bytes} {}
 
 void HexDump::dump(const Packet* packet) const {
   std::stringstream str;
 
-  m_fmt = NeoPG::make_unique<Formatter>(str, packet->m_header->m_offset);
+  m_fmt = NeoPG::make_unique<Formatter>(str, packet->m_header->m_offset,
+                                        m_max_bytes);
   DumpPacketSink::dump(packet);
   m_fmt.reset();
 
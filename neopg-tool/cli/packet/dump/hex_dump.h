@@ -15,6 +15,9 @@ class HexDump : public DumpPacketSink {
   class Formatter;
   mutable std::unique_ptr<Formatter> m_fmt;
 
+  /// Show at most this many bytes of each field (0 shows all).
+  size_t m_max_bytes;
+
   /// Dispatcher.
   void dump(const Packet* packet) const override;
 
@@ -25,7 +28,7 @@ class HexDump : public DumpPacketSink {
   void dump(const PublicSubkeyPacket* packet) const override;
   void dump(const SignaturePacket* packet) const override;
 
-  HexDump(std::ostream& out);
+  HexDump(std::ostream& out, size_t max_bytes = 0);
   ~HexDump();
 };
 
@@ -5,6 +5,8 @@
 
 #include <neopg-tool/cli/packet/dump/json_dump.h>
 
+#include <neopg-tool/cli/packet/dump/json_writer.h>
+
 #include <neopg/openpgp/public_key/data/v3_public_key_data.h>
 #include <neopg/openpgp/public_key/data/v4_public_key_data.h>
 
@@ -77,49 +79,191 @@
 
 using namespace NeoPG;
 
-static tao::json::value make_header(const PacketHeader* header) {
-  if (header == nullptr) return tao::json::empty_object;
+// Write the "_packet_header" member of a packet object.  The members are
+// written in sorted order, like tao::json sorts the members of an object.
+static void write_header(JsonWriter& json, const PacketHeader* header) {
+  if (header == nullptr) return;
 
+  json.key("_packet_header").begin_object();
+  json.key("_offset").value(header->m_offset);
   switch (header->format()) {
     case PacketFormat::Old: {
       auto hdr = dynamic_cast<const OldPacketHeader*>(header);
       assert(hdr != nullptr);
       auto length = hdr->length();
 
-      tao::json::value packet_header(
-          {{"format", "old"},
-           {"type", static_cast<uint8_t>(hdr->type())},
-           {"length", length},
-           {"_offset", hdr->m_offset}});
+      json.key("format").value("old");
+      json.key("length").value(length);
       if (hdr->m_length_type != OldPacketHeader::best_length_type(length))
         // FIXME: replace static cast
-        packet_header.insert(
-            {{"length_type", static_cast<uint8_t>(hdr->m_length_type)}});
-      return {{"_packet_header", packet_header}};
+        json.key("length_type")
+            .value(static_cast<uint8_t>(hdr->m_length_type));
+      json.key("type").value(static_cast<uint8_t>(hdr->type()));
+      break;
     }
     case PacketFormat::New: {
       auto hdr = dynamic_cast<const NewPacketHeader*>(header);
       assert(hdr != nullptr);
       auto length = hdr->length();
 
-      tao::json::value packet_header(
-          {{"format", "new"},
-           {"type", static_cast<uint8_t>(hdr->type())},
-           {"length", length},
-           {"_offset", hdr->m_offset}});
+      json.key("format").value("new");
+      json.key("length").value(length);
       if (hdr->m_length.m_length_type !=
           NewPacketLength::best_length_type(length))
         // FIXME: replace static cast
-        packet_header.insert(
-            {{"length_type",
-              static_cast<uint8_t>(hdr->m_length.m_length_type)}});
-      return {{"_packet_header", packet_header}};
+        json.key("length_type")
+            .value(static_cast<uint8_t>(hdr->m_length.m_length_type));
+      json.key("type").value(static_cast<uint8_t>(hdr->type()));
+      break;
     }
     default:
       throw std::logic_error("unknown header type");
-      // Unreachable.
-      return tao::json::null;
   }
+  json.end_object();
+}
+
+static void write_public_key_data(JsonWriter& json, const PublicKeyData* pub) {
+  PublicKeyMaterial* key = nullptr;
+  uint32_t created = 0;
+  uint16_t days_valid = 0;
+  switch (pub->version()) {
+    case PublicKeyVersion::V2:
+    case PublicKeyVersion::V3: {
+      auto v3pub = dynamic_cast<const V3PublicKeyData*>(pub);
+      created = v3pub->m_created;
+      days_valid = v3pub->m_days_valid;
+      key = v3pub->m_key.get();
+    } break;
+    case PublicKeyVersion::V4: {
+      auto v4pub = dynamic_cast<const V4PublicKeyData*>(pub);
+      created = v4pub->m_created;
+      key = v4pub->m_key.get();
+    } break;
+    default:
+      break;
+  }
+  if (key) {
+    json.key("algorithm").value(static_cast<uint8_t>(key->algorithm()));
+    json.key("bits").begin_array();
+    const ObjectIdentifier* curve = nullptr;
+    switch (key->algorithm()) {
+      case PublicKeyAlgorithm::Rsa: {
+        auto rsa = dynamic_cast<const RsaPublicKeyMaterial*>(key);
+        json.value(rsa->m_n.length()).value(rsa->m_e.length());
+      } break;
+      case PublicKeyAlgorithm::Dsa: {
+        auto dsa = dynamic_cast<const DsaPublicKeyMaterial*>(key);
+        json.value(dsa->m_p.length()).value(dsa->m_q.length());
+        json.value(dsa->m_g.length()).value(dsa->m_y.length());
+      } break;
+      case PublicKeyAlgorithm::Elgamal: {
+        auto elgamal = dynamic_cast<const ElgamalPublicKeyMaterial*>(key);
+        json.value(elgamal->m_p.length()).value(elgamal->m_g.length());
+        json.value(elgamal->m_y.length());
+      } break;
+      case PublicKeyAlgorithm::Ecdsa: {
+        auto ecdsa = dynamic_cast<const EcdsaPublicKeyMaterial*>(key);
+        json.value(ecdsa->m_key.length());
+        curve = &ecdsa->m_curve;
+      } break;
+      case PublicKeyAlgorithm::Eddsa: {
+        auto eddsa = dynamic_cast<const EddsaPublicKeyMaterial*>(key);
+        json.value(eddsa->m_key.length());
+        curve = &eddsa->m_curve;
+      } break;
+      default:
+        break;
+    }
+    json.end_array();
+    json.key("created").value(created);
+    if (curve) json.key("curve").value(curve->as_string());
+    json.key("expires").value(days_valid);
+    auto keyid = pub->keyid();
+    json.key("keyid").value(Botan::hex_encode(keyid.data(), keyid.size()));
+  }
+  json.key("version").value(static_cast<uint8_t>(pub->version()));
+}
+
+static void write_signature_subpackets(JsonWriter& json,
+                                       const V4SignatureSubpacketData* data) {
+  json.begin_array();
+  for (size_t i = 0; i < data->count(); i++) {
+    auto subpacket = data->at(i);
+    json.begin_object();
+    json.key("critical").value(subpacket->m_critical);
+    json.key("length").value(subpacket->body_length());
+    json.key("type").value(static_cast<uint8_t>(subpacket->type()));
+    json.end_object();
+  }
+  json.end_array();
+}
+
+static void write_signature_data(JsonWriter& json, const SignatureData* sig) {
+  const SignatureMaterial* sigmat = nullptr;
+  const V4SignatureData* v4sig = nullptr;
+  uint32_t created = 0;
+  const uint8_t* quick = nullptr;
+  SignatureType type{};
+  HashAlgorithm hash{};
+  switch (sig->version()) {
+    case SignatureVersion::V2:
+    case SignatureVersion::V3: {
+      auto v3sig = dynamic_cast<const V3SignatureData*>(sig);
+      assert(v3sig != nullptr);
+      created = v3sig->m_created;
+      quick = v3sig->m_quick.data();
+      type = v3sig->signature_type();
+      hash = v3sig->hash_algorithm();
+      sigmat = v3sig->m_signature.get();
+    } break;
+    case SignatureVersion::V4: {
+      v4sig = dynamic_cast<const V4SignatureData*>(sig);
+      assert(v4sig != nullptr);
+      created = v4sig->m_created;
+      quick = v4sig->m_quick.data();
+      type = v4sig->signature_type();
+      hash = v4sig->hash_algorithm();
+      sigmat = v4sig->m_signature.get();
+    } break;
+    default:
+      break;
+  }
+  if (sigmat) {
+    json.key("algorithm").value(static_cast<uint8_t>(sigmat->algorithm()));
+    json.key("bits").begin_array();
+    switch (sigmat->algorithm()) {
+      case PublicKeyAlgorithm::Rsa: {
+        auto rsa = dynamic_cast<const RsaSignatureMaterial*>(sigmat);
+        json.value(rsa->m_m_pow_d.length());
+      } break;
+      case PublicKeyAlgorithm::Dsa: {
+        auto dsa = dynamic_cast<const DsaSignatureMaterial*>(sigmat);
+        json.value(dsa->m_r.length()).value(dsa->m_s.length());
+      } break;
+      case PublicKeyAlgorithm::Ecdsa: {
+        auto ecdsa = dynamic_cast<const EcdsaSignatureMaterial*>(sigmat);
+        json.value(ecdsa->m_r.length()).value(ecdsa->m_s.length());
+      } break;
+      case PublicKeyAlgorithm::Eddsa: {
+        auto eddsa = dynamic_cast<const EddsaSignatureMaterial*>(sigmat);
+        json.value(eddsa->m_r.length()).value(eddsa->m_s.length());
+      } break;
+      default:
+        break;
+    }
+    json.end_array();
+    json.key("created").value(created);
+    json.key("digest_begin").value(Botan::hex_encode(quick, 2, false));
+    json.key("hash_algorithm").value(static_cast<uint8_t>(hash));
+    if (v4sig) {
+      json.key("hashed_subpackets");
+      write_signature_subpackets(json, v4sig->m_hashed_subpackets.get());
+      json.key("subpackets");
+      write_signature_subpackets(json, v4sig->m_unhashed_subpackets.get());
+    }
+    json.key("type").value(static_cast<uint8_t>(type));
+  }
+  json.key("version").value(static_cast<uint8_t>(sig->version()));
 }
 
 static void output_public_key_data(std::ostream& out,
@@ -194,7 +338,7 @@ static void output_public_key_data(std::ostream& out,
 
 static void output_signature_subpacket(std::ostream& out,
                                        const std::string& variant,
-                                       SignatureSubpacket* subpacket) {
+                                       const SignatureSubpacket* subpacket) {
   out << "\t" << (subpacket->m_critical ? "critical " : "") << variant << " "
       << static_cast<int>(subpacket->type()) << " len "
       << subpacket->body_length();
@@ -480,11 +624,13 @@ static void output_signature_data(std::ostream& out, const SignatureData* sig) {
           << " "
           << fmt::format("{:02x}", static_cast<int>(v4sig->m_quick.data()[1]))
           << "\n";
-      for (auto& subpacket : v4sig->m_hashed_subpackets->m_subpackets) {
-        output_signature_subpacket(out, "hashed subpkt", subpacket.get());
+      for (size_t i = 0; i < v4sig->m_hashed_subpackets->count(); i++) {
+        output_signature_subpacket(out, "hashed subpkt",
+                                   v4sig->m_hashed_subpackets->at(i));
       }
-      for (auto& subpacket : v4sig->m_unhashed_subpackets->m_subpackets) {
-        output_signature_subpacket(out, "subpkt", subpacket.get());
+      for (size_t i = 0; i < v4sig->m_unhashed_subpackets->count(); i++) {
+        output_signature_subpacket(out, "subpkt",
+                                   v4sig->m_unhashed_subpackets->at(i));
       }
       sigmat = v4sig->m_signature.get();
     } break;
@@ -521,69 +667,114 @@ static void output_signature_data(std::ostream& out, const SignatureData* sig) {
 }
 
 void JsonDump::dump(const Packet* packet) const {
-  DumpPacketSink::dump(packet);
+  switch (packet->type()) {
+    case PacketType::Marker:
+    case PacketType::UserId:
+    case PacketType::UserAttribute:
+    case PacketType::PublicKey:
+    case PacketType::PublicSubkey:
+    case PacketType::Signature:
+      DumpPacketSink::dump(packet);
+      break;
+    default:
+      // Every line of NDJSON output is an object.
+      if (m_ndjson) {
+        JsonWriter json{m_out};
+        json.begin_object().key("_packet").value("Raw");
+        write_header(json, packet->m_header.get());
+        json.key("_type").value(static_cast<uint8_t>(packet->type()));
+        json.end_object();
+      }
+      break;
+  }
   m_out << "\n";
 }
 
 void JsonDump::dump(const MarkerPacket* packet) const {
-  auto val = make_header(packet->m_header.get());
-  val.insert({{"_packet", "Marker"}});
-  m_out << val;
+  JsonWriter json{m_out};
+  json.begin_object().key("_packet").value("Marker");
+  write_header(json, packet->m_header.get());
+  json.end_object();
 }
 
 void JsonDump::dump(const UserIdPacket* uid) const {
-  auto val = make_header(uid->m_header.get());
-  val.insert({{"_packet", "UserId"}, {"content", uid->m_content}});
-  m_out << val;
+  JsonWriter json{m_out};
+  json.begin_object().key("_packet").value("UserId");
+  write_header(json, uid->m_header.get());
+  json.key("content").value(uid->m_content);
+  json.end_object();
 }
 
 void JsonDump::dump(const UserAttributePacket* attr) const {
-  auto val = make_header(attr->m_header.get());
-  tao::json::value subpackets = tao::json::empty_array;
+  JsonWriter json{m_out};
+  json.begin_object().key("_packet").value("UserAttribute");
+  write_header(json, attr->m_header.get());
+  json.key("subpackets").begin_array();
   for (const auto& sub : attr->m_subpackets) {
+    json.begin_object();
     switch (sub->type()) {
       case UserAttributeSubpacketType::Image: {
         auto img = dynamic_cast<const ImageAttributeSubpacket*>(sub.get());
         assert(img != nullptr);
         // FIXME: replace static cast, add subpacket header data
-        tao::json::value subpacket = {
-            {"type", "Image"},
-            {"encoding", static_cast<uint8_t>(img->m_encoding)},
-            {"size", img->m_image.size()}};
-        subpackets.append({subpacket});
+        json.key("encoding").value(static_cast<uint8_t>(img->m_encoding));
+        json.key("size").value(img->image_size());
+        json.key("type").value("Image");
       } break;
       default: {
-        tao::json::value subpacket = {
-            // FIXME: replace static cast, add subpacket header data
-            {"type", "Raw"},
-            {"_type", static_cast<uint8_t>(sub->type())},
-            {"size", sub->body_length()}};
-        subpackets.append({subpacket});
-
+        // FIXME: replace static cast, add subpacket header data
+        json.key("_type").value(static_cast<uint8_t>(sub->type()));
+        json.key("size").value(sub->body_length());
+        json.key("type").value("Raw");
         break;
       }
     }
+    json.end_object();
   }
-  val.insert({{"_packet", "UserAttribute"}, {"subpackets", subpackets}});
-  m_out << val;
+  json.end_array();
+  json.end_object();
 }
 
 void JsonDump::dump(const PublicKeyPacket* pubkey) const {
-  m_out << ":public key packet:\n";
   auto pub = dynamic_cast<const PublicKeyData*>(pubkey->m_public_key.get());
   assert(pub != nullptr);
+  if (m_ndjson) {
+    JsonWriter json{m_out};
+    json.begin_object().key("_packet").value("PublicKey");
+    write_header(json, pubkey->m_header.get());
+    write_public_key_data(json, pub);
+    json.end_object();
+    return;
+  }
+  m_out << ":public key packet:\n";
   output_public_key_data(m_out, pub);
 }
 
 void JsonDump::dump(const PublicSubkeyPacket* pubkey) const {
-  m_out << ":public sub key packet:\n";
   auto pub = dynamic_cast<const PublicKeyData*>(pubkey->m_public_key.get());
   assert(pub != nullptr);
+  if (m_ndjson) {
+    JsonWriter json{m_out};
+    json.begin_object().key("_packet").value("PublicSubkey");
+    write_header(json, pubkey->m_header.get());
+    write_public_key_data(json, pub);
+    json.end_object();
+    return;
+  }
+  m_out << ":public sub key packet:\n";
   output_public_key_data(m_out, pub);
 }
 
 void JsonDump::dump(const SignaturePacket* signature) const {
   auto sig = dynamic_cast<const SignatureData*>(signature->m_signature.get());
   assert(sig);
+  if (m_ndjson) {
+    JsonWriter json{m_out};
+    json.begin_object().key("_packet").value("Signature");
+    write_header(json, signature->m_header.get());
+    write_signature_data(json, sig);
+    json.end_object();
+    return;
+  }
   output_signature_data(m_out, sig);
 }
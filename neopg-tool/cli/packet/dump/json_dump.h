@@ -9,9 +9,14 @@
 
 namespace NeoPG {
 
-/// Json dump format like GnuPG.
+/// Json dump format like GnuPG.  Packets are written as they are parsed,
+/// one per line.
 class JsonDump : public DumpPacketSink {
  public:
+  /// If true, every packet (including keys and signatures) is written as a
+  /// JSON object, so that each line of the output is a JSON document.
+  bool m_ndjson;
+
   /// Dispatcher.
   void dump(const Packet* packet) const override;
 
@@ -22,7 +27,8 @@ class JsonDump : public DumpPacketSink {
   void dump(const PublicSubkeyPacket* packet) const override;
   void dump(const SignaturePacket* packet) const override;
 
-  JsonDump(std::ostream& out) : DumpPacketSink(out) {}
+  JsonDump(std::ostream& out, bool ndjson = false)
+      : DumpPacketSink(out), m_ndjson{ndjson} {}
 };
 
 }  // Namespace NeoPG
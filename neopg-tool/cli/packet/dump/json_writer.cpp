@@ -0,0 +1,141 @@
+// json writer (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg-tool/cli/packet/dump/json_writer.h>
+
+#include <cassert>
+#include <cstring>
+
+using namespace NeoPG;
+
+void JsonWriter::separator() {
+  if (m_after_key) {
+    m_after_key = false;
+    return;
+  }
+  if (m_first.empty()) return;
+  if (m_first.back())
+    m_first.back() = false;
+  else
+    m_out.put(',');
+}
+
+JsonWriter& JsonWriter::begin_object() {
+  separator();
+  m_out.put('{');
+  m_first.push_back(true);
+  return *this;
+}
+
+JsonWriter& JsonWriter::end_object() {
+  assert(!m_first.empty() && !m_after_key);
+  m_first.pop_back();
+  m_out.put('}');
+  return *this;
+}
+
+JsonWriter& JsonWriter::begin_array() {
+  separator();
+  m_out.put('[');
+  m_first.push_back(true);
+  return *this;
+}
+
+JsonWriter& JsonWriter::end_array() {
+  assert(!m_first.empty() && !m_after_key);
+  m_first.pop_back();
+  m_out.put(']');
+  return *this;
+}
+
+JsonWriter& JsonWriter::key(const std::string& name) {
+  separator();
+  quote(m_out, name.data(), name.size());
+  m_out.put(':');
+  m_after_key = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* str, size_t length) {
+  separator();
+  quote(m_out, str, length);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* str) {
+  return value(str, strlen(str));
+}
+
+JsonWriter& JsonWriter::value(uint64_t number) {
+  separator();
+  char buf[20];
+  char* end = buf + sizeof(buf);
+  char* pos = end;
+  do {
+    *--pos = static_cast<char>('0' + number % 10);
+    number /= 10;
+  } while (number);
+  m_out.write(pos, end - pos);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(bool boolean) {
+  separator();
+  if (boolean)
+    m_out.write("true", 4);
+  else
+    m_out.write("false", 5);
+  return *this;
+}
+
+JsonWriter& JsonWriter::null() {
+  separator();
+  m_out.write("null", 4);
+  return *this;
+}
+
+void JsonWriter::quote(std::ostream& out, const char* str, size_t length) {
+  static const char hex[] = "0123456789ABCDEF";
+  out.put('"');
+  // Write runs of characters that need no escaping at once.
+  const char* run = str;
+  const char* end = str + length;
+  for (const char* pos = str; pos != end; pos++) {
+    const unsigned char c = static_cast<unsigned char>(*pos);
+    if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7f) continue;
+    out.write(run, pos - run);
+    run = pos + 1;
+    switch (c) {
+      case '"':
+        out.write("\\\"", 2);
+        break;
+      case '\\':
+        out.write("\\\\", 2);
+        break;
+      case '\b':
+        out.write("\\b", 2);
+        break;
+      case '\f':
+        out.write("\\f", 2);
+        break;
+      case '\n':
+        out.write("\\n", 2);
+        break;
+      case '\r':
+        out.write("\\r", 2);
+        break;
+      case '\t':
+        out.write("\\t", 2);
+        break;
+      default: {
+        const char escape[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+        out.write(escape, sizeof(escape));
+        break;
+      }
+    }
+  }
+  out.write(run, end - run);
+  out.put('"');
+}
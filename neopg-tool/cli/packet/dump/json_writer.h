@@ -0,0 +1,60 @@
+// json writer
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace NeoPG {
+
+/// Write compact JSON to a stream as it is produced, without building a
+/// document in memory.  Separators are inserted automatically:
+///
+///     JsonWriter json{std::cout};
+///     json.begin_object().key("_packet").value("Marker").end_object();
+///
+/// Strings are escaped, but otherwise written as they are (no UTF-8
+/// validation), like tao::json does.
+class JsonWriter {
+ public:
+  JsonWriter(std::ostream& out) : m_out(out) {}
+
+  JsonWriter& begin_object();
+  JsonWriter& end_object();
+  JsonWriter& begin_array();
+  JsonWriter& end_array();
+
+  /// Write the key of the next member of the current object.
+  JsonWriter& key(const std::string& name);
+
+  JsonWriter& value(const char* str, size_t length);
+  JsonWriter& value(const std::string& str) {
+    return value(str.data(), str.size());
+  }
+  JsonWriter& value(const char* str);
+  JsonWriter& value(uint64_t number);
+  JsonWriter& value(uint32_t number) { return value(uint64_t{number}); }
+  JsonWriter& value(uint16_t number) { return value(uint64_t{number}); }
+  JsonWriter& value(uint8_t number) { return value(uint64_t{number}); }
+  JsonWriter& value(bool boolean);
+  JsonWriter& null();
+
+  /// Write \p str as an escaped JSON string to \p out.
+  static void quote(std::ostream& out, const char* str, size_t length);
+
+ private:
+  void separator();
+
+  std::ostream& m_out;
+  // One entry per open object or array: true until the first element.
+  std::vector<bool> m_first;
+  bool m_after_key{false};
+};
+
+}  // Namespace NeoPG
@@ -5,6 +5,8 @@
 
 #include <neopg-tool/cli/packet/dump/legacy_dump.h>
 
+#include <neopg/utils/hex.h>
+
 #include <neopg/openpgp/public_key/data/v3_public_key_data.h>
 #include <neopg/openpgp/public_key/data/v4_public_key_data.h>
 
@@ -60,7 +62,6 @@
 
 #include <botan/data_snk.h>
 #include <botan/data_src.h>
-#include <botan/hex.h>
 
 #include <botan/ber_dec.h>
 #include <botan/oids.h>
@@ -78,7 +79,7 @@
 using namespace NeoPG;
 
 static void output_header(std::ostream& out, const PacketHeader* header) {
-  std::stringstream head_ss;
+  ByteWriter head_ss;
   header->write(head_ss);
   auto head = head_ss.str();
 
@@ -160,13 +161,13 @@ static void output_public_key_data(std::ostream& out,
         break;
     }
     auto keyid = pub->keyid();
-    out << "\tkeyid: " << Botan::hex_encode(keyid.data(), keyid.size()) << "\n";
+    out << "\tkeyid: " << hex_encode(keyid.data(), keyid.size()) << "\n";
   }
 }
 
 static void output_signature_subpacket(std::ostream& out,
                                        const std::string& variant,
-                                       SignatureSubpacket* subpacket) {
+                                       const SignatureSubpacket* subpacket) {
   out << "\t" << (subpacket->m_critical ? "critical " : "") << variant << " "
       << static_cast<int>(subpacket->type()) << " len "
       << subpacket->body_length();
@@ -250,8 +251,8 @@ static void output_signature_subpacket(std::ostream& out,
       out << " (revocation key: c="
           << fmt::format("{:02x}", static_cast<int>(sub->m_class))
           << " a=" << static_cast<int>(sub->m_algorithm) << " f="
-          << Botan::hex_encode(sub->m_fingerprint.data(),
-                               sub->m_fingerprint.size())
+          << hex_encode(sub->m_fingerprint.data(),
+                        sub->m_fingerprint.size())
           << ")";
       break;
     }
@@ -259,7 +260,7 @@ static void output_signature_subpacket(std::ostream& out,
       auto sub = dynamic_cast<const IssuerSubpacket*>(subpacket);
       assert(sub != nullptr);
       out << " (issuer key ID "
-          << Botan::hex_encode(sub->m_issuer.data(), sub->m_issuer.size())
+          << hex_encode(sub->m_issuer.data(), sub->m_issuer.size())
           << ")";
       break;
     }
@@ -298,7 +299,7 @@ static void output_signature_subpacket(std::ostream& out,
       auto sub = dynamic_cast<const KeyServerPreferencesSubpacket*>(subpacket);
       assert(sub != nullptr);
       out << " (keyserver preferences: "
-          << Botan::hex_encode(sub->m_flags.data(), sub->m_flags.size()) << ")";
+          << hex_encode(sub->m_flags.data(), sub->m_flags.size()) << ")";
       break;
     }
     case SignatureSubpacketType::PreferredKeyServer: {
@@ -326,7 +327,7 @@ static void output_signature_subpacket(std::ostream& out,
       auto sub = dynamic_cast<const KeyFlagsSubpacket*>(subpacket);
       assert(sub != nullptr);
       out << " (key flags: "
-          << Botan::hex_encode(sub->m_flags.data(), sub->m_flags.size()) << ")";
+          << hex_encode(sub->m_flags.data(), sub->m_flags.size()) << ")";
       break;
     }
     case SignatureSubpacketType::SignersUserId: {
@@ -349,7 +350,7 @@ static void output_signature_subpacket(std::ostream& out,
       auto sub = dynamic_cast<const FeaturesSubpacket*>(subpacket);
       assert(sub != nullptr);
       out << " (features: "
-          << Botan::hex_encode(sub->m_features.data(), sub->m_features.size())
+          << hex_encode(sub->m_features.data(), sub->m_features.size())
           << ")";
       break;
     }
@@ -361,7 +362,7 @@ static void output_signature_subpacket(std::ostream& out,
                  "{:d}), digest ",
                  static_cast<uint8_t>(sub->m_public_key_algorithm),
                  static_cast<uint8_t>(sub->m_hash_algorithm))
-          << Botan::hex_encode(sub->m_hash.data(), sub->m_hash.size()) << ")";
+          << hex_encode(sub->m_hash.data(), sub->m_hash.size()) << ")";
       break;
     }
     case SignatureSubpacketType::EmbeddedSignature: {
@@ -452,11 +453,13 @@ static void output_signature_data(std::ostream& out, const SignatureData* sig) {
           << " "
           << fmt::format("{:02x}", static_cast<int>(v4sig->m_quick.data()[1]))
           << "\n";
-      for (auto& subpacket : v4sig->m_hashed_subpackets->m_subpackets) {
-        output_signature_subpacket(out, "hashed subpkt", subpacket.get());
+      for (size_t i = 0; i < v4sig->m_hashed_subpackets->count(); i++) {
+        output_signature_subpacket(out, "hashed subpkt",
+                                   v4sig->m_hashed_subpackets->at(i));
       }
-      for (auto& subpacket : v4sig->m_unhashed_subpackets->m_subpackets) {
-        output_signature_subpacket(out, "subpkt", subpacket.get());
+      for (size_t i = 0; i < v4sig->m_unhashed_subpackets->count(); i++) {
+        output_signature_subpacket(out, "subpkt",
+                                   v4sig->m_unhashed_subpackets->at(i));
       }
       sigmat = v4sig->m_signature.get();
     } break;
@@ -515,7 +518,7 @@ void LegacyDump::dump(const UserAttributePacket* attr) const {
         assert(img != nullptr);
         m_out << fmt::format("\t[image {:d} of size {:d}]\n",
                              static_cast<uint8_t>(img->m_encoding),
-                             img->m_image.size());
+                             img->image_size());
       } break;
       default:
         m_out << fmt::format("\t[unknown type {:d} of size {:d}]\n",
@@ -7,9 +7,15 @@
 
 #include <neopg-tool/cli/packet/dump/hex_dump.h>
 #include <neopg-tool/cli/packet/dump/json_dump.h>
+#include <neopg-tool/cli/packet/dump/json_writer.h>
 #include <neopg-tool/cli/packet/dump/legacy_dump.h>
+#include <neopg-tool/io/file_io.h>
+
+#include <neopg/openpgp/round_trip_verifier.h>
+#include <neopg/openpgp/user_attribute/subpacket/image_attribute_subpacket.h>
+#include <neopg/parser/decompressing_packet_sink.h>
+#include <neopg/utils/stream.h>
 
-#include <botan/data_snk.h>
 #include <botan/data_src.h>
 #include <botan/hex.h>
 
@@ -24,7 +30,16 @@
 
 #include <tao/json.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 namespace NeoPG {
 template <typename T, typename... Args>
@@ -35,45 +50,384 @@ std::unique_ptr<T> make_unique(Args&&... args) {
 
 using namespace NeoPG;
 
-#include <botan/comp_filter.h>
-#include <botan/pipe.h>
+namespace {
+const std::pair<const char*, PacketType> packet_type_names[] = {
+    {"Reserved", PacketType::Reserved},
+    {"PublicKeyEncryptedSessionKey", PacketType::PublicKeyEncryptedSessionKey},
+    {"Signature", PacketType::Signature},
+    {"SymmetricKeyEncryptedSessionKey",
+     PacketType::SymmetricKeyEncryptedSessionKey},
+    {"OnePassSignature", PacketType::OnePassSignature},
+    {"SecretKey", PacketType::SecretKey},
+    {"PublicKey", PacketType::PublicKey},
+    {"SecretSubkey", PacketType::SecretSubkey},
+    {"CompressedData", PacketType::CompressedData},
+    {"SymmetricallyEncryptedData", PacketType::SymmetricallyEncryptedData},
+    {"Marker", PacketType::Marker},
+    {"LiteralData", PacketType::LiteralData},
+    {"Trust", PacketType::Trust},
+    {"UserId", PacketType::UserId},
+    {"PublicSubkey", PacketType::PublicSubkey},
+    {"UserAttribute", PacketType::UserAttribute},
+    {"SymmetricallyEncryptedIntegrityProtectedData",
+     PacketType::SymmetricallyEncryptedIntegrityProtectedData},
+    {"ModificationDetectionCode", PacketType::ModificationDetectionCode},
+};
+
+std::string lowercase(std::string str) {
+  std::transform(str.begin(), str.end(), str.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return str;
+}
+
+// Parse a comma-separated list of packet type names (case-insensitive) or
+// numbers.
+PacketTypeMask parse_packet_types(const std::string& spec) {
+  if (spec.empty()) return PacketTypeMask::all();
+
+  PacketTypeMask mask;
+  std::stringstream in{spec};
+  std::string name;
+  while (std::getline(in, name, ',')) {
+    if (name.empty()) continue;
+    if (std::all_of(name.begin(), name.end(),
+                    [](unsigned char c) { return std::isdigit(c); })) {
+      if (name.size() > 2 || std::stoi(name) > 63)
+        throw CLI::ValidationError("--only", "invalid packet type " + name);
+      mask.set(static_cast<PacketType>(std::stoi(name)));
+      continue;
+    }
+    auto entry = std::find_if(
+        std::begin(packet_type_names), std::end(packet_type_names),
+        [&name](const std::pair<const char*, PacketType>& entry) {
+          return lowercase(entry.first) == lowercase(name);
+        });
+    if (entry == std::end(packet_type_names))
+      throw CLI::ValidationError("--only", "unknown packet type " + name);
+    mask.set(entry->second);
+  }
+  return mask;
+}
+
+// The name of packet type \p idx, or its number if it has no name.
+std::string packet_type_name(size_t idx) {
+  auto entry = std::find_if(
+      std::begin(packet_type_names), std::end(packet_type_names),
+      [idx](const std::pair<const char*, PacketType>& entry) {
+        return static_cast<size_t>(entry.second) == idx;
+      });
+  if (entry == std::end(packet_type_names)) return std::to_string(idx);
+  return entry->first;
+}
+
+tao::json::value stats_to_json(const ParserStats& stats) {
+  using seconds = std::chrono::duration<double>;
+  double total = std::chrono::duration_cast<seconds>(stats.m_total).count();
+
+  tao::json::value types = tao::json::empty_object;
+  for (size_t idx = 0; idx < ParserStats::PACKET_TYPES; idx++) {
+    if (stats.m_packets[idx] == 0) continue;
+    types[packet_type_name(idx)] = {{"packets", stats.m_packets[idx]},
+                                    {"bytes", stats.m_bytes[idx]}};
+  }
+
+  tao::json::value errors = tao::json::empty_object;
+  for (const auto& error : stats.m_errors) errors[error.first] = error.second;
 
-static void process_msg(const std::string& format, Botan::DataSource& source,
-                        Botan::DataSink& out) {
-  out.start_msg();
-  std::unique_ptr<RawPacketSink> sink;
+  return {
+      {"packets", stats.packets()},
+      {"bytes", stats.bytes()},
+      {"seconds", total},
+      {"packets_per_second", total > 0 ? stats.packets() / total : 0.0},
+      {"bytes_per_second", total > 0 ? stats.bytes() / total : 0.0},
+      {"framing_seconds",
+       std::chrono::duration_cast<seconds>(stats.framing_time()).count()},
+      {"decode_seconds",
+       std::chrono::duration_cast<seconds>(stats.m_decode).count()},
+      {"decoded", stats.m_decoded},
+      {"refills", stats.m_refills},
+      {"types", types},
+      {"errors", errors},
+  };
+}
+
+// How the packets are written.
+struct SinkOptions {
+  std::string m_format;
+  size_t m_max_bytes;
+  bool m_decompress;
+  DecompressionLimits m_limits;
+};
+}  // namespace
+
+static std::unique_ptr<RawPacketSink> make_sink(const SinkOptions& options,
+                                                std::ostream& out) {
+  const std::string& format = options.m_format;
   if (format == "legacy")
-    sink = NeoPG::make_unique<LegacyDump>(std::cout);
+    return NeoPG::make_unique<LegacyDump>(out);
   else if (format == "hex")
-    sink = NeoPG::make_unique<HexDump>(std::cout);
+    return NeoPG::make_unique<HexDump>(out, options.m_max_bytes);
+  else if (format == "ndjson")
+    return NeoPG::make_unique<JsonDump>(out, true);
   else
-    sink = NeoPG::make_unique<JsonDump>(std::cout);
-  RawPacketParser parser(*sink);
+    return NeoPG::make_unique<JsonDump>(out);
+}
 
-  //  Botan::Pipe parser(new Botan::Decompression_Filter("zlib"));
+// Run process on a parser for options, and report unrecoverable errors in
+// the output.
+template <typename Process>
+static void dump(const SinkOptions& options, PacketTypeMask only,
+                 ParserStats* stats, std::ostream& out, Process process) {
+  std::unique_ptr<RawPacketSink> sink = make_sink(options, out);
+  // With decompression, the filter applies to the content of compressed data
+  // packets, too, so the parser only lets those through in addition.
+  RawPacketSinkAdaptor adaptor(*sink);
+  FilterPacketSink filter(adaptor, only);
+  DecompressingPacketSink decompress(filter, options.m_limits);
+  std::unique_ptr<RawPacketParser> parser;
+  if (options.m_decompress) {
+    parser = NeoPG::make_unique<RawPacketParser>(decompress);
+    only.set(PacketType::CompressedData);
+  } else
+    parser = NeoPG::make_unique<RawPacketParser>(*sink);
+  parser->set_filter(only);
+  parser->set_stats(stats);
 
   try {
-    parser.process(source);
+    process(*parser);
   } catch (const ParserError& exc) {
-    std::cout << rang::style::bold << rang::fgB::red << "ERROR"
-              << rang::style::reset
-              << ":unrecoverable error:" << exc.as_string() << "\n";
+    if (options.m_format == "ndjson") {
+      JsonWriter json{out};
+      json.begin_object().key("_error");
+      json.value("unrecoverable error:" + exc.as_string()).end_object();
+      out << "\n";
+      return;
+    }
+    out << rang::style::bold << rang::fgB::red << "ERROR"
+        << rang::style::reset << ":unrecoverable error:" << exc.as_string()
+        << "\n";
   }
-  out.end_msg();
 }
 
-void DumpPacketCommand::run() {
-  Botan::DataSink_Stream out{std::cout};
-
-  if (m_files.empty()) m_files.emplace_back("-");
-  for (auto& file : m_files) {
-    if (file == "-") {
-      Botan::DataSource_Stream in{std::cin};
-      process_msg(m_format, in, out);
-    } else {
-      // Open in binary mode.
-      Botan::DataSource_Stream in{file, true};
-      process_msg(m_format, in, out);
+static void process_msg(const SinkOptions& options, PacketTypeMask only,
+                        ParserStats* stats, InputFile& in, std::ostream& out) {
+  InputSource source{in};
+  dump(options, only, stats, out,
+       [&source](RawPacketParser& parser) { parser.process(source); });
+}
+
+// Files are mapped into memory, which avoids copying through the parser
+// buffer and allows packets larger than RawPacketParser::MAX_PARSER_BUFFER.
+static void process_file(const SinkOptions& options, PacketTypeMask only,
+                         ParserStats* stats, const std::string& file,
+                         std::ostream& out) {
+  dump(options, only, stats, out,
+       [&file](RawPacketParser& parser) { parser.process_mapped(file); });
+}
+
+// Dump \p file, or stdin for "-".
+static void process_input(const SinkOptions& options, PacketTypeMask only,
+                          ParserStats* stats, const std::string& file,
+                          std::ostream& out) {
+  if (file == "-") {
+    InputFile in{file};
+    process_msg(options, only, stats, in, out);
+  } else
+    process_file(options, only, stats, file, out);
+}
+
+static SinkOptions sink_options(const DumpPacketCommand& cmd) {
+  DecompressionLimits limits;
+  limits.m_max_depth = cmd.m_max_depth;
+  limits.m_max_ratio = cmd.m_max_ratio;
+  return {cmd.m_format, cmd.m_max_bytes, cmd.m_decompress, limits};
+}
+
+void DumpPacketCommand::run_batch(PacketTypeMask only, ParserStats* total) {
+  const SinkOptions options = sink_options(*this);
+  std::string line;
+  std::string blob;
+  std::string output;
+  size_t count = 0;
+  while (std::getline(std::cin, line)) {
+    if (line.empty()) continue;
+    std::string name = line;
+    if (m_batch == "blobs") {
+      if (line.size() > 18 ||
+          !std::all_of(line.begin(), line.end(),
+                       [](unsigned char c) { return std::isdigit(c); }))
+        throw CLI::ValidationError("--batch", "invalid blob length " + line);
+      blob.resize(std::stoull(line));
+      std::cin.read(&blob[0], blob.size());
+      if (static_cast<size_t>(std::cin.gcount()) != blob.size())
+        throw CLI::ValidationError("--batch", "truncated blob");
+      name = "#" + std::to_string(count);
     }
+    count++;
+
+    output.clear();
+    BufferStream out{output};
+    ParserStats stats;
+    ParserStats* stats_ptr = total ? &stats : nullptr;
+    tao::json::value result = {{"input", name}};
+    try {
+      if (m_batch == "blobs")
+        dump(options, only, stats_ptr, out, [&blob](RawPacketParser& parser) {
+          parser.process(blob.data(), blob.size());
+        });
+      else
+        process_file(options, only, stats_ptr, name, out);
+    } catch (const std::exception& exc) {
+      result["error"] = exc.what();
+    }
+    out.flush();
+    result["output"] = output;
+    if (total) {
+      result["stats"] = stats_to_json(stats);
+      total->merge(stats);
+    }
+    // Flush, so the caller can wait for the result before sending the next
+    // input.
+    std::cout << tao::json::to_string(result) << "\n" << std::flush;
+  }
+}
+
+void DumpPacketCommand::run_files(PacketTypeMask only,
+                                  ImageAttributeSubpacket::Mode images,
+                                  ParserStats* total) {
+  const SinkOptions options = sink_options(*this);
+  size_t jobs = m_jobs ? m_jobs : std::thread::hardware_concurrency();
+  jobs = std::max<size_t>(1, std::min(jobs, m_files.size()));
+
+  // With --output-suffix, every file but stdin gets its own output.
+  auto dump_one = [this, &options, only](const std::string& file,
+                                         ParserStats* stats,
+                                         std::ostream& out) {
+    if (m_output_suffix.empty() || file == "-") {
+      process_input(options, only, stats, file, out);
+      return;
+    }
+    OutputFile file_out{file + m_output_suffix};
+    process_input(options, only, stats, file, file_out.stream());
+    file_out.flush();
+  };
+
+  OutputFile out{"-"};
+  if (jobs == 1) {
+    for (auto& file : m_files) dump_one(file, total, out.stream());
+    out.flush();
+    return;
+  }
+
+  // Workers take the next file from a shared counter.  They stay less than
+  // twice as many files as there are workers ahead of the output, which
+  // bounds the buffered output.
+  struct Result {
+    bool m_done{false};
+    std::string m_output;
+    ParserStats m_stats;
+    std::exception_ptr m_error;
+  };
+  const size_t window = 2 * jobs;
+  std::vector<Result> results(m_files.size());
+  std::atomic<size_t> next{0};
+  size_t written = 0;
+  bool stop = false;
+  std::mutex mutex;
+  std::condition_variable changed;
+
+  auto worker = [&]() {
+    ImageAttributeSubpacket::Scope scope{images};
+    size_t idx;
+    while ((idx = next++) < m_files.size()) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return stop || idx < written + window; });
+        if (stop) return;
+      }
+      // The dump is rendered into a buffer and written to stdout in the
+      // order of the files.
+      Result result;
+      try {
+        BufferStream buffer{result.m_output};
+        dump_one(m_files[idx], total ? &result.m_stats : nullptr, buffer);
+        buffer.flush();
+      } catch (...) {
+        result.m_error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      results[idx] = std::move(result);
+      results[idx].m_done = true;
+      changed.notify_all();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < jobs; i++) workers.emplace_back(worker);
+
+  std::exception_ptr error;
+  for (size_t idx = 0; idx < m_files.size(); idx++) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&results, idx]() { return results[idx].m_done; });
+    lock.unlock();
+    Result& result = results[idx];
+    try {
+      if (result.m_error) std::rethrow_exception(result.m_error);
+      out.write(result.m_output.data(), result.m_output.size());
+      if (total) total->merge(result.m_stats);
+    } catch (...) {
+      // Stop the workers after their current file.
+      error = std::current_exception();
+      lock.lock();
+      stop = true;
+      changed.notify_all();
+      break;
+    }
+    result = Result();
+    lock.lock();
+    written = idx + 1;
+    changed.notify_all();
+  }
+
+  for (auto& thread : workers) thread.join();
+  if (error) std::rethrow_exception(error);
+  out.flush();
+}
+
+void DumpPacketCommand::run() {
+  PacketTypeMask only = parse_packet_types(m_only);
+  ParserStats stats;
+  ParserStats* stats_ptr = m_stats ? &stats : nullptr;
+
+  if (!m_batch.empty() && m_batch != "paths" && m_batch != "blobs")
+    throw CLI::ValidationError("--batch", "must be paths or blobs");
+  if (!m_batch.empty() && !m_files.empty())
+    throw CLI::ValidationError("--batch", "can not be used with files");
+  if (!m_batch.empty() && !m_output_suffix.empty())
+    throw CLI::ValidationError("--output-suffix",
+                               "can not be used with --batch");
+
+  // The dumps only show the size of photo IDs, so the images are not
+  // copied, unless the packets are re-encoded for verification.
+  const ImageAttributeSubpacket::Mode images =
+      m_verify_round_trip ? ImageAttributeSubpacket::Mode::Copy
+                          : ImageAttributeSubpacket::Mode::Skip;
+  ImageAttributeSubpacket::Scope scope{images};
+
+  std::unique_ptr<RoundTripVerifier> verifier;
+  if (m_verify_round_trip) {
+    verifier = NeoPG::make_unique<RoundTripVerifier>(m_verify_round_trip);
+    RoundTripVerifier::set_global(verifier.get());
   }
+
+  if (!m_batch.empty()) {
+    run_batch(only, stats_ptr);
+  } else {
+    if (m_files.empty()) m_files.emplace_back("-");
+    run_files(only, images, stats_ptr);
+  }
+
+  if (m_stats) std::cerr << tao::json::to_string(stats_to_json(stats)) << "\n";
+
+  if (verifier) RoundTripVerifier::set_global(nullptr);
 }
@@ -7,6 +7,8 @@
 
 #include <neopg-tool/cli/command.h>
 
+#include <neopg/openpgp/user_attribute/subpacket/image_attribute_subpacket.h>
+#include <neopg/parser/decompressing_packet_sink.h>
 #include <neopg/parser/openpgp.h>
 
 #include <ostream>
@@ -17,15 +19,79 @@ class DumpPacketCommand : public Command {
  public:
   std::vector<std::string> m_files;
   std::string m_format;
+  std::string m_only;
+  uint32_t m_verify_round_trip{0};
+  bool m_stats{false};
+  std::string m_batch;
+  size_t m_max_bytes{0};
+  bool m_decompress{false};
+  size_t m_max_depth{DecompressionLimits().m_max_depth};
+  uint64_t m_max_ratio{DecompressionLimits().m_max_ratio};
+  unsigned int m_jobs{1};
+  std::string m_output_suffix;
 
   DumpPacketCommand(CLI::App& app, const std::string& flag,
                     const std::string& description,
                     const std::string& group_name = "")
       : Command(app, flag, description, group_name) {
-    m_cmd.add_option("--format", m_format, "output format", true);
+    m_cmd.add_option("--format", m_format,
+                     "output format: json, ndjson (one JSON object per "
+                     "packet and line), legacy or hex",
+                     true);
+    m_cmd.add_option("--max-bytes", m_max_bytes,
+                     "in hex dumps, show at most N bytes of each field (0 "
+                     "shows all)",
+                     true)
+        ->set_type_name("N");
+    m_cmd.add_option("--verify-round-trip", m_verify_round_trip,
+                     "check that every N-th packet writes out its input "
+                     "(0 disables the check)",
+                     true);
+    m_cmd.add_option("--only", m_only,
+                     "only decode packets of these types (comma-separated "
+                     "names like PublicKey,UserId or numbers)")
+        ->set_type_name("TYPE,...");
+    m_cmd.add_flag("--stats", m_stats,
+                   "print parser statistics as JSON to stderr");
+    m_cmd.add_option("--batch", m_batch,
+                     "read inputs from stdin and write one JSON object per "
+                     "input to stdout: paths (one file name per line) or "
+                     "blobs (a line with the length, then the data)")
+        ->set_type_name("MODE");
+    m_cmd.add_flag("--decompress", m_decompress,
+                   "also dump the packets inside compressed data packets");
+    m_cmd.add_option("--max-depth", m_max_depth,
+                     "with --decompress, decompress at most N nested "
+                     "compressed data packets",
+                     true)
+        ->set_type_name("N");
+    m_cmd.add_option("--max-ratio", m_max_ratio,
+                     "with --decompress, stop when the data expands more "
+                     "than N times",
+                     true)
+        ->set_type_name("N");
+    m_cmd.add_option("-j,--jobs", m_jobs,
+                     "number of files to dump concurrently (0 uses all "
+                     "cores); the output stays in the order of the files",
+                     true);
+    m_cmd.add_option("--output-suffix", m_output_suffix,
+                     "write the dump of each file to the file name followed "
+                     "by SUFFIX instead of stdout")
+        ->set_type_name("SUFFIX");
     m_cmd.add_option("file", m_files, "file to process");
   }
   void run();
+
+ private:
+  /// Process the inputs of --batch.  With \p total, add statistics to each
+  /// result, and merge them into \p total.
+  void run_batch(PacketTypeMask only, ParserStats* total);
+
+  /// Dump m_files with up to m_jobs threads.  Each thread uses
+  /// \p images for the photo IDs.  With \p total, merge the statistics of
+  /// all files into \p total.
+  void run_files(PacketTypeMask only, ImageAttributeSubpacket::Mode images,
+                 ParserStats* total);
 };
 
 }  // Namespace NeoPG
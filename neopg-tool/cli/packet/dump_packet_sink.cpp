@@ -75,6 +75,7 @@
 
 #include <tao/json.hpp>
 
+#include <initializer_list>
 #include <iostream>
 
 using namespace NeoPG;
@@ -140,14 +141,28 @@ void DumpPacketSink::dump(const Packet* packet) const {
 //   };
 // };
 
+// Decode the lazily parsed parts of \p packet, so that errors in them are
+// reported like other packet errors, before any output is written.
+static void decode_lazy(const Packet* packet) {
+  if (packet->type() != PacketType::Signature) return;
+  auto pkt = dynamic_cast<const SignaturePacket*>(packet);
+  assert(pkt != nullptr);
+  auto v4sig = dynamic_cast<const V4SignatureData*>(pkt->m_signature.get());
+  if (v4sig == nullptr) return;
+  for (auto data :
+       {v4sig->m_hashed_subpackets.get(), v4sig->m_unhashed_subpackets.get()})
+    for (size_t i = 0; i < data->count(); i++) data->at(i);
+}
+
 void DumpPacketSink::next_packet(std::unique_ptr<PacketHeader> header,
                                  const char* data, size_t length) {
   assert(length == header->length());
   size_t offset = header->m_offset;
   try {
     ParserInput in{data, length};
-    auto packet = Packet::create_or_throw(header->type(), in);
+    auto packet = Packet::create_view_or_throw(header->type(), in);
     packet->m_header = std::move(header);
+    decode_lazy(packet.get());
     dump(packet.get());
   } catch (ParserError& exc) {
     exc.m_pos.m_byte += offset;
@@ -5,13 +5,14 @@
 */
 
 #include <neopg-tool/cli/packet_command.h>
+#include <neopg-tool/io/file_io.h>
 
 #include <neopg/openpgp/marker_packet.h>
+#include <neopg/parser/decompressing_packet_sink.h>
 #include <neopg/parser/openpgp.h>
 #include <neopg/parser/parser_error.h>
 #include <neopg/openpgp/user_id_packet.h>
 
-#include <botan/data_snk.h>
 #include <botan/data_src.h>
 #include <botan/hex.h>
 
@@ -41,33 +42,39 @@ void UserIdPacketCommand::run() {
   packet.write(std::cout);
 }
 
+// Parse each packet and write it out again from the object model.
 struct LegacyPacketSink : public RawPacketSink {
+  ByteWriter& m_out;
+
+  LegacyPacketSink(ByteWriter& out) : m_out(out) {}
+
   void next_packet(std::unique_ptr<PacketHeader> header, const char* data,
                    size_t length) {
     assert(length == header->length());
     size_t offset = header->m_offset;
     try {
       ParserInput in{data, length};
-      auto packet = Packet::create_or_throw(header->type(), in);
+      // Unknown packets are written out from the input without a copy.
+      auto packet = Packet::create_view_or_throw(header->type(), in);
       packet->m_header = std::move(header);
-      packet->write(std::cout);
+      packet->write(m_out);
     } catch (ParserError& exc) {
       exc.m_pos.m_byte += offset;
       std::cerr << rang::style::bold << rang::fgB::red << "ERROR"
                 << rang::style::reset << ":" << exc.as_string() << "\n";
       // FIXME: Add option to suppress errorneous output.
-      header->write(std::cout);
-      std::cout.write(data, length);
+      header->write(m_out);
+      m_out.put_bytes(data, length);
     }
   }
 
   void start_packet(std::unique_ptr<PacketHeader> header) {
-    header->write(std::cout);
+    header->write(m_out);
   }
   void continue_packet(std::unique_ptr<NewPacketLength> length_info,
                        const char* data, size_t length) {
-    if (length_info) length_info->write(std::cout);
-    std::cout.write(data, length);
+    if (length_info) length_info->write(m_out);
+    m_out.put_bytes(data, length);
   }
   void finish_packet(std::unique_ptr<NewPacketLength> length_info,
                      const char* data, size_t length) {
@@ -81,35 +88,99 @@ struct LegacyPacketSink : public RawPacketSink {
   };
 };
 
-static void process_msg(Botan::DataSource& source, Botan::DataSink& out) {
-  out.start_msg();
-  LegacyPacketSink sink;
-  RawPacketParser parser(sink);
+// Copy each packet from the parser buffer.  The header is written from the
+// framing parser's state, and the body is copied without decoding it, so
+// nothing is allocated per packet.
+struct CopyPacketSink : public RawPacketRefSink {
+  ByteWriter& m_out;
+
+  CopyPacketSink(ByteWriter& out) : m_out(out) {}
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override {
+    header.write(m_out);
+    m_out.put_bytes(data, length);
+  }
+  void start_packet(const PacketHeader& header) override {
+    header.write(m_out);
+  }
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override {
+    if (length_info) length_info->write(m_out);
+    m_out.put_bytes(data, length);
+  }
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override {
+    continue_packet(length_info, data, length);
+  }
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override {
+    std::cerr << rang::style::bold << rang::fgB::red << "ERROR"
+              << rang::style::reset << ":" << error.as_string() << "\n";
+  }
+};
+
+// How the packets are filtered.
+struct FilterOptions {
+  bool m_decompress;
+  bool m_reencode;
+};
+
+// Run process on a parser that writes the packets to stdout, and report
+// unrecoverable errors.  With m_decompress, compressed data packets are
+// replaced by their content.  With m_reencode, packets are written out from
+// the object model, otherwise they are copied.
+template <typename Process>
+static void filter(const FilterOptions& options, std::ostream& stream,
+                   Process process) {
+  ByteWriter out{stream};
+  LegacyPacketSink legacy{out};
+  RawPacketSinkAdaptor adaptor{legacy};
+  CopyPacketSink copy{out};
+  RawPacketRefSink& sink =
+      options.m_reencode ? static_cast<RawPacketRefSink&>(adaptor) : copy;
+  DecompressingPacketSink decompressing(sink, DecompressionLimits(), false);
+  RawPacketParser parser(options.m_decompress ? decompressing : sink);
 
   try {
-    parser.process(source);
+    process(parser);
   } catch (const ParserError& exc) {
+    out.flush();
     std::cerr << rang::style::bold << rang::fgB::red << "ERROR"
               << rang::style::reset
               << ":unrecoverable error:" << exc.as_string() << "\n";
   }
-  out.end_msg();
+}
+
+static void process_msg(const FilterOptions& options, InputFile& in,
+                        std::ostream& out) {
+  InputSource source{in};
+  filter(options, out,
+         [&source](RawPacketParser& parser) { parser.process(source); });
+}
+
+// Files are mapped into memory, so packets are passed through without
+// copying them into the parser buffer.
+static void process_file(const FilterOptions& options,
+                         const std::string& file, std::ostream& out) {
+  filter(options, out,
+         [&file](RawPacketParser& parser) { parser.process_mapped(file); });
 }
 
 void FilterPacketCommand::run() {
-  Botan::DataSink_Stream out{std::cout};
+  const FilterOptions options{m_decompress, m_reencode};
+  OutputFile out{"-"};
 
   if (m_files.empty()) m_files.emplace_back("-");
   for (auto& file : m_files) {
     if (file == "-") {
-      Botan::DataSource_Stream in{std::cin};
-      process_msg(in, out);
+      InputFile in{file};
+      process_msg(options, in, out.stream());
     } else {
-      // Open in binary mode.
-      Botan::DataSource_Stream in{file, true};
-      process_msg(in, out);
+      process_file(options, file, out.stream());
     }
   }
+  out.flush();
 }
 
 PacketCommand::PacketCommand(CLI::App& app, const std::string& flag,
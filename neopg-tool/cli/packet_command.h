@@ -37,11 +37,18 @@ class UserIdPacketCommand : public Command {
 class FilterPacketCommand : public Command {
  public:
   std::vector<std::string> m_files;
+  bool m_decompress{false};
+  bool m_reencode{false};
 
   FilterPacketCommand(CLI::App& app, const std::string& flag,
                       const std::string& description,
                       const std::string& group_name = "")
       : Command(app, flag, description, group_name) {
+    m_cmd.add_flag("--decompress", m_decompress,
+                   "replace compressed data packets by their content");
+    m_cmd.add_flag("--reencode", m_reencode,
+                   "parse each packet and write it out again, instead of "
+                   "copying it");
     m_cmd.add_option("file", m_files, "file to process");
   }
   void run();
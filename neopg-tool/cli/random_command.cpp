@@ -4,7 +4,16 @@
    NeoPG is released under the Simplified BSD License (see license.txt)
 */
 
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <botan/chacha_rng.h>
+#include <botan/exceptn.h>
+
+#include <tao/json.hpp>
 
 #include <neopg/crypto/rng.h>
 
@@ -12,15 +21,79 @@
 
 namespace NeoPG {
 
+void RandomCommand::run_fast(bool infinite, size_t threads) {
+  // One generator per worker, each used by only one thread at a time.
+  std::vector<std::unique_ptr<Botan::ChaCha_RNG>> generators;
+  for (size_t i = 0; i < threads; i++) {
+    Botan::secure_vector<uint8_t> seed = rng()->random_vec(64);
+    generators.emplace_back(new Botan::ChaCha_RNG(seed));
+  }
+
+  // While the main thread writes one batch of blocks, the workers fill the
+  // next one.  Only the bytes still needed are generated.
+  uint64_t left = m_count;
+  auto fill = [&generators, &left,
+               infinite](std::vector<std::vector<uint8_t>>& blocks) {
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < blocks.size(); i++) {
+      size_t size = FAST_BLOCK_SIZE;
+      if (!infinite && left < size) size = left;
+      left -= infinite ? 0 : size;
+      blocks[i].resize(size);
+      if (size == 0) continue;
+      workers.emplace_back([&generators, &blocks, i]() {
+        generators[i]->randomize(blocks[i].data(), blocks[i].size());
+      });
+    }
+    return workers;
+  };
+
+  std::vector<std::vector<uint8_t>> current(threads), next(threads);
+  for (auto& worker : fill(current)) worker.join();
+  while (!current[0].empty()) {
+    auto workers = fill(next);
+    for (auto& block : current)
+      std::cout.write(reinterpret_cast<const char*>(block.data()),
+                      block.size());
+    for (auto& worker : workers) worker.join();
+    if (!std::cout) throw Botan::Stream_IO_Error("DataSink: Failure writing");
+    current.swap(next);
+  }
+}
+
 void RandomCommand::run() {
-  bool infinite = m_cmd.count("count") == 0;
-
-  std::vector<uint8_t> block(4096);
-  while (infinite || m_count > 0) {
-    int next_blocksize = m_count < block.size() ? m_count : block.size();
-    rng()->randomize(block.data(), next_blocksize);
-    std::cout.write((const char*)block.data(), next_blocksize);
-    m_count -= next_blocksize;
+  bool infinite = m_cmd.count("count") == 0 && m_cmd.count("--bytes") == 0;
+  size_t threads = m_threads ? m_threads : std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  auto start = std::chrono::steady_clock::now();
+
+  if (m_fast) {
+    run_fast(infinite, threads);
+  } else {
+    std::vector<uint8_t> block(4096);
+    uint64_t left = m_count;
+    while (infinite || left > 0) {
+      size_t next_blocksize = block.size();
+      if (!infinite && left < next_blocksize) next_blocksize = left;
+      rng()->randomize(block.data(), next_blocksize);
+      std::cout.write((const char*)block.data(), next_blocksize);
+      if (!infinite) left -= next_blocksize;
+    }
+  }
+  std::cout.flush();
+
+  if (m_stats) {
+    using seconds = std::chrono::duration<double>;
+    double elapsed =
+        std::chrono::duration_cast<seconds>(std::chrono::steady_clock::now() -
+                                            start)
+            .count();
+    const tao::json::value stats = {
+        {"bytes", m_count},
+        {"seconds", elapsed},
+        {"bytes_per_second", elapsed > 0 ? m_count / elapsed : 0.0},
+        {"threads", m_fast ? threads : 1}};
+    std::cerr << tao::json::to_string(stats) << "\n";
   }
 }
 
@@ -10,9 +10,23 @@
 
 namespace NeoPG {
 
+/// Output random bytes.
+///
+/// By default, the bytes come from NeoPG::rng(), which is suitable for key
+/// material.  With --fast, every thread runs its own ChaCha20 DRBG
+/// (Botan::ChaCha_RNG), each seeded with 512 bits from NeoPG::rng() and
+/// never reseeded, and the threads fill large blocks in parallel.  The
+/// output is unpredictable as long as the seeds are secret, but it is meant
+/// for wiping disks and test data, not for keys: there is no reseeding and
+/// no backtracking resistance within one run.
 class RandomCommand : public Command {
  public:
-  int m_count{0};
+  static const size_t FAST_BLOCK_SIZE = 4 * 1024 * 1024;
+
+  uint64_t m_count{0};
+  bool m_fast{false};
+  unsigned int m_threads{0};
+  bool m_stats{false};
   void run() override;
   RandomCommand(CLI::App& app, const std::string& flag,
                 const std::string& description,
@@ -20,8 +34,22 @@ class RandomCommand : public Command {
       : Command(app, flag, description, group_name) {
     m_cmd.add_option("count", m_count,
                      "number of bytes to output (or infinite)");
+    m_cmd.add_option("--bytes", m_count,
+                     "number of bytes to output (like count)");
+    m_cmd.add_flag("--fast", m_fast,
+                   "generate with per-thread ChaCha20 generators (not for "
+                   "key material)");
+    m_cmd.add_option("--threads", m_threads,
+                     "threads for --fast (0 uses all cores)", true);
+    m_cmd.add_flag("--stats", m_stats,
+                   "print throughput statistics as JSON to stderr");
   }
   virtual ~RandomCommand() {}
+
+ private:
+  /// Write \p count bytes (or infinitely many, if \p infinite) generated on
+  /// \p threads threads.
+  void run_fast(bool infinite, size_t threads);
 };
 
 }  // Namespace NeoPG
@@ -0,0 +1,273 @@
+// NeoPG tool file I/O (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg-tool/io/file_io.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <botan/exceptn.h>
+
+using namespace NeoPG;
+
+namespace {
+
+const size_t BUFFER_ALIGNMENT = 4096;
+
+void* allocate_aligned(size_t size) {
+#ifdef _WIN32
+  void* ptr = std::malloc(size);
+  if (!ptr) throw std::bad_alloc();
+#else
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, BUFFER_ALIGNMENT, size) != 0)
+    throw std::bad_alloc();
+#endif
+  return ptr;
+}
+
+}  // namespace
+
+AlignedBuffer::AlignedBuffer(size_t size)
+    : m_data(static_cast<uint8_t*>(allocate_aligned(size)), &std::free),
+      m_size(size) {}
+
+InputFile::InputFile(const std::string& file) : m_file(file) {
+#ifdef _WIN32
+  m_in = &std::cin;
+  if (file != "-") {
+    m_stream.open(file, std::ios::binary);
+    if (!m_stream) error("opening");
+    m_in = &m_stream;
+  }
+#else
+  m_fd = STDIN_FILENO;
+  if (file != "-") {
+    m_fd = open(file.c_str(), O_RDONLY);
+    if (m_fd < 0) error("opening");
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  // Fails harmlessly for pipes and terminals.
+  posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+}
+
+InputFile::~InputFile() {
+#ifndef _WIN32
+  if (m_data) munmap(m_data, m_size);
+  if (m_fd != STDIN_FILENO) close(m_fd);
+#endif
+}
+
+bool InputFile::map(size_t min_size) {
+#ifdef _WIN32
+  return false;
+#else
+  if (m_data) return true;
+  struct stat st;
+  if (fstat(m_fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+      static_cast<uint64_t>(st.st_size) < min_size ||
+      static_cast<uint64_t>(st.st_size) > SIZE_MAX)
+    return false;
+  size_t size = st.st_size;
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+  if (data == MAP_FAILED) return false;
+  madvise(data, size, MADV_SEQUENTIAL);
+  m_data = data;
+  m_size = size;
+  return true;
+#endif
+}
+
+size_t InputFile::read(uint8_t* buffer, size_t size) {
+  size_t done = 0;
+#ifdef _WIN32
+  m_in->read(reinterpret_cast<char*>(buffer), size);
+  done = m_in->gcount();
+  if (m_in->bad()) error("reading");
+#else
+  while (done < size) {
+    ssize_t count = ::read(m_fd, buffer + done, size - done);
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0) error("reading");
+    if (count == 0) break;
+    done += count;
+  }
+#endif
+  return done;
+}
+
+void InputFile::for_each_block(
+    const std::function<void(const uint8_t* data, size_t length)>& consume,
+    size_t min_map) {
+  if (map(min_map)) {
+    consume(data(), size());
+    return;
+  }
+
+  AlignedBuffer buffer;
+  size_t count;
+  do {
+    count = read(buffer.data(), buffer.size());
+    if (count) consume(buffer.data(), count);
+  } while (count == buffer.size());
+}
+
+void InputFile::error(const std::string& what) const {
+  throw Botan::Stream_IO_Error("DataSource: Failure " + what + " file " +
+                               m_file);
+}
+
+size_t InputSource::read(uint8_t out[], size_t length) {
+  size_t done = std::min(length, m_peeked.size());
+  if (done) {
+    std::memcpy(out, m_peeked.data(), done);
+    m_peeked.erase(m_peeked.begin(), m_peeked.begin() + done);
+  }
+  if (done < length) done += m_in.read(out + done, length - done);
+  m_read += done;
+  return done;
+}
+
+bool InputSource::check_available(size_t n) {
+  fill(n);
+  return m_peeked.size() >= n;
+}
+
+size_t InputSource::peek(uint8_t out[], size_t length, size_t offset) const {
+  fill(offset + length);
+  if (offset >= m_peeked.size()) return 0;
+  size_t count = std::min(length, m_peeked.size() - offset);
+  std::memcpy(out, m_peeked.data() + offset, count);
+  return count;
+}
+
+bool InputSource::end_of_data() const {
+  fill(1);
+  return m_peeked.empty();
+}
+
+void InputSource::fill(size_t n) const {
+  if (m_peeked.size() >= n) return;
+  size_t have = m_peeked.size();
+  m_peeked.resize(n);
+  m_peeked.resize(have + m_in.read(m_peeked.data() + have, n - have));
+}
+
+OutputFile::Buffer::Buffer(OutputFile& file) : m_file(file) {
+  char* begin = reinterpret_cast<char*>(file.m_buffer.data());
+  setp(begin, begin + file.m_buffer.size());
+}
+
+void OutputFile::Buffer::drain() {
+  size_t count = pptr() - pbase();
+  setp(pbase(), epptr());
+  if (count) m_file.write_through(pbase(), count);
+}
+
+std::streamsize OutputFile::Buffer::xsputn(const char_type* s,
+                                           std::streamsize n) {
+  if (n > epptr() - pptr()) {
+    drain();
+    // Large writes bypass the buffer.
+    if (n >= epptr() - pbase()) {
+      m_file.write_through(s, n);
+      return n;
+    }
+  }
+  std::memcpy(pptr(), s, n);
+  pbump(static_cast<int>(n));
+  return n;
+}
+
+OutputFile::Buffer::int_type OutputFile::Buffer::overflow(int_type ch) {
+  drain();
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+int OutputFile::Buffer::sync() {
+  drain();
+  return 0;
+}
+
+OutputFile::OutputFile(const std::string& file)
+    : m_file(file), m_streambuf(*this), m_stream(&m_streambuf) {
+#ifdef _WIN32
+  m_out = &std::cout;
+  if (file != "-") {
+    m_out_file.open(file, std::ios::binary);
+    if (!m_out_file) error("opening");
+    m_out = &m_out_file;
+  }
+#else
+  m_fd = STDOUT_FILENO;
+  if (file != "-") {
+    m_fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (m_fd < 0) error("opening");
+  }
+#endif
+  if (file == "-") std::cout.flush();
+}
+
+OutputFile::~OutputFile() {
+  try {
+    m_streambuf.drain();
+  } catch (...) {
+  }
+#ifndef _WIN32
+  if (m_fd != STDOUT_FILENO) close(m_fd);
+#endif
+}
+
+void OutputFile::write(const void* data, size_t length) {
+  m_streambuf.sputn(static_cast<const char*>(data), length);
+}
+
+void OutputFile::flush() {
+  // Errors in output through the stream are reported by setting badbit.
+  if (m_stream.bad()) error("writing");
+  m_streambuf.drain();
+#ifdef _WIN32
+  m_out->flush();
+  if (!*m_out) error("writing");
+#endif
+}
+
+void OutputFile::write_through(const void* data, size_t length) {
+#ifdef _WIN32
+  m_out->write(static_cast<const char*>(data), length);
+  if (!*m_out) error("writing");
+#else
+  auto ptr = static_cast<const char*>(data);
+  while (length) {
+    ssize_t written = ::write(m_fd, ptr, length);
+    if (written < 0 && errno == EINTR) continue;
+    if (written < 0) error("writing");
+    ptr += written;
+    length -= written;
+  }
+#endif
+}
+
+void OutputFile::error(const std::string& what) const {
+  throw Botan::Stream_IO_Error("DataSink: Failure " + what + " file " +
+                               m_file);
+}
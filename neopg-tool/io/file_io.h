@@ -0,0 +1,203 @@
+// NeoPG tool file I/O
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains the input and output files used by the commands.
+
+#pragma once
+
+#include <botan/data_src.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace NeoPG {
+
+/// A page aligned buffer for file I/O.
+class AlignedBuffer {
+ public:
+  /// The default size of I/O buffers.
+  static const size_t DEFAULT_SIZE = 1024 * 1024;
+
+  explicit AlignedBuffer(size_t size = DEFAULT_SIZE);
+
+  AlignedBuffer(const AlignedBuffer&) = delete;
+  AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+  uint8_t* data() noexcept { return m_data.get(); }
+  size_t size() const noexcept { return m_size; }
+
+ private:
+  std::unique_ptr<uint8_t, void (*)(void*)> m_data;
+  size_t m_size;
+};
+
+/// A file (or "-" for stdin) that is read sequentially with large reads, or
+/// mapped into memory as a whole.  Regular files are read with a sequential
+/// access hint, so the kernel reads ahead aggressively.
+class InputFile {
+ public:
+  /// Open \p file, or use stdin for "-".
+  ///
+  /// \throws Botan::Stream_IO_Error
+  explicit InputFile(const std::string& file);
+  ~InputFile();
+
+  InputFile(const InputFile&) = delete;
+  InputFile& operator=(const InputFile&) = delete;
+
+  /// \return the name of the file
+  const std::string& name() const noexcept { return m_file; }
+
+  /// Map the file into memory, if it is a regular file of at least \p
+  /// min_size bytes.
+  ///
+  /// \return false if the file has to be read instead
+  bool map(size_t min_size = 0);
+
+  /// \return the mapped data, see map()
+  const uint8_t* data() const noexcept {
+    return static_cast<const uint8_t*>(m_data);
+  }
+
+  /// \return the size of the mapped data, see map()
+  size_t size() const noexcept { return m_size; }
+
+  /// Read up to \p size bytes into \p buffer.  Less is only returned at the
+  /// end of the input.
+  ///
+  /// \throws Botan::Stream_IO_Error
+  size_t read(uint8_t* buffer, size_t size);
+
+  /// Call \p consume for all of the input.  Files of at least \p min_map
+  /// bytes are mapped and passed in one call, everything else is read in
+  /// blocks of AlignedBuffer::DEFAULT_SIZE.
+  ///
+  /// \throws Botan::Stream_IO_Error
+  void for_each_block(
+      const std::function<void(const uint8_t* data, size_t length)>& consume,
+      size_t min_map = AlignedBuffer::DEFAULT_SIZE);
+
+#ifndef _WIN32
+  /// \return the file descriptor
+  int fd() const noexcept { return m_fd; }
+#endif
+
+ private:
+  std::string m_file;
+  void* m_data{nullptr};
+  size_t m_size{0};
+#ifdef _WIN32
+  std::ifstream m_stream;
+  std::istream* m_in;
+#else
+  int m_fd;
+#endif
+
+  [[noreturn]] void error(const std::string& what) const;
+};
+
+/// A Botan::DataSource that reads from an InputFile, for the parser.  In
+/// contrast to Botan::DataSource_Stream, there is no iostream buffer in
+/// between.
+class InputSource : public Botan::DataSource {
+ public:
+  explicit InputSource(InputFile& in) : m_in(in) {}
+
+  size_t read(uint8_t out[], size_t length) override;
+  bool check_available(size_t n) override;
+  size_t peek(uint8_t out[], size_t length, size_t offset) const override;
+  bool end_of_data() const override;
+  std::string id() const override { return m_in.name(); }
+  size_t get_bytes_read() const override { return m_read; }
+
+ private:
+  InputFile& m_in;
+  size_t m_read{0};
+
+  // Data read ahead by peek() and check_available().
+  mutable std::vector<uint8_t> m_peeked;
+
+  void fill(size_t n) const;
+};
+
+/// A file (or "-" for stdout) that is written to with large, page aligned
+/// writes.  Writes that are at least as large as the buffer are passed
+/// through without copying.
+class OutputFile {
+ public:
+  /// Create \p file, or use stdout for "-".  std::cout is flushed first, so
+  /// earlier output stays in order.
+  ///
+  /// \throws Botan::Stream_IO_Error
+  explicit OutputFile(const std::string& file);
+
+  /// Flush the output.  Errors are ignored here, call flush() to see them.
+  ~OutputFile();
+
+  OutputFile(const OutputFile&) = delete;
+  OutputFile& operator=(const OutputFile&) = delete;
+
+  /// Write \p length bytes at \p data.
+  ///
+  /// \throws Botan::Stream_IO_Error
+  void write(const void* data, size_t length);
+
+  /// Write the buffered output to the file.
+  ///
+  /// \throws Botan::Stream_IO_Error
+  void flush();
+
+  /// \return a stream that writes to this file, for the encoders and dumps
+  /// that take a std::ostream.  Output through the stream and through
+  /// write() can be mixed.
+  std::ostream& stream() noexcept { return m_stream; }
+
+#ifndef _WIN32
+  /// \return the file descriptor
+  int fd() const noexcept { return m_fd; }
+#endif
+
+ private:
+  // The put area of the stream buffer is m_buffer.
+  class Buffer : public std::streambuf {
+   public:
+    explicit Buffer(OutputFile& file);
+
+    // Write the put area to the file, and reset it.
+    void drain();
+
+   protected:
+    std::streamsize xsputn(const char_type* s, std::streamsize n) override;
+    int_type overflow(int_type ch) override;
+    int sync() override;
+
+   private:
+    OutputFile& m_file;
+  };
+
+  std::string m_file;
+  AlignedBuffer m_buffer;
+  Buffer m_streambuf;
+  std::ostream m_stream;
+#ifdef _WIN32
+  std::ofstream m_out_file;
+  std::ostream* m_out;
+#else
+  int m_fd;
+#endif
+
+  void write_through(const void* data, size_t length);
+  [[noreturn]] void error(const std::string& what) const;
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,91 @@
+// NeoPG tool file I/O (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg-tool/io/file_io.h>
+
+#include "gtest/gtest.h"
+
+#include <botan/exceptn.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace NeoPG;
+
+namespace {
+std::string read_all(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream content;
+  content << in.rdbuf();
+  return content.str();
+}
+}  // namespace
+
+TEST(NeopgToolTest, io_file_io_output_test) {
+  const std::string path = "neopg-file-io-test.tmp";
+  const std::string large(AlignedBuffer::DEFAULT_SIZE + 10, 'x');
+  {
+    OutputFile out{path};
+    out.write("abc", 3);
+    out.stream() << "def" << 42;
+    // Larger than the buffer, written through after the buffered output.
+    out.write(large.data(), large.size());
+    out.stream() << 'z';
+    out.flush();
+  }
+  ASSERT_EQ(read_all(path), "abcdef42" + large + "z");
+  std::remove(path.c_str());
+}
+
+TEST(NeopgToolTest, io_file_io_input_test) {
+  const std::string path = "neopg-file-io-test.tmp";
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << "hello world";
+  }
+
+  {
+    InputFile in{path};
+    uint8_t buffer[32];
+    ASSERT_EQ(in.read(buffer, 5), 5);
+    ASSERT_EQ(std::string(reinterpret_cast<char*>(buffer), 5), "hello");
+    ASSERT_EQ(in.read(buffer, sizeof(buffer)), 6);
+    ASSERT_EQ(in.read(buffer, sizeof(buffer)), 0);
+  }
+
+  for (size_t min_map : {size_t{0}, AlignedBuffer::DEFAULT_SIZE}) {
+    InputFile in{path};
+    std::string content;
+    size_t calls = 0;
+    in.for_each_block(
+        [&content, &calls](const uint8_t* data, size_t length) {
+          content.append(reinterpret_cast<const char*>(data), length);
+          calls++;
+        },
+        min_map);
+    ASSERT_EQ(content, "hello world");
+    ASSERT_EQ(calls, 1);
+  }
+
+  {
+    InputFile in{path};
+    InputSource source{in};
+    uint8_t buffer[32];
+    ASSERT_EQ(source.peek(buffer, 5, 6), 5);
+    ASSERT_EQ(std::string(reinterpret_cast<char*>(buffer), 5), "world");
+    ASSERT_TRUE(source.check_available(11));
+    ASSERT_FALSE(source.check_available(12));
+    ASSERT_EQ(source.read(buffer, 6), 6);
+    ASSERT_EQ(source.read(buffer, sizeof(buffer)), 5);
+    ASSERT_EQ(std::string(reinterpret_cast<char*>(buffer), 5), "world");
+    ASSERT_EQ(source.get_bytes_read(), 11);
+    ASSERT_TRUE(source.end_of_data());
+  }
+
+  std::remove(path.c_str());
+  ASSERT_THROW(InputFile{path}, Botan::Stream_IO_Error);
+}
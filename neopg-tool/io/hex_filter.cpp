@@ -5,4 +5,12 @@
 
 #include <neopg-tool/io/hex_filter.h>
 
+#include <neopg/utils/hex.h>
+
 using namespace NeoPG;
+
+void HexFilter::write(const uint8_t input[], size_t length) {
+  m_buffer.clear();
+  hex_append(m_buffer, input, length, m_uppercase);
+  send(reinterpret_cast<const uint8_t*>(m_buffer.data()), m_buffer.size());
+}
@@ -4,15 +4,30 @@
 // NeoPG is released under the Simplified BSD License (see license.txt)
 
 /// \file
-/// This file contains support for hex input format.
+/// This file contains support for hex format.
 
 #pragma once
 
 #include <botan/filter.h>
 
+#include <string>
+
 namespace NeoPG {
 
-/// Represent a hex input filter.
-class HexFilter : public Botan::Filter {};
+/// Represent a hex output filter, which writes its input as hex digits.
+class HexFilter : public Botan::Filter {
+ public:
+  HexFilter(bool uppercase = false) : m_uppercase{uppercase} {}
+
+  std::string name() const override { return "Hex"; }
+
+  void write(const uint8_t input[], size_t length) override;
+
+ private:
+  bool m_uppercase;
+
+  /// The encoded input, reused between calls to write().
+  std::string m_buffer;
+};
 
 }  // namespace NeoPG
@@ -7,7 +7,12 @@
 
 #include <neopg-tool/version.h>
 
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
@@ -37,6 +42,7 @@ static void setup_locale() {
 }
 
 #include <neopg-tool/cli/armor_command.h>
+#include <neopg-tool/cli/bench_command.h>
 #include <neopg-tool/cli/cat_command.h>
 #include <neopg-tool/cli/command.h>
 #include <neopg-tool/cli/compress_command.h>
@@ -45,6 +51,8 @@ static void setup_locale() {
 #include <neopg-tool/cli/random_command.h>
 #include <neopg-tool/cli/version_command.h>
 
+#include <neopg/intern/cplusplus.h>
+
 using namespace NeoPG;
 
 int gpg_main(int argc, char** argv);
@@ -93,23 +101,133 @@ struct openpgp : cli::command<openpgp>
 #include <io.h>
 #endif
 
+namespace {
+
+const std::string legacy_group = "command to execute (GnuPG-compatible)";
+const std::string tools_group = "tools (for experts)";
+
+// The legacy commands need curl and translations, which are initialized on
+// first use.
+LegacyCommand::main_fnc_t legacy_main(int (*main_fnc)(int, char**)) {
+  return [main_fnc](int argc, char** argv) {
+    /* FIXME: This has to move into a neopg_init function.  We can't
+       even use a global static constructor, because those are called
+       from DllMain on Windows, and that's not allowed.  :( */
+    if (curl_global_init(CURL_GLOBAL_ALL)) {
+      std::cerr << "Failed to initialize CURL!\n";
+      return 1;
+    }
+    setup_locale();
+    return main_fnc(argc, argv);
+  };
+}
+
+template <typename CommandT>
+std::unique_ptr<Command> make_tool(CLI::App& app, const std::string& flag,
+                                   const std::string& description) {
+  return NeoPG::make_unique<CommandT>(app, flag, description, tools_group);
+}
+
+std::unique_ptr<Command> make_legacy(CLI::App& app,
+                                     int (*main_fnc)(int, char**),
+                                     const std::string& flag,
+                                     const std::string& description) {
+  return NeoPG::make_unique<LegacyCommand>(app, legacy_main(main_fnc), flag,
+                                           description, legacy_group);
+}
+
+struct CommandEntry {
+  const char* m_name;
+  std::function<std::unique_ptr<Command>(CLI::App& app)> m_make;
+};
+
+// All commands, in the order of the help output.
+const std::vector<CommandEntry>& command_table() {
+  static const std::vector<CommandEntry> table = {
+      {"gpg2",
+       [](CLI::App& app) {
+         return make_legacy(app, gpg_main, "gpg2", "invoke gpg2");
+       }},
+      {"gpgsm",
+       [](CLI::App& app) {
+         return make_legacy(app, gpgsm_main, "gpgsm", "invoke gpgsm");
+       }},
+      {"agent",
+       [](CLI::App& app) {
+         return make_legacy(app, agent_main, "agent", "invoke agent");
+       }},
+      {"scd",
+       [](CLI::App& app) {
+         return make_legacy(app, scd_main, "scd", "invoke scd");
+       }},
+      {"dirmngr",
+       [](CLI::App& app) {
+         return make_legacy(app, dirmngr_main, "dirmngr", "invoke dirmngr");
+       }},
+      {"dirmngr-client",
+       [](CLI::App& app) {
+         return make_legacy(app, dirmngr_client_main, "dirmngr-client",
+                            "invoke dirmngr-client");
+       }},
+      {"packet",
+       [](CLI::App& app) {
+         return make_tool<PacketCommand>(app, "packet",
+                                         "read and write OpenPGP packets");
+       }},
+      {"random",
+       [](CLI::App& app) {
+         return make_tool<RandomCommand>(app, "random", "output random bytes");
+       }},
+      {"hash",
+       [](CLI::App& app) {
+         return make_tool<HashCommand>(app, "hash", "calculate hash function");
+       }},
+      {"compress",
+       [](CLI::App& app) {
+         return make_tool<CompressCommand>(app, "compress",
+                                           "compress and decompress data");
+       }},
+      {"armor",
+       [](CLI::App& app) {
+         return make_tool<ArmorCommand>(app, "armor",
+                                        "ASCII-encode and decode binary data");
+       }},
+      {"bench",
+       [](CLI::App& app) {
+         return make_tool<BenchCommand>(
+             app, "bench", "measure the performance of this machine");
+       }},
+      {"cat", [](CLI::App& app) {
+         return make_tool<CatCommand>(app, "cat",
+                                      "the beginning of a new Unix system");
+       }}};
+  return table;
+}
+
+// Return the first argument that is not a global option (or the value of
+// one), which names the subcommand, or an empty string if there is none or
+// the global help is requested.
+std::string selected_command(const std::vector<std::string>& args) {
+  for (size_t i = 0; i < args.size(); i++) {
+    const std::string& arg = args[i];
+    if (arg == "--help")
+      return "";
+    else if (arg == "--color" || arg == "--log-level")
+      i++;
+    else if (arg.size() < 2 || arg[0] != '-')
+      return arg;
+  }
+  return "";
+}
+
+}  // namespace
+
 int main(int argc, char* argv[]) {
 #ifdef _WIN32
   setmode(fileno(stdin), O_BINARY);
   setmode(fileno(stdout), O_BINARY);
 #endif
 
-  /* FIXME: This has to move into a neopg_init function.  We can't
-     even use a global static constructor, because those are called
-     from DllMain on Windows, and that's not allowed.  :( */
-  if (curl_global_init(CURL_GLOBAL_ALL)) {
-    std::cerr << "Failed to initialize CURL!\n";
-    return 1;
-  }
-
-  /* Initialize translations.  */
-  setup_locale();
-
   /* This is also used to invoke ourself.  */
   neopg_program = make_absfilename(argv[0], NULL);
 
@@ -130,6 +248,19 @@ int main(int argc, char* argv[]) {
   else if (boost::algorithm::ends_with(neopg_program, "dirmngr-client"))
     args.emplace(args.begin(), "dirmngr-client");
 
+  // Only the selected command is constructed, and translations are only
+  // loaded for the full command tree (which is used for help and usage
+  // errors) and for the legacy commands.  Scripts that run the tools many
+  // times only pay for what they use.
+  std::string selected = selected_command(args);
+  const auto& table = command_table();
+  bool known = selected == "version" ||
+               std::any_of(table.begin(), table.end(),
+                           [&selected](const CommandEntry& entry) {
+                             return selected == entry.m_name;
+                           });
+  if (!known) setup_locale();
+
   CLI::App app{_("NeoPG implements the OpenPGP standard.")};
   GlobalOptions options;
 
@@ -177,9 +308,12 @@ int main(int argc, char* argv[]) {
 
     spdlog::set_level(options.log_level);
 
-    spdlog::set_pattern("%^[%l]%$ %v");
-    auto console = spdlog::stderr_color_mt("console");
-    console->info("Hello! This is NeoPG " NEOPG_VERSION);
+    // The console logger is only needed if it has something to say.
+    if (options.log_level <= spdlog::level::info) {
+      spdlog::set_pattern("%^[%l]%$ %v");
+      auto console = spdlog::stderr_color_mt("console");
+      console->info("Hello! This is NeoPG " NEOPG_VERSION);
+    }
 
     if (oVersion) {
       cmd_version.run();
@@ -191,29 +325,10 @@ int main(int argc, char* argv[]) {
     }
   });
 
-  std::string legacy_group = "command to execute (GnuPG-compatible)";
-  LegacyCommand cmd_gpg2(app, gpg_main, "gpg2", "invoke gpg2", legacy_group);
-  LegacyCommand cmd_gpgsm(app, gpgsm_main, "gpgsm", "invoke gpgsm",
-                          legacy_group);
-  LegacyCommand cmd_agent(app, agent_main, "agent", "invoke agent",
-                          legacy_group);
-  LegacyCommand cmd_scd(app, scd_main, "scd", "invoke scd", legacy_group);
-  LegacyCommand cmd_dirmngr(app, dirmngr_main, "dirmngr", "invoke dirmngr",
-                            legacy_group);
-  LegacyCommand cmd_dirmngr_client(app, dirmngr_client_main, "dirmngr-client",
-                                   "invoke dirmngr-client", legacy_group);
-
-  std::string tools_group = "tools (for experts)";
-  PacketCommand cmd_packet(app, "packet", "read and write OpenPGP packets",
-                           tools_group);
-  RandomCommand cmd_random(app, "random", "output random bytes", tools_group);
-  HashCommand cmd_hash(app, "hash", "calculate hash function", tools_group);
-  CompressCommand cmd_compress(app, "compress", "compress and decompress data",
-                               tools_group);
-  ArmorCommand cmd_armor(app, "armor", "ASCII-encode and decode binary data",
-                         tools_group);
-  CatCommand cmd_cat(app, "cat", "the beginning of a new Unix system",
-                     tools_group);
+  std::vector<std::unique_ptr<Command>> commands;
+  for (const auto& entry : table)
+    if (!known || selected == entry.m_name)
+      commands.emplace_back(entry.m_make(app));
 
   std::vector<const char*> argvec;
   argvec.emplace_back(neopg_program);
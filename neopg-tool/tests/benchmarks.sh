@@ -4,3 +4,7 @@ bench 'dd if=/dev/urandom bs=4M count=50 | gpg2 --print-md SHA1' 'dd if=/dev/ura
 dd if=/dev/urandom bs=4M count=10 | src/neopg gpg2 --compress-algo zip --encrypt -r obama  | src/neopg gpg2 --decrypt > /dev/null
 dd if=/dev/urandom bs=4M count=10 | src/neopg gpg2 --compress-algo zlib --encrypt -r obama  | src/neopg gpg2 --decrypt > /dev/null
 dd if=/dev/urandom bs=4M count=10 | src/neopg gpg2 --compress-algo bzip2 --encrypt -r obama  | src/neopg gpg2 --decrypt > /dev/null
+
+# Keyblock parsing with the NeoPG packet framer and with the legacy parser.
+bench 'src/neopg gpg2 --list-sigs > /dev/null' 'src/neopg gpg2 --legacy-packet-parser --list-sigs > /dev/null'
+bench 'src/neopg gpg2 --export > /dev/null' 'src/neopg gpg2 --legacy-packet-parser --export > /dev/null'
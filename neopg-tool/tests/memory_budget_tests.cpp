@@ -0,0 +1,241 @@
+// NeoPG tool peak memory (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+// Import and dump pathological certificates with the neopg binary, and
+// check the peak resident set size of the process against a budget
+// relative to the input size.  The budget is on top of the peak of the same
+// command on a small input, so it does not depend on the size of the binary
+// and its libraries.
+
+#include <neopg/openpgp/raw_packet.h>
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace NeoPG;
+
+namespace {
+
+// The number of third-party signatures on a flooded key.
+const uint32_t FLOOD_COUNT = 200000;
+
+void put_u32(std::string& out, uint32_t val) {
+  out += static_cast<char>(val >> 24);
+  out += static_cast<char>(val >> 16);
+  out += static_cast<char>(val >> 8);
+  out += static_cast<char>(val);
+}
+
+// A multiprecision integer of BITS bits (a multiple of 8).
+std::string mpi(uint16_t bits, char fill) {
+  std::string out;
+  out += static_cast<char>(bits >> 8);
+  out += static_cast<char>(bits);
+  out += '\x80';
+  out.append(bits / 8 - 1, fill);
+  return out;
+}
+
+// A V4 RSA-2048 public key.
+std::string public_key() {
+  std::string body{"\x04", 1};
+  put_u32(body, 1500000000);
+  body += '\x01';
+  body += mpi(2048, 'n');
+  body += std::string{"\x00\x11\x01\x00\x01", 5};
+  std::string out;
+  RawPacket{PacketType::PublicKey, body}.write(out);
+  return out;
+}
+
+std::string user_id(const std::string& name) {
+  std::string out;
+  RawPacket{PacketType::UserId, name}.write(out);
+  return out;
+}
+
+// A V4 RSA certification of a user ID by the key with the key ID ISSUER.
+std::string certification(uint32_t issuer) {
+  std::string body{"\x04\x10\x01\x08", 4};
+  // Hashed: signature creation time.
+  body += std::string{"\x00\x06\x05\x02", 4};
+  put_u32(body, 1500000000);
+  // Unhashed: issuer.
+  body += std::string{"\x00\x0a\x09\x10", 4};
+  put_u32(body, 0x12345678);
+  put_u32(body, issuer);
+  body += std::string{"\xab\xcd", 2};
+  body += mpi(2048, 's');
+  std::string out;
+  RawPacket{PacketType::Signature, body}.write(out);
+  return out;
+}
+
+// A user attribute with one JPEG image of SIZE bytes.
+std::string user_attribute(size_t size) {
+  std::string body;
+  // Five octet subpacket length (including the type), and the type.
+  body += '\xff';
+  put_u32(body, 1 + 16 + size);
+  body += '\x01';
+  body += std::string{"\x10\x00\x01\x01", 4};
+  body.append(12, '\0');
+  body.append(size, '\xff');
+  std::string out;
+  RawPacket{PacketType::UserAttribute, body}.write(out);
+  return out;
+}
+
+std::string flooded_key(uint32_t count) {
+  std::string out = public_key() + user_id("Flooded <flooded@example.org>");
+  for (uint32_t i = 0; i < count; i++) out += certification(i + 1);
+  return out;
+}
+
+// A key with COUNT user attributes of SIZE bytes.
+std::string attribute_key(size_t count, size_t size) {
+  std::string out = public_key() + user_id("Photos <photos@example.org>");
+  for (size_t i = 0; i < count; i++) out += user_attribute(size);
+  return out;
+}
+
+int remove_entry(const char* path, const struct stat*, int, struct FTW*) {
+  return std::remove(path);
+}
+
+class MemoryBudgetTest : public ::testing::Test {
+ protected:
+  std::string m_dir;
+
+  void SetUp() override {
+    char dir[] = "neopg-memory-test.XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    m_dir = dir;
+  }
+
+  void TearDown() override {
+    nftw(m_dir.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  }
+
+  struct Input {
+    std::string m_path;
+    size_t m_size;
+  };
+
+  // Write DATA to a file.  Call this with a temporary, so that the data is
+  // freed before the binary is run (see peak_rss).
+  Input write_input(const std::string& name, const std::string& data) {
+    Input input{m_dir + "/" + name, data.size()};
+    std::ofstream out(input.m_path, std::ios::binary);
+    out.write(data.data(), data.size());
+    return input;
+  }
+
+  // Run the neopg binary with ARGS (stdin from INPUT, output discarded),
+  // and return its peak resident set size in bytes.  Exit codes are not
+  // checked, as the pathological keys are rejected, but the process must
+  // not be killed.
+  //
+  // Linux reports the resident set of the process that calls exec as part
+  // of the peak of the child.  This is why the child is started with fork
+  // (posix_spawn may use vfork, which would count the peak of this
+  // process), and why large inputs must be freed before.
+  size_t peak_rss(const std::vector<std::string>& args,
+                  const std::string& input = "/dev/null") {
+    std::vector<char*> argv;
+    std::string program = NEOPG_BINARY;
+    argv.push_back(&program[0]);
+    std::vector<std::string> copy = args;
+    for (auto& arg : copy) argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      int in = open(input.c_str(), O_RDONLY);
+      int out = open("/dev/null", O_WRONLY);
+      if (in < 0 || out < 0) _exit(127);
+      dup2(in, STDIN_FILENO);
+      dup2(out, STDOUT_FILENO);
+      dup2(out, STDERR_FILENO);
+      execv(argv[0], argv.data());
+      _exit(127);
+    }
+    EXPECT_GT(pid, 0);
+    if (pid <= 0) return 0;
+
+    int status;
+    struct rusage usage;
+    EXPECT_EQ(wait4(pid, &status, 0, &usage), pid);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_NE(WEXITSTATUS(status), 127);
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+  }
+
+  size_t import_rss(const Input& input) {
+    std::string home = input.m_path + ".home";
+    EXPECT_EQ(mkdir(home.c_str(), 0700), 0);
+    return peak_rss({"gpg2", "--homedir", home, "--batch", "--no-tty",
+                     "--import", input.m_path});
+  }
+
+  // The input is read from stdin, because the pages of mapped files would
+  // count towards the resident set.
+  size_t dump_rss(const Input& input) {
+    return peak_rss({"packet", "dump"}, input.m_path);
+  }
+};
+
+}  // namespace
+
+TEST_F(MemoryBudgetTest, ImportFloodedKey) {
+  const size_t baseline = import_rss(write_input("small", flooded_key(10)));
+  const Input input = write_input("flooded", flooded_key(FLOOD_COUNT));
+  // Signatures beyond --import-max-uid-sigs are dropped while reading.
+  ASSERT_LT(import_rss(input), baseline + input.m_size / 4);
+}
+
+TEST_F(MemoryBudgetTest, ImportLargeUserAttributes) {
+  const size_t baseline =
+      import_rss(write_input("small", attribute_key(1, 1024)));
+  // Attribute packets are limited to 16 MiB each, but a key can have many.
+  const Input input =
+      write_input("attributes", attribute_key(8, 8 * 1024 * 1024));
+  ASSERT_LT(import_rss(input), baseline + 2 * input.m_size);
+}
+
+TEST_F(MemoryBudgetTest, DumpFloodedKey) {
+  const size_t baseline = dump_rss(write_input("small", flooded_key(10)));
+  const Input input = write_input("flooded", flooded_key(FLOOD_COUNT));
+  // The dump is streamed, one packet at a time.
+  ASSERT_LT(dump_rss(input), baseline + input.m_size / 16);
+}
+
+TEST_F(MemoryBudgetTest, DumpLargeUserAttributes) {
+  const size_t baseline =
+      dump_rss(write_input("small", attribute_key(1, 1024)));
+  const Input input =
+      write_input("attributes", attribute_key(8, 8 * 1024 * 1024));
+  ASSERT_LT(dump_rss(input), baseline + input.m_size / 4);
+}
+
+#endif
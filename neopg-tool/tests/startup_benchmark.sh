@@ -0,0 +1,44 @@
+#!/bin/sh
+# NeoPG - startup time benchmark
+# Copyright 2018 The NeoPG developers
+#
+# NeoPG is released under the Simplified BSD License (see license.txt)
+
+# Usage: startup_benchmark.sh NEOPG [RUNS]
+#
+# Run typical short invocations of NEOPG RUNS times each, and print the
+# average wall clock time per invocation.  The results depend on the
+# machine, so this is not part of the test suite.
+
+set -e
+
+neopg=$1
+runs=${2:-200}
+
+if [ -z "$neopg" ]; then
+  echo "usage: $0 NEOPG [RUNS]" >&2
+  exit 2
+fi
+
+now_ns() {
+  date +%s%N
+}
+
+bench() {
+  start=$(now_ns)
+  i=0
+  while [ $i -lt "$runs" ]; do
+    "$@" < /dev/null > /dev/null 2>&1 || true
+    i=$((i + 1))
+  done
+  end=$(now_ns)
+  echo "$(( (end - start) / runs / 1000 )) us: $*" | sed "s|$neopg|neopg|"
+}
+
+bench "$neopg" version
+bench "$neopg" --help
+bench "$neopg" hash
+bench "$neopg" armor
+bench "$neopg" cat
+bench "$neopg" packet dump
+bench "$neopg" packet filter
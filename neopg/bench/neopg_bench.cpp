@@ -0,0 +1,552 @@
+// NeoPG benchmarks
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+// Measure the throughput of the OpenPGP parser, the packet codecs, the ASCII
+// armor, URI handling and the random number generators, and emit the
+// results as JSON.
+// Usage:
+//
+//   neopg-bench [--min-time SECONDS] [--json FILE] [KEYRING...]
+//
+// Without KEYRING arguments, a built-in synthetic corpus is used, which
+// covers small keys, keys with many signatures, photo IDs, and partial length
+// streams.  Additional (binary) keyrings are benchmarked in addition to the
+// built-in corpus.
+
+#include <neopg/crypto/rng.h>
+#include <neopg/openpgp/armor.h>
+#include <neopg/openpgp/multiprecision_integer.h>
+#include <neopg/openpgp/packet.h>
+#include <neopg/openpgp/packet_stream.h>
+#include <neopg/parser/openpgp.h>
+#include <neopg/parser/parser_input.h>
+#include <neopg/proto/uri.h>
+#include <neopg/utils/base64.h>
+#include <neopg/utils/hex.h>
+#include <neopg/utils/stream.h>
+
+#include <botan/auto_rng.h>
+
+#include <tao/json.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace NeoPG;
+
+namespace {
+
+// A named input stream.
+struct Corpus {
+  std::string m_name;
+  std::string m_data;
+};
+
+// A framed packet of a corpus, with the partial body reassembled.
+struct FramedPacket {
+  PacketType m_type;
+  std::string m_body;
+};
+
+class NullSink : public RawPacketRefSink {
+ public:
+  size_t m_packets{0};
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override {
+    m_packets++;
+  }
+  void start_packet(const PacketHeader& header) override {}
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override {}
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override {
+    m_packets++;
+  }
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override {}
+};
+
+class FramingSink : public RawPacketRefSink {
+ public:
+  std::vector<FramedPacket> m_packets;
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override {
+    m_packets.push_back(FramedPacket{header.type(), std::string(data, length)});
+  }
+  void start_packet(const PacketHeader& header) override {
+    m_packets.push_back(FramedPacket{header.type(), std::string()});
+  }
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override {
+    m_packets.back().m_body.append(data, length);
+  }
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override {
+    m_packets.back().m_body.append(data, length);
+  }
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override {}
+};
+
+// Synthetic corpus.
+
+std::string mpi(uint16_t bits, uint8_t fill) {
+  std::string out;
+  out += static_cast<char>(bits >> 8);
+  out += static_cast<char>(bits);
+  std::string value((bits + 7) / 8, static_cast<char>(fill));
+  value[0] = static_cast<char>(0x80 >> ((8 - bits % 8) % 8));
+  return out + value;
+}
+
+std::string be32(uint32_t val) {
+  std::string out;
+  out += static_cast<char>(val >> 24);
+  out += static_cast<char>(val >> 16);
+  out += static_cast<char>(val >> 8);
+  out += static_cast<char>(val);
+  return out;
+}
+
+std::string new_packet(PacketType type, const std::string& body) {
+  std::string out;
+  out += static_cast<char>(0xc0 | static_cast<uint8_t>(type));
+  if (body.size() < 192) {
+    out += static_cast<char>(body.size());
+  } else if (body.size() < 8384) {
+    uint32_t len = body.size() - 192;
+    out += static_cast<char>((len >> 8) + 192);
+    out += static_cast<char>(len);
+  } else {
+    out += static_cast<char>(0xff);
+    out += be32(body.size());
+  }
+  return out + body;
+}
+
+std::string public_key(PacketType type, uint32_t created) {
+  // Version 4 RSA key with a 2048 bit modulus.
+  std::string body = "\x04" + be32(created) + "\x01";
+  body += mpi(2048, 0x5a) + mpi(17, 0x01);
+  return new_packet(type, body);
+}
+
+std::string user_id(const std::string& uid) {
+  return new_packet(PacketType::UserId, uid);
+}
+
+std::string signature(uint8_t sigclass, uint32_t created, uint8_t issuer) {
+  std::string hashed = std::string("\x05\x02", 2) + be32(created);
+  hashed += std::string("\x02\x1b\x03", 3);  // key flags
+  std::string unhashed = std::string("\x09\x10", 2) + std::string(7, '\x42');
+  unhashed += static_cast<char>(issuer);
+
+  std::string body = "\x04";
+  body += static_cast<char>(sigclass);
+  body += "\x01\x08";  // RSA, SHA256
+  body += static_cast<char>(hashed.size() >> 8);
+  body += static_cast<char>(hashed.size());
+  body += hashed;
+  body += static_cast<char>(unhashed.size() >> 8);
+  body += static_cast<char>(unhashed.size());
+  body += unhashed;
+  body += "\xab\xcd";
+  body += mpi(2048, 0xa5);
+  return new_packet(PacketType::Signature, body);
+}
+
+std::string photo_id(size_t size) {
+  // Image attribute subpacket with a JPEG header (the data is not a valid
+  // JPEG image, but that doesn't matter to the parser).
+  std::string image = std::string("\x01\x10\x00\x01\x01", 5);
+  image += std::string(12, '\0') + std::string(size, '\xff');
+  std::string sub = "\xff" + be32(image.size()) + image;
+  return new_packet(PacketType::UserAttribute, sub);
+}
+
+Corpus small_keys() {
+  std::string data;
+  for (uint32_t i = 0; i < 1000; i++) {
+    data += public_key(PacketType::PublicKey, 0x5a000000 + i);
+    data += user_id("Test User " + std::to_string(i) + " <test@example.org>");
+    data += signature(0x13, 0x5a000000 + i, i);
+    data += public_key(PacketType::PublicSubkey, 0x5a000000 + i);
+    data += signature(0x18, 0x5a000000 + i, i);
+  }
+  return Corpus{"small_keys", data};
+}
+
+Corpus many_signatures() {
+  std::string data;
+  data += public_key(PacketType::PublicKey, 0x5a000000);
+  data += user_id("Popular User <popular@example.org>");
+  for (uint32_t i = 0; i < 16384; i++)
+    data += signature(0x10, 0x5a000000 + i, i);
+  return Corpus{"16k_signatures", data};
+}
+
+Corpus photo_ids() {
+  std::string data;
+  for (uint32_t i = 0; i < 100; i++) {
+    data += public_key(PacketType::PublicKey, 0x5a000000 + i);
+    data += user_id("Photo User " + std::to_string(i));
+    data += signature(0x13, 0x5a000000 + i, i);
+    data += photo_id(64 * 1024);
+    data += signature(0x13, 0x5a000000 + i, i);
+  }
+  return Corpus{"photo_ids", data};
+}
+
+Corpus partial_stream() {
+  std::stringstream out;
+  {
+    PacketStream literal(out, PacketType::LiteralData, 8192);
+    literal << "b" << '\0' << std::string(4, '\0');
+    std::string chunk(64 * 1024, 'A');
+    for (int i = 0; i < 64; i++) literal << chunk;
+  }
+  return Corpus{"partial_stream", out.str()};
+}
+
+// Benchmark runner.
+
+class Runner {
+ public:
+  Runner(double min_time) : m_min_time(min_time) {}
+
+  tao::json::value m_results = tao::json::empty_array;
+
+  // Run FUNC until at least m_min_time seconds have passed.  BYTES and ITEMS
+  // are the amount of work done in one call of FUNC.
+  template <typename Func>
+  void run(const std::string& name, uint64_t bytes, uint64_t items,
+           Func func) {
+    using clock = std::chrono::steady_clock;
+    uint64_t iterations = 1;
+    double elapsed;
+    while (true) {
+      auto start = clock::now();
+      for (uint64_t i = 0; i < iterations; i++) func();
+      elapsed = std::chrono::duration<double>(clock::now() - start).count();
+      if (elapsed >= m_min_time or iterations >= (1ULL << 30)) break;
+      // Aim a bit beyond the minimum time for the next round.
+      double factor = elapsed > 0 ? (m_min_time * 1.4) / elapsed : 10;
+      if (factor > 10) factor = 10;
+      if (factor < 2) factor = 2;
+      iterations = static_cast<uint64_t>(iterations * factor);
+    }
+
+    tao::json::value result = {
+        {"name", name},
+        {"iterations", iterations},
+        {"real_time", elapsed * 1e9 / iterations},
+        {"time_unit", "ns"}};
+    if (bytes)
+      result.insert({{"bytes_per_second", bytes * iterations / elapsed}});
+    if (items)
+      result.insert({{"items_per_second", items * iterations / elapsed}});
+    m_results.append({result});
+    std::cerr << name << ": " << elapsed * 1e9 / iterations << " ns\n";
+  }
+
+ private:
+  double m_min_time;
+};
+
+void bench_corpus(Runner& runner, const Corpus& corpus) {
+  // Framing only.
+  {
+    NullSink sink;
+    RawPacketParser parser{sink};
+    parser.process(corpus.m_data.data(), corpus.m_data.size());
+    size_t packets = sink.m_packets;
+    runner.run("framing/" + corpus.m_name, corpus.m_data.size(), packets,
+               [&corpus]() {
+                 NullSink sink;
+                 RawPacketParser parser{sink};
+                 parser.process(corpus.m_data.data(), corpus.m_data.size());
+               });
+  }
+
+  FramingSink framing;
+  RawPacketParser parser{framing};
+  parser.process(corpus.m_data.data(), corpus.m_data.size());
+
+  std::map<PacketType, std::vector<const FramedPacket*>> by_type;
+  for (const auto& packet : framing.m_packets)
+    by_type[packet.m_type].push_back(&packet);
+
+  for (const auto& entry : by_type) {
+    const auto& packets = entry.second;
+    std::string type = std::to_string(static_cast<int>(entry.first));
+    uint64_t bytes = 0;
+    for (auto packet : packets) bytes += packet->m_body.size();
+
+    // Skip packet types we can not decode.
+    std::vector<std::unique_ptr<Packet>> decoded;
+    try {
+      for (auto packet : packets) {
+        ParserInput in{packet->m_body.data(), packet->m_body.size()};
+        decoded.push_back(Packet::create_or_throw(packet->m_type, in));
+      }
+    } catch (ParserError& exc) {
+      std::cerr << corpus.m_name << ": skipping packet type " << type << ": "
+                << exc.as_string() << "\n";
+      continue;
+    }
+
+    runner.run("decode/" + corpus.m_name + "/" + type, bytes, packets.size(),
+               [&packets]() {
+                 for (auto packet : packets) {
+                   ParserInput in{packet->m_body.data(),
+                                  packet->m_body.size()};
+                   Packet::create_or_throw(packet->m_type, in);
+                 }
+               });
+
+    runner.run("encode/" + corpus.m_name + "/" + type, bytes, packets.size(),
+               [&decoded]() {
+                 std::string out;
+                 for (const auto& packet : decoded) {
+                   out.clear();
+                   packet->write(out);
+                 }
+               });
+
+    // The same through the std::ostream adaptor, for comparison.
+    runner.run("encode_ostream/" + corpus.m_name + "/" + type, bytes,
+               packets.size(), [&decoded]() {
+                 std::stringstream out;
+                 for (const auto& packet : decoded) {
+                   out.str(std::string());
+                   packet->write(out);
+                 }
+               });
+  }
+}
+
+void bench_mpi(Runner& runner) {
+  const std::vector<uint16_t> sizes{256, 521, 2048, 4096};
+  for (auto bits : sizes) {
+    std::string data = mpi(bits, 0x42);
+    runner.run("mpi_parse/" + std::to_string(bits), data.size(), 1, [&data]() {
+      ParserInput in{data.data(), data.size()};
+      MultiprecisionInteger mpi;
+      mpi.parse(in);
+    });
+  }
+}
+
+void bench_armor(Runner& runner) {
+  std::string data(1024 * 1024, '\0');
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<char>((i * 7919) >> 5);
+  auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+
+  std::stringstream armored;
+  {
+    ArmorEncoder encoder{armored, "PGP PUBLIC KEY BLOCK"};
+    encoder.write(bytes, data.size());
+    encoder.finish();
+  }
+  const std::string text = armored.str();
+
+  const auto original = base64_kernel();
+  const std::vector<std::pair<Base64Kernel, std::string>> kernels{
+      {Base64Kernel::Scalar, "scalar"},
+      {Base64Kernel::SSSE3, "ssse3"},
+      {Base64Kernel::AVX2, "avx2"},
+      {Base64Kernel::NEON, "neon"}};
+  for (const auto& kernel : kernels) {
+    if (!base64_set_kernel(kernel.first)) continue;
+    runner.run("armor_encode/" + kernel.second, data.size(), 1,
+               [&data, bytes]() {
+                 std::string out;
+                 BufferStream stream{out};
+                 ArmorEncoder encoder{stream, "PGP PUBLIC KEY BLOCK"};
+                 encoder.write(bytes, data.size());
+                 encoder.finish();
+               });
+    runner.run("armor_decode/" + kernel.second, data.size(), 1, [&text]() {
+      std::string out;
+      BufferStream stream{out};
+      ArmorDecoder decoder{stream};
+      decoder.write(text.data(), text.size());
+      decoder.finish();
+    });
+  }
+  base64_set_kernel(original);
+}
+
+void bench_hex(Runner& runner) {
+  std::string data(1024 * 1024, '\0');
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<char>((i * 7919) >> 5);
+  auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+
+  const auto original = hex_kernel();
+  const std::vector<std::pair<HexKernel, std::string>> kernels{
+      {HexKernel::Scalar, "scalar"},
+      {HexKernel::SSSE3, "ssse3"},
+      {HexKernel::NEON, "neon"}};
+  std::string out;
+  for (const auto& kernel : kernels) {
+    if (!hex_set_kernel(kernel.first)) continue;
+    runner.run("hex_encode/" + kernel.second, data.size(), 1,
+               [&data, &out, bytes]() {
+                 out.clear();
+                 hex_append(out, bytes, data.size());
+               });
+  }
+  hex_set_kernel(original);
+}
+
+// Generate and parse HKP lookup URLs, with and without copying the
+// components.
+void bench_uri(Runner& runner) {
+  const size_t count = 1000;
+  std::vector<std::string> keyids;
+  for (size_t i = 0; i < count; i++) {
+    uint8_t id[8];
+    for (size_t j = 0; j < sizeof(id); j++)
+      id[j] = static_cast<uint8_t>((i * 7919 + j * 31) >> 3);
+    keyids.push_back("0x" + hex_encode(id, sizeof(id)));
+  }
+
+  std::vector<std::string> urls;
+  size_t bytes = 0;
+  URIBuilder builder;
+  for (const auto& keyid : keyids) {
+    builder.clear().scheme("https").authority("keys.example.org", "443");
+    builder.path("/pks/lookup").query("op", "get").query("search", keyid);
+    urls.push_back(builder.str());
+    bytes += urls.back().size();
+  }
+
+  runner.run("uri_build/concat", bytes, count, [&keyids]() {
+    for (const auto& keyid : keyids) {
+      std::string url = "https://keys.example.org:443/pks/lookup?op=get" +
+                        std::string("&search=") + keyid;
+    }
+  });
+  runner.run("uri_build/builder", bytes, count, [&keyids, &builder]() {
+    for (const auto& keyid : keyids) {
+      builder.clear().scheme("https").authority("keys.example.org", "443");
+      builder.path("/pks/lookup").query("op", "get").query("search", keyid);
+    }
+  });
+  runner.run("uri_parse/copy", bytes, count, [&urls]() {
+    URI uri;
+    for (const auto& url : urls) uri.set_uri(url);
+  });
+  runner.run("uri_parse/view", bytes, count, [&urls]() {
+    URIView uri;
+    for (const auto& url : urls) uri.set_uri(url);
+  });
+}
+
+// Draw 32-byte values (like nonces or session keys) on several threads,
+// from the per-thread generators of rng() and, for comparison, from one
+// generator shared under a mutex.
+void bench_rng(Runner& runner) {
+  const size_t calls = 4096;
+  const size_t size = 32;
+  Botan::AutoSeeded_RNG shared;
+  std::mutex shared_mutex;
+
+  for (size_t threads : {1, 8, 64}) {
+    auto draw = [threads](std::function<void(uint8_t*)> get) {
+      std::vector<std::thread> workers;
+      for (size_t i = 0; i < threads; i++)
+        workers.emplace_back([&get]() {
+          uint8_t buf[size];
+          for (size_t j = 0; j < calls; j++) get(buf);
+        });
+      for (auto& worker : workers) worker.join();
+    };
+    const uint64_t items = threads * calls;
+    runner.run("rng/thread_local/" + std::to_string(threads), items * size,
+               items, [&draw]() {
+                 draw([](uint8_t* buf) { rng()->randomize(buf, size); });
+               });
+    runner.run("rng/shared/" + std::to_string(threads), items * size, items,
+               [&draw, &shared, &shared_mutex]() {
+                 draw([&shared, &shared_mutex](uint8_t* buf) {
+                   std::lock_guard<std::mutex> lock(shared_mutex);
+                   shared.randomize(buf, size);
+                 });
+               });
+  }
+}
+
+void usage() {
+  std::cerr << "usage: neopg-bench [--min-time SECONDS] [--json FILE] "
+               "[KEYRING...]\n";
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  double min_time = 0.5;
+  std::string json_file;
+  std::vector<Corpus> corpora{small_keys(), many_signatures(), photo_ids(),
+                              partial_stream()};
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--min-time") {
+      if (++i == argc) usage();
+      min_time = std::atof(argv[i]);
+    } else if (arg == "--json") {
+      if (++i == argc) usage();
+      json_file = argv[i];
+    } else if (arg.size() > 0 and arg[0] == '-') {
+      usage();
+    } else {
+      std::ifstream in(arg, std::ios::binary);
+      if (!in) {
+        std::cerr << "neopg-bench: can not open " << arg << "\n";
+        return 1;
+      }
+      std::stringstream data;
+      data << in.rdbuf();
+      corpora.push_back(Corpus{arg, data.str()});
+    }
+  }
+
+  Runner runner{min_time};
+  for (const auto& corpus : corpora) bench_corpus(runner, corpus);
+  bench_mpi(runner);
+  bench_armor(runner);
+  bench_hex(runner);
+  bench_uri(runner);
+  bench_rng(runner);
+
+  tao::json::value result = {
+      {"context", {{"min_time", min_time}}},
+      {"benchmarks", runner.m_results}};
+  if (json_file.empty()) {
+    tao::json::to_stream(std::cout, result, 2);
+    std::cout << "\n";
+  } else {
+    std::ofstream out(json_file);
+    tao::json::to_stream(out, result, 2);
+    out << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,182 @@
+// NeoPG CPU features (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/crypto/cpu.h>
+
+#include <cstdlib>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NEOPG_CPU_X86 1
+#include <cpuid.h>
+#elif defined(__aarch64__)
+#define NEOPG_CPU_ARM64 1
+#if defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#endif
+
+using namespace NeoPG;
+
+namespace {
+
+struct FeatureName {
+  CpuFeature m_feature;
+  const char* m_name;
+};
+
+const FeatureName FEATURE_NAMES[] = {
+    {CpuFeature::SSSE3, "ssse3"},         {CpuFeature::SSE41, "sse4.1"},
+    {CpuFeature::PCLMUL, "pclmul"},       {CpuFeature::AESNI, "aesni"},
+    {CpuFeature::AVX, "avx"},             {CpuFeature::AVX2, "avx2"},
+    {CpuFeature::AVX512F, "avx512f"},     {CpuFeature::AVX512BW, "avx512bw"},
+    {CpuFeature::BMI2, "bmi2"},           {CpuFeature::SHA, "sha"},
+    {CpuFeature::RDRAND, "rdrand"},       {CpuFeature::VAES, "vaes"},
+    {CpuFeature::VPCLMUL, "vpclmul"},     {CpuFeature::NEON, "neon"},
+    {CpuFeature::ARM_AES, "arm-aes"},     {CpuFeature::ARM_PMULL, "arm-pmull"},
+    {CpuFeature::ARM_SHA1, "arm-sha1"},   {CpuFeature::ARM_SHA2, "arm-sha2"}};
+
+#ifdef NEOPG_CPU_X86
+
+uint32_t detect_x86() {
+  unsigned int eax, ebx, ecx, edx;
+  unsigned int max_leaf;
+  uint32_t features = 0;
+
+  if (!__get_cpuid(0, &max_leaf, &ebx, &ecx, &edx)) return 0;
+
+  __cpuid(1, eax, ebx, ecx, edx);
+  if (ecx & (1 << 1)) features |= uint32_t(CpuFeature::PCLMUL);
+  if (ecx & (1 << 9)) features |= uint32_t(CpuFeature::SSSE3);
+  if (ecx & (1 << 19)) features |= uint32_t(CpuFeature::SSE41);
+  if (ecx & (1 << 25)) features |= uint32_t(CpuFeature::AESNI);
+  if (ecx & (1 << 30)) features |= uint32_t(CpuFeature::RDRAND);
+
+  // The wider registers also need the operating system to save them
+  // (OSXSAVE, and the state enabled in XCR0): SSE and AVX for the YMM
+  // registers, and additionally the opmask and ZMM state for AVX-512.
+  bool os_avx = false;
+  bool os_avx512 = false;
+  if ((ecx & (1 << 27)) && (ecx & (1 << 28))) {
+    unsigned int xcr0, xcr0_high;
+    __asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+    os_avx = (xcr0 & 0x06) == 0x06;
+    os_avx512 = os_avx && (xcr0 & 0xe0) == 0xe0;
+  }
+  if (os_avx) features |= uint32_t(CpuFeature::AVX);
+
+  if (max_leaf >= 7) {
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    if (os_avx && (ebx & (1 << 5))) features |= uint32_t(CpuFeature::AVX2);
+    if (ebx & (1 << 8)) features |= uint32_t(CpuFeature::BMI2);
+    if (os_avx512 && (ebx & (1 << 16)))
+      features |= uint32_t(CpuFeature::AVX512F);
+    if (os_avx512 && (ebx & (1 << 30)))
+      features |= uint32_t(CpuFeature::AVX512BW);
+    if (ebx & (1 << 29)) features |= uint32_t(CpuFeature::SHA);
+    if (os_avx && (ecx & (1 << 9))) features |= uint32_t(CpuFeature::VAES);
+    if (os_avx && (ecx & (1 << 10)))
+      features |= uint32_t(CpuFeature::VPCLMUL);
+  }
+
+  return features;
+}
+
+#endif
+
+#ifdef NEOPG_CPU_ARM64
+
+uint32_t detect_arm64() {
+  // Advanced SIMD is part of the base architecture.
+  uint32_t features = uint32_t(CpuFeature::NEON);
+#if defined(__linux__)
+  const unsigned long HWCAP_AES_BIT = 1 << 3;
+  const unsigned long HWCAP_PMULL_BIT = 1 << 4;
+  const unsigned long HWCAP_SHA1_BIT = 1 << 5;
+  const unsigned long HWCAP_SHA2_BIT = 1 << 6;
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  if (hwcap & HWCAP_AES_BIT) features |= uint32_t(CpuFeature::ARM_AES);
+  if (hwcap & HWCAP_PMULL_BIT) features |= uint32_t(CpuFeature::ARM_PMULL);
+  if (hwcap & HWCAP_SHA1_BIT) features |= uint32_t(CpuFeature::ARM_SHA1);
+  if (hwcap & HWCAP_SHA2_BIT) features |= uint32_t(CpuFeature::ARM_SHA2);
+#elif defined(__APPLE__)
+  // All Apple ARM64 processors have the cryptography extensions.
+  features |= uint32_t(CpuFeature::ARM_AES | CpuFeature::ARM_PMULL |
+                       CpuFeature::ARM_SHA1 | CpuFeature::ARM_SHA2);
+#endif
+  return features;
+}
+
+#endif
+
+CpuFeatures detect() {
+#if defined(NEOPG_CPU_X86)
+  return CpuFeatures(detect_x86());
+#elif defined(NEOPG_CPU_ARM64)
+  return CpuFeatures(detect_arm64());
+#else
+  return CpuFeatures();
+#endif
+}
+
+CpuFeatures enabled() {
+  CpuFeatures disabled;
+  const char* list = std::getenv(CPU_DISABLE_ENV);
+  if (list) cpu_parse_features(list, disabled);
+  return cpu_detected() - disabled;
+}
+
+}  // namespace
+
+CpuFeatures NeoPG::cpu_detected() {
+  static const CpuFeatures features = detect();
+  return features;
+}
+
+CpuFeatures NeoPG::cpu_features() {
+  static const CpuFeatures features = enabled();
+  return features;
+}
+
+const char* NeoPG::cpu_feature_name(CpuFeature feature) {
+  for (const auto& entry : FEATURE_NAMES)
+    if (entry.m_feature == feature) return entry.m_name;
+  return "unknown";
+}
+
+std::string NeoPG::cpu_feature_names(CpuFeatures features) {
+  std::string names;
+  for (const auto& entry : FEATURE_NAMES)
+    if (features.contains(entry.m_feature)) {
+      if (!names.empty()) names += ",";
+      names += entry.m_name;
+    }
+  return names;
+}
+
+bool NeoPG::cpu_parse_features(const std::string& list,
+                               CpuFeatures& features) {
+  bool known = true;
+  features = CpuFeatures();
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find_first_of(", ", pos);
+    if (end == std::string::npos) end = list.size();
+    std::string name = list.substr(pos, end - pos);
+    pos = end + 1;
+    if (name.empty()) continue;
+    if (name == "all") {
+      features = CpuFeatures(~uint32_t{0});
+      continue;
+    }
+    bool found = false;
+    for (const auto& entry : FEATURE_NAMES)
+      if (name == entry.m_name) {
+        features = features | entry.m_feature;
+        found = true;
+      }
+    if (!found) known = false;
+  }
+  return known;
+}
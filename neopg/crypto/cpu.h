@@ -0,0 +1,135 @@
+// NeoPG CPU features
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains the detection of CPU features, and the selection of
+/// runtime dispatched kernels based on them.
+
+#pragma once
+
+#include <neopg/utils/common.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace NeoPG {
+
+/// The instruction set extensions used by the kernels.
+enum class CpuFeature : uint32_t {
+  SSSE3 = 1 << 0,
+  SSE41 = 1 << 1,
+  PCLMUL = 1 << 2,
+  AESNI = 1 << 3,
+  AVX = 1 << 4,
+  AVX2 = 1 << 5,
+  AVX512F = 1 << 6,
+  AVX512BW = 1 << 7,
+  BMI2 = 1 << 8,
+  SHA = 1 << 9,  ///< The Intel SHA extensions (SHA-NI)
+  RDRAND = 1 << 10,
+  VAES = 1 << 11,
+  VPCLMUL = 1 << 12,
+  NEON = 1 << 13,
+  ARM_AES = 1 << 14,
+  ARM_PMULL = 1 << 15,
+  ARM_SHA1 = 1 << 16,
+  ARM_SHA2 = 1 << 17
+};
+
+/// A set of CPU features.
+class NEOPG_UNSTABLE_API CpuFeatures {
+ public:
+  constexpr CpuFeatures() {}
+  constexpr CpuFeatures(CpuFeature feature)
+      : m_bits(static_cast<uint32_t>(feature)) {}
+  constexpr explicit CpuFeatures(uint32_t bits) : m_bits(bits) {}
+
+  constexpr uint32_t bits() const { return m_bits; }
+  constexpr bool empty() const { return m_bits == 0; }
+
+  /// \return true if all of \p features are in this set
+  constexpr bool contains(CpuFeatures features) const {
+    return (m_bits & features.m_bits) == features.m_bits;
+  }
+
+  constexpr CpuFeatures operator|(CpuFeatures other) const {
+    return CpuFeatures(m_bits | other.m_bits);
+  }
+
+  /// \return this set without \p other
+  constexpr CpuFeatures operator-(CpuFeatures other) const {
+    return CpuFeatures(m_bits & ~other.m_bits);
+  }
+
+  constexpr bool operator==(CpuFeatures other) const {
+    return m_bits == other.m_bits;
+  }
+  constexpr bool operator!=(CpuFeatures other) const {
+    return m_bits != other.m_bits;
+  }
+
+ private:
+  uint32_t m_bits{0};
+};
+
+constexpr CpuFeatures operator|(CpuFeature lhs, CpuFeature rhs) {
+  return CpuFeatures(lhs) | rhs;
+}
+
+/// The environment variable with the features that cpu_features() does
+/// not report, as a list for cpu_parse_features().  This is meant for
+/// testing and benchmarking the portable kernels on capable hardware.
+const char* const CPU_DISABLE_ENV = "NEOPG_CPU_DISABLE";
+
+/// \return the features of the CPU (and operating system, for the wider
+/// registers).  The CPU is only examined on the first call.
+NEOPG_UNSTABLE_API CpuFeatures cpu_detected();
+
+/// \return the features that kernels may use: cpu_detected() without the
+/// features listed in the NEOPG_CPU_DISABLE environment variable.  The
+/// environment is only read on the first call.
+NEOPG_UNSTABLE_API CpuFeatures cpu_features();
+
+/// \return true if all of \p features are in cpu_features()
+inline bool cpu_supports(CpuFeatures features) {
+  return cpu_features().contains(features);
+}
+
+/// \return the name of \p feature, in lower case (like "avx2")
+NEOPG_UNSTABLE_API const char* cpu_feature_name(CpuFeature feature);
+
+/// \return the names of \p features, separated by commas
+NEOPG_UNSTABLE_API std::string cpu_feature_names(CpuFeatures features);
+
+/// Parse \p list, feature names separated by commas or spaces, or "all",
+/// and store the result in \p features.  Unknown names are skipped.
+///
+/// \return false if \p list contains unknown names
+NEOPG_UNSTABLE_API bool cpu_parse_features(const std::string& list,
+                                           CpuFeatures& features);
+
+/// An implementation of a runtime dispatched function, and the features
+/// it requires.
+template <typename Function>
+struct CpuKernel {
+  const char* m_name;
+  CpuFeatures m_requires;
+  Function* m_function;
+};
+
+/// \return the first kernel in \p kernels whose features are all in \p
+/// available.  The kernels are ordered by preference, and the last one is
+/// the portable kernel, without requirements.
+template <typename Function, size_t N>
+const CpuKernel<Function>& cpu_select(const CpuKernel<Function> (&kernels)[N],
+                                      CpuFeatures available = cpu_features()) {
+  static_assert(N > 0, "no kernels");
+  for (size_t i = 0; i + 1 < N; i++)
+    if (available.contains(kernels[i].m_requires)) return kernels[i];
+  return kernels[N - 1];
+}
+
+}  // namespace NeoPG
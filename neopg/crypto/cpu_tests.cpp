@@ -0,0 +1,78 @@
+// NeoPG CPU features (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/crypto/cpu.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <string>
+
+using namespace NeoPG;
+
+namespace {
+
+int portable() { return 0; }
+int fast() { return 1; }
+int faster() { return 2; }
+
+}  // namespace
+
+TEST(NeopgCryptoCpu, Features) {
+  ASSERT_EQ(cpu_detected(), cpu_detected());
+  ASSERT_TRUE(cpu_detected().contains(cpu_features()));
+
+  CpuFeatures disabled;
+  const char* list = std::getenv(CPU_DISABLE_ENV);
+  if (list) cpu_parse_features(list, disabled);
+  ASSERT_EQ(cpu_features(), cpu_detected() - disabled);
+
+#if defined(__aarch64__)
+  ASSERT_TRUE(cpu_detected().contains(CpuFeature::NEON));
+#endif
+}
+
+TEST(NeopgCryptoCpu, Names) {
+  ASSERT_EQ(std::string(cpu_feature_name(CpuFeature::AVX2)), "avx2");
+  ASSERT_EQ(std::string(cpu_feature_name(CpuFeature::SSE41)), "sse4.1");
+  ASSERT_EQ(cpu_feature_names(CpuFeature::SSSE3 | CpuFeature::SHA),
+            "ssse3,sha");
+  ASSERT_EQ(cpu_feature_names(CpuFeatures()), "");
+
+  CpuFeatures features;
+  ASSERT_TRUE(cpu_parse_features("avx2, pclmul,,neon", features));
+  ASSERT_EQ(features,
+            CpuFeature::AVX2 | CpuFeature::PCLMUL | CpuFeature::NEON);
+  ASSERT_FALSE(cpu_parse_features("avx2,avx1024", features));
+  ASSERT_EQ(features, CpuFeatures(CpuFeature::AVX2));
+  ASSERT_TRUE(cpu_parse_features("all", features));
+  ASSERT_TRUE(features.contains(CpuFeature::ARM_SHA2 | CpuFeature::SSSE3));
+  ASSERT_TRUE(cpu_parse_features("", features));
+  ASSERT_TRUE(features.empty());
+
+  // Every name parses back to its feature.
+  ASSERT_TRUE(cpu_parse_features("all", features));
+  CpuFeatures round_trip;
+  ASSERT_TRUE(cpu_parse_features(cpu_feature_names(features), round_trip));
+  ASSERT_EQ(cpu_feature_names(round_trip), cpu_feature_names(features));
+}
+
+TEST(NeopgCryptoCpu, Select) {
+  const CpuKernel<int()> kernels[] = {
+      {"faster", CpuFeature::AVX2 | CpuFeature::BMI2, faster},
+      {"fast", CpuFeature::SSSE3, fast},
+      {"portable", CpuFeatures(), portable}};
+
+  ASSERT_EQ(cpu_select(kernels, CpuFeatures()).m_function(), 0);
+  ASSERT_EQ(cpu_select(kernels, CpuFeature::AVX2).m_function(), 0);
+  ASSERT_EQ(cpu_select(kernels, CpuFeature::SSSE3 | CpuFeature::AVX2)
+                .m_function(),
+            1);
+  ASSERT_EQ(std::string(cpu_select(kernels, CpuFeatures(~uint32_t{0})).m_name),
+            "faster");
+
+  const CpuKernel<int()>& selected = cpu_select(kernels);
+  ASSERT_TRUE(cpu_supports(selected.m_requires));
+}
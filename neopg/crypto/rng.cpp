@@ -5,17 +5,113 @@
 */
 
 #include <botan/auto_rng.h>
+#include <botan/hmac_drbg.h>
+#include <botan/mac.h>
 #include <neopg/crypto/rng.h>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 namespace NeoPG {
 
+namespace {
+
+/* The number of requests after which a thread generator reseeds from the
+   global pool.  This keeps the lock of the pool off the hot path, while
+   still limiting how much output depends on a single seed.  */
+const size_t RESEED_INTERVAL = 1024;
+
+/* The global pool.  It is only used to seed and reseed the per-thread
+   generators and to collect the input of add_entropy.  */
+class SeedPool : public Botan::RandomNumberGenerator {
+ public:
+  void randomize(uint8_t output[], size_t length) override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pool.randomize(output, length);
+  }
+
+  void add_entropy(const uint8_t input[], size_t length) override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pool.add_entropy(input, length);
+  }
+
+  /* Not marked override, as older versions of Botan don't have it.  */
+  bool accepts_input() const { return true; }
+
+  bool is_seeded() const override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pool.is_seeded();
+  }
+
+  void clear() override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pool.clear();
+  }
+
+  std::string name() const override {
+    return "SeedPool(" + m_pool.name() + ")";
+  }
+
+  /* Held across fork, so that the child never inherits a locked pool.  */
+  void lock() { m_mutex.lock(); }
+  void unlock() { m_mutex.unlock(); }
+
+ private:
+  mutable std::mutex m_mutex;
+  Botan::AutoSeeded_RNG m_pool;
+};
+
+/* Incremented in the child after every fork, so that no two processes
+   continue with copies of the same generator state.  */
+std::atomic<unsigned int> fork_generation{0};
+
+SeedPool& seed_pool() {
+  /* Never destroyed, as thread generators may outlive static
+     destruction.  */
+  static SeedPool* pool = []() {
+    SeedPool* pool = new SeedPool;
+#ifndef _WIN32
+    pthread_atfork([]() { seed_pool().lock(); },
+                   []() { seed_pool().unlock(); },
+                   []() {
+                     seed_pool().unlock();
+                     fork_generation++;
+                   });
+#endif
+    return pool;
+  }();
+  return *pool;
+}
+
+}  // namespace
+
 Botan::RandomNumberGenerator* rng(void) {
-  static thread_local Botan::RandomNumberGenerator* rng_local;
+  static thread_local std::unique_ptr<Botan::RandomNumberGenerator> rng_local;
+  static thread_local unsigned int rng_generation;
 
   /* We delay allocation so that only threads which actually use neopg
      crypto are creating a random pool.  */
-  if (rng_local == nullptr) rng_local = new Botan::AutoSeeded_RNG;
-  return rng_local;
+  const unsigned int generation = fork_generation.load();
+  if (rng_local == nullptr || rng_generation != generation) {
+    SeedPool& pool = seed_pool();
+    rng_local.reset(new Botan::HMAC_DRBG(
+        Botan::MessageAuthenticationCode::create_or_throw("HMAC(SHA-256)"),
+        pool, RESEED_INTERVAL));
+    rng_local->reseed_from_rng(pool);
+    rng_generation = generation;
+  }
+  return rng_local.get();
+}
+
+void add_entropy(const uint8_t* data, size_t length) {
+  seed_pool().add_entropy(data, length);
+  rng()->add_entropy(data, length);
 }
 
 }  // Namespace NeoPG
@@ -10,8 +10,23 @@
 
 #include <neopg/utils/common.h>
 
+#include <cstddef>
+#include <cstdint>
+
 namespace NeoPG {
 
+/* Return the random number generator of the calling thread.  Every thread
+   gets its own HMAC_DRBG, so threads never contend on a shared generator.
+   The generator is seeded from a global pool (an automatically seeded
+   DRBG, which is only used under a lock), reseeds itself from that pool
+   after a fixed number of requests, is replaced in the child after a
+   fork, and is destroyed when the thread exits.  The pointer must not be
+   used by other threads or after the thread exits.  */
 NEOPG_DLL Botan::RandomNumberGenerator* rng(void);
 
+/* Mix LENGTH bytes at DATA into the global pool and into the generator of
+   the calling thread.  The generators of other threads see the input at
+   their next reseed.  */
+NEOPG_DLL void add_entropy(const uint8_t* data, size_t length);
+
 }  // Namespace NeoPG
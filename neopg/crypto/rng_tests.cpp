@@ -0,0 +1,106 @@
+// NeoPG random numbers (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/crypto/rng.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace NeoPG;
+
+namespace {
+
+std::string draw(size_t length = 32) {
+  std::string out(length, '\0');
+  rng()->randomize(reinterpret_cast<uint8_t*>(&out[0]), out.size());
+  return out;
+}
+
+}  // namespace
+
+TEST(NeopgCryptoRng, PerThread) {
+  Botan::RandomNumberGenerator* main_rng = rng();
+  ASSERT_EQ(rng(), main_rng);
+  ASSERT_TRUE(main_rng->is_seeded());
+
+  Botan::RandomNumberGenerator* thread_rng = nullptr;
+  std::string thread_value;
+  std::thread thread([&thread_rng, &thread_value]() {
+    thread_rng = rng();
+    thread_value = draw();
+  });
+  thread.join();
+  ASSERT_NE(thread_rng, main_rng);
+  ASSERT_NE(draw(), thread_value);
+}
+
+TEST(NeopgCryptoRng, Reseed) {
+  // Run through several reseeds from the global pool.
+  std::string last;
+  for (int i = 0; i < 4096; i++) {
+    std::string value = draw(16);
+    ASSERT_NE(value, last);
+    last = value;
+  }
+}
+
+TEST(NeopgCryptoRng, ManyThreads) {
+  const size_t count = 64;
+  std::vector<std::string> values(count);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < count; i++)
+    threads.emplace_back([&values, i]() {
+      for (int j = 0; j < 100; j++) values[i] = draw();
+    });
+  for (auto& thread : threads) thread.join();
+  for (size_t i = 0; i < count; i++)
+    for (size_t j = i + 1; j < count; j++) ASSERT_NE(values[i], values[j]);
+}
+
+TEST(NeopgCryptoRng, AddEntropy) {
+  const std::string input(64, 'x');
+  add_entropy(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+  ASSERT_NE(draw(), draw());
+
+  std::thread thread([&input]() {
+    add_entropy(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+    ASSERT_NE(draw(), draw());
+  });
+  thread.join();
+}
+
+#ifndef _WIN32
+TEST(NeopgCryptoRng, Fork) {
+  draw();
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  pid_t pid = fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    std::string value = draw();
+    ssize_t written = write(fds[1], value.data(), value.size());
+    _exit(written == static_cast<ssize_t>(value.size()) ? 0 : 1);
+  }
+  close(fds[1]);
+  std::string parent = draw();
+  std::string child(parent.size(), '\0');
+  ASSERT_EQ(read(fds[0], &child[0], child.size()),
+            static_cast<ssize_t>(child.size()));
+  close(fds[0]);
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  ASSERT_NE(parent, child);
+}
+#endif
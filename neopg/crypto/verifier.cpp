@@ -0,0 +1,666 @@
+// NeoPG signature verification (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/crypto/verifier.h>
+
+#include <neopg/openpgp/object_identifier.h>
+#include <neopg/openpgp/public_key/data/v3_public_key_data.h>
+#include <neopg/openpgp/public_key/data/v4_public_key_data.h>
+#include <neopg/openpgp/public_key/material/dsa_public_key_material.h>
+#include <neopg/openpgp/public_key/material/ecdsa_public_key_material.h>
+#include <neopg/openpgp/public_key/material/eddsa_public_key_material.h>
+#include <neopg/openpgp/public_key/material/rsa_public_key_material.h>
+#include <neopg/openpgp/public_key_packet.h>
+#include <neopg/openpgp/public_subkey_packet.h>
+#include <neopg/openpgp/signature/data/v3_signature_data.h>
+#include <neopg/openpgp/signature/data/v4_signature_data.h>
+#include <neopg/openpgp/signature/material/dsa_signature_material.h>
+#include <neopg/openpgp/signature/material/ecdsa_signature_material.h>
+#include <neopg/openpgp/signature/material/eddsa_signature_material.h>
+#include <neopg/openpgp/signature/material/rsa_signature_material.h>
+#include <neopg/openpgp/signature/subpacket/embedded_signature_subpacket.h>
+#include <neopg/openpgp/signature/subpacket/issuer_subpacket.h>
+#include <neopg/openpgp/signature/subpacket/signature_creation_time_subpacket.h>
+#include <neopg/parser/decompressing_packet_sink.h>
+#include <neopg/parser/openpgp.h>
+#include <neopg/utils/workers.h>
+
+#include <neopg/intern/cplusplus.h>
+
+#include <botan/dsa.h>
+#include <botan/ecdsa.h>
+#include <botan/ed25519.h>
+#include <botan/hash.h>
+#include <botan/pubkey.h>
+#include <botan/rsa.h>
+
+#include <algorithm>
+
+using namespace NeoPG;
+
+namespace {
+
+// The Botan name of a hash algorithm, or nullptr if it is not accepted.
+// MD5 is broken for signatures, and rejected.
+const char* hash_name(HashAlgorithm algorithm) {
+  switch (algorithm) {
+    case HashAlgorithm::Sha1:
+      return "SHA-160";
+    case HashAlgorithm::Ripemd160:
+      return "RIPEMD-160";
+    case HashAlgorithm::Sha256:
+      return "SHA-256";
+    case HashAlgorithm::Sha384:
+      return "SHA-384";
+    case HashAlgorithm::Sha512:
+      return "SHA-512";
+    case HashAlgorithm::Sha224:
+      return "SHA-224";
+    default:
+      return nullptr;
+  }
+}
+
+bool is_rsa(PublicKeyAlgorithm algorithm) {
+  return algorithm == PublicKeyAlgorithm::Rsa ||
+         algorithm == PublicKeyAlgorithm::RsaSign;
+}
+
+// The signature algorithm a key of algorithm ALGORITHM makes.
+PublicKeyAlgorithm signing_algorithm(PublicKeyAlgorithm algorithm) {
+  return is_rsa(algorithm) ? PublicKeyAlgorithm::Rsa : algorithm;
+}
+
+Botan::BigInt bigint(const MultiprecisionInteger& mpi) {
+  return Botan::BigInt(mpi.bits().data(), mpi.bits().size());
+}
+
+// Append MPI to OUT as a big endian number of exactly LENGTH bytes.
+bool append_fixed(std::vector<uint8_t>& out, const MultiprecisionInteger& mpi,
+                  size_t length) {
+  const auto& bits = mpi.bits();
+  if (bits.size() > length) return false;
+  out.insert(out.end(), length - bits.size(), 0);
+  out.insert(out.end(), bits.begin(), bits.end());
+  return true;
+}
+
+std::unique_ptr<Botan::Public_Key> botan_key(
+    PublicKeyAlgorithm algorithm, const PublicKeyMaterial* material) {
+  if (!material) return nullptr;
+  if (is_rsa(algorithm)) {
+    auto rsa = dynamic_cast<const RsaPublicKeyMaterial*>(material);
+    if (!rsa) return nullptr;
+    return NeoPG::make_unique<Botan::RSA_PublicKey>(bigint(rsa->m_n),
+                                                    bigint(rsa->m_e));
+  }
+  switch (algorithm) {
+    case PublicKeyAlgorithm::Dsa: {
+      auto dsa = dynamic_cast<const DsaPublicKeyMaterial*>(material);
+      if (!dsa) return nullptr;
+      Botan::DL_Group group(bigint(dsa->m_p), bigint(dsa->m_q),
+                            bigint(dsa->m_g));
+      return NeoPG::make_unique<Botan::DSA_PublicKey>(group,
+                                                      bigint(dsa->m_y));
+    }
+    case PublicKeyAlgorithm::Ecdsa: {
+      auto ecdsa = dynamic_cast<const EcdsaPublicKeyMaterial*>(material);
+      if (!ecdsa) return nullptr;
+      Curve curve = ecdsa->m_curve.curve();
+      if (curve == Curve::Unknown || curve == Curve::Ed25519 ||
+          curve == Curve::Curve25519)
+        return nullptr;
+      Botan::EC_Group group(ObjectIdentifier::curve_name(curve));
+      const auto& point = ecdsa->m_key.bits();
+      return NeoPG::make_unique<Botan::ECDSA_PublicKey>(
+          group,
+          Botan::OS2ECP(point.data(), point.size(), group.get_curve()));
+    }
+    case PublicKeyAlgorithm::Eddsa: {
+      auto eddsa = dynamic_cast<const EddsaPublicKeyMaterial*>(material);
+      if (!eddsa || eddsa->m_curve.curve() != Curve::Ed25519) return nullptr;
+      // The native point format is prefixed with 0x40.
+      const auto& point = eddsa->m_key.bits();
+      if (point.size() != 33 || point[0] != 0x40) return nullptr;
+      return NeoPG::make_unique<Botan::Ed25519_PublicKey>(
+          std::vector<uint8_t>(point.begin() + 1, point.end()));
+    }
+    default:
+      return nullptr;
+  }
+}
+
+// The signature in the format that Botan expects for KEY, or an empty
+// vector if MATERIAL does not fit.
+std::vector<uint8_t> botan_signature(const VerificationKey& key,
+                                     const SignatureMaterial* material) {
+  std::vector<uint8_t> signature;
+  if (!material) return signature;
+  switch (key.m_algorithm) {
+    case PublicKeyAlgorithm::Rsa: {
+      auto rsa = dynamic_cast<const RsaSignatureMaterial*>(material);
+      if (rsa) signature = rsa->m_m_pow_d.bits().to_vector();
+    } break;
+    case PublicKeyAlgorithm::Dsa: {
+      auto dsa = dynamic_cast<const DsaSignatureMaterial*>(material);
+      size_t part = key.m_key->message_part_size();
+      if (!dsa || !append_fixed(signature, dsa->m_r, part) ||
+          !append_fixed(signature, dsa->m_s, part))
+        signature.clear();
+    } break;
+    case PublicKeyAlgorithm::Ecdsa: {
+      auto ecdsa = dynamic_cast<const EcdsaSignatureMaterial*>(material);
+      size_t part = key.m_key->message_part_size();
+      if (!ecdsa || !append_fixed(signature, ecdsa->m_r, part) ||
+          !append_fixed(signature, ecdsa->m_s, part))
+        signature.clear();
+    } break;
+    case PublicKeyAlgorithm::Eddsa: {
+      auto eddsa = dynamic_cast<const EddsaSignatureMaterial*>(material);
+      if (!eddsa || !append_fixed(signature, eddsa->m_r, 32) ||
+          !append_fixed(signature, eddsa->m_s, 32))
+        signature.clear();
+    } break;
+    default:
+      break;
+  }
+  return signature;
+}
+
+// The parts of a V3 or V4 signature that verification needs.
+struct SignatureParts {
+  SignatureType m_type{SignatureType::Binary};
+  PublicKeyAlgorithm m_algorithm{PublicKeyAlgorithm::Rsa};
+  HashAlgorithm m_hash{HashAlgorithm::Sha1};
+  std::array<uint8_t, 2> m_quick{{0, 0}};
+  const SignatureMaterial* m_material{nullptr};
+  uint32_t m_created{0};
+  std::vector<uint8_t> m_keyid;
+  // Hash the fields that follow the hashed data.
+  std::function<void(Botan::HashFunction&)> m_trailer;
+};
+
+bool signature_parts(const SignaturePacket& packet, SignatureParts& parts,
+                     VerifyResult& result) {
+  auto v4 = dynamic_cast<const V4SignatureData*>(packet.m_signature.get());
+  auto v3 = dynamic_cast<const V3SignatureData*>(packet.m_signature.get());
+  if (v4) {
+    parts.m_type = v4->m_type;
+    parts.m_algorithm = v4->m_public_key_algorithm;
+    parts.m_hash = v4->m_hash_algorithm;
+    parts.m_quick = v4->m_quick;
+    parts.m_material = v4->m_signature.get();
+    parts.m_created = v4->m_created;
+
+    auto created = dynamic_cast<const SignatureCreationTimeSubpacket*>(
+        v4->m_hashed_subpackets->find(
+            SignatureSubpacketType::SignatureCreationTime));
+    if (created) parts.m_created = created->m_created;
+    // The issuer is usually in the unhashed area, but can be in either.
+    for (auto area : {v4->m_hashed_subpackets.get(),
+                      v4->m_unhashed_subpackets.get()}) {
+      auto issuer = dynamic_cast<const IssuerSubpacket*>(
+          area->find(SignatureSubpacketType::Issuer));
+      if (issuer) {
+        parts.m_keyid = issuer->m_issuer;
+        break;
+      }
+    }
+
+    parts.m_trailer = [v4](Botan::HashFunction& hash) {
+      ByteWriter out;
+      out.put_u8(static_cast<uint8_t>(SignatureVersion::V4));
+      out.put_u8(static_cast<uint8_t>(v4->m_type));
+      out.put_u8(static_cast<uint8_t>(v4->m_public_key_algorithm));
+      out.put_u8(static_cast<uint8_t>(v4->m_hash_algorithm));
+      v4->m_hashed_subpackets->write(out);
+      uint32_t length = out.size();
+      out.put_u8(static_cast<uint8_t>(SignatureVersion::V4));
+      out.put_u8(0xff);
+      out.put_u32be(length);
+      hash.update(reinterpret_cast<const uint8_t*>(out.str().data()),
+                  out.str().size());
+    };
+  } else if (v3) {
+    parts.m_type = v3->m_type;
+    parts.m_algorithm = v3->m_public_key_algorithm;
+    parts.m_hash = v3->m_hash_algorithm;
+    parts.m_quick = v3->m_quick;
+    parts.m_material = v3->m_signature.get();
+    parts.m_created = v3->m_created;
+    parts.m_keyid.assign(v3->m_signer.begin(), v3->m_signer.end());
+    parts.m_trailer = [v3](Botan::HashFunction& hash) {
+      ByteWriter out;
+      out.put_u8(static_cast<uint8_t>(v3->m_type));
+      out.put_u32be(v3->m_created);
+      hash.update(reinterpret_cast<const uint8_t*>(out.str().data()),
+                  out.str().size());
+    };
+  } else {
+    result.m_status = VerifyStatus::Unsupported;
+    result.m_error = "unsupported signature version";
+    return false;
+  }
+  result.m_type = parts.m_type;
+  result.m_created = parts.m_created;
+  result.m_keyid = parts.m_keyid;
+  return true;
+}
+
+// Hash DATA in text mode, with all line endings converted to CR LF.
+void hash_text(Botan::HashFunction& hash, const char* data, size_t length) {
+  static const uint8_t CRLF[] = {'\r', '\n'};
+  auto ptr = reinterpret_cast<const uint8_t*>(data);
+  size_t start = 0;
+  for (size_t pos = 0; pos < length; pos++) {
+    if (ptr[pos] != '\n') continue;
+    size_t end = (pos > start && ptr[pos - 1] == '\r') ? pos - 1 : pos;
+    hash.update(ptr + start, end - start);
+    hash.update(CRLF, sizeof(CRLF));
+    start = pos + 1;
+  }
+  hash.update(ptr + start, length - start);
+}
+
+// Verify SIGNATURE, which covers the data hashed by HASH_DATA, with the key
+// candidates (or all keys with the right algorithm, if there is no issuer).
+VerifyResult verify_hashed(
+    const KeySet& keys, const SignaturePacket& signature,
+    const std::function<void(Botan::HashFunction&, SignatureType)>& hash_data,
+    const std::vector<const VerificationKey*>* only = nullptr) {
+  VerifyResult result;
+  SignatureParts parts;
+  if (!signature_parts(signature, parts, result)) return result;
+
+  const char* name = hash_name(parts.m_hash);
+  std::unique_ptr<Botan::HashFunction> hash;
+  if (name) hash = Botan::HashFunction::create(name);
+  if (!hash) {
+    result.m_status = VerifyStatus::Unsupported;
+    result.m_error = "unsupported hash algorithm " +
+                     std::to_string(static_cast<int>(parts.m_hash));
+    return result;
+  }
+
+  std::vector<const VerificationKey*> candidates;
+  if (only)
+    candidates = *only;
+  else if (!parts.m_keyid.empty())
+    candidates = keys.find(parts.m_keyid);
+  else
+    candidates = keys.keys();
+  auto algorithm = signing_algorithm(parts.m_algorithm);
+  candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                  [algorithm](const VerificationKey* key) {
+                                    return key->m_algorithm != algorithm;
+                                  }),
+                   candidates.end());
+  if (candidates.empty()) {
+    result.m_status = VerifyStatus::NoKey;
+    result.m_error = "no public key";
+    return result;
+  }
+
+  hash_data(*hash, parts.m_type);
+  parts.m_trailer(*hash);
+  auto digest = hash->final();
+
+  // The quick check rejects most mismatches without a public key operation.
+  if (digest[0] != parts.m_quick[0] || digest[1] != parts.m_quick[1]) {
+    result.m_status = VerifyStatus::Bad;
+    result.m_error = "digest does not match";
+    return result;
+  }
+
+  result.m_status = VerifyStatus::Bad;
+  result.m_error = "bad signature";
+  for (auto key : candidates) {
+    auto sig = botan_signature(*key, parts.m_material);
+    if (sig.empty()) {
+      result.m_status = VerifyStatus::Malformed;
+      result.m_error = "invalid signature material";
+      continue;
+    }
+    std::string padding;
+    if (key->m_algorithm == PublicKeyAlgorithm::Rsa)
+      padding = std::string("EMSA3(Raw,") + name + ")";
+    else if (key->m_algorithm == PublicKeyAlgorithm::Eddsa)
+      padding = "Pure";
+    else
+      padding = "Raw";
+    try {
+      Botan::PK_Verifier verifier(*key->m_key, padding);
+      if (verifier.verify_message(digest.data(), digest.size(), sig.data(),
+                                  sig.size())) {
+        result.m_status = VerifyStatus::Good;
+        result.m_fingerprint = key->m_fingerprint;
+        result.m_error.clear();
+        return result;
+      }
+    } catch (const std::exception& exc) {
+      result.m_error = std::string("verification failed: ") + exc.what();
+    }
+  }
+  return result;
+}
+
+// Hash the key packet PACKET as in key signatures.
+void hash_key(Botan::HashFunction& hash, const Packet& packet) {
+  ByteWriter body;
+  packet.write_body(body);
+  const std::string& data = body.str();
+  const uint8_t prefix[3] = {0x99, static_cast<uint8_t>(data.size() >> 8),
+                             static_cast<uint8_t>(data.size())};
+  hash.update(prefix, sizeof(prefix));
+  hash.update(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+}
+
+VerifyResult malformed(const std::string& error) {
+  VerifyResult result;
+  result.m_status = VerifyStatus::Malformed;
+  result.m_error = error;
+  return result;
+}
+
+// Collect the signatures and the literal data of a message.
+class MessageSink : public RawPacketRefSink {
+ public:
+  std::vector<std::unique_ptr<SignaturePacket>> m_signatures;
+  std::vector<VerifyResult> m_errors;
+  bool m_literal{false};
+  std::string m_content;
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override {
+    add(header.type(), data, length);
+  }
+
+  void start_packet(const PacketHeader& header) override {
+    m_type = header.type();
+    m_partial.clear();
+  }
+
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override {
+    m_partial.append(data, length);
+  }
+
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override {
+    m_partial.append(data, length);
+    add(m_type, m_partial.data(), m_partial.size());
+    m_partial.clear();
+  }
+
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override {
+    m_errors.push_back(malformed(error.what()));
+  }
+
+ private:
+  PacketType m_type{PacketType::Reserved};
+  std::string m_partial;
+
+  void add(PacketType type, const char* data, size_t length) {
+    if (type == PacketType::Signature) {
+      try {
+        ParserInput in{data, length};
+        m_signatures.emplace_back(SignaturePacket::create_or_throw(in));
+      } catch (const ParserError& exc) {
+        m_errors.push_back(malformed(exc.what()));
+      }
+    } else if (type == PacketType::LiteralData) {
+      // Format, file name, date, then the content.
+      if (m_literal || length < 6 ||
+          length < 6 + static_cast<uint8_t>(data[1])) {
+        m_errors.push_back(malformed("invalid literal data packet"));
+        return;
+      }
+      size_t offset = 6 + static_cast<uint8_t>(data[1]);
+      m_literal = true;
+      m_content.assign(data + offset, length - offset);
+    }
+  }
+};
+
+std::vector<VerifyResult> verify_all(
+    const Verifier& verifier,
+    const std::vector<std::unique_ptr<SignaturePacket>>& signatures,
+    const std::string& data) {
+  std::vector<VerifyResult> results;
+  for (const auto& signature : signatures)
+    results.push_back(verifier.verify(*signature, data.data(), data.size()));
+  return results;
+}
+
+}  // namespace
+
+bool KeySet::add(const PublicKeyData& data) {
+  const PublicKeyMaterial* material = nullptr;
+  PublicKeyAlgorithm algorithm;
+  if (auto v4 = dynamic_cast<const V4PublicKeyData*>(&data)) {
+    algorithm = v4->m_algorithm;
+    material = v4->m_key.get();
+  } else if (auto v3 = dynamic_cast<const V3PublicKeyData*>(&data)) {
+    algorithm = v3->m_algorithm;
+    material = v3->m_key.get();
+  } else
+    return false;
+
+  std::unique_ptr<Botan::Public_Key> key;
+  try {
+    key = botan_key(algorithm, material);
+  } catch (const std::exception&) {
+    // Invalid parameters or points.
+    return false;
+  }
+  if (!key) return false;
+
+  std::unique_ptr<VerificationKey> entry{new VerificationKey};
+  entry->m_fingerprint = data.fingerprint();
+  entry->m_keyid = data.keyid();
+  entry->m_algorithm = signing_algorithm(algorithm);
+  entry->m_key = std::move(key);
+  m_by_keyid.emplace(
+      std::string(entry->m_keyid.begin(), entry->m_keyid.end()),
+      m_keys.size());
+  m_keys.emplace_back(std::move(entry));
+  return true;
+}
+
+size_t KeySet::add(const Certificate& cert) {
+  if (cert.m_packets.empty()) return 0;
+  const Packet& primary_packet = cert.packet(cert.m_primary);
+  auto primary = dynamic_cast<const PublicKeyPacket*>(&primary_packet);
+  if (!primary || !primary->m_public_key) return 0;
+
+  // Bindings are verified with the primary key only.
+  KeySet primary_set;
+  if (!primary_set.add(*primary->m_public_key)) return 0;
+  auto primary_key = primary_set.keys();
+  add(*primary->m_public_key);
+  size_t added = 1;
+
+  for (const auto& component : cert.m_subkeys) {
+    const Packet& subkey_packet = cert.packet(component);
+    auto subkey = dynamic_cast<const PublicSubkeyPacket*>(&subkey_packet);
+    if (!subkey || !subkey->m_public_key) continue;
+
+    KeySet subkey_set;
+    if (!subkey_set.add(*subkey->m_public_key)) continue;
+    auto subkey_key = subkey_set.keys();
+    auto hash_keys = [&](Botan::HashFunction& hash, SignatureType) {
+      hash_key(hash, primary_packet);
+      hash_key(hash, subkey_packet);
+    };
+
+    bool bound = false;
+    for (size_t i = 0; i < component.m_signatures.size() && !bound; i++) {
+      auto binding = dynamic_cast<const SignaturePacket*>(
+          &cert.signature(component, i));
+      auto v4 = binding ? dynamic_cast<const V4SignatureData*>(
+                              binding->m_signature.get())
+                        : nullptr;
+      if (!v4 || v4->m_type != SignatureType::BindingSubkey) continue;
+      if (!verify_hashed(primary_set, *binding, hash_keys, &primary_key)
+               .good())
+        continue;
+
+      // A signing subkey has a back signature.  Verify it, if present.
+      auto embedded = dynamic_cast<const EmbeddedSignatureSubpacket*>(
+          v4->m_hashed_subpackets->find(
+              SignatureSubpacketType::EmbeddedSignature));
+      if (embedded) {
+        try {
+          ParserInput in{embedded->m_signature.data(),
+                         embedded->m_signature.size()};
+          auto back = SignaturePacket::create_or_throw(in);
+          auto back_v4 =
+              dynamic_cast<const V4SignatureData*>(back->m_signature.get());
+          if (!back_v4 || back_v4->m_type != SignatureType::BindingKey ||
+              !verify_hashed(subkey_set, *back, hash_keys, &subkey_key)
+                   .good())
+            continue;
+        } catch (const ParserError&) {
+          continue;
+        }
+      }
+      bound = true;
+    }
+    if (bound && add(*subkey->m_public_key)) added++;
+  }
+  return added;
+}
+
+std::vector<const VerificationKey*> KeySet::find(
+    const std::vector<uint8_t>& keyid) const {
+  std::vector<const VerificationKey*> result;
+  auto range = m_by_keyid.equal_range(std::string(keyid.begin(), keyid.end()));
+  for (auto it = range.first; it != range.second; ++it)
+    result.push_back(m_keys[it->second].get());
+  return result;
+}
+
+std::vector<const VerificationKey*> KeySet::keys() const {
+  std::vector<const VerificationKey*> result;
+  for (const auto& key : m_keys) result.push_back(key.get());
+  return result;
+}
+
+VerifyResult Verifier::verify(const SignaturePacket& signature,
+                              const char* data, size_t length) const {
+  return verify_hashed(
+      m_keys, signature,
+      [data, length](Botan::HashFunction& hash, SignatureType type) {
+        if (type == SignatureType::Text)
+          hash_text(hash, data, length);
+        else
+          hash.update(reinterpret_cast<const uint8_t*>(data), length);
+      });
+}
+
+std::vector<VerifyResult> Verifier::verify_detached(
+    const std::string& signatures, const std::string& data) const {
+  MessageSink sink;
+  RawPacketParser parser{sink};
+  parser.set_filter(PacketTypeMask{PacketType::Signature});
+  try {
+    parser.process(signatures.data(), signatures.size());
+  } catch (const ParserError& exc) {
+    return {malformed(exc.what())};
+  }
+  if (sink.m_signatures.empty()) {
+    if (sink.m_errors.empty()) return {malformed("no signature found")};
+    return sink.m_errors;
+  }
+  auto results = verify_all(*this, sink.m_signatures, data);
+  results.insert(results.end(), sink.m_errors.begin(), sink.m_errors.end());
+  return results;
+}
+
+std::vector<VerifyResult> Verifier::verify_inline(const std::string& message,
+                                                  std::string* content) const {
+  MessageSink sink;
+  DecompressingPacketSink decompress{sink, DecompressionLimits{}, false};
+  RawPacketParser parser{decompress};
+  try {
+    parser.process(message.data(), message.size());
+  } catch (const ParserError& exc) {
+    return {malformed(exc.what())};
+  }
+  if (!sink.m_literal) return {malformed("no literal data found")};
+  if (sink.m_signatures.empty()) {
+    if (sink.m_errors.empty()) return {malformed("no signature found")};
+    return sink.m_errors;
+  }
+  auto results = verify_all(*this, sink.m_signatures, sink.m_content);
+  results.insert(results.end(), sink.m_errors.begin(), sink.m_errors.end());
+  if (content) *content = std::move(sink.m_content);
+  return results;
+}
+
+BatchVerifier::BatchVerifier(const KeySet& keys, size_t threads)
+    : m_verifier(keys) {
+  if (threads == 0) threads = hardware_threads();
+  // Without a worker nothing would ever be done, so the first one must
+  // start.  If it can't, there are no threads to stop yet.
+  m_workers.emplace_back(&BatchVerifier::worker, this);
+  start_threads(m_workers, threads - 1, [this]() { worker(); });
+}
+
+BatchVerifier::~BatchVerifier() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_work.notify_all();
+  for (auto& worker : m_workers) worker.join();
+}
+
+std::vector<std::vector<VerifyResult>> BatchVerifier::verify(
+    const std::vector<VerifyRequest>& requests) {
+  std::lock_guard<std::mutex> batch(m_batch_mutex);
+  std::vector<std::vector<VerifyResult>> results(requests.size());
+  if (requests.empty()) return results;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_requests = &requests;
+  m_results = &results;
+  m_next = 0;
+  m_finished = 0;
+  m_work.notify_all();
+  m_done.wait(lock, [this, &requests]() {
+    return m_finished == requests.size();
+  });
+  m_requests = nullptr;
+  m_results = nullptr;
+  return results;
+}
+
+void BatchVerifier::worker() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_work.wait(lock, [this]() {
+      return m_stop || (m_requests && m_next < m_requests->size());
+    });
+    if (m_stop) return;
+
+    size_t idx = m_next++;
+    const VerifyRequest& request = (*m_requests)[idx];
+    std::vector<VerifyResult>& result = (*m_results)[idx];
+    lock.unlock();
+    try {
+      if (request.m_inline)
+        result = m_verifier.verify_inline(request.m_signature);
+      else
+        result = m_verifier.verify_detached(request.m_signature,
+                                            request.m_data);
+    } catch (const std::exception& exc) {
+      result = {malformed(exc.what())};
+    }
+    lock.lock();
+    if (++m_finished == m_requests->size()) m_done.notify_all();
+  }
+}
@@ -0,0 +1,203 @@
+// NeoPG signature verification
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains the verification of OpenPGP signatures.
+
+#pragma once
+
+#include <neopg/openpgp/keyblock_sink.h>
+#include <neopg/openpgp/public_key/public_key_data.h>
+#include <neopg/openpgp/signature_packet.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Botan {
+class Public_Key;
+}
+
+namespace NeoPG {
+
+/// A public key that can verify signatures, converted to its Botan
+/// representation once, when it is added to a KeySet.
+struct NEOPG_UNSTABLE_API VerificationKey {
+  std::vector<uint8_t> m_fingerprint;
+  std::vector<uint8_t> m_keyid;
+  PublicKeyAlgorithm m_algorithm{PublicKeyAlgorithm::Rsa};
+  std::shared_ptr<const Botan::Public_Key> m_key;
+};
+
+/// An in-memory set of public keys to verify signatures with.  A KeySet is
+/// not modified by verification, so it can be shared by any number of
+/// threads once it is filled.
+class NEOPG_UNSTABLE_API KeySet {
+ public:
+  /// Add the key \p key.
+  ///
+  /// \return false if the algorithm is not supported for signing or the key
+  /// material is invalid
+  bool add(const PublicKeyData& key);
+
+  /// Add the primary key of \p cert, and all subkeys that are bound to it
+  /// by a valid subkey binding signature (with a valid primary key binding
+  /// signature, if it has one).  Revocations and expiration are not
+  /// checked.
+  ///
+  /// \return the number of keys added
+  size_t add(const Certificate& cert);
+
+  /// \return the number of keys
+  size_t size() const noexcept { return m_keys.size(); }
+
+  /// \return all keys with the key ID \p keyid
+  std::vector<const VerificationKey*> find(
+      const std::vector<uint8_t>& keyid) const;
+
+  /// \return all keys, in the order they were added
+  std::vector<const VerificationKey*> keys() const;
+
+ private:
+  std::vector<std::unique_ptr<VerificationKey>> m_keys;
+  std::unordered_multimap<std::string, size_t> m_by_keyid;
+};
+
+/// The outcome of verifying one signature.
+enum class NEOPG_UNSTABLE_API VerifyStatus : uint8_t {
+  /// The signature was made by a key in the key set.
+  Good,
+  /// The signature does not match the data.
+  Bad,
+  /// No key in the key set can have made the signature.
+  NoKey,
+  /// The signature version, public key algorithm or hash algorithm is not
+  /// supported.
+  Unsupported,
+  /// The signature (or message) could not be parsed.
+  Malformed
+};
+
+/// The result of verifying one signature.
+struct NEOPG_UNSTABLE_API VerifyResult {
+  VerifyStatus m_status{VerifyStatus::Malformed};
+
+  /// The signature type, and the creation time (if known).
+  SignatureType m_type{SignatureType::Binary};
+  uint32_t m_created{0};
+
+  /// The issuer key ID from the signature, if any.
+  std::vector<uint8_t> m_keyid;
+
+  /// The fingerprint of the key that made a good signature.
+  std::vector<uint8_t> m_fingerprint;
+
+  /// A description of the problem, if the signature is not good.
+  std::string m_error;
+
+  bool good() const noexcept { return m_status == VerifyStatus::Good; }
+};
+
+/// Verify OpenPGP signatures against a KeySet.  This checks the
+/// cryptographic validity of document signatures (binary and text).
+/// Policy decisions (key validity, expiration, revocation, trust) are left
+/// to the caller.  Input is binary OpenPGP data, see ArmorDecoder for
+/// armored input.
+///
+/// A Verifier has no mutable state, so one instance can be used from
+/// several threads.
+class NEOPG_UNSTABLE_API Verifier {
+ public:
+  /// Use the keys in \p keys, which must outlive the verifier.
+  explicit Verifier(const KeySet& keys) : m_keys(keys) {}
+
+  /// Verify \p signature over the \p length bytes at \p data.
+  VerifyResult verify(const SignaturePacket& signature, const char* data,
+                      size_t length) const;
+
+  /// Verify the signature packets in \p signatures (a detached signature)
+  /// over \p data.
+  ///
+  /// \return one result for each signature packet, or one Malformed result
+  /// if \p signatures could not be parsed
+  std::vector<VerifyResult> verify_detached(const std::string& signatures,
+                                            const std::string& data) const;
+
+  /// Verify a signed message (one-pass signed or with leading signatures,
+  /// and possibly compressed).  If \p content is not nullptr, it receives
+  /// the content of the literal data packet.
+  ///
+  /// \return one result for each signature packet, or one Malformed result
+  /// if \p message could not be parsed or has no literal data packet
+  std::vector<VerifyResult> verify_inline(const std::string& message,
+                                          std::string* content = nullptr) const;
+
+ private:
+  const KeySet& m_keys;
+};
+
+/// A request for BatchVerifier.
+struct NEOPG_UNSTABLE_API VerifyRequest {
+  /// A detached signature, or the whole message if \p m_inline is set.
+  std::string m_signature;
+
+  /// The signed data of a detached signature.
+  std::string m_data;
+
+  /// True for a signed message, see Verifier::verify_inline().
+  bool m_inline{false};
+};
+
+/// Verify many messages on a pool of worker threads.  The workers are
+/// started once and wait between batches, so the pool can be kept for the
+/// lifetime of a service.
+class NEOPG_UNSTABLE_API BatchVerifier {
+ public:
+  /// Create a verifier for the keys in \p keys, which must outlive it.  If
+  /// \p threads is 0, use one thread per hardware thread.
+  BatchVerifier(const KeySet& keys, size_t threads = 0);
+
+  /// Stop the worker threads.
+  ~BatchVerifier();
+
+  BatchVerifier(const BatchVerifier&) = delete;
+  BatchVerifier& operator=(const BatchVerifier&) = delete;
+
+  /// Verify all \p requests.  Batches from several threads are processed
+  /// one after the other.
+  ///
+  /// \return the results of each request, in the order of \p requests
+  std::vector<std::vector<VerifyResult>> verify(
+      const std::vector<VerifyRequest>& requests);
+
+ private:
+  Verifier m_verifier;
+
+  // Only one batch at a time.
+  std::mutex m_batch_mutex;
+
+  // Protects all members below.
+  std::mutex m_mutex;
+  // Signalled if a batch starts or the pool is stopping.
+  std::condition_variable m_work;
+  // Signalled if the last request of a batch is done.
+  std::condition_variable m_done;
+
+  const std::vector<VerifyRequest>* m_requests{nullptr};
+  std::vector<std::vector<VerifyResult>>* m_results{nullptr};
+  size_t m_next{0};
+  size_t m_finished{0};
+  bool m_stop{false};
+  std::vector<std::thread> m_workers;
+
+  void worker();
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,120 @@
+// NeoPG signature verification (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/crypto/verifier.h>
+
+#include "gtest/gtest.h"
+
+using namespace NeoPG;
+
+namespace {
+// A V3 binary signature packet by key ID abcdefabcdefabcd, with the hash
+// algorithm HASH.
+std::string v3_signature(uint8_t hash) {
+  std::string packet{
+      "\xc2\x18"
+      "\x03"
+      "\x05\x00\x12\x34\x56\x78"
+      "\xab\xcd\xef\xab\xcd\xef\xab\xcd"
+      "\x01"
+      "\x02"
+      "\xde\xad"
+      "\x00\x11\x01\x42\x23",
+      26};
+  packet[18] = static_cast<char>(hash);
+  return packet;
+}
+}  // namespace
+
+TEST(NeopgTest, crypto_verifier_keyset_test) {
+  KeySet keys;
+  ASSERT_EQ(keys.size(), 0);
+  ASSERT_TRUE(keys.keys().empty());
+  ASSERT_TRUE(keys.find({0xab, 0xcd, 0xef, 0xab, 0xcd, 0xef, 0xab, 0xcd})
+                  .empty());
+}
+
+TEST(NeopgTest, crypto_verifier_detached_test) {
+  KeySet keys;
+  Verifier verifier{keys};
+
+  auto results = verifier.verify_detached(v3_signature(2), "data");
+  ASSERT_EQ(results.size(), 1);
+  ASSERT_EQ(results[0].m_status, VerifyStatus::NoKey);
+  ASSERT_EQ(results[0].m_created, 0x12345678);
+  ASSERT_EQ(results[0].m_keyid,
+            (std::vector<uint8_t>{0xab, 0xcd, 0xef, 0xab, 0xcd, 0xef, 0xab,
+                                  0xcd}));
+  ASSERT_FALSE(results[0].good());
+
+  // MD5 is not accepted.
+  results = verifier.verify_detached(v3_signature(1), "data");
+  ASSERT_EQ(results.size(), 1);
+  ASSERT_EQ(results[0].m_status, VerifyStatus::Unsupported);
+
+  // One result per signature packet.
+  results =
+      verifier.verify_detached(v3_signature(2) + v3_signature(1), "data");
+  ASSERT_EQ(results.size(), 2);
+  ASSERT_EQ(results[0].m_status, VerifyStatus::NoKey);
+  ASSERT_EQ(results[1].m_status, VerifyStatus::Unsupported);
+
+  results = verifier.verify_detached("", "data");
+  ASSERT_EQ(results.size(), 1);
+  ASSERT_EQ(results[0].m_status, VerifyStatus::Malformed);
+
+  results = verifier.verify_detached(std::string("\xc2\x03\x07\x00\x00", 5),
+                                     "data");
+  ASSERT_EQ(results.size(), 1);
+  ASSERT_EQ(results[0].m_status, VerifyStatus::Malformed);
+}
+
+TEST(NeopgTest, crypto_verifier_inline_test) {
+  KeySet keys;
+  Verifier verifier{keys};
+
+  // Signature without literal data.
+  auto results = verifier.verify_inline(v3_signature(2));
+  ASSERT_EQ(results.size(), 1);
+  ASSERT_EQ(results[0].m_status, VerifyStatus::Malformed);
+
+  // Literal data (binary, file name "f", date 0) with a leading signature.
+  std::string content;
+  results = verifier.verify_inline(
+      v3_signature(2) + std::string("\xcb\x0b"
+                                    "b\x01"
+                                    "f\x00\x00\x00\x00"
+                                    "data",
+                                    13),
+      &content);
+  ASSERT_EQ(results.size(), 1);
+  ASSERT_EQ(results[0].m_status, VerifyStatus::NoKey);
+  ASSERT_EQ(content, "data");
+}
+
+TEST(NeopgTest, crypto_verifier_batch_test) {
+  KeySet keys;
+  BatchVerifier batch{keys, 3};
+
+  std::vector<VerifyRequest> requests;
+  for (int i = 0; i < 20; i++) {
+    VerifyRequest request;
+    request.m_signature = (i % 2) ? v3_signature(1) : v3_signature(2);
+    request.m_data = "data";
+    requests.push_back(request);
+  }
+
+  // The pool can be used for several batches.
+  for (int round = 0; round < 2; round++) {
+    auto results = batch.verify(requests);
+    ASSERT_EQ(results.size(), requests.size());
+    for (size_t i = 0; i < results.size(); i++) {
+      ASSERT_EQ(results[i].size(), 1);
+      ASSERT_EQ(results[i][0].m_status,
+                (i % 2) ? VerifyStatus::Unsupported : VerifyStatus::NoKey);
+    }
+  }
+  ASSERT_TRUE(batch.verify({}).empty());
+}
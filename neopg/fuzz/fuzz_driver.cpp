@@ -0,0 +1,116 @@
+// NeoPG fuzz driver
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+// Run a fuzz target over a corpus without libFuzzer, for AFL and for the
+// performance regression check.  Usage:
+//
+//   neopg-fuzz-TARGET [--slow-unit-ms N] [FILE|DIRECTORY...]
+//
+// Without arguments, one input is read from stdin (as AFL expects).  At the
+// end, the number of executions per second and the peak resident set size
+// are reported.  Inputs that take longer than N milliseconds (default 100)
+// are reported as slow units, and make the driver fail.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+namespace {
+
+void collect(const std::string& path, std::vector<std::string>& files) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    std::cerr << path << ": not found\n";
+    std::exit(2);
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    files.push_back(path);
+    return;
+  }
+  DIR* dir = opendir(path.c_str());
+  if (!dir) return;
+  while (struct dirent* entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name.empty() || name[0] == '.') continue;
+    collect(path + "/" + name, files);
+  }
+  closedir(dir);
+}
+
+std::string read_all(std::istream& in) {
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+long peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  using clock = std::chrono::steady_clock;
+  double slow_unit_ms = 100;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--slow-unit-ms" && i + 1 < argc)
+      slow_unit_ms = std::atof(argv[++i]);
+    else
+      collect(arg, files);
+  }
+
+  if (argc == 1) {
+    std::string data = read_all(std::cin);
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(data.data()),
+                           data.size());
+    return 0;
+  }
+
+  size_t slow_units = 0;
+  double total = 0;
+  for (const auto& file : files) {
+    std::ifstream in{file, std::ios::binary};
+    std::string data = read_all(in);
+
+    auto start = clock::now();
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(data.data()),
+                           data.size());
+    double elapsed =
+        std::chrono::duration<double, std::milli>(clock::now() - start)
+            .count();
+    total += elapsed;
+    if (elapsed > slow_unit_ms) {
+      std::cerr << "slow unit: " << file << " (" << elapsed << " ms)\n";
+      slow_units++;
+    }
+  }
+
+  std::cerr << "stat::number_of_executed_units: " << files.size() << "\n"
+            << "stat::average_exec_per_sec: "
+            << (total > 0 ? files.size() * 1000 / total : 0) << "\n"
+            << "stat::peak_rss_mb: " << peak_rss_kb() / 1024 << "\n"
+            << "stat::slow_units: " << slow_units << "\n";
+  return slow_units ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+// NeoPG fuzz targets for the packet decoders
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+// Decode the input as the body of one packet, and write it out again.  This
+// file is compiled once for every packet class, which is selected with
+// -DNEOPG_FUZZ_PACKET=<class name>.
+
+#include <neopg/openpgp/marker_packet.h>
+#include <neopg/openpgp/modification_detection_code_packet.h>
+#include <neopg/openpgp/public_key_packet.h>
+#include <neopg/openpgp/public_subkey_packet.h>
+#include <neopg/openpgp/signature_packet.h>
+#include <neopg/openpgp/trust_packet.h>
+#include <neopg/openpgp/user_attribute_packet.h>
+#include <neopg/openpgp/user_id_packet.h>
+
+#include <neopg/parser/parser_error.h>
+#include <neopg/parser/parser_input.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+
+#ifndef NEOPG_FUZZ_PACKET
+#error "NEOPG_FUZZ_PACKET must be set to a packet class"
+#endif
+
+using namespace NeoPG;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  try {
+    ParserInput in{reinterpret_cast<const char*>(data), size};
+    auto packet = NEOPG_FUZZ_PACKET::create_or_throw(in);
+    std::stringstream out;
+    packet->write(out);
+  } catch (ParserError&) {
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+// NeoPG fuzz target for the packet parser
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+// Frame the input with RawPacketParser::process(const std::string&) and
+// decode every packet, like neopg packet dump does.
+
+#include <neopg/openpgp/packet.h>
+#include <neopg/parser/openpgp.h>
+#include <neopg/parser/parser_input.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+using namespace NeoPG;
+
+namespace {
+
+class DecodeSink : public RawPacketRefSink {
+ public:
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override {
+    decode(header.type(), data, length);
+  }
+  void start_packet(const PacketHeader& header) override {
+    m_type = header.type();
+    m_data.clear();
+  }
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override {
+    m_data.append(data, length);
+  }
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override {
+    m_data.append(data, length);
+    decode(m_type, m_data.data(), m_data.size());
+  }
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override {}
+
+ private:
+  PacketType m_type{PacketType::Reserved};
+  std::string m_data;
+
+  void decode(PacketType type, const char* data, size_t length) {
+    try {
+      ParserInput in{data, length};
+      auto packet = Packet::create_or_throw(type, in);
+      std::stringstream out;
+      packet->write(out);
+    } catch (ParserError&) {
+    }
+  }
+};
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  DecodeSink sink;
+  RawPacketParser parser{sink};
+  try {
+    parser.process(std::string(reinterpret_cast<const char*>(data), size));
+  } catch (ParserError&) {
+  }
+  return 0;
+}
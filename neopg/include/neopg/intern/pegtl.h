@@ -39,7 +39,7 @@ class ParserInput::Mark::Impl {
                           pegtl::rewind_mode::REQUIRED>
       m_mark;
   Impl(ParserInput& in)
-      : m_mark{in.m_impl->m_input.mark<pegtl::rewind_mode::REQUIRED>()} {}
+      : m_mark{in.impl().m_input.mark<pegtl::rewind_mode::REQUIRED>()} {}
 };
 
 template <typename Input>
@@ -49,6 +49,41 @@ ParserError parser_error(const std::string& msg, const Input& in) {
   return ParserError(msg, pos);
 }
 
+/// Raise a parser error at the position of \p in.  If a ParserErrorTrap is
+/// active, the error is recorded there and the function returns, otherwise it
+/// is thrown.  All control classes of the object model raise errors this way.
+template <typename Input>
+void raise_parser_error(const std::string& msg, const Input& in) {
+  ParserErrorTrap* trap = ParserErrorTrap::current();
+  if (!trap) throw parser_error(msg, in);
+  trap->record(parser_error(msg, in));
+}
+
+/// Like pegtl::must, but fails to match if Control<Rule>::raise returns,
+/// which it does with raise_parser_error while a ParserErrorTrap is active.
+/// Because the grammars of the object model live in nested namespaces of
+/// NeoPG, an unqualified must<> in them refers to this rule.
+template <typename Rule>
+struct must_one {
+  using analyze_t = typename Rule::analyze_t;
+
+  template <pegtl::apply_mode A, pegtl::rewind_mode M,
+            template <typename...> class Action,
+            template <typename...> class Control, typename Input,
+            typename... States>
+  static bool match(Input& in, States&&... st) {
+    if (!Control<Rule>::template match<A, pegtl::rewind_mode::DONTCARE,
+                                       Action, Control>(in, st...)) {
+      Control<Rule>::raise(static_cast<const Input&>(in), st...);
+      return false;
+    }
+    return true;
+  }
+};
+
+template <typename... Rules>
+struct must : pegtl::seq<must_one<Rules>...> {};
+
 }  // namespace NeoPG
 
 namespace tao {
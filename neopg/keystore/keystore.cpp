@@ -0,0 +1,436 @@
+// NeoPG keystore (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/keystore/keystore.h>
+
+#include <neopg/openpgp/public_key_packet.h>
+#include <neopg/openpgp/public_subkey_packet.h>
+#include <neopg/openpgp/user_id_packet.h>
+#include <neopg/parser/openpgp.h>
+#include <neopg/utils/byte_writer.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+using namespace NeoPG;
+
+const size_t Keystore::MAX_SEGMENTS;
+const size_t Keystore::BULK_BATCH_SIZE;
+
+namespace {
+
+// The files in the keystore directory.
+const char MANIFEST_FILE[] = "MANIFEST";
+const char LOG_FILE[] = "certs.log";
+const char LOCK_FILE[] = "LOCK";
+
+const char MANIFEST_MAGIC[] = "neopg-keystore 1";
+
+// How often a reader retries if the writer replaces the index while the
+// snapshot is opened.
+const int OPEN_RETRIES = 5;
+
+std::string path(const std::string& directory, const std::string& name) {
+  return directory + "/" + name;
+}
+
+std::string segment_name(uint64_t generation) {
+  return "index-" + std::to_string(generation) + ".seg";
+}
+
+// Decode the first certificate in \p length bytes at \p data.
+class FirstCertificateSink : public CertificateSink {
+ public:
+  std::unique_ptr<Certificate> m_cert;
+
+  void next_certificate(std::unique_ptr<Certificate> cert) override {
+    if (!m_cert) m_cert = std::move(cert);
+  }
+};
+
+// Insert certificates into a keystore, committing every batch.
+class InsertCertificateSink : public CertificateSink {
+ public:
+  InsertCertificateSink(Keystore& keystore, size_t batch_size)
+      : m_keystore(keystore), m_batch_size(batch_size) {}
+
+  size_t m_inserted{0};
+
+  void next_certificate(std::unique_ptr<Certificate> cert) override {
+    if (!m_keystore.insert(*cert)) return;
+    m_inserted++;
+    if (m_batch_size && m_keystore.pending() >= m_batch_size)
+      m_keystore.commit();
+  }
+
+ private:
+  Keystore& m_keystore;
+  size_t m_batch_size;
+};
+
+}  // namespace
+
+KeystoreManifest KeystoreManifest::read_or_throw(
+    const std::string& directory) {
+  KeystoreManifest manifest;
+  std::ifstream in(path(directory, MANIFEST_FILE));
+  if (!in) return manifest;
+
+  std::string line;
+  if (!std::getline(in, line) || line != MANIFEST_MAGIC)
+    throw std::runtime_error("keystore: invalid manifest in " + directory);
+  if (!(in >> manifest.m_generation >> manifest.m_log_length))
+    throw std::runtime_error("keystore: invalid manifest in " + directory);
+  std::string name;
+  while (in >> name) manifest.m_segments.push_back(name);
+  return manifest;
+}
+
+void KeystoreManifest::write_or_throw(const std::string& directory) const {
+  // Readers see either the old or the new manifest.
+  const std::string name = path(directory, MANIFEST_FILE);
+  const std::string temp = name + ".tmp";
+  {
+    std::ofstream out(temp, std::ios::trunc);
+    out << MANIFEST_MAGIC << "\n"
+        << m_generation << "\n"
+        << m_log_length << "\n";
+    for (const auto& segment : m_segments) out << segment << "\n";
+    out.close();
+    if (!out) throw std::runtime_error("keystore: Failure writing " + temp);
+  }
+#ifdef _WIN32
+  // rename does not replace existing files on Windows.
+  std::remove(name.c_str());
+#endif
+  if (std::rename(temp.c_str(), name.c_str()) != 0)
+    throw std::runtime_error("keystore: Failure writing " + name);
+}
+
+std::shared_ptr<const KeystoreSnapshot> KeystoreSnapshot::open_or_throw(
+    const std::string& directory) {
+  for (int retry = 0;; retry++) {
+    auto manifest = KeystoreManifest::read_or_throw(directory);
+    try {
+      return std::shared_ptr<const KeystoreSnapshot>(
+          new KeystoreSnapshot(directory, manifest));
+    } catch (const std::runtime_error&) {
+      // A compaction may have removed a segment of this manifest.
+      if (retry == OPEN_RETRIES ||
+          KeystoreManifest::read_or_throw(directory).m_generation ==
+              manifest.m_generation)
+        throw;
+    }
+  }
+}
+
+KeystoreSnapshot::KeystoreSnapshot(const std::string& directory,
+                                   const KeystoreManifest& manifest)
+    : m_manifest(manifest) {
+  for (const auto& name : manifest.m_segments)
+    m_segments.emplace_back(
+        KeystoreIndexSegment::open_or_throw(path(directory, name)));
+  if (manifest.m_log_length > 0)
+    m_log = MappedFile::open_or_throw(path(directory, LOG_FILE),
+                                      manifest.m_log_length);
+}
+
+std::vector<KeystoreRecord> KeystoreSnapshot::find_records(
+    const KeystoreIndexKey& key) const {
+  std::vector<KeystoreRecord> records;
+  for (const auto& segment : m_segments) segment->find(key, records);
+  std::sort(records.begin(), records.end(),
+            [](const KeystoreRecord& a, const KeystoreRecord& b) {
+              return a.m_offset > b.m_offset;
+            });
+  records.erase(std::unique(records.begin(), records.end(),
+                            [](const KeystoreRecord& a,
+                               const KeystoreRecord& b) {
+                              return a.m_offset == b.m_offset;
+                            }),
+                records.end());
+  return records;
+}
+
+const char* KeystoreSnapshot::data(const KeystoreRecord& record) const {
+  if (!m_log || record.m_offset > m_log->size() ||
+      record.m_length > m_log->size() - record.m_offset)
+    throw std::out_of_range("keystore: record outside of log");
+  return m_log->data() + record.m_offset;
+}
+
+std::unique_ptr<Certificate> KeystoreSnapshot::certificate(
+    const KeystoreRecord& record) const {
+  const char* packets = data(record);
+  FirstCertificateSink certs;
+  KeyblockSink sink{certs};
+  RawPacketParser parser{sink};
+  try {
+    parser.process(packets, record.m_length, LOG_FILE);
+  } catch (const ParserError&) {
+    // The log was written by us, so this only happens if it was damaged.
+    return nullptr;
+  }
+  sink.finish();
+  return std::move(certs.m_cert);
+}
+
+std::vector<std::unique_ptr<Certificate>> KeystoreSnapshot::find(
+    const KeystoreIndexKey& key) const {
+  std::vector<std::unique_ptr<Certificate>> result;
+  for (const auto& record : find_records(key)) {
+    auto cert = certificate(record);
+    if (!cert) continue;
+    auto keys = Keystore::keys(*cert);
+    if (std::find(keys.begin(), keys.end(), key) == keys.end()) continue;
+    // Skip replaced versions.  keys() starts with the fingerprint.
+    auto versions = find_records(keys[0]);
+    if (versions.empty() || versions[0].m_offset != record.m_offset)
+      continue;
+    result.emplace_back(std::move(cert));
+  }
+  return result;
+}
+
+std::vector<std::unique_ptr<Certificate>> KeystoreSnapshot::find(
+    KeystoreKeyType type, const std::vector<uint8_t>& value) const {
+  if (type == KeystoreKeyType::Email)
+    return find_email(std::string(value.begin(), value.end()));
+  return find(KeystoreIndexKey::create(type, value));
+}
+
+std::vector<std::unique_ptr<Certificate>> KeystoreSnapshot::find_email(
+    const std::string& email) const {
+  std::string normalized = Keystore::normalize_email(email);
+  if (normalized.empty()) return {};
+  return find(KeystoreIndexKey::create(KeystoreKeyType::Email, normalized));
+}
+
+std::unique_ptr<Certificate> KeystoreSnapshot::find_fingerprint(
+    const std::vector<uint8_t>& fingerprint) const {
+  auto certs = find(KeystoreKeyType::Fingerprint, fingerprint);
+  if (certs.empty()) return nullptr;
+  return std::move(certs[0]);
+}
+
+Keystore::Keystore(const std::string& directory) : m_directory(directory) {}
+
+Keystore::~Keystore() {
+#ifndef _WIN32
+  // Closing the file releases the lock.
+  if (m_lock >= 0) ::close(m_lock);
+#endif
+}
+
+std::unique_ptr<Keystore> Keystore::open_or_throw(
+    const std::string& directory) {
+  std::unique_ptr<Keystore> keystore{new Keystore(directory)};
+
+#ifndef _WIN32
+  const std::string lock = path(directory, LOCK_FILE);
+  keystore->m_lock = ::open(lock.c_str(), O_RDWR | O_CREAT, 0644);
+  if (keystore->m_lock < 0)
+    throw std::runtime_error("keystore: Failure opening file " + lock);
+  if (::flock(keystore->m_lock, LOCK_EX | LOCK_NB) != 0)
+    throw std::runtime_error("keystore: locked by another writer " +
+                             directory);
+#endif
+
+  keystore->m_manifest = KeystoreManifest::read_or_throw(directory);
+
+  // Data after the committed length is left over from an interrupted
+  // writer, and is overwritten.
+  const std::string log = path(directory, LOG_FILE);
+  std::ofstream(log, std::ios::binary | std::ios::app);
+  keystore->m_log.open(log, std::ios::binary | std::ios::in | std::ios::out);
+  keystore->m_log.seekg(0, std::ios::end);
+  if (!keystore->m_log ||
+      static_cast<uint64_t>(keystore->m_log.tellg()) <
+          keystore->m_manifest.m_log_length)
+    throw std::runtime_error("keystore: log truncated " + log);
+  keystore->m_log_length = keystore->m_manifest.m_log_length;
+  keystore->m_log.seekp(keystore->m_log_length);
+
+  keystore->publish(keystore->m_manifest);
+  return keystore;
+}
+
+bool Keystore::insert(const Certificate& cert) {
+  auto keys = Keystore::keys(cert);
+  if (keys.empty()) return false;
+
+  std::string packets;
+  {
+    ByteWriter out{packets};
+    for (const auto& packet : cert.m_packets) packet->write(out);
+  }
+  if (packets.size() > UINT32_MAX)
+    throw std::runtime_error("keystore: certificate too large");
+
+  m_log.write(packets.data(), packets.size());
+  if (!m_log) throw std::runtime_error("keystore: Failure writing log");
+
+  KeystoreRecord record;
+  record.m_offset = m_log_length;
+  record.m_length = packets.size();
+  for (const auto& key : keys) m_pending.push_back({key, record});
+  m_log_length += packets.size();
+  m_pending_certs++;
+  return true;
+}
+
+void Keystore::commit() {
+  if (m_pending_certs == 0) return;
+
+  m_log.flush();
+  if (!m_log) throw std::runtime_error("keystore: Failure writing log");
+
+  KeystoreManifest manifest = m_manifest;
+  manifest.m_generation++;
+  manifest.m_log_length = m_log_length;
+  std::sort(m_pending.begin(), m_pending.end());
+  const std::string name = segment_name(manifest.m_generation);
+  KeystoreIndexSegment::write_or_throw(path(m_directory, name), m_pending);
+  manifest.m_segments.push_back(name);
+  manifest.write_or_throw(m_directory);
+
+  m_manifest = manifest;
+  m_pending.clear();
+  m_pending_certs = 0;
+  publish(m_manifest);
+
+  if (m_manifest.m_segments.size() > MAX_SEGMENTS) compact();
+}
+
+void Keystore::compact() {
+  commit();
+  if (m_manifest.m_segments.size() <= 1) return;
+
+  // The current snapshot has all segments open.
+  auto current = snapshot();
+  std::vector<const KeystoreIndexSegment*> segments;
+  for (const auto& segment : current->m_segments)
+    segments.push_back(segment.get());
+
+  KeystoreManifest manifest = m_manifest;
+  manifest.m_generation++;
+  const std::string name = segment_name(manifest.m_generation);
+  KeystoreIndexSegment::merge_or_throw(path(m_directory, name), segments);
+  manifest.m_segments = {name};
+  manifest.write_or_throw(m_directory);
+
+  // Open snapshots keep the old segments mapped.  Where the platform does
+  // not allow to remove them, they are left behind.
+  for (const auto& old : m_manifest.m_segments)
+    std::remove(path(m_directory, old).c_str());
+  m_manifest = manifest;
+  publish(m_manifest);
+}
+
+template <typename Process>
+size_t Keystore::bulk_load(size_t batch_size, Process process) {
+  InsertCertificateSink certs{*this, batch_size};
+  KeyblockSink sink{certs};
+  RawPacketParser parser{sink};
+  process(parser);
+  sink.finish();
+  compact();
+  return certs.m_inserted;
+}
+
+size_t Keystore::bulk_load(std::istream& in, size_t batch_size) {
+  return bulk_load(batch_size,
+                   [&in](RawPacketParser& parser) { parser.process(in); });
+}
+
+size_t Keystore::bulk_load_file(const std::string& path, size_t batch_size) {
+  return bulk_load(batch_size, [&path](RawPacketParser& parser) {
+    parser.process_mapped(path);
+  });
+}
+
+std::shared_ptr<const KeystoreSnapshot> Keystore::snapshot() const {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  return m_snapshot;
+}
+
+void Keystore::publish(const KeystoreManifest& manifest) {
+  std::shared_ptr<const KeystoreSnapshot> snapshot{
+      new KeystoreSnapshot(m_directory, manifest)};
+  std::lock_guard<std::mutex> lock{m_mutex};
+  m_snapshot = std::move(snapshot);
+}
+
+std::string Keystore::normalize_email(const std::string& user_id) {
+  std::string addr = user_id;
+  size_t open = user_id.rfind('<');
+  if (open != std::string::npos) {
+    size_t close = user_id.find('>', open);
+    if (close == std::string::npos) return "";
+    addr = user_id.substr(open + 1, close - open - 1);
+  }
+
+  size_t start = addr.find_first_not_of(" \t");
+  if (start == std::string::npos) return "";
+  addr = addr.substr(start, addr.find_last_not_of(" \t") - start + 1);
+
+  size_t at = addr.find('@');
+  if (at == 0 || at == std::string::npos || at + 1 == addr.size() ||
+      addr.find('@', at + 1) != std::string::npos)
+    return "";
+  for (auto& c : addr) {
+    if (std::isspace(static_cast<unsigned char>(c)) || c == '<' || c == '>')
+      return "";
+    if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+  }
+  return addr;
+}
+
+std::vector<KeystoreIndexKey> Keystore::keys(const Certificate& cert) {
+  std::vector<KeystoreIndexKey> keys;
+  if (cert.m_packets.empty()) return keys;
+  auto primary =
+      dynamic_cast<const PublicKeyPacket*>(&cert.packet(cert.m_primary));
+  if (!primary || !primary->m_public_key) return keys;
+
+  // The fingerprint comes first.
+  keys.push_back(KeystoreIndexKey::create(
+      KeystoreKeyType::Fingerprint, primary->m_public_key->fingerprint()));
+  keys.push_back(KeystoreIndexKey::create(KeystoreKeyType::KeyId,
+                                          primary->m_public_key->keyid()));
+
+  for (const auto& component : cert.m_subkeys) {
+    auto subkey =
+        dynamic_cast<const PublicSubkeyPacket*>(&cert.packet(component));
+    if (!subkey || !subkey->m_public_key) continue;
+    keys.push_back(KeystoreIndexKey::create(
+        KeystoreKeyType::SubkeyFingerprint,
+        subkey->m_public_key->fingerprint()));
+    keys.push_back(KeystoreIndexKey::create(KeystoreKeyType::KeyId,
+                                            subkey->m_public_key->keyid()));
+  }
+
+  for (const auto& component : cert.m_users) {
+    auto uid = dynamic_cast<const UserIdPacket*>(&cert.packet(component));
+    if (!uid) continue;
+    std::string email = normalize_email(uid->m_content);
+    if (!email.empty())
+      keys.push_back(KeystoreIndexKey::create(KeystoreKeyType::Email, email));
+  }
+
+  // Keep the fingerprint in front.
+  std::sort(keys.begin() + 1, keys.end());
+  keys.erase(std::unique(keys.begin() + 1, keys.end()), keys.end());
+  return keys;
+}
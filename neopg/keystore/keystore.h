@@ -0,0 +1,218 @@
+// NeoPG keystore
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains an append-only store for certificates.
+
+#pragma once
+
+#include <neopg/keystore/keystore_index.h>
+#include <neopg/openpgp/keyblock_sink.h>
+#include <neopg/utils/mapped_file.h>
+
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace NeoPG {
+
+/// The committed state of a keystore: the length of the log that is valid,
+/// and the index files that cover it.  The manifest is replaced atomically on
+/// every commit, and each version has a new generation number.
+struct NEOPG_UNSTABLE_API KeystoreManifest {
+  uint64_t m_generation{0};
+  uint64_t m_log_length{0};
+
+  /// The file names of the index segments, oldest first.
+  std::vector<std::string> m_segments;
+
+  /// Read the manifest in \p directory.  A missing manifest is an empty
+  /// keystore.
+  ///
+  /// \throws std::runtime_error if the manifest is invalid
+  static KeystoreManifest read_or_throw(const std::string& directory);
+
+  /// Replace the manifest in \p directory.
+  ///
+  /// \throws std::runtime_error
+  void write_or_throw(const std::string& directory) const;
+};
+
+/// A read-only view of a keystore at one generation.  A snapshot maps the
+/// index segments and the committed part of the log, which are never
+/// modified, so it stays consistent (and can be used from several threads)
+/// while a writer appends and commits new certificates.
+class NEOPG_UNSTABLE_API KeystoreSnapshot {
+ public:
+  /// Open the current generation of the keystore in \p directory, which may
+  /// concurrently be written to by another process.
+  ///
+  /// \throws std::runtime_error
+  static std::shared_ptr<const KeystoreSnapshot> open_or_throw(
+      const std::string& directory);
+
+  /// \return the generation of this snapshot
+  uint64_t generation() const noexcept { return m_manifest.m_generation; }
+
+  /// \return the number of index segments of this snapshot
+  size_t segments() const noexcept { return m_segments.size(); }
+
+  /// \return the locations of the certificates that have the lookup key \p
+  /// key, newest first.  This includes certificates that were replaced by a
+  /// newer version, and may include certificates that have a different
+  /// value with the same key, see KeystoreIndexKey.
+  std::vector<KeystoreRecord> find_records(const KeystoreIndexKey& key) const;
+
+  /// \return the packets of the certificate at \p record, which are valid as
+  /// long as the snapshot
+  ///
+  /// \throws std::out_of_range if \p record is not in the committed log
+  const char* data(const KeystoreRecord& record) const;
+
+  /// Decode the certificate at \p record.
+  ///
+  /// \return the certificate, or nullptr if it has no primary key
+  ///
+  /// \throws std::out_of_range if \p record is not in the committed log
+  std::unique_ptr<Certificate> certificate(const KeystoreRecord& record) const;
+
+  /// \return the current versions of all certificates that have the lookup
+  /// key \p type with value \p value
+  std::vector<std::unique_ptr<Certificate>> find(
+      KeystoreKeyType type, const std::vector<uint8_t>& value) const;
+
+  /// \return the current versions of all certificates with a user ID for the
+  /// email address \p email, see Keystore::normalize_email()
+  std::vector<std::unique_ptr<Certificate>> find_email(
+      const std::string& email) const;
+
+  /// \return the current version of the certificate with the primary key
+  /// fingerprint \p fingerprint, or nullptr
+  std::unique_ptr<Certificate> find_fingerprint(
+      const std::vector<uint8_t>& fingerprint) const;
+
+ private:
+  friend class Keystore;
+
+  KeystoreSnapshot(const std::string& directory,
+                   const KeystoreManifest& manifest);
+
+  KeystoreManifest m_manifest;
+  std::unique_ptr<MappedFile> m_log;
+  std::vector<std::unique_ptr<KeystoreIndexSegment>> m_segments;
+
+  std::vector<std::unique_ptr<Certificate>> find(
+      const KeystoreIndexKey& key) const;
+};
+
+/// An append-only store for certificates (transferable public keys).
+///
+/// A keystore is a directory with a log file, which contains the
+/// certificates as OpenPGP packets in the order they were inserted, a number
+/// of immutable index files (see KeystoreIndexSegment), and a manifest that
+/// lists the valid part of the log and the index files.  Certificates are
+/// looked up by the fingerprint and key ID of the primary key, the
+/// fingerprints and key IDs of the subkeys, and the email addresses of the
+/// user IDs.  Inserting a certificate with the same primary key again
+/// replaces the earlier version, which stays in the log.
+///
+/// There is one writer at a time, a Keystore, which holds a lock on the
+/// directory.  Readers use a KeystoreSnapshot, and never block the writer.
+/// Inserted certificates become visible to new snapshots with commit(),
+/// which writes the pending index entries to a new index file.  When there
+/// are more than MAX_SEGMENTS index files, they are merged into one.
+class NEOPG_UNSTABLE_API Keystore {
+ public:
+  /// The number of index segments above which commit() compacts the index.
+  static const size_t MAX_SEGMENTS = 8;
+
+  /// The number of certificates per commit in bulk_load().
+  static const size_t BULK_BATCH_SIZE = 100000;
+
+  /// Open (or create) the keystore in \p directory for writing.  The
+  /// directory must exist.
+  ///
+  /// \throws std::runtime_error if the keystore is invalid or locked by
+  /// another writer
+  static std::unique_ptr<Keystore> open_or_throw(const std::string& directory);
+
+  Keystore(const Keystore&) = delete;
+  Keystore& operator=(const Keystore&) = delete;
+  ~Keystore();
+
+  /// Append \p cert to the log.  It is visible after the next commit().
+  ///
+  /// \return false (and store nothing) if \p cert has no decoded primary key
+  ///
+  /// \throws std::runtime_error
+  bool insert(const Certificate& cert);
+
+  /// \return the number of certificates inserted since the last commit
+  size_t pending() const noexcept { return m_pending_certs; }
+
+  /// Make the certificates inserted so far visible to new snapshots.
+  ///
+  /// \throws std::runtime_error
+  void commit();
+
+  /// Commit, and merge all index segments into one.
+  ///
+  /// \throws std::runtime_error
+  void compact();
+
+  /// Insert all certificates in the OpenPGP packet stream \p in (such as a
+  /// keyserver dump), committing every \p batch_size certificates, and
+  /// compact the index at the end.
+  ///
+  /// \return the number of inserted certificates
+  ///
+  /// \throws std::runtime_error
+  size_t bulk_load(std::istream& in, size_t batch_size = BULK_BATCH_SIZE);
+
+  /// Like bulk_load(std::istream&, size_t), but map the file at \p path into
+  /// memory.
+  size_t bulk_load_file(const std::string& path,
+                        size_t batch_size = BULK_BATCH_SIZE);
+
+  /// \return a snapshot of the last commit
+  std::shared_ptr<const KeystoreSnapshot> snapshot() const;
+
+  /// \return the lowercase addr-spec of the user ID \p user_id (either the
+  /// part in angle brackets, or the whole user ID), or an empty string if it
+  /// does not look like an email address
+  static std::string normalize_email(const std::string& user_id);
+
+  /// \return the lookup keys of \p cert, or none if it has no decoded
+  /// primary key
+  static std::vector<KeystoreIndexKey> keys(const Certificate& cert);
+
+ private:
+  Keystore(const std::string& directory);
+
+  std::string m_directory;
+  KeystoreManifest m_manifest;
+
+  std::fstream m_log;
+  uint64_t m_log_length{0};
+
+  std::vector<KeystoreIndexEntry> m_pending;
+  size_t m_pending_certs{0};
+
+  // The lock file descriptor (where supported).
+  int m_lock{-1};
+
+  mutable std::mutex m_mutex;
+  std::shared_ptr<const KeystoreSnapshot> m_snapshot;
+
+  template <typename Process>
+  size_t bulk_load(size_t batch_size, Process process);
+  void publish(const KeystoreManifest& manifest);
+};
+
+}  // namespace NeoPG
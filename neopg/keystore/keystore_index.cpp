@@ -0,0 +1,172 @@
+// NeoPG keystore index (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/keystore/keystore_index.h>
+
+#include <neopg/utils/byte_writer.h>
+
+#include <botan/hash.h>
+#include <botan/loadstor.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+
+using namespace NeoPG;
+
+const size_t KeystoreIndexKey::SIZE;
+const size_t KeystoreIndexSegment::ENTRY_SIZE;
+
+namespace {
+
+// Index file format, all integers are big endian:
+//   magic (8 octets), number of entries (8 octets), then for each entry:
+//   key (24 octets), log offset (8), record length (4), reserved (4).
+const char MAGIC[] = "NPGKSX\x00\x01";
+const size_t MAGIC_LENGTH = sizeof(MAGIC) - 1;
+const size_t HEADER_LENGTH = MAGIC_LENGTH + 8;
+
+void write_entry(ByteWriter& out, const KeystoreIndexEntry& entry) {
+  out.put_bytes(entry.m_key.m_bytes, KeystoreIndexKey::SIZE);
+  out.put_u32be(entry.m_record.m_offset >> 32);
+  out.put_u32be(entry.m_record.m_offset);
+  out.put_u32be(entry.m_record.m_length);
+  out.put_u32be(0);
+}
+
+void write_header(ByteWriter& out, uint64_t count) {
+  out.put_bytes(MAGIC, MAGIC_LENGTH);
+  out.put_u32be(count >> 32);
+  out.put_u32be(count);
+}
+
+void check(const std::ofstream& out, const std::string& path) {
+  if (!out) throw std::runtime_error("keystore: Failure writing " + path);
+}
+
+}  // namespace
+
+KeystoreIndexKey KeystoreIndexKey::create(KeystoreKeyType type,
+                                          const std::vector<uint8_t>& value) {
+  KeystoreIndexKey key;
+  std::memset(key.m_bytes, 0, SIZE);
+  key.m_bytes[0] = static_cast<uint8_t>(type);
+  std::copy_n(value.begin(), std::min(value.size(), SIZE - 1),
+              key.m_bytes + 1);
+  return key;
+}
+
+KeystoreIndexKey KeystoreIndexKey::create(KeystoreKeyType type,
+                                          const std::string& value) {
+  auto hash = Botan::HashFunction::create_or_throw("SHA-256");
+  hash->update(value);
+  auto digest = hash->final();
+  return create(type, std::vector<uint8_t>(digest.begin(), digest.end()));
+}
+
+std::unique_ptr<KeystoreIndexSegment> KeystoreIndexSegment::open_or_throw(
+    const std::string& path) {
+  std::unique_ptr<KeystoreIndexSegment> segment{new KeystoreIndexSegment};
+  segment->m_file = MappedFile::open_or_throw(path);
+  const char* data = segment->m_file->data();
+  size_t size = segment->m_file->size();
+
+  if (size < HEADER_LENGTH || std::memcmp(data, MAGIC, MAGIC_LENGTH) != 0)
+    throw std::runtime_error("keystore: invalid index file " + path);
+  uint64_t count = Botan::load_be<uint64_t>(
+      reinterpret_cast<const uint8_t*>(data + MAGIC_LENGTH), 0);
+  if (count != (size - HEADER_LENGTH) / ENTRY_SIZE ||
+      (size - HEADER_LENGTH) % ENTRY_SIZE != 0)
+    throw std::runtime_error("keystore: index file truncated " + path);
+
+  segment->m_entries = data + HEADER_LENGTH;
+  segment->m_size = count;
+  return segment;
+}
+
+void KeystoreIndexSegment::write_or_throw(
+    const std::string& path, const std::vector<KeystoreIndexEntry>& entries) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  check(file, path);
+  {
+    ByteWriter out{file};
+    write_header(out, entries.size());
+    for (const auto& entry : entries) write_entry(out, entry);
+  }
+  file.close();
+  check(file, path);
+}
+
+void KeystoreIndexSegment::merge_or_throw(
+    const std::string& path,
+    const std::vector<const KeystoreIndexSegment*>& segments) {
+  // The next entry of each segment, smallest first.
+  struct Cursor {
+    KeystoreIndexEntry m_entry;
+    size_t m_segment;
+    size_t m_pos;
+    bool operator>(const Cursor& other) const noexcept {
+      return other.m_entry < m_entry;
+    }
+  };
+  std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heap;
+  uint64_t count = 0;
+  for (size_t idx = 0; idx < segments.size(); idx++) {
+    count += segments[idx]->size();
+    if (segments[idx]->size() > 0)
+      heap.push(Cursor{segments[idx]->entry(0), idx, 0});
+  }
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  check(file, path);
+  {
+    ByteWriter out{file};
+    write_header(out, count);
+    while (!heap.empty()) {
+      Cursor cursor = heap.top();
+      heap.pop();
+      write_entry(out, cursor.m_entry);
+      const KeystoreIndexSegment* segment = segments[cursor.m_segment];
+      if (++cursor.m_pos < segment->size()) {
+        cursor.m_entry = segment->entry(cursor.m_pos);
+        heap.push(cursor);
+      }
+    }
+  }
+  file.close();
+  check(file, path);
+}
+
+KeystoreIndexEntry KeystoreIndexSegment::entry(size_t pos) const noexcept {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(entry_data(pos));
+  KeystoreIndexEntry entry;
+  std::memcpy(entry.m_key.m_bytes, data, KeystoreIndexKey::SIZE);
+  data += KeystoreIndexKey::SIZE;
+  entry.m_record.m_offset = Botan::load_be<uint64_t>(data, 0);
+  entry.m_record.m_length = Botan::load_be<uint32_t>(data + 8, 0);
+  return entry;
+}
+
+void KeystoreIndexSegment::find(const KeystoreIndexKey& key,
+                                std::vector<KeystoreRecord>& records) const {
+  // Binary search for the first entry with the key, comparing the keys in
+  // place.
+  size_t low = 0;
+  size_t high = m_size;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (std::memcmp(entry_data(mid), key.m_bytes, KeystoreIndexKey::SIZE) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  for (size_t pos = low; pos < m_size; pos++) {
+    if (std::memcmp(entry_data(pos), key.m_bytes, KeystoreIndexKey::SIZE) != 0)
+      break;
+    records.push_back(entry(pos).m_record);
+  }
+}
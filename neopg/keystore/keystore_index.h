@@ -0,0 +1,131 @@
+// NeoPG keystore index
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains the sorted index files of the keystore.
+
+#pragma once
+
+#include <neopg/utils/common.h>
+#include <neopg/utils/mapped_file.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NeoPG {
+
+/// The kinds of lookup keys in the keystore index.
+enum class NEOPG_UNSTABLE_API KeystoreKeyType : uint8_t {
+  /// The fingerprint of the primary key.
+  Fingerprint = 1,
+  /// The key ID of the primary key or of a subkey.
+  KeyId = 2,
+  /// The fingerprint of a subkey.
+  SubkeyFingerprint = 3,
+  /// A normalized email address from a user ID, see
+  /// Keystore::normalize_email().
+  Email = 4
+};
+
+/// A fixed-size lookup key: the key type, followed by the value.  Binary
+/// values (fingerprints and key IDs) are stored as is, zero-padded, and
+/// truncated if they are too long.  Email addresses are hashed.  So
+/// different values can have the same key, and callers must check the
+/// certificates they find.
+struct NEOPG_UNSTABLE_API KeystoreIndexKey {
+  static const size_t SIZE = 24;
+
+  uint8_t m_bytes[SIZE];
+
+  static KeystoreIndexKey create(KeystoreKeyType type,
+                                 const std::vector<uint8_t>& value);
+  static KeystoreIndexKey create(KeystoreKeyType type,
+                                 const std::string& value);
+
+  bool operator<(const KeystoreIndexKey& other) const noexcept {
+    return std::memcmp(m_bytes, other.m_bytes, SIZE) < 0;
+  }
+  bool operator==(const KeystoreIndexKey& other) const noexcept {
+    return std::memcmp(m_bytes, other.m_bytes, SIZE) == 0;
+  }
+};
+
+/// The location of a certificate in the keystore log.
+struct NEOPG_UNSTABLE_API KeystoreRecord {
+  uint64_t m_offset{0};
+  uint32_t m_length{0};
+};
+
+/// An entry of the keystore index, which maps a key to a certificate.
+struct NEOPG_UNSTABLE_API KeystoreIndexEntry {
+  KeystoreIndexKey m_key;
+  KeystoreRecord m_record;
+
+  /// Order by key, then by log offset.
+  bool operator<(const KeystoreIndexEntry& other) const noexcept {
+    int cmp = std::memcmp(m_key.m_bytes, other.m_key.m_bytes,
+                          KeystoreIndexKey::SIZE);
+    if (cmp != 0) return cmp < 0;
+    return m_record.m_offset < other.m_record.m_offset;
+  }
+};
+
+/// An immutable index file: a header, and the entries sorted by key in a
+/// fixed-size binary format, so that the file is searched in place after
+/// mapping it into memory.  Index files are written once, and replaced by
+/// merging them into a new one, like the runs of a log-structured merge
+/// tree.
+class NEOPG_UNSTABLE_API KeystoreIndexSegment {
+ public:
+  /// The size of an entry in the file.
+  static const size_t ENTRY_SIZE = KeystoreIndexKey::SIZE + 16;
+
+  /// Map the index file at \p path.
+  ///
+  /// \throws std::runtime_error if the file is not a valid index file
+  static std::unique_ptr<KeystoreIndexSegment> open_or_throw(
+      const std::string& path);
+
+  /// Write the \p entries, which must be sorted, to a new index file at \p
+  /// path.
+  ///
+  /// \throws std::runtime_error
+  static void write_or_throw(const std::string& path,
+                             const std::vector<KeystoreIndexEntry>& entries);
+
+  /// Merge the entries of \p segments into a new index file at \p path,
+  /// without loading them into memory.
+  ///
+  /// \throws std::runtime_error
+  static void merge_or_throw(
+      const std::string& path,
+      const std::vector<const KeystoreIndexSegment*>& segments);
+
+  /// \return the number of entries
+  size_t size() const noexcept { return m_size; }
+
+  /// \return the entry at position \p pos
+  KeystoreIndexEntry entry(size_t pos) const noexcept;
+
+  /// Append the records of all entries with key \p key to \p records.
+  void find(const KeystoreIndexKey& key,
+            std::vector<KeystoreRecord>& records) const;
+
+ private:
+  KeystoreIndexSegment() = default;
+
+  std::unique_ptr<MappedFile> m_file;
+  const char* m_entries{nullptr};
+  size_t m_size{0};
+
+  const char* entry_data(size_t pos) const noexcept {
+    return m_entries + pos * ENTRY_SIZE;
+  }
+};
+
+}  // namespace NeoPG
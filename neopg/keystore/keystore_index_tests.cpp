@@ -0,0 +1,109 @@
+// NeoPG keystore index (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/keystore/keystore_index.h>
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace NeoPG;
+
+namespace {
+KeystoreIndexEntry entry(uint8_t id, uint64_t offset) {
+  KeystoreIndexEntry entry;
+  entry.m_key = KeystoreIndexKey::create(KeystoreKeyType::KeyId,
+                                         std::vector<uint8_t>(8, id));
+  entry.m_record.m_offset = offset;
+  entry.m_record.m_length = 10;
+  return entry;
+}
+
+std::vector<uint64_t> offsets(const KeystoreIndexSegment& segment,
+                              uint8_t id) {
+  std::vector<KeystoreRecord> records;
+  segment.find(entry(id, 0).m_key, records);
+  std::vector<uint64_t> result;
+  for (const auto& record : records) result.push_back(record.m_offset);
+  return result;
+}
+}  // namespace
+
+TEST(NeopgTest, keystore_index_key_test) {
+  auto fpr = KeystoreIndexKey::create(KeystoreKeyType::Fingerprint,
+                                      std::vector<uint8_t>(20, 0xab));
+  ASSERT_EQ(fpr.m_bytes[0], 1);
+  ASSERT_EQ(fpr.m_bytes[20], 0xab);
+  ASSERT_EQ(fpr.m_bytes[21], 0);
+
+  // The type is part of the key.
+  ASSERT_FALSE(fpr == KeystoreIndexKey::create(KeystoreKeyType::KeyId,
+                                               std::vector<uint8_t>(20, 0xab)));
+
+  // Email addresses are hashed.
+  auto email = KeystoreIndexKey::create(KeystoreKeyType::Email,
+                                        std::string("alice@example.org"));
+  ASSERT_EQ(email.m_bytes[0], 4);
+  ASSERT_TRUE(email == KeystoreIndexKey::create(
+                           KeystoreKeyType::Email,
+                           std::string("alice@example.org")));
+  ASSERT_FALSE(email == KeystoreIndexKey::create(
+                            KeystoreKeyType::Email,
+                            std::string("bob@example.org")));
+}
+
+TEST(NeopgTest, keystore_index_segment_test) {
+  const std::string path1 = "neopg-keystore-index-test-1.tmp";
+  const std::string path2 = "neopg-keystore-index-test-2.tmp";
+  const std::string merged = "neopg-keystore-index-test-3.tmp";
+
+  std::vector<KeystoreIndexEntry> entries1{entry(1, 0), entry(3, 100),
+                                           entry(3, 200), entry(5, 300)};
+  std::vector<KeystoreIndexEntry> entries2{entry(2, 400), entry(3, 500)};
+  std::sort(entries1.begin(), entries1.end());
+  KeystoreIndexSegment::write_or_throw(path1, entries1);
+  KeystoreIndexSegment::write_or_throw(path2, entries2);
+
+  {
+    auto segment1 = KeystoreIndexSegment::open_or_throw(path1);
+    auto segment2 = KeystoreIndexSegment::open_or_throw(path2);
+    ASSERT_EQ(segment1->size(), 4);
+    ASSERT_EQ(offsets(*segment1, 1), std::vector<uint64_t>({0}));
+    ASSERT_EQ(offsets(*segment1, 3), std::vector<uint64_t>({100, 200}));
+    ASSERT_EQ(offsets(*segment1, 5), std::vector<uint64_t>({300}));
+    ASSERT_EQ(offsets(*segment1, 2), std::vector<uint64_t>());
+    ASSERT_EQ(offsets(*segment1, 6), std::vector<uint64_t>());
+
+    KeystoreIndexSegment::merge_or_throw(merged,
+                                         {segment1.get(), segment2.get()});
+    auto segment = KeystoreIndexSegment::open_or_throw(merged);
+    ASSERT_EQ(segment->size(), 6);
+    for (size_t pos = 1; pos < segment->size(); pos++)
+      ASSERT_FALSE(segment->entry(pos) < segment->entry(pos - 1));
+    ASSERT_EQ(offsets(*segment, 2), std::vector<uint64_t>({400}));
+    ASSERT_EQ(offsets(*segment, 3), std::vector<uint64_t>({100, 200, 500}));
+  }
+
+  // Truncated and invalid files are rejected.
+  {
+    std::ofstream out(path2, std::ios::binary | std::ios::app);
+    out << "x";
+  }
+  ASSERT_THROW(KeystoreIndexSegment::open_or_throw(path2), std::runtime_error);
+  {
+    std::ofstream out(path2, std::ios::binary | std::ios::trunc);
+    out << "not an index file";
+  }
+  ASSERT_THROW(KeystoreIndexSegment::open_or_throw(path2), std::runtime_error);
+
+  std::remove(path1.c_str());
+  std::remove(path2.c_str());
+  std::remove(merged.c_str());
+}
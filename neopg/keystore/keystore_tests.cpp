@@ -0,0 +1,218 @@
+// NeoPG keystore (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/keystore/keystore.h>
+
+#include <neopg/openpgp/public_key_packet.h>
+#include <neopg/openpgp/public_subkey_packet.h>
+#include <neopg/openpgp/user_id_packet.h>
+#include <neopg/parser/openpgp.h>
+
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace NeoPG;
+
+#ifndef _WIN32
+namespace {
+
+// A V4 public key packet with creation time \p created.
+std::string key_packet(char tag, char created) {
+  return std::string(1, tag) + std::string("\x0e\x04\x12\x34\x56", 5) +
+         std::string(1, created) +
+         std::string("\x01\x00\x11\x01\x42\x23\x00\x02\x03", 9);
+}
+
+std::string user_id_packet(const std::string& uid) {
+  return "\xcd" + std::string(1, static_cast<char>(uid.size())) + uid;
+}
+
+std::string certificate(char created, const std::string& uid,
+                        char subkey_created = 0) {
+  std::string packets = key_packet('\xc6', created) + user_id_packet(uid);
+  if (subkey_created) packets += key_packet('\xce', subkey_created);
+  return packets;
+}
+
+struct CollectSink : public CertificateSink {
+  std::vector<std::unique_ptr<Certificate>> m_certs;
+  void next_certificate(std::unique_ptr<Certificate> cert) override {
+    m_certs.emplace_back(std::move(cert));
+  }
+};
+
+std::unique_ptr<Certificate> parse(const std::string& packets) {
+  CollectSink certs;
+  KeyblockSink sink{certs};
+  RawPacketParser parser{sink};
+  parser.process(packets);
+  sink.finish();
+  return std::move(certs.m_certs.at(0));
+}
+
+std::vector<uint8_t> fingerprint(const Certificate& cert) {
+  auto& key = dynamic_cast<const PublicKeyPacket&>(cert.packet(cert.m_primary));
+  return key.m_public_key->fingerprint();
+}
+
+std::vector<uint8_t> keyid(const Certificate& cert) {
+  auto& key = dynamic_cast<const PublicKeyPacket&>(cert.packet(cert.m_primary));
+  return key.m_public_key->keyid();
+}
+
+std::vector<uint8_t> subkey_keyid(const Certificate& cert) {
+  auto& key = dynamic_cast<const PublicSubkeyPacket&>(
+      cert.packet(cert.m_subkeys.at(0)));
+  return key.m_public_key->keyid();
+}
+
+std::string user_id(const Certificate& cert) {
+  return dynamic_cast<const UserIdPacket&>(cert.packet(cert.m_users.at(0)))
+      .m_content;
+}
+
+class TempDir {
+ public:
+  TempDir() {
+    char name[] = "neopg-keystore-test-XXXXXX";
+    if (!mkdtemp(name)) throw std::runtime_error("mkdtemp");
+    m_path = name;
+  }
+  ~TempDir() {
+    std::system(("rm -rf " + m_path).c_str());
+  }
+  std::string m_path;
+};
+
+}  // namespace
+
+TEST(NeopgTest, keystore_normalize_email_test) {
+  ASSERT_EQ(Keystore::normalize_email("Alice <Alice@Example.ORG>"),
+            "alice@example.org");
+  ASSERT_EQ(Keystore::normalize_email(" bob@example.org "), "bob@example.org");
+  ASSERT_EQ(Keystore::normalize_email("Alice"), "");
+  ASSERT_EQ(Keystore::normalize_email("Alice <alice>"), "");
+  ASSERT_EQ(Keystore::normalize_email("a@b@c"), "");
+  ASSERT_EQ(Keystore::normalize_email("@example.org"), "");
+  ASSERT_EQ(Keystore::normalize_email("Alice <alice@example.org"), "");
+  ASSERT_EQ(Keystore::normalize_email("Alice Liddell@example.org"), "");
+}
+
+TEST(NeopgTest, keystore_insert_find_test) {
+  TempDir dir;
+  auto alice = parse(certificate(1, "Alice <alice@example.org>", 2));
+  auto bob = parse(certificate(3, "bob@example.org"));
+
+  auto keystore = Keystore::open_or_throw(dir.m_path);
+  auto empty = keystore->snapshot();
+  ASSERT_TRUE(keystore->insert(*alice));
+  ASSERT_TRUE(keystore->insert(*bob));
+  ASSERT_EQ(keystore->pending(), 2);
+
+  // Nothing is visible before the commit.
+  ASSERT_EQ(keystore->snapshot()->find_fingerprint(fingerprint(*alice)),
+            nullptr);
+  keystore->commit();
+  ASSERT_EQ(keystore->pending(), 0);
+
+  auto snapshot = keystore->snapshot();
+  ASSERT_EQ(empty->find_fingerprint(fingerprint(*alice)), nullptr);
+  auto found = snapshot->find_fingerprint(fingerprint(*alice));
+  ASSERT_NE(found, nullptr);
+  ASSERT_EQ(user_id(*found), "Alice <alice@example.org>");
+  ASSERT_EQ(found->m_subkeys.size(), 1);
+
+  auto certs = snapshot->find(KeystoreKeyType::KeyId, keyid(*bob));
+  ASSERT_EQ(certs.size(), 1);
+  ASSERT_EQ(user_id(*certs[0]), "bob@example.org");
+
+  // Subkeys are found by their key ID.
+  certs = snapshot->find(KeystoreKeyType::KeyId, subkey_keyid(*alice));
+  ASSERT_EQ(certs.size(), 1);
+  ASSERT_EQ(fingerprint(*certs[0]), fingerprint(*alice));
+
+  certs = snapshot->find_email("ALICE@example.org");
+  ASSERT_EQ(certs.size(), 1);
+  ASSERT_EQ(snapshot->find_email("carol@example.org").size(), 0);
+
+  // A new version replaces the old one.
+  auto alice2 = parse(certificate(1, "Alice <alice@example.net>", 2));
+  ASSERT_TRUE(keystore->insert(*alice2));
+  keystore->commit();
+  snapshot = keystore->snapshot();
+  found = snapshot->find_fingerprint(fingerprint(*alice));
+  ASSERT_NE(found, nullptr);
+  ASSERT_EQ(user_id(*found), "Alice <alice@example.net>");
+  ASSERT_EQ(snapshot->find_email("alice@example.org").size(), 0);
+  ASSERT_EQ(snapshot->find_email("alice@example.net").size(), 1);
+  ASSERT_EQ(snapshot->segments(), 2);
+
+  // Certificates without a primary key are not stored.
+  Certificate nokey;
+  ASSERT_FALSE(keystore->insert(nokey));
+}
+
+TEST(NeopgTest, keystore_reopen_compact_test) {
+  TempDir dir;
+  auto alice = parse(certificate(1, "alice@example.org"));
+  auto bob = parse(certificate(3, "bob@example.org"));
+  {
+    auto keystore = Keystore::open_or_throw(dir.m_path);
+
+    // There is only one writer.
+    ASSERT_THROW(Keystore::open_or_throw(dir.m_path), std::runtime_error);
+
+    keystore->insert(*alice);
+    keystore->commit();
+    keystore->insert(*bob);
+    keystore->commit();
+    // Not committed, so lost.
+    keystore->insert(*parse(certificate(5, "carol@example.org")));
+  }
+
+  auto reader = KeystoreSnapshot::open_or_throw(dir.m_path);
+  ASSERT_EQ(reader->segments(), 2);
+  ASSERT_NE(reader->find_fingerprint(fingerprint(*alice)), nullptr);
+  ASSERT_NE(reader->find_fingerprint(fingerprint(*bob)), nullptr);
+  ASSERT_EQ(reader->find_email("carol@example.org").size(), 0);
+
+  auto keystore = Keystore::open_or_throw(dir.m_path);
+  keystore->compact();
+  auto snapshot = keystore->snapshot();
+  ASSERT_EQ(snapshot->segments(), 1);
+  ASSERT_GT(snapshot->generation(), reader->generation());
+  ASSERT_NE(snapshot->find_fingerprint(fingerprint(*alice)), nullptr);
+  ASSERT_NE(snapshot->find_fingerprint(fingerprint(*bob)), nullptr);
+
+  // The old snapshot still works.
+  ASSERT_NE(reader->find_fingerprint(fingerprint(*bob)), nullptr);
+}
+
+TEST(NeopgTest, keystore_bulk_load_test) {
+  TempDir dir;
+  std::stringstream dump;
+  for (char created = 1; created <= 10; created++)
+    dump << certificate(created,
+                        "user" + std::to_string(created) + "@example.org");
+
+  auto keystore = Keystore::open_or_throw(dir.m_path);
+  ASSERT_EQ(keystore->bulk_load(dump, 3), 10);
+  auto snapshot = keystore->snapshot();
+  ASSERT_EQ(snapshot->segments(), 1);
+  for (int created = 1; created <= 10; created++)
+    ASSERT_EQ(snapshot
+                  ->find_email("user" + std::to_string(created) +
+                               "@example.org")
+                  .size(),
+              1);
+}
+#endif
@@ -0,0 +1,373 @@
+// OpenPGP ASCII armor (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/armor.h>
+
+#include <neopg/crypto/cpu.h>
+#include <neopg/utils/base64.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NEOPG_CRC24_CLMUL 1
+#include <immintrin.h>
+#endif
+
+using namespace NeoPG;
+
+namespace {
+
+const uint64_t CRC24_POLY = 0x864cfb;
+
+// Tables for the "slice-by-8" algorithm: m_table[k][i] is the checksum
+// update for byte i followed by k zero bytes.
+struct Crc24Tables {
+  uint32_t m_table[8][256];
+
+  // x^128 and x^192 modulo the polynomial (shifted into the upper 24 bits),
+  // for folding with carry-less multiplication.
+  uint64_t m_x128;
+  uint64_t m_x192;
+
+  Crc24Tables() {
+    const uint32_t poly = CRC24_POLY << 8;
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i << 24;
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc & 0x80000000) ? (crc << 1) ^ poly : crc << 1;
+      m_table[0][i] = crc;
+    }
+    for (int k = 1; k < 8; k++)
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t prev = m_table[k - 1][i];
+        m_table[k][i] = (prev << 8) ^ m_table[0][prev >> 24];
+      }
+
+    uint64_t rem = 1;
+    for (int n = 1; n <= 192; n++) {
+      rem <<= 1;
+      if (rem & (uint64_t{1} << 32)) rem ^= (uint64_t{1} << 32) | poly;
+      if (n == 128) m_x128 = rem;
+    }
+    m_x192 = rem;
+  }
+};
+
+const Crc24Tables& crc24_tables() {
+  static const Crc24Tables tables;
+  return tables;
+}
+
+uint32_t crc24_slice8(const Crc24Tables& tables, uint32_t crc,
+                      const uint8_t* data, size_t length) {
+  const auto& table = tables.m_table;
+  for (; length >= 8; data += 8, length -= 8) {
+    uint32_t word = crc ^ ((data[0] << 24) | (data[1] << 16) |
+                           (data[2] << 8) | data[3]);
+    crc = table[7][word >> 24] ^ table[6][(word >> 16) & 0xff] ^
+          table[5][(word >> 8) & 0xff] ^ table[4][word & 0xff] ^
+          table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^
+          table[0][data[7]];
+  }
+  for (; length > 0; data++, length--)
+    crc = (crc << 8) ^ table[0][(crc >> 24) ^ *data];
+  return crc;
+}
+
+#ifdef NEOPG_CRC24_CLMUL
+
+// Fold 16 bytes at a time: the data so far, as a 128-bit polynomial A, is
+// followed by the block B, so A x^128 + B is congruent to
+// (A_hi x^192 mod P) + (A_lo x^128 mod P) + B.  This is Intel's "Fast CRC
+// Computation for Generic Polynomials Using PCLMULQDQ" for a non-reflected
+// CRC, without the Barrett reduction: the remaining 16 bytes are checksummed
+// with the tables.
+__attribute__((target("pclmul,ssse3"))) uint32_t crc24_clmul(
+    const Crc24Tables& tables, uint32_t crc, const uint8_t* data,
+    size_t length) {
+  if (length < 64) return crc24_slice8(tables, crc, data, length);
+
+  const __m128i reverse =
+      _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  const __m128i fold = _mm_set_epi64x(tables.m_x192, tables.m_x128);
+
+  // Starting with crc is the same as adding it to the first 4 bytes.
+  __m128i acc = _mm_shuffle_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), reverse);
+  acc = _mm_xor_si128(acc, _mm_set_epi32(crc, 0, 0, 0));
+  data += 16;
+  length -= 16;
+
+  for (; length >= 16; data += 16, length -= 16) {
+    __m128i block = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), reverse);
+    acc = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(acc, fold, 0x11),
+                                      _mm_clmulepi64_si128(acc, fold, 0x00)),
+                        block);
+  }
+
+  uint8_t rest[16];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(rest),
+                   _mm_shuffle_epi8(acc, reverse));
+  crc = crc24_slice8(tables, 0, rest, sizeof(rest));
+  return crc24_slice8(tables, crc, data, length);
+}
+
+#endif
+
+using Crc24Function = uint32_t(const Crc24Tables& tables, uint32_t crc,
+                               const uint8_t* data, size_t length);
+
+const CpuKernel<Crc24Function> CRC24_KERNELS[] = {
+#ifdef NEOPG_CRC24_CLMUL
+    {"pclmul", CpuFeature::PCLMUL | CpuFeature::SSSE3, crc24_clmul},
+#endif
+    {"slice8", CpuFeatures(), crc24_slice8}};
+
+Crc24Function* crc24_kernel() {
+  static Crc24Function* const kernel = cpu_select(CRC24_KERNELS).m_function;
+  return kernel;
+}
+
+// Decode this many characters at once.
+const size_t DECODE_SIZE = 64 * 1024;
+
+bool is_space(char chr) {
+  return chr == ' ' || chr == '\t' || chr == '\r' || chr == '\n' ||
+         chr == '\v' || chr == '\f';
+}
+
+bool starts_with(const char* data, size_t length, const char* prefix) {
+  size_t len = std::strlen(prefix);
+  return length >= len && std::memcmp(data, prefix, len) == 0;
+}
+
+}  // namespace
+
+void Crc24::update(const uint8_t* data, size_t length) noexcept {
+  m_crc = crc24_kernel()(crc24_tables(), m_crc, data, length);
+}
+
+const size_t ArmorEncoder::LINE_LENGTH;
+const size_t ArmorEncoder::BLOCK_SIZE;
+
+ArmorEncoder::ArmorEncoder(std::ostream& out, const std::string& title,
+                           bool crc24)
+    : m_out(out), m_title(title), m_crc24(crc24) {}
+
+void ArmorEncoder::start() {
+  m_started = true;
+  if (m_title.empty()) return;
+  std::string header = "-----BEGIN " + m_title + "-----\n";
+  for (const auto& entry : m_headers)
+    header += entry.first + ": " + entry.second + "\n";
+  header += "\n";
+  m_out.write(header.data(), header.size());
+}
+
+void ArmorEncoder::encode(const uint8_t* data, size_t length) {
+  m_chars.resize(base64_encoded_size(length));
+  base64_encode(data, length, &m_chars[0]);
+  if (m_crc24) m_crc.update(data, length);
+
+  m_lines.clear();
+  for (size_t pos = 0; pos < m_chars.size(); pos += LINE_LENGTH) {
+    m_lines.append(m_chars, pos, LINE_LENGTH);
+    m_lines += '\n';
+  }
+  m_out.write(m_lines.data(), m_lines.size());
+}
+
+void ArmorEncoder::write(const uint8_t* data, size_t length) {
+  if (!m_started) start();
+
+  if (!m_pending.empty()) {
+    size_t len = std::min(length, BLOCK_SIZE - m_pending.size());
+    m_pending.append(reinterpret_cast<const char*>(data), len);
+    data += len;
+    length -= len;
+    if (m_pending.size() < BLOCK_SIZE) return;
+    encode(reinterpret_cast<const uint8_t*>(m_pending.data()), BLOCK_SIZE);
+    m_pending.clear();
+  }
+
+  for (; length >= BLOCK_SIZE; data += BLOCK_SIZE, length -= BLOCK_SIZE)
+    encode(data, BLOCK_SIZE);
+  m_pending.assign(reinterpret_cast<const char*>(data), length);
+}
+
+void ArmorEncoder::finish() {
+  if (!m_started) start();
+  if (!m_pending.empty()) {
+    encode(reinterpret_cast<const uint8_t*>(m_pending.data()),
+           m_pending.size());
+    m_pending.clear();
+  }
+
+  std::string trailer;
+  if (m_crc24) {
+    uint32_t crc = m_crc.value();
+    const uint8_t bytes[3] = {static_cast<uint8_t>(crc >> 16),
+                              static_cast<uint8_t>(crc >> 8),
+                              static_cast<uint8_t>(crc)};
+    char chars[4];
+    base64_encode(bytes, sizeof(bytes), chars);
+    trailer += "=";
+    trailer.append(chars, sizeof(chars));
+    trailer += "\n";
+  }
+  if (!m_title.empty()) trailer += "-----END " + m_title + "-----\n";
+  m_out.write(trailer.data(), trailer.size());
+}
+
+void ArmorDecoder::write(const char* data, size_t length) {
+  while (length > 0) {
+    auto eol = static_cast<const char*>(std::memchr(data, '\n', length));
+    if (!eol) {
+      m_partial.append(data, length);
+      return;
+    }
+    size_t len = eol - data;
+    if (m_partial.empty()) {
+      line(data, len);
+    } else {
+      m_partial.append(data, len);
+      line(m_partial.data(), m_partial.size());
+      m_partial.clear();
+    }
+    data += len + 1;
+    length -= len + 1;
+  }
+}
+
+void ArmorDecoder::finish() {
+  if (!m_partial.empty()) {
+    line(m_partial.data(), m_partial.size());
+    m_partial.clear();
+  }
+  if (m_state != State::Text)
+    throw std::runtime_error("armor block not terminated");
+  if (m_blocks == 0) throw std::runtime_error("no armor block found");
+}
+
+void ArmorDecoder::line(const char* data, size_t length) {
+  while (length > 0 && is_space(data[length - 1])) length--;
+  while (length > 0 && is_space(data[0])) {
+    data++;
+    length--;
+  }
+
+  switch (m_state) {
+    case State::Text: {
+      const char begin[] = "-----BEGIN ";
+      const char dashes[] = "-----";
+      const size_t prefix = sizeof(begin) - 1;
+      const size_t suffix = sizeof(dashes) - 1;
+      if (!starts_with(data, length, begin) || length < prefix + suffix ||
+          std::memcmp(data + length - suffix, dashes, suffix) != 0)
+        return;
+      std::string title(data + prefix, length - prefix - suffix);
+      // The cleartext of a signed message is not armored.
+      if (title == "PGP SIGNED MESSAGE") return;
+      m_title = title;
+      m_headers.clear();
+      m_crc = Crc24();
+      m_has_checksum = false;
+      m_state = State::Headers;
+      return;
+    }
+
+    case State::Headers: {
+      if (length == 0) {
+        m_state = State::Body;
+        return;
+      }
+      if (starts_with(data, length, "-----END")) {
+        end_block();
+        return;
+      }
+      auto colon = static_cast<const char*>(std::memchr(data, ':', length));
+      if (colon) {
+        const char* value = colon + 1;
+        const char* end = data + length;
+        while (value < end && is_space(*value)) value++;
+        m_headers.emplace_back(std::string(data, colon),
+                               std::string(value, end));
+        return;
+      }
+      // The empty line after the headers is missing.
+      m_state = State::Body;
+      body(data, length);
+      return;
+    }
+
+    case State::Body:
+      if (starts_with(data, length, "-----END")) {
+        end_block();
+      } else if (length == 5 && data[0] == '=') {
+        uint8_t bytes[3];
+        size_t count = 0;
+        try {
+          count = base64_decode(data + 1, 4, bytes);
+        } catch (const std::runtime_error&) {
+        }
+        if (count != 3) throw std::runtime_error("invalid armor checksum");
+        m_checksum = (bytes[0] << 16) | (bytes[1] << 8) | bytes[2];
+        m_has_checksum = true;
+        m_state = State::Checksum;
+      } else {
+        body(data, length);
+      }
+      return;
+
+    case State::Checksum:
+      if (starts_with(data, length, "-----END"))
+        end_block();
+      else if (length != 0)
+        throw std::runtime_error("data after armor checksum");
+      return;
+  }
+}
+
+void ArmorDecoder::body(const char* data, size_t length) {
+  // Whitespace within the line is rare, and all base64 characters are above
+  // the space character, so check for it first in a loop that vectorizes.
+  bool space = false;
+  for (size_t i = 0; i < length; i++)
+    space |= static_cast<uint8_t>(data[i]) <= ' ';
+
+  if (!space) {
+    m_chars.append(data, length);
+  } else {
+    for (size_t i = 0; i < length; i++)
+      if (!is_space(data[i])) m_chars += data[i];
+  }
+  if (m_chars.size() >= DECODE_SIZE) flush(false);
+}
+
+void ArmorDecoder::flush(bool final) {
+  size_t length = m_chars.size();
+  if (!final) {
+    // Padding is only allowed at the end, so keep it until then.
+    length -= length % 4;
+    if (length == 0 || m_chars[length - 1] == '=') return;
+  }
+  m_bytes.resize(base64_decoded_size(length));
+  auto bytes = reinterpret_cast<uint8_t*>(&m_bytes[0]);
+  size_t count = base64_decode(m_chars.data(), length, bytes);
+  m_crc.update(bytes, count);
+  m_out.write(m_bytes.data(), count);
+  m_chars.erase(0, length);
+}
+
+void ArmorDecoder::end_block() {
+  flush(true);
+  if (m_has_checksum && m_crc.value() != m_checksum)
+    throw std::runtime_error("armor checksum mismatch");
+  m_blocks++;
+  m_state = State::Text;
+}
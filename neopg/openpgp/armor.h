@@ -0,0 +1,134 @@
+// OpenPGP ASCII armor
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains the ASCII armor (RFC 4880, section 6) encoder and
+/// decoder.
+
+#pragma once
+
+#include <neopg/utils/common.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace NeoPG {
+
+/// The CRC24 checksum of ASCII armor (RFC 4880, section 6.1).
+class NEOPG_UNSTABLE_API Crc24 {
+ public:
+  /// Add \p length bytes at \p data to the checksum.
+  void update(const uint8_t* data, size_t length) noexcept;
+
+  /// \return the checksum of the data so far
+  uint32_t value() const noexcept { return m_crc >> 8; }
+
+ private:
+  // The checksum is kept in the upper 24 bits, so that the table-driven
+  // update works on whole 32-bit words.
+  uint32_t m_crc{0xb704ce00};
+};
+
+/// Write binary data as an armor block to a stream.  The data is encoded in
+/// blocks of BLOCK_SIZE bytes, and the checksum is updated while each block
+/// is still in the cache.
+///
+///     ArmorEncoder armor{std::cout, "PGP PUBLIC KEY BLOCK"};
+///     armor.write(data, length);
+///     armor.finish();
+class NEOPG_UNSTABLE_API ArmorEncoder {
+ public:
+  /// The number of base64 characters per line.
+  static const size_t LINE_LENGTH = 64;
+
+  /// The number of bytes encoded at once (a multiple of the line length).
+  static const size_t BLOCK_SIZE = LINE_LENGTH / 4 * 3 * 256;
+
+  /// Write an armor block with title \p title to \p out.  With an empty
+  /// title, the header and footer lines are omitted.  If \p crc24 is false,
+  /// the checksum is omitted.
+  ArmorEncoder(std::ostream& out, const std::string& title, bool crc24 = true);
+
+  /// Add the headers \p headers (name and value) to the armor header.  Must
+  /// be called before write().
+  void set_headers(const std::vector<std::pair<std::string, std::string>>&
+                       headers) {
+    m_headers = headers;
+  }
+
+  /// Encode \p length bytes at \p data.
+  void write(const uint8_t* data, size_t length);
+
+  /// Write the rest of the data, the checksum and the footer.
+  void finish();
+
+ private:
+  void start();
+  void encode(const uint8_t* data, size_t length);
+
+  std::ostream& m_out;
+  std::string m_title;
+  bool m_crc24;
+  bool m_started{false};
+  std::vector<std::pair<std::string, std::string>> m_headers;
+  Crc24 m_crc;
+  std::string m_pending;
+  std::string m_chars;
+  std::string m_lines;
+};
+
+/// Decode armored data from a text stream and write the binary data to a
+/// stream.  Text before, between and after armor blocks is ignored, as is
+/// whitespace in the armored data, so several armor blocks (such as a
+/// keyserver response with several keys) are decoded to the concatenation
+/// of their contents.  If present, the checksum of each block is verified.
+///
+/// write() and finish() throw std::runtime_error if the armor is invalid.
+class NEOPG_UNSTABLE_API ArmorDecoder {
+ public:
+  /// The title of the current (or last) armor block, for example "PGP
+  /// PUBLIC KEY BLOCK".
+  std::string m_title;
+
+  /// The armor headers of the current (or last) armor block.
+  std::vector<std::pair<std::string, std::string>> m_headers;
+
+  /// The number of complete armor blocks.
+  size_t m_blocks{0};
+
+  ArmorDecoder(std::ostream& out) : m_out(out) {}
+
+  /// Decode \p length characters at \p data.
+  void write(const char* data, size_t length);
+
+  /// Decode the last line.
+  ///
+  /// \throws std::runtime_error if no armor block was found, or the last one
+  /// is incomplete
+  void finish();
+
+ private:
+  enum class State { Text, Headers, Body, Checksum };
+
+  void line(const char* data, size_t length);
+  void body(const char* data, size_t length);
+  void flush(bool final);
+  void end_block();
+
+  std::ostream& m_out;
+  State m_state{State::Text};
+  bool m_has_checksum{false};
+  uint32_t m_checksum{0};
+  Crc24 m_crc;
+  std::string m_partial;
+  std::string m_chars;
+  std::string m_bytes;
+};
+
+}  // namespace NeoPG
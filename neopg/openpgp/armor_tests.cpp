@@ -0,0 +1,171 @@
+// OpenPGP ASCII armor (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/armor.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace NeoPG;
+
+namespace {
+
+std::string armor(const std::string& data, const std::string& title,
+                  bool crc24 = true) {
+  std::stringstream out;
+  ArmorEncoder encoder{out, title, crc24};
+  encoder.write(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+  encoder.finish();
+  return out.str();
+}
+
+std::string dearmor(const std::string& text) {
+  std::stringstream out;
+  ArmorDecoder decoder{out};
+  decoder.write(text.data(), text.size());
+  decoder.finish();
+  return out.str();
+}
+
+}  // namespace
+
+TEST(NeopgTest, openpgp_armor_crc24_test) {
+  Crc24 crc;
+  ASSERT_EQ(crc.value(), 0xb704ce);
+  // The check value of CRC-24/OPENPGP.
+  const std::string check{"123456789"};
+  crc.update(reinterpret_cast<const uint8_t*>(check.data()), check.size());
+  ASSERT_EQ(crc.value(), 0x21cf02);
+
+  // The result does not depend on how the data is split (long updates may
+  // use a different implementation than short ones).
+  std::string data;
+  for (int i = 0; i < 300; i++) data += static_cast<char>(i * 37);
+  auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+  Crc24 bytewise;
+  for (size_t i = 0; i < data.size(); i++) bytewise.update(bytes + i, 1);
+  for (size_t split = 0; split < data.size(); split++) {
+    Crc24 parts;
+    parts.update(bytes, split);
+    parts.update(bytes + split, data.size() - split);
+    ASSERT_EQ(parts.value(), bytewise.value());
+  }
+}
+
+TEST(NeopgTest, openpgp_armor_encode_test) {
+  ASSERT_EQ(armor("foobar", "PGP ARMORED FILE"),
+            "-----BEGIN PGP ARMORED FILE-----\n"
+            "\n"
+            "Zm9vYmFy\n"
+            "=czTe\n"
+            "-----END PGP ARMORED FILE-----\n");
+  ASSERT_EQ(armor("foobar", "", false), "Zm9vYmFy\n");
+  ASSERT_EQ(armor("", "X"), "-----BEGIN X-----\n\n=twTO\n-----END X-----\n");
+
+  // Lines are wrapped at 64 characters.
+  std::string data(100, 'x');
+  std::string text = armor(data, "", false);
+  ASSERT_EQ(text.find('\n'), ArmorEncoder::LINE_LENGTH);
+  ASSERT_EQ(text.size(), 136 + 3);
+
+  {
+    std::stringstream out;
+    ArmorEncoder encoder{out, "PGP PUBLIC KEY BLOCK"};
+    encoder.set_headers({{"Comment", "test"}});
+    encoder.finish();
+    ASSERT_EQ(out.str().find("-----BEGIN PGP PUBLIC KEY BLOCK-----\n"
+                             "Comment: test\n\n"),
+              0);
+  }
+}
+
+TEST(NeopgTest, openpgp_armor_decode_test) {
+  ASSERT_EQ(dearmor("-----BEGIN PGP ARMORED FILE-----\n"
+                    "\n"
+                    "Zm9vYmFy\n"
+                    "=czTe\n"
+                    "-----END PGP ARMORED FILE-----\n"),
+            "foobar");
+
+  // Text around the block, headers, whitespace, CRLF line endings and a
+  // missing checksum are tolerated.
+  std::stringstream out;
+  ArmorDecoder decoder{out};
+  const std::string text{
+      "<html><pre>\r\n"
+      "  -----BEGIN PGP PUBLIC KEY BLOCK-----\r\n"
+      "Version: 1\r\n"
+      "Comment: a: b\r\n"
+      "\r\n"
+      "Zm9v\tYm\r\n"
+      " Fy \r\n"
+      "-----END PGP PUBLIC KEY BLOCK-----\r\n"
+      "</pre></html>"};
+  decoder.write(text.data(), text.size());
+  decoder.finish();
+  ASSERT_EQ(out.str(), "foobar");
+  ASSERT_EQ(decoder.m_title, "PGP PUBLIC KEY BLOCK");
+  ASSERT_EQ(decoder.m_headers.size(), 2);
+  ASSERT_EQ(decoder.m_headers[1].first, "Comment");
+  ASSERT_EQ(decoder.m_headers[1].second, "a: b");
+  ASSERT_EQ(decoder.m_blocks, 1);
+
+  // A missing empty line after the header.
+  ASSERT_EQ(dearmor("-----BEGIN X-----\nZm9v\n-----END X-----\n"), "foo");
+
+  // Several blocks are concatenated.
+  ASSERT_EQ(dearmor(armor("foo", "A") + "text\n" + armor("bar", "B")),
+            "foobar");
+
+  // The cleartext of a signed message is skipped.
+  ASSERT_EQ(dearmor("-----BEGIN PGP SIGNED MESSAGE-----\n"
+                    "Hash: SHA256\n\n"
+                    "hello\n" +
+                    armor("sig", "PGP SIGNATURE")),
+            "sig");
+
+  ASSERT_THROW(dearmor(""), std::runtime_error);
+  ASSERT_THROW(dearmor("-----BEGIN X-----\n\nZm9v\n"), std::runtime_error);
+  ASSERT_THROW(dearmor("-----BEGIN X-----\n\nZm9v\n=AAAA\n-----END X-----\n"),
+               std::runtime_error);
+  ASSERT_THROW(dearmor("-----BEGIN X-----\n\nZm9v\n=czTe\nZm9v\n"),
+               std::runtime_error);
+  ASSERT_THROW(dearmor("-----BEGIN X-----\n\nZm9v!\n-----END X-----\n"),
+               std::runtime_error);
+}
+
+TEST(NeopgTest, openpgp_armor_round_trip_test) {
+  // Large enough to be decoded in several pieces.
+  std::string data;
+  for (size_t i = 0; i < 4 * ArmorEncoder::BLOCK_SIZE + 17; i++)
+    data += static_cast<char>((i * 7919) >> 5);
+
+  for (size_t len : {size_t(0), size_t(1), size_t(47), size_t(48),
+                     ArmorEncoder::BLOCK_SIZE, data.size()}) {
+    const std::string input = data.substr(0, len);
+    const std::string text = armor(input, "PGP MESSAGE");
+
+    // Feed the encoder and decoder in odd-sized pieces.
+    std::stringstream encoded;
+    ArmorEncoder encoder{encoded, "PGP MESSAGE"};
+    for (size_t pos = 0; pos < input.size(); pos += 1000)
+      encoder.write(reinterpret_cast<const uint8_t*>(input.data()) + pos,
+                    std::min(size_t(1000), input.size() - pos));
+    encoder.finish();
+    ASSERT_EQ(encoded.str(), text);
+
+    std::stringstream decoded;
+    ArmorDecoder decoder{decoded};
+    for (size_t pos = 0; pos < text.size(); pos += 777)
+      decoder.write(text.data() + pos,
+                    std::min(size_t(777), text.size() - pos));
+    decoder.finish();
+    ASSERT_EQ(decoded.str(), input);
+  }
+}
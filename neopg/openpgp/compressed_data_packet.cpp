@@ -9,19 +9,23 @@
 
 namespace NeoPG {
 
-void CompressedDataPacket::write_body(std::ostream& out) const {
-  out << (uint8_t)compression_algorithm();
+void CompressedDataPacket::write_body(ByteWriter& out) const {
+  out.put_u8((uint8_t)compression_algorithm());
   write_compressed_data(out);
 }
 
+uint32_t CompressedDataPacket::body_length() const {
+  return 1 + compressed_data_length();
+}
+
 PacketType CompressedDataPacket::type() const {
   return PacketType::CompressedData;
 }
 
 /* Uncompressed Data Packet */
 
-void UncompressedDataPacket::write_compressed_data(std::ostream& out) const {
-  out.write((char*)m_data.data(), m_data.size());
+void UncompressedDataPacket::write_compressed_data(ByteWriter& out) const {
+  out.put_bytes(m_data.data(), m_data.size());
 }
 
 CompressionAlgorithm UncompressedDataPacket::compression_algorithm() const {
@@ -31,8 +35,8 @@ CompressionAlgorithm UncompressedDataPacket::compression_algorithm() const {
 /* Deflate Compressed Data Packet */
 
 void DeflateCompressedDataPacket::write_compressed_data(
-    std::ostream& out) const {
-  out.write((char*)m_data.data(), m_data.size());
+    ByteWriter& out) const {
+  out.put_bytes(m_data.data(), m_data.size());
 }
 
 CompressionAlgorithm DeflateCompressedDataPacket::compression_algorithm()
@@ -42,8 +46,8 @@ CompressionAlgorithm DeflateCompressedDataPacket::compression_algorithm()
 
 /* Zlib Compressed Data Packet */
 
-void ZlibCompressedDataPacket::write_compressed_data(std::ostream& out) const {
-  out.write((char*)m_data.data(), m_data.size());
+void ZlibCompressedDataPacket::write_compressed_data(ByteWriter& out) const {
+  out.put_bytes(m_data.data(), m_data.size());
 }
 
 CompressionAlgorithm ZlibCompressedDataPacket::compression_algorithm() const {
@@ -52,8 +56,8 @@ CompressionAlgorithm ZlibCompressedDataPacket::compression_algorithm() const {
 
 /* Bzip2 Compressed Data Packet */
 
-void Bzip2CompressedDataPacket::write_compressed_data(std::ostream& out) const {
-  out.write((char*)m_data.data(), m_data.size());
+void Bzip2CompressedDataPacket::write_compressed_data(ByteWriter& out) const {
+  out.put_bytes(m_data.data(), m_data.size());
 }
 
 CompressionAlgorithm Bzip2CompressedDataPacket::compression_algorithm() const {
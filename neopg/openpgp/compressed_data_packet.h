@@ -30,10 +30,12 @@ enum class NEOPG_UNSTABLE_API CompressionAlgorithm : uint8_t {
 };
 
 struct NEOPG_UNSTABLE_API CompressedDataPacket : Packet {
-  void write_body(std::ostream& out) const override;
+  void write_body(ByteWriter& out) const override;
+  uint32_t body_length() const override;
   PacketType type() const override;
 
-  virtual void write_compressed_data(std::ostream& out) const = 0;
+  virtual void write_compressed_data(ByteWriter& out) const = 0;
+  virtual uint32_t compressed_data_length() const = 0;
   virtual CompressionAlgorithm compression_algorithm() const = 0;
 };
 
@@ -41,7 +43,8 @@ struct NEOPG_UNSTABLE_API CompressedDataPacket : Packet {
 
 struct NEOPG_UNSTABLE_API UncompressedDataPacket : CompressedDataPacket {
   std::vector<uint8_t> m_data;
-  void write_compressed_data(std::ostream& out) const override;
+  void write_compressed_data(ByteWriter& out) const override;
+  uint32_t compressed_data_length() const override { return m_data.size(); }
   CompressionAlgorithm compression_algorithm() const override;
 };
 
@@ -49,7 +52,8 @@ struct NEOPG_UNSTABLE_API UncompressedDataPacket : CompressedDataPacket {
 
 struct NEOPG_UNSTABLE_API DeflateCompressedDataPacket : CompressedDataPacket {
   std::vector<uint8_t> m_data;
-  void write_compressed_data(std::ostream& out) const override;
+  void write_compressed_data(ByteWriter& out) const override;
+  uint32_t compressed_data_length() const override { return m_data.size(); }
   CompressionAlgorithm compression_algorithm() const override;
 };
 
@@ -57,7 +61,8 @@ struct NEOPG_UNSTABLE_API DeflateCompressedDataPacket : CompressedDataPacket {
 
 struct NEOPG_UNSTABLE_API ZlibCompressedDataPacket : CompressedDataPacket {
   std::vector<uint8_t> m_data;
-  void write_compressed_data(std::ostream& out) const override;
+  void write_compressed_data(ByteWriter& out) const override;
+  uint32_t compressed_data_length() const override { return m_data.size(); }
   CompressionAlgorithm compression_algorithm() const override;
 };
 
@@ -65,7 +70,8 @@ struct NEOPG_UNSTABLE_API ZlibCompressedDataPacket : CompressedDataPacket {
 
 struct NEOPG_UNSTABLE_API Bzip2CompressedDataPacket : CompressedDataPacket {
   std::vector<uint8_t> m_data;
-  void write_compressed_data(std::ostream& out) const override;
+  void write_compressed_data(ByteWriter& out) const override;
+  uint32_t compressed_data_length() const override { return m_data.size(); }
   CompressionAlgorithm compression_algorithm() const override;
 };
 
@@ -0,0 +1,79 @@
+// OpenPGP factory table
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains a table of parsers, indexed by packet or subpacket type.
+
+#pragma once
+
+#include <neopg/parser/parser_input.h>
+
+#include <array>
+#include <cstddef>
+#include <memory>
+
+namespace NeoPG {
+
+/// A table that maps the \p N values of the enum \p Type to functions that
+/// parse an object of (a subclass of) \p Base.  Creating an object is one
+/// indexed call, and new types (such as private packet types) can be added
+/// without changing the dispatch code.
+///
+/// The tables used by the library are global, see Packet::factories(),
+/// SignatureSubpacket::factories() and UserAttributeSubpacket::factories().
+/// They are not synchronized, so register additional types before parsing.
+template <typename Base, typename Type, size_t N>
+class FactoryTable {
+ public:
+  using Factory = std::unique_ptr<Base> (*)(Type type, ParserInput& in);
+
+  /// Create a table that calls \p fallback for all types.
+  explicit FactoryTable(Factory fallback) : m_fallback(fallback) {
+    m_factories.fill(fallback);
+  }
+
+  /// Parse objects of type \p type with \p factory.
+  void set(Type type, Factory factory) {
+    auto idx = static_cast<size_t>(type);
+    if (idx < N) m_factories[idx] = factory;
+  }
+
+  /// Parse objects of type \p type with T::create_or_throw(ParserInput&).
+  template <typename T>
+  void set(Type type) {
+    set(type, &create<T>);
+  }
+
+  /// Parse objects of type \p type with the fallback again.
+  void reset(Type type) { set(type, m_fallback); }
+
+  /// \return true if a factory other than the fallback is set for \p type
+  bool has(Type type) const noexcept { return get(type) != m_fallback; }
+
+  /// \return the factory for \p type
+  Factory get(Type type) const noexcept {
+    auto idx = static_cast<size_t>(type);
+    return idx < N ? m_factories[idx] : m_fallback;
+  }
+
+  /// Create an object of type \p type from \p in.
+  ///
+  /// \throws ParserError
+  std::unique_ptr<Base> create_or_throw(Type type, ParserInput& in) const {
+    return get(type)(type, in);
+  }
+
+  /// The factory for classes with a T::create_or_throw(ParserInput&).
+  template <typename T>
+  static std::unique_ptr<Base> create(Type type, ParserInput& in) {
+    return T::create_or_throw(in);
+  }
+
+ private:
+  std::array<Factory, N> m_factories;
+  Factory m_fallback;
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,85 @@
+// OpenPGP factory table (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/factory_table.h>
+
+#include <neopg/openpgp/marker_packet.h>
+#include <neopg/openpgp/packet.h>
+#include <neopg/openpgp/raw_packet.h>
+
+#include <neopg/intern/cplusplus.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace NeoPG;
+
+namespace {
+
+// A private packet type that keeps the length of its body.
+struct PrivatePacket : Packet {
+  size_t m_length{0};
+
+  static std::unique_ptr<PrivatePacket> create_or_throw(ParserInput& in) {
+    auto packet = NeoPG::make_unique<PrivatePacket>();
+    packet->m_length = in.size();
+    in.bump(in.size());
+    return packet;
+  }
+
+  void write_body(ByteWriter& out) const override {
+    out.put_bytes(std::string(m_length, 'x'));
+  }
+  PacketType type() const override { return PacketType::Private_60; }
+};
+
+}  // namespace
+
+TEST(NeopgTest, openpgp_factory_table_test) {
+  auto& table = Packet::factories();
+  const std::string data{"abc"};
+
+  {
+    // Known types are dispatched to their parser.
+    ParserInput in{"PGP", 3};
+    auto packet = Packet::create_or_throw(PacketType::Marker, in);
+    ASSERT_NE(dynamic_cast<MarkerPacket*>(packet.get()), nullptr);
+  }
+
+  {
+    // Unknown types fall back to RawPacket.
+    ParserInput in{data.data(), data.size()};
+    auto packet = Packet::create_or_throw(PacketType::Private_60, in);
+    auto raw = dynamic_cast<RawPacket*>(packet.get());
+    ASSERT_NE(raw, nullptr);
+    ASSERT_EQ(raw->type(), PacketType::Private_60);
+    ASSERT_EQ(raw->content(), data);
+  }
+
+  table.set<PrivatePacket>(PacketType::Private_60);
+  {
+    ParserInput in{data.data(), data.size()};
+    auto packet = Packet::create_or_throw(PacketType::Private_60, in);
+    auto priv = dynamic_cast<PrivatePacket*>(packet.get());
+    ASSERT_NE(priv, nullptr);
+    ASSERT_EQ(priv->m_length, data.size());
+  }
+  {
+    // Other private types are not affected.
+    ParserInput in{data.data(), data.size()};
+    auto packet = Packet::create_or_throw(PacketType::Private_61, in);
+    ASSERT_NE(dynamic_cast<RawPacket*>(packet.get()), nullptr);
+  }
+
+  table.reset(PacketType::Private_60);
+  {
+    ParserInput in{data.data(), data.size()};
+    auto packet = Packet::create_or_throw(PacketType::Private_60, in);
+    ASSERT_NE(dynamic_cast<RawPacket*>(packet.get()), nullptr);
+  }
+}
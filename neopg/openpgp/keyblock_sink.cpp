@@ -0,0 +1,122 @@
+// OpenPGP keyblock sink (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/keyblock_sink.h>
+
+#include <neopg/openpgp/raw_packet.h>
+
+#include <neopg/intern/cplusplus.h>
+
+using namespace NeoPG;
+
+namespace {
+bool is_primary(PacketType type) {
+  return type == PacketType::PublicKey || type == PacketType::SecretKey;
+}
+
+bool is_subkey(PacketType type) {
+  return type == PacketType::PublicSubkey || type == PacketType::SecretSubkey;
+}
+
+bool is_user(PacketType type) {
+  return type == PacketType::UserId || type == PacketType::UserAttribute;
+}
+}  // namespace
+
+void KeyblockSink::finish() {
+  if (m_cert) m_sink.next_certificate(std::move(m_cert));
+  m_component = nullptr;
+}
+
+bool KeyblockSink::wanted(PacketType type) {
+  if (is_primary(type)) return true;
+  if (!m_cert) {
+    m_skipped++;
+    return false;
+  }
+  if (type == PacketType::Signature && m_max_signatures != UNLIMITED &&
+      m_component->m_signatures.size() >= m_max_signatures) {
+    m_cert->m_dropped_signatures++;
+    return false;
+  }
+  return true;
+}
+
+void KeyblockSink::add(std::unique_ptr<PacketHeader> header, const char* data,
+                       size_t length) {
+  auto type = header->type();
+  auto create = [&]() {
+    std::unique_ptr<ParserError> error;
+    ParserInput in{data, length};
+    std::unique_ptr<Packet> packet = Packet::try_create(type, in, error);
+    if (!packet) {
+      // Keep the packet, so the certificate is complete.
+      packet = NeoPG::make_unique<RawPacket>(type, std::string(data, length));
+    }
+    packet->m_header = std::move(header);
+    return packet;
+  };
+  std::shared_ptr<const Packet> packet;
+  if (m_pool)
+    packet = m_pool->intern(type, data, length, create);
+  else
+    packet = create();
+
+  if (is_primary(type)) {
+    finish();
+    m_cert = NeoPG::make_unique<Certificate>();
+    m_component = &m_cert->m_primary;
+  }
+
+  size_t pos = m_cert->m_packets.size();
+  m_cert->m_packets.emplace_back(std::move(packet));
+  if (is_user(type)) {
+    m_cert->m_users.emplace_back(pos);
+    m_component = &m_cert->m_users.back();
+  } else if (is_subkey(type)) {
+    m_cert->m_subkeys.emplace_back(pos);
+    m_component = &m_cert->m_subkeys.back();
+  } else if (type == PacketType::Signature) {
+    m_component->m_signatures.push_back(pos);
+  }
+}
+
+void KeyblockSink::next_packet(std::unique_ptr<PacketHeader> header,
+                               const char* data, size_t length) {
+  if (!wanted(header->type())) return;
+  add(std::move(header), data, length);
+}
+
+void KeyblockSink::start_packet(std::unique_ptr<PacketHeader> header) {
+  m_skip_partial = !wanted(header->type());
+  m_header = std::move(header);
+  m_data.clear();
+}
+
+void KeyblockSink::continue_packet(std::unique_ptr<NewPacketLength> length_info,
+                                   const char* data, size_t length) {
+  if (!m_skip_partial) m_data.append(data, length);
+}
+
+void KeyblockSink::finish_packet(std::unique_ptr<NewPacketLength> length_info,
+                                 const char* data, size_t length) {
+  if (m_skip_partial) return;
+  m_data.append(data, length);
+  // Replace the header by one that matches the reassembled body.
+  auto type = m_header->type();
+  auto offset = m_header->m_offset;
+  if (m_header->format() == PacketFormat::New)
+    m_header = NewPacketHeader::create_or_throw(type, m_data.size());
+  else
+    m_header = OldPacketHeader::create_or_throw(type, m_data.size());
+  m_header->m_offset = offset;
+  add(std::move(m_header), m_data.data(), m_data.size());
+  m_data.clear();
+}
+
+void KeyblockSink::error_packet(std::unique_ptr<PacketHeader> header,
+                                std::unique_ptr<ParserError> error) {
+  m_skipped++;
+}
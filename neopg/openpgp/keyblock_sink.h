@@ -0,0 +1,140 @@
+// OpenPGP keyblock sink
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains support for grouping packets into certificates.
+
+#pragma once
+
+#include <neopg/openpgp/packet.h>
+#include <neopg/openpgp/packet_pool.h>
+#include <neopg/parser/openpgp.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NeoPG {
+
+/// A certificate (transferable public key), as assembled by a KeyblockSink.
+///
+/// All packets are stored in stream order in one vector.  The components
+/// refer to their packet and signatures by position in that vector, so
+/// walking a certificate does not chase pointers between list nodes.
+struct NEOPG_UNSTABLE_API Certificate {
+  /// A key, user ID or user attribute, with the signatures that follow it.
+  struct Component {
+    Component(size_t packet) : m_packet(packet) {}
+
+    /// The position of the key or user packet in m_packets.
+    size_t m_packet;
+
+    /// The positions of the signature packets in m_packets.
+    std::vector<size_t> m_signatures;
+  };
+
+  /// All packets of the certificate, in stream order.  Packets that could not
+  /// be decoded are stored as RawPacket.  Packets may be shared with other
+  /// certificates, see PacketPool.
+  std::vector<std::shared_ptr<const Packet>> m_packets;
+
+  /// The primary key, and the signatures directly on it (revocations and
+  /// direct key signatures).
+  Component m_primary{0};
+
+  /// The user IDs and user attributes.
+  std::vector<Component> m_users;
+
+  /// The subkeys.
+  std::vector<Component> m_subkeys;
+
+  /// The number of signatures that were dropped because of the limit on
+  /// signatures per component.
+  size_t m_dropped_signatures{0};
+
+  /// \return the packet of \p component
+  const Packet& packet(const Component& component) const {
+    return *m_packets[component.m_packet];
+  }
+
+  /// \return the signature \p i of \p component
+  const Packet& signature(const Component& component, size_t i) const {
+    return *m_packets[component.m_signatures[i]];
+  }
+};
+
+/// Receive certificates from a KeyblockSink.
+class NEOPG_UNSTABLE_API CertificateSink {
+ public:
+  /// A certificate is complete.  Takes ownership of \p cert.
+  virtual void next_certificate(std::unique_ptr<Certificate> cert) = 0;
+
+  // Prevent memory leak when upcasting in smart pointer containers.
+  virtual ~CertificateSink() = default;
+};
+
+/// A RawPacketSink that groups the packets of a keyring or key export into
+/// certificates: a primary key, followed by user IDs, user attributes and
+/// subkeys, each with its signatures.  A certificate is passed on when the
+/// next primary key starts, or when finish() is called at the end of the
+/// input.
+///
+/// Packets before the first primary key are skipped.  Signatures that don't
+/// fit under the limit \p max_signatures (per component) are skipped without
+/// decoding them, so flooded certificates use bounded memory.
+class NEOPG_UNSTABLE_API KeyblockSink : public RawPacketSink {
+ public:
+  /// No limit on the number of signatures per component.
+  static const size_t UNLIMITED = 0;
+
+  KeyblockSink(CertificateSink& sink, size_t max_signatures = UNLIMITED)
+      : m_sink(sink), m_max_signatures(max_signatures) {}
+
+  /// Pass on the last certificate.  Call this at the end of the input.
+  void finish();
+
+  /// Share identical packets through \p pool (nullptr disables sharing).
+  /// The pool must outlive the sink.
+  void set_pool(PacketPool* pool) { m_pool = pool; }
+
+  /// The number of packets that were skipped because they are not part of a
+  /// certificate, or could not be framed.  Packets that can be framed but not
+  /// decoded are kept as RawPacket.
+  size_t m_skipped{0};
+
+  // Implement interface of RawPacketSink.
+  void next_packet(std::unique_ptr<PacketHeader> header, const char* data,
+                   size_t length) override;
+  void start_packet(std::unique_ptr<PacketHeader> header) override;
+  void continue_packet(std::unique_ptr<NewPacketLength> length_info,
+                       const char* data, size_t length) override;
+  void finish_packet(std::unique_ptr<NewPacketLength> length_info,
+                     const char* data, size_t length) override;
+  void error_packet(std::unique_ptr<PacketHeader> header,
+                    std::unique_ptr<ParserError> error) override;
+
+ private:
+  CertificateSink& m_sink;
+  size_t m_max_signatures;
+  PacketPool* m_pool{nullptr};
+
+  // The certificate being assembled, and the component signatures are added
+  // to.
+  std::unique_ptr<Certificate> m_cert;
+  Certificate::Component* m_component{nullptr};
+
+  // The current partial packet.
+  std::unique_ptr<PacketHeader> m_header;
+  std::string m_data;
+  bool m_skip_partial{false};
+
+  // Return false (and count it) if a packet of type TYPE is skipped before
+  // decoding.
+  bool wanted(PacketType type);
+  void add(std::unique_ptr<PacketHeader> header, const char* data,
+           size_t length);
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,105 @@
+// OpenPGP keyblock sink (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/keyblock_sink.h>
+
+#include <neopg/openpgp/raw_packet.h>
+#include <neopg/openpgp/user_id_packet.h>
+
+#include <sstream>
+
+#include "gtest/gtest.h"
+
+using namespace NeoPG;
+
+namespace {
+class TestCertificateSink : public CertificateSink {
+ public:
+  std::vector<std::unique_ptr<Certificate>> m_certs;
+
+  void next_certificate(std::unique_ptr<Certificate> cert) override {
+    m_certs.emplace_back(std::move(cert));
+  }
+};
+
+std::string keyring() {
+  ByteWriter out;
+  // Packets before the first key are skipped.
+  RawPacket{PacketType::Signature, "orphan"}.write(out);
+  RawPacket{PacketType::PublicKey, "key1"}.write(out);
+  RawPacket{PacketType::Signature, "revocation"}.write(out);
+  UserIdPacket alice;
+  alice.m_content = "alice";
+  alice.write(out);
+  RawPacket{PacketType::Signature, "sig1"}.write(out);
+  RawPacket{PacketType::Trust, "t"}.write(out);
+  RawPacket{PacketType::Signature, "sig2"}.write(out);
+  RawPacket{PacketType::Signature, "sig3"}.write(out);
+  RawPacket{PacketType::PublicSubkey, "sub1"}.write(out);
+  RawPacket{PacketType::Signature, "binding"}.write(out);
+  RawPacket{PacketType::PublicKey, "key2"}.write(out);
+  return out.str();
+}
+
+std::string content(const Packet& packet) {
+  ByteWriter out;
+  packet.write_body(out);
+  return out.str();
+}
+}  // namespace
+
+TEST(NeopgTest, openpgp_keyblock_sink_test) {
+  TestCertificateSink certs;
+  KeyblockSink sink{certs};
+  RawPacketParser parser{sink};
+  parser.process(keyring());
+  ASSERT_EQ(certs.m_certs.size(), 1);
+  sink.finish();
+  ASSERT_EQ(certs.m_certs.size(), 2);
+  ASSERT_EQ(sink.m_skipped, 1);
+
+  const Certificate& cert = *certs.m_certs[0];
+  ASSERT_EQ(cert.m_packets.size(), 9);
+  ASSERT_EQ(cert.m_dropped_signatures, 0);
+  ASSERT_EQ(content(cert.packet(cert.m_primary)), "key1");
+  ASSERT_EQ(cert.m_primary.m_signatures.size(), 1);
+  ASSERT_EQ(content(cert.signature(cert.m_primary, 0)), "revocation");
+
+  ASSERT_EQ(cert.m_users.size(), 1);
+  const auto& user = cert.m_users[0];
+  ASSERT_EQ(cert.packet(user).type(), PacketType::UserId);
+  ASSERT_EQ(dynamic_cast<const UserIdPacket&>(cert.packet(user)).m_content,
+            "alice");
+  ASSERT_EQ(user.m_signatures.size(), 3);
+  ASSERT_EQ(content(cert.signature(user, 2)), "sig3");
+  // The trust packet is kept, but not a signature.
+  ASSERT_EQ(cert.m_packets[user.m_signatures[1] - 1]->type(),
+            PacketType::Trust);
+
+  ASSERT_EQ(cert.m_subkeys.size(), 1);
+  ASSERT_EQ(content(cert.packet(cert.m_subkeys[0])), "sub1");
+  ASSERT_EQ(cert.m_subkeys[0].m_signatures.size(), 1);
+
+  const Certificate& cert2 = *certs.m_certs[1];
+  ASSERT_EQ(cert2.m_packets.size(), 1);
+  ASSERT_EQ(cert2.m_users.size(), 0);
+}
+
+TEST(NeopgTest, openpgp_keyblock_sink_bounded_test) {
+  TestCertificateSink certs;
+  KeyblockSink sink{certs, 2};
+  RawPacketParser parser{sink};
+  parser.process(keyring());
+  sink.finish();
+  ASSERT_EQ(certs.m_certs.size(), 2);
+
+  const Certificate& cert = *certs.m_certs[0];
+  ASSERT_EQ(cert.m_packets.size(), 8);
+  ASSERT_EQ(cert.m_dropped_signatures, 1);
+  ASSERT_EQ(sink.m_skipped, 1);
+  ASSERT_EQ(cert.m_users[0].m_signatures.size(), 2);
+  ASSERT_EQ(content(cert.signature(cert.m_users[0], 1)), "sig2");
+  ASSERT_EQ(cert.m_subkeys[0].m_signatures.size(), 1);
+}
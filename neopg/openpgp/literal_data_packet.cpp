@@ -8,22 +8,32 @@
 
 namespace NeoPG {
 
-void LiteralDataPacket::write_body(std::ostream& out) const {
-  out << (uint8_t)m_data_type;
+void LiteralDataPacket::write_body(ByteWriter& out) const {
+  write_body_prefix(out);
+  out.put_bytes(m_data.data(), m_data.size());
+}
+
+void LiteralDataPacket::write_body_prefix(ByteWriter& out) const {
+  out.put_u8(static_cast<uint8_t>(m_data_type));
 
   if (m_filename.length() > 255) {
     throw std::logic_error("filename too long");
   }
 
-  out << (uint8_t)m_filename.size();
-  out.write(m_filename.data(), m_filename.size());
+  out.put_u8((uint8_t)m_filename.size());
+  out.put_bytes(m_filename.data(), m_filename.size());
 
-  out << ((uint8_t)((m_timestamp >> 24) & 0xff))
-      << ((uint8_t)((m_timestamp >> 16) & 0xff))
-      << ((uint8_t)((m_timestamp >> 8) & 0xff))
-      << ((uint8_t)(m_timestamp & 0xff));
+  out.put_u32be(m_timestamp);
+}
+
+void LiteralDataPacket::write_body_prefix(std::ostream& out) const {
+  ByteWriter writer{out};
+  write_body_prefix(writer);
+}
 
-  out.write((char*)m_data.data(), m_data.size());
+uint32_t LiteralDataPacket::body_length() const {
+  // Data type, filename length, filename, timestamp, data.
+  return 1 + 1 + m_filename.size() + 4 + m_data.size();
 }
 
 PacketType LiteralDataPacket::type() const { return PacketType::LiteralData; }
@@ -27,8 +27,17 @@ struct NEOPG_UNSTABLE_API LiteralDataPacket : Packet {
   uint32_t m_timestamp = 0;
   std::vector<uint8_t> m_data;
 
-  void write_body(std::ostream& out) const override;
+  void write_body(ByteWriter& out) const override;
+  uint32_t body_length() const override;
+
   PacketType type() const override;
+
+  /// Write the fields preceding m_data (for use with PacketStream).
+  void write_body_prefix(ByteWriter& out) const;
+
+  /// Write the fields preceding m_data to a PacketStream or other
+  /// std::ostream.
+  void write_body_prefix(std::ostream& out) const;
 };
 
 }  // namespace NeoPG
@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(NeopgTest, openpgp_literal_data_packet_test) {
   {
-    std::stringstream out;
+    ByteWriter out;
     LiteralDataPacket packet;
     packet.write(out);
     ASSERT_EQ(out.str(), std::string("\xCB\x06"
@@ -23,7 +23,7 @@ TEST(NeopgTest, openpgp_literal_data_packet_test) {
   }
 
   {
-    std::stringstream out;
+    ByteWriter out;
     LiteralDataPacket packet;
     packet.m_filename = "test_test_hello.world";
     packet.write(out);
@@ -33,7 +33,7 @@ TEST(NeopgTest, openpgp_literal_data_packet_test) {
   }
 
   {
-    std::stringstream out;
+    ByteWriter out;
     LiteralDataPacket packet;
     packet.m_timestamp = 0x12345678;
     packet.write(out);
@@ -43,7 +43,7 @@ TEST(NeopgTest, openpgp_literal_data_packet_test) {
   }
 
   {
-    std::stringstream out;
+    ByteWriter out;
     LiteralDataPacket packet;
     packet.m_data_type = LiteralDataType::Text;
     packet.write(out);
@@ -54,9 +54,25 @@ TEST(NeopgTest, openpgp_literal_data_packet_test) {
 
   /* Failures.  */
   {
-    std::stringstream out;
+    ByteWriter out;
     LiteralDataPacket packet;
     packet.m_filename = std::string(256, 'A');
     ASSERT_THROW(packet.write(out), std::logic_error);
   }
 }
+
+TEST(NeopgTest, openpgp_literal_data_packet_length_test) {
+  LiteralDataPacket packet;
+  packet.m_filename = "hello.txt";
+  packet.m_data = std::vector<uint8_t>(300, 0x41);
+
+  ByteWriter body;
+  packet.write_body(body);
+  ASSERT_EQ(packet.body_length(), body.str().size());
+
+  ByteWriter out;
+  packet.write(out);
+  std::string buffer;
+  packet.write(buffer);
+  ASSERT_EQ(buffer, out.str());
+}
@@ -30,7 +30,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -46,17 +46,15 @@ const std::string control<eof>::error_message =
 }  // namespace NeoPG
 
 std::unique_ptr<MarkerPacket> MarkerPacket::create(ParserInput& in) {
-  try {
-    return MarkerPacket::create_or_throw(in);
-  } catch (const ParserError&) {
-    return nullptr;
-  }
+  return ParserErrorTrap::call(&MarkerPacket::create_or_throw, in);
 }
 
 std::unique_ptr<MarkerPacket> MarkerPacket::create_or_throw(ParserInput& in) {
   pegtl::parse<marker_packet::grammar, pegtl::nothing, marker_packet::control>(
-      in.m_impl->m_input);
+      in.impl().m_input);
   return NeoPG::make_unique<MarkerPacket>();
 }
 
-void MarkerPacket::write_body(std::ostream& out) const { out << MARKER; }
+void MarkerPacket::write_body(ByteWriter& out) const { out.put_bytes(MARKER); }
+
+uint32_t MarkerPacket::body_length() const { return sizeof(MARKER) - 1; }
@@ -41,10 +41,15 @@ class NEOPG_UNSTABLE_API MarkerPacket : public Packet {
   /// \throws ParserError
   static std::unique_ptr<MarkerPacket> create_or_throw(ParserInput& input);
 
-  /// Write the packet body to the output stream.
+  /// Write the packet body to the output.
   ///
-  /// \param out the output stream to write to
-  void write_body(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write_body(ByteWriter& out) const override;
+
+  /// Return the length of the packet body.
+  ///
+  /// \return the length of the marker
+  uint32_t body_length() const override;
 
   /// Return the packet type.
   ///
@@ -52,7 +52,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -69,11 +69,8 @@ const std::string control<eof>::error_message = "mdc packet is too large";
 
 std::unique_ptr<ModificationDetectionCodePacket>
 ModificationDetectionCodePacket::create(ParserInput& in) {
-  try {
-    return ModificationDetectionCodePacket::create_or_throw(in);
-  } catch (const ParserError&) {
-    return nullptr;
-  }
+  return ParserErrorTrap::call(
+      &ModificationDetectionCodePacket::create_or_throw, in);
 }
 
 std::unique_ptr<ModificationDetectionCodePacket>
@@ -81,10 +78,10 @@ ModificationDetectionCodePacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<ModificationDetectionCodePacket>();
 
   pegtl::parse<mdc_packet::grammar, mdc_packet::action, mdc_packet::control>(
-      in.m_impl->m_input, *packet.get());
+      in.impl().m_input, *packet.get());
   return packet;
 }
 
-void ModificationDetectionCodePacket::write_body(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_mdc.data()), m_mdc.size());
+void ModificationDetectionCodePacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_mdc.data(), m_mdc.size());
 }
@@ -49,10 +49,15 @@ struct NEOPG_UNSTABLE_API ModificationDetectionCodePacket : Packet {
   /// The MDC data.
   std::array<uint8_t, LENGTH> m_mdc;
 
-  /// Write the packet body to the output stream.
+  /// Write the packet body to the output.
   ///
-  /// \param out the output stream to write to
-  void write_body(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write_body(ByteWriter& out) const override;
+
+  /// Return the length of the packet body.
+  ///
+  /// \return the value #LENGTH
+  uint32_t body_length() const override { return LENGTH; }
 
   /// Return the packet type.
   ///
@@ -58,6 +58,19 @@ struct action<bits> {
   }
 };
 
+// Like action, but borrow the bits from the input.
+template <typename Rule>
+struct view_action : action<Rule> {};
+
+template <>
+struct view_action<bits> {
+  template <typename Input>
+  static void apply(const Input& in, MultiprecisionInteger& mpi) {
+    auto begin = reinterpret_cast<const uint8_t*>(in.begin());
+    mpi.m_bits.borrow(begin, in.size());
+  }
+};
+
 // Control
 template <typename Rule>
 struct control : pegtl::normal<Rule> {
@@ -65,7 +78,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -78,16 +91,21 @@ const std::string control<bits>::error_message = "mpi bits are invalid";
 }  // namespace mpi
 }  // namespace NeoPG
 
-void MultiprecisionInteger::write(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_length >> 8) << static_cast<uint8_t>(m_length);
-  out.write(reinterpret_cast<const char*>(m_bits.data()), m_bits.size());
+void MultiprecisionInteger::write(ByteWriter& out) const {
+  out.put_u16be(m_length);
+  out.put_bytes(m_bits.data(), m_bits.size());
 }
 
 void MultiprecisionInteger::parse(ParserInput& in) {
-  pegtl::parse<mpi::grammar, mpi::action, mpi::control>(in.m_impl->m_input,
+  pegtl::parse<mpi::grammar, mpi::action, mpi::control>(in.impl().m_input,
                                                         *this);
 }
 
+void MultiprecisionInteger::parse_view(ParserInput& in) {
+  pegtl::parse<mpi::grammar, mpi::view_action, mpi::control>(
+      in.impl().m_input, *this);
+}
+
 MultiprecisionInteger::MultiprecisionInteger(uint64_t nr) {
   auto bigint = Botan::BigInt{nr};
   m_length = bigint.bits();
@@ -6,6 +6,8 @@
 #pragma once
 
 #include <neopg/parser/parser_input.h>
+#include <neopg/utils/byte_writer.h>
+#include <neopg/utils/small_buffer.h>
 
 #include <memory>
 #include <vector>
@@ -16,23 +18,34 @@ namespace NeoPG {
 /// values.
 class NEOPG_UNSTABLE_API MultiprecisionInteger {
  public:
+  /// The mpi data.  Values up to 64 bytes (ECC points and scalars) are stored
+  /// inline, larger values (RSA, DSA and ElGamal) on the heap.
+  using Bits = SmallBuffer<64>;
+
   uint16_t m_length{0};
-  std::vector<uint8_t> m_bits;
+  Bits m_bits;
 
   /// Fill the instance from the input.
   /// @param input parser input with mpi data
   /// Throws ParserError if input can not be parsed.
   void parse(ParserInput& in);
 
+  /// Like parse(), but do not copy the mpi data.  Instead, m_bits refers to
+  /// the data of \p in, which must outlive this instance (and all its
+  /// copies), or until m_bits.own() is called.
+  /// @param input parser input with mpi data
+  /// Throws ParserError if input can not be parsed.
+  void parse_view(ParserInput& in);
+
   /// @return the length in bits
   uint16_t length() const noexcept { return m_length; }
 
   /// @return the mpi data
-  const std::vector<uint8_t>& bits() const noexcept { return m_bits; }
+  const Bits& bits() const noexcept { return m_bits; }
 
-  /// Write the mpi to the output stream.
-  /// @param out output stream
-  void write(std::ostream& out) const;
+  /// Write the mpi to the output.
+  /// @param out output
+  void write(ByteWriter& out) const;
 
   MultiprecisionInteger() = default;
   MultiprecisionInteger(uint64_t nr);
@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(NeopgTest, openpgp_multiprecision_integer_test) {
   {
-    std::stringstream out;
+    ByteWriter out;
     MultiprecisionInteger mpi;
     mpi.m_length = 1;
     mpi.m_bits.assign({0x01});
@@ -23,7 +23,7 @@ TEST(NeopgTest, openpgp_multiprecision_integer_test) {
   }
 
   {
-    std::stringstream out;
+    ByteWriter out;
     MultiprecisionInteger mpi(0x16234);
     ASSERT_EQ(mpi.m_length, 17);
     ASSERT_EQ(mpi.m_bits, std::vector<uint8_t>({0x01, 0x62, 0x34}));
@@ -31,3 +31,50 @@ TEST(NeopgTest, openpgp_multiprecision_integer_test) {
     ASSERT_EQ(out.str(), std::string("\x00\x11\x01\x62\x34", 5));
   }
 }
+
+TEST(NeopgTest, openpgp_multiprecision_integer_storage_test) {
+  // ECC sized values are stored inline.
+  const std::string small{"\x01\x00", 2};
+  {
+    std::string raw = small + std::string(32, '\x42');
+    ParserInput in(raw.data(), raw.size());
+    MultiprecisionInteger mpi;
+    mpi.parse(in);
+    ASSERT_EQ(mpi.m_length, 256);
+    ASSERT_EQ(mpi.m_bits.size(), 32);
+    ASSERT_FALSE(mpi.m_bits.borrowed());
+    ByteWriter out;
+    mpi.write(out);
+    ASSERT_EQ(out.str(), raw);
+  }
+
+  // RSA sized values spill to the heap.
+  const std::string large{"\x08\x00", 2};
+  {
+    std::string raw = large + std::string(256, '\x42');
+    ParserInput in(raw.data(), raw.size());
+    MultiprecisionInteger mpi;
+    mpi.parse(in);
+    ASSERT_EQ(mpi.m_bits.size(), 256);
+    MultiprecisionInteger copy = mpi;
+    ASSERT_EQ(copy, mpi);
+    ByteWriter out;
+    copy.write(out);
+    ASSERT_EQ(out.str(), raw);
+  }
+
+  // The view parser borrows the data from the input.
+  {
+    std::string raw = large + std::string(256, '\x42');
+    ParserInput in(raw.data(), raw.size());
+    MultiprecisionInteger mpi;
+    mpi.parse_view(in);
+    ASSERT_TRUE(mpi.m_bits.borrowed());
+    ASSERT_EQ(mpi.m_bits.data(),
+              reinterpret_cast<const uint8_t*>(raw.data()) + 2);
+    mpi.m_bits.own();
+    ASSERT_FALSE(mpi.m_bits.borrowed());
+    raw[2] = '\x00';
+    ASSERT_EQ(mpi.m_bits[0], 0x42);
+  }
+}
@@ -11,8 +11,64 @@
 #include <neopg/intern/cplusplus.h>
 #include <neopg/intern/pegtl.h>
 
+#include <cstring>
+#include <stdexcept>
+
 using namespace NeoPG;
 
+namespace {
+struct KnownCurve {
+  Curve m_curve;
+  const char* m_name;
+  uint8_t m_length;
+  uint8_t m_data[10];
+};
+
+// The encoded OIDs of the curves of RFC 6637 and RFC 4880bis.
+constexpr KnownCurve KNOWN_CURVES[] = {
+    // 1.2.840.10045.3.1.7
+    {Curve::NistP256,
+     "secp256r1",
+     8,
+     {0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07}},
+    // 1.3.132.0.34
+    {Curve::NistP384, "secp384r1", 5, {0x2b, 0x81, 0x04, 0x00, 0x22}},
+    // 1.3.132.0.35
+    {Curve::NistP521, "secp521r1", 5, {0x2b, 0x81, 0x04, 0x00, 0x23}},
+    // 1.3.36.3.3.2.8.1.1.7
+    {Curve::BrainpoolP256r1,
+     "brainpool256r1",
+     9,
+     {0x2b, 0x24, 0x03, 0x03, 0x02, 0x08, 0x01, 0x01, 0x07}},
+    // 1.3.36.3.3.2.8.1.1.11
+    {Curve::BrainpoolP384r1,
+     "brainpool384r1",
+     9,
+     {0x2b, 0x24, 0x03, 0x03, 0x02, 0x08, 0x01, 0x01, 0x0b}},
+    // 1.3.36.3.3.2.8.1.1.13
+    {Curve::BrainpoolP512r1,
+     "brainpool512r1",
+     9,
+     {0x2b, 0x24, 0x03, 0x03, 0x02, 0x08, 0x01, 0x01, 0x0d}},
+    // 1.3.6.1.4.1.11591.15.1
+    {Curve::Ed25519,
+     "Ed25519",
+     9,
+     {0x2b, 0x06, 0x01, 0x04, 0x01, 0xda, 0x47, 0x0f, 0x01}},
+    // 1.3.6.1.4.1.3029.1.5.1
+    {Curve::Curve25519,
+     "Curve25519",
+     10,
+     {0x2b, 0x06, 0x01, 0x04, 0x01, 0x97, 0x55, 0x01, 0x05, 0x01}},
+};
+
+const KnownCurve* find_curve(Curve curve) noexcept {
+  for (const auto& known : KNOWN_CURVES)
+    if (known.m_curve == curve) return &known;
+  return nullptr;
+}
+}  // namespace
+
 namespace NeoPG {
 namespace oid {
 using namespace pegtl;
@@ -53,14 +109,16 @@ struct action<oid> {
   static void apply(const Input& in, uint8_t& length, ObjectIdentifier& oid) {
     auto begin = reinterpret_cast<const uint8_t*>(in.begin());
     oid.m_data.assign(begin, begin + in.size());
+    // Known curves are valid.
+    if (oid.curve() != Curve::Unknown) return;
 
     try {
       // Test suitability for parsing and printing.
       auto oidstr = oid.as_string();
       Botan::OID oid(oidstr);
     } catch (const Botan::Decoding_Error& exc) {
-      throw parser_error(std::string("oid decoding error (") + exc.what() + ")",
-                         in);
+      raise_parser_error(
+          std::string("oid decoding error (") + exc.what() + ")", in);
     }
   }
 };
@@ -72,7 +130,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -91,7 +149,7 @@ const std::string ObjectIdentifier::as_string() const {
   std::vector<uint8_t> data;
   data.emplace_back(static_cast<uint8_t>(0x06));
   data.emplace_back(static_cast<uint8_t>(m_data.size()));
-  data.insert(std::end(data), std::begin(m_data), std::end(m_data));
+  data.insert(std::end(data), m_data.begin(), m_data.end());
 
   Botan::BER_Decoder decoder(data);
   Botan::OID oid;
@@ -99,16 +157,35 @@ const std::string ObjectIdentifier::as_string() const {
   return oid.as_string();
 }
 
-void ObjectIdentifier::write(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_data.size());
-  out.write(reinterpret_cast<const char*>(m_data.data()), m_data.size());
+void ObjectIdentifier::write(ByteWriter& out) const {
+  out.put_u8(m_data.size());
+  out.put_bytes(m_data.data(), m_data.size());
 }
 
 void ObjectIdentifier::parse(ParserInput& in) {
   uint8_t length = 0;
-  pegtl::parse<oid::grammar, oid::action, oid::control>(in.m_impl->m_input,
+  // The action validates the OID.
+  pegtl::parse<oid::grammar, oid::action, oid::control>(in.impl().m_input,
                                                         length, *this);
+}
+
+Curve ObjectIdentifier::curve() const noexcept {
+  for (const auto& known : KNOWN_CURVES)
+    if (known.m_length == m_data.size() &&
+        std::memcmp(known.m_data, m_data.data(), known.m_length) == 0)
+      return known.m_curve;
+  return Curve::Unknown;
+}
+
+ObjectIdentifier ObjectIdentifier::for_curve(Curve curve) {
+  const KnownCurve* known = find_curve(curve);
+  if (!known) throw std::invalid_argument("unknown curve");
+  ObjectIdentifier oid;
+  oid.m_data.assign(known->m_data, known->m_data + known->m_length);
+  return oid;
+}
 
-  // Make sure it is valid.  FIXME: Cache result?
-  as_string();
+const char* ObjectIdentifier::curve_name(Curve curve) noexcept {
+  const KnownCurve* known = find_curve(curve);
+  return known ? known->m_name : "unknown";
 }
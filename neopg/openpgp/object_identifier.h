@@ -6,16 +6,35 @@
 #pragma once
 
 #include <neopg/parser/parser_input.h>
+#include <neopg/utils/byte_writer.h>
+#include <neopg/utils/small_buffer.h>
 
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace NeoPG {
 
+/// The elliptic curves known to OpenPGP, see ObjectIdentifier::curve().
+enum class NEOPG_UNSTABLE_API Curve : uint8_t {
+  Unknown = 0,
+  NistP256,
+  NistP384,
+  NistP521,
+  BrainpoolP256r1,
+  BrainpoolP384r1,
+  BrainpoolP512r1,
+  Ed25519,
+  Curve25519
+};
+
 /// [ObjectIdentifier](https://tools.ietf.org/html/rfc6637#section-11)
 class NEOPG_UNSTABLE_API ObjectIdentifier {
  public:
-  std::vector<uint8_t> m_data;
+  /// The encoded OID.  Curve OIDs (at most 10 bytes) are stored inline.
+  using Data = SmallBuffer<16>;
+
+  Data m_data;
 
   /// Fill the instance from the input.
   /// @param input parser input with mpi data
@@ -26,14 +45,26 @@ class NEOPG_UNSTABLE_API ObjectIdentifier {
   uint16_t length() const noexcept { return m_data.size(); }
 
   /// @return the octet data
-  const std::vector<uint8_t>& data() const noexcept { return m_data; }
+  const Data& data() const noexcept { return m_data; }
 
-  /// Write the mpi to the output stream.
-  /// @param out output stream
-  void write(std::ostream& out) const;
+  /// Write the mpi to the output.
+  /// @param out output
+  void write(ByteWriter& out) const;
 
+  /// @return the dotted decimal notation
   const std::string as_string() const;
 
+  /// Look up the OID in the table of known curves.  This compares the encoded
+  /// bytes and does not decode the OID.
+  /// @return the curve, or Curve::Unknown
+  Curve curve() const noexcept;
+
+  /// @return the OID of \p curve, which must not be Curve::Unknown
+  static ObjectIdentifier for_curve(Curve curve);
+
+  /// @return the name of \p curve, as used by Botan
+  static const char* curve_name(Curve curve) noexcept;
+
   ObjectIdentifier() = default;
 };
 
@@ -9,12 +9,13 @@
 
 #include <memory>
 #include <sstream>
+#include <stdexcept>
 
 using namespace NeoPG;
 
 TEST(NeopgTest, openpgp_object_identifier_test) {
   {
-    std::stringstream out;
+    ByteWriter out;
     ObjectIdentifier oid;
     oid.m_data.assign({0x2b, 0x81, 0x04, 0x00, 0x23});
     oid.write(out);
@@ -22,3 +23,33 @@ TEST(NeopgTest, openpgp_object_identifier_test) {
     ASSERT_EQ(oid.as_string(), std::string("1.3.132.0.35"));
   }
 }
+
+TEST(NeopgTest, openpgp_object_identifier_curve_test) {
+  ObjectIdentifier oid;
+  oid.m_data.assign({0x2b, 0x81, 0x04, 0x00, 0x23});
+  ASSERT_EQ(oid.curve(), Curve::NistP521);
+  ASSERT_EQ(std::string(ObjectIdentifier::curve_name(oid.curve())),
+            "secp521r1");
+
+  oid.m_data.assign({0x2b, 0x81, 0x04, 0x00});
+  ASSERT_EQ(oid.curve(), Curve::Unknown);
+
+  for (auto curve : {Curve::NistP256, Curve::NistP384, Curve::NistP521,
+                     Curve::BrainpoolP256r1, Curve::BrainpoolP384r1,
+                     Curve::BrainpoolP512r1, Curve::Ed25519,
+                     Curve::Curve25519}) {
+    auto known = ObjectIdentifier::for_curve(curve);
+    ASSERT_EQ(known.curve(), curve);
+    ASSERT_FALSE(known.m_data.borrowed());
+  }
+  ASSERT_EQ(ObjectIdentifier::for_curve(Curve::Ed25519).as_string(),
+            "1.3.6.1.4.1.11591.15.1");
+  ASSERT_EQ(ObjectIdentifier::for_curve(Curve::Curve25519).as_string(),
+            "1.3.6.1.4.1.3029.1.5.1");
+  ASSERT_EQ(ObjectIdentifier::for_curve(Curve::NistP256).as_string(),
+            "1.2.840.10045.3.1.7");
+  ASSERT_EQ(ObjectIdentifier::for_curve(Curve::BrainpoolP384r1).as_string(),
+            "1.3.36.3.3.2.8.1.1.11");
+  ASSERT_THROW(ObjectIdentifier::for_curve(Curve::Unknown),
+               std::invalid_argument);
+}
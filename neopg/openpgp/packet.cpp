@@ -9,86 +9,142 @@
 #include <neopg/openpgp/public_key_packet.h>
 #include <neopg/openpgp/public_subkey_packet.h>
 #include <neopg/openpgp/raw_packet.h>
+#include <neopg/openpgp/raw_packet_view.h>
+#include <neopg/openpgp/round_trip_verifier.h>
 #include <neopg/openpgp/signature_packet.h>
 #include <neopg/openpgp/user_attribute_packet.h>
 #include <neopg/openpgp/user_id_packet.h>
 
 #include <neopg/parser/parser_input.h>
-#include <neopg/utils/stream.h>
+#include <neopg/parser/parser_stats.h>
 
 #include <assert.h>
 #include <neopg/intern/cplusplus.h>
 
-#ifndef NDEBUG
-#include <botan/hex.h>
-#include <sstream>
-#endif
-
 using namespace NeoPG;
 
+namespace {
+
+std::unique_ptr<Packet> create_raw_packet(PacketType type, ParserInput& in) {
+  // Should we do this?
+  return NeoPG::make_unique<RawPacket>(type, in.current(), in.size());
+}
+
+PacketFactoryTable make_factories() {
+  PacketFactoryTable table{create_raw_packet};
+  table.set<MarkerPacket>(PacketType::Marker);
+  table.set<UserIdPacket>(PacketType::UserId);
+  table.set<PublicKeyPacket>(PacketType::PublicKey);
+  table.set<PublicSubkeyPacket>(PacketType::PublicSubkey);
+  table.set<SignaturePacket>(PacketType::Signature);
+  table.set<UserAttributePacket>(PacketType::UserAttribute);
+  return table;
+}
+
+}  // namespace
+
+PacketFactoryTable& Packet::factories() {
+  static PacketFactoryTable table = make_factories();
+  return table;
+}
+
+namespace {
+
+// Parse a packet with the registered factory, and count it in the current
+// ParserStats.
+std::unique_ptr<Packet> decode(PacketType type, ParserInput& in) {
+  ParserStats* stats = ParserStats::current();
+  if (!stats) return Packet::factories().create_or_throw(type, in);
+
+  stats->m_decoded++;
+  ParserStats::Timer timer{stats->m_decode};
+  return Packet::factories().create_or_throw(type, in);
+}
+
+}  // namespace
+
 std::unique_ptr<Packet> Packet::create_or_throw(PacketType type,
                                                 ParserInput& in) {
+  // The input data stays valid, so we can verify against it without a copy.
+  const char* orig_data = in.current();
+  const size_t orig_size = in.size();
+
+  auto packet = decode(type, in);
+
+  RoundTripVerifier* verifier = RoundTripVerifier::global();
+  if (verifier) verifier->verify(*packet, orig_data, orig_size);
+  return packet;
+}
+
+std::unique_ptr<Packet> Packet::create_view_or_throw(PacketType type,
+                                                     ParserInput& in) {
+  if (factories().has(type)) return create_or_throw(type, in);
+  return NeoPG::make_unique<RawPacketView>(type, in.current(), in.size());
+}
+
+std::unique_ptr<Packet> Packet::try_create(
+    PacketType type, ParserInput& in, std::unique_ptr<ParserError>& error) {
+  const char* orig_data = in.current();
+  const size_t orig_size = in.size();
+
   std::unique_ptr<Packet> packet;
-#ifndef NDEBUG
-  std::string orig_data{in.current(), in.size()};
-#endif
-
-  switch (type) {
-    case PacketType::Marker:
-      packet = MarkerPacket::create_or_throw(in);
-      break;
-    case PacketType::UserId:
-      packet = UserIdPacket::create_or_throw(in);
-      break;
-    case PacketType::PublicKey:
-      packet = PublicKeyPacket::create_or_throw(in);
-      break;
-    case PacketType::PublicSubkey:
-      packet = PublicSubkeyPacket::create_or_throw(in);
-      break;
-    case PacketType::Signature:
-      packet = SignaturePacket::create_or_throw(in);
-      break;
-    case PacketType::UserAttribute:
-      packet = UserAttributePacket::create_or_throw(in);
-      break;
-    default:
-      // Should we do this?
-      packet = NeoPG::make_unique<RawPacket>(
-          type, std::string(in.current(), in.size()));
-      break;
+  {
+    ParserErrorTrap trap;
+    try {
+      packet = decode(type, in);
+    } catch (const ParserError& exc) {
+      error = NeoPG::make_unique<ParserError>(exc);
+      return nullptr;
+    }
+    if (trap.failed()) {
+      error = trap.take_error();
+      return nullptr;
+    }
   }
 
-#ifndef NDEBUG
-  /// Output the packet data and verify that it outputs to
-  /// exactly the same bytes as the original data.
-  std::stringstream out;
-  packet->write_body(out);
-  // if (orig_data != out.str()) {
-  //   std::cout << "ORIG: "
-  //             << Botan::hex_encode((const uint8_t*)orig_data.data(),
-  //                                  orig_data.size())
-  //             << "\n";
-  //   std::string o = out.str();
-  //   std::cout << "PARS: "
-  //             << Botan::hex_encode((const uint8_t*)o.data(), o.size()) <<
-  //             "\n";
-  // }
-  assert(orig_data == out.str());
-#endif
+  // Malformed packets are incomplete, so only verify successful parses.
+  RoundTripVerifier* verifier = RoundTripVerifier::global();
+  if (verifier) verifier->verify(*packet, orig_data, orig_size);
   return packet;
 }
 
-void Packet::write(std::ostream& out,
+std::unique_ptr<Packet> Packet::try_create_view(
+    PacketType type, ParserInput& in, std::unique_ptr<ParserError>& error) {
+  if (factories().has(type)) return try_create(type, in, error);
+  return NeoPG::make_unique<RawPacketView>(type, in.current(), in.size());
+}
+
+void Packet::write(ByteWriter& out,
                    packet_header_factory header_factory) const {
   if (m_header) {
     m_header->write(out);
   } else {
-    CountingStream cnt;
-    write_body(cnt);
-    uint32_t len = cnt.bytes_written();
+    uint32_t len = body_length();
     std::unique_ptr<PacketHeader> default_header = header_factory(type(), len);
     default_header->write(out);
   }
   write_body(out);
 }
+
+void Packet::write(std::string& out,
+                   packet_header_factory header_factory) const {
+  // The longest header is 6 bytes (new format with five-octet length).
+  const size_t max_header_length = 6;
+  uint32_t len = m_header ? m_header->length() : body_length();
+  out.reserve(out.size() + max_header_length + len);
+
+  ByteWriter writer{out};
+  write(writer, header_factory);
+}
+
+void Packet::write(std::ostream& out,
+                   packet_header_factory header_factory) const {
+  ByteWriter writer{out};
+  write(writer, header_factory);
+}
+
+uint32_t Packet::body_length() const {
+  ByteWriter cnt{nullptr};
+  write_body(cnt);
+  return cnt.size();
+}
@@ -5,21 +5,62 @@
 
 #pragma once
 
+#include <neopg/openpgp/factory_table.h>
 #include <neopg/openpgp/packet_header.h>
+#include <neopg/parser/parser_error.h>
 #include <neopg/parser/parser_input.h>
+#include <neopg/utils/arena.h>
+#include <neopg/utils/byte_writer.h>
 
 #include <functional>
 #include <memory>
+#include <string>
 
 namespace NeoPG {
 
 using packet_header_factory = std::function<std::unique_ptr<PacketHeader>(
     PacketType type, uint32_t length)>;
 
-struct NEOPG_UNSTABLE_API Packet {
+struct Packet;
+
+/// The table of packet parsers, see Packet::factories().
+using PacketFactoryTable = FactoryTable<Packet, PacketType, 64>;
+
+struct NEOPG_UNSTABLE_API Packet : ArenaAllocated {
+  /// Create a packet of type \p type from \p in, using the parser
+  /// registered in factories().  Unknown types are parsed as RawPacket.
+  /// Calls are counted in ParserStats::current(), if set.
+  ///
+  /// \throws ParserError
   static std::unique_ptr<Packet> create_or_throw(PacketType type,
                                                  ParserInput& in);
 
+  /// Like create_or_throw(), but packets without a registered parser are
+  /// returned as a RawPacketView that borrows the body from \p in.  Such a
+  /// packet must not outlive the input data.
+  ///
+  /// \throws ParserError
+  static std::unique_ptr<Packet> create_view_or_throw(PacketType type,
+                                                      ParserInput& in);
+
+  /// Like create_or_throw(), but malformed input is reported in \p error
+  /// instead of an exception.  Most errors are collected with a
+  /// ParserErrorTrap, without the cost of throwing them, so this is the
+  /// faster choice for inputs that contain many malformed packets.
+  ///
+  /// \return the packet, or nullptr (and the error in \p error) if \p in is
+  /// malformed
+  static std::unique_ptr<Packet> try_create(
+      PacketType type, ParserInput& in, std::unique_ptr<ParserError>& error);
+
+  /// Like create_view_or_throw(), but reports errors like try_create().
+  static std::unique_ptr<Packet> try_create_view(
+      PacketType type, ParserInput& in, std::unique_ptr<ParserError>& error);
+
+  /// The parsers used by create_or_throw().  Register parsers for private
+  /// packet types (60 to 63) here.
+  static PacketFactoryTable& factories();
+
   /// Use this to overwrite the default header.
   // FIXME: Replace this with a header-generator that comes in different
   // flavors, see issue #66.
@@ -27,13 +68,31 @@ struct NEOPG_UNSTABLE_API Packet {
 
   /// Write the packet to \p out. If \p m_header is set, use that. Otherwise,
   /// generate a default header using the provided factory.
+  void write(ByteWriter& out, packet_header_factory header_factory =
+                                  NewPacketHeader::create_or_throw) const;
+
+  /// Append the packet to \p out, like write(ByteWriter&).  The buffer is
+  /// grown to its final size once before the packet is written.
+  void write(std::string& out, packet_header_factory header_factory =
+                                   NewPacketHeader::create_or_throw) const;
+
+  /// Write the packet to the output stream \p out, like write(ByteWriter&).
   void write(std::ostream& out, packet_header_factory header_factory =
                                     NewPacketHeader::create_or_throw) const;
 
   /// Write the body of the packet to \p out.
   ///
-  /// @param out The output stream to which the body is written.
-  virtual void write_body(std::ostream& out) const = 0;
+  /// @param out The output buffer to which the body is written.
+  virtual void write_body(ByteWriter& out) const = 0;
+
+  /// Return the number of bytes written by write_body.
+  ///
+  /// The default implementation writes the body to a counting ByteWriter.
+  /// Packets that can compute the length from their fields override this, so
+  /// that write only serializes the body once.
+  ///
+  /// \return The length of the packet body.
+  virtual uint32_t body_length() const;
 
   /// Return the packet type.
   ///
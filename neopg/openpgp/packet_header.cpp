@@ -49,7 +49,7 @@ void OldPacketHeader::set_length(uint32_t length,
   m_length = length;
 }
 
-void OldPacketHeader::write(std::ostream& out) const {
+void OldPacketHeader::write(ByteWriter& out) const {
   PacketLengthType lentype = m_length_type;
   if (lentype == PacketLengthType::Default)
     lentype = best_length_type(m_length);
@@ -57,23 +57,22 @@ void OldPacketHeader::write(std::ostream& out) const {
   uint8_t tag = 0x80 | ((uint8_t)m_packet_type << 2);
   switch (lentype) {
     case PacketLengthType::OneOctet:
-      out << (uint8_t)(tag | 0x00) << ((uint8_t)(m_length & 0xff));
+      out.put_u8(tag | 0x00);
+      out.put_u8(m_length & 0xff);
       break;
 
     case PacketLengthType::TwoOctet:
-      out << (uint8_t)(tag | 0x01) << ((uint8_t)((m_length >> 8) & 0xff))
-          << ((uint8_t)(m_length & 0xff));
+      out.put_u8(tag | 0x01);
+      out.put_u16be(m_length);
       break;
 
     case PacketLengthType::FourOctet:
-      out << (uint8_t)(tag | 0x02) << ((uint8_t)((m_length >> 24) & 0xff))
-          << ((uint8_t)((m_length >> 16) & 0xff))
-          << ((uint8_t)((m_length >> 8) & 0xff))
-          << ((uint8_t)(m_length & 0xff));
+      out.put_u8(tag | 0x02);
+      out.put_u32be(m_length);
       break;
 
     case PacketLengthType::Indeterminate:
-      out << (uint8_t)(tag | 0x03);
+      out.put_u8(tag | 0x03);
       break;
 
     // LCOV_EXCL_START
@@ -98,9 +97,9 @@ NewPacketTag::NewPacketTag(PacketType packet_type) {
   set_packet_type(packet_type);
 }
 
-void NewPacketTag::write(std::ostream& out) const {
+void NewPacketTag::write(ByteWriter& out) const {
   uint8_t tag = 0x80 | 0x40 | (uint8_t)m_packet_type;
-  out << (uint8_t)tag;
+  out.put_u8(tag);
 }
 
 void NewPacketLength::verify_length(uint32_t length,
@@ -139,32 +138,30 @@ NewPacketLength::NewPacketLength(uint32_t length,
   set_length(length, length_type);
 }
 
-void NewPacketLength::write(std::ostream& out) const {
+void NewPacketLength::write(ByteWriter& out) const {
   PacketLengthType lentype = m_length_type;
   if (lentype == PacketLengthType::Default)
     lentype = best_length_type(m_length);
 
   switch (lentype) {
     case PacketLengthType::OneOctet:
-      out << (uint8_t)m_length;
+      out.put_u8(m_length);
       break;
 
     case PacketLengthType::TwoOctet: {
       uint32_t adj_length = m_length - 192;
-      out << (uint8_t)(((adj_length >> 8) & 0x1f) + 0xc0)
-          << ((uint8_t)(adj_length & 0xff));
+      out.put_u8(((adj_length >> 8) & 0x1f) + 0xc0);
+      out.put_u8(adj_length & 0xff);
     } break;
 
     case PacketLengthType::FourOctet:
-      out << (uint8_t)0xff << ((uint8_t)((m_length >> 24) & 0xff))
-          << ((uint8_t)((m_length >> 16) & 0xff))
-          << ((uint8_t)((m_length >> 8) & 0xff))
-          << ((uint8_t)(m_length & 0xff));
+      out.put_u8(0xff);
+      out.put_u32be(m_length);
       break;
 
     case PacketLengthType::Partial: {
       uint8_t exp = __builtin_ctz(m_length);
-      out << (uint8_t)((exp & 0x1f) + 0xe0);
+      out.put_u8((exp & 0x1f) + 0xe0);
     } break;
     // LCOV_EXCL_START
     case PacketLengthType::Default:
@@ -174,7 +171,7 @@ void NewPacketLength::write(std::ostream& out) const {
   }
 }
 
-void NewPacketHeader::write(std::ostream& out) const {
+void NewPacketHeader::write(ByteWriter& out) const {
   m_tag.write(out);
   m_length.write(out);
 }
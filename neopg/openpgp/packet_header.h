@@ -5,9 +5,12 @@
 
 #pragma once
 
+#include <neopg/utils/arena.h>
+#include <neopg/utils/byte_writer.h>
 #include <neopg/utils/common.h>
 
 #include <cstdint>
+#include <initializer_list>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
@@ -46,6 +49,41 @@ enum class NEOPG_UNSTABLE_API PacketType : uint8_t {
   Private_63 = 63,  ///< Private or Experimental Value (use RawPaceket)
 };
 
+/// Represent a set of packet types.  All packet types fit into six bits, so
+/// this is a simple bit mask.
+class NEOPG_UNSTABLE_API PacketTypeMask {
+ public:
+  /// \return a mask that contains all packet types
+  static PacketTypeMask all() noexcept {
+    PacketTypeMask mask;
+    mask.m_bits = ~uint64_t{0};
+    return mask;
+  }
+
+  /// Create an empty mask.
+  PacketTypeMask() = default;
+
+  PacketTypeMask(std::initializer_list<PacketType> types) {
+    for (auto type : types) set(type);
+  }
+
+  PacketTypeMask& set(PacketType type) noexcept {
+    m_bits |= bit(type);
+    return *this;
+  }
+
+  bool contains(PacketType type) const noexcept { return m_bits & bit(type); }
+
+  bool is_all() const noexcept { return m_bits == ~uint64_t{0}; }
+
+ private:
+  uint64_t m_bits{0};
+
+  static uint64_t bit(PacketType type) noexcept {
+    return uint64_t{1} << (static_cast<uint8_t>(type) & 0x3f);
+  }
+};
+
 enum class NEOPG_UNSTABLE_API PacketLengthType : uint8_t {
   OneOctet = 0,
   TwoOctet = 1,
@@ -63,11 +101,11 @@ enum class NEOPG_UNSTABLE_API PacketLengthType : uint8_t {
 };
 
 /// Represent an OpenPGP packet header.
-struct NEOPG_UNSTABLE_API PacketHeader {
+struct NEOPG_UNSTABLE_API PacketHeader : ArenaAllocated {
  public:
   size_t m_offset;
 
-  virtual void write(std::ostream& out) const = 0;
+  virtual void write(ByteWriter& out) const = 0;
   virtual PacketType type() const = 0;
 
   virtual PacketFormat format() const noexcept = 0;
@@ -101,7 +139,7 @@ class NEOPG_UNSTABLE_API OldPacketHeader : public PacketHeader {
   void set_length(uint32_t length,
                   PacketLengthType length_type = PacketLengthType::Default);
 
-  void write(std::ostream& out) const override;
+  void write(ByteWriter& out) const override;
 
   PacketType type() const override { return m_packet_type; }
   uint32_t length() const override { return m_length; }
@@ -115,10 +153,10 @@ class NEOPG_UNSTABLE_API NewPacketTag {
 
   NewPacketTag(PacketType packet_type);
 
-  void write(std::ostream& out) const;
+  void write(ByteWriter& out) const;
 };
 
-class NEOPG_UNSTABLE_API NewPacketLength {
+class NEOPG_UNSTABLE_API NewPacketLength : public ArenaAllocated {
  public:
   PacketLengthType m_length_type;
   uint32_t m_length;
@@ -133,7 +171,7 @@ class NEOPG_UNSTABLE_API NewPacketLength {
   NewPacketLength(uint32_t length,
                   PacketLengthType length_type = PacketLengthType::Default);
 
-  void write(std::ostream& out) const;
+  void write(ByteWriter& out) const;
 };
 
 class NEOPG_UNSTABLE_API NewPacketHeader : public PacketHeader {
@@ -153,7 +191,7 @@ class NEOPG_UNSTABLE_API NewPacketHeader : public PacketHeader {
                   PacketLengthType length_type = PacketLengthType::Default)
       : m_tag(packet_type), m_length(length, length_type) {}
 
-  void write(std::ostream& out) const override;
+  void write(ByteWriter& out) const override;
 
   PacketType type() const override { return m_tag.m_packet_type; }
   uint32_t length() const override { return m_length.m_length; }
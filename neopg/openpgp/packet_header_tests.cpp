@@ -13,14 +13,14 @@
 using namespace NeoPG;
 
 TEST(OpenpgpPacketHeader, WriteMarkerTag) {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketTag tag(PacketType::Marker);
   tag.write(out);
   ASSERT_EQ(out.str(), "\xca");
 }
 
 TEST(OpenpgpPacketHeader, WriteNewLength) {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketLength length(3);
   length.write(out);
   ASSERT_EQ(out.str(), "\x03");
@@ -29,7 +29,7 @@ TEST(OpenpgpPacketHeader, WriteNewLength) {
 TEST(OpenpgpPacketHeader, WriteMarkerNewLength)
 
 {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketTag tag(PacketType::Marker);
   NewPacketLength length(3);
   NewPacketHeader header(tag, length);
@@ -38,21 +38,21 @@ TEST(OpenpgpPacketHeader, WriteMarkerNewLength)
 }
 
 TEST(OpenpgpPacketHeader, WriteNewHeader) {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketHeader header(PacketType::Marker, 3);
   header.write(out);
   ASSERT_EQ(out.str(), "\xca\x03");
 }
 
 TEST(OpenpgpPacketHeader, WriteOldHeader) {
-  std::stringstream out;
+  ByteWriter out;
   OldPacketHeader header(PacketType::Marker, 3);
   header.write(out);
   ASSERT_EQ(out.str(), "\xa8\x03");
 }
 
 TEST(OpenpgpPacketHeader, OldHeaderIndeterminateLength) {
-  std::stringstream out;
+  ByteWriter out;
   OldPacketHeader header(PacketType::Marker, 1, PacketLengthType::OneOctet);
   /* Force unsupported packet length type.  */
   header.m_length_type = PacketLengthType::Indeterminate;
@@ -62,14 +62,14 @@ TEST(OpenpgpPacketHeader, OldHeaderIndeterminateLength) {
 
 /* Examples from RFC 4880.  */
 TEST(OpenpgpPacketHeader, RFC4880Example1) {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketLength length(100);
   length.write(out);
   ASSERT_EQ(out.str(), "\x64");
 }
 
 TEST(OpenpgpPacketHeader, RFC4880Example2) {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketLength length(1723);
   length.write(out);
   ASSERT_EQ(out.str(), "\xc5\xfb");
@@ -78,7 +78,7 @@ TEST(OpenpgpPacketHeader, RFC4880Example2) {
 TEST(OpenpgpPacketHeader, RFC4880Example3)
 
 {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketLength length(100000);
   length.write(out);
   ASSERT_EQ(out.str(), std::string("\xff\x00\x01\x86\xa0", 5));
@@ -87,7 +87,7 @@ TEST(OpenpgpPacketHeader, RFC4880Example3)
 TEST(OpenpgpPacketHeader, RFC4880Example4)
 
 {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketLength length(32768, PacketLengthType::Partial);
   length.write(out);
   ASSERT_EQ(out.str(), "\xef");
@@ -96,14 +96,14 @@ TEST(OpenpgpPacketHeader, RFC4880Example4)
 TEST(OpenpgpPacketHeader, RFC4880Example5)
 
 {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketLength length(2, PacketLengthType::Partial);
   length.write(out);
   ASSERT_EQ(out.str(), "\xe1");
 }
 
 TEST(OpenpgpPacketHeader, RFC4880Example6) {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketLength length(1, PacketLengthType::Partial);
   length.write(out);
   ASSERT_EQ(out.str(), "\xe0");
@@ -112,7 +112,7 @@ TEST(OpenpgpPacketHeader, RFC4880Example6) {
 TEST(OpenpgpPacketHeader, RFC4880Example7)
 
 {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketLength length(65536, PacketLengthType::Partial);
   length.write(out);
   ASSERT_EQ(out.str(), "\xf0");
@@ -121,7 +121,7 @@ TEST(OpenpgpPacketHeader, RFC4880Example7)
 TEST(OpenpgpPacketHeader, RFC4880Example8)
 
 {
-  std::stringstream out;
+  ByteWriter out;
   NewPacketLength length(1693, PacketLengthType::TwoOctet);
   length.write(out);
   ASSERT_EQ(out.str(), "\xc5\xdd");
@@ -129,21 +129,21 @@ TEST(OpenpgpPacketHeader, RFC4880Example8)
 
 /* Similar for old packet format, for comparison.  */
 TEST(OpenpgpPacketHeader, RFC4880Example1Old) {
-  std::stringstream out;
+  ByteWriter out;
   OldPacketHeader header(PacketType::Marker, 100);
   header.write(out);
   ASSERT_EQ(out.str(), "\xa8\x64");
 }
 
 TEST(OpenpgpPacketHeader, RFC4880Example2Old) {
-  std::stringstream out;
+  ByteWriter out;
   OldPacketHeader header(PacketType::Marker, 1723);
   header.write(out);
   ASSERT_EQ(out.str(), "\xa9\x06\xbb");
 }
 
 TEST(OpenpgpPacketHeader, RFC4880Example3Old) {
-  std::stringstream out;
+  ByteWriter out;
   OldPacketHeader header(PacketType::Marker, 100000);
   header.write(out);
   ASSERT_EQ(out.str(), std::string("\xaa\x00\x01\x86\xa0", 5));
@@ -223,3 +223,18 @@ TEST(OpenpgpPacketHeader, NewPacketHeaderBestLengths) {
   ASSERT_EQ(NewPacketLength::best_length_type(0xffffffffU),
             PacketLengthType::FiveOctet);
 }
+
+TEST(OpenpgpPacketHeader, PacketTypeMask) {
+  PacketTypeMask mask{PacketType::PublicKey, PacketType::UserId};
+  ASSERT_TRUE(mask.contains(PacketType::PublicKey));
+  ASSERT_TRUE(mask.contains(PacketType::UserId));
+  ASSERT_FALSE(mask.contains(PacketType::Signature));
+  ASSERT_FALSE(mask.contains(PacketType::Private_63));
+  ASSERT_FALSE(mask.is_all());
+  mask.set(PacketType::Signature);
+  ASSERT_TRUE(mask.contains(PacketType::Signature));
+
+  ASSERT_FALSE(PacketTypeMask{}.contains(PacketType::Reserved));
+  ASSERT_TRUE(PacketTypeMask::all().is_all());
+  ASSERT_TRUE(PacketTypeMask::all().contains(PacketType::Private_63));
+}
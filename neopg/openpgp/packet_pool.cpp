@@ -0,0 +1,63 @@
+// OpenPGP packet pool (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/packet_pool.h>
+
+#include <botan/hash.h>
+
+#include <algorithm>
+
+using namespace NeoPG;
+
+PacketPool::PacketPool()
+    : m_hash(Botan::HashFunction::create_or_throw("SHA-256")) {}
+
+PacketPool::~PacketPool() = default;
+
+std::shared_ptr<const Packet> PacketPool::intern(
+    PacketType type, const char* data, size_t length,
+    const std::function<std::unique_ptr<Packet>()>& create) {
+  uint8_t type_octet = static_cast<uint8_t>(type);
+  m_hash->update(&type_octet, 1);
+  m_hash->update(reinterpret_cast<const uint8_t*>(data), length);
+  auto digest = m_hash->final();
+  std::string key(digest.begin(), digest.end());
+
+  auto& entry = m_packets[key];
+  auto packet = entry.lock();
+  if (packet) {
+    m_hits++;
+    m_shared_bytes += length;
+    return packet;
+  }
+
+  m_misses++;
+  packet = create();
+  if (!packet) {
+    m_packets.erase(key);
+    return nullptr;
+  }
+  entry = packet;
+
+  if (m_packets.size() >= m_sweep_at) {
+    sweep();
+    m_sweep_at = std::max(m_sweep_at, 2 * m_packets.size());
+  }
+  return packet;
+}
+
+size_t PacketPool::size() {
+  sweep();
+  return m_packets.size();
+}
+
+void PacketPool::sweep() {
+  for (auto it = m_packets.begin(); it != m_packets.end();) {
+    if (it->second.expired())
+      it = m_packets.erase(it);
+    else
+      ++it;
+  }
+}
@@ -0,0 +1,73 @@
+// OpenPGP packet pool
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains support for sharing identical packets.
+
+#pragma once
+
+#include <neopg/openpgp/packet.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace Botan {
+class HashFunction;
+}
+
+namespace NeoPG {
+
+/// An interning table for packets, addressed by the SHA-256 digest of their
+/// type and body.  Keyserver dumps contain the same signatures and user IDs
+/// many times (in duplicate and merged certificates).  With a pool, each
+/// distinct packet is decoded and stored once, and shared by all
+/// certificates that contain it, so memory scales with the unique packets.
+/// Two packets from the same pool are equal if and only if they are the same
+/// object, so comparing pointers is enough when merging certificates.
+///
+/// The pool does not keep packets alive: an entry goes away with the last
+/// certificate that refers to it.  A shared packet keeps the header of its
+/// first occurrence.  If packets are allocated from an Arena, all pooled
+/// packets must be dropped before the arena, like any other packet.  A pool
+/// must only be used by one thread at a time.
+class NEOPG_UNSTABLE_API PacketPool {
+ public:
+  PacketPool();
+  ~PacketPool();
+
+  /// \return the packet of type \p type with the \p length bytes at \p data
+  /// as body.  If the pool does not contain it yet, it is created with \p
+  /// create (and not added if \p create returns nullptr).
+  std::shared_ptr<const Packet> intern(
+      PacketType type, const char* data, size_t length,
+      const std::function<std::unique_ptr<Packet>()>& create);
+
+  /// \return the number of distinct packets in use
+  size_t size();
+
+  /// The number of calls to intern() that found an existing packet.
+  uint64_t m_hits{0};
+
+  /// The number of calls to intern() that created a new packet.
+  uint64_t m_misses{0};
+
+  /// The number of body bytes of the packets found in the pool, which were
+  /// not stored again.
+  uint64_t m_shared_bytes{0};
+
+ private:
+  std::unique_ptr<Botan::HashFunction> m_hash;
+  std::unordered_map<std::string, std::weak_ptr<const Packet>> m_packets;
+
+  // The table is swept of expired entries when it grows beyond this size.
+  size_t m_sweep_at{1024};
+
+  void sweep();
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,90 @@
+// OpenPGP packet pool (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/packet_pool.h>
+
+#include <neopg/openpgp/keyblock_sink.h>
+#include <neopg/openpgp/raw_packet.h>
+
+#include <neopg/intern/cplusplus.h>
+
+#include "gtest/gtest.h"
+
+using namespace NeoPG;
+
+namespace {
+std::shared_ptr<const Packet> intern(PacketPool& pool, PacketType type,
+                                     const std::string& body) {
+  return pool.intern(type, body.data(), body.size(), [&]() {
+    return std::unique_ptr<Packet>(NeoPG::make_unique<RawPacket>(type, body));
+  });
+}
+
+class TestCertificateSink : public CertificateSink {
+ public:
+  std::vector<std::unique_ptr<Certificate>> m_certs;
+
+  void next_certificate(std::unique_ptr<Certificate> cert) override {
+    m_certs.emplace_back(std::move(cert));
+  }
+};
+}  // namespace
+
+TEST(NeopgTest, openpgp_packet_pool_test) {
+  PacketPool pool;
+  auto sig1 = intern(pool, PacketType::Signature, "sig");
+  auto sig2 = intern(pool, PacketType::Signature, "sig");
+  auto other = intern(pool, PacketType::Signature, "other");
+  // The type is part of the address.
+  auto uid = intern(pool, PacketType::UserId, "sig");
+
+  ASSERT_EQ(sig1, sig2);
+  ASSERT_NE(sig1, other);
+  ASSERT_NE(sig1, uid);
+  ASSERT_EQ(pool.m_hits, 1);
+  ASSERT_EQ(pool.m_misses, 3);
+  ASSERT_EQ(pool.m_shared_bytes, 3);
+  ASSERT_EQ(pool.size(), 3);
+
+  // Entries go away with their last user.
+  sig1.reset();
+  ASSERT_EQ(pool.size(), 3);
+  sig2.reset();
+  ASSERT_EQ(pool.size(), 2);
+  ASSERT_NE(intern(pool, PacketType::Signature, "sig"), nullptr);
+  ASSERT_EQ(pool.m_misses, 4);
+
+  // Failed creations are not stored.
+  auto none = pool.intern(PacketType::Signature, "x", 1,
+                          []() { return std::unique_ptr<Packet>(); });
+  ASSERT_EQ(none, nullptr);
+  ASSERT_EQ(pool.size(), 2);
+}
+
+TEST(NeopgTest, openpgp_packet_pool_keyblock_test) {
+  ByteWriter out;
+  for (int i = 0; i < 2; i++) {
+    RawPacket{PacketType::PublicKey, "key" + std::to_string(i)}.write(out);
+    RawPacket{PacketType::UserId, "alice"}.write(out);
+    RawPacket{PacketType::Signature, "sig"}.write(out);
+  }
+
+  PacketPool pool;
+  TestCertificateSink certs;
+  KeyblockSink sink{certs};
+  sink.set_pool(&pool);
+  RawPacketParser parser{sink};
+  parser.process(out.str());
+  sink.finish();
+
+  ASSERT_EQ(certs.m_certs.size(), 2);
+  const Certificate& cert1 = *certs.m_certs[0];
+  const Certificate& cert2 = *certs.m_certs[1];
+  ASSERT_NE(cert1.m_packets[0], cert2.m_packets[0]);
+  ASSERT_EQ(cert1.m_packets[1], cert2.m_packets[1]);
+  ASSERT_EQ(cert1.m_packets[2], cert2.m_packets[2]);
+  ASSERT_EQ(pool.m_hits, 2);
+  ASSERT_EQ(pool.size(), 4);
+}
@@ -0,0 +1,78 @@
+// OpenPGP packet stream (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/packet_stream.h>
+
+#include <stdexcept>
+
+using namespace NeoPG;
+
+PacketStreamBuf::PacketStreamBuf(std::ostream& out, PacketType type,
+                                 uint32_t chunk_size)
+    : m_out(out), m_type(type) {
+  if (chunk_size < 512 || (chunk_size & (chunk_size - 1)) != 0 ||
+      chunk_size > (1U << 30))
+    throw std::logic_error("invalid partial packet chunk size");
+  m_chunk.resize(chunk_size);
+  setp(m_chunk.data(), m_chunk.data() + m_chunk.size());
+}
+
+void PacketStreamBuf::write_partial() {
+  {
+    ByteWriter header{m_out};
+    if (m_started)
+      NewPacketLength(m_chunk.size(), PacketLengthType::Partial).write(header);
+    else
+      NewPacketHeader(m_type, m_chunk.size(), PacketLengthType::Partial)
+          .write(header);
+  }
+  m_started = true;
+  m_out.write(m_chunk.data(), m_chunk.size());
+  setp(m_chunk.data(), m_chunk.data() + m_chunk.size());
+}
+
+PacketStreamBuf::int_type PacketStreamBuf::overflow(int_type ch) {
+  if (m_closed) return traits_type::eof();
+  // The put area is full.  We only write a chunk if more data follows, so
+  // that the final part always has a definite length.
+  write_partial();
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+int PacketStreamBuf::sync() {
+  // We can not flush a partial chunk, but we can flush what we wrote.
+  m_out.flush();
+  return m_out ? 0 : -1;
+}
+
+void PacketStreamBuf::close() {
+  if (m_closed) return;
+  m_closed = true;
+
+  uint32_t len = pptr() - pbase();
+  {
+    ByteWriter header{m_out};
+    if (m_started)
+      NewPacketLength(len).write(header);
+    else
+      NewPacketHeader(m_type, len).write(header);
+  }
+  m_out.write(pbase(), len);
+  setp(nullptr, nullptr);
+}
+
+PacketStream::PacketStream(std::ostream& out, PacketType type,
+                           uint32_t chunk_size)
+    : std::ios(0),
+      std::ostream(&m_packet_stream_buf),
+      m_packet_stream_buf(out, type, chunk_size) {}
+
+PacketStream::~PacketStream() { close(); }
+
+void PacketStream::close() { m_packet_stream_buf.close(); }
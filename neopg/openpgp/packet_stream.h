@@ -0,0 +1,72 @@
+// OpenPGP packet stream
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains support for writing packets of unknown length.
+
+#pragma once
+
+#include <neopg/openpgp/packet_header.h>
+
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+namespace NeoPG {
+
+class NEOPG_UNSTABLE_API PacketStreamBuf : public std::streambuf {
+ public:
+  PacketStreamBuf(std::ostream& out, PacketType type, uint32_t chunk_size);
+
+  void close();
+
+ protected:
+  int_type overflow(int_type ch) override;
+  int sync() override;
+
+ private:
+  std::ostream& m_out;
+  PacketType m_type;
+  std::vector<char> m_chunk;
+  bool m_started{false};
+  bool m_closed{false};
+
+  void write_partial();
+};
+
+/// Write a packet body of unknown length to \p out, in new packet format.
+///
+/// The body is buffered in chunks of \p chunk_size bytes.  Bodies that fit
+/// into one chunk are written with a definite length.  Larger bodies are
+/// written as a sequence of partial length chunks, so the memory use does
+/// not depend on the size of the body.  Call close() to finish the packet.
+///
+/// For example, to stream a literal data packet:
+///
+///     PacketStream body{out, PacketType::LiteralData};
+///     packet.write_body_prefix(body);
+///     body.write(data, length);  // repeat as necessary
+///     body.close();
+class NEOPG_UNSTABLE_API PacketStream : public std::ostream {
+ public:
+  /// The default chunk size.  This is what GnuPG uses.
+  static const uint32_t DEFAULT_CHUNK_SIZE = 8192;
+
+  /// The chunk size must be a power of two and at least 512 bytes (RFC 4880
+  /// requires the first partial length to be at least that large).
+  PacketStream(std::ostream& out, PacketType type,
+               uint32_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+  /// Calls close().
+  ~PacketStream();
+
+  /// Write the remaining data and the final length.  Further writes fail.
+  void close();
+
+ private:
+  PacketStreamBuf m_packet_stream_buf;
+};
+
+}  // namespace NeoPG
@@ -7,11 +7,13 @@
 #include <neopg/openpgp/literal_data_packet.h>
 #include <neopg/openpgp/marker_packet.h>
 #include <neopg/openpgp/user_id_packet.h>
+#include <neopg/parser/parser_error.h>
 
 #include "gtest/gtest.h"
 
 #include <memory>
 #include <sstream>
+#include <string>
 
 using namespace NeoPG;
 
@@ -80,3 +82,64 @@ TEST(NeopgTest, openpgp_packet_test) {
     ASSERT_THROW(packet.write(out), std::logic_error);
   }
 }
+
+TEST(OpenpgpPacket, TryCreate) {
+  std::unique_ptr<ParserError> error;
+  {
+    const std::string uid{"John Doe"};
+    ParserInput in{uid.data(), uid.size()};
+    auto packet = Packet::try_create(PacketType::UserId, in, error);
+    ASSERT_NE(packet, nullptr);
+    ASSERT_EQ(error, nullptr);
+    ASSERT_EQ(dynamic_cast<UserIdPacket&>(*packet).m_content, uid);
+  }
+
+  {
+    const std::string uid(UserIdPacket::MAX_LENGTH + 1, 'x');
+    ParserInput in{uid.data(), uid.size()};
+    ASSERT_EQ(Packet::try_create(PacketType::UserId, in, error), nullptr);
+    ASSERT_NE(error, nullptr);
+    ASSERT_EQ(std::string(error->what()), "user id packet is too large");
+    ASSERT_EQ(error->m_pos.m_byte, UserIdPacket::MAX_LENGTH);
+  }
+
+  {
+    // Errors from imperative code are recorded, too.
+    const std::string sig{"\x09"};
+    ParserInput in{sig.data(), sig.size()};
+    ASSERT_EQ(Packet::try_create(PacketType::Signature, in, error), nullptr);
+    ASSERT_NE(error, nullptr);
+    ASSERT_EQ(std::string(error->what()), "unknown signature version");
+  }
+
+  {
+    const std::string marker{"PGX"};
+    ParserInput in{marker.data(), marker.size()};
+    ASSERT_EQ(MarkerPacket::create(in), nullptr);
+  }
+}
+
+TEST(OpenpgpPacket, ParserErrorTrap) {
+  const std::string uid(UserIdPacket::MAX_LENGTH + 1, 'x');
+  ASSERT_EQ(ParserErrorTrap::current(), nullptr);
+
+  ParserErrorTrap outer;
+  ASSERT_EQ(ParserErrorTrap::current(), &outer);
+  {
+    ParserErrorTrap inner;
+    ParserInput in{uid.data(), uid.size()};
+    ASSERT_NO_THROW(UserIdPacket::create_or_throw(in));
+    ASSERT_TRUE(inner.failed());
+    auto error = inner.take_error();
+    ASSERT_NE(error, nullptr);
+    ASSERT_FALSE(inner.failed());
+  }
+  ASSERT_EQ(ParserErrorTrap::current(), &outer);
+  ASSERT_FALSE(outer.failed());
+
+  // Only the first error is kept.
+  ParserInput in{uid.data(), uid.size()};
+  ASSERT_FALSE(in.fail("first"));
+  ASSERT_FALSE(in.fail("second"));
+  ASSERT_EQ(std::string(outer.take_error()->what()), "first");
+}
@@ -0,0 +1,199 @@
+// OpenPGP pathological certificates (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+// Certificates flooded with signatures or user IDs, and with oversized user
+// attributes, must be parsed in memory that is bounded, or at most
+// proportional to what is kept.
+
+#include <neopg/openpgp/keyblock_sink.h>
+
+#include <neopg/intern/cplusplus.h>
+#include <neopg/openpgp/raw_packet.h>
+#include <neopg/openpgp/user_attribute/subpacket/image_attribute_subpacket.h>
+#include <neopg/openpgp/user_attribute_packet.h>
+#include <neopg/openpgp/user_id_packet.h>
+#include <neopg/parser/parser_error.h>
+#include <neopg/parser/parser_input.h>
+#include <neopg/tests/memory_usage.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace NeoPG;
+using NeoPG::Test::MemoryUsage;
+
+namespace {
+
+// The allowance for the state of the parser and the test itself.
+const size_t OVERHEAD = 64 * 1024;
+
+// The number of signatures or user IDs on a flooded certificate.
+const size_t FLOOD_COUNT = 200000;
+const size_t MAX_SIGNATURES = 1000;
+
+class TestCertificateSink : public CertificateSink {
+ public:
+  std::vector<std::unique_ptr<Certificate>> m_certs;
+
+  void next_certificate(std::unique_ptr<Certificate> cert) override {
+    m_certs.emplace_back(std::move(cert));
+  }
+};
+
+// A key with one user ID and FLOOD_COUNT third-party signatures on it,
+// followed by a second, normal key.
+std::string flooded_keyring() {
+  std::string out;
+  RawPacket{PacketType::PublicKey, std::string(270, 'k')}.write(out);
+  UserIdPacket uid;
+  uid.m_content = "Flooded <flooded@example.org>";
+  uid.write(out);
+  RawPacket signature{PacketType::Signature, std::string(150, 's')};
+  for (size_t i = 0; i < FLOOD_COUNT; i++) signature.write(out);
+  RawPacket{PacketType::PublicKey, std::string(270, 'l')}.write(out);
+  return out;
+}
+
+// Decode every packet with Packet::create_or_throw, and drop it.
+class DecodingSink : public RawPacketRefSink {
+ public:
+  size_t m_packets{0};
+  size_t m_errors{0};
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override {
+    ParserInput in{data, length};
+    try {
+      auto packet = Packet::create_or_throw(header.type(), in);
+      m_packets++;
+    } catch (const ParserError&) {
+      m_errors++;
+    }
+  }
+  void start_packet(const PacketHeader& header) override {}
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override {}
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override {}
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override {}
+};
+
+// A user attribute packet with COUNT images of SIZE bytes.
+std::string user_attribute(size_t count, size_t size) {
+  UserAttributePacket packet;
+  for (size_t i = 0; i < count; i++) {
+    auto image = make_unique<ImageAttributeSubpacket>();
+    image->m_image.assign(size, 0xff);
+    packet.m_subpackets.emplace_back(std::move(image));
+  }
+  std::string out;
+  packet.write(out);
+  return out;
+}
+
+// The length of the header of the large packets (a tag and a five octet
+// length).
+const size_t LARGE_HEADER = 6;
+
+}  // namespace
+
+TEST(OpenpgpPathologicalCertificate, FloodedSignaturesInMemory) {
+  const std::string data = flooded_keyring();
+  TestCertificateSink certs;
+  {
+    MemoryUsage usage;
+    KeyblockSink sink{certs, MAX_SIGNATURES};
+    RawPacketParser parser{sink};
+    parser.process(data.data(), data.size());
+    sink.finish();
+    // The dropped signatures are never stored, so the memory is bounded
+    // by the limit, not the input.
+    ASSERT_LT(usage.peak(), data.size() / 16);
+  }
+  ASSERT_EQ(certs.m_certs.size(), 2);
+  ASSERT_EQ(certs.m_certs[0]->m_users.size(), 1);
+  ASSERT_EQ(certs.m_certs[0]->m_users[0].m_signatures.size(), MAX_SIGNATURES);
+  ASSERT_EQ(certs.m_certs[0]->m_dropped_signatures,
+            FLOOD_COUNT - MAX_SIGNATURES);
+}
+
+TEST(OpenpgpPathologicalCertificate, FloodedSignaturesInStream) {
+  std::istringstream data{flooded_keyring()};
+  const size_t size = data.str().size();
+  TestCertificateSink certs;
+  {
+    MemoryUsage usage;
+    KeyblockSink sink{certs, MAX_SIGNATURES};
+    RawPacketParser parser{sink};
+    parser.process(data);
+    sink.finish();
+    // Streams are read through the parser buffer.
+    ASSERT_LT(usage.peak(),
+              size / 16 + 2 * RawPacketParser::MAX_PARSER_BUFFER);
+  }
+  ASSERT_EQ(certs.m_certs.size(), 2);
+  ASSERT_EQ(certs.m_certs[0]->m_dropped_signatures,
+            FLOOD_COUNT - MAX_SIGNATURES);
+}
+
+TEST(OpenpgpPathologicalCertificate, FloodedUserIds) {
+  UserIdPacket uid;
+  uid.m_content = std::string(64, 'u');
+  std::string data;
+  for (size_t i = 0; i < FLOOD_COUNT; i++) uid.write(data);
+
+  // Decode one packet first, so that the parser tables are set up.
+  DecodingSink sink;
+  RawPacketParser parser{sink};
+  std::string first;
+  uid.write(first);
+  parser.process(first.data(), first.size());
+
+  MemoryUsage usage;
+  parser.process(data.data(), data.size());
+  ASSERT_EQ(sink.m_packets, 1 + FLOOD_COUNT);
+  ASSERT_EQ(sink.m_errors, 0);
+  // Decoded packets are dropped, so the memory does not grow with the input.
+  ASSERT_LT(usage.peak(), OVERHEAD);
+}
+
+TEST(OpenpgpPathologicalCertificate, LargeUserAttribute) {
+  // Many images close to the limit for an image.
+  const size_t image_size = ImageAttributeSubpacket::MAX_LENGTH - 1024;
+  const std::string data = user_attribute(16, image_size);
+
+  {
+    MemoryUsage usage;
+    ParserInput in{data.data() + LARGE_HEADER, data.size() - LARGE_HEADER};
+    auto packet = Packet::create_or_throw(PacketType::UserAttribute, in);
+    // One copy of the images, and nothing else that grows with them.
+    ASSERT_LT(usage.peak(), data.size() + OVERHEAD);
+  }
+
+  for (auto mode : {ImageAttributeSubpacket::Mode::Borrow,
+                    ImageAttributeSubpacket::Mode::Skip}) {
+    ImageAttributeSubpacket::Scope scope{mode};
+    MemoryUsage usage;
+    ParserInput in{data.data() + LARGE_HEADER, data.size() - LARGE_HEADER};
+    auto packet = Packet::create_or_throw(PacketType::UserAttribute, in);
+    ASSERT_LT(usage.peak(), OVERHEAD);
+  }
+}
+
+TEST(OpenpgpPathologicalCertificate, OversizedUserAttribute) {
+  // An image beyond the limit is rejected, without copying it first.
+  const std::string data =
+      user_attribute(1, 8 * ImageAttributeSubpacket::MAX_LENGTH);
+
+  MemoryUsage usage;
+  ParserInput in{data.data() + LARGE_HEADER, data.size() - LARGE_HEADER};
+  ASSERT_THROW(Packet::create_or_throw(PacketType::UserAttribute, in),
+               ParserError);
+  ASSERT_LT(usage.peak(), OVERHEAD);
+}
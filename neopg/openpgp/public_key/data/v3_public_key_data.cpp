@@ -52,7 +52,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -74,20 +74,16 @@ std::unique_ptr<V3PublicKeyData> V3PublicKeyData::create_or_throw(
   auto packet = make_unique<V3PublicKeyData>();
 
   pegtl::parse<v3_public_key_data::grammar, v3_public_key_data::action,
-               v3_public_key_data::control>(in.m_impl->m_input, *packet.get());
+               v3_public_key_data::control>(in.impl().m_input, *packet.get());
   packet->m_key = PublicKeyMaterial::create_or_throw(packet->m_algorithm, in);
 
   return packet;
 }
 
-void V3PublicKeyData::write(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_created >> 24)
-      << static_cast<uint8_t>(m_created >> 16)
-      << static_cast<uint8_t>(m_created >> 8)
-      << static_cast<uint8_t>(m_created);
-  out << static_cast<uint8_t>(m_days_valid >> 8)
-      << static_cast<uint8_t>(m_days_valid);
-  out << static_cast<uint8_t>(m_algorithm);
+void V3PublicKeyData::write(ByteWriter& out) const {
+  out.put_u32be(m_created);
+  out.put_u16be(m_days_valid);
+  out.put_u8(static_cast<uint8_t>(m_algorithm));
   if (m_key) m_key->write(out);
 }
 
@@ -95,8 +91,8 @@ std::vector<uint8_t> V3PublicKeyData::fingerprint() const {
   Botan::MD5 md5;
   auto rsa = dynamic_cast<RsaPublicKeyMaterial*>(m_key.get());
   if (rsa) {
-    md5.update(rsa->m_n.bits());
-    md5.update(rsa->m_e.bits());
+    md5.update(rsa->m_n.bits().data(), rsa->m_n.bits().size());
+    md5.update(rsa->m_e.bits().data(), rsa->m_e.bits().size());
   }
   return md5.final_stdvec();
 }
@@ -105,7 +101,7 @@ std::vector<uint8_t> V3PublicKeyData::keyid() const {
   std::vector<uint8_t> keyid(KEYID_LENGTH, static_cast<uint8_t>(0x00));
   auto rsa = dynamic_cast<RsaPublicKeyMaterial*>(m_key.get());
   if (rsa) {
-    const std::vector<uint8_t>& n = rsa->m_n.bits();
+    const auto& n = rsa->m_n.bits();
     size_t len = std::min(keyid.size(), n.size());
     std::copy_backward(n.end() - len, n.end(), keyid.end());
   }
@@ -35,10 +35,10 @@ class NEOPG_UNSTABLE_API V3PublicKeyData : public PublicKeyData {
   /// The key material.
   std::unique_ptr<PublicKeyMaterial> m_key;
 
-  /// Write the packet body to the output stream.
+  /// Write the packet body to the output.
   ///
-  /// \param out the output stream to write to
-  void write(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write(ByteWriter& out) const override;
 
   /// Return the public key version.
   ///
@@ -46,7 +46,7 @@ TEST(OpenpgpV3PublicKeyData, Create) {
   ASSERT_EQ(rsa->m_n, MultiprecisionInteger(0x14223));
   ASSERT_EQ(rsa->m_e, MultiprecisionInteger(0x3));
 
-  std::stringstream out;
+  ByteWriter out;
   v3key->write(out);
   ASSERT_EQ(out.str(), raw);
 }
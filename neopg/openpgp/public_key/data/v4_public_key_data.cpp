@@ -10,6 +10,9 @@
 
 #include <botan/sha160.h>
 
+#include <algorithm>
+#include <sstream>
+
 using namespace NeoPG;
 
 namespace NeoPG {
@@ -42,7 +45,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -62,27 +65,25 @@ std::unique_ptr<V4PublicKeyData> V4PublicKeyData::create_or_throw(
   auto packet = make_unique<V4PublicKeyData>();
 
   pegtl::parse<v4_public_key_data::grammar, v4_public_key_data::action,
-               v4_public_key_data::control>(in.m_impl->m_input, *packet.get());
+               v4_public_key_data::control>(in.impl().m_input, *packet.get());
   packet->m_key = PublicKeyMaterial::create_or_throw(packet->m_algorithm, in);
   // We accept all algorithms that are known to PublicKeyMaterial.
+  packet->update_fingerprint();
 
   return packet;
 }
 
-void V4PublicKeyData::write(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_created >> 24)
-      << static_cast<uint8_t>(m_created >> 16)
-      << static_cast<uint8_t>(m_created >> 8)
-      << static_cast<uint8_t>(m_created);
-  out << static_cast<uint8_t>(m_algorithm);
+void V4PublicKeyData::write(ByteWriter& out) const {
+  out.put_u32be(m_created);
+  out.put_u8(static_cast<uint8_t>(m_algorithm));
   if (m_key) m_key->write(out);
 }
 
-std::vector<uint8_t> V4PublicKeyData::fingerprint() const {
-  std::stringstream out;
-  out << static_cast<uint8_t>(version());
+void V4PublicKeyData::update_fingerprint() const {
+  ByteWriter out;
+  out.put_u8(static_cast<uint8_t>(version()));
   write(out);
-  auto public_key = out.str();
+  const std::string& public_key = out.str();
 
   Botan::SHA_160 sha1;
   sha1.update(0x99);
@@ -90,11 +91,30 @@ std::vector<uint8_t> V4PublicKeyData::fingerprint() const {
   auto length = static_cast<uint16_t>(public_key.size());
   sha1.update_be(length);
   sha1.update(public_key);
+  sha1.final(m_fingerprint.data());
 
-  return sha1.final_stdvec();
+  std::copy(m_fingerprint.end() - m_keyid.size(), m_fingerprint.end(),
+            m_keyid.begin());
+  m_fingerprint_valid = true;
+}
+
+const V4PublicKeyData::Fingerprint& V4PublicKeyData::fingerprint_bytes()
+    const {
+  if (!m_fingerprint_valid) update_fingerprint();
+  return m_fingerprint;
+}
+
+const V4PublicKeyData::KeyId& V4PublicKeyData::keyid_bytes() const {
+  if (!m_fingerprint_valid) update_fingerprint();
+  return m_keyid;
+}
+
+std::vector<uint8_t> V4PublicKeyData::fingerprint() const {
+  auto& fpr = fingerprint_bytes();
+  return std::vector<uint8_t>(fpr.begin(), fpr.end());
 }
 
 std::vector<uint8_t> V4PublicKeyData::keyid() const {
-  auto fpr = fingerprint();
-  return std::vector<uint8_t>(fpr.begin() + 12, fpr.end());
+  auto& keyid = keyid_bytes();
+  return std::vector<uint8_t>(keyid.begin(), keyid.end());
 }
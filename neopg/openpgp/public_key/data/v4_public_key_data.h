@@ -11,12 +11,19 @@
 #include <neopg/openpgp/public_key/public_key_data.h>
 #include <neopg/openpgp/public_key/public_key_material.h>
 
+#include <array>
 #include <memory>
 
 namespace NeoPG {
 
 class NEOPG_UNSTABLE_API V4PublicKeyData : public PublicKeyData {
  public:
+  /// A v4 fingerprint (SHA-1).
+  using Fingerprint = std::array<uint8_t, 20>;
+
+  /// A v4 key ID (the low order 64 bits of the fingerprint).
+  using KeyId = std::array<uint8_t, 8>;
+
   /// Create new public key data from \p input. Throw an exception on error.
   ///
   /// \param input the parser input to read from
@@ -35,10 +42,10 @@ class NEOPG_UNSTABLE_API V4PublicKeyData : public PublicKeyData {
   /// The key material.
   std::unique_ptr<PublicKeyMaterial> m_key;
 
-  /// Write the packet body to the output stream.
+  /// Write the packet body to the output.
   ///
-  /// \param out the output stream to write to
-  void write(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write(ByteWriter& out) const override;
 
   /// Return the public key version.
   ///
@@ -53,8 +60,29 @@ class NEOPG_UNSTABLE_API V4PublicKeyData : public PublicKeyData {
   /// Return the public key id.
   std::vector<uint8_t> keyid() const override;
 
+  /// Return the public key fingerprint without copying.  The fingerprint is
+  /// computed when the key is parsed, or on first use, and then cached.  Call
+  /// invalidate_fingerprint() after modifying the key.
+  const Fingerprint& fingerprint_bytes() const;
+
+  /// Return the public key id without copying, see fingerprint_bytes().
+  const KeyId& keyid_bytes() const;
+
+  /// Drop the cached fingerprint and key id.  This must be called after
+  /// changing #m_created, #m_algorithm or #m_key.
+  void invalidate_fingerprint() noexcept { m_fingerprint_valid = false; }
+
   /// Construct new v4 public key packet data.
   V4PublicKeyData() = default;
+
+ private:
+  // Not synchronized.  Keys created by create_or_throw() have the fingerprint
+  // computed already, so concurrent readers of those are safe.
+  mutable bool m_fingerprint_valid{false};
+  mutable Fingerprint m_fingerprint;
+  mutable KeyId m_keyid;
+
+  void update_fingerprint() const;
 };
 
 }  // namespace NeoPG
@@ -43,7 +43,39 @@ TEST(OpenpgpV4PublicKeyData, Create) {
   ASSERT_EQ(rsa->m_n, MultiprecisionInteger(0x14223));
   ASSERT_EQ(rsa->m_e, MultiprecisionInteger(0x3));
 
-  std::stringstream out;
+  ByteWriter out;
   v4key->write(out);
   ASSERT_EQ(out.str(), raw);
 }
+
+TEST(OpenpgpV4PublicKeyData, FingerprintCache) {
+  const std::string raw{
+      "\x12\x34\x56\x78"
+      "\x01"
+      "\x00\x11\x01\x42\x23"
+      "\x00\x02\x03",
+      13};
+  ParserInput in(raw.data(), raw.length());
+  auto v4key = V4PublicKeyData::create_or_throw(in);
+  auto fpr = v4key->fingerprint();
+  ASSERT_EQ(std::vector<uint8_t>(v4key->fingerprint_bytes().begin(),
+                                 v4key->fingerprint_bytes().end()),
+            fpr);
+  ASSERT_EQ(std::vector<uint8_t>(v4key->keyid_bytes().begin(),
+                                 v4key->keyid_bytes().end()),
+            v4key->keyid());
+  // The reference stays the same.
+  ASSERT_EQ(&v4key->fingerprint_bytes(), &v4key->fingerprint_bytes());
+
+  // After modification, the fingerprint is only updated on request.
+  v4key->m_created = 0x12345679;
+  ASSERT_EQ(v4key->fingerprint(), fpr);
+  v4key->invalidate_fingerprint();
+  ASSERT_NE(v4key->fingerprint(), fpr);
+
+  // Keys constructed by hand compute the fingerprint on first use.
+  V4PublicKeyData key;
+  key.m_created = 0x12345678;
+  key.m_key = std::move(v4key->m_key);
+  ASSERT_EQ(key.fingerprint(), fpr);
+}
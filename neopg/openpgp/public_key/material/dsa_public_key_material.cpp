@@ -20,7 +20,7 @@ std::unique_ptr<DsaPublicKeyMaterial> DsaPublicKeyMaterial::create_or_throw(
   return data;
 }
 
-void DsaPublicKeyMaterial::write(std::ostream& out) const {
+void DsaPublicKeyMaterial::write(ByteWriter& out) const {
   m_p.write(out);
   m_q.write(out);
   m_g.write(out);
@@ -27,7 +27,7 @@ TEST(OpenpgpDsaPublicKeyMaterial, Create) {
   ASSERT_EQ(dsa.m_g, MultiprecisionInteger(2));
   ASSERT_EQ(dsa.m_y, MultiprecisionInteger(1));
 
-  std::stringstream out;
+  ByteWriter out;
   dsa.write(out);
   ASSERT_EQ(out.str(), raw);
 }
@@ -42,7 +42,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -78,13 +78,15 @@ std::unique_ptr<EcdhPublicKeyMaterial> EcdhPublicKeyMaterial::create_or_throw(
   data->m_key.parse(in);
   pegtl::parse<ecdh_public_key_material::ecdh_kdf,
                ecdh_public_key_material::action,
-               ecdh_public_key_material::control>(in.m_impl->m_input, *data);
+               ecdh_public_key_material::control>(in.impl().m_input, *data);
   return data;
 }
 
-void EcdhPublicKeyMaterial::write(std::ostream& out) const {
+void EcdhPublicKeyMaterial::write(ByteWriter& out) const {
   m_curve.write(out);
   m_key.write(out);
-  out << static_cast<uint8_t>(0x03) << static_cast<uint8_t>(0x01)
-      << static_cast<uint8_t>(m_hash) << static_cast<uint8_t>(m_sym);
+  out.put_u8(0x03);
+  out.put_u8(0x01);
+  out.put_u8(m_hash);
+  out.put_u8(m_sym);
 }
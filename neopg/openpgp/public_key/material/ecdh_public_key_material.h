@@ -42,10 +42,10 @@ class NEOPG_UNSTABLE_API EcdhPublicKeyMaterial : public PublicKeyMaterial {
     return PublicKeyAlgorithm::Ecdh;
   };
 
-  /// Write the key material to the output stream.
+  /// Write the key material to the output.
   ///
-  /// \param out the output stream to write to
-  void write(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write(ByteWriter& out) const override;
 };
 
 }  // namespace NeoPG
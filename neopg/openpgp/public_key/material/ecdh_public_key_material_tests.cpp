@@ -27,7 +27,7 @@ TEST(OpenpgpEcdhPublicKeyMaterial, Create) {
   ASSERT_EQ(ecdh.m_hash, 0x01);
   ASSERT_EQ(ecdh.m_sym, 0x02);
 
-  std::stringstream out;
+  ByteWriter out;
   ecdh.write(out);
   ASSERT_EQ(out.str(), raw);
 }
@@ -19,7 +19,7 @@ std::unique_ptr<EcdsaPublicKeyMaterial> EcdsaPublicKeyMaterial::create_or_throw(
   return data;
 }
 
-void EcdsaPublicKeyMaterial::write(std::ostream& out) const {
+void EcdsaPublicKeyMaterial::write(ByteWriter& out) const {
   m_curve.write(out);
   m_key.write(out);
 }
@@ -24,7 +24,7 @@ TEST(OpenpgpEcdsaPublicKeyMaterial, Create) {
   ASSERT_EQ(ecdsa.m_curve.as_string(), "1.3.132.0.35");
   ASSERT_EQ(ecdsa.m_key, MultiprecisionInteger(0x3));
 
-  std::stringstream out;
+  ByteWriter out;
   ecdsa.write(out);
   ASSERT_EQ(out.str(), raw);
 }
@@ -19,7 +19,7 @@ std::unique_ptr<EddsaPublicKeyMaterial> EddsaPublicKeyMaterial::create_or_throw(
   return data;
 }
 
-void EddsaPublicKeyMaterial::write(std::ostream& out) const {
+void EddsaPublicKeyMaterial::write(ByteWriter& out) const {
   m_curve.write(out);
   m_key.write(out);
 }
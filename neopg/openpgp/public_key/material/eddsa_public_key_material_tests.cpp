@@ -24,7 +24,7 @@ TEST(OpenpgpEddsaPublicKeyMaterial, Create) {
   ASSERT_EQ(eddsa.m_curve.as_string(), "1.3.132.0.35");
   ASSERT_EQ(eddsa.m_key, MultiprecisionInteger(0x03));
 
-  std::stringstream out;
+  ByteWriter out;
   eddsa.write(out);
   ASSERT_EQ(out.str(), raw);
 }
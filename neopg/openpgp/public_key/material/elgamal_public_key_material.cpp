@@ -19,7 +19,7 @@ ElgamalPublicKeyMaterial::create_or_throw(ParserInput& in) {
   return data;
 }
 
-void ElgamalPublicKeyMaterial::write(std::ostream& out) const {
+void ElgamalPublicKeyMaterial::write(ByteWriter& out) const {
   m_p.write(out);
   m_g.write(out);
   m_y.write(out);
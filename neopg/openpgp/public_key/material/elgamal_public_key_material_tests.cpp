@@ -25,7 +25,7 @@ TEST(OpenpgpElgamalPublicKeyMaterial, Create) {
   ASSERT_EQ(elgamal.m_g, MultiprecisionInteger(3));
   ASSERT_EQ(elgamal.m_y, MultiprecisionInteger(2));
 
-  std::stringstream out;
+  ByteWriter out;
   elgamal.write(out);
   ASSERT_EQ(out.str(), raw);
 }
@@ -35,7 +35,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -58,11 +58,11 @@ std::unique_ptr<RawPublicKeyMaterial> RawPublicKeyMaterial::create_or_throw(
   data->m_algorithm = algorithm;
   pegtl::parse<raw_public_key_material::grammar,
                raw_public_key_material::action,
-               raw_public_key_material::control>(in.m_impl->m_input,
+               raw_public_key_material::control>(in.impl().m_input,
                                                  *data.get());
   return data;
 }
 
-void RawPublicKeyMaterial::write(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_content.data()), m_content.size());
+void RawPublicKeyMaterial::write(ByteWriter& out) const {
+  out.put_bytes(m_content.data(), m_content.size());
 }
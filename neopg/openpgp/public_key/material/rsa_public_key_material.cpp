@@ -18,7 +18,7 @@ std::unique_ptr<RsaPublicKeyMaterial> RsaPublicKeyMaterial::create_or_throw(
   return data;
 }
 
-void RsaPublicKeyMaterial::write(std::ostream& out) const {
+void RsaPublicKeyMaterial::write(ByteWriter& out) const {
   m_n.write(out);
   m_e.write(out);
 }
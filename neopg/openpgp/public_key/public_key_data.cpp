@@ -28,7 +28,7 @@ std::unique_ptr<PublicKeyData> PublicKeyData::create_or_throw(
       public_key = V4PublicKeyData::create_or_throw(in);
       break;
     default:
-      in.error("unknown public key version");
+      in.fail("unknown public key version");
   }
 
   return public_key;
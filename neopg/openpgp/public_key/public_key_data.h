@@ -10,6 +10,7 @@
 
 #include <neopg/openpgp/packet.h>
 #include <neopg/openpgp/public_key/public_key_material.h>
+#include <neopg/utils/byte_writer.h>
 
 #include <memory>
 
@@ -21,7 +22,7 @@ enum class PublicKeyVersion : uint8_t { V2 = 2, V3 = 3, V4 = 4 };
 
 /// Represent the version specific part of an OpenPGP [public-key
 /// packet](https://tools.ietf.org/html/rfc4880#section-5.5.2).
-class NEOPG_UNSTABLE_API PublicKeyData {
+class NEOPG_UNSTABLE_API PublicKeyData : public ArenaAllocated {
  public:
   /// Create new public key data from \p input. Throw an exception on error.
   ///
@@ -33,10 +34,10 @@ class NEOPG_UNSTABLE_API PublicKeyData {
   static std::unique_ptr<PublicKeyData> create_or_throw(
       PublicKeyVersion version, ParserInput& input);
 
-  /// Write the packet body to the output stream.
+  /// Write the packet body to the output.
   ///
-  /// \param out the output stream to write to
-  virtual void write(std::ostream& out) const = 0;
+  /// \param out the output to write to
+  virtual void write(ByteWriter& out) const = 0;
 
   /// Return the public key version.
   virtual PublicKeyVersion version() const noexcept = 0;
@@ -12,6 +12,8 @@
 #include <neopg/openpgp/multiprecision_integer.h>
 #include <neopg/openpgp/object_identifier.h>
 #include <neopg/parser/parser_input.h>
+#include <neopg/utils/arena.h>
+#include <neopg/utils/byte_writer.h>
 
 #include <memory>
 
@@ -45,7 +47,7 @@ enum class PublicKeyAlgorithm : uint8_t {
 
 /// Algorithm-specific key material for a [public
 /// key](https://tools.ietf.org/html/rfc4880#section-5.5.2).
-class NEOPG_UNSTABLE_API PublicKeyMaterial {
+class NEOPG_UNSTABLE_API PublicKeyMaterial : public ArenaAllocated {
  public:
   /// Create an instance based on the algorithm.
   ///
@@ -59,10 +61,10 @@ class NEOPG_UNSTABLE_API PublicKeyMaterial {
   /// \return the algorithm specifier
   virtual PublicKeyAlgorithm algorithm() const = 0;
 
-  /// Write the key material to the output stream.
+  /// Write the key material to the output.
   ///
-  /// \param out output stream
-  virtual void write(std::ostream& out) const = 0;
+  /// \param out output
+  virtual void write(ByteWriter& out) const = 0;
 
   // Prevent memory leak when upcasting in smart pointer containers.
   virtual ~PublicKeyMaterial() = default;
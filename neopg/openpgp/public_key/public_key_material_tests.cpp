@@ -29,7 +29,7 @@ TEST(OpenpgpPublicKeyMaterial, CreateRsa) {
   ASSERT_EQ(rsa.m_n, MultiprecisionInteger(0x162));
   ASSERT_EQ(rsa.m_e, MultiprecisionInteger(3));
 
-  std::stringstream out;
+  ByteWriter out;
   rsa.write(out);
   ASSERT_EQ(out.str(), raw);
 }
@@ -39,7 +39,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -55,25 +55,21 @@ const std::string control<eof>::error_message =
 }  // namespace NeoPG
 
 std::unique_ptr<PublicKeyPacket> PublicKeyPacket::create(ParserInput& in) {
-  try {
-    return PublicKeyPacket::create_or_throw(in);
-  } catch (const ParserError&) {
-    return nullptr;
-  }
+  return ParserErrorTrap::call(&PublicKeyPacket::create_or_throw, in);
 }
 
 std::unique_ptr<PublicKeyPacket> PublicKeyPacket::create_or_throw(
     ParserInput& in) {
   auto packet = make_unique<PublicKeyPacket>();
   pegtl::parse<public_key_packet::grammar, public_key_packet::action,
-               public_key_packet::control>(in.m_impl->m_input, *packet.get());
+               public_key_packet::control>(in.impl().m_input, *packet.get());
   packet->m_public_key = PublicKeyData::create_or_throw(packet->version(), in);
   pegtl::parse<public_key_packet::end, public_key_packet::action,
-               public_key_packet::control>(in.m_impl->m_input, *packet.get());
+               public_key_packet::control>(in.impl().m_input, *packet.get());
   return packet;
 }
 
-void PublicKeyPacket::write_body(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_version);
+void PublicKeyPacket::write_body(ByteWriter& out) const {
+  out.put_u8(static_cast<uint8_t>(m_version));
   if (m_public_key) m_public_key->write(out);
 }
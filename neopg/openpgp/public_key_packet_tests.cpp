@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpPublicKeyPacket, WriteWithOldHeader) {
   // Test old packet header.
-  std::stringstream out;
+  ByteWriter out;
   PublicKeyPacket packet;
 
   packet.write(out, OldPacketHeader::create_or_throw);
@@ -24,7 +24,7 @@ TEST(OpenpgpPublicKeyPacket, WriteWithOldHeader) {
 
 TEST(OpenpgpPublicKeyPacket, WriteWithNewHeader) {
   // Test new packet header.
-  std::stringstream out;
+  ByteWriter out;
   PublicKeyPacket packet;
   packet.write(out);
   ASSERT_EQ(out.str(), std::string("\xc6\x01\x04", 3));
@@ -48,7 +48,7 @@ TEST(OpenpgpPublicKeyPacket, ParseV3) {
   ASSERT_EQ(public_key->version(), PublicKeyVersion::V3);
 
   // Test writing.
-  std::stringstream out;
+  ByteWriter out;
   packet->write_body(out);
   ASSERT_EQ(out.str(), raw);
 }
@@ -70,7 +70,7 @@ TEST(OpenpgpPublicKeyPacket, ParseV4) {
   ASSERT_EQ(public_key->version(), PublicKeyVersion::V4);
 
   // Test writing.
-  std::stringstream out;
+  ByteWriter out;
   packet->write_body(out);
   ASSERT_EQ(out.str(), raw);
 }
@@ -38,7 +38,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -55,27 +55,23 @@ const std::string control<eof>::error_message =
 
 std::unique_ptr<PublicSubkeyPacket> PublicSubkeyPacket::create(
     ParserInput& in) {
-  try {
-    return PublicSubkeyPacket::create_or_throw(in);
-  } catch (const ParserError&) {
-    return nullptr;
-  }
+  return ParserErrorTrap::call(&PublicSubkeyPacket::create_or_throw, in);
 }
 
 std::unique_ptr<PublicSubkeyPacket> PublicSubkeyPacket::create_or_throw(
     ParserInput& in) {
   auto packet = make_unique<PublicSubkeyPacket>();
   pegtl::parse<public_subkey_packet::version, public_subkey_packet::action,
-               public_subkey_packet::control>(in.m_impl->m_input,
+               public_subkey_packet::control>(in.impl().m_input,
                                               *packet.get());
   packet->m_public_key = PublicKeyData::create_or_throw(packet->version(), in);
   pegtl::parse<public_subkey_packet::end, public_subkey_packet::action,
-               public_subkey_packet::control>(in.m_impl->m_input,
+               public_subkey_packet::control>(in.impl().m_input,
                                               *packet.get());
   return packet;
 }
 
-void PublicSubkeyPacket::write_body(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_version);
+void PublicSubkeyPacket::write_body(ByteWriter& out) const {
+  out.put_u8(static_cast<uint8_t>(m_version));
   if (m_public_key) m_public_key->write(out);
 }
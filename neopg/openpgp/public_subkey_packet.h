@@ -46,10 +46,10 @@ class NEOPG_UNSTABLE_API PublicSubkeyPacket : public Packet {
   /// indicate a version 2 public key with \a m_public_key being version 3.
   std::unique_ptr<PublicKeyData> m_public_key;
 
-  /// Write the packet body to the output stream.
+  /// Write the packet body to the output.
   ///
-  /// \param out the output stream to write to
-  void write_body(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write_body(ByteWriter& out) const override;
 
   /// Return the packet type.
   ///
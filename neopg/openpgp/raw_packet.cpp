@@ -7,8 +7,8 @@
 
 using namespace NeoPG;
 
-void RawPacket::write_body(std::ostream& out) const {
-  out.write(m_content.data(), m_content.size());
+void RawPacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_content.data(), m_content.size());
 }
 
 PacketType RawPacket::type() const { return m_packet_type; }
@@ -8,6 +8,9 @@
 #include <neopg/openpgp/packet.h>
 #include <neopg/openpgp/packet_header.h>
 
+#include <string>
+#include <utility>
+
 namespace NeoPG {
 
 class NEOPG_UNSTABLE_API RawPacket : public Packet {
@@ -16,8 +19,11 @@ class NEOPG_UNSTABLE_API RawPacket : public Packet {
 
  public:
   RawPacket(PacketType packet_type, std::string content = "")
-      : m_packet_type(packet_type), m_content(content) {}
-  void write_body(std::ostream& out) const override;
+      : m_packet_type(packet_type), m_content(std::move(content)) {}
+  RawPacket(PacketType packet_type, const char* data, size_t length)
+      : m_packet_type(packet_type), m_content(data, length) {}
+  void write_body(ByteWriter& out) const override;
+  uint32_t body_length() const override { return m_content.size(); }
   PacketType type() const override;
   const std::string& content() const;
 };
@@ -0,0 +1,12 @@
+// OpenPGP raw packet view (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/raw_packet_view.h>
+
+using namespace NeoPG;
+
+void RawPacketView::write_body(ByteWriter& out) const {
+  out.put_bytes(m_data, m_length);
+}
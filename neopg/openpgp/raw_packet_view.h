@@ -0,0 +1,38 @@
+// OpenPGP raw packet view
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#pragma once
+
+#include <neopg/openpgp/packet.h>
+#include <neopg/openpgp/packet_header.h>
+
+#include <cstddef>
+
+namespace NeoPG {
+
+/// Like RawPacket, but the body is borrowed from the parser input instead
+/// of being copied.  The view is only valid as long as the input, which is
+/// usually until the sink callback that received the data returns (or for
+/// the lifetime of a mapped file).  Use RawPacket to keep the packet longer.
+class NEOPG_UNSTABLE_API RawPacketView : public Packet {
+  PacketType m_packet_type{NeoPG::PacketType::Reserved};
+  const char* m_data{nullptr};
+  size_t m_length{0};
+
+ public:
+  RawPacketView(PacketType packet_type, const char* data, size_t length)
+      : m_packet_type(packet_type), m_data(data), m_length(length) {}
+  void write_body(ByteWriter& out) const override;
+  uint32_t body_length() const override { return m_length; }
+  PacketType type() const override { return m_packet_type; }
+
+  /// \return the borrowed packet body
+  const char* data() const noexcept { return m_data; }
+
+  /// \return the length of the packet body
+  size_t size() const noexcept { return m_length; }
+};
+
+}  // namespace NeoPG
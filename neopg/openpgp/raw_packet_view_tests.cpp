@@ -0,0 +1,46 @@
+// OpenPGP raw packet view (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/raw_packet_view.h>
+
+#include <neopg/openpgp/marker_packet.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace NeoPG;
+
+TEST(NeopgTest, openpgp_raw_packet_view_test) {
+  {
+    const std::string data{"\x01\x02\x03\x04\x05\x06\x07\x08", 8};
+    std::stringstream out;
+    RawPacketView packet{PacketType::Private_60, data.data(), data.size()};
+    ASSERT_EQ(packet.data(), data.data());
+    ASSERT_EQ(packet.body_length(), data.size());
+    packet.write(out);
+    ASSERT_EQ(out.str(), std::string("\xF0\x08", 2) + data);
+  }
+
+  {
+    // Unknown packets are borrowed from the input.
+    const std::string data{"content"};
+    ParserInput in{data.data(), data.size()};
+    auto packet = Packet::create_view_or_throw(PacketType::Private_61, in);
+    auto view = dynamic_cast<RawPacketView*>(packet.get());
+    ASSERT_NE(view, nullptr);
+    ASSERT_EQ(view->data(), data.data());
+    ASSERT_EQ(view->size(), data.size());
+  }
+
+  {
+    // Known packets are parsed as usual.
+    ParserInput in{"PGP", 3};
+    auto packet = Packet::create_view_or_throw(PacketType::Marker, in);
+    ASSERT_NE(dynamic_cast<MarkerPacket*>(packet.get()), nullptr);
+  }
+}
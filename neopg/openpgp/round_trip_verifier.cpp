@@ -0,0 +1,86 @@
+// OpenPGP packet round-trip verifier (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/round_trip_verifier.h>
+
+#include <botan/hex.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace NeoPG;
+
+std::atomic<RoundTripVerifier*> RoundTripVerifier::s_global{nullptr};
+
+namespace {
+// Number of bytes per line, and number of lines shown after the difference.
+const size_t DIFF_WIDTH = 16;
+const size_t DIFF_LINES = 4;
+
+std::string hex_line(const std::string& data, size_t offset) {
+  if (offset >= data.size()) return "";
+  size_t len = std::min(DIFF_WIDTH, data.size() - offset);
+  return Botan::hex_encode(
+      reinterpret_cast<const uint8_t*>(data.data()) + offset, len, false);
+}
+}  // namespace
+
+std::string RoundTripMismatch::diff() const {
+  auto first = std::mismatch(
+      m_original.begin(),
+      m_original.begin() + std::min(m_original.size(), m_written.size()),
+      m_written.begin());
+  size_t pos = first.first - m_original.begin();
+
+  std::stringstream out;
+  out << "packet type " << static_cast<int>(m_type) << ": original "
+      << m_original.size() << " bytes, written " << m_written.size()
+      << " bytes, first difference at offset " << pos << "\n";
+
+  size_t start = pos - pos % DIFF_WIDTH;
+  for (size_t line = 0; line < DIFF_LINES; line++) {
+    size_t offset = start + line * DIFF_WIDTH;
+    if (offset >= m_original.size() && offset >= m_written.size()) break;
+    out << std::hex << std::setw(8) << std::setfill('0') << offset << std::dec
+        << " - " << hex_line(m_original, offset) << "\n"
+        << "         + " << hex_line(m_written, offset) << "\n";
+  }
+  return out.str();
+}
+
+RoundTripVerifier::RoundTripVerifier(uint32_t sample_rate, report_fn report)
+    : m_sample_rate(sample_rate), m_report(report) {}
+
+bool RoundTripVerifier::verify(const Packet& packet, const char* data,
+                               size_t length) {
+  if (m_sample_rate == 0) return true;
+  if (m_seen++ % m_sample_rate != 0) return true;
+  m_checked++;
+
+  std::string written;
+  written.reserve(length);
+  {
+    ByteWriter out{written};
+    packet.write_body(out);
+  }
+  if (written.size() == length && std::equal(data, data + length,
+                                             written.begin()))
+    return true;
+
+  m_mismatches++;
+  RoundTripMismatch mismatch{packet.type(), std::string(data, length),
+                             std::move(written)};
+  if (m_report)
+    m_report(mismatch);
+  else
+    std::cerr << "round trip mismatch: " << mismatch.diff();
+  return false;
+}
+
+void RoundTripVerifier::set_global(RoundTripVerifier* verifier) {
+  s_global = verifier;
+}
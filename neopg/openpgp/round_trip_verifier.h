@@ -0,0 +1,76 @@
+// OpenPGP packet round-trip verifier
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains a checker that parsed packets serialize to their input.
+
+#pragma once
+
+#include <neopg/openpgp/packet.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace NeoPG {
+
+/// Describe a packet that did not serialize to its original data.
+struct NEOPG_UNSTABLE_API RoundTripMismatch {
+  /// The type of the packet.
+  PacketType m_type;
+
+  /// The original packet body.
+  std::string m_original;
+
+  /// The packet body as written by Packet::write_body.
+  std::string m_written;
+
+  /// Return a hex dump of both bodies around the first difference.
+  std::string diff() const;
+};
+
+/// Check that parsed packets write out exactly the body they were parsed
+/// from.  This catches parser and serializer bugs, but costs a copy and a
+/// serialization per checked packet, so it is off by default.  Enable it
+/// for all packets created by Packet::create_or_throw with set_global.
+class NEOPG_UNSTABLE_API RoundTripVerifier {
+ public:
+  using report_fn = std::function<void(const RoundTripMismatch& mismatch)>;
+
+  /// Create a verifier that checks every \p sample_rate th packet (1 checks
+  /// all packets, 0 checks none).  Mismatches are passed to \p report, or
+  /// written to std::cerr if \p report is empty.
+  RoundTripVerifier(uint32_t sample_rate = 1, report_fn report = nullptr);
+
+  /// Verify that \p packet writes out the \p length bytes at \p data. Return
+  /// false if the packet was sampled and did not match.
+  bool verify(const Packet& packet, const char* data, size_t length);
+
+  /// The number of packets that were checked.
+  uint64_t checked() const { return m_checked; }
+
+  /// The number of packets that did not match.
+  uint64_t mismatches() const { return m_mismatches; }
+
+  /// Set the verifier used by Packet::create_or_throw (nullptr disables
+  /// verification).  The caller keeps ownership of \p verifier.
+  static void set_global(RoundTripVerifier* verifier);
+
+  /// Return the verifier used by Packet::create_or_throw, or nullptr.
+  static RoundTripVerifier* global() { return s_global; }
+
+ private:
+  uint32_t m_sample_rate;
+  report_fn m_report;
+
+  std::atomic<uint64_t> m_seen{0};
+  std::atomic<uint64_t> m_checked{0};
+  std::atomic<uint64_t> m_mismatches{0};
+
+  static std::atomic<RoundTripVerifier*> s_global;
+};
+
+}  // namespace NeoPG
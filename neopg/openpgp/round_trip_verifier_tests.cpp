@@ -0,0 +1,69 @@
+// OpenPGP packet round-trip verifier (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/openpgp/round_trip_verifier.h>
+
+#include <neopg/openpgp/raw_packet.h>
+#include <neopg/openpgp/user_id_packet.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace NeoPG;
+
+TEST(OpenpgpRoundTripVerifier, Match) {
+  RoundTripVerifier verifier;
+  UserIdPacket packet;
+  packet.m_content = "John Doe";
+  ASSERT_TRUE(verifier.verify(packet, "John Doe", 8));
+  ASSERT_EQ(verifier.checked(), 1);
+  ASSERT_EQ(verifier.mismatches(), 0);
+}
+
+TEST(OpenpgpRoundTripVerifier, Mismatch) {
+  std::vector<RoundTripMismatch> reports;
+  RoundTripVerifier verifier{1, [&reports](const RoundTripMismatch& m) {
+                               reports.push_back(m);
+                             }};
+  RawPacket packet{PacketType::Reserved, "abcd"};
+  ASSERT_FALSE(verifier.verify(packet, "abce", 4));
+  ASSERT_EQ(verifier.mismatches(), 1);
+  ASSERT_EQ(reports.size(), 1);
+  ASSERT_EQ(reports[0].m_original, "abce");
+  ASSERT_EQ(reports[0].m_written, "abcd");
+
+  const std::string diff = reports[0].diff();
+  ASSERT_NE(diff.find("first difference at offset 3"), std::string::npos);
+  ASSERT_NE(diff.find("61626365"), std::string::npos);
+  ASSERT_NE(diff.find("61626364"), std::string::npos);
+}
+
+TEST(OpenpgpRoundTripVerifier, Sampling) {
+  RoundTripVerifier verifier{3};
+  RawPacket packet{PacketType::Reserved, "x"};
+  for (int i = 0; i < 9; i++) verifier.verify(packet, "x", 1);
+  ASSERT_EQ(verifier.checked(), 3);
+
+  RoundTripVerifier disabled{0};
+  ASSERT_TRUE(disabled.verify(packet, "y", 1));
+  ASSERT_EQ(disabled.checked(), 0);
+}
+
+TEST(OpenpgpRoundTripVerifier, Global) {
+  RoundTripVerifier verifier;
+  RoundTripVerifier::set_global(&verifier);
+
+  const std::string uid{"jonny@example.com"};
+  ParserInput in{uid.data(), uid.length()};
+  auto packet = Packet::create_or_throw(PacketType::UserId, in);
+  RoundTripVerifier::set_global(nullptr);
+
+  ASSERT_NE(packet, nullptr);
+  ASSERT_EQ(verifier.checked(), 1);
+  ASSERT_EQ(verifier.mismatches(), 0);
+}
@@ -82,7 +82,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -122,23 +122,20 @@ std::unique_ptr<V3SignatureData> V3SignatureData::create_or_throw(
   auto packet = make_unique<V3SignatureData>();
 
   pegtl::parse<v3_signature_data::grammar, v3_signature_data::action,
-               v3_signature_data::control>(in.m_impl->m_input, *packet);
+               v3_signature_data::control>(in.impl().m_input, *packet);
   packet->m_signature =
       SignatureMaterial::create_or_throw(packet->m_public_key_algorithm, in);
 
   return packet;
 }
 
-void V3SignatureData::write(std::ostream& out) const {
-  out << static_cast<uint8_t>(0x05);
-  out << static_cast<uint8_t>(m_type);
-  out << static_cast<uint8_t>(m_created >> 24)
-      << static_cast<uint8_t>(m_created >> 16)
-      << static_cast<uint8_t>(m_created >> 8)
-      << static_cast<uint8_t>(m_created);
-  out.write(reinterpret_cast<const char*>(m_signer.data()), m_signer.size());
-  out << static_cast<uint8_t>(m_public_key_algorithm);
-  out << static_cast<uint8_t>(m_hash_algorithm);
-  out.write(reinterpret_cast<const char*>(m_quick.data()), m_quick.size());
+void V3SignatureData::write(ByteWriter& out) const {
+  out.put_u8(0x05);
+  out.put_u8(static_cast<uint8_t>(m_type));
+  out.put_u32be(m_created);
+  out.put_bytes(m_signer.data(), m_signer.size());
+  out.put_u8(static_cast<uint8_t>(m_public_key_algorithm));
+  out.put_u8(static_cast<uint8_t>(m_hash_algorithm));
+  out.put_bytes(m_quick.data(), m_quick.size());
   if (m_signature) m_signature->write(out);
 }
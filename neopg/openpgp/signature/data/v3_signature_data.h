@@ -48,10 +48,10 @@ class NEOPG_UNSTABLE_API V3SignatureData : public SignatureData {
   /// \throws ParserError
   static std::unique_ptr<V3SignatureData> create_or_throw(ParserInput& input);
 
-  /// Write the packet body to the output stream.
+  /// Write the packet body to the output.
   ///
-  /// \param out the output stream to write to
-  void write(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write(ByteWriter& out) const override;
 
   /// Return the signature version.
   ///
@@ -61,7 +61,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -88,22 +88,24 @@ std::unique_ptr<V4SignatureData> V4SignatureData::create_or_throw(
     ParserInput& in) {
   auto packet = make_unique<V4SignatureData>();
   pegtl::parse<v4_signature_data::grammar, v4_signature_data::action,
-               v4_signature_data::control>(in.m_impl->m_input, *packet);
-  packet->m_hashed_subpackets = V4SignatureSubpacketData::create_or_throw(in);
-  packet->m_unhashed_subpackets = V4SignatureSubpacketData::create_or_throw(in);
+               v4_signature_data::control>(in.impl().m_input, *packet);
+  packet->m_hashed_subpackets =
+      V4SignatureSubpacketData::create_lazy_or_throw(in);
+  packet->m_unhashed_subpackets =
+      V4SignatureSubpacketData::create_lazy_or_throw(in);
   pegtl::parse<v4_signature_data::tail, v4_signature_data::action,
-               v4_signature_data::control>(in.m_impl->m_input, *packet);
+               v4_signature_data::control>(in.impl().m_input, *packet);
   packet->m_signature =
       SignatureMaterial::create_or_throw(packet->m_public_key_algorithm, in);
   return packet;
 }
 
-void V4SignatureData::write(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_type);
-  out << static_cast<uint8_t>(m_public_key_algorithm);
-  out << static_cast<uint8_t>(m_hash_algorithm);
+void V4SignatureData::write(ByteWriter& out) const {
+  out.put_u8(static_cast<uint8_t>(m_type));
+  out.put_u8(static_cast<uint8_t>(m_public_key_algorithm));
+  out.put_u8(static_cast<uint8_t>(m_hash_algorithm));
   m_hashed_subpackets->write(out);
   m_unhashed_subpackets->write(out);
-  out.write(reinterpret_cast<const char*>(m_quick.data()), m_quick.size());
+  out.put_bytes(m_quick.data(), m_quick.size());
   if (m_signature) m_signature->write(out);
 }
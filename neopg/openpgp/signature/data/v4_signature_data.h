@@ -52,10 +52,10 @@ class NEOPG_UNSTABLE_API V4SignatureData : public SignatureData {
   /// \throws ParserError
   static std::unique_ptr<V4SignatureData> create_or_throw(ParserInput& input);
 
-  /// Write the v4 signature data to the output stream.
+  /// Write the v4 signature data to the output.
   ///
-  /// \param out the output stream to write to
-  void write(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write(ByteWriter& out) const override;
 
   /// Return the signature version.
   ///
@@ -7,7 +7,7 @@
 
 #include <neopg/intern/cplusplus.h>
 #include <neopg/intern/pegtl.h>
-#include <neopg/utils/stream.h>
+#include <neopg/utils/byte_writer.h>
 
 #include <botan/loadstor.h>
 
@@ -32,8 +32,10 @@ struct subpacket_data {
                     std::unique_ptr<SignatureSubpacketLength>& length,
                     SignatureSubpacketType& type, bool& critical,
                     V4SignatureSubpacketData& data) {
-    if (length->m_length == 0)
-      throw parser_error("invalid signature subpacket length of zero", in);
+    if (length->m_length == 0) {
+      raise_parser_error("invalid signature subpacket length of zero", in);
+      return false;
+    }
     uint32_t subpacket_length = length->m_length - 1;
     if (in.size(subpacket_length) >= subpacket_length) {
       in.bump(subpacket_length);
@@ -167,7 +169,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -183,7 +185,7 @@ struct action<subpackets_data> {
     pegtl::parse<v4_signature_subpacket_data::subpacket_list,
                  v4_signature_subpacket_data::action,
                  v4_signature_subpacket_data::control>(
-        in2.m_impl->m_input, subpacket_length, type, critical, data);
+        in2.impl().m_input, subpacket_length, type, critical, data);
     // FIXME: In case of error, rewrite exception to point to byte offset.
   }
 };
@@ -223,18 +225,187 @@ std::unique_ptr<V4SignatureSubpacketData>
 V4SignatureSubpacketData::create_or_throw(ParserInput& in) {
   auto data = make_unique<V4SignatureSubpacketData>();
   uint16_t length;
-  pegtl::parse<v4_signature_subpacket_data::subpackets,
-               v4_signature_subpacket_data::action,
-               v4_signature_subpacket_data::control>(in.m_impl->m_input, length,
-                                                     *data);
+  const char* start = in.current();
+  if (!pegtl::parse<v4_signature_subpacket_data::subpackets,
+                    v4_signature_subpacket_data::action,
+                    v4_signature_subpacket_data::control>(in.impl().m_input,
+                                                          length, *data))
+    return data;
+
+  // Keep the subpacket area, so it can be written out without re-encoding.
+  data->m_raw.assign(start + 2, in.current());
+  data->m_raw_valid = true;
+  return data;
+}
+
+std::unique_ptr<V4SignatureSubpacketData>
+V4SignatureSubpacketData::create_lazy_or_throw(ParserInput& in) {
+  auto data = make_unique<V4SignatureSubpacketData>();
+  if (in.size() < 2) {
+    in.fail("v4 signature subpacket data subpacket invalid subpackets length");
+    return data;
+  }
+  auto ptr = reinterpret_cast<const uint8_t*>(in.current());
+  uint16_t length = (static_cast<uint16_t>(ptr[0]) << 8) + ptr[1];
+  in.bump(2);
+  if (in.size() < length) {
+    in.fail("v4 signature subpacket data invalid subpackets data");
+    return data;
+  }
+  data->m_raw.assign(in.current(), length);
+  data->m_lazy = true;
+  data->m_raw_valid = true;
+  in.bump(length);
   return data;
 }
 
-void V4SignatureSubpacketData::write(std::ostream& out) const {
-  CountingStream cnt;
+void V4SignatureSubpacketData::index() const {
+  if (m_indexed) return;
+
+  // This mirrors the subpacket_list grammar above, but only records where each
+  // subpacket is located.
+  ParserInput in(m_raw.data(), m_raw.size());
+  auto ptr = reinterpret_cast<const uint8_t*>(m_raw.data());
+  size_t size = m_raw.size();
+  size_t pos = 0;
+  std::vector<Entry> entries;
+  while (pos < size) {
+    Entry entry{};
+    uint8_t val0 = ptr[pos];
+    size_t header;
+    if (val0 < 0xc0) {
+      header = 1;
+      entry.m_length_type = SignatureSubpacketLengthType::OneOctet;
+      entry.m_length = val0;
+    } else if (val0 < 0xff) {
+      header = 2;
+      entry.m_length_type = SignatureSubpacketLengthType::TwoOctet;
+      if (size - pos >= header)
+        entry.m_length = ((val0 - 0xc0) << 8) + ptr[pos + 1] + 192;
+    } else {
+      header = 5;
+      entry.m_length_type = SignatureSubpacketLengthType::FiveOctet;
+      if (size - pos >= header)
+        entry.m_length = Botan::load_be<uint32_t>(ptr + pos + 1, 0);
+    }
+    if (size - pos < header) {
+      in.bump(pos);
+      in.error(
+          "v4 signature subpacket data subpacket invalid subpacket length");
+    }
+    if (entry.m_length == 0) {
+      in.bump(pos + header);
+      in.error("invalid signature subpacket length of zero");
+    }
+    if (size - pos - header < entry.m_length) {
+      in.bump(pos + header);
+      in.error("v4 signature subpacket data invalid subpacket data");
+    }
+    uint8_t type = ptr[pos + header];
+    entry.m_critical = (type & 0x80) ? true : false;
+    entry.m_type = static_cast<SignatureSubpacketType>(type & 0x7f);
+    entry.m_offset = pos + header + 1;
+    entries.push_back(entry);
+    pos += header + entry.m_length;
+  }
+
+  m_index = std::move(entries);
+  m_decoded.clear();
+  m_decoded.resize(m_index.size());
+  m_indexed = true;
+}
+
+std::unique_ptr<SignatureSubpacket> V4SignatureSubpacketData::decode(
+    const Entry& entry) const {
+  ParserInput in(m_raw.data() + entry.m_offset, entry.m_length - 1);
+  auto subpacket = SignatureSubpacket::create_or_throw(entry.m_type, in);
+  subpacket->m_length = make_unique<SignatureSubpacketLength>(
+      entry.m_length, entry.m_length_type);
+  subpacket->m_critical = entry.m_critical;
+  return subpacket;
+}
+
+size_t V4SignatureSubpacketData::count() const {
+  if (not m_lazy) return m_subpackets.size();
+  index();
+  return m_index.size();
+}
+
+const SignatureSubpacket* V4SignatureSubpacketData::at(size_t i) const {
+  if (not m_lazy) return m_subpackets.at(i).get();
+  index();
+  if (not m_decoded.at(i)) m_decoded[i] = decode(m_index[i]);
+  return m_decoded[i].get();
+}
+
+const SignatureSubpacket* V4SignatureSubpacketData::find(
+    SignatureSubpacketType type) const {
+  if (not m_lazy) {
+    auto it = std::find_if(
+        m_subpackets.begin(), m_subpackets.end(),
+        [type](const std::unique_ptr<SignatureSubpacket>& subpacket) {
+          return subpacket->type() == type;
+        });
+    return it == m_subpackets.end() ? nullptr : it->get();
+  }
+
+  index();
+  for (size_t i = 0; i < m_index.size(); i++)
+    if (m_index[i].m_type == type) return at(i);
+  return nullptr;
+}
+
+void V4SignatureSubpacketData::decode_all() {
+  if (not m_lazy) return;
+
+  index();
+  std::vector<std::unique_ptr<SignatureSubpacket>> subpackets;
+  for (size_t i = 0; i < m_index.size(); i++) {
+    if (m_decoded[i])
+      subpackets.push_back(std::move(m_decoded[i]));
+    else
+      subpackets.push_back(decode(m_index[i]));
+  }
+  m_subpackets = std::move(subpackets);
+  m_lazy = false;
+  m_index.clear();
+  m_decoded.clear();
+  m_indexed = false;
+}
+
+void V4SignatureSubpacketData::materialize() {
+  decode_all();
+  m_raw.clear();
+  m_raw_valid = false;
+}
+
+std::vector<const SignatureSubpacket*> V4SignatureSubpacketData::subpackets()
+    const {
+  std::vector<const SignatureSubpacket*> subpackets;
+  size_t n = count();
+  subpackets.reserve(n);
+  for (size_t i = 0; i < n; i++) subpackets.push_back(at(i));
+  return subpackets;
+}
+
+std::vector<std::unique_ptr<SignatureSubpacket>>&
+V4SignatureSubpacketData::mutable_subpackets() {
+  materialize();
+  return m_subpackets;
+}
+
+void V4SignatureSubpacketData::write(ByteWriter& out) const {
+  if (m_raw_valid) {
+    uint32_t len = m_raw.size();
+    out.put_u16be(len);
+    out.put_bytes(m_raw.data(), m_raw.size());
+    return;
+  }
+
+  ByteWriter cnt{nullptr};
   for (const auto& subpacket : m_subpackets) subpacket->write(cnt);
-  uint32_t len = cnt.bytes_written();
+  uint32_t len = cnt.size();
   if (len >= 1 << 16) throw std::length_error("Subpacket data too large");
-  out << static_cast<uint8_t>(len >> 8) << static_cast<uint8_t>(len);
+  out.put_u16be(len);
   for (const auto& subpacket : m_subpackets) subpacket->write(out);
 }
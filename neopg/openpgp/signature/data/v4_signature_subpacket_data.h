@@ -9,18 +9,26 @@
 #pragma once
 
 #include <neopg/openpgp/signature/signature_subpacket.h>
+#include <neopg/utils/byte_writer.h>
 
 #include <array>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace NeoPG {
 
 /// Signature subpackets as found in version 4 signature data.
+///
+/// The subpackets can be decoded eagerly, or lazily.  In the lazy case, only
+/// the raw subpacket area is kept.  It is indexed on first access, and
+/// individual subpackets are decoded when they are requested.
+///
+/// In both cases, the raw subpacket area is kept and written out unchanged
+/// (with a single copy, and without re-encoding the subpackets) until the
+/// subpackets are modified with mutable_subpackets().
 class NEOPG_UNSTABLE_API V4SignatureSubpacketData {
  public:
-  /// The signature subpackets.
-  std::vector<std::unique_ptr<SignatureSubpacket>> m_subpackets;
-
   /// Create new v4 signature subpacket data from \p input. Throw an exception
   /// on error.
   ///
@@ -32,10 +40,95 @@ class NEOPG_UNSTABLE_API V4SignatureSubpacketData {
   static std::unique_ptr<V4SignatureSubpacketData> create_or_throw(
       ParserInput& input);
 
-  /// Write the signature subpacket data to the output stream.
+  /// Create new v4 signature subpacket data from \p input, but do not decode
+  /// the subpackets yet.  Only the subpacket area length is validated.
+  ///
+  /// \param input the parser input to read from
+  ///
+  /// \return pointer to packet
+  ///
+  /// \throws ParserError
+  static std::unique_ptr<V4SignatureSubpacketData> create_lazy_or_throw(
+      ParserInput& input);
+
+  /// \return true if the subpackets have not been materialized yet
+  bool lazy() const noexcept { return m_lazy; }
+
+  /// Return the number of subpackets.  In lazy mode, this indexes the raw
+  /// subpacket area, but does not decode any subpacket.
+  ///
+  /// \throws ParserError
+  size_t count() const;
+
+  /// Return the subpacket at position \p i, which must be less than count().
+  /// In lazy mode, only this subpacket is decoded.
+  ///
+  /// \throws ParserError
+  const SignatureSubpacket* at(size_t i) const;
+
+  /// Return the first subpacket of type \p type, or nullptr if there is
+  /// none.  In lazy mode, only the matching subpacket is decoded.
+  ///
+  /// \throws ParserError
+  const SignatureSubpacket* find(SignatureSubpacketType type) const;
+
+  /// Decode all remaining subpackets, and drop the raw bytes, so that
+  /// write() encodes the subpackets.
+  ///
+  /// \throws ParserError
+  void materialize();
+
+  /// Return all subpackets, decoding them first if necessary.  This keeps
+  /// the raw bytes for write().
+  ///
+  /// \throws ParserError
+  std::vector<const SignatureSubpacket*> subpackets() const;
+
+  /// Return the subpackets for modification.  This calls materialize(), so
+  /// write() encodes the modified subpackets.
   ///
-  /// \param out the output stream to write to
-  void write(std::ostream& out) const;
+  /// \throws ParserError
+  std::vector<std::unique_ptr<SignatureSubpacket>>& mutable_subpackets();
+
+  /// \return true if write() emits the original raw subpacket area
+  bool raw() const noexcept { return m_raw_valid; }
+
+  /// Write the signature subpacket data to the output.
+  ///
+  /// \param out the output to write to
+  void write(ByteWriter& out) const;
+
+ private:
+  /// The location of one subpacket in the raw subpacket area.
+  struct Entry {
+    SignatureSubpacketType m_type;
+    bool m_critical;
+    SignatureSubpacketLengthType m_length_type;
+    /// Length including the type octet.
+    uint32_t m_length;
+    /// Offset of the subpacket body.
+    size_t m_offset;
+  };
+
+  /// The signature subpackets.  In lazy mode, this is empty until
+  /// materialize() is called.
+  std::vector<std::unique_ptr<SignatureSubpacket>> m_subpackets;
+
+  bool m_lazy{false};
+
+  /// The raw subpacket area (without the two octet length).
+  std::string m_raw;
+
+  /// True if m_raw holds the encoding of the subpackets.
+  bool m_raw_valid{false};
+
+  mutable bool m_indexed{false};
+  mutable std::vector<Entry> m_index;
+  mutable std::vector<std::unique_ptr<SignatureSubpacket>> m_decoded;
+
+  void index() const;
+  std::unique_ptr<SignatureSubpacket> decode(const Entry& entry) const;
+  void decode_all();
 };
 
 }  // namespace NeoPG
@@ -4,6 +4,7 @@
 // NeoPG is released under the Simplified BSD License (see license.txt)
 
 #include <neopg/openpgp/signature/data/v4_signature_subpacket_data.h>
+#include <neopg/openpgp/signature/subpacket/issuer_subpacket.h>
 
 #include <gtest/gtest.h>
 
@@ -17,7 +18,7 @@ TEST(OpenpgpV4SignatureSubpacketData, CreateEmpty) {
   ParserInput in(raw.data(), raw.length());
   auto data = V4SignatureSubpacketData::create_or_throw(in);
   ASSERT_EQ(in.size(), 0);
-  ASSERT_EQ(data->m_subpackets.size(), 0);
+  ASSERT_EQ(data->count(), 0);
 }
 
 TEST(OpenpgpV4SignatureSubpacketData, CreateOne) {
@@ -25,7 +26,7 @@ TEST(OpenpgpV4SignatureSubpacketData, CreateOne) {
   ParserInput in(raw.data(), raw.length());
   auto data = V4SignatureSubpacketData::create_or_throw(in);
   ASSERT_EQ(in.size(), 0);
-  ASSERT_EQ(data->m_subpackets.size(), 1);
+  ASSERT_EQ(data->count(), 1);
 }
 
 TEST(OpenpgpV4SignatureSubpacketData, CreateTwo) {
@@ -33,7 +34,12 @@ TEST(OpenpgpV4SignatureSubpacketData, CreateTwo) {
   ParserInput in(raw.data(), raw.length());
   auto data = V4SignatureSubpacketData::create_or_throw(in);
   ASSERT_EQ(in.size(), 0);
-  ASSERT_EQ(data->m_subpackets.size(), 2);
+  ASSERT_EQ(data->count(), 2);
+  ASSERT_TRUE(data->raw());
+
+  ByteWriter out;
+  data->write(out);
+  ASSERT_EQ(out.str(), raw);
 }
 
 TEST(OpenpgpV4SignatureSubpacketData, FailZeroLength) {
@@ -47,3 +53,93 @@ TEST(OpenpgpV4SignatureSubpacketData, FailMissingData) {
   ParserInput in(raw.data(), raw.length());
   ASSERT_ANY_THROW(V4SignatureSubpacketData::create_or_throw(in));
 }
+
+TEST(OpenpgpV4SignatureSubpacketData, CreateLazy) {
+  const std::string raw{
+      "\x00\x10\x05\x02\x12\x34\x56\x78"
+      "\x09\x10\x01\x02\x03\x04\x05\x06\x07\x08",
+      18};
+  ParserInput in(raw.data(), raw.length());
+  auto data = V4SignatureSubpacketData::create_lazy_or_throw(in);
+  ASSERT_EQ(in.size(), 0);
+  ASSERT_TRUE(data->lazy());
+  ASSERT_EQ(data->count(), 2);
+
+  auto subpacket = data->find(SignatureSubpacketType::Issuer);
+  ASSERT_NE(subpacket, nullptr);
+  auto issuer = dynamic_cast<const IssuerSubpacket*>(subpacket);
+  ASSERT_NE(issuer, nullptr);
+  ASSERT_EQ(issuer->m_issuer,
+            (std::vector<uint8_t>{0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                  0x08}));
+  ASSERT_EQ(data->find(SignatureSubpacketType::KeyFlags), nullptr);
+
+  ByteWriter out;
+  data->write(out);
+  ASSERT_EQ(out.str(), raw);
+
+  // Reading all subpackets keeps the raw bytes.
+  ASSERT_EQ(data->subpackets().size(), 2);
+  ASSERT_TRUE(data->raw());
+  ASSERT_EQ(data->subpackets()[1], subpacket);
+
+  data->materialize();
+  ASSERT_FALSE(data->lazy());
+  ASSERT_FALSE(data->raw());
+  ASSERT_EQ(data->count(), 2);
+  ASSERT_EQ(data->at(1)->type(), SignatureSubpacketType::Issuer);
+
+  ByteWriter out2;
+  data->write(out2);
+  ASSERT_EQ(out2.str(), raw);
+}
+
+TEST(OpenpgpV4SignatureSubpacketData, ModifyParsed) {
+  const std::string raw{"\x00\x0a\x04\x00\x01\x02\x03\x04\x00\x01\x02\x03", 12};
+  ParserInput in(raw.data(), raw.length());
+  auto data = V4SignatureSubpacketData::create_or_throw(in);
+  ASSERT_TRUE(data->raw());
+
+  // Modified subpackets are written out, not the original bytes.
+  data->mutable_subpackets().pop_back();
+  ASSERT_FALSE(data->raw());
+  ASSERT_EQ(data->count(), 1);
+
+  ByteWriter out;
+  data->write(out);
+  ASSERT_EQ(out.str(), std::string("\x00\x05\x04\x00\x01\x02\x03", 7));
+}
+
+TEST(OpenpgpV4SignatureSubpacketData, ModifyLazy) {
+  const std::string raw{
+      "\x00\x10\x05\x02\x12\x34\x56\x78"
+      "\x09\x10\x01\x02\x03\x04\x05\x06\x07\x08",
+      18};
+  ParserInput in(raw.data(), raw.length());
+  auto data = V4SignatureSubpacketData::create_lazy_or_throw(in);
+
+  auto issuer =
+      dynamic_cast<IssuerSubpacket*>(data->mutable_subpackets()[1].get());
+  ASSERT_NE(issuer, nullptr);
+  issuer->m_issuer[7] = 0x09;
+  ASSERT_FALSE(data->raw());
+
+  std::string expected = raw;
+  expected[17] = '\x09';
+  ByteWriter out;
+  data->write(out);
+  ASSERT_EQ(out.str(), expected);
+}
+
+TEST(OpenpgpV4SignatureSubpacketData, LazyFailZeroLength) {
+  const std::string raw{"\x00\x01\x00", 3};
+  ParserInput in(raw.data(), raw.length());
+  auto data = V4SignatureSubpacketData::create_lazy_or_throw(in);
+  ASSERT_ANY_THROW(data->count());
+}
+
+TEST(OpenpgpV4SignatureSubpacketData, LazyFailMissingData) {
+  const std::string raw{"\x00\x02\x00", 3};
+  ParserInput in(raw.data(), raw.length());
+  ASSERT_ANY_THROW(V4SignatureSubpacketData::create_lazy_or_throw(in));
+}
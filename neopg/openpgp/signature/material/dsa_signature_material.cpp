@@ -17,7 +17,7 @@ std::unique_ptr<DsaSignatureMaterial> DsaSignatureMaterial::create_or_throw(
   return data;
 }
 
-void DsaSignatureMaterial::write(std::ostream& out) const {
+void DsaSignatureMaterial::write(ByteWriter& out) const {
   m_r.write(out);
   m_s.write(out);
 }
@@ -17,7 +17,7 @@ std::unique_ptr<EcdsaSignatureMaterial> EcdsaSignatureMaterial::create_or_throw(
   return data;
 }
 
-void EcdsaSignatureMaterial::write(std::ostream& out) const {
+void EcdsaSignatureMaterial::write(ByteWriter& out) const {
   m_r.write(out);
   m_s.write(out);
 }
@@ -42,10 +42,10 @@ class NEOPG_UNSTABLE_API EcdsaSignatureMaterial : public SignatureMaterial {
     return PublicKeyAlgorithm::Ecdsa;
   };
 
-  /// Write the signature material to the output stream.
+  /// Write the signature material to the output.
   ///
-  /// \param out the output stream to write to
-  void write(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write(ByteWriter& out) const override;
 };
 
 }  // namespace NeoPG
@@ -17,7 +17,7 @@ std::unique_ptr<EddsaSignatureMaterial> EddsaSignatureMaterial::create_or_throw(
   return data;
 }
 
-void EddsaSignatureMaterial::write(std::ostream& out) const {
+void EddsaSignatureMaterial::write(ByteWriter& out) const {
   m_r.write(out);
   m_s.write(out);
 }
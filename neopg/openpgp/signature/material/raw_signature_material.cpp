@@ -35,7 +35,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -57,11 +57,11 @@ std::unique_ptr<RawSignatureMaterial> RawSignatureMaterial::create_or_throw(
   auto data = make_unique<RawSignatureMaterial>();
   data->m_algorithm = algorithm;
   pegtl::parse<raw_signature_material::grammar, raw_signature_material::action,
-               raw_signature_material::control>(in.m_impl->m_input,
+               raw_signature_material::control>(in.impl().m_input,
                                                 *data.get());
   return data;
 }
 
-void RawSignatureMaterial::write(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_content.data()), m_content.size());
+void RawSignatureMaterial::write(ByteWriter& out) const {
+  out.put_bytes(m_content.data(), m_content.size());
 }
@@ -45,10 +45,10 @@ class NEOPG_UNSTABLE_API RawSignatureMaterial : public SignatureMaterial {
   /// \return the algorithm identifier
   PublicKeyAlgorithm algorithm() const override { return m_algorithm; };
 
-  /// Write the signature material to the output stream.
+  /// Write the signature material to the output.
   ///
-  /// \param out the output stream to write to
-  void write(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write(ByteWriter& out) const override;
 };
 
 }  // namespace NeoPG
@@ -16,6 +16,6 @@ std::unique_ptr<RsaSignatureMaterial> RsaSignatureMaterial::create_or_throw(
   return data;
 }
 
-void RsaSignatureMaterial::write(std::ostream& out) const {
+void RsaSignatureMaterial::write(ByteWriter& out) const {
   m_m_pow_d.write(out);
 }
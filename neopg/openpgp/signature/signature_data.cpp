@@ -25,7 +25,7 @@ std::unique_ptr<SignatureData> SignatureData::create_or_throw(
       signature = V4SignatureData::create_or_throw(in);
       break;
     default:
-      in.error("unknown signature version");
+      in.fail("unknown signature version");
   }
 
   return signature;
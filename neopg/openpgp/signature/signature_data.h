@@ -11,6 +11,7 @@
 #include <neopg/openpgp/packet.h>
 #include <neopg/openpgp/public_key/public_key_material.h>
 #include <neopg/openpgp/signature/signature_material.h>
+#include <neopg/utils/byte_writer.h>
 
 #include <memory>
 
@@ -69,7 +70,7 @@ enum class NEOPG_UNSTABLE_API SignatureType : uint8_t {
 
 /// Represent an OpenPGP [signature
 /// packet](https://tools.ietf.org/html/rfc4880#section-5.2).
-class NEOPG_UNSTABLE_API SignatureData {
+class NEOPG_UNSTABLE_API SignatureData : public ArenaAllocated {
  public:
   /// Create new signature data from \p input. Throw an exception on error.
   ///
@@ -81,10 +82,10 @@ class NEOPG_UNSTABLE_API SignatureData {
   static std::unique_ptr<SignatureData> create_or_throw(
       SignatureVersion version, ParserInput& input);
 
-  /// Write the packet body to the output stream.
+  /// Write the packet body to the output.
   ///
-  /// \param out the output stream to write to
-  virtual void write(std::ostream& out) const = 0;
+  /// \param out the output to write to
+  virtual void write(ByteWriter& out) const = 0;
 
   /// Return the signature version.
   virtual SignatureVersion version() const noexcept = 0;
@@ -8,6 +8,7 @@
 #include <neopg/openpgp/public_key/public_key_material.h>
 
 #include <neopg/parser/parser_input.h>
+#include <neopg/utils/byte_writer.h>
 
 #include <memory>
 
@@ -15,7 +16,7 @@ namespace NeoPG {
 
 /// Algorithm-specific key material for a
 /// [signature](https://tools.ietf.org/html/rfc4880#section-5.2).
-class NEOPG_UNSTABLE_API SignatureMaterial {
+class NEOPG_UNSTABLE_API SignatureMaterial : public ArenaAllocated {
  public:
   /// Create a new signature material from \p input.
   ///
@@ -28,10 +29,10 @@ class NEOPG_UNSTABLE_API SignatureMaterial {
   /// \return the algorithm specifier
   virtual PublicKeyAlgorithm algorithm() const = 0;
 
-  /// Write the key material to the output stream.
+  /// Write the key material to the output.
   ///
-  /// \param out output stream
-  virtual void write(std::ostream& out) const = 0;
+  /// \param out output
+  virtual void write(ByteWriter& out) const = 0;
 
   // Prevent memory leak when upcasting in smart pointer containers.
   virtual ~SignatureMaterial() = default;
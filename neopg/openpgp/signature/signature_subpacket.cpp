@@ -31,7 +31,7 @@
 #include <neopg/openpgp/signature/subpacket/trust_signature_subpacket.h>
 
 #include <neopg/parser/parser_input.h>
-#include <neopg/utils/stream.h>
+#include <neopg/utils/byte_writer.h>
 
 #include <neopg/intern/cplusplus.h>
 #include <neopg/intern/pegtl.h>
@@ -71,27 +71,25 @@ SignatureSubpacketLength::SignatureSubpacketLength(
   set_length(length, length_type);
 }
 
-void SignatureSubpacketLength::write(std::ostream& out) {
+void SignatureSubpacketLength::write(ByteWriter& out) {
   SignatureSubpacketLengthType lentype = m_length_type;
   if (lentype == SignatureSubpacketLengthType::Default)
     lentype = best_length_type(m_length);
 
   switch (lentype) {
     case SignatureSubpacketLengthType::OneOctet:
-      out << (uint8_t)m_length;
+      out.put_u8(m_length);
       break;
 
     case SignatureSubpacketLengthType::TwoOctet: {
       uint32_t adj_length = m_length - 0xc0;
-      out << (uint8_t)(((adj_length >> 8) & 0x3f) + 0xc0)
-          << ((uint8_t)(adj_length & 0xff));
+      out.put_u8(((adj_length >> 8) & 0x3f) + 0xc0);
+      out.put_u8(adj_length & 0xff);
     } break;
 
     case SignatureSubpacketLengthType::FiveOctet:
-      out << (uint8_t)0xff << ((uint8_t)((m_length >> 24) & 0xff))
-          << ((uint8_t)((m_length >> 16) & 0xff))
-          << ((uint8_t)((m_length >> 8) & 0xff))
-          << ((uint8_t)(m_length & 0xff));
+      out.put_u8(0xff);
+      out.put_u32be(m_length);
       break;
 
     // LCOV_EXCL_START
@@ -102,74 +100,79 @@ void SignatureSubpacketLength::write(std::ostream& out) {
   }
 }
 
+namespace {
+
+std::unique_ptr<SignatureSubpacket> create_raw_subpacket(
+    SignatureSubpacketType type, ParserInput& in) {
+  return RawSignatureSubpacket::create_or_throw(type, in);
+}
+
+SignatureSubpacketFactoryTable make_factories() {
+  SignatureSubpacketFactoryTable table{create_raw_subpacket};
+  table.set<SignatureCreationTimeSubpacket>(
+      SignatureSubpacketType::SignatureCreationTime);
+  table.set<SignatureExpirationTimeSubpacket>(
+      SignatureSubpacketType::SignatureExpirationTime);
+  table.set<ExportableCertificationSubpacket>(
+      SignatureSubpacketType::ExportableCertification);
+  table.set<TrustSignatureSubpacket>(SignatureSubpacketType::TrustSignature);
+  table.set<RegularExpressionSubpacket>(
+      SignatureSubpacketType::RegularExpression);
+  table.set<RevocableSubpacket>(SignatureSubpacketType::Revocable);
+  table.set<KeyExpirationTimeSubpacket>(
+      SignatureSubpacketType::KeyExpirationTime);
+  table.set<PreferredSymmetricAlgorithmsSubpacket>(
+      SignatureSubpacketType::PreferredSymmetricAlgorithms);
+  table.set<RevocationKeySubpacket>(SignatureSubpacketType::RevocationKey);
+  table.set<IssuerSubpacket>(SignatureSubpacketType::Issuer);
+  table.set<NotationDataSubpacket>(SignatureSubpacketType::NotationData);
+  table.set<PreferredHashAlgorithmsSubpacket>(
+      SignatureSubpacketType::PreferredHashAlgorithms);
+  table.set<PreferredCompressionAlgorithmsSubpacket>(
+      SignatureSubpacketType::PreferredCompressionAlgorithms);
+  table.set<KeyServerPreferencesSubpacket>(
+      SignatureSubpacketType::KeyServerPreferences);
+  table.set<PreferredKeyServerSubpacket>(
+      SignatureSubpacketType::PreferredKeyServer);
+  table.set<PrimaryUserIdSubpacket>(SignatureSubpacketType::PrimaryUserId);
+  table.set<PolicyUriSubpacket>(SignatureSubpacketType::PolicyUri);
+  table.set<KeyFlagsSubpacket>(SignatureSubpacketType::KeyFlags);
+  table.set<SignersUserIdSubpacket>(SignatureSubpacketType::SignersUserId);
+  table.set<ReasonForRevocationSubpacket>(
+      SignatureSubpacketType::ReasonForRevocation);
+  table.set<FeaturesSubpacket>(SignatureSubpacketType::Features);
+  table.set<SignatureTargetSubpacket>(SignatureSubpacketType::SignatureTarget);
+  table.set<EmbeddedSignatureSubpacket>(
+      SignatureSubpacketType::EmbeddedSignature);
+  return table;
+}
+
+}  // namespace
+
+SignatureSubpacketFactoryTable& SignatureSubpacket::factories() {
+  static SignatureSubpacketFactoryTable table = make_factories();
+  return table;
+}
+
 std::unique_ptr<SignatureSubpacket> SignatureSubpacket::create_or_throw(
     SignatureSubpacketType type, ParserInput& in) {
-  switch (type) {
-    case SignatureSubpacketType::SignatureCreationTime:
-      return SignatureCreationTimeSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::SignatureExpirationTime:
-      return SignatureExpirationTimeSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::ExportableCertification:
-      return ExportableCertificationSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::TrustSignature:
-      return TrustSignatureSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::RegularExpression:
-      return RegularExpressionSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::Revocable:
-      return RevocableSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::KeyExpirationTime:
-      return KeyExpirationTimeSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::PreferredSymmetricAlgorithms:
-      return PreferredSymmetricAlgorithmsSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::RevocationKey:
-      return RevocationKeySubpacket::create_or_throw(in);
-    case SignatureSubpacketType::Issuer:
-      return IssuerSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::NotationData:
-      return NotationDataSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::PreferredHashAlgorithms:
-      return PreferredHashAlgorithmsSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::PreferredCompressionAlgorithms:
-      return PreferredCompressionAlgorithmsSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::KeyServerPreferences:
-      return KeyServerPreferencesSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::PreferredKeyServer:
-      return PreferredKeyServerSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::PrimaryUserId:
-      return PrimaryUserIdSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::PolicyUri:
-      return PolicyUriSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::KeyFlags:
-      return KeyFlagsSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::SignersUserId:
-      return SignersUserIdSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::ReasonForRevocation:
-      return ReasonForRevocationSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::Features:
-      return FeaturesSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::SignatureTarget:
-      return SignatureTargetSubpacket::create_or_throw(in);
-    case SignatureSubpacketType::EmbeddedSignature:
-      return EmbeddedSignatureSubpacket::create_or_throw(in);
-    default:
-      return RawSignatureSubpacket::create_or_throw(type, in);
-  }
+  return factories().create_or_throw(type, in);
 }
 
 uint32_t SignatureSubpacket::body_length() const {
-  CountingStream cnt;
+  ByteWriter cnt{nullptr};
   write_body(cnt);
-  return cnt.bytes_written();
+  return cnt.size();
 }
 
-void SignatureSubpacket::write(std::ostream& out,
+void SignatureSubpacket::write(ByteWriter& out,
                                SignatureSubpacketLengthType length_type) const {
   if (m_length) {
     m_length->write(out);
   } else {
-    CountingStream cnt;
+    ByteWriter cnt{nullptr};
     write_body(cnt);
-    uint32_t len = cnt.bytes_written();
+    uint32_t len = cnt.size();
     // Length needs to include the type octet.
     if (len == (uint32_t)-1)
       throw std::length_error("signature subpacket too large");
@@ -179,6 +182,6 @@ void SignatureSubpacket::write(std::ostream& out,
   }
   auto subpacket_type = static_cast<uint8_t>(type());
   if (critical()) subpacket_type |= 0x80_b;
-  out << subpacket_type;
+  out.put_u8(subpacket_type);
   write_body(out);
 }
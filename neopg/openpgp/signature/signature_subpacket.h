@@ -5,7 +5,9 @@
 
 #pragma once
 
+#include <neopg/openpgp/factory_table.h>
 #include <neopg/openpgp/packet.h>
+#include <neopg/utils/byte_writer.h>
 
 #include <memory>
 #include <vector>
@@ -42,7 +44,7 @@ class NEOPG_UNSTABLE_API SignatureSubpacketLength {
                            SignatureSubpacketLengthType length_type =
                                SignatureSubpacketLengthType::Default);
 
-  void write(std::ostream& out);
+  void write(ByteWriter& out);
 };
 
 /// Represent an OpenPGP [signature
@@ -95,9 +97,16 @@ enum class NEOPG_UNSTABLE_API SignatureSubpacketType : uint8_t {
   // Maximum is 127 (Bit 7 is the "critical" bit).
 };
 
+class SignatureSubpacket;
+
+/// The table of signature subpacket parsers, see
+/// SignatureSubpacket::factories().
+using SignatureSubpacketFactoryTable =
+    FactoryTable<SignatureSubpacket, SignatureSubpacketType, 256>;
+
 /// Represent an OpenPGP [signature
 /// subpacket](https://tools.ietf.org/html/rfc4880#section-5.2.3.1).
-class NEOPG_UNSTABLE_API SignatureSubpacket {
+class NEOPG_UNSTABLE_API SignatureSubpacket : public ArenaAllocated {
  public:
   /// Create new signature subpacket from \p input. Throw an exception on error.
   ///
@@ -110,6 +119,10 @@ class NEOPG_UNSTABLE_API SignatureSubpacket {
   static std::unique_ptr<SignatureSubpacket> create_or_throw(
       SignatureSubpacketType type, ParserInput& in);
 
+  /// The parsers used by create_or_throw().  Unknown types are parsed as
+  /// RawSignatureSubpacket.
+  static SignatureSubpacketFactoryTable& factories();
+
   /// The critical flag.
   bool m_critical{false};
 
@@ -118,14 +131,14 @@ class NEOPG_UNSTABLE_API SignatureSubpacket {
 
   /// Write the subpacket to \p out. If \p m_length is set, use that. Otherwise,
   /// generate a default header using the provided length type.
-  void write(std::ostream& out,
+  void write(ByteWriter& out,
              SignatureSubpacketLengthType length_type =
                  SignatureSubpacketLengthType::Default) const;
 
   /// Write the body of the subpacket to \p out.
   ///
-  /// @param out The output stream to which the body is written.
-  virtual void write_body(std::ostream& out) const = 0;
+  /// @param out The output to which the body is written.
+  virtual void write_body(ByteWriter& out) const = 0;
 
   /// Return the length of the subpacket.
   uint32_t body_length() const;
@@ -15,7 +15,7 @@
 using namespace NeoPG;
 
 TEST(OpenpgpSignatureSubpacket, CreateDefaultLengthType) {
-  std::stringstream out;
+  ByteWriter out;
   RawSignatureSubpacket sub;
 
   sub.write(out);
@@ -23,7 +23,7 @@ TEST(OpenpgpSignatureSubpacket, CreateDefaultLengthType) {
 }
 
 TEST(OpenpgpSignatureSubpacket, CreateOneOctetLength) {
-  std::stringstream out;
+  ByteWriter out;
   RawSignatureSubpacket sub;
 
   sub.write(out, SignatureSubpacketLengthType::OneOctet);
@@ -31,7 +31,7 @@ TEST(OpenpgpSignatureSubpacket, CreateOneOctetLength) {
 }
 
 TEST(OpenpgpSignatureSubpacket, CreateFiveOctetLength) {
-  std::stringstream out;
+  ByteWriter out;
   RawSignatureSubpacket sub;
 
   sub.write(out, SignatureSubpacketLengthType::FiveOctet);
@@ -39,7 +39,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -61,12 +61,11 @@ EmbeddedSignatureSubpacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<EmbeddedSignatureSubpacket>();
   pegtl::parse<embedded_signature_subpacket::grammar,
                embedded_signature_subpacket::action,
-               embedded_signature_subpacket::control>(in.m_impl->m_input,
+               embedded_signature_subpacket::control>(in.impl().m_input,
                                                       *packet.get());
   return packet;
 }
 
-void EmbeddedSignatureSubpacket::write_body(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_signature.data()),
-            m_signature.size());
+void EmbeddedSignatureSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_signature.data(), m_signature.size());
 }
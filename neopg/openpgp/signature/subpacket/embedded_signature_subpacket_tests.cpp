@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpEmbeddedSignatureSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     EmbeddedSignatureSubpacket packet;
     packet.m_signature = std::vector<uint8_t>{{0x12, 0x34, 0x56, 0x78}};
     packet.write(out);
@@ -38,7 +38,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -58,11 +58,11 @@ ExportableCertificationSubpacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<ExportableCertificationSubpacket>();
   pegtl::parse<exportable_certification_subpacket::grammar,
                exportable_certification_subpacket::action,
-               exportable_certification_subpacket::control>(in.m_impl->m_input,
+               exportable_certification_subpacket::control>(in.impl().m_input,
                                                             *packet.get());
   return packet;
 }
 
-void ExportableCertificationSubpacket::write_body(std::ostream& out) const {
-  out << m_exportable;
+void ExportableCertificationSubpacket::write_body(ByteWriter& out) const {
+  out.put_u8(m_exportable);
 }
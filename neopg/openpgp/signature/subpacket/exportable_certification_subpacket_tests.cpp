@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpExportableCertificationSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     ExportableCertificationSubpacket packet;
     packet.m_exportable = 0x01;
     packet.write(out);
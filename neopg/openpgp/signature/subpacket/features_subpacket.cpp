@@ -38,7 +38,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -59,11 +59,10 @@ std::unique_ptr<FeaturesSubpacket> FeaturesSubpacket::create_or_throw(
     ParserInput& in) {
   auto packet = NeoPG::make_unique<FeaturesSubpacket>();
   pegtl::parse<features_subpacket::grammar, features_subpacket::action,
-               features_subpacket::control>(in.m_impl->m_input, *packet.get());
+               features_subpacket::control>(in.impl().m_input, *packet.get());
   return packet;
 }
 
-void FeaturesSubpacket::write_body(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_features.data()),
-            m_features.size());
+void FeaturesSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_features.data(), m_features.size());
 }
@@ -39,7 +39,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -57,10 +57,10 @@ std::unique_ptr<IssuerSubpacket> IssuerSubpacket::create_or_throw(
     ParserInput& in) {
   auto packet = NeoPG::make_unique<IssuerSubpacket>();
   pegtl::parse<issuer_subpacket::grammar, issuer_subpacket::action,
-               issuer_subpacket::control>(in.m_impl->m_input, *packet.get());
+               issuer_subpacket::control>(in.impl().m_input, *packet.get());
   return packet;
 }
 
-void IssuerSubpacket::write_body(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_issuer.data()), m_issuer.size());
+void IssuerSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_issuer.data(), m_issuer.size());
 }
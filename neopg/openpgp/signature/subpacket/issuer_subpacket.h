@@ -30,10 +30,10 @@ class NEOPG_UNSTABLE_API IssuerSubpacket : public SignatureSubpacket {
   /// \throws ParserError
   static std::unique_ptr<IssuerSubpacket> create_or_throw(ParserInput& input);
 
-  /// Write the signature subpacket body to the output stream.
+  /// Write the signature subpacket body to the output.
   ///
-  /// \param out the output stream to write to
-  void write_body(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write_body(ByteWriter& out) const override;
 
   /// Return the subpacket type.
   ///
@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpIssuerSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     IssuerSubpacket packet;
     packet.m_issuer =
         std::vector<uint8_t>{{0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08}};
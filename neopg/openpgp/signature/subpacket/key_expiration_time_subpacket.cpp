@@ -37,7 +37,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -57,14 +57,11 @@ KeyExpirationTimeSubpacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<KeyExpirationTimeSubpacket>();
   pegtl::parse<key_expiration_time_subpacket::grammar,
                key_expiration_time_subpacket::action,
-               key_expiration_time_subpacket::control>(in.m_impl->m_input,
+               key_expiration_time_subpacket::control>(in.impl().m_input,
                                                        *packet.get());
   return packet;
 }
 
-void KeyExpirationTimeSubpacket::write_body(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_expiration >> 24)
-      << static_cast<uint8_t>(m_expiration >> 16)
-      << static_cast<uint8_t>(m_expiration >> 8)
-      << static_cast<uint8_t>(m_expiration);
+void KeyExpirationTimeSubpacket::write_body(ByteWriter& out) const {
+  out.put_u32be(m_expiration);
 }
@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpKeyExpirationTimeSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     KeyExpirationTimeSubpacket packet;
     packet.m_expiration = 0x12345678;
     packet.write(out);
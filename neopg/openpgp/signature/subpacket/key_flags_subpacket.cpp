@@ -38,7 +38,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -59,10 +59,10 @@ std::unique_ptr<KeyFlagsSubpacket> KeyFlagsSubpacket::create_or_throw(
     ParserInput& in) {
   auto packet = NeoPG::make_unique<KeyFlagsSubpacket>();
   pegtl::parse<key_flags_subpacket::grammar, key_flags_subpacket::action,
-               key_flags_subpacket::control>(in.m_impl->m_input, *packet.get());
+               key_flags_subpacket::control>(in.impl().m_input, *packet.get());
   return packet;
 }
 
-void KeyFlagsSubpacket::write_body(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_flags.data()), m_flags.size());
+void KeyFlagsSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_flags.data(), m_flags.size());
 }
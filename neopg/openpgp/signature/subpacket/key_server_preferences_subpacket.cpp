@@ -38,7 +38,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -60,11 +60,11 @@ KeyServerPreferencesSubpacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<KeyServerPreferencesSubpacket>();
   pegtl::parse<key_server_preferences_subpacket::grammar,
                key_server_preferences_subpacket::action,
-               key_server_preferences_subpacket::control>(in.m_impl->m_input,
+               key_server_preferences_subpacket::control>(in.impl().m_input,
                                                           *packet.get());
   return packet;
 }
 
-void KeyServerPreferencesSubpacket::write_body(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_flags.data()), m_flags.size());
+void KeyServerPreferencesSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_flags.data(), m_flags.size());
 }
@@ -101,7 +101,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -137,19 +137,18 @@ std::unique_ptr<NotationDataSubpacket> NotationDataSubpacket::create_or_throw(
   auto packet = NeoPG::make_unique<NotationDataSubpacket>();
   pegtl::parse<notation_data_subpacket::grammar,
                notation_data_subpacket::action,
-               notation_data_subpacket::control>(in.m_impl->m_input,
+               notation_data_subpacket::control>(in.impl().m_input,
                                                  *packet.get());
   return packet;
 }
 
-void NotationDataSubpacket::write_body(std::ostream& out) const {
+void NotationDataSubpacket::write_body(ByteWriter& out) const {
   uint16_t name_len = m_name.size();
   uint16_t value_len = m_value.size();
 
-  out.write(reinterpret_cast<const char*>(m_flags.data()), m_flags.size());
-  out << static_cast<uint8_t>(name_len >> 8) << static_cast<uint8_t>(name_len)
-      << static_cast<uint8_t>(value_len >> 8)
-      << static_cast<uint8_t>(value_len);
-  out.write(reinterpret_cast<const char*>(m_name.data()), m_name.size());
-  out.write(reinterpret_cast<const char*>(m_value.data()), m_value.size());
+  out.put_bytes(m_flags.data(), m_flags.size());
+  out.put_u16be(name_len);
+  out.put_u16be(value_len);
+  out.put_bytes(m_name.data(), m_name.size());
+  out.put_bytes(m_value.data(), m_value.size());
 }
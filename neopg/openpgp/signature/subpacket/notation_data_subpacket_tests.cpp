@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpNotationDataSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     NotationDataSubpacket packet;
     packet.m_flags = std::vector<uint8_t>{{0x01, 0x02, 0x03, 0x04}};
     packet.m_name = std::vector<uint8_t>{{0xa1, 0xa2, 0xa3}};
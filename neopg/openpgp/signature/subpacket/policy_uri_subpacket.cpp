@@ -38,7 +38,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -59,9 +59,11 @@ std::unique_ptr<PolicyUriSubpacket> PolicyUriSubpacket::create_or_throw(
     ParserInput& in) {
   auto packet = NeoPG::make_unique<PolicyUriSubpacket>();
   pegtl::parse<policy_uri_subpacket::grammar, policy_uri_subpacket::action,
-               policy_uri_subpacket::control>(in.m_impl->m_input,
+               policy_uri_subpacket::control>(in.impl().m_input,
                                               *packet.get());
   return packet;
 }
 
-void PolicyUriSubpacket::write_body(std::ostream& out) const { out << m_uri; }
+void PolicyUriSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_uri);
+}
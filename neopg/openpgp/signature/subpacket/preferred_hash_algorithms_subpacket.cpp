@@ -40,7 +40,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -62,12 +62,11 @@ PreferredHashAlgorithmsSubpacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<PreferredHashAlgorithmsSubpacket>();
   pegtl::parse<preferred_hash_algorithms_subpacket::grammar,
                preferred_hash_algorithms_subpacket::action,
-               preferred_hash_algorithms_subpacket::control>(in.m_impl->m_input,
+               preferred_hash_algorithms_subpacket::control>(in.impl().m_input,
                                                              *packet.get());
   return packet;
 }
 
-void PreferredHashAlgorithmsSubpacket::write_body(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_algorithms.data()),
-            m_algorithms.size());
+void PreferredHashAlgorithmsSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_algorithms.data(), m_algorithms.size());
 }
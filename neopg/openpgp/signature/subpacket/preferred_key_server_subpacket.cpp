@@ -38,7 +38,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -60,11 +60,11 @@ PreferredKeyServerSubpacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<PreferredKeyServerSubpacket>();
   pegtl::parse<preferred_key_server_subpacket::grammar,
                preferred_key_server_subpacket::action,
-               preferred_key_server_subpacket::control>(in.m_impl->m_input,
+               preferred_key_server_subpacket::control>(in.impl().m_input,
                                                         *packet.get());
   return packet;
 }
 
-void PreferredKeyServerSubpacket::write_body(std::ostream& out) const {
-  out << m_uri;
+void PreferredKeyServerSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_uri);
 }
@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpPreferredKeyServerSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     PreferredKeyServerSubpacket packet;
     packet.m_uri = std::string("\x12\x34\x56\x78", 4);
     packet.write(out);
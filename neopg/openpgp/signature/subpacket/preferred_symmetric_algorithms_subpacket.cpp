@@ -40,7 +40,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -63,12 +63,11 @@ PreferredSymmetricAlgorithmsSubpacket::create_or_throw(ParserInput& in) {
   pegtl::parse<preferred_symmetric_algorithms_subpacket::grammar,
                preferred_symmetric_algorithms_subpacket::action,
                preferred_symmetric_algorithms_subpacket::control>(
-      in.m_impl->m_input, *packet.get());
+      in.impl().m_input, *packet.get());
   return packet;
 }
 
 void PreferredSymmetricAlgorithmsSubpacket::write_body(
-    std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_algorithms.data()),
-            m_algorithms.size());
+    ByteWriter& out) const {
+  out.put_bytes(m_algorithms.data(), m_algorithms.size());
 }
@@ -37,7 +37,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -57,11 +57,11 @@ std::unique_ptr<PrimaryUserIdSubpacket> PrimaryUserIdSubpacket::create_or_throw(
   auto packet = NeoPG::make_unique<PrimaryUserIdSubpacket>();
   pegtl::parse<primary_user_id_subpacket::grammar,
                primary_user_id_subpacket::action,
-               primary_user_id_subpacket::control>(in.m_impl->m_input,
+               primary_user_id_subpacket::control>(in.impl().m_input,
                                                    *packet.get());
   return packet;
 }
 
-void PrimaryUserIdSubpacket::write_body(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_primary);
+void PrimaryUserIdSubpacket::write_body(ByteWriter& out) const {
+  out.put_u8(m_primary);
 }
@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpPrimaryUserIdSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     PrimaryUserIdSubpacket packet;
     packet.m_primary = 0x01;
     packet.write(out);
@@ -38,7 +38,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -61,11 +61,11 @@ std::unique_ptr<RawSignatureSubpacket> RawSignatureSubpacket::create_or_throw(
   packet->m_type = type;
   pegtl::parse<raw_signature_subpacket::grammar,
                raw_signature_subpacket::action,
-               raw_signature_subpacket::control>(in.m_impl->m_input,
+               raw_signature_subpacket::control>(in.impl().m_input,
                                                  *packet.get());
   return packet;
 }
 
-void RawSignatureSubpacket::write_body(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_content.data()), m_content.size());
+void RawSignatureSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_content.data(), m_content.size());
 }
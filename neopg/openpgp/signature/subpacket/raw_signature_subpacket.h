@@ -35,10 +35,10 @@ class NEOPG_UNSTABLE_API RawSignatureSubpacket : public SignatureSubpacket {
   static std::unique_ptr<RawSignatureSubpacket> create_or_throw(
       SignatureSubpacketType type, ParserInput& input);
 
-  /// Write the signature subpacket body to the output stream.
+  /// Write the signature subpacket body to the output.
   ///
-  /// \param out the output stream to write to
-  void write_body(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write_body(ByteWriter& out) const override;
 
   /// \return the subpacket type
   SignatureSubpacketType type() const noexcept override { return m_type; }
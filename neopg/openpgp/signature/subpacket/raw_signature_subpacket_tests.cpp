@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpRawSignatureSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     RawSignatureSubpacket packet;
     packet.m_type = SignatureSubpacketType::SignatureCreationTime;
     packet.m_content = std::string("\x12\x34\x56\x78", 4);
@@ -43,7 +43,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -69,11 +69,12 @@ ReasonForRevocationSubpacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<ReasonForRevocationSubpacket>();
   pegtl::parse<reason_for_revocation_subpacket::grammar,
                reason_for_revocation_subpacket::action,
-               reason_for_revocation_subpacket::control>(in.m_impl->m_input,
+               reason_for_revocation_subpacket::control>(in.impl().m_input,
                                                          *packet.get());
   return packet;
 }
 
-void ReasonForRevocationSubpacket::write_body(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_code) << m_reason;
+void ReasonForRevocationSubpacket::write_body(ByteWriter& out) const {
+  out.put_u8(static_cast<uint8_t>(m_code));
+  out.put_bytes(m_reason);
 }
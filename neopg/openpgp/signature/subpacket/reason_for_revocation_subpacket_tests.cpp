@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpReasonForRevocationSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     ReasonForRevocationSubpacket packet;
     packet.m_code = RevocationCode::KeyCompromised;
     packet.m_reason = "compromised";
@@ -38,7 +38,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -60,11 +60,11 @@ RegularExpressionSubpacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<RegularExpressionSubpacket>();
   pegtl::parse<regular_expression_subpacket::grammar,
                regular_expression_subpacket::action,
-               regular_expression_subpacket::control>(in.m_impl->m_input,
+               regular_expression_subpacket::control>(in.impl().m_input,
                                                       *packet.get());
   return packet;
 }
 
-void RegularExpressionSubpacket::write_body(std::ostream& out) const {
-  out << m_regex;
+void RegularExpressionSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_regex);
 }
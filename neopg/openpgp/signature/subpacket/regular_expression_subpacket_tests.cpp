@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpRegularExpressionSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     RegularExpressionSubpacket packet;
     packet.m_regex = std::string("\x12\x34\x56\x78", 4);
     packet.write(out);
@@ -37,7 +37,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -56,10 +56,10 @@ std::unique_ptr<RevocableSubpacket> RevocableSubpacket::create_or_throw(
     ParserInput& in) {
   auto packet = NeoPG::make_unique<RevocableSubpacket>();
   pegtl::parse<revocable_subpacket::grammar, revocable_subpacket::action,
-               revocable_subpacket::control>(in.m_impl->m_input, *packet.get());
+               revocable_subpacket::control>(in.impl().m_input, *packet.get());
   return packet;
 }
 
-void RevocableSubpacket::write_body(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_revocable);
+void RevocableSubpacket::write_body(ByteWriter& out) const {
+  out.put_u8(m_revocable);
 }
@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpRevocableSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     RevocableSubpacket packet;
     packet.m_revocable = 0x01;
     packet.write(out);
@@ -48,7 +48,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -76,13 +76,13 @@ std::unique_ptr<RevocationKeySubpacket> RevocationKeySubpacket::create_or_throw(
   auto packet = NeoPG::make_unique<RevocationKeySubpacket>();
   pegtl::parse<revocation_key_subpacket::grammar,
                revocation_key_subpacket::action,
-               revocation_key_subpacket::control>(in.m_impl->m_input,
+               revocation_key_subpacket::control>(in.impl().m_input,
                                                   *packet.get());
   return packet;
 }
 
-void RevocationKeySubpacket::write_body(std::ostream& out) const {
-  out << m_class << static_cast<uint8_t>(m_algorithm);
-  out.write(reinterpret_cast<const char*>(m_fingerprint.data()),
-            m_fingerprint.size());
+void RevocationKeySubpacket::write_body(ByteWriter& out) const {
+  out.put_u8(m_class);
+  out.put_u8(static_cast<uint8_t>(m_algorithm));
+  out.put_bytes(m_fingerprint.data(), m_fingerprint.size());
 }
@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpRevocationKeySubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     RevocationKeySubpacket packet;
     packet.m_class = 0x80;
     packet.m_algorithm = PublicKeyAlgorithm::Rsa;
@@ -37,7 +37,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -57,14 +57,11 @@ SignatureCreationTimeSubpacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<SignatureCreationTimeSubpacket>();
   pegtl::parse<signature_creation_time_subpacket::grammar,
                signature_creation_time_subpacket::action,
-               signature_creation_time_subpacket::control>(in.m_impl->m_input,
+               signature_creation_time_subpacket::control>(in.impl().m_input,
                                                            *packet.get());
   return packet;
 }
 
-void SignatureCreationTimeSubpacket::write_body(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_created >> 24)
-      << static_cast<uint8_t>(m_created >> 16)
-      << static_cast<uint8_t>(m_created >> 8)
-      << static_cast<uint8_t>(m_created);
+void SignatureCreationTimeSubpacket::write_body(ByteWriter& out) const {
+  out.put_u32be(m_created);
 }
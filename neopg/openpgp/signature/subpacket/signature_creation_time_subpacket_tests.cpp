@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpSignatureCreationTimeSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     SignatureCreationTimeSubpacket packet;
     packet.m_created = 0x12345678;
     packet.write(out);
@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpSignatureExpirationTimeSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     SignatureExpirationTimeSubpacket packet;
     packet.m_expiration = 0x12345678;
     packet.write(out);
@@ -55,7 +55,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -83,50 +83,50 @@ SignatureTargetSubpacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<SignatureTargetSubpacket>();
   pegtl::parse<signature_target_subpacket::grammar,
                signature_target_subpacket::action,
-               signature_target_subpacket::control>(in.m_impl->m_input,
+               signature_target_subpacket::control>(in.impl().m_input,
                                                     *packet.get());
 
   switch (packet->m_hash_algorithm) {
     case HashAlgorithm::Md5: {
       Botan::MD5 digest;
       if (packet->m_hash.size() != digest.output_length())
-        in.error("signature target subpacket hash size wrong for MD5");
+        in.fail("signature target subpacket hash size wrong for MD5");
       break;
     }
     case HashAlgorithm::Sha1: {
       Botan::SHA_160 digest;
       if (packet->m_hash.size() != digest.output_length())
-        in.error("signature target subpacket hash size wrong for SHA-1");
+        in.fail("signature target subpacket hash size wrong for SHA-1");
       break;
     }
     case HashAlgorithm::Ripemd160: {
       Botan::RIPEMD_160 digest;
       if (packet->m_hash.size() != digest.output_length())
-        in.error("signature target subpacket hash size wrong for RIPEMD-160");
+        in.fail("signature target subpacket hash size wrong for RIPEMD-160");
       break;
     }
     case HashAlgorithm::Sha256: {
       Botan::SHA_256 digest;
       if (packet->m_hash.size() != digest.output_length())
-        in.error("signature target subpacket hash size wrong for SHA-256");
+        in.fail("signature target subpacket hash size wrong for SHA-256");
       break;
     }
     case HashAlgorithm::Sha384: {
       Botan::SHA_384 digest;
       if (packet->m_hash.size() != digest.output_length())
-        in.error("signature target subpacket hash size wrong for SHA-384");
+        in.fail("signature target subpacket hash size wrong for SHA-384");
       break;
     }
     case HashAlgorithm::Sha512: {
       Botan::SHA_512 digest;
       if (packet->m_hash.size() != digest.output_length())
-        in.error("signature target subpacket hash size wrong for SHA-512");
+        in.fail("signature target subpacket hash size wrong for SHA-512");
       break;
     }
     case HashAlgorithm::Sha224: {
       Botan::SHA_224 digest;
       if (packet->m_hash.size() != digest.output_length())
-        in.error("signature target subpacket hash size wrong for SHA-224");
+        in.fail("signature target subpacket hash size wrong for SHA-224");
       break;
     }
     default:
@@ -136,8 +136,8 @@ SignatureTargetSubpacket::create_or_throw(ParserInput& in) {
   return packet;
 }
 
-void SignatureTargetSubpacket::write_body(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_public_key_algorithm)
-      << static_cast<uint8_t>(m_hash_algorithm);
-  out.write(reinterpret_cast<const char*>(m_hash.data()), m_hash.size());
+void SignatureTargetSubpacket::write_body(ByteWriter& out) const {
+  out.put_u8(static_cast<uint8_t>(m_public_key_algorithm));
+  out.put_u8(static_cast<uint8_t>(m_hash_algorithm));
+  out.put_bytes(m_hash.data(), m_hash.size());
 }
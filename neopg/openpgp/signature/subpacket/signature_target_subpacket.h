@@ -43,10 +43,10 @@ class NEOPG_UNSTABLE_API SignatureTargetSubpacket : public SignatureSubpacket {
   static std::unique_ptr<SignatureTargetSubpacket> create_or_throw(
       ParserInput& input);
 
-  /// Write the signature subpacket body to the output stream.
+  /// Write the signature subpacket body to the output.
   ///
-  /// \param out the output stream to write to
-  void write_body(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write_body(ByteWriter& out) const override;
 
   /// Return the subpacket type.
   ///
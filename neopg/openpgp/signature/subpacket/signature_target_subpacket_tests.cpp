@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpSignatureTargetSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     SignatureTargetSubpacket packet;
     packet.m_public_key_algorithm = PublicKeyAlgorithm::Rsa;
     packet.m_hash_algorithm = HashAlgorithm::Sha1;
@@ -38,7 +38,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -60,11 +60,11 @@ std::unique_ptr<SignersUserIdSubpacket> SignersUserIdSubpacket::create_or_throw(
   auto packet = NeoPG::make_unique<SignersUserIdSubpacket>();
   pegtl::parse<signers_user_id_subpacket::grammar,
                signers_user_id_subpacket::action,
-               signers_user_id_subpacket::control>(in.m_impl->m_input,
+               signers_user_id_subpacket::control>(in.impl().m_input,
                                                    *packet.get());
   return packet;
 }
 
-void SignersUserIdSubpacket::write_body(std::ostream& out) const {
-  out << m_user_id;
+void SignersUserIdSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_user_id);
 }
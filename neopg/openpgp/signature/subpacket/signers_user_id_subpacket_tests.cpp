@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpSignersUserIdSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     SignersUserIdSubpacket packet;
     packet.m_user_id = std::string("\x12\x34\x56\x78", 4);
     packet.write(out);
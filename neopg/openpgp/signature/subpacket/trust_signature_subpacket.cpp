@@ -42,7 +42,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -66,11 +66,12 @@ TrustSignatureSubpacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<TrustSignatureSubpacket>();
   pegtl::parse<trust_signature_subpacket::grammar,
                trust_signature_subpacket::action,
-               trust_signature_subpacket::control>(in.m_impl->m_input,
+               trust_signature_subpacket::control>(in.impl().m_input,
                                                    *packet.get());
   return packet;
 }
 
-void TrustSignatureSubpacket::write_body(std::ostream& out) const {
-  out << m_level << m_amount;
+void TrustSignatureSubpacket::write_body(ByteWriter& out) const {
+  out.put_u8(m_level);
+  out.put_u8(m_amount);
 }
@@ -14,7 +14,7 @@ using namespace NeoPG;
 
 TEST(OpenpgpTrustSignatureSubpacket, Create) {
   {
-    std::stringstream out;
+    ByteWriter out;
     TrustSignatureSubpacket packet;
     packet.m_level = 0xab;
     packet.m_amount = 0xcd;
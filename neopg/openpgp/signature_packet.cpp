@@ -39,7 +39,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -54,25 +54,21 @@ const std::string control<eof>::error_message = "signature packet is too large";
 }  // namespace NeoPG
 
 std::unique_ptr<SignaturePacket> SignaturePacket::create(ParserInput& in) {
-  try {
-    return SignaturePacket::create_or_throw(in);
-  } catch (const ParserError&) {
-    return nullptr;
-  }
+  return ParserErrorTrap::call(&SignaturePacket::create_or_throw, in);
 }
 
 std::unique_ptr<SignaturePacket> SignaturePacket::create_or_throw(
     ParserInput& in) {
   auto packet = make_unique<SignaturePacket>();
   pegtl::parse<signature_packet::grammar, signature_packet::action,
-               signature_packet::control>(in.m_impl->m_input, *packet.get());
+               signature_packet::control>(in.impl().m_input, *packet.get());
   packet->m_signature = SignatureData::create_or_throw(packet->version(), in);
   pegtl::parse<signature_packet::end, signature_packet::action,
-               signature_packet::control>(in.m_impl->m_input, *packet.get());
+               signature_packet::control>(in.impl().m_input, *packet.get());
   return packet;
 }
 
-void SignaturePacket::write_body(std::ostream& out) const {
-  out << static_cast<uint8_t>(m_version);
+void SignaturePacket::write_body(ByteWriter& out) const {
+  out.put_u8(static_cast<uint8_t>(m_version));
   if (m_signature) m_signature->write(out);
 }
@@ -8,8 +8,8 @@
 
 namespace NeoPG {
 
-void SymmetricallyEncryptedDataPacket::write_body(std::ostream& out) const {
-  out.write((char*)m_data.data(), m_data.size());
+void SymmetricallyEncryptedDataPacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_data.data(), m_data.size());
 }
 
 PacketType SymmetricallyEncryptedDataPacket::type() const {
@@ -14,7 +14,8 @@ namespace NeoPG {
 struct NEOPG_UNSTABLE_API SymmetricallyEncryptedDataPacket : Packet {
   std::vector<uint8_t> m_data;
 
-  void write_body(std::ostream& out) const override;
+  void write_body(ByteWriter& out) const override;
+  uint32_t body_length() const override { return m_data.size(); }
   PacketType type() const override;
 };
 
@@ -9,9 +9,9 @@
 namespace NeoPG {
 
 void SymmetricallyEncryptedIntegrityProtectedDataPacket::write_body(
-    std::ostream& out) const {
-  out << (uint8_t)0x01;
-  out.write((char*)m_data.data(), m_data.size());
+    ByteWriter& out) const {
+  out.put_u8(VERSION);
+  out.put_bytes(m_data.data(), m_data.size());
 }
 
 PacketType SymmetricallyEncryptedIntegrityProtectedDataPacket::type() const {
@@ -13,9 +13,13 @@ namespace NeoPG {
 
 struct NEOPG_UNSTABLE_API SymmetricallyEncryptedIntegrityProtectedDataPacket
     : Packet {
+  /// The only version defined by RFC 4880.
+  static const uint8_t VERSION = 0x01;
+
   std::vector<uint8_t> m_data;
 
-  void write_body(std::ostream& out) const override;
+  void write_body(ByteWriter& out) const override;
+  uint32_t body_length() const override { return 1 + m_data.size(); }
   PacketType type() const override;
 };
 
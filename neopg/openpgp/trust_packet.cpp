@@ -35,7 +35,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -51,20 +51,16 @@ const std::string control<eof>::error_message = "trust packet is too large";
 }  // namespace NeoPG
 
 std::unique_ptr<TrustPacket> TrustPacket::create(ParserInput& in) {
-  try {
-    return TrustPacket::create_or_throw(in);
-  } catch (const ParserError&) {
-    return nullptr;
-  }
+  return ParserErrorTrap::call(&TrustPacket::create_or_throw, in);
 }
 
 std::unique_ptr<TrustPacket> TrustPacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<TrustPacket>();
   pegtl::parse<trust_packet::grammar, trust_packet::action,
-               trust_packet::control>(in.m_impl->m_input, *packet.get());
+               trust_packet::control>(in.impl().m_input, *packet.get());
   return packet;
 }
 
-void TrustPacket::write_body(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_data.data()), m_data.size());
+void TrustPacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_data.data(), m_data.size());
 }
@@ -45,10 +45,15 @@ class NEOPG_UNSTABLE_API TrustPacket : public Packet {
   /// The (raw) content of the trust packet.
   std::vector<uint8_t> m_data;
 
-  /// Write the packet body to the output stream.
+  /// Write the packet body to the output.
   ///
-  /// \param out the output stream to write to
-  void write_body(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write_body(ByteWriter& out) const override;
+
+  /// Return the length of the packet body.
+  ///
+  /// \return the length of #m_data
+  uint32_t body_length() const override { return m_data.size(); }
 
   /// Return the packet type.
   ///
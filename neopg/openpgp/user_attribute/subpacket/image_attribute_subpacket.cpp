@@ -8,8 +8,17 @@
 #include <neopg/intern/cplusplus.h>
 #include <neopg/intern/pegtl.h>
 
+#include <stdexcept>
+
 using namespace NeoPG;
 
+const size_t ImageAttributeSubpacket::HEADER_LENGTH;
+
+namespace {
+thread_local ImageAttributeSubpacket::Mode current_mode =
+    ImageAttributeSubpacket::Mode::Copy;
+}  // namespace
+
 namespace NeoPG {
 namespace image_attribute_subpacket {
 
@@ -38,8 +47,23 @@ struct action<header_encoding> {
 };
 
 template <>
-struct action<image> : bind<ImageAttributeSubpacket, std::vector<uint8_t>,
-                            &ImageAttributeSubpacket::m_image> {};
+struct action<image> {
+  template <typename Input>
+  static void apply(const Input& in, ImageAttributeSubpacket& packet) {
+    auto ptr = reinterpret_cast<const uint8_t*>(in.begin());
+    switch (ImageAttributeSubpacket::mode()) {
+      case ImageAttributeSubpacket::Mode::Copy:
+        packet.m_image.assign(ptr, ptr + in.size());
+        break;
+      case ImageAttributeSubpacket::Mode::Borrow:
+        packet.set_image_view(ptr, in.size());
+        break;
+      case ImageAttributeSubpacket::Mode::Skip:
+        packet.set_image_skipped(in.size());
+        break;
+    }
+  }
+};
 
 template <>
 struct action<header_tail> : bind<ImageAttributeSubpacket, std::vector<uint8_t>,
@@ -52,7 +76,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -78,23 +102,75 @@ ImageAttributeSubpacket::create_or_throw(ParserInput& in) {
   auto data = make_unique<ImageAttributeSubpacket>();
   pegtl::parse<image_attribute_subpacket::grammar,
                image_attribute_subpacket::action,
-               image_attribute_subpacket::control>(in.m_impl->m_input,
+               image_attribute_subpacket::control>(in.impl().m_input,
                                                    *data.get());
   return data;
 }
 
-void ImageAttributeSubpacket::write_body(std::ostream& out) const {
+ImageAttributeSubpacket::Scope::Scope(Mode mode) : m_previous(current_mode) {
+  current_mode = mode;
+}
+
+ImageAttributeSubpacket::Scope::~Scope() { current_mode = m_previous; }
+
+ImageAttributeSubpacket::Mode ImageAttributeSubpacket::mode() noexcept {
+  return current_mode;
+}
+
+void ImageAttributeSubpacket::set_image_view(const uint8_t* data,
+                                             size_t length) noexcept {
+  m_image.clear();
+  m_view = data;
+  m_view_size = length;
+  m_skipped = false;
+}
+
+void ImageAttributeSubpacket::set_image_skipped(size_t length) noexcept {
+  m_image.clear();
+  m_view = nullptr;
+  m_view_size = length;
+  m_skipped = true;
+}
+
+size_t ImageAttributeSubpacket::image_size() const noexcept {
+  return (m_view || m_skipped) ? m_view_size : m_image.size();
+}
+
+const uint8_t* ImageAttributeSubpacket::image_data() const noexcept {
+  if (m_skipped) return nullptr;
+  return m_view ? m_view : m_image.data();
+}
+
+const std::vector<uint8_t>& ImageAttributeSubpacket::image() {
+  if (m_skipped)
+    throw std::logic_error("image attribute subpacket: image was skipped");
+  if (m_view) {
+    m_image.assign(m_view, m_view + m_view_size);
+    m_view = nullptr;
+    m_view_size = 0;
+  }
+  return m_image;
+}
+
+void ImageAttributeSubpacket::write_body(ByteWriter& out) const {
+  if (m_skipped && !out.counting())
+    throw std::logic_error("image attribute subpacket: image was skipped");
+
   // Little-endian image header length ("historical accident").
-  out << static_cast<uint8_t>(0x10) << static_cast<uint8_t>(0x00);
+  out.put_u8(0x10);
+  out.put_u8(0x00);
   // Image header version.
-  out << static_cast<uint8_t>(0x01);
+  out.put_u8(0x01);
   // Encoding.
-  out << static_cast<uint8_t>(m_encoding);
+  out.put_u8(static_cast<uint8_t>(m_encoding));
   // Reserved.
   if (m_tail.size() == 12)
-    out.write(reinterpret_cast<const char*>(m_tail.data()), m_tail.size());
+    out.put_bytes(m_tail.data(), m_tail.size());
   else
-    out << std::string(12, '\x00');
+    out.put_bytes(std::string(12, '\x00'));
 
-  out.write(reinterpret_cast<const char*>(m_image.data()), m_image.size());
+  if (m_skipped)
+    out.put_bytes(nullptr, m_view_size);
+  else
+    out.put_bytes(image_data(), image_size());
 }
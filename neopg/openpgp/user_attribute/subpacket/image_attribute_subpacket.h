@@ -33,13 +33,53 @@ enum class NEOPG_UNSTABLE_API ImageEncoding : uint8_t {
 /// Representation of an OpenPGP
 /// [image attribute](https://tools.ietf.org/html/rfc4880#section-5.12.1)
 /// subpacket.
+///
+/// Photo IDs are often hundreds of KB, and most consumers (dumps, key
+/// listings) only need the size.  The parser copies the image into #m_image
+/// by default, but within a Scope it can instead borrow the image from the
+/// parser input, or skip it and only record its size, see Mode.
 class NEOPG_UNSTABLE_API ImageAttributeSubpacket
     : public UserAttributeSubpacket {
  public:
+  /// How the parser stores the image data.
+  enum class Mode : uint8_t {
+    /// Copy the image into #m_image.
+    Copy,
+    /// Borrow the image from the parser input, which must outlive the
+    /// subpacket (for example, a mapped file).  It is copied on first call
+    /// to image().
+    Borrow,
+    /// Only record the size of the image.  Such a subpacket can not be
+    /// written out.
+    Skip
+  };
+
+  /// Use the parser mode \p mode on this thread for the lifetime of the
+  /// scope.  Scopes can be nested.
+  class NEOPG_UNSTABLE_API Scope {
+   public:
+    Scope(Mode mode);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    Mode m_previous;
+  };
+
+  /// Return the parser mode of this thread.
+  static Mode mode() noexcept;
+
+  /// The length of the image header, which precedes the image in the
+  /// subpacket body.
+  static const size_t HEADER_LENGTH = 16;
+
   /// The subpacket type.
   ImageEncoding m_encoding{ImageEncoding::JPEG};
 
-  /// The content.
+  /// The content.  This is empty if the image was borrowed (until image() is
+  /// called) or skipped by the parser.
   std::vector<uint8_t> m_image;
 
   /// The header tail (should be all zero, but sometimes isn't).
@@ -50,7 +90,7 @@ class NEOPG_UNSTABLE_API ImageAttributeSubpacket
   static const size_t MAX_LENGTH = 1024 * 1024;
 
   /// Create new image attribute subpacket from \p input. Throw an exception
-  /// on error.
+  /// on error.  The image is stored according to mode().
   ///
   /// \param input the parser input to read from
   ///
@@ -60,6 +100,28 @@ class NEOPG_UNSTABLE_API ImageAttributeSubpacket
   static std::unique_ptr<ImageAttributeSubpacket> create_or_throw(
       ParserInput& input);
 
+  /// Borrow the image from \p data instead of #m_image.  The data must
+  /// outlive the subpacket, or the next call to image().
+  void set_image_view(const uint8_t* data, size_t length) noexcept;
+
+  /// Mark the image of \p length bytes as skipped.
+  void set_image_skipped(size_t length) noexcept;
+
+  /// \return the size of the image, without copying it
+  size_t image_size() const noexcept;
+
+  /// \return the image data (borrowed or owned), or nullptr if it was
+  /// skipped
+  const uint8_t* image_data() const noexcept;
+
+  /// \return true if the image was skipped by the parser
+  bool image_skipped() const noexcept { return m_skipped; }
+
+  /// Return the image, copying a borrowed image into #m_image first.
+  ///
+  /// \throws std::logic_error if the image was skipped
+  const std::vector<uint8_t>& image();
+
   /// Return the user attribute subpacket type.
   ///
   /// \return the the value UserAttributeSubpacketType::Image
@@ -67,10 +129,18 @@ class NEOPG_UNSTABLE_API ImageAttributeSubpacket
     return UserAttributeSubpacketType::Image;
   };
 
-  /// Write the user attribute subpacket to the output stream.
+  /// Write the user attribute subpacket to the output.  If the image was
+  /// skipped, only a counting writer is supported (see body_length()).
   ///
-  /// \param out the output stream to write to
-  void write_body(std::ostream& out) const override;
+  /// \param out the output to write to
+  ///
+  /// \throws std::logic_error if the image was skipped
+  void write_body(ByteWriter& out) const override;
+
+ private:
+  const uint8_t* m_view{nullptr};
+  size_t m_view_size{0};
+  bool m_skipped{false};
 };
 
 }  // namespace NeoPG
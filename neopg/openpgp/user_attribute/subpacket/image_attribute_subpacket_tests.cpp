@@ -9,6 +9,7 @@
 
 #include <memory>
 #include <sstream>
+#include <stdexcept>
 
 using namespace NeoPG;
 
@@ -24,7 +25,7 @@ const std::vector<uint8_t> small_jpeg{
     0x01, 0x01, 0x00, 0x00, 0x3f, 0x00, 0xd2, 0xcf, 0x20, 0xff, 0xd9};
 
 TEST(ImageAttributeSubpacket, WriteEmpty) {
-  std::stringstream out;
+  ByteWriter out;
   ImageAttributeSubpacket packet;
   packet.write(out);
   ASSERT_EQ(out.str(), std::string("\x11\x01"
@@ -34,7 +35,7 @@ TEST(ImageAttributeSubpacket, WriteEmpty) {
 }
 
 TEST(ImageAttributeSubpacket, WriteImage) {
-  std::stringstream out;
+  ByteWriter out;
   ImageAttributeSubpacket packet;
   packet.m_image = small_jpeg;
   packet.write(out);
@@ -45,3 +46,52 @@ TEST(ImageAttributeSubpacket, WriteImage) {
                         18) +
                 std::string((char*)small_jpeg.data(), small_jpeg.size()));
 }
+
+TEST(ImageAttributeSubpacket, ParseModes) {
+  const std::string raw = std::string("\x10\x00\x01\x01"
+                                      "\0\0\0\0\0\0\0\0\0\0\0\0",
+                                      16) +
+                          std::string((char*)small_jpeg.data(),
+                                      small_jpeg.size());
+  const uint8_t* image = reinterpret_cast<const uint8_t*>(raw.data()) +
+                         ImageAttributeSubpacket::HEADER_LENGTH;
+  ASSERT_EQ(ImageAttributeSubpacket::mode(),
+            ImageAttributeSubpacket::Mode::Copy);
+  {
+    ParserInput in(raw.data(), raw.size());
+    auto packet = ImageAttributeSubpacket::create_or_throw(in);
+    ASSERT_EQ(packet->m_image, small_jpeg);
+    ASSERT_NE(packet->image_data(), image);
+  }
+
+  {
+    ImageAttributeSubpacket::Scope scope{
+        ImageAttributeSubpacket::Mode::Borrow};
+    ParserInput in(raw.data(), raw.size());
+    auto packet = ImageAttributeSubpacket::create_or_throw(in);
+    ASSERT_TRUE(packet->m_image.empty());
+    ASSERT_EQ(packet->image_data(), image);
+    ASSERT_EQ(packet->image_size(), small_jpeg.size());
+    ByteWriter out;
+    packet->write_body(out);
+    ASSERT_EQ(out.str(), raw);
+    // Materialize a copy.
+    ASSERT_EQ(packet->image(), small_jpeg);
+    ASSERT_NE(packet->image_data(), image);
+  }
+
+  {
+    ImageAttributeSubpacket::Scope scope{ImageAttributeSubpacket::Mode::Skip};
+    ParserInput in(raw.data(), raw.size());
+    auto packet = ImageAttributeSubpacket::create_or_throw(in);
+    ASSERT_TRUE(packet->image_skipped());
+    ASSERT_EQ(packet->image_data(), nullptr);
+    ASSERT_EQ(packet->image_size(), small_jpeg.size());
+    ASSERT_EQ(packet->body_length(), raw.size());
+    ByteWriter out;
+    ASSERT_THROW(packet->write_body(out), std::logic_error);
+    ASSERT_THROW(packet->image(), std::logic_error);
+  }
+  ASSERT_EQ(ImageAttributeSubpacket::mode(),
+            ImageAttributeSubpacket::Mode::Copy);
+}
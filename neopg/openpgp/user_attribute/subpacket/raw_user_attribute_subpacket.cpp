@@ -35,7 +35,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -59,11 +59,11 @@ RawUserAttributeSubpacket::create_or_throw(UserAttributeSubpacketType type,
   data->m_type = type;
   pegtl::parse<raw_user_attribute_subpacket::grammar,
                raw_user_attribute_subpacket::action,
-               raw_user_attribute_subpacket::control>(in.m_impl->m_input,
+               raw_user_attribute_subpacket::control>(in.impl().m_input,
                                                       *data.get());
   return data;
 }
 
-void RawUserAttributeSubpacket::write_body(std::ostream& out) const {
-  out.write(reinterpret_cast<const char*>(m_content.data()), m_content.size());
+void RawUserAttributeSubpacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_content.data(), m_content.size());
 }
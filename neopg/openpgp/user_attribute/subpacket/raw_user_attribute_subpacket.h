@@ -45,10 +45,10 @@ class NEOPG_UNSTABLE_API RawUserAttributeSubpacket
   /// \return the user attribute subpacket type
   UserAttributeSubpacketType type() const noexcept override { return m_type; };
 
-  /// Write the user attribute subpacket to the output stream.
+  /// Write the user attribute subpacket to the output.
   ///
-  /// \param out the output stream to write to
-  void write_body(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write_body(ByteWriter& out) const override;
 };
 
 }  // namespace NeoPG
@@ -8,7 +8,7 @@
 #include <neopg/openpgp/user_attribute/subpacket/image_attribute_subpacket.h>
 #include <neopg/openpgp/user_attribute/subpacket/raw_user_attribute_subpacket.h>
 
-#include <neopg/utils/stream.h>
+#include <neopg/utils/byte_writer.h>
 
 using namespace NeoPG;
 
@@ -45,27 +45,25 @@ UserAttributeSubpacketLength::UserAttributeSubpacketLength(
   set_length(length, length_type);
 }
 
-void UserAttributeSubpacketLength::write(std::ostream& out) {
+void UserAttributeSubpacketLength::write(ByteWriter& out) {
   UserAttributeSubpacketLengthType lentype = m_length_type;
   if (lentype == UserAttributeSubpacketLengthType::Default)
     lentype = best_length_type(m_length);
 
   switch (lentype) {
     case UserAttributeSubpacketLengthType::OneOctet:
-      out << (uint8_t)m_length;
+      out.put_u8(m_length);
       break;
 
     case UserAttributeSubpacketLengthType::TwoOctet: {
       uint32_t adj_length = m_length - 0xc0;
-      out << (uint8_t)(((adj_length >> 8) & 0x3f) + 0xc0)
-          << ((uint8_t)(adj_length & 0xff));
+      out.put_u8(((adj_length >> 8) & 0x3f) + 0xc0);
+      out.put_u8(adj_length & 0xff);
     } break;
 
     case UserAttributeSubpacketLengthType::FiveOctet:
-      out << (uint8_t)0xff << ((uint8_t)((m_length >> 24) & 0xff))
-          << ((uint8_t)((m_length >> 16) & 0xff))
-          << ((uint8_t)((m_length >> 8) & 0xff))
-          << ((uint8_t)(m_length & 0xff));
+      out.put_u8(0xff);
+      out.put_u32be(m_length);
       break;
 
     // LCOV_EXCL_START
@@ -77,24 +75,39 @@ void UserAttributeSubpacketLength::write(std::ostream& out) {
   }
 }
 
+namespace {
+
+std::unique_ptr<UserAttributeSubpacket> create_raw_subpacket(
+    UserAttributeSubpacketType type, ParserInput& in) {
+  return RawUserAttributeSubpacket::create_or_throw(type, in);
+}
+
+UserAttributeSubpacketFactoryTable make_factories() {
+  UserAttributeSubpacketFactoryTable table{create_raw_subpacket};
+  table.set<ImageAttributeSubpacket>(UserAttributeSubpacketType::Image);
+  return table;
+}
+
+}  // namespace
+
+UserAttributeSubpacketFactoryTable& UserAttributeSubpacket::factories() {
+  static UserAttributeSubpacketFactoryTable table = make_factories();
+  return table;
+}
+
 std::unique_ptr<UserAttributeSubpacket> UserAttributeSubpacket::create_or_throw(
     UserAttributeSubpacketType type, ParserInput& in) {
-  switch (type) {
-    case UserAttributeSubpacketType::Image:
-      return ImageAttributeSubpacket::create_or_throw(in);
-    default:
-      return RawUserAttributeSubpacket::create_or_throw(type, in);
-  }
+  return factories().create_or_throw(type, in);
 }
 
 void UserAttributeSubpacket::write(
-    std::ostream& out, UserAttributeSubpacketLengthType length_type) const {
+    ByteWriter& out, UserAttributeSubpacketLengthType length_type) const {
   if (m_length) {
     m_length->write(out);
   } else {
-    CountingStream cnt;
+    ByteWriter cnt{nullptr};
     write_body(cnt);
-    uint32_t len = cnt.bytes_written();
+    uint32_t len = cnt.size();
     // Length needs to include the type octet.
     if (len == (uint32_t)-1)
       throw std::length_error("user attribute subpacket too large");
@@ -103,12 +116,12 @@ void UserAttributeSubpacket::write(
     default_length.write(out);
   }
   auto subpacket_type = static_cast<uint8_t>(type());
-  out << subpacket_type;
+  out.put_u8(subpacket_type);
   write_body(out);
 }
 
 uint32_t UserAttributeSubpacket::body_length() const {
-  CountingStream cnt;
+  ByteWriter cnt{nullptr};
   write_body(cnt);
-  return cnt.bytes_written();
+  return cnt.size();
 }
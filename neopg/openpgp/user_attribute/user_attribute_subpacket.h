@@ -5,8 +5,11 @@
 
 #pragma once
 
+#include <neopg/openpgp/factory_table.h>
+#include <neopg/utils/byte_writer.h>
 #include <neopg/utils/common.h>
 #include <neopg/parser/parser_input.h>
+#include <neopg/utils/arena.h>
 
 #include <cstdint>
 #include <memory>
@@ -45,7 +48,7 @@ class NEOPG_UNSTABLE_API UserAttributeSubpacketLength {
                                UserAttributeSubpacketLengthType length_type =
                                    UserAttributeSubpacketLengthType::Default);
 
-  void write(std::ostream& out);
+  void write(ByteWriter& out);
 };
 
 /// Representation of an OpenPGP [user attribute subpacket
@@ -66,9 +69,16 @@ enum class NEOPG_UNSTABLE_API UserAttributeSubpacketType : uint8_t {
   Private_110 = 0x6e,
 };
 
+class UserAttributeSubpacket;
+
+/// The table of user attribute subpacket parsers, see
+/// UserAttributeSubpacket::factories().
+using UserAttributeSubpacketFactoryTable =
+    FactoryTable<UserAttributeSubpacket, UserAttributeSubpacketType, 256>;
+
 /// Representation of an OpenPGP [user
 /// attribute](https://tools.ietf.org/html/rfc4880#section-5.12) packet.
-class NEOPG_UNSTABLE_API UserAttributeSubpacket {
+class NEOPG_UNSTABLE_API UserAttributeSubpacket : public ArenaAllocated {
  public:
   /// Create new user attribute subpacket from \p input. Throw an exception on
   /// error.
@@ -82,19 +92,23 @@ class NEOPG_UNSTABLE_API UserAttributeSubpacket {
   static std::unique_ptr<UserAttributeSubpacket> create_or_throw(
       UserAttributeSubpacketType type, ParserInput& in);
 
+  /// The parsers used by create_or_throw().  Unknown types are parsed as
+  /// RawUserAttributeSubpacket.
+  static UserAttributeSubpacketFactoryTable& factories();
+
   /// Use this to overwrite the default length (including the type field).
   std::unique_ptr<UserAttributeSubpacketLength> m_length;
 
   /// Write the subpacket to \p out. If \p m_length is set, use that. Otherwise,
   /// generate a default header using the provided length type.
-  void write(std::ostream& out,
+  void write(ByteWriter& out,
              UserAttributeSubpacketLengthType length_type =
                  UserAttributeSubpacketLengthType::Default) const;
 
   /// Write the body of the subpacket to \p out.
   ///
-  /// @param out The output stream to which the body is written.
-  virtual void write_body(std::ostream& out) const = 0;
+  /// @param out The output to which the body is written.
+  virtual void write_body(ByteWriter& out) const = 0;
 
   /// Return the length of the subpacket.
   uint32_t body_length() const;
@@ -15,7 +15,7 @@
 using namespace NeoPG;
 
 TEST(OpenpgpUserAttributeSubpacket, CreateDefaultLengthType) {
-  std::stringstream out;
+  ByteWriter out;
   RawUserAttributeSubpacket sub;
 
   sub.write(out);
@@ -23,7 +23,7 @@ TEST(OpenpgpUserAttributeSubpacket, CreateDefaultLengthType) {
 }
 
 TEST(OpenpgpUserAttributeSubpacket, CreateOneOctetLength) {
-  std::stringstream out;
+  ByteWriter out;
   RawUserAttributeSubpacket sub;
 
   sub.write(out, UserAttributeSubpacketLengthType::OneOctet);
@@ -31,7 +31,7 @@ TEST(OpenpgpUserAttributeSubpacket, CreateOneOctetLength) {
 }
 
 TEST(OpenpgpUserAttributeSubpacket, CreateFiveOctetLength) {
-  std::stringstream out;
+  ByteWriter out;
   RawUserAttributeSubpacket sub;
 
   sub.write(out, UserAttributeSubpacketLengthType::FiveOctet);
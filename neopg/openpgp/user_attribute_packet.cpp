@@ -32,8 +32,10 @@ struct subpacket_data {
                     std::unique_ptr<UserAttributeSubpacketLength>& length,
                     UserAttributeSubpacketType& type,
                     UserAttributePacket& packet) {
-    if (length->m_length == 0)
-      throw parser_error("invalid user attribute subpacket length of zero", in);
+    if (length->m_length == 0) {
+      raise_parser_error("invalid user attribute subpacket length of zero", in);
+      return false;
+    }
     uint32_t subpacket_length = length->m_length - 1;
     if (in.size(subpacket_length) >= subpacket_length) {
       in.bump(subpacket_length);
@@ -133,7 +135,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -166,12 +168,12 @@ std::unique_ptr<UserAttributePacket> UserAttributePacket::create_or_throw(
   std::unique_ptr<UserAttributeSubpacketLength> length;
   UserAttributeSubpacketType type;
   pegtl::parse<user_attribute_packet::subpackets, user_attribute_packet::action,
-               user_attribute_packet::control>(in.m_impl->m_input, length, type,
+               user_attribute_packet::control>(in.impl().m_input, length, type,
                                                *packet.get());
 
   return packet;
 }
 
-void UserAttributePacket::write_body(std::ostream& out) const {
+void UserAttributePacket::write_body(ByteWriter& out) const {
   for (const auto& subpacket : m_subpackets) subpacket->write(out);
 }
@@ -38,10 +38,10 @@ class NEOPG_UNSTABLE_API UserAttributePacket : public Packet {
   static std::unique_ptr<UserAttributePacket> create_or_throw(
       ParserInput& input);
 
-  /// Write the packet body to the output stream.
+  /// Write the packet body to the output.
   ///
-  /// \param out the output stream to write to
-  void write_body(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write_body(ByteWriter& out) const override;
 
   /// Return the packet type.
   ///
@@ -36,7 +36,7 @@ struct control : pegtl::normal<Rule> {
 
   template <typename Input, typename... States>
   static void raise(const Input& in, States&&...) {
-    throw parser_error(error_message, in);
+    raise_parser_error(error_message, in);
   }
 };
 
@@ -52,20 +52,16 @@ const std::string control<eof>::error_message = "user id packet is too large";
 }  // namespace NeoPG
 
 std::unique_ptr<UserIdPacket> UserIdPacket::create(ParserInput& in) {
-  try {
-    return UserIdPacket::create_or_throw(in);
-  } catch (const ParserError&) {
-    return nullptr;
-  }
+  return ParserErrorTrap::call(&UserIdPacket::create_or_throw, in);
 }
 
 std::unique_ptr<UserIdPacket> UserIdPacket::create_or_throw(ParserInput& in) {
   auto packet = NeoPG::make_unique<UserIdPacket>();
   pegtl::parse<user_id_packet::grammar, user_id_packet::action,
-               user_id_packet::control>(in.m_impl->m_input, *packet.get());
+               user_id_packet::control>(in.impl().m_input, *packet.get());
   return packet;
 }
 
-void UserIdPacket::write_body(std::ostream& out) const {
-  out.write(m_content.data(), m_content.size());
+void UserIdPacket::write_body(ByteWriter& out) const {
+  out.put_bytes(m_content.data(), m_content.size());
 }
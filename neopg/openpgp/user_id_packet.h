@@ -46,10 +46,15 @@ class NEOPG_UNSTABLE_API UserIdPacket : public Packet {
   /// The user ID.
   std::string m_content;
 
-  /// Write the packet body to the output stream.
+  /// Write the packet body to the output.
   ///
-  /// \param out the output stream to write to
-  void write_body(std::ostream& out) const override;
+  /// \param out the output to write to
+  void write_body(ByteWriter& out) const override;
+
+  /// Return the length of the packet body.
+  ///
+  /// \return the length of #m_content
+  uint32_t body_length() const override { return m_content.size(); }
 
   /// Return the packet type.
   ///
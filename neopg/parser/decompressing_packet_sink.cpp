@@ -0,0 +1,213 @@
+// OpenPGP decompressing packet sink (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/decompressing_packet_sink.h>
+
+#include <neopg/parser/push_packet_parser.h>
+
+#include <botan/compression.h>
+#include <botan/secmem.h>
+
+#include <algorithm>
+#include <exception>
+
+using namespace NeoPG;
+
+const size_t DecompressingPacketSink::INPUT_BLOCK_SIZE;
+
+DecompressingPacketSink::DecompressingPacketSink(
+    RawPacketRefSink& sink, const DecompressionLimits& limits,
+    bool pass_compressed)
+    : DecompressingPacketSink(sink, limits, pass_compressed, 0, m_own_totals) {
+}
+
+DecompressingPacketSink::DecompressingPacketSink(
+    RawPacketRefSink& sink, const DecompressionLimits& limits,
+    bool pass_compressed, size_t depth, Totals& totals)
+    : m_sink(sink),
+      m_limits(limits),
+      m_pass_compressed(pass_compressed),
+      m_depth(depth),
+      m_totals(totals) {}
+
+DecompressingPacketSink::~DecompressingPacketSink() = default;
+
+void DecompressingPacketSink::next_packet(const PacketHeader& header,
+                                          const char* data, size_t length) {
+  bool decompress = begin(header);
+  if (!decompress || m_pass_compressed)
+    m_sink.next_packet(header, data, length);
+  if (!decompress) return;
+  feed(data, length);
+  finish();
+}
+
+void DecompressingPacketSink::start_packet(const PacketHeader& header) {
+  bool decompress = begin(header);
+  m_pass = !decompress || m_pass_compressed;
+  if (m_pass) m_sink.start_packet(header);
+}
+
+void DecompressingPacketSink::continue_packet(
+    const NewPacketLength* length_info, const char* data, size_t length) {
+  if (m_pass) m_sink.continue_packet(length_info, data, length);
+  if (m_state != State::Idle) feed(data, length);
+}
+
+void DecompressingPacketSink::finish_packet(const NewPacketLength* length_info,
+                                            const char* data, size_t length) {
+  if (m_pass) m_sink.finish_packet(length_info, data, length);
+  if (m_state == State::Idle) return;
+  feed(data, length);
+  finish();
+}
+
+void DecompressingPacketSink::error_packet(const PacketHeader& header,
+                                           const ParserError& error) {
+  m_sink.error_packet(header, error);
+}
+
+bool DecompressingPacketSink::begin(const PacketHeader& header) {
+  reset();
+  if (header.type() != PacketType::CompressedData) return false;
+
+  if (m_depth >= m_limits.m_max_depth) {
+    ParserPosition pos("-", header.m_offset);
+    m_sink.error_packet(header,
+                        ParserError("compressed data nested too deeply", pos));
+    return false;
+  }
+
+  // The parser only creates these two types of headers.
+  if (header.format() == PacketFormat::Old) {
+    m_old_header = static_cast<const OldPacketHeader&>(header);
+    m_header = &m_old_header;
+  } else {
+    m_new_header = static_cast<const NewPacketHeader&>(header);
+    m_header = &m_new_header;
+  }
+  m_state = State::Algorithm;
+  return true;
+}
+
+void DecompressingPacketSink::feed(const char* data, size_t length) {
+  if (m_state == State::Algorithm && length > 0) {
+    start(static_cast<uint8_t>(data[0]));
+    data++;
+    length--;
+  }
+
+  Botan::secure_vector<uint8_t> buffer;
+  while (m_state == State::Body && length > 0) {
+    size_t block = std::min(length, INPUT_BLOCK_SIZE);
+    // Only the outermost input counts, everything below it is already
+    // output.
+    if (m_depth == 0) m_totals.m_in += block;
+    if (!m_decompressor)
+      inflated(data, block);
+    else {
+      buffer.assign(data, data + block);
+      try {
+        m_decompressor->update(buffer);
+      } catch (const std::exception& exc) {
+        fail(std::string("decompression failed: ") + exc.what());
+        return;
+      }
+      inflated(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    }
+    data += block;
+    length -= block;
+  }
+}
+
+void DecompressingPacketSink::finish() {
+  if (m_state == State::Algorithm) fail("compressed data packet too short");
+
+  if (m_state == State::Body && m_decompressor) {
+    Botan::secure_vector<uint8_t> buffer;
+    try {
+      m_decompressor->finish(buffer);
+    } catch (const std::exception& exc) {
+      fail(std::string("decompression failed: ") + exc.what());
+    }
+    if (m_state == State::Body)
+      inflated(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  }
+
+  if (m_state == State::Body) {
+    try {
+      m_nested->finish();
+    } catch (const ParserError& exc) {
+      fail(exc.what());
+    }
+  }
+  reset();
+}
+
+void DecompressingPacketSink::start(uint8_t algorithm) {
+  const char* name = nullptr;
+  switch (static_cast<CompressionAlgorithm>(algorithm)) {
+    case CompressionAlgorithm::Uncompressed:
+      break;
+    case CompressionAlgorithm::Deflate:
+      name = "deflate";
+      break;
+    case CompressionAlgorithm::Zlib:
+      name = "zlib";
+      break;
+    case CompressionAlgorithm::Bzip2:
+      name = "bzip2";
+      break;
+    default:
+      fail("unknown compression algorithm " + std::to_string(algorithm));
+      return;
+  }
+
+  if (name) {
+    m_decompressor.reset(Botan::make_decompressor(name));
+    if (!m_decompressor) {
+      fail(std::string("unsupported compression algorithm ") + name);
+      return;
+    }
+    m_decompressor->start();
+  }
+
+  m_nested_sink.reset(new DecompressingPacketSink(
+      m_sink, m_limits, m_pass_compressed, m_depth + 1, m_totals));
+  m_nested.reset(new PushPacketParser(*m_nested_sink));
+  m_state = State::Body;
+}
+
+void DecompressingPacketSink::inflated(const char* data, size_t length) {
+  m_totals.m_out += length;
+  if (m_totals.m_out > m_limits.m_ratio_allowance &&
+      m_totals.m_out > m_totals.m_in * m_limits.m_max_ratio) {
+    fail("compressed data expands too much");
+    return;
+  }
+
+  try {
+    m_nested->feed(data, length);
+  } catch (const ParserError& exc) {
+    fail(exc.what());
+  }
+}
+
+void DecompressingPacketSink::fail(const std::string& message) {
+  ParserPosition pos("-", m_header->m_offset);
+  m_sink.error_packet(*m_header, ParserError(message, pos));
+  m_nested.reset();
+  m_nested_sink.reset();
+  m_decompressor.reset();
+  m_state = State::Skip;
+}
+
+void DecompressingPacketSink::reset() noexcept {
+  m_nested.reset();
+  m_nested_sink.reset();
+  m_decompressor.reset();
+  m_header = nullptr;
+  m_state = State::Idle;
+}
@@ -0,0 +1,149 @@
+// OpenPGP decompressing packet sink
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains support for parsing the content of compressed data
+/// packets in bounded memory.
+
+#pragma once
+
+#include <neopg/openpgp/compressed_data_packet.h>
+#include <neopg/parser/openpgp.h>
+
+#include <cstdint>
+#include <memory>
+
+namespace Botan {
+class Decompression_Algorithm;
+}
+
+namespace NeoPG {
+
+class PushPacketParser;
+
+/// Limits that protect a DecompressingPacketSink against compression bombs.
+struct NEOPG_UNSTABLE_API DecompressionLimits {
+  /// The maximum number of nested compressed data packets that are
+  /// decompressed.  Deeper compressed data packets are passed on as is, and
+  /// reported with error_packet.
+  size_t m_max_depth{8};
+
+  /// The maximum number of decompressed bytes (at all nesting levels) per
+  /// byte of compressed input.
+  uint64_t m_max_ratio{100};
+
+  /// The number of decompressed bytes that is always allowed, independent
+  /// of the ratio.  This lets small, well compressed messages through.
+  uint64_t m_ratio_allowance{1024 * 1024};
+};
+
+/// Pass the callbacks of a RawPacketRefSink on to another one, and in
+/// addition decompress the bodies of compressed data packets and pass the
+/// packets they contain on to the same sink, recursively.
+///
+/// The content is decompressed while the compressed data arrives, in small
+/// blocks, and framed with a PushPacketParser, so neither the compressed nor
+/// the decompressed data is held in memory (except for incomplete packets,
+/// which are bounded by RawPacketParser::MAX_PARSER_BUFFER).  The offsets in
+/// the headers of the contained packets are relative to the decompressed
+/// stream.
+///
+/// If a limit in DecompressionLimits is exceeded, or the compressed data or
+/// its content is malformed, decompression of the outermost compressed data
+/// packet affected stops, and the error is reported with error_packet for
+/// its header.  Parsing continues after that packet.
+class NEOPG_UNSTABLE_API DecompressingPacketSink : public RawPacketRefSink {
+ public:
+  /// Create a sink that passes everything on to \p sink.  If \p
+  /// pass_compressed is false, compressed data packets that are
+  /// decompressed are replaced by their content instead of being passed on,
+  /// too.
+  DecompressingPacketSink(RawPacketRefSink& sink,
+                          const DecompressionLimits& limits = {},
+                          bool pass_compressed = true);
+  ~DecompressingPacketSink();
+
+  /// \return the total number of decompressed bytes so far
+  uint64_t decompressed() const noexcept { return m_totals.m_out; }
+
+  // Implement interface of RawPacketRefSink.
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override;
+  void start_packet(const PacketHeader& header) override;
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override;
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override;
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override;
+
+ private:
+  // The compressed input is fed to the decompressor in blocks of this size,
+  // which bounds the output of a single decompression step.
+  static const size_t INPUT_BLOCK_SIZE = 1024;
+
+  // The byte counts that the expansion ratio applies to, shared by all
+  // nesting levels.
+  struct Totals {
+    uint64_t m_in{0};
+    uint64_t m_out{0};
+  };
+
+  enum class State {
+    // Not in a compressed data packet.
+    Idle,
+    // Waiting for the algorithm octet.
+    Algorithm,
+    // Decompressing the body.
+    Body,
+    // Skipping the rest of a compressed data packet after an error.
+    Skip
+  };
+
+  DecompressingPacketSink(RawPacketRefSink& sink,
+                          const DecompressionLimits& limits,
+                          bool pass_compressed, size_t depth, Totals& totals);
+
+  RawPacketRefSink& m_sink;
+  DecompressionLimits m_limits;
+  bool m_pass_compressed;
+  size_t m_depth;
+  Totals m_own_totals;
+  Totals& m_totals;
+
+  State m_state{State::Idle};
+
+  // The current packet is passed on to m_sink.
+  bool m_pass{false};
+
+  // A copy of the header of the current compressed data packet, for error
+  // reporting.  Points to either m_old_header or m_new_header.
+  PacketHeader* m_header{nullptr};
+  OldPacketHeader m_old_header{PacketType::Reserved, 0};
+  NewPacketHeader m_new_header{PacketType::Reserved, 0};
+
+  std::unique_ptr<Botan::Decompression_Algorithm> m_decompressor;
+
+  // The parser (and its sink) for the content of the current compressed
+  // data packet.
+  std::unique_ptr<DecompressingPacketSink> m_nested_sink;
+  std::unique_ptr<PushPacketParser> m_nested;
+
+  // Return true if the body of the packet with \p header is decompressed.
+  bool begin(const PacketHeader& header);
+  // Feed compressed data of the current packet.
+  void feed(const char* data, size_t length);
+  // Finish the current packet.
+  void finish();
+  // Set up decompression for the algorithm octet \p algorithm.
+  void start(uint8_t algorithm);
+  // Pass decompressed data on to the nested parser.
+  void inflated(const char* data, size_t length);
+  // Stop decompressing the current packet because of \p message.
+  void fail(const std::string& message);
+  void reset() noexcept;
+};
+
+}  // namespace NeoPG
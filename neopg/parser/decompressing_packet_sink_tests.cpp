@@ -0,0 +1,198 @@
+// OpenPGP decompressing packet sink (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/decompressing_packet_sink.h>
+
+#include <neopg/parser/push_packet_parser.h>
+
+#include <botan/compression.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace NeoPG;
+
+namespace {
+class LogSink : public RawPacketRefSink {
+ public:
+  std::vector<std::string> m_log;
+
+  static std::string type_str(const PacketHeader& header) {
+    return std::to_string(static_cast<int>(header.type()));
+  }
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override {
+    m_log.emplace_back("next " + type_str(header) + " " +
+                       std::to_string(length));
+  }
+  void start_packet(const PacketHeader& header) override {
+    m_log.emplace_back("start " + type_str(header));
+  }
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override {
+    m_log.emplace_back("continue " + std::to_string(length));
+  }
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override {
+    m_log.emplace_back("finish " + std::to_string(length));
+  }
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override {
+    m_log.emplace_back("error " + type_str(header) + " " + error.what());
+  }
+};
+
+// A new format packet of type \p type with a definite length.
+std::string packet(uint8_t type, const std::string& body) {
+  std::string data(1, static_cast<char>(0xc0 | type));
+  if (body.size() < 192)
+    data.push_back(static_cast<char>(body.size()));
+  else {
+    uint32_t len = body.size();
+    data.push_back('\xff');
+    for (int shift = 24; shift >= 0; shift -= 8)
+      data.push_back(static_cast<char>(len >> shift));
+  }
+  return data + body;
+}
+
+// A compressed data packet containing \p content, compressed with the
+// Botan algorithm \p algo (empty for none).
+std::string compressed(const std::string& content,
+                       const std::string& algo = "") {
+  if (algo.empty()) return packet(8, std::string(1, '\x00') + content);
+
+  std::unique_ptr<Botan::Compression_Algorithm> compressor{
+      Botan::make_compressor(algo)};
+  compressor->start();
+  Botan::secure_vector<uint8_t> buffer(content.begin(), content.end());
+  compressor->finish(buffer);
+  const char id = algo == "deflate" ? '\x01' : algo == "zlib" ? '\x02' : '\x03';
+  return packet(8, std::string(1, id) + std::string(buffer.begin(),
+                                                     buffer.end()));
+}
+
+std::vector<std::string> decompress_log(
+    const std::string& data, const DecompressionLimits& limits = {},
+    bool pass_compressed = true, size_t chunk = 0) {
+  LogSink log;
+  DecompressingPacketSink sink{log, limits, pass_compressed};
+  PushPacketParser parser{sink};
+  if (chunk == 0) chunk = data.size();
+  for (size_t pos = 0; pos < data.size(); pos += chunk)
+    parser.feed(data.data() + pos, std::min(chunk, data.size() - pos));
+  parser.finish();
+  return log.m_log;
+}
+}  // namespace
+
+TEST(NeopgTest, parser_decompressing_packet_sink_test) {
+  const std::string uid = packet(13, "abc");
+  const std::string content =
+      uid + packet(11, std::string("b\0\0\0\0\0text", 10));
+
+  // Packets outside of compressed data are passed on unchanged.
+  ASSERT_EQ(decompress_log(uid), std::vector<std::string>({"next 13 3"}));
+
+  // Uncompressed content.
+  {
+    auto log = decompress_log(compressed(content) + uid);
+    ASSERT_EQ(log, std::vector<std::string>({"next 8 18", "next 13 3",
+                                             "next 11 10", "next 13 3"}));
+    log = decompress_log(compressed(content), {}, false);
+    ASSERT_EQ(log, std::vector<std::string>({"next 13 3", "next 11 10"}));
+  }
+
+  // Compressed content, also when it arrives in small pieces.
+  for (auto algo : {"deflate", "zlib", "bzip2"}) {
+    std::string data = compressed(content, algo);
+    for (size_t chunk : {0, 1, 5})
+      ASSERT_EQ(decompress_log(data, {}, false, chunk),
+                std::vector<std::string>({"next 13 3", "next 11 10"}))
+          << algo << " chunk size " << chunk;
+  }
+
+  // Nested compressed data (with a partial length at the outer level).
+  {
+    std::string inner = compressed(compressed(uid, "zlib"), "deflate");
+    std::string data = std::string("\xC8\xE0", 2) + inner.substr(2, 1) +
+                       std::string(1, static_cast<char>(inner.size() - 3)) +
+                       inner.substr(3);
+    ASSERT_EQ(decompress_log(data, {}, false),
+              std::vector<std::string>({"next 13 3"}));
+    auto log = decompress_log(data);
+    ASSERT_EQ(log.size(), 5);
+    ASSERT_EQ(log[0], "start 8");
+    ASSERT_EQ(log[1], "continue 1");
+    ASSERT_EQ(log[2], "finish " + std::to_string(inner.size() - 3));
+    ASSERT_EQ(log[3].substr(0, 7), "next 8 ");
+    ASSERT_EQ(log[4], "next 13 3");
+  }
+}
+
+TEST(NeopgTest, parser_decompressing_packet_sink_limits_test) {
+  const std::string uid = packet(13, "abc");
+
+  // Compressed data beyond the maximum depth is passed on as is.
+  {
+    DecompressionLimits limits;
+    limits.m_max_depth = 2;
+    auto log =
+        decompress_log(compressed(compressed(compressed(uid))), limits, false);
+    ASSERT_EQ(log, std::vector<std::string>(
+                       {"error 8 compressed data nested too deeply",
+                        "next 8 6"}));
+  }
+
+  // Compression bombs are stopped early.
+  {
+    std::string bomb =
+        compressed(packet(11, std::string(3 * 1024 * 1024, '\0')), "zlib");
+    DecompressionLimits limits;
+    limits.m_max_ratio = 10;
+    limits.m_ratio_allowance = 0;
+    LogSink log;
+    DecompressingPacketSink sink{log, limits, false};
+    PushPacketParser parser{sink};
+    parser.feed(bomb.data(), bomb.size());
+    parser.finish();
+    ASSERT_EQ(log.m_log, std::vector<std::string>(
+                             {"error 8 compressed data expands too much"}));
+    ASSERT_LT(sink.decompressed(), 2 * 1024 * 1024);
+
+    // The same data with a higher ratio.
+    limits.m_max_ratio = 2000;
+    ASSERT_EQ(decompress_log(bomb, limits, false),
+              std::vector<std::string>({"next 11 3145728"}));
+  }
+
+  // Malformed compressed data.
+  {
+    auto log = decompress_log(packet(8, "\x02garbage"));
+    ASSERT_EQ(log.size(), 2);
+    ASSERT_EQ(log[0], "next 8 8");
+    ASSERT_EQ(log[1].substr(0, 28), "error 8 decompression failed");
+
+    log = decompress_log(packet(8, "\x64" + uid));
+    ASSERT_EQ(log, std::vector<std::string>(
+                       {"next 8 6",
+                        "error 8 unknown compression algorithm 100"}));
+
+    log = decompress_log(packet(8, ""));
+    ASSERT_EQ(log, std::vector<std::string>(
+                       {"next 8 0",
+                        "error 8 compressed data packet too short"}));
+
+    // Malformed content.
+    log = decompress_log(compressed(uid.substr(0, 3)) + uid);
+    ASSERT_EQ(log, std::vector<std::string>({"next 8 4",
+                                             "error 13 packet too short",
+                                             "next 13 3"}));
+  }
+}
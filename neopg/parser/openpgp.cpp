@@ -8,6 +8,8 @@
 #include <neopg/intern/cplusplus.h>
 #include <neopg/intern/pegtl.h>
 
+#include <botan/loadstor.h>
+
 #include <functional>
 
 using namespace NeoPG;
@@ -18,11 +20,19 @@ namespace openpgp {
 // The OpenPGP parser is stateful (due to the length field), so the state,
 // grammar and actions are tightly coupled.
 struct state {
-  RawPacketSink& sink;
+  RawPacketRefSink& sink;
   PacketType packet_type;
   size_t packet_pos;
-  std::unique_ptr<PacketHeader> header;
-  std::unique_ptr<NewPacketLength> length;
+
+  // The header of the current packet, which points to either old_header or
+  // new_header.  These are reused for all packets, so the parser does not
+  // allocate memory for each packet.
+  PacketHeader* header{nullptr};
+  OldPacketHeader old_header{PacketType::Reserved, 0};
+  NewPacketHeader new_header{PacketType::Reserved, 0};
+
+  // The length of the current part of a partial packet.
+  NewPacketLength length{0};
 
   // The exception object if a packet could not be parsed.
   std::unique_ptr<ParserError> exc;
@@ -36,7 +46,12 @@ struct state {
   // This indicates that we have started a partial packet.
   bool started;
 
-  state(RawPacketSink& a_sink) : sink(a_sink) {}
+  // The maximum number of bytes the input can hold at one time, or 0 if the
+  // whole input is in memory (and no packet is too large).
+  size_t max_buffer;
+
+  state(RawPacketRefSink& a_sink, size_t a_max_buffer)
+      : sink(a_sink), max_buffer(a_max_buffer) {}
 };
 
 // A custom rule to match packet data.  This is stateful, because it requires
@@ -50,8 +65,15 @@ struct packet_body_data {
     if (available >= st.packet_len) {
       in.bump(st.packet_len);
       return true;
+    } else if (st.max_buffer == 0) {
+      // The whole input is available, so the packet is truncated.
+      in.bump(available);
+      st.packet_len = 0;
+      st.exc = NeoPG::make_unique<ParserError>(
+          parser_error("packet too short", in));
+      return true;
     } else {
-      uint32_t max = RawPacketParser::MAX_PARSER_BUFFER;
+      uint32_t max = st.max_buffer;
       available = in.size(max);
       if (st.packet_len > max && available == max) {
         // Best we can do at this point is to skip over the packet and set an
@@ -176,7 +198,10 @@ struct is_packet : at<uint8::mask_one<0x80, 0x80>> {};
 struct packet : seq<discard, is_packet, sor<new_packet, old_packet>> {};
 
 // OpenPGP consists of a sequence of packets.
-struct grammar : seq<until<eof, packet>, must<eof>> {};
+struct grammar : seq<until<eof, packet>, pegtl::must<eof>> {};
+
+// Used to parse single packets between runs of scan_packets.
+struct single_packet : sor<packet, pegtl::must<eof>> {};
 
 template <typename Rule>
 struct action : nothing<Rule> {};
@@ -197,9 +222,10 @@ struct action<old_packet_length_one> {
   static void apply(const Input& in, state& st) {
     auto match = in.begin();
     st.packet_len = in.peek_byte();
-    st.header = NeoPG::make_unique<OldPacketHeader>(
-        st.packet_type, st.packet_len, PacketLengthType::OneOctet);
-    st.header->m_offset = st.packet_pos;
+    st.old_header = OldPacketHeader(st.packet_type, st.packet_len,
+                                    PacketLengthType::OneOctet);
+    st.old_header.m_offset = st.packet_pos;
+    st.header = &st.old_header;
   }
 };
 
@@ -209,9 +235,10 @@ struct action<old_packet_length_two> {
   static void apply(const Input& in, state& st) {
     std::string str = in.string();
     st.packet_len = (in.peek_byte(0) << 8) + in.peek_byte(1);
-    st.header = NeoPG::make_unique<OldPacketHeader>(
-        st.packet_type, st.packet_len, PacketLengthType::TwoOctet);
-    st.header->m_offset = st.packet_pos;
+    st.old_header = OldPacketHeader(st.packet_type, st.packet_len,
+                                    PacketLengthType::TwoOctet);
+    st.old_header.m_offset = st.packet_pos;
+    st.header = &st.old_header;
   }
 };
 
@@ -224,9 +251,10 @@ struct action<old_packet_length_four> {
     auto val2 = (uint32_t)in.peek_byte(2);
     auto val3 = (uint32_t)in.peek_byte(3);
     st.packet_len = (val0 << 24) + (val1 << 16) + (val2 << 8) + val3;
-    st.header = NeoPG::make_unique<OldPacketHeader>(
-        st.packet_type, st.packet_len, PacketLengthType::FourOctet);
-    st.header->m_offset = st.packet_pos;
+    st.old_header = OldPacketHeader(st.packet_type, st.packet_len,
+                                    PacketLengthType::FourOctet);
+    st.old_header.m_offset = st.packet_pos;
+    st.header = &st.old_header;
   }
 };
 
@@ -235,9 +263,10 @@ struct action<old_packet_length_na> {
   template <typename Input>
   static void apply(const Input& in, state& st) {
     st.packet_len = INDETERMINATE_LENGTH_CHUNK_SIZE;
-    st.header = NeoPG::make_unique<OldPacketHeader>(
-        st.packet_type, st.packet_len, PacketLengthType::Indeterminate);
-    st.header->m_offset = st.packet_pos;
+    st.old_header = OldPacketHeader(st.packet_type, st.packet_len,
+                                    PacketLengthType::Indeterminate);
+    st.old_header.m_offset = st.packet_pos;
+    st.header = &st.old_header;
     // Simulate a partial packet (we finish differently with
     // packet_body_data_rest).
     st.partial = true;
@@ -261,12 +290,12 @@ struct action<new_packet_length_one> {
   static void apply(const Input& in, state& st) {
     st.packet_len = in.peek_byte();
     if (st.started == false) {
-      st.header = NeoPG::make_unique<NewPacketHeader>(
-          st.packet_type, st.packet_len, PacketLengthType::OneOctet);
-      st.header->m_offset = st.packet_pos;
+      st.new_header = NewPacketHeader(st.packet_type, st.packet_len,
+                                      PacketLengthType::OneOctet);
+      st.new_header.m_offset = st.packet_pos;
+      st.header = &st.new_header;
     } else {
-      st.length = NeoPG::make_unique<NewPacketLength>(
-          st.packet_len, PacketLengthType::OneOctet);
+      st.length = NewPacketLength(st.packet_len, PacketLengthType::OneOctet);
     }
     st.partial = false;
   }
@@ -278,12 +307,12 @@ struct action<new_packet_length_two> {
   static void apply(const Input& in, state& st) {
     st.packet_len = ((in.peek_byte() - 0xc0) << 8) + in.peek_byte(1) + 192;
     if (st.started == false) {
-      st.header = NeoPG::make_unique<NewPacketHeader>(
-          st.packet_type, st.packet_len, PacketLengthType::TwoOctet);
-      st.header->m_offset = st.packet_pos;
+      st.new_header = NewPacketHeader(st.packet_type, st.packet_len,
+                                      PacketLengthType::TwoOctet);
+      st.new_header.m_offset = st.packet_pos;
+      st.header = &st.new_header;
     } else {
-      st.length = NeoPG::make_unique<NewPacketLength>(
-          st.packet_len, PacketLengthType::TwoOctet);
+      st.length = NewPacketLength(st.packet_len, PacketLengthType::TwoOctet);
     }
     st.partial = false;
   }
@@ -299,12 +328,12 @@ struct action<new_packet_length_five> {
     auto val3 = (uint32_t)in.peek_byte(4);
     st.packet_len = (val0 << 24) + (val1 << 16) + (val2 << 8) + val3;
     if (st.started == false) {
-      st.header = NeoPG::make_unique<NewPacketHeader>(
-          st.packet_type, st.packet_len, PacketLengthType::FiveOctet);
-      st.header->m_offset = st.packet_pos;
+      st.new_header = NewPacketHeader(st.packet_type, st.packet_len,
+                                      PacketLengthType::FiveOctet);
+      st.new_header.m_offset = st.packet_pos;
+      st.header = &st.new_header;
     } else {
-      st.length = NeoPG::make_unique<NewPacketLength>(
-          st.packet_len, PacketLengthType::FiveOctet);
+      st.length = NewPacketLength(st.packet_len, PacketLengthType::FiveOctet);
     }
     st.partial = false;
   }
@@ -315,14 +344,13 @@ struct action<new_packet_length_partial> {
   template <typename Input>
   static void apply(const Input& in, state& st) {
     st.packet_len = 1 << (in.peek_byte() & 0x1f);
-    // FIXME: Not necessary if started == true. Would save one allocation.
     if (st.started == false) {
-      st.header = NeoPG::make_unique<NewPacketHeader>(
-          st.packet_type, st.packet_len, PacketLengthType::Partial);
-      st.header->m_offset = st.packet_pos;
+      st.new_header = NewPacketHeader(st.packet_type, st.packet_len,
+                                      PacketLengthType::Partial);
+      st.new_header.m_offset = st.packet_pos;
+      st.header = &st.new_header;
     } else {
-      st.length = NeoPG::make_unique<NewPacketLength>(
-          st.packet_len, PacketLengthType::Partial);
+      st.length = NewPacketLength(st.packet_len, PacketLengthType::Partial);
     }
     st.partial = true;
   }
@@ -333,8 +361,7 @@ struct action<is_packet> {
   template <typename Input>
   static void apply(const Input& in, state& st) {
     st.packet_type = PacketType::Reserved;
-    st.header.reset(nullptr);
-    st.length.reset(nullptr);
+    st.header = nullptr;
     st.exc.reset(nullptr);
     st.partial = false;
     st.started = false;
@@ -351,15 +378,15 @@ struct action<packet_body_data> {
     if (!st.started) {
       if (!st.partial) {
         if (st.exc)
-          st.sink.error_packet(std::move(st.header), std::move(st.exc));
+          st.sink.error_packet(*st.header, *st.exc);
         else
-          st.sink.next_packet(std::move(st.header), data, length);
+          st.sink.next_packet(*st.header, data, length);
       } else {
         // At this point, we don't support error packets for partial packets,
         // because we can't skip them easily. The semantics would be unclear.
         if (st.exc) throw *st.exc;
 
-        st.sink.start_packet(std::move(st.header));
+        st.sink.start_packet(*st.header);
         st.sink.continue_packet(nullptr, data, length);
       }
       st.started = true;
@@ -369,9 +396,9 @@ struct action<packet_body_data> {
       if (st.exc) throw *st.exc;
 
       if (st.partial) {
-        st.sink.continue_packet(std::move(st.length), data, length);
+        st.sink.continue_packet(&st.length, data, length);
       } else {
-        st.sink.finish_packet(std::move(st.length), data, length);
+        st.sink.finish_packet(&st.length, data, length);
       }
     }
     // auto packet = NeoPG::make_unique::make_unique<NeoPG::RawPacket>();
@@ -404,16 +431,215 @@ struct control : pegtl::normal<Rule> {
 template <>
 const std::string control<eof>::error_message = "input has trailing data";
 
+// Frame a run of packets with definite lengths, starting at DATA (which is at
+// offset BASE of the input), without going through the grammar.  This is
+// much faster for streams of small packets, such as keyrings with many
+// signatures.  Stop at the first packet that needs the grammar (partial or
+// indeterminate lengths, truncated input, or an invalid tag), and return the
+// number of bytes consumed.
+size_t scan_packets(const char* data, size_t length, size_t base, state& st) {
+  auto ptr = reinterpret_cast<const uint8_t*>(data);
+  size_t pos = 0;
+  while (pos < length) {
+    const uint8_t* hdr = ptr + pos;
+    size_t avail = length - pos;
+    uint8_t tag = hdr[0];
+    size_t hdr_len = 0;
+    uint32_t len = 0;
+
+    if ((tag & 0x80) == 0 || avail < 2) break;
+    if (tag & 0x40) {
+      auto type = static_cast<PacketType>(tag & 0x3f);
+      auto length_type = PacketLengthType::Default;
+      uint8_t val0 = hdr[1];
+      if (val0 < 0xc0) {
+        hdr_len = 2;
+        len = val0;
+        length_type = PacketLengthType::OneOctet;
+      } else if (val0 < 0xe0) {
+        if (avail < 3) break;
+        hdr_len = 3;
+        len = ((val0 - 0xc0) << 8) + hdr[2] + 192;
+        length_type = PacketLengthType::TwoOctet;
+      } else if (val0 == 0xff) {
+        if (avail < 6) break;
+        hdr_len = 6;
+        len = Botan::load_be<uint32_t>(hdr + 2, 0);
+        length_type = PacketLengthType::FiveOctet;
+      } else {
+        // Partial length.
+        break;
+      }
+      if (avail - hdr_len < len) break;
+      st.new_header = NewPacketHeader(type, len, length_type);
+      st.new_header.m_offset = base + pos;
+      st.header = &st.new_header;
+    } else {
+      auto type = static_cast<PacketType>((tag >> 2) & 0xf);
+      auto length_type = PacketLengthType::Default;
+      switch (tag & 0x03) {
+        case 0x00:
+          hdr_len = 2;
+          len = hdr[1];
+          length_type = PacketLengthType::OneOctet;
+          break;
+        case 0x01:
+          hdr_len = 3;
+          if (avail < hdr_len) break;
+          len = (hdr[1] << 8) + hdr[2];
+          length_type = PacketLengthType::TwoOctet;
+          break;
+        case 0x02:
+          hdr_len = 5;
+          if (avail < hdr_len) break;
+          len = Botan::load_be<uint32_t>(hdr + 1, 0);
+          length_type = PacketLengthType::FourOctet;
+          break;
+        default:
+          // Indeterminate length, hdr_len stays 0.
+          break;
+      }
+      if (hdr_len == 0 || avail < hdr_len || avail - hdr_len < len) break;
+      st.old_header = OldPacketHeader(type, len, length_type);
+      st.old_header.m_offset = base + pos;
+      st.header = &st.old_header;
+    }
+
+    st.sink.next_packet(*st.header, data + pos + hdr_len, len);
+    pos += hdr_len + len;
+  }
+  return pos;
+}
+
+// Parse an input that is completely in memory, using scan_packets where
+// possible, and the grammar for everything else.
+template <typename Input>
+void parse_in_memory(Input& input, state& st) {
+  while (true) {
+    size_t done =
+        scan_packets(input.current(), input.size(), input.byte(), st);
+    input.bump(done);
+    if (input.empty()) break;
+    parse<single_packet, action, control>(input, st);
+  }
+}
+
 }  // namespace openpgp
 
+namespace {
+std::unique_ptr<PacketHeader> copy_header(const PacketHeader& header) {
+  // The parser only creates these two types of headers.
+  if (header.format() == PacketFormat::Old)
+    return NeoPG::make_unique<OldPacketHeader>(
+        static_cast<const OldPacketHeader&>(header));
+  return NeoPG::make_unique<NewPacketHeader>(
+      static_cast<const NewPacketHeader&>(header));
+}
+
+std::unique_ptr<NewPacketLength> copy_length(const NewPacketLength* length) {
+  if (!length) return nullptr;
+  return NeoPG::make_unique<NewPacketLength>(*length);
+}
+}  // namespace
+
+void RawPacketSinkAdaptor::next_packet(const PacketHeader& header,
+                                       const char* data, size_t length) {
+  m_sink.next_packet(copy_header(header), data, length);
+}
+
+void RawPacketSinkAdaptor::start_packet(const PacketHeader& header) {
+  m_sink.start_packet(copy_header(header));
+}
+
+void RawPacketSinkAdaptor::continue_packet(const NewPacketLength* length_info,
+                                           const char* data, size_t length) {
+  m_sink.continue_packet(copy_length(length_info), data, length);
+}
+
+void RawPacketSinkAdaptor::finish_packet(const NewPacketLength* length_info,
+                                         const char* data, size_t length) {
+  m_sink.finish_packet(copy_length(length_info), data, length);
+}
+
+void RawPacketSinkAdaptor::error_packet(const PacketHeader& header,
+                                        const ParserError& error) {
+  m_sink.error_packet(copy_header(header),
+                      NeoPG::make_unique<ParserError>(error));
+}
+
+void FilterPacketSink::next_packet(const PacketHeader& header,
+                                   const char* data, size_t length) {
+  if (m_mask.contains(header.type())) m_sink.next_packet(header, data, length);
+}
+
+void FilterPacketSink::start_packet(const PacketHeader& header) {
+  m_pass = m_mask.contains(header.type());
+  if (m_pass) m_sink.start_packet(header);
+}
+
+void FilterPacketSink::continue_packet(const NewPacketLength* length_info,
+                                       const char* data, size_t length) {
+  if (m_pass) m_sink.continue_packet(length_info, data, length);
+}
+
+void FilterPacketSink::finish_packet(const NewPacketLength* length_info,
+                                     const char* data, size_t length) {
+  if (m_pass) m_sink.finish_packet(length_info, data, length);
+}
+
+void FilterPacketSink::error_packet(const PacketHeader& header,
+                                    const ParserError& error) {
+  if (m_mask.contains(header.type())) m_sink.error_packet(header, error);
+}
+
+void StatsPacketSink::next_packet(const PacketHeader& header,
+                                  const char* data, size_t length) {
+  m_stats->count_packet(header.type(), length);
+  ParserStats::Timer timer{m_stats->m_sink};
+  m_sink.next_packet(header, data, length);
+}
+
+void StatsPacketSink::start_packet(const PacketHeader& header) {
+  m_type = header.type();
+  m_stats->count_packet(m_type, 0);
+  ParserStats::Timer timer{m_stats->m_sink};
+  m_sink.start_packet(header);
+}
+
+void StatsPacketSink::continue_packet(const NewPacketLength* length_info,
+                                      const char* data, size_t length) {
+  m_stats->count_bytes(m_type, length);
+  ParserStats::Timer timer{m_stats->m_sink};
+  m_sink.continue_packet(length_info, data, length);
+}
+
+void StatsPacketSink::finish_packet(const NewPacketLength* length_info,
+                                    const char* data, size_t length) {
+  m_stats->count_bytes(m_type, length);
+  ParserStats::Timer timer{m_stats->m_sink};
+  m_sink.finish_packet(length_info, data, length);
+}
+
+void StatsPacketSink::error_packet(const PacketHeader& header,
+                                   const ParserError& error) {
+  m_stats->count_packet(header.type(), 0);
+  m_stats->m_errors[error.what()]++;
+  ParserStats::Timer timer{m_stats->m_sink};
+  m_sink.error_packet(header, error);
+}
+
 // FIXME: Pass filename to ParserInput (everywhere).
 void RawPacketParser::process(Botan::DataSource& source) {
   using reader_t =
       std::function<std::size_t(char* buffer, const std::size_t length)>;
 
-  auto state = openpgp::state{m_sink};
+  FilterPacketSink filter{m_sink, m_filter};
+  StatsPacketSink stats{filter, m_stats};
+  ParserStats::Scope scope{m_stats};
+  auto state = openpgp::state{sink(filter, stats), MAX_PARSER_BUFFER};
   auto reader = [this, &source, &state](
                     char* buffer, const std::size_t length) mutable -> size_t {
+    if (m_stats) m_stats->m_refills++;
     size_t count = source.read(reinterpret_cast<uint8_t*>(buffer), length);
     return count;
   };
@@ -422,12 +648,42 @@ void RawPacketParser::process(Botan::DataSource& source) {
   parse<openpgp::grammar, openpgp::action, openpgp::control>(input, state);
 }
 
+RawPacketRefSink& RawPacketParser::sink(FilterPacketSink& filter,
+                                        StatsPacketSink& stats) {
+  if (m_stats) return stats;
+  // Without a filter, avoid the extra indirection.
+  if (m_filter.is_all()) return m_sink;
+  return filter;
+}
+
 void RawPacketParser::process(std::istream& source) {
   Botan::DataSource_Stream in{source};
   process(in);
 }
 
 void RawPacketParser::process(const std::string& source) {
-  std::stringstream in{source};
-  process(in);
+  process(source.data(), source.size());
+}
+
+void RawPacketParser::process(const char* data, size_t length,
+                              const std::string& source) {
+  FilterPacketSink filter{m_sink, m_filter};
+  StatsPacketSink stats{filter, m_stats};
+  ParserStats::Scope scope{m_stats};
+  auto state = openpgp::state{sink(filter, stats), 0};
+  memory_input<> input(data, length, source);
+
+  openpgp::parse_in_memory(input, state);
+}
+
+void RawPacketParser::process_mapped(const std::string& path) {
+  // PEGTL's file_input uses mmap where available, and reads the whole file
+  // into memory otherwise.  Either way, it is a memory_input.
+  FilterPacketSink filter{m_sink, m_filter};
+  StatsPacketSink stats{filter, m_stats};
+  ParserStats::Scope scope{m_stats};
+  auto state = openpgp::state{sink(filter, stats), 0};
+  file_input<> input(path);
+
+  openpgp::parse_in_memory(input, state);
 }
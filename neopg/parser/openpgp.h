@@ -6,11 +6,14 @@
 #pragma once
 
 #include <neopg/parser/parser_error.h>
+#include <neopg/parser/parser_stats.h>
 #include <neopg/openpgp/raw_packet.h>
 
 #include <botan/data_snk.h>
 #include <botan/data_src.h>
 
+#include <memory>
+
 namespace NeoPG {
 
 class NEOPG_UNSTABLE_API RawPacketSink {
@@ -46,9 +49,106 @@ class NEOPG_UNSTABLE_API RawPacketSink {
   virtual ~RawPacketSink() = default;
 };
 
-class NEOPG_UNSTABLE_API RawPacketParser {
+/// Like RawPacketSink, but the header, length information and errors are
+/// passed by reference and are only valid during execution of the callback.
+/// The parser does not allocate any memory for these, which makes a
+/// difference for streams with many short partial data chunks.
+class NEOPG_UNSTABLE_API RawPacketRefSink {
+ public:
+  virtual void next_packet(const PacketHeader& header, const char* data,
+                           size_t length) = 0;
+
+  virtual void start_packet(const PacketHeader& header) = 0;
+
+  // LENGTH_INFO is nullptr in the same cases as for RawPacketSink.
+  virtual void continue_packet(const NewPacketLength* length_info,
+                               const char* data, size_t length) = 0;
+
+  virtual void finish_packet(const NewPacketLength* length_info,
+                             const char* data, size_t length) = 0;
+
+  virtual void error_packet(const PacketHeader& header,
+                            const ParserError& error) = 0;
+
+  // Prevent memory leak when upcasting in smart pointer containers.
+  virtual ~RawPacketRefSink() = default;
+};
+
+/// Pass the callbacks of a RawPacketRefSink on to a RawPacketSink, copying
+/// the header, length information and errors into new objects.
+class NEOPG_UNSTABLE_API RawPacketSinkAdaptor : public RawPacketRefSink {
   RawPacketSink& m_sink;
 
+ public:
+  RawPacketSinkAdaptor(RawPacketSink& sink) : m_sink(sink) {}
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override;
+  void start_packet(const PacketHeader& header) override;
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override;
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override;
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override;
+};
+
+/// Pass the callbacks of a RawPacketRefSink on to another one, but only for
+/// packets of the types in a PacketTypeMask.  Other packets are skipped
+/// before anything is allocated or decoded for them.
+class NEOPG_UNSTABLE_API FilterPacketSink : public RawPacketRefSink {
+  RawPacketRefSink& m_sink;
+  PacketTypeMask m_mask;
+
+  // The current partial packet is passed on.
+  bool m_pass{false};
+
+ public:
+  FilterPacketSink(RawPacketRefSink& sink, PacketTypeMask mask)
+      : m_sink(sink), m_mask(mask) {}
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override;
+  void start_packet(const PacketHeader& header) override;
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override;
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override;
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override;
+};
+
+/// Pass the callbacks of a RawPacketRefSink on to another one, and count the
+/// packets, bytes, errors and the time spent in the callbacks in a
+/// ParserStats object.  If the stats are nullptr, the sink must not be used.
+class NEOPG_UNSTABLE_API StatsPacketSink : public RawPacketRefSink {
+  RawPacketRefSink& m_sink;
+  ParserStats* m_stats;
+
+  // The type of the current partial packet.
+  PacketType m_type{PacketType::Reserved};
+
+ public:
+  StatsPacketSink(RawPacketRefSink& sink, ParserStats* stats)
+      : m_sink(sink), m_stats(stats) {}
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override;
+  void start_packet(const PacketHeader& header) override;
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override;
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override;
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override;
+};
+
+class NEOPG_UNSTABLE_API RawPacketParser {
+  std::unique_ptr<RawPacketRefSink> m_adaptor;
+  RawPacketRefSink& m_sink;
+  PacketTypeMask m_filter{PacketTypeMask::all()};
+  ParserStats* m_stats{nullptr};
+
  public:
   // This must be at least as many bytes as the parser needs to see between two
   // discard rules.
@@ -60,11 +160,37 @@ class NEOPG_UNSTABLE_API RawPacketParser {
   // Photo ids can be much larger.
   static const size_t MAX_PARSER_BUFFER = 4 * 1024 * 1024;  // 4 MiB
 
-  RawPacketParser(RawPacketSink& sink) : m_sink(sink) {}
+  RawPacketParser(RawPacketSink& sink)
+      : m_adaptor(new RawPacketSinkAdaptor(sink)), m_sink(*m_adaptor) {}
+  RawPacketParser(RawPacketRefSink& sink) : m_sink(sink) {}
+
+  /// Only pass packets of the types in \p mask to the sink.  The bodies of
+  /// other packets are skipped by the framing layer.
+  void set_filter(PacketTypeMask mask) { m_filter = mask; }
+
+  /// Count packets, bytes, errors, buffer refills and timings in \p stats
+  /// (nullptr disables counting).  Packets skipped by the filter are
+  /// counted, too.
+  void set_stats(ParserStats* stats) { m_stats = stats; }
 
   void process(Botan::DataSource& source);
   void process(std::istream& source);
   void process(const std::string& source);
+
+  /// Process the \p length bytes at \p data in place.  The whole input is
+  /// available to the parser, so the data pointers passed to the sink point
+  /// directly into \p data, and packets are not limited by
+  /// MAX_PARSER_BUFFER.  The \p source name is used in error positions.
+  void process(const char* data, size_t length,
+               const std::string& source = "-");
+
+  /// Map the file at \p path into memory (where supported) and process it
+  /// in place, see process(const char*, size_t).  Throws if the file can not
+  /// be opened or mapped.
+  void process_mapped(const std::string& path);
+
+ private:
+  RawPacketRefSink& sink(FilterPacketSink& filter, StatsPacketSink& stats);
 };
 
 }  // namespace NeoPG
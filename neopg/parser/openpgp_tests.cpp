@@ -68,3 +68,255 @@ TEST(NeopgTest, parser_openpgp_test) {
     // Missing tests: offset, mixed new/old, partial, indeterminate.
   }
 }
+
+TEST(NeopgTest, parser_openpgp_memory_test) {
+  std::vector<std::unique_ptr<RawPacket>> packets;
+  auto sink = TestSink{packets};
+  auto parser = RawPacketParser{sink};
+
+  {
+    std::stringstream data;
+    RawPacket packet{PacketType::Reserved, "reserved"};
+    packet.write(data);
+    const std::string str = data.str();
+
+    parser.process(str.data(), str.size());
+    ASSERT_EQ(packets.size(), 1);
+    ASSERT_EQ(*packets[0], packet);
+  }
+
+  {
+    // Packets larger than the parser buffer are fine for memory input.
+    std::stringstream data;
+    RawPacket packet{
+        PacketType::UserAttribute,
+        std::string(RawPacketParser::MAX_PARSER_BUFFER + 1, 'x')};
+    packet.write(data);
+    const std::string str = data.str();
+
+    packets.clear();
+    parser.process(str.data(), str.size());
+    ASSERT_EQ(packets.size(), 1);
+    ASSERT_EQ(*packets[0], packet);
+  }
+}
+
+namespace {
+class RefTestSink : public RawPacketRefSink {
+ public:
+  std::vector<std::string> m_parts;
+  std::vector<PacketLengthType> m_lengths;
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override {
+    m_parts.emplace_back(data, length);
+  }
+  void start_packet(const PacketHeader& header) override {}
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override {
+    if (length_info) m_lengths.push_back(length_info->m_length_type);
+    m_parts.emplace_back(data, length);
+  }
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override {
+    continue_packet(length_info, data, length);
+  }
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override {}
+};
+}  // namespace
+
+TEST(NeopgTest, parser_openpgp_ref_sink_test) {
+  RefTestSink sink;
+  RawPacketParser parser{sink};
+
+  // A new format user ID packet with a partial length of 512 followed by a
+  // final part of one byte.
+  std::string data{"\xCD\xE9", 2};
+  data.append(512, 'x');
+  data.append("\x01y", 2);
+
+  parser.process(data);
+  ASSERT_EQ(sink.m_parts.size(), 2);
+  ASSERT_EQ(sink.m_parts[0], std::string(512, 'x'));
+  ASSERT_EQ(sink.m_parts[1], "y");
+  ASSERT_EQ(sink.m_lengths.size(), 1);
+  ASSERT_EQ(sink.m_lengths[0], PacketLengthType::OneOctet);
+}
+
+namespace {
+// Record all callbacks, so that different parser modes can be compared.
+class LogSink : public RawPacketRefSink {
+ public:
+  std::vector<std::string> m_log;
+
+  static std::string header_str(const PacketHeader& header) {
+    std::stringstream out;
+    header.write(out);
+    return std::to_string(header.m_offset) + ":" + out.str();
+  }
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override {
+    m_log.emplace_back("next " + header_str(header) + " " +
+                       std::string(data, length));
+  }
+  void start_packet(const PacketHeader& header) override {
+    m_log.emplace_back("start " + header_str(header));
+  }
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override {
+    m_log.emplace_back("continue " + std::string(data, length));
+  }
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override {
+    m_log.emplace_back("finish " + std::string(data, length));
+  }
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override {
+    m_log.emplace_back("error " + header_str(header));
+  }
+};
+
+std::vector<std::string> parse_log(const std::string& data, bool in_memory) {
+  LogSink sink;
+  RawPacketParser parser{sink};
+  if (in_memory) {
+    parser.process(data.data(), data.size());
+  } else {
+    std::stringstream in{data};
+    parser.process(in);
+  }
+  return sink.m_log;
+}
+}  // namespace
+
+TEST(NeopgTest, parser_openpgp_scan_test) {
+  // The in-memory parser frames packets with definite lengths without the
+  // grammar.  It must give the same results as the stream parser.
+  std::string data;
+  data.append("\xCD\x03"
+              "abc",
+              5);
+  data.append("\xCD\xC0\x00", 3);
+  data.append(192, 'a');
+  data.append("\xCD\xFF\x00\x00\x00\x05hello", 11);
+  data.append("\xB4\x03"
+              "abc",
+              5);
+  data.append("\xB5\x00\x03"
+              "abc",
+              6);
+  data.append("\xB6\x00\x00\x00\x03"
+              "abc",
+              8);
+  data.append("\xCD\xE9", 2);
+  data.append(512, 'x');
+  data.append("\x01y", 2);
+  data.append("\xCD\x01z", 3);
+
+  auto log = parse_log(data, true);
+  ASSERT_EQ(log.size(), 10);
+  ASSERT_EQ(log, parse_log(data, false));
+
+  // A truncated packet after a run of good packets.
+  std::string truncated{"\xCD\x03"
+                        "abc\xCD\x05"
+                        "ab",
+                        9};
+  log = parse_log(truncated, true);
+  ASSERT_EQ(log.size(), 2);
+  ASSERT_EQ(log[0], std::string("next 0:\xCD\x03 abc"));
+  ASSERT_EQ(log[1], std::string("error 5:\xCD\x05"));
+  ASSERT_EQ(log, parse_log(truncated, false));
+
+  // Trailing garbage is still reported.
+  ASSERT_THROW(parse_log(std::string("\xCD\x01z\x01", 4), true),
+               ParserError);
+}
+
+TEST(NeopgTest, parser_openpgp_filter_test) {
+  // Unfiltered packets are skipped, including partial packets.
+  std::string data;
+  data.append("\xCD\x03"
+              "abc",
+              5);
+  data.append("\xC2\x01x", 3);
+  data.append("\xC2\xE1"
+              "ab\x01"
+              "c",
+              6);
+  data.append("\xCD\xE1"
+              "de\x01"
+              "f",
+              6);
+  data.append("\xCD\x05"
+              "ab",
+              4);
+
+  for (bool in_memory : {true, false}) {
+    LogSink sink;
+    RawPacketParser parser{sink};
+    parser.set_filter({PacketType::UserId});
+    if (in_memory) {
+      parser.process(data.data(), data.size());
+    } else {
+      std::stringstream in{data};
+      parser.process(in);
+    }
+    ASSERT_EQ(sink.m_log.size(), 5);
+    ASSERT_EQ(sink.m_log[0], std::string("next 0:\xCD\x03 abc"));
+    ASSERT_EQ(sink.m_log[1], std::string("start 14:\xCD\xE1"));
+    ASSERT_EQ(sink.m_log[2], "continue de");
+    ASSERT_EQ(sink.m_log[3], "finish f");
+    ASSERT_EQ(sink.m_log[4], std::string("error 20:\xCD\x05"));
+  }
+
+  // An empty filter skips everything.
+  LogSink sink;
+  RawPacketParser parser{sink};
+  parser.set_filter(PacketTypeMask{});
+  parser.process(data.data(), data.size());
+  ASSERT_EQ(sink.m_log.size(), 0);
+}
+
+TEST(NeopgTest, parser_openpgp_stats_test) {
+  // Packets skipped by the filter are counted, too.
+  std::string data;
+  data.append("\xCD\x03"
+              "abc",
+              5);
+  data.append("\xC2\x01x", 3);
+  data.append("\xC2\xE1"
+              "ab\x01"
+              "c",
+              6);
+  data.append("\xCD\x05"
+              "ab",
+              4);
+
+  for (bool in_memory : {true, false}) {
+    LogSink sink;
+    ParserStats stats;
+    RawPacketParser parser{sink};
+    parser.set_filter({PacketType::UserId});
+    parser.set_stats(&stats);
+    if (in_memory) {
+      parser.process(data.data(), data.size());
+    } else {
+      std::stringstream in{data};
+      parser.process(in);
+    }
+    ASSERT_EQ(sink.m_log.size(), 2);
+    ASSERT_EQ(stats.packets(), 4);
+    ASSERT_EQ(stats.bytes(), 7);
+    ASSERT_EQ(stats.m_packets[static_cast<size_t>(PacketType::UserId)], 2);
+    ASSERT_EQ(stats.m_bytes[static_cast<size_t>(PacketType::UserId)], 3);
+    ASSERT_EQ(stats.m_packets[static_cast<size_t>(PacketType::Signature)], 2);
+    ASSERT_EQ(stats.m_bytes[static_cast<size_t>(PacketType::Signature)], 4);
+    ASSERT_EQ(stats.errors(), 1);
+    ASSERT_EQ(stats.m_errors["packet too short"], 1);
+    ASSERT_EQ(stats.m_refills > 0, !in_memory);
+    ASSERT_EQ(stats.m_total >= stats.m_sink, true);
+  }
+}
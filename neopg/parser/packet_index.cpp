@@ -0,0 +1,317 @@
+// OpenPGP packet index (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/packet_index.h>
+
+#include <neopg/openpgp/public_key_packet.h>
+#include <neopg/openpgp/public_subkey_packet.h>
+
+#include <neopg/intern/cplusplus.h>
+#include <neopg/utils/byte_writer.h>
+
+#include <botan/loadstor.h>
+
+#include <stdexcept>
+
+using namespace NeoPG;
+
+namespace {
+
+// Sidecar file format, all integers are big endian:
+//   magic (8 octets), number of entries (8 octets), then for each entry:
+//   offset (8), length (8), header length (4), body length (4), type (1),
+//   flags (1), and if FLAG_KEY is set: fingerprint length (1), fingerprint,
+//   key ID length (1), key ID.
+const char MAGIC[] = "NPGIDX\x00\x01";
+const size_t MAGIC_LENGTH = sizeof(MAGIC) - 1;
+const uint8_t FLAG_PARTIAL = 0x01;
+const uint8_t FLAG_KEY = 0x02;
+
+template <typename T>
+void write_be(std::ostream& out, T val) {
+  uint8_t buf[sizeof(T)];
+  Botan::store_be(val, buf);
+  out.write(reinterpret_cast<const char*>(buf), sizeof(buf));
+}
+
+template <typename T>
+T read_be(std::istream& in) {
+  uint8_t buf[sizeof(T)];
+  if (!in.read(reinterpret_cast<char*>(buf), sizeof(buf)))
+    throw std::runtime_error("packet index truncated");
+  return Botan::load_be<T>(buf, 0);
+}
+
+void write_bytes(std::ostream& out, const std::vector<uint8_t>& bytes) {
+  out << static_cast<uint8_t>(bytes.size());
+  out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+std::vector<uint8_t> read_bytes(std::istream& in) {
+  auto length = read_be<uint8_t>(in);
+  std::vector<uint8_t> bytes(length);
+  if (!in.read(reinterpret_cast<char*>(bytes.data()), length))
+    throw std::runtime_error("packet index truncated");
+  return bytes;
+}
+
+uint32_t encoded_length(const PacketHeader& header) {
+  ByteWriter cnt{nullptr};
+  header.write(cnt);
+  return cnt.size();
+}
+
+uint32_t encoded_length(const NewPacketLength* length_info) {
+  if (!length_info) return 0;
+  ByteWriter cnt{nullptr};
+  length_info->write(cnt);
+  return cnt.size();
+}
+
+// Decode the packets of a span of the original stream.
+class DecodeSink : public RawPacketSink {
+ public:
+  DecodeSink(uint64_t offset) : m_offset(offset) {}
+
+  uint64_t m_offset;
+  std::vector<std::unique_ptr<Packet>> m_packets;
+
+  void next_packet(std::unique_ptr<PacketHeader> header, const char* data,
+                   size_t length) override {
+    header->m_offset += m_offset;
+    decode(std::move(header), data, length);
+  }
+
+  void start_packet(std::unique_ptr<PacketHeader> header) override {
+    header->m_offset += m_offset;
+    m_header = std::move(header);
+    m_data.clear();
+  }
+
+  void continue_packet(std::unique_ptr<NewPacketLength> length_info,
+                       const char* data, size_t length) override {
+    m_data.append(data, length);
+  }
+
+  void finish_packet(std::unique_ptr<NewPacketLength> length_info,
+                     const char* data, size_t length) override {
+    m_data.append(data, length);
+    // Replace the header by one that matches the reassembled body.
+    size_t offset = m_header->m_offset;
+    uint32_t total = m_data.size();
+    if (m_header->format() == PacketFormat::New)
+      m_header = NewPacketHeader::create_or_throw(m_header->type(), total);
+    else
+      m_header = OldPacketHeader::create_or_throw(m_header->type(), total);
+    m_header->m_offset = offset;
+    decode(std::move(m_header), m_data.data(), m_data.size());
+  }
+
+  void error_packet(std::unique_ptr<PacketHeader> header,
+                    std::unique_ptr<ParserError> error) override {
+    error->m_pos.m_byte += m_offset;
+    throw *error;
+  }
+
+ private:
+  std::unique_ptr<PacketHeader> m_header;
+  std::string m_data;
+
+  void decode(std::unique_ptr<PacketHeader> header, const char* data,
+              size_t length) {
+    try {
+      ParserInput in{data, length};
+      auto packet = Packet::create_or_throw(header->type(), in);
+      packet->m_header = std::move(header);
+      m_packets.emplace_back(std::move(packet));
+    } catch (ParserError& exc) {
+      exc.m_pos.m_byte += m_offset;
+      throw;
+    }
+  }
+};
+
+std::vector<std::unique_ptr<Packet>> decode_span(std::istream& in,
+                                                 uint64_t offset,
+                                                 uint64_t length) {
+  std::string data(length, '\0');
+  in.clear();
+  in.seekg(offset);
+  if (!in.read(&data[0], length)) {
+    ParserPosition pos("-", offset);
+    throw ParserError("packet index does not match stream", pos);
+  }
+
+  DecodeSink sink{offset};
+  RawPacketParser parser{sink};
+  parser.process(data.data(), data.size());
+  return std::move(sink.m_packets);
+}
+
+}  // namespace
+
+std::unique_ptr<PacketIndex> PacketIndex::read_or_throw(std::istream& in) {
+  char magic[MAGIC_LENGTH];
+  if (!in.read(magic, MAGIC_LENGTH) ||
+      std::string(magic, MAGIC_LENGTH) != std::string(MAGIC, MAGIC_LENGTH))
+    throw std::runtime_error("not a packet index");
+
+  auto index = NeoPG::make_unique<PacketIndex>();
+  auto count = read_be<uint64_t>(in);
+  for (uint64_t i = 0; i < count; i++) {
+    PacketIndexEntry entry;
+    entry.m_offset = read_be<uint64_t>(in);
+    entry.m_length = read_be<uint64_t>(in);
+    entry.m_header_length = read_be<uint32_t>(in);
+    entry.m_body_length = read_be<uint32_t>(in);
+    entry.m_type = static_cast<PacketType>(read_be<uint8_t>(in));
+    auto flags = read_be<uint8_t>(in);
+    entry.m_partial = flags & FLAG_PARTIAL;
+    if (flags & FLAG_KEY) {
+      entry.m_fingerprint = read_bytes(in);
+      entry.m_keyid = read_bytes(in);
+    }
+    index->m_entries.emplace_back(std::move(entry));
+  }
+  return index;
+}
+
+void PacketIndex::write(std::ostream& out) const {
+  out.write(MAGIC, MAGIC_LENGTH);
+  write_be<uint64_t>(out, m_entries.size());
+  for (const auto& entry : m_entries) {
+    bool key = !entry.m_fingerprint.empty();
+    write_be<uint64_t>(out, entry.m_offset);
+    write_be<uint64_t>(out, entry.m_length);
+    write_be<uint32_t>(out, entry.m_header_length);
+    write_be<uint32_t>(out, entry.m_body_length);
+    out << static_cast<uint8_t>(entry.m_type);
+    out << static_cast<uint8_t>((entry.m_partial ? FLAG_PARTIAL : 0) |
+                                (key ? FLAG_KEY : 0));
+    if (key) {
+      write_bytes(out, entry.m_fingerprint);
+      write_bytes(out, entry.m_keyid);
+    }
+  }
+}
+
+size_t PacketIndex::find_keyid(const std::vector<uint8_t>& keyid) const {
+  size_t pos;
+  for (pos = 0; pos < m_entries.size(); pos++)
+    if (m_entries[pos].m_keyid == keyid) break;
+  return pos;
+}
+
+size_t PacketIndex::find_fingerprint(
+    const std::vector<uint8_t>& fingerprint) const {
+  size_t pos;
+  for (pos = 0; pos < m_entries.size(); pos++)
+    if (m_entries[pos].m_fingerprint == fingerprint) break;
+  return pos;
+}
+
+size_t PacketIndex::find_offset(uint64_t offset) const {
+  // The entries are sorted by offset.
+  size_t low = 0;
+  size_t high = m_entries.size();
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (m_entries[mid].m_offset < offset)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if (low < m_entries.size() && m_entries[low].m_offset == offset) return low;
+  return m_entries.size();
+}
+
+std::unique_ptr<Packet> PacketIndex::decode(std::istream& in,
+                                            const PacketIndexEntry& entry) {
+  auto packets = decode_span(in, entry.m_offset, entry.m_length);
+  if (packets.size() != 1) {
+    ParserPosition pos("-", entry.m_offset);
+    throw ParserError("packet index does not match stream", pos);
+  }
+  return std::move(packets.front());
+}
+
+std::vector<std::unique_ptr<Packet>> PacketIndex::decode_keyblock(
+    std::istream& in, size_t pos) const {
+  if (pos >= m_entries.size())
+    throw std::out_of_range("packet index position out of range");
+
+  size_t first = pos;
+  while (first > 0 && m_entries[first].m_type != PacketType::PublicKey)
+    first--;
+  size_t last = pos + 1;
+  while (last < m_entries.size() &&
+         m_entries[last].m_type != PacketType::PublicKey)
+    last++;
+
+  std::vector<std::unique_ptr<Packet>> packets;
+  for (size_t i = first; i < last; i++)
+    packets.emplace_back(decode(in, m_entries[i]));
+  return packets;
+}
+
+void PacketIndexBuilder::next_packet(const PacketHeader& header,
+                                     const char* data, size_t length) {
+  PacketIndexEntry entry;
+  entry.m_offset = header.m_offset;
+  entry.m_header_length = encoded_length(header);
+  entry.m_body_length = length;
+  entry.m_length = entry.m_header_length + length;
+  entry.m_type = header.type();
+
+  if (entry.m_type == PacketType::PublicKey ||
+      entry.m_type == PacketType::PublicSubkey) {
+    try {
+      ParserInput in{data, length};
+      const PublicKeyData* key = nullptr;
+      std::unique_ptr<Packet> packet;
+      if (entry.m_type == PacketType::PublicKey) {
+        auto pubkey = PublicKeyPacket::create_or_throw(in);
+        key = pubkey->m_public_key.get();
+        packet = std::move(pubkey);
+      } else {
+        auto subkey = PublicSubkeyPacket::create_or_throw(in);
+        key = subkey->m_public_key.get();
+        packet = std::move(subkey);
+      }
+      if (key) {
+        entry.m_fingerprint = key->fingerprint();
+        entry.m_keyid = key->keyid();
+      }
+    } catch (ParserError&) {
+      // The packet is still indexed, but can't be found by key.
+    }
+  }
+
+  m_index.m_entries.emplace_back(std::move(entry));
+}
+
+void PacketIndexBuilder::start_packet(const PacketHeader& header) {
+  m_partial = PacketIndexEntry{};
+  m_partial.m_offset = header.m_offset;
+  m_partial.m_header_length = encoded_length(header);
+  m_partial.m_length = m_partial.m_header_length;
+  m_partial.m_type = header.type();
+  m_partial.m_partial = true;
+}
+
+void PacketIndexBuilder::continue_packet(const NewPacketLength* length_info,
+                                         const char* data, size_t length) {
+  m_partial.m_length += encoded_length(length_info) + length;
+  m_partial.m_body_length += length;
+}
+
+void PacketIndexBuilder::finish_packet(const NewPacketLength* length_info,
+                                       const char* data, size_t length) {
+  continue_packet(length_info, data, length);
+  m_index.m_entries.emplace_back(std::move(m_partial));
+}
+
+void PacketIndexBuilder::error_packet(const PacketHeader& header,
+                                      const ParserError& error) {}
@@ -0,0 +1,117 @@
+// OpenPGP packet index
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains a random-access index for OpenPGP packet streams.
+
+#pragma once
+
+#include <neopg/openpgp/packet.h>
+#include <neopg/parser/openpgp.h>
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace NeoPG {
+
+/// The location of one packet in an OpenPGP packet stream.
+struct NEOPG_UNSTABLE_API PacketIndexEntry {
+  /// The offset of the first header byte in the stream.
+  uint64_t m_offset{0};
+
+  /// The length of the (first) packet header.
+  uint32_t m_header_length{0};
+
+  /// The length of the packet body.  For partial packets, this is the length
+  /// of the reassembled body.
+  uint32_t m_body_length{0};
+
+  /// The number of bytes the packet occupies in the stream, including all
+  /// headers and partial length octets.
+  uint64_t m_length{0};
+
+  /// The packet type.
+  PacketType m_type{PacketType::Reserved};
+
+  /// True if the packet uses partial body lengths.
+  bool m_partial{false};
+
+  /// For public key and public subkey packets, the fingerprint and key ID of
+  /// the key.  Empty for other packets, or if the key could not be decoded.
+  std::vector<uint8_t> m_fingerprint;
+  std::vector<uint8_t> m_keyid;
+};
+
+/// An index of all packets in an OpenPGP packet stream, which can be stored
+/// in a sidecar file and used to decode single packets or keyblocks without
+/// parsing the whole stream again.  Use a PacketIndexBuilder to create it.
+class NEOPG_UNSTABLE_API PacketIndex {
+ public:
+  /// The packets in stream order.
+  std::vector<PacketIndexEntry> m_entries;
+
+  /// Read an index from the sidecar file \p in, as written by write().
+  ///
+  /// \throws std::runtime_error if the file is not a valid index
+  static std::unique_ptr<PacketIndex> read_or_throw(std::istream& in);
+
+  /// Write the index in a compact binary format to \p out.
+  void write(std::ostream& out) const;
+
+  /// Return the position of the first key packet with the key ID \p keyid,
+  /// or m_entries.size() if there is none.
+  size_t find_keyid(const std::vector<uint8_t>& keyid) const;
+
+  /// Return the position of the first key packet with the fingerprint \p
+  /// fingerprint, or m_entries.size() if there is none.
+  size_t find_fingerprint(const std::vector<uint8_t>& fingerprint) const;
+
+  /// Return the position of the entry for the packet at \p offset, or
+  /// m_entries.size() if there is none.
+  size_t find_offset(uint64_t offset) const;
+
+  /// Seek to the packet \p entry in the original stream \p in and decode it.
+  ///
+  /// \throws ParserError
+  static std::unique_ptr<Packet> decode(std::istream& in,
+                                        const PacketIndexEntry& entry);
+
+  /// Decode the keyblock that contains the packet at position \p pos, that
+  /// is, all packets from the preceding public key packet up to (but not
+  /// including) the next one.
+  ///
+  /// \throws ParserError
+  std::vector<std::unique_ptr<Packet>> decode_keyblock(std::istream& in,
+                                                       size_t pos) const;
+};
+
+/// A RawPacketRefSink that records all packets framed by a RawPacketParser in
+/// a PacketIndex.  Packets that can not be framed are not recorded.
+class NEOPG_UNSTABLE_API PacketIndexBuilder : public RawPacketRefSink {
+  PacketIndex& m_index;
+
+  // The partial packet being framed.
+  PacketIndexEntry m_partial;
+
+ public:
+  PacketIndexBuilder(PacketIndex& index) : m_index(index) {}
+
+  // Implement interface of RawPacketRefSink.
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override;
+  void start_packet(const PacketHeader& header) override;
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override;
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override;
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override;
+};
+
+}  // namespace NeoPG
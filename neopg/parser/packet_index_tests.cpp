@@ -0,0 +1,138 @@
+// OpenPGP packet index (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/packet_index.h>
+
+#include <neopg/openpgp/literal_data_packet.h>
+#include <neopg/openpgp/packet_stream.h>
+#include <neopg/openpgp/public_key_packet.h>
+#include <neopg/openpgp/user_id_packet.h>
+
+#include <sstream>
+
+#include "gtest/gtest.h"
+
+using namespace NeoPG;
+
+namespace {
+std::string public_key(char created) {
+  return std::string{
+      "\xc6\x0e\x04"
+      "\x12\x34\x56",
+      6} +
+         created +
+         std::string{
+             "\x01"
+             "\x00\x11\x01\x42\x23"
+             "\x00\x02\x03",
+             9};
+}
+
+std::string test_stream() {
+  std::stringstream out;
+  out << public_key('\x01');
+  UserIdPacket uid;
+  uid.m_content = "Alice";
+  uid.write(out);
+  out << public_key('\x02');
+  {
+    PacketStream literal(out, PacketType::LiteralData, 512);
+    literal << "b" << '\0' << std::string(4, '\0') << std::string(2000, 'A');
+  }
+  return out.str();
+}
+}  // namespace
+
+TEST(ParserPacketIndex, Build) {
+  auto data = test_stream();
+  PacketIndex index;
+  PacketIndexBuilder builder{index};
+  RawPacketParser parser{builder};
+  parser.process(data.data(), data.size());
+
+  ASSERT_EQ(index.m_entries.size(), 4);
+  auto& key = index.m_entries[0];
+  ASSERT_EQ(key.m_offset, 0);
+  ASSERT_EQ(key.m_header_length, 2);
+  ASSERT_EQ(key.m_body_length, 14);
+  ASSERT_EQ(key.m_length, 16);
+  ASSERT_EQ(key.m_type, PacketType::PublicKey);
+  ASSERT_EQ(key.m_fingerprint.size(), 20);
+  ASSERT_EQ(key.m_keyid, std::vector<uint8_t>(key.m_fingerprint.end() - 8,
+                                              key.m_fingerprint.end()));
+
+  auto& uid = index.m_entries[1];
+  ASSERT_EQ(uid.m_offset, 16);
+  ASSERT_EQ(uid.m_type, PacketType::UserId);
+  ASSERT_TRUE(uid.m_fingerprint.empty());
+
+  ASSERT_NE(index.m_entries[2].m_keyid, key.m_keyid);
+  ASSERT_EQ(index.find_keyid(index.m_entries[2].m_keyid), 2);
+  ASSERT_EQ(index.find_fingerprint(key.m_fingerprint), 0);
+  ASSERT_EQ(index.find_offset(16), 1);
+  ASSERT_EQ(index.find_offset(17), 4);
+
+  auto& literal = index.m_entries[3];
+  ASSERT_TRUE(literal.m_partial);
+  ASSERT_EQ(literal.m_body_length, 2006);
+  ASSERT_EQ(literal.m_offset + literal.m_length, data.size());
+}
+
+TEST(ParserPacketIndex, ReadWrite) {
+  auto data = test_stream();
+  PacketIndex index;
+  PacketIndexBuilder builder{index};
+  RawPacketParser parser{builder};
+  parser.process(data.data(), data.size());
+
+  std::stringstream sidecar;
+  index.write(sidecar);
+  auto index2 = PacketIndex::read_or_throw(sidecar);
+  ASSERT_EQ(index2->m_entries.size(), index.m_entries.size());
+  for (size_t i = 0; i < index.m_entries.size(); i++) {
+    auto& entry = index.m_entries[i];
+    auto& entry2 = index2->m_entries[i];
+    ASSERT_EQ(entry2.m_offset, entry.m_offset);
+    ASSERT_EQ(entry2.m_header_length, entry.m_header_length);
+    ASSERT_EQ(entry2.m_body_length, entry.m_body_length);
+    ASSERT_EQ(entry2.m_length, entry.m_length);
+    ASSERT_EQ(entry2.m_type, entry.m_type);
+    ASSERT_EQ(entry2.m_partial, entry.m_partial);
+    ASSERT_EQ(entry2.m_fingerprint, entry.m_fingerprint);
+    ASSERT_EQ(entry2.m_keyid, entry.m_keyid);
+  }
+
+  std::stringstream garbage{"NOTANIDX"};
+  ASSERT_THROW(PacketIndex::read_or_throw(garbage), std::runtime_error);
+}
+
+TEST(ParserPacketIndex, Decode) {
+  auto data = test_stream();
+  PacketIndex index;
+  PacketIndexBuilder builder{index};
+  RawPacketParser parser{builder};
+  parser.process(data.data(), data.size());
+
+  std::stringstream in{data};
+  auto packet = PacketIndex::decode(in, index.m_entries[1]);
+  ASSERT_EQ(packet->type(), PacketType::UserId);
+  ASSERT_EQ(dynamic_cast<UserIdPacket*>(packet.get())->m_content, "Alice");
+  ASSERT_EQ(packet->m_header->m_offset, 16);
+
+  packet = PacketIndex::decode(in, index.m_entries[3]);
+  auto literal = dynamic_cast<LiteralDataPacket*>(packet.get());
+  ASSERT_NE(literal, nullptr);
+  ASSERT_EQ(literal->m_data.size(), 2000);
+
+  auto keyblock = index.decode_keyblock(in, 1);
+  ASSERT_EQ(keyblock.size(), 2);
+  ASSERT_EQ(keyblock[0]->type(), PacketType::PublicKey);
+  ASSERT_EQ(keyblock[1]->type(), PacketType::UserId);
+
+  keyblock = index.decode_keyblock(in, 2);
+  ASSERT_EQ(keyblock.size(), 2);
+  ASSERT_EQ(keyblock[0]->type(), PacketType::PublicKey);
+  ASSERT_EQ(keyblock[1]->type(), PacketType::LiteralData);
+}
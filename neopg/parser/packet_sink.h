@@ -0,0 +1,36 @@
+// OpenPGP packet sink
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains the interface for consumers of decoded packets.
+
+#pragma once
+
+#include <neopg/openpgp/packet.h>
+#include <neopg/parser/parser_error.h>
+
+#include <memory>
+
+namespace NeoPG {
+
+/// A consumer of decoded packets.  In contrast to RawPacketSink, which sees
+/// the framing of the packets, a PacketSink receives complete Packet objects.
+class NEOPG_UNSTABLE_API PacketSink {
+ public:
+  /// Takes ownership of \p packet.  The original header is available in
+  /// Packet::m_header.
+  virtual void next_packet(std::unique_ptr<Packet> packet) = 0;
+
+  /// A packet could not be framed or decoded.  Takes ownership of \p header
+  /// and \p error.  The error position is relative to the start of the
+  /// input stream.
+  virtual void error_packet(std::unique_ptr<PacketHeader> header,
+                            std::unique_ptr<ParserError> error) = 0;
+
+  // Prevent memory leak when upcasting in smart pointer containers.
+  virtual ~PacketSink() = default;
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,158 @@
+// OpenPGP parallel packet decoder (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/parallel_packet_sink.h>
+
+#include <neopg/parser/parser_input.h>
+#include <neopg/utils/workers.h>
+
+#include <neopg/intern/cplusplus.h>
+
+#include <assert.h>
+
+using namespace NeoPG;
+
+ParallelPacketSink::ParallelPacketSink(PacketSink& sink, size_t threads,
+                                       size_t max_pending)
+    : m_sink(sink), m_max_pending(max_pending ? max_pending : 1) {
+  if (threads == 0) threads = hardware_threads();
+  // Without a worker nothing would ever be done, so the first one must
+  // start.  If it can't, there are no threads to stop yet.
+  m_workers.emplace_back(&ParallelPacketSink::worker, this);
+  start_threads(m_workers, threads - 1, [this]() { worker(); });
+}
+
+ParallelPacketSink::~ParallelPacketSink() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_work.notify_all();
+  for (auto& worker : m_workers) worker.join();
+}
+
+void ParallelPacketSink::worker() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_work.wait(lock, [this]() { return m_stop || !m_todo.empty(); });
+    if (m_stop) return;
+
+    Job* job = m_todo.front();
+    m_todo.pop_front();
+
+    lock.unlock();
+    decode(*job);
+    lock.lock();
+
+    job->m_done = true;
+    m_done.notify_all();
+  }
+}
+
+void ParallelPacketSink::decode(Job& job) {
+  try {
+    ParserInput in{job.m_data.data(), job.m_data.size()};
+    job.m_packet = Packet::try_create(job.m_header->type(), in, job.m_error);
+    if (job.m_error) job.m_error->m_pos.m_byte += job.m_header->m_offset;
+  } catch (...) {
+    job.m_exception = std::current_exception();
+  }
+  // The body is not needed anymore, release it early.
+  std::string().swap(job.m_data);
+}
+
+void ParallelPacketSink::emit_done(std::unique_lock<std::mutex>& lock) {
+  while (!m_jobs.empty() && m_jobs.front()->m_done) {
+    std::unique_ptr<Job> job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+
+    // Do not hold the lock while calling into the downstream sink.
+    lock.unlock();
+    if (job->m_exception) std::rethrow_exception(job->m_exception);
+    if (job->m_packet) {
+      job->m_packet->m_header = std::move(job->m_header);
+      m_sink.next_packet(std::move(job->m_packet));
+    } else
+      m_sink.error_packet(std::move(job->m_header), std::move(job->m_error));
+    lock.lock();
+  }
+}
+
+void ParallelPacketSink::enqueue(std::unique_ptr<Job> job) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  // Back-pressure: wait for the oldest job if the queue is full.
+  while (m_jobs.size() >= m_max_pending) {
+    m_done.wait(lock, [this]() { return m_jobs.front()->m_done; });
+    emit_done(lock);
+  }
+
+  Job* todo = job->m_done ? nullptr : job.get();
+  m_jobs.emplace_back(std::move(job));
+  if (todo) {
+    m_todo.push_back(todo);
+    m_work.notify_one();
+  }
+
+  emit_done(lock);
+}
+
+void ParallelPacketSink::flush() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_jobs.empty()) {
+    m_done.wait(lock, [this]() { return m_jobs.front()->m_done; });
+    emit_done(lock);
+  }
+}
+
+void ParallelPacketSink::next_packet(std::unique_ptr<PacketHeader> header,
+                                     const char* data, size_t length) {
+  auto job = NeoPG::make_unique<Job>();
+  job->m_header = std::move(header);
+  job->m_data.assign(data, length);
+  enqueue(std::move(job));
+}
+
+void ParallelPacketSink::start_packet(std::unique_ptr<PacketHeader> header) {
+  assert(!m_partial);
+  m_partial = NeoPG::make_unique<Job>();
+  m_partial->m_header = std::move(header);
+}
+
+void ParallelPacketSink::continue_packet(
+    std::unique_ptr<NewPacketLength> length_info, const char* data,
+    size_t length) {
+  assert(m_partial);
+  m_partial->m_data.append(data, length);
+}
+
+void ParallelPacketSink::finish_packet(
+    std::unique_ptr<NewPacketLength> length_info, const char* data,
+    size_t length) {
+  assert(m_partial);
+  m_partial->m_data.append(data, length);
+
+  // The original header only describes the first part of the body, replace
+  // it by one that matches the reassembled body.
+  auto& header = m_partial->m_header;
+  size_t offset = header->m_offset;
+  uint32_t total = m_partial->m_data.size();
+  if (header->format() == PacketFormat::New)
+    header = NewPacketHeader::create_or_throw(header->type(), total);
+  else
+    header = OldPacketHeader::create_or_throw(header->type(), total);
+  header->m_offset = offset;
+
+  enqueue(std::move(m_partial));
+}
+
+void ParallelPacketSink::error_packet(std::unique_ptr<PacketHeader> header,
+                                      std::unique_ptr<ParserError> error) {
+  auto job = NeoPG::make_unique<Job>();
+  job->m_header = std::move(header);
+  job->m_error = std::move(error);
+  job->m_done = true;
+  enqueue(std::move(job));
+}
@@ -0,0 +1,100 @@
+// OpenPGP parallel packet decoder
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains a RawPacketSink that decodes packets on a thread pool.
+
+#pragma once
+
+#include <neopg/parser/openpgp.h>
+#include <neopg/parser/packet_sink.h>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace NeoPG {
+
+/// Decode the packets framed by a RawPacketParser on a pool of worker threads,
+/// and pass them on to a PacketSink in the original stream order.
+///
+/// All calls to the downstream sink are made from the thread that feeds this
+/// sink (usually the parser thread), so the downstream sink does not need to
+/// be thread-safe.  At most \p max_pending packets are buffered; if the queue
+/// is full, the parser blocks until the oldest packet is decoded.
+///
+/// Partial packets are reassembled before they are decoded.  Call flush()
+/// after the parser returns to emit the remaining packets.
+class NEOPG_UNSTABLE_API ParallelPacketSink : public RawPacketSink {
+ public:
+  /// The default number of packets that can be in flight.
+  static const size_t DEFAULT_MAX_PENDING = 1024;
+
+  /// Create a new sink that passes decoded packets to \p sink. If \p threads
+  /// is 0, use one thread per hardware thread.
+  ParallelPacketSink(PacketSink& sink, size_t threads = 0,
+                     size_t max_pending = DEFAULT_MAX_PENDING);
+
+  /// Stop the worker threads.  Packets that were not flushed are discarded.
+  ~ParallelPacketSink();
+
+  /// Wait until all queued packets are decoded and pass them on.
+  void flush();
+
+  // Implement interface of RawPacketSink.
+  void next_packet(std::unique_ptr<PacketHeader> header, const char* data,
+                   size_t length) override;
+  void start_packet(std::unique_ptr<PacketHeader> header) override;
+  void continue_packet(std::unique_ptr<NewPacketLength> length_info,
+                       const char* data, size_t length) override;
+  void finish_packet(std::unique_ptr<NewPacketLength> length_info,
+                     const char* data, size_t length) override;
+  void error_packet(std::unique_ptr<PacketHeader> header,
+                    std::unique_ptr<ParserError> error) override;
+
+ private:
+  struct Job {
+    std::unique_ptr<PacketHeader> m_header;
+    std::string m_data;
+
+    std::unique_ptr<Packet> m_packet;
+    std::unique_ptr<ParserError> m_error;
+    std::exception_ptr m_exception;
+    bool m_done{false};
+  };
+
+  PacketSink& m_sink;
+  size_t m_max_pending;
+
+  // Protects all members below.
+  std::mutex m_mutex;
+  // Signalled if a job is queued or stopping.
+  std::condition_variable m_work;
+  // Signalled if a job is done.
+  std::condition_variable m_done;
+
+  // All jobs in stream order, the oldest job is first.
+  std::deque<std::unique_ptr<Job>> m_jobs;
+  // Jobs not yet picked up by a worker.
+  std::deque<Job*> m_todo;
+  bool m_stop{false};
+
+  std::vector<std::thread> m_workers;
+
+  // The partial packet being reassembled.
+  std::unique_ptr<Job> m_partial;
+
+  void worker();
+  void decode(Job& job);
+  void enqueue(std::unique_ptr<Job> job);
+  void emit_done(std::unique_lock<std::mutex>& lock);
+};
+
+}  // namespace NeoPG
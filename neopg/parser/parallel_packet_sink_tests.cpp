@@ -0,0 +1,76 @@
+// OpenPGP parallel packet decoder (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/parallel_packet_sink.h>
+
+#include <neopg/openpgp/user_id_packet.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <sstream>
+#include <vector>
+
+using namespace NeoPG;
+
+namespace {
+class CollectSink : public PacketSink {
+ public:
+  std::vector<std::unique_ptr<Packet>> m_packets;
+  size_t m_errors{0};
+
+  void next_packet(std::unique_ptr<Packet> packet) override {
+    m_packets.emplace_back(std::move(packet));
+  }
+  void error_packet(std::unique_ptr<PacketHeader> header,
+                    std::unique_ptr<ParserError> error) override {
+    m_errors++;
+  }
+};
+}  // namespace
+
+TEST(ParserParallelPacketSink, PreservesOrder) {
+  const size_t count = 500;
+  std::stringstream data;
+  for (size_t i = 0; i < count; i++) {
+    UserIdPacket packet;
+    packet.m_content = "user " + std::to_string(i);
+    packet.write(data);
+  }
+
+  CollectSink out;
+  {
+    // A small queue exercises the back-pressure path.
+    ParallelPacketSink sink{out, 4, 8};
+    RawPacketParser parser{sink};
+    parser.process(data.str());
+    sink.flush();
+  }
+
+  ASSERT_EQ(out.m_errors, 0);
+  ASSERT_EQ(out.m_packets.size(), count);
+  for (size_t i = 0; i < count; i++) {
+    auto uid = dynamic_cast<UserIdPacket*>(out.m_packets[i].get());
+    ASSERT_NE(uid, nullptr);
+    ASSERT_EQ(uid->m_content, "user " + std::to_string(i));
+    ASSERT_NE(uid->m_header, nullptr);
+  }
+}
+
+TEST(ParserParallelPacketSink, ReportsErrors) {
+  std::stringstream data;
+  UserIdPacket packet;
+  packet.m_content = std::string(UserIdPacket::MAX_LENGTH + 1, 'x');
+  packet.write(data);
+
+  CollectSink out;
+  ParallelPacketSink sink{out, 2};
+  RawPacketParser parser{sink};
+  parser.process(data.str());
+  sink.flush();
+
+  ASSERT_EQ(out.m_errors, 1);
+  ASSERT_EQ(out.m_packets.size(), 0);
+}
@@ -0,0 +1,20 @@
+// OpenPGP parser error (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/parser_error.h>
+
+using namespace NeoPG;
+
+namespace {
+thread_local ParserErrorTrap* current_trap = nullptr;
+}  // namespace
+
+ParserErrorTrap::ParserErrorTrap() noexcept : m_previous(current_trap) {
+  current_trap = this;
+}
+
+ParserErrorTrap::~ParserErrorTrap() { current_trap = m_previous; }
+
+ParserErrorTrap* ParserErrorTrap::current() noexcept { return current_trap; }
@@ -12,10 +12,13 @@
 #include <neopg/parser/parser_position.h>
 
 #include <memory>
+#include <stdexcept>
 #include <string>
 
 namespace NeoPG {
 
+class ParserInput;
+
 class NEOPG_UNSTABLE_API ParserError : public std::runtime_error {
  public:
   ParserError(const std::string& msg, ParserPosition& pos)
@@ -26,4 +29,68 @@ class NEOPG_UNSTABLE_API ParserError : public std::runtime_error {
   ParserPosition m_pos;
 };
 
+/// Collect parser errors without throwing them.
+///
+/// Throwing and unwinding a ParserError is expensive compared to parsing a
+/// small packet, which matters for inputs with many malformed packets (such
+/// as keyserver dumps).  While a ParserErrorTrap is active on a thread, the
+/// grammars of the OpenPGP object model record the first error in the trap
+/// and fail to match, instead of throwing.  The caller checks failed() after
+/// parsing and discards the (incomplete) result.
+///
+///     ParserErrorTrap trap;
+///     auto packet = UserIdPacket::create_or_throw(in);
+///     if (trap.failed()) handle(trap.take_error());
+///
+/// Some errors are still thrown as exceptions (for example, from
+/// ParserInput::error and from the framing parser RawPacketParser), so
+/// callers must catch ParserError as well, see call().  Traps can be nested.
+class NEOPG_UNSTABLE_API ParserErrorTrap {
+ public:
+  ParserErrorTrap() noexcept;
+  ~ParserErrorTrap();
+
+  ParserErrorTrap(const ParserErrorTrap&) = delete;
+  ParserErrorTrap& operator=(const ParserErrorTrap&) = delete;
+
+  /// \return true if an error was recorded
+  bool failed() const noexcept { return m_error != nullptr; }
+
+  /// \return the recorded error, or nullptr
+  std::unique_ptr<ParserError> take_error() noexcept {
+    return std::move(m_error);
+  }
+
+  /// Record \p error, unless an earlier error was recorded.
+  void record(const ParserError& error) {
+    if (!m_error) m_error.reset(new ParserError(error));
+  }
+
+  /// \return the active trap of this thread, or nullptr
+  static ParserErrorTrap* current() noexcept;
+
+  /// Call \p create on \p in with a trap.
+  ///
+  /// \return the result, or nullptr (and the error in \p error, if not
+  /// nullptr) if the input is malformed
+  template <typename T>
+  static std::unique_ptr<T> call(
+      std::unique_ptr<T> (*create)(ParserInput&), ParserInput& in,
+      std::unique_ptr<ParserError>* error = nullptr) {
+    ParserErrorTrap trap;
+    try {
+      std::unique_ptr<T> result = create(in);
+      if (!trap.failed()) return result;
+      if (error) *error = trap.take_error();
+    } catch (const ParserError& exc) {
+      if (error) error->reset(new ParserError(exc));
+    }
+    return nullptr;
+  }
+
+ private:
+  std::unique_ptr<ParserError> m_error;
+  ParserErrorTrap* m_previous;
+};
+
 }  // namespace NeoPG
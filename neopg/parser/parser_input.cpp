@@ -6,34 +6,49 @@
 #include <neopg/parser/parser_error.h>
 #include <neopg/parser/parser_input.h>
 
-#include <neopg/intern/cplusplus.h>
 #include <neopg/intern/pegtl.h>
 
+#include <new>
+
 using namespace NeoPG;
 using namespace tao::neopg_pegtl;
 
+static_assert(sizeof(ParserInput::Impl) <= ParserInput::IMPL_SIZE,
+              "ParserInput::IMPL_SIZE too small");
+static_assert(sizeof(ParserInput::Mark::Impl) <= ParserInput::Mark::IMPL_SIZE,
+              "ParserInput::Mark::IMPL_SIZE too small");
+
+const size_t ParserInput::IMPL_SIZE;
+const size_t ParserInput::Mark::IMPL_SIZE;
+
 ParserInput::ParserInput(const char* data, size_t length,
-                         const std::string& source)
-    : m_impl{NeoPG::make_unique<Impl>(data, length, source)} {}
+                         const std::string& source) {
+  new (&m_storage) Impl(data, length, source);
+}
 
-ParserInput::~ParserInput() = default;
+ParserInput::~ParserInput() { impl().~Impl(); }
 
 const char* ParserInput::current() const noexcept {
-  return m_impl->m_input.current();
+  return impl().m_input.current();
 }
 
-size_t ParserInput::size() { return m_impl->m_input.size(); }
+size_t ParserInput::size() { return impl().m_input.size(); }
 
-size_t ParserInput::position() const { return m_impl->m_input.position().byte; }
+size_t ParserInput::position() const { return impl().m_input.position().byte; }
 
 void ParserInput::bump(const std::size_t in_count) noexcept {
-  m_impl->m_input.bump(in_count);
+  impl().m_input.bump(in_count);
 }
 
 void ParserInput::error(const std::string& message) {
-  throw parser_error(message, m_impl->m_input);
+  throw parser_error(message, impl().m_input);
 }
 
-ParserInput::Mark::Mark(ParserInput& in)
-    : m_impl{NeoPG::make_unique<Impl>(in)} {}
-ParserInput::Mark::~Mark() = default;
+bool ParserInput::fail(const std::string& message) {
+  raise_parser_error(message, impl().m_input);
+  return false;
+}
+
+ParserInput::Mark::Mark(ParserInput& in) { new (&m_storage) Impl(in); }
+
+ParserInput::Mark::~Mark() { impl().~Impl(); }
@@ -10,18 +10,23 @@
 
 #include <neopg/utils/common.h>
 
-#include <memory>
+#include <cstddef>
 #include <string>
+#include <type_traits>
 
 namespace NeoPG {
 
 // We wrap PEGTL memory_input, because we have to pass it around in public
-// interfaces, and we don't want to expose the (template) type.
+// interfaces, and we don't want to expose the (template) type.  The wrapped
+// input is constructed in place (see intern/pegtl.h), so creating a
+// ParserInput or a Mark does not allocate, and parsers inside the library
+// access the memory_input directly through impl().
 class NEOPG_UNSTABLE_API ParserInput {
  public:
   class Impl;
-  // propagate_const?
-  std::unique_ptr<Impl> m_impl;
+
+  /// The space reserved for the Impl.
+  static const size_t IMPL_SIZE = 160;
 
   ParserInput(const char* data, size_t length, const std::string& source = "-");
   ParserInput(const uint8_t* data, size_t length,
@@ -32,6 +37,14 @@ class NEOPG_UNSTABLE_API ParserInput {
   // We need to define the destructor somewhere the Impl is defined.
   ~ParserInput();
 
+  ParserInput(const ParserInput&) = delete;
+  ParserInput& operator=(const ParserInput&) = delete;
+
+  Impl& impl() noexcept { return *reinterpret_cast<Impl*>(&m_storage); }
+  const Impl& impl() const noexcept {
+    return *reinterpret_cast<const Impl*>(&m_storage);
+  }
+
   const char* current() const noexcept;
   size_t size();
   size_t position() const;
@@ -40,14 +53,35 @@ class NEOPG_UNSTABLE_API ParserInput {
   /// Throw parse error exception at current position.
   void error(const std::string& message);
 
+  /// Raise a parse error at the current position.  If a ParserErrorTrap is
+  /// active, the error is recorded there and false is returned, so the caller
+  /// must stop parsing.  Otherwise, the error is thrown like error().
+  bool fail(const std::string& message);
+
   /// Create a Mark to reset the input position when the mark goes out of scope.
-  class Mark {
+  class NEOPG_UNSTABLE_API Mark {
    public:
     class Impl;
-    std::unique_ptr<Impl> m_impl;
+
+    /// The space reserved for the Impl.
+    static const size_t IMPL_SIZE = 64;
+
     Mark(ParserInput& in);
     ~Mark();
+
+    Mark(const Mark&) = delete;
+    Mark& operator=(const Mark&) = delete;
+
+    Impl& impl() noexcept { return *reinterpret_cast<Impl*>(&m_storage); }
+
+   private:
+    typename std::aligned_storage<IMPL_SIZE,
+                                  alignof(std::max_align_t)>::type m_storage;
   };
+
+ private:
+  typename std::aligned_storage<IMPL_SIZE, alignof(std::max_align_t)>::type
+      m_storage;
 };
 
 }  // namespace NeoPG
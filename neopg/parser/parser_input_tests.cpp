@@ -26,3 +26,21 @@ TEST(NeopgTest, parser_input_test) {
   ParserInput in_vec{vec.data(), vec.size()};
   ASSERT_EQ(in_vec.size(), 4);
 }
+
+TEST(NeopgTest, parser_input_mark_test) {
+  auto str = std::string{"foobar"};
+  ParserInput in(str.data(), str.length());
+  {
+    ParserInput::Mark mark(in);
+    in.bump(3);
+    ASSERT_EQ(in.position(), 3);
+    {
+      ParserInput::Mark inner(in);
+      in.bump(2);
+      ASSERT_EQ(in.position(), 5);
+    }
+    ASSERT_EQ(in.position(), 3);
+  }
+  ASSERT_EQ(in.position(), 0);
+  ASSERT_EQ(in.size(), str.length());
+}
@@ -0,0 +1,56 @@
+// OpenPGP parser statistics (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/parser_stats.h>
+
+#include <numeric>
+
+using namespace NeoPG;
+
+namespace {
+thread_local ParserStats* current_stats = nullptr;
+}  // namespace
+
+const size_t ParserStats::PACKET_TYPES;
+
+uint64_t ParserStats::packets() const noexcept {
+  return std::accumulate(m_packets.begin(), m_packets.end(), uint64_t{0});
+}
+
+uint64_t ParserStats::bytes() const noexcept {
+  return std::accumulate(m_bytes.begin(), m_bytes.end(), uint64_t{0});
+}
+
+uint64_t ParserStats::errors() const noexcept {
+  uint64_t count = 0;
+  for (const auto& error : m_errors) count += error.second;
+  return count;
+}
+
+void ParserStats::merge(const ParserStats& other) {
+  for (size_t i = 0; i < PACKET_TYPES; i++) {
+    m_packets[i] += other.m_packets[i];
+    m_bytes[i] += other.m_bytes[i];
+  }
+  for (const auto& error : other.m_errors) m_errors[error.first] += error.second;
+  m_refills += other.m_refills;
+  m_decoded += other.m_decoded;
+  m_total += other.m_total;
+  m_sink += other.m_sink;
+  m_decode += other.m_decode;
+}
+
+ParserStats::Scope::Scope(ParserStats* stats)
+    : m_stats(stats), m_previous(current_stats) {
+  current_stats = stats;
+  if (m_stats) m_start = clock::now();
+}
+
+ParserStats::Scope::~Scope() {
+  if (m_stats) m_stats->m_total += clock::now() - m_start;
+  current_stats = m_previous;
+}
+
+ParserStats* ParserStats::current() noexcept { return current_stats; }
@@ -0,0 +1,130 @@
+// OpenPGP parser statistics
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains counters for the packet parser.
+
+#pragma once
+
+#include <neopg/openpgp/packet_header.h>
+#include <neopg/utils/common.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace NeoPG {
+
+/// Counters for RawPacketParser and Packet::create_or_throw.
+///
+/// The counters are plain integers, so a ParserStats object must only be
+/// updated by one thread at a time.  To collect statistics for several
+/// threads, give each thread its own object and merge() them afterwards.
+///
+///     ParserStats stats;
+///     RawPacketParser parser{sink};
+///     parser.set_stats(&stats);
+///     parser.process(input);
+///
+/// Packets decoded by Packet::create_or_throw are counted while a
+/// ParserStats::Scope is active on the same thread.  RawPacketParser opens
+/// one for the duration of process(), so the decode time includes packets
+/// decoded in the sink callbacks.
+class NEOPG_UNSTABLE_API ParserStats {
+ public:
+  using clock = std::chrono::steady_clock;
+  using duration = clock::duration;
+
+  static const size_t PACKET_TYPES = 64;
+
+  /// The number of packets of each type (including error packets).
+  std::array<uint64_t, PACKET_TYPES> m_packets{{}};
+
+  /// The number of body bytes of each type.
+  std::array<uint64_t, PACKET_TYPES> m_bytes{{}};
+
+  /// The number of error packets, by error message.
+  std::map<std::string, uint64_t> m_errors;
+
+  /// The number of times the parser buffer was refilled from the source.
+  uint64_t m_refills{0};
+
+  /// The number of calls to Packet::create_or_throw.
+  uint64_t m_decoded{0};
+
+  /// The time spent in RawPacketParser::process.
+  duration m_total{0};
+
+  /// The part of m_total spent in the sink callbacks.
+  duration m_sink{0};
+
+  /// The time spent in Packet::create_or_throw.
+  duration m_decode{0};
+
+  /// \return the number of packets of all types
+  uint64_t packets() const noexcept;
+
+  /// \return the number of body bytes of all types
+  uint64_t bytes() const noexcept;
+
+  /// \return the number of error packets
+  uint64_t errors() const noexcept;
+
+  /// \return the time spent framing packets (outside the sink callbacks)
+  duration framing_time() const noexcept { return m_total - m_sink; }
+
+  /// Add the counters of \p other to this object.
+  void merge(const ParserStats& other);
+
+  /// Count one packet of type \p type with \p length body bytes.
+  void count_packet(PacketType type, uint64_t length) noexcept {
+    auto idx = static_cast<size_t>(type) % PACKET_TYPES;
+    m_packets[idx]++;
+    m_bytes[idx] += length;
+  }
+
+  /// Count \p length more body bytes of a packet of type \p type.
+  void count_bytes(PacketType type, uint64_t length) noexcept {
+    m_bytes[static_cast<size_t>(type) % PACKET_TYPES] += length;
+  }
+
+  /// Add the time from construction to destruction to a duration.
+  class Timer {
+   public:
+    Timer(duration& total) : m_total(total), m_start(clock::now()) {}
+    ~Timer() { m_total += clock::now() - m_start; }
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+   private:
+    duration& m_total;
+    clock::time_point m_start;
+  };
+
+  /// Make \p stats (which can be nullptr) the current statistics of this
+  /// thread for the lifetime of the scope, and add the lifetime to
+  /// m_total.  Scopes can be nested.
+  class NEOPG_UNSTABLE_API Scope {
+   public:
+    Scope(ParserStats* stats);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    ParserStats* m_stats;
+    ParserStats* m_previous;
+    clock::time_point m_start;
+  };
+
+  /// Return the current statistics of this thread, or nullptr.
+  static ParserStats* current() noexcept;
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,66 @@
+// OpenPGP parser statistics (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/parser_stats.h>
+
+#include <gtest/gtest.h>
+
+using namespace NeoPG;
+
+TEST(NeopgTest, parser_stats_test) {
+  ParserStats stats;
+  ASSERT_EQ(stats.packets(), 0);
+  ASSERT_EQ(stats.bytes(), 0);
+  ASSERT_EQ(stats.errors(), 0);
+
+  stats.count_packet(PacketType::UserId, 10);
+  stats.count_packet(PacketType::UserId, 5);
+  stats.count_bytes(PacketType::UserId, 1);
+  stats.count_packet(PacketType::Signature, 100);
+  stats.m_errors["packet too short"]++;
+  ASSERT_EQ(stats.packets(), 3);
+  ASSERT_EQ(stats.bytes(), 116);
+  ASSERT_EQ(stats.m_packets[static_cast<size_t>(PacketType::UserId)], 2);
+  ASSERT_EQ(stats.m_bytes[static_cast<size_t>(PacketType::UserId)], 16);
+  ASSERT_EQ(stats.errors(), 1);
+
+  ParserStats other;
+  other.count_packet(PacketType::UserId, 4);
+  other.m_errors["packet too short"]++;
+  other.m_errors["packet too large"]++;
+  other.m_refills = 2;
+  stats.merge(other);
+  ASSERT_EQ(stats.packets(), 4);
+  ASSERT_EQ(stats.bytes(), 120);
+  ASSERT_EQ(stats.errors(), 3);
+  ASSERT_EQ(stats.m_errors["packet too short"], 2);
+  ASSERT_EQ(stats.m_refills, 2);
+}
+
+TEST(NeopgTest, parser_stats_scope_test) {
+  ParserStats outer;
+  ParserStats inner;
+  ASSERT_EQ(ParserStats::current(), nullptr);
+  {
+    ParserStats::Scope scope{&outer};
+    ASSERT_EQ(ParserStats::current(), &outer);
+    {
+      ParserStats::Scope scope{&inner};
+      ASSERT_EQ(ParserStats::current(), &inner);
+      {
+        ParserStats::Scope scope{nullptr};
+        ASSERT_EQ(ParserStats::current(), nullptr);
+      }
+      ASSERT_EQ(ParserStats::current(), &inner);
+    }
+    ASSERT_EQ(ParserStats::current(), &outer);
+  }
+  ASSERT_EQ(ParserStats::current(), nullptr);
+  ASSERT_EQ(outer.m_total >= inner.m_total, true);
+
+  ParserStats::duration total{0};
+  { ParserStats::Timer timer{total}; }
+  ASSERT_EQ(total >= ParserStats::duration{0}, true);
+}
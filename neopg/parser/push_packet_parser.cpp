@@ -0,0 +1,250 @@
+// OpenPGP push parser (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/push_packet_parser.h>
+
+#include <botan/loadstor.h>
+
+#include <algorithm>
+
+using namespace NeoPG;
+
+namespace {
+
+// Decode a new format length starting at DATA with AVAIL bytes available.
+// Return the number of length octets, or 0 if more data is needed.
+size_t parse_new_length(const uint8_t* data, size_t avail, uint32_t& len,
+                        PacketLengthType& length_type) {
+  if (avail < 1) return 0;
+  uint8_t val0 = data[0];
+  if (val0 < 0xc0) {
+    len = val0;
+    length_type = PacketLengthType::OneOctet;
+    return 1;
+  } else if (val0 < 0xe0) {
+    if (avail < 2) return 0;
+    len = ((val0 - 0xc0) << 8) + data[1] + 192;
+    length_type = PacketLengthType::TwoOctet;
+    return 2;
+  } else if (val0 == 0xff) {
+    if (avail < 5) return 0;
+    len = Botan::load_be<uint32_t>(data + 1, 0);
+    length_type = PacketLengthType::FiveOctet;
+    return 5;
+  }
+  len = 1 << (val0 & 0x1f);
+  length_type = PacketLengthType::Partial;
+  return 1;
+}
+
+}  // namespace
+
+void PushPacketParser::feed(const char* data, size_t length) {
+  try {
+    if (m_buffer.empty()) {
+      // Frame directly from the caller's data, and only keep the rest.
+      size_t done = consume(data, length);
+      m_buffer.assign(data + done, length - done);
+    } else {
+      m_buffer.append(data, length);
+      size_t done = consume(m_buffer.data(), m_buffer.size());
+      m_buffer.erase(0, done);
+    }
+  } catch (...) {
+    reset();
+    throw;
+  }
+}
+
+void PushPacketParser::finish() {
+  try {
+    flush();
+  } catch (...) {
+    reset();
+    throw;
+  }
+  reset();
+}
+
+void PushPacketParser::flush() {
+  auto offset = m_offset;
+  switch (m_state) {
+    case State::Header:
+      if (!m_buffer.empty()) error("input has trailing data", offset);
+      break;
+    case State::Body:
+      if (m_started || m_partial) error("packet too short", offset);
+      {
+        ParserPosition pos("-", offset + m_buffer.size());
+        m_sink.error_packet(*m_header, ParserError("packet too short", pos));
+      }
+      break;
+    case State::PartialLength:
+      error("packet too short", offset);
+    case State::Indeterminate:
+      if (!m_started) m_sink.start_packet(*m_header);
+      m_sink.finish_packet(nullptr, m_buffer.data(), m_buffer.size());
+      break;
+    case State::Skip: {
+      ParserPosition pos("-", offset);
+      m_sink.error_packet(
+          *m_header,
+          ParserError("packet too short (while skipping too large packet)",
+                      pos));
+    } break;
+  }
+}
+
+size_t PushPacketParser::consume(const char* data, size_t length) {
+  auto ptr = reinterpret_cast<const uint8_t*>(data);
+  size_t pos = 0;
+  // Not a loop over the available bytes, as packets may have zero length.
+  while (true) {
+    size_t avail = length - pos;
+    switch (m_state) {
+      case State::Header: {
+        if (avail < 1) return pos;
+        uint8_t tag = ptr[pos];
+        if ((tag & 0x80) == 0) error("input has trailing data", m_offset);
+        if (avail < 2) return pos;
+        uint32_t len = 0;
+        size_t hdr_len = 0;
+        auto length_type = PacketLengthType::Default;
+        if (tag & 0x40) {
+          auto type = static_cast<PacketType>(tag & 0x3f);
+          hdr_len =
+              parse_new_length(ptr + pos + 1, avail - 1, len, length_type);
+          if (hdr_len == 0) return pos;
+          hdr_len += 1;
+          m_new_header = NewPacketHeader(type, len, length_type);
+          m_new_header.m_offset = m_offset;
+          m_header = &m_new_header;
+          m_partial = (length_type == PacketLengthType::Partial);
+          m_state = State::Body;
+        } else {
+          auto type = static_cast<PacketType>((tag >> 2) & 0xf);
+          switch (tag & 0x03) {
+            case 0x00:
+              hdr_len = 2;
+              len = ptr[pos + 1];
+              length_type = PacketLengthType::OneOctet;
+              break;
+            case 0x01:
+              hdr_len = 3;
+              if (avail < hdr_len) return pos;
+              len = (ptr[pos + 1] << 8) + ptr[pos + 2];
+              length_type = PacketLengthType::TwoOctet;
+              break;
+            case 0x02:
+              hdr_len = 5;
+              if (avail < hdr_len) return pos;
+              len = Botan::load_be<uint32_t>(ptr + pos + 1, 0);
+              length_type = PacketLengthType::FourOctet;
+              break;
+            default:
+              hdr_len = 1;
+              length_type = PacketLengthType::Indeterminate;
+              break;
+          }
+          m_old_header = OldPacketHeader(type, len, length_type);
+          m_old_header.m_offset = m_offset;
+          m_header = &m_old_header;
+          m_partial = false;
+          m_state = length_type == PacketLengthType::Indeterminate
+                        ? State::Indeterminate
+                        : State::Body;
+        }
+        m_started = false;
+        m_remaining = len;
+        if (m_state == State::Body &&
+            len > RawPacketParser::MAX_PARSER_BUFFER) {
+          // Partial chunks are at most 1 GiB, but we can't skip them.
+          if (m_partial) error("packet too large", m_offset);
+          m_state = State::Skip;
+        }
+        pos += hdr_len;
+        m_offset += hdr_len;
+      } break;
+
+      case State::Body:
+        if (avail < m_remaining) return pos;
+        emit_body(data + pos, m_remaining);
+        pos += m_remaining;
+        m_offset += m_remaining;
+        m_state = m_partial ? State::PartialLength : State::Header;
+        break;
+
+      case State::PartialLength: {
+        uint32_t len = 0;
+        auto length_type = PacketLengthType::Default;
+        size_t hdr_len = parse_new_length(ptr + pos, avail, len, length_type);
+        if (hdr_len == 0) return pos;
+        if (len > RawPacketParser::MAX_PARSER_BUFFER)
+          error("packet too large", m_offset);
+        m_length = NewPacketLength(len, length_type);
+        m_partial = (length_type == PacketLengthType::Partial);
+        m_remaining = len;
+        m_state = State::Body;
+        pos += hdr_len;
+        m_offset += hdr_len;
+      } break;
+
+      case State::Indeterminate:
+        if (avail < 1) return pos;
+        if (!m_started) {
+          m_sink.start_packet(*m_header);
+          m_started = true;
+        }
+        m_sink.continue_packet(nullptr, data + pos, avail);
+        pos += avail;
+        m_offset += avail;
+        break;
+
+      case State::Skip: {
+        if (avail < 1) return pos;
+        size_t skip = std::min<size_t>(avail, m_remaining);
+        pos += skip;
+        m_offset += skip;
+        m_remaining -= skip;
+        if (m_remaining == 0) {
+          ParserPosition err_pos("-", m_offset);
+          m_sink.error_packet(*m_header,
+                              ParserError("packet too large", err_pos));
+          m_state = State::Header;
+        }
+      } break;
+    }
+  }
+}
+
+void PushPacketParser::emit_body(const char* data, size_t length) {
+  if (!m_started) {
+    if (!m_partial) {
+      m_sink.next_packet(*m_header, data, length);
+    } else {
+      m_sink.start_packet(*m_header);
+      m_sink.continue_packet(nullptr, data, length);
+      m_started = true;
+    }
+  } else if (m_partial) {
+    m_sink.continue_packet(&m_length, data, length);
+  } else {
+    m_sink.finish_packet(&m_length, data, length);
+  }
+}
+
+void PushPacketParser::reset() noexcept {
+  m_state = State::Header;
+  m_buffer.clear();
+  m_offset = 0;
+  m_header = nullptr;
+  m_partial = false;
+  m_started = false;
+}
+
+void PushPacketParser::error(const std::string& message, uint64_t offset) {
+  ParserPosition pos("-", offset);
+  throw ParserError(message, pos);
+}
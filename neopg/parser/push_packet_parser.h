@@ -0,0 +1,107 @@
+// OpenPGP push parser
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains a resumable parser that is fed data in chunks.
+
+#pragma once
+
+#include <neopg/parser/openpgp.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace NeoPG {
+
+/// Frame OpenPGP packets like RawPacketParser, but instead of pulling the
+/// input from a source until EOF, the data is pushed into the parser in
+/// chunks of arbitrary size with feed(), and the end of the input is signalled
+/// with finish().  The framing state is kept between calls, so a single thread
+/// can serve many concurrent streams.
+///
+/// The sink is called from within feed() and finish().  Complete packets are
+/// passed on as soon as their last byte arrives.  Packets that are still
+/// incomplete are buffered, up to RawPacketParser::MAX_PARSER_BUFFER bytes;
+/// larger packets are skipped and reported with error_packet.  Old format
+/// packets of indeterminate length are passed on with continue_packet as the
+/// data arrives, and completed by finish().
+///
+/// Errors that prevent further framing (invalid packet tags, oversized or
+/// truncated partial packets) are thrown as ParserError.  After that, or after
+/// finish(), the parser can be used for a new stream.
+class NEOPG_UNSTABLE_API PushPacketParser {
+  std::unique_ptr<RawPacketRefSink> m_adaptor;
+  RawPacketRefSink& m_sink;
+
+ public:
+  PushPacketParser(RawPacketSink& sink)
+      : m_adaptor(new RawPacketSinkAdaptor(sink)), m_sink(*m_adaptor) {}
+  PushPacketParser(RawPacketRefSink& sink) : m_sink(sink) {}
+
+  /// Process the next \p length bytes at \p data.  The data is only accessed
+  /// during the call.
+  ///
+  /// \throws ParserError
+  void feed(const char* data, size_t length);
+
+  /// Signal the end of the input, and flush out the last packet.
+  ///
+  /// \throws ParserError
+  void finish();
+
+  /// \return the number of bytes that are buffered for incomplete packets
+  size_t buffered() const noexcept { return m_buffer.size(); }
+
+  /// \return the number of bytes that were framed so far
+  uint64_t position() const noexcept { return m_offset; }
+
+ private:
+  enum class State {
+    // Waiting for a packet header.
+    Header,
+    // Waiting for m_remaining bytes of packet (or part) body.
+    Body,
+    // Waiting for the length of the next part of a partial packet.
+    PartialLength,
+    // Passing on data until the end of the input.
+    Indeterminate,
+    // Skipping m_remaining bytes of an oversized packet.
+    Skip
+  };
+
+  State m_state{State::Header};
+
+  // Data of incomplete packets.
+  std::string m_buffer;
+
+  // The stream offset of the first byte not yet framed.
+  uint64_t m_offset{0};
+
+  // The header of the current packet, which points to either m_old_header or
+  // m_new_header.
+  PacketHeader* m_header{nullptr};
+  OldPacketHeader m_old_header{PacketType::Reserved, 0};
+  NewPacketHeader m_new_header{PacketType::Reserved, 0};
+
+  // The length of the current part of a partial packet.
+  NewPacketLength m_length{0};
+
+  uint32_t m_remaining{0};
+
+  // The current part is followed by more parts.
+  bool m_partial{false};
+
+  // start_packet was called for the current packet.
+  bool m_started{false};
+
+  size_t consume(const char* data, size_t length);
+  void flush();
+  void emit_body(const char* data, size_t length);
+  void reset() noexcept;
+  [[noreturn]] void error(const std::string& message, uint64_t offset);
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,184 @@
+// OpenPGP push parser (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/push_packet_parser.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace NeoPG;
+
+namespace {
+class LogSink : public RawPacketRefSink {
+ public:
+  std::vector<std::string> m_log;
+
+  static std::string header_str(const PacketHeader& header) {
+    ByteWriter out;
+    header.write(out);
+    return std::to_string(header.m_offset) + ":" + out.str();
+  }
+
+  void next_packet(const PacketHeader& header, const char* data,
+                   size_t length) override {
+    m_log.emplace_back("next " + header_str(header) + " " +
+                       std::string(data, length));
+  }
+  void start_packet(const PacketHeader& header) override {
+    m_log.emplace_back("start " + header_str(header));
+  }
+  void continue_packet(const NewPacketLength* length_info, const char* data,
+                       size_t length) override {
+    m_log.emplace_back("continue " + std::string(data, length));
+  }
+  void finish_packet(const NewPacketLength* length_info, const char* data,
+                     size_t length) override {
+    m_log.emplace_back("finish " + std::string(data, length));
+  }
+  void error_packet(const PacketHeader& header,
+                    const ParserError& error) override {
+    m_log.emplace_back("error " + header_str(header) + " " + error.what());
+  }
+};
+
+std::vector<std::string> push_log(const std::string& data, size_t chunk) {
+  LogSink sink;
+  PushPacketParser parser{sink};
+  for (size_t pos = 0; pos < data.size(); pos += chunk)
+    parser.feed(data.data() + pos, std::min(chunk, data.size() - pos));
+  parser.finish();
+  return sink.m_log;
+}
+
+std::vector<std::string> pull_log(const std::string& data) {
+  LogSink sink;
+  RawPacketParser parser{sink};
+  parser.process(data.data(), data.size());
+  return sink.m_log;
+}
+}  // namespace
+
+TEST(NeopgTest, parser_push_packet_parser_test) {
+  // Definite lengths of all sizes, an empty packet, and a partial packet.
+  std::string data;
+  data.append("\xCD\x03"
+              "abc",
+              5);
+  data.append("\xCD\x00", 2);
+  data.append("\xCD\xC0\x00", 3);
+  data.append(192, 'a');
+  data.append("\xCD\xFF\x00\x00\x00\x05hello", 11);
+  data.append("\xB4\x03"
+              "abc",
+              5);
+  data.append("\xB5\x00\x03"
+              "abc",
+              6);
+  data.append("\xB6\x00\x00\x00\x03"
+              "abc",
+              8);
+  data.append("\xCD\xE1"
+              "ab\xE0"
+              "c\x02"
+              "de",
+              9);
+  data.append("\xCD\x01z", 3);
+
+  auto log = pull_log(data);
+  ASSERT_EQ(log.size(), 12);
+  for (size_t chunk : {1, 2, 3, 7, 64})
+    ASSERT_EQ(push_log(data, chunk), log) << "chunk size " << chunk;
+  ASSERT_EQ(push_log(data, data.size()), log);
+
+  // Nothing is buffered after a complete packet.
+  {
+    LogSink sink;
+    PushPacketParser parser{sink};
+    parser.feed(data.data(), 3);
+    ASSERT_EQ(parser.buffered(), 1);
+    ASSERT_EQ(parser.position(), 2);
+    parser.feed(data.data() + 3, 4);
+    ASSERT_EQ(parser.buffered(), 0);
+    ASSERT_EQ(parser.position(), 7);
+    ASSERT_EQ(sink.m_log.size(), 2);
+  }
+}
+
+TEST(NeopgTest, parser_push_packet_parser_errors_test) {
+  // A truncated packet is reported by finish().
+  std::string truncated{"\xCD\x03"
+                        "abc\xCD\x05"
+                        "ab",
+                        9};
+  for (size_t chunk : {1, 4, 9}) {
+    auto log = push_log(truncated, chunk);
+    ASSERT_EQ(log.size(), 2);
+    ASSERT_EQ(log[0], std::string("next 0:\xCD\x03 abc"));
+    ASSERT_EQ(log[1], std::string("error 5:\xCD\x05 packet too short"));
+  }
+
+  // A truncated partial packet or header can't be reported as a packet.
+  ASSERT_THROW(push_log(std::string("\xCD\xE1"
+                                    "ab",
+                                    4),
+                        1),
+               ParserError);
+  ASSERT_THROW(push_log(std::string("\xCD", 1), 1), ParserError);
+
+  // Invalid tags are reported by feed().
+  {
+    LogSink sink;
+    PushPacketParser parser{sink};
+    ASSERT_THROW(parser.feed("\xCD\x01z\x01", 4), ParserError);
+    ASSERT_EQ(sink.m_log.size(), 1);
+
+    // The parser is ready for a new stream.
+    parser.feed("\xCD\x01y", 3);
+    parser.finish();
+    ASSERT_EQ(sink.m_log.size(), 2);
+    ASSERT_EQ(sink.m_log[1], std::string("next 0:\xCD\x01 y"));
+  }
+
+  // Packets that are too large are skipped without buffering them.
+  {
+    LogSink sink;
+    PushPacketParser parser{sink};
+    uint32_t len = RawPacketParser::MAX_PARSER_BUFFER + 1;
+    std::string header{"\xCD\xFF", 2};
+    for (int i = 3; i >= 0; i--) header += static_cast<char>(len >> (8 * i));
+    parser.feed(header.data(), header.size());
+    std::string chunk(4096, 'x');
+    for (uint32_t done = 0; done < len; done += chunk.size()) {
+      parser.feed(chunk.data(), std::min<size_t>(chunk.size(), len - done));
+      ASSERT_EQ(parser.buffered(), 0);
+    }
+    parser.feed("\xCD\x01z", 3);
+    parser.finish();
+    ASSERT_EQ(sink.m_log.size(), 2);
+    ASSERT_EQ(sink.m_log[0], "error 0:" + header + " packet too large");
+    ASSERT_EQ(sink.m_log[1],
+              "next " + std::to_string(header.size() + len) + ":\xCD\x01 z");
+  }
+}
+
+TEST(NeopgTest, parser_push_packet_parser_indeterminate_test) {
+  // Indeterminate length data is passed on as it arrives.
+  LogSink sink;
+  PushPacketParser parser{sink};
+  parser.feed("\xCD\x01z\xB3he", 6);
+  parser.feed("llo", 3);
+  ASSERT_EQ(parser.buffered(), 0);
+  parser.finish();
+  ASSERT_EQ(sink.m_log.size(), 5);
+  ASSERT_EQ(sink.m_log[0], std::string("next 0:\xCD\x01 z"));
+  ASSERT_EQ(sink.m_log[1], std::string("start 3:\xB3"));
+  ASSERT_EQ(sink.m_log[2], "continue he");
+  ASSERT_EQ(sink.m_log[3], "continue llo");
+  ASSERT_EQ(sink.m_log[4], "finish ");
+}
@@ -0,0 +1,141 @@
+// OpenPGP streaming packet sink (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/streaming_packet_sink.h>
+
+#include <neopg/openpgp/literal_data_packet.h>
+#include <neopg/openpgp/symmetrically_encrypted_integrity_protected_data_packet.h>
+
+#include <neopg/intern/cplusplus.h>
+
+#include <algorithm>
+
+using namespace NeoPG;
+
+namespace {
+ParserError body_error(const std::string& msg, const PacketHeader& header) {
+  ParserPosition pos{"-", header.m_offset};
+  return ParserError(msg, pos);
+}
+}  // namespace
+
+bool StreamingPacketSink::is_streamed(PacketType type) {
+  return type == PacketType::LiteralData ||
+         type == PacketType::SymmetricallyEncryptedIntegrityProtectedData;
+}
+
+size_t StreamingPacketSink::prefix_length() const {
+  if (m_header->type() == PacketType::LiteralData) {
+    // Data type, filename length, filename, timestamp.
+    if (m_prefix.size() < 2) return 0;
+    return 1 + 1 + static_cast<uint8_t>(m_prefix[1]) + 4;
+  }
+  // SEIPD: Version.
+  return 1;
+}
+
+std::unique_ptr<Packet> StreamingPacketSink::parse_prefix() {
+  const uint8_t* prefix = reinterpret_cast<const uint8_t*>(m_prefix.data());
+  if (m_header->type() == PacketType::LiteralData) {
+    auto packet = NeoPG::make_unique<LiteralDataPacket>();
+    packet->m_data_type = static_cast<LiteralDataType>(prefix[0]);
+    packet->m_filename.assign(m_prefix, 2, prefix[1]);
+    const uint8_t* ts = prefix + 2 + prefix[1];
+    packet->m_timestamp = (static_cast<uint32_t>(ts[0]) << 24) |
+                          (static_cast<uint32_t>(ts[1]) << 16) |
+                          (static_cast<uint32_t>(ts[2]) << 8) | ts[3];
+    return std::move(packet);
+  }
+
+  if (prefix[0] != SymmetricallyEncryptedIntegrityProtectedDataPacket::VERSION)
+    throw body_error("unknown SEIPD packet version", *m_header);
+  return NeoPG::make_unique<
+      SymmetricallyEncryptedIntegrityProtectedDataPacket>();
+}
+
+void StreamingPacketSink::feed(const char* data, size_t length) {
+  if (m_header) {
+    // Still collecting the prefix.  It is short, so buffering is fine.
+    size_t needed;
+    while (length > 0 && ((needed = prefix_length()) == 0 ||
+                          m_prefix.size() < needed)) {
+      size_t take = needed ? needed - m_prefix.size() : 1;
+      take = std::min(take, length);
+      m_prefix.append(data, take);
+      data += take;
+      length -= take;
+    }
+    needed = prefix_length();
+    if (needed == 0 || m_prefix.size() < needed) return;
+
+    auto packet = parse_prefix();
+    packet->m_header = std::move(m_header);
+    m_prefix.clear();
+    m_body_sink.start_body(std::move(packet));
+  }
+  if (length > 0) m_body_sink.body_data(data, length);
+}
+
+void StreamingPacketSink::finish() {
+  if (m_header) throw body_error("packet too short", *m_header);
+  m_body_sink.finish_body();
+}
+
+void StreamingPacketSink::next_packet(std::unique_ptr<PacketHeader> header,
+                                      const char* data, size_t length) {
+  if (!is_streamed(header->type())) {
+    m_other.next_packet(std::move(header), data, length);
+    return;
+  }
+
+  m_header = std::move(header);
+  m_prefix.clear();
+  try {
+    feed(data, length);
+    finish();
+  } catch (ParserError& exc) {
+    // The packet is complete, so we can skip it.
+    if (!m_header) throw;
+    m_other.error_packet(std::move(m_header),
+                         NeoPG::make_unique<ParserError>(exc));
+  }
+}
+
+void StreamingPacketSink::start_packet(std::unique_ptr<PacketHeader> header) {
+  m_streaming = is_streamed(header->type());
+  if (!m_streaming) {
+    m_other.start_packet(std::move(header));
+    return;
+  }
+  m_header = std::move(header);
+  m_prefix.clear();
+}
+
+void StreamingPacketSink::continue_packet(
+    std::unique_ptr<NewPacketLength> length_info, const char* data,
+    size_t length) {
+  if (!m_streaming) {
+    m_other.continue_packet(std::move(length_info), data, length);
+    return;
+  }
+  feed(data, length);
+}
+
+void StreamingPacketSink::finish_packet(
+    std::unique_ptr<NewPacketLength> length_info, const char* data,
+    size_t length) {
+  if (!m_streaming) {
+    m_other.finish_packet(std::move(length_info), data, length);
+    return;
+  }
+  m_streaming = false;
+  feed(data, length);
+  finish();
+}
+
+void StreamingPacketSink::error_packet(std::unique_ptr<PacketHeader> header,
+                                       std::unique_ptr<ParserError> error) {
+  m_other.error_packet(std::move(header), std::move(error));
+}
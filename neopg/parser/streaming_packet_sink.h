@@ -0,0 +1,79 @@
+// OpenPGP streaming packet sink
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains support for consuming data packets in bounded memory.
+
+#pragma once
+
+#include <neopg/openpgp/packet.h>
+#include <neopg/parser/openpgp.h>
+
+#include <memory>
+#include <string>
+
+namespace NeoPG {
+
+/// Receive the body of a data packet in pieces.
+class NEOPG_UNSTABLE_API PacketBodySink {
+ public:
+  /// A new data packet starts.  \p packet has all fields set except for the
+  /// data, which follows with body_data calls.  Takes ownership of \p packet.
+  virtual void start_body(std::unique_ptr<Packet> packet) = 0;
+
+  /// Data is passed by reference and only valid during execution of this
+  /// function.
+  virtual void body_data(const char* data, size_t length) = 0;
+
+  /// The data packet is complete.
+  virtual void finish_body() = 0;
+
+  // Prevent memory leak when upcasting in smart pointer containers.
+  virtual ~PacketBodySink() = default;
+};
+
+/// A RawPacketSink that streams the bodies of literal data and SEIPD packets
+/// to a PacketBodySink, without ever holding a packet body in memory.  All
+/// other packets are passed unchanged to another RawPacketSink.
+class NEOPG_UNSTABLE_API StreamingPacketSink : public RawPacketSink {
+ public:
+  StreamingPacketSink(PacketBodySink& body_sink, RawPacketSink& other)
+      : m_body_sink(body_sink), m_other(other) {}
+
+  /// Return true if packets of type \p type are streamed.
+  static bool is_streamed(PacketType type);
+
+  // Implement interface of RawPacketSink.
+  void next_packet(std::unique_ptr<PacketHeader> header, const char* data,
+                   size_t length) override;
+  void start_packet(std::unique_ptr<PacketHeader> header) override;
+  void continue_packet(std::unique_ptr<NewPacketLength> length_info,
+                       const char* data, size_t length) override;
+  void finish_packet(std::unique_ptr<NewPacketLength> length_info,
+                     const char* data, size_t length) override;
+  void error_packet(std::unique_ptr<PacketHeader> header,
+                    std::unique_ptr<ParserError> error) override;
+
+ private:
+  PacketBodySink& m_body_sink;
+  RawPacketSink& m_other;
+
+  // True if the current partial packet is streamed.
+  bool m_streaming{false};
+
+  // The current packet, until its prefix is complete.
+  std::unique_ptr<PacketHeader> m_header;
+  std::string m_prefix;
+
+  // Feed data of the current streamed packet.
+  void feed(const char* data, size_t length);
+  // Finish the current streamed packet.
+  void finish();
+  // Return the length of the prefix, or 0 if more data is needed to know.
+  size_t prefix_length() const;
+  std::unique_ptr<Packet> parse_prefix();
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,136 @@
+// OpenPGP streaming packet sink (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/parser/streaming_packet_sink.h>
+
+#include <neopg/openpgp/literal_data_packet.h>
+#include <neopg/openpgp/packet_stream.h>
+#include <neopg/openpgp/user_id_packet.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace NeoPG;
+
+namespace {
+class CollectBodySink : public PacketBodySink {
+ public:
+  std::unique_ptr<Packet> m_packet;
+  std::string m_data;
+  size_t m_chunks{0};
+  bool m_finished{false};
+
+  void start_body(std::unique_ptr<Packet> packet) override {
+    m_packet = std::move(packet);
+  }
+  void body_data(const char* data, size_t length) override {
+    m_data.append(data, length);
+    m_chunks++;
+  }
+  void finish_body() override { m_finished = true; }
+};
+
+class CountSink : public RawPacketSink {
+ public:
+  size_t m_packets{0};
+  size_t m_errors{0};
+
+  void next_packet(std::unique_ptr<PacketHeader> header, const char* data,
+                   size_t length) override {
+    m_packets++;
+  }
+  void start_packet(std::unique_ptr<PacketHeader> header) override {}
+  void continue_packet(std::unique_ptr<NewPacketLength> length_info,
+                       const char* data, size_t length) override {}
+  void finish_packet(std::unique_ptr<NewPacketLength> length_info,
+                     const char* data, size_t length) override {
+    m_packets++;
+  }
+  void error_packet(std::unique_ptr<PacketHeader> header,
+                    std::unique_ptr<ParserError> error) override {
+    m_errors++;
+  }
+};
+
+std::string stream_literal(const std::string& data, uint32_t chunk_size) {
+  std::stringstream out;
+  LiteralDataPacket packet;
+  packet.m_filename = "data.bin";
+  packet.m_timestamp = 0x12345678;
+
+  PacketStream body{out, PacketType::LiteralData, chunk_size};
+  packet.write_body_prefix(body);
+  body.write(data.data(), data.size());
+  body.close();
+  return out.str();
+}
+}  // namespace
+
+TEST(OpenpgpPacketStream, SmallBodyHasDefiniteLength) {
+  std::stringstream out;
+  {
+    PacketStream body{out, PacketType::UserId};
+    body << "John Doe";
+  }
+  UserIdPacket packet;
+  packet.m_content = "John Doe";
+  std::stringstream expected;
+  packet.write(expected);
+  ASSERT_EQ(out.str(), expected.str());
+}
+
+TEST(OpenpgpPacketStream, LargeBodyIsPartial) {
+  const std::string data(2000, 'x');
+  const std::string out = stream_literal(data, 512);
+  // New packet tag followed by a partial length of 2^9.
+  ASSERT_EQ(out.substr(0, 2), std::string("\xCB\xE9"));
+  ASSERT_THROW(PacketStream(std::cout, PacketType::LiteralData, 1000),
+               std::logic_error);
+}
+
+TEST(ParserStreamingPacketSink, LiteralData) {
+  const std::string data(20000, 'y');
+  const std::string stream = stream_literal(data, 512);
+
+  UserIdPacket uid;
+  uid.m_content = "John Doe";
+  std::stringstream uid_out;
+  uid.write(uid_out);
+
+  CollectBodySink body;
+  CountSink other;
+  StreamingPacketSink sink{body, other};
+  RawPacketParser parser{sink};
+  parser.process(stream + uid_out.str());
+
+  ASSERT_TRUE(body.m_finished);
+  ASSERT_GT(body.m_chunks, 1);
+  ASSERT_EQ(body.m_data, data);
+  auto literal = dynamic_cast<LiteralDataPacket*>(body.m_packet.get());
+  ASSERT_NE(literal, nullptr);
+  ASSERT_EQ(literal->m_filename, "data.bin");
+  ASSERT_EQ(literal->m_timestamp, 0x12345678);
+  ASSERT_TRUE(literal->m_data.empty());
+
+  ASSERT_EQ(other.m_packets, 1);
+  ASSERT_EQ(other.m_errors, 0);
+}
+
+TEST(ParserStreamingPacketSink, ShortLiteralData) {
+  CollectBodySink body;
+  CountSink other;
+  StreamingPacketSink sink{body, other};
+  RawPacketParser parser{sink};
+  // A literal data packet with a truncated filename.
+  parser.process(std::string("\xCB\x03"
+                             "b\x05x",
+                             5));
+
+  ASSERT_FALSE(body.m_finished);
+  ASSERT_EQ(other.m_errors, 1);
+}
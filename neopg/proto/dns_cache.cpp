@@ -0,0 +1,151 @@
+/* Shared DNS cache for HTTP requests
+   Copyright 2018 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/proto/dns_cache.h>
+
+#include <ctime>
+#include <stdexcept>
+
+namespace NeoPG {
+
+DnsCache::DnsCache()
+    : m_share(curl_share_init(), curl_share_cleanup),
+      m_ttl(TTL_DEFAULT),
+      m_negative_ttl(NEGATIVE_TTL_DEFAULT),
+      m_happy_eyeballs(HAPPY_EYEBALLS_DEFAULT) {
+  if (m_share.get() == nullptr) throw std::bad_alloc();
+
+  curl_share_setopt(m_share.get(), CURLSHOPT_LOCKFUNC, lock_fnc);
+  curl_share_setopt(m_share.get(), CURLSHOPT_UNLOCKFUNC, unlock_fnc);
+  curl_share_setopt(m_share.get(), CURLSHOPT_USERDATA, (void*)this);
+  curl_share_setopt(m_share.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(m_share.get(), CURLSHOPT_SHARE,
+                    CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+  curl_share_setopt(m_share.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+}
+
+/* Must be unbound functions, because they are used as C callbacks.  */
+void DnsCache::lock_fnc(CURL* handle, curl_lock_data data,
+                        curl_lock_access access, void* userp) {
+  DnsCache* cache = (DnsCache*)userp;
+  cache->m_share_locks[data].lock();
+}
+
+void DnsCache::unlock_fnc(CURL* handle, curl_lock_data data, void* userp) {
+  DnsCache* cache = (DnsCache*)userp;
+  cache->m_share_locks[data].unlock();
+}
+
+DnsCache& DnsCache::set_ttl(long seconds) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_ttl = seconds;
+  return *this;
+}
+
+DnsCache& DnsCache::set_negative_ttl(long seconds) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_negative_ttl = seconds;
+  if (seconds == 0) m_negative.clear();
+  return *this;
+}
+
+DnsCache& DnsCache::set_happy_eyeballs_timeout(long milliseconds) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_happy_eyeballs = milliseconds;
+  return *this;
+}
+
+DnsCache& DnsCache::set_max_host_connections(long max) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_max_host_connections = max;
+  m_host_cond.notify_all();
+  return *this;
+}
+
+void DnsCache::acquire_host(const std::string& host) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  /* The entry is removed while there are no transfers, so look it up
+     again after every wakeup.  */
+  auto full = [&] {
+    auto it = m_host_connections.find(host);
+    return m_max_host_connections > 0 && it != m_host_connections.end() &&
+           it->second >= m_max_host_connections;
+  };
+  if (full()) {
+    m_stats.m_host_waits++;
+    m_host_cond.wait(lock, [&] { return !full(); });
+  }
+  m_host_connections[host]++;
+}
+
+void DnsCache::release_host(const std::string& host) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_host_connections.find(host);
+  if (it == m_host_connections.end()) return;
+  if (--it->second <= 0) m_host_connections.erase(it);
+  m_host_cond.notify_all();
+}
+
+void DnsCache::check(const std::string& host) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_negative.find(host);
+  if (it == m_negative.end()) return;
+  if (it->second <= std::time(nullptr)) {
+    m_negative.erase(it);
+    return;
+  }
+  m_stats.m_negative_hits++;
+  throw std::runtime_error("Could not resolve host: " + host + " (cached)");
+}
+
+void DnsCache::attach(CURL* handle) {
+  long ttl, happy_eyeballs;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ttl = m_ttl;
+    happy_eyeballs = m_happy_eyeballs;
+    m_stats.m_requests++;
+  }
+
+  CURLcode cc = curl_easy_setopt(handle, CURLOPT_SHARE, m_share.get());
+  if (cc == CURLE_OK)
+    cc = curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, ttl);
+#if LIBCURL_VERSION_NUM >= 0x073b00
+  if (cc == CURLE_OK)
+    cc = curl_easy_setopt(handle, CURLOPT_HAPPY_EYEBALLS_TIMEOUT_MS,
+                          happy_eyeballs);
+#else
+  (void)happy_eyeballs;
+#endif
+  if (cc != CURLE_OK) throw std::runtime_error(curl_easy_strerror(cc));
+}
+
+void DnsCache::record(CURL* handle, const std::string& host,
+                      CURLcode result) {
+  double resolve_time = 0;
+  long connects = 1;
+  curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME, &resolve_time);
+  curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stats.m_resolve_time += resolve_time;
+  if (result == CURLE_OK && connects == 0) m_stats.m_reused++;
+  if (result == CURLE_COULDNT_RESOLVE_HOST) {
+    m_stats.m_failures++;
+    if (m_negative_ttl > 0 && host.size())
+      m_negative[host] = std::time(nullptr) + m_negative_ttl;
+  } else if (result == CURLE_OK)
+    m_negative.erase(host);
+}
+
+DnsCache::Stats DnsCache::stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+}  // Namespace NeoPG
@@ -0,0 +1,125 @@
+/* Shared DNS cache for HTTP requests
+   Copyright 2018 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#pragma once
+
+#include <curl/curl.h>
+
+#include <neopg/utils/common.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace NeoPG {
+
+/* A DNS cache shared by many requests, which may run in several threads.
+   Attach it with Http::set_dns_cache or HttpPool::set_dns_cache.
+
+   Resolved addresses are kept by libcurl (whose resolver runs
+   asynchronously to the transfer) for the TTL, so that consecutive
+   requests to a keyserver pool or CRL distribution point do not each pay
+   for a lookup.  Hosts that could not be resolved are remembered for the
+   negative TTL, and requests to them fail at once.  Connections to
+   dual-stack hosts race IPv6 against IPv4 ("happy eyeballs").  TLS
+   sessions are shared as well, and with curl 7.57 or later so are idle
+   connections, so that a request to a host that was contacted recently
+   (say, an OCSP responder after a CRL download from the same CA) skips
+   the TCP and TLS handshakes.  The number of requests in flight to one
+   host can be limited, see set_max_host_connections.
+
+   The cache must outlive all requests it is attached to.  */
+class NEOPG_UNSTABLE_API DnsCache {
+  const long TTL_DEFAULT = 5 * 60;
+  const long NEGATIVE_TTL_DEFAULT = 30;
+  const long HAPPY_EYEBALLS_DEFAULT = 200;
+
+ public:
+  struct Stats {
+    /* Transfers that used the cache.  */
+    uint64_t m_requests{0};
+
+    /* Transfers that failed because the host could not be resolved.  */
+    uint64_t m_failures{0};
+
+    /* Transfers refused because the host failed to resolve recently.  */
+    uint64_t m_negative_hits{0};
+
+    /* The time spent resolving names, in seconds.  */
+    double m_resolve_time{0};
+
+    /* Transfers that reused an open connection.  */
+    uint64_t m_reused{0};
+
+    /* Transfers that waited for a connection to the host to be free.  */
+    uint64_t m_host_waits{0};
+  };
+
+  DnsCache();
+
+  /* Keep resolved addresses for \p seconds.  0 disables the cache.  */
+  DnsCache& set_ttl(long seconds);
+
+  /* Remember failed lookups for \p seconds.  0 disables this.  */
+  DnsCache& set_negative_ttl(long seconds);
+
+  /* Start the connection to the other address family if the first one
+     did not connect within \p milliseconds.  */
+  DnsCache& set_happy_eyeballs_timeout(long milliseconds);
+
+  /* Let at most \p max transfers to one host run at the same time across
+     all threads (0 is unlimited).  Further transfers wait in
+     acquire_host.  */
+  DnsCache& set_max_host_connections(long max);
+
+  /* Wait until a transfer to \p host may start, and count it.  Every
+     call must be followed by one of release_host.  */
+  void acquire_host(const std::string& host);
+
+  /* Finish a transfer to \p host started with acquire_host.  */
+  void release_host(const std::string& host);
+
+  /* Throw if \p host could not be resolved within the negative TTL.  */
+  void check(const std::string& host);
+
+  /* Make the transfer on \p handle use the cache.  */
+  void attach(CURL* handle);
+
+  /* Account for the transfer to \p host on \p handle, which finished
+     with \p result.  */
+  void record(CURL* handle, const std::string& host, CURLcode result);
+
+  Stats stats() const;
+
+ private:
+  static void lock_fnc(CURL* handle, curl_lock_data data,
+                       curl_lock_access access, void* userp);
+  static void unlock_fnc(CURL* handle, curl_lock_data data, void* userp);
+
+  std::unique_ptr<CURLSH, CURLSHcode (*)(CURLSH*)> m_share;
+  std::mutex m_share_locks[CURL_LOCK_DATA_LAST];
+
+  /* Protects the members below.  */
+  mutable std::mutex m_mutex;
+  long m_ttl;
+  long m_negative_ttl;
+  long m_happy_eyeballs;
+  long m_max_host_connections{0};
+
+  /* The transfers in flight per host, and the waiters for them.  */
+  std::map<std::string, long> m_host_connections;
+  std::condition_variable m_host_cond;
+
+  /* Hosts that failed to resolve, and until when that is remembered.  */
+  std::map<std::string, int64_t> m_negative;
+
+  Stats m_stats;
+};
+
+}  // Namespace NeoPG
@@ -0,0 +1,96 @@
+/* Tests for the shared DNS cache
+   Copyright 2018 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/proto/dns_cache.h>
+#include <neopg/proto/http.h>
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+using namespace NeoPG;
+
+namespace NeoPG {
+
+TEST(NeopgTest, proto_dns_cache_test) {
+  std::unique_ptr<CURL, void (*)(CURL*)> handle(curl_easy_init(),
+                                                curl_easy_cleanup);
+  ASSERT_NE(handle.get(), nullptr);
+
+  {
+    DnsCache dns;
+    ASSERT_NO_THROW(dns.attach(handle.get()));
+    ASSERT_NO_THROW(dns.check("www.example.com"));
+
+    /* A failed lookup is remembered.  */
+    dns.record(handle.get(), "www.example.com", CURLE_COULDNT_RESOLVE_HOST);
+    ASSERT_THROW(dns.check("www.example.com"), std::runtime_error);
+    ASSERT_NO_THROW(dns.check("www.example.org"));
+
+    /* Until the host resolves again.  */
+    dns.record(handle.get(), "www.example.com", CURLE_OK);
+    ASSERT_NO_THROW(dns.check("www.example.com"));
+
+    /* Other errors are not cached.  */
+    dns.record(handle.get(), "www.example.com", CURLE_COULDNT_CONNECT);
+    ASSERT_NO_THROW(dns.check("www.example.com"));
+
+    auto stats = dns.stats();
+    ASSERT_EQ(stats.m_requests, 1);
+    ASSERT_EQ(stats.m_failures, 1);
+    ASSERT_EQ(stats.m_negative_hits, 1);
+
+    /* Without negative TTL, failures are forgotten.  */
+    dns.record(handle.get(), "www.example.com", CURLE_COULDNT_RESOLVE_HOST);
+    dns.set_negative_ttl(0);
+    ASSERT_NO_THROW(dns.check("www.example.com"));
+    dns.record(handle.get(), "www.example.com", CURLE_COULDNT_RESOLVE_HOST);
+    ASSERT_NO_THROW(dns.check("www.example.com"));
+
+    /* The handle must not use the share after it is gone.  */
+    curl_easy_setopt(handle.get(), CURLOPT_SHARE, nullptr);
+  }
+
+  {
+    DnsCache dns;
+    dns.record(handle.get(), "127.0.0.1", CURLE_COULDNT_RESOLVE_HOST);
+
+    /* The request fails without trying.  */
+    Http request;
+    request.set_url("http://127.0.0.1:1/").set_dns_cache(&dns);
+    ASSERT_THROW(request.fetch(), std::runtime_error);
+    ASSERT_EQ(dns.stats().m_negative_hits, 1);
+    ASSERT_EQ(dns.stats().m_requests, 0);
+  }
+
+  {
+    /* At most one transfer to a host at a time, other hosts are not
+       affected.  */
+    DnsCache dns;
+    dns.set_max_host_connections(1);
+    dns.acquire_host("www.example.com");
+    dns.acquire_host("www.example.org");
+
+    std::atomic<bool> started{false};
+    std::thread waiter([&] {
+      dns.acquire_host("www.example.com");
+      started = true;
+      dns.release_host("www.example.com");
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_FALSE(started);
+    dns.release_host("www.example.com");
+    waiter.join();
+    ASSERT_TRUE(started);
+    dns.release_host("www.example.org");
+    ASSERT_EQ(dns.stats().m_host_waits, 1);
+  }
+}
+}  // namespace NeoPG
@@ -6,7 +6,18 @@
 
 #include <neopg/proto/http.h>
 
+#include <neopg/parser/push_packet_parser.h>
+#include <neopg/proto/dns_cache.h>
+#include <neopg/proto/http_cache.h>
+
+#include <botan/data_snk.h>
+
+#include <cctype>
+#include <ctime>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 namespace NeoPG {
 
@@ -33,6 +44,7 @@ Http& Http::set_url(const std::string& url) {
   }
 
   /* Would be nice to have a URI check.  */
+  m_url = url;
   return set_opt_ptr(CURLOPT_URL, (void*)url.c_str());
 }
 
@@ -106,30 +118,158 @@ Http& Http::set_connect_to(const std::string& connect_to) {
 
 Http& Http::set_maxfilesize(long maxfilesize) {
   /* CURLOPT_MAXFILESIZE only works if the server advertises the filesize in the
-     header.  We also implement a hard limit for unknown filesizes.  */
+     header.  We also implement a hard limit for unknown filesizes.  0 means
+     no limit.  */
   m_maxfilesize = maxfilesize;
   return set_opt_long(CURLOPT_MAXFILESIZE, maxfilesize);
 }
 
+Http& Http::set_http2(bool http2) {
+#ifdef CURL_HTTP_VERSION_2TLS
+  return set_opt_long(CURLOPT_HTTP_VERSION, http2 ? CURL_HTTP_VERSION_2TLS
+                                                  : CURL_HTTP_VERSION_1_1);
+#else
+  return *this;
+#endif
+}
+
+Http& Http::set_cache(HttpCache* cache) {
+  m_cache = cache;
+  return *this;
+}
+
+Http& Http::set_dns_cache(DnsCache* dns) {
+  m_dns_cache = dns;
+  if (!dns) set_opt_ptr(CURLOPT_SHARE, nullptr);
+  return *this;
+}
+
+/* The state of a streaming fetch, shared with the C callbacks.  */
+struct HttpStream {
+  HttpStream(CURL* handle, const Http::Receiver* receive, HttpCache* cache,
+             const std::string& url)
+      : m_handle(handle), m_receive(receive), m_cache(cache), m_url(url) {}
+
+  CURL* m_handle;
+  const Http::Receiver* m_receive;
+  bool m_started{false};
+  std::exception_ptr m_error;
+
+  /* The headers of the last response (after redirects), with lowercase
+     names.  Only collected if there is a cache.  */
+  std::map<std::string, std::string> m_headers;
+
+  /* If the response is stored, where to.  */
+  HttpCache* m_cache;
+  const std::string& m_url;
+  std::unique_ptr<HttpCache::Store> m_store;
+  HttpCache::Entry m_entry;
+};
+
+static size_t header_fnc(char* buffer, size_t size, size_t nitems,
+                         void* userp) {
+  HttpStream* stream = (HttpStream*)userp;
+  size_t amount = size * nitems;
+  if (!stream->m_cache) return amount;
+  try {
+    std::string line(buffer, amount);
+    /* Every response (including redirects) starts with a status line.  */
+    if (line.compare(0, 5, "HTTP/") == 0) {
+      stream->m_headers.clear();
+      return amount;
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) return amount;
+    std::string name = line.substr(0, colon);
+    for (auto& c : name) c = std::tolower(static_cast<unsigned char>(c));
+    size_t end = line.find_last_not_of("\r\n");
+    stream->m_headers[name] =
+        end > colon ? line.substr(colon + 1, end - colon) : "";
+  } catch (...) {
+    stream->m_error = std::current_exception();
+    return 0;
+  }
+  return amount;
+}
+
 /* Must be an unbound function, because it is used as C callback.  */
 static size_t write_fnc(void* buffer, size_t size, size_t nmemb, void* userp) {
-  std::string* response = (std::string*)userp;
+  HttpStream* stream = (HttpStream*)userp;
   size_t amount = size * nmemb;  // Overflow?
-  response->append((char*)buffer, amount);
+  /* Exceptions must not pass through curl.  Returning less than amount
+     aborts the transfer with CURLE_WRITE_ERROR.  */
+  try {
+    if (!stream->m_started) {
+      /* Don't pass on error pages.  */
+      long http_code = 0;
+      curl_easy_getinfo(stream->m_handle, CURLINFO_RESPONSE_CODE, &http_code);
+      if (http_code != 200)
+        throw std::runtime_error("HTTP " + std::to_string(http_code));
+      stream->m_started = true;
+      if (stream->m_cache &&
+          HttpCache::parse_response(stream->m_headers, std::time(nullptr),
+                                    stream->m_entry)) {
+        stream->m_store.reset(
+            new HttpCache::Store(*stream->m_cache, stream->m_url));
+        if (!stream->m_store->good()) stream->m_store.reset();
+      }
+    }
+    (*stream->m_receive)((const char*)buffer, amount);
+    if (stream->m_store) stream->m_store->write((const char*)buffer, amount);
+  } catch (...) {
+    stream->m_error = std::current_exception();
+    return 0;
+  }
   return amount;
 }
 
 static int progress_fnc(void* userp, curl_off_t dltotal, curl_off_t dlnow,
                         curl_off_t ultotal, curl_off_t ulnow) {
   long* maxfilesize = (long*)userp;
-  if (dlnow >
-      (curl_off_t)maxfilesize) /* Aborts with CURLE_ABORTED_BY_CALLBACK.  */
-    return 1;
+  /* Aborts with CURLE_ABORTED_BY_CALLBACK.  */
+  if (*maxfilesize > 0 && dlnow > (curl_off_t)*maxfilesize) return 1;
   return 0;
 }
 
 std::string Http::fetch() {
   std::string response;
+  fetch([&response](const char* data, size_t length) {
+    response.append(data, length);
+  });
+  return response;
+}
+
+void Http::fetch(Botan::DataSink& sink) {
+  fetch([&sink](const char* data, size_t length) {
+    sink.write((const uint8_t*)data, length);
+  });
+}
+
+void Http::fetch(PushPacketParser& parser) {
+  fetch([&parser](const char* data, size_t length) {
+    parser.feed(data, length);
+  });
+  parser.finish();
+}
+
+void Http::fetch(const Receiver& receive) {
+  /* Only GET requests are cached.  */
+  HttpCache* cache = m_post_data ? nullptr : m_cache;
+  HttpCache::Entry cached;
+  bool have_cached = cache && cache->lookup(m_url, cached);
+  if (have_cached) {
+    auto cache_control = m_header.find("Cache-Control");
+    bool no_cache = cache_control != m_header.end() &&
+                    cache_control->second.find("no-cache") != std::string::npos;
+    if (!no_cache && cached.m_expires > std::time(nullptr) &&
+        cache->read(m_url, receive)) {
+      cache->m_hits++;
+      clear_request();
+      return;
+    }
+  }
+
+  HttpStream stream{m_handle.get(), &receive, cache, m_url};
   char last_error[CURL_ERROR_SIZE] = {'\0'};
   std::unique_ptr<struct curl_slist, void (*)(struct curl_slist*)> headers{
       nullptr, curl_slist_free_all};
@@ -137,7 +277,9 @@ std::string Http::fetch() {
       nullptr, curl_slist_free_all};
 
   set_opt_ptr(CURLOPT_WRITEFUNCTION, (void*)write_fnc);
-  set_opt_ptr(CURLOPT_WRITEDATA, (void*)&response);
+  set_opt_ptr(CURLOPT_WRITEDATA, (void*)&stream);
+  set_opt_ptr(CURLOPT_HEADERFUNCTION, (void*)header_fnc);
+  set_opt_ptr(CURLOPT_HEADERDATA, (void*)&stream);
   // FIXME: Proxy, IP resolve, header, post, cainfo, http_code?
   set_opt_ptr(CURLOPT_ERRORBUFFER, last_error);
 
@@ -152,6 +294,20 @@ std::string Http::fetch() {
     else if (!headers.get())
       headers.reset(ptr);
   }
+
+  /* Revalidate a stale entry.  */
+  std::vector<std::string> conditions;
+  if (have_cached && cached.m_etag.size())
+    conditions.push_back("If-None-Match: " + cached.m_etag);
+  if (have_cached && cached.m_last_modified.size())
+    conditions.push_back("If-Modified-Since: " + cached.m_last_modified);
+  for (auto& header : conditions) {
+    struct curl_slist* ptr = curl_slist_append(headers.get(), header.c_str());
+    if (!ptr)
+      throw std::bad_alloc();
+    else if (!headers.get())
+      headers.reset(ptr);
+  }
   set_opt_ptr(CURLOPT_HTTPHEADER, (void*)headers.get());
 
   if (m_connect_to.size()) {
@@ -170,23 +326,71 @@ std::string Http::fetch() {
   set_opt_ptr(CURLOPT_XFERINFODATA, (void*)&m_maxfilesize);
   set_opt_long(CURLOPT_NOPROGRESS, 0);
 
+  std::string host;
+  if (m_dns_cache) {
+    host = URI(m_url).host;
+    m_dns_cache->check(host);
+    m_dns_cache->attach(m_handle.get());
+    m_dns_cache->acquire_host(host);
+  }
+
   CURLcode result = curl_easy_perform(m_handle.get());
+  if (m_dns_cache) {
+    m_dns_cache->release_host(host);
+    m_dns_cache->record(m_handle.get(), host, result);
+  }
+  if (stream.m_error) std::rethrow_exception(stream.m_error);
   if (result != CURLE_OK) throw std::runtime_error(last_error);
 
   m_last_error = last_error;
 
   long http_code;
   curl_easy_getinfo(m_handle.get(), CURLINFO_RESPONSE_CODE, &http_code);
-  std::string reason;
-  reason += "HTTP " + std::to_string(http_code);
-  if (http_code != 200) throw std::runtime_error(reason);
+  if (http_code == 304 && have_cached && conditions.size()) {
+    /* The 304 may update the freshness and validators.  */
+    auto& response = stream.m_headers;
+    if (!response.count("etag")) response["etag"] = cached.m_etag;
+    if (!response.count("last-modified"))
+      response["last-modified"] = cached.m_last_modified;
+    HttpCache::Entry entry;
+    bool storable =
+        HttpCache::parse_response(response, std::time(nullptr), entry);
+    if (!cache->read(m_url, receive))
+      throw std::runtime_error("cache entry disappeared");
+    if (storable)
+      cache->update(m_url, entry);
+    else
+      cache->remove(m_url);
+    cache->m_revalidations++;
+  } else {
+    std::string reason;
+    reason += "HTTP " + std::to_string(http_code);
+    if (http_code != 200) throw std::runtime_error(reason);
+
+    if (cache) {
+      if (!stream.m_started) {
+        /* An empty body.  */
+        HttpCache::Store store(*cache, m_url);
+        if (HttpCache::parse_response(stream.m_headers, std::time(nullptr),
+                                      stream.m_entry))
+          store.commit(stream.m_entry);
+      } else if (stream.m_store)
+        stream.m_store->commit(stream.m_entry);
+      else
+        cache->remove(m_url);
+      cache->m_misses++;
+    }
+  }
 
+  clear_request();
+}
+
+void Http::clear_request() {
   // Clear post data so it is never reused accidentially.
   set_post();
   m_connect_to = "";
   /* This is probably too simplicistic.  */
   m_header.clear();
-  return response;
 }
 
 }  // Namespace NeoPG
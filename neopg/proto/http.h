@@ -8,13 +8,22 @@
 
 #include <curl/curl.h>
 #include <tao/json/external/optional.hpp>
+#include <functional>
 #include <map>
 #include <regex>
 
 #include <neopg/proto/uri.h>
 
+namespace Botan {
+class DataSink;
+}
+
 namespace NeoPG {
 
+class DnsCache;
+class HttpCache;
+class PushPacketParser;
+
 class NEOPG_UNSTABLE_API Http {
   const long MAX_REDIRECTS_DEFAULT = 2;
   const long MAX_FILESIZE_DEFAULT = 2 * 1024 * 1024;
@@ -35,6 +44,20 @@ class NEOPG_UNSTABLE_API Http {
   Http& set_connect_to(const std::string& host);
   Http& set_maxfilesize(long size);
 
+  /* Offer HTTP/2 over TLS (see HttpPool::set_http2).  */
+  Http& set_http2(bool http2 = true);
+
+  /* Serve GET requests from \p cache where possible, and store the
+     responses in it (nullptr disables caching).  The cache must outlive
+     the request.  With no_cache, fresh entries are revalidated anyway.  */
+  Http& set_cache(HttpCache* cache);
+
+  /* Resolve host names through \p dns (nullptr uses a private cache of
+     the handle).  The cache must outlive the request.  Connections are
+     then kept in \p dns as well, for reuse by other requests, and its
+     limit of connections per host applies.  */
+  Http& set_dns_cache(DnsCache* dns);
+
   enum class Resolve : long {
     Any = CURL_IPRESOLVE_WHATEVER,
     IPv4 = CURL_IPRESOLVE_V4,
@@ -42,8 +65,26 @@ class NEOPG_UNSTABLE_API Http {
   };
   Http& set_ipresolve(Resolve which = Resolve::Any);
 
+  /* Receives the response body in chunks as it arrives.  */
+  using Receiver = std::function<void(const char* data, size_t length)>;
+
+  /* Fetch the URL and return the response body.  */
   std::string fetch();
 
+  /* Fetch the URL and pass the response body to \p receive as it arrives,
+     so that it is never buffered as a whole (use set_maxfilesize(0) for
+     large downloads).  The body is only passed on if the status is 200.
+     Exceptions thrown by \p receive abort the transfer and are
+     rethrown.  */
+  void fetch(const Receiver& receive);
+
+  /* Write the response body to \p sink as it arrives.  */
+  void fetch(Botan::DataSink& sink);
+
+  /* Parse the response body with \p parser as it arrives, and finish the
+     parser at the end.  Parser errors are thrown as ParserError.  */
+  void fetch(PushPacketParser& parser);
+
   std::string get_last_error() { return m_last_error; }
 
   /* Add header here.  */
@@ -52,6 +93,9 @@ class NEOPG_UNSTABLE_API Http {
  private:
   std::unique_ptr<CURL, void (*)(CURL*)> m_handle;
   std::string m_last_error;
+  std::string m_url;
+  HttpCache* m_cache{nullptr};
+  DnsCache* m_dns_cache{nullptr};
   tao::optional<std::string> m_post_data;
   std::string m_connect_to;
   long m_maxfilesize;
@@ -64,6 +108,9 @@ class NEOPG_UNSTABLE_API Http {
   }
   Http& set_opt_long(CURLoption opt, long val) { return set_opt<>(opt, val); }
   Http& set_opt_ptr(CURLoption opt, void* ptr) { return set_opt<>(opt, ptr); }
+
+  /* Forget the per-request settings after a fetch.  */
+  void clear_request();
 };
 
 }  // Namespace NeoPG
@@ -0,0 +1,234 @@
+/* HTTP response cache
+   Copyright 2018 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/proto/http_cache.h>
+
+#include <neopg/utils/hex.h>
+
+#include <botan/hash.h>
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace NeoPG {
+
+static const char META_MAGIC[] = "neopg-http-cache 1";
+
+/* A file name that no other writer (thread or process) uses.  */
+static std::string temp_name(const std::string& path) {
+  static std::atomic<unsigned> counter{0};
+  return path + ".tmp." + std::to_string(getpid()) + "." +
+         std::to_string(counter++);
+}
+
+static std::string trim(const std::string& str) {
+  size_t start = str.find_first_not_of(" \t");
+  if (start == std::string::npos) return "";
+  size_t end = str.find_last_not_of(" \t");
+  return str.substr(start, end - start + 1);
+}
+
+static std::string lowercase(std::string str) {
+  for (auto& c : str) c = std::tolower(static_cast<unsigned char>(c));
+  return str;
+}
+
+HttpCache::Store::Store(HttpCache& cache, const std::string& url)
+    : m_cache(cache),
+      m_url(url),
+      m_temp(temp_name(cache.path(url) + ".body")),
+      m_file(m_temp, std::ios::binary | std::ios::trunc) {}
+
+HttpCache::Store::~Store() {
+  if (!m_temp.empty()) {
+    m_file.close();
+    std::remove(m_temp.c_str());
+  }
+}
+
+void HttpCache::Store::write(const char* data, size_t length) {
+  m_file.write(data, length);
+}
+
+void HttpCache::Store::commit(const Entry& entry) {
+  m_file.close();
+  if (!m_file.good()) return;
+
+  /* The body is replaced before the metadata.  A reader in between sees
+     the new body with the old validators, which at worst causes a full
+     download on revalidation.  */
+  const std::string body = m_cache.path(m_url) + ".body";
+  if (std::rename(m_temp.c_str(), body.c_str()) != 0) return;
+  m_temp.clear();
+  m_cache.write_meta(m_url, entry);
+}
+
+HttpCache::HttpCache(const std::string& directory) : m_directory(directory) {
+  if (m_directory.empty()) m_directory = ".";
+  if (m_directory.back() != '/') m_directory += '/';
+}
+
+std::string HttpCache::path(const std::string& url) const {
+  auto hash = Botan::HashFunction::create_or_throw("SHA-256");
+  hash->update(reinterpret_cast<const uint8_t*>(url.data()), url.size());
+  auto digest = hash->final();
+  return m_directory + hex_encode(digest.data(), digest.size(), false);
+}
+
+bool HttpCache::lookup(const std::string& url, Entry& entry) const {
+  std::ifstream meta(path(url) + ".meta");
+  std::string line;
+  if (!std::getline(meta, line) || line != META_MAGIC) return false;
+
+  Entry result;
+  bool found_url = false;
+  while (std::getline(meta, line)) {
+    size_t space = line.find(' ');
+    if (space == std::string::npos) continue;
+    const std::string key = line.substr(0, space);
+    const std::string value = line.substr(space + 1);
+    if (key == "url") {
+      /* Guards against hash collisions and truncated files.  */
+      if (value != url) return false;
+      found_url = true;
+    } else if (key == "etag")
+      result.m_etag = value;
+    else if (key == "last-modified")
+      result.m_last_modified = value;
+    else if (key == "expires")
+      result.m_expires = std::strtoll(value.c_str(), nullptr, 10);
+  }
+  if (!found_url) return false;
+  entry = result;
+  return true;
+}
+
+bool HttpCache::read(const std::string& url, const Receiver& receive) const {
+  std::ifstream body(path(url) + ".body", std::ios::binary);
+  if (!body) return false;
+  char buffer[16 * 1024];
+  while (body) {
+    body.read(buffer, sizeof(buffer));
+    if (body.gcount() > 0) receive(buffer, body.gcount());
+  }
+  /* Part of the body was passed on already, so there is no way back.  */
+  if (!body.eof()) throw std::runtime_error("reading cache entry failed");
+  return true;
+}
+
+void HttpCache::update(const std::string& url, const Entry& entry) {
+  write_meta(url, entry);
+}
+
+void HttpCache::remove(const std::string& url) {
+  const std::string base = path(url);
+  std::remove((base + ".meta").c_str());
+  std::remove((base + ".body").c_str());
+}
+
+void HttpCache::write_meta(const std::string& url, const Entry& entry) {
+  const std::string meta = path(url) + ".meta";
+  const std::string temp = temp_name(meta);
+  {
+    std::ofstream out(temp, std::ios::trunc);
+    out << META_MAGIC << "\n"
+        << "url " << url << "\n"
+        << "etag " << entry.m_etag << "\n"
+        << "last-modified " << entry.m_last_modified << "\n"
+        << "expires " << entry.m_expires << "\n";
+    out.close();
+    if (!out.good()) {
+      std::remove(temp.c_str());
+      return;
+    }
+  }
+  if (std::rename(temp.c_str(), meta.c_str()) != 0) std::remove(temp.c_str());
+}
+
+bool HttpCache::parse_response(
+    const std::map<std::string, std::string>& headers, int64_t now,
+    Entry& entry) {
+  entry = Entry();
+  auto header = [&headers](const char* name) -> std::string {
+    auto it = headers.find(name);
+    return it == headers.end() ? "" : trim(it->second);
+  };
+
+  entry.m_etag = header("etag");
+  entry.m_last_modified = header("last-modified");
+
+  bool no_store = false;
+  bool no_cache = false;
+  long long max_age = -1;
+  const std::string cache_control = header("cache-control");
+  size_t pos = 0;
+  while (pos <= cache_control.size()) {
+    size_t comma = cache_control.find(',', pos);
+    if (comma == std::string::npos) comma = cache_control.size();
+    std::string directive =
+        lowercase(trim(cache_control.substr(pos, comma - pos)));
+    pos = comma + 1;
+
+    std::string value;
+    size_t equals = directive.find('=');
+    if (equals != std::string::npos) {
+      value = trim(directive.substr(equals + 1));
+      directive = trim(directive.substr(0, equals));
+      if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        value = value.substr(1, value.size() - 2);
+    }
+
+    if (directive == "no-store")
+      no_store = true;
+    else if (directive == "no-cache")
+      no_cache = true;
+    else if (directive == "max-age" && !value.empty() &&
+             std::isdigit(static_cast<unsigned char>(value[0])))
+      max_age = std::strtoll(value.c_str(), nullptr, 10);
+  }
+  if (no_store) return false;
+
+  if (no_cache)
+    entry.m_expires = 0;
+  else if (max_age >= 0) {
+    /* The response may have aged in intermediate caches already.  */
+    const std::string age = header("age");
+    if (!age.empty()) max_age -= std::strtoll(age.c_str(), nullptr, 10);
+    entry.m_expires = max_age > 0 ? now + max_age : 0;
+  } else {
+    /* Expires is relative to the server clock.  Invalid dates (like "0")
+       mean already expired.  */
+    const std::string expires = header("expires");
+    if (!expires.empty()) {
+      time_t expires_at = curl_getdate(expires.c_str(), nullptr);
+      time_t date = curl_getdate(header("date").c_str(), nullptr);
+      if (expires_at > 0 && date > 0)
+        entry.m_expires = now + (expires_at - date);
+      else if (expires_at > 0)
+        entry.m_expires = expires_at;
+      if (entry.m_expires <= now) entry.m_expires = 0;
+    }
+  }
+
+  /* Without freshness or validators, the entry would never be used.  */
+  return entry.m_expires > now || !entry.m_etag.empty() ||
+         !entry.m_last_modified.empty();
+}
+
+}  // Namespace NeoPG
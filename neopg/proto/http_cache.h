@@ -0,0 +1,103 @@
+/* HTTP response cache
+   Copyright 2018 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#pragma once
+
+#include <neopg/utils/common.h>
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+
+namespace NeoPG {
+
+/* An on-disk cache of HTTP responses, keyed by URL.  Attach it to a
+   request with Http::set_cache.  Fresh entries (by Cache-Control max-age
+   or Expires) are served without contacting the server.  Stale entries
+   are revalidated with If-None-Match and If-Modified-Since, and a "304
+   Not Modified" response is served from the cache.  Responses with
+   "Cache-Control: no-store" are never stored.
+
+   Each entry is a pair of files in the cache directory, named after the
+   SHA-256 of the URL: a small ".meta" file with the validators and the
+   expiry time, and a ".body" file.  The directory must exist.  Entries
+   are written to temporary files and renamed into place, so several
+   processes can share one cache.  */
+class NEOPG_UNSTABLE_API HttpCache {
+ public:
+  /* The metadata of a cached response.  */
+  struct Entry {
+    std::string m_etag;
+    std::string m_last_modified;
+
+    /* Seconds since the epoch until which the entry is fresh.  */
+    int64_t m_expires{0};
+  };
+
+  using Receiver = std::function<void(const char* data, size_t length)>;
+
+  /* Writes a new body to a temporary file, which replaces the entry on
+     commit.  It is discarded if commit is never called.  */
+  class NEOPG_UNSTABLE_API Store {
+   public:
+    Store(HttpCache& cache, const std::string& url);
+    ~Store();
+
+    /* False if the temporary file could not be created.  */
+    bool good() const { return m_file.good(); }
+
+    void write(const char* data, size_t length);
+    void commit(const Entry& entry);
+
+   private:
+    HttpCache& m_cache;
+    std::string m_url;
+    std::string m_temp;
+    std::ofstream m_file;
+  };
+
+  HttpCache(const std::string& directory);
+
+  /* Read the metadata of the entry for \p url.  Returns false if there is
+     none.  */
+  bool lookup(const std::string& url, Entry& entry) const;
+
+  /* Pass the cached body for \p url to \p receive.  Returns false if
+     there is none, and throws if it can not be read completely.  */
+  bool read(const std::string& url, const Receiver& receive) const;
+
+  /* Replace the metadata of an existing entry, after revalidation.  */
+  void update(const std::string& url, const Entry& entry);
+
+  /* Remove the entry for \p url.  */
+  void remove(const std::string& url);
+
+  /* Fill \p entry from the response headers (with lowercase names).
+     Returns false if the response must not be stored, because it says
+     no-store or can be neither reused nor revalidated.  */
+  static bool parse_response(const std::map<std::string, std::string>& headers,
+                             int64_t now, Entry& entry);
+
+  /* Responses served from the cache without a request.  */
+  uint64_t m_hits{0};
+
+  /* Responses served from the cache after a "304 Not Modified".  */
+  uint64_t m_revalidations{0};
+
+  /* Responses downloaded in full.  */
+  uint64_t m_misses{0};
+
+ private:
+  std::string m_directory;
+
+  /* The path of the entry files for \p url, without suffix.  */
+  std::string path(const std::string& url) const;
+  void write_meta(const std::string& url, const Entry& entry);
+};
+
+}  // Namespace NeoPG
@@ -0,0 +1,108 @@
+/* Tests for the HTTP response cache
+   Copyright 2018 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/proto/http_cache.h>
+
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+using namespace NeoPG;
+
+namespace NeoPG {
+
+TEST(NeopgTest, proto_http_cache_parse_test) {
+  const int64_t now = 1000000;
+  HttpCache::Entry entry;
+
+  ASSERT_TRUE(HttpCache::parse_response(
+      {{"cache-control", "public, max-age=60"}, {"etag", "\"abc\""}}, now,
+      entry));
+  ASSERT_EQ(entry.m_expires, now + 60);
+  ASSERT_EQ(entry.m_etag, "\"abc\"");
+
+  /* Age is subtracted, and max-age takes precedence over Expires.  */
+  ASSERT_TRUE(HttpCache::parse_response({{"cache-control", "max-age=\"60\""},
+                                         {"age", "10"},
+                                         {"expires", "0"}},
+                                        now, entry));
+  ASSERT_EQ(entry.m_expires, now + 50);
+
+  /* Expires is relative to the server's Date.  */
+  ASSERT_TRUE(HttpCache::parse_response(
+      {{"date", "Thu, 01 Jan 2015 00:00:00 GMT"},
+       {"expires", "Thu, 01 Jan 2015 01:00:00 GMT"}},
+      now, entry));
+  ASSERT_EQ(entry.m_expires, now + 3600);
+
+  /* no-cache responses are stored, but always revalidated.  */
+  ASSERT_TRUE(HttpCache::parse_response(
+      {{"cache-control", "No-Cache, max-age=60"},
+       {"last-modified", "Thu, 01 Jan 2015 00:00:00 GMT"}},
+      now, entry));
+  ASSERT_EQ(entry.m_expires, 0);
+  ASSERT_EQ(entry.m_last_modified, "Thu, 01 Jan 2015 00:00:00 GMT");
+
+  ASSERT_FALSE(HttpCache::parse_response(
+      {{"cache-control", "max-age=60, no-store"}, {"etag", "\"abc\""}}, now,
+      entry));
+  /* Neither fresh nor revalidatable.  */
+  ASSERT_FALSE(HttpCache::parse_response({}, now, entry));
+  ASSERT_FALSE(HttpCache::parse_response({{"expires", "0"}}, now, entry));
+}
+
+TEST(NeopgTest, proto_http_cache_store_test) {
+  HttpCache cache(".");
+  const std::string url{"http://www.example.com/neopg-http-cache-test"};
+  cache.remove(url);
+
+  HttpCache::Entry entry;
+  ASSERT_FALSE(cache.lookup(url, entry));
+  auto append = [](std::string& out) {
+    return [&out](const char* data, size_t length) { out.append(data, length); };
+  };
+  std::string body;
+  ASSERT_FALSE(cache.read(url, append(body)));
+
+  /* Uncommitted entries are discarded.  */
+  { HttpCache::Store store(cache, url); store.write("foo", 3); }
+  ASSERT_FALSE(cache.lookup(url, entry));
+
+  std::string large(100000, 'x');
+  entry.m_etag = "\"v1\"";
+  entry.m_expires = 12345;
+  {
+    HttpCache::Store store(cache, url);
+    ASSERT_TRUE(store.good());
+    store.write(large.data(), large.size());
+    store.write("end", 3);
+    store.commit(entry);
+  }
+
+  HttpCache::Entry found;
+  ASSERT_TRUE(cache.lookup(url, found));
+  ASSERT_EQ(found.m_etag, "\"v1\"");
+  ASSERT_EQ(found.m_last_modified, "");
+  ASSERT_EQ(found.m_expires, 12345);
+  ASSERT_TRUE(cache.read(url, append(body)));
+  ASSERT_EQ(body, large + "end");
+
+  entry.m_last_modified = "Thu, 01 Jan 2015 00:00:00 GMT";
+  cache.update(url, entry);
+  ASSERT_TRUE(cache.lookup(url, found));
+  ASSERT_EQ(found.m_last_modified, entry.m_last_modified);
+
+  /* Other URLs don't match.  */
+  ASSERT_FALSE(cache.lookup(url + "/", found));
+
+  cache.remove(url);
+  ASSERT_FALSE(cache.lookup(url, found));
+  ASSERT_EQ(cache.m_hits + cache.m_revalidations + cache.m_misses, 0);
+}
+
+}  // namespace NeoPG
@@ -0,0 +1,432 @@
+/* HTTP connection pool
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/proto/http_pool.h>
+
+#include <neopg/proto/dns_cache.h>
+#include <neopg/proto/http_cache.h>
+#include <neopg/proto/uri.h>
+
+#include <cctype>
+#include <ctime>
+#include <list>
+#include <map>
+#include <stdexcept>
+
+namespace NeoPG {
+
+struct HttpPool::Transfer {
+  CURL* m_handle{nullptr};
+  size_t m_index{0};
+  std::string m_host;
+  HttpResult m_result;
+  char m_error[CURL_ERROR_SIZE];
+  long m_maxfilesize{0};
+
+  /* The request headers, owned by the transfer.  */
+  struct curl_slist* m_headers{nullptr};
+
+  /* The headers of the last response (after redirects), with lowercase
+     names.  Only collected if there is a cache.  */
+  std::map<std::string, std::string> m_response_headers;
+
+  /* The cache entry which is revalidated, if any.  */
+  bool m_conditional{false};
+  HttpCache::Entry m_cached;
+};
+
+/* Must be unbound functions, because they are used as C callbacks.  */
+static size_t pool_write_fnc(void* buffer, size_t size, size_t nmemb,
+                             void* userp) {
+  std::string* response = (std::string*)userp;
+  size_t amount = size * nmemb;
+  response->append((char*)buffer, amount);
+  return amount;
+}
+
+static size_t pool_header_fnc(char* buffer, size_t size, size_t nitems,
+                              void* userp) {
+  auto headers = (std::map<std::string, std::string>*)userp;
+  size_t amount = size * nitems;
+  try {
+    std::string line(buffer, amount);
+    /* Every response (including redirects) starts with a status line.  */
+    if (line.compare(0, 5, "HTTP/") == 0) {
+      headers->clear();
+      return amount;
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) return amount;
+    std::string name = line.substr(0, colon);
+    for (auto& c : name) c = std::tolower(static_cast<unsigned char>(c));
+    size_t end = line.find_last_not_of("\r\n");
+    (*headers)[name] = end > colon ? line.substr(colon + 1, end - colon) : "";
+  } catch (...) {
+    /* Aborts with CURLE_WRITE_ERROR.  */
+    return 0;
+  }
+  return amount;
+}
+
+static int pool_progress_fnc(void* userp, curl_off_t dltotal, curl_off_t dlnow,
+                             curl_off_t ultotal, curl_off_t ulnow) {
+  long* maxfilesize = (long*)userp;
+  /* Aborts with CURLE_ABORTED_BY_CALLBACK.  */
+  return *maxfilesize > 0 && dlnow > (curl_off_t)*maxfilesize ? 1 : 0;
+}
+
+template <typename T>
+static void set_opt(CURL* handle, CURLoption opt, const T& val) {
+  CURLcode cc = curl_easy_setopt(handle, opt, val);
+  if (cc != CURLE_OK) throw std::runtime_error(curl_easy_strerror(cc));
+}
+
+HttpPool::HttpPool()
+    : m_multi(curl_multi_init(), curl_multi_cleanup),
+      m_share(curl_share_init(), curl_share_cleanup),
+      m_concurrency(CONCURRENCY_DEFAULT),
+      m_redirects(MAX_REDIRECTS_DEFAULT),
+      m_maxfilesize(MAX_FILESIZE_DEFAULT) {
+  if (m_multi.get() == nullptr || m_share.get() == nullptr)
+    throw std::bad_alloc();
+
+  /* Connections are cached by the multi handle.  */
+  curl_share_setopt(m_share.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(m_share.get(), CURLSHOPT_SHARE,
+                    CURL_LOCK_DATA_SSL_SESSION);
+  set_http2(true);
+}
+
+HttpPool::~HttpPool() {
+  /* The share handle can only be cleaned up when no easy handle uses it.  */
+  for (auto handle : m_idle) curl_easy_cleanup(handle);
+}
+
+HttpPool& HttpPool::set_concurrency(size_t max) {
+  if (max == 0) throw std::invalid_argument("concurrency must be positive");
+  m_concurrency = max;
+  return *this;
+}
+
+HttpPool& HttpPool::set_max_host_connections(long max) {
+  curl_multi_setopt(m_multi.get(), CURLMOPT_MAX_HOST_CONNECTIONS, max);
+  return *this;
+}
+
+HttpPool& HttpPool::set_http2(bool http2) {
+  m_http2 = http2;
+#ifdef CURLPIPE_MULTIPLEX
+  curl_multi_setopt(m_multi.get(), CURLMOPT_PIPELINING,
+                    http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+#endif
+  return *this;
+}
+
+HttpPool& HttpPool::set_proxy(const std::string& proxy) {
+  m_proxy = proxy;
+  return *this;
+}
+
+HttpPool& HttpPool::set_redirects(long nr) {
+  m_redirects = nr;
+  return *this;
+}
+
+HttpPool& HttpPool::set_timeout(long milliseconds) {
+  m_timeout = milliseconds;
+  return *this;
+}
+
+HttpPool& HttpPool::set_cainfo(const std::string& pemfile) {
+  m_cainfo = pemfile;
+  return *this;
+}
+
+HttpPool& HttpPool::set_maxfilesize(long size) {
+  m_maxfilesize = size;
+  return *this;
+}
+
+HttpPool& HttpPool::set_cache(HttpCache* cache) {
+  m_cache = cache;
+  return *this;
+}
+
+HttpPool& HttpPool::set_dns_cache(DnsCache* dns) {
+  m_dns_cache = dns;
+  return *this;
+}
+
+HttpPool& HttpPool::no_cache(bool no_cache) {
+  m_no_cache = no_cache;
+  return *this;
+}
+
+/* Append \p header to the list \p headers.  */
+static void add_header(struct curl_slist*& headers, const std::string& header) {
+  struct curl_slist* ptr = curl_slist_append(headers, header.c_str());
+  if (!ptr) throw std::bad_alloc();
+  headers = ptr;
+}
+
+void HttpPool::start(Transfer& transfer, const std::string& url) {
+  URI uri(url);
+  long redir_protocols;
+  if (uri.scheme == "https")
+    redir_protocols = CURLPROTO_HTTPS;
+  else if (uri.scheme == "http")
+    redir_protocols = CURLPROTO_HTTP | CURLPROTO_HTTPS;
+  else
+    throw std::runtime_error("unsupported protocol");
+  if (m_dns_cache) m_dns_cache->check(uri.host);
+  transfer.m_host = uri.host;
+
+  CURL* handle;
+  if (m_idle.empty()) {
+    handle = curl_easy_init();
+    if (handle == nullptr) throw std::bad_alloc();
+  } else {
+    /* Resetting keeps the connections and caches.  */
+    handle = m_idle.back();
+    m_idle.pop_back();
+    curl_easy_reset(handle);
+  }
+  transfer.m_handle = handle;
+  transfer.m_error[0] = '\0';
+  transfer.m_maxfilesize = m_maxfilesize;
+
+  set_opt(handle, CURLOPT_NOSIGNAL, 1L);
+  if (m_dns_cache)
+    m_dns_cache->attach(handle);
+  else
+    set_opt(handle, CURLOPT_SHARE, m_share.get());
+  set_opt(handle, CURLOPT_PRIVATE, (void*)&transfer);
+  set_opt(handle, CURLOPT_URL, url.c_str());
+  set_opt(handle, CURLOPT_REDIR_PROTOCOLS, redir_protocols);
+  if (m_redirects == 0)
+    set_opt(handle, CURLOPT_FOLLOWLOCATION, 0L);
+  else {
+    set_opt(handle, CURLOPT_MAXREDIRS, m_redirects);
+    set_opt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+  }
+  if (m_timeout) set_opt(handle, CURLOPT_TIMEOUT_MS, m_timeout);
+  if (m_cainfo.size()) set_opt(handle, CURLOPT_CAINFO, m_cainfo.c_str());
+  if (m_proxy.size()) set_opt(handle, CURLOPT_PROXY, m_proxy.c_str());
+  if (m_http2) {
+#ifdef CURL_HTTP_VERSION_2TLS
+    set_opt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+#endif
+#ifdef CURLPIPE_MULTIPLEX
+    /* Wait for a connection that can be multiplexed instead of opening a
+       new one.  */
+    set_opt(handle, CURLOPT_PIPEWAIT, 1L);
+#endif
+  }
+
+  if (m_no_cache) {
+    add_header(transfer.m_headers, "Pragma: no-cache");
+    add_header(transfer.m_headers, "Cache-Control: no-cache");
+  }
+  if (m_cache) {
+    set_opt(handle, CURLOPT_HEADERFUNCTION, pool_header_fnc);
+    set_opt(handle, CURLOPT_HEADERDATA,
+            (void*)&transfer.m_response_headers);
+    /* Revalidate a stale entry.  */
+    HttpCache::Entry& cached = transfer.m_cached;
+    if (m_cache->lookup(url, cached) &&
+        (cached.m_etag.size() || cached.m_last_modified.size())) {
+      transfer.m_conditional = true;
+      if (cached.m_etag.size())
+        add_header(transfer.m_headers, "If-None-Match: " + cached.m_etag);
+      if (cached.m_last_modified.size())
+        add_header(transfer.m_headers,
+                   "If-Modified-Since: " + cached.m_last_modified);
+    }
+  }
+  if (transfer.m_headers)
+    set_opt(handle, CURLOPT_HTTPHEADER, transfer.m_headers);
+
+  set_opt(handle, CURLOPT_WRITEFUNCTION, pool_write_fnc);
+  set_opt(handle, CURLOPT_WRITEDATA, (void*)&transfer.m_result.m_body);
+  set_opt(handle, CURLOPT_ERRORBUFFER, transfer.m_error);
+
+  /* Enforce maximum filesize, see Http::set_maxfilesize.  */
+  set_opt(handle, CURLOPT_MAXFILESIZE, m_maxfilesize);
+  set_opt(handle, CURLOPT_XFERINFOFUNCTION, pool_progress_fnc);
+  set_opt(handle, CURLOPT_XFERINFODATA, (void*)&transfer.m_maxfilesize);
+  set_opt(handle, CURLOPT_NOPROGRESS, 0L);
+
+  CURLMcode mc = curl_multi_add_handle(m_multi.get(), handle);
+  if (mc != CURLM_OK) {
+    m_idle.push_back(handle);
+    transfer.m_handle = nullptr;
+    throw std::runtime_error(curl_multi_strerror(mc));
+  }
+}
+
+bool HttpPool::serve_cached(Transfer& transfer) {
+  HttpResult& result = transfer.m_result;
+  HttpCache::Entry cached;
+  if (!m_cache || m_no_cache) return false;
+  if (!m_cache->lookup(result.m_url, cached) ||
+      cached.m_expires <= std::time(nullptr))
+    return false;
+
+  auto append = [&result](const char* data, size_t length) {
+    result.m_body.append(data, length);
+  };
+  try {
+    if (!m_cache->read(result.m_url, append)) return false;
+  } catch (const std::exception&) {
+    result.m_body.clear();
+    return false;
+  }
+  result.m_status = 200;
+  m_cache->m_hits++;
+  return true;
+}
+
+void HttpPool::update_cache(Transfer& transfer) {
+  HttpResult& result = transfer.m_result;
+  auto& headers = transfer.m_response_headers;
+  auto append = [&result](const char* data, size_t length) {
+    result.m_body.append(data, length);
+  };
+  if (!m_cache) return;
+
+  try {
+    if (result.m_status == 304 && transfer.m_conditional) {
+      /* The 304 may update the freshness and validators.  */
+      if (!headers.count("etag")) headers["etag"] = transfer.m_cached.m_etag;
+      if (!headers.count("last-modified"))
+        headers["last-modified"] = transfer.m_cached.m_last_modified;
+      HttpCache::Entry entry;
+      bool storable =
+          HttpCache::parse_response(headers, std::time(nullptr), entry);
+      result.m_body.clear();
+      if (!m_cache->read(result.m_url, append))
+        throw std::runtime_error("cache entry disappeared");
+      result.m_status = 200;
+      result.m_error.clear();
+      if (storable)
+        m_cache->update(result.m_url, entry);
+      else
+        m_cache->remove(result.m_url);
+      m_cache->m_revalidations++;
+    } else if (result.m_status == 200 && result.m_error.empty()) {
+      HttpCache::Entry entry;
+      if (HttpCache::parse_response(headers, std::time(nullptr), entry)) {
+        HttpCache::Store store(*m_cache, result.m_url);
+        if (store.good()) {
+          store.write(result.m_body.data(), result.m_body.size());
+          store.commit(entry);
+        }
+      } else
+        m_cache->remove(result.m_url);
+      m_cache->m_misses++;
+    }
+  } catch (const std::exception& exc) {
+    result.m_body.clear();
+    result.m_error = exc.what();
+  }
+}
+
+std::vector<HttpResult> HttpPool::fetch_many(
+    const std::vector<std::string>& urls, Callback done) {
+  std::vector<HttpResult> results(urls.size());
+  for (size_t i = 0; i < urls.size(); i++) results[i].m_url = urls[i];
+
+  std::list<Transfer> active;
+  auto finish = [&results, &done](Transfer& transfer) {
+    if (done)
+      done(transfer.m_index, transfer.m_result);
+    else
+      results[transfer.m_index] = std::move(transfer.m_result);
+  };
+
+  /* Detach the easy handle of a transfer and keep it for later requests.  */
+  auto release = [this](Transfer& transfer) {
+    curl_slist_free_all(transfer.m_headers);
+    transfer.m_headers = nullptr;
+    if (transfer.m_handle == nullptr) return;
+    curl_multi_remove_handle(m_multi.get(), transfer.m_handle);
+    m_idle.push_back(transfer.m_handle);
+    transfer.m_handle = nullptr;
+  };
+
+  try {
+    size_t next = 0;
+    while (next < urls.size() || !active.empty()) {
+      while (active.size() < m_concurrency && next < urls.size()) {
+        active.emplace_back();
+        Transfer& transfer = active.back();
+        transfer.m_index = next;
+        transfer.m_result.m_url = urls[next];
+        next++;
+        if (serve_cached(transfer)) {
+          finish(transfer);
+          active.pop_back();
+          continue;
+        }
+        try {
+          start(transfer, transfer.m_result.m_url);
+        } catch (const std::exception& exc) {
+          transfer.m_result.m_error = exc.what();
+          release(transfer);
+          finish(transfer);
+          active.pop_back();
+        }
+      }
+      if (active.empty()) continue;
+
+      int running;
+      CURLMcode mc = curl_multi_perform(m_multi.get(), &running);
+      if (mc != CURLM_OK) throw std::runtime_error(curl_multi_strerror(mc));
+
+      CURLMsg* msg;
+      int queued;
+      while ((msg = curl_multi_info_read(m_multi.get(), &queued))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+        char* priv = nullptr;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+        Transfer& transfer = *reinterpret_cast<Transfer*>(priv);
+        HttpResult& result = transfer.m_result;
+
+        CURLcode cc = msg->data.result;
+        curl_easy_getinfo(transfer.m_handle, CURLINFO_RESPONSE_CODE,
+                          &result.m_status);
+        if (cc != CURLE_OK)
+          result.m_error =
+              transfer.m_error[0] ? transfer.m_error : curl_easy_strerror(cc);
+        else if (result.m_status != 200)
+          result.m_error = "HTTP " + std::to_string(result.m_status);
+        if (cc == CURLE_OK) update_cache(transfer);
+        if (m_dns_cache)
+          m_dns_cache->record(transfer.m_handle, transfer.m_host, cc);
+
+        release(transfer);
+        finish(transfer);
+        for (auto it = active.begin(); it != active.end(); ++it)
+          if (&*it == &transfer) {
+            active.erase(it);
+            break;
+          }
+      }
+
+      if (!active.empty()) {
+        mc = curl_multi_wait(m_multi.get(), nullptr, 0, 1000, nullptr);
+        if (mc != CURLM_OK) throw std::runtime_error(curl_multi_strerror(mc));
+      }
+    }
+  } catch (...) {
+    for (auto& transfer : active) release(transfer);
+    throw;
+  }
+
+  return results;
+}
+
+}  // Namespace NeoPG
@@ -0,0 +1,123 @@
+/* HTTP connection pool
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#pragma once
+
+#include <curl/curl.h>
+
+#include <neopg/utils/common.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NeoPG {
+
+class DnsCache;
+class HttpCache;
+
+/* The result of one request of HttpPool::fetch_many.  */
+struct NEOPG_UNSTABLE_API HttpResult {
+  std::string m_url;
+
+  /* The HTTP status code, or 0 if no response was received.  */
+  long m_status{0};
+
+  std::string m_body;
+
+  /* Empty if the request succeeded with status 200.  */
+  std::string m_error;
+};
+
+/* Fetch many URLs concurrently on one thread.  All requests share one
+   curl multi handle, so connections are kept open and reused across
+   requests (and batches), and with HTTP/2 several requests to the same
+   host are multiplexed over one connection.  DNS results and TLS sessions
+   are shared as well.
+
+     HttpPool pool;
+     pool.set_concurrency(32);
+     auto results = pool.fetch_many(urls);
+
+   A pool must only be used by one thread at a time.  */
+class NEOPG_UNSTABLE_API HttpPool {
+  const long MAX_REDIRECTS_DEFAULT = 2;
+  const long MAX_FILESIZE_DEFAULT = 2 * 1024 * 1024;
+  const size_t CONCURRENCY_DEFAULT = 16;
+
+ public:
+  using Callback = std::function<void(size_t index, const HttpResult& result)>;
+
+  HttpPool();
+  ~HttpPool();
+
+  /* The maximum number of requests in flight.  */
+  HttpPool& set_concurrency(size_t max);
+
+  /* The maximum number of connections to one host (0 is unlimited).  With
+     HTTP/2, requests beyond that are multiplexed.  */
+  HttpPool& set_max_host_connections(long max);
+
+  /* Allow HTTP/2 (over TLS) and multiplexing.  Enabled by default.  */
+  HttpPool& set_http2(bool http2 = true);
+
+  HttpPool& set_proxy(const std::string& proxy);
+  HttpPool& set_redirects(long nr);
+  HttpPool& set_timeout(long milliseconds);
+  HttpPool& set_cainfo(const std::string& pemfile);
+  HttpPool& set_maxfilesize(long size);
+
+  /* Serve requests from \p cache where possible, and store the responses
+     in it, like Http::set_cache (nullptr disables caching).  The cache
+     must outlive the pool.  */
+  HttpPool& set_cache(HttpCache* cache);
+
+  /* Resolve host names through \p dns instead of the cache of the pool,
+     so that it is kept across pools (see Http::set_dns_cache).  */
+  HttpPool& set_dns_cache(DnsCache* dns);
+
+  /* Revalidate fresh cache entries anyway, and ask proxies to do the same
+     (see Http::no_cache).  */
+  HttpPool& no_cache(bool no_cache = true);
+
+  /* Fetch all \p urls and return the results in the same order.  Errors
+     are reported in the results and do not stop the batch.  If \p done is
+     set, it is called for every result as soon as the request finishes,
+     and the results are not kept (so the returned vector only contains the
+     URLs).  */
+  std::vector<HttpResult> fetch_many(const std::vector<std::string>& urls,
+                                     Callback done = nullptr);
+
+ private:
+  struct Transfer;
+
+  void start(Transfer& transfer, const std::string& url);
+
+  /* Serve a fresh cache entry without a request.  */
+  bool serve_cached(Transfer& transfer);
+
+  /* Update the cache with the response of a finished request.  */
+  void update_cache(Transfer& transfer);
+
+  std::unique_ptr<CURLM, CURLMcode (*)(CURLM*)> m_multi;
+  std::unique_ptr<CURLSH, CURLSHcode (*)(CURLSH*)> m_share;
+  /* Idle easy handles, reused for later requests.  */
+  std::vector<CURL*> m_idle;
+
+  size_t m_concurrency;
+  bool m_http2{true};
+  std::string m_proxy;
+  long m_redirects;
+  long m_timeout{0};
+  std::string m_cainfo;
+  long m_maxfilesize;
+  HttpCache* m_cache{nullptr};
+  DnsCache* m_dns_cache{nullptr};
+  bool m_no_cache{false};
+};
+
+}  // Namespace NeoPG
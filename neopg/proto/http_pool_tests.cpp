@@ -0,0 +1,102 @@
+/* Tests for the HTTP connection pool
+   Copyright 2017 The NeoPG developers
+
+   NeoPG is released under the Simplified BSD License (see license.txt)
+*/
+
+#include <neopg/proto/http_cache.h>
+#include <neopg/proto/http_pool.h>
+
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace NeoPG;
+
+namespace NeoPG {
+
+namespace {
+
+class TempDir {
+ public:
+  TempDir() {
+    char name[] = "neopg-http-pool-test-XXXXXX";
+    if (!mkdtemp(name)) throw std::runtime_error("mkdtemp");
+    m_path = name;
+  }
+  ~TempDir() {
+    std::system(("rm -rf " + m_path).c_str());
+  }
+  std::string m_path;
+};
+
+}  // namespace
+
+TEST(NeopgTest, proto_http_pool_test) {
+  HttpPool pool;
+  pool.set_concurrency(2).set_timeout(5000);
+
+  ASSERT_EQ(pool.fetch_many({}).size(), 0);
+
+  /* These fail without network access.  Nothing listens on port 1.  */
+  const std::vector<std::string> urls{"ftp://www.example.com/",
+                                      "http://127.0.0.1:1/a",
+                                      "http://127.0.0.1:1/b"};
+  auto results = pool.fetch_many(urls);
+  ASSERT_EQ(results.size(), 3);
+  for (size_t i = 0; i < urls.size(); i++) {
+    ASSERT_EQ(results[i].m_url, urls[i]);
+    ASSERT_EQ(results[i].m_status, 0);
+    ASSERT_NE(results[i].m_error, "");
+  }
+  ASSERT_EQ(results[0].m_error, "unsupported protocol");
+
+  /* With a callback, every result is reported once.  */
+  std::vector<size_t> seen(urls.size(), 0);
+  pool.fetch_many(urls, [&seen](size_t index, const HttpResult& result) {
+    seen[index]++;
+  });
+  ASSERT_EQ(seen, std::vector<size_t>(urls.size(), 1));
+
+  ASSERT_THROW(pool.set_concurrency(0), std::invalid_argument);
+
+  /* FIXME: Fetching real keys requires network access. */
+}
+
+TEST(NeopgTest, proto_http_pool_cache_test) {
+  TempDir dir;
+  HttpCache cache(dir.m_path);
+  HttpPool pool;
+  pool.set_cache(&cache).set_timeout(5000);
+
+  /* A fresh entry is served without a request, which would fail.  */
+  const std::string url{"http://127.0.0.1:1/neopg-http-pool-cache-test"};
+  HttpCache::Entry entry;
+  entry.m_etag = "\"v1\"";
+  entry.m_expires = std::time(nullptr) + 3600;
+  {
+    HttpCache::Store store(cache, url);
+    ASSERT_TRUE(store.good());
+    store.write("cached", 6);
+    store.commit(entry);
+  }
+  auto results = pool.fetch_many({url, url + "/other"});
+  ASSERT_EQ(results.size(), 2);
+  ASSERT_EQ(results[0].m_status, 200);
+  ASSERT_EQ(results[0].m_body, "cached");
+  ASSERT_EQ(results[0].m_error, "");
+  ASSERT_NE(results[1].m_error, "");
+  ASSERT_EQ(cache.m_hits, 1);
+
+  /* With no_cache, the entry is revalidated.  */
+  results = pool.no_cache().fetch_many({url});
+  ASSERT_NE(results[0].m_error, "");
+  ASSERT_EQ(cache.m_hits, 1);
+
+  cache.remove(url);
+}
+}  // namespace NeoPG
@@ -80,6 +80,64 @@ struct action<pegtl::uri::query> : bind<&URI::query> {};
 
 template <>
 struct action<pegtl::uri::fragment> : bind<&URI::fragment> {};
+
+/* The same for URIView, without copying.  */
+template <URIPart URIView::*Field>
+struct bind_view {
+  template <typename Input>
+  static void apply(const Input& in, URIView& uri, URIPart& tmp) {
+    uri.*Field = URIPart(in.begin(), in.size());
+  }
+};
+
+template <typename Rule>
+struct view_action : pegtl::nothing<Rule> {};
+
+template <>
+struct view_action<pegtl::uri::scheme> : bind_view<&URIView::scheme> {};
+
+template <>
+struct view_action<pegtl::uri::authority> : bind_view<&URIView::authority> {};
+
+template <>
+struct view_action<pegtl::uri::userinfo> {
+  template <typename Input>
+  static void apply(const Input& in, URIView& uri, URIPart& tmp) {
+    tmp = URIPart(in.begin(), in.size());
+  }
+};
+
+template <>
+struct view_action<pegtl::one<'@'>> {
+  template <typename Input>
+  static void apply(const Input& in, URIView& uri, URIPart& tmp) {
+    uri.userinfo = tmp;
+  }
+};
+
+template <>
+struct view_action<pegtl::uri::host> : bind_view<&URIView::host> {};
+
+template <>
+struct view_action<pegtl::uri::port> : bind_view<&URIView::port> {};
+
+template <>
+struct view_action<pegtl::uri::path_abempty> : bind_view<&URIView::path> {};
+
+template <>
+struct view_action<pegtl::uri::path_rootless> : bind_view<&URIView::path> {};
+
+template <>
+struct view_action<pegtl::uri::path_absolute> : bind_view<&URIView::path> {};
+
+template <>
+struct view_action<pegtl::uri::path_empty> : bind_view<&URIView::path> {};
+
+template <>
+struct view_action<pegtl::uri::query> : bind_view<&URIView::query> {};
+
+template <>
+struct view_action<pegtl::uri::fragment> : bind_view<&URIView::fragment> {};
 };  // namespace uri
 
 URI& URI::clear() {
@@ -119,4 +177,85 @@ std::string URI::str() {
   return uri;
 }
 
+URIView& URIView::clear() {
+  *this = URIView();
+  return *this;
+}
+
+URIView& URIView::set_uri(const char* data, size_t length) {
+  clear();
+
+  pegtl::memory_input<> input(data, length, "uri");
+  URIPart tmp;
+  pegtl::parse<uri::grammar, uri::view_action>(input, *this, tmp);
+
+  return *this;
+}
+
+URIBuilder& URIBuilder::clear() {
+  m_buffer.clear();
+  m_query = false;
+  return *this;
+}
+
+URIBuilder& URIBuilder::scheme(URIPart scheme) {
+  m_buffer.append(scheme.data(), scheme.size());
+  m_buffer += ':';
+  return *this;
+}
+
+URIBuilder& URIBuilder::authority(URIPart host, URIPart port,
+                                  URIPart userinfo) {
+  m_buffer += "//";
+  if (!userinfo.empty()) {
+    m_buffer.append(userinfo.data(), userinfo.size());
+    m_buffer += '@';
+  }
+  m_buffer.append(host.data(), host.size());
+  if (!port.empty()) {
+    m_buffer += ':';
+    m_buffer.append(port.data(), port.size());
+  }
+  return *this;
+}
+
+URIBuilder& URIBuilder::path(URIPart path) {
+  m_buffer.append(path.data(), path.size());
+  return *this;
+}
+
+URIBuilder& URIBuilder::query(URIPart key, URIPart value) {
+  m_buffer += m_query ? '&' : '?';
+  m_query = true;
+  percent_encode(m_buffer, key);
+  m_buffer += '=';
+  percent_encode(m_buffer, value);
+  return *this;
+}
+
+URIBuilder& URIBuilder::fragment(URIPart fragment) {
+  m_buffer += '#';
+  m_buffer.append(fragment.data(), fragment.size());
+  return *this;
+}
+
+void URIBuilder::percent_encode(std::string& out, URIPart str) {
+  static const char hex[] = "0123456789ABCDEF";
+  const char* run = str.data();
+  const char* end = str.data() + str.size();
+  /* Copy runs of unreserved characters at once.  */
+  for (const char* pos = run; pos != end; pos++) {
+    const unsigned char c = static_cast<unsigned char>(*pos);
+    bool unreserved = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                      (c >= '0' && c <= '9') || c == '-' || c == '.' ||
+                      c == '_' || c == '~';
+    if (unreserved) continue;
+    out.append(run, pos - run);
+    run = pos + 1;
+    const char escape[] = {'%', hex[c >> 4], hex[c & 15]};
+    out.append(escape, sizeof(escape));
+  }
+  out.append(run, end - run);
+}
+
 }  // Namespace NeoPG
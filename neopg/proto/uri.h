@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstring>
 #include <string>
 
 #include <neopg/utils/common.h>
@@ -30,4 +32,85 @@ class NEOPG_DLL URI {
   std::string str();
 };
 
+/* A range of characters owned by someone else, like a component of a
+   URIView.  */
+class NEOPG_UNSTABLE_API URIPart {
+ public:
+  URIPart() {}
+  URIPart(const char* data, size_t size) : m_data(data), m_size(size) {}
+  URIPart(const char* str) : m_data(str), m_size(strlen(str)) {}
+  URIPart(const std::string& str) : m_data(str.data()), m_size(str.size()) {}
+
+  const char* data() const { return m_data; }
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  std::string str() const { return std::string(m_data, m_size); }
+
+  bool operator==(const URIPart& other) const {
+    return m_size == other.m_size &&
+           (m_size == 0 || memcmp(m_data, other.m_data, m_size) == 0);
+  }
+  bool operator!=(const URIPart& other) const { return !(*this == other); }
+
+ private:
+  const char* m_data{""};
+  size_t m_size{0};
+};
+
+/* Like URI, but the components point into the parsed string instead of
+   being copied, so parsing does not allocate.  The view is only valid as
+   long as the string.  */
+class NEOPG_UNSTABLE_API URIView {
+ public:
+  URIPart scheme;
+  URIPart authority;
+  URIPart userinfo;
+  URIPart host;
+  URIPart port;
+  URIPart path;
+  URIPart query;
+  URIPart fragment;
+
+  URIView() {}
+  URIView(const std::string& uri) { set_uri(uri); }
+  URIView& clear();
+  URIView& set_uri(const char* data, size_t length);
+  URIView& set_uri(const std::string& uri) {
+    return set_uri(uri.data(), uri.size());
+  }
+};
+
+/* Build URIs in a buffer that is reused for the next URI, so generating
+   many of them does not allocate once the buffer is large enough.
+   Components must be added in order.
+
+     URIBuilder builder;
+     builder.clear().scheme("https").authority(host, "443");
+     builder.path("/pks/lookup").query("op", "get").query("search", keyid);
+     fetch(builder.str());
+
+   Query keys and values are percent-encoded, the other components are
+   copied unchanged.  */
+class NEOPG_UNSTABLE_API URIBuilder {
+ public:
+  URIBuilder& clear();
+  URIBuilder& scheme(URIPart scheme);
+  URIBuilder& authority(URIPart host, URIPart port = URIPart(),
+                        URIPart userinfo = URIPart());
+  URIBuilder& path(URIPart path);
+  URIBuilder& query(URIPart key, URIPart value);
+  URIBuilder& fragment(URIPart fragment);
+
+  /* Valid until the builder is changed.  */
+  const std::string& str() const { return m_buffer; }
+
+  /* Append \p str to \p out, percent-encoding all but the unreserved
+     characters of RFC 3986.  */
+  static void percent_encode(std::string& out, URIPart str);
+
+ private:
+  std::string m_buffer;
+  bool m_query{false};
+};
+
 }  // Namespace NeoPG
@@ -66,4 +66,60 @@ TEST(NeopgTest, proto_uri_test) {
     EXPECT_EQ(uri.str(), input);
   }
 }
+
+TEST(NeopgTest, proto_uri_view_test) {
+  // URIView agrees with URI, and points into the input.
+  for (const std::string input :
+       {"", "http://www.example.org", "https://www.example.org:10080/index.html",
+        "http://nobody@www.example.org/?name=foo#chapter1",
+        "http://brave.com%60x.code-fu.org", "mailto:nobody@example.org"}) {
+    URI uri{input};
+    URIView view{input};
+    EXPECT_EQ(view.scheme, uri.scheme);
+    EXPECT_EQ(view.authority, uri.authority);
+    EXPECT_EQ(view.userinfo, uri.userinfo);
+    EXPECT_EQ(view.host, uri.host);
+    EXPECT_EQ(view.port, uri.port);
+    EXPECT_EQ(view.path, uri.path);
+    EXPECT_EQ(view.query, uri.query);
+    EXPECT_EQ(view.fragment, uri.fragment);
+    if (!view.scheme.empty()) {
+      EXPECT_EQ(view.scheme.data(), input.data());
+    }
+  }
+
+  URIView view{"http://www.example.org/"};
+  EXPECT_EQ(view.path.str(), "/");
+  view.clear();
+  EXPECT_TRUE(view.host.empty());
+}
+
+TEST(NeopgTest, proto_uri_builder_test) {
+  URIBuilder builder;
+  EXPECT_EQ(builder.str(), "");
+
+  builder.scheme("https").authority("www.example.org", "10080");
+  builder.path("/index.html");
+  EXPECT_EQ(builder.str(), "https://www.example.org:10080/index.html");
+
+  builder.clear().scheme("http").authority("www.example.org", "", "nobody");
+  builder.path("/").query("name", "foo").query("search", "a b&c=d/~");
+  builder.fragment("chapter1");
+  EXPECT_EQ(builder.str(),
+            "http://nobody@www.example.org/"
+            "?name=foo&search=a%20b%26c%3Dd%2F~#chapter1");
+
+  // What URIBuilder writes, URIView reads.  The buffer is reused.
+  const char* buffer = builder.str().data();
+  builder.clear().scheme("hkps").authority("keys.example.org");
+  builder.path("/pks/lookup").query("op", "get").query("search", "0x1234");
+  EXPECT_EQ(builder.str().data(), buffer);
+  URIView view{builder.str()};
+  EXPECT_EQ(view.host, "keys.example.org");
+  EXPECT_EQ(view.query, "op=get&search=0x1234");
+
+  std::string out;
+  URIBuilder::percent_encode(out, std::string("\x00\xff-", 3));
+  EXPECT_EQ(out, "%00%FF-");
+}
 }  // namespace NeoPG
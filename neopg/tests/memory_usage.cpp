@@ -0,0 +1,80 @@
+// NeoPG tests - heap usage accounting (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/tests/memory_usage.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+using namespace NeoPG::Test;
+
+namespace {
+
+// Every block starts with its size, padded to keep the alignment of
+// malloc.
+const size_t HEADER_SIZE = alignof(std::max_align_t);
+
+std::atomic<size_t> g_current{0};
+std::atomic<size_t> g_peak{0};
+
+void* allocate(size_t size) {
+  void* block = std::malloc(HEADER_SIZE + size);
+  if (!block) return nullptr;
+  *static_cast<size_t*>(block) = size;
+
+  size_t current = g_current.fetch_add(size) + size;
+  size_t peak = g_peak.load();
+  while (current > peak && !g_peak.compare_exchange_weak(peak, current)) {
+  }
+  return static_cast<char*>(block) + HEADER_SIZE;
+}
+
+void* allocate_or_throw(size_t size) {
+  void* ptr = allocate(size);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void deallocate(void* ptr) {
+  if (!ptr) return;
+  void* block = static_cast<char*>(ptr) - HEADER_SIZE;
+  g_current.fetch_sub(*static_cast<size_t*>(block));
+  std::free(block);
+}
+
+}  // namespace
+
+void* operator new(size_t size) { return allocate_or_throw(size); }
+void* operator new[](size_t size) { return allocate_or_throw(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+void operator delete(void* ptr) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  deallocate(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  deallocate(ptr);
+}
+
+MemoryUsage::MemoryUsage() : m_start(g_current.load()) {
+  g_peak.store(m_start);
+}
+
+size_t MemoryUsage::peak() const {
+  size_t peak = g_peak.load();
+  return peak > m_start ? peak - m_start : 0;
+}
+
+size_t MemoryUsage::current() const {
+  size_t current = g_current.load();
+  return current > m_start ? current - m_start : 0;
+}
@@ -0,0 +1,44 @@
+// NeoPG tests - heap usage accounting
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains the measurement of heap usage in tests.  The test
+/// binary replaces the global operator new and delete with versions that
+/// count the allocated bytes, see memory_usage.cpp.
+
+#pragma once
+
+#include <cstddef>
+
+namespace NeoPG {
+namespace Test {
+
+/// Measure the heap usage from construction on.  Allocations of all threads
+/// are counted, including those of the standard library containers.  Memory
+/// that does not come from operator new (Botan's secure allocator, malloc in
+/// C code, mapped files) is not counted.
+///
+/// Measurements must not overlap, as they share the peak counter.
+class MemoryUsage {
+ public:
+  MemoryUsage();
+
+  MemoryUsage(const MemoryUsage&) = delete;
+  MemoryUsage& operator=(const MemoryUsage&) = delete;
+
+  /// \return the largest number of bytes allocated at any time since
+  /// construction, beyond what was allocated at construction
+  size_t peak() const;
+
+  /// \return the number of bytes allocated now, beyond what was allocated at
+  /// construction (or zero, if less are allocated now)
+  size_t current() const;
+
+ private:
+  size_t m_start;
+};
+
+}  // namespace Test
+}  // namespace NeoPG
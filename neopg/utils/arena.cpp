@@ -0,0 +1,76 @@
+// Arena allocator (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/arena.h>
+
+#include <new>
+
+using namespace NeoPG;
+
+namespace {
+const size_t ALIGNMENT = alignof(std::max_align_t);
+
+size_t align_up(size_t size) {
+  return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+thread_local Arena* current_arena = nullptr;
+
+// ArenaAllocated objects are preceded by a header that records where the
+// memory came from.  It is padded to keep the object aligned.
+const size_t HEADER_SIZE = align_up(sizeof(bool));
+}  // namespace
+
+Arena::Arena(size_t block_size) : m_block_size(align_up(block_size)) {}
+
+void* Arena::allocate(size_t size) {
+  size = align_up(size);
+  if (size > m_available) {
+    // Large allocations get their own block, so we do not waste the rest of
+    // the current one.
+    size_t block_size = size > m_block_size / 4 ? size : m_block_size;
+    // new[] returns memory aligned for any fundamental type.
+    m_blocks.emplace_back(new char[block_size]);
+    char* block = m_blocks.back().get();
+    if (block_size == size) {
+      m_bytes_allocated += size;
+      return block;
+    }
+    m_next = block;
+    m_available = block_size;
+  }
+  void* ptr = m_next;
+  m_next += size;
+  m_available -= size;
+  m_bytes_allocated += size;
+  return ptr;
+}
+
+Arena::Scope::Scope(Arena& arena) : m_previous(current_arena) {
+  current_arena = &arena;
+}
+
+Arena::Scope::~Scope() { current_arena = m_previous; }
+
+Arena* Arena::current() { return current_arena; }
+
+void* ArenaAllocated::operator new(size_t size) {
+  Arena* arena = current_arena;
+  char* base;
+  if (arena)
+    base = static_cast<char*>(arena->allocate(HEADER_SIZE + size));
+  else
+    base = static_cast<char*>(::operator new(HEADER_SIZE + size));
+  *reinterpret_cast<bool*>(base) = arena != nullptr;
+  return base + HEADER_SIZE;
+}
+
+void ArenaAllocated::operator delete(void* ptr) noexcept {
+  if (!ptr) return;
+  char* base = static_cast<char*>(ptr) - HEADER_SIZE;
+  bool from_arena = *reinterpret_cast<bool*>(base);
+  // Arena memory is released with the arena.
+  if (!from_arena) ::operator delete(base);
+}
@@ -0,0 +1,82 @@
+// Arena allocator
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains a monotonic arena for parsed packet objects.
+
+#pragma once
+
+#include <neopg/utils/common.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace NeoPG {
+
+/// A monotonic memory arena.  Memory is handed out from large blocks and only
+/// released when the arena is destroyed.
+///
+/// While an Arena::Scope is active, all objects derived from ArenaAllocated
+/// (packets, packet headers, key and signature data, materials and
+/// subpackets) that are created on the same thread are allocated from the
+/// arena.  Deleting such an object runs its destructor, but the memory is
+/// only reclaimed with the arena, in one shot.  All objects allocated from an
+/// arena must be destroyed before the arena.
+///
+///     Arena arena;
+///     {
+///       Arena::Scope scope{arena};
+///       parser.process(input);  // sink collects packets into a keyblock
+///     }
+///     // ... use the keyblock, then drop it before the arena.
+class NEOPG_UNSTABLE_API Arena {
+ public:
+  static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+  Arena(size_t block_size = DEFAULT_BLOCK_SIZE);
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  /// Return \p size bytes of memory, aligned for any type.
+  void* allocate(size_t size);
+
+  /// The total number of bytes handed out by allocate.
+  size_t bytes_allocated() const { return m_bytes_allocated; }
+
+  /// Make \p arena the current arena of this thread for the lifetime of
+  /// the scope.  Scopes can be nested.
+  class NEOPG_UNSTABLE_API Scope {
+   public:
+    Scope(Arena& arena);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    Arena* m_previous;
+  };
+
+  /// Return the current arena of this thread, or nullptr.
+  static Arena* current();
+
+ private:
+  size_t m_block_size;
+  std::vector<std::unique_ptr<char[]>> m_blocks;
+  char* m_next{nullptr};
+  size_t m_available{0};
+  size_t m_bytes_allocated{0};
+};
+
+/// Base class for objects that are allocated from the current Arena, if
+/// there is one, and from the heap otherwise.
+struct NEOPG_UNSTABLE_API ArenaAllocated {
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr) noexcept;
+};
+
+}  // namespace NeoPG
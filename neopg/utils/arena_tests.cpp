@@ -0,0 +1,53 @@
+// Arena allocator (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/arena.h>
+
+#include <neopg/openpgp/user_id_packet.h>
+
+#include <neopg/intern/cplusplus.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+
+using namespace NeoPG;
+
+TEST(NeopgUtilsArena, Allocate) {
+  Arena arena{1024};
+  void* a = arena.allocate(1);
+  void* b = arena.allocate(3);
+  ASSERT_NE(a, b);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(b) % alignof(std::max_align_t), 0);
+  // Larger than the block size.
+  ASSERT_NE(arena.allocate(4096), nullptr);
+  ASSERT_GE(arena.bytes_allocated(), 4096 + 4);
+}
+
+TEST(NeopgUtilsArena, Scope) {
+  Arena arena;
+  ASSERT_EQ(Arena::current(), nullptr);
+  {
+    Arena::Scope scope{arena};
+    ASSERT_EQ(Arena::current(), &arena);
+    {
+      Arena inner;
+      Arena::Scope inner_scope{inner};
+      ASSERT_EQ(Arena::current(), &inner);
+    }
+    ASSERT_EQ(Arena::current(), &arena);
+
+    auto packet = NeoPG::make_unique<UserIdPacket>();
+    packet->m_content = "John Doe";
+    ASSERT_GE(arena.bytes_allocated(), sizeof(UserIdPacket));
+  }
+  ASSERT_EQ(Arena::current(), nullptr);
+
+  // Without a scope, packets come from the heap.
+  size_t allocated = arena.bytes_allocated();
+  auto packet = NeoPG::make_unique<UserIdPacket>();
+  ASSERT_EQ(arena.bytes_allocated(), allocated);
+}
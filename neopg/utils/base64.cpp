@@ -0,0 +1,412 @@
+// NeoPG base64 coding (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/base64.h>
+
+#include <neopg/crypto/cpu.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NEOPG_BASE64_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define NEOPG_BASE64_NEON 1
+#include <arm_neon.h>
+#endif
+
+using namespace NeoPG;
+
+namespace {
+
+const char ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+const uint8_t INVALID = 0xff;
+
+struct DecodeTable {
+  uint8_t m_value[256];
+
+  DecodeTable() {
+    std::memset(m_value, INVALID, sizeof(m_value));
+    for (uint8_t i = 0; i < 64; i++)
+      m_value[static_cast<uint8_t>(ALPHABET[i])] = i;
+  }
+};
+
+const DecodeTable& decode_table() {
+  static const DecodeTable table;
+  return table;
+}
+
+// The SIMD kernels process whole blocks and return the number of input
+// bytes (or characters) consumed.  The scalar code handles the rest.  The
+// decode kernels stop at the first block with a character that is not in
+// the alphabet (including padding), so the scalar code can report it.
+
+void encode_scalar(const uint8_t* data, size_t length, char* out) {
+  size_t i = 0;
+  for (; i + 3 <= length; i += 3) {
+    uint32_t val = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    *out++ = ALPHABET[val >> 18];
+    *out++ = ALPHABET[(val >> 12) & 0x3f];
+    *out++ = ALPHABET[(val >> 6) & 0x3f];
+    *out++ = ALPHABET[val & 0x3f];
+  }
+  if (i + 1 == length) {
+    uint32_t val = data[i] << 16;
+    *out++ = ALPHABET[val >> 18];
+    *out++ = ALPHABET[(val >> 12) & 0x3f];
+    *out++ = '=';
+    *out++ = '=';
+  } else if (i + 2 == length) {
+    uint32_t val = (data[i] << 16) | (data[i + 1] << 8);
+    *out++ = ALPHABET[val >> 18];
+    *out++ = ALPHABET[(val >> 12) & 0x3f];
+    *out++ = ALPHABET[(val >> 6) & 0x3f];
+    *out++ = '=';
+  }
+}
+
+size_t decode_scalar(const char* data, size_t length, uint8_t* out) {
+  auto in = reinterpret_cast<const uint8_t*>(data);
+  const uint8_t* table = decode_table().m_value;
+  uint8_t* start = out;
+
+  size_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    uint8_t a = table[in[i]];
+    uint8_t b = table[in[i + 1]];
+    uint8_t c = table[in[i + 2]];
+    uint8_t d = table[in[i + 3]];
+    if ((a | b | c | d) & 0x80) break;
+    uint32_t val = (a << 18) | (b << 12) | (c << 6) | d;
+    *out++ = val >> 16;
+    *out++ = val >> 8;
+    *out++ = val;
+  }
+
+  // The final quantum, which is shorter or padded.
+  size_t rest = length - i;
+  size_t pad = 0;
+  while (pad < 2 && pad < rest && in[length - 1 - pad] == '=') pad++;
+  if (rest > 4) throw std::runtime_error("invalid base64 character");
+  if ((pad && rest != 4) || rest - pad == 1)
+    throw std::runtime_error("invalid base64 length");
+  uint32_t val = 0;
+  for (size_t j = 0; j < rest - pad; j++) {
+    uint8_t v = table[in[i + j]];
+    if (v == INVALID) throw std::runtime_error("invalid base64 character");
+    val |= v << (18 - 6 * j);
+  }
+  if (rest - pad >= 2) *out++ = val >> 16;
+  if (rest - pad == 3) *out++ = val >> 8;
+  return out - start;
+}
+
+#ifdef NEOPG_BASE64_X86
+
+// The x86 kernels follow Wojciech Muła and Daniel Lemire, "Faster Base64
+// Encoding and Decoding Using AVX2 Instructions" (2018).
+
+__attribute__((target("ssse3"))) __m128i encode_lookup_ssse3(__m128i idx) {
+  const __m128i shift = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  __m128i result = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+  __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+  result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+  return _mm_add_epi8(_mm_shuffle_epi8(shift, result), idx);
+}
+
+__attribute__((target("ssse3"))) size_t encode_ssse3(const uint8_t* data,
+                                                     size_t length,
+                                                     char* out) {
+  const __m128i shuffle =
+      _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  size_t i = 0;
+  // Each step reads 16 bytes and encodes 12 of them.
+  for (; i + 16 <= length; i += 12) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    in = _mm_shuffle_epi8(in, shuffle);
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    __m128i chars = encode_lookup_ssse3(_mm_or_si128(t1, t3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), chars);
+    out += 16;
+  }
+  return i;
+}
+
+__attribute__((target("ssse3"))) size_t decode_ssse3(const char* data,
+                                                     size_t length,
+                                                     uint8_t* out) {
+  const __m128i lut_lo =
+      _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                    0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi =
+      _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+                    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll =
+      _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                     -1, -1, -1, -1);
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  // Each step decodes 16 characters and writes 16 bytes, 12 of which are
+  // valid.  Stopping 8 characters early keeps the writes within the output.
+  for (; i + 24 <= length; i += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), nibble);
+    __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(in, nibble));
+    __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    if (_mm_movemask_epi8(
+            _mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+      break;
+    __m128i eq_slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    __m128i roll =
+        _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_slash, hi_nibbles));
+    in = _mm_add_epi8(in, roll);
+    __m128i merged = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    merged = _mm_shuffle_epi8(merged, pack);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), merged);
+    out += 12;
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) __m256i encode_lookup_avx2(__m256i idx) {
+  const __m256i shift = _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  __m256i result = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+  __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+  result =
+      _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+  return _mm256_add_epi8(_mm256_shuffle_epi8(shift, result), idx);
+}
+
+__attribute__((target("avx2"))) size_t encode_avx2(const uint8_t* data,
+                                                   size_t length, char* out) {
+  const __m256i shuffle = _mm256_set_epi8(
+      10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1, 10, 11, 9, 10, 7, 8,
+      6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  size_t i = 0;
+  // Each step reads 28 bytes and encodes 24 of them, 12 per lane.
+  for (; i + 32 <= length; i += 24) {
+    auto src = reinterpret_cast<const __m128i*>(data + i);
+    auto src2 = reinterpret_cast<const __m128i*>(data + i + 12);
+    __m256i in = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(src)), _mm_loadu_si128(src2),
+        1);
+    in = _mm256_shuffle_epi8(in, shuffle);
+    __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    __m256i chars = encode_lookup_avx2(_mm256_or_si256(t1, t3));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), chars);
+    out += 32;
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t decode_avx2(const char* data,
+                                                   size_t length,
+                                                   uint8_t* out) {
+  const __m256i lut_lo = _mm256_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+      0x1b, 0x1b, 0x1b, 0x1a, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m256i lut_hi = _mm256_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 19, 4,
+      -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i pack = _mm256_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5,
+      4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+  // Each step decodes 32 characters and writes 32 bytes, 24 of which are
+  // valid.
+  for (; i + 48 <= length; i += 32) {
+    __m256i in =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), nibble);
+    __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(in, nibble));
+    __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    if (!_mm256_testz_si256(lo, hi)) break;
+    __m256i eq_slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+    __m256i roll =
+        _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_slash, hi_nibbles));
+    in = _mm256_add_epi8(in, roll);
+    __m256i merged = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+    merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    merged = _mm256_shuffle_epi8(merged, pack);
+    merged = _mm256_permutevar8x32_epi32(
+        merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), merged);
+    out += 24;
+  }
+  return i;
+}
+
+#endif
+
+#ifdef NEOPG_BASE64_NEON
+
+size_t encode_neon(const uint8_t* data, size_t length, char* out) {
+  auto alphabet = reinterpret_cast<const uint8_t*>(ALPHABET);
+  const uint8x16x4_t lut = {{vld1q_u8(alphabet), vld1q_u8(alphabet + 16),
+                             vld1q_u8(alphabet + 32),
+                             vld1q_u8(alphabet + 48)}};
+  size_t i = 0;
+  for (; i + 48 <= length; i += 48) {
+    uint8x16x3_t in = vld3q_u8(data + i);
+    uint8x16x4_t idx;
+    idx.val[0] = vshrq_n_u8(in.val[0], 2);
+    idx.val[1] = vandq_u8(
+        vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)),
+        vdupq_n_u8(0x3f));
+    idx.val[2] = vandq_u8(
+        vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)),
+        vdupq_n_u8(0x3f));
+    idx.val[3] = vandq_u8(in.val[2], vdupq_n_u8(0x3f));
+    uint8x16x4_t chars;
+    for (int j = 0; j < 4; j++) chars.val[j] = vqtbl4q_u8(lut, idx.val[j]);
+    vst4q_u8(reinterpret_cast<uint8_t*>(out), chars);
+    out += 64;
+  }
+  return i;
+}
+
+size_t decode_neon(const char* data, size_t length, uint8_t* out) {
+  // Characters 0-63 and 64-127 are looked up in separate tables.  Indices
+  // out of range yield 0, and characters above 127 are caught by their top
+  // bit.
+  const uint8_t* table = decode_table().m_value;
+  const uint8x16x4_t lut_lo = {{vld1q_u8(table), vld1q_u8(table + 16),
+                                vld1q_u8(table + 32), vld1q_u8(table + 48)}};
+  const uint8x16x4_t lut_hi = {{vld1q_u8(table + 64), vld1q_u8(table + 80),
+                                vld1q_u8(table + 96), vld1q_u8(table + 112)}};
+  size_t i = 0;
+  for (; i + 64 <= length; i += 64) {
+    uint8x16x4_t in = vld4q_u8(reinterpret_cast<const uint8_t*>(data + i));
+    uint8x16x4_t val;
+    uint8x16_t error = vdupq_n_u8(0);
+    for (int j = 0; j < 4; j++) {
+      val.val[j] =
+          vorrq_u8(vqtbl4q_u8(lut_lo, in.val[j]),
+                   vqtbl4q_u8(lut_hi, vsubq_u8(in.val[j], vdupq_n_u8(64))));
+      error = vorrq_u8(error, vorrq_u8(val.val[j], in.val[j]));
+    }
+    if (vmaxvq_u8(error) & 0x80) break;
+    uint8x16x3_t bytes;
+    bytes.val[0] =
+        vorrq_u8(vshlq_n_u8(val.val[0], 2), vshrq_n_u8(val.val[1], 4));
+    bytes.val[1] =
+        vorrq_u8(vshlq_n_u8(val.val[1], 4), vshrq_n_u8(val.val[2], 2));
+    bytes.val[2] = vorrq_u8(vshlq_n_u8(val.val[2], 6), val.val[3]);
+    vst3q_u8(out, bytes);
+    out += 48;
+  }
+  return i;
+}
+
+#endif
+
+bool supported(Base64Kernel kernel) {
+  switch (kernel) {
+    case Base64Kernel::Scalar:
+      return true;
+#ifdef NEOPG_BASE64_X86
+    case Base64Kernel::SSSE3:
+      return cpu_supports(CpuFeature::SSSE3);
+    case Base64Kernel::AVX2:
+      return cpu_supports(CpuFeature::AVX2);
+#endif
+#ifdef NEOPG_BASE64_NEON
+    case Base64Kernel::NEON:
+      return cpu_supports(CpuFeature::NEON);
+#endif
+    default:
+      return false;
+  }
+}
+
+Base64Kernel& current_kernel() {
+  static Base64Kernel kernel = supported(Base64Kernel::AVX2)
+                                   ? Base64Kernel::AVX2
+                                   : supported(Base64Kernel::SSSE3)
+                                         ? Base64Kernel::SSSE3
+                                         : supported(Base64Kernel::NEON)
+                                               ? Base64Kernel::NEON
+                                               : Base64Kernel::Scalar;
+  return kernel;
+}
+
+}  // namespace
+
+void NeoPG::base64_encode(const uint8_t* data, size_t length, char* out) {
+  size_t done = 0;
+  switch (current_kernel()) {
+#ifdef NEOPG_BASE64_X86
+    case Base64Kernel::SSSE3:
+      done = encode_ssse3(data, length, out);
+      break;
+    case Base64Kernel::AVX2:
+      done = encode_avx2(data, length, out);
+      break;
+#endif
+#ifdef NEOPG_BASE64_NEON
+    case Base64Kernel::NEON:
+      done = encode_neon(data, length, out);
+      break;
+#endif
+    default:
+      break;
+  }
+  encode_scalar(data + done, length - done, out + done / 3 * 4);
+}
+
+size_t NeoPG::base64_decode(const char* data, size_t length, uint8_t* out) {
+  size_t done = 0;
+  switch (current_kernel()) {
+#ifdef NEOPG_BASE64_X86
+    case Base64Kernel::SSSE3:
+      done = decode_ssse3(data, length, out);
+      break;
+    case Base64Kernel::AVX2:
+      done = decode_avx2(data, length, out);
+      break;
+#endif
+#ifdef NEOPG_BASE64_NEON
+    case Base64Kernel::NEON:
+      done = decode_neon(data, length, out);
+      break;
+#endif
+    default:
+      break;
+  }
+  return done / 4 * 3 +
+         decode_scalar(data + done, length - done, out + done / 4 * 3);
+}
+
+Base64Kernel NeoPG::base64_kernel() { return current_kernel(); }
+
+bool NeoPG::base64_set_kernel(Base64Kernel kernel) {
+  if (!supported(kernel)) return false;
+  current_kernel() = kernel;
+  return true;
+}
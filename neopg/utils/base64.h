@@ -0,0 +1,59 @@
+// NeoPG base64 coding
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains base64 encoding and decoding (RFC 4648) of whole
+/// buffers, with SIMD kernels where the CPU supports them.
+
+#pragma once
+
+#include <neopg/utils/common.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace NeoPG {
+
+/// The implementations of the base64 functions.  The best kernel supported
+/// by the CPU is selected at runtime.
+enum class Base64Kernel { Scalar, SSSE3, AVX2, NEON };
+
+/// \return the number of characters of the padded encoding of \p length
+/// bytes
+inline size_t base64_encoded_size(size_t length) {
+  return (length + 2) / 3 * 4;
+}
+
+/// \return an upper bound for the number of bytes encoded by \p length
+/// characters
+inline size_t base64_decoded_size(size_t length) {
+  return (length + 3) / 4 * 3;
+}
+
+/// Encode \p length bytes at \p data, with padding, and write
+/// base64_encoded_size(length) characters (without line breaks) to \p out.
+NEOPG_UNSTABLE_API void base64_encode(const uint8_t* data, size_t length,
+                                      char* out);
+
+/// Decode \p length characters at \p data, which must not contain
+/// whitespace, to \p out, which must have room for
+/// base64_decoded_size(length) bytes.  Padding is optional, but only allowed
+/// at the end.
+///
+/// \return the number of bytes written
+/// \throws std::runtime_error if the input is not valid base64
+NEOPG_UNSTABLE_API size_t base64_decode(const char* data, size_t length,
+                                        uint8_t* out);
+
+/// \return the kernel used by base64_encode and base64_decode
+NEOPG_TEST_API Base64Kernel base64_kernel();
+
+/// Use \p kernel for base64_encode and base64_decode.  This is not
+/// synchronized, and only meant for tests and benchmarks.
+///
+/// \return false if the CPU does not support \p kernel
+NEOPG_TEST_API bool base64_set_kernel(Base64Kernel kernel);
+
+}  // namespace NeoPG
@@ -0,0 +1,99 @@
+// NeoPG base64 coding (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/base64.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace NeoPG;
+
+namespace {
+
+std::string encode(const std::string& data) {
+  std::string out(base64_encoded_size(data.size()), '\0');
+  base64_encode(reinterpret_cast<const uint8_t*>(data.data()), data.size(),
+                &out[0]);
+  return out;
+}
+
+std::string decode(const std::string& data) {
+  std::vector<uint8_t> out(base64_decoded_size(data.size()));
+  size_t length = base64_decode(data.data(), data.size(), out.data());
+  return std::string(out.begin(), out.begin() + length);
+}
+
+const std::vector<Base64Kernel> kernels{
+    Base64Kernel::Scalar, Base64Kernel::SSSE3, Base64Kernel::AVX2,
+    Base64Kernel::NEON};
+
+}  // namespace
+
+TEST(NeopgUtilsBase64, Vectors) {
+  // RFC 4648, section 10.
+  ASSERT_EQ(encode(""), "");
+  ASSERT_EQ(encode("f"), "Zg==");
+  ASSERT_EQ(encode("fo"), "Zm8=");
+  ASSERT_EQ(encode("foo"), "Zm9v");
+  ASSERT_EQ(encode("foob"), "Zm9vYg==");
+  ASSERT_EQ(encode("fooba"), "Zm9vYmE=");
+  ASSERT_EQ(encode("foobar"), "Zm9vYmFy");
+
+  ASSERT_EQ(decode(""), "");
+  ASSERT_EQ(decode("Zg=="), "f");
+  ASSERT_EQ(decode("Zm8="), "fo");
+  ASSERT_EQ(decode("Zm9vYmFy"), "foobar");
+
+  // Padding is optional.
+  ASSERT_EQ(decode("Zg"), "f");
+  ASSERT_EQ(decode("Zm9vYmE"), "fooba");
+}
+
+TEST(NeopgUtilsBase64, Invalid) {
+  ASSERT_THROW(decode("Z"), std::runtime_error);
+  ASSERT_THROW(decode("Zg="), std::runtime_error);
+  ASSERT_THROW(decode("Z==="), std::runtime_error);
+  ASSERT_THROW(decode("Zg==Zm8="), std::runtime_error);
+  ASSERT_THROW(decode("Zm9v Zm9v"), std::runtime_error);
+  ASSERT_THROW(decode("Zm9-"), std::runtime_error);
+}
+
+TEST(NeopgUtilsBase64, Kernels) {
+  const auto original = base64_kernel();
+
+  std::string data;
+  for (size_t i = 0; i < 1000; i++)
+    data += static_cast<char>((i * 7919) >> 3);
+
+  ASSERT_EQ(base64_set_kernel(Base64Kernel::Scalar), true);
+  std::vector<std::string> expected;
+  for (size_t len = 0; len < 300; len++)
+    expected.push_back(encode(data.substr(0, len)));
+
+  for (auto kernel : kernels) {
+    if (!base64_set_kernel(kernel)) continue;
+    for (size_t len = 0; len < 300; len++) {
+      ASSERT_EQ(encode(data.substr(0, len)), expected[len]);
+      ASSERT_EQ(decode(expected[len]), data.substr(0, len));
+    }
+
+    // Invalid characters are found at every position, including those
+    // handled by the SIMD kernels.
+    const std::string valid = encode(data);
+    for (size_t pos = 0; pos < 200; pos++) {
+      for (char bad : {'=', '-', ' ', '\x80', '\0'}) {
+        std::string invalid = valid;
+        invalid[pos] = bad;
+        ASSERT_THROW(decode(invalid), std::runtime_error);
+      }
+    }
+  }
+
+  base64_set_kernel(original);
+}
@@ -0,0 +1,27 @@
+// NeoPG byte writer (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/byte_writer.h>
+
+#include <ostream>
+
+namespace NeoPG {
+
+const size_t ByteWriter::SINK_BLOCK_SIZE;
+
+void ByteWriter::flush() {
+  if (!m_sink || m_buffer.empty()) return;
+  m_sink->write(m_buffer.data(), m_buffer.size());
+  m_flushed += m_buffer.size();
+  m_buffer.clear();
+}
+
+void ByteWriter::write_through(const void* data, size_t length) {
+  flush();
+  m_sink->write(static_cast<const char*>(data), length);
+  m_flushed += length;
+}
+
+}  // namespace NeoPG
@@ -0,0 +1,125 @@
+// NeoPG byte writer
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains the output buffer used for packet serialization.
+
+#pragma once
+
+#include <neopg/utils/common.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+namespace NeoPG {
+
+/// A growable, contiguous output buffer.  All serialization functions write
+/// to a ByteWriter.  In contrast to std::ostream, the output functions are
+/// inline and append to the buffer directly, without a virtual call or
+/// sentry object per field.
+///
+/// A ByteWriter either owns its buffer, or appends to a std::string owned by
+/// the caller (which can then be reserved in advance), or passes its output
+/// on to a std::ostream, or only counts the bytes written to it.
+class NEOPG_UNSTABLE_API ByteWriter {
+ public:
+  /// Create a writer with its own buffer, see str().
+  ByteWriter() : m_out(&m_buffer) {}
+
+  /// Create a writer that appends to \p out.
+  explicit ByteWriter(std::string& out) : m_out(&out), m_start(out.size()) {}
+
+  /// Create a writer that discards its output and only counts it.  This is
+  /// used to compute the length of a packet body without serializing it.
+  explicit ByteWriter(std::nullptr_t) : m_out(nullptr) {}
+
+  /// Create a writer that passes its output on to \p sink.  The output is
+  /// buffered and written to \p sink in large blocks, and when the writer is
+  /// flushed or destroyed.
+  explicit ByteWriter(std::ostream& sink) : m_out(&m_buffer), m_sink(&sink) {}
+
+  ByteWriter(const ByteWriter&) = delete;
+  ByteWriter& operator=(const ByteWriter&) = delete;
+
+  ~ByteWriter() { flush(); }
+
+  void put_u8(uint8_t val) {
+    if (m_out)
+      m_out->push_back(static_cast<char>(val));
+    else
+      m_count++;
+  }
+
+  void put_u16be(uint16_t val) {
+    const char buf[2] = {static_cast<char>(val >> 8), static_cast<char>(val)};
+    put_bytes(buf, sizeof(buf));
+  }
+
+  void put_u32be(uint32_t val) {
+    const char buf[4] = {static_cast<char>(val >> 24),
+                         static_cast<char>(val >> 16),
+                         static_cast<char>(val >> 8), static_cast<char>(val)};
+    put_bytes(buf, sizeof(buf));
+  }
+
+  void put_bytes(const void* data, size_t length) {
+    if (m_out) {
+      if (m_sink && length >= SINK_BLOCK_SIZE) {
+        write_through(data, length);
+        return;
+      }
+      m_out->append(static_cast<const char*>(data), length);
+      if (m_sink && m_buffer.size() >= SINK_BLOCK_SIZE) flush();
+    } else
+      m_count += length;
+  }
+
+  void put_bytes(const std::string& data) {
+    put_bytes(data.data(), data.size());
+  }
+
+  /// Make room for \p length more bytes.
+  void reserve(size_t length) {
+    if (m_out) m_out->reserve(m_out->size() + length);
+  }
+
+  /// \return true if this writer only counts its output
+  bool counting() const noexcept { return !m_out; }
+
+  /// \return the number of bytes written to this writer.
+  size_t size() const {
+    return m_out ? m_out->size() - m_start + m_flushed : m_count;
+  }
+
+  /// \return the bytes written to this writer.  Not available for counting
+  /// writers and writers that pass their output to a std::ostream.
+  const std::string& str() const {
+    assert(m_out && !m_sink);
+    return *m_out;
+  }
+
+  /// Write the buffered output to the std::ostream, if any.
+  void flush();
+
+ private:
+  /// The buffer size at which output is passed to the std::ostream.
+  static const size_t SINK_BLOCK_SIZE = 64 * 1024;
+
+  /// Flush the buffer and write \p data directly to the std::ostream.  This
+  /// avoids copying large blocks through the buffer.
+  void write_through(const void* data, size_t length);
+
+  std::string m_buffer;
+  std::string* m_out;
+  size_t m_start{0};
+  size_t m_count{0};
+  std::ostream* m_sink{nullptr};
+  size_t m_flushed{0};
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,59 @@
+// NeoPG byte writer (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/byte_writer.h>
+
+#include "gtest/gtest.h"
+
+#include <sstream>
+#include <string>
+
+using namespace NeoPG;
+
+TEST(NeopgTest, utils_byte_writer_test) {
+  {
+    ByteWriter out;
+    out.put_u8(0x01);
+    out.put_u16be(0x0203);
+    out.put_u32be(0x04050607);
+    out.put_bytes("\x08\x09", 2);
+    out.put_bytes(std::string("\x0a"));
+    ASSERT_EQ(out.size(), 10);
+    ASSERT_EQ(out.str(),
+              std::string("\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a"));
+  }
+
+  {
+    // Appending to a caller's string.
+    std::string buffer{"abc"};
+    ByteWriter out{buffer};
+    out.put_bytes("def", 3);
+    ASSERT_EQ(out.size(), 3);
+    ASSERT_EQ(buffer, "abcdef");
+  }
+
+  {
+    // Counting only.
+    ByteWriter out{nullptr};
+    out.put_u8(0x01);
+    out.put_u32be(0x02030405);
+    out.put_bytes(std::string(1000, 'x'));
+    ASSERT_EQ(out.size(), 1005);
+  }
+
+  {
+    // Passing the output on to a stream, across block boundaries.
+    std::stringstream sink;
+    const std::string data(100000, 'y');
+    {
+      ByteWriter out{sink};
+      out.put_u8('x');
+      out.put_bytes(data);
+      out.put_bytes(data);
+      ASSERT_EQ(out.size(), 200001);
+    }
+    ASSERT_EQ(sink.str(), "x" + data + data);
+  }
+}
@@ -0,0 +1,164 @@
+// NeoPG hex coding (implementation)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/hex.h>
+
+#include <neopg/crypto/cpu.h>
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NEOPG_HEX_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define NEOPG_HEX_NEON 1
+#include <arm_neon.h>
+#endif
+
+using namespace NeoPG;
+
+namespace {
+
+const char LOWER[] = "0123456789abcdef";
+const char UPPER[] = "0123456789ABCDEF";
+
+// The two digits of every byte, so the scalar code needs one lookup (and
+// one two-byte store) per byte.
+struct PairTable {
+  char m_lower[512];
+  char m_upper[512];
+
+  PairTable() {
+    for (int i = 0; i < 256; i++) {
+      m_lower[2 * i] = LOWER[i >> 4];
+      m_lower[2 * i + 1] = LOWER[i & 15];
+      m_upper[2 * i] = UPPER[i >> 4];
+      m_upper[2 * i + 1] = UPPER[i & 15];
+    }
+  }
+};
+
+const PairTable& pair_table() {
+  static const PairTable table;
+  return table;
+}
+
+void encode_scalar(const uint8_t* data, size_t length, char* out,
+                   bool uppercase) {
+  const char* pairs =
+      uppercase ? pair_table().m_upper : pair_table().m_lower;
+  for (size_t i = 0; i < length; i++)
+    std::memcpy(out + 2 * i, pairs + 2 * data[i], 2);
+}
+
+// The SIMD kernels process blocks of 16 bytes and return the number of
+// bytes consumed.  The scalar code handles the rest.
+
+#ifdef NEOPG_HEX_X86
+
+__attribute__((target("ssse3"))) size_t encode_ssse3(const uint8_t* data,
+                                                     size_t length, char* out,
+                                                     bool uppercase) {
+  const __m128i digits = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(uppercase ? UPPER : LOWER));
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    __m128i hi = _mm_shuffle_epi8(
+        digits, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+    __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, mask));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i),
+                     _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16),
+                     _mm_unpackhi_epi8(hi, lo));
+  }
+  return i;
+}
+
+#endif
+
+#ifdef NEOPG_HEX_NEON
+
+size_t encode_neon(const uint8_t* data, size_t length, char* out,
+                   bool uppercase) {
+  const uint8x16_t digits =
+      vld1q_u8(reinterpret_cast<const uint8_t*>(uppercase ? UPPER : LOWER));
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    uint8x16_t in = vld1q_u8(data + i);
+    uint8x16x2_t pairs;
+    pairs.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(in, 4));
+    pairs.val[1] = vqtbl1q_u8(digits, vandq_u8(in, vdupq_n_u8(0x0f)));
+    // The interleaving store writes the two digits of each byte in order.
+    vst2q_u8(reinterpret_cast<uint8_t*>(out + 2 * i), pairs);
+  }
+  return i;
+}
+
+#endif
+
+bool supported(HexKernel kernel) {
+  switch (kernel) {
+    case HexKernel::Scalar:
+      return true;
+#ifdef NEOPG_HEX_X86
+    case HexKernel::SSSE3:
+      return cpu_supports(CpuFeature::SSSE3);
+#endif
+#ifdef NEOPG_HEX_NEON
+    case HexKernel::NEON:
+      return cpu_supports(CpuFeature::NEON);
+#endif
+    default:
+      return false;
+  }
+}
+
+HexKernel& current_kernel() {
+  static HexKernel kernel = supported(HexKernel::SSSE3)
+                                ? HexKernel::SSSE3
+                                : supported(HexKernel::NEON)
+                                      ? HexKernel::NEON
+                                      : HexKernel::Scalar;
+  return kernel;
+}
+
+}  // namespace
+
+void NeoPG::hex_encode(const uint8_t* data, size_t length, char* out,
+                       bool uppercase) {
+  size_t done = 0;
+  switch (current_kernel()) {
+#ifdef NEOPG_HEX_X86
+    case HexKernel::SSSE3:
+      done = encode_ssse3(data, length, out, uppercase);
+      break;
+#endif
+#ifdef NEOPG_HEX_NEON
+    case HexKernel::NEON:
+      done = encode_neon(data, length, out, uppercase);
+      break;
+#endif
+    default:
+      break;
+  }
+  encode_scalar(data + done, length - done, out + 2 * done, uppercase);
+}
+
+void NeoPG::hex_append(std::string& buffer, const uint8_t* data,
+                       size_t length, bool uppercase) {
+  const size_t start = buffer.size();
+  buffer.resize(start + 2 * length);
+  if (length) hex_encode(data, length, &buffer[start], uppercase);
+}
+
+HexKernel NeoPG::hex_kernel() { return current_kernel(); }
+
+bool NeoPG::hex_set_kernel(HexKernel kernel) {
+  if (!supported(kernel)) return false;
+  current_kernel() = kernel;
+  return true;
+}
@@ -0,0 +1,51 @@
+// NeoPG hex coding
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains hex encoding of whole buffers, with SIMD kernels where
+/// the CPU supports them.
+
+#pragma once
+
+#include <neopg/utils/common.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace NeoPG {
+
+/// The implementations of the hex functions.  The best kernel supported by
+/// the CPU is selected at runtime.
+enum class HexKernel { Scalar, SSSE3, NEON };
+
+/// Encode \p length bytes at \p data and write 2 * length hex digits to
+/// \p out.
+NEOPG_UNSTABLE_API void hex_encode(const uint8_t* data, size_t length,
+                                   char* out, bool uppercase = true);
+
+/// Append the hex encoding of \p length bytes at \p data to \p buffer.
+/// Reusing the buffer avoids an allocation for every call.
+NEOPG_UNSTABLE_API void hex_append(std::string& buffer, const uint8_t* data,
+                                   size_t length, bool uppercase = true);
+
+/// \return the hex encoding of \p length bytes at \p data
+inline std::string hex_encode(const uint8_t* data, size_t length,
+                              bool uppercase = true) {
+  std::string result;
+  hex_append(result, data, length, uppercase);
+  return result;
+}
+
+/// \return the kernel used by hex_encode
+NEOPG_TEST_API HexKernel hex_kernel();
+
+/// Use \p kernel for hex_encode.  This is not synchronized, and only meant
+/// for tests and benchmarks.
+///
+/// \return false if the CPU does not support \p kernel
+NEOPG_TEST_API bool hex_set_kernel(HexKernel kernel);
+
+}  // namespace NeoPG
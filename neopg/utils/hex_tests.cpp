@@ -0,0 +1,68 @@
+// NeoPG hex coding (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/hex.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace NeoPG;
+
+namespace {
+
+std::string encode(const std::string& data, bool uppercase = true) {
+  return hex_encode(reinterpret_cast<const uint8_t*>(data.data()),
+                    data.size(), uppercase);
+}
+
+std::string naive(const std::string& data, bool uppercase) {
+  const char* digits = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
+  std::string result;
+  for (unsigned char c : data) {
+    result += digits[c >> 4];
+    result += digits[c & 15];
+  }
+  return result;
+}
+
+const std::vector<HexKernel> kernels{HexKernel::Scalar, HexKernel::SSSE3,
+                                     HexKernel::NEON};
+
+}  // namespace
+
+TEST(NeopgUtilsHex, Encode) {
+  ASSERT_EQ(encode(""), "");
+  ASSERT_EQ(encode("\x01\xab\xff"), "01ABFF");
+  ASSERT_EQ(encode("\x01\xab\xff", false), "01abff");
+
+  // hex_append appends to the buffer.
+  std::string buffer{"x"};
+  const uint8_t data[] = {0xde, 0xad};
+  hex_append(buffer, data, sizeof(data), false);
+  hex_append(buffer, data, 0);
+  ASSERT_EQ(buffer, "xdead");
+}
+
+TEST(NeopgUtilsHex, Kernels) {
+  const auto original = hex_kernel();
+
+  std::string data;
+  for (size_t i = 0; i < 300; i++)
+    data += static_cast<char>((i * 7919) >> 3);
+
+  for (auto kernel : kernels) {
+    if (!hex_set_kernel(kernel)) continue;
+    for (size_t len = 0; len < data.size(); len++) {
+      ASSERT_EQ(encode(data.substr(0, len)), naive(data.substr(0, len), true));
+      ASSERT_EQ(encode(data.substr(0, len), false),
+                naive(data.substr(0, len), false));
+    }
+  }
+
+  hex_set_kernel(original);
+}
@@ -0,0 +1,93 @@
+// NeoPG mapped file (implementation)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/mapped_file.h>
+
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace NeoPG;
+
+const uint64_t MappedFile::WHOLE_FILE;
+
+namespace {
+std::runtime_error open_error(const std::string& path) {
+  return std::runtime_error("MappedFile: Failure opening file " + path);
+}
+
+std::runtime_error short_error(const std::string& path) {
+  return std::runtime_error("MappedFile: File too short " + path);
+}
+}  // namespace
+
+#ifndef _WIN32
+
+std::unique_ptr<MappedFile> MappedFile::open_or_throw(const std::string& path,
+                                                      uint64_t length) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw open_error(path);
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw open_error(path);
+  }
+  uint64_t size = st.st_size;
+  if (length == WHOLE_FILE) length = size;
+  if (length > size) {
+    ::close(fd);
+    throw short_error(path);
+  }
+
+  std::unique_ptr<MappedFile> file{new MappedFile};
+  // Empty mappings are not allowed.
+  if (length > 0) {
+    void* data = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      ::close(fd);
+      throw open_error(path);
+    }
+    file->m_data = static_cast<const char*>(data);
+    file->m_size = length;
+    file->m_mapped = true;
+  }
+  // The mapping keeps the file open.
+  ::close(fd);
+  return file;
+}
+
+MappedFile::~MappedFile() {
+  if (m_mapped) ::munmap(const_cast<char*>(m_data), m_size);
+}
+
+#else
+
+std::unique_ptr<MappedFile> MappedFile::open_or_throw(const std::string& path,
+                                                      uint64_t length) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) throw open_error(path);
+  uint64_t size = in.tellg();
+  if (length == WHOLE_FILE) length = size;
+  if (length > size) throw short_error(path);
+
+  std::unique_ptr<MappedFile> file{new MappedFile};
+  file->m_buffer.resize(length);
+  in.seekg(0);
+  if (!in.read(&file->m_buffer[0], length)) throw open_error(path);
+  file->m_data = file->m_buffer.data();
+  file->m_size = length;
+  return file;
+}
+
+MappedFile::~MappedFile() {}
+
+#endif
@@ -0,0 +1,56 @@
+// NeoPG mapped file
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains read-only access to files in memory.
+
+#pragma once
+
+#include <neopg/utils/common.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace NeoPG {
+
+/// A read-only view of (the beginning of) a file in memory.  The file is
+/// mapped where supported, so the pages are shared with the page cache and
+/// other processes, and read into memory otherwise.
+///
+/// A mapping stays valid if the file is appended to, renamed or removed
+/// (where the platform allows that) while it is mapped.
+class NEOPG_UNSTABLE_API MappedFile {
+ public:
+  /// Map the whole file.
+  static const uint64_t WHOLE_FILE = ~uint64_t{0};
+
+  /// Map the first \p length bytes of the file at \p path.
+  ///
+  /// \throws std::runtime_error if the file can not be opened, or is
+  /// shorter than \p length
+  static std::unique_ptr<MappedFile> open_or_throw(
+      const std::string& path, uint64_t length = WHOLE_FILE);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  const char* data() const noexcept { return m_data; }
+  size_t size() const noexcept { return m_size; }
+
+ private:
+  MappedFile() = default;
+
+  const char* m_data{nullptr};
+  size_t m_size{0};
+
+  // True if m_data is mapped, otherwise it points into m_buffer.
+  bool m_mapped{false};
+  std::string m_buffer;
+};
+
+}  // namespace NeoPG
@@ -0,0 +1,44 @@
+// NeoPG mapped file (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/mapped_file.h>
+
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+using namespace NeoPG;
+
+TEST(NeopgTest, utils_mapped_file_test) {
+  const std::string path = "neopg-mapped-file-test.tmp";
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << "hello world";
+  }
+
+  {
+    auto file = MappedFile::open_or_throw(path);
+    ASSERT_EQ(std::string(file->data(), file->size()), "hello world");
+
+    // Appending to the file does not change the mapping.
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    out << "!";
+    out.close();
+    ASSERT_EQ(std::string(file->data(), file->size()), "hello world");
+  }
+
+  {
+    auto file = MappedFile::open_or_throw(path, 5);
+    ASSERT_EQ(std::string(file->data(), file->size()), "hello");
+    ASSERT_EQ(MappedFile::open_or_throw(path, 0)->size(), 0);
+  }
+
+  ASSERT_THROW(MappedFile::open_or_throw(path, 100), std::runtime_error);
+  std::remove(path.c_str());
+  ASSERT_THROW(MappedFile::open_or_throw(path), std::runtime_error);
+}
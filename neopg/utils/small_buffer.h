@@ -0,0 +1,173 @@
+// NeoPG small byte buffer
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains a byte buffer with inline storage for small values.
+
+#pragma once
+
+#include <neopg/utils/common.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+namespace NeoPG {
+
+/// A byte buffer that stores up to \p N bytes inline, and larger values on
+/// the heap.  Alternatively, the buffer can borrow external data without
+/// copying it, in which case the caller must keep the data alive for as long
+/// as the buffer (and any copy of it) is used.
+template <size_t N>
+class SmallBuffer {
+ public:
+  /// The number of bytes that are stored without allocation.
+  static const size_t INLINE_SIZE = N;
+
+  SmallBuffer() = default;
+
+  SmallBuffer(const std::vector<uint8_t>& data) {
+    assign(data.data(), data.data() + data.size());
+  }
+
+  SmallBuffer(const SmallBuffer& other) { *this = other; }
+
+  SmallBuffer(SmallBuffer&& other) noexcept { *this = std::move(other); }
+
+  SmallBuffer& operator=(const SmallBuffer& other) {
+    if (this == &other) return *this;
+    if (other.borrowed())
+      borrow(other.m_data, other.m_size);
+    else
+      assign(other.begin(), other.end());
+    return *this;
+  }
+
+  SmallBuffer& operator=(SmallBuffer&& other) noexcept {
+    if (this == &other) return *this;
+    if (other.m_heap) {
+      m_heap = std::move(other.m_heap);
+      m_capacity = other.m_capacity;
+      m_data = m_heap.get();
+      m_size = other.m_size;
+    } else if (other.borrowed()) {
+      m_heap.reset();
+      m_data = other.m_data;
+      m_size = other.m_size;
+    } else {
+      m_heap.reset();
+      if (other.m_size) std::memcpy(m_inline, other.m_inline, other.m_size);
+      m_data = m_inline;
+      m_size = other.m_size;
+    }
+    other.clear();
+    return *this;
+  }
+
+  SmallBuffer& operator=(const std::vector<uint8_t>& data) {
+    assign(data.data(), data.data() + data.size());
+    return *this;
+  }
+
+  /// Copy the bytes in [\p begin, \p end) into the buffer.
+  void assign(const uint8_t* begin, const uint8_t* end) {
+    // BEGIN may point into our own storage, so release it only after copying.
+    size_t size = end - begin;
+    if (size <= N) {
+      if (size) std::memmove(m_inline, begin, size);
+      m_heap.reset();
+      m_data = m_inline;
+    } else if (m_heap && size <= m_capacity) {
+      std::memmove(m_heap.get(), begin, size);
+      m_data = m_heap.get();
+    } else {
+      std::unique_ptr<uint8_t[]> heap{new uint8_t[size]};
+      std::memcpy(heap.get(), begin, size);
+      m_heap = std::move(heap);
+      m_capacity = size;
+      m_data = m_heap.get();
+    }
+    m_size = size;
+  }
+
+  void assign(std::initializer_list<uint8_t> data) {
+    assign(data.begin(), data.end());
+  }
+
+  /// Refer to the \p size bytes at \p data without copying them.
+  void borrow(const uint8_t* data, size_t size) noexcept {
+    if (!data) {
+      clear();
+      return;
+    }
+    m_heap.reset();
+    m_data = const_cast<uint8_t*>(data);
+    m_size = size;
+  }
+
+  /// \return true if the buffer refers to external data
+  bool borrowed() const noexcept {
+    return m_data != m_inline && m_data != m_heap.get();
+  }
+
+  /// Make sure that the buffer owns its data.
+  void own() {
+    if (borrowed()) assign(m_data, m_data + m_size);
+  }
+
+  void clear() noexcept {
+    m_heap.reset();
+    m_data = m_inline;
+    m_size = 0;
+  }
+
+  const uint8_t* data() const noexcept { return m_data; }
+  size_t size() const noexcept { return m_size; }
+  bool empty() const noexcept { return m_size == 0; }
+  const uint8_t* begin() const noexcept { return m_data; }
+  const uint8_t* end() const noexcept { return m_data + m_size; }
+  uint8_t operator[](size_t i) const noexcept { return m_data[i]; }
+
+  /// \return a copy of the data
+  std::vector<uint8_t> to_vector() const {
+    return std::vector<uint8_t>(begin(), end());
+  }
+
+ private:
+  uint8_t m_inline[N];
+  std::unique_ptr<uint8_t[]> m_heap;
+  size_t m_capacity{0};
+  uint8_t* m_data{m_inline};
+  size_t m_size{0};
+};
+
+template <size_t N>
+inline bool operator==(const SmallBuffer<N>& lhs, const SmallBuffer<N>& rhs) {
+  return lhs.size() == rhs.size() &&
+         std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template <size_t N>
+inline bool operator==(const SmallBuffer<N>& lhs,
+                       const std::vector<uint8_t>& rhs) {
+  return lhs.size() == rhs.size() &&
+         std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template <size_t N>
+inline bool operator==(const std::vector<uint8_t>& lhs,
+                       const SmallBuffer<N>& rhs) {
+  return rhs == lhs;
+}
+
+template <size_t N>
+inline bool operator!=(const SmallBuffer<N>& lhs, const SmallBuffer<N>& rhs) {
+  return !(lhs == rhs);
+}
+
+}  // namespace NeoPG
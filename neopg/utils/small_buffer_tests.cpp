@@ -0,0 +1,65 @@
+// NeoPG small byte buffer (tests)
+// Copyright 2017-2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/small_buffer.h>
+
+#include "gtest/gtest.h"
+
+#include <utility>
+#include <vector>
+
+using namespace NeoPG;
+
+TEST(NeopgTest, utils_small_buffer_test) {
+  const std::vector<uint8_t> small(4, 0x11);
+  const std::vector<uint8_t> large(100, 0x22);
+
+  SmallBuffer<8> buf;
+  ASSERT_TRUE(buf.empty());
+  ASSERT_FALSE(buf.borrowed());
+
+  buf = small;
+  ASSERT_EQ(buf, small);
+  buf = large;
+  ASSERT_EQ(buf, large);
+  buf = small;
+  ASSERT_EQ(buf, small);
+
+  // Assigning from our own storage.
+  buf = large;
+  buf.assign(buf.begin() + 10, buf.end());
+  ASSERT_EQ(buf.to_vector(), std::vector<uint8_t>(90, 0x22));
+  buf.assign(buf.begin() + 85, buf.end());
+  ASSERT_EQ(buf.to_vector(), std::vector<uint8_t>(5, 0x22));
+
+  // Copy and move.
+  SmallBuffer<8> copy{buf};
+  ASSERT_EQ(copy, buf);
+  SmallBuffer<8> moved{std::move(copy)};
+  ASSERT_EQ(moved, buf);
+  ASSERT_TRUE(copy.empty());
+
+  SmallBuffer<8> heap{large};
+  SmallBuffer<8> heap_moved{std::move(heap)};
+  ASSERT_EQ(heap_moved, large);
+}
+
+TEST(NeopgTest, utils_small_buffer_borrow_test) {
+  std::vector<uint8_t> data(100, 0x33);
+  SmallBuffer<8> buf;
+  buf.borrow(data.data(), data.size());
+  ASSERT_TRUE(buf.borrowed());
+  ASSERT_EQ(buf.data(), data.data());
+
+  // Copies borrow as well.
+  SmallBuffer<8> copy{buf};
+  ASSERT_TRUE(copy.borrowed());
+
+  buf.own();
+  ASSERT_FALSE(buf.borrowed());
+  data[0] = 0x00;
+  ASSERT_EQ(buf[0], 0x33);
+  ASSERT_EQ(copy[0], 0x00);
+}
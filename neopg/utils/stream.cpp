@@ -29,4 +29,22 @@ uint32_t CountingStream::bytes_written() {
   return m_counting_stream_buf.bytes_written();
 }
 
+std::streamsize BufferStreamBuf::xsputn(const char_type* s, std::streamsize n) {
+  m_buffer.append(s, n);
+  return n;
+}
+
+BufferStreamBuf::int_type BufferStreamBuf::overflow(
+    BufferStreamBuf::int_type ch) {
+  if (traits_type::eq_int_type(ch, traits_type::eof()))
+    return traits_type::not_eof(ch);
+  m_buffer.push_back(traits_type::to_char_type(ch));
+  return ch;
+}
+
+BufferStream::BufferStream(std::string& buffer)
+    : std::ios(0),
+      std::ostream(&m_buffer_stream_buf),
+      m_buffer_stream_buf(buffer) {}
+
 }  // namespace NeoPG
@@ -8,6 +8,7 @@
 #include <neopg/utils/common.h>
 #include <iostream>
 #include <streambuf>
+#include <string>
 
 namespace NeoPG {
 
@@ -32,4 +33,27 @@ class NEOPG_UNSTABLE_API CountingStream : public std::ostream {
   CountingStreamBuf m_counting_stream_buf;
 };
 
+class NEOPG_UNSTABLE_API BufferStreamBuf : public std::streambuf {
+ public:
+  BufferStreamBuf(std::string& buffer) : m_buffer(buffer) {}
+
+ protected:
+  std::streamsize xsputn(const char_type* s, std::streamsize n) override;
+  int_type overflow(int_type ch) override;
+
+ private:
+  std::string& m_buffer;
+};
+
+/// An output stream that appends to a std::string.  In contrast to
+/// std::stringstream, the caller owns the buffer, so it can be reserved in
+/// advance and used without a copy.
+class NEOPG_UNSTABLE_API BufferStream : public std::ostream {
+ public:
+  BufferStream(std::string& buffer);
+
+ private:
+  BufferStreamBuf m_buffer_stream_buf;
+};
+
 }  // namespace NeoPG
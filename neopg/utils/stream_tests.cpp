@@ -36,5 +36,14 @@ TEST(NeopgTest, utils_stream_test) {
     out.write("Test", 4);
     ASSERT_EQ(out.bytes_written(), 11);
   }
+  {
+    std::string buffer{"x"};
+    BufferStream out{buffer};
+    out.put(0x41);
+    out << (uint8_t)0x42;
+    out << "NeoPG";
+    out.write("Test", 4);
+    ASSERT_EQ(buffer, "xABNeoPGTest");
+  }
 }
 }  // namespace NeoPG
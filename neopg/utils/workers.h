@@ -0,0 +1,83 @@
+// NeoPG worker threads
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+/// \file
+/// This file contains helpers to spread independent jobs over threads.
+
+#pragma once
+
+#include <neopg/utils/common.h>
+
+#include <atomic>
+#include <cstddef>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace NeoPG {
+
+/// \return the number of threads to use for CPU bound work, at least 1
+inline size_t hardware_threads() {
+  size_t nthreads = std::thread::hardware_concurrency();
+  return nthreads ? nthreads : 1;
+}
+
+/// Start up to \p count threads running \p worker and append them to
+/// \p threads.  A thread that can't be created is not an error, as the work
+/// can be done by fewer threads.  The caller must join the threads.
+///
+/// \return the number of threads started
+template <typename Worker>
+size_t start_threads(std::vector<std::thread>& threads, size_t count,
+                     const Worker& worker) {
+  size_t started;
+
+  for (started = 0; started < count; started++) {
+    try {
+      threads.emplace_back(worker);
+    } catch (const std::system_error&) {
+      break;
+    }
+  }
+  return started;
+}
+
+/// Run \p worker on up to \p nthreads threads and wait for all of them.  The
+/// calling thread is one of the workers.  \p worker is called with the
+/// number of its thread, which is 0 for the calling thread.  If a thread
+/// can't be created, the worker runs on fewer threads, so it should take its
+/// work from a shared queue.  If the worker throws in the calling thread,
+/// the other threads are joined before the exception is passed on.
+template <typename Worker>
+void run_workers(size_t nthreads, const Worker& worker) {
+  std::vector<std::thread> threads;
+
+  for (size_t i = 1; i < nthreads; i++)
+    if (!start_threads(threads, 1, [&worker, i]() { worker(i); })) break;
+  try {
+    worker(0);
+  } catch (...) {
+    for (auto& thread : threads) thread.join();
+    throw;
+  }
+  for (auto& thread : threads) thread.join();
+}
+
+/// Call \p job with each index below \p njobs, using up to \p nthreads
+/// threads including the calling thread.  The jobs are handed out one at a
+/// time, in order.
+template <typename Job>
+void parallel_for(size_t njobs, size_t nthreads, const Job& job) {
+  std::atomic<size_t> next(0);
+
+  if (nthreads > njobs) nthreads = njobs;
+  run_workers(nthreads, [&](size_t) {
+    size_t idx;
+
+    while ((idx = next++) < njobs) job(idx);
+  });
+}
+
+}  // namespace NeoPG
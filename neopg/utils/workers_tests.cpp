@@ -0,0 +1,64 @@
+// NeoPG worker threads (tests)
+// Copyright 2018 The NeoPG developers
+//
+// NeoPG is released under the Simplified BSD License (see license.txt)
+
+#include <neopg/utils/workers.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace NeoPG;
+
+TEST(NeopgUtilsWorkers, HardwareThreads) {
+  ASSERT_GE(hardware_threads(), 1);
+}
+
+TEST(NeopgUtilsWorkers, StartThreads) {
+  std::vector<std::thread> threads;
+  std::atomic<int> calls(0);
+
+  ASSERT_EQ(start_threads(threads, 3, [&calls]() { calls++; }), 3);
+  ASSERT_EQ(threads.size(), 3);
+  for (auto& thread : threads) thread.join();
+  ASSERT_EQ(calls, 3);
+}
+
+TEST(NeopgUtilsWorkers, RunWorkers) {
+  std::vector<std::atomic<int>> calls(4);
+
+  run_workers(4, [&calls](size_t i) { calls.at(i)++; });
+  for (auto& count : calls) ASSERT_EQ(count, 1);
+
+  // A single worker runs in the calling thread.
+  const auto self = std::this_thread::get_id();
+  run_workers(1, [self](size_t i) {
+    ASSERT_EQ(i, 0);
+    ASSERT_EQ(std::this_thread::get_id(), self);
+  });
+}
+
+TEST(NeopgUtilsWorkers, RunWorkersThrow) {
+  std::atomic<int> calls(0);
+
+  // The other workers are joined before the exception is passed on.
+  ASSERT_THROW(run_workers(4,
+                           [&calls](size_t i) {
+                             calls++;
+                             if (i == 0) throw std::runtime_error("worker");
+                           }),
+               std::runtime_error);
+  ASSERT_EQ(calls, 4);
+}
+
+TEST(NeopgUtilsWorkers, ParallelFor) {
+  std::vector<std::atomic<int>> calls(100);
+
+  parallel_for(calls.size(), 8, [&calls](size_t i) { calls.at(i)++; });
+  for (auto& count : calls) ASSERT_EQ(count, 1);
+
+  parallel_for(0, 8, [](size_t) { FAIL(); });
+}